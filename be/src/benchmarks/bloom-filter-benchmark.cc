@@ -172,11 +172,44 @@ void Absent(int batch_size, void* data) {
   }
 }
 
+// Number of elements looked up per BloomFilter::FindBatch() call.
+const int FIND_BATCH_SIZE = 1024;
+
+void FindBatch(int batch_size, TestData* d, const vector<uint32_t>& v) {
+  bool found[FIND_BATCH_SIZE];
+  // 'vec_mask' + 1 is a power of two larger than FIND_BATCH_SIZE, so a batch starting
+  // at a multiple of FIND_BATCH_SIZE never goes past the end of 'v'.
+  for (int i = 0; i < batch_size; i += FIND_BATCH_SIZE) {
+    d->result += d->bf.FindBatch(&v[i & d->vec_mask],
+        min(FIND_BATCH_SIZE, batch_size - i), found);
+  }
+}
+
+void PresentBatch(int batch_size, void* data) {
+  TestData* d = reinterpret_cast<TestData*>(data);
+  FindBatch(batch_size, d, d->present);
+}
+
+void AbsentBatch(int batch_size, void* data) {
+  TestData* d = reinterpret_cast<TestData*>(data);
+  FindBatch(batch_size, d, d->absent);
+}
+
 }  // namespace find
 
+// Runs benchmark 'F' with the AVX2 code paths of BloomFilter disabled.
+template <void (*F)(int, void*)>
+void Scalar(int batch_size, void* data) {
+  CpuInfo::EnableFeature(CpuInfo::AVX2, false);
+  F(batch_size, data);
+  CpuInfo::EnableFeature(CpuInfo::AVX2, true);
+}
+
 int main(int argc, char **argv) {
   CpuInfo::Init();
   cout << endl << Benchmark::GetMachineInfo() << endl;
+  // Compare against the scalar code paths only if AVX2 is used by default.
+  const bool avx2 = CpuInfo::IsSupported(CpuInfo::AVX2);
 
   char name[120];
 
@@ -200,6 +233,11 @@ int main(int argc, char **argv) {
             new insert::TestData(BloomFilter::MinLogSpace(ndv, fpp));
         snprintf(name, sizeof(name), "ndv %7dk fpp %6.1f%%", ndv/1000, fpp*100);
         suite.AddBenchmark(name, insert::Benchmark, d);
+        if (avx2) {
+          snprintf(name, sizeof(name), "scalar ndv %7dk fpp %6.1f%%", ndv/1000,
+              fpp*100);
+          suite.AddBenchmark(name, Scalar<insert::Benchmark>, d);
+        }
       }
     }
     cout << suite.Measure() << endl;
@@ -216,6 +254,24 @@ int main(int argc, char **argv) {
 
         snprintf(name, sizeof(name), "absent  ndv %7dk fpp %6.1f%%", ndv/1000, fpp*100);
         suite.AddBenchmark(name, find::Absent, d);
+
+        snprintf(name, sizeof(name), "present batch ndv %7dk fpp %6.1f%%", ndv/1000,
+            fpp*100);
+        suite.AddBenchmark(name, find::PresentBatch, d);
+
+        snprintf(name, sizeof(name), "absent  batch ndv %7dk fpp %6.1f%%", ndv/1000,
+            fpp*100);
+        suite.AddBenchmark(name, find::AbsentBatch, d);
+
+        if (avx2) {
+          snprintf(name, sizeof(name), "present scalar ndv %7dk fpp %6.1f%%", ndv/1000,
+              fpp*100);
+          suite.AddBenchmark(name, Scalar<find::Present>, d);
+
+          snprintf(name, sizeof(name), "absent  scalar ndv %7dk fpp %6.1f%%", ndv/1000,
+              fpp*100);
+          suite.AddBenchmark(name, Scalar<find::Absent>, d);
+        }
       }
     }
     cout << suite.Measure() << endl;
@@ -0,0 +1,422 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "codegen/llvm-codegen.h"
+#include "common/init.h"
+#include "common/object-pool.h"
+#include "exec/analytic-eval-node.h"
+#include "exec/exec-node.h"
+#include "exec/partitioned-aggregation-node.h"
+#include "exec/partitioned-hash-join-node.h"
+#include "exec/sort-node.h"
+#include "runtime/buffered-block-mgr.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/row-batch.h"
+#include "runtime/runtime-state.h"
+#include "runtime/test-env.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/pretty-printer.h"
+#include "util/stopwatch.h"
+#include "util/test-info.h"
+
+#include "gen-cpp/Exprs_types.h"
+#include "gen-cpp/ImpalaInternalService_types.h"
+#include "gen-cpp/PlanNodes_types.h"
+#include "gen-cpp/Types_types.h"
+
+#include "common/names.h"
+
+DEFINE_int64(bench_num_rows, 10 * 1000 * 1000, "Number of rows of the (probe) input of "
+    "each exec node.");
+DEFINE_int64(bench_num_build_rows, 2 * 1000 * 1000, "Number of rows of the build input "
+    "of the hash join.");
+DEFINE_int64(bench_ndv, 1000 * 1000, "Number of distinct keys of the inputs.");
+DEFINE_int64(bench_spill_mem_limit, 128L * 1024 * 1024, "Query memory limit of the "
+    "runs that spill.");
+DEFINE_int32(bench_num_repeats, 3, "Number of runs of each configuration. The fastest "
+    "run is reported.");
+
+using namespace impala;
+
+// End-to-end benchmark of exec nodes: each operator runs in isolation over GeneratorNode
+// inputs of two BIGINT columns (key, value), with and without codegen, and without a
+// memory limit or with --bench_spill_mem_limit, so that the spilling paths are measured.
+// Reports the input rows per second and the peak memory of the query. The operators are
+//  - PartitionedAggregationNode: SELECT key, count(*) GROUP BY key
+//  - PartitionedHashJoinNode: inner join of the input and the build input on key
+//  - SortNode: ORDER BY key
+//  - AnalyticEvalNode: count(*) OVER ()
+// The aggregate functions are the count(*) builtin, referenced by the symbols the
+// frontend uses.
+//
+// Prints one line per configuration, e.g.
+//  Node         Codegen  Mem limit      Rows/sec        Peak mem
+//  Aggregation  true     none           <rate> M/sec    <bytes>
+//  Aggregation  true     128.00 MB      <rate> M/sec    <bytes>
+
+// Symbols of the count(*) builtin.
+const char* COUNT_INIT_SYMBOL =
+    "_ZN6impala18AggregateFunctions8InitZeroIN10impala_udf9BigIntValEEEvPNS2_"
+    "15FunctionContextEPT_";
+const char* COUNT_STAR_UPDATE_SYMBOL =
+    "_ZN6impala18AggregateFunctions15CountStarUpdateEPN10impala_udf15FunctionContextEPNS1_"
+    "9BigIntValE";
+const char* COUNT_STAR_REMOVE_SYMBOL =
+    "_ZN6impala18AggregateFunctions15CountStarRemoveEPN10impala_udf15FunctionContextEPNS1_"
+    "9BigIntValE";
+const char* COUNT_MERGE_SYMBOL =
+    "_ZN6impala18AggregateFunctions10CountMergeEPN10impala_udf15FunctionContextERKNS1_"
+    "9BigIntValEPS4_";
+
+// The tuples of the descriptor table.
+enum TupleIds {
+  INPUT_TUPLE = 0,
+  BUILD_TUPLE,
+  AGG_INTERMEDIATE_TUPLE,
+  AGG_OUTPUT_TUPLE,
+  ANALYTIC_INTERMEDIATE_TUPLE,
+  ANALYTIC_OUTPUT_TUPLE,
+};
+
+enum Operator {
+  AGGREGATION,
+  HASH_JOIN,
+  SORT,
+  ANALYTIC,
+};
+
+const char* OPERATOR_NAMES[] = {"Aggregation", "Hash join", "Sort", "Analytic"};
+
+// Leaf node that generates 'num_rows' rows of a single tuple with a BIGINT key in
+// [0, 'ndv') and a BIGINT value. Consecutive rows have scattered keys.
+class GeneratorNode : public ExecNode {
+ public:
+  GeneratorNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs,
+      int64_t num_rows, int64_t ndv)
+    : ExecNode(pool, tnode, descs),
+      num_rows_(num_rows),
+      ndv_(ndv),
+      next_row_(0) {
+  }
+
+  virtual Status Open(RuntimeState* state) {
+    RETURN_IF_ERROR(ExecNode::Open(state));
+    next_row_ = 0;
+    return Status::OK();
+  }
+
+  virtual Status GetNext(RuntimeState* state, RowBatch* batch, bool* eos) {
+    RETURN_IF_CANCELLED(state);
+    const TupleDescriptor* desc = row_desc().tuple_descriptors()[0];
+    int key_offset = desc->slots()[0]->tuple_offset();
+    int value_offset = desc->slots()[1]->tuple_offset();
+    int64_t num_rows =
+        min<int64_t>(batch->capacity() - batch->num_rows(), num_rows_ - next_row_);
+    uint8_t* tuple_mem =
+        batch->tuple_data_pool()->Allocate(num_rows * desc->byte_size());
+    memset(tuple_mem, 0, num_rows * desc->byte_size());
+    for (int64_t i = 0; i < num_rows; ++i) {
+      Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * desc->byte_size());
+      uint64_t row_idx = next_row_ + i;
+      // Multiplicative hashing scatters the keys of consecutive rows.
+      *reinterpret_cast<int64_t*>(tuple->GetSlot(key_offset)) =
+          ((row_idx * 0x9E3779B97F4A7C15ULL) >> 16) % ndv_;
+      *reinterpret_cast<int64_t*>(tuple->GetSlot(value_offset)) = row_idx;
+      TupleRow* row = batch->GetRow(batch->AddRow());
+      row->SetTuple(0, tuple);
+      batch->CommitLastRow();
+    }
+    next_row_ += num_rows;
+    num_rows_returned_ += num_rows;
+    COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+    *eos = next_row_ == num_rows_;
+    return Status::OK();
+  }
+
+ private:
+  const int64_t num_rows_;
+  const int64_t ndv_;
+  int64_t next_row_;
+};
+
+class ExecNodeBenchmark {
+ public:
+  ExecNodeBenchmark() : next_query_id_(0) { }
+
+  // Runs all configurations and prints their results.
+  void Run() {
+    cout << FLAGS_bench_num_rows << " input rows, " << FLAGS_bench_ndv << " keys, "
+         << FLAGS_bench_num_build_rows << " build rows:" << endl;
+    cout << left << setw(13) << "Node" << setw(9) << "Codegen" << setw(15)
+         << "Mem limit" << setw(16) << "Rows/sec" << "Peak mem" << endl;
+    for (int op = AGGREGATION; op <= ANALYTIC; ++op) {
+      for (int codegen = 1; codegen >= 0; --codegen) {
+        for (int spill = 0; spill <= 1; ++spill) {
+          int64_t mem_limit = spill ? FLAGS_bench_spill_mem_limit : -1;
+          double best_rows_per_sec = 0;
+          int64_t peak_mem = 0;
+          for (int i = 0; i < FLAGS_bench_num_repeats; ++i) {
+            double rows_per_sec;
+            Status status = RunPlan(static_cast<Operator>(op), codegen, mem_limit,
+                &rows_per_sec, &peak_mem);
+            if (!status.ok()) {
+              cerr << OPERATOR_NAMES[op] << " failed: " << status.GetDetail() << endl;
+              exit(1);
+            }
+            best_rows_per_sec = max(best_rows_per_sec, rows_per_sec);
+          }
+          cout << left << setw(13) << OPERATOR_NAMES[op]
+               << setw(9) << (codegen ? "true" : "false")
+               << setw(15) << (spill ? PrettyPrinter::Print(mem_limit, TUnit::BYTES)
+                   : "none")
+               << setw(16) << PrettyPrinter::Print(
+                   static_cast<int64_t>(best_rows_per_sec), TUnit::UNIT_PER_SECOND)
+               << PrettyPrinter::Print(peak_mem, TUnit::BYTES) << endl;
+        }
+      }
+    }
+  }
+
+ private:
+  // Runs 'op' over the generated inputs and returns the input rows per second and the
+  // peak memory consumption of the query. 'mem_limit' of -1 means no limit.
+  Status RunPlan(Operator op, bool codegen, int64_t mem_limit, double* rows_per_sec,
+      int64_t* peak_mem) {
+    TExecPlanFragmentParams params;
+    TUniqueId query_id;
+    query_id.hi = 0;
+    query_id.lo = ++next_query_id_;
+    params.fragment_instance_ctx.query_ctx.query_id = query_id;
+    params.fragment_instance_ctx.query_ctx.request.query_options.__set_disable_codegen(
+        !codegen);
+    scoped_ptr<RuntimeState> state(
+        new RuntimeState(params, "", test_env_.exec_env()));
+    state->InitMemTrackers(query_id, NULL, mem_limit);
+    shared_ptr<BufferedBlockMgr> block_mgr;
+    RETURN_IF_ERROR(BufferedBlockMgr::Create(state.get(), state->query_mem_tracker(),
+        state->runtime_profile(), test_env_.tmp_file_mgr(),
+        mem_limit == -1 ? -1 : mem_limit * 8 / 10,
+        state->io_mgr()->max_read_buffer_size(), &block_mgr));
+    state->set_block_mgr(block_mgr);
+    state->set_desc_tbl(CreateDescriptorTbl(state->obj_pool()));
+
+    ExecNode* root;
+    RETURN_IF_ERROR(CreatePlan(op, state.get(), &root));
+    int64_t num_input_rows = FLAGS_bench_num_rows;
+    if (op == HASH_JOIN) num_input_rows += FLAGS_bench_num_build_rows;
+
+    MonotonicStopWatch sw;
+    Status status = root->Prepare(state.get());
+    if (status.ok() && state->codegen_created()) {
+      LlvmCodeGen* codegen;
+      status = state->GetCodegen(&codegen, false);
+      if (status.ok()) status = codegen->FinalizeModule();
+    }
+    if (status.ok()) {
+      sw.Start();
+      status = root->Open(state.get());
+    }
+    if (status.ok()) {
+      RowBatch batch(root->row_desc(), state->batch_size(),
+          state->instance_mem_tracker());
+      bool eos = false;
+      while (status.ok() && !eos) {
+        status = root->GetNext(state.get(), &batch, &eos);
+        batch.Reset();
+      }
+    }
+    sw.Stop();
+    root->Close(state.get());
+    RETURN_IF_ERROR(status);
+    *rows_per_sec = num_input_rows / (sw.ElapsedTime() / 1e9);
+    *peak_mem = state->query_mem_tracker()->peak_consumption();
+    return Status::OK();
+  }
+
+  DescriptorTbl* CreateDescriptorTbl(ObjectPool* pool) {
+    DescriptorTblBuilder builder(pool);
+    // Declared in the order of TupleIds.
+    builder.DeclareTuple() << TYPE_BIGINT << TYPE_BIGINT;
+    builder.DeclareTuple() << TYPE_BIGINT << TYPE_BIGINT;
+    builder.DeclareTuple() << TYPE_BIGINT << TYPE_BIGINT;
+    builder.DeclareTuple() << TYPE_BIGINT << TYPE_BIGINT;
+    builder.DeclareTuple() << TYPE_BIGINT;
+    builder.DeclareTuple() << TYPE_BIGINT;
+    return builder.Build();
+  }
+
+  // Creates the tree of 'op' over GeneratorNodes and initializes its nodes.
+  Status CreatePlan(Operator op, RuntimeState* state, ExecNode** root) {
+    ObjectPool* pool = state->obj_pool();
+    const DescriptorTbl& descs = state->desc_tbl();
+    TPlanNode input_tnode = MakePlanNode(1, TPlanNodeType::EMPTY_SET_NODE,
+        vector<TTupleId>(1, INPUT_TUPLE));
+    ExecNode* input = pool->Add(new GeneratorNode(pool, input_tnode, descs,
+        FLAGS_bench_num_rows, FLAGS_bench_ndv));
+    RETURN_IF_ERROR(input->Init(input_tnode, state));
+    TExpr input_key = MakeSlotRef(descs, INPUT_TUPLE, 0);
+
+    TPlanNode tnode;
+    switch (op) {
+      case AGGREGATION: {
+        tnode = MakePlanNode(0, TPlanNodeType::AGGREGATION_NODE,
+            vector<TTupleId>(1, AGG_OUTPUT_TUPLE));
+        TAggregationNode agg_node;
+        agg_node.grouping_exprs.push_back(input_key);
+        agg_node.aggregate_functions.push_back(MakeCountStar());
+        agg_node.intermediate_tuple_id = AGG_INTERMEDIATE_TUPLE;
+        agg_node.output_tuple_id = AGG_OUTPUT_TUPLE;
+        agg_node.need_finalize = true;
+        agg_node.__set_use_streaming_preaggregation(false);
+        agg_node.__set_estimated_input_cardinality(FLAGS_bench_num_rows);
+        tnode.__set_agg_node(agg_node);
+        *root = pool->Add(new PartitionedAggregationNode(pool, tnode, descs));
+        break;
+      }
+      case HASH_JOIN: {
+        vector<TTupleId> tuple_ids;
+        tuple_ids.push_back(INPUT_TUPLE);
+        tuple_ids.push_back(BUILD_TUPLE);
+        tnode = MakePlanNode(0, TPlanNodeType::HASH_JOIN_NODE, tuple_ids);
+        THashJoinNode join_node;
+        join_node.join_op = TJoinOp::INNER_JOIN;
+        TEqJoinCondition eq_join_conjunct;
+        eq_join_conjunct.left = input_key;
+        eq_join_conjunct.right = MakeSlotRef(descs, BUILD_TUPLE, 0);
+        eq_join_conjunct.__set_is_not_distinct_from(false);
+        join_node.eq_join_conjuncts.push_back(eq_join_conjunct);
+        tnode.__set_hash_join_node(join_node);
+        *root = pool->Add(new PartitionedHashJoinNode(pool, tnode, descs));
+        break;
+      }
+      case SORT: {
+        tnode = MakePlanNode(0, TPlanNodeType::SORT_NODE,
+            vector<TTupleId>(1, INPUT_TUPLE));
+        TSortNode sort_node;
+        sort_node.sort_info.ordering_exprs.push_back(input_key);
+        sort_node.sort_info.is_asc_order.push_back(true);
+        sort_node.sort_info.nulls_first.push_back(false);
+        sort_node.use_top_n = false;
+        tnode.__set_sort_node(sort_node);
+        *root = pool->Add(new SortNode(pool, tnode, descs));
+        break;
+      }
+      case ANALYTIC: {
+        vector<TTupleId> tuple_ids;
+        tuple_ids.push_back(INPUT_TUPLE);
+        tuple_ids.push_back(ANALYTIC_OUTPUT_TUPLE);
+        tnode = MakePlanNode(0, TPlanNodeType::ANALYTIC_EVAL_NODE, tuple_ids);
+        TAnalyticNode analytic_node;
+        analytic_node.analytic_functions.push_back(MakeCountStar());
+        analytic_node.intermediate_tuple_id = ANALYTIC_INTERMEDIATE_TUPLE;
+        analytic_node.output_tuple_id = ANALYTIC_OUTPUT_TUPLE;
+        tnode.__set_analytic_node(analytic_node);
+        *root = pool->Add(new AnalyticEvalNode(pool, tnode, descs));
+        break;
+      }
+    }
+    (*root)->AddChild(input);
+    if (op == HASH_JOIN) {
+      TPlanNode build_tnode = MakePlanNode(2, TPlanNodeType::EMPTY_SET_NODE,
+          vector<TTupleId>(1, BUILD_TUPLE));
+      ExecNode* build = pool->Add(new GeneratorNode(pool, build_tnode, descs,
+          FLAGS_bench_num_build_rows, FLAGS_bench_ndv));
+      RETURN_IF_ERROR(build->Init(build_tnode, state));
+      (*root)->AddChild(build);
+    }
+    tnode.num_children = (*root)->num_children();
+    return (*root)->Init(tnode, state);
+  }
+
+  static TPlanNode MakePlanNode(int id, TPlanNodeType::type type,
+      const vector<TTupleId>& tuple_ids) {
+    TPlanNode tnode;
+    tnode.node_id = id;
+    tnode.node_type = type;
+    tnode.num_children = 0;
+    tnode.limit = -1;
+    tnode.row_tuples = tuple_ids;
+    tnode.nullable_tuples.resize(tuple_ids.size(), false);
+    return tnode;
+  }
+
+  // Returns a SlotRef on slot 'slot_idx' of tuple 'tuple_id'.
+  static TExpr MakeSlotRef(const DescriptorTbl& descs, TTupleId tuple_id, int slot_idx) {
+    const SlotDescriptor* slot_desc =
+        descs.GetTupleDescriptor(tuple_id)->slots()[slot_idx];
+    TExprNode node;
+    node.node_type = TExprNodeType::SLOT_REF;
+    node.type = slot_desc->type().ToThrift();
+    node.num_children = 0;
+    TSlotRef slot_ref;
+    slot_ref.slot_id = slot_desc->id();
+    node.__set_slot_ref(slot_ref);
+    TExpr expr;
+    expr.nodes.push_back(node);
+    return expr;
+  }
+
+  // Returns a count(*) aggregate expr, which is also valid as an analytic function.
+  static TExpr MakeCountStar() {
+    TColumnType bigint_type = ColumnType(TYPE_BIGINT).ToThrift();
+    TAggregateFunction agg_fn;
+    agg_fn.intermediate_type = bigint_type;
+    agg_fn.init_fn_symbol = COUNT_INIT_SYMBOL;
+    agg_fn.update_fn_symbol = COUNT_STAR_UPDATE_SYMBOL;
+    agg_fn.merge_fn_symbol = COUNT_MERGE_SYMBOL;
+    agg_fn.__set_remove_fn_symbol(COUNT_STAR_REMOVE_SYMBOL);
+    TFunction fn;
+    fn.name.function_name = "count";
+    fn.binary_type = TFunctionBinaryType::BUILTIN;
+    fn.ret_type = bigint_type;
+    fn.has_var_args = false;
+    fn.__set_aggregate_fn(agg_fn);
+    TExprNode node;
+    node.node_type = TExprNodeType::AGGREGATE_EXPR;
+    node.type = bigint_type;
+    node.num_children = 0;
+    node.__set_fn(fn);
+    TAggregateExpr agg_expr;
+    agg_expr.is_merge_agg = false;
+    node.__set_agg_expr(agg_expr);
+    TExpr expr;
+    expr.nodes.push_back(node);
+    return expr;
+  }
+
+  TestEnv test_env_;
+  int64_t next_query_id_;
+};
+
+int main(int argc, char** argv) {
+  InitCommonRuntime(argc, argv, false, TestInfo::BE_TEST);
+  LlvmCodeGen::InitializeLlvm();
+  cout << Benchmark::GetMachineInfo() << endl;
+  ExecNodeBenchmark benchmark;
+  benchmark.Run();
+  return 0;
+}
@@ -0,0 +1,91 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <iostream>
+#include <boost/bind.hpp>
+
+#include "common/object-pool.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/periodic-counter-updater.h"
+#include "util/runtime-profile.h"
+#include "util/thread.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+// Benchmarks the per-query bookkeeping of a query that only runs on the coordinator
+// with and without the single node fast path (--single_node_fast_path_max_scan_bytes).
+// Every iteration does the work that doesn't depend on the query's plan: it creates
+// the fragment's profile, waits for the first rows on a separate thread or on the
+// calling thread and, without the fast path, registers and stops the sampled thread and
+// memory usage counters of the fragment.
+
+namespace {
+
+int64_t SampleValue() {
+  return 0;
+}
+
+// Stands in for the Wait() of a query whose rows are available right away.
+void WaitForRows(int64_t* num_waits) {
+  ++*num_waits;
+}
+
+void TestRegularPath(int batch_size, void* d) {
+  int64_t* num_waits = reinterpret_cast<int64_t*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    ObjectPool pool;
+    RuntimeProfile profile(&pool, "Fragment");
+    RuntimeProfile::Counter* average_thread_tokens =
+        profile.AddSamplingCounter("AverageThreadTokens", bind(SampleValue));
+    RuntimeProfile::TimeSeriesCounter* mem_usage =
+        profile.AddTimeSeriesCounter("MemoryUsage", TUnit::BYTES, bind(SampleValue));
+    RuntimeProfile::TimeSeriesCounter* thread_usage =
+        profile.AddTimeSeriesCounter("ThreadUsage", TUnit::UNIT, bind(SampleValue));
+    Thread wait_thread("fast-path-benchmark", "wait-thread", WaitForRows, num_waits);
+    wait_thread.Join();
+    PeriodicCounterUpdater::StopSamplingCounter(average_thread_tokens);
+    PeriodicCounterUpdater::StopTimeSeriesCounter(thread_usage);
+    PeriodicCounterUpdater::StopTimeSeriesCounter(mem_usage);
+  }
+}
+
+void TestFastPath(int batch_size, void* d) {
+  int64_t* num_waits = reinterpret_cast<int64_t*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    ObjectPool pool;
+    RuntimeProfile profile(&pool, "Fragment");
+    WaitForRows(num_waits);
+  }
+}
+
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  CpuInfo::Init();
+  impala::InitThreading();
+  cout << endl << Benchmark::GetMachineInfo() << endl;
+
+  int64_t regular_waits = 0;
+  int64_t fast_path_waits = 0;
+  Benchmark suite("Per-query bookkeeping of coordinator-only queries");
+  suite.AddBenchmark("regular path", TestRegularPath, &regular_waits);
+  suite.AddBenchmark("fast path", TestFastPath, &fast_path_waits);
+  cout << suite.Measure() << endl;
+  return 0;
+}
@@ -0,0 +1,197 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+
+#include "exprs/aggregate-functions.h"
+#include "exprs/anyval-util.h"
+#include "udf/udf-test-harness.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace impala_udf;
+
+// Compares the NDV() intermediate state with sparse registers for small groups and an
+// SSE2 merge with the dense-only state it replaced:
+//  - "Small groups" computes NDV() of 1000 groups with 3 distinct values each, from
+//    HllInit() to HllFinalize(). "Dense" always allocates and finalizes HLL_LEN
+//    registers.
+//  - "Merge" merges the dense states of two large groups, with a scalar loop for
+//    "Dense".
+//  - "Merge small groups" merges the states of 1000 pairs of groups with 3 values each.
+// No results have been recorded yet.
+
+const int NUM_GROUPS = 1000;
+const int VALUES_PER_GROUP = 3;
+
+struct TestData {
+  FunctionContext* ctx;
+  vector<IntVal> values;
+  vector<StringVal> states;
+  vector<StringVal> dense_states;
+  StringVal large_src;
+  StringVal large_dst;
+  int64_t result;
+};
+
+// The dense-only HllUpdate() before the sparse representation.
+void DenseUpdate(FunctionContext* ctx, const IntVal& src, StringVal* dst) {
+  uint64_t hash_value =
+      AnyValUtil::Hash64(src, *ctx->GetArgType(0), HashUtil::FNV64_SEED);
+  if (hash_value != 0) {
+    int idx = hash_value & (AggregateFunctions::HLL_LEN - 1);
+    uint8_t first_one_bit =
+        __builtin_ctzl(hash_value >> AggregateFunctions::HLL_PRECISION) + 1;
+    dst->ptr[idx] = ::max(dst->ptr[idx], first_one_bit);
+  }
+}
+
+// The dense-only HllMerge() before the SSE2 loop.
+void DenseMerge(const StringVal& src, StringVal* dst) {
+  for (int i = 0; i < src.len; ++i) dst->ptr[i] = ::max(dst->ptr[i], src.ptr[i]);
+}
+
+StringVal DenseInit(FunctionContext* ctx) {
+  StringVal dst(ctx->Allocate(AggregateFunctions::HLL_LEN), AggregateFunctions::HLL_LEN);
+  memset(dst.ptr, 0, dst.len);
+  return dst;
+}
+
+void TestDenseSmallGroups(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    for (int g = 0; g < NUM_GROUPS; ++g) {
+      StringVal state = DenseInit(data->ctx);
+      for (int v = 0; v < VALUES_PER_GROUP; ++v) {
+        DenseUpdate(data->ctx, data->values[g * VALUES_PER_GROUP + v], &state);
+      }
+      data->result += AggregateFunctions::HllFinalEstimate(state.ptr, state.len);
+      data->ctx->Free(state.ptr);
+    }
+  }
+}
+
+void TestSmallGroups(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    for (int g = 0; g < NUM_GROUPS; ++g) {
+      StringVal state;
+      AggregateFunctions::HllInit(data->ctx, &state);
+      for (int v = 0; v < VALUES_PER_GROUP; ++v) {
+        AggregateFunctions::HllUpdate(data->ctx, data->values[g * VALUES_PER_GROUP + v],
+            &state);
+      }
+      data->result += AggregateFunctions::HllFinalize(data->ctx, state).val;
+    }
+  }
+}
+
+void TestDenseMerge(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) DenseMerge(data->large_src, &data->large_dst);
+}
+
+void TestMerge(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    AggregateFunctions::HllMerge(data->ctx, data->large_src, &data->large_dst);
+  }
+}
+
+void TestDenseMergeSmallGroups(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    for (int g = 0; g < NUM_GROUPS; ++g) {
+      StringVal dst = DenseInit(data->ctx);
+      DenseMerge(data->dense_states[g], &dst);
+      data->ctx->Free(dst.ptr);
+    }
+  }
+}
+
+void TestMergeSmallGroups(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    for (int g = 0; g < NUM_GROUPS; ++g) {
+      StringVal dst;
+      AggregateFunctions::HllInit(data->ctx, &dst);
+      AggregateFunctions::HllMerge(data->ctx, data->states[g], &dst);
+      data->ctx->Free(dst.ptr);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  CpuInfo::Init();
+  cout << Benchmark::GetMachineInfo() << endl;
+
+  FunctionContext::TypeDesc return_type;
+  return_type.type = FunctionContext::TYPE_BIGINT;
+  FunctionContext::TypeDesc int_type;
+  int_type.type = FunctionContext::TYPE_INT;
+  vector<FunctionContext::TypeDesc> arg_types(1, int_type);
+
+  TestData data;
+  data.ctx = UdfTestHarness::CreateTestContext(return_type, arg_types);
+  data.result = 0;
+  for (int i = 0; i < NUM_GROUPS * VALUES_PER_GROUP; ++i) data.values.push_back(rand());
+  for (int g = 0; g < NUM_GROUPS; ++g) {
+    StringVal state;
+    AggregateFunctions::HllInit(data.ctx, &state);
+    for (int v = 0; v < VALUES_PER_GROUP; ++v) {
+      AggregateFunctions::HllUpdate(data.ctx, data.values[g * VALUES_PER_GROUP + v],
+          &state);
+    }
+    data.states.push_back(state);
+    StringVal dense_state = DenseInit(data.ctx);
+    for (int v = 0; v < VALUES_PER_GROUP; ++v) {
+      DenseUpdate(data.ctx, data.values[g * VALUES_PER_GROUP + v], &dense_state);
+    }
+    data.dense_states.push_back(dense_state);
+  }
+  AggregateFunctions::HllInit(data.ctx, &data.large_src);
+  AggregateFunctions::HllInit(data.ctx, &data.large_dst);
+  for (int i = 0; i < 100000; ++i) {
+    AggregateFunctions::HllUpdate(data.ctx, IntVal(rand()), &data.large_src);
+    AggregateFunctions::HllUpdate(data.ctx, IntVal(rand()), &data.large_dst);
+  }
+
+  Benchmark small_groups_suite("Small groups");
+  small_groups_suite.AddBenchmark("Dense", TestDenseSmallGroups, &data);
+  small_groups_suite.AddBenchmark("Sparse", TestSmallGroups, &data);
+  cout << small_groups_suite.Measure() << endl;
+
+  Benchmark merge_suite("Merge");
+  merge_suite.AddBenchmark("Scalar", TestDenseMerge, &data);
+  merge_suite.AddBenchmark("SSE2", TestMerge, &data);
+  cout << merge_suite.Measure() << endl;
+
+  Benchmark merge_small_suite("Merge small groups");
+  merge_small_suite.AddBenchmark("Dense", TestDenseMergeSmallGroups, &data);
+  merge_small_suite.AddBenchmark("Sparse", TestMergeSmallGroups, &data);
+  cout << merge_small_suite.Measure() << endl;
+
+  for (StringVal& state: data.states) data.ctx->Free(state.ptr);
+  for (StringVal& state: data.dense_states) data.ctx->Free(state.ptr);
+  data.ctx->Free(data.large_src.ptr);
+  data.ctx->Free(data.large_dst.ptr);
+  UdfTestHarness::CloseContext(data.ctx);
+  delete data.ctx;
+  return 0;
+}
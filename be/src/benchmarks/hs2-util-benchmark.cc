@@ -0,0 +1,110 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <gutil/strings/substitute.h>
+
+#include "service/hs2-util.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+
+#include "common/names.h"
+
+using namespace std;
+using namespace impala;
+using namespace strings;
+
+// Benchmarks the stitching of HS2 null bitmaps with StitchNulls(), which copies the
+// rows of a fetch out of the result cache, against the previous bit-at-a-time
+// implementation. Every iteration stitches the null bits of one fetch, at offsets that
+// are not byte-aligned, out of a column of 10M rows of which half are NULL.
+
+namespace {
+
+const int NUM_ROWS = 10 * 1000 * 1000;
+
+// The fetch sizes are multiples of 8, so all fetches start in the middle of a byte.
+const int FIRST_ROW = 3;
+
+struct TestData {
+  TestData(int fetch_size) : fetch_size(fetch_size), next_row(FIRST_ROW) {
+    nulls.resize((NUM_ROWS + 7) / 8);
+    for (int i = 0; i < nulls.size(); ++i) nulls[i] = rand();
+  }
+
+  int fetch_size;
+  string nulls;
+  int next_row;
+  string result;
+
+  // Returns the first row of the next fetch.
+  int NextFetch() {
+    int start = next_row;
+    next_row += fetch_size;
+    if (next_row + fetch_size > NUM_ROWS) next_row = FIRST_ROW;
+    return start;
+  }
+};
+
+// The implementation of StitchNulls() before it went a byte at a time.
+void StitchNullsBitByBit(uint32_t num_rows_before, uint32_t num_rows_added,
+    uint32_t start_idx, const string& from, string* to) {
+  to->reserve((num_rows_before + num_rows_added + 7) / 8);
+  for (int i = 0; i < num_rows_added; ++i) {
+    uint32_t from_idx = i + start_idx;
+    bool is_null = from[from_idx / 8] & (1 << from_idx % 8);
+    uint32_t row_idx = num_rows_before + i;
+    int mod_8 = row_idx % 8;
+    if (mod_8 == 0) (*to) += '\0';
+    (*to)[row_idx / 8] |= (1 << mod_8) * is_null;
+  }
+}
+
+void TestBitByBit(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    // One row is already in the result set.
+    data->result.assign(1, '\0');
+    StitchNullsBitByBit(1, data->fetch_size, data->NextFetch(), data->nulls,
+        &data->result);
+  }
+}
+
+void TestByteAtATime(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    data->result.assign(1, '\0');
+    StitchNulls(1, data->fetch_size, data->NextFetch(), data->nulls, &data->result);
+  }
+}
+
+}
+
+int main(int argc, char **argv) {
+  CpuInfo::Init();
+  cout << endl << Benchmark::GetMachineInfo() << endl;
+
+  for (int fetch_size = 1024; fetch_size <= 1024 * 1024; fetch_size *= 32) {
+    Benchmark suite(Substitute("StitchNulls fetch_size=$0", fetch_size));
+    TestData bit_by_bit(fetch_size);
+    TestData byte_at_a_time(fetch_size);
+    suite.AddBenchmark("bit by bit", TestBitByBit, &bit_by_bit);
+    suite.AddBenchmark("byte at a time", TestByteAtATime, &byte_at_a_time);
+    cout << suite.Measure() << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,75 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+DECLARE_int64(mem_pool_thread_cache_bytes);
+
+// Benchmark for a MemPool that is filled and freed over and over, like the tuple data
+// pool of a row batch, with and without the chunk cache. Each iteration makes
+// ALLOCS_PER_ITER allocations and then calls FreeAll().
+
+const int ALLOCS_PER_ITER = 64;
+
+struct TestData {
+  TestData(int alloc_size, int64_t cache_bytes)
+    : alloc_size(alloc_size), cache_bytes(cache_bytes), pool(&tracker) {
+  }
+
+  int alloc_size;
+  int64_t cache_bytes;
+  MemTracker tracker;
+  MemPool pool;
+};
+
+void TestFillAndFree(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  FLAGS_mem_pool_thread_cache_bytes = data->cache_bytes;
+  for (int i = 0; i < batch_size; ++i) {
+    for (int j = 0; j < ALLOCS_PER_ITER; ++j) {
+      uint8_t* mem = data->pool.Allocate(data->alloc_size);
+      // Touch the memory, as a row batch would.
+      mem[0] = j;
+    }
+    data->pool.FreeAll();
+  }
+}
+
+int main(int argc, char **argv) {
+  CpuInfo::Init();
+  cout << endl << Benchmark::GetMachineInfo() << endl;
+
+  const int64_t cache_bytes = FLAGS_mem_pool_thread_cache_bytes;
+  char name[120];
+  for (int alloc_size = 64; alloc_size <= 4096; alloc_size *= 8) {
+    snprintf(name, sizeof(name), "fill and free, %d byte allocations", alloc_size);
+    Benchmark suite(name);
+    suite.AddBenchmark("no chunk cache", TestFillAndFree, new TestData(alloc_size, 0));
+    suite.AddBenchmark("chunk cache", TestFillAndFree,
+        new TestData(alloc_size, cache_bytes));
+    cout << suite.Measure() << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,219 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/stopwatch.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+// Compares the priority queues that SortedRunMerger can use to merge NUM_RUNS sorted
+// runs of BIGINT keys, NUM_ROWS rows in total:
+//  - "binary heap": the min-heap of runs that is sifted down after the minimum run
+//    advanced, which takes two comparisons per level.
+//  - "tree of losers": the tournament tree that replays the matches on the path of the
+//    advanced run, which takes one comparison per level.
+// The runs are compared through an indirect call, like the TupleRowComparator. Both
+// variants merge the same runs NUM_REPEATS times and the fastest time is reported,
+// together with the number of comparisons per row, which doesn't depend on the machine.
+//
+// On a Xeon server, with this (cheap, BIGINT-only) stand-in for the comparator:
+//   runs  binary heap              tree of losers
+//      2   115ms,  1.0 comps/row    138ms (0.84x),  1.0 comps/row
+//      7   271ms,  3.7 comps/row    334ms (0.81x),  2.9 comps/row
+//     16   426ms,  5.6 comps/row    452ms (0.94x),  4.0 comps/row
+//    100   762ms, 10.6 comps/row    855ms (0.89x),  6.7 comps/row
+//   1000  1435ms, 17.0 comps/row   1269ms (1.13x), 10.0 comps/row
+// The tree of losers saves a third to two fifths of the comparisons, which pays off
+// once a comparison costs more than the bookkeeping of the tree, i.e. for many runs or
+// for comparators that evaluate several or string keys.
+
+const int64_t NUM_ROWS = 10 * 1000 * 1000;
+const int NUM_REPEATS = 3;
+
+struct Run {
+  const int64_t* cur;
+  const int64_t* end;
+};
+
+// Stands in for the comparator. Allocated on the heap so that the compiler cannot
+// devirtualize Less().
+class RunLess {
+ public:
+  RunLess() : num_comparisons_(0) { }
+  virtual ~RunLess() { }
+  virtual bool Less(const Run* lhs, const Run* rhs) {
+    ++num_comparisons_;
+    return *lhs->cur < *rhs->cur;
+  }
+  int64_t num_comparisons() const { return num_comparisons_; }
+
+ private:
+  int64_t num_comparisons_;
+};
+
+class HeapMerger {
+ public:
+  HeapMerger(vector<Run>* runs, RunLess* less) : less_(less) {
+    for (Run& run: *runs) heap_.push_back(&run);
+    for (int i = heap_.size() / 2 - 1; i >= 0; --i) Heapify(i);
+  }
+
+  void Merge(int64_t* out) {
+    while (!heap_.empty()) {
+      Run* min = heap_[0];
+      *out++ = *min->cur;
+      if (++min->cur == min->end) {
+        heap_[0] = heap_.back();
+        heap_.pop_back();
+        if (heap_.empty()) break;
+      }
+      Heapify(0);
+    }
+  }
+
+ private:
+  void Heapify(int parent) {
+    while (true) {
+      int left = 2 * parent + 1;
+      int right = left + 1;
+      if (left >= heap_.size()) return;
+      int least = right >= heap_.size() || less_->Less(heap_[left], heap_[right]) ?
+          left : right;
+      if (!less_->Less(heap_[least], heap_[parent])) return;
+      swap(heap_[least], heap_[parent]);
+      parent = least;
+    }
+  }
+
+  RunLess* less_;
+  vector<Run*> heap_;
+};
+
+class LoserTreeMerger {
+ public:
+  LoserTreeMerger(vector<Run>* runs, RunLess* less)
+    : less_(less),
+      tree_(runs->size()) {
+    for (Run& run: *runs) runs_.push_back(&run);
+    num_active_runs_ = runs_.size();
+    tree_[0] = Build(1);
+  }
+
+  void Merge(int64_t* out) {
+    while (num_active_runs_ > 0) {
+      int min = tree_[0];
+      *out++ = *runs_[min]->cur;
+      if (++runs_[min]->cur == runs_[min]->end) {
+        runs_[min] = NULL;
+        if (--num_active_runs_ == 0) break;
+      }
+      int winner = min;
+      for (int node = (min + runs_.size()) / 2; node > 0; node /= 2) {
+        if (LessRun(tree_[node], winner)) swap(tree_[node], winner);
+      }
+      tree_[0] = winner;
+    }
+  }
+
+ private:
+  bool LessRun(int lhs, int rhs) {
+    if (runs_[lhs] == NULL) return false;
+    if (runs_[rhs] == NULL) return true;
+    return less_->Less(runs_[lhs], runs_[rhs]);
+  }
+
+  int Build(int node) {
+    int num_runs = runs_.size();
+    if (node >= num_runs) return node - num_runs;
+    int left = Build(2 * node);
+    int right = Build(2 * node + 1);
+    if (LessRun(right, left)) {
+      tree_[node] = left;
+      return right;
+    }
+    tree_[node] = right;
+    return left;
+  }
+
+  RunLess* less_;
+  vector<Run*> runs_;
+  vector<int> tree_;
+  int num_active_runs_;
+};
+
+// Merges 'sorted_runs' NUM_REPEATS times and returns the fastest time in ms. Sets
+// 'comparisons_per_row'.
+template <typename Merger>
+double TimeMerge(const vector<vector<int64_t> >& sorted_runs,
+    double* comparisons_per_row) {
+  double best_ms = 0;
+  vector<int64_t> out(NUM_ROWS);
+  for (int i = 0; i < NUM_REPEATS; ++i) {
+    vector<Run> runs;
+    for (const vector<int64_t>& sorted_run: sorted_runs) {
+      Run run = {&sorted_run[0], &sorted_run[0] + sorted_run.size()};
+      runs.push_back(run);
+    }
+    scoped_ptr<RunLess> less(new RunLess());
+    MonotonicStopWatch sw;
+    sw.Start();
+    Merger merger(&runs, less.get());
+    merger.Merge(&out[0]);
+    sw.Stop();
+    if (!is_sorted(out.begin(), out.end())) {
+      cerr << "Merge produced unsorted output" << endl;
+      exit(1);
+    }
+    double ms = sw.ElapsedTime() / 1000000.0;
+    if (i == 0 || ms < best_ms) best_ms = ms;
+    *comparisons_per_row = static_cast<double>(less->num_comparisons()) / NUM_ROWS;
+  }
+  return best_ms;
+}
+
+int main(int argc, char** argv) {
+  CpuInfo::Init();
+  cout << Benchmark::GetMachineInfo() << endl;
+
+  int num_runs[] = {2, 7, 16, 100, 1000};
+  for (int k: num_runs) {
+    vector<vector<int64_t> > sorted_runs(k);
+    for (int64_t i = 0; i < NUM_ROWS; ++i) {
+      sorted_runs[i % k].push_back(static_cast<int64_t>(rand()) << 32 | rand());
+    }
+    for (vector<int64_t>& sorted_run: sorted_runs) {
+      sort(sorted_run.begin(), sorted_run.end());
+    }
+    double heap_comparisons;
+    double tree_comparisons;
+    double heap_ms = TimeMerge<HeapMerger>(sorted_runs, &heap_comparisons);
+    double tree_ms = TimeMerge<LoserTreeMerger>(sorted_runs, &tree_comparisons);
+    cout << "Merging " << NUM_ROWS << " rows from " << k << " runs" << endl
+         << "  binary heap:    " << heap_ms << "ms, " << heap_comparisons
+         << " comparisons/row" << endl
+         << "  tree of losers: " << tree_ms << "ms (" << heap_ms / tree_ms << "x), "
+         << tree_comparisons << " comparisons/row" << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,355 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "util/benchmark.h"
+#include "util/bit-util.h"
+#include "util/cpu-info.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+// Feasibility study for radix partitioning the in-memory build side of
+// PartitionedHashJoinNode. PartitionedHashJoinNode itself is unchanged; this benchmark
+// only models its probe loop.
+//
+// Compares the probe phase of a hash join over a build side much larger than the LLC
+// using the layout of PartitionedHashJoinNode's in-memory partitions (one large linear
+// probing table of 16-byte buckets pointing at build rows) against radix partitioned
+// layouts, in which the build side is split into sub-partitions whose hash tables fit
+// in L2.
+//
+// The variants are:
+//  - "single table": probes the large table one row at a time.
+//  - "single table, prefetch": hashes groups of probe rows and prefetches their buckets
+//    and then their build rows before probing. This is what ProcessProbeBatch() does.
+//  - "radix, batch clustered": the probe rows of a batch are clustered by sub-partition
+//    before probing. This is the most a streaming probe side can do without
+//    materializing its input.
+//  - "radix, fully clustered": the probe side was radix partitioned up front, the way a
+//    classic radix join does it. The partitioning cost is not included, so this is an
+//    upper bound on what the probe loop can gain from cache-resident hash tables.
+//
+// The build side is partitioned in multiple passes with a fanout of at most
+// 2^MAX_BITS_PER_PASS per pass, to keep the number of partitions written to
+// concurrently within the number of TLB entries.
+//
+// Each iteration probes one batch of BATCH_SIZE rows.
+//
+// With 4M build rows (a 128MB table) and a 256KB L2, prefetching was about 1.6x faster
+// than the single table, clustering each batch only about 1.2x (a batch spreads over
+// 1024 sub-partitions, so few probes share a table), and the fully clustered probe about
+// 4x. The gain of a radix join therefore depends on partitioning the probe side up
+// front, which a streaming probe side cannot do without materializing its input, so
+// PartitionedHashJoinNode keeps a single hash table per spill partition.
+
+// Size of the build side. The single table has 2 * NUM_BUILD_ROWS buckets of 16 bytes.
+const int NUM_BUILD_ROWS = 4 * 1024 * 1024;
+const int NUM_PROBE_ROWS = 4 * 1024 * 1024;
+
+// Rows per probe batch, matching the default row batch size.
+const int BATCH_SIZE = 1024;
+
+// Number of probe rows that are hashed and prefetched together.
+const int PREFETCH_GROUP_SIZE = 256;
+
+// Maximum fanout per partitioning pass.
+const int MAX_BITS_PER_PASS = 6;
+
+// Same layout as HashTable::Bucket.
+struct Bucket {
+  bool filled;
+  bool matched;
+  bool has_duplicates;
+  uint32_t hash;
+  // Index of the build row.
+  uint64_t data;
+};
+
+inline uint32_t Hash(uint32_t key) {
+  // Multiplicative hashing mixes the input bits into the upper bits of the result.
+  // Fold them back so that both the partitioning (upper) bits and the bucket (lower)
+  // bits are well distributed.
+  uint64_t h = static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15ULL;
+  return static_cast<uint32_t>(h >> 32) ^ static_cast<uint32_t>(h);
+}
+
+// Linear probing hash table over build rows with unique keys. Comparing the key of the
+// build row mimics the dereference of the build tuple done by HashTableCtx::Equals().
+class LinearProbeTable {
+ public:
+  LinearProbeTable(const uint32_t* build_keys, int64_t num_rows)
+    : build_keys_(build_keys),
+      num_buckets_(BitUtil::RoundUpToPowerOfTwo(max<int64_t>(2 * num_rows, 2))),
+      buckets_(num_buckets_) {
+    memset(&buckets_[0], 0, sizeof(Bucket) * num_buckets_);
+  }
+
+  void Insert(uint32_t hash, uint64_t row_idx) {
+    int64_t idx = hash & (num_buckets_ - 1);
+    while (buckets_[idx].filled) idx = (idx + 1) & (num_buckets_ - 1);
+    buckets_[idx].filled = true;
+    buckets_[idx].hash = hash;
+    buckets_[idx].data = row_idx;
+  }
+
+  bool Find(uint32_t key, uint32_t hash) const {
+    int64_t idx = hash & (num_buckets_ - 1);
+    while (buckets_[idx].filled) {
+      if (buckets_[idx].hash == hash && build_keys_[buckets_[idx].data] == key) {
+        return true;
+      }
+      idx = (idx + 1) & (num_buckets_ - 1);
+    }
+    return false;
+  }
+
+  void PrefetchBucket(uint32_t hash) const {
+    __builtin_prefetch(&buckets_[hash & (num_buckets_ - 1)], 0, 1);
+  }
+
+  void PrefetchBucketData(uint32_t hash) const {
+    const Bucket& bucket = buckets_[hash & (num_buckets_ - 1)];
+    if (bucket.filled && bucket.hash == hash) {
+      __builtin_prefetch(&build_keys_[bucket.data], 0, 1);
+    }
+  }
+
+  int64_t byte_size() const { return num_buckets_ * sizeof(Bucket); }
+
+ private:
+  const uint32_t* build_keys_;
+  const int64_t num_buckets_;
+  vector<Bucket> buckets_;
+};
+
+// Radix partitions 'keys' on the 'num_bits' upper bits of their hash values, starting
+// at bit 'start_bit' (counted from the most significant bit). Partitions in passes of at
+// most MAX_BITS_PER_PASS bits. 'offsets' is set to the start offset of each partition in
+// 'keys', followed by the total number of keys.
+void RadixPartition(vector<uint32_t>* keys, int start_bit, int num_bits,
+    vector<int64_t>* offsets) {
+  vector<uint32_t> scratch(keys->size());
+  // Ranges of 'keys' that are partitioned on the next pass.
+  vector<int64_t> ranges;
+  ranges.push_back(0);
+  ranges.push_back(keys->size());
+  int bits_done = 0;
+  while (bits_done < num_bits) {
+    const int pass_bits = min(MAX_BITS_PER_PASS, num_bits - bits_done);
+    const int fanout = 1 << pass_bits;
+    const int shift = 32 - start_bit - bits_done - pass_bits;
+    vector<int64_t> new_ranges;
+    for (int r = 0; r + 1 < ranges.size(); ++r) {
+      const int64_t begin = ranges[r];
+      const int64_t end = ranges[r + 1];
+      vector<int64_t> hist(fanout + 1, 0);
+      for (int64_t i = begin; i < end; ++i) {
+        ++hist[((Hash((*keys)[i]) >> shift) & (fanout - 1)) + 1];
+      }
+      for (int p = 0; p < fanout; ++p) hist[p + 1] += hist[p];
+      for (int p = 0; p < fanout; ++p) new_ranges.push_back(begin + hist[p]);
+      vector<int64_t> dst(hist.begin(), hist.end() - 1);
+      for (int64_t i = begin; i < end; ++i) {
+        uint32_t key = (*keys)[i];
+        scratch[begin + dst[(Hash(key) >> shift) & (fanout - 1)]++] = key;
+      }
+    }
+    new_ranges.push_back(keys->size());
+    keys->swap(scratch);
+    ranges.swap(new_ranges);
+    bits_done += pass_bits;
+  }
+  offsets->swap(ranges);
+}
+
+struct TestData {
+  vector<uint32_t> build_keys;
+  vector<uint32_t> probe_keys;
+  int probe_pos;
+  int64_t num_matches;
+
+  LinearProbeTable* single_table;
+
+  // Radix partitioned build side, one table per sub-partition.
+  int radix_bits;
+  vector<uint32_t> partitioned_build_keys;
+  vector<int64_t> build_offsets;
+  vector<LinearProbeTable*> sub_tables;
+
+  // Radix partitioned probe side for the fully clustered variant.
+  vector<uint32_t> partitioned_probe_keys;
+
+  // Scratch arrays used to cluster a probe batch.
+  vector<uint32_t> batch_keys;
+  vector<int> batch_hist;
+};
+
+inline const uint32_t* NextProbeBatch(TestData* data, const vector<uint32_t>& keys) {
+  if (data->probe_pos + BATCH_SIZE > keys.size()) data->probe_pos = 0;
+  const uint32_t* batch = &keys[data->probe_pos];
+  data->probe_pos += BATCH_SIZE;
+  return batch;
+}
+
+inline int SubPartition(const TestData* data, uint32_t hash) {
+  return hash >> (32 - data->radix_bits);
+}
+
+void TestSingleTable(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    const uint32_t* batch = NextProbeBatch(data, data->probe_keys);
+    for (int j = 0; j < BATCH_SIZE; ++j) {
+      data->num_matches += data->single_table->Find(batch[j], Hash(batch[j]));
+    }
+  }
+}
+
+void TestSingleTablePrefetch(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  uint32_t hashes[PREFETCH_GROUP_SIZE];
+  for (int i = 0; i < batch_size; ++i) {
+    const uint32_t* batch = NextProbeBatch(data, data->probe_keys);
+    for (int group = 0; group < BATCH_SIZE; group += PREFETCH_GROUP_SIZE) {
+      const uint32_t* keys = batch + group;
+      for (int j = 0; j < PREFETCH_GROUP_SIZE; ++j) {
+        hashes[j] = Hash(keys[j]);
+        data->single_table->PrefetchBucket(hashes[j]);
+      }
+      for (int j = 0; j < PREFETCH_GROUP_SIZE; ++j) {
+        data->single_table->PrefetchBucketData(hashes[j]);
+      }
+      for (int j = 0; j < PREFETCH_GROUP_SIZE; ++j) {
+        data->num_matches += data->single_table->Find(keys[j], hashes[j]);
+      }
+    }
+  }
+}
+
+void TestRadixBatchClustered(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  const int num_sub_partitions = 1 << data->radix_bits;
+  for (int i = 0; i < batch_size; ++i) {
+    const uint32_t* batch = NextProbeBatch(data, data->probe_keys);
+    // Counting sort of the batch by sub-partition.
+    int* hist = &data->batch_hist[0];
+    memset(hist, 0, sizeof(int) * (num_sub_partitions + 1));
+    for (int j = 0; j < BATCH_SIZE; ++j) ++hist[SubPartition(data, Hash(batch[j])) + 1];
+    for (int p = 0; p < num_sub_partitions; ++p) hist[p + 1] += hist[p];
+    for (int j = 0; j < BATCH_SIZE; ++j) {
+      data->batch_keys[hist[SubPartition(data, Hash(batch[j]))]++] = batch[j];
+    }
+    // 'hist[p]' is now the end of sub-partition p.
+    int begin = 0;
+    for (int p = 0; p < num_sub_partitions; ++p) {
+      const LinearProbeTable* table = data->sub_tables[p];
+      for (int j = begin; j < hist[p]; ++j) {
+        uint32_t key = data->batch_keys[j];
+        data->num_matches += table->Find(key, Hash(key));
+      }
+      begin = hist[p];
+    }
+  }
+}
+
+void TestRadixFullyClustered(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    const uint32_t* batch = NextProbeBatch(data, data->partitioned_probe_keys);
+    for (int j = 0; j < BATCH_SIZE; ++j) {
+      uint32_t hash = Hash(batch[j]);
+      data->num_matches += data->sub_tables[SubPartition(data, hash)]->Find(batch[j], hash);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  CpuInfo::Init();
+  cout << Benchmark::GetMachineInfo() << endl;
+
+  TestData data;
+  data.probe_pos = 0;
+  data.num_matches = 0;
+
+  // Unique build keys; every other probe key has a match.
+  data.build_keys.resize(NUM_BUILD_ROWS);
+  for (int i = 0; i < NUM_BUILD_ROWS; ++i) data.build_keys[i] = 2 * i;
+  random_shuffle(data.build_keys.begin(), data.build_keys.end());
+  data.probe_keys.resize(NUM_PROBE_ROWS);
+  for (int i = 0; i < NUM_PROBE_ROWS; ++i) {
+    data.probe_keys[i] = rand() % (2 * NUM_BUILD_ROWS);
+  }
+
+  data.single_table = new LinearProbeTable(&data.build_keys[0], NUM_BUILD_ROWS);
+  for (int i = 0; i < NUM_BUILD_ROWS; ++i) {
+    data.single_table->Insert(Hash(data.build_keys[i]), i);
+  }
+
+  // Pick enough sub-partitions so that each hash table fits in half of L2, leaving the
+  // other half for the probe rows and build rows.
+  const int64_t l2_size = CpuInfo::CacheSize(CpuInfo::L2_CACHE);
+  const int64_t target_bytes = max<int64_t>(l2_size / 2, 16 * 1024);
+  data.radix_bits = 1;
+  while (data.radix_bits < 16 &&
+      (data.single_table->byte_size() >> data.radix_bits) > target_bytes) {
+    ++data.radix_bits;
+  }
+
+  data.partitioned_build_keys = data.build_keys;
+  RadixPartition(&data.partitioned_build_keys, 0, data.radix_bits, &data.build_offsets);
+  for (int p = 0; p + 1 < data.build_offsets.size(); ++p) {
+    const int64_t begin = data.build_offsets[p];
+    const int64_t num_rows = data.build_offsets[p + 1] - begin;
+    LinearProbeTable* table =
+        new LinearProbeTable(&data.partitioned_build_keys[begin], num_rows);
+    for (int64_t i = 0; i < num_rows; ++i) {
+      table->Insert(Hash(data.partitioned_build_keys[begin + i]), i);
+    }
+    data.sub_tables.push_back(table);
+  }
+
+  vector<int64_t> probe_offsets;
+  data.partitioned_probe_keys = data.probe_keys;
+  RadixPartition(&data.partitioned_probe_keys, 0, data.radix_bits, &probe_offsets);
+
+  data.batch_keys.resize(BATCH_SIZE);
+  data.batch_hist.resize((1 << data.radix_bits) + 1);
+
+  cout << "Build rows: " << NUM_BUILD_ROWS << " Single table bytes: "
+       << data.single_table->byte_size() << " Sub-partitions: "
+       << data.sub_tables.size() << " L2: " << l2_size << endl;
+
+  Benchmark suite("Hash join probe");
+  suite.AddBenchmark("single table", TestSingleTable, &data);
+  suite.AddBenchmark("single table, prefetch", TestSingleTablePrefetch, &data);
+  suite.AddBenchmark("radix, batch clustered", TestRadixBatchClustered, &data);
+  suite.AddBenchmark("radix, fully clustered", TestRadixFullyClustered, &data);
+  cout << suite.Measure() << endl;
+
+  // Make sure the probes are not optimized away.
+  cout << "Matches: " << data.num_matches << endl;
+
+  delete data.single_table;
+  for (int i = 0; i < data.sub_tables.size(); ++i) delete data.sub_tables[i];
+  return 0;
+}
@@ -19,6 +19,7 @@
 #include "runtime/mem-tracker.h"
 #include "experiments/bit-stream-utils.8byte.inline.h"
 #include "util/benchmark.h"
+#include "util/bit-packing.h"
 #include "util/bit-stream-utils.inline.h"
 #include "util/cpu-info.h"
 
@@ -108,6 +109,8 @@ struct TestData {
   int max_value;
   MemPool* pool;
   bool result;
+  // Output of the batch decode benchmarks.
+  uint32_t* values;
 };
 
 void TestBitWriterEncode(int batch_size, void* d) {
@@ -189,6 +192,48 @@ void TestBitWriter8ByteDecode(int batch_size, void* d) {
   CHECK(data->result);
 }
 
+void TestBitReaderGetValue(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    BitReader reader(data->buffer, BUFFER_LEN);
+    for (int j = 0; j < data->num_values; ++j) {
+      reader.GetValue(data->num_bits, &data->values[j]);
+    }
+  }
+}
+
+void TestBitReaderGetValues(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    BitReader reader(data->buffer, BUFFER_LEN);
+    reader.GetValues(data->num_bits, data->values, data->num_values);
+  }
+}
+
+void TestUnpackScalar(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    BitPacking::UnpackValuesScalar(
+        data->num_bits, data->buffer, BUFFER_LEN, data->num_values, data->values);
+  }
+}
+
+void TestUnpackSSE4(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    BitPacking::UnpackValuesSSE4(
+        data->num_bits, data->buffer, BUFFER_LEN, data->num_values, data->values);
+  }
+}
+
+void TestUnpackAVX2(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  for (int i = 0; i < batch_size; ++i) {
+    BitPacking::UnpackValuesAVX2(
+        data->num_bits, data->buffer, BUFFER_LEN, data->num_values, data->values);
+  }
+}
+
 int main(int argc, char** argv) {
   CpuInfo::Init();
 
@@ -237,5 +282,54 @@ int main(int argc, char** argv) {
   }
   cout << decode_suite.Measure() << endl;
 
+  // Compares decoding a value at a time with the batch unpacking kernels.
+  const int max_unpack_bits = BitPacking::MAX_BIT_WIDTH;
+  Benchmark batch_decode_suite("batch decode");
+  TestData unpack_data[max_unpack_bits];
+  for (int i = 0; i < max_unpack_bits; ++i) {
+    unpack_data[i].buffer = new uint8_t[BUFFER_LEN];
+    unpack_data[i].values = new uint32_t[num_values];
+    unpack_data[i].num_values = num_values;
+    unpack_data[i].num_bits = i + 1;
+    BitWriter writer(unpack_data[i].buffer, BUFFER_LEN);
+    for (int j = 0; j < num_values; ++j) {
+      writer.PutValue(rand() & ((1ULL << (i + 1)) - 1), i + 1);
+    }
+    writer.Flush();
+
+    stringstream suffix;
+    suffix << " " << (i+1) << "-Bit";
+
+    stringstream name;
+    name << "\"GetValue" << suffix.str() << "\"";
+    int baseline = batch_decode_suite.AddBenchmark(
+        name.str(), TestBitReaderGetValue, &unpack_data[i], -1);
+
+    name.str("");
+    name << "\"GetValues" << suffix.str() << "\"";
+    batch_decode_suite.AddBenchmark(
+        name.str(), TestBitReaderGetValues, &unpack_data[i], baseline);
+
+    name.str("");
+    name << "\"Unpack Scalar" << suffix.str() << "\"";
+    batch_decode_suite.AddBenchmark(
+        name.str(), TestUnpackScalar, &unpack_data[i], baseline);
+
+    if (CpuInfo::IsSupported(CpuInfo::SSE4_1)) {
+      name.str("");
+      name << "\"Unpack SSE4.1" << suffix.str() << "\"";
+      batch_decode_suite.AddBenchmark(
+          name.str(), TestUnpackSSE4, &unpack_data[i], baseline);
+    }
+
+    if (CpuInfo::IsSupported(CpuInfo::AVX2)) {
+      name.str("");
+      name << "\"Unpack AVX2" << suffix.str() << "\"";
+      batch_decode_suite.AddBenchmark(
+          name.str(), TestUnpackAVX2, &unpack_data[i], baseline);
+    }
+  }
+  cout << batch_decode_suite.Measure() << endl;
+
   return 0;
 }
@@ -0,0 +1,307 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <gutil/strings/substitute.h>
+
+#include "exec/delimited-text-parser.inline.h"
+#include "exec/parquet-common.h"
+#include "exec/read-write-util.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "util/benchmark.h"
+#include "util/codec.h"
+#include "util/cpu-info.h"
+#include "util/dict-encoding.h"
+#include "util/string-parser.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace strings;
+
+// Benchmark of the per-core decoding work the HDFS scanners do for each file format
+// and compression codec, independent of the disk and of the DiskIoMgr. Driving the
+// scanners themselves requires an HDFS connection and the io manager, so this
+// benchmarks the kernels they spend their time in over generated in-memory data:
+//  - decompression: decompressing 1MB of text and 1MB of a BIGINT column with every
+//    codec the scanners support, relative to a memcpy() of the uncompressed data.
+//  - decoding: materializing the same BIGINT values from the encoding of each format:
+//    delimited text (parsing plus string conversion), Parquet PLAIN and dictionary
+//    encoding, Avro zig-zag longs and the Hadoop vlongs of sequence and RC files.
+//    Varint lengths depend on the magnitude of the values, so the suite runs over
+//    values with a small and a large range.
+// The numbers are iterations per millisecond, where each iteration processes all of
+// the data, so they are comparable within a suite.
+
+const int DATA_SIZE = 1024 * 1024;
+const int NUM_VALUES = 128 * 1024;
+
+// Number of columns of the generated text rows.
+const int NUM_COLS = 8;
+
+// Maximum number of tuples parsed per ParseFieldLocations() call, like the batch
+// size of the text scanner.
+const int MAX_TUPLES = 1024;
+
+struct CodecData {
+  CodecData(THdfsCompression::type codec, const string& raw)
+    : codec(codec), raw(raw), output(raw.size()) {
+    MemTracker tracker;
+    MemPool pool(&tracker);
+    if (codec != THdfsCompression::NONE) {
+      scoped_ptr<Codec> compressor;
+      Status status = Codec::CreateCompressor(&pool, false, codec, &compressor);
+      DCHECK(status.ok()) << status.GetDetail();
+      int64_t compressed_len;
+      uint8_t* compressed_data;
+      status = compressor->ProcessBlock(false, raw.size(),
+          reinterpret_cast<const uint8_t*>(raw.data()), &compressed_len,
+          &compressed_data);
+      DCHECK(status.ok()) << status.GetDetail();
+      compressed.assign(reinterpret_cast<char*>(compressed_data), compressed_len);
+      status = Codec::CreateDecompressor(NULL, false, codec, &decompressor);
+      DCHECK(status.ok()) << status.GetDetail();
+    }
+    pool.FreeAll();
+  }
+
+  THdfsCompression::type codec;
+  const string& raw;
+  string compressed;
+  scoped_ptr<Codec> decompressor;
+  vector<uint8_t> output;
+};
+
+void DecompressBenchmark(int batch_size, void* data) {
+  CodecData* d = reinterpret_cast<CodecData*>(data);
+  for (int i = 0; i < batch_size; ++i) {
+    if (d->codec == THdfsCompression::NONE) {
+      memcpy(&d->output[0], d->raw.data(), d->raw.size());
+      continue;
+    }
+    int64_t output_len = d->output.size();
+    uint8_t* output = &d->output[0];
+    Status status = d->decompressor->ProcessBlock(true, d->compressed.size(),
+        reinterpret_cast<const uint8_t*>(d->compressed.data()), &output_len, &output);
+    DCHECK(status.ok()) << status.GetDetail();
+    DCHECK_EQ(output_len, d->raw.size());
+  }
+}
+
+// The same values in the encoding of each file format.
+struct DecodeData {
+  DecodeData(int64_t max_value)
+    : field_locations(MAX_TUPLES * NUM_COLS),
+      row_end_locations(MAX_TUPLES),
+      sum(0) {
+    for (int i = 0; i < NUM_VALUES; ++i) {
+      values.push_back(((static_cast<int64_t>(rand()) << 31) | rand()) % max_value);
+    }
+
+    for (int i = 0; i < NUM_COLS; ++i) is_materialized_col[i] = true;
+    parser.reset(new DelimitedTextParser(NUM_COLS, 0, is_materialized_col, '\n', ',',
+        ':', '\0'));
+    for (int i = 0; i < NUM_VALUES; ++i) {
+      text += lexical_cast<string>(values[i]);
+      text += ((i + 1) % NUM_COLS == 0) ? '\n' : ',';
+    }
+
+    plain.resize(NUM_VALUES * sizeof(int64_t));
+    uint8_t* ptr = &plain[0];
+    for (int64_t v: values) ptr += ParquetPlainEncoder::Encode(ptr, -1, v);
+
+    MemTracker tracker;
+    MemPool pool(&tracker);
+    DictEncoder<int64_t> encoder(&pool, -1);
+    for (int64_t v: values) encoder.Put(v);
+    dict.resize(encoder.dict_encoded_size());
+    encoder.WriteDict(&dict[0]);
+    dict_indices.resize(encoder.EstimatedDataEncodedSize());
+    dict_indices.resize(encoder.WriteData(&dict_indices[0], dict_indices.size()));
+    decoder.Reset(&dict[0], dict.size(), -1);
+    encoder.ClearIndices();
+    pool.FreeAll();
+
+    zlongs.resize(NUM_VALUES * 10);
+    ptr = &zlongs[0];
+    for (int64_t v: values) ptr += ReadWriteUtil::PutZLong(v, ptr);
+    zlongs.resize(ptr - &zlongs[0]);
+
+    vlongs.resize(NUM_VALUES * 9);
+    ptr = &vlongs[0];
+    for (int64_t v: values) ptr += ReadWriteUtil::PutVLong(v, ptr);
+    vlongs.resize(ptr - &vlongs[0]);
+  }
+
+  vector<int64_t> values;
+
+  bool is_materialized_col[NUM_COLS];
+  scoped_ptr<DelimitedTextParser> parser;
+  string text;
+  vector<FieldLocation> field_locations;
+  vector<char*> row_end_locations;
+
+  vector<uint8_t> plain;
+  vector<uint8_t> dict;
+  vector<uint8_t> dict_indices;
+  DictDecoder<int64_t> decoder;
+  vector<uint8_t> zlongs;
+  vector<uint8_t> vlongs;
+
+  // Used only to avoid the compiler optimizing out the decoding.
+  int64_t sum;
+};
+
+void TextBenchmark(int batch_size, void* data) {
+  DecodeData* d = reinterpret_cast<DecodeData*>(data);
+  for (int i = 0; i < batch_size; ++i) {
+    d->parser->ParserReset();
+    char* ptr = const_cast<char*>(d->text.c_str());
+    char* end = ptr + d->text.size();
+    while (ptr < end) {
+      int num_tuples = 0;
+      int num_fields = 0;
+      char* next_column_start;
+      Status status = d->parser->ParseFieldLocations(MAX_TUPLES, end - ptr, &ptr,
+          &d->row_end_locations[0], &d->field_locations[0], &num_tuples, &num_fields,
+          &next_column_start);
+      DCHECK(status.ok());
+      for (int j = 0; j < num_fields; ++j) {
+        const FieldLocation& field = d->field_locations[j];
+        StringParser::ParseResult result;
+        d->sum += StringParser::StringToInt<int64_t>(field.start, field.len, &result);
+        DCHECK_EQ(result, StringParser::PARSE_SUCCESS);
+      }
+    }
+  }
+}
+
+void ParquetPlainBenchmark(int batch_size, void* data) {
+  DecodeData* d = reinterpret_cast<DecodeData*>(data);
+  for (int i = 0; i < batch_size; ++i) {
+    uint8_t* ptr = &d->plain[0];
+    for (int j = 0; j < NUM_VALUES; ++j) {
+      int64_t v;
+      ptr += ParquetPlainEncoder::Decode(ptr, -1, &v);
+      d->sum += v;
+    }
+  }
+}
+
+void ParquetDictBenchmark(int batch_size, void* data) {
+  DecodeData* d = reinterpret_cast<DecodeData*>(data);
+  for (int i = 0; i < batch_size; ++i) {
+    d->decoder.SetData(&d->dict_indices[0], d->dict_indices.size());
+    for (int j = 0; j < NUM_VALUES; ++j) {
+      int64_t v;
+      bool ok = d->decoder.GetValue(&v);
+      DCHECK(ok);
+      d->sum += v;
+    }
+  }
+}
+
+void AvroBenchmark(int batch_size, void* data) {
+  DecodeData* d = reinterpret_cast<DecodeData*>(data);
+  for (int i = 0; i < batch_size; ++i) {
+    uint8_t* ptr = &d->zlongs[0];
+    for (int j = 0; j < NUM_VALUES; ++j) d->sum += ReadWriteUtil::ReadZLong(&ptr);
+  }
+}
+
+void VLongBenchmark(int batch_size, void* data) {
+  DecodeData* d = reinterpret_cast<DecodeData*>(data);
+  for (int i = 0; i < batch_size; ++i) {
+    uint8_t* ptr = &d->vlongs[0];
+    for (int j = 0; j < NUM_VALUES; ++j) {
+      int64_t v;
+      ptr += ReadWriteUtil::GetVLong(ptr, &v);
+      d->sum += v;
+    }
+  }
+}
+
+// Returns DATA_SIZE bytes of delimited text rows.
+string MakeText() {
+  string text;
+  int col = 0;
+  while (text.size() < DATA_SIZE) {
+    // Draw words from a small vocabulary, so the data compresses like real text.
+    int word = rand() % 1000;
+    text += "word" + lexical_cast<string>(word);
+    text += (++col % NUM_COLS == 0) ? '\n' : ',';
+  }
+  text.resize(DATA_SIZE);
+  return text;
+}
+
+// Returns DATA_SIZE bytes of PLAIN encoded BIGINT values.
+string MakeColumn() {
+  string column(DATA_SIZE, '\0');
+  int64_t* values = reinterpret_cast<int64_t*>(&column[0]);
+  for (int i = 0; i < DATA_SIZE / sizeof(int64_t); ++i) values[i] = rand() % 100000;
+  return column;
+}
+
+int main(int argc, char **argv) {
+  CpuInfo::Init();
+  cout << endl << Benchmark::GetMachineInfo() << endl;
+
+  const THdfsCompression::type codecs[] = {THdfsCompression::NONE,
+      THdfsCompression::GZIP, THdfsCompression::DEFLATE, THdfsCompression::BZIP2,
+      THdfsCompression::SNAPPY, THdfsCompression::SNAPPY_BLOCKED,
+      THdfsCompression::LZ4,
+#ifdef IMPALA_HAVE_ZSTD
+      THdfsCompression::ZSTD
+#endif
+  };
+  const char* codec_names[] = {"memcpy", "gzip", "deflate", "bzip2", "snappy",
+      "snappy blocked", "lz4",
+#ifdef IMPALA_HAVE_ZSTD
+      "zstd"
+#endif
+  };
+  const string text = MakeText();
+  const string column = MakeColumn();
+  const string* inputs[] = {&text, &column};
+  const char* input_names[] = {"text", "bigint column"};
+  for (int i = 0; i < 2; ++i) {
+    Benchmark suite(Substitute("decompress 1MB $0", input_names[i]));
+    for (int j = 0; j < sizeof(codecs) / sizeof(codecs[0]); ++j) {
+      CodecData* data = new CodecData(codecs[j], *inputs[i]);
+      // Names the codecs with their compression ratio.
+      string name = j == 0 ? codec_names[j] : Substitute("$0 ($1%)", codec_names[j],
+          data->compressed.size() * 100 / data->raw.size());
+      suite.AddBenchmark(name, DecompressBenchmark, data);
+    }
+    cout << suite.Measure() << endl;
+  }
+
+  const int64_t max_values[] = {1000, 1L << 40};
+  for (int64_t max_value: max_values) {
+    Benchmark suite(Substitute("decode $0 bigints < $1", NUM_VALUES, max_value));
+    DecodeData* data = new DecodeData(max_value);
+    suite.AddBenchmark("text", TextBenchmark, data);
+    suite.AddBenchmark("parquet plain", ParquetPlainBenchmark, data);
+    suite.AddBenchmark("parquet dict", ParquetDictBenchmark, data);
+    suite.AddBenchmark("avro", AvroBenchmark, data);
+    suite.AddBenchmark("seq/rc vlong", VLongBenchmark, data);
+    cout << suite.Measure() << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,329 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "runtime/types.h"
+#include "util/benchmark.h"
+#include "util/bit-util.h"
+#include "util/cpu-info.h"
+#include "util/stopwatch.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+// Compares the algorithms of Sorter's in-memory sort (Sorter::TupleSorter) on a run of
+// NUM_ROWS tuples with a BIGINT sort key and a BIGINT payload:
+//  - "quicksort, comparator": quicksort comparing tuples by evaluating the sort key
+//    through an indirect call per value, like the interpreted TupleRowComparator.
+//  - "quicksort, normalized keys": the same quicksort, comparing the memcmp-comparable
+//    keys built by KeyNormalizer (a null byte followed by the big endian key with the
+//    sign bit flipped) that are moved along with the tuples.
+//  - "radix sort, normalized keys": the MSD radix sort on the normalized keys that
+//    TupleSorter uses when the keys are at most 16 bytes.
+// The times include building the normalized keys. Each variant sorts the same input
+// NUM_REPEATS times and the fastest time is reported.
+//
+// On a Xeon server, with this (cheap, BIGINT-only) stand-in for the comparator:
+//   quicksort, comparator:       1904ms
+//   quicksort, normalized keys:  3513ms (0.54x)
+//   radix sort, normalized keys:  867ms (2.2x)
+// For a single fixed-width key, moving and comparing the keys costs more than the
+// comparator saves; the normalized keys pay off in quicksort for string and multi-column
+// keys, where the comparator is much more expensive, and the radix sort is the fastest
+// for short keys.
+
+const int64_t NUM_ROWS = 10 * 1000 * 1000;
+const int NUM_REPEATS = 3;
+
+const int INSERTION_THRESHOLD = 16;
+
+// Length of a normalized BIGINT key: the null byte and the value.
+const int KEY_LEN = 1 + sizeof(int64_t);
+
+struct SortTuple {
+  int64_t key;
+  int64_t payload;
+};
+
+// Stands in for a SlotRef evaluated through ExprContext::GetValue(): a virtual call
+// that checks the null indicator before returning the slot.
+class KeyExpr {
+ public:
+  KeyExpr(PrimitiveType type) : type_(type) { }
+  virtual ~KeyExpr() { }
+  virtual void* GetValue(SortTuple* tuple) const {
+    if ((tuple->payload & (1LL << 62)) != 0) return NULL;
+    return &tuple->key;
+  }
+  PrimitiveType type() const { return type_; }
+
+ private:
+  PrimitiveType type_;
+};
+
+// Stands in for RawValue::Compare(), which switches on the type of the values.
+int CompareValues(const void* lhs, const void* rhs, PrimitiveType type) {
+  switch (type) {
+    case TYPE_INT: {
+      int32_t l = *reinterpret_cast<const int32_t*>(lhs);
+      int32_t r = *reinterpret_cast<const int32_t*>(rhs);
+      return l > r ? 1 : (l < r ? -1 : 0);
+    }
+    case TYPE_BIGINT: {
+      int64_t l = *reinterpret_cast<const int64_t*>(lhs);
+      int64_t r = *reinterpret_cast<const int64_t*>(rhs);
+      return l > r ? 1 : (l < r ? -1 : 0);
+    }
+    default:
+      return 0;
+  }
+}
+
+class InMemorySort {
+ public:
+  InMemorySort(vector<SortTuple>* tuples, const KeyExpr* key_expr, bool use_keys)
+    : tuples_(&(*tuples)[0]),
+      num_tuples_(tuples->size()),
+      key_expr_(key_expr),
+      use_keys_(use_keys),
+      rng_state_(1) {
+  }
+
+  void NormalizeKeys() {
+    keys_.resize(num_tuples_ * KEY_LEN);
+    for (int64_t i = 0; i < num_tuples_; ++i) {
+      uint8_t* key = &keys_[i * KEY_LEN];
+      key[0] = 1;
+      uint64_t value = BitUtil::ToBigEndian(
+          static_cast<uint64_t>(tuples_[i].key) ^ (1ULL << 63));
+      memcpy(key + 1, &value, sizeof(value));
+    }
+  }
+
+  void QuickSort() { SortHelper(0, num_tuples_); }
+
+  void RadixSort() { RadixSort(0, num_tuples_, 0); }
+
+  bool IsSorted() const {
+    for (int64_t i = 1; i < num_tuples_; ++i) {
+      if (tuples_[i].key < tuples_[i - 1].key) return false;
+      if (use_keys_ && memcmp(Key(i - 1), Key(i), KEY_LEN) > 0) return false;
+    }
+    return true;
+  }
+
+ private:
+  uint8_t* Key(int64_t i) { return &keys_[i * KEY_LEN]; }
+  const uint8_t* Key(int64_t i) const { return &keys_[i * KEY_LEN]; }
+
+  bool Less(const uint8_t* lhs_key, SortTuple* lhs, const uint8_t* rhs_key,
+      SortTuple* rhs) {
+    if (use_keys_) return memcmp(lhs_key, rhs_key, KEY_LEN) < 0;
+    void* lhs_value = key_expr_->GetValue(lhs);
+    void* rhs_value = key_expr_->GetValue(rhs);
+    if (lhs_value == NULL || rhs_value == NULL) return lhs_value == NULL;
+    return CompareValues(lhs_value, rhs_value, key_expr_->type()) < 0;
+  }
+
+  bool Less(int64_t lhs, int64_t rhs) {
+    return Less(use_keys_ ? Key(lhs) : NULL, &tuples_[lhs],
+        use_keys_ ? Key(rhs) : NULL, &tuples_[rhs]);
+  }
+
+  void Swap(int64_t left, int64_t right) {
+    swap(tuples_[left], tuples_[right]);
+    if (use_keys_) {
+      uint8_t tmp[KEY_LEN];
+      memcpy(tmp, Key(left), KEY_LEN);
+      memcpy(Key(left), Key(right), KEY_LEN);
+      memcpy(Key(right), tmp, KEY_LEN);
+    }
+  }
+
+  void InsertionSort(int64_t first, int64_t last) {
+    for (int64_t i = first + 1; i < last; ++i) {
+      SortTuple tuple = tuples_[i];
+      uint8_t key[KEY_LEN];
+      if (use_keys_) memcpy(key, Key(i), KEY_LEN);
+      int64_t j = i;
+      while (j > first && Less(key, &tuple, use_keys_ ? Key(j - 1) : NULL,
+          &tuples_[j - 1])) {
+        tuples_[j] = tuples_[j - 1];
+        if (use_keys_) memcpy(Key(j), Key(j - 1), KEY_LEN);
+        --j;
+      }
+      tuples_[j] = tuple;
+      if (use_keys_) memcpy(Key(j), key, KEY_LEN);
+    }
+  }
+
+  int64_t RandomIndex(int64_t first, int64_t last) {
+    rng_state_ = rng_state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    return first + (rng_state_ >> 33) % (last - first);
+  }
+
+  int64_t SelectPivot(int64_t first, int64_t last) {
+    int64_t t1 = RandomIndex(first, last);
+    int64_t t2 = RandomIndex(first, last);
+    int64_t t3 = RandomIndex(first, last);
+    bool t1_lt_t2 = Less(t1, t2);
+    bool t2_lt_t3 = Less(t2, t3);
+    bool t1_lt_t3 = Less(t1, t3);
+    if (t1_lt_t2) {
+      if (t2_lt_t3) return t2;
+      return t1_lt_t3 ? t3 : t1;
+    }
+    if (t1_lt_t3) return t1;
+    return t2_lt_t3 ? t3 : t2;
+  }
+
+  int64_t Partition(int64_t first, int64_t last, int64_t pivot_index) {
+    SortTuple pivot = tuples_[pivot_index];
+    uint8_t pivot_key[KEY_LEN];
+    if (use_keys_) memcpy(pivot_key, Key(pivot_index), KEY_LEN);
+    --last;
+    while (true) {
+      while (Less(use_keys_ ? Key(first) : NULL, &tuples_[first], pivot_key, &pivot)) {
+        ++first;
+      }
+      while (Less(pivot_key, &pivot, use_keys_ ? Key(last) : NULL, &tuples_[last])) {
+        --last;
+      }
+      if (first >= last) break;
+      Swap(first, last);
+      ++first;
+      --last;
+    }
+    return first;
+  }
+
+  void SortHelper(int64_t first, int64_t last) {
+    while (last - first > INSERTION_THRESHOLD) {
+      int64_t cut = Partition(first, last, SelectPivot(first, last));
+      if (cut - first < last - cut) {
+        SortHelper(first, cut);
+        first = cut;
+      } else {
+        SortHelper(cut, last);
+        last = cut;
+      }
+    }
+    InsertionSort(first, last);
+  }
+
+  void RadixSort(int64_t first, int64_t last, int byte) {
+    if (last - first <= INSERTION_THRESHOLD) {
+      InsertionSort(first, last);
+      return;
+    }
+    if (byte == KEY_LEN) return;
+    int64_t bucket_end[256];
+    int64_t next[256];
+    memset(bucket_end, 0, sizeof(bucket_end));
+    for (int64_t i = first; i < last; ++i) ++bucket_end[Key(i)[byte]];
+    int64_t start = first;
+    for (int b = 0; b < 256; ++b) {
+      next[b] = start;
+      start += bucket_end[b];
+      bucket_end[b] = start;
+    }
+    for (int b = 0; b < 256; ++b) {
+      while (next[b] < bucket_end[b]) {
+        uint8_t key_byte = Key(next[b])[byte];
+        if (key_byte == b) {
+          ++next[b];
+        } else {
+          Swap(next[b], next[key_byte]);
+          ++next[key_byte];
+        }
+      }
+    }
+    int64_t bucket_start = first;
+    for (int b = 0; b < 256; ++b) {
+      if (bucket_end[b] - bucket_start > 1) RadixSort(bucket_start, bucket_end[b], byte + 1);
+      bucket_start = bucket_end[b];
+    }
+  }
+
+  SortTuple* tuples_;
+  int64_t num_tuples_;
+  const KeyExpr* key_expr_;
+  bool use_keys_;
+  vector<uint8_t> keys_;
+  uint64_t rng_state_;
+};
+
+enum Variant {
+  QUICKSORT_COMPARATOR,
+  QUICKSORT_KEYS,
+  RADIX_SORT_KEYS,
+};
+
+// Returns the fastest of NUM_REPEATS sorts of 'input' in ms.
+double TimeSort(const vector<SortTuple>& input, const KeyExpr* key_expr,
+    Variant variant) {
+  double best_ms = 0;
+  for (int i = 0; i < NUM_REPEATS; ++i) {
+    vector<SortTuple> tuples(input);
+    InMemorySort sort(&tuples, key_expr, variant != QUICKSORT_COMPARATOR);
+    MonotonicStopWatch sw;
+    sw.Start();
+    if (variant != QUICKSORT_COMPARATOR) sort.NormalizeKeys();
+    if (variant == RADIX_SORT_KEYS) {
+      sort.RadixSort();
+    } else {
+      sort.QuickSort();
+    }
+    sw.Stop();
+    if (!sort.IsSorted()) {
+      cerr << "Sort variant " << variant << " produced unsorted output" << endl;
+      exit(1);
+    }
+    double ms = sw.ElapsedTime() / 1000000.0;
+    if (i == 0 || ms < best_ms) best_ms = ms;
+  }
+  return best_ms;
+}
+
+int main(int argc, char** argv) {
+  CpuInfo::Init();
+  cout << Benchmark::GetMachineInfo() << endl;
+
+  vector<SortTuple> input(NUM_ROWS);
+  for (int64_t i = 0; i < NUM_ROWS; ++i) {
+    input[i].key = (static_cast<int64_t>(rand()) << 32 | rand()) - (1LL << 61);
+    input[i].payload = i;
+  }
+  // Allocated on the heap so that the compiler cannot devirtualize GetValue().
+  scoped_ptr<KeyExpr> key_expr(new KeyExpr(TYPE_BIGINT));
+
+  const char* names[] = {
+      "quicksort, comparator", "quicksort, normalized keys", "radix sort, normalized keys"};
+  double baseline_ms = 0;
+  cout << "Sorting " << NUM_ROWS << " rows" << endl;
+  for (int variant = QUICKSORT_COMPARATOR; variant <= RADIX_SORT_KEYS; ++variant) {
+    double ms = TimeSort(input, key_expr.get(), static_cast<Variant>(variant));
+    if (variant == QUICKSORT_COMPARATOR) baseline_ms = ms;
+    cout << names[variant] << ": " << ms << "ms (" << baseline_ms / ms << "x)" << endl;
+  }
+  return 0;
+}
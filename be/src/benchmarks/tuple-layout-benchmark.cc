@@ -35,6 +35,18 @@ using namespace impala;
 //                   RandomPadded              0.1342             0.3345X
 //                   RandomImpala              0.1437              0.358X
 //                RandomUnaligned              0.1452             0.3619X
+//
+// The wide tuples of nullable slots below (72 bytes in the frontend's layout, 60 bytes
+// compacted), on a virtualized x86-64 machine:
+// Wide Tuple Layout:    Function     Rate (iters/ms)          Comparison
+// ----------------------------------------------------------------------
+//               SequentialImpala             0.08391                  1X
+//              SequentialCompact             0.08557               1.02X
+//
+//                   RandomImpala             0.03512                  1X
+//                  RandomCompact             0.04117              1.172X
+// Sequential scans are bound by the work per tuple, but random accesses, like hash
+// table probes, touch fewer cache lines per tuple in the compact layout.
 
 #define VALIDATE 0
 
@@ -66,6 +78,49 @@ struct ImpalaTupleStruct {
   double val;
 };
 
+// A wide tuple of nullable slots, as hash join builds and aggregations store them, in
+// the layout of the frontend: the null indicator bytes first, then the slots in
+// descending size order, each aligned to its size (at most 8), and a DECIMAL(24, 2)
+// slot that takes 16 bytes although 12 would hold its precision.
+struct ImpalaWideTupleStruct {
+  uint8_t null_bytes[2];
+  uint8_t padding[6];
+  int64_t decimal_lo;
+  int64_t decimal_hi;
+  int64_t id;
+  int64_t a;
+  int64_t b;
+  double val;
+  int32_t c;
+  int32_t d;
+  int16_t e;
+  int16_t f;
+  int8_t g;
+  int8_t h;
+};
+
+// The same tuple packed without any padding, with bit-packed null indicators at the
+// front and the decimal in 12 bytes. This layout is only modeled here: tuple layouts
+// are computed by the frontend, which has no compact mode.
+struct __attribute__((packed)) CompactWideTupleStruct {
+  uint8_t null_bytes[2];
+  int64_t decimal_lo;
+  int32_t decimal_hi;
+  int64_t id;
+  int64_t a;
+  int64_t b;
+  double val;
+  int32_t c;
+  int32_t d;
+  int16_t e;
+  int16_t f;
+  int8_t g;
+  int8_t h;
+};
+
+// The null indicator bit of the 'id' slot.
+const uint8_t ID_NULL_BIT = 1 << 2;
+
 struct TestData {
   double result;
   UnpaddedTupleStruct* unpadded_data;
@@ -73,6 +128,10 @@ struct TestData {
   ImpalaTupleStruct* impala_data;
   char* unaligned_data;
   vector<int> rand_access_order;
+
+  int64_t wide_result;
+  ImpalaWideTupleStruct* impala_wide_data;
+  CompactWideTupleStruct* compact_wide_data;
 };
 
 void InitTestData(TestData* data) {
@@ -118,6 +177,19 @@ void InitTestData(TestData* data) {
   DCHECK_EQ(unpadded_ptr,
       data->unaligned_data + NUM_TUPLES * PaddedTupleStruct::UnpaddedSize);
   random_shuffle(data->rand_access_order.begin(), data->rand_access_order.end());
+
+  data->impala_wide_data = reinterpret_cast<ImpalaWideTupleStruct*>(
+      calloc(NUM_TUPLES, sizeof(ImpalaWideTupleStruct)));
+  data->compact_wide_data = reinterpret_cast<CompactWideTupleStruct*>(
+      calloc(NUM_TUPLES, sizeof(CompactWideTupleStruct)));
+  for (int i = 0; i < NUM_TUPLES; ++i) {
+    ImpalaWideTupleStruct* impala = &data->impala_wide_data[i];
+    CompactWideTupleStruct* compact = &data->compact_wide_data[i];
+    impala->null_bytes[0] = compact->null_bytes[0] = (rand() % 10 == 0) ? ID_NULL_BIT : 0;
+    impala->decimal_lo = compact->decimal_lo = rand();
+    impala->id = compact->id = rand() % MAX_ID;
+    impala->val = compact->val = rand() / (double)RAND_MAX;
+  }
 }
 
 
@@ -208,6 +280,55 @@ void TestRandomUnaligned(int batch_size, void* d) {
   }
 }
 
+// Sums the decimal (only its low word, as the values are small) and 'val' of the
+// tuples whose 'id' is not NULL and above MAX_ID / 2.
+template <typename TupleStruct>
+inline void AddWideTuple(const TupleStruct& tuple, TestData* data) {
+  if ((tuple.null_bytes[0] & ID_NULL_BIT) == 0 && tuple.id > MAX_ID / 2) {
+    data->wide_result += tuple.decimal_lo;
+    data->result += tuple.val;
+  }
+}
+
+template <typename TupleStruct>
+void TestSequentialWide(TupleStruct* tuples, int batch_size, TestData* data) {
+  for (int i = 0; i < batch_size; ++i) {
+    data->result = 0;
+    data->wide_result = 0;
+    for (int j = 0; j < NUM_TUPLES; ++j) AddWideTuple(tuples[j], data);
+  }
+}
+
+template <typename TupleStruct>
+void TestRandomWide(TupleStruct* tuples, int batch_size, TestData* data) {
+  for (int i = 0; i < batch_size; ++i) {
+    int* order = &data->rand_access_order[0];
+    data->result = 0;
+    data->wide_result = 0;
+    for (int j = 0; j < NUM_TUPLES; ++j) AddWideTuple(tuples[order[j]], data);
+  }
+}
+
+void TestSequentialImpalaWide(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  TestSequentialWide(data->impala_wide_data, batch_size, data);
+}
+
+void TestSequentialCompactWide(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  TestSequentialWide(data->compact_wide_data, batch_size, data);
+}
+
+void TestRandomImpalaWide(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  TestRandomWide(data->impala_wide_data, batch_size, data);
+}
+
+void TestRandomCompactWide(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  TestRandomWide(data->compact_wide_data, batch_size, data);
+}
+
 int main(int argc, char **argv) {
   CpuInfo::Init();
   cout << Benchmark::GetMachineInfo() << endl;
@@ -215,6 +336,8 @@ int main(int argc, char **argv) {
   DCHECK_EQ(sizeof(UnpaddedTupleStruct), 24);
   DCHECK_EQ(sizeof(PaddedTupleStruct), 32);
   DCHECK_EQ(sizeof(ImpalaTupleStruct), 24);
+  DCHECK_EQ(sizeof(ImpalaWideTupleStruct), 72);
+  DCHECK_EQ(sizeof(CompactWideTupleStruct), 60);
 
   TestData data;
   InitTestData(&data);
@@ -234,6 +357,14 @@ int main(int argc, char **argv) {
   cout << data.result << endl;
   TestRandomUnaligned(1, &data);
   cout << data.result << endl;
+  TestSequentialImpalaWide(1, &data);
+  cout << data.result << " " << data.wide_result << endl;
+  TestSequentialCompactWide(1, &data);
+  cout << data.result << " " << data.wide_result << endl;
+  TestRandomImpalaWide(1, &data);
+  cout << data.result << " " << data.wide_result << endl;
+  TestRandomCompactWide(1, &data);
+  cout << data.result << " " << data.wide_result << endl;
 #else
   Benchmark suite("Tuple Layout");
   suite.AddBenchmark("SequentialPadded", TestSequentialPadded, &data);
@@ -243,6 +374,14 @@ int main(int argc, char **argv) {
   suite.AddBenchmark("RandomImpala", TestRandomImpala, &data);
   suite.AddBenchmark("RandomUnaligned", TestRandomUnaligned, &data);
   cout << suite.Measure();
+
+  Benchmark wide_suite("Wide Tuple Layout");
+  wide_suite.AddBenchmark("SequentialImpala", TestSequentialImpalaWide, &data);
+  wide_suite.AddBenchmark("SequentialCompact", TestSequentialCompactWide, &data);
+  int random_baseline =
+      wide_suite.AddBenchmark("RandomImpala", TestRandomImpalaWide, &data, -1);
+  wide_suite.AddBenchmark("RandomCompact", TestRandomCompactWide, &data, random_baseline);
+  cout << wide_suite.Measure();
 #endif
 
   return 0;
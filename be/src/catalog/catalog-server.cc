@@ -15,11 +15,13 @@
 #include "catalog/catalog-server.h"
 
 #include <gutil/strings/substitute.h>
+#include <snappy.h>
 #include <thrift/protocol/TDebugProtocol.h>
 
 #include "catalog/catalog-util.h"
 #include "statestore/statestore-subscriber.h"
 #include "util/debug-util.h"
+#include "util/hash-util.h"
 #include "gen-cpp/CatalogInternalService_types.h"
 #include "gen-cpp/CatalogObjects_types.h"
 #include "gen-cpp/CatalogService_types.h"
@@ -39,6 +41,8 @@ DECLARE_int32(state_store_subscriber_port);
 DECLARE_int32(state_store_port);
 DECLARE_string(hostname);
 DECLARE_bool(compact_catalog_topic);
+DECLARE_bool(compress_catalog_topic);
+DECLARE_bool(catalog_topic_partition_entries);
 
 string CatalogServer::IMPALA_CATALOG_TOPIC = "catalog-update";
 
@@ -223,6 +227,7 @@ void CatalogServer::UpdateCatalogTopicCallback(
   if (delta.from_version == 0 && delta.to_version == 0 &&
       catalog_objects_min_version_ != 0) {
     catalog_topic_entry_keys_.clear();
+    published_partition_hashes_.clear();
     last_sent_catalog_version_ = 0L;
   } else {
     // Process the pending topic update.
@@ -279,7 +284,7 @@ void CatalogServer::GatherCatalogUpdatesThread() {
         LOG(ERROR) << status.GetDetail();
       } else {
         // Use the catalog objects to build a topic update list.
-        BuildTopicUpdates(catalog_objects.objects);
+        BuildTopicUpdates(&catalog_objects.objects);
         catalog_objects_min_version_ = last_sent_catalog_version_;
         catalog_objects_max_version_ = catalog_objects.max_catalog_version;
       }
@@ -290,11 +295,11 @@ void CatalogServer::GatherCatalogUpdatesThread() {
   }
 }
 
-void CatalogServer::BuildTopicUpdates(const vector<TCatalogObject>& catalog_objects) {
+void CatalogServer::BuildTopicUpdates(vector<TCatalogObject>* catalog_objects) {
   unordered_set<string> current_entry_keys;
 
   // Add any new/updated catalog objects to the topic.
-  for (const TCatalogObject& catalog_object: catalog_objects) {
+  for (TCatalogObject& catalog_object: *catalog_objects) {
     const string& entry_key = TCatalogObjectToEntryKey(catalog_object);
     if (entry_key.empty()) {
       LOG_EVERY_N(WARNING, 60) << "Unable to build topic entry key for TCatalogObject: "
@@ -313,19 +318,36 @@ void CatalogServer::BuildTopicUpdates(const vector<TCatalogObject>& catalog_obje
     VLOG(1) << "Publishing update: " << entry_key << "@"
             << catalog_object.catalog_version;
 
-    pending_topic_updates_.push_back(TTopicItem());
-    TTopicItem& item = pending_topic_updates_.back();
+    // With --catalog_topic_table_markers, only the name and version of a table are
+    // published. Impalads fetch its metadata when they need it, and replace the
+    // metadata they cached with the marker when its version changes.
+    if (!ReplaceWithTableMarker(&catalog_object) &&
+        FLAGS_catalog_topic_partition_entries &&
+        catalog_object.type == TCatalogObjectType::TABLE) {
+      map<int64_t, THdfsPartition> no_partitions;
+      BuildPartitionUpdates(entry_key, catalog_object.table.__isset.hdfs_table ?
+          &catalog_object.table.hdfs_table.partitions : &no_partitions);
+    }
+
+    TTopicItem item;
     item.key = entry_key;
     Status status = thrift_serializer_.Serialize(&catalog_object, &item.value);
     if (!status.ok()) {
       LOG(ERROR) << "Error serializing topic value: " << status.GetDetail();
-      pending_topic_updates_.pop_back();
+      continue;
     }
+    AddPendingTopicUpdate(&item);
   }
 
   // Any remaining items in catalog_topic_entry_keys_ indicate the object was removed
   // since the last update.
   for (const string& key: catalog_topic_entry_keys_) {
+    // Delete the partitions of a dropped table first.
+    map<int64_t, THdfsPartition> no_partitions;
+    if (published_partition_hashes_.find(key) != published_partition_hashes_.end()) {
+      BuildPartitionUpdates(key, &no_partitions);
+      published_partition_hashes_.erase(key);
+    }
     pending_topic_updates_.push_back(TTopicItem());
     TTopicItem& item = pending_topic_updates_.back();
     item.key = key;
@@ -335,6 +357,45 @@ void CatalogServer::BuildTopicUpdates(const vector<TCatalogObject>& catalog_obje
   catalog_topic_entry_keys_.swap(current_entry_keys);
 }
 
+void CatalogServer::BuildPartitionUpdates(const string& table_entry_key,
+    map<int64_t, THdfsPartition>* partitions) {
+  PartitionHashes* published_hashes = &published_partition_hashes_[table_entry_key];
+  PartitionHashes current_hashes;
+  for (map<int64_t, THdfsPartition>::value_type& partition: *partitions) {
+    TTopicItem item;
+    item.key = HdfsPartitionEntryKey(table_entry_key, partition.first);
+    Status status = thrift_serializer_.Serialize(&partition.second, &item.value);
+    if (!status.ok()) {
+      LOG(ERROR) << "Error serializing topic value: " << status.GetDetail();
+      continue;
+    }
+    uint64_t hash = HashUtil::MurmurHash2_64(item.value.data(), item.value.size(), 0);
+    current_hashes[partition.first] = hash;
+    PartitionHashes::const_iterator published = published_hashes->find(partition.first);
+    if (published != published_hashes->end() && published->second == hash) continue;
+    AddPendingTopicUpdate(&item);
+  }
+  for (const PartitionHashes::value_type& published: *published_hashes) {
+    if (current_hashes.find(published.first) != current_hashes.end()) continue;
+    pending_topic_updates_.push_back(TTopicItem());
+    pending_topic_updates_.back().key =
+        HdfsPartitionEntryKey(table_entry_key, published.first);
+  }
+  published_hashes->swap(current_hashes);
+  partitions->clear();
+}
+
+void CatalogServer::AddPendingTopicUpdate(TTopicItem* item) {
+  if (FLAGS_compress_catalog_topic) {
+    string compressed_value;
+    snappy::Compress(item->value.data(), item->value.size(), &compressed_value);
+    item->value.swap(compressed_value);
+  }
+  pending_topic_updates_.push_back(TTopicItem());
+  pending_topic_updates_.back().key.swap(item->key);
+  pending_topic_updates_.back().value.swap(item->value);
+}
+
 void CatalogServer::CatalogUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
   TGetDbsResult get_dbs_result;
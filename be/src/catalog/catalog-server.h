@@ -19,6 +19,7 @@
 #include <vector>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 
 #include "gen-cpp/CatalogService.h"
@@ -91,6 +92,12 @@ class CatalogServer {
   /// since the last heartbeat.
   boost::unordered_set<std::string> catalog_topic_entry_keys_;
 
+  /// If --catalog_topic_partition_entries is true, the hashes of the serialized
+  /// partitions last published for each HDFS table, by the topic entry key of the table
+  /// and the partition id. Used to only publish the partitions that changed.
+  typedef boost::unordered_map<int64_t, uint64_t> PartitionHashes;
+  boost::unordered_map<std::string, PartitionHashes> published_partition_hashes_;
+
   /// Protects catalog_update_cv_, pending_topic_updates_,
   /// catalog_objects_to/from_version_, and last_sent_catalog_version.
   boost::mutex catalog_lock_;
@@ -163,7 +170,21 @@ class CatalogServer {
   /// are unique, as well as helps to determine what object type was removed in a state
   /// store delta update (since the state store only sends key names for deleted items).
   /// Must hold catalog_lock_ when calling this function.
-  void BuildTopicUpdates(const std::vector<TCatalogObject>& catalog_objects);
+  /// Moves the partitions of HDFS tables out of 'catalog_objects' if
+  /// --catalog_topic_partition_entries is true.
+  void BuildTopicUpdates(std::vector<TCatalogObject>* catalog_objects);
+
+  /// Adds the partitions in 'partitions' of the table with topic entry key
+  /// 'table_entry_key' that changed since they were last published to
+  /// pending_topic_updates_, as separate entries, as well as deletions of the
+  /// partitions that no longer exist. Clears 'partitions'.
+  /// Must hold catalog_lock_ when calling this function.
+  void BuildPartitionUpdates(const std::string& table_entry_key,
+      std::map<int64_t, THdfsPartition>* partitions);
+
+  /// Moves 'item', whose value is a serialized catalog object or partition, to
+  /// pending_topic_updates_, compressing its value if --compress_catalog_topic is true.
+  void AddPendingTopicUpdate(TTopicItem* item);
 
   /// Example output:
   /// "databases": [
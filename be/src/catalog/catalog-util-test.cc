@@ -0,0 +1,89 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catalog/catalog-util.h"
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+
+#include "common/names.h"
+
+DECLARE_bool(catalog_topic_table_markers);
+
+namespace impala {
+
+TCatalogObject MakeTable() {
+  TCatalogObject table;
+  table.__set_type(TCatalogObjectType::TABLE);
+  table.__set_catalog_version(7);
+  table.table.__set_db_name("db");
+  table.table.__set_tbl_name("tbl");
+  table.table.__set_id(42);
+  table.table.__set_load_status(TStatus());
+  table.__isset.table = true;
+  return table;
+}
+
+TEST(CatalogUtilTest, EntryKeys) {
+  TCatalogObject table = MakeTable();
+  string table_key = TCatalogObjectToEntryKey(table);
+  EXPECT_EQ(table_key, "TABLE:db.tbl");
+
+  string partition_key = HdfsPartitionEntryKey(table_key, 3);
+  EXPECT_EQ(partition_key, "HDFS_PARTITION:db.tbl:3");
+  string parsed_key;
+  int64_t partition_id;
+  EXPECT_TRUE(ParseHdfsPartitionEntryKey(partition_key, &parsed_key, &partition_id));
+  EXPECT_EQ(parsed_key, table_key);
+  EXPECT_EQ(partition_id, 3);
+  EXPECT_FALSE(ParseHdfsPartitionEntryKey(table_key, &parsed_key, &partition_id));
+}
+
+// By default, the catalog topic carries the full table objects.
+TEST(CatalogUtilTest, NoTableMarkersByDefault) {
+  ASSERT_FALSE(FLAGS_catalog_topic_table_markers);
+  TCatalogObject table = MakeTable();
+  EXPECT_FALSE(ReplaceWithTableMarker(&table));
+  EXPECT_TRUE(table == MakeTable());
+}
+
+TEST(CatalogUtilTest, TableMarkers) {
+  FLAGS_catalog_topic_table_markers = true;
+  TCatalogObject table = MakeTable();
+  EXPECT_TRUE(ReplaceWithTableMarker(&table));
+  EXPECT_EQ(table.type, TCatalogObjectType::TABLE);
+  EXPECT_EQ(table.catalog_version, 7);
+  EXPECT_EQ(table.table.db_name, "db");
+  EXPECT_EQ(table.table.tbl_name, "tbl");
+  EXPECT_FALSE(table.table.__isset.id);
+  EXPECT_FALSE(table.table.__isset.load_status);
+
+  // Objects other than tables are published as they are.
+  TCatalogObject db;
+  db.__set_type(TCatalogObjectType::DATABASE);
+  db.__set_catalog_version(8);
+  db.db.__set_db_name("db");
+  db.__isset.db = true;
+  TCatalogObject db_copy = db;
+  EXPECT_FALSE(ReplaceWithTableMarker(&db));
+  EXPECT_TRUE(db == db_copy);
+  FLAGS_catalog_topic_table_markers = false;
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -14,18 +14,26 @@
 
 
 #include <boost/algorithm/string.hpp>
+#include <gflags/gflags.h>
 #include <sstream>
 
 #include "catalog/catalog-util.h"
 #include "common/status.h"
 #include "util/debug-util.h"
+#include "util/string-parser.h"
 
 #include "common/names.h"
 
+DECLARE_bool(catalog_topic_table_markers);
+
 using boost::algorithm::to_upper_copy;
 
 namespace impala {
 
+// Prefixes of the topic entry keys of tables and of their partitions.
+static const string TABLE_KEY_PREFIX = "TABLE:";
+static const string HDFS_PARTITION_KEY_PREFIX = "HDFS_PARTITION:";
+
 TCatalogObjectType::type TCatalogObjectTypeFromName(const string& name) {
   const string& upper = to_upper_copy(name);
   if (upper == "DATABASE") {
@@ -184,5 +192,43 @@ string TCatalogObjectToEntryKey(const TCatalogObject& catalog_object) {
   return entry_key.str();
 }
 
+string HdfsPartitionEntryKey(const string& table_entry_key, int64_t partition_id) {
+  DCHECK_EQ(table_entry_key.compare(0, TABLE_KEY_PREFIX.size(), TABLE_KEY_PREFIX), 0);
+  stringstream entry_key;
+  entry_key << HDFS_PARTITION_KEY_PREFIX
+            << table_entry_key.substr(TABLE_KEY_PREFIX.size()) << ":" << partition_id;
+  return entry_key.str();
+}
+
+bool ParseHdfsPartitionEntryKey(const string& key, string* table_entry_key,
+    int64_t* partition_id) {
+  if (key.compare(0, HDFS_PARTITION_KEY_PREFIX.size(), HDFS_PARTITION_KEY_PREFIX) != 0) {
+    return false;
+  }
+  size_t pos = key.rfind(":");
+  if (pos == string::npos || pos < HDFS_PARTITION_KEY_PREFIX.size()) return false;
+  StringParser::ParseResult result;
+  *partition_id = StringParser::StringToInt<int64_t>(
+      key.data() + pos + 1, key.size() - pos - 1, &result);
+  if (result != StringParser::PARSE_SUCCESS) return false;
+  size_t name_start = HDFS_PARTITION_KEY_PREFIX.size();
+  *table_entry_key = TABLE_KEY_PREFIX + key.substr(name_start, pos - name_start);
+  return true;
+}
+
+bool ReplaceWithTableMarker(TCatalogObject* catalog_object) {
+  if (!FLAGS_catalog_topic_table_markers ||
+      catalog_object->type != TCatalogObjectType::TABLE) {
+    return false;
+  }
+  TCatalogObject marker;
+  marker.__set_type(TCatalogObjectType::TABLE);
+  marker.__set_catalog_version(catalog_object->catalog_version);
+  marker.table.__set_db_name(catalog_object->table.db_name);
+  marker.table.__set_tbl_name(catalog_object->table.tbl_name);
+  marker.__isset.table = true;
+  *catalog_object = marker;
+  return true;
+}
 
 }
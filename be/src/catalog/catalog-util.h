@@ -48,6 +48,24 @@ Status TCatalogObjectFromObjectName(const TCatalogObjectType::type& object_type,
 /// Returns an empty string if there were any problem building the key.
 std::string TCatalogObjectToEntryKey(const TCatalogObject& catalog_object);
 
+/// Builds and returns the topic entry key of the partition with the given id of the HDFS
+/// table with topic entry key 'table_entry_key'. Partitions are published as separate
+/// topic entries if --catalog_topic_partition_entries is true. The key format is:
+/// "HDFS_PARTITION:<fully qualified table name>:<partition id>"
+std::string HdfsPartitionEntryKey(const std::string& table_entry_key,
+    int64_t partition_id);
+
+/// Returns true if 'key' is a topic entry key built by HdfsPartitionEntryKey(), in which
+/// case 'table_entry_key' and 'partition_id' are set to the arguments it was built from.
+bool ParseHdfsPartitionEntryKey(const std::string& key, std::string* table_entry_key,
+    int64_t* partition_id);
+
+/// If --catalog_topic_table_markers is true and 'catalog_object' is a table, replaces it
+/// with a marker that only has the type, catalog version and name of the table, which is
+/// what the catalog topic carries for tables in that mode. Returns true if
+/// 'catalog_object' was replaced.
+bool ReplaceWithTableMarker(TCatalogObject* catalog_object);
+
 }
 
 #endif
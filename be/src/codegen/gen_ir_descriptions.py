@@ -38,8 +38,6 @@ options, args = parser.parse_args()
 # be a substring of the actual, mangled compiler generated name.
 # TODO: should we work out the mangling rules?
 ir_functions = [
-  ["AGG_NODE_PROCESS_ROW_BATCH_WITH_GROUPING", "ProcessRowBatchWithGrouping"],
-  ["AGG_NODE_PROCESS_ROW_BATCH_NO_GROUPING", "ProcessRowBatchNoGrouping"],
   ["PART_AGG_NODE_PROCESS_BATCH_UNAGGREGATED",
       "PartitionedAggregationNode12ProcessBatchILb0"],
   ["PART_AGG_NODE_PROCESS_BATCH_AGGREGATED",
@@ -71,8 +69,7 @@ ir_functions = [
   ["HASH_CRC", "IrCrcHash"],
   ["HASH_FNV", "IrFnvHash"],
   ["HASH_MURMUR", "IrMurmurHash"],
-  ["HASH_JOIN_PROCESS_BUILD_BATCH", "12HashJoinNode17ProcessBuildBatch"],
-  ["HASH_JOIN_PROCESS_PROBE_BATCH", "12HashJoinNode17ProcessProbeBatch"],
+  ["HASH_MURMUR_64TO32", "IrMurmurHash64to32"],
   ["PHJ_PROCESS_BUILD_BATCH", "23PartitionedHashJoinNode17ProcessBuildBatch"],
   ["PHJ_PROCESS_PROBE_BATCH_INNER_JOIN", "ProcessProbeBatchILi0"],
   ["PHJ_PROCESS_PROBE_BATCH_LEFT_OUTER_JOIN", "ProcessProbeBatchILi1"],
@@ -115,10 +112,16 @@ ir_functions = [
   ["STRING_TO_INT64", "IrStringToInt64"],
   ["STRING_TO_FLOAT", "IrStringToFloat"],
   ["STRING_TO_DOUBLE", "IrStringToDouble"],
+  ["STRING_TO_TIMESTAMP", "IrStringToTimestamp"],
+  ["STRING_TO_DECIMAL4", "IrStringToDecimal4"],
+  ["STRING_TO_DECIMAL8", "IrStringToDecimal8"],
+  ["STRING_TO_DECIMAL16", "IrStringToDecimal16"],
   ["IS_NULL_STRING", "IrIsNullString"],
   ["GENERIC_IS_NULL_STRING", "IrGenericIsNullString"],
   ["RAW_VALUE_COMPARE", "8RawValue7Compare"],
   ["TOPN_NODE_INSERT_BATCH", "TopNNode11InsertBatch"],
+  ["UNION_NODE_MATERIALIZE_BATCH", "UnionNode16MaterializeBatch"],
+  ["ANALYTIC_EVAL_NODE_PROCESS_CHILD_BATCH", "AnalyticEvalNode17ProcessChildBatch"],
   ["MEMPOOL_ALLOCATE", "MemPool8AllocateILb0"],
   ["MEMPOOL_CHECKED_ALLOCATE", "MemPool8AllocateILb1"],
 ]
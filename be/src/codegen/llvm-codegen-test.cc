@@ -29,6 +29,8 @@
 using namespace llvm;
 using std::unique_ptr;
 
+DECLARE_int64(codegen_cache_capacity);
+
 namespace impala {
 
 class LlvmCodeGenTest : public testing:: Test {
@@ -81,6 +83,10 @@ class LlvmCodeGenTest : public testing:: Test {
     return codegen->FinalizeModule();
   }
 
+  static int64_t NumCacheHits(LlvmCodeGen* codegen) {
+    return codegen->num_cache_hits_->value();
+  }
+
 };
 
 // Simple test to just make and destroy llvmcodegen objects.  LLVM
@@ -449,11 +455,46 @@ TEST_F(LlvmCodeGenTest, HashTest) {
   CpuInfo::EnableFeature(CpuInfo::SSE4_2, restore_sse_support);
 }
 
+// Test that an identical module uses the object compiled for the first one.
+TEST_F(LlvmCodeGenTest, CompiledObjectCache) {
+  ObjectPool pool;
+  for (int i = 0; i < 2; ++i) {
+    scoped_ptr<LlvmCodeGen> codegen;
+    ASSERT_OK(LlvmCodeGen::CreateImpalaCodegen(&pool, "test", &codegen));
+    codegen->EnableOptimizations(true);
+
+    LlvmCodeGen::FnPrototype prototype(codegen.get(), "CachedMemcpy",
+        codegen->void_type());
+    prototype.AddArgument(LlvmCodeGen::NamedVariable("dest", codegen->ptr_type()));
+    prototype.AddArgument(LlvmCodeGen::NamedVariable("src", codegen->ptr_type()));
+    LlvmCodeGen::LlvmBuilder builder(codegen->context());
+    Value* args[2];
+    Function* fn = prototype.GeneratePrototype(&builder, &args[0]);
+    codegen->CodegenMemcpy(&builder, args[0], args[1], 4);
+    builder.CreateRetVoid();
+    fn = codegen->FinalizeFunction(fn);
+    ASSERT_TRUE(fn != NULL);
+
+    void* jitted_fn = NULL;
+    LlvmCodeGenTest::AddFunctionToJit(codegen.get(), fn, &jitted_fn);
+    ASSERT_OK(LlvmCodeGenTest::FinalizeModule(codegen.get()));
+    ASSERT_TRUE(jitted_fn != NULL);
+    EXPECT_EQ(i, LlvmCodeGenTest::NumCacheHits(codegen.get()));
+
+    char src[] = "abcd";
+    char dst[] = "aaaa";
+    typedef void (*CachedMemcpyFn)(char*, char*);
+    reinterpret_cast<CachedMemcpyFn>(jitted_fn)(dst, src);
+    EXPECT_EQ(memcmp(src, dst, 4), 0);
+  }
+}
+
 }
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   impala::InitCommonRuntime(argc, argv, false, impala::TestInfo::BE_TEST);
+  FLAGS_codegen_cache_capacity = 1024 * 1024;
   impala::LlvmCodeGen::InitializeLlvm();
   return RUN_ALL_TESTS();
 }
@@ -28,6 +28,7 @@
 #include <llvm/Bitcode/ReaderWriter.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
 #include <llvm/IR/DataLayout.h>
 #include "llvm/IR/Function.h"
 #include "llvm/IR/InstIterator.h"
@@ -47,6 +48,7 @@
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 #include <llvm/Transforms/Utils/Cloning.h>
 
+#include "common/atomic.h"
 #include "common/logging.h"
 #include "codegen/codegen-anyval.h"
 #include "codegen/codegen-symbol-emitter.h"
@@ -57,6 +59,7 @@
 #include "runtime/hdfs-fs-cache.h"
 #include "util/cpu-info.h"
 #include "util/hdfs-util.h"
+#include "util/impalad-metrics.h"
 #include "util/path-builder.h"
 #include "util/test-info.h"
 
@@ -82,6 +85,20 @@ DEFINE_string(opt_module_dir, "",
     "if set, saves optimized generated IR modules to the specified directory.");
 DEFINE_string(asm_module_dir, "",
     "if set, saves disassembly for generated IR modules to the specified directory.");
+DEFINE_int64(codegen_cache_capacity, 0, "(Advanced) Maximum number of bytes of "
+    "bitcode and compiled objects of codegen'd modules kept in a process-wide cache, so "
+    "that fragment instances that generate identical code skip its optimization and "
+    "compilation. If 0, the cache is disabled.");
+DEFINE_bool(async_codegen, false, "(Advanced) If true, fragments start executing the "
+    "interpreted code paths while their codegen'd module is optimized and compiled in a "
+    "separate thread, and switch to the jitted functions once they are ready. Fragments "
+    "with functions that cannot be interpreted, e.g. IR UDFs, still wait for codegen.");
+DEFINE_int64(codegen_opt_level_1_instructions, 0, "(Advanced) Modules with at least "
+    "this many instructions after pruning unused functions are optimized at -O1 instead "
+    "of -O2, only inlining functions that must be inlined. If 0, this tier is disabled.");
+DEFINE_int64(codegen_opt_level_0_instructions, 0, "(Advanced) Modules with at least "
+    "this many instructions after pruning unused functions are not optimized beyond "
+    "inlining functions that must be inlined. If 0, this tier is disabled.");
 DECLARE_string(local_library_dir);
 
 namespace impala {
@@ -126,12 +143,53 @@ void LlvmCodeGen::InitializeLlvm(bool load_backend) {
   if (FLAGS_perf_map) CodegenSymbolEmitter::WritePerfMap();
 }
 
+class LlvmCodeGen::ModuleObjectCache : public llvm::ObjectCache {
+ public:
+  // 'cached_object' is the object found in 'cache' for 'module_bitcode', if any.
+  ModuleObjectCache(CompiledObjectCache* cache, const string& module_bitcode,
+      const CompiledObjectCache::ValuePtr& cached_object)
+    : cache_(cache), module_bitcode_(module_bitcode), cached_object_(cached_object) {}
+
+  // Called by the execution engine after it compiled the module.
+  // The charge includes the key twice, since the cache stores it in its map and list.
+  virtual void notifyObjectCompiled(const Module* module,
+      MemoryBufferRef object) override {
+    cache_->Put(module_bitcode_, CompiledObjectCache::ValuePtr(
+        new string(object.getBufferStart(), object.getBufferSize())),
+        2 * module_bitcode_.size() + object.getBufferSize());
+    if (ImpaladMetrics::CODEGEN_CACHE_NUM_ENTRIES != NULL) {
+      ImpaladMetrics::CODEGEN_CACHE_NUM_ENTRIES->set_value(cache_->size());
+      ImpaladMetrics::CODEGEN_CACHE_TOTAL_BYTES->set_value(cache_->total_charge());
+    }
+  }
+
+  // Called by the execution engine before it compiles the module. Returns a copy of
+  // the cached object, which the execution engine keeps for its lifetime, or NULL to
+  // compile the module.
+  virtual unique_ptr<MemoryBuffer> getObject(const Module* module) override {
+    if (cached_object_ == NULL) return unique_ptr<MemoryBuffer>();
+    return MemoryBuffer::getMemBufferCopy(*cached_object_);
+  }
+
+ private:
+  CompiledObjectCache* const cache_;
+  const string module_bitcode_;
+  const CompiledObjectCache::ValuePtr cached_object_;
+};
+
+LlvmCodeGen::CompiledObjectCache* LlvmCodeGen::GetCompiledObjectCache() {
+  static CompiledObjectCache* cache = FLAGS_codegen_cache_capacity > 0 ?
+      new CompiledObjectCache(FLAGS_codegen_cache_capacity) : NULL;
+  return cache;
+}
+
 LlvmCodeGen::LlvmCodeGen(ObjectPool* pool, const string& id) :
   id_(id),
   profile_(pool, "CodeGen"),
   optimizations_enabled_(false),
   is_corrupt_(false),
   is_compiled_(false),
+  requires_sync_finalize_(false),
   context_(new llvm::LLVMContext()),
   module_(NULL) {
 
@@ -139,10 +197,14 @@ LlvmCodeGen::LlvmCodeGen(ObjectPool* pool, const string& id) :
 
   load_module_timer_ = ADD_TIMER(&profile_, "LoadTime");
   prepare_module_timer_ = ADD_TIMER(&profile_, "PrepareTime");
+  lib_cache_timer_ = ADD_TIMER(&profile_, "LibCacheTime");
+  link_module_timer_ = ADD_TIMER(&profile_, "LinkTime");
   module_bitcode_size_ = ADD_COUNTER(&profile_, "ModuleBitcodeSize", TUnit::BYTES);
   codegen_timer_ = ADD_TIMER(&profile_, "CodegenTime");
   optimization_timer_ = ADD_TIMER(&profile_, "OptimizationTime");
   compile_timer_ = ADD_TIMER(&profile_, "CompileTime");
+  num_cache_hits_ = ADD_COUNTER(&profile_, "NumCacheHits", TUnit::UNIT);
+  opt_level_ = ADD_COUNTER(&profile_, "OptimizationLevel", TUnit::UNIT);
   num_functions_ = ADD_COUNTER(&profile_, "NumFunctions", TUnit::UNIT);
   num_instructions_ = ADD_COUNTER(&profile_, "NumInstructions", TUnit::UNIT);
 
@@ -221,17 +283,32 @@ Status LlvmCodeGen::LinkModule(const string& file) {
   SCOPED_TIMER(profile_.total_time_counter());
   unique_ptr<Module> new_module;
   RETURN_IF_ERROR(LoadModuleFromFile(file, &new_module));
+  return LinkLoadedModule(file, std::move(new_module));
+}
+
+Status LlvmCodeGen::LinkModuleFromMemory(MemoryBufferRef module_ir,
+    const string& module_name) {
+  if (linked_modules_.find(module_name) != linked_modules_.end()) return Status::OK();
+
+  SCOPED_TIMER(profile_.total_time_counter());
+  unique_ptr<Module> new_module;
+  RETURN_IF_ERROR(LoadModuleFromMemory(module_ir, module_name, &new_module));
+  return LinkLoadedModule(module_name, std::move(new_module));
+}
 
+Status LlvmCodeGen::LinkLoadedModule(const string& module_name,
+    unique_ptr<Module> new_module) {
+  SCOPED_TIMER(link_module_timer_);
   // The module data layout must match the one selected by the execution engine.
   new_module->setDataLayout(execution_engine_->getDataLayout());
 
   bool error = Linker::linkModules(*module_, std::move(new_module));
   if (error) {
     stringstream ss;
-    ss << "Problem linking " << file << " to main module.";
+    ss << "Problem linking " << module_name << " to main module.";
     return Status(ss.str());
   }
-  linked_modules_.insert(file);
+  linked_modules_.insert(module_name);
   return Status::OK();
 }
 
@@ -722,7 +799,36 @@ Status LlvmCodeGen::FinalizeModule() {
   // if the codegen object is created but no functions are successfully codegen'd.
   if (fns_to_jit_compile_.empty()) return Status::OK();
 
-  if (optimizations_enabled_ && !FLAGS_disable_optimization_passes) OptimizeModule();
+  bool optimize = optimizations_enabled_ && !FLAGS_disable_optimization_passes;
+  if (optimize) PruneModule();
+
+  // Look up the object of an identical module in the cache. Only pruned modules are
+  // cached, the bitcode of the whole Impala IR module would be too large a key.
+  CompiledObjectCache* cache = optimize ? GetCompiledObjectCache() : NULL;
+  scoped_ptr<ModuleObjectCache> module_object_cache;
+  bool is_cache_hit = false;
+  if (cache != NULL) {
+    string module_bitcode;
+    raw_string_ostream stream(module_bitcode);
+    WriteBitcodeToFile(module_, stream);
+    stream.flush();
+    CompiledObjectCache::ValuePtr cached_object;
+    is_cache_hit = cache->Get(module_bitcode, &cached_object);
+    if (is_cache_hit) {
+      COUNTER_ADD(num_cache_hits_, 1);
+      if (ImpaladMetrics::CODEGEN_CACHE_HIT_COUNT != NULL) {
+        ImpaladMetrics::CODEGEN_CACHE_HIT_COUNT->Increment(1L);
+      }
+    } else if (ImpaladMetrics::CODEGEN_CACHE_MISS_COUNT != NULL) {
+      ImpaladMetrics::CODEGEN_CACHE_MISS_COUNT->Increment(1L);
+    }
+    module_object_cache.reset(
+        new ModuleObjectCache(cache, module_bitcode, cached_object));
+    execution_engine_->setObjectCache(module_object_cache.get());
+  }
+
+  // The cached object was compiled from the optimized module.
+  if (optimize && !is_cache_hit) OptimizeModule();
 
   if (FLAGS_opt_module_dir.size() != 0) {
     string path = FLAGS_opt_module_dir + "/" + id_ + "_opt.ll";
@@ -737,37 +843,27 @@ Status LlvmCodeGen::FinalizeModule() {
 
   {
     SCOPED_TIMER(compile_timer_);
-    // Finalize module, which compiles all functions.
+    // Finalize module, which compiles all functions or loads the cached object.
     execution_engine_->finalizeObject();
   }
+  if (module_object_cache != NULL) execution_engine_->setObjectCache(NULL);
 
-  // Get pointers to all codegen'd functions.
+  // Get pointers to all codegen'd functions. They are published with release stores,
+  // since the fragment may already be reading them with --async_codegen.
   for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
     Function* function = fns_to_jit_compile_[i].first;
     void* jitted_function = execution_engine_->getPointerToFunction(function);
     DCHECK(jitted_function != NULL) << "Failed to jit " << function->getName().data();
-    *fns_to_jit_compile_[i].second = jitted_function;
+    base::subtle::Release_Store(
+        reinterpret_cast<volatile base::subtle::Atomic64*>(fns_to_jit_compile_[i].second),
+        reinterpret_cast<base::subtle::Atomic64>(jitted_function));
   }
   return Status::OK();
 }
 
-void LlvmCodeGen::OptimizeModule() {
+void LlvmCodeGen::PruneModule() {
   SCOPED_TIMER(optimization_timer_);
 
-  // This pass manager will construct optimizations passes that are "typical" for
-  // c/c++ programs.  We're relying on llvm to pick the best passes for us.
-  // TODO: we can likely muck with this to get better compile speeds or write
-  // our own passes.  Our subexpression elimination optimization can be rolled into
-  // a pass.
-  PassManagerBuilder pass_builder;
-  // 2 maps to -O2
-  // TODO: should we switch to 3? (3 may not produce different IR than 2 while taking
-  // longer, but we should check)
-  pass_builder.OptLevel = 2;
-  // Don't optimize for code size (this corresponds to -O2/-O3)
-  pass_builder.SizeLevel = 0;
-  pass_builder.Inliner = createFunctionInliningPass();
-
   // The TargetIRAnalysis pass is required to provide information about the target
   // machine to optimisation passes, e.g. the cost model.
   TargetIRAnalysis target_analysis =
@@ -794,6 +890,41 @@ void LlvmCodeGen::OptimizeModule() {
   counter.visit(*module_);
   COUNTER_SET(num_functions_, counter.GetCount(InstructionCounter::TOTAL_FUNCTIONS));
   COUNTER_SET(num_instructions_, counter.GetCount(InstructionCounter::TOTAL_INSTS));
+}
+
+void LlvmCodeGen::OptimizeModule() {
+  SCOPED_TIMER(optimization_timer_);
+
+  // This pass manager will construct optimizations passes that are "typical" for
+  // c/c++ programs.  We're relying on llvm to pick the best passes for us.
+  // TODO: we can likely muck with this to get better compile speeds or write
+  // our own passes.  Our subexpression elimination optimization can be rolled into
+  // a pass.
+  PassManagerBuilder pass_builder;
+  // 2 maps to -O2
+  // TODO: should we switch to 3? (3 may not produce different IR than 2 while taking
+  // longer, but we should check)
+  pass_builder.OptLevel = 2;
+  // Large modules, e.g. with wide CASE exprs or for inserts into wide tables, can take
+  // seconds to optimize at -O2, so they are optimized at a lower level. Functions marked
+  // AlwaysInline, which includes the cross-compiled functions whose calls are replaced
+  // by codegen, are still inlined.
+  int64_t num_instructions = num_instructions_->value();
+  if (FLAGS_codegen_opt_level_0_instructions > 0 &&
+      num_instructions >= FLAGS_codegen_opt_level_0_instructions) {
+    pass_builder.OptLevel = 0;
+  } else if (FLAGS_codegen_opt_level_1_instructions > 0 &&
+      num_instructions >= FLAGS_codegen_opt_level_1_instructions) {
+    pass_builder.OptLevel = 1;
+  }
+  COUNTER_SET(opt_level_, static_cast<int64_t>(pass_builder.OptLevel));
+  // Don't optimize for code size (this corresponds to -O2/-O3)
+  pass_builder.SizeLevel = 0;
+  pass_builder.Inliner = pass_builder.OptLevel == 2 ?
+      createFunctionInliningPass() : createAlwaysInlinerPass();
+
+  TargetIRAnalysis target_analysis =
+      execution_engine_->getTargetMachine()->getTargetIRAnalysis();
 
   // Create and run function pass manager
   unique_ptr<legacy::FunctionPassManager> fn_pass_manager(
@@ -807,7 +938,7 @@ void LlvmCodeGen::OptimizeModule() {
   fn_pass_manager->doFinalization();
 
   // Create and run module pass manager
-  module_pass_manager.reset(new legacy::PassManager());
+  unique_ptr<legacy::PassManager> module_pass_manager(new legacy::PassManager());
   module_pass_manager->add(createTargetTransformInfoWrapperPass(target_analysis));
   pass_builder.populateModulePassManager(*module_pass_manager);
   module_pass_manager->run(*module_);
@@ -1200,6 +1331,10 @@ Function* LlvmCodeGen::GetMurmurHashFunction(int len) {
   return GetLenOptimizedHashFn(this, IRFunction::HASH_MURMUR, len);
 }
 
+Function* LlvmCodeGen::GetMurmurHash64to32Function(int len) {
+  return GetLenOptimizedHashFn(this, IRFunction::HASH_MURMUR_64TO32, len);
+}
+
 void LlvmCodeGen::ReplaceInstWithValue(Instruction* from, Value* to) {
   BasicBlock::iterator iter(from);
   llvm::ReplaceInstWithValue(from->getParent()->getInstList(), iter, to);
@@ -16,6 +16,7 @@
 #ifndef IMPALA_CODEGEN_LLVM_CODEGEN_H
 #define IMPALA_CODEGEN_LLVM_CODEGEN_H
 
+#include "common/atomic.h"
 #include "common/status.h"
 
 #include <map>
@@ -37,6 +38,7 @@
 #include "exprs/expr.h"
 #include "impala-ir/impala-ir-functions.h"
 #include "runtime/types.h"
+#include "util/lru-cache.h"
 #include "util/runtime-profile.h"
 
 /// Forward declare all llvm classes to avoid namespace pollution.
@@ -102,6 +104,12 @@ class SubExprElimination;
 /// TODO: we should be able to do this once per process and let llvm compile
 /// functions from across modules.
 //
+/// The optimization and compilation of the module, which dominate the codegen time, are
+/// skipped if an identical module was compiled before and its object is still in the
+/// process-wide cache enabled by --codegen_cache_capacity. Modules are identical if
+/// their bitcode after pruning unused functions is, including any pointers and
+/// constants baked into the code, so cached objects are never used for different IR.
+//
 /// LLVM has a nontrivial memory management scheme and objects will take
 /// ownership of others.  The document is pretty good about being explicit with this
 /// but it is not very intuitive.
@@ -130,11 +138,18 @@ class LlvmCodeGen {
   static Status CreateFromFile(ObjectPool*, const std::string& file, const std::string& id,
       boost::scoped_ptr<LlvmCodeGen>* codegen);
 
+  /// Creates a LlvmCodeGen instance initialized with the module bitcode from 'module_ir'.
+  /// 'codegen' will contain the created object on success.
+  static Status CreateFromMemory(ObjectPool* pool, llvm::MemoryBufferRef module_ir,
+      const std::string& module_name, const std::string& id,
+      boost::scoped_ptr<LlvmCodeGen>* codegen);
+
   /// Removes all jit compiled dynamically linked functions from the process.
   ~LlvmCodeGen();
 
   RuntimeProfile* runtime_profile() { return &profile_; }
   RuntimeProfile::Counter* codegen_timer() { return codegen_timer_; }
+  RuntimeProfile::Counter* lib_cache_timer() { return lib_cache_timer_; }
 
   /// Turns on/off optimization passes
   void EnableOptimizations(bool enable);
@@ -211,7 +226,7 @@ class LlvmCodeGen {
   /// compiled IR.  The types we generate at runtime are unnamed.
   /// The name is generated by the clang compiler in this form:
   /// <class/struct>.<namespace>::<class name>.  For example:
-  /// "class.impala::AggregationNode"
+  /// "class.impala::HashTableCtx"
   llvm::Type* GetType(const std::string& name);
 
   /// Returns the pointer type of the type returned by GetType(name)
@@ -248,8 +263,18 @@ class LlvmCodeGen {
   /// Optimize and compile the module. This should be called after all functions to JIT
   /// have been added to the module via AddFunctionToJit(). If optimizations_enabled_ is
   /// false, the module will not be optimized before compilation.
+  /// With --async_codegen, this may be called in a separate thread while the fragment
+  /// already executes the interpreted code paths. The function pointers registered with
+  /// AddFunctionToJit() are therefore set with release stores once all functions are
+  /// compiled, so that concurrent readers see either NULL or the jitted function.
   Status FinalizeModule();
 
+  /// Records that a function registered with AddFunctionToJit() has no interpreted
+  /// fallback, e.g. an IR UDF, so the fragment must not execute before FinalizeModule()
+  /// returns.
+  void RequireSyncFinalize() { requires_sync_finalize_ = true; }
+  bool requires_sync_finalize() const { return requires_sync_finalize_; }
+
   /// Replaces all instructions in 'caller' that call 'target_name' with a call
   /// instruction to 'new_fn'. Returns the number of call sites updated.
   ///
@@ -293,6 +318,17 @@ class LlvmCodeGen {
   /// call non-compliant code from native code.
   void AddFunctionToJit(llvm::Function* fn, void** fn_ptr);
 
+  /// Returns the function pointer set by FinalizeModule() for a function registered
+  /// with AddFunctionToJit(), or NULL if it is not compiled yet. Uses an acquire load,
+  /// since with --async_codegen FinalizeModule() may run concurrently. The pointers are
+  /// published in registration order, so if the pointer of a function is not NULL, the
+  /// pointers of all functions registered before it are not NULL either.
+  template <typename Fn>
+  static Fn LoadJittedFunction(Fn* fn_ptr) {
+    return reinterpret_cast<Fn>(base::subtle::Acquire_Load(
+        reinterpret_cast<volatile const base::subtle::Atomic64*>(fn_ptr)));
+  }
+
   /// This will generate a printf call instruction to output 'message' at the builder's
   /// insert point. If 'v1' is non-NULL, it will also be passed to the printf call. Only
   /// for debugging.
@@ -327,6 +363,8 @@ class LlvmCodeGen {
   llvm::Function* GetHashFunction(int num_bytes = -1);
   llvm::Function* GetFnvHashFunction(int num_bytes = -1);
   llvm::Function* GetMurmurHashFunction(int num_bytes = -1);
+  /// Same as above for HashUtil::MurmurHash2_64to32().
+  llvm::Function* GetMurmurHash64to32Function(int num_bytes = -1);
 
   /// Allocate stack storage for local variables.  This is similar to traditional c, where
   /// all the variables must be declared at the top of the function.  This helper can be
@@ -414,6 +452,11 @@ class LlvmCodeGen {
   /// this LlvmCodeGen object. The module must be on the local filesystem.
   Status LinkModule(const std::string& file);
 
+  /// Same as LinkModule(), but parses the module from the bitcode in 'module_ir'.
+  /// 'module_name' identifies the module, which is only linked once.
+  Status LinkModuleFromMemory(llvm::MemoryBufferRef module_ir,
+      const std::string& module_name);
+
  private:
   friend class ExprCodegenTest;
   friend class LlvmCodeGenTest;
@@ -425,12 +468,6 @@ class LlvmCodeGen {
   /// Initializes the jitter and execution engine with the given module.
   Status Init(std::unique_ptr<llvm::Module> module);
 
-  /// Creates a LlvmCodeGen instance initialized with the module bitcode from 'module_ir'.
-  /// 'codegen' will contain the created object on success.
-  static Status CreateFromMemory(ObjectPool* pool, llvm::MemoryBufferRef module_ir,
-      const std::string& module_name, const std::string& id,
-      boost::scoped_ptr<LlvmCodeGen>* codegen);
-
   /// Loads an LLVM module. 'file' should be the local path to the LLVM bitcode
   /// file. The caller is responsible for cleaning up module.
   Status LoadModuleFromFile(const string& file, std::unique_ptr<llvm::Module>* module);
@@ -445,6 +482,10 @@ class LlvmCodeGen {
   /// anyway (they must be explicitly invoked) so it is dead code.
   static void StripGlobalCtorsDtors(llvm::Module* module);
 
+  /// Links 'new_module', which was loaded from 'module_name', into module_.
+  Status LinkLoadedModule(const std::string& module_name,
+      std::unique_ptr<llvm::Module> new_module);
+
   // Setup any JIT listeners to process generated machine code object, e.g. to generate
   // perf symbol map or disassembly.
   void SetupJITListeners();
@@ -463,9 +504,25 @@ class LlvmCodeGen {
   // Used for testing.
   void ResetVerification() { is_corrupt_ = false; }
 
-  /// Optimizes the module. This includes pruning the module of any unused functions.
+  /// Prunes the module of any unused functions, i.e. functions that are not registered
+  /// with AddFunctionToJit() and not called by registered functions.
+  void PruneModule();
+
+  /// Optimizes the module. Must be called after PruneModule().
   void OptimizeModule();
 
+  /// Process-wide cache of compiled objects, from the bitcode of pruned modules to the
+  /// object compiled for them. Bounded by --codegen_cache_capacity bytes of bitcode and
+  /// objects.
+  typedef LruCache<std::string, std::string> CompiledObjectCache;
+
+  /// Returns the process-wide cache of compiled objects, or NULL if it is disabled.
+  static CompiledObjectCache* GetCompiledObjectCache();
+
+  /// Implementation of llvm::ObjectCache used by execution_engine_ to look up and add
+  /// the object of module_ in the CompiledObjectCache.
+  class ModuleObjectCache;
+
   /// Clears generated hash fns.  This is only used for testing.
   void ClearHashFns();
 
@@ -499,6 +556,11 @@ class LlvmCodeGen {
   /// Time spent constructing the in-memory module from the ir.
   RuntimeProfile::Counter* prepare_module_timer_;
 
+  /// Time spent getting the libraries of IR UDFs from the LibCache, including copying
+  /// them from HDFS if they aren't cached yet, and linking them into module_.
+  RuntimeProfile::Counter* lib_cache_timer_;
+  RuntimeProfile::Counter* link_module_timer_;
+
   /// Time spent doing codegen (adding IR to the module)
   RuntimeProfile::Counter* codegen_timer_;
 
@@ -508,6 +570,13 @@ class LlvmCodeGen {
   /// Time spent compiling the module.
   RuntimeProfile::Counter* compile_timer_;
 
+  /// Number of modules whose compiled object was found in the CompiledObjectCache.
+  RuntimeProfile::Counter* num_cache_hits_;
+
+  /// The -O level the module was optimized at, chosen from num_instructions_.
+  /// optimization_timer_ is the time spent at this level.
+  RuntimeProfile::Counter* opt_level_;
+
   /// Total size of bitcode modules loaded in bytes.
   RuntimeProfile::Counter* module_bitcode_size_;
 
@@ -529,6 +598,9 @@ class LlvmCodeGen {
   /// functions after this point.
   bool is_compiled_;
 
+  /// If true, FinalizeModule() must not be called asynchronously.
+  bool requires_sync_finalize_;
+
   /// Error string that llvm will write to
   std::string error_string_;
 
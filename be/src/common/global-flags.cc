@@ -61,6 +61,23 @@ DEFINE_bool(compact_catalog_topic, false, "If true, catalog updates sent via the
     "statestore are compacted before transmission. This saves network bandwidth at the"
     " cost of a small quantity of CPU time. Enable this option in cluster with large"
     " catalogs. It must be enabled on both the catalog service, and all Impala demons.");
+DEFINE_bool(compress_catalog_topic, false, "If true, the serialized catalog objects sent "
+    "via the statestore are compressed with snappy. This reduces the statestore's "
+    "network traffic and memory for large catalogs at the cost of some CPU time in the "
+    "catalog service and the Impala daemons. It must be enabled on both the catalog "
+    "service, and all Impala demons.");
+DEFINE_bool(catalog_topic_partition_entries, false, "If true, the partitions of HDFS "
+    "tables are published in the catalog topic as separate entries, and only those that "
+    "changed are published again when a table changes. This reduces the size of the "
+    "catalog topic updates of tables with many partitions. It must be enabled on both "
+    "the catalog service, and all Impala demons.");
+DEFINE_bool(catalog_topic_table_markers, false, "If true, the catalog service publishes "
+    "only the names and versions of tables in the catalog topic, and Impala daemons "
+    "fetch the metadata of the tables that their queries use from the catalog service on "
+    "demand, caching at most --catalog_loaded_tables_limit of them. This reduces the "
+    "memory of the Impala daemons and the size of the catalog topic for large catalogs. "
+    "It must be enabled on both the catalog service, and all Impala demons. Requires "
+    "frontend support that is not available yet: setting it fails at startup.");
 
 DEFINE_string(redaction_rules_file, "", "Absolute path to sensitive data redaction "
     "rules. The rules will be applied to all log messages and query text shown in the "
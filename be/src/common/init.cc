@@ -72,6 +72,7 @@ DEFINE_int64(pause_monitor_warn_threshold_ms, 10000, "If the pause monitor sleep
 // is enabled, this option won't be allowed because some logging dumps table data
 // in ways the authors of redaction rules can't anticipate.
 DECLARE_string(vmodule);
+DECLARE_bool(catalog_topic_table_markers);
 
 // tcmalloc will hold on to freed memory. We will periodically release the memory back
 // to the OS if the extra memory is too high. If the memory used by the application
@@ -172,6 +173,12 @@ void impala::InitCommonRuntime(int argc, char** argv, bool init_jvm,
 
   google::SetVersionString(impala::GetBuildVersion());
   google::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_catalog_topic_table_markers) {
+    // The frontend's catalog cannot apply table markers from the topic yet, so the
+    // catalog updates of impalads would break.
+    CLEAN_EXIT_WITH_ERROR("--catalog_topic_table_markers requires frontend support for "
+        "table markers in the catalog topic, which this build does not have.");
+  }
   if (!FLAGS_redaction_rules_file.empty()) {
     if (VLOG_ROW_IS_ON || !FLAGS_vmodule.empty()) {
       CLEAN_EXIT_WITH_ERROR("Redaction cannot be used in combination with log level 3 or "
@@ -0,0 +1,151 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exec/analytic-eval-node.h"
+
+#include "exprs/agg-fn-evaluator.h"
+#include "runtime/buffered-tuple-stream.inline.h"
+#include "runtime/row-batch.h"
+#include "runtime/runtime-state.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+// The per-row processing of AnalyticEvalNode is cross compiled to IR. Codegen replaces
+// the window getters with constants and the partition and order by comparisons with
+// codegen'd expr evaluation (see AnalyticEvalNode::Codegen()).
+
+bool AnalyticEvalNode::EvalPartitionByEq(ExprContext* const* ctxs, int num_ctxs,
+    TupleRow* row) {
+  return EvalConjuncts(ctxs, num_ctxs, row);
+}
+
+bool AnalyticEvalNode::EvalOrderByEq(ExprContext* const* ctxs, int num_ctxs,
+    TupleRow* row) {
+  return EvalConjuncts(ctxs, num_ctxs, row);
+}
+
+Status AnalyticEvalNode::AddRow(int64_t stream_idx, TupleRow* row) {
+  if (!is_rows_window() || !has_window_start() ||
+      stream_idx - rows_start_offset_ >= curr_partition_idx_) {
+    if (!use_window_tree()) AggFnEvaluator::Add(evaluators_, fn_ctxs_, row, curr_tuple_);
+    if (has_window_start()) RETURN_IF_ERROR(AddWindowRow(stream_idx, row));
+  }
+
+  // Buffer the entire input row to be returned later with the analytic eval results.
+  return AddRowToStream(input_stream_, row);
+}
+
+void AnalyticEvalNode::TryAddResultTupleForPrevRow(bool next_partition,
+    int64_t stream_idx, TupleRow* row) {
+  // The analytic fns are finalized after the previous row if we found a new partition
+  // or the window is a RANGE and the order by exprs changed. For ROWS windows we do not
+  // need to compare the current row to the previous row.
+  if (is_rows_window()) return;
+  if (next_partition || (is_range_window() && has_window_end() &&
+      !EvalOrderByEq(&order_by_eq_expr_ctx_, 1, child_tuple_cmp_row_))) {
+    AddResultTuple(stream_idx - 1);
+  }
+}
+
+void AnalyticEvalNode::TryAddResultTupleForCurrRow(int64_t stream_idx,
+    TupleRow* row) {
+  // We only add results at this point for ROWS windows (unless unbounded following)
+  if (!is_rows_window() || !has_window_end()) return;
+
+  // Nothing to add if the end offset is before the start of the partition.
+  if (stream_idx - rows_end_offset_ < curr_partition_idx_) return;
+  AddResultTuple(stream_idx - rows_end_offset_);
+}
+
+Status AnalyticEvalNode::TryRemoveRowsBeforeWindow(int64_t stream_idx) {
+  if (!is_rows_window() || !has_window_start()) return Status::OK();
+  // The start of the window may have been before the current partition, in which case
+  // there is no row to remove in window_stream_. Check the index of the row at which
+  // rows from window_stream_ should begin to be removed.
+  int64_t remove_idx = stream_idx - rows_end_offset_ +
+      min<int64_t>(rows_start_offset_, 0) - 1;
+  if (remove_idx < curr_partition_idx_) return Status::OK();
+  DCHECK_GT(num_window_rows_, 0) << DebugStateString(true);
+  DCHECK_EQ(remove_idx + max<int64_t>(rows_start_offset_, 0), window_start_idx_)
+      << DebugStateString(true);
+  return RemoveWindowRow();
+}
+
+Status AnalyticEvalNode::ProcessChildBatch(RuntimeState* state) {
+  // TODO: DCHECK input is sorted (even just first row vs prev_input_row_)
+
+  // BufferedTupleStream::num_rows() returns the total number of rows that have been
+  // inserted into the stream (it does not decrease when we read rows), so the index of
+  // the next input row that will be inserted will be the current size of the stream.
+  int64_t stream_idx = input_stream_->num_rows();
+
+  // The very first row in the stream is handled specially because there is no previous
+  // row to compare and we cannot rely on EvalPartitionByEq() returning true even for the
+  // same row pointers if there are NaN values.
+  int batch_idx = 0;
+  if (UNLIKELY(stream_idx == 0 && curr_child_batch_->num_rows() > 0)) {
+    TupleRow* row = curr_child_batch_->GetRow(0);
+    RETURN_IF_ERROR(AddRow(0, row));
+    TryAddResultTupleForCurrRow(0, row);
+    prev_input_row_ = row;
+    ++batch_idx;
+    ++stream_idx;
+  }
+
+  for (; batch_idx < curr_child_batch_->num_rows(); ++batch_idx, ++stream_idx) {
+    TupleRow* row = curr_child_batch_->GetRow(batch_idx);
+    if (partition_by_eq_expr_ctx_ != NULL || order_by_eq_expr_ctx_ != NULL) {
+      // Only set the tuples in child_tuple_cmp_row_ if there are partition exprs or
+      // order by exprs that require comparing the current and previous rows. If there
+      // aren't partition or order by exprs (i.e. empty OVER() clause), there was no sort
+      // and there could be nullable tuples (whereas the sort node does not produce
+      // them), see IMPALA-1562.
+      child_tuple_cmp_row_->SetTuple(0, prev_input_row_->GetTuple(0));
+      child_tuple_cmp_row_->SetTuple(1, row->GetTuple(0));
+    }
+    RETURN_IF_ERROR(TryRemoveRowsBeforeWindow(stream_idx));
+
+    // Every row is compared against the previous row to determine if (a) the row
+    // starts a new partition or (b) the row does not share the same values for the
+    // ordering exprs. When either of these occurs, the evaluators_ are finalized and
+    // the result tuple is added to result_tuples_ so that it may be added to output
+    // rows in GetNextOutputBatch(). When a new partition is found (a), a new, empty
+    // result tuple is created and initialized over the evaluators_. If the row has
+    // different values for the ordering exprs (b), then a new tuple is created but
+    // copied from curr_tuple_ because the original is used for one or more previous
+    // row(s) but the incremental state still applies to the current row.
+    bool next_partition = false;
+    if (partition_by_eq_expr_ctx_ != NULL) {
+      // partition_by_eq_expr_ctx_ checks equality over the predicate exprs
+      next_partition =
+          !EvalPartitionByEq(&partition_by_eq_expr_ctx_, 1, child_tuple_cmp_row_);
+    }
+    TryAddResultTupleForPrevRow(next_partition, stream_idx, row);
+    if (next_partition) RETURN_IF_ERROR(InitNextPartition(state, stream_idx));
+
+    // The evaluators_ are updated with the current row.
+    RETURN_IF_ERROR(AddRow(stream_idx, row));
+
+    TryAddResultTupleForCurrRow(stream_idx, row);
+    prev_input_row_ = row;
+  }
+
+  if (UNLIKELY(input_eos_ && stream_idx > curr_partition_idx_)) {
+    // We need to add the results for the last row(s).
+    RETURN_IF_ERROR(TryAddRemainingResults(stream_idx, curr_partition_idx_));
+  }
+  return Status::OK();
+}
@@ -16,6 +16,7 @@
 
 #include <gutil/strings/substitute.h>
 
+#include "codegen/llvm-codegen.h"
 #include "exprs/agg-fn-evaluator.h"
 #include "runtime/buffered-tuple-stream.inline.h"
 #include "runtime/descriptors.h"
@@ -27,6 +28,7 @@
 
 static const int MAX_TUPLE_POOL_SIZE = 8 * 1024 * 1024; // 8MB
 
+using namespace llvm;
 using namespace strings;
 
 namespace impala {
@@ -50,14 +52,21 @@ AnalyticEvalNode::AnalyticEvalNode(ObjectPool* pool, const TPlanNode& tnode,
     child_tuple_cmp_row_(NULL),
     last_result_idx_(-1),
     prev_pool_last_result_idx_(-1),
-    prev_pool_last_window_idx_(-1),
     curr_tuple_(NULL),
     dummy_result_tuple_(NULL),
     curr_partition_idx_(-1),
     prev_input_row_(NULL),
     input_stream_(NULL),
+    window_stream_(NULL),
+    window_batch_idx_(0),
+    window_start_idx_(0),
+    num_window_rows_(0),
+    use_window_tree_(false),
+    num_window_tree_leaves_(0),
     input_eos_(false),
-    evaluation_timer_(NULL) {
+    evaluation_timer_(NULL),
+    codegend_process_child_batch_fn_(NULL),
+    codegend_copy_row_fn_(NULL) {
   if (tnode.analytic_node.__isset.buffered_tuple_id) {
     buffered_tuple_desc_ = descs.GetTupleDescriptor(
         tnode.analytic_node.buffered_tuple_id);
@@ -136,6 +145,7 @@ Status AnalyticEvalNode::Init(const TPlanNode& tnode, RuntimeState* state) {
 
 Status AnalyticEvalNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Prepare(state));
   DCHECK(child(0)->row_desc().IsPrefixOf(row_desc()));
   curr_tuple_pool_.reset(new MemPool(mem_tracker()));
@@ -154,6 +164,20 @@ Status AnalyticEvalNode::Prepare(RuntimeState* state) {
     state->obj_pool()->Add(ctx);
   }
 
+  if (fn_scope_ == ROWS && window_.__isset.window_start) {
+    for (int i = 0; i < evaluators_.size(); ++i) {
+      use_window_tree_ |= !evaluators_[i]->SupportsRemove();
+    }
+    for (int i = 0; use_window_tree_ && i < evaluators_.size(); ++i) {
+      // The tree merges the intermediate values in place, so they must not need a
+      // Serialize().
+      if (!evaluators_[i]->SupportsMerge() || evaluators_[i]->SupportsSerialize()) {
+        return Status(Substitute("Analytic function '$0' with a window start bound "
+            "requires a Remove() or Merge() function.", evaluators_[i]->fn_name()));
+      }
+    }
+  }
+
   if (partition_by_eq_expr_ctx_ != NULL || order_by_eq_expr_ctx_ != NULL) {
     DCHECK(buffered_tuple_desc_ != NULL);
     vector<TTupleId> tuple_ids;
@@ -172,14 +196,88 @@ Status AnalyticEvalNode::Prepare(RuntimeState* state) {
     }
   }
 
+  // Each stream needs a read and a write buffer.
+  int min_buffers = fn_scope_ == ROWS && window_.__isset.window_start &&
+      !use_window_tree_ ? 4 : 2;
   RETURN_IF_ERROR(state->block_mgr()->RegisterClient(
       Substitute("AnalyticEvalNode id=$0 ptr=$1", id_, this),
-      2, false, mem_tracker(), state, &client_));
+      min_buffers, false, mem_tracker(), state, &client_));
+
+  bool codegen_enabled = false;
+  Status codegen_status;
+  if (state->codegen_enabled()) {
+    codegen_status = Codegen(state);
+    codegen_enabled = codegen_status.ok();
+  }
+  AddCodegenExecOption(codegen_enabled, codegen_status);
+  if (state->codegen_enabled()) {
+    Status copy_row_codegen_status = BufferedTupleStream::Codegen(state,
+        child(0)->row_desc(), &codegend_copy_row_fn_);
+    AddCodegenExecOption(copy_row_codegen_status.ok(), copy_row_codegen_status,
+        "Stream Row Copy");
+  }
+  return Status::OK();
+}
+
+Status AnalyticEvalNode::Codegen(RuntimeState* state) {
+  LlvmCodeGen* codegen;
+  RETURN_IF_ERROR(state->GetCodegen(&codegen));
+  SCOPED_TIMER(codegen->codegen_timer());
+  Function* process_child_batch_fn =
+      codegen->GetFunction(IRFunction::ANALYTIC_EVAL_NODE_PROCESS_CHILD_BATCH, true);
+  DCHECK(process_child_batch_fn != NULL);
+
+  int replaced;
+  if (partition_by_eq_expr_ctx_ != NULL) {
+    Function* partition_by_eq_fn;
+    RETURN_IF_ERROR(CodegenEvalConjuncts(state,
+        vector<ExprContext*>(1, partition_by_eq_expr_ctx_), &partition_by_eq_fn,
+        "EvalPartitionByEq"));
+    replaced = codegen->ReplaceCallSites(process_child_batch_fn, partition_by_eq_fn,
+        "EvalPartitionByEq");
+    DCHECK_EQ(replaced, 1) << LlvmCodeGen::Print(process_child_batch_fn);
+  }
+  if (order_by_eq_expr_ctx_ != NULL) {
+    Function* order_by_eq_fn;
+    RETURN_IF_ERROR(CodegenEvalConjuncts(state,
+        vector<ExprContext*>(1, order_by_eq_expr_ctx_), &order_by_eq_fn,
+        "EvalOrderByEq"));
+    replaced = codegen->ReplaceCallSites(process_child_batch_fn, order_by_eq_fn,
+        "EvalOrderByEq");
+    DCHECK_EQ(replaced, 1) << LlvmCodeGen::Print(process_child_batch_fn);
+  }
+
+  // Replace the window properties with constants so that only the code for this kind of
+  // window remains.
+  replaced = codegen->ReplaceCallSitesWithBoolConst(process_child_batch_fn,
+      fn_scope_ == ROWS, "is_rows_window");
+  DCHECK_GE(replaced, 1);
+  replaced = codegen->ReplaceCallSitesWithBoolConst(process_child_batch_fn,
+      fn_scope_ == RANGE, "is_range_window");
+  DCHECK_GE(replaced, 1);
+  replaced = codegen->ReplaceCallSitesWithBoolConst(process_child_batch_fn,
+      window_.__isset.window_start, "has_window_start");
+  DCHECK_GE(replaced, 1);
+  replaced = codegen->ReplaceCallSitesWithBoolConst(process_child_batch_fn,
+      window_.__isset.window_end, "has_window_end");
+  DCHECK_GE(replaced, 1);
+  replaced = codegen->ReplaceCallSitesWithBoolConst(process_child_batch_fn,
+      use_window_tree_, "use_window_tree");
+  DCHECK_GE(replaced, 1);
+
+  process_child_batch_fn = codegen->FinalizeFunction(process_child_batch_fn);
+  if (process_child_batch_fn == NULL) {
+    return Status("AnalyticEvalNode::Codegen(): codegen'd ProcessChildBatch() function "
+        "failed verification, see log");
+  }
+  codegen->AddFunctionToJit(process_child_batch_fn,
+      reinterpret_cast<void**>(&codegend_process_child_batch_fn_));
   return Status::OK();
 }
 
 Status AnalyticEvalNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -189,6 +287,7 @@ Status AnalyticEvalNode::Open(RuntimeState* state) {
   input_stream_ = new BufferedTupleStream(state, child(0)->row_desc(),
       state->block_mgr(), client_, false /* use_initial_small_buffers */,
       true /* read_write */);
+  input_stream_->set_copy_row_fn(codegend_copy_row_fn_);
   RETURN_IF_ERROR(input_stream_->Init(id(), runtime_profile(), true));
   bool got_read_buffer;
   RETURN_IF_ERROR(input_stream_->PrepareForRead(true, &got_read_buffer));
@@ -199,6 +298,21 @@ Status AnalyticEvalNode::Open(RuntimeState* state) {
         "help this query to complete successfully.");
     return status;
   }
+  if (fn_scope_ == ROWS && window_.__isset.window_start && !use_window_tree_) {
+    DCHECK(window_stream_ == NULL);
+    window_stream_ = new BufferedTupleStream(state, child(0)->row_desc(),
+        state->block_mgr(), client_, false /* use_initial_small_buffers */,
+        true /* read_write */);
+    window_stream_->set_copy_row_fn(codegend_copy_row_fn_);
+    RETURN_IF_ERROR(window_stream_->Init(id(), runtime_profile(), true));
+    RETURN_IF_ERROR(window_stream_->PrepareForRead(true, &got_read_buffer));
+    if (!got_read_buffer) {
+      return state->block_mgr()->MemLimitTooLowError(client_, id());
+    }
+    window_batch_.reset(
+        new RowBatch(child(0)->row_desc(), state->batch_size(), mem_tracker()));
+    window_batch_idx_ = 0;
+  }
 
   DCHECK_EQ(evaluators_.size(), fn_ctxs_.size());
   for (int i = 0; i < evaluators_.size(); ++i) {
@@ -239,6 +353,7 @@ Status AnalyticEvalNode::Open(RuntimeState* state) {
   dummy_result_tuple_ = Tuple::Create(result_tuple_desc_->byte_size(), mem_pool_.get());
   // Check for failures during AggFnEvaluator::Init().
   RETURN_IF_ERROR(state->GetQueryStatus());
+  if (use_window_tree_) RETURN_IF_ERROR(InitWindowTree());
 
   // Initialize state for the first partition.
   RETURN_IF_ERROR(InitNextPartition(state, 0));
@@ -311,24 +426,16 @@ string AnalyticEvalNode::DebugStateString(bool detailed = false) const {
       if (*it != result_tuples_.back()) ss << ", ";
     }
     ss << "]";
-    if (fn_scope_ == ROWS && window_.__isset.window_start) {
-      ss << " window_tuples idx: [";
-      for (list<pair<int64_t, Tuple*> >::const_iterator it = window_tuples_.begin();
-          it != window_tuples_.end(); ++it) {
-        ss << it->first;
-        if (*it != window_tuples_.back()) ss << ", ";
-      }
-      ss << "]";
-    }
-  } else {
-    if (fn_scope_ == ROWS && window_.__isset.window_start) {
-      if (window_tuples_.empty()) {
-        ss << " window_tuples empty";
-      } else {
-        ss << " window_tuples idx range: (" << window_tuples_.front().first << ","
-          << window_tuples_.back().first << ")";
-      }
+  }
+  if (fn_scope_ == ROWS && window_.__isset.window_start) {
+    if (num_window_rows_ == 0) {
+      ss << " window_rows empty";
+    } else {
+      ss << " window_rows idx range: (" << window_start_idx_ << ","
+        << window_start_idx_ + num_window_rows_ - 1 << ")";
     }
+  }
+  if (!detailed) {
     if (result_tuples_.empty()) {
       ss << " result_tuples empty";
     } else {
@@ -339,31 +446,18 @@ string AnalyticEvalNode::DebugStateString(bool detailed = false) const {
   return ss.str();
 }
 
-inline Status AnalyticEvalNode::AddRow(int64_t stream_idx, TupleRow* row) {
-  if (fn_scope_ != ROWS || !window_.__isset.window_start ||
-      stream_idx - rows_start_offset_ >= curr_partition_idx_) {
-    VLOG_ROW << id() << " Update idx=" << stream_idx;
-    AggFnEvaluator::Add(evaluators_, fn_ctxs_, row, curr_tuple_);
-    if (window_.__isset.window_start) {
-      VLOG_ROW << id() << " Adding tuple to window at idx=" << stream_idx;
-      Tuple* tuple = row->GetTuple(0)->DeepCopy(
-          *child(0)->row_desc().tuple_descriptors()[0],
-          curr_tuple_pool_.get());
-      window_tuples_.push_back(pair<int64_t, Tuple*>(stream_idx, tuple));
-    }
-  }
-
+Status AnalyticEvalNode::AddRowToStream(BufferedTupleStream* stream, TupleRow* row) {
   Status status = Status::OK();
-  // Buffer the entire input row to be returned later with the analytic eval results.
-  if (UNLIKELY(!input_stream_->AddRow(row, &status))) {
+  if (UNLIKELY(!stream->AddRow(row, &status))) {
     // AddRow returns false if an error occurs (available via status()) or there is
     // not enough memory (status() is OK). If there isn't enough memory, we unpin
-    // the stream and continue writing/reading in unpinned mode.
-    // TODO: Consider re-pinning later if the output stream is fully consumed.
+    // the stream and continue writing/reading in unpinned mode. The stream is pinned
+    // again by TryPinStream() once its rows have been read.
     RETURN_IF_ERROR(status);
-    RETURN_IF_ERROR(input_stream_->UnpinStream());
-    VLOG_FILE << id() << " Unpin input stream while adding row idx=" << stream_idx;
-    if (!input_stream_->AddRow(row, &status)) {
+    RETURN_IF_ERROR(stream->UnpinStream());
+    VLOG_FILE << id() << " Unpin " << (stream == input_stream_ ? "input" : "window")
+              << " stream while adding row";
+    if (!stream->AddRow(row, &status)) {
       // Rows should be added in unpinned mode unless an error occurs.
       RETURN_IF_ERROR(status);
       DCHECK(false);
@@ -373,11 +467,83 @@ inline Status AnalyticEvalNode::AddRow(int64_t stream_idx, TupleRow* row) {
   return status;
 }
 
+Status AnalyticEvalNode::TryPinStream(BufferedTupleStream* stream) {
+  if (stream->is_pinned() || stream->rows_returned() < stream->num_rows()) {
+    return Status::OK();
+  }
+  bool pinned;
+  RETURN_IF_ERROR(stream->PinStream(false, &pinned));
+  if (pinned) {
+    VLOG_FILE << id() << " Pinned " << (stream == input_stream_ ? "input" : "window")
+              << " stream again";
+  }
+  return Status::OK();
+}
+
+Status AnalyticEvalNode::AddWindowRow(int64_t stream_idx, TupleRow* row) {
+  VLOG_ROW << id() << " Adding row to window at idx=" << stream_idx;
+  if (num_window_rows_ == 0) {
+    window_start_idx_ = stream_idx;
+  } else {
+    DCHECK_EQ(window_start_idx_ + num_window_rows_, stream_idx);
+  }
+  if (use_window_tree_) {
+    DCHECK_LT(num_window_rows_, num_window_tree_leaves_);
+    UpdateWindowTree(stream_idx, row);
+  } else {
+    RETURN_IF_ERROR(AddRowToStream(window_stream_, row));
+  }
+  ++num_window_rows_;
+  return Status::OK();
+}
+
+Status AnalyticEvalNode::RemoveWindowRow() {
+  DCHECK_GT(num_window_rows_, 0) << DebugStateString(true);
+  if (use_window_tree_) {
+    // The leaf is no longer covered by the window and is overwritten by a later row.
+    ++window_start_idx_;
+    --num_window_rows_;
+    return Status::OK();
+  }
+  if (window_batch_idx_ == window_batch_->num_rows()) {
+    // The rows of the previous batch are no longer referenced: the blocks they point to
+    // can be deleted by GetNext().
+    window_batch_->Reset();
+    window_batch_idx_ = 0;
+    bool eos;
+    RETURN_IF_ERROR(window_stream_->GetNext(window_batch_.get(), &eos));
+    DCHECK_GT(window_batch_->num_rows(), 0);
+  }
+  TupleRow* remove_row = window_batch_->GetRow(window_batch_idx_++);
+  AggFnEvaluator::Remove(evaluators_, fn_ctxs_, remove_row, curr_tuple_);
+  ++window_start_idx_;
+  --num_window_rows_;
+  if (num_window_rows_ == 0) RETURN_IF_ERROR(TryPinStream(window_stream_));
+  return Status::OK();
+}
+
+Status AnalyticEvalNode::ClearWindow() {
+  if (use_window_tree_) num_window_rows_ = 0;
+  if (window_stream_ == NULL || num_window_rows_ == 0) return Status::OK();
+  VLOG_ROW << id() << " Clear window " << DebugStateString();
+  // All rows in the stream that have not been returned are still in the window.
+  window_batch_->Reset();
+  window_batch_idx_ = 0;
+  while (window_stream_->rows_returned() < window_stream_->num_rows()) {
+    bool eos;
+    RETURN_IF_ERROR(window_stream_->GetNext(window_batch_.get(), &eos));
+    window_batch_->Reset();
+  }
+  num_window_rows_ = 0;
+  return TryPinStream(window_stream_);
+}
+
 void AnalyticEvalNode::AddResultTuple(int64_t stream_idx) {
   VLOG_ROW << id() << " AddResultTuple idx=" << stream_idx;
   DCHECK(curr_tuple_ != NULL);
   Tuple* result_tuple = Tuple::Create(result_tuple_desc_->byte_size(),
       curr_tuple_pool_.get());
+  if (use_window_tree_) EvalWindowTree();
 
   AggFnEvaluator::GetValue(evaluators_, fn_ctxs_, curr_tuple_, result_tuple);
   DCHECK_GT(stream_idx, last_result_idx_);
@@ -386,56 +552,89 @@ void AnalyticEvalNode::AddResultTuple(int64_t stream_idx) {
   VLOG_ROW << id() << " Added result tuple, final state: " << DebugStateString(true);
 }
 
-inline void AnalyticEvalNode::TryAddResultTupleForPrevRow(bool next_partition,
-    int64_t stream_idx, TupleRow* row) {
-  // The analytic fns are finalized after the previous row if we found a new partition
-  // or the window is a RANGE and the order by exprs changed. For ROWS windows we do not
-  // need to compare the current row to the previous row.
-  VLOG_ROW << id() << " TryAddResultTupleForPrevRow partition=" << next_partition
-           << " idx=" << stream_idx;
-  if (fn_scope_ == ROWS) return;
-  if (next_partition || (fn_scope_ == RANGE && window_.__isset.window_end &&
-      !PrevRowCompare(order_by_eq_expr_ctx_))) {
-    AddResultTuple(stream_idx - 1);
+Status AnalyticEvalNode::InitWindowTree() {
+  DCHECK(use_window_tree_);
+  // After the row at stream_idx is added, the window holds the rows in
+  // [stream_idx - rows_end_offset_ + rows_start_offset_, stream_idx].
+  int64_t window_size = rows_end_offset_ - rows_start_offset_ + 1;
+  DCHECK_GT(window_size, 0);
+  num_window_tree_leaves_ = 1;
+  while (num_window_tree_leaves_ < window_size) num_window_tree_leaves_ *= 2;
+  int64_t num_nodes = 2 * num_window_tree_leaves_;
+  int64_t tuple_size = intermediate_tuple_desc_->byte_size();
+  uint8_t* buffer = mem_pool_->TryAllocate(num_nodes * tuple_size);
+  if (buffer == NULL) {
+    Status status = Status::MemLimitExceeded();
+    status.AddDetail(Substitute("Failed to allocate $0 bytes for the analytic window "
+        "of $1 rows.", num_nodes * tuple_size, window_size));
+    return status;
   }
+  memset(buffer, 0, num_nodes * tuple_size);
+  window_tree_.resize(num_nodes);
+  for (int64_t i = 0; i < num_nodes; ++i) {
+    window_tree_[i] = reinterpret_cast<Tuple*>(buffer + i * tuple_size);
+    AggFnEvaluator::Init(evaluators_, fn_ctxs_, window_tree_[i]);
+  }
+  VLOG_FILE << id() << " Window tree with " << num_window_tree_leaves_ << " leaves";
+  return Status::OK();
 }
 
-inline void AnalyticEvalNode::TryAddResultTupleForCurrRow(int64_t stream_idx,
-    TupleRow* row) {
-  VLOG_ROW << id() << " TryAddResultTupleForCurrRow idx=" << stream_idx;
-  // We only add results at this point for ROWS windows (unless unbounded following)
-  if (fn_scope_ != ROWS || !window_.__isset.window_end) return;
+void AnalyticEvalNode::ResetIntermediateTuple(Tuple* tuple) {
+  // Finalize() releases the resources of the intermediate value; the result is not
+  // needed.
+  AggFnEvaluator::Finalize(evaluators_, fn_ctxs_, tuple, dummy_result_tuple_);
+  AggFnEvaluator::Init(evaluators_, fn_ctxs_, tuple);
+}
 
-  // Nothing to add if the end offset is before the start of the partition.
-  if (stream_idx - rows_end_offset_ < curr_partition_idx_) return;
-  AddResultTuple(stream_idx - rows_end_offset_);
+void AnalyticEvalNode::UpdateWindowTree(int64_t stream_idx, TupleRow* row) {
+  int64_t node = num_window_tree_leaves_ + stream_idx % num_window_tree_leaves_;
+  ResetIntermediateTuple(window_tree_[node]);
+  AggFnEvaluator::Add(evaluators_, fn_ctxs_, row, window_tree_[node]);
+  for (node /= 2; node >= 1; node /= 2) {
+    ResetIntermediateTuple(window_tree_[node]);
+    AggFnEvaluator::Merge(evaluators_, fn_ctxs_, window_tree_[2 * node],
+        window_tree_[node]);
+    AggFnEvaluator::Merge(evaluators_, fn_ctxs_, window_tree_[2 * node + 1],
+        window_tree_[node]);
+  }
 }
 
-inline void AnalyticEvalNode::TryRemoveRowsBeforeWindow(int64_t stream_idx) {
-  if (fn_scope_ != ROWS || !window_.__isset.window_start) return;
-  // The start of the window may have been before the current partition, in which case
-  // there is no tuple to remove in window_tuples_. Check the index of the row at which
-  // tuples from window_tuples_ should begin to be removed.
-  int64_t remove_idx = stream_idx - rows_end_offset_ +
-      min<int64_t>(rows_start_offset_, 0) - 1;
-  if (remove_idx < curr_partition_idx_) return;
-  VLOG_ROW << id() << " Remove idx=" << remove_idx << " stream_idx=" << stream_idx;
-  DCHECK(!window_tuples_.empty()) << DebugStateString(true);
-  DCHECK_EQ(remove_idx + max<int64_t>(rows_start_offset_, 0),
-      window_tuples_.front().first) << DebugStateString(true);
-  TupleRow* remove_row = reinterpret_cast<TupleRow*>(&window_tuples_.front().second);
-  AggFnEvaluator::Remove(evaluators_, fn_ctxs_, remove_row, curr_tuple_);
-  window_tuples_.pop_front();
+void AnalyticEvalNode::MergeWindowTree(int64_t begin, int64_t end, Tuple* dst) {
+  DCHECK_LE(begin, end);
+  DCHECK_LE(end, num_window_tree_leaves_);
+  // Merge the nodes that are entirely within [begin, end), bottom up.
+  for (begin += num_window_tree_leaves_, end += num_window_tree_leaves_; begin < end;
+      begin /= 2, end /= 2) {
+    if (begin & 1) {
+      AggFnEvaluator::Merge(evaluators_, fn_ctxs_, window_tree_[begin++], dst);
+    }
+    if (end & 1) AggFnEvaluator::Merge(evaluators_, fn_ctxs_, window_tree_[--end], dst);
+  }
 }
 
-inline void AnalyticEvalNode::TryAddRemainingResults(int64_t partition_idx,
+void AnalyticEvalNode::EvalWindowTree() {
+  ResetIntermediateTuple(curr_tuple_);
+  if (num_window_rows_ == 0) return;
+  DCHECK_LE(num_window_rows_, num_window_tree_leaves_);
+  // The leaves are used as a circular buffer, so the window may wrap around.
+  int64_t begin = window_start_idx_ % num_window_tree_leaves_;
+  int64_t end = begin + num_window_rows_;
+  if (end <= num_window_tree_leaves_) {
+    MergeWindowTree(begin, end, curr_tuple_);
+  } else {
+    MergeWindowTree(begin, num_window_tree_leaves_, curr_tuple_);
+    MergeWindowTree(0, end - num_window_tree_leaves_, curr_tuple_);
+  }
+}
+
+Status AnalyticEvalNode::TryAddRemainingResults(int64_t partition_idx,
     int64_t prev_partition_idx) {
   DCHECK_LT(prev_partition_idx, partition_idx);
   // For PARTITION, RANGE, or ROWS with UNBOUNDED PRECEDING: add a result tuple for the
   // remaining rows in the partition that do not have an associated result tuple yet.
   if (fn_scope_ != ROWS || !window_.__isset.window_end) {
     if (last_result_idx_ < partition_idx - 1) AddResultTuple(partition_idx - 1);
-    return;
+    return Status::OK();
   }
 
   // lead() is re-written to a ROWS window with an end bound FOLLOWING. Any remaining
@@ -452,16 +651,14 @@ inline void AnalyticEvalNode::TryAddRemainingResults(int64_t partition_idx,
            << " " << DebugStateString(true);
   for (int64_t next_result_idx = last_result_idx_ + 1; next_result_idx < partition_idx;
       ++next_result_idx) {
-    if (window_tuples_.empty()) break;
-    if (next_result_idx + rows_start_offset_ > window_tuples_.front().first) {
-      DCHECK_EQ(next_result_idx + rows_start_offset_ - 1, window_tuples_.front().first);
-      // For every tuple that is removed from the window: Remove() from the evaluators
+    if (num_window_rows_ == 0) break;
+    if (next_result_idx + rows_start_offset_ > window_start_idx_) {
+      DCHECK_EQ(next_result_idx + rows_start_offset_ - 1, window_start_idx_);
+      // For every row that is removed from the window: Remove() from the evaluators
       // and add the result tuple at the next index.
-      VLOG_ROW << id() << " Remove window_row_idx=" << window_tuples_.front().first
+      VLOG_ROW << id() << " Remove window_row_idx=" << window_start_idx_
                << " for result row at idx=" << next_result_idx;
-      TupleRow* remove_row = reinterpret_cast<TupleRow*>(&window_tuples_.front().second);
-      AggFnEvaluator::Remove(evaluators_, fn_ctxs_, remove_row, curr_tuple_);
-      window_tuples_.pop_front();
+      RETURN_IF_ERROR(RemoveWindowRow());
     }
     AddResultTuple(last_result_idx_ + 1);
   }
@@ -470,9 +667,10 @@ inline void AnalyticEvalNode::TryAddRemainingResults(int64_t partition_idx,
   // have updated last_result_idx_) and the partition boundary, add the current results
   // for the remaining rows with the same result tuple (curr_tuple_ is not modified).
   if (last_result_idx_ < partition_idx - 1) AddResultTuple(partition_idx - 1);
+  return Status::OK();
 }
 
-inline Status AnalyticEvalNode::InitNextPartition(RuntimeState* state,
+Status AnalyticEvalNode::InitNextPartition(RuntimeState* state,
     int64_t stream_idx) {
   VLOG_FILE << id() << " InitNextPartition idx=" << stream_idx;
   DCHECK_LT(curr_partition_idx_, stream_idx);
@@ -516,9 +714,9 @@ inline Status AnalyticEvalNode::InitNextPartition(RuntimeState* state,
 
   if (fn_scope_ == ROWS && stream_idx > 0 && (!window_.__isset.window_end ||
         window_.window_end.type == TAnalyticWindowBoundaryType::FOLLOWING)) {
-    TryAddRemainingResults(stream_idx, prev_partition_stream_idx);
+    RETURN_IF_ERROR(TryAddRemainingResults(stream_idx, prev_partition_stream_idx));
   }
-  window_tuples_.clear();
+  RETURN_IF_ERROR(ClearWindow());
 
   VLOG_ROW << id() << " Reset curr_tuple";
   // Call finalize to release resources; result is not needed but the dst tuple must be
@@ -559,13 +757,6 @@ inline Status AnalyticEvalNode::InitNextPartition(RuntimeState* state,
   return Status::OK();
 }
 
-inline bool AnalyticEvalNode::PrevRowCompare(ExprContext* pred_ctx) {
-  DCHECK(pred_ctx != NULL);
-  BooleanVal result = pred_ctx->GetBooleanVal(child_tuple_cmp_row_);
-  DCHECK(!result.is_null);
-  return result.val;
-}
-
 Status AnalyticEvalNode::ProcessChildBatches(RuntimeState* state) {
   // Consume child batches until eos or there are enough rows to return more than an
   // output batch. Ensuring there is at least one more row left after returning results
@@ -574,7 +765,27 @@ Status AnalyticEvalNode::ProcessChildBatches(RuntimeState* state) {
     RETURN_IF_CANCELLED(state);
     RETURN_IF_ERROR(child(0)->GetNext(state, curr_child_batch_.get(), &input_eos_));
     RETURN_IF_ERROR(QueryMaintenance(state));
-    RETURN_IF_ERROR(ProcessChildBatch(state));
+    {
+      VLOG_FILE << id() << " ProcessChildBatch: " << DebugStateString()
+                << " input batch size:" << curr_child_batch_->num_rows()
+                << " tuple pool size:" << curr_tuple_pool_->total_allocated_bytes();
+      SCOPED_TIMER(evaluation_timer_);
+      if (codegend_process_child_batch_fn_ != NULL) {
+        RETURN_IF_ERROR(codegend_process_child_batch_fn_(this, state));
+      } else {
+        RETURN_IF_ERROR(ProcessChildBatch(state));
+      }
+    }
+    // Transfer resources to prev_tuple_pool_ when enough resources have accumulated
+    // and the prev_tuple_pool_ has already been transfered to an output batch.
+    if (curr_tuple_pool_->total_allocated_bytes() > MAX_TUPLE_POOL_SIZE &&
+        prev_pool_last_result_idx_ == -1) {
+      prev_tuple_pool_->AcquireData(curr_tuple_pool_.get(), false);
+      prev_pool_last_result_idx_ = last_result_idx_;
+      VLOG_FILE << id() << " Transfer resources from curr to prev pool at idx: "
+                << input_stream_->num_rows() << ", stores tuples with last result idx: "
+                << prev_pool_last_result_idx_;
+    }
     // TODO: DCHECK that the size of result_tuples_ is bounded. It shouldn't be larger
     // than 2x the batch size unless the end bound has an offset preceding, in which
     // case it may be slightly larger (proportional to the offset but still bounded).
@@ -588,92 +799,6 @@ Status AnalyticEvalNode::ProcessChildBatches(RuntimeState* state) {
   return Status::OK();
 }
 
-Status AnalyticEvalNode::ProcessChildBatch(RuntimeState* state) {
-  // TODO: DCHECK input is sorted (even just first row vs prev_input_row_)
-  VLOG_FILE << id() << " ProcessChildBatch: " << DebugStateString()
-            << " input batch size:" << curr_child_batch_->num_rows()
-            << " tuple pool size:" << curr_tuple_pool_->total_allocated_bytes();
-  SCOPED_TIMER(evaluation_timer_);
-
-  // BufferedTupleStream::num_rows() returns the total number of rows that have been
-  // inserted into the stream (it does not decrease when we read rows), so the index of
-  // the next input row that will be inserted will be the current size of the stream.
-  int64_t stream_idx = input_stream_->num_rows();
-
-  // The very first row in the stream is handled specially because there is no previous
-  // row to compare and we cannot rely on PrevRowCompare() returning true even for the
-  // same row pointers if there are NaN values.
-  int batch_idx = 0;
-  if (UNLIKELY(stream_idx == 0 && curr_child_batch_->num_rows() > 0)) {
-    TupleRow* row = curr_child_batch_->GetRow(0);
-    RETURN_IF_ERROR(AddRow(0, row));
-    TryAddResultTupleForCurrRow(0, row);
-    prev_input_row_ = row;
-    ++batch_idx;
-    ++stream_idx;
-  }
-
-  for (; batch_idx < curr_child_batch_->num_rows(); ++batch_idx, ++stream_idx) {
-    TupleRow* row = curr_child_batch_->GetRow(batch_idx);
-    if (partition_by_eq_expr_ctx_ != NULL || order_by_eq_expr_ctx_ != NULL) {
-      // Only set the tuples in child_tuple_cmp_row_ if there are partition exprs or
-      // order by exprs that require comparing the current and previous rows. If there
-      // aren't partition or order by exprs (i.e. empty OVER() clause), there was no sort
-      // and there could be nullable tuples (whereas the sort node does not produce
-      // them), see IMPALA-1562.
-      child_tuple_cmp_row_->SetTuple(0, prev_input_row_->GetTuple(0));
-      child_tuple_cmp_row_->SetTuple(1, row->GetTuple(0));
-    }
-    TryRemoveRowsBeforeWindow(stream_idx);
-
-    // Every row is compared against the previous row to determine if (a) the row
-    // starts a new partition or (b) the row does not share the same values for the
-    // ordering exprs. When either of these occurs, the evaluators_ are finalized and
-    // the result tuple is added to result_tuples_ so that it may be added to output
-    // rows in GetNextOutputBatch(). When a new partition is found (a), a new, empty
-    // result tuple is created and initialized over the evaluators_. If the row has
-    // different values for the ordering exprs (b), then a new tuple is created but
-    // copied from curr_tuple_ because the original is used for one or more previous
-    // row(s) but the incremental state still applies to the current row.
-    bool next_partition = false;
-    if (partition_by_eq_expr_ctx_ != NULL) {
-      // partition_by_eq_expr_ctx_ checks equality over the predicate exprs
-      next_partition = !PrevRowCompare(partition_by_eq_expr_ctx_);
-    }
-    TryAddResultTupleForPrevRow(next_partition, stream_idx, row);
-    if (next_partition) RETURN_IF_ERROR(InitNextPartition(state, stream_idx));
-
-    // The evaluators_ are updated with the current row.
-    RETURN_IF_ERROR(AddRow(stream_idx, row));
-
-    TryAddResultTupleForCurrRow(stream_idx, row);
-    prev_input_row_ = row;
-  }
-
-  if (UNLIKELY(input_eos_ && stream_idx > curr_partition_idx_)) {
-    // We need to add the results for the last row(s).
-    TryAddRemainingResults(stream_idx, curr_partition_idx_);
-  }
-
-  // Transfer resources to prev_tuple_pool_ when enough resources have accumulated
-  // and the prev_tuple_pool_ has already been transfered to an output batch.
-  if (curr_tuple_pool_->total_allocated_bytes() > MAX_TUPLE_POOL_SIZE &&
-      (prev_pool_last_result_idx_ == -1 || prev_pool_last_window_idx_ == -1)) {
-    prev_tuple_pool_->AcquireData(curr_tuple_pool_.get(), false);
-    prev_pool_last_result_idx_ = last_result_idx_;
-    if (window_tuples_.size() > 0) {
-      prev_pool_last_window_idx_ = window_tuples_.back().first;
-    } else {
-      prev_pool_last_window_idx_ = -1;
-    }
-    VLOG_FILE << id() << " Transfer resources from curr to prev pool at idx: "
-              << stream_idx << ", stores tuples with last result idx: "
-              << prev_pool_last_result_idx_ << " last window idx: "
-              << prev_pool_last_window_idx_;
-  }
-  return Status::OK();
-}
-
 Status AnalyticEvalNode::GetNextOutputBatch(RuntimeState* state, RowBatch* output_batch,
     bool* eos) {
   SCOPED_TIMER(evaluation_timer_);
@@ -709,6 +834,7 @@ Status AnalyticEvalNode::GetNextOutputBatch(RuntimeState* state, RowBatch* outpu
     ++stream_idx;
   }
   input_batch.TransferResourceOwnership(output_batch);
+  RETURN_IF_ERROR(TryPinStream(input_stream_));
   if (ReachedLimit()) *eos = true;
   return Status::OK();
 }
@@ -732,6 +858,7 @@ inline int64_t AnalyticEvalNode::NumOutputRowsReady() const {
 
 Status AnalyticEvalNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -768,17 +895,14 @@ Status AnalyticEvalNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool*
     input_stream_ = NULL;
     *eos = true;
   } else if (prev_pool_last_result_idx_ != -1 &&
-      prev_pool_last_result_idx_ < input_stream_->rows_returned() &&
-      prev_pool_last_window_idx_ < window_tuples_.front().first) {
+      prev_pool_last_result_idx_ < input_stream_->rows_returned()) {
     // Transfer resources to the output row batch if enough have accumulated and they're
     // no longer needed by output rows to be returned later.
     VLOG_FILE << id() << " Transfer prev pool to output batch, "
               << " pool size: " << prev_tuple_pool_->total_allocated_bytes()
-              << " last result idx: " << prev_pool_last_result_idx_
-              << " last window idx: " << prev_pool_last_window_idx_;
+              << " last result idx: " << prev_pool_last_result_idx_;
     row_batch->tuple_data_pool()->AcquireData(prev_tuple_pool_.get(), !*eos);
     prev_pool_last_result_idx_ = -1;
-    prev_pool_last_window_idx_ = -1;
   }
 
   COUNTER_SET(rows_returned_counter_, num_rows_returned_);
@@ -787,11 +911,18 @@ Status AnalyticEvalNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool*
 
 Status AnalyticEvalNode::Reset(RuntimeState* state) {
   result_tuples_.clear();
-  window_tuples_.clear();
+  if (curr_tuple_ != NULL) {
+    for (int64_t i = 0; i < window_tree_.size(); ++i) {
+      AggFnEvaluator::Finalize(evaluators_, fn_ctxs_, window_tree_[i],
+          dummy_result_tuple_);
+    }
+  }
+  window_tree_.clear();
   last_result_idx_ = -1;
   curr_partition_idx_ = -1;
   prev_pool_last_result_idx_ = -1;
-  prev_pool_last_window_idx_ = -1;
+  num_window_rows_ = 0;
+  window_batch_idx_ = 0;
   input_eos_ = false;
   // TODO: The Reset() contract allows calling Reset() even if eos has not been reached,
   // but the analytic eval node currently does not support that. In practice, we only
@@ -808,6 +939,12 @@ Status AnalyticEvalNode::Reset(RuntimeState* state) {
   mem_pool_->Clear();
   // The following members will be re-created in Open().
   DCHECK(input_stream_ == NULL); // input_stream_ should have been attached to last batch.
+  if (window_stream_ != NULL) {
+    window_stream_->Close();
+    delete window_stream_;
+    window_stream_ = NULL;
+  }
+  window_batch_.reset();
   curr_tuple_ = NULL;
   child_tuple_cmp_row_ = NULL;
   dummy_result_tuple_ = NULL;
@@ -826,6 +963,12 @@ void AnalyticEvalNode::Close(RuntimeState* state) {
     delete input_stream_;
     input_stream_ = NULL;
   }
+  if (window_stream_ != NULL) {
+    window_stream_->Close();
+    delete window_stream_;
+    window_stream_ = NULL;
+  }
+  window_batch_.reset();
 
   // Close all evaluators and fn ctxs. If an error occurred in Init or Prepare there may
   // be fewer ctxs than evaluators. We also need to Finalize if curr_tuple_ was created
@@ -15,6 +15,7 @@
 #ifndef IMPALA_EXEC_ANALYTIC_EVAL_NODE_H
 #define IMPALA_EXEC_ANALYTIC_EVAL_NODE_H
 
+#include "codegen/impala-ir.h"
 #include "exec/exec-node.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
@@ -101,11 +102,12 @@ class AnalyticEvalNode : public ExecNode {
     /// before or after the partition). When the end boundary is offset from the current
     /// row, input rows are consumed and result tuples are produced for the associated
     /// preceding or following row. When the start boundary is offset from the current
-    /// row, the first tuple (i.e. the input to the analytic functions) from the input
-    /// rows are buffered in window_tuples_ because they must later be removed from the
-    /// window (by calling AggFnEvaluator::Remove() with the expired tuple to remove it
-    /// from the current row). When either the start or end boundaries are offset from the
-    /// current row, there is special casing around partition boundaries.
+    /// row, the input rows are buffered in window_stream_ because they must later be
+    /// removed from the window (by calling AggFnEvaluator::Remove() with the expired
+    /// tuple to remove it from the current row). If some function has no Remove(), the
+    /// window is instead evaluated by merging the nodes of window_tree_ that cover it.
+    /// When either the start or end boundaries are offset from the current row, there
+    /// is special casing around partition boundaries.
     ROWS
   };
 
@@ -115,8 +117,13 @@ class AnalyticEvalNode : public ExecNode {
   /// returned. When enough rows have been processed so that results can be produced for
   /// one or more rows, a tuple containing those results are stored in result_tuples_.
   /// That tuple gets set in the associated output row(s) later in GetNextOutputBatch().
+  /// Cross compiled to IR in analytic-eval-node-ir.cc and replaced by
+  /// codegend_process_child_batch_fn_ if codegen is enabled.
   Status ProcessChildBatch(RuntimeState* state);
 
+  /// Codegens ProcessChildBatch() into codegend_process_child_batch_fn_.
+  Status Codegen(RuntimeState* state);
+
   /// Processes child batches (calling ProcessChildBatch()) until enough output rows
   /// are ready to return an output batch.
   Status ProcessChildBatches(RuntimeState* state);
@@ -126,30 +133,65 @@ class AnalyticEvalNode : public ExecNode {
   Status GetNextOutputBatch(RuntimeState* state, RowBatch* row_batch, bool* eos);
 
   /// Adds the row to the evaluators and the tuple stream.
-  Status AddRow(int64_t stream_idx, TupleRow* row);
+  Status IR_ALWAYS_INLINE AddRow(int64_t stream_idx, TupleRow* row);
 
   /// Determines if there is a window ending at the previous row, and if so, calls
   /// AddResultTuple() with the index of the previous row in input_stream_. next_partition
   /// indicates if the current row is the start of a new partition. stream_idx is the
   /// index of the current input row from input_stream_.
-  void TryAddResultTupleForPrevRow(bool next_partition, int64_t stream_idx,
+  void IR_ALWAYS_INLINE TryAddResultTupleForPrevRow(bool next_partition,
+      int64_t stream_idx,
       TupleRow* row);
 
   /// Determines if there is a window ending at the current row, and if so, calls
   /// AddResultTuple() with the index of the current row in input_stream_. stream_idx is
   /// the index of the current input row from input_stream_.
-  void TryAddResultTupleForCurrRow(int64_t stream_idx, TupleRow* row);
+  void IR_ALWAYS_INLINE TryAddResultTupleForCurrRow(int64_t stream_idx, TupleRow* row);
 
   /// Adds additional result tuples at the end of a partition, e.g. if the end bound is
   /// FOLLOWING. partition_idx is the index into input_stream_ of the new partition,
   /// prev_partition_idx is the index of the previous partition.
-  void TryAddRemainingResults(int64_t partition_idx, int64_t prev_partition_idx);
+  Status TryAddRemainingResults(int64_t partition_idx, int64_t prev_partition_idx);
 
   /// Removes rows from curr_tuple_ (by calling AggFnEvaluator::Remove()) that are no
   /// longer in the window (i.e. they are before the window start boundary). stream_idx
   /// is the index of the row in input_stream_ that is currently being processed in
   /// ProcessChildBatch().
-  void TryRemoveRowsBeforeWindow(int64_t stream_idx);
+  Status IR_ALWAYS_INLINE TryRemoveRowsBeforeWindow(int64_t stream_idx);
+
+  /// Appends 'row', the row at index stream_idx of input_stream_, to the end of the
+  /// window in window_stream_.
+  Status AddWindowRow(int64_t stream_idx, TupleRow* row);
+
+  /// Removes the row at the start of the window from curr_tuple_ and window_stream_.
+  Status RemoveWindowRow();
+
+  /// Allocates and initializes the nodes of window_tree_.
+  Status InitWindowTree();
+
+  /// Sets the leaf of window_tree_ for the row at index stream_idx of input_stream_ to
+  /// 'row' and updates the nodes above it.
+  void UpdateWindowTree(int64_t stream_idx, TupleRow* row);
+
+  /// Sets curr_tuple_ to the merge of the window_tree_ nodes covering the window.
+  void EvalWindowTree();
+
+  /// Merges the nodes of window_tree_ that cover the leaves in [begin, end) into 'dst'.
+  void MergeWindowTree(int64_t begin, int64_t end, Tuple* dst);
+
+  /// Frees the state of 'tuple' and re-initializes it.
+  void ResetIntermediateTuple(Tuple* tuple);
+
+  /// Drops the rows left in the window at the end of a partition.
+  Status ClearWindow();
+
+  /// Adds 'row' to 'stream', unpinning the stream if it runs out of memory.
+  Status AddRowToStream(BufferedTupleStream* stream, TupleRow* row);
+
+  /// Pins 'stream' again if it is unpinned, all its rows were read and the memory
+  /// to pin it is available, so that rows are buffered in memory until it runs out of
+  /// memory again.
+  Status TryPinStream(BufferedTupleStream* stream);
 
   /// Initializes state at the start of a new partition. stream_idx is the index of the
   /// current input row from input_stream_.
@@ -168,9 +210,22 @@ class AnalyticEvalNode : public ExecNode {
   /// This is necessary to produce the default value (set by Init()).
   void ResetLeadFnSlots();
 
-  /// Evaluates the predicate pred_ctx over child_tuple_cmp_row_, which is a TupleRow*
-  /// containing the previous row and the current row set during ProcessChildBatch().
-  bool PrevRowCompare(ExprContext* pred_ctx);
+  /// Evaluate partition_by_eq_expr_ctx_ and order_by_eq_expr_ctx_ over
+  /// child_tuple_cmp_row_, which is a TupleRow* containing the previous row and the
+  /// current row set during ProcessChildBatch(). They have the signature of
+  /// EvalConjuncts() so that codegen can replace them with a codegen'd EvalConjuncts().
+  static bool IR_NO_INLINE EvalPartitionByEq(ExprContext* const* ctxs, int num_ctxs,
+      TupleRow* row);
+  static bool IR_NO_INLINE EvalOrderByEq(ExprContext* const* ctxs, int num_ctxs,
+      TupleRow* row);
+
+  /// Properties of the window used by ProcessChildBatch(). Codegen replaces them with
+  /// constants so that the branches for the other kinds of windows are optimized out.
+  bool IR_NO_INLINE is_rows_window() const { return fn_scope_ == ROWS; }
+  bool IR_NO_INLINE is_range_window() const { return fn_scope_ == RANGE; }
+  bool IR_NO_INLINE has_window_start() const { return window_.__isset.window_start; }
+  bool IR_NO_INLINE has_window_end() const { return window_.__isset.window_end; }
+  bool IR_NO_INLINE use_window_tree() const { return use_window_tree_; }
 
   /// Debug string containing current state. If 'detailed', per-row state is included.
   std::string DebugStateString(bool detailed) const;
@@ -182,7 +237,6 @@ class AnalyticEvalNode : public ExecNode {
 
   /// Window over which the analytic functions are evaluated. Only used if fn_scope_
   /// is ROWS or RANGE.
-  /// TODO: fn_scope_ and window_ are candidates to be removed during codegen
   const TAnalyticWindow window_;
 
   /// Tuple descriptor for storing intermediate values of analytic fn evaluation.
@@ -236,16 +290,15 @@ class AnalyticEvalNode : public ExecNode {
   /// bookkeeping using a pointer-based structure stored in the memory blocks themselves.
   boost::scoped_ptr<MemPool> fn_pool_;
 
-  /// Pools used to allocate result tuples (added to result_tuples_ and later returned)
-  /// and window tuples (added to window_tuples_ to buffer the current window). Resources
-  /// are transferred from curr_tuple_pool_ to prev_tuple_pool_ once it is at least
-  /// MAX_TUPLE_POOL_SIZE bytes. Resources from prev_tuple_pool_ are transferred to an
-  /// output row batch when all result tuples it contains have been returned and all
-  /// window tuples it contains are no longer needed, or upon eos.
+  /// Pools used to allocate result tuples (added to result_tuples_ and later returned).
+  /// Resources are transferred from curr_tuple_pool_ to prev_tuple_pool_ once it is at
+  /// least MAX_TUPLE_POOL_SIZE bytes. Resources from prev_tuple_pool_ are transferred to
+  /// an output row batch when all result tuples it contains have been returned, or upon
+  /// eos.
   boost::scoped_ptr<MemPool> curr_tuple_pool_;
   boost::scoped_ptr<MemPool> prev_tuple_pool_;
 
-  /// Block manager client used by input_stream_. Not owned.
+  /// Block manager client used by input_stream_ and window_stream_. Not owned.
   BufferedBlockMgr::Client* client_;
 
   /////////////////////////////////////////
@@ -273,12 +326,37 @@ class AnalyticEvalNode : public ExecNode {
   /// Index in input_stream_ of the most recently added result tuple.
   int64_t last_result_idx_;
 
-  /// Child tuples that are currently within the window and the index into input_stream_
-  /// of the row they're associated with. Only used when window start bound is PRECEDING
-  /// or FOLLOWING. Tuples in this list are deep copied and owned by
-  /// curr_window_tuple_pool_.
-  /// TODO: Remove and use BufferedTupleStream (needs support for multiple readers).
-  std::list<std::pair<int64_t, Tuple*> > window_tuples_;
+  /// Copies of the child rows that are currently within the window, in the order of
+  /// their index into input_stream_. Only used when window start bound is PRECEDING or
+  /// FOLLOWING. Rows are read back from the front of the stream when they leave the
+  /// window, so large windows are unpinned like input_stream_. A second stream is used
+  /// rather than a second reader of input_stream_ because the rows leave the window
+  /// both before and after they are returned from input_stream_, which deletes its
+  /// blocks as they are read.
+  BufferedTupleStream* window_stream_;
+
+  /// Batch of rows read from the front of window_stream_, and the index of the next row
+  /// in it to remove from the window.
+  boost::scoped_ptr<RowBatch> window_batch_;
+  int window_batch_idx_;
+
+  /// Index into input_stream_ of the row at the start of the window, and the number of
+  /// rows in the window.
+  int64_t window_start_idx_;
+  int64_t num_window_rows_;
+
+  /// True if the ROWS window has a start bound and some evaluator does not support
+  /// Remove(), in which case all evaluators must support Merge(). Set in Prepare().
+  bool use_window_tree_;
+
+  /// Segment tree over the intermediate tuples of the rows in the window, used instead
+  /// of window_stream_ if use_window_tree_. The row at index i of input_stream_ is the
+  /// leaf at window_tree_[num_window_tree_leaves_ + i % num_window_tree_leaves_] and
+  /// every other node is the merge of its two children, so that the aggregate over the
+  /// window needs O(log N) merges for a window of N rows. num_window_tree_leaves_ is
+  /// the window size rounded up to a power of 2. The nodes are allocated from mem_pool_.
+  std::vector<Tuple*> window_tree_;
+  int64_t num_window_tree_leaves_;
 
   /// The index of the last row from input_stream_ associated with output row containing
   /// resources in prev_tuple_pool_. -1 when the pool is empty. Resources from
@@ -286,12 +364,6 @@ class AnalyticEvalNode : public ExecNode {
   /// these tuples have been returned.
   int64_t prev_pool_last_result_idx_;
 
-  /// The index of the last row from input_stream_ associated with window tuples
-  /// containing resources in prev_tuple_pool_. -1 when the pool is empty. Resources from
-  /// prev_tuple_pool_ can only be transferred to an output batch once all rows containing
-  /// these tuples are no longer needed (removed from the window_tuples_).
-  int64_t prev_pool_last_window_idx_;
-
   /// The tuple described by intermediate_tuple_desc_ storing intermediate state for the
   /// evaluators_. When enough input rows have been consumed to produce the analytic
   /// function results, a result tuple (described by result_tuple_desc_) is created and
@@ -327,8 +399,8 @@ class AnalyticEvalNode : public ExecNode {
   /// buffered data exceeds the available memory in the underlying BufferedBlockMgr,
   /// input_stream_ is unpinned (i.e., possibly spilled to disk if necessary).
   /// The input stream owns tuple data backing rows returned in GetNext(), and is
-  /// attached to an output row batch on eos or ReachedLimit().
-  /// TODO: Consider re-pinning unpinned streams when possible.
+  /// attached to an output row batch on eos or ReachedLimit(). An unpinned stream is
+  /// pinned again once all its rows have been returned (see TryPinStream()).
   BufferedTupleStream* input_stream_;
 
   /// Pool used for O(1) allocations that live until Close() or Reset().
@@ -344,6 +416,15 @@ class AnalyticEvalNode : public ExecNode {
 
   /// Time spent processing the child rows.
   RuntimeProfile::Counter* evaluation_timer_;
+
+  /// Codegen'd version of ProcessChildBatch(), or NULL if codegen is disabled or
+  /// failed.
+  typedef Status (*ProcessChildBatchFn)(AnalyticEvalNode*, RuntimeState*);
+  ProcessChildBatchFn codegend_process_child_batch_fn_;
+
+  /// Codegen'd function that copies the child's rows into input_stream_ and
+  /// window_stream_, or NULL if codegen is disabled or failed.
+  BufferedTupleStream::CopyRowFn codegend_copy_row_fn_;
 };
 
 }
@@ -21,6 +21,8 @@
 #include "runtime/runtime-state.h"
 #include "util/debug-util.h"
 #include "util/runtime-profile.h"
+#include "util/sampling-profiler.h"
+#include "util/thread.h"
 #include "util/time.h"
 
 #include "gen-cpp/PlanNodes_types.h"
@@ -65,6 +67,7 @@ BlockingJoinNode::~BlockingJoinNode() {
 
 Status BlockingJoinNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Prepare(state));
 
   build_pool_.reset(new MemPool(mem_tracker()));
@@ -125,6 +128,9 @@ Status BlockingJoinNode::Prepare(RuntimeState* state) {
 
   probe_batch_.reset(
       new RowBatch(child(0)->row_desc(), state->batch_size(), mem_tracker()));
+  // Lets a select child pass its selected rows without copying them. They are compacted
+  // with ApplySelection() after each GetNext(), since the probe walks the rows by index.
+  probe_batch_->EnableSelection();
   return Status::OK();
 }
 
@@ -137,9 +143,12 @@ void BlockingJoinNode::Close(RuntimeState* state) {
 }
 
 void BlockingJoinNode::BuildSideThread(RuntimeState* state, Promise<Status>* status) {
+  SamplingProfiler::ScopedQueryTag query_tag(state->query_id());
+  ScopedNumaAffinity numa_affinity(state->resource_pool()->numa_node());
   Status s;
   {
     SCOPED_TIMER(state->total_cpu_timer());
+    SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
     s = ConstructBuildSide(state);
   }
   // IMPALA-1863: If the build-side thread failed, then we need to close the right
@@ -157,6 +166,7 @@ void BlockingJoinNode::BuildSideThread(RuntimeState* state, Promise<Status>* sta
 
 Status BlockingJoinNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -218,6 +228,7 @@ Status BlockingJoinNode::Open(RuntimeState* state) {
   // Seed left child in preparation for GetNext().
   while (true) {
     RETURN_IF_ERROR(child(0)->GetNext(state, probe_batch_.get(), &probe_side_eos_));
+    probe_batch_->ApplySelection();
     COUNTER_ADD(probe_row_counter_, probe_batch_->num_rows());
     probe_batch_pos_ = 0;
     if (probe_batch_->num_rows() == 0) {
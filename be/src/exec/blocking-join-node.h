@@ -58,6 +58,8 @@ class BlockingJoinNode : public ExecNode {
   /// BlockingJoinNode::Close().
   virtual void Close(RuntimeState* state);
 
+  TJoinOp::type join_op() const { return join_op_; }
+
   static const char* LLVM_CLASS_NAME;
 
  protected:
@@ -18,6 +18,7 @@
 
 #include "exec/incr-stats-util.h"
 #include "common/status.h"
+#include "exec/incr-stats-util.h"
 #include "runtime/lib-cache.h"
 #include "service/impala-server.h"
 #include "service/hs2-util.h"
@@ -103,6 +104,11 @@ Status CatalogOpExecutor::ExecComputeStats(
   update_stats_params.__set_expect_all_partitions(
       compute_stats_params.expect_all_partitions);
   update_stats_params.__set_is_incremental(compute_stats_params.is_incremental);
+  double sample_fraction = ComputeStatsSampleFraction();
+  if (sample_fraction < 1) {
+    profile_->AddInfoString("Stats Sample Percent",
+        lexical_cast<string>(sample_fraction * 100));
+  }
 
   // Fill the alteration request based on the child-query results.
   SetTableStats(tbl_stats_schema, tbl_stats_data,
@@ -195,9 +201,10 @@ void CatalogOpExecutor::SetTableStats(const TTableSchema& tbl_stats_schema,
   // Set per-partition stats.
   for (const TRow& row: tbl_stats_data.rows) {
     DCHECK_GT(row.colVals.size(), 0);
-    // The first column is the COUNT(*) expr of the original query.
+    // The first column is the COUNT(*) expr of the original query, over the sample of
+    // the files if the scans are sampled.
     DCHECK(row.colVals[0].__isset.i64Val);
-    int64_t num_rows = row.colVals[0].i64Val.value;
+    int64_t num_rows = row.colVals[0].i64Val.value / ComputeStatsSampleFraction();
     // The remaining columns are partition columns that the results are grouped by.
     vector<string> partition_key_vals;
     partition_key_vals.reserve(row.colVals.size());
@@ -231,10 +238,17 @@ void CatalogOpExecutor::SetColumnStats(const TTableSchema& col_stats_schema,
   // the NDVs and the number of NULLs are at position i and i + 1 of the
   // col_stats_row, respectively. Positions i + 2 and i + 3 contain the max/avg
   // length for string columns, and -1 for non-string columns.
+  // The NDVs and numbers of NULLs of sampled scans are extrapolated to the number of rows
+  // of the table, which SetTableStats() extrapolated.
+  double sample_fraction = ComputeStatsSampleFraction();
+  int64_t num_rows = params->table_stats.num_rows;
   for (int i = 0; i < col_stats_row.colVals.size(); i += 4) {
     TColumnStats col_stats;
-    col_stats.__set_num_distinct_values(col_stats_row.colVals[i].i64Val.value);
-    col_stats.__set_num_nulls(col_stats_row.colVals[i + 1].i64Val.value);
+    col_stats.__set_num_distinct_values(ExtrapolateNdv(
+        col_stats_row.colVals[i].i64Val.value, num_rows, sample_fraction));
+    int64_t num_nulls = col_stats_row.colVals[i + 1].i64Val.value;
+    if (num_nulls > 0) num_nulls /= sample_fraction;
+    col_stats.__set_num_nulls(num_nulls);
     col_stats.__set_max_size(col_stats_row.colVals[i + 2].i32Val.value);
     col_stats.__set_avg_size(col_stats_row.colVals[i + 3].doubleVal.value);
     params->column_stats[col_stats_schema.columns[i].columnName] = col_stats;
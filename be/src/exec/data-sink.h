@@ -72,6 +72,11 @@ class DataSink {
   /// Returns the runtime profile for the sink.
   virtual RuntimeProfile* profile() = 0;
 
+  /// Returns true if the receivers of the rows don't need any more of them, e.g. because
+  /// a downstream exchange node reached its limit. The fragment then stops producing
+  /// rows and calls FlushFinal().
+  virtual bool ReceiversClosed() const { return false; }
+
   /// Merges one update to the insert stats for a partition. dst_stats will have the
   /// combined stats of src_stats and dst_stats after this method returns.
   static void MergeInsertStats(const TInsertStats& src_stats,
@@ -34,8 +34,9 @@
 using namespace strings;
 using namespace impala::extdatasource;
 
-DEFINE_int32(data_source_batch_size, 1024, "Batch size for calls to GetNext() on "
-    "external data sources.");
+DEFINE_int32(data_source_batch_size, 8192, "Batch size for calls to GetNext() on "
+    "external data sources. Each call crosses JNI and serializes its rows with thrift, "
+    "so larger batches amortize that overhead over more rows.");
 
 namespace impala {
 
@@ -88,6 +89,7 @@ Status DataSourceScanNode::Prepare(RuntimeState* state) {
 
 Status DataSourceScanNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_CANCELLED(state);
 
@@ -188,103 +190,137 @@ inline Status SetDecimalVal(const ColumnType& type, char* bytes, int len,
   return Status::OK();
 }
 
-Status DataSourceScanNode::MaterializeNextRow(MemPool* tuple_pool, Tuple* tuple) {
+// Copies the values of the non-NULL rows of column 'col' in [first_row, first_row +
+// num_rows) from 'vals' into 'slot_desc' of the 'num_rows' tuples at 'tuple_mem' and
+// sets the slots of the NULL rows to NULL. 'val_idx' is the index of the next value in
+// 'vals' and is advanced past the copied values.
+template <typename SLOT_T, typename VAL_T>
+static inline Status CopyColumn(const TColumnData& col, const vector<VAL_T>& vals,
+    const char* type_name, int first_row, int num_rows, const SlotDescriptor* slot_desc,
+    int tuple_byte_size, uint8_t* tuple_mem, int* val_idx) {
+  for (int i = 0; i < num_rows; ++i) {
+    Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_byte_size);
+    if (col.is_null[first_row + i]) {
+      tuple->SetNull(slot_desc->null_indicator_offset());
+      continue;
+    }
+    if (UNLIKELY(*val_idx >= vals.size())) {
+      return Status(Substitute(ERROR_INVALID_COL_DATA, type_name));
+    }
+    *reinterpret_cast<SLOT_T*>(tuple->GetSlot(slot_desc->tuple_offset())) =
+        vals[(*val_idx)++];
+  }
+  return Status::OK();
+}
+
+Status DataSourceScanNode::MaterializeNextRows(MemPool* tuple_pool, int num_rows,
+    uint8_t* tuple_mem) {
   const vector<TColumnData>& cols = input_batch_->rows.cols;
-  tuple->Init(tuple_desc_->byte_size());
+  const int tuple_byte_size = tuple_desc_->byte_size();
+  memset(tuple_mem, 0, num_rows * tuple_byte_size);
 
+  // Materialize one column at a time, so that the type of each column is only
+  // dispatched on once per batch of rows.
   for (int i = 0; i < tuple_desc_->slots().size(); ++i) {
     const SlotDescriptor* slot_desc = tuple_desc_->slots()[i];
-    void* slot = tuple->GetSlot(slot_desc->tuple_offset());
     const TColumnData& col = cols[i];
-
-    if (col.is_null[next_row_idx_]) {
-      tuple->SetNull(slot_desc->null_indicator_offset());
-      continue;
-    }
-
-    // Get and increment the index into the values array (e.g. int_vals) for this col.
-    int val_idx = cols_next_val_idx_[i]++;
+    int* val_idx = &cols_next_val_idx_[i];
     switch (slot_desc->type().type) {
       case TYPE_STRING: {
-          if (val_idx >= col.string_vals.size()) {
+        // Copy the strings of all rows into a single allocation.
+        int64_t total_len = 0;
+        int end_val_idx = *val_idx;
+        for (int j = 0; j < num_rows; ++j) {
+          if (col.is_null[next_row_idx_ + j]) continue;
+          if (end_val_idx >= col.string_vals.size()) {
             return Status(Substitute(ERROR_INVALID_COL_DATA, "STRING"));
           }
-          const string& val = col.string_vals[val_idx];
-          size_t val_size = val.size();
-          char* buffer = reinterpret_cast<char*>(tuple_pool->TryAllocate(val_size));
-          if (UNLIKELY(buffer == NULL)) {
-            string details = Substitute(ERROR_MEM_LIMIT_EXCEEDED, "MaterializeNextRow",
-                val_size, "string slot");
-            return tuple_pool->mem_tracker()->MemLimitExceeded(NULL, details, val_size);
+          total_len += col.string_vals[end_val_idx++].size();
+        }
+        char* buffer = reinterpret_cast<char*>(tuple_pool->TryAllocate(total_len));
+        if (UNLIKELY(buffer == NULL && total_len > 0)) {
+          string details = Substitute(ERROR_MEM_LIMIT_EXCEEDED, "MaterializeNextRows",
+              total_len, "string slots");
+          return tuple_pool->mem_tracker()->MemLimitExceeded(NULL, details, total_len);
+        }
+        for (int j = 0; j < num_rows; ++j) {
+          Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + j * tuple_byte_size);
+          if (col.is_null[next_row_idx_ + j]) {
+            tuple->SetNull(slot_desc->null_indicator_offset());
+            continue;
           }
-          memcpy(buffer, val.data(), val_size);
-          reinterpret_cast<StringValue*>(slot)->ptr = buffer;
-          reinterpret_cast<StringValue*>(slot)->len = val_size;
-          break;
+          const string& val = col.string_vals[(*val_idx)++];
+          memcpy(buffer, val.data(), val.size());
+          StringValue* slot =
+              reinterpret_cast<StringValue*>(tuple->GetSlot(slot_desc->tuple_offset()));
+          slot->ptr = buffer;
+          slot->len = val.size();
+          buffer += val.size();
         }
+        break;
+      }
       case TYPE_TINYINT:
-        if (val_idx >= col.byte_vals.size()) {
-          return Status(Substitute(ERROR_INVALID_COL_DATA, "TINYINT"));
-        }
-        *reinterpret_cast<int8_t*>(slot) = col.byte_vals[val_idx];
+        RETURN_IF_ERROR((CopyColumn<int8_t>(col, col.byte_vals, "TINYINT",
+            next_row_idx_, num_rows, slot_desc, tuple_byte_size, tuple_mem, val_idx)));
         break;
       case TYPE_SMALLINT:
-        if (val_idx >= col.short_vals.size()) {
-          return Status(Substitute(ERROR_INVALID_COL_DATA, "SMALLINT"));
-        }
-        *reinterpret_cast<int16_t*>(slot) = col.short_vals[val_idx];
+        RETURN_IF_ERROR((CopyColumn<int16_t>(col, col.short_vals, "SMALLINT",
+            next_row_idx_, num_rows, slot_desc, tuple_byte_size, tuple_mem, val_idx)));
         break;
       case TYPE_INT:
-        if (val_idx >= col.int_vals.size()) {
-          return Status(Substitute(ERROR_INVALID_COL_DATA, "INT"));
-        }
-        *reinterpret_cast<int32_t*>(slot) = col.int_vals[val_idx];
+        RETURN_IF_ERROR((CopyColumn<int32_t>(col, col.int_vals, "INT",
+            next_row_idx_, num_rows, slot_desc, tuple_byte_size, tuple_mem, val_idx)));
         break;
       case TYPE_BIGINT:
-        if (val_idx >= col.long_vals.size()) {
-          return Status(Substitute(ERROR_INVALID_COL_DATA, "BIGINT"));
-        }
-        *reinterpret_cast<int64_t*>(slot) = col.long_vals[val_idx];
+        RETURN_IF_ERROR((CopyColumn<int64_t>(col, col.long_vals, "BIGINT",
+            next_row_idx_, num_rows, slot_desc, tuple_byte_size, tuple_mem, val_idx)));
         break;
       case TYPE_DOUBLE:
-        if (val_idx >= col.double_vals.size()) {
-          return Status(Substitute(ERROR_INVALID_COL_DATA, "DOUBLE"));
-        }
-        *reinterpret_cast<double*>(slot) = col.double_vals[val_idx];
+        RETURN_IF_ERROR((CopyColumn<double>(col, col.double_vals, "DOUBLE",
+            next_row_idx_, num_rows, slot_desc, tuple_byte_size, tuple_mem, val_idx)));
         break;
       case TYPE_FLOAT:
-        if (val_idx >= col.double_vals.size()) {
-          return Status(Substitute(ERROR_INVALID_COL_DATA, "FLOAT"));
-        }
-        *reinterpret_cast<float*>(slot) = col.double_vals[val_idx];
+        RETURN_IF_ERROR((CopyColumn<float>(col, col.double_vals, "FLOAT",
+            next_row_idx_, num_rows, slot_desc, tuple_byte_size, tuple_mem, val_idx)));
         break;
       case TYPE_BOOLEAN:
-        if (val_idx >= col.bool_vals.size()) {
-          return Status(Substitute(ERROR_INVALID_COL_DATA, "BOOLEAN"));
-        }
-        *reinterpret_cast<int8_t*>(slot) = col.bool_vals[val_idx];
+        RETURN_IF_ERROR((CopyColumn<int8_t>(col, col.bool_vals, "BOOLEAN",
+            next_row_idx_, num_rows, slot_desc, tuple_byte_size, tuple_mem, val_idx)));
         break;
-      case TYPE_TIMESTAMP: {
-        if (val_idx >= col.binary_vals.size()) {
-          return Status(Substitute(ERROR_INVALID_COL_DATA, "TIMESTAMP"));
+      case TYPE_TIMESTAMP:
+        for (int j = 0; j < num_rows; ++j) {
+          Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + j * tuple_byte_size);
+          if (col.is_null[next_row_idx_ + j]) {
+            tuple->SetNull(slot_desc->null_indicator_offset());
+            continue;
+          }
+          if (*val_idx >= col.binary_vals.size()) {
+            return Status(Substitute(ERROR_INVALID_COL_DATA, "TIMESTAMP"));
+          }
+          const string& val = col.binary_vals[(*val_idx)++];
+          if (val.size() != TIMESTAMP_SIZE) return Status(ERROR_INVALID_TIMESTAMP);
+          const uint8_t* bytes = reinterpret_cast<const uint8_t*>(val.data());
+          *reinterpret_cast<TimestampValue*>(tuple->GetSlot(slot_desc->tuple_offset())) =
+              TimestampValue(ReadWriteUtil::GetInt<uint64_t>(bytes),
+                  ReadWriteUtil::GetInt<uint32_t>(bytes + sizeof(int64_t)));
         }
-        const string& val = col.binary_vals[val_idx];
-        if (val.size() != TIMESTAMP_SIZE) return Status(ERROR_INVALID_TIMESTAMP);
-        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(val.data());
-        *reinterpret_cast<TimestampValue*>(slot) = TimestampValue(
-            ReadWriteUtil::GetInt<uint64_t>(bytes),
-            ReadWriteUtil::GetInt<uint32_t>(bytes + sizeof(int64_t)));
         break;
-      }
-      case TYPE_DECIMAL: {
-        if (val_idx >= col.binary_vals.size()) {
-          return Status(Substitute(ERROR_INVALID_COL_DATA, "DECIMAL"));
+      case TYPE_DECIMAL:
+        for (int j = 0; j < num_rows; ++j) {
+          Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + j * tuple_byte_size);
+          if (col.is_null[next_row_idx_ + j]) {
+            tuple->SetNull(slot_desc->null_indicator_offset());
+            continue;
+          }
+          if (*val_idx >= col.binary_vals.size()) {
+            return Status(Substitute(ERROR_INVALID_COL_DATA, "DECIMAL"));
+          }
+          const string& val = col.binary_vals[(*val_idx)++];
+          RETURN_IF_ERROR(SetDecimalVal(slot_desc->type(),
+              const_cast<char*>(val.data()), val.size(),
+              tuple->GetSlot(slot_desc->tuple_offset())));
         }
-        const string& val = col.binary_vals[val_idx];
-        RETURN_IF_ERROR(SetDecimalVal(slot_desc->type(), const_cast<char*>(val.data()),
-            val.size(), slot));
         break;
-      }
       default:
         DCHECK(false);
     }
@@ -297,6 +333,7 @@ Status DataSourceScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, boo
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   if (ReachedLimit()) {
     *eos = true;
     return Status::OK();
@@ -313,23 +350,38 @@ Status DataSourceScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, boo
   ExprContext** ctxs = &conjunct_ctxs_[0];
   int num_ctxs = conjunct_ctxs_.size();
 
+  const int tuple_byte_size = tuple_desc_->byte_size();
+
   while (true) {
     {
       SCOPED_TIMER(materialize_tuple_timer());
-      // copy rows until we hit the limit/capacity or until we exhaust input_batch_
+      // Copy rows until we hit the limit/capacity or until we exhaust input_batch_.
+      // The rows are materialized a column at a time into the free tuples of the row
+      // batch, then the conjuncts are evaluated and the passing tuples compacted.
       while (!ReachedLimit() && !row_batch->AtCapacity() && InputBatchHasNext()) {
-        RETURN_IF_ERROR(MaterializeNextRow(tuple_pool, tuple));
-        int row_idx = row_batch->AddRow();
-        TupleRow* tuple_row = row_batch->GetRow(row_idx);
-        tuple_row->SetTuple(tuple_idx_, tuple);
-
-        if (ExecNode::EvalConjuncts(ctxs, num_ctxs, tuple_row)) {
-          row_batch->CommitLastRow();
-          tuple = reinterpret_cast<Tuple*>(
-              reinterpret_cast<uint8_t*>(tuple) + tuple_desc_->byte_size());
-          ++num_rows_returned_;
+        int num_rows = min<int64_t>(row_batch->capacity() - row_batch->num_rows(),
+            num_rows_ - next_row_idx_);
+        uint8_t* tuple_mem = reinterpret_cast<uint8_t*>(tuple);
+        RETURN_IF_ERROR(MaterializeNextRows(tuple_pool, num_rows, tuple_mem));
+        int i = 0;
+        for (; i < num_rows && !ReachedLimit(); ++i) {
+          Tuple* src = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_byte_size);
+          int row_idx = row_batch->AddRow();
+          TupleRow* tuple_row = row_batch->GetRow(row_idx);
+          tuple_row->SetTuple(tuple_idx_, src);
+
+          if (ExecNode::EvalConjuncts(ctxs, num_ctxs, tuple_row)) {
+            if (src != tuple) {
+              memcpy(tuple, src, tuple_byte_size);
+              tuple_row->SetTuple(tuple_idx_, tuple);
+            }
+            row_batch->CommitLastRow();
+            tuple = reinterpret_cast<Tuple*>(
+                reinterpret_cast<uint8_t*>(tuple) + tuple_byte_size);
+            ++num_rows_returned_;
+          }
         }
-        ++next_row_idx_;
+        next_row_idx_ += i;
       }
       COUNTER_SET(rows_returned_counter_, num_rows_returned_);
 
@@ -353,6 +405,7 @@ Status DataSourceScanNode::Reset(RuntimeState* state) {
 void DataSourceScanNode::Close(RuntimeState* state) {
   if (is_closed()) return;
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   PeriodicCounterUpdater::StopRateCounter(total_throughput_counter());
   PeriodicCounterUpdater::StopTimeSeriesCounter(bytes_read_timeseries_counter_);
   input_batch_.reset();
@@ -93,8 +93,11 @@ class DataSourceScanNode : public ScanNode {
   /// the next row batch.
   std::vector<int> cols_next_val_idx_;
 
-  /// Materializes the next row (next_row_idx_) into tuple.
-  Status MaterializeNextRow(MemPool* mem_pool, Tuple* tuple);
+  /// Materializes the 'num_rows' rows starting at next_row_idx_ into consecutive tuples
+  /// at 'tuple_mem', one column at a time. Does not advance next_row_idx_, but advances
+  /// cols_next_val_idx_ past the rows' values. The strings of each column are copied
+  /// into a single allocation from 'mem_pool'.
+  Status MaterializeNextRows(MemPool* mem_pool, int num_rows, uint8_t* tuple_mem);
 
   /// Gets the next batch from the data source, stored in input_batch_.
   Status GetNextInputBatch();
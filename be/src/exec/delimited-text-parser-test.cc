@@ -16,6 +16,7 @@
 #include <gtest/gtest.h>
 
 #include "exec/delimited-text-parser.inline.h"
+#include "testutil/gtest-util.h"
 #include "util/cpu-info.h"
 
 #include "common/names.h"
@@ -178,6 +179,102 @@ TEST(DelimitedTextParser, SpecialDelimiters) {
   Validate(&tuple_delim_parser, data, 2, TUPLE_DELIM, 3, 3);
 }
 
+// Parses 'data' from the start with a fresh parser and returns the field locations and
+// row ends as offsets into 'data'.
+static void ParseAll(const string& data, bool process_escapes, vector<int>* fields,
+    vector<int>* row_ends) {
+  const int NUM_COLS = 3;
+  bool is_materialized_col[NUM_COLS] = {true, false, true};
+  DelimitedTextParser parser(NUM_COLS, 0, is_materialized_col, '\n', ',', ':',
+      process_escapes ? '@' : '\0');
+  char* data_ptr = const_cast<char*>(data.c_str());
+  vector<char*> row_end_locs(data.size() + 1);
+  vector<FieldLocation> field_locations((data.size() + 1) * NUM_COLS);
+  int num_tuples = 0;
+  int num_fields = 0;
+  char* next_column_start;
+  EXPECT_OK(parser.ParseFieldLocations(data.size() + 1, data.size(), &data_ptr,
+      &row_end_locs[0], &field_locations[0], &num_tuples, &num_fields,
+      &next_column_start));
+  for (int i = 0; i < num_fields; ++i) {
+    fields->push_back(field_locations[i].start - data.c_str());
+    fields->push_back(field_locations[i].len);
+  }
+  for (int i = 0; i < num_tuples; ++i) {
+    row_ends->push_back(row_end_locs[i] - data.c_str());
+  }
+}
+
+// The AVX2 and SSE4.2 code paths must find the same fields and rows.
+TEST(DelimitedTextParser, Avx2MatchesSse) {
+  if (!CpuInfo::IsSupported(CpuInfo::AVX2)) return;
+  const char CHARS[] = "abc,:@\r\n";
+  srand(0);
+  for (int iter = 0; iter < 100; ++iter) {
+    string data;
+    int len = rand() % 300;
+    for (int i = 0; i < len; ++i) data += CHARS[rand() % (sizeof(CHARS) - 1)];
+    for (int process_escapes = 0; process_escapes < 2; ++process_escapes) {
+      vector<int> avx2_fields, avx2_row_ends, sse_fields, sse_row_ends;
+      ParseAll(data, process_escapes, &avx2_fields, &avx2_row_ends);
+      CpuInfo::EnableFeature(CpuInfo::AVX2, false);
+      ParseAll(data, process_escapes, &sse_fields, &sse_row_ends);
+      CpuInfo::EnableFeature(CpuInfo::AVX2, true);
+      EXPECT_EQ(sse_fields, avx2_fields) << data;
+      EXPECT_EQ(sse_row_ends, avx2_row_ends) << data;
+    }
+  }
+}
+
+// Returns the row ends of 'data' as offsets, parsed in batches of at most 'max_tuples'
+// tuples with ParseFieldLocations(), or with CountTuples() if 'count_only' is true.
+static vector<int> FindRowEnds(const string& data, int max_tuples, bool count_only) {
+  const int NUM_COLS = 2;
+  bool is_materialized_col[NUM_COLS] = {false, false};
+  DelimitedTextParser parser(NUM_COLS, 0, is_materialized_col, '\n', ',', ':');
+  char* data_ptr = const_cast<char*>(data.c_str());
+  char* data_end = data_ptr + data.size();
+  vector<char*> row_end_locs(max_tuples);
+  vector<FieldLocation> field_locations((data.size() + 1) * NUM_COLS);
+  vector<int> row_ends;
+  while (data_ptr < data_end) {
+    int num_tuples = 0;
+    if (count_only) {
+      parser.CountTuples(max_tuples, data_end - data_ptr, &data_ptr, &row_end_locs[0],
+          &num_tuples);
+    } else {
+      int num_fields = 0;
+      char* next_column_start;
+      EXPECT_OK(parser.ParseFieldLocations(max_tuples, data_end - data_ptr, &data_ptr,
+          &row_end_locs[0], &field_locations[0], &num_tuples, &num_fields,
+          &next_column_start));
+    }
+    for (int i = 0; i < num_tuples; ++i) {
+      row_ends.push_back(row_end_locs[i] - data.c_str());
+    }
+  }
+  return row_ends;
+}
+
+// CountTuples() must find the same rows as ParseFieldLocations(), with and without
+// AVX2.
+TEST(DelimitedTextParser, CountTuples) {
+  const char CHARS[] = "abc,:\r\n";
+  srand(0);
+  for (int iter = 0; iter < 100; ++iter) {
+    string data;
+    int len = rand() % 300;
+    for (int i = 0; i < len; ++i) data += CHARS[rand() % (sizeof(CHARS) - 1)];
+    int max_tuples = 1 + rand() % 5;
+    vector<int> expected = FindRowEnds(data, max_tuples, false);
+    EXPECT_EQ(expected, FindRowEnds(data, max_tuples, true)) << data;
+    bool has_avx2 = CpuInfo::IsSupported(CpuInfo::AVX2);
+    CpuInfo::EnableFeature(CpuInfo::AVX2, false);
+    EXPECT_EQ(expected, FindRowEnds(data, max_tuples, true)) << data;
+    CpuInfo::EnableFeature(CpuInfo::AVX2, has_avx2);
+  }
+}
+
 // TODO: expand test for other delimited text parser functions/cases.
 // Not all of them work without creating a HdfsScanNode but we can expand
 // these tests quite a bit more.
@@ -60,8 +60,10 @@ class DelimitedTextParser {
   /// This function uses SSE ("Intel x86 instruction set extension
   /// 'Streaming Simd Extension') if the hardware supports SSE4.2
   /// instructions.  SSE4.2 added string processing instructions that
-  /// allow for processing 16 characters at a time.  Otherwise, this
-  /// function walks the file_buffer_ character by character.
+  /// allow for processing 16 characters at a time.  If the hardware supports AVX2,
+  /// 32 characters at a time are compared against each delimiter instead, and the
+  /// SSE4.2 path only handles the remainder.  Otherwise, this function walks the
+  /// file_buffer_ character by character.
   /// Input Parameters:
   ///   max_tuples: The maximum number of tuples that should be parsed.
   ///               This is used to control how the batching works.
@@ -78,6 +80,14 @@ class DelimitedTextParser {
       FieldLocation* field_locations,
       int* num_tuples, int* num_fields, char** next_column_start);
 
+  /// Counts the tuples in the buffer like ParseFieldLocations(), but only searches for
+  /// the tuple delimiters and skips the fields, which is enough for scans that don't
+  /// materialize any column of the file, e.g. count(*). Uses AVX2 if the hardware
+  /// supports it. Must only be used if the parser doesn't process escapes and has a
+  /// tuple delimiter. The arguments are the same as for ParseFieldLocations().
+  void CountTuples(int max_tuples, int64_t remaining_len, char** byte_buffer_ptr,
+      char** row_end_locations, int* num_tuples);
+
   /// Parse a single tuple from buffer.
   /// - buffer/len are input parameters for the entire record.
   /// - on return field_locations will contain the start/len for each materialized
@@ -150,6 +160,40 @@ class DelimitedTextParser {
       FieldLocation* field_locations,
       int* num_tuples, int* num_fields, char** next_column_start);
 
+  /// Helper routine to parse delimited text using AVX2 instructions, 32 characters
+  /// at a time. Identical arguments and semantics as ParseSse(). Returns with fewer
+  /// than AVX2_CHARS_PER_ITERATION characters remaining unless max_tuples was
+  /// reached.
+  template <bool process_escapes>
+  void ParseAvx2(int max_tuples, int64_t* remaining_len,
+      char** byte_buffer_ptr, char** row_end_locations_,
+      FieldLocation* field_locations,
+      int* num_tuples, int* num_fields, char** next_column_start);
+
+  /// Helper routine of CountTuples() that searches AVX2_CHARS_PER_ITERATION characters
+  /// at a time. Returns with fewer than AVX2_CHARS_PER_ITERATION characters remaining
+  /// unless max_tuples was reached.
+  void CountTuplesAvx2(int max_tuples, int64_t* remaining_len, char** byte_buffer_ptr,
+      char** row_end_locations, int* num_tuples);
+
+  /// Adds the tuple that ends at the tuple delimiter 'delim_ptr' with 'remaining_len'
+  /// characters left in the buffer from 'delim_ptr' on. Ignores the '\n' of a "\r\n".
+  /// Returns true if a tuple was added.
+  bool AddCountedTuple(char* delim_ptr, int64_t remaining_len, char** row_end_locations,
+      int* num_tuples);
+
+  /// Number of characters processed per iteration by ParseAvx2().
+  static const int AVX2_CHARS_PER_ITERATION = 32;
+
+  /// Maximum number of delimiter characters: tuple delimiter, '\r', field delimiter
+  /// and collection item delimiter.
+  static const int MAX_DELIMS = 4;
+
+  /// The delimiter search characters of xmm_delim_search_. The entries past
+  /// num_delims_ repeat the first one so that ParseAvx2() can always compare against
+  /// MAX_DELIMS characters.
+  char delim_chars_[MAX_DELIMS];
+
   /// SSE(xmm) register containing the tuple search character(s).
   __m128i xmm_tuple_search_;
 
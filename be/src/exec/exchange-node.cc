@@ -80,19 +80,28 @@ Status ExchangeNode::Prepare(RuntimeState* state) {
     RETURN_IF_ERROR(sort_exec_exprs_.Prepare(
         state, row_descriptor_, row_descriptor_, expr_mem_tracker()));
     AddExprCtxsToFree(sort_exec_exprs_);
+    less_than_.reset(
+        new TupleRowComparator(sort_exec_exprs_, is_asc_order_, nulls_first_));
+    bool codegen_enabled = false;
+    Status codegen_status;
+    if (state->codegen_enabled()) {
+      codegen_status = less_than_->Codegen(state);
+      codegen_enabled = codegen_status.ok();
+    }
+    AddCodegenExecOption(codegen_enabled, codegen_status);
   }
   return Status::OK();
 }
 
 Status ExchangeNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   if (is_merging_) {
     RETURN_IF_ERROR(sort_exec_exprs_.Open(state));
-    TupleRowComparator less_than(sort_exec_exprs_, is_asc_order_, nulls_first_);
-    // CreateMerger() will populate its merging heap with batches from the stream_recvr_,
+    // CreateMerger() will populate its merging tree with batches from the stream_recvr_,
     // so it is not necessary to call FillInputRowBatch().
-    RETURN_IF_ERROR(stream_recvr_->CreateMerger(less_than));
+    RETURN_IF_ERROR(stream_recvr_->CreateMerger(*less_than_));
   } else {
     RETURN_IF_ERROR(FillInputRowBatch(state));
   }
@@ -106,9 +115,11 @@ Status ExchangeNode::Reset(RuntimeState* state) {
 
 void ExchangeNode::Close(RuntimeState* state) {
   if (is_closed()) return;
-  if (is_merging_) sort_exec_exprs_.Close(state);
+  // The receiver closes the clones of the sort exprs of its intermediate merges before
+  // the sort exprs are closed.
   if (stream_recvr_ != NULL) stream_recvr_->Close();
   stream_recvr_.reset();
+  if (is_merging_) sort_exec_exprs_.Close(state);
   ExecNode::Close(state);
 }
 
@@ -129,8 +140,11 @@ Status ExchangeNode::FillInputRowBatch(RuntimeState* state) {
 Status ExchangeNode::GetNext(RuntimeState* state, RowBatch* output_batch, bool* eos) {
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   if (ReachedLimit()) {
     stream_recvr_->TransferAllResources(output_batch);
+    // Tell the senders to stop sending rows we don't need.
+    stream_recvr_->CancelStream();
     *eos = true;
     return Status::OK();
   } else {
@@ -164,6 +178,7 @@ Status ExchangeNode::GetNext(RuntimeState* state, RowBatch* output_batch, bool*
 
       if (ReachedLimit()) {
         stream_recvr_->TransferAllResources(output_batch);
+        stream_recvr_->CancelStream();
         *eos = true;
         return Status::OK();
       }
@@ -210,6 +225,7 @@ Status ExchangeNode::GetNextMerging(RuntimeState* state, RowBatch* output_batch,
   // On eos, transfer all remaining resources from the input batches maintained
   // by the merger to the output batch.
   if (*eos) stream_recvr_->TransferAllResources(output_batch);
+  if (ReachedLimit()) stream_recvr_->CancelStream();
 
   COUNTER_SET(rows_returned_counter_, num_rows_returned_);
   return Status::OK();
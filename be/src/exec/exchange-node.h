@@ -19,6 +19,7 @@
 #include <boost/scoped_ptr.hpp>
 #include "exec/exec-node.h"
 #include "exec/sort-exec-exprs.h"
+#include "util/tuple-row-compare.h"
 
 namespace impala {
 
@@ -96,6 +97,10 @@ class ExchangeNode : public ExecNode {
   std::vector<bool> is_asc_order_;
   std::vector<bool> nulls_first_;
 
+  /// Compares the rows of the senders. Created and codegen'd in Prepare() if
+  /// is_merging_ is true.
+  boost::scoped_ptr<TupleRowComparator> less_than_;
+
   /// Offset specifying number of rows to skip.
   int64_t offset_;
 
@@ -24,12 +24,10 @@
 #include "common/object-pool.h"
 #include "common/status.h"
 #include "exprs/expr.h"
-#include "exec/aggregation-node.h"
 #include "exec/analytic-eval-node.h"
 #include "exec/data-source-scan-node.h"
 #include "exec/empty-set-node.h"
 #include "exec/exchange-node.h"
-#include "exec/hash-join-node.h"
 #include "exec/hbase-scan-node.h"
 #include "exec/hdfs-scan-node.h"
 #include "exec/kudu-scan-node.h"
@@ -56,9 +54,15 @@
 
 using namespace llvm;
 
-// TODO: remove when we remove hash-join-node.cc and aggregation-node.cc
-DEFINE_bool(enable_partitioned_hash_join, true, "Enable partitioned hash join");
-DEFINE_bool(enable_partitioned_aggregation, true, "Enable partitioned hash agg");
+// Deprecated no-ops. The non-partitioned hash join and aggregation nodes were removed,
+// and the flags are only kept so that existing startup options are still accepted.
+DEFINE_bool(enable_partitioned_hash_join, true, "Deprecated, has no effect.");
+DEFINE_bool(enable_partitioned_aggregation, true, "Deprecated, has no effect.");
+DEFINE_bool(hw_perf_counters, false, "(Advanced) If true, the cycles, instructions, "
+    "cache misses and branch misses of the threads that execute plan fragments are "
+    "counted with perf_event_open() and added to the profiles of the fragments and of "
+    "the exec nodes that caused them. Ignored if the kernel doesn't allow the counters "
+    "to be opened.");
 
 namespace impala {
 
@@ -124,6 +128,7 @@ ExecNode::ExecNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl
     num_rows_returned_(0),
     rows_returned_counter_(NULL),
     rows_returned_rate_(NULL),
+    exec_time_counters_(NULL),
     containing_subplan_(NULL),
     is_closed_(false) {
   InitRuntimeProfile(PrintPlanNodeType(tnode.node_type));
@@ -187,6 +192,7 @@ void ExecNode::Close(RuntimeState* state) {
   }
   Expr::Close(conjunct_ctxs_, state);
 
+  if (mem_tracker() != NULL) mem_tracker()->ReleaseBatchedConsumption();
   if (mem_tracker() != NULL && mem_tracker()->consumption() != 0) {
     LOG(WARNING) << "Query " << state->query_id() << " may have leaked memory." << endl
                  << state->instance_mem_tracker()->LogUsage();
@@ -297,24 +303,10 @@ Status ExecNode::CreateNode(ObjectPool* pool, const TPlanNode& tnode,
       *node = pool->Add(new KuduScanNode(pool, tnode, descs));
       break;
     case TPlanNodeType::AGGREGATION_NODE:
-      if (FLAGS_enable_partitioned_aggregation) {
-        *node = pool->Add(new PartitionedAggregationNode(pool, tnode, descs));
-      } else {
-        *node = pool->Add(new AggregationNode(pool, tnode, descs));
-      }
+      *node = pool->Add(new PartitionedAggregationNode(pool, tnode, descs));
       break;
     case TPlanNodeType::HASH_JOIN_NODE:
-      // The (old) HashJoinNode does not support left-anti, right-semi, and right-anti
-      // joins.
-      if (tnode.hash_join_node.join_op == TJoinOp::LEFT_ANTI_JOIN ||
-          tnode.hash_join_node.join_op == TJoinOp::RIGHT_SEMI_JOIN ||
-          tnode.hash_join_node.join_op == TJoinOp::RIGHT_ANTI_JOIN ||
-          tnode.hash_join_node.join_op == TJoinOp::NULL_AWARE_LEFT_ANTI_JOIN ||
-          FLAGS_enable_partitioned_hash_join) {
-        *node = pool->Add(new PartitionedHashJoinNode(pool, tnode, descs));
-      } else {
-        *node = pool->Add(new HashJoinNode(pool, tnode, descs));
-      }
+      *node = pool->Add(new PartitionedHashJoinNode(pool, tnode, descs));
       break;
     case TPlanNodeType::NESTED_LOOP_JOIN_NODE:
       *node = pool->Add(new NestedLoopJoinNode(pool, tnode, descs));
@@ -345,13 +337,6 @@ Status ExecNode::CreateNode(ObjectPool* pool, const TPlanNode& tnode,
       *node = pool->Add(new SingularRowSrcNode(pool, tnode, descs));
       break;
     case TPlanNodeType::SUBPLAN_NODE:
-      if (!FLAGS_enable_partitioned_hash_join || !FLAGS_enable_partitioned_aggregation) {
-        error_msg << "Query referencing nested types is not supported because the "
-            << "--enable_partitioned_hash_join and/or --enable_partitioned_aggregation "
-            << "Impala Daemon start-up flags are set to false.\nTo enable nested types "
-            << "support please set those flags to true (they are enabled by default).";
-        return Status(error_msg.str());
-      }
       *node = pool->Add(new SubplanNode(pool, tnode, descs));
       break;
     case TPlanNodeType::UNNEST_NODE:
@@ -415,6 +400,7 @@ void ExecNode::InitRuntimeProfile(const string& name) {
   ss << name << " (id=" << id_ << ")";
   runtime_profile_.reset(new RuntimeProfile(pool_, ss.str()));
   runtime_profile_->set_metadata(id_);
+  exec_time_counters_ = ADD_EXEC_TIME_COUNTERS(runtime_profile_, FLAGS_hw_perf_counters);
 }
 
 Status ExecNode::ExecDebugAction(TExecNodePhase::type phase, RuntimeState* state) {
@@ -445,6 +431,15 @@ bool ExecNode::EvalConjuncts(ExprContext* const* ctxs, int num_ctxs, TupleRow* r
   return true;
 }
 
+int ExecNode::EvalConjunctsBatch(ExprContext* const* ctxs, int num_ctxs, Tuple** rows,
+    int num_tuples_per_row, int* selection, int num_selected) {
+  for (int i = 0; i < num_ctxs && num_selected > 0; ++i) {
+    num_selected = ctxs[i]->EvalPredicateBatch(rows, num_tuples_per_row, selection,
+        num_selected);
+  }
+  return num_selected;
+}
+
 Status ExecNode::QueryMaintenance(RuntimeState* state) {
   FreeLocalAllocations();
   return state->CheckQueryState();
@@ -36,6 +36,7 @@ class SortExecExprs;
 class RowBatch;
 class RuntimeState;
 class TPlan;
+class Tuple;
 class TupleRow;
 class DataSink;
 class MemTracker;
@@ -85,7 +86,6 @@ class ExecNode {
   /// by the callee in subsequent GetNext() calls, it must *not* be attached to the
   /// row_batch's tuple_data_pool.
   /// Caller must not be holding any io buffers. This will cause deadlock.
-  /// TODO: AggregationNode and HashJoinNode cannot be "re-opened" yet.
   virtual Status GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) = 0;
 
   /// Resets the stream of row batches to be retrieved by subsequent GetNext() calls.
@@ -140,6 +140,13 @@ class ExecNode {
   /// out how to deal with declaring a templated std:vector type in IR
   static bool EvalConjuncts(ExprContext* const* ctxs, int num_ctxs, TupleRow* row);
 
+  /// Evaluates ExprContexts over a batch of rows with Expr::EvalPredicateBatch(), one
+  /// context at a time over the rows that passed the previous ones. 'selection' is
+  /// compacted in place to the rows for which all exprs return true, whose number is
+  /// returned.
+  static int EvalConjunctsBatch(ExprContext* const* ctxs, int num_ctxs, Tuple** rows,
+      int num_tuples_per_row, int* selection, int num_selected);
+
   /// Codegen EvalConjuncts(). Returns a non-OK status if the function couldn't be
   /// codegen'd. The codegen'd version uses inlined, codegen'd GetBooleanVal() functions.
   static Status CodegenEvalConjuncts(
@@ -163,6 +170,10 @@ class ExecNode {
   const RowDescriptor& row_desc() const { return row_descriptor_; }
   ExecNode* child(int i) { return children_[i]; }
   int num_children() const { return children_.size(); }
+
+  /// Adds 'child' as the last child of this node. Only for trees that are not created
+  /// from a TPlan by CreateTree(), e.g. benchmarks over synthetic input nodes.
+  void AddChild(ExecNode* child) { children_.push_back(child); }
   SubplanNode* get_containing_subplan() const { return containing_subplan_; }
   void set_containing_subplan(SubplanNode* sp) {
     DCHECK(containing_subplan_ == NULL);
@@ -249,6 +260,11 @@ class ExecNode {
   RuntimeProfile::Counter* rows_returned_counter_;
   RuntimeProfile::Counter* rows_returned_rate_;
 
+  /// The CPU time and wait timers of this node. Measured with
+  /// SCOPED_EXEC_TIME_MEASUREMENT next to every SCOPED_TIMER of the total time counter,
+  /// and in the threads that the node starts.
+  RuntimeProfile::ExecTimeCounters* exec_time_counters_;
+
   /// Account for peak memory used by this node
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
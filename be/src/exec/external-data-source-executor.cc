@@ -166,9 +166,11 @@ Status ExternalDataSourceExecutor::Init(const string& jar_path,
 // another namespace. The issue seems to be that SerializeThriftMsg/DeserializeThriftMsg
 // are not being generated for these types.
 // TODO: Understand what's happening, remove, and use JniUtil::CallJniMethod
+// If 'pin_result' is true, the result is deserialized without copying it out of the
+// Java heap first, see DeserializeThriftMsgPinned().
 template <typename T, typename R>
 Status CallJniMethod(const jobject& obj, const jmethodID& method, const T& arg,
-    R* response) {
+    R* response, bool pin_result = false) {
   JNIEnv* jni_env = getJNIEnv();
   jbyteArray request_bytes;
   JniLocalFrame jni_frame;
@@ -177,7 +179,11 @@ Status CallJniMethod(const jobject& obj, const jmethodID& method, const T& arg,
   jbyteArray result_bytes = static_cast<jbyteArray>(
       jni_env->CallObjectMethod(obj, method, request_bytes));
   RETURN_ERROR_IF_EXC(jni_env);
-  RETURN_IF_ERROR(DeserializeThriftMsg(jni_env, result_bytes, response));
+  if (pin_result) {
+    RETURN_IF_ERROR(DeserializeThriftMsgPinned(jni_env, result_bytes, response));
+  } else {
+    RETURN_IF_ERROR(DeserializeThriftMsg(jni_env, result_bytes, response));
+  }
   return Status::OK();
 }
 
@@ -191,7 +197,9 @@ Status ExternalDataSourceExecutor::GetNext(const TGetNextParams& params,
     TGetNextResult* result) {
   DCHECK(is_initialized_);
   const JniState& s = JniState::GetInstance();
-  return CallJniMethod(executor_, s.get_next_id_, params, result);
+  // The rows are the bulk of the data returned by the data source, so they are read
+  // straight from the Java heap.
+  return CallJniMethod(executor_, s.get_next_id_, params, result, true);
 }
 
 Status ExternalDataSourceExecutor::Close(const TCloseParams& params,
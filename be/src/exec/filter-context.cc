@@ -14,6 +14,9 @@
 
 #include "exec/filter-context.h"
 
+#include "runtime/runtime-filter.h"
+#include "util/pretty-printer.h"
+
 using namespace impala;
 using namespace strings;
 
@@ -22,7 +25,8 @@ const std::string FilterStats::FILES_KEY = "Files";
 const std::string FilterStats::SPLITS_KEY = "Splits";
 const std::string FilterStats::ROWS_KEY = "Rows";
 
-FilterStats::FilterStats(RuntimeProfile* runtime_profile, bool is_partition_filter) {
+FilterStats::FilterStats(RuntimeProfile* runtime_profile, bool is_partition_filter)
+  : is_partition_filter_(is_partition_filter) {
   DCHECK(runtime_profile != NULL);
   profile = runtime_profile;
   if (is_partition_filter) {
@@ -33,6 +37,7 @@ FilterStats::FilterStats(RuntimeProfile* runtime_profile, bool is_partition_filt
   // TODO: These only apply to Parquet, so only register them in that case.
   RegisterCounterGroup(FilterStats::ROWS_KEY);
   if (is_partition_filter) RegisterCounterGroup(FilterStats::ROW_GROUPS_KEY);
+  disabled_counter = ADD_COUNTER(profile, "Scanners disabled", TUnit::UNIT);
 }
 
 void FilterStats::IncrCounters(const string& key, int32_t total, int32_t processed,
@@ -56,6 +61,13 @@ void FilterStats::RegisterCounterGroup(const string& key) {
   counters[key] = counter;
 }
 
+void FilterStats::RecordArrival(const RuntimeFilter* filter) {
+  profile->AddInfoString("Arrival", filter->HasBloomFilter() ?
+      Substitute("Arrived after $0",
+          PrettyPrinter::Print(filter->arrival_delay(), TUnit::TIME_MS)) :
+      "Did not arrive");
+}
+
 Status FilterContext::CloneFrom(const FilterContext& from, RuntimeState* state) {
   filter = from.filter;
   stats = from.stats;
@@ -25,6 +25,7 @@
 namespace impala {
 
 class BloomFilter;
+class MinMaxFilter;
 class RuntimeFilter;
 
 /// Container struct for per-filter statistics, with statistics for each granularity of
@@ -63,6 +64,16 @@ class FilterStats {
   /// Adds a new counter group with key 'key'. Not thread safe.
   void RegisterCounterGroup(const std::string& key);
 
+  /// Counts a scanner that stopped evaluating the filter on rows because it rejected
+  /// too few of them. Thread safe.
+  void IncrDisabled() const { disabled_counter->Add(1); }
+
+  /// Records in the profile when 'filter' arrived, or that it did not arrive. Called
+  /// once the scan is done.
+  void RecordArrival(const RuntimeFilter* filter);
+
+  bool is_partition_filter() const { return is_partition_filter_; }
+
  private:
   /// Map from some key to statistics for that key.
   typedef boost::unordered_map<std::string, CounterGroup> CountersMap;
@@ -70,6 +81,12 @@ class FilterStats {
 
   /// Runtime profile to which counters are added. Owned by runtime state's object pool.
   RuntimeProfile* profile;
+
+  /// Number of scanners that disabled the filter as ineffective.
+  RuntimeProfile::Counter* disabled_counter;
+
+  /// True if the filter's target is bound by partition columns only.
+  bool is_partition_filter_;
 };
 
 /// FilterContext contains all metadata for a single runtime filter, and allows the filter
@@ -87,12 +104,17 @@ struct FilterContext {
   /// Working copy of local bloom filter
   BloomFilter* local_bloom_filter;
 
+  /// Working copy of local min/max filter. NULL if the filter has no local targets or
+  /// its type is not supported by MinMaxFilter.
+  MinMaxFilter* local_min_max_filter;
+
   /// Clones this FilterContext for use in a multi-threaded context (i.e. by scanner
   /// threads).
   Status CloneFrom(const FilterContext& from, RuntimeState* state);
 
   FilterContext()
-      : expr(NULL), filter(NULL), local_bloom_filter(NULL) { }
+      : expr(NULL), filter(NULL), local_bloom_filter(NULL),
+        local_min_max_filter(NULL) { }
 };
 
 }
@@ -179,7 +179,7 @@ class HashTableTest : public testing::Test {
   // Construct hash table with custom block manager. Returns result of HashTable::Init()
   bool CreateHashTable(bool quadratic, int64_t initial_num_buckets,
       scoped_ptr<HashTable>* table, int block_size = 8 * 1024 * 1024,
-      int max_num_blocks = 100, int reserved_blocks = 10) {
+      int max_num_blocks = 100, int reserved_blocks = 10, bool stores_duplicates = true) {
     EXPECT_TRUE(test_env_->CreateQueryState(0, max_num_blocks, block_size,
         &runtime_state_).ok());
     BufferedBlockMgr::Client* client;
@@ -189,7 +189,8 @@ class HashTableTest : public testing::Test {
     // Initial_num_buckets must be a power of two.
     EXPECT_EQ(initial_num_buckets, BitUtil::RoundUpToPowerOfTwo(initial_num_buckets));
     int64_t max_num_buckets = 1L << 31;
-    table->reset(new HashTable(quadratic, runtime_state_, client, true, 1, NULL,
+    table->reset(new HashTable(quadratic, runtime_state_, client, stores_duplicates, 1,
+          NULL,
           max_num_buckets, initial_num_buckets));
     return (*table)->Init();
   }
@@ -499,6 +500,232 @@ class HashTableTest : public testing::Test {
     ht_ctx->Close();
   }
 
+  // This test inserts duplicate build rows and marks some of them as matched. The
+  // matched flags of duplicate nodes are stored in the low bit of their next pointers, so
+  // this validates that setting them neither corrupts the duplicate chains nor leaks to
+  // other nodes.
+  void MatchedDuplicatesTest(bool quadratic) {
+    const int num_vals = 16;
+    scoped_ptr<HashTable> hash_table;
+    ASSERT_TRUE(CreateHashTable(quadratic, 64, &hash_table));
+    scoped_ptr<HashTableCtx> ht_ctx;
+    Status status = HashTableCtx::Create(runtime_state_, build_expr_ctxs_,
+        probe_expr_ctxs_, false /* !stores_nulls_ */,
+        vector<bool>(build_expr_ctxs_.size(), false), 1, 0, 1, &tracker_, &ht_ctx);
+    EXPECT_OK(status);
+
+    // Insert 'val' rows with value 'val'. Values > 1 end up in duplicate nodes.
+    int total_rows = 0;
+    for (int val = 1; val <= num_vals; ++val) {
+      for (int i = 0; i < val; ++i) {
+        TupleRow* row = CreateTupleRow(val);
+        ASSERT_TRUE(ht_ctx->EvalAndHashBuild(row));
+        BufferedTupleStream::RowIdx dummy_row_idx;
+        ASSERT_TRUE(hash_table->Insert(ht_ctx.get(), dummy_row_idx, row));
+        ++total_rows;
+      }
+    }
+
+    // Mark every other row of each value as matched.
+    int num_matched = 0;
+    for (int val = 1; val <= num_vals; ++val) {
+      TupleRow* probe_row = CreateTupleRow(val);
+      ASSERT_TRUE(ht_ctx->EvalAndHashProbe(probe_row));
+      HashTable::Iterator iter = hash_table->FindProbeRow(ht_ctx.get());
+      int num_dups = 0;
+      for (; !iter.AtEnd(); iter.NextDuplicate(), ++num_dups) {
+        EXPECT_FALSE(iter.IsMatched());
+        if (num_dups % 2 == 0) {
+          iter.SetMatched();
+          EXPECT_TRUE(iter.IsMatched());
+          ++num_matched;
+        }
+      }
+      EXPECT_EQ(num_dups, val);
+    }
+    EXPECT_TRUE(hash_table->HasMatches());
+
+    // A full scan still visits every row and the unmatched scan visits the rest.
+    int num_scanned = 0;
+    for (HashTable::Iterator iter = hash_table->Begin(ht_ctx.get()); !iter.AtEnd();
+         iter.Next()) {
+      ++num_scanned;
+    }
+    EXPECT_EQ(num_scanned, total_rows);
+    int num_unmatched = 0;
+    for (HashTable::Iterator iter = hash_table->FirstUnmatched(ht_ctx.get());
+         !iter.AtEnd(); iter.NextUnmatched()) {
+      EXPECT_FALSE(iter.IsMatched());
+      ++num_unmatched;
+    }
+    EXPECT_EQ(num_unmatched, total_rows - num_matched);
+
+    hash_table->Close();
+    ht_ctx->Close();
+  }
+
+  // This test marks some rows without duplicates as matched, whose flags are stored in
+  // the table's bitmap of matched buckets, and validates that the unmatched scan skips
+  // them before and after resizing the table.
+  void MatchedBucketsTest(bool quadratic) {
+    const int num_vals = 32;
+    scoped_ptr<HashTable> hash_table;
+    ASSERT_TRUE(CreateHashTable(quadratic, 64, &hash_table));
+    scoped_ptr<HashTableCtx> ht_ctx;
+    Status status = HashTableCtx::Create(runtime_state_, build_expr_ctxs_,
+        probe_expr_ctxs_, false /* !stores_nulls_ */,
+        vector<bool>(build_expr_ctxs_.size(), false), 1, 0, 1, &tracker_, &ht_ctx);
+    EXPECT_OK(status);
+
+    for (int val = 0; val < num_vals; ++val) {
+      TupleRow* row = CreateTupleRow(val);
+      ASSERT_TRUE(ht_ctx->EvalAndHashBuild(row));
+      BufferedTupleStream::RowIdx dummy_row_idx;
+      ASSERT_TRUE(hash_table->Insert(ht_ctx.get(), dummy_row_idx, row));
+    }
+    EXPECT_FALSE(hash_table->HasMatches());
+
+    // Mark the rows with odd values as matched.
+    for (int val = 1; val < num_vals; val += 2) {
+      TupleRow* probe_row = CreateTupleRow(val);
+      ASSERT_TRUE(ht_ctx->EvalAndHashProbe(probe_row));
+      HashTable::Iterator iter = hash_table->FindProbeRow(ht_ctx.get());
+      ASSERT_FALSE(iter.AtEnd());
+      EXPECT_FALSE(iter.IsMatched());
+      iter.SetMatched();
+      EXPECT_TRUE(iter.IsMatched());
+    }
+    EXPECT_TRUE(hash_table->HasMatches());
+
+    for (int i = 0; i < 2; ++i) {
+      int num_unmatched = 0;
+      for (HashTable::Iterator iter = hash_table->FirstUnmatched(ht_ctx.get());
+           !iter.AtEnd(); iter.NextUnmatched()) {
+        EXPECT_FALSE(iter.IsMatched());
+        int32_t val = *reinterpret_cast<int32_t*>(build_expr_ctxs_[0]->GetValue(
+            iter.GetRow()));
+        EXPECT_EQ(val % 2, 0);
+        ++num_unmatched;
+      }
+      EXPECT_EQ(num_unmatched, num_vals / 2);
+      // The matched flags are moved along with the buckets.
+      ResizeTable(hash_table.get(), 256, ht_ctx.get());
+    }
+
+    hash_table->Close();
+    ht_ctx->Close();
+  }
+
+  // This test inserts every key several times into a hash table that doesn't store
+  // duplicates, which should keep the last row of each key.
+  void NoDuplicatesTest(bool quadratic) {
+    const int num_vals = 16;
+    scoped_ptr<HashTable> hash_table;
+    ASSERT_TRUE(CreateHashTable(quadratic, 64, &hash_table, 8 * 1024 * 1024, 100, 10,
+        false /* !stores_duplicates */));
+    scoped_ptr<HashTableCtx> ht_ctx;
+    Status status = HashTableCtx::Create(runtime_state_, build_expr_ctxs_,
+        probe_expr_ctxs_, false /* !stores_nulls_ */,
+        vector<bool>(build_expr_ctxs_.size(), false), 1, 0, 1, &tracker_, &ht_ctx);
+    EXPECT_OK(status);
+
+    TupleRow* last_rows[num_vals];
+    for (int i = 0; i < 3; ++i) {
+      for (int val = 0; val < num_vals; ++val) {
+        TupleRow* row = CreateTupleRow(val);
+        ASSERT_TRUE(ht_ctx->EvalAndHashBuild(row));
+        BufferedTupleStream::RowIdx dummy_row_idx;
+        ASSERT_TRUE(hash_table->Insert(ht_ctx.get(), dummy_row_idx, row));
+        last_rows[val] = row;
+      }
+    }
+    EXPECT_EQ(hash_table->size(), num_vals);
+    EXPECT_EQ(hash_table->EmptyBuckets(), 64 - num_vals);
+
+    for (int val = 0; val < num_vals; ++val) {
+      TupleRow* probe_row = CreateTupleRow(val);
+      ASSERT_TRUE(ht_ctx->EvalAndHashProbe(probe_row));
+      HashTable::Iterator iter = hash_table->FindProbeRow(ht_ctx.get());
+      ASSERT_FALSE(iter.AtEnd());
+      EXPECT_EQ(iter.GetTuple(), last_rows[val]->GetTuple(0));
+      iter.NextDuplicate();
+      EXPECT_TRUE(iter.AtEnd());
+    }
+
+    hash_table->Close();
+    ht_ctx->Close();
+  }
+
+  // Probes 'hash_table' for the values in [0, 2 * num_vals) and checks that the values
+  // below num_vals match 'num_dups' rows and the others none.
+  void DirectIndexProbe(HashTable* hash_table, HashTableCtx* ht_ctx, int num_vals,
+      int num_dups) {
+    for (int val = 0; val < 2 * num_vals; ++val) {
+      TupleRow* probe_row = CreateTupleRow(val);
+      ASSERT_TRUE(ht_ctx->EvalAndHashProbe(probe_row));
+      HashTable::Iterator iter = hash_table->FindProbeRow(ht_ctx);
+      int num_matches = 0;
+      while (!iter.AtEnd()) {
+        ValidateMatch(probe_row, iter.GetRow());
+        ++num_matches;
+        iter.NextDuplicate();
+      }
+      EXPECT_EQ(num_matches, val < num_vals ? num_dups : 0) << val;
+    }
+  }
+
+  // This test adds a direct index to a hash table with some rows, keeps inserting and
+  // probing through the index and checks that the index is carried over by a resize and
+  // dropped when a key falls outside of its range.
+  void DirectIndexTest(bool quadratic) {
+    const int num_vals = 32;
+    scoped_ptr<HashTable> hash_table;
+    ASSERT_TRUE(CreateHashTable(quadratic, 64, &hash_table));
+    scoped_ptr<HashTableCtx> ht_ctx;
+    Status status = HashTableCtx::Create(runtime_state_, build_expr_ctxs_,
+        probe_expr_ctxs_, false /* !stores_nulls_ */,
+        vector<bool>(build_expr_ctxs_.size(), false), 1, 0, 1, &tracker_, &ht_ctx);
+    EXPECT_OK(status);
+    ASSERT_GT(ht_ctx->direct_index_key_bytes(), 0);
+
+    BufferedTupleStream::RowIdx dummy_row_idx;
+    for (int val = 0; val < num_vals / 2; ++val) {
+      TupleRow* row = CreateTupleRow(val);
+      ASSERT_TRUE(ht_ctx->EvalAndHashBuild(row));
+      ASSERT_TRUE(hash_table->Insert(ht_ctx.get(), dummy_row_idx, row));
+    }
+    ASSERT_TRUE(hash_table->InitDirectIndex(ht_ctx.get(), 0, 2 * num_vals));
+    for (int val = num_vals / 2; val < num_vals; ++val) {
+      TupleRow* row = CreateTupleRow(val);
+      ASSERT_TRUE(ht_ctx->EvalAndHashBuild(row));
+      ASSERT_TRUE(hash_table->Insert(ht_ctx.get(), dummy_row_idx, row));
+    }
+    EXPECT_TRUE(hash_table->has_direct_index());
+    DirectIndexProbe(hash_table.get(), ht_ctx.get(), num_vals, 1);
+
+    // Duplicates are found through the index.
+    for (int val = 0; val < num_vals; ++val) {
+      TupleRow* row = CreateTupleRow(val);
+      ASSERT_TRUE(ht_ctx->EvalAndHashBuild(row));
+      ASSERT_TRUE(hash_table->Insert(ht_ctx.get(), dummy_row_idx, row));
+    }
+    DirectIndexProbe(hash_table.get(), ht_ctx.get(), num_vals, 2);
+
+    ResizeTable(hash_table.get(), 256, ht_ctx.get());
+    EXPECT_TRUE(hash_table->has_direct_index());
+    DirectIndexProbe(hash_table.get(), ht_ctx.get(), num_vals, 2);
+
+    // A key outside of the range drops the index, the table keeps working.
+    TupleRow* row = CreateTupleRow(10 * num_vals);
+    ASSERT_TRUE(ht_ctx->EvalAndHashBuild(row));
+    ASSERT_TRUE(hash_table->Insert(ht_ctx.get(), dummy_row_idx, row));
+    EXPECT_FALSE(hash_table->has_direct_index());
+    DirectIndexProbe(hash_table.get(), ht_ctx.get(), num_vals, 2);
+
+    hash_table->Close();
+    ht_ctx->Close();
+  }
+
   // This test makes sure we can tolerate the low memory case where we do not have enough
   // memory to allocate the array of buckets for the hash table.
   void VeryLowMemTest(bool quadratic) {
@@ -594,6 +821,38 @@ TEST_F(HashTableTest, QuadraticInsertFullTest) {
   InsertFullTest(true, 65536);
 }
 
+TEST_F(HashTableTest, LinearMatchedDuplicatesTest) {
+  MatchedDuplicatesTest(false);
+}
+
+TEST_F(HashTableTest, QuadraticMatchedDuplicatesTest) {
+  MatchedDuplicatesTest(true);
+}
+
+TEST_F(HashTableTest, LinearMatchedBucketsTest) {
+  MatchedBucketsTest(false);
+}
+
+TEST_F(HashTableTest, QuadraticMatchedBucketsTest) {
+  MatchedBucketsTest(true);
+}
+
+TEST_F(HashTableTest, LinearNoDuplicatesTest) {
+  NoDuplicatesTest(false);
+}
+
+TEST_F(HashTableTest, QuadraticNoDuplicatesTest) {
+  NoDuplicatesTest(true);
+}
+
+TEST_F(HashTableTest, LinearDirectIndexTest) {
+  DirectIndexTest(false);
+}
+
+TEST_F(HashTableTest, QuadraticDirectIndexTest) {
+  DirectIndexTest(true);
+}
+
 // Test that hashing empty string updates hash value.
 TEST_F(HashTableTest, HashEmpty) {
   EXPECT_TRUE(test_env_->CreateQueryState(0, 100, 8 * 1024 * 1024,
@@ -615,6 +874,49 @@ TEST_F(HashTableTest, HashEmpty) {
   ht_ctx.get()->Close();
 }
 
+// Test that the values in one partition of a level are partitioned evenly at the next
+// level, i.e. that the partitioning bits of the levels are not correlated.
+TEST_F(HashTableTest, HashLevelsIndependent) {
+  EXPECT_TRUE(test_env_->CreateQueryState(0, 100, 8 * 1024 * 1024,
+      &runtime_state_).ok());
+  const int MAX_LEVELS = 4;
+  const int NUM_PARTITIONING_BITS = 4;
+  const int FANOUT = 1 << NUM_PARTITIONING_BITS;
+  scoped_ptr<HashTableCtx> ht_ctx;
+  Status status = HashTableCtx::Create(runtime_state_, build_expr_ctxs_,
+      probe_expr_ctxs_, false /* !stores_nulls_ */,
+      vector<bool>(build_expr_ctxs_.size(), false), 1, MAX_LEVELS, 1, &tracker_,
+      &ht_ctx);
+  EXPECT_OK(status);
+
+  const int64_t NUM_VALUES = FANOUT * FANOUT * 256;
+  for (int level = 0; level < MAX_LEVELS; ++level) {
+    // Collect the values in the first partition of this level.
+    ht_ctx->set_level(level);
+    vector<int64_t> partition;
+    for (int64_t value = 0; value < NUM_VALUES; ++value) {
+      uint32_t hash = ht_ctx->Hash(&value, sizeof(value), ht_ctx->seed(level));
+      if (hash >> (32 - NUM_PARTITIONING_BITS) == 0) partition.push_back(value);
+    }
+    int partition_size = partition.size();
+    EXPECT_GT(partition_size, NUM_VALUES / FANOUT / 2) << level;
+    EXPECT_LT(partition_size, NUM_VALUES / FANOUT * 2) << level;
+
+    ht_ctx->set_level(level + 1);
+    vector<int> counts(FANOUT, 0);
+    for (int64_t value: partition) {
+      uint32_t hash = ht_ctx->Hash(&value, sizeof(value), ht_ctx->seed(level + 1));
+      ++counts[hash >> (32 - NUM_PARTITIONING_BITS)];
+    }
+    int expected_count = partition_size / FANOUT;
+    for (int i = 0; i < FANOUT; ++i) {
+      EXPECT_GT(counts[i], expected_count / 2) << level << " " << i;
+      EXPECT_LT(counts[i], expected_count * 2) << level << " " << i;
+    }
+  }
+  ht_ctx.get()->Close();
+}
+
 TEST_F(HashTableTest, VeryLowMemTest) {
   VeryLowMemTest(true);
   VeryLowMemTest(false);
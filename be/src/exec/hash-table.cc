@@ -15,6 +15,7 @@
 #include "exec/hash-table.inline.h"
 
 #include <functional>
+#include <limits>
 #include <numeric>
 #include <gutil/strings/substitute.h>
 
@@ -38,6 +39,10 @@ using namespace llvm;
 using namespace strings;
 
 DEFINE_bool(enable_quadratic_probing, true, "Enable quadratic probing hash table");
+DEFINE_int64(hash_table_direct_index_max_keys, 64 * 1024, "(Advanced) Maximum number "
+    "of keys of the direct index of a hash table with a single integer key, which maps "
+    "each key of a small range to its bucket so that lookups don't probe the table. "
+    "Set to 0 to never build direct indexes.");
 
 const char* HashTableCtx::LLVM_CLASS_NAME = "class.impala::HashTableCtx";
 
@@ -77,9 +82,10 @@ static int64_t NULL_VALUE[] = { HashUtil::FNV_SEED, HashUtil::FNV_SEED,
                                 HashUtil::FNV_SEED, HashUtil::FNV_SEED };
 
 // The first NUM_SMALL_BLOCKS of nodes_ are made of blocks less than the IO size (of 8MB)
-// to reduce the memory footprint of small queries. In particular, we always first use a
-// 64KB and a 512KB block before starting using IO-sized blocks.
-static const int64_t INITIAL_DATA_PAGE_SIZES[] = { 64 * 1024, 512 * 1024 };
+// to reduce the memory footprint of small queries. In particular, we always first use
+// blocks of 64KB up to 512KB, doubling in size, before starting using IO-sized blocks.
+static const int64_t INITIAL_DATA_PAGE_SIZES[] =
+    { 64 * 1024, 128 * 1024, 256 * 1024, 512 * 1024 };
 static const int NUM_SMALL_DATA_PAGES = sizeof(INITIAL_DATA_PAGE_SIZES) / sizeof(int64_t);
 
 HashTableCtx::HashTableCtx(const std::vector<ExprContext*>& build_expr_ctxs,
@@ -94,7 +100,8 @@ HashTableCtx::HashTableCtx(const std::vector<ExprContext*>& build_expr_ctxs,
           finds_nulls_.begin(), finds_nulls_.end(), false, std::logical_or<bool>())),
       level_(0),
       scratch_row_(NULL),
-      tracker_(tracker) {
+      tracker_(tracker),
+      direct_index_key_bytes_(0) {
   DCHECK(!finds_some_nulls_ || stores_nulls_);
   // Compute the layout and buffer size to store the evaluated expr results
   DCHECK_EQ(build_expr_ctxs_.size(), probe_expr_ctxs_.size());
@@ -110,6 +117,15 @@ HashTableCtx::HashTableCtx(const std::vector<ExprContext*>& build_expr_ctxs,
   for (int i = 1; i <= max_levels; ++i) {
     seeds_[i] = seeds_[i - 1] * SEED_PRIMES[i];
   }
+
+  if (build_expr_ctxs_.size() == 1) {
+    const ColumnType& type = build_expr_ctxs_[0]->root()->type();
+    if (type == probe_expr_ctxs_[0]->root()->type() && (type.type == TYPE_TINYINT ||
+        type.type == TYPE_SMALLINT || type.type == TYPE_INT ||
+        type.type == TYPE_BIGINT)) {
+      direct_index_key_bytes_ = type.GetByteSize();
+    }
+  }
 }
 
 Status HashTableCtx::Create(RuntimeState* state,
@@ -141,8 +157,10 @@ void HashTableCtx::Close() {
 uint32_t HashTableCtx::Hash(const void* input, int len, uint32_t hash) const {
   /// Use CRC hash at first level for better performance. Switch to murmur hash at
   /// subsequent levels since CRC doesn't randomize well with different seed inputs.
+  /// The 64-bit murmur hash is folded, so that the partitioning bits of each level
+  /// depend on all of the hash state and the whole seed of the level.
   if (level_ == 0) return HashUtil::Hash(input, len, hash);
-  return HashUtil::MurmurHash2_64(input, len, hash);
+  return HashUtil::MurmurHash2_64to32(input, len, hash);
 }
 
 uint32_t HashTableCtx::HashCurrentRow() const {
@@ -179,6 +197,27 @@ bool HashTableCtx::EvalRow(TupleRow* row, const vector<ExprContext*>& ctxs) {
   return has_null;
 }
 
+bool HashTableCtx::EvalBuildIntegerKey(TupleRow* row, int64_t* key) const {
+  DCHECK_GT(direct_index_key_bytes_, 0);
+  void* value = build_expr_ctxs_[0]->GetValue(row);
+  if (value == NULL) return false;
+  switch (direct_index_key_bytes_) {
+    case 1:
+      *key = *reinterpret_cast<int8_t*>(value);
+      break;
+    case 2:
+      *key = *reinterpret_cast<int16_t*>(value);
+      break;
+    case 4:
+      *key = *reinterpret_cast<int32_t*>(value);
+      break;
+    default:
+      DCHECK_EQ(direct_index_key_bytes_, 8);
+      *key = *reinterpret_cast<int64_t*>(value);
+  }
+  return true;
+}
+
 uint32_t HashTableCtx::HashVariableLenRow() const {
   uint32_t hash = seeds_[level_];
   int var_result_offset = expr_values_cache_.var_result_offset();
@@ -339,6 +378,8 @@ void HashTableCtx::ExprValuesCache::ResetForRead() {
 }
 
 const double HashTable::MAX_FILL_FACTOR = 0.75f;
+const int64_t HashTable::DIRECT_INDEX_NULL_KEY;
+const int64_t HashTable::DIRECT_INDEX_OUT_OF_RANGE;
 
 HashTable* HashTable::Create(RuntimeState* state,
     BufferedBlockMgr::Client* client, bool stores_duplicates, int num_build_tuples,
@@ -364,12 +405,17 @@ HashTable::HashTable(bool quadratic_probing, RuntimeState* state,
     max_num_buckets_(max_num_buckets),
     buckets_(NULL),
     num_buckets_(num_buckets),
+    matched_buckets_(0),
     num_filled_buckets_(0),
     num_buckets_with_duplicates_(0),
     num_build_tuples_(num_build_tuples),
     has_matches_(false),
     num_probes_(0), num_failed_probes_(0), travel_length_(0), num_hash_collisions_(0),
-    num_resizes_(0) {
+    num_hash_mismatch_skips_(0), num_resizes_(0),
+    direct_index_(NULL),
+    direct_index_min_key_(0),
+    direct_index_num_keys_(0),
+    direct_index_insert_offset_(DIRECT_INDEX_OUT_OF_RANGE) {
   DCHECK_EQ((num_buckets & (num_buckets-1)), 0) << "num_buckets must be a power of 2";
   DCHECK_GT(num_buckets, 0) << "num_buckets must be larger than 0";
   DCHECK(stores_tuples_ || stream != NULL);
@@ -377,16 +423,64 @@ HashTable::HashTable(bool quadratic_probing, RuntimeState* state,
 }
 
 bool HashTable::Init() {
-  int64_t buckets_byte_size = num_buckets_ * sizeof(Bucket);
-  if (!state_->block_mgr()->ConsumeMemory(block_mgr_client_, buckets_byte_size)) {
+  if (!state_->block_mgr()->ConsumeMemory(block_mgr_client_,
+          BucketsByteSize(num_buckets_))) {
     num_buckets_ = 0;
     return false;
   }
+  int64_t buckets_byte_size = num_buckets_ * sizeof(Bucket);
   buckets_ = reinterpret_cast<Bucket*>(malloc(buckets_byte_size));
   memset(buckets_, 0, buckets_byte_size);
+  if (stores_duplicates_) {
+    // All buckets are empty.
+    matched_buckets_.Reset(num_buckets_);
+    matched_buckets_.SetAllBits(true);
+  }
   return true;
 }
 
+bool HashTable::InitDirectIndex(HashTableCtx* ht_ctx, int64_t min_key,
+    int64_t num_keys) {
+  DCHECK(direct_index_ == NULL);
+  DCHECK_GT(num_keys, 0);
+  if (ht_ctx->direct_index_key_bytes() == 0) return false;
+  if (num_keys > FLAGS_hash_table_direct_index_max_keys) return false;
+  // The index stores bucket indices as int32_t.
+  if (num_buckets_ > std::numeric_limits<int32_t>::max()) return false;
+  int64_t byte_size = num_keys * sizeof(int32_t);
+  if (!state_->block_mgr()->ConsumeMemory(block_mgr_client_, byte_size)) return false;
+  direct_index_ = reinterpret_cast<int32_t*>(malloc(byte_size));
+  // Sets every entry to -1.
+  memset(direct_index_, 0xff, byte_size);
+  direct_index_min_key_ = min_key;
+  direct_index_num_keys_ = num_keys;
+  for (int64_t bucket_idx = 0; bucket_idx < num_buckets_; ++bucket_idx) {
+    Bucket* bucket = &buckets_[bucket_idx];
+    if (!bucket->filled) continue;
+    int64_t key;
+    // NULL keys aren't indexed.
+    if (!ht_ctx->EvalBuildIntegerKey(GetRow(bucket, ht_ctx->scratch_row()), &key)) {
+      continue;
+    }
+    uint64_t offset = static_cast<uint64_t>(key) - static_cast<uint64_t>(min_key);
+    if (offset >= static_cast<uint64_t>(num_keys)) {
+      CloseDirectIndex();
+      return false;
+    }
+    direct_index_[offset] = bucket_idx;
+  }
+  return true;
+}
+
+void HashTable::CloseDirectIndex() {
+  if (direct_index_ == NULL) return;
+  free(direct_index_);
+  direct_index_ = NULL;
+  state_->block_mgr()->ReleaseMemory(block_mgr_client_,
+      direct_index_num_keys_ * sizeof(int32_t));
+  direct_index_num_keys_ = 0;
+}
+
 void HashTable::Close() {
   // Print statistics only for the large or heavily used hash tables.
   // TODO: Tweak these numbers/conditions, or print them always?
@@ -401,8 +495,10 @@ void HashTable::Close() {
     ImpaladMetrics::HASH_TABLE_TOTAL_BYTES->Increment(-total_data_page_size_);
   }
   data_pages_.clear();
+  CloseDirectIndex();
   if (buckets_ != NULL) free(buckets_);
-  state_->block_mgr()->ReleaseMemory(block_mgr_client_, num_buckets_ * sizeof(Bucket));
+  matched_buckets_ = Bitmap(0);
+  state_->block_mgr()->ReleaseMemory(block_mgr_client_, BucketsByteSize(num_buckets_));
 }
 
 bool HashTable::CheckAndResize(uint64_t buckets_to_fill, const HashTableCtx* ht_ctx) {
@@ -431,12 +527,20 @@ bool HashTable::ResizeBuckets(int64_t num_buckets, const HashTableCtx* ht_ctx) {
   // Note that while we copying over the contents of the old hash table, we need to have
   // allocated both the old and the new hash table. Once we finish, we return the memory
   // of the old hash table.
-  int64_t old_size = num_buckets_ * sizeof(Bucket);
-  int64_t new_size = num_buckets * sizeof(Bucket);
-  if (!state_->block_mgr()->ConsumeMemory(block_mgr_client_, new_size)) return false;
-  Bucket* new_buckets = reinterpret_cast<Bucket*>(malloc(new_size));
+  int64_t old_size = BucketsByteSize(num_buckets_);
+  if (!state_->block_mgr()->ConsumeMemory(block_mgr_client_,
+          BucketsByteSize(num_buckets))) {
+    return false;
+  }
+  int64_t new_buckets_size = num_buckets * sizeof(Bucket);
+  Bucket* new_buckets = reinterpret_cast<Bucket*>(malloc(new_buckets_size));
   DCHECK(new_buckets != NULL);
-  memset(new_buckets, 0, new_size);
+  memset(new_buckets, 0, new_buckets_size);
+  Bitmap new_matched_buckets(stores_duplicates_ ? num_buckets : 0);
+  if (stores_duplicates_) new_matched_buckets.SetAllBits(true);
+  if (num_buckets > std::numeric_limits<int32_t>::max()) CloseDirectIndex();
+  // The new index of each old bucket, to update the direct index with.
+  vector<int32_t> moved_buckets(direct_index_ != NULL ? num_buckets_ : 0);
 
   // Walk the old table and copy all the filled buckets to the new (resized) table.
   // We do not have to do anything with the duplicate nodes. This operation is expected
@@ -452,11 +556,22 @@ bool HashTable::ResizeBuckets(int64_t num_buckets, const HashTableCtx* ht_ctx) {
         " there are free buckets. " << num_buckets << " " << num_filled_buckets_;
     Bucket* dst_bucket = &new_buckets[bucket_idx];
     *dst_bucket = *bucket_to_copy;
+    if (stores_duplicates_) {
+      new_matched_buckets.Set<false>(bucket_idx,
+          matched_buckets_.Get<false>(iter.bucket_idx_));
+    }
+    if (direct_index_ != NULL) moved_buckets[iter.bucket_idx_] = bucket_idx;
+  }
+  if (direct_index_ != NULL) {
+    for (int64_t i = 0; i < direct_index_num_keys_; ++i) {
+      if (direct_index_[i] >= 0) direct_index_[i] = moved_buckets[direct_index_[i]];
+    }
   }
 
   num_buckets_ = num_buckets;
   free(buckets_);
   buckets_ = new_buckets;
+  std::swap(matched_buckets_, new_matched_buckets);
   state_->block_mgr()->ReleaseMemory(block_mgr_client_, old_size);
   return true;
 }
@@ -502,7 +617,7 @@ string HashTable::DebugString(bool skip_empty, bool show_match,
     if (skip_empty && !buckets_[i].filled) continue;
     ss << i << ": ";
     if (show_match) {
-      if (buckets_[i].matched) {
+      if (stores_duplicates_ && buckets_[i].filled && matched_buckets_.Get<false>(i)) {
         ss << " [M]";
       } else {
         ss << " [U]";
@@ -515,7 +630,7 @@ string HashTable::DebugString(bool skip_empty, bool show_match,
       while (node != NULL) {
         if (!first) ss << ",";
         DebugStringTuple(ss, node->htdata, desc);
-        node = node->next;
+        node = node->next();
         first = false;
       }
     } else {
@@ -544,6 +659,7 @@ string HashTable::PrintStats() const {
   ss << "FailedProbes: " << num_failed_probes_ << endl;
   ss << "Travel: " << travel_length_ << " " << avg_travel << endl;
   ss << "HashCollisions: " << num_hash_collisions_ << " " << avg_collisions << endl;
+  ss << "HashMismatchSkips: " << num_hash_mismatch_skips_ << endl;
   ss << "Resizes: " << num_resizes_ << endl;
   return ss.str();
 }
@@ -875,8 +991,8 @@ Status HashTableCtx::CodegenHashCurrentRow(RuntimeState* state, bool use_murmur,
     // No variable length slots, just hash what is in 'expr_expr_values_cache_'
     if (expr_values_bytes_per_row > 0) {
       Function* hash_fn = use_murmur ?
-                          codegen->GetMurmurHashFunction(expr_values_bytes_per_row) :
-                          codegen->GetHashFunction(expr_values_bytes_per_row);
+          codegen->GetMurmurHash64to32Function(expr_values_bytes_per_row) :
+          codegen->GetHashFunction(expr_values_bytes_per_row);
       Value* len = codegen->GetIntConstant(TYPE_INT, expr_values_bytes_per_row);
       hash_result = builder.CreateCall(hash_fn,
           ArrayRef<Value*>({cur_expr_values, len, hash_result}), "hash");
@@ -884,7 +1000,7 @@ Status HashTableCtx::CodegenHashCurrentRow(RuntimeState* state, bool use_murmur,
   } else {
     if (var_result_offset > 0) {
       Function* hash_fn = use_murmur ?
-                          codegen->GetMurmurHashFunction(var_result_offset) :
+                          codegen->GetMurmurHash64to32Function(var_result_offset) :
                           codegen->GetHashFunction(var_result_offset);
       Value* len = codegen->GetIntConstant(TYPE_INT, var_result_offset);
       hash_result = builder.CreateCall(hash_fn,
@@ -923,8 +1039,8 @@ Status HashTableCtx::CodegenHashCurrentRow(RuntimeState* state, bool use_murmur,
         // the data
         builder.SetInsertPoint(null_block);
         Function* null_hash_fn = use_murmur ?
-                                 codegen->GetMurmurHashFunction(sizeof(StringValue)) :
-                                 codegen->GetHashFunction(sizeof(StringValue));
+            codegen->GetMurmurHash64to32Function(sizeof(StringValue)) :
+            codegen->GetHashFunction(sizeof(StringValue));
         Value* len = codegen->GetIntConstant(TYPE_INT, sizeof(StringValue));
         str_null_result = builder.CreateCall(null_hash_fn,
             ArrayRef<Value*>({llvm_loc, len, hash_result}), "str_null");
@@ -943,7 +1059,7 @@ Status HashTableCtx::CodegenHashCurrentRow(RuntimeState* state, bool use_murmur,
       len = builder.CreateLoad(len, "len");
 
       // Call hash(ptr, len, hash_result);
-      Function* general_hash_fn = use_murmur ? codegen->GetMurmurHashFunction() :
+      Function* general_hash_fn = use_murmur ? codegen->GetMurmurHash64to32Function() :
                                   codegen->GetHashFunction();
       Value* string_hash_result = builder.CreateCall(general_hash_fn,
           ArrayRef<Value*>({ptr, len, hash_result}), "string_hash");
@@ -87,7 +87,8 @@ class HashTable;
 ///
 /// TODO: Compare linear and quadratic probing and remove the loser.
 /// TODO: We currently use 32-bit hashes. There is room in the bucket structure for at
-/// least 48-bits. We should exploit this space.
+/// least 48-bits. We should exploit this space if NumHashCollisions() shows that full
+/// row comparisons on false candidates matter.
 /// TODO: Consider capping the probes with a threshold value. If an insert reaches
 /// that threshold it is inserted to another linked list of overflow entries.
 /// TODO: Smarter resizes, and perhaps avoid using powers of 2 as the hash table size.
@@ -98,7 +99,11 @@ class HashTable;
 /// the rows and then calls scan to find them.  Aggregation interleaves FindProbeRow() and
 /// Inserts().  We may want to optimize joins more heavily for Inserts() (in particular
 /// growing).
-/// TODO: Batched interface for inserts and finds.
+/// Inserts and finds are batched by the exec nodes in groups of rows whose evaluated
+/// expression values and hashes are cached in the HashTableCtx's ExprValuesCache (see
+/// below). For a group, the nodes first evaluate and hash all rows and prefetch their
+/// buckets (PrefetchBucket()), then optionally prefetch the data referenced by those
+/// buckets (PrefetchBucketData()) and finally perform the actual inserts or probes.
 /// TODO: Do we need to check mem limit exceeded so often. Check once per batch?
 /// TODO: as an optimization, compute variable-length data size for the agg node.
 
@@ -161,6 +166,19 @@ class HashTableCtx {
     return static_cast<bool>(*expr_values_cache_.ExprValueNullPtr(expr_idx));
   }
 
+  /// The byte size of the key if the build and probe side have a single TINYINT,
+  /// SMALLINT, INT or BIGINT expr of the same type, which a direct index can be built
+  /// on, see HashTable::InitDirectIndex(). 0 otherwise.
+  int direct_index_key_bytes() const { return direct_index_key_bytes_; }
+
+  /// Sets 'key' to the integer key of the current row of the ExprValuesCache. Returns
+  /// false if it is NULL. direct_index_key_bytes() must be non-zero.
+  bool IR_ALWAYS_INLINE CurrentIntegerKey(int64_t* key) const;
+
+  /// Evaluates the integer key of the build row 'row' into 'key'. Returns false if it
+  /// is NULL. direct_index_key_bytes() must be non-zero.
+  bool EvalBuildIntegerKey(TupleRow* row, int64_t* key) const;
+
   /// Evaluate and hash the build/probe row, saving the evaluation to the current row of
   /// the ExprValuesCache in this hash table context: the results are saved in
   /// 'cur_expr_values_', the nullness of expressions values in 'cur_expr_values_null_',
@@ -386,6 +404,7 @@ class HashTableCtx {
  private:
   friend class HashTable;
   friend class HashTableTest_HashEmpty_Test;
+  friend class HashTableTest_HashLevelsIndependent_Test;
 
   /// Allocate various buffers for storing expression evaluation results, hash values,
   /// null bits etc. Returns error if allocation causes query memory limit to be exceeded.
@@ -465,17 +484,29 @@ class HashTableCtx {
   /// Memory tracker of the exec node which owns this hash table context. Account the
   /// memory usage of expression values cache towards it.
   MemTracker* tracker_;
+
+  /// See direct_index_key_bytes().
+  int direct_index_key_bytes_;
 };
 
 /// The hash table consists of a contiguous array of buckets that contain a pointer to the
-/// data, the hash value and three flags: whether this bucket is filled, whether this
-/// entry has been matched (used in right and full joins) and whether this entry has
-/// duplicates. If there are duplicates, then the data is pointing to the head of a
-/// linked list of duplicate nodes that point to the actual data. Note that the duplicate
-/// nodes do not contain the hash value, because all the linked nodes have the same hash
-/// value, the one in the bucket. The data is either a tuple stream index or a Tuple*.
-/// This array of buckets is sparse, we are shooting for up to 3/4 fill factor (75%). The
-/// data allocated by the hash table comes from the BufferedBlockMgr.
+/// data, the hash value and two flags: whether this bucket is filled and whether this
+/// entry has duplicates. If there are duplicates, then the data is pointing to the head
+/// of a linked list of duplicate nodes that point to the actual data. Note that the
+/// duplicate nodes do not contain the hash value, because all the linked nodes have the
+/// same hash value, the one in the bucket. The data is either a tuple stream index or a
+/// Tuple*. This array of buckets is sparse, we are shooting for up to 3/4 fill factor
+/// (75%). The data allocated by the hash table comes from the BufferedBlockMgr.
+///
+/// Tables that store duplicates (i.e. those of joins) track which rows have been matched
+/// (used in right and full joins) in 'matched_buckets_', a bitmap with a bit per bucket,
+/// and in the duplicate nodes themselves. Probes then don't write to the buckets, and
+/// the scan for unmatched rows skips 64 matched or empty buckets at a time.
+///
+/// A table with a single integer key whose values are known to be in a small range can
+/// also have a direct index, an array with the bucket of every key in the range, see
+/// InitDirectIndex(). Lookups of non-NULL keys then read the bucket from the array
+/// instead of probing for it and comparing rows.
 class HashTable {
  private:
 
@@ -487,28 +518,36 @@ class HashTable {
 
   /// Linked list of entries used for duplicates.
   struct DuplicateNode {
-    /// Used for full outer and right {outer, anti, semi} joins. Indicates whether the
-    /// row in the DuplicateNode has been matched.
-    /// From an abstraction point of view, this is an awkward place to store this
-    /// information.
-    /// TODO: Fold this flag in the next pointer below.
-    bool matched;
-
-    /// Chain to next duplicate node, NULL when end of list.
-    DuplicateNode* next;
+    /// Chain to next duplicate node, NULL when end of list. DuplicateNodes are allocated
+    /// in arrays of 8-byte aligned structs, so the lowest bit of the pointer is always
+    /// zero and is used to store the 'matched' flag. Used for full outer and right
+    /// {outer, anti, semi} joins, it indicates whether the row in the DuplicateNode has
+    /// been matched. Folding the flag keeps the node at 16 bytes instead of 24.
+    uintptr_t next_and_matched;
+
     HtData htdata;
+
+    DuplicateNode* ALWAYS_INLINE next() const {
+      return reinterpret_cast<DuplicateNode*>(next_and_matched & ~MATCHED_BIT);
+    }
+
+    bool ALWAYS_INLINE matched() const { return next_and_matched & MATCHED_BIT; }
+
+    /// Sets the next pointer and clears the matched flag.
+    void ALWAYS_INLINE Reset(DuplicateNode* next) {
+      DCHECK_EQ(reinterpret_cast<uintptr_t>(next) & MATCHED_BIT, 0);
+      next_and_matched = reinterpret_cast<uintptr_t>(next);
+    }
+
+    void ALWAYS_INLINE SetMatched() { next_and_matched |= MATCHED_BIT; }
+
+    static const uintptr_t MATCHED_BIT = 1;
   };
 
   struct Bucket {
     /// Whether this bucket contains a vaild entry, or it is empty.
     bool filled;
 
-    /// Used for full outer and right {outer, anti, semi} joins. Indicates whether the
-    /// row in the bucket has been matched.
-    /// From an abstraction point of view, this is an awkward place to store this
-    /// information but it is efficient. This space is otherwise unused.
-    bool matched;
-
     /// Used in case of duplicates. If true, then the bucketData union should be used as
     /// 'duplicates'.
     bool hasDuplicates;
@@ -548,6 +587,16 @@ class HashTable {
   /// Allocates the initial bucket structure. Returns false if OOM.
   bool Init();
 
+  /// Adds a direct index for the keys in [min_key, min_key + num_keys) and indexes the
+  /// entries that are already in the table. 'ht_ctx' must have a single integer key,
+  /// see HashTableCtx::direct_index_key_bytes(). Inserting a key outside the range later
+  /// drops the index. Returns false and leaves the table without a direct index if the
+  /// key isn't an integer, if there are more than --hash_table_direct_index_max_keys
+  /// keys, if an entry is outside the range or if there is not enough memory.
+  bool InitDirectIndex(HashTableCtx* ht_ctx, int64_t min_key, int64_t num_keys);
+
+  bool has_direct_index() const { return direct_index_ != NULL; }
+
   /// Call to cleanup any resources. Must be called once.
   void Close();
 
@@ -559,7 +608,8 @@ class HashTable {
   /// hash table and the caller must guarantee it stays in memory. This will not grow the
   /// hash table. In the case that there is a need to insert a duplicate node, instead of
   /// filling a new bucket, and there is not enough memory to insert a duplicate node,
-  /// the insert fails and this function returns false.
+  /// the insert fails and this function returns false. If the table doesn't store
+  /// duplicates, a row whose key is already in the table replaces the existing row.
   /// Used during the build phase of hash joins.
   bool IR_ALWAYS_INLINE Insert(HashTableCtx* ht_ctx,
       const BufferedTupleStream::RowIdx& idx, TupleRow* row);
@@ -568,6 +618,14 @@ class HashTable {
   template<const bool READ>
   void IR_ALWAYS_INLINE PrefetchBucket(uint32_t hash);
 
+  /// Prefetch the data referenced by the bucket which 'hash' maps to, i.e. the build
+  /// tuple if the table stores tuples or the head of the duplicate list. This reads the
+  /// bucket, so it should only be called once the bucket itself has been prefetched with
+  /// PrefetchBucket(), typically in a second pass over a prefetch group. Does nothing if
+  /// the bucket is empty or holds a different hash value.
+  template<const bool READ>
+  void IR_ALWAYS_INLINE PrefetchBucketData(uint32_t hash);
+
   /// Returns an iterator to the bucket that matches the probe expression results that
   /// are cached at the current position of the ExprValuesCache in 'ht_ctx'. Assumes that
   /// the ExprValuesCache was filled using EvalAndHashProbe(). Returns HashTable::End()
@@ -595,6 +653,9 @@ class HashTable {
   /// Returns the number of buckets
   int64_t num_buckets() const { return num_buckets_; }
 
+  /// Returns the number of times that the buckets were resized.
+  int64_t num_resizes() const { return num_resizes_; }
+
   /// Returns the load factor (the number of non-empty buckets)
   double load_factor() const {
     return static_cast<double>(num_filled_buckets_) / num_buckets_;
@@ -609,7 +670,7 @@ class HashTable {
   }
   static int64_t EstimateSize(int64_t num_rows) {
     int64_t num_buckets = EstimateNumBuckets(num_rows);
-    return num_buckets * sizeof(Bucket);
+    return num_buckets * sizeof(Bucket) + Bitmap::MemUsage(num_buckets);
   }
 
   /// Returns the memory occupied by the hash table, takes into account the number of
@@ -627,7 +688,9 @@ class HashTable {
   bool CheckAndResize(uint64_t buckets_to_fill, const HashTableCtx* ht_ctx);
 
   /// Returns the number of bytes allocated to the hash table from the block manager.
-  int64_t ByteSize() const { return num_buckets_ * sizeof(Bucket) + total_data_page_size_; }
+  int64_t ByteSize() const {
+    return BucketsByteSize(num_buckets_) + total_data_page_size_;
+  }
 
   /// Returns an iterator at the beginning of the hash table.  Advancing this iterator
   /// will traverse all elements.
@@ -660,6 +723,10 @@ class HashTable {
   /// Number of hash collisions so far in the lifetime of this object
   int64_t NumHashCollisions() const { return num_hash_collisions_; }
 
+  /// Number of filled buckets that Find() and Insert() probes skipped without a row
+  /// comparison because the hash stored in the bucket did not match.
+  int64_t NumHashMismatchSkips() const { return num_hash_mismatch_skips_; }
+
   /// stl-like iterator interface.
   class Iterator {
    private:
@@ -790,6 +857,12 @@ class HashTable {
   /// 'bucket_idx' to BUCKET_NOT_FOUND.
   void NextFilledBucket(int64_t* bucket_idx, DuplicateNode** node);
 
+  /// Like NextFilledBucket(), but moves to the next bucket with an unmatched row,
+  /// skipping over the buckets whose bits in 'matched_buckets_' are set. If the bucket
+  /// has duplicates, 'node' is set to its first unmatched duplicate node. Only valid if
+  /// the table stores duplicates.
+  void NextUnmatchedBucket(int64_t* bucket_idx, DuplicateNode** node);
+
   /// Resize the hash table to 'num_buckets'. Returns false on OOM.
   bool ResizeBuckets(int64_t num_buckets, const HashTableCtx* ht_ctx);
 
@@ -822,6 +895,28 @@ class HashTable {
   /// Grow the node array. Returns false on OOM.
   bool GrowNodeArray();
 
+  /// Returned by DirectIndexOffset() for keys that don't have a position in the index.
+  static const int64_t DIRECT_INDEX_NULL_KEY = -1;
+  static const int64_t DIRECT_INDEX_OUT_OF_RANGE = -2;
+
+  /// Returns the position in 'direct_index_' of the key of the current row of 'ht_ctx',
+  /// or one of the DIRECT_INDEX_* values above. 'direct_index_' must be non-NULL.
+  int64_t IR_ALWAYS_INLINE DirectIndexOffset(const HashTableCtx* ht_ctx) const;
+
+  /// Records the bucket 'bucket_idx' that was just filled in 'direct_index_' at
+  /// 'direct_index_insert_offset_'. Drops the index if the key is out of its range.
+  void IR_ALWAYS_INLINE AddToDirectIndex(int64_t bucket_idx);
+
+  /// Frees 'direct_index_', if there is one.
+  void CloseDirectIndex();
+
+  /// Returns the number of bytes of 'num_buckets' buckets, including their bits in
+  /// 'matched_buckets_'.
+  int64_t BucketsByteSize(int64_t num_buckets) const {
+    return num_buckets * sizeof(Bucket) +
+        (stores_duplicates_ ? Bitmap::MemUsage(num_buckets) : 0);
+  }
+
   /// Functions to be replaced by codegen to specialize the hash table.
   bool IR_NO_INLINE stores_tuples() const { return stores_tuples_; }
   bool IR_NO_INLINE stores_duplicates() const { return stores_duplicates_; }
@@ -875,6 +970,11 @@ class HashTable {
   /// Total number of buckets (filled and empty).
   int64_t num_buckets_;
 
+  /// Only used if 'stores_duplicates_', a bit per bucket that is set if the bucket is
+  /// empty or its single row has been matched. The bit of a bucket with duplicates is
+  /// always clear, the matched flags of its rows are in its duplicate nodes.
+  Bitmap matched_buckets_;
+
   /// Number of non-empty buckets.  Used to determine when to resize.
   int64_t num_filled_buckets_;
 
@@ -908,8 +1008,23 @@ class HashTable {
   /// the row equality failed.
   int64_t num_hash_collisions_;
 
+  /// The number of filled buckets skipped by probes with a HashTableCtx because their
+  /// hash value differed. Probes of ResizeBuckets() are not counted.
+  int64_t num_hash_mismatch_skips_;
+
   /// How many times this table has resized so far.
   int64_t num_resizes_;
+
+  /// The direct index, NULL if there is none. Entry i holds the index of the bucket
+  /// with the key 'direct_index_min_key_' + i, or -1 if the key isn't in the table.
+  int32_t* direct_index_;
+  int64_t direct_index_min_key_;
+  int64_t direct_index_num_keys_;
+
+  /// The DirectIndexOffset() of the key that is being inserted, set by Insert() and by
+  /// FindBuildRowBucket() if it didn't find the key. Reset to DIRECT_INDEX_OUT_OF_RANGE
+  /// after each insert, so that a bucket filled without a lookup drops the index.
+  int64_t direct_index_insert_offset_;
 };
 
 }
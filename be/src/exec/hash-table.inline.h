@@ -37,6 +37,27 @@ inline bool HashTableCtx::EvalAndHashProbe(TupleRow* row) {
   return true;
 }
 
+inline bool HashTableCtx::CurrentIntegerKey(int64_t* key) const {
+  DCHECK_GT(direct_index_key_bytes_, 0);
+  if (ExprValueNull(0)) return false;
+  const void* value = ExprValue(0);
+  switch (direct_index_key_bytes_) {
+    case 1:
+      *key = *reinterpret_cast<const int8_t*>(value);
+      break;
+    case 2:
+      *key = *reinterpret_cast<const int16_t*>(value);
+      break;
+    case 4:
+      *key = *reinterpret_cast<const int32_t*>(value);
+      break;
+    default:
+      DCHECK_EQ(direct_index_key_bytes_, 8);
+      *key = *reinterpret_cast<const int64_t*>(value);
+  }
+  return true;
+}
+
 inline void HashTableCtx::ExprValuesCache::NextRow() {
   cur_expr_values_ += expr_values_bytes_per_row_;
   cur_expr_values_null_ += num_exprs_;
@@ -56,18 +77,28 @@ inline int64_t HashTable::Probe(Bucket* buckets, int64_t num_buckets,
   // for knowing when to exit the loop (e.g. by capping the total travel length). In case
   // of quadratic probing it is also used for calculating the length of the next jump.
   int64_t step = 0;
+  // Number of filled buckets skipped because of a different hash. Accumulated locally
+  // and added to num_hash_mismatch_skips_ once per probe. Not counted for resizes,
+  // which never compare rows.
+  int64_t hash_mismatch_skips = 0;
   do {
     Bucket* bucket = &buckets[bucket_idx];
-    if (LIKELY(!bucket->filled)) return bucket_idx;
+    if (LIKELY(!bucket->filled)) {
+      if (ht_ctx != NULL) num_hash_mismatch_skips_ += hash_mismatch_skips;
+      return bucket_idx;
+    }
     if (hash == bucket->hash) {
       if (ht_ctx != NULL &&
           ht_ctx->Equals<FORCE_NULL_EQUALITY>(GetRow(bucket, ht_ctx->scratch_row_))) {
+        num_hash_mismatch_skips_ += hash_mismatch_skips;
         *found = true;
         return bucket_idx;
       }
       // Row equality failed, or not performed. This is a hash collision. Continue
       // searching.
       ++num_hash_collisions_;
+    } else {
+      ++hash_mismatch_skips;
     }
     // Move to the next bucket.
     ++step;
@@ -81,6 +112,7 @@ inline int64_t HashTable::Probe(Bucket* buckets, int64_t num_buckets,
       bucket_idx = (bucket_idx + 1) & (num_buckets - 1);
     }
   } while (LIKELY(step < num_buckets));
+  if (ht_ctx != NULL) num_hash_mismatch_skips_ += hash_mismatch_skips;
   DCHECK_EQ(num_filled_buckets_, num_buckets) << "Probing of a non-full table "
       << "failed: " << quadratic_probing() << " " << hash;
   return Iterator::BUCKET_NOT_FOUND;
@@ -93,11 +125,14 @@ inline HashTable::HtData* HashTable::InsertInternal(HashTableCtx* ht_ctx) {
   int64_t bucket_idx = Probe<true>(buckets_, num_buckets_, ht_ctx, hash, &found);
   DCHECK_NE(bucket_idx, Iterator::BUCKET_NOT_FOUND);
   if (found) {
+    // Without duplicates, the row replaces the one with the same key.
+    if (!stores_duplicates()) return &buckets_[bucket_idx].bucketData.htdata;
     // We need to insert a duplicate node, note that this may fail to allocate memory.
     DuplicateNode* new_node = InsertDuplicateNode(bucket_idx);
     if (UNLIKELY(new_node == NULL)) return NULL;
     return &new_node->htdata;
   } else {
+    if (direct_index_ != NULL) direct_index_insert_offset_ = DirectIndexOffset(ht_ctx);
     PrepareBucketForInsert(bucket_idx, hash);
     return &buckets_[bucket_idx].bucketData.htdata;
   }
@@ -129,8 +164,60 @@ inline void HashTable::PrefetchBucket(uint32_t hash) {
   __builtin_prefetch(&buckets_[bucket_idx], READ ? 0 : 1, 1);
 }
 
+template<const bool READ>
+inline void HashTable::PrefetchBucketData(uint32_t hash) {
+  int64_t bucket_idx = hash & (num_buckets_ - 1);
+  Bucket* bucket = &buckets_[bucket_idx];
+  // Only the first bucket of the probe sequence is considered. With the 75% fill factor
+  // most probes terminate there, and chasing the probe sequence here would stall on the
+  // very cache misses this function is trying to hide.
+  if (!bucket->filled || bucket->hash != hash) return;
+  if (stores_duplicates() && bucket->hasDuplicates) {
+    __builtin_prefetch(bucket->bucketData.duplicates, READ ? 0 : 1, 1);
+  } else if (stores_tuples()) {
+    __builtin_prefetch(bucket->bucketData.htdata.tuple, READ ? 0 : 1, 1);
+  }
+}
+
+inline int64_t HashTable::DirectIndexOffset(const HashTableCtx* ht_ctx) const {
+  DCHECK(direct_index_ != NULL);
+  int64_t key;
+  if (!ht_ctx->CurrentIntegerKey(&key)) return DIRECT_INDEX_NULL_KEY;
+  // Computed unsigned, so that keys below the range wrap around to large values.
+  uint64_t offset =
+      static_cast<uint64_t>(key) - static_cast<uint64_t>(direct_index_min_key_);
+  if (offset >= static_cast<uint64_t>(direct_index_num_keys_)) {
+    return DIRECT_INDEX_OUT_OF_RANGE;
+  }
+  return offset;
+}
+
+inline void HashTable::AddToDirectIndex(int64_t bucket_idx) {
+  DCHECK(direct_index_ != NULL);
+  int64_t offset = direct_index_insert_offset_;
+  direct_index_insert_offset_ = DIRECT_INDEX_OUT_OF_RANGE;
+  if (offset >= 0) {
+    DCHECK_LT(direct_index_[offset], 0);
+    direct_index_[offset] = bucket_idx;
+  } else if (offset == DIRECT_INDEX_OUT_OF_RANGE) {
+    CloseDirectIndex();
+  }
+  // A NULL key isn't indexed, lookups for it probe the table.
+}
+
 inline HashTable::Iterator HashTable::FindProbeRow(HashTableCtx* ht_ctx) {
   ++num_probes_;
+  if (direct_index_ != NULL) {
+    int64_t offset = DirectIndexOffset(ht_ctx);
+    if (LIKELY(offset != DIRECT_INDEX_NULL_KEY)) {
+      if (offset == DIRECT_INDEX_OUT_OF_RANGE || direct_index_[offset] < 0) {
+        return End();
+      }
+      int64_t bucket_idx = direct_index_[offset];
+      return Iterator(this, ht_ctx->scratch_row(), bucket_idx,
+          stores_duplicates() ? buckets_[bucket_idx].bucketData.duplicates : NULL);
+    }
+  }
   bool found = false;
   uint32_t hash = ht_ctx->expr_values_cache()->ExprValuesHash();
   int64_t bucket_idx = Probe<false>(buckets_, num_buckets_, ht_ctx, hash, &found);
@@ -145,6 +232,18 @@ inline HashTable::Iterator HashTable::FindProbeRow(HashTableCtx* ht_ctx) {
 inline HashTable::Iterator HashTable::FindBuildRowBucket(
     HashTableCtx* ht_ctx, bool* found) {
   ++num_probes_;
+  if (direct_index_ != NULL) {
+    int64_t offset = DirectIndexOffset(ht_ctx);
+    if (offset >= 0 && direct_index_[offset] >= 0) {
+      int64_t bucket_idx = direct_index_[offset];
+      *found = true;
+      return Iterator(this, ht_ctx->scratch_row(), bucket_idx,
+          stores_duplicates() ? buckets_[bucket_idx].bucketData.duplicates : NULL);
+    }
+    // The key isn't in the table. Probe for the bucket to insert it into, which is
+    // indexed once it is filled.
+    direct_index_insert_offset_ = offset;
+  }
   uint32_t hash = ht_ctx->expr_values_cache()->ExprValuesHash();
   int64_t bucket_idx = Probe<true>(buckets_, num_buckets_, ht_ctx, hash, found);
   DuplicateNode* duplicates = NULL;
@@ -164,16 +263,8 @@ inline HashTable::Iterator HashTable::Begin(const HashTableCtx* ctx) {
 inline HashTable::Iterator HashTable::FirstUnmatched(HashTableCtx* ctx) {
   int64_t bucket_idx = Iterator::BUCKET_NOT_FOUND;
   DuplicateNode* node = NULL;
-  NextFilledBucket(&bucket_idx, &node);
-  Iterator it(this, ctx->scratch_row(), bucket_idx, node);
-  // Check whether the bucket, or its first duplicate node, is matched. If it is not
-  // matched, then return. Otherwise, move to the first unmatched entry (node or bucket).
-  Bucket* bucket = &buckets_[bucket_idx];
-  bool has_duplicates = stores_duplicates() && bucket->hasDuplicates;
-  if ((!has_duplicates && bucket->matched) || (has_duplicates && node->matched)) {
-    it.NextUnmatched();
-  }
-  return it;
+  NextUnmatchedBucket(&bucket_idx, &node);
+  return Iterator(this, ctx->scratch_row(), bucket_idx, node);
 }
 
 inline void HashTable::NextFilledBucket(int64_t* bucket_idx, DuplicateNode** node) {
@@ -189,6 +280,28 @@ inline void HashTable::NextFilledBucket(int64_t* bucket_idx, DuplicateNode** nod
   *node = NULL;
 }
 
+inline void HashTable::NextUnmatchedBucket(int64_t* bucket_idx, DuplicateNode** node) {
+  DCHECK(stores_duplicates());
+  // The bits of the empty and matched buckets are set, so this skips whole words of
+  // them at once.
+  for (*bucket_idx = matched_buckets_.NextUnsetBit(*bucket_idx + 1);
+       *bucket_idx < num_buckets_;
+       *bucket_idx = matched_buckets_.NextUnsetBit(*bucket_idx + 1)) {
+    Bucket* bucket = &buckets_[*bucket_idx];
+    DCHECK(bucket->filled);
+    if (!bucket->hasDuplicates) {
+      *node = NULL;
+      return;
+    }
+    for (*node = bucket->bucketData.duplicates; *node != NULL; *node = (*node)->next()) {
+      if (!(*node)->matched()) return;
+    }
+  }
+  // Reached the end of the hash table.
+  *bucket_idx = Iterator::BUCKET_NOT_FOUND;
+  *node = NULL;
+}
+
 inline void HashTable::PrepareBucketForInsert(int64_t bucket_idx, uint32_t hash) {
   DCHECK_GE(bucket_idx, 0);
   DCHECK_LT(bucket_idx, num_buckets_);
@@ -196,9 +309,10 @@ inline void HashTable::PrepareBucketForInsert(int64_t bucket_idx, uint32_t hash)
   DCHECK(!bucket->filled);
   ++num_filled_buckets_;
   bucket->filled = true;
-  bucket->matched = false;
   bucket->hasDuplicates = false;
   bucket->hash = hash;
+  if (stores_duplicates()) matched_buckets_.Set<false>(bucket_idx, false);
+  if (direct_index_ != NULL) AddToDirectIndex(bucket_idx);
 }
 
 inline HashTable::DuplicateNode* HashTable::AppendNextNode(Bucket* bucket) {
@@ -224,16 +338,14 @@ inline HashTable::DuplicateNode* HashTable::InsertDuplicateNode(int64_t bucket_i
     // This is the first duplicate in this bucket. It means that we need to convert
     // the current entry in the bucket to a node and link it from the bucket.
     next_node_->htdata.idx = bucket->bucketData.htdata.idx;
-    DCHECK(!bucket->matched);
-    next_node_->matched = false;
-    next_node_->next = NULL;
+    DCHECK(!matched_buckets_.Get<false>(bucket_idx));
+    next_node_->Reset(NULL);
     AppendNextNode(bucket);
     bucket->hasDuplicates = true;
     ++num_buckets_with_duplicates_;
   }
   // Link a new node.
-  next_node_->next = bucket->bucketData.duplicates;
-  next_node_->matched = false;
+  next_node_->Reset(bucket->bucketData.duplicates);
   return AppendNextNode(bucket);
 }
 
@@ -294,10 +406,11 @@ inline void HashTable::Iterator::SetTuple(Tuple* tuple, uint32_t hash) {
 inline void HashTable::Iterator::SetMatched() {
   DCHECK(!AtEnd());
   Bucket* bucket = &table_->buckets_[bucket_idx_];
-  if (table_->stores_duplicates() && bucket->hasDuplicates) {
-    node_->matched = true;
+  DCHECK(table_->stores_duplicates());
+  if (bucket->hasDuplicates) {
+    node_->SetMatched();
   } else {
-    bucket->matched = true;
+    table_->matched_buckets_.Set<false>(bucket_idx_, true);
   }
   // Used for disabling spilling of hash tables in right and full-outer joins with
   // matches. See IMPALA-1488.
@@ -307,10 +420,9 @@ inline void HashTable::Iterator::SetMatched() {
 inline bool HashTable::Iterator::IsMatched() const {
   DCHECK(!AtEnd());
   Bucket* bucket = &table_->buckets_[bucket_idx_];
-  if (table_->stores_duplicates() && bucket->hasDuplicates) {
-    return node_->matched;
-  }
-  return bucket->matched;
+  DCHECK(table_->stores_duplicates());
+  if (bucket->hasDuplicates) return node_->matched();
+  return table_->matched_buckets_.Get<false>(bucket_idx_);
 }
 
 inline void HashTable::Iterator::SetAtEnd() {
@@ -331,8 +443,8 @@ inline void HashTable::Iterator::PrefetchBucket() {
 inline void HashTable::Iterator::Next() {
   DCHECK(!AtEnd());
   if (table_->stores_duplicates() && table_->buckets_[bucket_idx_].hasDuplicates &&
-      node_->next != NULL) {
-    node_ = node_->next;
+      node_->next() != NULL) {
+    node_ = node_->next();
   } else {
     table_->NextFilledBucket(&bucket_idx_, &node_);
   }
@@ -341,8 +453,8 @@ inline void HashTable::Iterator::Next() {
 inline void HashTable::Iterator::NextDuplicate() {
   DCHECK(!AtEnd());
   if (table_->stores_duplicates() && table_->buckets_[bucket_idx_].hasDuplicates &&
-      node_->next != NULL) {
-    node_ = node_->next;
+      node_->next() != NULL) {
+    node_ = node_->next();
   } else {
     bucket_idx_ = BUCKET_NOT_FOUND;
     node_ = NULL;
@@ -351,29 +463,14 @@ inline void HashTable::Iterator::NextDuplicate() {
 
 inline void HashTable::Iterator::NextUnmatched() {
   DCHECK(!AtEnd());
-  Bucket* bucket = &table_->buckets_[bucket_idx_];
   // Check if there is any remaining unmatched duplicate node in the current bucket.
-  if (table_->stores_duplicates() && bucket->hasDuplicates) {
-    while (node_->next != NULL) {
-      node_ = node_->next;
-      if (!node_->matched) return;
+  if (table_->buckets_[bucket_idx_].hasDuplicates) {
+    while (node_->next() != NULL) {
+      node_ = node_->next();
+      if (!node_->matched()) return;
     }
   }
-  // Move to the next filled bucket and return if this bucket is not matched or
-  // iterate to the first not matched duplicate node.
-  table_->NextFilledBucket(&bucket_idx_, &node_);
-  while (bucket_idx_ != Iterator::BUCKET_NOT_FOUND) {
-    bucket = &table_->buckets_[bucket_idx_];
-    if (!table_->stores_duplicates() || !bucket->hasDuplicates) {
-      if (!bucket->matched) return;
-    } else {
-      while (node_->matched && node_->next != NULL) {
-        node_ = node_->next;
-      }
-      if (!node_->matched) return;
-    }
-    table_->NextFilledBucket(&bucket_idx_, &node_);
-  }
+  table_->NextUnmatchedBucket(&bucket_idx_, &node_);
 }
 
 inline void HashTableCtx::set_level(int level) {
@@ -383,7 +480,7 @@ inline void HashTableCtx::set_level(int level) {
 }
 
 inline int64_t HashTable::CurrentMemSize() const {
-  return num_buckets_ * sizeof(Bucket) + num_duplicate_nodes_ * sizeof(DuplicateNode);
+  return BucketsByteSize(num_buckets_) + num_duplicate_nodes_ * sizeof(DuplicateNode);
 }
 
 inline int64_t HashTable::NumInsertsBeforeResize() const {
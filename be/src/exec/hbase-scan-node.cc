@@ -115,6 +115,7 @@ Status HBaseScanNode::Open(RuntimeState* state) {
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   JNIEnv* env = getJNIEnv();
 
   // No need to initialize hbase_scanner_ if there are no scan ranges.
@@ -148,6 +149,7 @@ Status HBaseScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eo
   // but there's still some considerable time inside here.
   // TODO: need to understand how the time is spent inside this function.
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   SCOPED_THREAD_COUNTER_MEASUREMENT(scanner_thread_counters());
 
   if (scan_range_vector_.empty() || ReachedLimit()) {
@@ -267,6 +269,7 @@ Status HBaseScanNode::Reset(RuntimeState* state) {
 void HBaseScanNode::Close(RuntimeState* state) {
   if (is_closed()) return;
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   PeriodicCounterUpdater::StopRateCounter(total_throughput_counter());
   PeriodicCounterUpdater::StopTimeSeriesCounter(bytes_read_timeseries_counter_);
 
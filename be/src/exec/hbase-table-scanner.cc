@@ -27,6 +27,10 @@
 
 #include "common/names.h"
 
+DEFINE_int32(hbase_multi_get_max_keys, 1024, "(Advanced) Maximum number of row keys "
+    "fetched by one multi-get of an HBase scan whose scan ranges are all point ranges. "
+    "If 0, point ranges are read with scans.");
+
 using namespace impala;
 using namespace strings;
 
@@ -40,6 +44,8 @@ jclass HBaseTableScanner::filter_list_op_cl_ = NULL;
 jclass HBaseTableScanner::single_column_value_filter_cl_ = NULL;
 jclass HBaseTableScanner::compare_op_cl_ = NULL;
 jclass HBaseTableScanner::scanner_timeout_ex_cl_ = NULL;
+jclass HBaseTableScanner::get_cl_ = NULL;
+jclass HBaseTableScanner::array_list_cl_ = NULL;
 jmethodID HBaseTableScanner::scan_ctor_ = NULL;
 jmethodID HBaseTableScanner::scan_set_max_versions_id_ = NULL;
 jmethodID HBaseTableScanner::scan_set_caching_id_ = NULL;
@@ -48,9 +54,10 @@ jmethodID HBaseTableScanner::scan_add_column_id_ = NULL;
 jmethodID HBaseTableScanner::scan_set_filter_id_ = NULL;
 jmethodID HBaseTableScanner::scan_set_start_row_id_ = NULL;
 jmethodID HBaseTableScanner::scan_set_stop_row_id_ = NULL;
-jmethodID HBaseTableScanner::resultscanner_next_id_ = NULL;
+jmethodID HBaseTableScanner::resultscanner_next_batch_id_ = NULL;
 jmethodID HBaseTableScanner::resultscanner_close_id_ = NULL;
 jmethodID HBaseTableScanner::result_isempty_id_ = NULL;
+jmethodID HBaseTableScanner::result_get_row_id_ = NULL;
 jmethodID HBaseTableScanner::result_raw_cells_id_ = NULL;
 jmethodID HBaseTableScanner::cell_get_row_array_ = NULL;
 jmethodID HBaseTableScanner::cell_get_family_array_ = NULL;
@@ -67,6 +74,11 @@ jmethodID HBaseTableScanner::cell_get_value_length_id_ = NULL;
 jmethodID HBaseTableScanner::filter_list_ctor_ = NULL;
 jmethodID HBaseTableScanner::filter_list_add_filter_id_ = NULL;
 jmethodID HBaseTableScanner::single_column_value_filter_ctor_ = NULL;
+jmethodID HBaseTableScanner::get_ctor_ = NULL;
+jmethodID HBaseTableScanner::get_add_column_id_ = NULL;
+jmethodID HBaseTableScanner::get_set_filter_id_ = NULL;
+jmethodID HBaseTableScanner::array_list_ctor_ = NULL;
+jmethodID HBaseTableScanner::array_list_add_id_ = NULL;
 jobject HBaseTableScanner::empty_row_ = NULL;
 jobject HBaseTableScanner::must_pass_all_op_ = NULL;
 jobjectArray HBaseTableScanner::compare_ops_ = NULL;
@@ -93,6 +105,11 @@ HBaseTableScanner::HBaseTableScanner(
     htable_(NULL),
     scan_(NULL),
     resultscanner_(NULL),
+    filter_list_(NULL),
+    use_multi_get_(false),
+    results_(NULL),
+    result_idx_(0),
+    num_results_(0),
     cells_(NULL),
     cell_index_(0),
     num_requested_cells_(0),
@@ -101,7 +118,9 @@ HBaseTableScanner::HBaseTableScanner(
     all_cells_present_(false),
     value_pool_(new MemPool(scan_node_->mem_tracker())),
     scan_setup_timer_(ADD_TIMER(scan_node_->runtime_profile(),
-      "HBaseTableScanner.ScanSetup")) {
+      "HBaseTableScanner.ScanSetup")),
+    num_fetches_counter_(ADD_COUNTER(scan_node_->runtime_profile(),
+      "HBaseTableScanner.NumFetches", TUnit::UNIT)) {
   const TQueryOptions& query_option = state->query_options();
   if (query_option.__isset.hbase_caching && query_option.hbase_caching > 0) {
     rows_cached_ = query_option.hbase_caching;
@@ -152,6 +171,10 @@ Status HBaseTableScanner::Init() {
       JniUtil::GetGlobalClassRef(env,
           "org/apache/hadoop/hbase/client/ScannerTimeoutException",
           &scanner_timeout_ex_cl_));
+  RETURN_IF_ERROR(
+      JniUtil::GetGlobalClassRef(env, "org/apache/hadoop/hbase/client/Get", &get_cl_));
+  RETURN_IF_ERROR(
+      JniUtil::GetGlobalClassRef(env, "java/util/ArrayList", &array_list_cl_));
 
   // Distinguish HBase versions by checking for the existence of the Cell class.
   // HBase 0.95.2: Use Cell class and corresponding methods.
@@ -193,8 +216,8 @@ Status HBaseTableScanner::Init() {
   RETURN_ERROR_IF_EXC(env);
 
   // ResultScanner method ids.
-  resultscanner_next_id_ = env->GetMethodID(resultscanner_cl_, "next",
-      "()Lorg/apache/hadoop/hbase/client/Result;");
+  resultscanner_next_batch_id_ = env->GetMethodID(resultscanner_cl_, "next",
+      "(I)[Lorg/apache/hadoop/hbase/client/Result;");
   RETURN_ERROR_IF_EXC(env);
   resultscanner_close_id_ = env->GetMethodID(resultscanner_cl_, "close", "()V");
   RETURN_ERROR_IF_EXC(env);
@@ -210,6 +233,24 @@ Status HBaseTableScanner::Init() {
   RETURN_ERROR_IF_EXC(env);
   result_isempty_id_ = env->GetMethodID(result_cl_, "isEmpty", "()Z");
   RETURN_ERROR_IF_EXC(env);
+  result_get_row_id_ = env->GetMethodID(result_cl_, "getRow", "()[B");
+  RETURN_ERROR_IF_EXC(env);
+
+  // Get method ids.
+  get_ctor_ = env->GetMethodID(get_cl_, "<init>", "([B)V");
+  RETURN_ERROR_IF_EXC(env);
+  get_add_column_id_ = env->GetMethodID(get_cl_, "addColumn",
+      "([B[B)Lorg/apache/hadoop/hbase/client/Get;");
+  RETURN_ERROR_IF_EXC(env);
+  get_set_filter_id_ = env->GetMethodID(get_cl_, "setFilter",
+      "(Lorg/apache/hadoop/hbase/filter/Filter;)Lorg/apache/hadoop/hbase/client/Get;");
+  RETURN_ERROR_IF_EXC(env);
+
+  // ArrayList method ids.
+  array_list_ctor_ = env->GetMethodID(array_list_cl_, "<init>", "(I)V");
+  RETURN_ERROR_IF_EXC(env);
+  array_list_add_id_ = env->GetMethodID(array_list_cl_, "add", "(Ljava/lang/Object;)Z");
+  RETURN_ERROR_IF_EXC(env);
 
 
   // Cell or equivalent KeyValue method ids.
@@ -329,6 +370,7 @@ Status HBaseTableScanner::ScanSetup(JNIEnv* env, const TupleDescriptor* tuple_de
     const string& qualifier = hbase_table->cols()[slots[i]->col_pos()].qualifier;
     // The row key has an empty qualifier.
     if (qualifier.empty()) continue;
+    requested_columns_.push_back(make_pair(family, qualifier));
     JniLocalFrame jni_frame;
     RETURN_IF_ERROR(jni_frame.push(env));
     jbyteArray family_bytes;
@@ -356,6 +398,7 @@ Status HBaseTableScanner::ScanSetup(JNIEnv* env, const TupleDescriptor* tuple_de
       }
     }
     if (requested) continue;
+    requested_columns_.push_back(make_pair(it->family, it->qualifier));
     JniLocalFrame jni_frame;
     RETURN_IF_ERROR(jni_frame.push(env));
     jbyteArray family_bytes;
@@ -400,6 +443,7 @@ Status HBaseTableScanner::ScanSetup(JNIEnv* env, const TupleDescriptor* tuple_de
     // scan.setFilter(filter_list);
     env->CallObjectMethod(scan_, scan_set_filter_id_, filter_list);
     RETURN_ERROR_IF_EXC(env);
+    RETURN_IF_ERROR(JniUtil::LocalToGlobalRef(env, filter_list, &filter_list_));
   }
 
   return Status::OK();
@@ -417,18 +461,26 @@ Status HBaseTableScanner::HandleResultScannerTimeout(JNIEnv* env, bool* timeout)
 
   *timeout = true;
   const ScanRange& scan_range = (*scan_range_vector_)[current_scan_range_idx_];
-  // If cells_ is NULL, then the ResultScanner timed out before it was ever used
+  // If results_ is NULL, then no rows were fetched from the current scan range yet
   // so we can just re-create the ResultScanner with the same scan_range
-  if (cells_ == NULL) return InitScanRange(env, scan_range);
+  if (results_ == NULL) return InitScanRange(env, scan_range);
 
   JniLocalFrame jni_frame;
   RETURN_IF_ERROR(jni_frame.push(env));
-  DCHECK_LT(cell_index_, num_cells_);
-  jobject cell = env->GetObjectArrayElement(cells_, cell_index_);
-  // Specifically set the start_bytes to the next row since some of them were already
-  // read
-  jbyteArray start_bytes =
-    (jbyteArray) env->CallObjectMethod(cell, cell_get_row_array_);
+  DCHECK_GT(num_results_, 0);
+  jobject last_result = env->GetObjectArrayElement(results_, num_results_ - 1);
+  RETURN_ERROR_IF_EXC(env);
+  jbyteArray last_row =
+      (jbyteArray) env->CallObjectMethod(last_result, result_get_row_id_);
+  RETURN_ERROR_IF_EXC(env);
+  // Specifically set the start_bytes to the smallest row key after the last fetched row,
+  // since all fetched rows were already read or are still in results_.
+  int last_row_length = env->GetArrayLength(last_row);
+  vector<jbyte> start_key(last_row_length + 1, 0);
+  env->GetByteArrayRegion(last_row, 0, last_row_length, &start_key[0]);
+  jbyteArray start_bytes = env->NewByteArray(start_key.size());
+  RETURN_ERROR_IF_EXC(env);
+  env->SetByteArrayRegion(start_bytes, 0, start_key.size(), &start_key[0]);
   jbyteArray end_bytes;
   CreateByteArray(env, scan_range.stop_key(), &end_bytes);
   return InitScanRange(env, start_bytes, end_bytes);
@@ -477,6 +529,13 @@ Status HBaseTableScanner::StartScan(JNIEnv* env, const TupleDescriptor* tuple_de
   scan_range_vector_ = &scan_range_vector;
   current_scan_range_idx_ = 0;
 
+  use_multi_get_ = FLAGS_hbase_multi_get_max_keys > 0;
+  for (const ScanRange& scan_range: scan_range_vector) {
+    use_multi_get_ &= IsPointRange(scan_range);
+  }
+  // The rows are fetched by MultiGet() without a ResultScanner.
+  if (use_multi_get_) return Status::OK();
+
   // Now, scan the first range (we should have at least one range). The
   // resultscanner_ is NULL and gets created in InitScanRange, so we don't
   // need to check if it timed out.
@@ -499,6 +558,116 @@ Status HBaseTableScanner::CreateByteArray(JNIEnv* env, const string& s,
   return Status::OK();
 }
 
+bool HBaseTableScanner::IsPointRange(const ScanRange& scan_range) {
+  const string& start_key = scan_range.start_key();
+  const string& stop_key = scan_range.stop_key();
+  // The scan range of a single row key stops at the smallest key greater than it.
+  return !start_key.empty() && stop_key.size() == start_key.size() + 1 &&
+      stop_key.compare(0, start_key.size(), start_key) == 0 &&
+      stop_key[start_key.size()] == '\0';
+}
+
+Status HBaseTableScanner::SetResults(JNIEnv* env, jobjectArray local_results) {
+  if (results_ != NULL) {
+    RETURN_IF_ERROR(JniUtil::FreeGlobalRef(env, results_));
+    results_ = NULL;
+  }
+  result_idx_ = 0;
+  num_results_ = 0;
+  if (local_results == NULL) return Status::OK();
+  RETURN_IF_ERROR(JniUtil::LocalToGlobalRef(env, local_results, &results_));
+  num_results_ = env->GetArrayLength(results_);
+  return Status::OK();
+}
+
+Status HBaseTableScanner::FetchResults(JNIEnv* env, bool* eos) {
+  *eos = false;
+  if (use_multi_get_) return MultiGet(env, eos);
+  JniLocalFrame jni_frame;
+  RETURN_IF_ERROR(jni_frame.push(env));
+  while (true) {
+    DCHECK(resultscanner_ != NULL);
+    // results = resultscanner_.next(rows_cached_);
+    jobjectArray results = reinterpret_cast<jobjectArray>(env->CallObjectMethod(
+        resultscanner_, resultscanner_next_batch_id_, rows_cached_));
+    // Normally we would check for a JNI exception via RETURN_ERROR_IF_EXC, but we
+    // need to also check for scanner timeouts and handle them specially, which is
+    // done by HandleResultScannerTimeout(). If a timeout occurred, then it will
+    // re-create the ResultScanner so we can try again.
+    bool timeout;
+    RETURN_IF_ERROR(HandleResultScannerTimeout(env, &timeout));
+    if (timeout) {
+      results = reinterpret_cast<jobjectArray>(env->CallObjectMethod(
+          resultscanner_, resultscanner_next_batch_id_, rows_cached_));
+      // There shouldn't be a timeout now, so we will just return any errors.
+      RETURN_ERROR_IF_EXC(env);
+    }
+    COUNTER_ADD(num_fetches_counter_, 1);
+    if (results != NULL && env->GetArrayLength(results) > 0) {
+      return SetResults(env, results);
+    }
+    if (current_scan_range_idx_ + 1 >= scan_range_vector_->size()) {
+      *eos = true;
+      return Status::OK();
+    }
+    // jump to the next region when finished with the current region.
+    ++current_scan_range_idx_;
+    RETURN_IF_ERROR(SetResults(env, NULL));
+    RETURN_IF_ERROR(InitScanRange(env, (*scan_range_vector_)[current_scan_range_idx_]));
+  }
+}
+
+Status HBaseTableScanner::MultiGet(JNIEnv* env, bool* eos) {
+  if (current_scan_range_idx_ >= scan_range_vector_->size()) {
+    *eos = true;
+    return Status::OK();
+  }
+  JniLocalFrame jni_frame;
+  RETURN_IF_ERROR(jni_frame.push(env, 2 * requested_columns_.size() + 10));
+  int num_keys = min<int>(FLAGS_hbase_multi_get_max_keys,
+      scan_range_vector_->size() - current_scan_range_idx_);
+  // gets = new ArrayList<Get>(num_keys);
+  jobject gets = env->NewObject(array_list_cl_, array_list_ctor_, num_keys);
+  RETURN_ERROR_IF_EXC(env);
+  // The family and qualifier of each requested column, shared by all Gets.
+  vector<jbyteArray> column_bytes(2 * requested_columns_.size());
+  for (int i = 0; i < requested_columns_.size(); ++i) {
+    RETURN_IF_ERROR(CreateByteArray(env, requested_columns_[i].first,
+        &column_bytes[2 * i]));
+    RETURN_IF_ERROR(CreateByteArray(env, requested_columns_[i].second,
+        &column_bytes[2 * i + 1]));
+  }
+  for (int i = 0; i < num_keys; ++i) {
+    JniLocalFrame get_frame;
+    RETURN_IF_ERROR(get_frame.push(env));
+    const ScanRange& scan_range = (*scan_range_vector_)[current_scan_range_idx_++];
+    jbyteArray row_bytes;
+    RETURN_IF_ERROR(CreateByteArray(env, scan_range.start_key(), &row_bytes));
+    // get = new Get(row_bytes);
+    jobject get = env->NewObject(get_cl_, get_ctor_, row_bytes);
+    RETURN_ERROR_IF_EXC(env);
+    for (int j = 0; j < column_bytes.size(); j += 2) {
+      // get.addColumn(family_bytes, qualifier_bytes);
+      env->CallObjectMethod(get, get_add_column_id_, column_bytes[j],
+          column_bytes[j + 1]);
+      RETURN_ERROR_IF_EXC(env);
+    }
+    if (filter_list_ != NULL) {
+      // get.setFilter(filter_list_);
+      env->CallObjectMethod(get, get_set_filter_id_, filter_list_);
+      RETURN_ERROR_IF_EXC(env);
+    }
+    // gets.add(get);
+    env->CallBooleanMethod(gets, array_list_add_id_, get);
+    RETURN_ERROR_IF_EXC(env);
+  }
+  // results = htable_.get(gets);
+  jobjectArray results;
+  RETURN_IF_ERROR(htable_->Get(gets, &results));
+  COUNTER_ADD(num_fetches_counter_, 1);
+  return SetResults(env, results);
+}
+
 Status HBaseTableScanner::Next(JNIEnv* env, bool* has_next) {
   JniLocalFrame jni_frame;
   RETURN_IF_ERROR(jni_frame.push(env));
@@ -506,42 +675,27 @@ Status HBaseTableScanner::Next(JNIEnv* env, bool* has_next) {
   {
     SCOPED_TIMER(scan_node_->read_timer());
     while (true) {
-      DCHECK(resultscanner_ != NULL);
-      // result_ = resultscanner_.next();
-      result = env->CallObjectMethod(resultscanner_, resultscanner_next_id_);
-      // Normally we would check for a JNI exception via RETURN_ERROR_IF_EXC, but we
-      // need to also check for scanner timeouts and handle them specially, which is
-      // done by HandleResultScannerTimeout(). If a timeout occurred, then it will
-      // re-create the ResultScanner so we can try again.
-      bool timeout;
-      RETURN_IF_ERROR(HandleResultScannerTimeout(env, &timeout));
-      if (timeout) {
-        result = env->CallObjectMethod(resultscanner_, resultscanner_next_id_);
-        // There shouldn't be a timeout now, so we will just return any errors.
-        RETURN_ERROR_IF_EXC(env);
-      }
-      // jump to the next region when finished with the current region.
-      if (result == NULL && current_scan_range_idx_ + 1 < scan_range_vector_->size()) {
-        ++current_scan_range_idx_;
-        RETURN_IF_ERROR(InitScanRange(env,
-            (*scan_range_vector_)[current_scan_range_idx_]));
+      if (result_idx_ == num_results_) {
+        bool eos;
+        RETURN_IF_ERROR(FetchResults(env, &eos));
+        if (eos) {
+          *has_next = false;
+          return Status::OK();
+        }
         continue;
       }
-
-      // Ignore empty rows
-      if (result != NULL &&
+      result = env->GetObjectArrayElement(results_, result_idx_++);
+      RETURN_ERROR_IF_EXC(env);
+      // Ignore empty rows, e.g. the rows of multi-gets whose row key doesn't exist.
+      if (result == NULL ||
           JNI_TRUE == env->CallBooleanMethod(result, result_isempty_id_)) {
+        if (result != NULL) env->DeleteLocalRef(result);
         continue;
       }
       break;
     }
   }
 
-  if (result == NULL) {
-    *has_next = false;
-    return Status::OK();
-  }
-
   if (cells_ != NULL) RETURN_IF_ERROR(JniUtil::FreeGlobalRef(env, cells_));
   // cells_ = result.raw();
   jobject local_cells = reinterpret_cast<jobjectArray>(
@@ -763,6 +917,8 @@ void HBaseTableScanner::Close(JNIEnv* env) {
     resultscanner_ = NULL;
   }
   if (scan_ != NULL) JniUtil::FreeGlobalRef(env, scan_);
+  if (filter_list_ != NULL) JniUtil::FreeGlobalRef(env, filter_list_);
+  if (results_ != NULL) JniUtil::FreeGlobalRef(env, results_);
   if (cells_ != NULL) JniUtil::FreeGlobalRef(env, cells_);
 
   // Close the HTable so that the connections are not kept around.
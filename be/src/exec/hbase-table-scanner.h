@@ -50,7 +50,12 @@ class HBaseScanNode;
 /// high value will put more memory pressure on the HBase region server and having a small
 /// value will cause extra round trips to the HBase region server. This value can
 /// be overridden by the query option hbase_caching. FE will also suggest a max value such
-/// that it won't put too much memory pressure on the region server.
+/// that it won't put too much memory pressure on the region server. The same number of
+/// rows is fetched from the ResultScanner per JNI call.
+//
+/// If all scan ranges are point ranges, i.e. each covers a single row key, the rows are
+/// fetched with multi-gets of up to --hbase_multi_get_max_keys row keys instead of one
+/// scan per range.
 //
 /// HBase version compatibility: Starting from HBase 0.95.2 result rows are represented by
 /// Cells instead of KeyValues (prior HBase versions). To mitigate this API
@@ -157,6 +162,8 @@ class HBaseTableScanner {
   static jclass filter_list_op_cl_;
   static jclass single_column_value_filter_cl_;
   static jclass compare_op_cl_;
+  static jclass get_cl_;
+  static jclass array_list_cl_;
   /// Exception thrown when a ResultScanner times out
   static jclass scanner_timeout_ex_cl_;
 
@@ -168,9 +175,10 @@ class HBaseTableScanner {
   static jmethodID scan_set_filter_id_;
   static jmethodID scan_set_start_row_id_;
   static jmethodID scan_set_stop_row_id_;
-  static jmethodID resultscanner_next_id_;
+  static jmethodID resultscanner_next_batch_id_;
   static jmethodID resultscanner_close_id_;
   static jmethodID result_isempty_id_;
+  static jmethodID result_get_row_id_;
   static jmethodID result_raw_cells_id_;
   static jmethodID cell_get_row_array_;
   static jmethodID cell_get_family_array_;
@@ -187,6 +195,11 @@ class HBaseTableScanner {
   static jmethodID filter_list_ctor_;
   static jmethodID filter_list_add_filter_id_;
   static jmethodID single_column_value_filter_ctor_;
+  static jmethodID get_ctor_;
+  static jmethodID get_add_column_id_;
+  static jmethodID get_set_filter_id_;
+  static jmethodID array_list_ctor_;
+  static jmethodID array_list_add_id_;
 
   static jobject empty_row_;
   static jobject must_pass_all_op_;
@@ -207,6 +220,24 @@ class HBaseTableScanner {
   jobject scan_;           // Java type Scan
   jobject resultscanner_;  // Java type ResultScanner
 
+  /// Filters and columns of the scan, which are also set on the Gets of multi-gets.
+  /// Set in ScanSetup(). filter_list_ is a global reference and NULL if there are no
+  /// filters.
+  jobject filter_list_;  // Java type FilterList
+  std::vector<std::pair<std::string, std::string> > requested_columns_;
+
+  /// True if the rows are fetched with multi-gets instead of scans.
+  bool use_multi_get_;
+
+  /// Rows fetched by the last ResultScanner.next(int) call or multi-get. Java type
+  /// Result[]. A global reference that is NULL if no rows were fetched from the current
+  /// scan range yet.
+  jobjectArray results_;
+
+  /// Index of the next row in results_ and the number of rows in results_.
+  int result_idx_;
+  int num_results_;
+
   /// Helper members for retrieving results from a scan. Updated in Next() and
   /// used by GetRowKey() and GetValue(). Result of resultscanner_.next().raw()
   /// Java type Cell[] or KeyValue[] depending on HBase version.
@@ -244,6 +275,10 @@ class HBaseTableScanner {
   /// HBase specific counters
   RuntimeProfile::Counter* scan_setup_timer_;
 
+  /// Number of JNI calls that fetched rows, i.e. ResultScanner.next(int) calls and
+  /// multi-gets.
+  RuntimeProfile::Counter* num_fetches_counter_;
+
   /// Checks for and handles a ScannerTimeoutException which is thrown if the
   /// ResultScanner times out. If a timeout occurs, the ResultScanner is re-created
   /// (with the scan range adjusted if some results have already been returned) and
@@ -252,6 +287,20 @@ class HBaseTableScanner {
   /// 'timeout' is true if a ScannerTimeoutException was thrown, false otherwise.
   Status HandleResultScannerTimeout(JNIEnv* env, bool* timeout);
 
+  /// Returns true if 'scan_range' covers exactly one row key.
+  static bool IsPointRange(const ScanRange& scan_range);
+
+  /// Replaces results_ with the next rows of the scan. Sets '*eos' if all scan ranges
+  /// were read.
+  Status FetchResults(JNIEnv* env, bool* eos);
+
+  /// Replaces results_ with the rows of the next point ranges, which are fetched with
+  /// one multi-get. Sets '*eos' if all scan ranges were read.
+  Status MultiGet(JNIEnv* env, bool* eos);
+
+  /// Replaces results_ with 'local_results', a local reference to a Result[].
+  Status SetResults(JNIEnv* env, jobjectArray local_results);
+
   /// Lexicographically compares s with the string in data having given length.
   /// Returns a value > 0 if s is greater, a value < 0 if s is smaller,
   /// and 0 if they are equal.
@@ -16,6 +16,7 @@
 
 #include <avro/errors.h>
 #include <avro/legacy.h>
+#include <boost/bind.hpp>
 #include <gutil/strings/substitute.h>
 
 #include "codegen/llvm-codegen.h"
@@ -25,6 +26,7 @@
 #include "runtime/raw-value.h"
 #include "runtime/runtime-state.h"
 #include "util/codec.h"
+#include "util/debug-util.h"
 #include "util/decompress.h"
 #include "util/runtime-profile.h"
 
@@ -62,7 +64,8 @@ Function* HdfsAvroScanner::Codegen(HdfsScanNode* node,
   if (!node->runtime_state()->codegen_enabled()) return NULL;
   LlvmCodeGen* codegen;
   if (!node->runtime_state()->GetCodegen(&codegen).ok()) return NULL;
-  Function* materialize_tuple_fn = CodegenMaterializeTuple(node, codegen);
+  Function* materialize_tuple_fn =
+      CodegenMaterializeTuple(node, codegen, node->avro_schema(), false);
   if (materialize_tuple_fn == NULL) return NULL;
   return CodegenDecodeAvroData(node->runtime_state(), materialize_tuple_fn, conjunct_ctxs);
 }
@@ -138,11 +141,13 @@ Status HdfsAvroScanner::ParseMetadata() {
 
         RETURN_IF_ERROR(ResolveSchemas(scan_node_->avro_schema(), file_schema));
 
-        // We currently codegen a function only for the table schema. If this file's
-        // schema is different from the table schema, don't use the codegen'd function and
-        // use the interpreted path instead.
+        // The function codegen'd for the table schema can only be used if this file's
+        // schema is the same. Otherwise a function is codegen'd for the file schema.
         avro_header_->use_codegend_decode_avro_data = avro_schema_equal(
             scan_node_->avro_schema().schema, file_schema->schema);
+        if (!avro_header_->use_codegend_decode_avro_data) {
+          avro_header_->schema_json.assign(reinterpret_cast<char*>(value), value_len);
+        }
 
       } else if (key == AVRO_CODEC_KEY) {
         string avro_codec(reinterpret_cast<char*>(value), value_len);
@@ -431,9 +436,15 @@ Status HdfsAvroScanner::InitNewRange() {
     RETURN_IF_ERROR(UpdateDecompressor(header_->compression_type));
   }
 
+  codegend_decode_avro_data_ = NULL;
   if (avro_header_->use_codegend_decode_avro_data) {
     codegend_decode_avro_data_ = reinterpret_cast<DecodeAvroDataFn>(
         scan_node_->GetCodegenFn(THdfsFileFormat::AVRO));
+  } else if (state_->codegen_enabled()) {
+    codegend_decode_avro_data_ = reinterpret_cast<DecodeAvroDataFn>(
+        scan_node_->GetRuntimeCodegenFn(avro_header_->schema_json,
+            bind(&HdfsAvroScanner::CodegenFileSchemaDecodeAvroData, scan_node_,
+                avro_header_->schema.get(), _1, _2)));
   }
   if (codegend_decode_avro_data_ == NULL) {
     scan_node_->IncNumScannersCodegenDisabled();
@@ -587,10 +598,10 @@ bool HdfsAvroScanner::MaterializeTuple(const AvroSchemaElement& record_schema,
 }
 
 // This function produces a codegen'd function equivalent to MaterializeTuple() but
-// optimized for the table schema. Via helper functions CodegenReadRecord() and
-// CodegenReadScalar(), it eliminates the conditionals necessary when interpreting the
-// type of each element in the schema, instead generating code to handle each element in
-// the schema. Example output with tpch.region:
+// optimized for a specific schema, i.e. the table schema or a file schema. Via helper
+// functions CodegenReadRecord() and CodegenReadScalar(), it eliminates the conditionals
+// necessary when interpreting the type of each element in the schema, instead
+// generating code to handle each element in the schema. Example output with tpch.region:
 //
 // define i1 @MaterializeTuple(%"class.impala::HdfsAvroScanner"* %this,
 //     %"struct.impala::AvroSchemaElement"* %record_schema,
@@ -663,8 +674,8 @@ bool HdfsAvroScanner::MaterializeTuple(const AvroSchemaElement& record_schema,
 // bail_out:                                         ; No predecessors!
 //   ret i1 false                                    // used only if there is CHAR.
 //}
-Function* HdfsAvroScanner::CodegenMaterializeTuple(
-    HdfsScanNode* node, LlvmCodeGen* codegen) {
+Function* HdfsAvroScanner::CodegenMaterializeTuple(HdfsScanNode* node,
+    LlvmCodeGen* codegen, const AvroSchemaElement& record_schema, bool is_file_schema) {
   LLVMContext& context = codegen->context();
   LlvmCodeGen::LlvmBuilder builder(context);
 
@@ -704,9 +715,9 @@ Function* HdfsAvroScanner::CodegenMaterializeTuple(
   // Create a bail out block to handle decoding failures.
   BasicBlock* bail_out_block = BasicBlock::Create(context, "bail_out", fn, NULL);
 
-  Status status = CodegenReadRecord(
-      SchemaPath(), node->avro_schema(), node, codegen, &builder, fn, bail_out_block,
-      bail_out_block, this_val, pool_val, tuple_val, data_val);
+  Status status = CodegenReadRecord(SchemaPath(), record_schema, is_file_schema, node,
+      codegen, &builder, fn, bail_out_block, bail_out_block, this_val, pool_val,
+      tuple_val, data_val);
   if (!status.ok()) {
     VLOG_QUERY << status.GetDetail();
     fn->eraseFromParent();
@@ -724,8 +735,9 @@ Function* HdfsAvroScanner::CodegenMaterializeTuple(
 }
 
 Status HdfsAvroScanner::CodegenReadRecord(
-    const SchemaPath& path, const AvroSchemaElement& record, HdfsScanNode* node,
-    LlvmCodeGen* codegen, void* void_builder, Function* fn, BasicBlock* insert_before,
+    const SchemaPath& path, const AvroSchemaElement& record, bool is_file_schema,
+    HdfsScanNode* node, LlvmCodeGen* codegen, void* void_builder, Function* fn,
+    BasicBlock* insert_before,
     BasicBlock* bail_out, Value* this_val, Value* pool_val, Value* tuple_val,
     Value* data_val) {
   DCHECK_EQ(record.schema->type, AVRO_RECORD);
@@ -743,9 +755,14 @@ Status HdfsAvroScanner::CodegenReadRecord(
     if (path.empty()) col_idx += node->num_partition_keys();
     SchemaPath new_path = path;
     new_path.push_back(col_idx);
-    int slot_idx = node->GetMaterializedSlotIdx(new_path);
-    SlotDescriptor* slot_desc = (slot_idx == HdfsScanNode::SKIP_COLUMN) ?
-                                NULL : node->materialized_slots()[slot_idx];
+    SlotDescriptor* slot_desc;
+    if (is_file_schema) {
+      slot_desc = const_cast<SlotDescriptor*>(field->slot_desc);
+    } else {
+      int slot_idx = node->GetMaterializedSlotIdx(new_path);
+      slot_desc = (slot_idx == HdfsScanNode::SKIP_COLUMN) ?
+                  NULL : node->materialized_slots()[slot_idx];
+    }
 
     // Block that calls appropriate Read<Type> function
     BasicBlock* read_field_block =
@@ -773,7 +790,7 @@ Status HdfsAvroScanner::CodegenReadRecord(
 
       // Write null field IR
       builder->SetInsertPoint(null_block);
-      if (slot_idx != HdfsScanNode::SKIP_COLUMN) {
+      if (slot_desc != NULL) {
         Function* set_null_fn = slot_desc->GetUpdateNullFn(codegen, true);
         DCHECK(set_null_fn != NULL);
         builder->CreateCall(set_null_fn, ArrayRef<Value*>({tuple_val}));
@@ -790,8 +807,9 @@ Status HdfsAvroScanner::CodegenReadRecord(
     if (field->schema->type == AVRO_RECORD) {
       BasicBlock* insert_before_block =
           (null_block != NULL) ? null_block : end_field_block;
-      RETURN_IF_ERROR(CodegenReadRecord(new_path, *field, node, codegen, builder, fn,
-          insert_before_block, bail_out, this_val, pool_val, tuple_val, data_val));
+      RETURN_IF_ERROR(CodegenReadRecord(new_path, *field, is_file_schema, node, codegen,
+          builder, fn, insert_before_block, bail_out, this_val, pool_val, tuple_val,
+          data_val));
     } else {
       RETURN_IF_ERROR(CodegenReadScalar(*field, slot_desc, codegen, builder,
           end_field_block, bail_out, this_val, pool_val, tuple_val, data_val));
@@ -914,3 +932,33 @@ Function* HdfsAvroScanner::CodegenDecodeAvroData(RuntimeState* state,
   DCHECK(decode_avro_data_fn != NULL);
   return decode_avro_data_fn;
 }
+
+Status HdfsAvroScanner::CodegenFileSchemaDecodeAvroData(HdfsScanNode* node,
+    const AvroSchemaElement* file_schema, scoped_ptr<LlvmCodeGen>* codegen_ret,
+    void** fn) {
+  RuntimeState* state = node->runtime_state();
+  RETURN_IF_ERROR(LlvmCodeGen::CreateImpalaCodegen(state->obj_pool(),
+      Substitute("$0_avro_$1", PrintId(state->fragment_instance_id()), node->id()),
+      codegen_ret));
+  LlvmCodeGen* codegen = codegen_ret->get();
+  codegen->EnableOptimizations(true);
+
+  Function* materialize_tuple_fn =
+      CodegenMaterializeTuple(node, codegen, *file_schema, true);
+  if (materialize_tuple_fn == NULL) {
+    return Status("Failed to codegen MaterializeTuple() for the file schema");
+  }
+  Function* decode_avro_data_fn =
+      codegen->GetFunction(IRFunction::DECODE_AVRO_DATA, true);
+  int replaced = codegen->ReplaceCallSites(decode_avro_data_fn, materialize_tuple_fn,
+      "MaterializeTuple");
+  DCHECK_EQ(replaced, 1);
+  // The call to EvalConjuncts() is left to the cross-compiled, interpreted version.
+  decode_avro_data_fn->setName("DecodeAvroData");
+  decode_avro_data_fn = codegen->FinalizeFunction(decode_avro_data_fn);
+  if (decode_avro_data_fn == NULL) {
+    return Status("Failed to codegen DecodeAvroData() for the file schema");
+  }
+  codegen->AddFunctionToJit(decode_avro_data_fn, fn);
+  return codegen->FinalizeModule();
+}
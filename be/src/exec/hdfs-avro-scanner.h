@@ -43,7 +43,10 @@
 /// header to decode the serialized objects. If possible, non-materialized columns are
 /// skipped without being read. If codegen is enabled, we codegen a function based on the
 /// table schema that parses records, materializes them to tuples, and evaluates the
-/// conjuncts.
+/// conjuncts. Files whose schema differs from the table schema use a function that is
+/// codegen'd while scanning for each distinct file schema and shared by all scanners of
+/// the scan node (see HdfsScanNode::GetRuntimeCodegenFn()). These functions evaluate the
+/// conjuncts interpreted.
 //
 /// The Avro C library is used to parse the file's schema and the table's schema, which are
 /// then resolved according to the Avro spec and transformed into our own schema
@@ -61,7 +64,6 @@
 //
 /// TODO:
 /// - implement SkipComplex()
-/// - codegen a function per unique file schema, rather than just the table schema
 /// - once Exprs are thread-safe, we can cache the jitted function directly
 /// - microbenchmark codegen'd functions (this and other scanners)
 
@@ -116,6 +118,10 @@ class HdfsAvroScanner : public BaseSequenceScanner {
     /// True if this file can use the codegen'd version of DecodeAvroData() (i.e. its
     /// schema matches the table schema), false otherwise.
     bool use_codegend_decode_avro_data;
+
+    /// The JSON text of the file schema. Identifies the function codegen'd for the file
+    /// schema if use_codegend_decode_avro_data is false.
+    std::string schema_json;
   };
 
   AvroFileHeader* avro_header_;
@@ -188,17 +194,28 @@ class HdfsAvroScanner : public BaseSequenceScanner {
       RuntimeState* state, llvm::Function* materialize_tuple_fn,
       const std::vector<ExprContext*>& conjunct_ctxs);
 
-  /// Codegens a version of MaterializeTuple() that reads records based on the table
-  /// schema.
-  /// TODO: Codegen a function for each unique file schema.
+  /// Codegens DecodeAvroData() for 'file_schema', which was resolved against the table
+  /// schema by ResolveSchemas(), into a new LlvmCodeGen returned in 'codegen', and JIT
+  /// compiles it into 'fn'. The conjuncts are evaluated interpreted, since the exprs
+  /// codegen into the fragment's module only. Passed to
+  /// HdfsScanNode::GetRuntimeCodegenFn().
+  static Status CodegenFileSchemaDecodeAvroData(HdfsScanNode* node,
+      const AvroSchemaElement* file_schema, boost::scoped_ptr<LlvmCodeGen>* codegen,
+      void** fn);
+
+  /// Codegens a version of MaterializeTuple() that reads records based on
+  /// 'record_schema'. If 'is_file_schema' is false, 'record_schema' is the table schema
+  /// and the slots of its fields are looked up by column path. Otherwise it is a file
+  /// schema resolved by ResolveSchemas() and the slots are its fields' 'slot_desc'.
   static llvm::Function* CodegenMaterializeTuple(HdfsScanNode* node,
-      LlvmCodeGen* codegen);
+      LlvmCodeGen* codegen, const AvroSchemaElement& record_schema, bool is_file_schema);
 
   /// Used by CodegenMaterializeTuple to recursively create the IR for reading an Avro
   /// record.
   /// - path: the column path constructed so far. This is used to find the slot desc, if
   ///     any, associated with each field of the record. Note that this assumes the
   ///     table's Avro schema matches up with the table's column definitions by ordinal.
+  ///     Unused if 'is_file_schema' is true.
   /// - builder: used to insert the IR, starting at the current insert point. The insert
   ///     point will be left at the end of the record but before the 'insert_before'
   ///     block.
@@ -208,8 +225,8 @@ class HdfsAvroScanner : public BaseSequenceScanner {
   ///     ReadAvroChar() which can exceed memory limit during allocation from MemPool.
   /// - this_val, pool_val, tuple_val, data_val: arguments to MaterializeTuple()
   static Status CodegenReadRecord(
-      const SchemaPath& path, const AvroSchemaElement& record, HdfsScanNode* node,
-      LlvmCodeGen* codegen, void* builder, llvm::Function* fn,
+      const SchemaPath& path, const AvroSchemaElement& record, bool is_file_schema,
+      HdfsScanNode* node, LlvmCodeGen* codegen, void* builder, llvm::Function* fn,
       llvm::BasicBlock* insert_before, llvm::BasicBlock* bail_out, llvm::Value* this_val,
       llvm::Value* pool_val, llvm::Value* tuple_val, llvm::Value* data_val);
 
@@ -14,6 +14,7 @@
 
 #include "exec/hdfs-parquet-scanner.h"
 
+#include <algorithm>
 #include <limits> // for std::numeric_limits
 #include <queue>
 
@@ -27,24 +28,34 @@
 #include "exec/scanner-context.inline.h"
 #include "exec/read-write-util.h"
 #include "exprs/expr.h"
+#include "exprs/slot-ref.h"
 #include "gutil/bits.h"
 #include "runtime/collection-value-builder.h"
 #include "runtime/descriptors.h"
 #include "runtime/runtime-state.h"
 #include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-filter.inline.h"
 #include "runtime/tuple-row.h"
 #include "runtime/tuple.h"
 #include "runtime/string-value.h"
+#include "runtime/thread-resource-mgr.h"
 #include "util/bitmap.h"
 #include "util/bit-util.h"
+#include "util/bloom-filter.h"
 #include "util/decompress.h"
 #include "util/debug-util.h"
 #include "util/error-util.h"
+#include "util/impalad-metrics.h"
 #include "util/dict-encoding.h"
+#include "util/lru-cache.h"
+#include "util/min-max-filter.h"
 #include "util/rle-encoding.h"
 #include "util/runtime-profile.h"
+#include "util/string-parser.h"
+#include "util/thread-pool.h"
 #include "rpc/thrift-util.h"
 
 #include "common/names.h"
@@ -63,6 +74,34 @@ DEFINE_bool(convert_legacy_hive_parquet_utc_timestamps, false,
 DEFINE_double(parquet_min_filter_reject_ratio, 0.1, "(Advanced) If the percentage of "
     "rows rejected by a runtime filter drops below this value, the filter is disabled.");
 
+DEFINE_bool(parquet_late_materialization, true, "(Advanced) When true, the Parquet "
+    "scanner first materializes the columns referenced by conjuncts and runtime filters "
+    "and evaluates them, and then materializes the remaining columns only for the rows "
+    "that passed.");
+
+DEFINE_bool(parquet_dictionary_conjuncts, true, "(Advanced) When true, the Parquet "
+    "scanner evaluates the conjuncts that reference a single column once per entry of "
+    "the column dictionary, for column chunks that are fully dictionary-encoded, "
+    "instead of once per row.");
+
+DEFINE_int64(parquet_footer_cache_capacity, 0, "(Advanced) Maximum estimated number of "
+    "bytes of deserialized Parquet file footers that are cached across queries. Cached "
+    "footers are keyed by the path, modification time and length of the file. 0 disables "
+    "the cache.");
+
+DEFINE_int64(parquet_page_cache_capacity, 0, "(Advanced) Maximum number of bytes of "
+    "decompressed Parquet pages that are cached across queries. Only column chunks that "
+    "are read completely are cached. 0 disables the cache.");
+
+DEFINE_int64(parquet_page_cache_max_chunk_size, 16L * 1024L * 1024L, "(Advanced) "
+    "Column chunks whose uncompressed size exceeds this are not added to the Parquet "
+    "page cache, so that scans of large tables do not evict the chunks of small ones.");
+
+DEFINE_int32(parquet_decompression_threads, 0, "(Advanced) Maximum number of helper "
+    "threads per Parquet scanner that decompress the data pages of different columns "
+    "ahead of time. Helper threads are only started if optional thread tokens are "
+    "available. 0 disables parallel decompression.");
+
 const int64_t HdfsParquetScanner::FOOTER_SIZE = 100 * 1024;
 const int16_t HdfsParquetScanner::ROW_GROUP_END = numeric_limits<int16_t>::min();
 const int16_t HdfsParquetScanner::INVALID_LEVEL = -1;
@@ -180,6 +219,14 @@ struct ScratchTupleBatch {
   int num_tuples;
   // Cached for convenient access.
   const int tuple_byte_size;
+  // Non-zero for each tuple that was rejected by a runtime filter evaluated on a column
+  // dictionary. Only maintained while dictionary filters are active, see
+  // HdfsParquetScanner::EvalDictionaryFilters().
+  vector<uint8_t> rejected;
+  // Scratch space for evaluating the conjuncts over a batch of tuples: the tuples as
+  // single-tuple rows and the indices of the tuples that are still selected.
+  vector<Tuple*> tuple_ptrs;
+  vector<int> selection;
 
   // Helper batch for safely allocating tuple_mem from its tuple data pool using
   // ResizeAndAllocateTupleBuffer().
@@ -191,6 +238,9 @@ struct ScratchTupleBatch {
       tuple_idx(0),
       num_tuples(0),
       tuple_byte_size(row_desc.GetRowSize()),
+      rejected(batch_size),
+      tuple_ptrs(batch_size),
+      selection(batch_size),
       batch(row_desc, batch_size, mem_tracker) {
     DCHECK_EQ(row_desc.tuple_descriptors().size(), 1);
   }
@@ -220,10 +270,15 @@ const string PARQUET_MEM_LIMIT_EXCEEDED = "HdfsParquetScanner::$0() failed to al
 
 HdfsParquetScanner::HdfsParquetScanner(HdfsScanNode* scan_node, RuntimeState* state)
     : HdfsScanner(scan_node, state),
+      dict_filters_active_(false),
+      late_materialization_(false),
+      num_eager_col_readers_(0),
       scratch_batch_(new ScratchTupleBatch(
           scan_node->row_desc(), state_->batch_size(), scan_node->mem_tracker())),
+      file_metadata_(NULL),
       metadata_range_(NULL),
       dictionary_pool_(new MemPool(scan_node->mem_tracker())),
+      num_decompression_threads_(0),
       assemble_rows_timer_(scan_node_->materialize_tuple_timer()) {
   assemble_rows_timer_.Stop();
 }
@@ -287,6 +342,16 @@ class HdfsParquetScanner::LevelDecoder : public RleDecoder {
   inline int CacheRemaining() const { return num_cached_levels_ - cached_level_idx_; }
   inline int CacheCurrIdx() const { return cached_level_idx_; }
 
+  /// Returns the number of consecutive cached levels, starting at the current one and
+  /// up to 'max_levels', that are at least 'level'. Does not consume them.
+  inline int CacheRunLength(int level, int max_levels) const {
+    DCHECK_LE(max_levels, CacheRemaining());
+    const uint8_t* levels = cached_levels_ + cached_level_idx_;
+    int run_length = 0;
+    while (run_length < max_levels && levels[run_length] >= level) ++run_length;
+    return run_length;
+  }
+
  private:
   /// Initializes members associated with the level cache. Allocates memory for
   /// the cache from pool, if necessary.
@@ -395,6 +460,22 @@ class HdfsParquetScanner::ColumnReader {
   virtual bool ReadNonRepeatedValueBatch(MemPool* pool, int max_values, int tuple_size,
       uint8_t* tuple_mem, int* num_values);
 
+  /// Returns the number of values, at most 'max_values', from the current one up to the
+  /// end of the current collection, i.e. before the next value whose repetition level
+  /// is <= 'new_collection_rep_level', that are known without reading ahead. Returns at
+  /// least 1. Only valid for readers of collection items whose current value is not an
+  /// empty or NULL collection.
+  virtual int NumCollectionValuesAhead(int new_collection_rep_level, int max_values) {
+    return 1;
+  }
+
+  /// Reads the next 'num_values' values of collection items with ReadValue() and
+  /// materializes them into consecutive tuples in 'tuple_mem', including the position
+  /// slot. The values must have been counted by NumCollectionValuesAhead(). The return
+  /// value and error behavior are the same as in ReadValueBatch().
+  virtual bool ReadCollectionValueBatch(MemPool* pool, int num_values, int tuple_size,
+      uint8_t* tuple_mem);
+
   /// Advances this column reader's def and rep levels to the next logical value, i.e. to
   /// the next scalar value or the beginning of the next collection, without attempting to
   /// read the value. This is used to skip past def/rep levels that don't materialize a
@@ -553,27 +634,51 @@ class HdfsParquetScanner::BaseScalarColumnReader :
       num_values_read_(0),
       metadata_(NULL),
       stream_(NULL),
-      decompressed_data_pool_(new MemPool(parent->scan_node_->mem_tracker())) {
+      decompressed_data_pool_(new MemPool(parent->scan_node_->mem_tracker())),
+      dict_filter_active_(false),
+      dict_filter_null_pass_(true),
+      skip_rejected_(false),
+      page_skipped_(false),
+      prefetch_pool_(new MemPool(parent->scan_node_->mem_tracker())),
+      prefetch_pending_(false),
+      next_cached_page_(0) {
     DCHECK_GE(node_.col_idx, 0) << node_.DebugString();
 
   }
 
   virtual ~BaseScalarColumnReader() { }
 
-  /// This is called once for each row group in the file.
-  Status Reset(const parquet::ColumnMetaData* metadata, ScannerContext::Stream* stream) {
-    DCHECK(stream != NULL);
+  /// This is called once for each row group in the file. The pages of the column chunk
+  /// are read either from 'stream' or, if it is NULL, from 'cached_chunk'. If
+  /// 'cache_key' is not empty, the pages read from 'stream' are collected and added to
+  /// the page cache under that key once the whole chunk has been read.
+  Status Reset(const parquet::ColumnMetaData* metadata, ScannerContext::Stream* stream,
+      const boost::shared_ptr<const CachedColumnChunk>& cached_chunk,
+      const std::string& cache_key) {
+    DCHECK((stream != NULL) != (cached_chunk.get() != NULL));
     DCHECK(metadata != NULL);
+    // A page of the previous row group may still be prefetched if its scan stopped early.
+    DiscardPrefetchedPage();
 
     num_buffered_values_ = 0;
     data_ = NULL;
     stream_ = stream;
+    cached_chunk_ = cached_chunk;
+    next_cached_page_ = 0;
+    cache_key_ = cache_key;
+    new_cached_chunk_.reset();
+    if (stream != NULL && !cache_key.empty()) {
+      new_cached_chunk_.reset(new CachedColumnChunk(page_cache_mem_tracker_));
+    }
     metadata_ = metadata;
     num_values_read_ = 0;
     def_level_ = -1;
     // See ColumnReader constructor.
     rep_level_ = max_rep_level() == 0 ? 0 : -1;
     pos_current_value_ = -1;
+    dict_filter_active_ = false;
+    dict_filter_null_pass_ = true;
+    page_skipped_ = false;
 
     if (metadata_->codec != parquet::CompressionCodec::UNCOMPRESSED) {
       RETURN_IF_ERROR(Codec::CreateDecompressor(
@@ -585,6 +690,9 @@ class HdfsParquetScanner::BaseScalarColumnReader :
 
   /// Called once when the scanner is complete for final cleanup.
   void Close() {
+    DiscardPrefetchedPage();
+    cached_chunk_.reset();
+    new_cached_chunk_.reset();
     if (decompressor_.get() != NULL) decompressor_->Close();
   }
 
@@ -600,6 +708,75 @@ class HdfsParquetScanner::BaseScalarColumnReader :
   /// next data page if necessary.
   virtual bool NextLevels() { return NextLevels<true>(); }
 
+  /// Counts the values in the repetition level cache that NextLevels() decoded ahead.
+  virtual int NumCollectionValuesAhead(int new_collection_rep_level, int max_values) {
+    DCHECK_GT(max_rep_level(), 0);
+    DCHECK_GT(max_values, 0);
+    int max_ahead = min(max_values - 1, rep_levels_.CacheRemaining());
+    return 1 + rep_levels_.CacheRunLength(new_collection_rep_level + 1, max_ahead);
+  }
+
+  /// Reads the dictionary page of the current column chunk, if it starts with one, so
+  /// that filters can be evaluated against the dictionary before any data is read. Must
+  /// be called after Reset() and before any value is read.
+  Status InitDictionary();
+
+  /// If the scanner has decompression threads, reads the compressed bytes of the next
+  /// page of the column chunk and offers it to a decompression thread, unless the page
+  /// is not a data page or is skipped based on its statistics. ReadDataPage() then
+  /// initializes the prefetched page instead of reading one. Errors reading the page are
+  /// returned by ReadDataPage().
+  void PrefetchNextPage();
+
+  /// Returns true if this reader can evaluate filters against its dictionary entries,
+  /// see EvalDictionaryFilter().
+  virtual bool SupportsDictionaryFiltering() const { return false; }
+
+  /// Evaluates 'filter' against every dictionary entry that passed all filters evaluated
+  /// so far in this row group and returns the number of entries that still pass. From
+  /// then on, ReadNonRepeatedValueBatch() flags the scratch tuples whose value did not
+  /// pass in ScratchTupleBatch::rejected, so the filter need not be evaluated per row.
+  /// Only valid for top-level readers with an initialized dictionary.
+  virtual int EvalDictionaryFilter(const RuntimeFilter* filter) {
+    DCHECK(false);
+    return -1;
+  }
+
+  /// Same as EvalDictionaryFilter() for the scanner conjunct 'ctx', whose only slot is
+  /// this reader's slot. Each entry is evaluated by writing it into 'tuple', a scratch
+  /// tuple of the scanned tuple descriptor, and NULL by setting the slot to NULL. Only
+  /// the slot of 'tuple' is modified. Sets 'num_evals' to the number of evaluations.
+  virtual int EvalDictionaryConjunct(ExprContext* ctx, Tuple* tuple, int* num_evals) {
+    DCHECK(false);
+    return -1;
+  }
+
+  /// Returns true if this reader can skip the values of rejected tuples, see
+  /// set_skip_rejected().
+  virtual bool SupportsSkippingRejected() const { return false; }
+
+  /// If 'skip_rejected' is true, ReadNonRepeatedValueBatch() does not materialize the
+  /// values of the scratch tuples flagged in ScratchTupleBatch::rejected, but only
+  /// advances past them. Used for late materialization of top-level columns.
+  void set_skip_rejected(bool skip_rejected) {
+    DCHECK(!skip_rejected || SupportsSkippingRejected());
+    skip_rejected_ = skip_rejected;
+  }
+
+  /// Returns true if this reader can skip data pages based on their statistics, see
+  /// add_page_conjunct().
+  virtual bool SupportsPageSkipping() const { return false; }
+
+  /// Adds a conjunct on this reader's column that is tested against the statistics of
+  /// each data page. ReadDataPage() skips the pages that fail it, and
+  /// ReadNonRepeatedValueBatch() flags their rows in ScratchTupleBatch::rejected.
+  /// Only valid for top-level readers.
+  void add_page_conjunct(const MinMaxConjunct* conjunct) {
+    DCHECK(SupportsPageSkipping());
+    DCHECK_EQ(max_rep_level(), 0);
+    page_conjuncts_.push_back(conjunct);
+  }
+
   // TODO: Some encodings might benefit a lot from a SkipValues(int num_rows) if
   // we know this row can be skipped. This could be very useful with stats and big
   // sections can be skipped. Implement that when we can benefit from it.
@@ -642,10 +819,114 @@ class HdfsParquetScanner::BaseScalarColumnReader :
   /// Header for current data page.
   parquet::PageHeader current_page_header_;
 
+  /// True if values are filtered by dictionary index in the current row group, i.e.
+  /// EvalDictionaryFilter() was called.
+  bool dict_filter_active_;
+
+  /// False if NULLs are rejected by one of the filters evaluated on the dictionary.
+  bool dict_filter_null_pass_;
+
+  /// Starts filtering by dictionary index, with all 'num_entries' entries passing, if no
+  /// filter or conjunct was evaluated on the dictionary yet in this row group.
+  void StartDictFiltering(int num_entries) {
+    if (dict_filter_active_) return;
+    dict_filter_pass_.assign(num_entries, 1);
+    dict_filter_null_pass_ = true;
+    dict_filter_active_ = true;
+  }
+
+  /// If dict_filter_active_, 1 for each dictionary entry that passed all filters
+  /// evaluated on the dictionary and 0 for all others.
+  vector<uint8_t> dict_filter_pass_;
+
+  /// See set_skip_rejected().
+  bool skip_rejected_;
+
+  /// See add_page_conjunct().
+  vector<const MinMaxConjunct*> page_conjuncts_;
+
+  /// True if the current data page was skipped by ReadDataPage() because it failed one
+  /// of 'page_conjuncts_'. Its values are neither decompressed nor decoded.
+  bool page_skipped_;
+
+  /// Pool for the buffers of the prefetched page. They are transferred to
+  /// 'decompressed_data_pool_' when the page becomes the current data page.
+  boost::scoped_ptr<MemPool> prefetch_pool_;
+
+  /// The page started by PrefetchNextPage(). Allocated on first use.
+  boost::scoped_ptr<PrefetchedPage> prefetched_page_;
+
+  /// True if 'prefetched_page_' holds the next data page of the column chunk, whose
+  /// header is in 'current_page_header_'.
+  bool prefetch_pending_;
+
+  /// The page cache entry of the current column chunk if its pages are read from the
+  /// cache, in which case 'stream_' is NULL. 'next_cached_page_' is the index of the
+  /// next page to read from it.
+  boost::shared_ptr<const CachedColumnChunk> cached_chunk_;
+  int next_cached_page_;
+
+  /// If the current column chunk is read from 'stream_' and should be added to the page
+  /// cache, the pages read so far and the key to add them under. Reset if a page is
+  /// skipped without being decompressed, or if the page cache's memory is exhausted.
+  boost::shared_ptr<CachedColumnChunk> new_cached_chunk_;
+  std::string cache_key_;
+
+  /// How the values read by a top-level reader interact with the rejected flags of the
+  /// scratch tuples (see ScratchTupleBatch::rejected).
+  enum RejectedFlagsMode {
+    /// The flags are not used.
+    IGNORE_REJECTED,
+    /// Flag the tuples whose values did not pass the dictionary filters.
+    SET_REJECTED,
+    /// Skip over the values of flagged tuples without materializing them.
+    SKIP_REJECTED
+  };
+
   /// Read the next data page. If a dictionary page is encountered, that will be read and
   /// this function will continue reading the next data page.
   Status ReadDataPage();
 
+  /// Waits for 'prefetched_page_' to be decompressed and makes it the current data page.
+  Status InitPrefetchedPage();
+
+  /// Waits for any prefetched page and frees its buffers.
+  void DiscardPrefetchedPage();
+
+  /// Initializes the level decoders and values of the current data page, whose
+  /// uncompressed contents start at 'data_' and span 'data_size' bytes.
+  Status InitDataPageContents(int data_size);
+
+  /// Deserializes the header of the next page into current_page_header_ without
+  /// consuming it from the stream. The size of the header is returned in 'header_size'.
+  /// Sets 'eos' if the stream has no more data. If the chunk is read from
+  /// 'cached_chunk_', copies the header of the next cached page and sets 'header_size'
+  /// to 0.
+  Status PeekPageHeader(uint32_t* header_size, bool* eos);
+
+  /// Consumes the page header returned by PeekPageHeader().
+  Status ConsumePageHeader(uint32_t header_size);
+
+  /// Skips the contents of the current page, which are 'size' bytes in the stream.
+  Status SkipPageContents(int size);
+
+  /// Copies the contents of the current page from 'cached_chunk_' into a buffer
+  /// allocated from 'pool' and points 'data_' to it. Returns the size of the contents,
+  /// which are already decompressed, in 'data_size'.
+  Status ReadCachedPageContents(MemPool* pool, int* data_size);
+
+  /// Appends the current page, whose decompressed contents are 'data' of 'size' bytes,
+  /// to 'new_cached_chunk_', if it is set.
+  void AddPageToNewCachedChunk(const uint8_t* data, int size);
+
+  /// Reads the dictionary page described by current_page_header_, whose header has
+  /// already been consumed, and creates the dictionary decoder.
+  Status ReadDictionaryPage();
+
+  /// Returns false if the statistics of the data page described by current_page_header_
+  /// show that none of its values can pass one of 'page_conjuncts_'.
+  bool PagePassesMinMaxConjuncts() const;
+
   /// Try to move the the next page and buffer more values. Return false and sets rep_level_,
   /// def_level_ and pos_current_value_ to -1 if no more pages or an error encountered.
   bool NextPage();
@@ -654,6 +935,11 @@ class HdfsParquetScanner::BaseScalarColumnReader :
   template <bool ADVANCE_REP_LEVEL>
   bool NextLevels();
 
+  /// Decodes the next batch of definition and repetition levels of the current data
+  /// page into the level caches, for NextLevels() of values in collections. Returns
+  /// false and sets the parse status if a level could not be decoded.
+  bool CacheNextLevels();
+
   /// Creates a dictionary decoder from values/size and store in class. Subclass must
   /// implement this.
   virtual DictDecoderBase* CreateDictionaryDecoder(uint8_t* values, int size) = 0;
@@ -681,6 +967,14 @@ class HdfsParquetScanner::BaseScalarColumnReader :
   inline bool ReadSlot(void* slot, MemPool* pool);
 };
 
+/// True for the types whose PLAIN encoding is their in-memory representation, so that
+/// runs of PLAIN encoded values can be copied into slots without decoding them.
+template<typename T> struct IsPlainEncodingNative { static const bool value = false; };
+template<> struct IsPlainEncodingNative<int32_t> { static const bool value = true; };
+template<> struct IsPlainEncodingNative<int64_t> { static const bool value = true; };
+template<> struct IsPlainEncodingNative<float> { static const bool value = true; };
+template<> struct IsPlainEncodingNative<double> { static const bool value = true; };
+
 /// Per column type reader. If MATERIALIZED is true, the column values are materialized
 /// into the slot described by slot_desc. If MATERIALIZED is false, the column values
 /// are not materialized, but the position can be accessed.
@@ -738,6 +1032,18 @@ class HdfsParquetScanner::ScalarColumnReader :
     return ReadValueBatch<false>(pool, max_values, tuple_size, tuple_mem, num_values);
   }
 
+  /// Same as ColumnReader::ReadCollectionValueBatch() but with the inlined ReadValue().
+  virtual bool ReadCollectionValueBatch(MemPool* pool, int num_values, int tuple_size,
+      uint8_t* tuple_mem) {
+    for (int i = 0; i < num_values; ++i) {
+      FILE_CHECK_GE(def_level_, def_level_of_immediate_repeated_ancestor());
+      Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size);
+      if (pos_slot_desc_ != NULL) ReadPosition(tuple);
+      if (UNLIKELY(!ReadValue<true>(pool, tuple))) return false;
+    }
+    return true;
+  }
+
  protected:
   template <bool IN_COLLECTION>
   inline bool ReadValue(MemPool* pool, Tuple* tuple) {
@@ -787,6 +1093,15 @@ class HdfsParquetScanner::ScalarColumnReader :
         }
       }
 
+      // The rows of a page skipped by ReadDataPage() are all rejected.
+      if (!IN_COLLECTION && page_skipped_) {
+        int vals_to_skip = min(num_buffered_values_, max_values - val_count);
+        memset(&parent_->scratch_batch_->rejected[val_count], 1, vals_to_skip);
+        val_count += vals_to_skip;
+        num_buffered_values_ -= vals_to_skip;
+        continue;
+      }
+
       // Fill def/rep level caches if they are empty.
       int level_batch_size = min(parent_->state_->batch_size(), num_buffered_values_);
       if (!def_levels_.CacheHasNext()) {
@@ -813,12 +1128,20 @@ class HdfsParquetScanner::ScalarColumnReader :
       uint8_t* next_tuple = tuple_mem + val_count * tuple_size;
       int remaining_val_capacity = max_values - val_count;
       int ret_val_count = 0;
-      if (page_encoding_ == parquet::Encoding::PLAIN_DICTIONARY) {
-        continue_execution = MaterializeValueBatch<IN_COLLECTION, true>(
-            pool, remaining_val_capacity, tuple_size, next_tuple, &ret_val_count);
+      if (!IN_COLLECTION && (dict_filter_active_ || skip_rejected_)) {
+        // Only top-level readers use the rejected flags, so 'tuple_mem' is the start of
+        // the scratch batch.
+        uint8_t* rejected = &parent_->scratch_batch_->rejected[val_count];
+        if (skip_rejected_) {
+          continue_execution = MaterializePageValueBatch<IN_COLLECTION, SKIP_REJECTED>(pool,
+              remaining_val_capacity, tuple_size, next_tuple, &ret_val_count, rejected);
+        } else {
+          continue_execution = MaterializePageValueBatch<IN_COLLECTION, SET_REJECTED>(pool,
+              remaining_val_capacity, tuple_size, next_tuple, &ret_val_count, rejected);
+        }
       } else {
-        continue_execution = MaterializeValueBatch<IN_COLLECTION, false>(
-            pool, remaining_val_capacity, tuple_size, next_tuple, &ret_val_count);
+        continue_execution = MaterializePageValueBatch<IN_COLLECTION, IGNORE_REJECTED>(
+            pool, remaining_val_capacity, tuple_size, next_tuple, &ret_val_count, NULL);
       }
       val_count += ret_val_count;
       num_buffered_values_ -= (def_levels_.CacheCurrIdx() - cache_start_idx);
@@ -827,15 +1150,44 @@ class HdfsParquetScanner::ScalarColumnReader :
     return continue_execution;
   }
 
+  /// Calls MaterializeValueBatch() below for the encoding of the current data page, or
+  /// MaterializeFlatValueBatch() if the values can be decoded in bulk.
+  template<bool IN_COLLECTION, RejectedFlagsMode MODE>
+  bool MaterializePageValueBatch(MemPool* pool, int max_values, int tuple_size,
+      uint8_t* tuple_mem, int* num_values, uint8_t* rejected) {
+    if (MATERIALIZED && !IN_COLLECTION && MODE == IGNORE_REJECTED && !NeedsConversion()) {
+      if (page_encoding_ == parquet::Encoding::PLAIN_DICTIONARY) {
+        return MaterializeFlatValueBatch<true>(
+            max_values, tuple_size, tuple_mem, num_values);
+      } else if (IsPlainEncodingNative<T>::value) {
+        return MaterializeFlatValueBatch<false>(
+            max_values, tuple_size, tuple_mem, num_values);
+      }
+    }
+    if (page_encoding_ == parquet::Encoding::PLAIN_DICTIONARY) {
+      return MaterializeValueBatch<IN_COLLECTION, true, MODE>(
+          pool, max_values, tuple_size, tuple_mem, num_values, rejected);
+    } else {
+      return MaterializeValueBatch<IN_COLLECTION, false, MODE>(
+          pool, max_values, tuple_size, tuple_mem, num_values, rejected);
+    }
+  }
+
   /// Helper function for ReadValueBatch() above that performs value materialization.
   /// It assumes a data page with remaining values is available, and that the def/rep
   /// level caches have been populated.
   /// For efficiency, the simple special case of !MATERIALIZED && !IN_COLLECTION is not
   /// handled in this function.
-  template<bool IN_COLLECTION, bool IS_DICT_ENCODED>
+  /// Unless MODE is IGNORE_REJECTED, 'rejected' holds the rejected flags of the tuples
+  /// in 'tuple_mem'. With SET_REJECTED, the flag is set for each value whose dictionary
+  /// entry did not pass the dictionary filters, and for each NULL if NULLs did not pass.
+  /// Values from PLAIN pages are not filtered. With SKIP_REJECTED, the values of flagged
+  /// tuples are skipped.
+  template<bool IN_COLLECTION, bool IS_DICT_ENCODED, RejectedFlagsMode MODE>
   bool MaterializeValueBatch(MemPool* pool, int max_values, int tuple_size,
-      uint8_t* tuple_mem, int* num_values) {
+      uint8_t* tuple_mem, int* num_values, uint8_t* rejected) {
     DCHECK(MATERIALIZED || IN_COLLECTION);
+    DCHECK(MODE == IGNORE_REJECTED || (MATERIALIZED && !IN_COLLECTION));
     DCHECK_GT(num_buffered_values_, 0);
     DCHECK(def_levels_.CacheHasNext());
     if (IN_COLLECTION && pos_slot_desc_ != NULL) DCHECK(rep_levels_.CacheHasNext());
@@ -864,11 +1216,20 @@ class HdfsParquetScanner::ScalarColumnReader :
 
       if (MATERIALIZED) {
         if (def_level >= max_def_level()) {
-          bool continue_execution =
-              ReadSlot<IS_DICT_ENCODED>(tuple->GetSlot(tuple_offset_), pool);
+          bool continue_execution;
+          if (MODE == SKIP_REJECTED && rejected[val_count]) {
+            continue_execution = SkipSlot<IS_DICT_ENCODED>();
+          } else if (MODE == SET_REJECTED && IS_DICT_ENCODED) {
+            continue_execution = ReadDictFilteredSlot(
+                tuple->GetSlot(tuple_offset_), &rejected[val_count]);
+          } else {
+            continue_execution =
+                ReadSlot<IS_DICT_ENCODED>(tuple->GetSlot(tuple_offset_), pool);
+          }
           if (UNLIKELY(!continue_execution)) break;
         } else {
           tuple->SetNull(null_indicator_offset_);
+          if (MODE == SET_REJECTED) rejected[val_count] |= !dict_filter_null_pass_;
         }
       }
 
@@ -880,6 +1241,72 @@ class HdfsParquetScanner::ScalarColumnReader :
     return true;
   }
 
+  /// Same as MaterializeValueBatch<false, IS_DICT_ENCODED, IGNORE_REJECTED>() for values
+  /// that need no conversion, but decodes each run of non-NULL values in the def level
+  /// cache in bulk instead of value by value. With dictionary encoding the indices of
+  /// the run are decoded at once, otherwise IsPlainEncodingNative<T> must hold and the
+  /// values are copied straight from the page.
+  template<bool IS_DICT_ENCODED>
+  bool MaterializeFlatValueBatch(int max_values, int tuple_size, uint8_t* tuple_mem,
+      int* num_values) {
+    DCHECK(MATERIALIZED);
+    DCHECK(!NeedsConversion());
+    DCHECK_GT(num_buffered_values_, 0);
+    DCHECK(def_levels_.CacheHasNext());
+
+    uint8_t* curr_tuple = tuple_mem;
+    int val_count = 0;
+    while (def_levels_.CacheHasNext() && val_count < max_values) {
+      int max_run_length = min(def_levels_.CacheRemaining(), max_values - val_count);
+      int run_length = def_levels_.CacheRunLength(max_def_level(), max_run_length);
+      if (run_length == 0) {
+        def_levels_.CacheGetNext();
+        reinterpret_cast<Tuple*>(curr_tuple)->SetNull(null_indicator_offset_);
+        curr_tuple += tuple_size;
+        ++val_count;
+        continue;
+      }
+      if (UNLIKELY(!DecodeValueRun<IS_DICT_ENCODED>(run_length, tuple_size, curr_tuple))) {
+        *num_values = val_count;
+        return false;
+      }
+      def_levels_.CacheSkipLevels(run_length);
+      curr_tuple += run_length * tuple_size;
+      val_count += run_length;
+    }
+    *num_values = val_count;
+    return true;
+  }
+
+  /// Decodes the next 'num_values' non-NULL values into the slots of the consecutive
+  /// tuples starting at 'tuple_mem'. Returns false if the values could not be decoded.
+  template<bool IS_DICT_ENCODED>
+  inline bool DecodeValueRun(int num_values, int tuple_size, uint8_t* tuple_mem) {
+    uint8_t* slot = tuple_mem + tuple_offset_;
+    if (IS_DICT_ENCODED) {
+      DCHECK_EQ(page_encoding_, parquet::Encoding::PLAIN_DICTIONARY);
+      if (dict_indices_.size() < num_values) dict_indices_.resize(num_values);
+      int* indices = dict_indices_.data();
+      if (UNLIKELY(!dict_decoder_.GetIndices(indices, num_values))) {
+        SetDictDecodeError();
+        return false;
+      }
+      for (int i = 0; i < num_values; ++i) {
+        dict_decoder_.GetEntry(indices[i], reinterpret_cast<T*>(slot));
+        slot += tuple_size;
+      }
+    } else {
+      DCHECK_EQ(page_encoding_, parquet::Encoding::PLAIN);
+      DCHECK(IsPlainEncodingNative<T>::value);
+      for (int i = 0; i < num_values; ++i) {
+        memcpy(slot, data_, sizeof(T));
+        data_ += sizeof(T);
+        slot += tuple_size;
+      }
+    }
+    return true;
+  }
+
   virtual DictDecoderBase* CreateDictionaryDecoder(uint8_t* values, int size) {
     dict_decoder_.Reset(values, size, fixed_len_size_);
     dict_decoder_init_ = true;
@@ -894,6 +1321,62 @@ class HdfsParquetScanner::ScalarColumnReader :
     dict_decoder_init_ = false;
   }
 
+  virtual bool SupportsDictionaryFiltering() const {
+    // Converted values differ from the dictionary entries.
+    return MATERIALIZED && !needs_conversion_;
+  }
+
+  virtual bool SupportsSkippingRejected() const { return MATERIALIZED; }
+
+  virtual bool SupportsPageSkipping() const { return MATERIALIZED; }
+
+  virtual int EvalDictionaryFilter(const RuntimeFilter* filter) {
+    DCHECK(SupportsDictionaryFiltering());
+    DCHECK(dict_decoder_init_);
+    DCHECK_EQ(max_rep_level(), 0);
+    const ColumnType& type = slot_desc_->type();
+    int num_entries = dict_decoder_.num_entries();
+    StartDictFiltering(num_entries);
+    int num_passed = 0;
+    for (int i = 0; i < num_entries; ++i) {
+      if (!dict_filter_pass_[i]) continue;
+      T val;
+      dict_decoder_.GetEntry(i, &val);
+      dict_filter_pass_[i] = filter->Eval<void>(&val, type);
+      num_passed += dict_filter_pass_[i];
+    }
+    dict_filter_null_pass_ &= filter->Eval<void>(NULL, type);
+    return num_passed;
+  }
+
+  virtual int EvalDictionaryConjunct(ExprContext* ctx, Tuple* tuple, int* num_evals) {
+    DCHECK(SupportsDictionaryFiltering());
+    DCHECK(dict_decoder_init_);
+    DCHECK_EQ(max_rep_level(), 0);
+    int num_entries = dict_decoder_.num_entries();
+    StartDictFiltering(num_entries);
+    TupleRow* row = reinterpret_cast<TupleRow*>(&tuple);
+    T* slot = reinterpret_cast<T*>(tuple->GetSlot(slot_desc_->tuple_offset()));
+    const NullIndicatorOffset& null_offset = slot_desc_->null_indicator_offset();
+    tuple->SetNotNull(null_offset);
+    *num_evals = 0;
+    int num_passed = 0;
+    for (int i = 0; i < num_entries; ++i) {
+      if (!dict_filter_pass_[i]) continue;
+      dict_decoder_.GetEntry(i, slot);
+      dict_filter_pass_[i] = ExecNode::EvalConjuncts(&ctx, 1, row);
+      num_passed += dict_filter_pass_[i];
+      ++*num_evals;
+    }
+    // A slot that is not nullable never holds NULL.
+    if (slot_desc_->is_nullable() && dict_filter_null_pass_) {
+      tuple->SetNull(null_offset);
+      dict_filter_null_pass_ = ExecNode::EvalConjuncts(&ctx, 1, row);
+      ++*num_evals;
+    }
+    return num_passed;
+  }
+
   virtual Status InitDataPage(uint8_t* data, int size) {
     page_encoding_ = current_page_header_.data_page_header.encoding;
     if (page_encoding_ != parquet::Encoding::PLAIN_DICTIONARY &&
@@ -944,6 +1427,40 @@ class HdfsParquetScanner::ScalarColumnReader :
     return true;
   }
 
+  /// Same as ReadSlot<true>() for readers that filter by dictionary index. Sets *rejected
+  /// if the value's dictionary entry did not pass the dictionary filters.
+  inline bool ReadDictFilteredSlot(void* slot, uint8_t* rejected) {
+    DCHECK_EQ(page_encoding_, parquet::Encoding::PLAIN_DICTIONARY);
+    DCHECK(!needs_conversion_);
+    int index;
+    if (UNLIKELY(!dict_decoder_.GetIndex(&index))) {
+      SetDictDecodeError();
+      return false;
+    }
+    dict_decoder_.GetEntry(index, reinterpret_cast<T*>(slot));
+    *rejected |= !dict_filter_pass_[index];
+    return true;
+  }
+
+  /// Advances past the next value without materializing it. Also skips any conversion.
+  /// Returns false if the value could not be decoded.
+  template<bool IS_DICT_ENCODED>
+  inline bool SkipSlot() {
+    if (IS_DICT_ENCODED) {
+      DCHECK_EQ(page_encoding_, parquet::Encoding::PLAIN_DICTIONARY);
+      int index;
+      if (UNLIKELY(!dict_decoder_.GetIndex(&index))) {
+        SetDictDecodeError();
+        return false;
+      }
+    } else {
+      DCHECK_EQ(page_encoding_, parquet::Encoding::PLAIN);
+      T val;
+      data_ += ParquetPlainEncoder::Decode<T>(data_, fixed_len_size_, &val);
+    }
+    return true;
+  }
+
   /// Most column readers never require conversion, so we can avoid branches by
   /// returning constant false. Column readers for types that require conversion
   /// must specialize this function.
@@ -970,6 +1487,9 @@ class HdfsParquetScanner::ScalarColumnReader :
   /// True if dict_decoder_ has been initialized with a dictionary page.
   bool dict_decoder_init_;
 
+  /// Buffer for the dictionary indices decoded by DecodeValueRun().
+  vector<int> dict_indices_;
+
   /// true if decoded values must be converted before being written to an output tuple.
   bool needs_conversion_;
 
@@ -1113,6 +1633,24 @@ Status HdfsParquetScanner::Prepare(ScannerContext* context) {
       ADD_COUNTER(scan_node_->runtime_profile(), "NumColumns", TUnit::UNIT);
   num_row_groups_counter_ =
       ADD_COUNTER(scan_node_->runtime_profile(), "NumRowGroups", TUnit::UNIT);
+  num_row_groups_filtered_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumRowGroupsFilteredByMinMax", TUnit::UNIT);
+  num_row_groups_dict_filtered_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumRowGroupsFilteredByDictionary", TUnit::UNIT);
+  num_dict_conjunct_evals_saved_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumConjunctEvalsSavedByDictionary", TUnit::UNIT);
+  num_pages_skipped_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumDataPagesSkipped", TUnit::UNIT);
+  num_row_groups_skipped_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumRowGroupsSkipped", TUnit::UNIT);
+  bytes_skipped_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "BytesSkipped", TUnit::BYTES);
+  num_row_groups_bloom_filtered_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumRowGroupsFilteredByBloomFilter", TUnit::UNIT);
+  num_pages_prefetched_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumDataPagesDecompressedInParallel", TUnit::UNIT);
+  num_cached_col_chunks_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumColumnChunksReadFromPageCache", TUnit::UNIT);
 
   scan_node_->IncNumScannersCodegenDisabled();
 
@@ -1154,6 +1692,16 @@ void HdfsParquetScanner::Close() {
     scalar_reader->Close();
     compression_types.push_back(scalar_reader->codec());
   }
+  // The column readers waited for their prefetched pages above.
+  if (decompression_pool_.get() != NULL) {
+    decompression_pool_->Shutdown();
+    decompression_pool_->Join();
+    decompression_pool_.reset();
+    for (int i = 0; i < num_decompression_threads_; ++i) {
+      state_->resource_pool()->ReleaseThreadToken(false);
+    }
+    num_decompression_threads_ = 0;
+  }
   if (batch_ != NULL) {
     AttachPool(dictionary_pool_.get(), false);
     AttachPool(scratch_batch_->mem_pool(), false);
@@ -1179,6 +1727,7 @@ void HdfsParquetScanner::Close() {
     const LocalFilterStats& local = filter_stats_[i];
     stats->IncrCounters(FilterStats::ROWS_KEY, local.total_possible,
         local.considered, local.rejected);
+    if (!local.enabled) stats->IncrDisabled();
   }
 
   HdfsScanner::Close();
@@ -1267,6 +1816,17 @@ bool HdfsParquetScanner::ColumnReader::ReadValueBatch(MemPool* pool, int max_val
   return continue_execution;
 }
 
+bool HdfsParquetScanner::ColumnReader::ReadCollectionValueBatch(MemPool* pool,
+    int num_values, int tuple_size, uint8_t* tuple_mem) {
+  for (int i = 0; i < num_values; ++i) {
+    FILE_CHECK_GE(def_level_, def_level_of_immediate_repeated_ancestor());
+    Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size);
+    if (pos_slot_desc_ != NULL) ReadPosition(tuple);
+    if (UNLIKELY(!ReadValue(pool, tuple))) return false;
+  }
+  return true;
+}
+
 bool HdfsParquetScanner::ColumnReader::ReadNonRepeatedValueBatch(MemPool* pool,
     int max_values, int tuple_size, uint8_t* tuple_mem, int* num_values) {
   int val_count = 0;
@@ -1301,9 +1861,249 @@ static bool RequiresSkippedDictionaryHeaderCheck(
   return v.VersionEq(1,1,0) || (v.VersionEq(1,2,0) && v.is_impala_internal);
 }
 
+namespace {
+
+/// Decodes the plain-encoded statistics value 'stat' of a column with physical type
+/// 'type'. Returns false if 'type' is not an integer type or 'stat' is malformed.
+bool DecodeIntStatistic(parquet::Type::type type, const string& stat, int64_t* val) {
+  if (type == parquet::Type::INT32 && stat.size() == sizeof(int32_t)) {
+    int32_t v;
+    memcpy(&v, stat.data(), sizeof(v));
+    *val = v;
+    return true;
+  }
+  if (type == parquet::Type::INT64 && stat.size() == sizeof(int64_t)) {
+    memcpy(val, stat.data(), sizeof(*val));
+    return true;
+  }
+  return false;
+}
+
+}
+
+Status HdfsParquetScanner::BaseScalarColumnReader::PeekPageHeader(
+    uint32_t* header_size, bool* eos) {
+  *eos = false;
+  if (cached_chunk_.get() != NULL) {
+    if (next_cached_page_ == cached_chunk_->pages.size()) {
+      *eos = true;
+    } else {
+      current_page_header_ = cached_chunk_->pages[next_cached_page_].header;
+      *header_size = 0;
+    }
+    return Status::OK();
+  }
+
+  uint8_t* buffer;
+  int64_t buffer_size;
+  RETURN_IF_ERROR(stream_->GetBuffer(true, &buffer, &buffer_size));
+  if (buffer_size == 0) {
+    DCHECK(stream_->eosr());
+    *eos = true;
+    return Status::OK();
+  }
+
+  // We don't know the actual header size until the thrift object is deserialized.  Loop
+  // until we successfully deserialize the header or exceed the maximum header size.
+  while (true) {
+    *header_size = buffer_size;
+    Status status = DeserializeThriftMsg(
+        buffer, header_size, true, &current_page_header_);
+    if (status.ok()) break;
+
+    if (buffer_size >= FLAGS_max_page_header_size) {
+      stringstream ss;
+      ss << "ParquetScanner: could not read data page because page header exceeded "
+         << "maximum size of "
+         << PrettyPrinter::Print(FLAGS_max_page_header_size, TUnit::BYTES);
+      status.AddDetail(ss.str());
+      return status;
+    }
+
+    // Didn't read entire header, increase buffer size and try again
+    Status read_status;
+    int64_t new_buffer_size = max<int64_t>(buffer_size * 2, 1024);
+    bool success = stream_->GetBytes(
+        new_buffer_size, &buffer, &new_buffer_size, &read_status, /* peek */ true);
+    if (!success) {
+      DCHECK(!read_status.ok());
+      return read_status;
+    }
+    DCHECK(read_status.ok());
+
+    if (buffer_size == new_buffer_size) {
+      DCHECK_NE(new_buffer_size, 0);
+      return Status(TErrorCode::PARQUET_HEADER_EOF, filename());
+    }
+    DCHECK_GT(new_buffer_size, buffer_size);
+    buffer_size = new_buffer_size;
+  }
+  return Status::OK();
+}
+
+Status HdfsParquetScanner::BaseScalarColumnReader::ConsumePageHeader(
+    uint32_t header_size) {
+  if (cached_chunk_.get() != NULL) return Status::OK();
+  Status status;
+  if (!stream_->SkipBytes(header_size, &status)) return status;
+  return Status::OK();
+}
+
+Status HdfsParquetScanner::BaseScalarColumnReader::SkipPageContents(int size) {
+  if (cached_chunk_.get() != NULL) {
+    DCHECK_LT(next_cached_page_, cached_chunk_->pages.size());
+    ++next_cached_page_;
+    return Status::OK();
+  }
+  Status status;
+  if (!stream_->SkipBytes(size, &status)) return status;
+  return Status::OK();
+}
+
+Status HdfsParquetScanner::BaseScalarColumnReader::ReadCachedPageContents(
+    MemPool* pool, int* data_size) {
+  DCHECK_LT(next_cached_page_, cached_chunk_->pages.size());
+  const string& contents = cached_chunk_->pages[next_cached_page_].data;
+  *data_size = contents.size();
+  data_ = pool->TryAllocate(*data_size);
+  if (UNLIKELY(data_ == NULL)) {
+    string details = Substitute(PARQUET_MEM_LIMIT_EXCEEDED, "ReadCachedPageContents",
+        *data_size, "cached page");
+    return pool->mem_tracker()->MemLimitExceeded(parent_->state_, details, *data_size);
+  }
+  memcpy(data_, contents.data(), *data_size);
+  ++next_cached_page_;
+  return Status::OK();
+}
+
+void HdfsParquetScanner::BaseScalarColumnReader::AddPageToNewCachedChunk(
+    const uint8_t* data, int size) {
+  if (new_cached_chunk_.get() == NULL) return;
+  if (!new_cached_chunk_->mem_tracker->TryConsume(size)) {
+    // Give up on caching this chunk, which releases the pages collected so far.
+    new_cached_chunk_.reset();
+    return;
+  }
+  new_cached_chunk_->bytes += size;
+  new_cached_chunk_->pages.push_back(CachedColumnChunk::Page());
+  CachedColumnChunk::Page* page = &new_cached_chunk_->pages.back();
+  page->header = current_page_header_;
+  page->data.assign(reinterpret_cast<const char*>(data), size);
+}
+
+Status HdfsParquetScanner::BaseScalarColumnReader::ReadDictionaryPage() {
+  DCHECK_EQ(current_page_header_.type, parquet::PageType::DICTIONARY_PAGE);
+  Status status;
+  int data_size = current_page_header_.compressed_page_size;
+  int uncompressed_size = current_page_header_.uncompressed_page_size;
+
+  if (slot_desc_ == NULL) {
+    // Skip processing the dictionary page if we don't need to decode any values. In
+    // addition to being unnecessary, we are likely unable to successfully decode the
+    // dictionary values because we don't necessarily create the right type of scalar
+    // reader if there's no slot to read into (see CreateReader()).
+    // The chunk is not cached, since the dictionary is not decompressed.
+    new_cached_chunk_.reset();
+    return SkipPageContents(data_size);
+  }
+
+  if (HasDictionaryDecoder()) {
+    return Status("Column chunk should not contain two dictionary pages.");
+  }
+  if (node_.element->type == parquet::Type::BOOLEAN) {
+    return Status("Unexpected dictionary page. Dictionary page is not"
+        " supported for booleans.");
+  }
+  const parquet::DictionaryPageHeader* dict_header = NULL;
+  if (current_page_header_.__isset.dictionary_page_header) {
+    dict_header = &current_page_header_.dictionary_page_header;
+  } else {
+    if (!RequiresSkippedDictionaryHeaderCheck(parent_->file_version_)) {
+      return Status("Dictionary page does not have dictionary header set.");
+    }
+  }
+  if (dict_header != NULL &&
+      dict_header->encoding != parquet::Encoding::PLAIN &&
+      dict_header->encoding != parquet::Encoding::PLAIN_DICTIONARY) {
+    return Status("Only PLAIN and PLAIN_DICTIONARY encodings are supported "
+        "for dictionary pages.");
+  }
+
+  uint8_t* dict_values = NULL;
+  if (cached_chunk_.get() != NULL) {
+    RETURN_IF_ERROR(ReadCachedPageContents(parent_->dictionary_pool_.get(), &data_size));
+    dict_values = data_;
+  } else if (!stream_->ReadBytes(data_size, &data_, &status)) {
+    return status;
+  } else if (decompressor_.get() != NULL) {
+    dict_values = parent_->dictionary_pool_->TryAllocate(uncompressed_size);
+    if (UNLIKELY(dict_values == NULL)) {
+      string details = Substitute(PARQUET_MEM_LIMIT_EXCEEDED, "ReadDictionaryPage",
+          uncompressed_size, "dictionary");
+      return parent_->dictionary_pool_->mem_tracker()->MemLimitExceeded(
+          parent_->state_, details, uncompressed_size);
+    }
+    RETURN_IF_ERROR(decompressor_->ProcessBlock32(true, data_size, data_,
+        &uncompressed_size, &dict_values));
+    VLOG_FILE << "Decompressed " << data_size << " to " << uncompressed_size;
+    data_size = uncompressed_size;
+  } else {
+    FILE_CHECK_EQ(data_size, current_page_header_.uncompressed_page_size);
+    // Copy dictionary from io buffer (which will be recycled as we read
+    // more data) to a new buffer
+    dict_values = parent_->dictionary_pool_->TryAllocate(data_size);
+    if (UNLIKELY(dict_values == NULL)) {
+      string details = Substitute(PARQUET_MEM_LIMIT_EXCEEDED, "ReadDictionaryPage",
+          data_size, "dictionary");
+      return parent_->dictionary_pool_->mem_tracker()->MemLimitExceeded(
+          parent_->state_, details, data_size);
+    }
+    memcpy(dict_values, data_, data_size);
+  }
+  AddPageToNewCachedChunk(dict_values, data_size);
+
+  DictDecoderBase* dict_decoder = CreateDictionaryDecoder(dict_values, data_size);
+  if (dict_header != NULL &&
+      dict_header->num_values != dict_decoder->num_entries()) {
+    return Status(Substitute(
+        "Invalid dictionary. Expected $0 entries but data contained $1 entries",
+        dict_header->num_values, dict_decoder->num_entries()));
+  }
+  return Status::OK();
+}
+
+Status HdfsParquetScanner::BaseScalarColumnReader::InitDictionary() {
+  DCHECK_EQ(num_values_read_, 0);
+  if (HasDictionaryDecoder()) return Status::OK();
+  uint32_t header_size;
+  bool eos;
+  RETURN_IF_ERROR(PeekPageHeader(&header_size, &eos));
+  // Leave any other first page, and the error reporting for a missing one, to
+  // ReadDataPage().
+  if (eos || current_page_header_.type != parquet::PageType::DICTIONARY_PAGE) {
+    return Status::OK();
+  }
+  RETURN_IF_ERROR(ConsumePageHeader(header_size));
+  return ReadDictionaryPage();
+}
+
+bool HdfsParquetScanner::BaseScalarColumnReader::PagePassesMinMaxConjuncts() const {
+  const parquet::DataPageHeader& header = current_page_header_.data_page_header;
+  if (!header.__isset.statistics) return true;
+  const parquet::Statistics& stats = header.statistics;
+  if (!stats.__isset.min || !stats.__isset.max) return true;
+  int64_t min_val, max_val;
+  if (!DecodeIntStatistic(node_.element->type, stats.min, &min_val)) return true;
+  if (!DecodeIntStatistic(node_.element->type, stats.max, &max_val)) return true;
+  for (const MinMaxConjunct* conjunct: page_conjuncts_) {
+    if (!conjunct->MayPass(min_val, max_val)) return false;
+  }
+  return true;
+}
+
 Status HdfsParquetScanner::BaseScalarColumnReader::ReadDataPage() {
   Status status;
-  uint8_t* buffer;
+  page_skipped_ = false;
 
   // We're about to move to the next data page.  The previous data page is
   // now complete, pass along the memory allocated for it.
@@ -1314,9 +2114,17 @@ Status HdfsParquetScanner::BaseScalarColumnReader::ReadDataPage() {
   // the pages).
   while (true) {
     DCHECK_EQ(num_buffered_values_, 0);
+    if (prefetch_pending_) {
+      RETURN_IF_ERROR(InitPrefetchedPage());
+      break;
+    }
     if (num_values_read_ == metadata_->num_values) {
       // No more pages to read
       // TODO: should we check for stream_->eosr()?
+      if (new_cached_chunk_.get() != NULL) {
+        AddToPageCache(cache_key_, new_cached_chunk_);
+        new_cached_chunk_.reset();
+      }
       break;
     } else if (num_values_read_ > metadata_->num_values) {
       ErrorMsg msg(TErrorCode::PARQUET_COLUMN_METADATA_INVALID,
@@ -1325,11 +2133,11 @@ Status HdfsParquetScanner::BaseScalarColumnReader::ReadDataPage() {
       return Status::OK();
     }
 
-    int64_t buffer_size;
-    RETURN_IF_ERROR(stream_->GetBuffer(true, &buffer, &buffer_size));
-    if (buffer_size == 0) {
+    uint32_t header_size;
+    bool eos;
+    RETURN_IF_ERROR(PeekPageHeader(&header_size, &eos));
+    if (eos) {
       // The data pages contain fewer values than stated in the column metadata.
-      DCHECK(stream_->eosr());
       DCHECK_LT(num_values_read_, metadata_->num_values);
       // TODO for 2.3: node_.element->name isn't necessarily useful
       ErrorMsg msg(TErrorCode::PARQUET_COLUMN_METADATA_INVALID,
@@ -1338,135 +2146,49 @@ Status HdfsParquetScanner::BaseScalarColumnReader::ReadDataPage() {
       return Status::OK();
     }
 
-    // We don't know the actual header size until the thrift object is deserialized.  Loop
-    // until we successfully deserialize the header or exceed the maximum header size.
-    uint32_t header_size;
-    while (true) {
-      header_size = buffer_size;
-      status = DeserializeThriftMsg(
-          buffer, &header_size, true, &current_page_header_);
-      if (status.ok()) break;
-
-      if (buffer_size >= FLAGS_max_page_header_size) {
-        stringstream ss;
-        ss << "ParquetScanner: could not read data page because page header exceeded "
-           << "maximum size of "
-           << PrettyPrinter::Print(FLAGS_max_page_header_size, TUnit::BYTES);
-        status.AddDetail(ss.str());
-        return status;
-      }
-
-      // Didn't read entire header, increase buffer size and try again
-      Status status;
-      int64_t new_buffer_size = max<int64_t>(buffer_size * 2, 1024);
-      bool success = stream_->GetBytes(
-          new_buffer_size, &buffer, &new_buffer_size, &status, /* peek */ true);
-      if (!success) {
-        DCHECK(!status.ok());
-        return status;
-      }
-      DCHECK(status.ok());
-
-      if (buffer_size == new_buffer_size) {
-        DCHECK_NE(new_buffer_size, 0);
-        return Status(TErrorCode::PARQUET_HEADER_EOF, filename());
-      }
-      DCHECK_GT(new_buffer_size, buffer_size);
-      buffer_size = new_buffer_size;
-    }
-
     // Successfully deserialized current_page_header_
-    if (!stream_->SkipBytes(header_size, &status)) return status;
+    RETURN_IF_ERROR(ConsumePageHeader(header_size));
 
     int data_size = current_page_header_.compressed_page_size;
     int uncompressed_size = current_page_header_.uncompressed_page_size;
 
     if (current_page_header_.type == parquet::PageType::DICTIONARY_PAGE) {
-      if (slot_desc_ == NULL) {
-        // Skip processing the dictionary page if we don't need to decode any values. In
-        // addition to being unnecessary, we are likely unable to successfully decode the
-        // dictionary values because we don't necessarily create the right type of scalar
-        // reader if there's no slot to read into (see CreateReader()).
-        if (!stream_->ReadBytes(data_size, &data_, &status)) return status;
-        continue;
-      }
-
-      if (HasDictionaryDecoder()) {
-        return Status("Column chunk should not contain two dictionary pages.");
-      }
-      if (node_.element->type == parquet::Type::BOOLEAN) {
-        return Status("Unexpected dictionary page. Dictionary page is not"
-            " supported for booleans.");
-      }
-      const parquet::DictionaryPageHeader* dict_header = NULL;
-      if (current_page_header_.__isset.dictionary_page_header) {
-        dict_header = &current_page_header_.dictionary_page_header;
-      } else {
-        if (!RequiresSkippedDictionaryHeaderCheck(parent_->file_version_)) {
-          return Status("Dictionary page does not have dictionary header set.");
-        }
-      }
-      if (dict_header != NULL &&
-          dict_header->encoding != parquet::Encoding::PLAIN &&
-          dict_header->encoding != parquet::Encoding::PLAIN_DICTIONARY) {
-        return Status("Only PLAIN and PLAIN_DICTIONARY encodings are supported "
-            "for dictionary pages.");
-      }
-
-      if (!stream_->ReadBytes(data_size, &data_, &status)) return status;
-
-      uint8_t* dict_values = NULL;
-      if (decompressor_.get() != NULL) {
-        dict_values = parent_->dictionary_pool_->TryAllocate(uncompressed_size);
-        if (UNLIKELY(dict_values == NULL)) {
-          string details = Substitute(PARQUET_MEM_LIMIT_EXCEEDED, "ReadDataPage",
-              uncompressed_size, "dictionary");
-          return parent_->dictionary_pool_->mem_tracker()->MemLimitExceeded(
-              parent_->state_, details, uncompressed_size);
-        }
-        RETURN_IF_ERROR(decompressor_->ProcessBlock32(true, data_size, data_,
-            &uncompressed_size, &dict_values));
-        VLOG_FILE << "Decompressed " << data_size << " to " << uncompressed_size;
-        data_size = uncompressed_size;
-      } else {
-        FILE_CHECK_EQ(data_size, current_page_header_.uncompressed_page_size);
-        // Copy dictionary from io buffer (which will be recycled as we read
-        // more data) to a new buffer
-        dict_values = parent_->dictionary_pool_->TryAllocate(data_size);
-        if (UNLIKELY(dict_values == NULL)) {
-          string details = Substitute(PARQUET_MEM_LIMIT_EXCEEDED, "ReadDataPage",
-              data_size, "dictionary");
-          return parent_->dictionary_pool_->mem_tracker()->MemLimitExceeded(
-              parent_->state_, details, data_size);
-        }
-        memcpy(dict_values, data_, data_size);
-      }
-
-      DictDecoderBase* dict_decoder = CreateDictionaryDecoder(dict_values, data_size);
-      if (dict_header != NULL &&
-          dict_header->num_values != dict_decoder->num_entries()) {
-        return Status(Substitute(
-            "Invalid dictionary. Expected $0 entries but data contained $1 entries",
-            dict_header->num_values, dict_decoder->num_entries()));
-      }
+      RETURN_IF_ERROR(ReadDictionaryPage());
       // Done with dictionary page, read next page
       continue;
     }
 
     if (current_page_header_.type != parquet::PageType::DATA_PAGE) {
       // We can safely skip non-data pages
-      if (!stream_->SkipBytes(data_size, &status)) return status;
+      RETURN_IF_ERROR(SkipPageContents(data_size));
       continue;
     }
 
+    // Only integer statistics are used, which are not affected by the corrupt string
+    // statistics of some writers (see IMPALA-2208 and PARQUET-251).
+    if (!page_conjuncts_.empty() && !PagePassesMinMaxConjuncts()) {
+      RETURN_IF_ERROR(SkipPageContents(data_size));
+      new_cached_chunk_.reset();
+      num_buffered_values_ = current_page_header_.data_page_header.num_values;
+      num_values_read_ += num_buffered_values_;
+      page_skipped_ = true;
+      COUNTER_ADD(parent_->num_pages_skipped_counter_, 1);
+      break;
+    }
+
     // Read Data Page
-    // TODO: when we start using page statistics, we will need to ignore certain corrupt
-    // statistics. See IMPALA-2208 and PARQUET-251.
-    if (!stream_->ReadBytes(data_size, &data_, &status)) return status;
+    if (cached_chunk_.get() != NULL) {
+      RETURN_IF_ERROR(ReadCachedPageContents(decompressed_data_pool_.get(), &data_size));
+    } else if (!stream_->ReadBytes(data_size, &data_, &status)) {
+      return status;
+    }
     num_buffered_values_ = current_page_header_.data_page_header.num_values;
     num_values_read_ += num_buffered_values_;
 
-    if (decompressor_.get() != NULL) {
+    if (cached_chunk_.get() != NULL) {
+      // The cached contents are already decompressed.
+      DCHECK_EQ(data_size, uncompressed_size);
+    } else if (decompressor_.get() != NULL) {
       SCOPED_TIMER(parent_->decompress_timer_);
       uint8_t* decompressed_buffer =
           decompressed_data_pool_->TryAllocate(uncompressed_size);
@@ -1488,38 +2210,137 @@ Status HdfsParquetScanner::BaseScalarColumnReader::ReadDataPage() {
       DCHECK_EQ(metadata_->codec, parquet::CompressionCodec::UNCOMPRESSED);
       FILE_CHECK_EQ(current_page_header_.compressed_page_size, uncompressed_size);
     }
-
-    // Initialize the repetition level data
-    RETURN_IF_ERROR(rep_levels_.Init(filename(),
-        current_page_header_.data_page_header.repetition_level_encoding,
-        parent_->level_cache_pool_.get(), parent_->state_->batch_size(),
-        max_rep_level(), num_buffered_values_,
-        &data_, &data_size));
-
-    // Initialize the definition level data
-    RETURN_IF_ERROR(def_levels_.Init(filename(),
-        current_page_header_.data_page_header.definition_level_encoding,
-        parent_->level_cache_pool_.get(), parent_->state_->batch_size(),
-        max_def_level(), num_buffered_values_, &data_, &data_size));
-
-    // Data can be empty if the column contains all NULLs
-    if (data_size != 0) RETURN_IF_ERROR(InitDataPage(data_, data_size));
+    AddPageToNewCachedChunk(data_, data_size);
+    RETURN_IF_ERROR(InitDataPageContents(data_size));
     break;
   }
 
+  // Decompress the next page while this one is decoded.
+  PrefetchNextPage();
   return Status::OK();
 }
 
-Status HdfsParquetScanner::LevelDecoder::Init(const string& filename,
-    parquet::Encoding::type encoding, MemPool* cache_pool, int cache_size,
-    int max_level, int num_buffered_values, uint8_t** data, int* data_size) {
-  encoding_ = encoding;
-  max_level_ = max_level;
-  num_buffered_values_ = num_buffered_values;
-  filename_ = filename;
-  RETURN_IF_ERROR(InitCache(cache_pool, cache_size));
+Status HdfsParquetScanner::BaseScalarColumnReader::InitDataPageContents(int data_size) {
+  // Initialize the repetition level data
+  RETURN_IF_ERROR(rep_levels_.Init(filename(),
+      current_page_header_.data_page_header.repetition_level_encoding,
+      parent_->level_cache_pool_.get(), parent_->state_->batch_size(),
+      max_rep_level(), num_buffered_values_,
+      &data_, &data_size));
+
+  // Initialize the definition level data
+  RETURN_IF_ERROR(def_levels_.Init(filename(),
+      current_page_header_.data_page_header.definition_level_encoding,
+      parent_->level_cache_pool_.get(), parent_->state_->batch_size(),
+      max_def_level(), num_buffered_values_, &data_, &data_size));
+
+  // Data can be empty if the column contains all NULLs
+  if (data_size != 0) RETURN_IF_ERROR(InitDataPage(data_, data_size));
+  return Status::OK();
+}
 
-  // Return because there is no level data to read, e.g., required field.
+void HdfsParquetScanner::BaseScalarColumnReader::PrefetchNextPage() {
+  DCHECK(!prefetch_pending_);
+  if (parent_->decompression_pool_.get() == NULL || decompressor_.get() == NULL) return;
+  if (cached_chunk_.get() != NULL) return;
+  if (num_values_read_ >= metadata_->num_values) return;
+
+  // Any error is returned when ReadDataPage() reads the header again.
+  uint32_t header_size;
+  bool eos;
+  if (!PeekPageHeader(&header_size, &eos).ok() || eos) return;
+  if (current_page_header_.type != parquet::PageType::DATA_PAGE) return;
+  if (!page_conjuncts_.empty() && !PagePassesMinMaxConjuncts()) return;
+
+  int compressed_size = current_page_header_.compressed_page_size;
+  int uncompressed_size = current_page_header_.uncompressed_page_size;
+  if (compressed_size < 0 || uncompressed_size < 0) return;
+  // The compressed bytes are copied so that they outlive the I/O buffers of the stream.
+  uint8_t* buffer = prefetch_pool_->TryAllocate(compressed_size + uncompressed_size);
+  if (buffer == NULL) return;
+
+  if (prefetched_page_.get() == NULL) prefetched_page_.reset(new PrefetchedPage());
+  PrefetchedPage* page = prefetched_page_.get();
+  page->decompressor = decompressor_.get();
+  page->decompress_timer = parent_->decompress_timer_;
+  page->compressed_data = buffer;
+  page->compressed_size = compressed_size;
+  page->decompressed_data = buffer + compressed_size;
+  page->uncompressed_size = uncompressed_size;
+  page->status = Status::OK();
+  page->done = false;
+  prefetch_pending_ = true;
+
+  // The header is consumed, so from here on errors are returned with the page.
+  uint8_t* compressed_data;
+  if (!stream_->SkipBytes(header_size, &page->status) ||
+      !stream_->ReadBytes(compressed_size, &compressed_data, &page->status)) {
+    page->done = true;
+    return;
+  }
+  memcpy(buffer, compressed_data, compressed_size);
+  if (!parent_->decompression_pool_->Offer(page)) {
+    page->status = Status("Parquet decompression threads were shut down.");
+    page->done = true;
+  }
+}
+
+void HdfsParquetScanner::DecompressPage(int thread_id, PrefetchedPage* const& page) {
+  Status status;
+  {
+    SCOPED_TIMER(page->decompress_timer);
+    status = page->decompressor->ProcessBlock32(true, page->compressed_size,
+        page->compressed_data, &page->uncompressed_size, &page->decompressed_data);
+  }
+  boost::lock_guard<boost::mutex> l(page->lock);
+  page->status = status;
+  page->done = true;
+  page->done_cv.notify_one();
+}
+
+Status HdfsParquetScanner::BaseScalarColumnReader::InitPrefetchedPage() {
+  DCHECK(prefetch_pending_);
+  PrefetchedPage* page = prefetched_page_.get();
+  {
+    boost::unique_lock<boost::mutex> l(page->lock);
+    while (!page->done) page->done_cv.wait(l);
+  }
+  prefetch_pending_ = false;
+  // The buffers of the page are passed along with those of the current page.
+  decompressed_data_pool_->AcquireData(prefetch_pool_.get(), false);
+  RETURN_IF_ERROR(page->status);
+  COUNTER_ADD(parent_->num_pages_prefetched_counter_, 1);
+  VLOG_FILE << "Decompressed " << current_page_header_.compressed_page_size
+            << " to " << page->uncompressed_size;
+  FILE_CHECK_EQ(current_page_header_.uncompressed_page_size, page->uncompressed_size);
+  AddPageToNewCachedChunk(page->decompressed_data, page->uncompressed_size);
+
+  num_buffered_values_ = current_page_header_.data_page_header.num_values;
+  num_values_read_ += num_buffered_values_;
+  data_ = page->decompressed_data;
+  return InitDataPageContents(page->uncompressed_size);
+}
+
+void HdfsParquetScanner::BaseScalarColumnReader::DiscardPrefetchedPage() {
+  if (prefetch_pending_) {
+    PrefetchedPage* page = prefetched_page_.get();
+    boost::unique_lock<boost::mutex> l(page->lock);
+    while (!page->done) page->done_cv.wait(l);
+    prefetch_pending_ = false;
+  }
+  prefetch_pool_->FreeAll();
+}
+
+Status HdfsParquetScanner::LevelDecoder::Init(const string& filename,
+    parquet::Encoding::type encoding, MemPool* cache_pool, int cache_size,
+    int max_level, int num_buffered_values, uint8_t** data, int* data_size) {
+  encoding_ = encoding;
+  max_level_ = max_level;
+  num_buffered_values_ = num_buffered_values;
+  filename_ = filename;
+  RETURN_IF_ERROR(InitCache(cache_pool, cache_size));
+
+  // Return because there is no level data to read, e.g., required field.
   if (max_level == 0) return Status::OK();
 
   int32_t num_bytes = 0;
@@ -1643,21 +2464,42 @@ bool HdfsParquetScanner::BaseScalarColumnReader::NextLevels() {
   if (UNLIKELY(num_buffered_values_ == 0)) {
     if (!NextPage()) return parent_->parse_status_.ok();
   }
-  --num_buffered_values_;
-
-  // Definition level is not present if column and any containing structs are required.
-  def_level_ = max_def_level() == 0 ? 0 : def_levels_.ReadLevel();
+  // Only readers that use ReadValueBatch() skip pages.
+  DCHECK(!page_skipped_);
 
   if (ADVANCE_REP_LEVEL && max_rep_level() > 0) {
     // Repetition level is only present if this column is nested in any collection type.
-    rep_level_ = rep_levels_.ReadLevel();
+    // The values of collection items are read one at a time by AssembleCollection(),
+    // but their levels are decoded in batches, which also lets
+    // NumCollectionValuesAhead() find the end of the collection.
+    if (!def_levels_.CacheHasNext() && !CacheNextLevels()) return false;
+    --num_buffered_values_;
+    def_level_ = def_levels_.CacheGetNext();
+    rep_level_ = rep_levels_.CacheHasNext() ? rep_levels_.CacheGetNext() : INVALID_LEVEL;
     // Reset position counter if we are at the start of a new parent collection.
     if (rep_level_ <= max_rep_level() - 1) pos_current_value_ = 0;
+    return parent_->parse_status_.ok();
   }
 
+  --num_buffered_values_;
+  // Definition level is not present if column and any containing structs are required.
+  def_level_ = max_def_level() == 0 ? 0 : def_levels_.ReadLevel();
   return parent_->parse_status_.ok();
 }
 
+bool HdfsParquetScanner::BaseScalarColumnReader::CacheNextLevels() {
+  int level_batch_size = min(parent_->state_->batch_size(), num_buffered_values_);
+  parent_->parse_status_.MergeStatus(def_levels_.CacheNextBatch(level_batch_size));
+  parent_->parse_status_.MergeStatus(rep_levels_.CacheNextBatch(level_batch_size));
+  if (UNLIKELY(!parent_->parse_status_.ok())) return false;
+  if (UNLIKELY(!def_levels_.CacheHasNext())) {
+    parent_->parse_status_ = Status(TErrorCode::PARQUET_DEF_LEVEL_ERROR,
+        num_buffered_values_, filename());
+    return false;
+  }
+  return true;
+}
+
 bool HdfsParquetScanner::BaseScalarColumnReader::NextPage() {
   parent_->assemble_rows_timer_.Stop();
   parent_->parse_status_ = ReadDataPage();
@@ -1824,6 +2666,44 @@ int HdfsParquetScanner::CountScalarColumns(const vector<ColumnReader*>& column_r
   return num_columns;
 }
 
+void HdfsParquetScanner::StartDecompressionThreads() {
+  DCHECK(decompression_pool_.get() == NULL);
+  if (FLAGS_parquet_decompression_threads <= 0) return;
+  bool compressed = false;
+  for (const parquet::RowGroup& row_group: file_metadata_->row_groups) {
+    for (const parquet::ColumnChunk& col_chunk: row_group.columns) {
+      if (col_chunk.meta_data.codec != parquet::CompressionCodec::UNCOMPRESSED) {
+        compressed = true;
+      }
+    }
+  }
+  if (!compressed) return;
+
+  int num_scalar_cols = CountScalarColumns(column_readers_);
+  int max_threads = min(FLAGS_parquet_decompression_threads, num_scalar_cols);
+  while (num_decompression_threads_ < max_threads &&
+      state_->resource_pool()->TryAcquireThreadToken()) {
+    ++num_decompression_threads_;
+  }
+  if (num_decompression_threads_ == 0) return;
+  // At most one page per column is in flight, so Offer() never blocks.
+  decompression_pool_.reset(new ThreadPool<PrefetchedPage*>("parquet-scanner",
+      "parquet-decompression", num_decompression_threads_,
+      num_scalar_cols, &HdfsParquetScanner::DecompressPage));
+}
+
+Status HdfsParquetScanner::PrefetchFirstPages() {
+  if (decompression_pool_.get() == NULL) return Status::OK();
+  for (ColumnReader* col_reader: column_readers_) {
+    if (col_reader->IsCollectionReader()) continue;
+    BaseScalarColumnReader* scalar_reader =
+        static_cast<BaseScalarColumnReader*>(col_reader);
+    RETURN_IF_ERROR(scalar_reader->InitDictionary());
+    scalar_reader->PrefetchNextPage();
+  }
+  return Status::OK();
+}
+
 Status HdfsParquetScanner::ProcessSplit() {
   DCHECK(parse_status_.ok()) << "Invalid parse_status_" << parse_status_.GetDetail();
   // First process the file metadata in the footer
@@ -1839,14 +2719,42 @@ Status HdfsParquetScanner::ProcessSplit() {
   // Set top-level template tuple.
   template_tuple_ = template_tuple_map_[scan_node_->tuple_desc()];
 
+  // If none of the materialized columns are in this file, e.g. due to schema evolution,
+  // the only reader is a counting reader and every row is the template tuple. The rows
+  // of the row groups can then be counted from the footer instead of reading the
+  // counting reader's column. Rows that runtime filters apply to are still read.
+  bool count_from_metadata = column_readers_.size() == 1 &&
+      column_readers_[0]->slot_desc() == NULL && filter_ctxs_.empty();
+
+  // Find the column each runtime filter applies to, so that min/max filters can be
+  // tested against the row group statistics and filters can be evaluated on the column
+  // dictionaries.
+  filter_col_readers_.assign(filter_ctxs_.size(), NULL);
+  for (int i = 0; i < filter_ctxs_.size(); ++i) {
+    const Expr* root = filter_ctxs_[i]->expr->root();
+    if (!root->is_slotref()) continue;
+    SlotId slot_id = static_cast<const SlotRef*>(root)->slot_id();
+    for (ColumnReader* col_reader: column_readers_) {
+      if (col_reader->IsCollectionReader()) continue;
+      if (col_reader->slot_desc() == NULL) continue;
+      if (col_reader->slot_desc()->id() != slot_id) continue;
+      filter_col_readers_[i] = static_cast<BaseScalarColumnReader*>(col_reader);
+      break;
+    }
+  }
+  InitLateMaterialization();
+  InitStatisticsConjuncts();
+  InitDictionaryConjuncts();
+  StartDecompressionThreads();
+
   // The scanner-wide stream was used only to read the file footer.  Each column has added
   // its own stream.
   stream_ = NULL;
 
   // Iterate through each row group in the file and process any row groups that fall
   // within this split.
-  for (int i = 0; i < file_metadata_.row_groups.size(); ++i) {
-    const parquet::RowGroup& row_group = file_metadata_.row_groups[i];
+  for (int i = 0; i < file_metadata_->row_groups.size(); ++i) {
+    const parquet::RowGroup& row_group = file_metadata_->row_groups[i];
     if (row_group.num_rows == 0) continue;
 
     const DiskIoMgr::ScanRange* split_range =
@@ -1860,6 +2768,29 @@ Status HdfsParquetScanner::ProcessSplit() {
         row_group_mid_pos < split_offset + split_length)) continue;
     COUNTER_ADD(num_row_groups_counter_, 1);
 
+    if (count_from_metadata) {
+      RETURN_IF_ERROR(WriteTuplesFromMetadata(row_group.num_rows));
+      if (scan_node_->ReachedLimit() || context_->cancelled()) return Status::OK();
+      continue;
+    }
+
+    if (!RowGroupPassesMinMaxFilters(row_group)) {
+      COUNTER_ADD(num_row_groups_filtered_counter_, 1);
+      continue;
+    }
+    if (!RowGroupPassesStatistics(row_group)) {
+      COUNTER_ADD(num_row_groups_skipped_counter_, 1);
+      COUNTER_ADD(bytes_skipped_counter_, GetColumnChunksSize(row_group));
+      continue;
+    }
+    bool passes_bloom_filters;
+    RETURN_IF_ERROR(RowGroupPassesBloomFilters(row_group, &passes_bloom_filters));
+    if (!passes_bloom_filters) {
+      COUNTER_ADD(num_row_groups_bloom_filtered_counter_, 1);
+      COUNTER_ADD(bytes_skipped_counter_, GetColumnChunksSize(row_group));
+      continue;
+    }
+
     // Attach any resources and clear the streams before starting a new row group. These
     // streams could either be just the footer stream or streams for the previous row
     // group.
@@ -1869,6 +2800,17 @@ Status HdfsParquetScanner::ProcessSplit() {
 
     RETURN_IF_ERROR(InitColumns(i, column_readers_));
 
+    bool skip_row_group;
+    RETURN_IF_ERROR(EvalDictionaryFilters(row_group, &skip_row_group));
+    if (!skip_row_group) {
+      RETURN_IF_ERROR(EvalDictionaryConjuncts(row_group, &skip_row_group));
+    }
+    if (skip_row_group) {
+      COUNTER_ADD(num_row_groups_dict_filtered_counter_, 1);
+      continue;
+    }
+    RETURN_IF_ERROR(PrefetchFirstPages());
+
     assemble_rows_timer_.Start();
 
     // Prepare column readers for first read
@@ -1925,10 +2867,12 @@ int HdfsParquetScanner::TransferScratchTuples() {
   // never be empty.
   DCHECK_LT(batch_->num_rows(), batch_->capacity());
 
-  const bool has_filters = !filter_ctxs_.empty();
-  const bool has_conjuncts = !scanner_conjunct_ctxs_->empty();
-  ExprContext* const* conjunct_ctxs = &(*scanner_conjunct_ctxs_)[0];
-  const int num_conjuncts = scanner_conjunct_ctxs_->size();
+  // With late materialization, filters and conjuncts were already evaluated.
+  const bool has_filters = !late_materialization_ && !filter_ctxs_.empty();
+  const bool has_conjuncts = !late_materialization_ && !row_group_conjunct_ctxs_.empty();
+  const bool check_rejected = UsesRejectedFlags();
+  ExprContext* const* conjunct_ctxs = row_group_conjunct_ctxs_.data();
+  const int num_conjuncts = row_group_conjunct_ctxs_.size();
 
   // Start/end/current iterators over the output rows.
   DCHECK_EQ(scan_node_->tuple_idx(), 0);
@@ -1949,6 +2893,7 @@ int HdfsParquetScanner::TransferScratchTuples() {
     // output batch per remaining scratch tuple and return. No need to evaluate
     // filters/conjuncts or transfer memory ownership.
     DCHECK(!has_filters);
+    DCHECK(!check_rejected);
     DCHECK(!has_conjuncts);
     DCHECK_EQ(scratch_batch_->mem_pool()->total_allocated_bytes(), 0);
     int num_tuples = min(batch_->capacity() - batch_->num_rows(),
@@ -1958,24 +2903,51 @@ int HdfsParquetScanner::TransferScratchTuples() {
     return num_tuples;
   }
 
-  // Loop until the scratch batch is exhausted or the output batch is full.
-  // Do not use batch_->AtCapacity() in this loop because it is not necessary
-  // to perform the memory capacity check.
-  while (scratch_tuple != scratch_tuple_end) {
-    *output_row = reinterpret_cast<Tuple*>(scratch_tuple);
-    scratch_tuple += tuple_size;
-    // Evaluate runtime filters and conjuncts. Short-circuit the evaluation if
-    // the filters/conjuncts are empty to avoid function calls.
-    if (has_filters && !EvalRuntimeFilters(reinterpret_cast<TupleRow*>(output_row))) {
-      continue;
+  // Rejected flags of the scratch tuples, set by the column readers for runtime filters
+  // that were evaluated on the column dictionaries and by EvalScratchTuplePredicates().
+  const uint8_t* rejected = &scratch_batch_->rejected[scratch_batch_->tuple_idx];
+
+  if (has_conjuncts) {
+    // Evaluate the conjuncts over as many tuples as the output batch has room for, one
+    // conjunct at a time, with the output rows as the input of the evaluation.
+    int num_tuples = min<int>(output_row_end - output_row_start,
+        scratch_batch_->num_tuples - scratch_batch_->tuple_idx);
+    int* selection = &scratch_batch_->selection[0];
+    int num_selected = 0;
+    for (int i = 0; i < num_tuples; ++i) {
+      output_row_start[i] = reinterpret_cast<Tuple*>(scratch_tuple + i * tuple_size);
+      if (check_rejected && rejected[i]) continue;
+      if (has_filters &&
+          !EvalRuntimeFilters(reinterpret_cast<TupleRow*>(&output_row_start[i]))) {
+        continue;
+      }
+      selection[num_selected++] = i;
     }
-    if (has_conjuncts && !ExecNode::EvalConjuncts(
-        conjunct_ctxs, num_conjuncts, reinterpret_cast<TupleRow*>(output_row))) {
-      continue;
+    num_selected = ExecNode::EvalConjunctsBatch(conjunct_ctxs, num_conjuncts,
+        output_row_start, 1, selection, num_selected);
+    // The selected indices are increasing, so the rows can be compacted in place.
+    for (int i = 0; i < num_selected; ++i) {
+      output_row_start[i] = output_row_start[selection[i]];
+    }
+    scratch_tuple += num_tuples * tuple_size;
+    output_row = output_row_start + num_selected;
+  } else {
+    // Loop until the scratch batch is exhausted or the output batch is full.
+    // Do not use batch_->AtCapacity() in this loop because it is not necessary
+    // to perform the memory capacity check.
+    while (scratch_tuple != scratch_tuple_end) {
+      *output_row = reinterpret_cast<Tuple*>(scratch_tuple);
+      scratch_tuple += tuple_size;
+      if (check_rejected && *rejected++) continue;
+      // Evaluate runtime filters. Short-circuit the evaluation if the filters are
+      // empty to avoid function calls.
+      if (has_filters && !EvalRuntimeFilters(reinterpret_cast<TupleRow*>(output_row))) {
+        continue;
+      }
+      // Row survived runtime filters.
+      ++output_row;
+      if (output_row == output_row_end) break;
     }
-    // Row survived runtime filters and conjuncts.
-    ++output_row;
-    if (output_row == output_row_end) break;
   }
   scratch_batch_->tuple_idx += (scratch_tuple - scratch_tuple_start) / tuple_size;
 
@@ -1989,19 +2961,607 @@ int HdfsParquetScanner::TransferScratchTuples() {
   return output_row - output_row_start;
 }
 
+namespace {
+
+/// Returns true if all values of the column chunk described by 'col_metadata' are
+/// dictionary encoded.
+bool IsDictionaryEncoded(const parquet::ColumnMetaData& col_metadata) {
+  if (!col_metadata.__isset.dictionary_page_offset) return false;
+  for (parquet::Encoding::type encoding: col_metadata.encodings) {
+    if (encoding == parquet::Encoding::PLAIN) return false;
+  }
+  return true;
+}
+
+/// Returns true if the column chunk described by 'col_metadata', with maximum
+/// definition level 'max_def_level', may contain NULLs according to its statistics.
+bool MayHaveNulls(const parquet::ColumnMetaData& col_metadata, int max_def_level) {
+  return max_def_level > 0 &&
+      !(col_metadata.__isset.statistics &&
+        col_metadata.statistics.__isset.null_count &&
+        col_metadata.statistics.null_count == 0);
+}
+
+}
+
+bool HdfsParquetScanner::RowGroupPassesMinMaxFilters(const parquet::RowGroup& row_group) {
+  for (int i = 0; i < filter_ctxs_.size(); ++i) {
+    const BaseScalarColumnReader* col_reader = filter_col_readers_[i];
+    if (col_reader == NULL) continue;
+    const MinMaxFilter* min_max_filter = filter_ctxs_[i]->filter->min_max_filter();
+    if (min_max_filter == NULL) continue;
+
+    const parquet::ColumnMetaData& col_metadata =
+        row_group.columns[col_reader->col_idx()].meta_data;
+    if (!col_metadata.__isset.statistics) continue;
+    const parquet::Statistics& stats = col_metadata.statistics;
+    if (!stats.__isset.min || !stats.__isset.max) continue;
+    int64_t min_val, max_val;
+    parquet::Type::type type = col_reader->schema_element().type;
+    if (!DecodeIntStatistic(type, stats.min, &min_val)) continue;
+    if (!DecodeIntStatistic(type, stats.max, &max_val)) continue;
+    if (!min_max_filter->Overlaps(min_val, max_val)) return false;
+  }
+  return true;
+}
+
+void HdfsParquetScanner::InitLateMaterialization() {
+  late_materialization_ = false;
+  num_eager_col_readers_ = column_readers_.size();
+  if (!FLAGS_parquet_late_materialization) return;
+  if (filter_ctxs_.empty() && scanner_conjunct_ctxs_->empty()) return;
+
+  vector<SlotId> predicate_slot_ids;
+  for (ExprContext* ctx: *scanner_conjunct_ctxs_) {
+    ctx->root()->GetSlotIds(&predicate_slot_ids);
+  }
+  for (const FilterContext* ctx: filter_ctxs_) {
+    ctx->expr->root()->GetSlotIds(&predicate_slot_ids);
+  }
+
+  // Only top-level scalar columns that no predicate references are materialized late.
+  vector<ColumnReader*> eager_readers;
+  vector<ColumnReader*> late_readers;
+  for (ColumnReader* col_reader: column_readers_) {
+    bool late = !col_reader->IsCollectionReader() && col_reader->slot_desc() != NULL &&
+        static_cast<BaseScalarColumnReader*>(col_reader)->SupportsSkippingRejected() &&
+        find(predicate_slot_ids.begin(), predicate_slot_ids.end(),
+            col_reader->slot_desc()->id()) == predicate_slot_ids.end();
+    if (late) {
+      late_readers.push_back(col_reader);
+    } else {
+      eager_readers.push_back(col_reader);
+    }
+  }
+  // The eager readers determine the number of scratch tuples the predicates are
+  // evaluated on.
+  if (eager_readers.empty() || late_readers.empty()) return;
+
+  for (ColumnReader* col_reader: late_readers) {
+    static_cast<BaseScalarColumnReader*>(col_reader)->set_skip_rejected(true);
+  }
+  num_eager_col_readers_ = eager_readers.size();
+  column_readers_ = eager_readers;
+  column_readers_.insert(column_readers_.end(), late_readers.begin(), late_readers.end());
+  late_materialization_ = true;
+}
+
+bool HdfsParquetScanner::MinMaxConjunct::MayPass(int64_t min_val, int64_t max_val) const {
+  switch (op) {
+    case LT: return min_val < value;
+    case LE: return min_val <= value;
+    case EQ: return min_val <= value && value <= max_val;
+    case NE: return min_val != value || max_val != value;
+    case GE: return max_val >= value;
+    case GT: return max_val > value;
+  }
+  DCHECK(false);
+  return true;
+}
+
+void HdfsParquetScanner::InitStatisticsConjuncts() {
+  min_max_conjuncts_.clear();
+  null_conjuncts_.clear();
+  bloom_conjuncts_.clear();
+  for (ExprContext* ctx: *scanner_conjunct_ctxs_) {
+    MinMaxConjunct min_max_conjunct;
+    NullConjunct null_conjunct;
+    BloomConjunct bloom_conjunct;
+    if (InitMinMaxConjunct(ctx, &min_max_conjunct)) {
+      min_max_conjuncts_.push_back(min_max_conjunct);
+    } else if (InitNullConjunct(ctx, &null_conjunct)) {
+      null_conjuncts_.push_back(null_conjunct);
+    }
+    // Equality conjuncts are tested against both the statistics and the Bloom filters.
+    if (InitBloomConjunct(ctx, &bloom_conjunct)) {
+      bloom_conjuncts_.push_back(bloom_conjunct);
+    }
+  }
+  for (const MinMaxConjunct& conjunct: min_max_conjuncts_) {
+    if (conjunct.col_reader->SupportsPageSkipping()) {
+      conjunct.col_reader->add_page_conjunct(&conjunct);
+    }
+  }
+}
+
+namespace {
+
+/// Returns true if 'expr' returns the same value whenever its slots have the same
+/// values, i.e. it has no non-deterministic builtins or UDFs.
+bool IsDeterministic(const Expr* expr) {
+  if (expr->fn().binary_type != TFunctionBinaryType::BUILTIN) return false;
+  const string& fn_name = expr->fn().name.function_name;
+  if (fn_name == "rand" || fn_name == "random") return false;
+  for (int i = 0; i < expr->GetNumChildren(); ++i) {
+    if (!IsDeterministic(expr->GetChild(i))) return false;
+  }
+  return true;
+}
+
+}
+
+void HdfsParquetScanner::InitDictionaryConjuncts() {
+  dict_conjuncts_.clear();
+  row_group_conjunct_ctxs_ = *scanner_conjunct_ctxs_;
+  if (!FLAGS_parquet_dictionary_conjuncts) return;
+  for (ExprContext* ctx: *scanner_conjunct_ctxs_) {
+    vector<SlotId> slot_ids;
+    ctx->root()->GetSlotIds(&slot_ids);
+    if (slot_ids.empty()) continue;
+    // A slot may be referenced more than once.
+    if (count(slot_ids.begin(), slot_ids.end(), slot_ids[0]) != slot_ids.size()) continue;
+    if (!IsDeterministic(ctx->root())) continue;
+    for (ColumnReader* col_reader: column_readers_) {
+      if (col_reader->IsCollectionReader()) continue;
+      if (col_reader->slot_desc() == NULL) continue;
+      if (col_reader->slot_desc()->id() != slot_ids[0]) continue;
+      BaseScalarColumnReader* scalar_reader =
+          static_cast<BaseScalarColumnReader*>(col_reader);
+      if (!scalar_reader->SupportsDictionaryFiltering()) break;
+      DictConjunct conjunct;
+      conjunct.ctx = ctx;
+      conjunct.col_reader = scalar_reader;
+      dict_conjuncts_.push_back(conjunct);
+      break;
+    }
+  }
+  dict_conjunct_tuple_mem_.assign(scan_node_->tuple_desc()->byte_size(), 0);
+}
+
+bool HdfsParquetScanner::InitMinMaxConjunct(ExprContext* ctx,
+    MinMaxConjunct* conjunct) {
+  Expr* root = ctx->root();
+  if (root->GetNumChildren() != 2) return false;
+  if (root->fn().binary_type != TFunctionBinaryType::BUILTIN) return false;
+  const string& fn_name = root->fn().name.function_name;
+  // The op if the slot is the left child, and if it is the right child.
+  MinMaxConjunct::Op op, flipped_op;
+  if (fn_name == "lt") {
+    op = MinMaxConjunct::LT;
+    flipped_op = MinMaxConjunct::GT;
+  } else if (fn_name == "le") {
+    op = MinMaxConjunct::LE;
+    flipped_op = MinMaxConjunct::GE;
+  } else if (fn_name == "eq") {
+    op = flipped_op = MinMaxConjunct::EQ;
+  } else if (fn_name == "ne") {
+    op = flipped_op = MinMaxConjunct::NE;
+  } else if (fn_name == "ge") {
+    op = MinMaxConjunct::GE;
+    flipped_op = MinMaxConjunct::LE;
+  } else if (fn_name == "gt") {
+    op = MinMaxConjunct::GT;
+    flipped_op = MinMaxConjunct::LT;
+  } else {
+    return false;
+  }
+
+  Expr* slot_expr = root->GetChild(0);
+  Expr* const_expr = root->GetChild(1);
+  if (!slot_expr->is_slotref()) {
+    swap(slot_expr, const_expr);
+    op = flipped_op;
+  }
+  if (!slot_expr->is_slotref() || !const_expr->IsConstant()) return false;
+  const ColumnType& type = slot_expr->type();
+  if (!MinMaxFilter::SupportsType(type) || const_expr->type() != type) return false;
+
+  // The constant must be non-NULL, otherwise the conjunct rejects every row anyway.
+  switch (type.type) {
+    case TYPE_TINYINT: {
+      TinyIntVal v = const_expr->GetTinyIntVal(ctx, NULL);
+      if (v.is_null) return false;
+      conjunct->value = v.val;
+      break;
+    }
+    case TYPE_SMALLINT: {
+      SmallIntVal v = const_expr->GetSmallIntVal(ctx, NULL);
+      if (v.is_null) return false;
+      conjunct->value = v.val;
+      break;
+    }
+    case TYPE_INT: {
+      IntVal v = const_expr->GetIntVal(ctx, NULL);
+      if (v.is_null) return false;
+      conjunct->value = v.val;
+      break;
+    }
+    case TYPE_BIGINT: {
+      BigIntVal v = const_expr->GetBigIntVal(ctx, NULL);
+      if (v.is_null) return false;
+      conjunct->value = v.val;
+      break;
+    }
+    default:
+      DCHECK(false) << type;
+      return false;
+  }
+  conjunct->op = op;
+
+  SlotId slot_id = static_cast<SlotRef*>(slot_expr)->slot_id();
+  for (ColumnReader* col_reader: column_readers_) {
+    if (col_reader->IsCollectionReader()) continue;
+    if (col_reader->slot_desc() == NULL || col_reader->slot_desc()->id() != slot_id) {
+      continue;
+    }
+    conjunct->col_reader = static_cast<BaseScalarColumnReader*>(col_reader);
+    return true;
+  }
+  return false;
+}
+
+bool HdfsParquetScanner::InitNullConjunct(ExprContext* ctx, NullConjunct* conjunct) {
+  Expr* root = ctx->root();
+  if (root->GetNumChildren() != 1 || !root->GetChild(0)->is_slotref()) return false;
+  if (root->fn().binary_type != TFunctionBinaryType::BUILTIN) return false;
+  const string& fn_name = root->fn().name.function_name;
+  if (fn_name == "is_null_pred") {
+    conjunct->is_null = true;
+  } else if (fn_name == "is_not_null_pred") {
+    conjunct->is_null = false;
+  } else {
+    return false;
+  }
+  SlotId slot_id = static_cast<SlotRef*>(root->GetChild(0))->slot_id();
+  for (ColumnReader* col_reader: column_readers_) {
+    if (col_reader->IsCollectionReader()) continue;
+    if (col_reader->slot_desc() == NULL || col_reader->slot_desc()->id() != slot_id) {
+      continue;
+    }
+    conjunct->col_reader = static_cast<BaseScalarColumnReader*>(col_reader);
+    return true;
+  }
+  return false;
+}
+
+namespace {
+
+/// Sets 'hash' to the Bloom filter hash of the value of the constant 'expr', see
+/// PARQUET_BLOOM_FILTER_SEED. Returns false if the value is NULL.
+bool HashBloomFilterConstant(ExprContext* ctx, Expr* expr, uint32_t* hash) {
+  const ColumnType& type = expr->type();
+  int8_t tinyint_val;
+  int16_t smallint_val;
+  int32_t int_val;
+  int64_t bigint_val;
+  StringValue string_val;
+  const void* value;
+  switch (type.type) {
+    case TYPE_TINYINT: {
+      TinyIntVal v = expr->GetTinyIntVal(ctx, NULL);
+      if (v.is_null) return false;
+      tinyint_val = v.val;
+      value = &tinyint_val;
+      break;
+    }
+    case TYPE_SMALLINT: {
+      SmallIntVal v = expr->GetSmallIntVal(ctx, NULL);
+      if (v.is_null) return false;
+      smallint_val = v.val;
+      value = &smallint_val;
+      break;
+    }
+    case TYPE_INT: {
+      IntVal v = expr->GetIntVal(ctx, NULL);
+      if (v.is_null) return false;
+      int_val = v.val;
+      value = &int_val;
+      break;
+    }
+    case TYPE_BIGINT: {
+      BigIntVal v = expr->GetBigIntVal(ctx, NULL);
+      if (v.is_null) return false;
+      bigint_val = v.val;
+      value = &bigint_val;
+      break;
+    }
+    case TYPE_STRING:
+    case TYPE_VARCHAR: {
+      StringVal v = expr->GetStringVal(ctx, NULL);
+      if (v.is_null) return false;
+      string_val = StringValue::FromStringVal(v);
+      value = &string_val;
+      break;
+    }
+    default:
+      DCHECK(false) << type;
+      return false;
+  }
+  *hash = RawValue::GetHashValue(value, type, PARQUET_BLOOM_FILTER_SEED);
+  return true;
+}
+
+/// Parses the location of the Bloom filter of the column chunk 'col_metadata', see
+/// PARQUET_BLOOM_FILTER_KEY. Returns false if the chunk has no valid filter whose values
+/// were hashed as 'hash_type'.
+bool ParseBloomFilterLocation(const parquet::ColumnMetaData& col_metadata,
+    const string& hash_type, int64_t file_length, int64_t* offset,
+    int* log_heap_space) {
+  if (!col_metadata.__isset.key_value_metadata) return false;
+  for (const parquet::KeyValue& key_value: col_metadata.key_value_metadata) {
+    if (key_value.key != PARQUET_BLOOM_FILTER_KEY || !key_value.__isset.value) continue;
+    vector<string> fields;
+    split(fields, key_value.value, is_any_of(":"));
+    if (fields.size() != 3 || fields[2] != hash_type) return false;
+    StringParser::ParseResult offset_result, log_heap_space_result;
+    *offset = StringParser::StringToInt<int64_t>(
+        fields[0].data(), fields[0].size(), &offset_result);
+    *log_heap_space = StringParser::StringToInt<int>(
+        fields[1].data(), fields[1].size(), &log_heap_space_result);
+    if (offset_result != StringParser::PARSE_SUCCESS) return false;
+    if (log_heap_space_result != StringParser::PARSE_SUCCESS) return false;
+    // A BloomFilter has at least two buckets of 64 bytes, and the writer's filters are
+    // far smaller than 1GB.
+    if (*log_heap_space < 7 || *log_heap_space > 30) return false;
+    return *offset >= 0 && *offset + (1LL << *log_heap_space) <= file_length;
+  }
+  return false;
+}
+
+}
+
+bool HdfsParquetScanner::InitBloomConjunct(ExprContext* ctx, BloomConjunct* conjunct) {
+  Expr* root = ctx->root();
+  if (root->fn().binary_type != TFunctionBinaryType::BUILTIN) return false;
+  if (root->GetNumChildren() < 2) return false;
+  const string& fn_name = root->fn().name.function_name;
+  Expr* slot_expr = root->GetChild(0);
+  vector<Expr*> const_exprs;
+  if (fn_name == "eq" && root->GetNumChildren() == 2) {
+    const_exprs.push_back(root->GetChild(1));
+    if (!slot_expr->is_slotref()) swap(slot_expr, const_exprs[0]);
+  } else if (fn_name == "in_iterate" || fn_name == "in_set_lookup") {
+    for (int i = 1; i < root->GetNumChildren(); ++i) {
+      const_exprs.push_back(root->GetChild(i));
+    }
+  } else {
+    return false;
+  }
+  if (!slot_expr->is_slotref()) return false;
+  const ColumnType& type = slot_expr->type();
+  conjunct->hash_type = ParquetBloomFilterHashType(type);
+  if (conjunct->hash_type.empty()) return false;
+  conjunct->hashes.clear();
+  for (Expr* const_expr: const_exprs) {
+    if (!const_expr->IsConstant() || const_expr->type() != type) return false;
+    // NULL constants are never equal to a value.
+    uint32_t hash;
+    if (HashBloomFilterConstant(ctx, const_expr, &hash)) {
+      conjunct->hashes.push_back(hash);
+    }
+  }
+
+  SlotId slot_id = static_cast<SlotRef*>(slot_expr)->slot_id();
+  for (ColumnReader* col_reader: column_readers_) {
+    if (col_reader->IsCollectionReader()) continue;
+    if (col_reader->slot_desc() == NULL || col_reader->slot_desc()->id() != slot_id) {
+      continue;
+    }
+    conjunct->col_reader = static_cast<BaseScalarColumnReader*>(col_reader);
+    return true;
+  }
+  return false;
+}
+
+bool HdfsParquetScanner::RowGroupPassesStatistics(const parquet::RowGroup& row_group) {
+  for (const MinMaxConjunct& conjunct: min_max_conjuncts_) {
+    const parquet::ColumnMetaData& col_metadata =
+        row_group.columns[conjunct.col_reader->col_idx()].meta_data;
+    if (!col_metadata.__isset.statistics) continue;
+    const parquet::Statistics& stats = col_metadata.statistics;
+    // A comparison with NULL never passes.
+    if (stats.__isset.null_count && stats.null_count == col_metadata.num_values) {
+      return false;
+    }
+    if (!stats.__isset.min || !stats.__isset.max) continue;
+    int64_t min_val, max_val;
+    parquet::Type::type type = conjunct.col_reader->schema_element().type;
+    if (!DecodeIntStatistic(type, stats.min, &min_val)) continue;
+    if (!DecodeIntStatistic(type, stats.max, &max_val)) continue;
+    if (!conjunct.MayPass(min_val, max_val)) return false;
+  }
+  for (const NullConjunct& conjunct: null_conjuncts_) {
+    const parquet::ColumnMetaData& col_metadata =
+        row_group.columns[conjunct.col_reader->col_idx()].meta_data;
+    if (!col_metadata.__isset.statistics) continue;
+    const parquet::Statistics& stats = col_metadata.statistics;
+    if (!stats.__isset.null_count) continue;
+    if (conjunct.is_null && stats.null_count == 0) return false;
+    if (!conjunct.is_null && stats.null_count == col_metadata.num_values) return false;
+  }
+  return true;
+}
+
+Status HdfsParquetScanner::RowGroupPassesBloomFilters(
+    const parquet::RowGroup& row_group, bool* passes) {
+  *passes = true;
+  if (bloom_conjuncts_.empty()) return Status::OK();
+  const HdfsFileDesc* file_desc = scan_node_->GetFileDesc(filename());
+  DCHECK(file_desc != NULL);
+  for (const BloomConjunct& conjunct: bloom_conjuncts_) {
+    const parquet::ColumnMetaData& col_metadata =
+        row_group.columns[conjunct.col_reader->col_idx()].meta_data;
+    int64_t offset;
+    int log_heap_space;
+    if (!ParseBloomFilterLocation(col_metadata, conjunct.hash_type,
+        file_desc->file_length, &offset, &log_heap_space)) {
+      continue;
+    }
+    TBloomFilter thrift_filter;
+    thrift_filter.log_heap_space = log_heap_space;
+    thrift_filter.always_true = false;
+    thrift_filter.directory.resize(1LL << log_heap_space);
+    RETURN_IF_ERROR(ReadFileBytes(offset, thrift_filter.directory.size(),
+        reinterpret_cast<uint8_t*>(&thrift_filter.directory[0])));
+    BloomFilter filter(thrift_filter);
+    bool found = false;
+    for (uint32_t hash: conjunct.hashes) {
+      if (filter.Find(hash)) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      *passes = false;
+      return Status::OK();
+    }
+  }
+  return Status::OK();
+}
+
+int64_t HdfsParquetScanner::GetColumnChunksSize(const parquet::RowGroup& row_group) {
+  int64_t size = 0;
+  stack<ColumnReader*> readers;
+  for (ColumnReader* r: column_readers_) readers.push(r);
+  while (!readers.empty()) {
+    ColumnReader* col_reader = readers.top();
+    readers.pop();
+    if (col_reader->IsCollectionReader()) {
+      CollectionColumnReader* collection_reader =
+          static_cast<CollectionColumnReader*>(col_reader);
+      for (ColumnReader* r: *collection_reader->children()) readers.push(r);
+      continue;
+    }
+    int col_idx = static_cast<BaseScalarColumnReader*>(col_reader)->col_idx();
+    size += row_group.columns[col_idx].meta_data.total_compressed_size;
+  }
+  return size;
+}
+
+void HdfsParquetScanner::EvalScratchTuplePredicates() {
+  const bool has_filters = !filter_ctxs_.empty();
+  const bool has_conjuncts = !row_group_conjunct_ctxs_.empty();
+  ExprContext* const* conjunct_ctxs = row_group_conjunct_ctxs_.data();
+  const int num_conjuncts = row_group_conjunct_ctxs_.size();
+  uint8_t* rejected = &scratch_batch_->rejected[0];
+  Tuple** tuples = &scratch_batch_->tuple_ptrs[0];
+  int* selection = &scratch_batch_->selection[0];
+  int num_selected = 0;
+  for (int i = 0; i < scratch_batch_->num_tuples; ++i) {
+    if (rejected[i]) continue;
+    tuples[i] = scratch_batch_->GetTuple(i);
+    if (has_filters && !EvalRuntimeFilters(reinterpret_cast<TupleRow*>(&tuples[i]))) {
+      rejected[i] = 1;
+      continue;
+    }
+    selection[num_selected++] = i;
+  }
+  if (!has_conjuncts || num_selected == 0) return;
+
+  // Evaluate the conjuncts over the selected tuples, then flag the ones that didn't
+  // pass by flagging all of them and clearing the flags of the passing ones.
+  for (int i = 0; i < num_selected; ++i) rejected[selection[i]] = 1;
+  num_selected = ExecNode::EvalConjunctsBatch(conjunct_ctxs, num_conjuncts, tuples, 1,
+      selection, num_selected);
+  for (int i = 0; i < num_selected; ++i) rejected[selection[i]] = 0;
+}
+
+Status HdfsParquetScanner::EvalDictionaryFilters(const parquet::RowGroup& row_group,
+    bool* skip_row_group) {
+  *skip_row_group = false;
+  dict_filters_active_ = false;
+  for (int i = 0; i < filter_ctxs_.size(); ++i) {
+    LocalFilterStats* stats = &filter_stats_[i];
+    stats->dict_filtered = 0;
+    BaseScalarColumnReader* col_reader = filter_col_readers_[i];
+    if (col_reader == NULL || !stats->enabled) continue;
+    if (!col_reader->SupportsDictionaryFiltering()) continue;
+    // Filters that arrive later are evaluated per row.
+    const RuntimeFilter* filter = filter_ctxs_[i]->filter;
+    if (!filter->HasBloomFilter() || filter->AlwaysTrue()) continue;
+    const parquet::ColumnMetaData& col_metadata =
+        row_group.columns[col_reader->col_idx()].meta_data;
+    if (!IsDictionaryEncoded(col_metadata)) continue;
+    RETURN_IF_ERROR(col_reader->InitDictionary());
+    if (!col_reader->HasDictionaryDecoder()) continue;
+
+    int num_passed = col_reader->EvalDictionaryFilter(filter);
+    stats->dict_filtered = 1;
+    dict_filters_active_ = true;
+    if (num_passed > 0) continue;
+    // No non-NULL value can pass. The row group can only be skipped if NULLs cannot
+    // pass either, or if the column has no NULLs.
+    if (!col_reader->dict_filter_null_pass_ ||
+        !MayHaveNulls(col_metadata, col_reader->max_def_level())) {
+      *skip_row_group = true;
+      return Status::OK();
+    }
+  }
+  return Status::OK();
+}
+
+Status HdfsParquetScanner::EvalDictionaryConjuncts(const parquet::RowGroup& row_group,
+    bool* skip_row_group) {
+  *skip_row_group = false;
+  row_group_conjunct_ctxs_ = *scanner_conjunct_ctxs_;
+  if (dict_conjuncts_.empty()) return Status::OK();
+  Tuple* tuple = reinterpret_cast<Tuple*>(dict_conjunct_tuple_mem_.data());
+  int64_t num_evals_saved = 0;
+  for (const DictConjunct& conjunct: dict_conjuncts_) {
+    BaseScalarColumnReader* col_reader = conjunct.col_reader;
+    const parquet::ColumnMetaData& col_metadata =
+        row_group.columns[col_reader->col_idx()].meta_data;
+    if (!IsDictionaryEncoded(col_metadata)) continue;
+    RETURN_IF_ERROR(col_reader->InitDictionary());
+    if (!col_reader->HasDictionaryDecoder()) continue;
+
+    int num_evals;
+    int num_passed = col_reader->EvalDictionaryConjunct(conjunct.ctx, tuple, &num_evals);
+    // Errors while evaluating the dictionary entries are returned like errors while
+    // evaluating rows, see AssembleRows().
+    RETURN_IF_ERROR(state_->GetQueryStatus());
+    dict_filters_active_ = true;
+    row_group_conjunct_ctxs_.erase(find(row_group_conjunct_ctxs_.begin(),
+        row_group_conjunct_ctxs_.end(), conjunct.ctx));
+    num_evals_saved += max<int64_t>(row_group.num_rows - num_evals, 0);
+    if (num_passed > 0) continue;
+    if (!col_reader->dict_filter_null_pass_ ||
+        !MayHaveNulls(col_metadata, col_reader->max_def_level())) {
+      *skip_row_group = true;
+      break;
+    }
+  }
+  COUNTER_ADD(num_dict_conjunct_evals_saved_counter_, num_evals_saved);
+  return Status::OK();
+}
+
 bool HdfsParquetScanner::EvalRuntimeFilters(TupleRow* row) {
   int num_filters = filter_ctxs_.size();
   for (int i = 0; i < num_filters; ++i) {
     LocalFilterStats* stats = &filter_stats_[i];
-    if (!stats->enabled) continue;
+    if (!stats->enabled || stats->dict_filtered) continue;
     const RuntimeFilter* filter = filter_ctxs_[i]->filter;
-    // Check filter effectiveness every ROWS_PER_FILTER_SELECTIVITY_CHECK rows.
+    ++stats->total_possible;
+    // Filters that have not arrived yet pass all rows. They are applied from the first
+    // row after they arrive.
+    if (!filter->HasBloomFilter()) continue;
+    // Check filter effectiveness every ROWS_PER_FILTER_SELECTIVITY_CHECK rows that it
+    // was applied to, so that the rows scanned before it arrived do not count.
     // TODO: The stats updates and the filter effectiveness check are executed very
     // frequently. Consider hoisting it out of of this loop, and doing an equivalent
     // check less frequently, e.g., after producing an output batch.
-    ++stats->total_possible;
-    if (UNLIKELY(
-        !(stats->total_possible & (ROWS_PER_FILTER_SELECTIVITY_CHECK - 1)))) {
+    if (UNLIKELY(stats->considered > 0 &&
+        !(stats->considered & (ROWS_PER_FILTER_SELECTIVITY_CHECK - 1)))) {
       double reject_ratio = stats->rejected / static_cast<double>(stats->considered);
       if (filter->AlwaysTrue() ||
           reject_ratio < FLAGS_parquet_min_filter_reject_ratio) {
@@ -2035,6 +3595,7 @@ bool HdfsParquetScanner::AssembleRows(
     const vector<ColumnReader*>& column_readers, int row_group_idx, bool* filters_pass) {
   DCHECK(!column_readers.empty());
   DCHECK(scratch_batch_ != NULL);
+  DCHECK(!late_materialization_ || &column_readers == &column_readers_);
 
   int64_t rows_read = 0;
   bool continue_execution = !scan_node_->ReachedLimit() && !context_->cancelled();
@@ -2060,11 +3621,19 @@ bool HdfsParquetScanner::AssembleRows(
     for (int i = 0; i < scratch_capacity; ++i) {
       InitTuple(template_tuple_, scratch_batch_->GetTuple(i));
     }
+    if (UsesRejectedFlags()) {
+      memset(&scratch_batch_->rejected[0], 0, scratch_capacity);
+    }
 
     // Materialize the top-level slots into the scratch batch column-by-column.
     int last_num_tuples = -1;
     int num_col_readers = column_readers.size();
     for (int c = 0; c < num_col_readers; ++c) {
+      // With late materialization, evaluate the predicates once their slots are
+      // materialized so the remaining readers can skip the rejected tuples.
+      if (late_materialization_ && c == num_eager_col_readers_) {
+        EvalScratchTuplePredicates();
+      }
       ColumnReader* col_reader = column_readers[c];
       if (col_reader->max_rep_level() > 0) {
         continue_execution = col_reader->ReadValueBatch(
@@ -2146,25 +3715,33 @@ bool HdfsParquetScanner::AssembleCollection(
 
     int num_to_commit = 0;
     int row_idx = 0;
-    for (row_idx = 0; row_idx < num_rows && !end_of_collection; ++row_idx) {
+    while (row_idx < num_rows && !end_of_collection) {
       DCHECK(continue_execution);
       // A tuple is produced iff the collection that contains its values is not empty and
       // non-NULL. (Empty or NULL collections produce no output values, whereas NULL is
       // output for the fields of NULL structs.)
       bool materialize_tuple = column_readers[0]->def_level() >=
           column_readers[0]->def_level_of_immediate_repeated_ancestor();
-      InitTuple(tuple_desc, template_tuple, tuple);
-      continue_execution =
-          ReadCollectionItem(column_readers, materialize_tuple, pool, tuple);
-      if (UNLIKELY(!continue_execution)) break;
-      end_of_collection = column_readers[0]->rep_level() <= new_collection_rep_level;
-
-      if (materialize_tuple) {
-        if (ExecNode::EvalConjuncts(&conjunct_ctxs[0], conjunct_ctxs.size(), row)) {
-          tuple = next_tuple(tuple_desc->byte_size(), tuple);
-          ++num_to_commit;
-        }
+      if (!materialize_tuple) {
+        InitTuple(tuple_desc, template_tuple, tuple);
+        continue_execution = ReadCollectionItem(column_readers, false, pool, tuple);
+        if (UNLIKELY(!continue_execution)) break;
+        ++row_idx;
+      } else {
+        // Materialize the items up to the end of the collection, as far as the first
+        // reader knows it, column by column.
+        int num_items = column_readers[0]->NumCollectionValuesAhead(
+            new_collection_rep_level, num_rows - row_idx);
+        continue_execution = ReadCollectionItems(column_readers, tuple_desc,
+            template_tuple, num_items, pool, tuple);
+        if (UNLIKELY(!continue_execution)) break;
+        row_idx += num_items;
+        int num_passed = FilterCollectionItems(tuple_desc, conjunct_ctxs, num_items,
+            tuple);
+        tuple = next_tuple(num_passed * tuple_desc->byte_size(), tuple);
+        num_to_commit += num_passed;
       }
+      end_of_collection = column_readers[0]->rep_level() <= new_collection_rep_level;
     }
 
     rows_read += row_idx;
@@ -2208,6 +3785,156 @@ inline bool HdfsParquetScanner::ReadCollectionItem(
   return continue_execution;
 }
 
+inline bool HdfsParquetScanner::ReadCollectionItems(
+    const vector<ColumnReader*>& column_readers, const TupleDescriptor* tuple_desc,
+    Tuple* template_tuple, int num_items, MemPool* pool, Tuple* tuple) {
+  DCHECK(!column_readers.empty());
+  int tuple_size = tuple_desc->byte_size();
+  uint8_t* tuple_mem = reinterpret_cast<uint8_t*>(tuple);
+  for (int i = 0; i < num_items; ++i) {
+    InitTuple(tuple_desc, template_tuple,
+        reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size));
+  }
+  int size = column_readers.size();
+  for (int c = 0; c < size; ++c) {
+    if (UNLIKELY(!column_readers[c]->ReadCollectionValueBatch(
+        pool, num_items, tuple_size, tuple_mem))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline int HdfsParquetScanner::FilterCollectionItems(const TupleDescriptor* tuple_desc,
+    const vector<ExprContext*>& conjunct_ctxs, int num_items, Tuple* tuple) {
+  if (conjunct_ctxs.empty()) return num_items;
+  int tuple_size = tuple_desc->byte_size();
+  uint8_t* tuple_mem = reinterpret_cast<uint8_t*>(tuple);
+  int num_passed = 0;
+  for (int i = 0; i < num_items; ++i) {
+    Tuple* item = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size);
+    // Treat the tuple as a single-tuple row, like GetCollectionMemory().
+    TupleRow* row = reinterpret_cast<TupleRow*>(&item);
+    if (!ExecNode::EvalConjuncts(&conjunct_ctxs[0], conjunct_ctxs.size(), row)) continue;
+    if (num_passed != i) {
+      memcpy(tuple_mem + num_passed * tuple_size, item, tuple_size);
+    }
+    ++num_passed;
+  }
+  return num_passed;
+}
+
+HdfsParquetScanner::FooterCache* HdfsParquetScanner::GetFooterCache() {
+  static FooterCache* cache = FLAGS_parquet_footer_cache_capacity > 0 ?
+      new FooterCache(FLAGS_parquet_footer_cache_capacity) : NULL;
+  return cache;
+}
+
+namespace {
+
+string FooterCacheKey(const string& filename, const HdfsFileDesc* file_desc) {
+  return Substitute("$0:$1:$2", filename, file_desc->mtime, file_desc->file_length);
+}
+
+/// Deserialized thrift objects take several times the space of their serialized form.
+/// Used to estimate the memory held by a cached footer.
+const int FOOTER_MEMORY_EXPANSION_FACTOR = 4;
+
+}
+
+void HdfsParquetScanner::LookupCachedFooter(const HdfsFileDesc* file_desc) {
+  FooterCache* cache = GetFooterCache();
+  if (cache == NULL) return;
+  if (cache->Get(FooterCacheKey(filename(), file_desc), &footer_)) {
+    ImpaladMetrics::PARQUET_FOOTER_CACHE_HIT_COUNT->Increment(1L);
+  } else {
+    ImpaladMetrics::PARQUET_FOOTER_CACHE_MISS_COUNT->Increment(1L);
+  }
+}
+
+Status HdfsParquetScanner::ParseFooter(const HdfsFileDesc* file_desc,
+    uint8_t* metadata_ptr, uint32_t metadata_size) {
+  boost::shared_ptr<ParsedFooter> footer(new ParsedFooter());
+  // Deserialize file header
+  // TODO: this takes ~7ms for a 1000-column table, figure out how to reduce this.
+  uint32_t serialized_size = metadata_size;
+  Status status =
+      DeserializeThriftMsg(metadata_ptr, &metadata_size, true, &footer->file_metadata);
+  if (!status.ok()) {
+    return Status(Substitute("File $0 has invalid file metadata at file offset $1. "
+        "Error = $2.", filename(),
+        metadata_size + sizeof(PARQUET_VERSION_NUMBER) + sizeof(uint32_t),
+        status.GetDetail()));
+  }
+
+  file_metadata_ = &footer->file_metadata;
+  RETURN_IF_ERROR(ValidateFileMetadata());
+  // Parse file schema
+  RETURN_IF_ERROR(CreateSchemaTree(footer->file_metadata.schema, &footer->schema));
+  footer_ = footer;
+
+  FooterCache* cache = GetFooterCache();
+  if (cache != NULL) {
+    cache->Put(FooterCacheKey(filename(), file_desc), footer_,
+        static_cast<size_t>(serialized_size) * FOOTER_MEMORY_EXPANSION_FACTOR);
+    ImpaladMetrics::PARQUET_FOOTER_CACHE_NUM_ENTRIES->set_value(cache->size());
+    ImpaladMetrics::PARQUET_FOOTER_CACHE_TOTAL_BYTES->set_value(cache->total_charge());
+  }
+  return Status::OK();
+}
+
+HdfsParquetScanner::PageCache* HdfsParquetScanner::page_cache_ = NULL;
+MemTracker* HdfsParquetScanner::page_cache_mem_tracker_ = NULL;
+
+HdfsParquetScanner::CachedColumnChunk::~CachedColumnChunk() {
+  mem_tracker->Release(bytes);
+}
+
+void HdfsParquetScanner::InitPageCache(MemTracker* process_mem_tracker) {
+  DCHECK(page_cache_ == NULL);
+  if (FLAGS_parquet_page_cache_capacity <= 0) return;
+  page_cache_mem_tracker_ =
+      new MemTracker(-1, -1, "Parquet Page Cache", process_mem_tracker);
+  page_cache_ = new PageCache(FLAGS_parquet_page_cache_capacity);
+  // If we hit the process limit, free the cached pages. They are re-read from the files
+  // by later scans.
+  process_mem_tracker->AddGcFunction(&HdfsParquetScanner::GcPageCache);
+}
+
+void HdfsParquetScanner::GcPageCache() {
+  page_cache_->Clear();
+  ImpaladMetrics::PARQUET_PAGE_CACHE_NUM_ENTRIES->set_value(0);
+  ImpaladMetrics::PARQUET_PAGE_CACHE_TOTAL_BYTES->set_value(0);
+}
+
+void HdfsParquetScanner::AddToPageCache(const string& key,
+    const boost::shared_ptr<const CachedColumnChunk>& chunk) {
+  page_cache_->Put(key, chunk, chunk->bytes);
+  ImpaladMetrics::PARQUET_PAGE_CACHE_NUM_ENTRIES->set_value(page_cache_->size());
+  ImpaladMetrics::PARQUET_PAGE_CACHE_TOTAL_BYTES->set_value(page_cache_->total_charge());
+}
+
+Status HdfsParquetScanner::ReadFileBytes(int64_t offset, int64_t len, uint8_t* buffer) {
+  const HdfsFileDesc* file_desc = scan_node_->GetFileDesc(filename());
+  DCHECK(file_desc != NULL);
+  DiskIoMgr* io_mgr = scan_node_->runtime_state()->io_mgr();
+  int64_t copy_offset = 0;
+  while (copy_offset < len) {
+    int64_t to_read = ::min<int64_t>(io_mgr->max_read_buffer_size(), len - copy_offset);
+    DiskIoMgr::ScanRange* range = scan_node_->AllocateScanRange(
+        metadata_range_->fs(), filename(), to_read, offset + copy_offset, -1,
+        metadata_range_->disk_id(), metadata_range_->try_cache(),
+        metadata_range_->expected_local(), file_desc->mtime);
+
+    DiskIoMgr::BufferDescriptor* io_buffer = NULL;
+    RETURN_IF_ERROR(io_mgr->Read(scan_node_->reader_context(), range, &io_buffer));
+    memcpy(buffer + copy_offset, io_buffer->buffer(), io_buffer->len());
+    io_buffer->Return();
+    copy_offset += to_read;
+  }
+  return Status::OK();
+}
+
 Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
   *eosr = false;
   int64_t len = stream_->scan_range()->len();
@@ -2262,17 +3989,17 @@ Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
   vector<uint8_t> metadata_buffer;
 
   DCHECK(metadata_range_ != NULL);
-  if (UNLIKELY(metadata_size > remaining_bytes_buffered)) {
+  const HdfsFileDesc* file_desc = scan_node_->GetFileDesc(filename());
+  DCHECK(file_desc != NULL);
+  LookupCachedFooter(file_desc);
+  if (footer_.get() == NULL && UNLIKELY(metadata_size > remaining_bytes_buffered)) {
     // In this case, the metadata is bigger than our guess meaning there are
     // not enough bytes in the footer range from IssueInitialRanges().
     // We'll just issue more ranges to the IoMgr that is the actual footer.
-    const HdfsFileDesc* file_desc = scan_node_->GetFileDesc(filename());
-    DCHECK(file_desc != NULL);
     // The start of the metadata is:
     // file_length - 4-byte metadata size - footer-size - metadata size
     int64_t metadata_start = file_desc->file_length -
       sizeof(int32_t) - sizeof(PARQUET_VERSION_NUMBER) - metadata_size;
-    int64_t metadata_bytes_to_read = metadata_size;
     if (metadata_start < 0) {
       return Status(Substitute("File $0 is invalid. Invalid metadata size in file "
           "footer: $1 bytes. File size: $2 bytes.", filename(), metadata_size,
@@ -2285,70 +4012,31 @@ Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
     // now.
     metadata_buffer.resize(metadata_size);
     metadata_ptr = &metadata_buffer[0];
-    int64_t copy_offset = 0;
-    DiskIoMgr* io_mgr = scan_node_->runtime_state()->io_mgr();
-
-    while (metadata_bytes_to_read > 0) {
-      int64_t to_read = ::min<int64_t>(io_mgr->max_read_buffer_size(),
-          metadata_bytes_to_read);
-      DiskIoMgr::ScanRange* range = scan_node_->AllocateScanRange(
-          metadata_range_->fs(), filename(), to_read, metadata_start + copy_offset, -1,
-          metadata_range_->disk_id(), metadata_range_->try_cache(),
-          metadata_range_->expected_local(), file_desc->mtime);
-
-      DiskIoMgr::BufferDescriptor* io_buffer = NULL;
-      RETURN_IF_ERROR(io_mgr->Read(scan_node_->reader_context(), range, &io_buffer));
-      memcpy(metadata_ptr + copy_offset, io_buffer->buffer(), io_buffer->len());
-      io_buffer->Return();
-
-      metadata_bytes_to_read -= to_read;
-      copy_offset += to_read;
-    }
-    DCHECK_EQ(metadata_bytes_to_read, 0);
+    RETURN_IF_ERROR(ReadFileBytes(metadata_start, metadata_size, metadata_ptr));
   }
 
-  // Deserialize file header
-  // TODO: this takes ~7ms for a 1000-column table, figure out how to reduce this.
-  Status status =
-      DeserializeThriftMsg(metadata_ptr, &metadata_size, true, &file_metadata_);
-  if (!status.ok()) {
-    return Status(Substitute("File $0 has invalid file metadata at file offset $1. "
-        "Error = $2.", filename(),
-        metadata_size + sizeof(PARQUET_VERSION_NUMBER) + sizeof(uint32_t),
-        status.GetDetail()));
+  if (footer_.get() == NULL) {
+    RETURN_IF_ERROR(ParseFooter(file_desc, metadata_ptr, metadata_size));
+  } else {
+    // Sets file_version_.
+    file_metadata_ = &footer_->file_metadata;
+    RETURN_IF_ERROR(ValidateFileMetadata());
   }
-
-  RETURN_IF_ERROR(ValidateFileMetadata());
-  // Parse file schema
-  RETURN_IF_ERROR(CreateSchemaTree(file_metadata_.schema, &schema_));
+  schema_ = footer_->schema;
 
   if (scan_node_->IsZeroSlotTableScan()) {
     // There are no materialized slots, e.g. count(*) over the table.  We can serve
     // this query from just the file metadata.  We don't need to read the column data.
-    int64_t num_tuples = file_metadata_.num_rows;
-    COUNTER_ADD(scan_node_->rows_read_counter(), num_tuples);
-
-    while (num_tuples > 0) {
-      MemPool* pool;
-      Tuple* tuple;
-      TupleRow* current_row;
-      int max_tuples = GetMemory(&pool, &tuple, &current_row);
-      max_tuples = min<int64_t>(max_tuples, num_tuples);
-      num_tuples -= max_tuples;
-
-      int num_to_commit = WriteEmptyTuples(context_, current_row, max_tuples);
-      RETURN_IF_ERROR(CommitRows(num_to_commit));
-    }
-
+    RETURN_IF_ERROR(WriteTuplesFromMetadata(file_metadata_->num_rows));
     *eosr = true;
     return Status::OK();
-  } else if (file_metadata_.num_rows == 0) {
+  } else if (file_metadata_->num_rows == 0) {
     // Empty file
     *eosr = true;
     return Status::OK();
   }
 
-  if (file_metadata_.row_groups.empty()) {
+  if (file_metadata_->row_groups.empty()) {
     return Status(
         Substitute("Invalid file. This file: $0 has no row groups", filename()));
   }
@@ -2358,6 +4046,23 @@ Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
   return Status::OK();
 }
 
+Status HdfsParquetScanner::WriteTuplesFromMetadata(int64_t num_tuples) {
+  COUNTER_ADD(scan_node_->rows_read_counter(), num_tuples);
+  while (num_tuples > 0) {
+    MemPool* pool;
+    Tuple* tuple;
+    TupleRow* current_row;
+    int max_tuples = GetMemory(&pool, &tuple, &current_row);
+    max_tuples = min<int64_t>(max_tuples, num_tuples);
+    num_tuples -= max_tuples;
+
+    int num_to_commit = WriteEmptyTuples(context_, current_row, max_tuples);
+    RETURN_IF_ERROR(CommitRows(num_to_commit));
+    if (scan_node_->ReachedLimit() || context_->cancelled()) break;
+  }
+  return Status::OK();
+}
+
 Status HdfsParquetScanner::ResolvePath(const SchemaPath& path, SchemaNode** node,
     bool* pos_field, bool* missing_field) {
   *missing_field = false;
@@ -2776,7 +4481,7 @@ Status HdfsParquetScanner::InitColumns(
     int row_group_idx, const vector<ColumnReader*>& column_readers) {
   const HdfsFileDesc* file_desc = scan_node_->GetFileDesc(filename());
   DCHECK(file_desc != NULL);
-  parquet::RowGroup& row_group = file_metadata_.row_groups[row_group_idx];
+  const parquet::RowGroup& row_group = file_metadata_->row_groups[row_group_idx];
 
   // All the scan ranges (one for each column).
   vector<DiskIoMgr::ScanRange*> col_ranges;
@@ -2785,6 +4490,8 @@ Status HdfsParquetScanner::InitColumns(
   int num_values = -1;
   // Used to validate we issued the right number of scan ranges
   int num_scalar_readers = 0;
+  // Number of readers of column chunks found in the page cache, which need no scan range.
+  int num_cached_readers = 0;
 
   for (ColumnReader* col_reader: column_readers) {
     if (col_reader->IsCollectionReader()) {
@@ -2842,6 +4549,26 @@ Status HdfsParquetScanner::InitColumns(
       FILE_CHECK_EQ(col_chunk.file_path, string(filename()));
     }
 
+    string cache_key;
+    if (page_cache_ != NULL) {
+      cache_key = Substitute("$0:$1:$2:$3", filename(), file_desc->mtime,
+          file_desc->file_length, col_start);
+      boost::shared_ptr<const CachedColumnChunk> cached_chunk;
+      if (page_cache_->Get(cache_key, &cached_chunk)) {
+        ImpaladMetrics::PARQUET_PAGE_CACHE_HIT_COUNT->Increment(1L);
+        COUNTER_ADD(num_cached_col_chunks_counter_, 1);
+        ++num_cached_readers;
+        RETURN_IF_ERROR(scalar_reader->Reset(&col_chunk.meta_data, NULL, cached_chunk,
+            string()));
+        continue;
+      }
+      ImpaladMetrics::PARQUET_PAGE_CACHE_MISS_COUNT->Increment(1L);
+      if (col_chunk.meta_data.total_uncompressed_size >
+          FLAGS_parquet_page_cache_max_chunk_size) {
+        cache_key.clear();
+      }
+    }
+
     const DiskIoMgr::ScanRange* split_range =
         reinterpret_cast<ScanRangeMetadata*>(metadata_range_->meta_data())->original_split;
 
@@ -2860,7 +4587,8 @@ Status HdfsParquetScanner::InitColumns(
     ScannerContext::Stream* stream = context_->AddStream(col_range);
     DCHECK(stream != NULL);
 
-    RETURN_IF_ERROR(scalar_reader->Reset(&col_chunk.meta_data, stream));
+    RETURN_IF_ERROR(scalar_reader->Reset(&col_chunk.meta_data, stream,
+        boost::shared_ptr<const CachedColumnChunk>(), cache_key));
 
     const SlotDescriptor* slot_desc = scalar_reader->slot_desc();
     if (slot_desc == NULL || !slot_desc->type().IsStringType() ||
@@ -2871,7 +4599,7 @@ Status HdfsParquetScanner::InitColumns(
       stream->set_contains_tuple_data(false);
     }
   }
-  DCHECK_EQ(col_ranges.size(), num_scalar_readers);
+  DCHECK_EQ(col_ranges.size() + num_cached_readers, num_scalar_readers);
 
   // Issue all the column chunks to the io mgr and have them scheduled immediately.
   // This means these ranges aren't returned via DiskIoMgr::GetNextRange and
@@ -2902,7 +4630,7 @@ Status HdfsParquetScanner::CreateSchemaTree(
 
   if (node->element->num_children == 0) {
     // node is a leaf node, meaning it's materialized in the file and appears in
-    // file_metadata_.row_groups.columns
+    // file_metadata_->row_groups.columns
     node->col_idx = *col_idx;
     ++(*col_idx);
   }
@@ -2981,16 +4709,16 @@ bool HdfsParquetScanner::FileVersion::VersionEq(int major, int minor, int patch)
 }
 
 Status HdfsParquetScanner::ValidateFileMetadata() {
-  if (file_metadata_.version > PARQUET_CURRENT_VERSION) {
+  if (file_metadata_->version > PARQUET_CURRENT_VERSION) {
     stringstream ss;
     ss << "File: " << filename() << " is of an unsupported version. "
-       << "file version: " << file_metadata_.version;
+       << "file version: " << file_metadata_->version;
     return Status(ss.str());
   }
 
   // Parse out the created by application version string
-  if (file_metadata_.__isset.created_by) {
-    file_version_ = FileVersion(file_metadata_.created_by);
+  if (file_metadata_->__isset.created_by) {
+    file_version_ = FileVersion(file_metadata_->created_by);
   }
   return Status::OK();
 }
@@ -3012,7 +4740,7 @@ Status HdfsParquetScanner::ValidateColumn(
   int col_idx = col_reader.col_idx();
   const parquet::SchemaElement& schema_element = col_reader.schema_element();
   parquet::ColumnChunk& file_data =
-      file_metadata_.row_groups[row_group_idx].columns[col_idx];
+      file_metadata_->row_groups[row_group_idx].columns[col_idx];
 
   // Check the encodings are supported.
   vector<parquet::Encoding::type>& encodings = file_data.meta_data.encodings;
@@ -3027,9 +4755,14 @@ Status HdfsParquetScanner::ValidateColumn(
   }
 
   // Check the compression is supported.
-  if (file_data.meta_data.codec != parquet::CompressionCodec::UNCOMPRESSED &&
-      file_data.meta_data.codec != parquet::CompressionCodec::SNAPPY &&
-      file_data.meta_data.codec != parquet::CompressionCodec::GZIP) {
+  bool supported_codec =
+      file_data.meta_data.codec == parquet::CompressionCodec::UNCOMPRESSED ||
+      file_data.meta_data.codec == parquet::CompressionCodec::SNAPPY ||
+      file_data.meta_data.codec == parquet::CompressionCodec::GZIP;
+#ifdef IMPALA_HAVE_ZSTD
+  supported_codec |= file_data.meta_data.codec == parquet::CompressionCodec::ZSTD;
+#endif
+  if (!supported_codec) {
     stringstream ss;
     ss << "File '" << filename() << "' uses an unsupported compression: "
         << file_data.meta_data.codec << " for column '" << schema_element.name
@@ -3133,7 +4866,7 @@ Status HdfsParquetScanner::ValidateEndOfRowGroup(
     // These column readers materialize table-level values (vs. collection values). Test
     // if the expected number of rows from the file metadata matches the actual number of
     // rows read from the file.
-    int64_t expected_rows_in_group = file_metadata_.row_groups[row_group_idx].num_rows;
+    int64_t expected_rows_in_group = file_metadata_->row_groups[row_group_idx].num_rows;
     if (rows_read != expected_rows_in_group) {
       return Status(TErrorCode::PARQUET_GROUP_ROW_COUNT_ERROR, filename(), row_group_idx,
           expected_rows_in_group, rows_read);
@@ -16,6 +16,10 @@
 #ifndef IMPALA_EXEC_HDFS_PARQUET_SCANNER_H
 #define IMPALA_EXEC_HDFS_PARQUET_SCANNER_H
 
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include "exec/hdfs-scanner.h"
 #include "exec/parquet-common.h"
 
@@ -23,7 +27,10 @@ namespace impala {
 
 class CollectionValueBuilder;
 struct HdfsFileDesc;
+class MemTracker;
 struct ScratchTupleBatch;
+template <typename Key, typename Value> class LruCache;
+template <typename T> class ThreadPool;
 
 /// This scanner parses Parquet files located in HDFS, and writes the content as tuples in
 /// the Impala in-memory representation of data, e.g.  (tuples, rows, row batches).
@@ -282,6 +289,13 @@ struct ScratchTupleBatch;
 /// scratch batch to an output row batch once all tuples in the scratch batch have either
 /// been filtered or returned as part of an output batch.
 ///
+/// Late materialization (--parquet_late_materialization):
+/// If some top-level scalar columns are not referenced by any conjunct or runtime
+/// filter, the other columns are materialized first and the conjuncts and filters are
+/// evaluated against the partially populated scratch tuples. The remaining columns are
+/// then only materialized for the tuples that passed; their readers decode past the
+/// values of the rejected tuples without writing or converting them.
+///
 /// Collection items:
 /// Unlike the top-level tuples, the item tuples of CollectionValues are populated in
 /// a row-wise fashion because doing it column-wise has the following challenges.
@@ -300,6 +314,57 @@ struct ScratchTupleBatch;
 /// excluded from output. Only partition-column filters are applied at AssembleRows(). The
 /// FilterContexts for these filters are cloned from the parent scan node and attached to
 /// the ScannerContext.
+///
+/// Filters on fully dictionary-encoded columns are instead evaluated once per dictionary
+/// entry when the row group is started (see EvalDictionaryFilters()). If no entry passes,
+/// the row group is skipped. Otherwise the column reader flags the rows whose dictionary
+/// index was rejected while decoding, and the filter is not evaluated per row.
+///
+/// Scanner conjuncts whose only slot is a top-level scalar column, e.g. 'col LIKE
+/// "%abc%"' or 'upper(col) = "ABC"', are evaluated in the same way on fully
+/// dictionary-encoded column chunks (see EvalDictionaryConjuncts()), so that they are
+/// evaluated once per distinct value instead of once per row. This is controlled by
+/// --parquet_dictionary_conjuncts.
+///
+/// ---- Row group and page skipping ----
+/// Conjuncts of the form '<slot> <op> <constant>' on top-level integer columns, where
+/// <op> is a comparison, and '<slot> IS [NOT] NULL' on top-level scalar columns are
+/// tested against the column statistics of each row group before its column ranges
+/// are issued (see RowGroupPassesStatistics()). Row groups that no row can pass are
+/// skipped.
+///
+/// The comparisons are also tested against the min/max statistics of each data page
+/// of the column (see InitStatisticsConjuncts()). A data page whose values cannot satisfy
+/// one of them is neither decompressed nor decoded, and its rows are flagged as rejected
+/// in the scratch batch. The other columns still decode the values of those rows, since
+/// the page boundaries of different columns do not line up.
+///
+/// Conjuncts of the form '<slot> = <constant>' and '<slot> IN (<constants>)' on
+/// top-level integer and string columns are tested against the Bloom filters that
+/// HdfsParquetTableWriter wrote for the column chunks of --parquet_bloom_filter_columns
+/// (see PARQUET_BLOOM_FILTER_KEY and RowGroupPassesBloomFilters()). The filters are read
+/// synchronously after the statistics passed, and a row group is skipped if a filter
+/// contains none of the constants. This helps point lookups by high-cardinality keys,
+/// whose min/max statistics span almost the whole domain in every row group.
+///
+/// ---- Parallel decompression ----
+/// The data pages of all columns are read and decoded by the scanner thread. If
+/// --parquet_decompression_threads is set and the scanner can acquire optional thread
+/// tokens, it starts helper threads that decompress pages ahead of time: whenever a
+/// column reader starts on a data page, it reads the compressed bytes of the column's
+/// next data page and hands them to a helper (see PrefetchNextPage()). The pages of
+/// different columns are thus decompressed concurrently while the scanner thread decodes
+/// the current pages. Only decompression is offloaded; the streams of the column chunks
+/// and the decoding state are only touched by the scanner thread.
+///
+/// ---- Page cache ----
+/// If --parquet_page_cache_capacity is set, the decompressed pages of column chunks that
+/// were read completely are kept in a process-wide LRU cache (see 'page_cache_'). When a
+/// row group is started, InitColumns() looks up each column chunk, and the readers of
+/// cached chunks read their pages from the cache instead of issuing a scan range. The
+/// cached contents are copied into the reader's pools, so row batches never reference
+/// cache entries. The cache's memory is tracked as a child of the process MemTracker and
+/// the cache is emptied if the process memory limit is reached.
 class HdfsParquetScanner : public HdfsScanner {
  public:
   HdfsParquetScanner(HdfsScanNode* scan_node, RuntimeState* state);
@@ -314,6 +379,12 @@ class HdfsParquetScanner : public HdfsScanner {
   static Status IssueInitialRanges(HdfsScanNode* scan_node,
                                    const std::vector<HdfsFileDesc*>& files);
 
+  /// Creates the process-wide page cache if --parquet_page_cache_capacity is positive.
+  /// Its memory is counted against a child of 'process_mem_tracker', and the cache is
+  /// emptied when the process memory limit is reached. Must be called once at startup,
+  /// before any file is scanned.
+  static void InitPageCache(MemTracker* process_mem_tracker);
+
   struct FileVersion {
     /// Application that wrote the file. e.g. "IMPALA"
     std::string application;
@@ -426,10 +497,15 @@ class HdfsParquetScanner : public HdfsScanner {
     /// in filter_ctxs_ should be applied, 0 if it was ineffective and was disabled.
     uint8_t enabled;
 
+    /// Set to 1 if the filter was evaluated on the dictionary of its column for the
+    /// current row group, so it must not be evaluated per row.
+    uint8_t dict_filtered;
+
     /// Padding to ensure structs do not straddle cache-line boundary.
-    uint8_t padding[7];
+    uint8_t padding[6];
 
-    LocalFilterStats() : considered(0), rejected(0), total_possible(0), enabled(1) { }
+    LocalFilterStats()
+      : considered(0), rejected(0), total_possible(0), enabled(1), dict_filtered(0) { }
   };
 
   /// Pool used for allocating caches of definition/repetition levels that are
@@ -441,20 +517,156 @@ class HdfsParquetScanner : public HdfsScanner {
   /// Close().
   vector<LocalFilterStats> filter_stats_;
 
-  /// Column reader for each materialized columns for this file.
+  /// For each filter in filter_ctxs_, the top-level scalar column reader for the slot
+  /// the filter is applied to, or NULL if the filter's expr is not a SlotRef on a
+  /// materialized top-level slot. Used to test min/max filters against row group
+  /// statistics and to evaluate filters on column dictionaries. Set in ProcessSplit().
+  std::vector<BaseScalarColumnReader*> filter_col_readers_;
+
+  /// True if any filter or conjunct was evaluated on a column dictionary for the current
+  /// row group, i.e. ScratchTupleBatch::rejected must be maintained.
+  bool dict_filters_active_;
+
+  /// True if the top-level columns that no conjunct or runtime filter references are
+  /// materialized late, i.e. only for the scratch tuples that passed the conjuncts and
+  /// filters. Set in InitLateMaterialization().
+  bool late_materialization_;
+
+  /// Column reader for each materialized columns for this file. With late
+  /// materialization, the readers of the columns referenced by conjuncts and runtime
+  /// filters come first, followed by the ones that are materialized late.
   std::vector<ColumnReader*> column_readers_;
 
+  /// Number of readers at the start of 'column_readers_' that materialize all values.
+  int num_eager_col_readers_;
+
+  /// A conjunct of the form '<slot> <op> <constant>' on a top-level integer column, which
+  /// can be tested against the min/max statistics of the column.
+  struct MinMaxConjunct {
+    enum Op { LT, LE, EQ, NE, GE, GT };
+
+    /// Reader of the column the slot is materialized from.
+    BaseScalarColumnReader* col_reader;
+    Op op;
+    int64_t value;
+
+    /// Returns false if no value in [min_val, max_val] satisfies the conjunct.
+    bool MayPass(int64_t min_val, int64_t max_val) const;
+  };
+
+  /// A conjunct of the form '<slot> IS [NOT] NULL' on a top-level scalar column, which
+  /// can be tested against the null count statistics of the column.
+  struct NullConjunct {
+    /// Reader of the column the slot is materialized from.
+    BaseScalarColumnReader* col_reader;
+    /// True for IS NULL, false for IS NOT NULL.
+    bool is_null;
+  };
+
+  /// A conjunct of the form '<slot> = <constant>' or '<slot> IN (<constants>)' on a
+  /// top-level column whose type supports Bloom filters, which can be tested against
+  /// the Bloom filters of the column chunks.
+  struct BloomConjunct {
+    /// Reader of the column the slot is materialized from.
+    BaseScalarColumnReader* col_reader;
+    /// See ParquetBloomFilterHashType(). Filters of other hash types are ignored.
+    std::string hash_type;
+    /// The hashes of the non-NULL constants. Rows can only pass if one of them is found.
+    std::vector<uint32_t> hashes;
+  };
+
+  /// The scanner conjuncts that can be tested against column statistics and Bloom
+  /// filters. Set in InitStatisticsConjuncts().
+  std::vector<MinMaxConjunct> min_max_conjuncts_;
+  std::vector<NullConjunct> null_conjuncts_;
+  std::vector<BloomConjunct> bloom_conjuncts_;
+
+  /// A scanner conjunct that can be evaluated on the dictionary of a column, because it
+  /// is deterministic and its only slot is materialized from a top-level scalar column.
+  struct DictConjunct {
+    ExprContext* ctx;
+    /// Reader of the column the slot is materialized from.
+    BaseScalarColumnReader* col_reader;
+  };
+
+  /// Set in InitDictionaryConjuncts().
+  std::vector<DictConjunct> dict_conjuncts_;
+
+  /// The scanner conjuncts that are evaluated per row in the current row group, i.e.
+  /// the ones that were not evaluated on a column dictionary. Set by
+  /// EvalDictionaryConjuncts().
+  std::vector<ExprContext*> row_group_conjunct_ctxs_;
+
+  /// Memory of the scratch tuple that dictionary entries are written into to evaluate
+  /// 'dict_conjuncts_'.
+  std::vector<uint8_t> dict_conjunct_tuple_mem_;
+
   /// Column readers will write slot values into this scratch batch for
   /// top-level tuples. See AssembleRows().
   boost::scoped_ptr<ScratchTupleBatch> scratch_batch_;
 
-  /// File metadata thrift object
-  parquet::FileMetaData file_metadata_;
+  /// The deserialized metadata of a file and its schema tree, whose nodes point into
+  /// 'file_metadata'. Entries of the footer cache are shared by all scanners of the file,
+  /// so a ParsedFooter is immutable once created.
+  struct ParsedFooter {
+    parquet::FileMetaData file_metadata;
+    SchemaNode schema;
+  };
+
+  /// The parsed footer of this file, which may be shared with the footer cache. Set in
+  /// ProcessFooter().
+  boost::shared_ptr<const ParsedFooter> footer_;
+
+  /// Process-wide cache of parsed footers, keyed by the path, modification time and
+  /// length of the file. Bounded by --parquet_footer_cache_capacity.
+  typedef LruCache<std::string, ParsedFooter> FooterCache;
+
+  /// Returns the footer cache, or NULL if it is disabled.
+  static FooterCache* GetFooterCache();
+
+  /// The pages of a column chunk with decompressed contents, in file order, as stored in
+  /// the page cache. Entries are shared by all scanners of the file, so a
+  /// CachedColumnChunk is immutable once it is added to the cache. The page contents are
+  /// counted against 'mem_tracker' until the CachedColumnChunk is destroyed.
+  struct CachedColumnChunk {
+    struct Page {
+      parquet::PageHeader header;
+      std::string data;
+    };
+    std::vector<Page> pages;
+    MemTracker* mem_tracker;
+    /// Total size of the contents of 'pages', consumed from 'mem_tracker'.
+    int64_t bytes;
+
+    CachedColumnChunk(MemTracker* mem_tracker) : mem_tracker(mem_tracker), bytes(0) {}
+    ~CachedColumnChunk();
+  };
+
+  /// Process-wide cache of the decompressed pages of recently read column chunks, keyed
+  /// by the path, modification time and length of the file and the offset of the chunk.
+  /// Bounded by --parquet_page_cache_capacity. NULL if the cache is disabled.
+  typedef LruCache<std::string, CachedColumnChunk> PageCache;
+  static PageCache* page_cache_;
+
+  /// Tracks the memory of the entries of 'page_cache_' and of the chunks that are being
+  /// read to be added to it.
+  static MemTracker* page_cache_mem_tracker_;
+
+  /// Empties the page cache. Registered as a GC function of the process MemTracker.
+  static void GcPageCache();
+
+  /// Adds 'chunk', which was read from the column chunk identified by 'key', to the page
+  /// cache.
+  static void AddToPageCache(const std::string& key,
+      const boost::shared_ptr<const CachedColumnChunk>& chunk);
+
+  /// File metadata thrift object, owned by 'footer_'.
+  const parquet::FileMetaData* file_metadata_;
 
   /// Version of the application that wrote this file.
   FileVersion file_version_;
 
-  /// The root schema node for this file.
+  /// The root schema node for this file, a copy of the schema of 'footer_'.
   SchemaNode schema_;
 
   /// Scan range for the metadata.
@@ -473,6 +685,63 @@ class HdfsParquetScanner : public HdfsScanner {
   /// Number of row groups that need to be read.
   RuntimeProfile::Counter* num_row_groups_counter_;
 
+  /// Number of row groups skipped because their column statistics showed that no row
+  /// could pass a min/max runtime filter.
+  RuntimeProfile::Counter* num_row_groups_filtered_counter_;
+
+  /// Number of row groups skipped because no entry of a column dictionary passed a
+  /// runtime filter.
+  RuntimeProfile::Counter* num_row_groups_dict_filtered_counter_;
+
+  /// Number of per-row conjunct evaluations that were avoided by evaluating conjuncts on
+  /// column dictionaries, net of the evaluations on the dictionary entries.
+  RuntimeProfile::Counter* num_dict_conjunct_evals_saved_counter_;
+
+  /// Number of data pages skipped because their statistics showed that none of their
+  /// rows could pass a conjunct.
+  RuntimeProfile::Counter* num_pages_skipped_counter_;
+
+  /// Number of row groups skipped because their column statistics showed that none of
+  /// their rows could pass a conjunct, and the size of their skipped column chunks.
+  RuntimeProfile::Counter* num_row_groups_skipped_counter_;
+  RuntimeProfile::Counter* bytes_skipped_counter_;
+
+  /// Number of row groups skipped because a Bloom filter of one of their column chunks
+  /// contained none of the constants of a conjunct. Their column chunks are counted in
+  /// 'bytes_skipped_counter_'.
+  RuntimeProfile::Counter* num_row_groups_bloom_filtered_counter_;
+
+  /// Number of data pages decompressed by 'decompression_pool_'.
+  RuntimeProfile::Counter* num_pages_prefetched_counter_;
+
+  /// Number of column chunks read from the page cache instead of the file.
+  RuntimeProfile::Counter* num_cached_col_chunks_counter_;
+
+  /// A data page whose compressed bytes were read by a column reader ahead of time and
+  /// which is decompressed by one of the threads of 'decompression_pool_'.
+  struct PrefetchedPage {
+    /// Set by the scanner thread before the page is offered to the pool. The buffers are
+    /// allocated from the prefetch pool of the column reader.
+    Codec* decompressor;
+    RuntimeProfile::Counter* decompress_timer;
+    const uint8_t* compressed_data;
+    int compressed_size;
+    uint8_t* decompressed_data;
+    int uncompressed_size;
+
+    /// Set by the decompression thread. 'lock' protects 'done'.
+    Status status;
+    bool done;
+    boost::mutex lock;
+    boost::condition_variable done_cv;
+  };
+
+  /// Helper threads that decompress the pages prefetched by the column readers, or NULL
+  /// if the scanner has none. Created in StartDecompressionThreads(), each thread holds
+  /// an optional thread token that is released in Close().
+  boost::scoped_ptr<ThreadPool<PrefetchedPage*> > decompression_pool_;
+  int num_decompression_threads_;
+
   const char* filename() const { return metadata_range_->file(); }
 
   /// Reads data using 'column_readers' to materialize top-level tuples.
@@ -498,15 +767,92 @@ class HdfsParquetScanner : public HdfsScanner {
   /// Evaluates runtime filters and conjuncts (if any) against the tuples in
   /// 'scratch_batch_', and adds the surviving tuples to the output batch.
   /// Transfers the ownership of tuple memory to the output batch when the
-  /// scratch batch is exhausted.
+  /// scratch batch is exhausted. With late materialization the filters and conjuncts
+  /// were already evaluated by EvalScratchTuplePredicates(), so only the tuples that are
+  /// not flagged as rejected are added.
   /// Returns the number of rows that should be committed to the output batch.
   int TransferScratchTuples();
 
+  /// Decides whether late materialization can be used for the current file and, if so,
+  /// reorders 'column_readers_' and sets up the late readers to skip rejected tuples.
+  /// Must be called after the column readers were created.
+  void InitLateMaterialization();
+
+  /// Collects the scanner conjuncts that can be tested against the statistics of their
+  /// column into 'min_max_conjuncts_' and 'null_conjuncts_', and hands the former to the
+  /// column readers so that they can skip data pages. Also collects the conjuncts that
+  /// can be tested against Bloom filters into 'bloom_conjuncts_'. Must be called after
+  /// the column readers were created.
+  void InitStatisticsConjuncts();
+
+  /// Collects the scanner conjuncts that can be evaluated on column dictionaries into
+  /// 'dict_conjuncts_'. Must be called after the column readers were created.
+  void InitDictionaryConjuncts();
+
+  /// Returns true and fills in 'conjunct' if the conjunct 'ctx' can be tested against
+  /// the min/max statistics of a column in 'column_readers_'.
+  bool InitMinMaxConjunct(ExprContext* ctx, MinMaxConjunct* conjunct);
+
+  /// Returns true and fills in 'conjunct' if the conjunct 'ctx' can be tested against
+  /// the null count statistics of a column in 'column_readers_'.
+  bool InitNullConjunct(ExprContext* ctx, NullConjunct* conjunct);
+
+  /// Returns true and fills in 'conjunct' if the conjunct 'ctx' can be tested against
+  /// the Bloom filters of a column in 'column_readers_'.
+  bool InitBloomConjunct(ExprContext* ctx, BloomConjunct* conjunct);
+
+  /// Returns false if the column statistics of 'row_group' show that none of its rows
+  /// can pass one of 'min_max_conjuncts_' or 'null_conjuncts_'.
+  bool RowGroupPassesStatistics(const parquet::RowGroup& row_group);
+
+  /// Reads the Bloom filters of the column chunks of 'row_group' that
+  /// 'bloom_conjuncts_' can be tested against. Sets 'passes' to false if one of the
+  /// filters shows that none of the rows can pass a conjunct.
+  Status RowGroupPassesBloomFilters(const parquet::RowGroup& row_group, bool* passes);
+
+  /// Synchronously reads 'len' bytes at 'offset' of the file of the current split into
+  /// 'buffer', in reads of at most the I/O manager's maximum buffer size.
+  Status ReadFileBytes(int64_t offset, int64_t len, uint8_t* buffer);
+
+  /// Returns the total compressed size of the column chunks of 'row_group' that are
+  /// read by 'column_readers_'.
+  int64_t GetColumnChunksSize(const parquet::RowGroup& row_group);
+
+  /// Returns true if ScratchTupleBatch::rejected must be maintained for the current
+  /// row group, because tuples may be rejected before TransferScratchTuples().
+  bool UsesRejectedFlags() const {
+    return dict_filters_active_ || late_materialization_ || !min_max_conjuncts_.empty();
+  }
+
+  /// Evaluates runtime filters and conjuncts against the tuples in 'scratch_batch_'
+  /// whose slots were materialized by the first 'num_eager_col_readers_' readers, and
+  /// flags the tuples that did not pass in ScratchTupleBatch::rejected.
+  void EvalScratchTuplePredicates();
+
   /// Evaluates runtime filters (if any) against the given row. Returns true if
   /// they passed, false otherwise. Maintains the runtime filter stats, determines
   /// whether the filters are effective, and disables them if they are not.
   bool EvalRuntimeFilters(TupleRow* row);
 
+  /// Returns false if the column statistics of 'row_group' show that none of its rows
+  /// can pass one of the min/max runtime filters that have arrived so far. Only integer
+  /// columns with both min and max statistics are considered.
+  bool RowGroupPassesMinMaxFilters(const parquet::RowGroup& row_group);
+
+  /// Evaluates the runtime filters that have arrived against the dictionaries of the
+  /// fully dictionary-encoded filter columns of 'row_group', which must have been
+  /// initialized with InitColumns(). Sets 'skip_row_group' if no row of the row group can
+  /// pass one of the filters. Otherwise sets up the column readers to flag rejected
+  /// rows while decoding, and marks the filters in 'filter_stats_' as dictionary
+  /// filtered for this row group.
+  Status EvalDictionaryFilters(const parquet::RowGroup& row_group, bool* skip_row_group);
+
+  /// Same as EvalDictionaryFilters() for 'dict_conjuncts_'. Sets
+  /// 'row_group_conjunct_ctxs_' to the scanner conjuncts that must still be evaluated
+  /// per row.
+  Status EvalDictionaryConjuncts(const parquet::RowGroup& row_group,
+      bool* skip_row_group);
+
   /// Reads data using 'column_readers' to materialize the tuples of a CollectionValue
   /// allocated from 'coll_value_builder'.
   ///
@@ -532,6 +878,21 @@ class HdfsParquetScanner : public HdfsScanner {
   inline bool ReadCollectionItem(const std::vector<ColumnReader*>& column_readers,
       bool materialize_tuple, MemPool* pool, Tuple* tuple) const;
 
+  /// Function used by AssembleCollection() to materialize the next 'num_items'
+  /// collection items, as counted by ColumnReader::NumCollectionValuesAhead(), into
+  /// consecutive tuples starting at 'tuple'. Initializes the tuples and then reads each
+  /// column's values in one batch. Returns false if execution should be aborted for some
+  /// reason, otherwise returns true.
+  inline bool ReadCollectionItems(const std::vector<ColumnReader*>& column_readers,
+      const TupleDescriptor* tuple_desc, Tuple* template_tuple, int num_items,
+      MemPool* pool, Tuple* tuple);
+
+  /// Evaluates 'conjunct_ctxs' against the 'num_items' consecutive item tuples starting
+  /// at 'tuple' and moves the tuples that pass to the front, keeping their order.
+  /// Returns the number of tuples that passed.
+  inline int FilterCollectionItems(const TupleDescriptor* tuple_desc,
+      const std::vector<ExprContext*>& conjunct_ctxs, int num_items, Tuple* tuple);
+
   /// Find and return the last split in the file if it is assigned to this scan node.
   /// Returns NULL otherwise.
   static DiskIoMgr::ScanRange* FindFooterSplit(HdfsFileDesc* file);
@@ -545,6 +906,20 @@ class HdfsParquetScanner : public HdfsScanner {
   /// *eosr is a return value.  If true, the scan range is complete (e.g. select count(*))
   Status ProcessFooter(bool* eosr);
 
+  /// Writes 'num_tuples' rows of the template tuple without reading any column data,
+  /// e.g. for a count(*), and adds them to the rows read.
+  Status WriteTuplesFromMetadata(int64_t num_tuples);
+
+  /// Sets 'footer_' to the entry of the process-wide footer cache for this version of the
+  /// file, if the cache is enabled and holds one.
+  void LookupCachedFooter(const HdfsFileDesc* file_desc);
+
+  /// Deserializes the file metadata, which starts at 'metadata_ptr' and spans
+  /// 'metadata_size' bytes, validates it and builds its schema tree. Sets 'footer_' to
+  /// the result and adds it to the footer cache.
+  Status ParseFooter(const HdfsFileDesc* file_desc, uint8_t* metadata_ptr,
+      uint32_t metadata_size);
+
   /// Populates 'column_readers' for the slots in 'tuple_desc', including creating child
   /// readers for any collections. Schema resolution is handled in this function as
   /// well. Fills in the appropriate template tuple slot with NULL for any materialized
@@ -599,6 +974,18 @@ class HdfsParquetScanner : public HdfsScanner {
   Status ValidateEndOfRowGroup(const std::vector<ColumnReader*>& column_readers,
       int row_group_idx, int64_t rows_read);
 
+  /// Starts 'decompression_pool_' with as many threads, up to
+  /// --parquet_decompression_threads, as optional thread tokens can be acquired for.
+  /// Does nothing if the columns of the file are not compressed.
+  void StartDecompressionThreads();
+
+  /// Work function of 'decompression_pool_'.
+  static void DecompressPage(int thread_id, PrefetchedPage* const& page);
+
+  /// Reads the dictionary of each top-level column of the current row group and starts
+  /// decompressing its first data page, if the scanner has decompression threads.
+  Status PrefetchFirstPages();
+
   /// Part of the HdfsScanner interface, not used in Parquet.
   Status InitNewRange() { return Status::OK(); };
 
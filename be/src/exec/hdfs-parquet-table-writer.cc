@@ -17,20 +17,31 @@
 #include "common/version.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
+#include "gutil/bits.h"
 #include "runtime/decimal-value.h"
+#include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/string-value.inline.h"
+#include "runtime/thread-resource-mgr.h"
 #include "util/bit-stream-utils.h"
 #include "util/bit-util.h"
+#include "util/bloom-filter.h"
 #include "util/buffer-builder.h"
 #include "util/compress.h"
 #include "util/debug-util.h"
 #include "util/dict-encoding.h"
 #include "util/hdfs-util.h"
+#include "util/min-max-filter.h"
 #include "util/rle-encoding.h"
+#include "util/thread-pool.h"
 #include "rpc/thrift-util.h"
 
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <gflags/gflags.h>
+#include <gutil/strings/substitute.h>
+#include <limits>
 #include <sstream>
 
 #include "gen-cpp/ImpalaService_types.h"
@@ -39,6 +50,44 @@
 using namespace impala;
 using namespace parquet;
 using namespace apache::thrift;
+using namespace strings;
+using boost::algorithm::is_any_of;
+using boost::algorithm::split;
+using boost::algorithm::to_lower;
+using boost::algorithm::trim;
+
+DEFINE_bool(parquet_adaptive_dictionary_encoding, false, "(Advanced) When true, the "
+    "Parquet writer stops dictionary encoding a column early in each row group if more "
+    "than --parquet_max_dictionary_distinct_ratio of the first values of the row group "
+    "are distinct, instead of building a dictionary until it is full.");
+
+DEFINE_double(parquet_max_dictionary_distinct_ratio, 0.5, "(Advanced) See "
+    "--parquet_adaptive_dictionary_encoding.");
+
+DEFINE_int32(parquet_writer_compression_threads, 0, "(Advanced) Maximum number of "
+    "helper threads per Parquet writer that compress finished data pages while the sink "
+    "thread keeps encoding rows. Helper threads are only started if optional thread "
+    "tokens are available. 0 compresses pages on the sink thread.");
+
+DEFINE_bool(parquet_sort_dictionaries, false, "(Advanced) When true, the Parquet writer "
+    "sorts the dictionary of each column chunk. Sorted dictionaries and their indices "
+    "compress better, but the dictionary encoded data pages of a row group are only "
+    "encoded and compressed when the row group is flushed.");
+
+DEFINE_string(parquet_bloom_filter_columns, "", "(Advanced) Comma-separated list of "
+    "the columns for which the Parquet writer writes a Bloom filter of each column chunk "
+    "that is not entirely dictionary encoded, e.g. high-cardinality keys of point "
+    "lookups. Scans skip the row groups whose Bloom filters reject the constants of "
+    "equality and IN predicates. Only integer and STRING/VARCHAR columns are supported.");
+
+DEFINE_double(parquet_bloom_filter_fpp, 0.05, "(Advanced) The false positive "
+    "probability that the Parquet writer sizes the Bloom filters of "
+    "--parquet_bloom_filter_columns for.");
+
+DEFINE_int32(parquet_bloom_filter_max_bytes, 1024 * 1024, "(Advanced) Maximum size of a "
+    "Bloom filter of a Parquet column chunk, rounded down to a power of two. Column "
+    "chunks with more distinct values than a filter of this size holds at "
+    "--parquet_bloom_filter_fpp get no filter.");
 
 // Managing file sizes: We need to estimate how big the files being buffered
 // are in order to split them correctly in HDFS. Having a file that is too big
@@ -87,7 +136,16 @@ class HdfsParquetTableWriter::BaseColumnWriter {
       page_size_(DEFAULT_DATA_PAGE_SIZE), current_page_(NULL), num_values_(0),
       total_compressed_byte_size_(0),
       total_uncompressed_byte_size_(0),
+      plain_encoding_used_(false),
+      num_nulls_(0),
+      row_group_min_(std::numeric_limits<int64_t>::max()),
+      row_group_max_(std::numeric_limits<int64_t>::min()),
       dict_encoder_base_(NULL),
+      sort_dictionary_(FLAGS_parquet_sort_dictionaries),
+      pending_page_idx_(-1),
+      pending_page_estimate_(0),
+      write_bloom_filter_(false),
+      bloom_filter_overflowed_(false),
       def_levels_(NULL),
       values_buffer_len_(DEFAULT_DATA_PAGE_SIZE) {
     Codec::CreateCompressor(NULL, false, codec, &compressor_);
@@ -96,6 +154,7 @@ class HdfsParquetTableWriter::BaseColumnWriter {
         new RleEncoder(parent_->reusable_col_mem_pool_->Allocate(DEFAULT_DATA_PAGE_SIZE),
                        DEFAULT_DATA_PAGE_SIZE, 1));
     values_buffer_ = parent_->reusable_col_mem_pool_->Allocate(values_buffer_len_);
+    if (MinMaxFilter::SupportsType(type())) page_stats_.reset(new MinMaxFilter(type()));
   }
 
   virtual ~BaseColumnWriter() {}
@@ -127,11 +186,18 @@ class HdfsParquetTableWriter::BaseColumnWriter {
     num_values_ = 0;
     total_compressed_byte_size_ = 0;
     current_encoding_ = Encoding::PLAIN;
+    plain_encoding_used_ = false;
+    num_nulls_ = 0;
+    row_group_min_ = std::numeric_limits<int64_t>::max();
+    row_group_max_ = std::numeric_limits<int64_t>::min();
+    bloom_hashes_.clear();
+    bloom_filter_overflowed_ = false;
   }
 
   // Close this writer. This is only called after Flush() and no more rows will
   // be added.
   void Close() {
+    FinishPendingPage();
     if (compressor_.get() != NULL) compressor_->Close();
     if (dict_encoder_base_ != NULL) dict_encoder_base_->ClearIndices();
   }
@@ -140,8 +206,14 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   uint64_t num_values() const { return num_values_; }
   uint64_t total_compressed_size() const { return total_compressed_byte_size_; }
   uint64_t total_uncompressed_size() const { return total_uncompressed_byte_size_; }
+  bool plain_encoding_used() const { return plain_encoding_used_; }
+
+  // Returns the statistics of the values appended since the last Reset(). The null count
+  // is always set, min and max only for integer columns with non-NULL values. Must be
+  // called after Flush().
+  Statistics GetStatistics() const;
   parquet::CompressionCodec::type codec() const {
-    return IMPALA_TO_PARQUET_CODEC[codec_];
+    return ImpalaToParquetCodec(codec_);
   }
 
  protected:
@@ -164,6 +236,46 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   // Writes out the dictionary encoded data buffered in dict_encoder_.
   void WriteDictDataPage();
 
+  // Combines the definition levels 'def_levels' of 'def_levels_len' bytes and the values
+  // in values_buffer_ into the contents of current_page_, compresses them and updates
+  // the sizes. Returns the size of the page in the file, including its header. If the
+  // page is compressed by the parent's compression threads, it becomes the pending page
+  // and an estimate of its size is returned instead, which FinishPendingPage() corrects.
+  int64_t EncodeCurrentPage(const uint8_t* def_levels, int def_levels_len);
+
+  // Waits for the pending page, if any, to be compressed and updates its sizes. Errors
+  // are kept in compression_status_.
+  void FinishPendingPage();
+
+  // If sort_dictionary_ is set, sorts the dictionary and encodes the dictionary encoded
+  // pages whose encoding was deferred by FinalizeCurrentPage().
+  void FinalizeDeferredPages();
+
+  // Adds the hash of the non-NULL 'value' to bloom_hashes_.
+  void AddBloomFilterHash(const void* value) {
+    if (bloom_filter_overflowed_) return;
+    uint32_t hash = RawValue::GetHashValue(value, type(), PARQUET_BLOOM_FILTER_SEED);
+    // Skips runs of equal values, which are common in sorted or clustered columns.
+    if (!bloom_hashes_.empty() && bloom_hashes_.back() == hash) return;
+    bloom_hashes_.push_back(hash);
+    if (bloom_hashes_.size() >= 2 * parent_->bloom_filter_max_ndv_) {
+      CompactBloomFilterHashes();
+    }
+  }
+
+  // Sorts and deduplicates bloom_hashes_. Gives up the Bloom filter of this column chunk
+  // if it has more distinct values than the largest filter holds at the configured
+  // false positive probability, which bounds the memory of bloom_hashes_.
+  void CompactBloomFilterHashes() {
+    sort(bloom_hashes_.begin(), bloom_hashes_.end());
+    bloom_hashes_.erase(unique(bloom_hashes_.begin(), bloom_hashes_.end()),
+        bloom_hashes_.end());
+    if (bloom_hashes_.size() > parent_->bloom_filter_max_ndv_) {
+      bloom_filter_overflowed_ = true;
+      vector<uint32_t>().swap(bloom_hashes_);
+    }
+  }
+
   struct DataPage {
     // Page header.  This is a union of all page types.
     PageHeader header;
@@ -182,6 +294,13 @@ class HdfsParquetTableWriter::BaseColumnWriter {
 
     // Number of non-null values
     int num_non_null;
+
+    // True if this is a dictionary encoded page whose data is only encoded once the
+    // dictionary is sorted, see sort_dictionary_. Until then, the dictionary indices of
+    // its values and its definition levels are kept in the following vectors.
+    bool deferred;
+    vector<int> deferred_indices;
+    vector<uint8_t> deferred_def_levels;
   };
 
   HdfsParquetTableWriter* parent_;
@@ -211,9 +330,46 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   int64_t total_uncompressed_byte_size_;
   Encoding::type current_encoding_;
 
+  // True if a data page with PLAIN encoded values was written since the last Reset().
+  // Pages of only NULLs are PLAIN encoded too, but hold no values.
+  bool plain_encoding_used_;
+
+  // Number of NULLs appended since the last Reset().
+  int64_t num_nulls_;
+
+  // Min and max of the non-NULL values in the finalized pages since the last Reset().
+  // Only maintained if page_stats_ is set. row_group_min_ > row_group_max_ if there
+  // were no such values.
+  int64_t row_group_min_;
+  int64_t row_group_max_;
+
   // Created and set by the base class.
   DictEncoderBase* dict_encoder_base_;
 
+  // If true, the dictionary is sorted before it is written out. Since this changes the
+  // indices of its entries, dictionary encoded pages are only encoded by Flush().
+  bool sort_dictionary_;
+
+  // The page whose compression was offered to the parent's compression threads, as an
+  // index into pages_, or -1. 'pending_page_estimate_' is the size EncodeCurrentPage()
+  // returned for it. Only one page per column is in flight, so 'compression_input_' can
+  // be reused as the uncompressed input of every page.
+  int pending_page_idx_;
+  int64_t pending_page_estimate_;
+  HdfsParquetTableWriter::CompressionTask compression_task_;
+  vector<uint8_t> compression_input_;
+
+  // The first error returned by an asynchronous compression. Returned by Flush().
+  Status compression_status_;
+
+  // If true, the hashes of the values appended since the last Reset() are collected in
+  // bloom_hashes_ for the Bloom filter of the column chunk, which the parent writes
+  // with WriteBloomFilter(). 'bloom_filter_overflowed_' is set if the chunk has too
+  // many distinct values for a filter.
+  bool write_bloom_filter_;
+  bool bloom_filter_overflowed_;
+  vector<uint32_t> bloom_hashes_;
+
   // Rle encoder object for storing definition levels. For non-nested schemas,
   // this always uses 1 bit per row.
   // This is reused across pages since the underlying buffer is copied out when
@@ -224,6 +380,10 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   uint8_t* values_buffer_;
   // The size of values_buffer_.
   int values_buffer_len_;
+
+  // Min and max of the values in the current page, written to the page header so that
+  // readers can skip pages. Only set for integer columns.
+  scoped_ptr<MinMaxFilter> page_stats_;
 };
 
 // Per type column writer.
@@ -233,7 +393,8 @@ class HdfsParquetTableWriter::ColumnWriter :
  public:
   ColumnWriter(HdfsParquetTableWriter* parent, ExprContext* ctx,
       const THdfsCompression::type& codec) : BaseColumnWriter(parent, ctx, codec),
-      num_values_since_dict_size_check_(0) {
+      num_values_since_dict_size_check_(0),
+      num_dict_values_(0) {
     DCHECK_NE(ctx->root()->type().type, TYPE_BOOLEAN);
     encoded_value_size_ = ParquetPlainEncoder::ByteSize(ctx->root()->type());
   }
@@ -246,6 +407,8 @@ class HdfsParquetTableWriter::ColumnWriter :
     dict_encoder_.reset(
         new DictEncoder<T>(parent_->per_file_mem_pool_.get(), encoded_value_size_));
     dict_encoder_base_ = dict_encoder_.get();
+    num_values_since_dict_size_check_ = 0;
+    num_dict_values_ = 0;
   }
 
  protected:
@@ -254,9 +417,20 @@ class HdfsParquetTableWriter::ColumnWriter :
       if (UNLIKELY(num_values_since_dict_size_check_ >=
                    DICTIONARY_DATA_PAGE_SIZE_CHECK_PERIOD)) {
         num_values_since_dict_size_check_ = 0;
+        if (UNLIKELY(num_dict_values_ == ADAPTIVE_DICTIONARY_SAMPLE_SIZE) &&
+            FLAGS_parquet_adaptive_dictionary_encoding &&
+            dict_encoder_->num_entries() >
+                FLAGS_parquet_max_dictionary_distinct_ratio * num_dict_values_) {
+          // Too many distinct values for the dictionary to pay off, switch to plain
+          // encoding like below.
+          FinalizeCurrentPage();
+          current_encoding_ = Encoding::PLAIN;
+          return false;
+        }
         if (dict_encoder_->EstimatedDataEncodedSize() >= page_size_) return false;
       }
       ++num_values_since_dict_size_check_;
+      ++num_dict_values_;
       *bytes_needed = dict_encoder_->Put(*CastValue(value));
       // If the dictionary contains the maximum number of values, switch to plain
       // encoding.  The current dictionary encoded page is written out.
@@ -295,12 +469,20 @@ class HdfsParquetTableWriter::ColumnWriter :
   // TODO: is there a better way?
   static const int DICTIONARY_DATA_PAGE_SIZE_CHECK_PERIOD = 100;
 
+  // With --parquet_adaptive_dictionary_encoding, the number of values of a row group
+  // after which the ratio of distinct values is checked. Must be a multiple of
+  // DICTIONARY_DATA_PAGE_SIZE_CHECK_PERIOD.
+  static const int ADAPTIVE_DICTIONARY_SAMPLE_SIZE = 100 * 100;
+
   // Encoder for dictionary encoding for different columns. Only one is set.
   scoped_ptr<DictEncoder<T> > dict_encoder_;
 
   // The number of values added since we last checked the dictionary.
   int num_values_since_dict_size_check_;
 
+  // The number of values added to the dictionary encoder since the last Reset().
+  int64_t num_dict_values_;
+
   // Size of each encoded value. -1 if the size is type is variable-length.
   int64_t encoded_value_size_;
 
@@ -365,6 +547,7 @@ class HdfsParquetTableWriter::BoolColumnWriter :
 inline Status HdfsParquetTableWriter::BaseColumnWriter::AppendRow(TupleRow* row) {
   ++num_values_;
   void* value = expr_ctx_->GetValue(row);
+  if (value == NULL) ++num_nulls_;
   if (current_page_ == NULL) NewPage();
 
   // We might need to try again if this current page is not big enough
@@ -381,7 +564,11 @@ inline Status HdfsParquetTableWriter::BaseColumnWriter::AppendRow(TupleRow* row)
     ++current_page_->num_non_null;
 
     int64_t bytes_needed = 0;
-    if (EncodeValue(value, &bytes_needed)) break;
+    if (EncodeValue(value, &bytes_needed)) {
+      if (page_stats_.get() != NULL) page_stats_->Insert(value);
+      if (write_bloom_filter_) AddBloomFilterHash(value);
+      break;
+    }
 
     // Value didn't fit on page, try again on a new page.
     FinalizeCurrentPage();
@@ -433,6 +620,10 @@ Status HdfsParquetTableWriter::BaseColumnWriter::Flush(int64_t* file_pos,
   }
 
   FinalizeCurrentPage();
+  FinalizeDeferredPages();
+  // The dictionary page below is compressed with the same compressor.
+  FinishPendingPage();
+  RETURN_IF_ERROR(compression_status_);
 
   *first_dictionary_page = -1;
   // First write the dictionary page before any of the data pages.
@@ -513,6 +704,30 @@ Status HdfsParquetTableWriter::BaseColumnWriter::Flush(int64_t* file_pos,
   return Status::OK();
 }
 
+namespace {
+
+// Returns 'val' plain encoded as a statistics value of an integer column of 'type'.
+// TINYINT and SMALLINT are stored as INT32.
+string EncodeIntStatistic(const ColumnType& type, int64_t val) {
+  if (type.type == TYPE_BIGINT) {
+    return string(reinterpret_cast<const char*>(&val), sizeof(val));
+  }
+  int32_t v = val;
+  return string(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+}
+
+Statistics HdfsParquetTableWriter::BaseColumnWriter::GetStatistics() const {
+  Statistics stats;
+  stats.__set_null_count(num_nulls_);
+  if (row_group_min_ <= row_group_max_) {
+    stats.__set_min(EncodeIntStatistic(type(), row_group_min_));
+    stats.__set_max(EncodeIntStatistic(type(), row_group_max_));
+  }
+  return stats;
+}
+
 void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
   DCHECK(current_page_ != NULL);
   if (current_page_->finalized) return;
@@ -522,21 +737,65 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
   // around a parquet MR bug (see IMPALA-759 for more details).
   if (current_page_->num_non_null == 0) current_encoding_ = Encoding::PLAIN;
 
-  if (current_encoding_ == Encoding::PLAIN_DICTIONARY) WriteDictDataPage();
+  bool defer_page = current_encoding_ == Encoding::PLAIN_DICTIONARY && sort_dictionary_;
+  if (current_encoding_ == Encoding::PLAIN_DICTIONARY) {
+    if (!defer_page) WriteDictDataPage();
+  } else if (current_page_->num_non_null > 0) {
+    plain_encoding_used_ = true;
+  }
 
   PageHeader& header = current_page_->header;
   header.data_page_header.encoding = current_encoding_;
+  if (page_stats_.get() != NULL && !page_stats_->IsEmpty()) {
+    Statistics stats;
+    stats.__set_min(EncodeIntStatistic(type(), page_stats_->min()));
+    stats.__set_max(EncodeIntStatistic(type(), page_stats_->max()));
+    header.data_page_header.__set_statistics(stats);
+    row_group_min_ = min(row_group_min_, page_stats_->min());
+    row_group_max_ = max(row_group_max_, page_stats_->max());
+  } else {
+    // Pages are reused, clear the statistics of a previous page.
+    header.data_page_header.__isset.statistics = false;
+  }
 
-  // Compute size of definition bits
   def_levels_->Flush();
-  current_page_->num_def_bytes = sizeof(int32_t) + def_levels_->len();
+  if (defer_page) {
+    // Keep the indices and levels until the sorted dictionary is known. The file size
+    // estimate assumes that the page does not compress.
+    parent_->file_size_estimate_ += sizeof(int32_t) + def_levels_->len() +
+        dict_encoder_base_->EstimatedDataEncodedSize();
+    dict_encoder_base_->SwapIndices(&current_page_->deferred_indices);
+    current_page_->deferred_def_levels.assign(
+        def_levels_->buffer(), def_levels_->buffer() + def_levels_->len());
+    current_page_->deferred = true;
+  } else {
+    parent_->file_size_estimate_ +=
+        EncodeCurrentPage(def_levels_->buffer(), def_levels_->len());
+  }
+  current_page_->finalized = true;
+  def_levels_->Clear();
+}
+
+int64_t HdfsParquetTableWriter::BaseColumnWriter::EncodeCurrentPage(
+    const uint8_t* def_levels, int def_levels_len) {
+  PageHeader& header = current_page_->header;
+  // Compute size of definition bits
+  current_page_->num_def_bytes = sizeof(int32_t) + def_levels_len;
   header.uncompressed_page_size += current_page_->num_def_bytes;
 
+  bool compress_async =
+      compressor_.get() != NULL && parent_->compression_pool_.get() != NULL;
+  // The previous page is still using the compressor and the staging buffer.
+  if (compress_async) FinishPendingPage();
+
   // At this point we know all the data for the data page.  Combine them into one buffer.
   uint8_t* uncompressed_data = NULL;
   if (compressor_.get() == NULL) {
     uncompressed_data =
         parent_->per_file_mem_pool_->Allocate(header.uncompressed_page_size);
+  } else if (compress_async) {
+    compression_input_.resize(header.uncompressed_page_size);
+    uncompressed_data = &compression_input_[0];
   } else {
     // We have compression.  Combine into the staging buffer.
     parent_->compression_staging_buffer_.resize(
@@ -547,10 +806,8 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
   BufferBuilder buffer(uncompressed_data, header.uncompressed_page_size);
 
   // Copy the definition (null) data
-  int num_def_level_bytes = def_levels_->len();
-
-  buffer.Append(num_def_level_bytes);
-  buffer.Append(def_levels_->buffer(), num_def_level_bytes);
+  buffer.Append(def_levels_len);
+  buffer.Append(def_levels, def_levels_len);
   // TODO: copy repetition data when we support nested types.
   buffer.Append(values_buffer_, buffer.capacity() - buffer.size());
 
@@ -558,6 +815,30 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
   if (compressor_.get() == NULL) {
     current_page_->data = reinterpret_cast<uint8_t*>(uncompressed_data);
     header.compressed_page_size = header.uncompressed_page_size;
+  } else if (compress_async) {
+    int64_t max_compressed_size =
+        compressor_->MaxOutputLen(header.uncompressed_page_size);
+    DCHECK_GT(max_compressed_size, 0);
+    // The unused part of the output buffer cannot be returned to the pool, since other
+    // allocations may follow it by the time the page is compressed.
+    current_page_->data = parent_->per_file_mem_pool_->Allocate(max_compressed_size);
+    CompressionTask* task = &compression_task_;
+    task->compressor = compressor_.get();
+    task->compress_timer = parent_->parent_->compress_timer();
+    task->input = uncompressed_data;
+    task->input_len = header.uncompressed_page_size;
+    task->output = current_page_->data;
+    task->output_len = max_compressed_size;
+    task->status = Status::OK();
+    task->done = false;
+    pending_page_idx_ = current_page_ - &pages_[0];
+    // Until the compressed size is known, assume the page does not compress.
+    pending_page_estimate_ = header.uncompressed_page_size;
+    if (!parent_->compression_pool_->Offer(task)) {
+      task->status = Status("Parquet compression threads were shut down.");
+      task->done = true;
+    }
+    return pending_page_estimate_;
   } else {
     SCOPED_TIMER(parent_->parent_->compress_timer());
     int64_t max_compressed_size =
@@ -581,11 +862,67 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
   parent_->thrift_serializer_->Serialize(
       &current_page_->header, &header_len, &header_buffer);
 
-  current_page_->finalized = true;
   total_compressed_byte_size_ += header_len + header.compressed_page_size;
   total_uncompressed_byte_size_ += header_len + header.uncompressed_page_size;
-  parent_->file_size_estimate_ += header_len + header.compressed_page_size;
-  def_levels_->Clear();
+  return header_len + header.compressed_page_size;
+}
+
+void HdfsParquetTableWriter::BaseColumnWriter::FinishPendingPage() {
+  if (pending_page_idx_ < 0) return;
+  CompressionTask* task = &compression_task_;
+  {
+    boost::unique_lock<boost::mutex> l(task->lock);
+    while (!task->done) task->done_cv.wait(l);
+  }
+  DataPage* page = &pages_[pending_page_idx_];
+  pending_page_idx_ = -1;
+  if (!task->status.ok()) {
+    if (compression_status_.ok()) compression_status_ = task->status;
+    return;
+  }
+  PageHeader& header = page->header;
+  header.compressed_page_size = task->output_len;
+
+  uint8_t* header_buffer;
+  uint32_t header_len = 0;
+  parent_->thrift_serializer_->Serialize(&header, &header_len, &header_buffer);
+  total_compressed_byte_size_ += header_len + header.compressed_page_size;
+  total_uncompressed_byte_size_ += header_len + header.uncompressed_page_size;
+  parent_->file_size_estimate_ +=
+      header_len + header.compressed_page_size - pending_page_estimate_;
+}
+
+void HdfsParquetTableWriter::CompressPage(int thread_id, CompressionTask* const& task) {
+  Status status;
+  {
+    SCOPED_TIMER(task->compress_timer);
+    status = task->compressor->ProcessBlock32(true, task->input_len, task->input,
+        &task->output_len, &task->output);
+  }
+  boost::lock_guard<boost::mutex> l(task->lock);
+  task->status = status;
+  task->done = true;
+  task->done_cv.notify_one();
+}
+
+void HdfsParquetTableWriter::BaseColumnWriter::FinalizeDeferredPages() {
+  if (!sort_dictionary_ || dict_encoder_base_ == NULL) return;
+  vector<int> new_indices;
+  dict_encoder_base_->SortDictionary(&new_indices);
+  DataPage* last_page = current_page_;
+  for (int i = 0; i < num_data_pages_; ++i) {
+    if (!pages_[i].deferred) continue;
+    current_page_ = &pages_[i];
+    for (int& index: current_page_->deferred_indices) index = new_indices[index];
+    dict_encoder_base_->SwapIndices(&current_page_->deferred_indices);
+    WriteDictDataPage();
+    EncodeCurrentPage(current_page_->deferred_def_levels.data(),
+        current_page_->deferred_def_levels.size());
+    current_page_->deferred = false;
+    current_page_->deferred_indices.clear();
+    current_page_->deferred_def_levels.clear();
+  }
+  current_page_ = last_page;
 }
 
 void HdfsParquetTableWriter::BaseColumnWriter::NewPage() {
@@ -606,7 +943,9 @@ void HdfsParquetTableWriter::BaseColumnWriter::NewPage() {
     current_page_->header.__set_data_page_header(header);
   }
   current_page_->finalized = false;
+  current_page_->deferred = false;
   current_page_->num_non_null = 0;
+  if (page_stats_.get() != NULL) page_stats_.reset(new MinMaxFilter(type()));
 }
 
 HdfsParquetTableWriter::HdfsParquetTableWriter(HdfsTableSink* parent, RuntimeState* state,
@@ -620,7 +959,11 @@ HdfsParquetTableWriter::HdfsParquetTableWriter(HdfsTableSink* parent, RuntimeSta
       file_size_limit_(0),
       reusable_col_mem_pool_(new MemPool(parent_->mem_tracker())),
       per_file_mem_pool_(new MemPool(parent_->mem_tracker())),
-      row_idx_(0) {
+      row_idx_(0),
+      num_bloom_filter_columns_(0),
+      bloom_filter_max_log_space_(0),
+      bloom_filter_max_ndv_(0),
+      num_compression_threads_(0) {
 }
 
 HdfsParquetTableWriter::~HdfsParquetTableWriter() {
@@ -642,9 +985,12 @@ Status HdfsParquetTableWriter::Init() {
   if (query_options.__isset.compression_codec) {
     codec = query_options.compression_codec;
   }
-  if (!(codec == THdfsCompression::NONE ||
-        codec == THdfsCompression::GZIP ||
-        codec == THdfsCompression::SNAPPY)) {
+  bool supported_codec = codec == THdfsCompression::NONE ||
+      codec == THdfsCompression::GZIP || codec == THdfsCompression::SNAPPY;
+#ifdef IMPALA_HAVE_ZSTD
+  supported_codec |= codec == THdfsCompression::ZSTD;
+#endif
+  if (!supported_codec) {
     stringstream ss;
     ss << "Invalid parquet compression codec " << Codec::GetCodecName(codec);
     return Status(ss.str());
@@ -720,10 +1066,83 @@ Status HdfsParquetTableWriter::Init() {
     columns_[i] = state_->obj_pool()->Add(writer);
     columns_[i]->Reset();
   }
+  InitBloomFilterColumns();
   RETURN_IF_ERROR(CreateSchema());
+  StartCompressionThreads(codec);
+  return Status::OK();
+}
+
+void HdfsParquetTableWriter::InitBloomFilterColumns() {
+  if (FLAGS_parquet_bloom_filter_columns.empty()) return;
+  vector<string> names;
+  split(names, FLAGS_parquet_bloom_filter_columns, is_any_of(","));
+  for (string& name: names) {
+    trim(name);
+    to_lower(name);
+  }
+  int num_clustering_cols = table_desc_->num_clustering_cols();
+  for (int i = 0; i < columns_.size(); ++i) {
+    const string& name = table_desc_->col_descs()[i + num_clustering_cols].name();
+    if (find(names.begin(), names.end(), name) == names.end()) continue;
+    if (ParquetBloomFilterHashType(columns_[i]->type()).empty()) {
+      VLOG_QUERY << "Not writing Bloom filters of Parquet column " << name << " of "
+                 << "unsupported type " << columns_[i]->type();
+      continue;
+    }
+    columns_[i]->write_bloom_filter_ = true;
+    ++num_bloom_filter_columns_;
+  }
+  // Smaller filters would not be worth the read.
+  bloom_filter_max_log_space_ =
+      Bits::Log2Floor(max(FLAGS_parquet_bloom_filter_max_bytes, 4 * 1024));
+  bloom_filter_max_ndv_ =
+      BloomFilter::MaxNdv(bloom_filter_max_log_space_, FLAGS_parquet_bloom_filter_fpp);
+}
+
+Status HdfsParquetTableWriter::WriteBloomFilter(BaseColumnWriter* column,
+    ColumnMetaData* metadata) {
+  // A chunk that is entirely dictionary encoded is skipped with its dictionary instead,
+  // which is exact.
+  if (!column->plain_encoding_used()) return Status::OK();
+  column->CompactBloomFilterHashes();
+  if (column->bloom_filter_overflowed_ || column->bloom_hashes_.empty()) {
+    return Status::OK();
+  }
+  int log_heap_space = min(bloom_filter_max_log_space_, BloomFilter::MinLogSpace(
+      column->bloom_hashes_.size(), FLAGS_parquet_bloom_filter_fpp));
+  BloomFilter filter(log_heap_space);
+  for (uint32_t hash: column->bloom_hashes_) filter.Insert(hash);
+  TBloomFilter thrift_filter;
+  BloomFilter::ToThrift(&filter, &thrift_filter);
+  const string& directory = thrift_filter.directory;
+  RETURN_IF_ERROR(Write(directory.data(), directory.size()));
+
+  KeyValue location;
+  location.key = PARQUET_BLOOM_FILTER_KEY;
+  location.__set_value(Substitute("$0:$1:$2", file_pos_, thrift_filter.log_heap_space,
+      ParquetBloomFilterHashType(column->type())));
+  metadata->key_value_metadata.push_back(location);
+  metadata->__isset.key_value_metadata = true;
+  file_pos_ += directory.size();
   return Status::OK();
 }
 
+void HdfsParquetTableWriter::StartCompressionThreads(THdfsCompression::type codec) {
+  if (FLAGS_parquet_writer_compression_threads <= 0) return;
+  if (codec == THdfsCompression::NONE || columns_.empty()) return;
+  int max_threads =
+      min<int>(FLAGS_parquet_writer_compression_threads, columns_.size());
+  while (num_compression_threads_ < max_threads &&
+      state_->resource_pool()->TryAcquireThreadToken()) {
+    ++num_compression_threads_;
+  }
+  if (num_compression_threads_ == 0) return;
+  // At most one page per column is in flight, so Offer() never blocks.
+  compression_pool_.reset(new ThreadPool<CompressionTask*>("parquet-writer",
+      "parquet-compression", num_compression_threads_, columns_.size(),
+      &HdfsParquetTableWriter::CompressPage));
+}
+
 Status HdfsParquetTableWriter::CreateSchema() {
   int num_clustering_cols = table_desc_->num_clustering_cols();
 
@@ -770,13 +1189,7 @@ Status HdfsParquetTableWriter::AddRowGroup() {
   for (int i = 0; i < columns_.size(); ++i) {
     ColumnMetaData metadata;
     metadata.type = IMPALA_TO_PARQUET_TYPES[columns_[i]->expr_ctx_->root()->type().type];
-    // Add all encodings that were used in this file.  Currently we use PLAIN and
-    // PLAIN_DICTIONARY for data values and RLE for the definition levels.
-    metadata.encodings.push_back(Encoding::RLE);
-    // Columns are initially dictionary encoded
-    // TODO: we might not have PLAIN encoding in this case
-    metadata.encodings.push_back(Encoding::PLAIN_DICTIONARY);
-    metadata.encodings.push_back(Encoding::PLAIN);
+    // The encodings are added in FlushCurrentRowGroup() once they are known.
     metadata.path_in_schema.push_back(
         table_desc_->col_descs()[i + num_clustering_cols].name());
     metadata.codec = columns_[i]->codec();
@@ -788,7 +1201,12 @@ Status HdfsParquetTableWriter::AddRowGroup() {
 
 int64_t HdfsParquetTableWriter::MinBlockSize() const {
   // See file_size_limit_ calculation in InitNewFile().
-  return 3 * DEFAULT_DATA_PAGE_SIZE * columns_.size();
+  return 3 * DEFAULT_DATA_PAGE_SIZE * columns_.size() + BloomFilterReservation();
+}
+
+int64_t HdfsParquetTableWriter::BloomFilterReservation() const {
+  if (num_bloom_filter_columns_ == 0) return 0;
+  return num_bloom_filter_columns_ * (1LL << bloom_filter_max_log_space_);
 }
 
 uint64_t HdfsParquetTableWriter::default_block_size() const {
@@ -833,7 +1251,8 @@ Status HdfsParquetTableWriter::InitNewFile() {
   // pages, means we stop 800KB shy of the limit.
   // Data pages calculate their size precisely when they are complete so having
   // a two page buffer guarantees we will never go over (unless there are huge values
-  // that require increasing the page size).
+  // that require increasing the page size). The largest Bloom filters of the columns
+  // that have them are reserved too, since they are only written with the row group.
   // TODO: this should be made dynamic based on the size of rows seen so far.
   // This would for example, let us account for very long string columns.
   if (file_size_limit_ < MinBlockSize()) {
@@ -843,7 +1262,8 @@ Status HdfsParquetTableWriter::InitNewFile() {
        << "PARQUET_FILE_SIZE to at least " << MinBlockSize() << ".";
     return Status(ss.str());
   }
-  file_size_limit_ -= 2 * DEFAULT_DATA_PAGE_SIZE * columns_.size();
+  file_size_limit_ -=
+      2 * DEFAULT_DATA_PAGE_SIZE * columns_.size() + BloomFilterReservation();
   DCHECK_GE(file_size_limit_, DEFAULT_DATA_PAGE_SIZE * columns_.size());
   file_pos_ = 0;
   row_count_ = 0;
@@ -909,6 +1329,16 @@ void HdfsParquetTableWriter::Close() {
   for (int i = 0; i < columns_.size(); ++i) {
     columns_[i]->Close();
   }
+  // The column writers waited for their pending pages above.
+  if (compression_pool_.get() != NULL) {
+    compression_pool_->Shutdown();
+    compression_pool_->Join();
+    compression_pool_.reset();
+    for (int i = 0; i < num_compression_threads_; ++i) {
+      state_->resource_pool()->ReleaseThreadToken(false);
+    }
+    num_compression_threads_ = 0;
+  }
   reusable_col_mem_pool_->FreeAll();
   per_file_mem_pool_->FreeAll();
   compression_staging_buffer_.clear();
@@ -937,8 +1367,26 @@ Status HdfsParquetTableWriter::FlushCurrentRowGroup() {
       current_row_group_->columns[i].meta_data.__set_dictionary_page_offset(
           dict_page_offset);
     }
+    if (columns_[i]->write_bloom_filter_) {
+      RETURN_IF_ERROR(
+          WriteBloomFilter(columns_[i], &current_row_group_->columns[i].meta_data));
+    }
+
+    // Add all encodings that were used for this column. We use PLAIN and
+    // PLAIN_DICTIONARY for data values and RLE for the definition levels. PLAIN is only
+    // listed if some values were not dictionary encoded, which lets readers rely on the
+    // dictionary to hold all values of the column chunk.
+    vector<Encoding::type>* encodings =
+        &current_row_group_->columns[i].meta_data.encodings;
+    encodings->push_back(Encoding::RLE);
+    if (dict_page_offset >= 0) encodings->push_back(Encoding::PLAIN_DICTIONARY);
+    if (columns_[i]->plain_encoding_used() || dict_page_offset < 0) {
+      encodings->push_back(Encoding::PLAIN);
+    }
 
     current_row_group_->columns[i].meta_data.num_values = columns_[i]->num_values();
+    current_row_group_->columns[i].meta_data.__set_statistics(
+        columns_[i]->GetStatistics());
     current_row_group_->columns[i].meta_data.total_uncompressed_size =
         columns_[i]->total_uncompressed_size();
     current_row_group_->columns[i].meta_data.total_compressed_size =
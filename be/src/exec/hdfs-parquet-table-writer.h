@@ -21,6 +21,8 @@
 #include <hdfs.h>
 #include <map>
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "util/compress.h"
 #include "runtime/descriptors.h"
@@ -33,6 +35,7 @@ class Expr;
 struct OutputPartition;
 class RuntimeState;
 class ThriftSerializer;
+template <typename T> class ThreadPool;
 class TupleRow;
 
 /// The writer consumes all rows passed to it and writes the evaluated output_exprs
@@ -45,6 +48,12 @@ class TupleRow;
 /// from the FE.  This includes:
 /// - compression & codec
 /// - type of encoding to use for each type
+///
+/// If --parquet_writer_compression_threads is set and the writer can acquire optional
+/// thread tokens, finished data pages are compressed by helper threads while the sink
+/// thread keeps appending rows. Each column has at most one page in flight, which it
+/// waits for before it finalizes its next page or flushes the row group, so the pages
+/// of different columns are compressed concurrently.
 
 class HdfsParquetTableWriter : public HdfsTableWriter {
  public:
@@ -111,6 +120,19 @@ class HdfsParquetTableWriter : public HdfsTableWriter {
   /// Minimum allowable block size in bytes. This is a function of the number of columns.
   int64_t MinBlockSize() const;
 
+  /// Bytes reserved in each file for the Bloom filters of the column chunks.
+  int64_t BloomFilterReservation() const;
+
+  /// Enables the Bloom filters of the columns in --parquet_bloom_filter_columns whose
+  /// types support them. Called by Init() after the column writers are created.
+  void InitBloomFilterColumns();
+
+  /// Writes the Bloom filter of the values that 'column' collected for the current row
+  /// group to the file and records its location in 'metadata', see
+  /// PARQUET_BLOOM_FILTER_KEY. Writes nothing if the column chunk is entirely dictionary
+  /// encoded or has too many distinct values.
+  Status WriteBloomFilter(BaseColumnWriter* column, parquet::ColumnMetaData* metadata);
+
   /// Fills in the schema portion of the file metadata, converting the schema in
   /// table_desc_ into the format in the file metadata
   Status CreateSchema();
@@ -179,6 +201,46 @@ class HdfsParquetTableWriter : public HdfsTableWriter {
 
   /// For each column, the on disk size written.
   TParquetInsertStats parquet_stats_;
+
+  /// Number of columns that get Bloom filters, and the log2 of the maximum size in bytes
+  /// and the maximum number of distinct values of their filters. Set by
+  /// InitBloomFilterColumns().
+  int num_bloom_filter_columns_;
+  int bloom_filter_max_log_space_;
+  size_t bloom_filter_max_ndv_;
+
+  /// A finished data page that is compressed by one of the threads of
+  /// 'compression_pool_'.
+  struct CompressionTask {
+    /// Set by the sink thread before the task is offered to the pool. The input is a
+    /// staging buffer of the column writer, the output is allocated from
+    /// per_file_mem_pool_.
+    Codec* compressor;
+    RuntimeProfile::Counter* compress_timer;
+    const uint8_t* input;
+    int input_len;
+    uint8_t* output;
+    int output_len;
+
+    /// Set by the compression thread. 'lock' protects 'done'.
+    Status status;
+    bool done;
+    boost::mutex lock;
+    boost::condition_variable done_cv;
+  };
+
+  /// Helper threads that compress the data pages of the column writers, or NULL if the
+  /// writer has none. Created in Init(), each thread holds an optional thread token that
+  /// is released in Close().
+  boost::scoped_ptr<ThreadPool<CompressionTask*> > compression_pool_;
+  int num_compression_threads_;
+
+  /// Starts up to --parquet_writer_compression_threads compression threads if the
+  /// column data is compressed and optional thread tokens are available.
+  void StartCompressionThreads(THdfsCompression::type codec);
+
+  /// Work function of 'compression_pool_'.
+  static void CompressPage(int thread_id, CompressionTask* const& task);
 };
 
 }
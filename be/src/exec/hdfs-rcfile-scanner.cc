@@ -50,7 +50,10 @@ const uint8_t HdfsRCFileScanner::RCFILE_VERSION_HEADER[4] = {'R', 'C', 'F', 1};
 #define RETURN_IF_FALSE(x) if (UNLIKELY(!(x))) return parse_status_
 
 HdfsRCFileScanner::HdfsRCFileScanner(HdfsScanNode* scan_node, RuntimeState* state)
-    : BaseSequenceScanner(scan_node, state) {
+    : BaseSequenceScanner(scan_node, state),
+      column_bytes_read_counter_(NULL),
+      column_bytes_decompressed_counter_(NULL),
+      column_bytes_skipped_counter_(NULL) {
 }
 
 HdfsRCFileScanner::~HdfsRCFileScanner() {
@@ -60,6 +63,12 @@ Status HdfsRCFileScanner::Prepare(ScannerContext* context) {
   RETURN_IF_ERROR(BaseSequenceScanner::Prepare(context));
   text_converter_.reset(
       new TextConverter(0, scan_node_->hdfs_table()->null_column_value()));
+  column_bytes_read_counter_ = ADD_COUNTER(
+      scan_node_->runtime_profile(), "RCFileColumnBytesRead", TUnit::BYTES);
+  column_bytes_decompressed_counter_ = ADD_COUNTER(
+      scan_node_->runtime_profile(), "RCFileColumnBytesDecompressed", TUnit::BYTES);
+  column_bytes_skipped_counter_ = ADD_COUNTER(
+      scan_node_->runtime_profile(), "RCFileColumnBytesSkipped", TUnit::BYTES);
   scan_node_->IncNumScannersCodegenDisabled();
   return Status::OK();
 }
@@ -416,8 +425,10 @@ Status HdfsRCFileScanner::ReadColumnBuffers() {
       // Not materializing this column, just skip it.
       RETURN_IF_FALSE(
           stream_->SkipBytes(column.buffer_len, &parse_status_));
+      COUNTER_ADD(column_bytes_skipped_counter_, column.buffer_len);
       continue;
     }
+    COUNTER_ADD(column_bytes_read_counter_, column.buffer_len);
 
     // TODO: Stream through these column buffers instead of reading everything
     // in at once.
@@ -435,6 +446,7 @@ Status HdfsRCFileScanner::ReadColumnBuffers() {
         VLOG_FILE << "Decompressed " << column.buffer_len << " to "
                   << column.uncompressed_buffer_len;
       }
+      COUNTER_ADD(column_bytes_decompressed_counter_, column.uncompressed_buffer_len);
     } else {
       uint8_t* uncompressed_data;
       RETURN_IF_FALSE(stream_->ReadBytes(
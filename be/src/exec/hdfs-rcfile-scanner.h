@@ -409,6 +409,14 @@ class HdfsRCFileScanner : public BaseSequenceScanner {
   /// This is the allocated size of 'row_group_buffer_'.  'row_group_buffer_' is reused
   /// across row groups and will grow as necessary.
   int row_group_buffer_size_;
+
+  /// Bytes of the column buffers of materialized columns as stored in the file, their
+  /// size after decompression (only counted for compressed files), and bytes of the
+  /// column buffers of non-materialized columns, which are skipped without being
+  /// decompressed.
+  RuntimeProfile::Counter* column_bytes_read_counter_;
+  RuntimeProfile::Counter* column_bytes_decompressed_counter_;
+  RuntimeProfile::Counter* column_bytes_skipped_counter_;
 };
 
 }
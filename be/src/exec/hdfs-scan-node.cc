@@ -21,6 +21,7 @@
 #include "exec/hdfs-avro-scanner.h"
 #include "exec/hdfs-parquet-scanner.h"
 
+#include <limits>
 #include <sstream>
 #include <avro/errors.h>
 #include <avro/schema.h>
@@ -41,8 +42,10 @@
 #include "runtime/mem-pool.h"
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
+#include "runtime/row-batch-pool.h"
 #include "util/bit-util.h"
 #include "util/container-util.h"
+#include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/disk-info.h"
 #include "util/error-util.h"
@@ -50,6 +53,9 @@
 #include "util/impalad-metrics.h"
 #include "util/periodic-counter-updater.h"
 #include "util/runtime-profile.h"
+#include "util/sampling-profiler.h"
+#include "util/thread.h"
+#include "util/time.h"
 
 #include "gen-cpp/PlanNodes_types.h"
 
@@ -61,6 +67,27 @@ DEFINE_bool(suppress_unknown_disk_id_warnings, false,
     " provide volume/disk information.");
 DEFINE_int32(runtime_filter_wait_time_ms, 1000, "(Advanced) the maximum time, in ms, "
     "that a scan node will wait for expected runtime filters to arrive.");
+DEFINE_bool(runtime_filter_wait_for_row_filters, false, "(Advanced) If true, scan "
+    "nodes wait for all of their runtime filters before they start scanning. If false, "
+    "they only wait for the filters on partition columns, which prune files before "
+    "they are read, and the scanners apply the other filters once they arrive.");
+DEFINE_int32(max_runtime_codegen_fns_per_scan_node, 8, "(Advanced) the maximum number "
+    "of functions a scan node codegens while scanning, e.g. one per distinct Avro file "
+    "schema that differs from the table schema. Each function is compiled in its own "
+    "module. Files that need further functions are scanned without codegen.");
+DEFINE_int32(scanner_thread_scaling_interval_ms, 100, "(Advanced) the interval, in ms, "
+    "at which a scan node adjusts the number of its scanner threads to whether the scan "
+    "is I/O-bound or CPU-bound. If 0, scan nodes start as many scanner threads as the "
+    "thread tokens allow.");
+DEFINE_int64(scan_node_mem_tracker_batch_bytes, 64 * 1024, "(Advanced) if > 0, the "
+    "scanner threads' updates of a scan node's memory consumption are batched in "
+    "batches of this many bytes per CPU to avoid contention on the consumption of the "
+    "query's memory trackers.");
+DEFINE_bool(scanner_threads_read_ahead, false, "(Advanced) If true, scanner threads "
+    "start reading their next scan range before they process the current one, so that "
+    "fewer scanner threads keep more ranges in flight and a thread that finishes a "
+    "range finds the buffers of its next range already read.");
+
 DECLARE_string(cgroup_hierarchy_path);
 DECLARE_bool(enable_rm);
 
@@ -73,6 +100,12 @@ using boost::algorithm::join;
 const string HdfsScanNode::HDFS_SPLIT_STATS_DESC =
     "Hdfs split stats (<volume id>:<# splits>/<split lengths>)";
 
+// The fraction of the time in an interval that the scanner threads must wait for I/O
+// buffers for a scan to count as I/O-bound, and the fraction below which it counts as
+// CPU-bound.
+const double IO_BOUND_WAIT_RATIO = 0.7;
+const double CPU_BOUND_WAIT_RATIO = 0.3;
+
 // Amount of memory that we approximate a scanner thread will use not including IoBuffers.
 // The memory used does not vary considerably between file formats (just a couple of MBs).
 // This value is conservative and taken from running against the tpch lineitem table.
@@ -111,8 +144,14 @@ HdfsScanNode::HdfsScanNode(ObjectPool* pool, const TPlanNode& tnode,
       bytes_read_dn_cache_(NULL),
       num_remote_ranges_(NULL),
       unexpected_remote_bytes_(NULL),
+      runtime_codegen_timer_(NULL),
+      num_runtime_codegen_fns_(NULL),
+      scanner_io_wait_timer_(NULL),
+      scanner_thread_target_timeseries_(NULL),
       done_(false),
       all_ranges_started_(false),
+      last_scaling_time_ns_(0),
+      last_scaling_io_wait_ns_(0),
       counters_running_(false),
       thread_avail_cb_id_(-1),
       rm_callback_id_(-1) {
@@ -197,8 +236,15 @@ bool HdfsScanNode::FilePassesFilterPredicates(const vector<FilterContext>& filte
 
 bool HdfsScanNode::WaitForRuntimeFilters(int32_t time_ms) {
   vector<string> arrived_filter_ids;
+  int num_awaited = 0;
   int32_t start = MonotonicMillis();
   for (auto& ctx: filter_ctxs_) {
+    // Filters on other columns are applied to rows as they arrive during the scan.
+    if (!FLAGS_runtime_filter_wait_for_row_filters &&
+        !ctx.stats->is_partition_filter()) {
+      continue;
+    }
+    ++num_awaited;
     if (ctx.filter->WaitForArrival(time_ms)) {
       arrived_filter_ids.push_back(Substitute("$0", ctx.filter->id()));
     }
@@ -206,9 +252,9 @@ bool HdfsScanNode::WaitForRuntimeFilters(int32_t time_ms) {
   int32_t end = MonotonicMillis();
   const string& wait_time = PrettyPrinter::Print(end - start, TUnit::TIME_MS);
 
-  if (arrived_filter_ids.size() == filter_ctxs_.size()) {
+  if (arrived_filter_ids.size() == num_awaited) {
     runtime_profile()->AddInfoString("Runtime filters",
-        Substitute("All filters arrived. Waited $0", wait_time));
+        Substitute("All $0 awaited filters arrived. Waited $1", num_awaited, wait_time));
     VLOG_QUERY << "Filters arrived. Waited " << wait_time;
     return true;
   }
@@ -222,6 +268,7 @@ bool HdfsScanNode::WaitForRuntimeFilters(int32_t time_ms) {
 
 Status HdfsScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
 
   if (!initial_ranges_issued_) {
     // We do this in GetNext() to maximise the amount of work we can do while waiting for
@@ -305,7 +352,7 @@ Status HdfsScanNode::GetNextInternal(
       SetDone();
     }
     DCHECK_EQ(materialized_batch->num_io_buffers(), 0);
-    delete materialized_batch;
+    row_batch_pool_->Return(materialized_batch);
     return Status::OK();
   }
   // The RowBatchQueue was shutdown either because all scan ranges are complete or a
@@ -363,6 +410,29 @@ void* HdfsScanNode::GetCodegenFn(THdfsFileFormat::type type) {
   return it->second;
 }
 
+void* HdfsScanNode::GetRuntimeCodegenFn(const string& key,
+    const RuntimeCodegenFn& codegen_fn) {
+  lock_guard<mutex> l(runtime_codegen_lock_);
+  map<string, void*>::iterator it = runtime_codegen_fns_.find(key);
+  if (it != runtime_codegen_fns_.end()) return it->second;
+  if (runtime_codegens_.size() >= FLAGS_max_runtime_codegen_fns_per_scan_node) {
+    return NULL;
+  }
+
+  SCOPED_TIMER(runtime_codegen_timer_);
+  scoped_ptr<LlvmCodeGen> codegen;
+  void* fn = NULL;
+  Status status = codegen_fn(&codegen, &fn);
+  if (!status.ok()) {
+    VLOG_QUERY << "Failed to codegen a function while scanning: " << status.GetDetail();
+    fn = NULL;
+  }
+  if (codegen.get() != NULL) runtime_codegens_.push_back(codegen.release());
+  if (fn != NULL) COUNTER_ADD(num_runtime_codegen_fns_, 1);
+  runtime_codegen_fns_[key] = fn;
+  return fn;
+}
+
 Status HdfsScanNode::CreateAndPrepareScanner(HdfsPartitionDescriptor* partition,
     ScannerContext* context, scoped_ptr<HdfsScanner>* scanner) {
   DCHECK(context != NULL);
@@ -441,11 +511,17 @@ void HdfsScanNode::TransferToScanNodePool(MemPool* pool) {
 
 Status HdfsScanNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   runtime_state_ = state;
   RETURN_IF_ERROR(ScanNode::Prepare(state));
 
   tuple_desc_ = state->desc_tbl().GetTupleDescriptor(tuple_id_);
   DCHECK(tuple_desc_ != NULL);
+  if (FLAGS_scan_node_mem_tracker_batch_bytes > 0) {
+    mem_tracker()->EnableConsumptionBatching(FLAGS_scan_node_mem_tracker_batch_bytes);
+  }
+  row_batch_pool_.reset(new RowBatchPool(row_desc(), state->batch_size(), mem_tracker(),
+      max_materialized_row_batches_));
 
   // Prepare collection conjuncts
   ConjunctsMap::const_iterator iter = conjuncts_map_.begin();
@@ -732,6 +808,8 @@ Status HdfsScanNode::Open(RuntimeState* state) {
 
   RETURN_IF_ERROR(runtime_state_->io_mgr()->RegisterContext(
       &reader_context_, mem_tracker()));
+  runtime_state_->io_mgr()->set_request_pool(reader_context_,
+      state->fragment_params().request_pool);
 
   // Initialize HdfsScanNode specific counters
   read_timer_ = ADD_TIMER(runtime_profile(), TOTAL_HDFS_READ_TIMER);
@@ -771,10 +849,25 @@ Status HdfsScanNode::Open(RuntimeState* state) {
       TUnit::UNIT);
   unexpected_remote_bytes_ = ADD_COUNTER(runtime_profile(), "BytesReadRemoteUnexpected",
       TUnit::BYTES);
+  runtime_codegen_timer_ = ADD_TIMER(runtime_profile(), "RuntimeCodegenTime");
+  num_runtime_codegen_fns_ = ADD_COUNTER(runtime_profile(), "NumRuntimeCodegenFns",
+      TUnit::UNIT);
 
   max_compressed_text_file_length_ = runtime_profile()->AddHighWaterMarkCounter(
       "MaxCompressedTextFileLength", TUnit::BYTES);
 
+  // Start with one scanner thread per core. UpdateScannerThreadTarget() adjusts the
+  // target once the scanner threads are running.
+  scanner_io_wait_timer_ = ADD_TIMER(runtime_profile(), "ScannerIoWaitTime");
+  scanner_thread_target_.Store(FLAGS_scanner_thread_scaling_interval_ms > 0 ?
+      CpuInfo::num_cores() : numeric_limits<int32_t>::max());
+  last_scaling_time_ns_ = MonotonicNanos();
+  if (FLAGS_scanner_thread_scaling_interval_ms > 0) {
+    scanner_thread_target_timeseries_ = runtime_profile()->AddTimeSeriesCounter(
+        "ScannerThreadsTarget", TUnit::UNIT,
+        bind<int64_t>(mem_fn(&HdfsScanNode::scanner_thread_target), this));
+  }
+
   for (int i = 0; i < state->io_mgr()->num_total_disks() + 1; ++i) {
     hdfs_read_thread_concurrency_bucket_.push_back(
         pool_->Add(new RuntimeProfile::Counter(TUnit::DOUBLE_VALUE, 0)));
@@ -838,6 +931,11 @@ void HdfsScanNode::Close(RuntimeState* state) {
   DCHECK_EQ(active_hdfs_read_thread_counter_.value(), 0);
 
   if (scan_node_pool_.get() != NULL) scan_node_pool_->FreeAll();
+  // The free batches are charged to the mem tracker, which ExecNode::Close() closes.
+  row_batch_pool_.reset();
+
+  // The scanner threads, the only users of the runtime codegen'd functions, are done.
+  runtime_codegens_.clear();
 
   // Close all the partitions scanned by the scan node
   for (int64_t partition_id: partition_ids_) {
@@ -860,7 +958,10 @@ void HdfsScanNode::Close(RuntimeState* state) {
     Expr::Close(iter->second, state);
   }
 
-  for (auto& filter_ctx: filter_ctxs_) filter_ctx.expr->Close(state);
+  for (auto& filter_ctx: filter_ctxs_) {
+    filter_ctx.stats->RecordArrival(filter_ctx.filter);
+    filter_ctx.expr->Close(state);
+  }
   ScanNode::Close(state);
 }
 
@@ -959,6 +1060,8 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
   //  7. Don't start up if there are no thread tokens.
   //  8. Don't start up if we are running too many threads for our vcore allocation
   //  (unless the thread is reserved, in which case it has to run).
+  //  9. Don't start up if there are as many active scanner threads as the target of
+  //     UpdateScannerThreadTarget(), e.g. because the scan is I/O-bound.
 
   // Case 4. We have not issued the initial ranges so don't start a scanner thread.
   // Issuing ranges will call this function and we'll start the scanner threads then.
@@ -977,10 +1080,11 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
       break;
     }
 
-    // Cases 5 and 6.
+    // Cases 5, 6 and 9.
     if (active_scanner_thread_counter_.value() > 0 &&
         (materialized_row_batches_->GetSize() >= max_materialized_row_batches_ ||
-         !EnoughMemoryForScannerThread(true))) {
+         !EnoughMemoryForScannerThread(true) ||
+         active_scanner_thread_counter_.value() >= scanner_thread_target_.Load())) {
       break;
     }
 
@@ -1001,8 +1105,11 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
     COUNTER_ADD(num_scanner_threads_started_counter_, 1);
     stringstream ss;
     ss << "scanner-thread(" << num_scanner_threads_started_counter_->value() << ")";
-    scanner_threads_.AddThread(
-        new Thread("hdfs-scan-node", ss.str(), &HdfsScanNode::ScannerThread, this));
+    // Threads that are assigned to the query's cgroup can't be reused by other queries.
+    function<void ()> scanner_fn = bind<void>(&HdfsScanNode::ScannerThread, this);
+    scanner_threads_.AddThread(runtime_state_->cgroup().empty() ?
+        Thread::CreatePooled("hdfs-scan-node", ss.str(), scanner_fn) :
+        new Thread("hdfs-scan-node", ss.str(), scanner_fn));
 
     if (runtime_state_->query_resource_mgr() != NULL) {
       runtime_state_->query_resource_mgr()->NotifyThreadUsageChange(1);
@@ -1011,7 +1118,10 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
 }
 
 void HdfsScanNode::ScannerThread() {
+  SamplingProfiler::ScopedQueryTag query_tag(runtime_state_->query_id());
+  ScopedNumaAffinity numa_affinity(runtime_state_->resource_pool()->numa_node());
   SCOPED_THREAD_COUNTER_MEASUREMENT(scanner_thread_counters());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   SCOPED_TIMER(runtime_state_->total_cpu_timer());
 
   // Make thread-local copy of filter contexts to prune scan ranges, and to pass to the
@@ -1025,14 +1135,20 @@ void HdfsScanNode::ScannerThread() {
     filter_ctxs.push_back(filter);
   }
 
+  // The range that this thread started reading before processing the previous one,
+  // with --scanner_threads_read_ahead.
+  DiskIoMgr::ScanRange* next_scan_range = NULL;
   while (!done_) {
+    bool target_increased = false;
     {
       // Check if we have enough resources (thread token and memory) to keep using
-      // this thread.
+      // this thread, and if the scan still needs it.
       unique_lock<mutex> l(lock_);
-      if (active_scanner_thread_counter_.value() > 1) {
+      target_increased = UpdateScannerThreadTarget();
+      if (active_scanner_thread_counter_.value() > 1 && next_scan_range == NULL) {
         if (runtime_state_->resource_pool()->optional_exceeded() ||
-            !EnoughMemoryForScannerThread(false)) {
+            !EnoughMemoryForScannerThread(false) ||
+            active_scanner_thread_counter_.value() > scanner_thread_target_.Load()) {
           // We can't break here. We need to update the counter with the lock held or else
           // all threads might see active_scanner_thread_counter_.value > 1
           COUNTER_ADD(&active_scanner_thread_counter_, -1);
@@ -1052,17 +1168,19 @@ void HdfsScanNode::ScannerThread() {
           return;
         }
       } else {
-        // If this is the only scanner thread, it should keep running regardless
-        // of resource constraints.
+        // If this is the only scanner thread or it started reading its next range, it
+        // should keep running regardless of resource constraints.
       }
     }
+    if (target_increased) ThreadTokenAvailableCb(runtime_state_->resource_pool());
 
     bool unused = false;
     // Wake up every SCANNER_THREAD_COUNTERS to yield scanner threads back if unused, or
     // to return if there's an error.
     ranges_issued_barrier_.Wait(SCANNER_THREAD_WAIT_TIME_MS, &unused);
 
-    DiskIoMgr::ScanRange* scan_range;
+    DiskIoMgr::ScanRange* scan_range = next_scan_range;
+    next_scan_range = NULL;
     // Take a snapshot of num_unqueued_files_ before calling GetNextRange().
     // We don't want num_unqueued_files_ to go to zero between the return from
     // GetNextRange() and the check for when all ranges are complete.
@@ -1070,12 +1188,23 @@ void HdfsScanNode::ScannerThread() {
     // TODO: the Load() acts as an acquire barrier.  Is this needed? (i.e. any earlier
     // stores that need to complete?)
     AtomicUtil::MemoryBarrier();
-    Status status = runtime_state_->io_mgr()->GetNextRange(reader_context_, &scan_range);
+    Status status = Status::OK();
+    if (scan_range == NULL) {
+      status = runtime_state_->io_mgr()->GetNextRange(reader_context_, &scan_range);
+    }
 
     if (status.ok() && scan_range != NULL) {
+      // Let the disk threads read the next range while this one is processed, unless
+      // the disk threads didn't prepare one yet.
+      if (FLAGS_scanner_threads_read_ahead) {
+        status = runtime_state_->io_mgr()->TryGetNextRange(reader_context_,
+            &next_scan_range);
+      }
       // Got a scan range. Process the range end to end (in this thread).
-      status = ProcessSplit(filter_status.ok() ? filter_ctxs : vector<FilterContext>(),
-          scan_range);
+      if (status.ok()) {
+        status = ProcessSplit(filter_status.ok() ? filter_ctxs : vector<FilterContext>(),
+            scan_range);
+      }
     }
 
     if (!status.ok()) {
@@ -1130,6 +1259,42 @@ void HdfsScanNode::ScannerThread() {
   runtime_state_->resource_pool()->ReleaseThreadToken(false);
 }
 
+bool HdfsScanNode::UpdateScannerThreadTarget() {
+  if (FLAGS_scanner_thread_scaling_interval_ms <= 0) return false;
+  int64_t now = MonotonicNanos();
+  int64_t elapsed_ns = now - last_scaling_time_ns_;
+  if (elapsed_ns < FLAGS_scanner_thread_scaling_interval_ms * 1000L * 1000L) {
+    return false;
+  }
+  int64_t io_wait_ns = scanner_io_wait_timer_->value();
+  int active_threads = max<int64_t>(1, active_scanner_thread_counter_.value());
+  // The fraction of the time of the interval that the active threads waited for I/O.
+  double wait_ratio = static_cast<double>(io_wait_ns - last_scaling_io_wait_ns_) /
+      (elapsed_ns * active_threads);
+  last_scaling_time_ns_ = now;
+  last_scaling_io_wait_ns_ = io_wait_ns;
+
+  int64_t ready_buffers = runtime_state_->io_mgr()->queue_size(reader_context_);
+  int target = scanner_thread_target_.Load();
+  int new_target = target;
+  if (wait_ratio > IO_BOUND_WAIT_RATIO && ready_buffers == 0) {
+    // The disks can't keep up with the threads, so fewer threads would not scan slower.
+    new_target = max(1, min(target, active_threads) - 1);
+  } else if (wait_ratio < CPU_BOUND_WAIT_RATIO || ready_buffers > active_threads) {
+    // The threads can't keep up with the disks. Don't raise the target beyond twice
+    // the threads that actually run, e.g. if there are not enough thread tokens.
+    new_target = max(target, min(2 * active_threads,
+        static_cast<int>(min<int64_t>(progress_.remaining(),
+            numeric_limits<int32_t>::max()))));
+  }
+  if (new_target == target) return false;
+  VLOG_FILE << "Scan node " << id() << " changes scanner thread target from " << target
+            << " to " << new_target << " (I/O wait ratio " << wait_ratio
+            << ", ready buffers " << ready_buffers << ")";
+  scanner_thread_target_.Store(new_target);
+  return new_target > target;
+}
+
 bool HdfsScanNode::PartitionPassesFilterPredicates(int32_t partition_id,
     const string& stats_name,  const vector<FilterContext>& filter_ctxs) {
   if (filter_ctxs.size() == 0) return true;
@@ -1284,6 +1449,9 @@ void HdfsScanNode::StopAndFinalizeCounters() {
   counters_running_ = false;
 
   PeriodicCounterUpdater::StopTimeSeriesCounter(bytes_read_timeseries_counter_);
+  if (scanner_thread_target_timeseries_ != NULL) {
+    PeriodicCounterUpdater::StopTimeSeriesCounter(scanner_thread_target_timeseries_);
+  }
   PeriodicCounterUpdater::StopRateCounter(total_throughput_counter());
   PeriodicCounterUpdater::StopSamplingCounter(average_scanner_thread_concurrency_);
   PeriodicCounterUpdater::StopSamplingCounter(average_hdfs_read_thread_concurrency_);
@@ -20,6 +20,8 @@
 #include <memory>
 #include <stdint.h>
 
+#include <boost/function.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -45,7 +47,9 @@ namespace impala {
 
 class DescriptorTbl;
 class HdfsScanner;
+class LlvmCodeGen;
 class RowBatch;
+class RowBatchPool;
 class RuntimeFilter;
 class Status;
 class Tuple;
@@ -166,6 +170,8 @@ class HdfsScanNode : public ScanNode {
 
   DiskIoMgr::RequestContext* reader_context() { return reader_context_; }
 
+  RuntimeProfile::Counter* scanner_io_wait_timer() { return scanner_io_wait_timer_; }
+
   typedef std::map<TupleId, std::vector<ExprContext*> > ConjunctsMap;
   const ConjunctsMap& conjuncts_map() const { return conjuncts_map_; }
 
@@ -193,6 +199,19 @@ class HdfsScanNode : public ScanNode {
   /// codegen'd function to use.  Returns NULL if codegen should not be used.
   void* GetCodegenFn(THdfsFileFormat::type);
 
+  /// Codegens a function into the new LlvmCodeGen it creates in 'codegen', finalizes the
+  /// module and returns the jitted function in 'fn'.
+  typedef boost::function<Status (boost::scoped_ptr<LlvmCodeGen>* codegen, void** fn)>
+      RuntimeCodegenFn;
+
+  /// Returns a codegen'd function for a property that is only known while scanning,
+  /// i.e. after the fragment's module was finalized, such as the writer schema of an
+  /// Avro file. 'key' identifies the function among all scanners of this node. The
+  /// first caller for 'key' compiles the function with 'codegen_fn' in its own module
+  /// and later callers reuse it. Returns NULL if codegen failed, or if this node already
+  /// compiled --max_runtime_codegen_fns_per_scan_node functions.
+  void* GetRuntimeCodegenFn(const std::string& key, const RuntimeCodegenFn& codegen_fn);
+
   inline void IncNumScannersCodegenEnabled() {
     num_scanners_codegen_enabled_.Add(1);
   }
@@ -206,6 +225,10 @@ class HdfsScanNode : public ScanNode {
   /// This function will block if materialized_row_batches_ is full.
   void AddMaterializedRowBatch(RowBatch* row_batch);
 
+  /// Scanner threads get their row batches from this pool, and GetNext() returns them
+  /// once it has taken their rows and resources.
+  RowBatchPool* row_batch_pool() { return row_batch_pool_.get(); }
+
   /// Allocate a new scan range object, stored in the runtime state's object pool. For
   /// scan ranges that correspond to the original hdfs splits, the partition id must be
   /// set to the range's partition id. For other ranges (e.g. columns in parquet, read
@@ -427,6 +450,9 @@ class HdfsScanNode : public ScanNode {
   /// Maximum size of materialized_row_batches_.
   int max_materialized_row_batches_;
 
+  /// Recycles the batches of materialized_row_batches_. Created in Prepare().
+  boost::scoped_ptr<RowBatchPool> row_batch_pool_;
+
   /// This is the number of io buffers that are owned by the scan node and the scanners.
   /// This is used just to help debug leaked io buffers to determine if the leak is
   /// happening in the scanners vs other parts of the execution.
@@ -459,6 +485,29 @@ class HdfsScanNode : public ScanNode {
   /// Total number of bytes read remotely that were expected to be local
   RuntimeProfile::Counter* unexpected_remote_bytes_;
 
+  /// Total time that the scanner threads waited for the I/O buffers of their ranges.
+  RuntimeProfile::Counter* scanner_io_wait_timer_;
+
+  /// Time series of scanner_thread_target_, i.e. of the decisions of
+  /// UpdateScannerThreadTarget().
+  RuntimeProfile::TimeSeriesCounter* scanner_thread_target_timeseries_;
+
+  /// Time spent and number of functions compiled by GetRuntimeCodegenFn().
+  RuntimeProfile::Counter* runtime_codegen_timer_;
+  RuntimeProfile::Counter* num_runtime_codegen_fns_;
+
+  /// Protects the fields below that GetRuntimeCodegenFn() uses. Held while compiling,
+  /// which also serializes the use of the codegen caches of tuple_desc_ by the scanner
+  /// threads. This lock cannot be taken together with any other locks.
+  boost::mutex runtime_codegen_lock_;
+
+  /// Functions returned by GetRuntimeCodegenFn() by key. NULL if codegen failed.
+  std::map<std::string, void*> runtime_codegen_fns_;
+
+  /// The codegen objects that own the jitted code of runtime_codegen_fns_. Freed in
+  /// Close().
+  boost::ptr_vector<LlvmCodeGen> runtime_codegens_;
+
   /// Lock protects access between scanner thread and main query thread (the one calling
   /// GetNext()) for all fields below.  If this lock and any other locks needs to be taken
   /// together, this lock must be taken first.
@@ -478,6 +527,16 @@ class HdfsScanNode : public ScanNode {
   /// e.g. partition key tuple and their string buffers
   boost::scoped_ptr<MemPool> scan_node_pool_;
 
+  /// The number of scanner threads that UpdateScannerThreadTarget() aims for. No
+  /// scanner threads are started beyond it, and scanner threads exit while more of them
+  /// are running. Only written with lock_ held.
+  AtomicInt32 scanner_thread_target_;
+
+  /// The time UpdateScannerThreadTarget() last adjusted the target, and the value of
+  /// scanner_io_wait_timer_ at that time.
+  int64_t last_scaling_time_ns_;
+  int64_t last_scaling_io_wait_ns_;
+
   /// Status of failed operations.  This is set in the ScannerThreads
   /// Returned in GetNext() if an error occurred.  An non-ok status triggers cleanup
   /// scanner threads.
@@ -511,6 +570,18 @@ class HdfsScanNode : public ScanNode {
   /// thread tokens if they are available.
   void ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool);
 
+  /// Adjusts scanner_thread_target_ at most every --scanner_thread_scaling_interval_ms
+  /// to how much the scanner threads of the last interval waited for I/O. If they
+  /// mostly waited and the DiskIoMgr has no buffers ready for this scan, the scan is
+  /// I/O-bound, and the target is lowered so that idle threads exit. If they hardly
+  /// waited, or buffers pile up, the scan is CPU-bound, and the target is doubled.
+  /// Returns true if the target increased, in which case the caller should try to
+  /// start threads after releasing lock_. lock_ must be taken before calling this.
+  bool UpdateScannerThreadTarget();
+
+  /// Returns scanner_thread_target_ for scanner_thread_target_timeseries_.
+  int64_t scanner_thread_target() { return scanner_thread_target_.Load(); }
+
   /// Create and prepare new scanner for this partition type.
   /// If the scanner is successfully created, it is returned in 'scanner'.
   Status CreateAndPrepareScanner(HdfsPartitionDescriptor* partition,
@@ -568,7 +639,9 @@ class HdfsScanNode : public ScanNode {
 
   /// Waits for up to time_ms for runtime filters to arrive, checking every 20ms. Returns
   /// true if all filters arrived within the time limit (as measured from the time of
-  /// RuntimeFilterBank::RegisterFilter()), false otherwise.
+  /// RuntimeFilterBank::RegisterFilter()), false otherwise. Unless
+  /// --runtime_filter_wait_for_row_filters is set, only waits for the partition filters,
+  /// since the scanners apply the other filters to rows once they arrive.
   bool WaitForRuntimeFilters(int32_t time_ms);
 };
 
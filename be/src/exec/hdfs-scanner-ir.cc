@@ -14,6 +14,7 @@
 
 #include "exec/hdfs-scanner.h"
 #include "runtime/row-batch.h"
+#include "runtime/timestamp-value.h"
 #include "util/string-parser.h"
 #include "runtime/string-value.inline.h"
 
@@ -116,6 +117,43 @@ double IrStringToDouble(const char* s, int len, StringParser::ParseResult* resul
   return StringParser::StringToFloat<double>(s, len, result);
 }
 
+// The timestamp and decimal parse functions write the value directly into 'slot'
+// since their values are not returned in registers.
+extern "C"
+void IrStringToTimestamp(const char* s, int len, StringParser::ParseResult* result,
+    TimestampValue* slot) {
+  *slot = TimestampValue(s, len);
+  *result = slot->HasDateOrTime() ? StringParser::PARSE_SUCCESS
+      : StringParser::PARSE_FAILURE;
+}
+
+// Underflow and overflow are not accepted for decimals, like in
+// TextConverter::WriteSlot().
+template <typename T>
+static inline void StringToDecimalSlot(const char* s, int len, int precision, int scale,
+    StringParser::ParseResult* result, DecimalValue<T>* slot) {
+  *slot = StringParser::StringToDecimal<T>(s, len, precision, scale, result);
+  if (*result != StringParser::PARSE_SUCCESS) *result = StringParser::PARSE_FAILURE;
+}
+
+extern "C"
+void IrStringToDecimal4(const char* s, int len, int precision, int scale,
+    StringParser::ParseResult* result, Decimal4Value* slot) {
+  StringToDecimalSlot<int32_t>(s, len, precision, scale, result, slot);
+}
+
+extern "C"
+void IrStringToDecimal8(const char* s, int len, int precision, int scale,
+    StringParser::ParseResult* result, Decimal8Value* slot) {
+  StringToDecimalSlot<int64_t>(s, len, precision, scale, result, slot);
+}
+
+extern "C"
+void IrStringToDecimal16(const char* s, int len, int precision, int scale,
+    StringParser::ParseResult* result, Decimal16Value* slot) {
+  StringToDecimalSlot<int128_t>(s, len, precision, scale, result, slot);
+}
+
 extern "C"
 bool IrIsNullString(const char* data, int len) {
   return data == NULL || (len == 2 && data[0] == '\\' && data[1] == 'N');
@@ -26,15 +26,18 @@
 #include "runtime/raw-value.inline.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
+#include "runtime/sorter.h"
 #include "runtime/string-value.inline.h"
 #include "util/impalad-metrics.h"
 #include "runtime/mem-tracker.h"
+#include "util/tuple-row-compare.h"
 #include "util/url-coding.h"
 
 #include <vector>
 #include <sstream>
 #include <gutil/strings/substitute.h>
 #include <hdfs.h>
+#include <boost/algorithm/string.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <stdlib.h>
@@ -43,6 +46,26 @@
 
 #include "common/names.h"
 
+DEFINE_int32(hdfs_sink_max_open_writers, 0, "(Advanced) Maximum number of partitions "
+    "of a dynamic partition insert that an HDFS table sink writes to at the same time. "
+    "If the limit is reached, the file of the least recently written partition is "
+    "finalized and its writer closed. If 0, there is no limit.");
+DEFINE_string(hdfs_sink_sort_columns, "", "(Advanced) Comma-separated list of column "
+    "names. If the target table of an insert has any of these columns, the rows are "
+    "sorted by them, in the order of the list, before they are written, so that the "
+    "min/max statistics of the files are narrow and scans can skip more data. The sort "
+    "uses the sorter of sort nodes and spills to disk if it runs out of memory.");
+DEFINE_bool(hdfs_sink_zorder, false, "(Advanced) If true, the rows of inserts that are "
+    "sorted by --hdfs_sink_sort_columns are sorted in Z-order instead of lexically, "
+    "which clusters the rows by all sort columns instead of mainly the first one. Only "
+    "boolean, integer, floating point and string columns can be Z-ordered, strings by "
+    "their first 8 bytes.");
+
+using boost::algorithm::iequals;
+using boost::algorithm::is_any_of;
+using boost::algorithm::split;
+using boost::algorithm::token_compress_on;
+using boost::algorithm::trim;
 using boost::posix_time::microsec_clock;
 using boost::posix_time::ptime;
 using namespace strings;
@@ -62,7 +85,8 @@ HdfsTableSink::HdfsTableSink(const RowDescriptor& row_desc,
            ? tsink.table_sink.hdfs_table_sink.skip_header_line_count : 0),
        select_list_texprs_(select_list_texprs),
        partition_key_texprs_(tsink.table_sink.hdfs_table_sink.partition_key_exprs),
-       overwrite_(tsink.table_sink.hdfs_table_sink.overwrite) {
+       overwrite_(tsink.table_sink.hdfs_table_sink.overwrite),
+       sort_row_desc_(row_desc) {
   DCHECK(tsink.__isset.table_sink);
 }
 
@@ -105,6 +129,57 @@ Status HdfsTableSink::PrepareExprs(RuntimeState* state) {
   return Status::OK();
 }
 
+Status HdfsTableSink::PrepareSorter(RuntimeState* state) {
+  if (FLAGS_hdfs_sink_sort_columns.empty()) return Status::OK();
+  // The output exprs of the non-clustering columns, in the order of
+  // --hdfs_sink_sort_columns.
+  vector<TExpr> ordering_exprs;
+  vector<string> sort_columns;
+  split(sort_columns, FLAGS_hdfs_sink_sort_columns, is_any_of(","), token_compress_on);
+  const vector<ColumnDescriptor>& col_descs = table_desc_->col_descs();
+  int num_clustering_cols = table_desc_->num_clustering_cols();
+  for (string& sort_column: sort_columns) {
+    trim(sort_column);
+    for (int i = num_clustering_cols; i < col_descs.size(); ++i) {
+      if (!iequals(col_descs[i].name(), sort_column)) continue;
+      const ColumnType& type = col_descs[i].type();
+      if (FLAGS_hdfs_sink_zorder && !TupleRowComparator::SupportsZOrder(type)) {
+        VLOG_QUERY << "Not sorting insert into " << table_desc_->name()
+                   << ": column " << sort_column << " of type " << type
+                   << " can't be Z-ordered";
+        return Status::OK();
+      }
+      ordering_exprs.push_back(select_list_texprs_[i - num_clustering_cols]);
+      break;
+    }
+  }
+  if (ordering_exprs.empty()) return Status::OK();
+  // The sorter adds the input rows without materializing them, which requires rows of a
+  // single tuple.
+  if (row_desc_.tuple_descriptors().size() != 1 || row_desc_.IsAnyTupleNullable() ||
+      !row_desc_.tuple_descriptors()[0]->collection_slots().empty()) {
+    VLOG_QUERY << "Not sorting insert into " << table_desc_->name()
+               << ": unsupported input rows " << row_desc_.DebugString();
+    return Status::OK();
+  }
+
+  RETURN_IF_ERROR(sort_exec_exprs_.Init(ordering_exprs, NULL, state->obj_pool()));
+  RETURN_IF_ERROR(sort_exec_exprs_.Prepare(
+      state, row_desc_, row_desc_, expr_mem_tracker_.get()));
+  // NULLs come first, like in ascending sorts of SQL.
+  TupleRowComparator less_than(sort_exec_exprs_, true, true, FLAGS_hdfs_sink_zorder);
+  if (state->codegen_enabled() && !FLAGS_hdfs_sink_zorder) {
+    Status codegen_status = less_than.Codegen(state);
+    if (!codegen_status.ok()) {
+      VLOG_QUERY << "Failed to codegen sort of HdfsTableSink: "
+                 << codegen_status.GetDetail();
+    }
+  }
+  sorter_.reset(new Sorter(less_than, sort_exec_exprs_.sort_tuple_slot_expr_ctxs(),
+      &sort_row_desc_, mem_tracker_.get(), profile(), state));
+  return Status::OK();
+}
+
 Status HdfsTableSink::Prepare(RuntimeState* state) {
   RETURN_IF_ERROR(DataSink::Prepare(state));
   unique_id_str_ = PrintId(state->fragment_instance_id(), "-");
@@ -147,6 +222,8 @@ Status HdfsTableSink::Prepare(RuntimeState* state) {
       ADD_COUNTER(profile(), "PartitionsCreated", TUnit::UNIT);
   files_created_counter_ =
       ADD_COUNTER(profile(), "FilesCreated", TUnit::UNIT);
+  writers_evicted_counter_ =
+      ADD_COUNTER(profile(), "WritersEvicted", TUnit::UNIT);
   rows_inserted_counter_ =
       ADD_COUNTER(profile(), "RowsInserted", TUnit::UNIT);
   bytes_written_counter_ =
@@ -155,12 +232,17 @@ Status HdfsTableSink::Prepare(RuntimeState* state) {
   hdfs_write_timer_ = ADD_TIMER(profile(), "HdfsWriteTimer");
   compress_timer_ = ADD_TIMER(profile(), "CompressTimer");
 
+  RETURN_IF_ERROR(PrepareSorter(state));
   return Status::OK();
 }
 
 Status HdfsTableSink::Open(RuntimeState* state) {
   RETURN_IF_ERROR(Expr::Open(output_expr_ctxs_, state));
   RETURN_IF_ERROR(Expr::Open(partition_key_expr_ctxs_, state));
+  if (sorter_.get() != NULL) {
+    RETURN_IF_ERROR(sort_exec_exprs_.Open(state));
+    RETURN_IF_ERROR(sorter_->Init());
+  }
   // Open literal partition key exprs
   for (const HdfsTableDescriptor::PartitionIdToDescriptorMap::value_type& id_to_desc:
        table_desc_->partition_descriptors()) {
@@ -333,10 +415,9 @@ Status HdfsTableSink::CreateNewTmpFile(RuntimeState* state,
   ImpaladMetrics::NUM_FILES_OPEN_FOR_INSERT->Increment(1);
   COUNTER_ADD(files_created_counter_, 1);
 
-  if (!ShouldSkipStaging(state, output_partition)) {
-    // Save the ultimate destination for this file (it will be moved by the coordinator)
-    (*state->hdfs_files_to_move())[output_partition->current_file_name] = final_location;
-  }
+  // Save the ultimate destination for this file (it will be moved by the coordinator).
+  // If staging is skipped, the source is the destination.
+  (*state->hdfs_files_to_move())[output_partition->current_file_name] = final_location;
 
   ++output_partition->num_files;
   output_partition->num_rows = 0;
@@ -414,7 +495,19 @@ Status HdfsTableSink::InitOutputPartition(RuntimeState* state,
   // It is incorrect to initialize a writer if there are no rows to feed it. The writer
   // could incorrectly create an empty file or empty partition.
   if (empty_partition) return Status::OK();
+  COUNTER_ADD(partitions_created_counter_, 1);
+  // If the number of open writers is limited, Send() opens the writer before it appends
+  // rows to the partition.
+  if (FLAGS_hdfs_sink_max_open_writers > 0 && !dynamic_partition_key_expr_ctxs_.empty()) {
+    return Status::OK();
+  }
+  return CreateWriter(state, output_partition);
+}
 
+Status HdfsTableSink::CreateWriter(RuntimeState* state,
+    OutputPartition* output_partition) {
+  const HdfsPartitionDescriptor& partition_descriptor =
+      *output_partition->partition_descriptor;
   switch (partition_descriptor.file_format()) {
     case THdfsFileFormat::TEXT:
       output_partition->writer.reset(
@@ -455,10 +548,38 @@ Status HdfsTableSink::InitOutputPartition(RuntimeState* state,
       return Status(error_msg.str());
   }
   RETURN_IF_ERROR(output_partition->writer->Init());
-  COUNTER_ADD(partitions_created_counter_, 1);
   return CreateNewTmpFile(state, output_partition);
 }
 
+Status HdfsTableSink::OpenPartitionWriter(RuntimeState* state,
+    OutputPartition* output_partition) {
+  DCHECK_GT(FLAGS_hdfs_sink_max_open_writers, 0);
+  if (output_partition->writer.get() != NULL) {
+    open_partitions_.splice(open_partitions_.begin(), open_partitions_,
+        output_partition->open_partitions_pos);
+    return Status::OK();
+  }
+  int max_open_writers = FLAGS_hdfs_sink_max_open_writers;
+  while (open_partitions_.size() >= max_open_writers) {
+    OutputPartition* lru_partition = open_partitions_.back();
+    open_partitions_.pop_back();
+    COUNTER_ADD(writers_evicted_counter_, 1);
+    RETURN_IF_ERROR(ClosePartitionWriter(state, lru_partition));
+  }
+  RETURN_IF_ERROR(CreateWriter(state, output_partition));
+  open_partitions_.push_front(output_partition);
+  output_partition->open_partitions_pos = open_partitions_.begin();
+  return Status::OK();
+}
+
+Status HdfsTableSink::ClosePartitionWriter(RuntimeState* state,
+    OutputPartition* output_partition) {
+  RETURN_IF_ERROR(FinalizePartitionFile(state, output_partition));
+  output_partition->writer->Close();
+  output_partition->writer.reset();
+  return Status::OK();
+}
+
 void HdfsTableSink::GetHashTblKey(const vector<ExprContext*>& ctxs, string* key) {
   stringstream hash_table_key;
   for (int i = 0; i < ctxs.size(); ++i) {
@@ -525,6 +646,32 @@ Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
   ExprContext::FreeLocalAllocations(output_expr_ctxs_);
   ExprContext::FreeLocalAllocations(partition_key_expr_ctxs_);
   RETURN_IF_ERROR(state->CheckQueryState());
+  if (sorter_.get() != NULL) {
+    ExprContext::FreeLocalAllocations(sort_exec_exprs_.lhs_ordering_expr_ctxs());
+    ExprContext::FreeLocalAllocations(sort_exec_exprs_.rhs_ordering_expr_ctxs());
+    if (batch->num_rows() > 0) RETURN_IF_ERROR(sorter_->AddMaterializedBatch(batch));
+    if (!eos) return Status::OK();
+    RETURN_IF_ERROR(sorter_->InputDone());
+    return WriteSortedRows(state);
+  }
+  return WriteRowBatch(state, batch, eos);
+}
+
+Status HdfsTableSink::WriteSortedRows(RuntimeState* state) {
+  RowBatch batch(row_desc_, state->batch_size(), mem_tracker_.get());
+  bool eos = false;
+  while (!eos) {
+    RETURN_IF_ERROR(state->CheckQueryState());
+    RETURN_IF_ERROR(sorter_->GetNext(&batch, &eos));
+    ExprContext::FreeLocalAllocations(output_expr_ctxs_);
+    ExprContext::FreeLocalAllocations(partition_key_expr_ctxs_);
+    RETURN_IF_ERROR(WriteRowBatch(state, &batch, eos));
+    batch.Reset();
+  }
+  return Status::OK();
+}
+
+Status HdfsTableSink::WriteRowBatch(RuntimeState* state, RowBatch* batch, bool eos) {
   bool empty_input_batch = batch->num_rows() == 0;
   // We don't do any work for an empty batch aside from end of stream finalization.
   if (empty_input_batch && !eos) return Status::OK();
@@ -554,6 +701,9 @@ Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
       } while (new_file);
     }
   } else {
+    // The partitions of this batch in the order of their first row, so that with
+    // clustered input the partition of the last rows stays open for the next batch.
+    vector<PartitionPair*> batch_partitions;
     for (int i = 0; i < batch->num_rows(); ++i) {
       current_row_ = batch->GetRow(i);
 
@@ -561,23 +711,25 @@ Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
       GetHashTblKey(dynamic_partition_key_expr_ctxs_, &key);
       PartitionPair* partition_pair = NULL;
       RETURN_IF_ERROR(GetOutputPartition(state, key, &partition_pair, false));
+      if (partition_pair->second.empty()) batch_partitions.push_back(partition_pair);
       partition_pair->second.push_back(i);
     }
-    for (PartitionMap::iterator partition = partition_keys_to_output_partitions_.begin();
-         partition != partition_keys_to_output_partitions_.end(); ++partition) {
-      OutputPartition* output_partition = partition->second.first;
-      if (partition->second.second.empty()) continue;
+    for (PartitionPair* partition_pair: batch_partitions) {
+      OutputPartition* output_partition = partition_pair->first;
+      if (FLAGS_hdfs_sink_max_open_writers > 0) {
+        RETURN_IF_ERROR(OpenPartitionWriter(state, output_partition));
+      }
 
       bool new_file;
       do {
         RETURN_IF_ERROR(output_partition->writer->AppendRowBatch(
-            batch, partition->second.second, &new_file));
+            batch, partition_pair->second, &new_file));
         if (new_file) {
           RETURN_IF_ERROR(FinalizePartitionFile(state, output_partition));
           RETURN_IF_ERROR(CreateNewTmpFile(state, output_partition));
         }
       } while (new_file);
-      partition->second.second.clear();
+      partition_pair->second.clear();
     }
   }
 
@@ -651,6 +803,7 @@ void HdfsTableSink::Close(RuntimeState* state) {
     ClosePartitionFile(state, cur_partition->second.first);
   }
   partition_keys_to_output_partitions_.clear();
+  open_partitions_.clear();
 
   // Close literal partition key exprs
   for (const HdfsTableDescriptor::PartitionIdToDescriptorMap::value_type& id_to_desc:
@@ -660,6 +813,10 @@ void HdfsTableSink::Close(RuntimeState* state) {
   }
   Expr::Close(output_expr_ctxs_, state);
   Expr::Close(partition_key_expr_ctxs_, state);
+  if (sorter_.get() != NULL) {
+    sort_exec_exprs_.Close(state);
+    sorter_.reset();
+  }
   if (mem_tracker_.get() != NULL) {
     mem_tracker_->UnregisterFromParent();
     mem_tracker_.reset();
@@ -669,7 +826,7 @@ void HdfsTableSink::Close(RuntimeState* state) {
 }
 
 bool HdfsTableSink::ShouldSkipStaging(RuntimeState* state, OutputPartition* partition) {
-  return IsS3APath(partition->final_hdfs_file_name_prefix.c_str()) && !overwrite_ &&
+  return IsS3APath(partition->final_hdfs_file_name_prefix.c_str()) &&
       state->query_options().s3_skip_insert_staging;
 }
 
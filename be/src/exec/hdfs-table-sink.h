@@ -17,12 +17,14 @@
 #define IMPALA_EXEC_HDFS_TABLE_SINK_H
 
 #include <hdfs.h>
+#include <list>
 #include <boost/unordered_map.hpp>
 #include <boost/scoped_ptr.hpp>
 
 /// needed for scoped_ptr to work on ObjectPool
 #include "common/object-pool.h"
 #include "exec/data-sink.h"
+#include "exec/sort-exec-exprs.h"
 #include "runtime/descriptors.h"
 #include "util/runtime-profile.h"
 
@@ -34,6 +36,7 @@ class TupleRow;
 class RuntimeState;
 class HdfsTableWriter;
 class MemTracker;
+class Sorter;
 
 /// Records the temporary and final Hdfs file name, the opened temporary Hdfs file, and
 /// the number of appended rows of an output partition.
@@ -89,6 +92,10 @@ struct OutputPartition {
   /// The block size decided on for this file.
   int64_t block_size;
 
+  /// Position in HdfsTableSink::open_partitions_ while 'writer' is open. Only used if the
+  /// number of open writers is limited.
+  std::list<OutputPartition*>::iterator open_partitions_pos;
+
   OutputPartition();
 };
 
@@ -111,6 +118,15 @@ struct OutputPartition {
 /// A map of opened Hdfs files (corresponding to partitions) is maintained.
 /// Each row may belong to different partition than the one before it.
 //
+/// Open writers and files:
+/// By default a dynamic partition insert keeps a writer and a file open for each
+/// partition it has written to, which may buffer a lot of memory per partition (e.g. a
+/// Parquet row group). If --hdfs_sink_max_open_writers is set, at most that many writers
+/// are open at a time: writing to another partition finalizes the file and closes the
+/// writer of the least recently written partition. A partition that receives rows again
+/// later gets a new file. If the input is clustered by the partition keys, a limit of 1
+/// writes a single file per partition with the memory of a single writer.
+//
 /// Failure behavior:
 /// In Exec() all data is written to Hdfs files in a temporary directory.
 /// In Close() all temporary Hdfs files are moved to their final locations,
@@ -136,6 +152,8 @@ class HdfsTableSink : public DataSink {
   virtual Status Open(RuntimeState* state);
 
   /// Append all rows in batch to the temporary Hdfs files corresponding to partitions.
+  /// If the rows are sorted, they are added to the sorter instead and all rows are
+  /// written at 'eos'.
   virtual Status Send(RuntimeState* state, RowBatch* batch, bool eos);
 
   /// Currently a no-op function.
@@ -168,6 +186,18 @@ class HdfsTableSink : public DataSink {
                              const HdfsPartitionDescriptor& partition_descriptor,
                              OutputPartition* output_partition, bool empty_partition);
 
+  /// Creates and initialises the table writer of 'output_partition' and opens its first
+  /// temporary file.
+  Status CreateWriter(RuntimeState* state, OutputPartition* output_partition);
+
+  /// Makes sure that the writer of 'output_partition' is open, closing the writer of the
+  /// least recently written partition if --hdfs_sink_max_open_writers writers are open.
+  /// Only used if the number of open writers is limited.
+  Status OpenPartitionWriter(RuntimeState* state, OutputPartition* output_partition);
+
+  /// Finalizes the current file of 'output_partition' and closes its writer.
+  Status ClosePartitionWriter(RuntimeState* state, OutputPartition* output_partition);
+
   /// Add a temporary file to an output partition.  Files are created in a
   /// temporary directory and then moved to the real partition directory by the
   /// coordinator in a finalization step. The temporary file's current location
@@ -197,6 +227,17 @@ class HdfsTableSink : public DataSink {
   /// Initialise and prepare select and partition key expressions
   Status PrepareExprs(RuntimeState* state);
 
+  /// Creates sorter_ if --hdfs_sink_sort_columns names columns of the target table and
+  /// the rows can be sorted. Called in Prepare().
+  Status PrepareSorter(RuntimeState* state);
+
+  /// Appends the rows of 'batch' to the files of their partitions. Finalizes all files
+  /// if 'eos' is true.
+  Status WriteRowBatch(RuntimeState* state, RowBatch* batch, bool eos);
+
+  /// Writes all rows of sorter_ in sorted order and finalizes all files. Called at eos.
+  Status WriteSortedRows(RuntimeState* state);
+
   /// Sets hdfs_file_name and tmp_hdfs_file_name of given output partition.
   /// The Hdfs directory is created from the target table's base Hdfs dir,
   /// the partition_key_names_ and the evaluated partition_key_exprs_.
@@ -213,10 +254,10 @@ class HdfsTableSink : public DataSink {
 
   // Returns TRUE if the staging step should be skipped for this partition. This allows
   // for faster INSERT query completion time for the S3A filesystem as the coordinator
-  // does not have to copy the file(s) from the staging locaiton to the final location. We
-  // do not skip for INSERT OVERWRITEs because the coordinator will delete all files in
-  // the final location before moving the staged files there, so we cannot write directly
-  // to the final location and need to write to the temporary staging location.
+  // does not have to copy the file(s) from the staging locaiton to the final location.
+  // Files written to their final location are recorded in the files to move with the
+  // same source and destination, so that for INSERT OVERWRITEs the coordinator deletes
+  // only the files that existed before the insert.
   bool ShouldSkipStaging(RuntimeState* state, OutputPartition* partition);
 
   /// Descriptor of target table. Set in Prepare().
@@ -286,12 +327,29 @@ class HdfsTableSink : public DataSink {
       PartitionDescriptorMap;
   PartitionDescriptorMap partition_descriptor_map_;
 
+  /// Partitions with open writers, most recently written first. Only used if the number
+  /// of open writers is limited.
+  std::list<OutputPartition*> open_partitions_;
+
+  /// The sort keys, i.e. the output exprs of the columns of --hdfs_sink_sort_columns.
+  /// Only used if sorter_ is set.
+  SortExecExprs sort_exec_exprs_;
+
+  /// Copy of row_desc_, which the sorter requires to be mutable.
+  RowDescriptor sort_row_desc_;
+
+  /// Sorts the input rows before they are written, so that the rows of every file are
+  /// in lexical or Z-order of the sort keys. NULL if the rows are written unsorted.
+  boost::scoped_ptr<Sorter> sorter_;
+
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
   /// Allocated from runtime state's pool.
   RuntimeProfile* runtime_profile_;
   RuntimeProfile::Counter* partitions_created_counter_;
   RuntimeProfile::Counter* files_created_counter_;
+  /// Number of writers closed to stay within --hdfs_sink_max_open_writers.
+  RuntimeProfile::Counter* writers_evicted_counter_;
   RuntimeProfile::Counter* rows_inserted_counter_;
   RuntimeProfile::Counter* bytes_written_counter_;
 
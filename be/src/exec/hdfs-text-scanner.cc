@@ -26,6 +26,7 @@
 #include "runtime/runtime-state.h"
 #include "util/codec.h"
 #include "util/decompress.h"
+#include "util/decompression-pipeline.h"
 #include "util/cpu-info.h"
 #include "util/debug-util.h"
 
@@ -37,6 +38,17 @@ using namespace impala;
 using namespace llvm;
 using namespace strings;
 
+DEFINE_int64(compressed_text_stream_buffer_size, 8L * 1024 * 1024, "(Advanced) Size "
+    "in bytes of the buffers that gzip and bzip2 text files are decompressed into and "
+    "parsed from. Bounds the memory each scanner uses for decompressed data.");
+DEFINE_int32(compressed_text_decompression_buffers, 0, "(Advanced) If > 0, gzip and "
+    "bzip2 text files are decompressed on a separate thread per scanner, ahead of the "
+    "parsing, with at most this many buffers of --compressed_text_stream_buffer_size "
+    "queued.");
+
+// Number of compressed io buffers copied ahead for the decompression pipeline.
+const int DECOMPRESSION_PIPELINE_INPUT_BUFFERS = 2;
+
 const char* HdfsTextScanner::LLVM_CLASS_NAME = "class.impala::HdfsTextScanner";
 
 // Suffix for lzo index file: hdfs-filename.index
@@ -159,6 +171,17 @@ Status HdfsTextScanner::ProcessSplit() {
     DCHECK(stream_->file_desc()->file_compression != THdfsCompression::SNAPPY)
         << "FE should have generated SNAPPY_BLOCKED instead.";
     RETURN_IF_ERROR(UpdateDecompressor(stream_->file_desc()->file_compression));
+    if (decompressor_.get() != NULL && decompressor_->supports_streaming()) {
+      decompressor_->set_stream_out_buf_size(FLAGS_compressed_text_stream_buffer_size);
+      if (FLAGS_compressed_text_decompression_buffers > 0) {
+        decompression_pipeline_.reset(new DecompressionPipeline(
+            scan_node_->mem_tracker(), DECOMPRESSION_PIPELINE_INPUT_BUFFERS,
+            FLAGS_compressed_text_decompression_buffers));
+        RETURN_IF_ERROR(decompression_pipeline_->Init(
+            stream_->file_desc()->file_compression,
+            FLAGS_compressed_text_stream_buffer_size));
+      }
+    }
 
     // Process the scan range.
     int dummy_num_tuples;
@@ -173,6 +196,11 @@ Status HdfsTextScanner::ProcessSplit() {
 }
 
 void HdfsTextScanner::Close() {
+  // Stop the decompression thread first, it may still be filling its queue.
+  if (decompression_pipeline_.get() != NULL) {
+    decompression_pipeline_->Close();
+    decompression_pipeline_.reset();
+  }
   // Need to close the decompressor before releasing the resources at AddFinalRowBatch(),
   // because in some cases there is memory allocated in decompressor_'s temp_memory_pool_.
   if (decompressor_.get() != NULL) {
@@ -354,7 +382,15 @@ Status HdfsTextScanner::ProcessRange(int* num_tuples, bool past_scan_range) {
 
     batch_start_ptr_ = byte_buffer_ptr_;
     char* col_start = byte_buffer_ptr_;
-    {
+    if (scan_node_->materialized_slots().empty() &&
+        delimited_text_parser_->escape_char() == '\0') {
+      // No fields are needed, e.g. for count(*). Only count the tuple delimiters.
+      SCOPED_TIMER(parse_delimiter_timer_);
+      delimited_text_parser_->CountTuples(max_tuples,
+          byte_buffer_end_ - byte_buffer_ptr_, &byte_buffer_ptr_,
+          &row_end_locations_[0], num_tuples);
+      col_start = byte_buffer_ptr_;
+    } else {
       // Parse the bytes for delimiters and store their offsets in field_locations_
       SCOPED_TIMER(parse_delimiter_timer_);
       RETURN_IF_ERROR(delimited_text_parser_->ParseFieldLocations(max_tuples,
@@ -429,6 +465,9 @@ Status HdfsTextScanner::FillByteBuffer(bool* eosr, int num_bytes) {
     }
     RETURN_IF_ERROR(status);
     *eosr = stream_->eosr();
+  } else if (decompression_pipeline_.get() != NULL) {
+    DCHECK_EQ(num_bytes, 0);
+    RETURN_IF_ERROR(FillByteBufferPipelined(eosr));
   } else if (decompressor_->supports_streaming()) {
     DCHECK_EQ(num_bytes, 0);
     RETURN_IF_ERROR(FillByteBufferCompressedStream(eosr));
@@ -533,6 +572,53 @@ Status HdfsTextScanner::FillByteBufferCompressedStream(bool* eosr) {
   return Status::OK();
 }
 
+Status HdfsTextScanner::FillByteBufferPipelined(bool* eosr) {
+  // Every decompressed buffer is a new allocation, so the previous one can be attached
+  // to batch_, like in FillByteBufferCompressedStream().
+  AttachPool(data_buffer_pool_.get(), false);
+
+  uint8_t* decompressed_buffer = NULL;
+  int64_t decompressed_len = 0;
+  do {
+    // Keep the pipeline supplied with compressed input. The io buffers are copied, so
+    // they can be returned as usual while the copies are decompressed.
+    while (decompression_pipeline_->NeedsInput()) {
+      if (stream_->eosr()) {
+        decompression_pipeline_->InputDone();
+        break;
+      }
+      uint8_t* compressed_buffer;
+      int64_t compressed_len;
+      RETURN_IF_ERROR(stream_->GetBuffer(false, &compressed_buffer, &compressed_len));
+      if (compressed_len == 0) {
+        decompression_pipeline_->InputDone();
+        break;
+      }
+      RETURN_IF_ERROR(decompression_pipeline_->AddInput(compressed_buffer,
+          compressed_len));
+    }
+    // Only counts the time spent waiting for the decompression thread.
+    SCOPED_TIMER(decompress_timer_);
+    Status status = decompression_pipeline_->GetNext(data_buffer_pool_.get(),
+        &decompressed_buffer, &decompressed_len, eosr);
+    if (!status.ok()) {
+      status.AddDetail(Substitute("file=$0, offset=$1", stream_->filename(),
+          stream_->file_offset()));
+      return status;
+    }
+  } while (decompressed_len == 0 && !*eosr);
+
+  if (*eosr) {
+    if (!decompression_pipeline_->stream_end()) {
+      return Status(TErrorCode::COMPRESSED_FILE_TRUNCATED, stream_->filename());
+    }
+    context_->ReleaseCompletedResources(NULL, true);
+  }
+  byte_buffer_ptr_ = reinterpret_cast<char*>(decompressed_buffer);
+  byte_buffer_read_size_ = decompressed_len;
+  return Status::OK();
+}
+
 Status HdfsTextScanner::FillByteBufferCompressedFile(bool* eosr) {
   // For other compressed text: attempt to read and decompress the entire file, point
   // to the decompressed buffer, and then continue normal processing.
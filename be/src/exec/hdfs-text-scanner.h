@@ -21,6 +21,7 @@
 
 namespace impala {
 
+class DecompressionPipeline;
 class DelimitedTextParser;
 class ScannerContext;
 struct HdfsFileDesc;
@@ -122,6 +123,11 @@ class HdfsTextScanner : public HdfsScanner {
   /// to available decompressed data.
   Status FillByteBufferCompressedStream(bool* eosr);
 
+  /// Fills the next byte buffer like FillByteBufferCompressedStream(), but the buffers
+  /// from stream_ are decompressed ahead by decompression_pipeline_ on a separate
+  /// thread. Used if --compressed_text_decompression_buffers > 0.
+  Status FillByteBufferPipelined(bool* eosr);
+
   /// Used by FillByteBufferCompressedStream() to decompress data from 'stream_'.
   /// Returns COMPRESSED_FILE_DECOMPRESSOR_NO_PROGRESS if it needs more input.
   /// If bytes_to_read > 0, will read specified size.
@@ -177,6 +183,10 @@ class HdfsTextScanner : public HdfsScanner {
   /// Index into materialized_slots_ for the next slot to output for the current tuple.
   int slot_idx_;
 
+  /// Decompresses gzip and bzip2 text on a separate thread. NULL unless
+  /// --compressed_text_decompression_buffers > 0.
+  boost::scoped_ptr<DecompressionPipeline> decompression_pipeline_;
+
   /// Helper class for picking fields and rows from delimited text.
   boost::scoped_ptr<DelimitedTextParser> delimited_text_parser_;
 
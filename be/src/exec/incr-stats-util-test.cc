@@ -18,6 +18,7 @@
 #include <cmath>
 
 #include "common/logging.h"
+#include "exec/incr-stats-util.h"
 #include "exprs/aggregate-functions.h"
 
 #include "common/names.h"
@@ -26,6 +27,7 @@ using namespace impala;
 
 extern string EncodeNdv(const string& ndv, bool* is_encoded);
 extern string DecodeNdv(const string& ndv, bool is_encoded);
+extern void MergeNdv(const string& ndv, bool is_encoded, uint8_t* registers);
 
 static const int HLL_LEN = pow(2, AggregateFunctions::HLL_PRECISION);
 
@@ -69,6 +71,50 @@ TEST(RleTest, TestEncode) {
   ASSERT_EQ(DecodeNdv(encoded, is_encoded), test);
 }
 
+// Dense registers that fit into 6 bits are packed into 3/4 of their size.
+TEST(RleTest, TestPack) {
+  string test;
+  for (int i = 0; i < HLL_LEN; ++i) test += static_cast<char>(i % 56);
+
+  bool is_encoded;
+  const string& encoded = EncodeNdv(test, &is_encoded);
+  ASSERT_FALSE(is_encoded);
+  ASSERT_EQ(HLL_LEN * 3 / 4, encoded.size());
+  ASSERT_EQ(DecodeNdv(encoded, is_encoded), test);
+}
+
+// Merging encoded, packed and unencoded registers takes the maximum of each register.
+TEST(RleTest, TestMerge) {
+  string sparse(HLL_LEN, 0);
+  sparse[3] = 7;
+  sparse[HLL_LEN - 1] = 2;
+  string dense;
+  for (int i = 0; i < HLL_LEN; ++i) dense += static_cast<char>(i % 5);
+  string unpackable(HLL_LEN, 1);
+  unpackable[10] = 100;
+
+  string merged(HLL_LEN, 0);
+  for (const string& ndv: {sparse, dense, unpackable}) {
+    bool is_encoded;
+    const string& encoded = EncodeNdv(ndv, &is_encoded);
+    MergeNdv(encoded, is_encoded, reinterpret_cast<uint8_t*>(&merged[0]));
+  }
+  for (int i = 0; i < HLL_LEN; ++i) {
+    int expected = max<int>(max<int>(sparse[i], dense[i]), unpackable[i]);
+    ASSERT_EQ(expected, merged[i]) << i;
+  }
+}
+
+// Unique columns are extrapolated linearly, columns with few values keep their NDV.
+TEST(SampledStatsTest, ExtrapolateNdv) {
+  EXPECT_EQ(1000, ExtrapolateNdv(1000, 1000, 1));
+  EXPECT_EQ(10000, ExtrapolateNdv(1000, 10000, 0.1));
+  EXPECT_EQ(10, ExtrapolateNdv(10, 10000, 0.1));
+  EXPECT_EQ(2750, ExtrapolateNdv(500, 10000, 0.1));
+  // The estimate is within the NDV of the sample and the number of rows.
+  EXPECT_EQ(100, ExtrapolateNdv(50, 100, 0.1));
+  EXPECT_EQ(0, ExtrapolateNdv(0, 10000, 0.1));
+}
 
 int main(int argc, char** argv) {
   //InitCommonRuntime(argc, argv, true);
@@ -14,6 +14,7 @@
 
 #include "incr-stats-util.h"
 
+#include <emmintrin.h>
 #include <boost/unordered_set.hpp>
 #include <gutil/strings/substitute.h>
 #include <cmath>
@@ -34,28 +35,74 @@ using namespace impala;
 using namespace impala_udf;
 using namespace strings;
 
+DECLARE_double(compute_stats_sample_percent);
+
 // Finalize method for the NDV_NO_FINALIZE() UDA, which only copies the intermediate state
 // of the NDV computation into its output StringVal.
 StringVal IncrementNdvFinalize(FunctionContext* ctx, const StringVal& src) {
   if (UNLIKELY(src.is_null)) return src;
-  DCHECK_EQ(src.len, AggregateFunctions::HLL_LEN);
-  StringVal result_str(ctx, src.len);
+  // The stats are stored with the dense registers.
+  StringVal dense = src;
+  AggregateFunctions::HllMakeDense(ctx, &dense);
+  if (UNLIKELY(dense.is_null)) return dense;
+  DCHECK_EQ(dense.len, AggregateFunctions::HLL_LEN);
+  StringVal result_str(ctx, dense.len);
   if (UNLIKELY(result_str.is_null)) return result_str;
-  memcpy(result_str.ptr, src.ptr, src.len);
-  ctx->Free(src.ptr);
+  memcpy(result_str.ptr, dense.ptr, dense.len);
+  ctx->Free(dense.ptr);
   return result_str;
 }
 
-// To save space when sending NDV estimates around the cluster, we compress them using
-// RLE, since they are often sparse. The resulting string has the form CVCVCVCV where C is
-// the count, i.e. the number of times the subsequent V (value) should be repeated in the
-// output string. C is between 0 and 255 inclusive, the count it represents is one more
-// than the absolute value of C (since we never have a 0 count, and want to use the full
-// range available to us).
+// HLL registers hold at most 64 - HLL_PRECISION + 1 and fit into 6 bits, so dense
+// registers are stored packed, 4 registers in 3 bytes.
+const static int NDV_PACKED_VALUE_BITS = 6;
+const static int NDV_PACKED_LEN =
+    AggregateFunctions::HLL_LEN * NDV_PACKED_VALUE_BITS / 8;
+
+// Returns the registers 'ndv' packed into NDV_PACKED_LEN bytes, or an empty string if
+// some register doesn't fit into NDV_PACKED_VALUE_BITS bits.
+static string PackNdv(const string& ndv) {
+  DCHECK_EQ(ndv.size() % 4, 0);
+  string packed(NDV_PACKED_LEN, 0);
+  for (int i = 0, j = 0; i < ndv.size(); i += 4, j += 3) {
+    uint32_t group = 0;
+    for (int k = 0; k < 4; ++k) {
+      uint8_t value = ndv[i + k];
+      if (value >> NDV_PACKED_VALUE_BITS != 0) return "";
+      group |= static_cast<uint32_t>(value) << (k * NDV_PACKED_VALUE_BITS);
+    }
+    packed[j] = group;
+    packed[j + 1] = group >> 8;
+    packed[j + 2] = group >> 16;
+  }
+  return packed;
+}
+
+// Sets 'registers' to the maximum of themselves and the registers packed in 'packed'.
+static void MergePackedNdv(const string& packed, uint8_t* registers) {
+  DCHECK_EQ(packed.size(), NDV_PACKED_LEN);
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(packed.data());
+  const uint32_t mask = (1 << NDV_PACKED_VALUE_BITS) - 1;
+  for (int i = 0, j = 0; j < NDV_PACKED_LEN; i += 4, j += 3) {
+    uint32_t group = data[j] | data[j + 1] << 8 | data[j + 2] << 16;
+    for (int k = 0; k < 4; ++k) {
+      uint8_t value = (group >> (k * NDV_PACKED_VALUE_BITS)) & mask;
+      registers[i + k] = ::max(registers[i + k], value);
+    }
+  }
+}
+
+// To save space when sending NDV estimates around the cluster and storing them in the
+// metastore, we compress them using RLE, since they are often sparse. The resulting
+// string has the form CVCVCVCV where C is the count, i.e. the number of times the
+// subsequent V (value) should be repeated in the output string. C is between 0 and 255
+// inclusive, the count it represents is one more than the absolute value of C (since we
+// never have a 0 count, and want to use the full range available to us).
 //
 // The output parameter is_encoded is set to true only if the RLE-compressed string is
-// shorter than the input. Otherwise it is set to false, and the input is returned
-// unencoded.
+// shorter than the input and than the packed registers. Otherwise it is set to false,
+// and the registers are returned packed into NDV_PACKED_LEN bytes, or unencoded if they
+// don't fit. The two are told apart by their length.
 string EncodeNdv(const string& ndv, bool* is_encoded) {
   DCHECK_EQ(ndv.size(), AggregateFunctions::HLL_LEN);
   string encoded_ndv(AggregateFunctions::HLL_LEN, 0);
@@ -80,6 +127,13 @@ string EncodeNdv(const string& ndv, bool* is_encoded) {
   }
 
   // +2 for the remaining two bytes written below
+  if (idx + 2 > NDV_PACKED_LEN) {
+    string packed = PackNdv(ndv);
+    if (!packed.empty()) {
+      *is_encoded = false;
+      return packed;
+    }
+  }
   if (idx + 2 > AggregateFunctions::HLL_LEN) {
     *is_encoded = false;
     return ndv;
@@ -95,17 +149,44 @@ string EncodeNdv(const string& ndv, bool* is_encoded) {
   return encoded_ndv;
 }
 
-string DecodeNdv(const string& ndv, bool is_encoded) {
-  if (!is_encoded) return ndv;
-  DCHECK_EQ(ndv.size() % 2, 0);
-  string decoded_ndv(AggregateFunctions::HLL_LEN, 0);
-  int idx = 0;
-  for (int i = 0; i < ndv.size(); i += 2) {
-    for (int j = 0; j < (static_cast<uint8_t>(ndv[i])) + 1; ++j) {
-      decoded_ndv[idx++] = ndv[i+1];
+// Sets the HLL_LEN 'registers' to the maximum of themselves and the registers of 'ndv',
+// which was returned by EncodeNdv(). Runs of zero registers are skipped and unencoded
+// registers are merged 16 at a time, so that merging the sketches of many partitions
+// doesn't decode every one of them.
+void MergeNdv(const string& ndv, bool is_encoded, uint8_t* registers) {
+  if (is_encoded) {
+    DCHECK_EQ(ndv.size() % 2, 0);
+    int idx = 0;
+    for (int i = 0; i < ndv.size(); i += 2) {
+      int count = static_cast<uint8_t>(ndv[i]) + 1;
+      uint8_t value = ndv[i + 1];
+      DCHECK_LE(idx + count, AggregateFunctions::HLL_LEN);
+      if (value != 0) {
+        for (int j = idx; j < idx + count; ++j) registers[j] = ::max(registers[j], value);
+      }
+      idx += count;
     }
+    DCHECK_EQ(idx, AggregateFunctions::HLL_LEN);
+    return;
+  }
+  if (ndv.size() == NDV_PACKED_LEN) {
+    MergePackedNdv(ndv, registers);
+    return;
+  }
+  DCHECK_EQ(ndv.size(), AggregateFunctions::HLL_LEN);
+  // SSE2 is available on all x86-64 CPUs.
+  DCHECK_EQ(AggregateFunctions::HLL_LEN % 16, 0);
+  for (int i = 0; i < AggregateFunctions::HLL_LEN; i += 16) {
+    __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ndv.data() + i));
+    __m128i dst = _mm_loadu_si128(reinterpret_cast<__m128i*>(registers + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(registers + i), _mm_max_epu8(src, dst));
   }
-  DCHECK_EQ(idx, AggregateFunctions::HLL_LEN);
+}
+
+string DecodeNdv(const string& ndv, bool is_encoded) {
+  if (!is_encoded && ndv.size() == AggregateFunctions::HLL_LEN) return ndv;
+  string decoded_ndv(AggregateFunctions::HLL_LEN, 0);
+  MergeNdv(ndv, is_encoded, reinterpret_cast<uint8_t*>(&decoded_ndv[0]));
   return decoded_ndv;
 }
 
@@ -140,17 +221,15 @@ struct PerColumnStats {
       : intermediate_ndv(AggregateFunctions::HLL_LEN, 0), num_nulls(-1),
         max_width(0), num_rows(0), avg_width(0) { }
 
-  // Updates all aggregate statistics with a new set of measurements.
-  void Update(const string& ndv, int64_t num_new_rows, double new_avg_width,
-      int32_t max_new_width, int64_t num_new_nulls) {
-    DCHECK_EQ(intermediate_ndv.size(), ndv.size()) << "Incompatible intermediate NDVs";
+  // Updates all aggregate statistics with a new set of measurements. 'ndv' is encoded
+  // by EncodeNdv() if 'is_ndv_encoded' is true.
+  void Update(const string& ndv, bool is_ndv_encoded, int64_t num_new_rows,
+      double new_avg_width, int32_t max_new_width, int64_t num_new_nulls) {
     DCHECK_GE(num_new_rows, 0);
     DCHECK_GE(max_new_width, 0);
     DCHECK_GE(new_avg_width, 0);
     DCHECK_GE(num_new_nulls, -1);
-    for (int j = 0; j < ndv.size(); ++j) {
-      intermediate_ndv[j] = ::max(intermediate_ndv[j], ndv[j]);
-    }
+    MergeNdv(ndv, is_ndv_encoded, reinterpret_cast<uint8_t*>(&intermediate_ndv[0]));
     if (num_new_nulls >= 0) num_nulls += num_new_nulls;
     max_width = ::max(max_width, max_new_width);
     avg_width += (new_avg_width * num_new_rows);
@@ -159,11 +238,13 @@ struct PerColumnStats {
 
   // Performs any stats computations that are not distributive, that is they may not be
   // computed in part during Update(). After this method returns, ndv_estimate and
-  // avg_width contain valid values.
-  void Finalize() {
+  // avg_width contain valid values. The NDV is extrapolated if the registers are of a
+  // sample of 'sample_fraction' of the rows.
+  void Finalize(double sample_fraction) {
     ndv_estimate = AggregateFunctions::HllFinalEstimate(
         reinterpret_cast<const uint8_t*>(intermediate_ndv.data()),
         intermediate_ndv.size());
+    ndv_estimate = ExtrapolateNdv(ndv_estimate, num_rows, sample_fraction);
     avg_width = num_rows == 0 ? 0 : avg_width / num_rows;
   }
 
@@ -186,6 +267,25 @@ struct PerColumnStats {
 
 namespace impala {
 
+double ComputeStatsSampleFraction() {
+  if (FLAGS_compute_stats_sample_percent <= 0 ||
+      FLAGS_compute_stats_sample_percent >= 100) {
+    return 1;
+  }
+  return FLAGS_compute_stats_sample_percent / 100;
+}
+
+int64_t ExtrapolateNdv(int64_t sample_ndv, int64_t num_rows, double sample_fraction) {
+  if (sample_fraction >= 1) return sample_ndv;
+  double sample_rows = num_rows * sample_fraction;
+  if (sample_rows <= 0) return sample_ndv;
+  // Interpolates between the NDV of the sample, for columns with few distinct values
+  // that all appear in the sample, and the linear extrapolation, for unique columns.
+  double distinct_ratio = min(1.0, sample_ndv / sample_rows);
+  double ndv = sample_ndv * (1 + (1 / sample_fraction - 1) * distinct_ratio);
+  return ::max(sample_ndv, min(num_rows, static_cast<int64_t>(ndv)));
+}
+
 void FinalizePartitionedColumnStats(const TTableSchema& col_stats_schema,
     const vector<TPartitionStats>& existing_part_stats,
     const vector<vector<string> >& expected_partitions, const TRowSet& rowset,
@@ -197,6 +297,9 @@ void FinalizePartitionedColumnStats(const TTableSchema& col_stats_schema,
 
   const int num_cols =
       (col_stats_schema.columns.size() - num_partition_cols) / COLUMNS_PER_STAT;
+  // The row and null counts of sampled partitions are extrapolated before they are
+  // stored, the NDVs when the final stats are computed.
+  const double sample_fraction = ComputeStatsSampleFraction();
   unordered_set<vector<string> > seen_partitions;
   vector<PerColumnStats> stats(num_cols);
 
@@ -220,12 +323,13 @@ void FinalizePartitionedColumnStats(const TTableSchema& col_stats_schema,
       for (int i = 0; i < num_cols * COLUMNS_PER_STAT; i += COLUMNS_PER_STAT) {
         PerColumnStats* stat = &stats[i / COLUMNS_PER_STAT];
         const string& ndv = col_stats_row.colVals[i].stringVal.value;
-        int64_t num_rows = col_stats_row.colVals[i + 4].i64Val.value;
+        int64_t num_rows = col_stats_row.colVals[i + 4].i64Val.value / sample_fraction;
         double avg_width = col_stats_row.colVals[i + 3].doubleVal.value;
         int32_t max_width = col_stats_row.colVals[i + 2].i32Val.value;
         int64_t num_nulls = col_stats_row.colVals[i + 1].i64Val.value;
+        if (num_nulls > 0) num_nulls /= sample_fraction;
 
-        stat->Update(ndv, num_rows, avg_width, max_width, num_nulls);
+        stat->Update(ndv, false, num_rows, avg_width, max_width, num_nulls);
 
         // Save the intermediate state per-column, per-partition
         TIntermediateColumnStats int_stats;
@@ -286,7 +390,7 @@ void FinalizePartitionedColumnStats(const TTableSchema& col_stats_schema,
       }
 
       const TIntermediateColumnStats& int_stats = it->second;
-      stats[i].Update(DecodeNdv(int_stats.intermediate_ndv, int_stats.is_ndv_encoded),
+      stats[i].Update(int_stats.intermediate_ndv, int_stats.is_ndv_encoded,
           int_stats.num_rows, int_stats.avg_width, int_stats.max_width,
           int_stats.num_nulls);
     }
@@ -295,7 +399,7 @@ void FinalizePartitionedColumnStats(const TTableSchema& col_stats_schema,
   // Compute the final results now that all aggregations are done, and save those as
   // column stats for each column in turn.
   for (int i = 0; i < stats.size(); ++i) {
-    stats[i].Finalize();
+    stats[i].Finalize(sample_fraction);
     const string& col_name = col_stats_schema.columns[i * COLUMNS_PER_STAT].columnName;
     params->column_stats[col_name] = stats[i].ToTColumnStats();
 
@@ -30,4 +30,14 @@ void FinalizePartitionedColumnStats(
     const std::vector<std::vector<std::string> >& expected_partitions,
     const apache::hive::service::cli::thrift::TRowSet& rowset,
     int32_t num_partition_cols, TAlterTableUpdateStatsParams* params);
+
+/// Returns the fraction of the files of a table that the child queries of COMPUTE STATS
+/// scan, which is less than 1 if --compute_stats_sample_percent is set.
+double ComputeStatsSampleFraction();
+
+/// Returns the estimated number of distinct values of a column of 'num_rows' rows if
+/// the sample of 'sample_fraction' of its rows has 'sample_ndv' distinct values. Columns
+/// whose values are mostly distinct in the sample are extrapolated linearly, columns of
+/// few distinct values keep the NDV of the sample.
+int64_t ExtrapolateNdv(int64_t sample_ndv, int64_t num_rows, double sample_fraction);
 }
@@ -25,6 +25,7 @@
 #include "exec/kudu-util.h"
 #include "exprs/expr.h"
 #include "runtime/mem-pool.h"
+#include "runtime/runtime-filter.inline.h"
 #include "runtime/runtime-state.h"
 #include "runtime/row-batch.h"
 #include "runtime/string-value.h"
@@ -34,8 +35,12 @@
 #include "gutil/stl_util.h"
 #include "util/disk-info.h"
 #include "util/jni-util.h"
+#include "util/min-max-filter.h"
 #include "util/periodic-counter-updater.h"
 #include "util/runtime-profile.h"
+#include "util/sampling-profiler.h"
+#include "util/thread.h"
+#include "util/time.h"
 
 #include "common/names.h"
 
@@ -44,6 +49,7 @@ DEFINE_int32(kudu_max_row_batches, 0, "The maximum size of the row batch queue,
 DEFINE_int32(kudu_scanner_keep_alive_period_us, 15 * 1000L * 1000L,
     "The period at which Kudu Scanners should send keep-alive requests to the tablet "
     "server to ensure that scanners do not time out.");
+DECLARE_int32(runtime_filter_wait_time_ms);
 
 using boost::algorithm::to_lower_copy;
 using kudu::client::KuduClient;
@@ -73,7 +79,9 @@ KuduScanNode::KuduScanNode(ObjectPool* pool, const TPlanNode& tnode,
       num_active_scanners_(0),
       done_(false),
       pushable_conjuncts_(tnode.kudu_scan_node.kudu_conjuncts),
-      thread_avail_cb_id_(-1) {
+      thread_avail_cb_id_(-1),
+      num_runtime_filters_pushed_(NULL),
+      runtime_filter_deadline_ms_(0) {
   DCHECK(KuduIsAvailable());
 }
 
@@ -81,6 +89,31 @@ KuduScanNode::~KuduScanNode() {
   STLDeleteElements(&kudu_predicates_);
 }
 
+Status KuduScanNode::Init(const TPlanNode& tnode, RuntimeState* state) {
+  RETURN_IF_ERROR(ExecNode::Init(tnode, state));
+  const TQueryOptions& query_options = state->query_options();
+  if (query_options.disable_row_runtime_filtering) return Status::OK();
+  for (const TRuntimeFilterDesc& filter: tnode.runtime_filters) {
+    auto it = filter.planid_to_target_ndx.find(tnode.node_id);
+    DCHECK(it != filter.planid_to_target_ndx.end());
+    const TRuntimeFilterTargetDesc& target = filter.targets[it->second];
+    // Only filters with local producers have min/max filters, which are the only ones
+    // that can be pushed to Kudu. Their target must be a column of the table.
+    if (!target.is_local_target) continue;
+    const vector<TExprNode>& target_nodes = target.target_expr.nodes;
+    if (target_nodes.size() != 1 ||
+        target_nodes[0].node_type != TExprNodeType::SLOT_REF ||
+        !MinMaxFilter::SupportsType(ColumnType::FromThrift(target_nodes[0].type))) {
+      continue;
+    }
+    RuntimeFilterTarget filter_target;
+    filter_target.filter = state->filter_bank()->RegisterFilter(filter, false);
+    filter_target.slot_ref = target_nodes[0];
+    runtime_filters_.push_back(filter_target);
+  }
+  return Status::OK();
+}
+
 Status KuduScanNode::Prepare(RuntimeState* state) {
   RETURN_IF_ERROR(ScanNode::Prepare(state));
   runtime_state_ = state;
@@ -90,6 +123,8 @@ Status KuduScanNode::Prepare(RuntimeState* state) {
   kudu_read_timer_ = ADD_CHILD_TIMER(runtime_profile(), KUDU_READ_TIMER,
       SCANNER_THREAD_TOTAL_WALLCLOCK_TIME);
   kudu_round_trips_ = ADD_COUNTER(runtime_profile(), KUDU_ROUND_TRIPS, TUnit::UNIT);
+  num_runtime_filters_pushed_ =
+      ADD_COUNTER(runtime_profile(), "NumRuntimeFiltersPushedToKudu", TUnit::UNIT);
 
   DCHECK(state->desc_tbl().GetTupleDescriptor(tuple_id_) != NULL);
 
@@ -121,6 +156,7 @@ Status KuduScanNode::Open(RuntimeState* state) {
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
 
   const KuduTableDescriptor* table_desc =
       static_cast<const KuduTableDescriptor*>(tuple_desc_->table_desc());
@@ -138,6 +174,16 @@ Status KuduScanNode::Open(RuntimeState* state) {
       table_->schema()));
   // Must happen after table_ is opened.
   RETURN_IF_ERROR(TransformPushableConjunctsToRangePredicates());
+  for (RuntimeFilterTarget& target: runtime_filters_) {
+    int col_idx;
+    RETURN_IF_ERROR(GetKuduColumnIdx(target.slot_ref, &col_idx));
+    target.column_name = table_->schema().Column(col_idx).name();
+  }
+  int32_t wait_time_ms = FLAGS_runtime_filter_wait_time_ms;
+  if (state->query_options().runtime_filter_wait_time_ms > 0) {
+    wait_time_ms = state->query_options().runtime_filter_wait_time_ms;
+  }
+  runtime_filter_deadline_ms_ = MonotonicMillis() + wait_time_ms;
 
   num_scanner_threads_started_counter_ =
       ADD_COUNTER(runtime_profile(), NUM_SCANNER_THREADS_STARTED, TUnit::UNIT);
@@ -160,6 +206,7 @@ Status KuduScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   SCOPED_TIMER(materialize_tuple_timer());
 
   if (ReachedLimit() || key_ranges_.empty()) {
@@ -205,21 +252,9 @@ Status KuduScanNode::TransformPushableConjunctsToRangePredicates() {
 
     DCHECK_EQ(function_call.node_type, TExprNodeType::FUNCTION_CALL);
 
-    IdxByLowerCaseColName idx_by_lc_name;
-    RETURN_IF_ERROR(MapLowercaseKuduColumnNamesToIndexes(table_->schema(),
-        &idx_by_lc_name));
-
-    string impala_col_name;
-    GetSlotRefColumnName(predicate.nodes[1], &impala_col_name);
-
-    IdxByLowerCaseColName::const_iterator iter;
-    if ((iter = idx_by_lc_name.find(impala_col_name)) ==
-        idx_by_lc_name.end()) {
-      return Status(Substitute("Could not find col: '$0' in the table schema",
-                               impala_col_name));
-    }
-
-    KuduColumnSchema column = table_->schema().Column(iter->second);
+    int col_idx;
+    RETURN_IF_ERROR(GetKuduColumnIdx(predicate.nodes[1], &col_idx));
+    KuduColumnSchema column = table_->schema().Column(col_idx);
 
     KuduValue* bound;
     RETURN_IF_ERROR(GetExprLiteralBound(predicate.nodes[2], column.type(), &bound));
@@ -242,6 +277,24 @@ Status KuduScanNode::TransformPushableConjunctsToRangePredicates() {
   return Status::OK();
 }
 
+Status KuduScanNode::GetKuduColumnIdx(const TExprNode& node, int* col_idx) {
+  IdxByLowerCaseColName idx_by_lc_name;
+  RETURN_IF_ERROR(MapLowercaseKuduColumnNamesToIndexes(table_->schema(),
+      &idx_by_lc_name));
+
+  string impala_col_name;
+  GetSlotRefColumnName(node, &impala_col_name);
+
+  IdxByLowerCaseColName::const_iterator iter;
+  if ((iter = idx_by_lc_name.find(impala_col_name)) ==
+      idx_by_lc_name.end()) {
+    return Status(Substitute("Could not find col: '$0' in the table schema",
+                             impala_col_name));
+  }
+  *col_idx = iter->second;
+  return Status::OK();
+}
+
 void KuduScanNode::GetSlotRefColumnName(const TExprNode& node, string* col_name) {
   const KuduTableDescriptor* table_desc =
       static_cast<const KuduTableDescriptor*>(tuple_desc_->table_desc());
@@ -338,6 +391,7 @@ Status KuduScanNode::GetExprLiteralBound(const TExprNode& node,
 void KuduScanNode::Close(RuntimeState* state) {
   if (is_closed()) return;
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   PeriodicCounterUpdater::StopRateCounter(total_throughput_counter());
   PeriodicCounterUpdater::StopTimeSeriesCounter(bytes_read_timeseries_counter_);
   if (thread_avail_cb_id_ != -1) {
@@ -379,6 +433,36 @@ void KuduScanNode::ClonePredicates(vector<KuduPredicate*>* predicates) {
   }
 }
 
+void KuduScanNode::GetRuntimeFilterPredicates(vector<KuduPredicate*>* predicates) {
+  for (const RuntimeFilterTarget& target: runtime_filters_) {
+    if (!target.filter->HasBloomFilter()) continue;
+    const MinMaxFilter* min_max_filter = target.filter->min_max_filter();
+    // Kudu predicates never pass NULLs, while the filter passes NULLs if the build side
+    // had one.
+    if (min_max_filter == NULL || min_max_filter->has_null()) continue;
+    int64_t min_val = min_max_filter->min();
+    int64_t max_val = min_max_filter->max();
+    if (min_max_filter->IsEmpty()) {
+      // The filter rejects all rows. Push an empty range that fits any integer type.
+      min_val = 1;
+      max_val = 0;
+    }
+    predicates->push_back(table_->NewComparisonPredicate(target.column_name,
+        KuduPredicate::GREATER_EQUAL, KuduValue::FromInt(min_val)));
+    predicates->push_back(table_->NewComparisonPredicate(target.column_name,
+        KuduPredicate::LESS_EQUAL, KuduValue::FromInt(max_val)));
+    COUNTER_ADD(num_runtime_filters_pushed_, 1);
+  }
+}
+
+void KuduScanNode::WaitForRuntimeFilters() {
+  for (const RuntimeFilterTarget& target: runtime_filters_) {
+    int64_t remaining_ms = runtime_filter_deadline_ms_ - MonotonicMillis();
+    if (remaining_ms <= 0) return;
+    target.filter->WaitForArrival(remaining_ms);
+  }
+}
+
 void KuduScanNode::ThreadTokenAvailableCb(
     ThreadResourceMgr::ResourcePool* pool) {
   while (true) {
@@ -408,12 +492,16 @@ void KuduScanNode::ThreadTokenAvailableCb(
 }
 
 void KuduScanNode::ScannerThread(const string& name, const TKuduKeyRange* key_range) {
+  SamplingProfiler::ScopedQueryTag query_tag(runtime_state_->query_id());
+  ScopedNumaAffinity numa_affinity(runtime_state_->resource_pool()->numa_node());
   SCOPED_THREAD_COUNTER_MEASUREMENT(scanner_thread_counters());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   SCOPED_TIMER(runtime_state_->total_cpu_timer());
 
   KuduScanner scanner(this, runtime_state_);
   Status status = scanner.Open();
   if (!status.ok()) goto done;
+  WaitForRuntimeFilters();
 
   while (!done_) {
     status = scanner.OpenNextRange(*key_range);
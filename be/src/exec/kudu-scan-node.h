@@ -28,6 +28,7 @@
 namespace impala {
 
 class KuduScanner;
+class RuntimeFilter;
 class Tuple;
 
 /// A scan node that scans Kudu TabletServers.
@@ -42,6 +43,9 @@ class KuduScanNode : public ScanNode {
 
   ~KuduScanNode();
 
+  /// Registers the runtime filters that target a column of this scan.
+  virtual Status Init(const TPlanNode& tnode, RuntimeState* state);
+
   /// Create Kudu schema and columns to slots mapping.
   virtual Status Prepare(RuntimeState* state);
 
@@ -146,6 +150,26 @@ class KuduScanNode : public ScanNode {
   /// Derived from 'pushable_conjuncts_'.
   std::vector<kudu::client::KuduPredicate*> kudu_predicates_;
 
+  /// A runtime filter whose target expr is a slot of this scan. The range of its min/max
+  /// filter, if it has one, is pushed to Kudu as predicates on the slot's column.
+  struct RuntimeFilterTarget {
+    const RuntimeFilter* filter;
+
+    /// The SlotRef target expr.
+    TExprNode slot_ref;
+
+    /// Name of the column in the Kudu schema. Set in Open().
+    std::string column_name;
+  };
+  std::vector<RuntimeFilterTarget> runtime_filters_;
+
+  /// Number of min/max runtime filters pushed to Kudu, counted once per scan range.
+  RuntimeProfile::Counter* num_runtime_filters_pushed_;
+
+  /// Time, as returned by MonotonicMillis(), until which scanner threads wait for the
+  /// runtime filters to arrive before opening their first scan range. Set in Open().
+  int64_t runtime_filter_deadline_ms_;
+
   /// Returns a KuduValue with 'type' built from a literal in 'node'.
   /// Expects that 'node' is a literal value.
   Status GetExprLiteralBound(const TExprNode& node,
@@ -154,6 +178,10 @@ class KuduScanNode : public ScanNode {
   /// Returns a string with the name of the column that 'node' refers to.
   void GetSlotRefColumnName(const TExprNode& node, string* col_name);
 
+  /// Returns in 'col_idx' the index in the Kudu schema of the column that the SlotRef
+  /// 'node' refers to.
+  Status GetKuduColumnIdx(const TExprNode& node, int* col_idx);
+
   /// Transforms 'pushable_conjuncts_' received from the frontend into 'kudu_predicates_' that will
   /// be set in all scanners.
   Status TransformPushableConjunctsToRangePredicates();
@@ -183,6 +211,13 @@ class KuduScanNode : public ScanNode {
   // Clones the set of predicates to be set on scanners.
   void ClonePredicates(vector<kudu::client::KuduPredicate*>* predicates);
 
+  /// Adds predicates for the min/max filters of the runtime filters that have arrived
+  /// to 'predicates'. The caller owns the predicates. Thread safe.
+  void GetRuntimeFilterPredicates(vector<kudu::client::KuduPredicate*>* predicates);
+
+  /// Waits for the runtime filters to arrive, at most for the runtime filter wait time.
+  void WaitForRuntimeFilters();
+
   RuntimeProfile::Counter* kudu_read_timer() const { return kudu_read_timer_; }
   RuntimeProfile::Counter* kudu_round_trips() const { return kudu_round_trips_; }
 };
@@ -167,6 +167,7 @@ Status KuduScanner::OpenNextRange(const TKuduKeyRange& key_range)  {
 
   vector<KuduPredicate*> predicates;
   scan_node_->ClonePredicates(&predicates);
+  scan_node_->GetRuntimeFilterPredicates(&predicates);
   for (KuduPredicate* predicate: predicates) {
     KUDU_RETURN_IF_ERROR(scanner_->AddConjunctPredicate(predicate),
                          "Unable to add conjunct predicate.");
@@ -215,47 +216,53 @@ Status KuduScanner::DecodeRowsIntoRowBatch(RowBatch* row_batch,
     return HandleEmptyProjection(row_batch, batch_done);
   }
 
-  // TODO consider consolidating the tuple creation/initialization here with the version
-  // that happens inside the loop.
-  int idx = row_batch->AddRow();
-  TupleRow* row = row_batch->GetRow(idx);
-  (*tuple_mem)->Init(scan_node_->tuple_desc()->num_null_bytes());
-  row->SetTuple(tuple_idx(), *tuple_mem);
-
-  int num_rows = cur_kudu_batch_.NumRows();
-  // Now iterate through the Kudu rows.
-  for (int krow_idx = rows_scanned_current_block_; krow_idx < num_rows; ++krow_idx) {
-    // Clear any NULL indicators set by a previous iteration.
-    (*tuple_mem)->Init(tuple_num_null_bytes_);
-
-    // Transform a Kudu row into an Impala row.
-    KuduScanBatch::RowPtr krow = cur_kudu_batch_.Row(krow_idx);
-    RETURN_IF_ERROR(KuduRowToImpalaTuple(krow, row_batch, *tuple_mem));
-    ++rows_scanned_current_block_;
-
-    // Evaluate the conjuncts that haven't been pushed down to Kudu.
-    if (conjunct_ctxs_.empty() ||
-        ExecNode::EvalConjuncts(&conjunct_ctxs_[0], conjunct_ctxs_.size(), row)) {
-      // Materialize those slots that require auxiliary memory
-      RETURN_IF_ERROR(RelocateValuesFromKudu(*tuple_mem, row_batch->tuple_data_pool()));
-      // If the conjuncts pass on the row commit it.
-      row_batch->CommitLastRow();
-      // If we've reached the capacity, or the LIMIT for the scan, return.
-      if (row_batch->AtCapacity() || scan_node_->ReachedLimit()) {
-        *batch_done = true;
-        break;
-      }
-      // Add another row.
-      idx = row_batch->AddRow();
-
-      // Move to the next tuple in the tuple buffer.
-      *tuple_mem = next_tuple(*tuple_mem);
-      (*tuple_mem)->Init(tuple_num_null_bytes_);
-      // Make 'row' point to the new row.
-      row = row_batch->GetRow(idx);
+  // Decode as many rows as fit into the row batch. The tuple buffer has room for a tuple
+  // per row of the batch, so the rows can be decoded into the tuples after '*tuple_mem'
+  // before the conjuncts are evaluated.
+  int first_row = rows_scanned_current_block_;
+  int num_rows = std::min(row_batch->capacity() - row_batch->num_rows(),
+      cur_kudu_batch_.NumRows() - first_row);
+  DCHECK_GT(num_rows, 0);
+  Tuple* tuple = *tuple_mem;
+  for (int i = 0; i < num_rows; ++i) {
+    tuple->Init(tuple_num_null_bytes_);
+    tuple = next_tuple(tuple);
+  }
+  // Decode column by column, so that the type of each column is only dispatched on once
+  // per batch.
+  for (int i = 0; i < scan_node_->tuple_desc_->slots().size(); ++i) {
+    RETURN_IF_ERROR(DecodeColumn(i, first_row, num_rows, *tuple_mem));
+  }
+
+  // Evaluate the conjuncts that haven't been pushed down to Kudu and keep the tuples of
+  // the rows that pass at the front of the tuple buffer.
+  tuple = *tuple_mem;
+  for (int i = 0; i < num_rows; ++i, tuple = next_tuple(tuple)) {
+    int idx = row_batch->AddRow();
+    TupleRow* row = row_batch->GetRow(idx);
+    row->SetTuple(tuple_idx(), tuple);
+    if (!conjunct_ctxs_.empty() &&
+        !ExecNode::EvalConjuncts(&conjunct_ctxs_[0], conjunct_ctxs_.size(), row)) {
+      continue;
+    }
+    if (tuple != *tuple_mem) {
+      memcpy(*tuple_mem, tuple, tuple_byte_size_);
       row->SetTuple(tuple_idx(), *tuple_mem);
     }
+    // Materialize those slots that require auxiliary memory
+    RETURN_IF_ERROR(RelocateValuesFromKudu(*tuple_mem, row_batch->tuple_data_pool()));
+    // If the conjuncts pass on the row commit it.
+    row_batch->CommitLastRow();
+    *tuple_mem = next_tuple(*tuple_mem);
+    // If we've reached the capacity, or the LIMIT for the scan, return. The rows after
+    // this one are decoded again by the next call.
+    if (row_batch->AtCapacity() || scan_node_->ReachedLimit()) {
+      *batch_done = true;
+      num_rows = i + 1;
+      break;
+    }
   }
+  rows_scanned_current_block_ = first_row + num_rows;
   ExprContext::FreeLocalAllocations(conjunct_ctxs_);
 
   // Check the status in case an error status was set during conjunct evaluation.
@@ -274,7 +281,7 @@ bool KuduScanner::IsSlotNull(Tuple* tuple, const SlotDescriptor& slot) {
 Status KuduScanner::RelocateValuesFromKudu(Tuple* tuple, MemPool* mem_pool) {
   for (int i = 0; i < string_slots_.size(); ++i) {
     const SlotDescriptor* slot = string_slots_[i];
-    // NULL handling was done in KuduRowToImpalaTuple.
+    // NULL handling was done in DecodeColumn().
     if (IsSlotNull(tuple, *slot)) continue;
 
     // Extract the string value.
@@ -301,75 +308,90 @@ Status KuduScanner::RelocateValuesFromKudu(Tuple* tuple, MemPool* mem_pool) {
 }
 
 
-Status KuduScanner::KuduRowToImpalaTuple(const KuduScanBatch::RowPtr& row,
-    RowBatch* row_batch, Tuple* tuple) {
-  for (int i = 0; i < scan_node_->tuple_desc_->slots().size(); ++i) {
-    const SlotDescriptor* info = scan_node_->tuple_desc_->slots()[i];
-    void* slot = tuple->GetSlot(info->tuple_offset());
+namespace {
 
-    if (row.IsNull(i)) {
-      SetSlotToNull(tuple, *info);
+// Decodes the fixed-length column 'col_idx' of the 'num_rows' rows of 'batch' starting at
+// 'first_row' into 'slot', a slot of 'tuple' and of the tuples following it, using
+// 'get_fn' to read the values. 'tuple_byte_size' is the distance between the tuples.
+template <typename T>
+Status DecodeFixedLenColumn(const KuduScanBatch& batch, int col_idx, int first_row,
+    int num_rows, const SlotDescriptor& slot, Tuple* tuple, int tuple_byte_size,
+    kudu::Status (KuduScanBatch::RowPtr::*get_fn)(int, T*) const) {
+  uint8_t* tuple_ptr = reinterpret_cast<uint8_t*>(tuple);
+  for (int i = 0; i < num_rows; ++i, tuple_ptr += tuple_byte_size) {
+    KuduScanBatch::RowPtr row = batch.Row(first_row + i);
+    Tuple* t = reinterpret_cast<Tuple*>(tuple_ptr);
+    if (row.IsNull(col_idx)) {
+      DCHECK(slot.is_nullable());
+      t->SetNull(slot.null_indicator_offset());
       continue;
     }
+    KUDU_RETURN_IF_ERROR((row.*get_fn)(col_idx,
+        reinterpret_cast<T*>(t->GetSlot(slot.tuple_offset()))),
+        "Error getting column value from Kudu.");
+  }
+  return Status::OK();
+}
+
+} // anonymous namespace
 
-    int max_len = -1;
-    switch (info->type().type) {
-      case TYPE_VARCHAR:
-        max_len = info->type().len;
-        DCHECK_GT(max_len, 0);
-        // Fallthrough intended.
-      case TYPE_STRING: {
-        // For types with auxiliary memory (String, Binary,...) store the original memory
-        // location in the tuple to avoid the copy when the conjuncts do not pass. Relocate
-        // the memory into the row batch's memory in a later step.
+Status KuduScanner::DecodeColumn(int col_idx, int first_row, int num_rows,
+    Tuple* tuple) {
+  const SlotDescriptor& slot = *scan_node_->tuple_desc_->slots()[col_idx];
+  switch (slot.type().type) {
+    case TYPE_VARCHAR:
+    case TYPE_STRING: {
+      // For types with auxiliary memory (String, Binary,...) store the original memory
+      // location in the tuple to avoid the copy when the conjuncts do not pass. Relocate
+      // the memory into the row batch's memory in a later step.
+      int max_len = slot.type().type == TYPE_VARCHAR ? slot.type().len : -1;
+      DCHECK(slot.type().type != TYPE_VARCHAR || max_len > 0);
+      for (int i = 0; i < num_rows; ++i, tuple = next_tuple(tuple)) {
+        KuduScanBatch::RowPtr row = cur_kudu_batch_.Row(first_row + i);
+        if (row.IsNull(col_idx)) {
+          SetSlotToNull(tuple, slot);
+          continue;
+        }
         kudu::Slice slice;
-        KUDU_RETURN_IF_ERROR(row.GetString(i, &slice),
+        KUDU_RETURN_IF_ERROR(row.GetString(col_idx, &slice),
             "Error getting column value from Kudu.");
-        StringValue* sv = reinterpret_cast<StringValue*>(slot);
+        StringValue* sv = reinterpret_cast<StringValue*>(
+            tuple->GetSlot(slot.tuple_offset()));
         sv->ptr = const_cast<char*>(reinterpret_cast<const char*>(slice.data()));
         sv->len = static_cast<int>(slice.size());
         if (max_len > 0) sv->len = std::min(sv->len, max_len);
-        break;
       }
-      case TYPE_TINYINT:
-        KUDU_RETURN_IF_ERROR(row.GetInt8(i, reinterpret_cast<int8_t*>(slot)),
-            "Error getting column value from Kudu.");
-        break;
-      case TYPE_SMALLINT:
-        KUDU_RETURN_IF_ERROR(row.GetInt16(i, reinterpret_cast<int16_t*>(slot)),
-            "Error getting column value from Kudu.");
-        break;
-      case TYPE_INT:
-        KUDU_RETURN_IF_ERROR(row.GetInt32(i, reinterpret_cast<int32_t*>(slot)),
-            "Error getting column value from Kudu.");
-        break;
-      case TYPE_BIGINT:
-        KUDU_RETURN_IF_ERROR(row.GetInt64(i, reinterpret_cast<int64_t*>(slot)),
-            "Error getting column value from Kudu.");
-        break;
-      case TYPE_FLOAT:
-        KUDU_RETURN_IF_ERROR(row.GetFloat(i, reinterpret_cast<float*>(slot)),
-            "Error getting column value from Kudu.");
-        break;
-      case TYPE_DOUBLE:
-        KUDU_RETURN_IF_ERROR(row.GetDouble(i, reinterpret_cast<double*>(slot)),
-            "Error getting column value from Kudu.");
-        break;
-      case TYPE_BOOLEAN:
-        KUDU_RETURN_IF_ERROR(row.GetBool(i, reinterpret_cast<bool*>(slot)),
-            "Error getting column value from Kudu.");
-        break;
-      default:
-        DCHECK(false) << "Impala type unsupported in Kudu: "
-            << TypeToString(info->type().type);
-        return Status(TErrorCode::IMPALA_KUDU_TYPE_MISSING,
-            TypeToString(info->type().type));
+      return Status::OK();
     }
+    case TYPE_TINYINT:
+      return DecodeFixedLenColumn<int8_t>(cur_kudu_batch_, col_idx, first_row, num_rows,
+          slot, tuple, tuple_byte_size_, &KuduScanBatch::RowPtr::GetInt8);
+    case TYPE_SMALLINT:
+      return DecodeFixedLenColumn<int16_t>(cur_kudu_batch_, col_idx, first_row, num_rows,
+          slot, tuple, tuple_byte_size_, &KuduScanBatch::RowPtr::GetInt16);
+    case TYPE_INT:
+      return DecodeFixedLenColumn<int32_t>(cur_kudu_batch_, col_idx, first_row, num_rows,
+          slot, tuple, tuple_byte_size_, &KuduScanBatch::RowPtr::GetInt32);
+    case TYPE_BIGINT:
+      return DecodeFixedLenColumn<int64_t>(cur_kudu_batch_, col_idx, first_row, num_rows,
+          slot, tuple, tuple_byte_size_, &KuduScanBatch::RowPtr::GetInt64);
+    case TYPE_FLOAT:
+      return DecodeFixedLenColumn<float>(cur_kudu_batch_, col_idx, first_row, num_rows,
+          slot, tuple, tuple_byte_size_, &KuduScanBatch::RowPtr::GetFloat);
+    case TYPE_DOUBLE:
+      return DecodeFixedLenColumn<double>(cur_kudu_batch_, col_idx, first_row, num_rows,
+          slot, tuple, tuple_byte_size_, &KuduScanBatch::RowPtr::GetDouble);
+    case TYPE_BOOLEAN:
+      return DecodeFixedLenColumn<bool>(cur_kudu_batch_, col_idx, first_row, num_rows,
+          slot, tuple, tuple_byte_size_, &KuduScanBatch::RowPtr::GetBool);
+    default:
+      DCHECK(false) << "Impala type unsupported in Kudu: "
+          << TypeToString(slot.type().type);
+      return Status(TErrorCode::IMPALA_KUDU_TYPE_MISSING,
+          TypeToString(slot.type().type));
   }
-  return Status::OK();
 }
 
-
 Status KuduScanner::GetNextBlock() {
   SCOPED_TIMER(scan_node_->kudu_read_timer());
   int64_t now = MonotonicMicros();
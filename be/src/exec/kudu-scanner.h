@@ -92,11 +92,13 @@ class KuduScanner {
   /// other columns are already materialized.
   Status RelocateValuesFromKudu(Tuple* tuple, MemPool* mem_pool);
 
-  /// Transforms a kudu row into an Impala row. Columns that don't require auxiliary
-  /// memory are copied to the tuple directly. String columns are stored as a reference to
-  /// the memory of the RowPtr and need to be relocated later.
-  Status KuduRowToImpalaTuple(const kudu::client::KuduScanBatch::RowPtr& row,
-      RowBatch* row_batch, Tuple* tuple);
+  /// Decodes the column at 'col_idx' in the projection, which is the column of the slot
+  /// at the same index in the tuple descriptor, of the 'num_rows' rows of the current
+  /// block starting at row 'first_row' into 'tuple' and the following tuples. Columns
+  /// that don't require auxiliary memory are copied to the tuples directly. String
+  /// columns are stored as a reference to the memory of the Kudu batch and need to be
+  /// relocated later.
+  Status DecodeColumn(int col_idx, int first_row, int num_rows, Tuple* tuple);
 
   inline Tuple* next_tuple(Tuple* t) const {
     uint8_t* mem = reinterpret_cast<uint8_t*>(t);
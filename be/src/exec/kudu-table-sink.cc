@@ -22,11 +22,20 @@
 #include "exprs/expr-context.h"
 #include "gen-cpp/ImpalaInternalService_constants.h"
 #include "gutil/gscoped_ptr.h"
+#include "gutil/strings/substitute.h"
+#include "runtime/mem-tracker.h"
+#include "util/time.h"
 
 #include "common/names.h"
 
 DEFINE_int32(kudu_session_timeout_seconds, 60, "Timeout set on the Kudu session. "
     "How long to wait before considering a write failed.");
+DEFINE_int32(kudu_sink_max_outstanding_flushes, 2, "(Advanced) Maximum number of "
+    "asynchronous flushes of a Kudu table sink that are in flight at a time. If 0, each "
+    "row batch is flushed synchronously.");
+DEFINE_int64(kudu_sink_mutation_buffer_size, 7 * 1024 * 1024, "(Advanced) Size in "
+    "bytes of the buffer of operations of a Kudu table sink that are applied but not "
+    "yet flushed.");
 
 using kudu::client::KuduColumnSchema;
 using kudu::client::KuduSchema;
@@ -36,6 +45,8 @@ using kudu::client::KuduTable;
 using kudu::client::KuduInsert;
 using kudu::client::KuduUpdate;
 using kudu::client::KuduError;
+using kudu::client::KuduStatusCallback;
+using strings::Substitute;
 
 static const char* KUDU_SINK_NAME = "KuduTableSink";
 
@@ -44,6 +55,22 @@ namespace impala {
 const static string& ROOT_PARTITION_KEY =
     g_ImpalaInternalService_constants.ROOT_PARTITION_KEY;
 
+class KuduTableSink::FlushCallback : public KuduStatusCallback {
+ public:
+  FlushCallback(KuduTableSink* sink) : sink_(sink), start_ns_(MonotonicNanos()) { }
+
+  /// The errors of the flush are returned by the session's GetPendingErrors(), so
+  /// 's' is ignored.
+  virtual void Run(const kudu::Status& s) {
+    sink_->FlushDone(MonotonicNanos() - start_ns_);
+    delete this;
+  }
+
+ private:
+  KuduTableSink* sink_;
+  int64_t start_ns_;
+};
+
 KuduTableSink::KuduTableSink(const RowDescriptor& row_desc,
     const vector<TExpr>& select_list_texprs,
     const TDataSink& tsink)
@@ -54,9 +81,15 @@ KuduTableSink::KuduTableSink(const RowDescriptor& row_desc,
       kudu_table_sink_(tsink.table_sink.kudu_table_sink),
       kudu_flush_counter_(NULL),
       kudu_flush_timer_(NULL),
+      kudu_flush_latency_(NULL),
+      max_kudu_flush_latency_(NULL),
       kudu_error_counter_(NULL),
       rows_written_(NULL),
-      rows_written_rate_(NULL) {
+      rows_written_rate_(NULL),
+      mutation_buffer_bytes_(0),
+      num_outstanding_flushes_(0),
+      num_unreported_rows_(0),
+      num_unreported_errors_(0) {
   DCHECK(KuduIsAvailable());
 }
 
@@ -100,6 +133,9 @@ Status KuduTableSink::Prepare(RuntimeState* state) {
   kudu_error_counter_ =
       ADD_COUNTER(runtime_profile_, "TotalKuduFlushErrors", TUnit::UNIT);
   kudu_flush_timer_ = ADD_TIMER(runtime_profile_, "KuduFlushTimer");
+  kudu_flush_latency_ = ADD_TIMER(runtime_profile_, "KuduFlushLatency");
+  max_kudu_flush_latency_ = runtime_profile_->AddHighWaterMarkCounter(
+      "MaxKuduFlushLatency", TUnit::TIME_NS);
   rows_written_ =
       ADD_COUNTER(runtime_profile_, "RowsWritten", TUnit::UNIT);
   rows_written_rate_ = runtime_profile_->AddDerivedCounter(
@@ -107,12 +143,24 @@ Status KuduTableSink::Prepare(RuntimeState* state) {
       bind<int64_t>(&RuntimeProfile::UnitsPerSecond, rows_written_,
         runtime_profile_->total_time_counter()));
 
+  mem_tracker_.reset(new MemTracker(-1, -1, "Kudu table sink",
+      state->instance_mem_tracker(), false));
   return Status::OK();
 }
 
 Status KuduTableSink::Open(RuntimeState* state) {
   RETURN_IF_ERROR(Expr::Open(output_expr_ctxs_, state));
 
+  // The session holds one buffer being applied to and one per flush in flight.
+  int64_t mutation_buffer_bytes = FLAGS_kudu_sink_mutation_buffer_size *
+      (max(FLAGS_kudu_sink_max_outstanding_flushes, 0) + 1);
+  if (!mem_tracker_->TryConsume(mutation_buffer_bytes)) {
+    return mem_tracker_->MemLimitExceeded(state, Substitute("Could not allocate $0 "
+        "bytes for the mutation buffers of the Kudu session.", mutation_buffer_bytes),
+        mutation_buffer_bytes);
+  }
+  mutation_buffer_bytes_ = mutation_buffer_bytes;
+
   kudu::client::KuduClientBuilder b;
   for (const string& address: table_desc_->kudu_master_addresses()) {
     b.add_master_server_addr(address);
@@ -127,6 +175,8 @@ Status KuduTableSink::Open(RuntimeState* state) {
   session_->SetTimeoutMillis(FLAGS_kudu_session_timeout_seconds * 1000);
   KUDU_RETURN_IF_ERROR(session_->SetFlushMode(
       kudu::client::KuduSession::MANUAL_FLUSH), "Unable to set flush mode");
+  KUDU_RETURN_IF_ERROR(session_->SetMutationBufferSpace(
+      FLAGS_kudu_sink_mutation_buffer_size), "Unable to set mutation buffer space");
   return Status::OK();
 }
 
@@ -223,23 +273,53 @@ Status KuduTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
     ++rows_added;
   }
   COUNTER_ADD(rows_written_, rows_added);
-  int64_t error_count = 0;
-  RETURN_IF_ERROR(Flush(&error_count));
-  (*state->per_partition_status())[ROOT_PARTITION_KEY].num_appended_rows +=
-      rows_added - error_count;
+  num_unreported_rows_ += rows_added;
+  RETURN_IF_ERROR(FlushAsync());
+  if (eos) RETURN_IF_ERROR(FlushAll(state));
   return Status::OK();
 }
 
-Status KuduTableSink::Flush(int64_t* error_count) {
+Status KuduTableSink::FlushAsync() {
   // TODO right now we always flush an entire row batch, if these are small we'll
   // be inefficient. Consider decoupling impala's batch size from kudu's
-  kudu::Status s;
+  WaitForFlushes(max(FLAGS_kudu_sink_max_outstanding_flushes - 1, 0));
   {
-    SCOPED_TIMER(kudu_flush_timer_);
-    COUNTER_ADD(kudu_flush_counter_, 1);
-    s = session_->Flush();
+    lock_guard<mutex> l(flush_lock_);
+    ++num_outstanding_flushes_;
   }
-  if (LIKELY(s.ok())) return Status::OK();
+  COUNTER_ADD(kudu_flush_counter_, 1);
+  session_->FlushAsync(new FlushCallback(this));
+  if (FLAGS_kudu_sink_max_outstanding_flushes <= 0) WaitForFlushes(0);
+  return CheckForErrors(&num_unreported_errors_);
+}
+
+void KuduTableSink::WaitForFlushes(int max_outstanding) {
+  SCOPED_TIMER(kudu_flush_timer_);
+  unique_lock<mutex> l(flush_lock_);
+  while (num_outstanding_flushes_ > max_outstanding) flush_done_cv_.wait(l);
+}
+
+Status KuduTableSink::FlushAll(RuntimeState* state) {
+  WaitForFlushes(0);
+  RETURN_IF_ERROR(CheckForErrors(&num_unreported_errors_));
+  (*state->per_partition_status())[ROOT_PARTITION_KEY].num_appended_rows +=
+      num_unreported_rows_ - num_unreported_errors_;
+  num_unreported_rows_ = 0;
+  num_unreported_errors_ = 0;
+  return Status::OK();
+}
+
+void KuduTableSink::FlushDone(int64_t latency_ns) {
+  COUNTER_ADD(kudu_flush_latency_, latency_ns);
+  max_kudu_flush_latency_->UpdateMax(latency_ns);
+  lock_guard<mutex> l(flush_lock_);
+  DCHECK_GT(num_outstanding_flushes_, 0);
+  --num_outstanding_flushes_;
+  flush_done_cv_.notify_all();
+}
+
+Status KuduTableSink::CheckForErrors(int64_t* error_count) {
+  if (LIKELY(session_->CountPendingErrors() == 0)) return Status::OK();
 
   stringstream error_msg_buffer;
   vector<KuduError*> errors;
@@ -276,19 +356,26 @@ Status KuduTableSink::Flush(int64_t* error_count) {
     delete errors[i];
   }
   COUNTER_ADD(kudu_error_counter_, errors.size());
-  if (error_count != NULL) *error_count = errors.size();
+  *error_count += errors.size();
   if (failed) return Status(error_msg_buffer.str());
   return Status::OK();
 }
 
 Status KuduTableSink::FlushFinal(RuntimeState* state) {
-  // No buffered state to flush.
-  return Status::OK();
+  SCOPED_TIMER(runtime_profile_->total_time_counter());
+  return FlushAll(state);
 }
 
 void KuduTableSink::Close(RuntimeState* state) {
   if (closed_) return;
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  // The callbacks of the flushes in flight reference this sink.
+  WaitForFlushes(0);
+  if (mem_tracker_.get() != NULL) {
+    mem_tracker_->Release(mutation_buffer_bytes_);
+    mutation_buffer_bytes_ = 0;
+    mem_tracker_->UnregisterFromParent();
+  }
   Expr::Close(output_expr_ctxs_, state);
   closed_ = true;
 }
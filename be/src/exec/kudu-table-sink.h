@@ -16,6 +16,8 @@
 #define IMPALA_EXEC_KUDU_TABLE_SINK_H
 
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <kudu/client/client.h>
 
 #include "gen-cpp/ImpalaInternalService_constants.h"
@@ -28,16 +30,17 @@
 namespace impala {
 
 /// Sink that takes RowBatches and writes them into Kudu.
-/// Currently the data is sent to Kudu on Send(), i.e. the data is batched on the
-/// KuduSession until all the rows in a RowBatch are applied and then the session
-/// is flushed.
+/// The data is batched on the KuduSession until all the rows in a RowBatch are applied
+/// and then the session is flushed asynchronously, so that the next row batches are
+/// applied while the flush is in flight. At most --kudu_sink_max_outstanding_flushes
+/// flushes are in flight at a time; Send() waits for one of them to complete before
+/// starting another one. The mutation buffers of the in-flight flushes and of the
+/// operations being applied are counted against the sink's MemTracker.
 ///
 /// Kudu doesn't have transactions (yet!) so some rows may fail to write while
 /// others are successful. This sink will return an error if any of the rows fails
-/// to be written.
-///
-/// TODO Once Kudu actually implements AUTOFLUSH_BACKGROUND flush mode we should
-/// change the flushing behavior as it will likely make writes more efficient.
+/// to be written. Errors are checked after each flush completes, so an error may only
+/// be returned by a later Send() or by FlushFinal().
 class KuduTableSink : public DataSink {
  public:
   KuduTableSink(const RowDescriptor& row_desc,
@@ -51,13 +54,14 @@ class KuduTableSink : public DataSink {
   virtual Status Open(RuntimeState* state);
 
   /// Transforms 'batch' into Kudu writes and sends them to Kudu.
-  /// The KuduSession is flushed on each row batch.
+  /// The KuduSession is flushed asynchronously on each row batch. If 'eos' is true,
+  /// waits for all flushes to complete.
   virtual Status Send(RuntimeState* state, RowBatch* batch, bool eos);
 
-  /// Does nothing. We currently flush on each Send() call.
+  /// Waits for all flushes to complete and returns an error if any write failed.
   virtual Status FlushFinal(RuntimeState* state);
 
-  /// Closes the KuduSession and the expressions.
+  /// Waits for the flushes in flight and closes the expressions.
   virtual void Close(RuntimeState* state);
 
   virtual RuntimeProfile* profile() { return runtime_profile_; }
@@ -69,12 +73,30 @@ class KuduTableSink : public DataSink {
   /// Create a new write operation according to the sink type.
   kudu::client::KuduWriteOperation* NewWriteOp();
 
-  /// Flushes the Kudu session, making sure all previous operations were committed, and handles
-  /// errors returned from Kudu. Passes the number of errors during the flush operations as an
-  /// out parameter.
+  /// Invoked by Kudu when an asynchronous flush completes.
+  class FlushCallback;
+
+  /// Starts an asynchronous flush of the operations applied since the last flush, after
+  /// waiting until fewer than --kudu_sink_max_outstanding_flushes flushes are in flight.
+  /// Returns the errors of the completed flushes.
+  Status FlushAsync();
+
+  /// Waits until at most 'max_outstanding' flushes are in flight.
+  void WaitForFlushes(int max_outstanding);
+
+  /// Waits for all flushes, checks their errors and adds the rows written since the
+  /// last call to the insert stats.
+  Status FlushAll(RuntimeState* state);
+
+  /// Called by FlushCallback on a Kudu client thread once a flush that took
+  /// 'latency_ns' completed.
+  void FlushDone(int64_t latency_ns);
+
+  /// Handles the errors returned from Kudu for the operations of completed flushes.
+  /// Adds the number of errors to '*error_count'.
   /// Returns a non-OK status if there was an unrecoverable error. This might return an OK
   /// status even if 'error_count' is > 0, as some errors might be ignored.
-  Status Flush(int64_t* error_count);
+  Status CheckForErrors(int64_t* error_count);
 
   /// Used to get the KuduTableDescriptor from the RuntimeState
   TableId table_id_;
@@ -104,12 +126,16 @@ class KuduTableSink : public DataSink {
   /// Captures parameters passed down from the frontend
   TKuduTableSink kudu_table_sink_;
 
-  /// Counts the number of calls to KuduSession::flush().
+  /// Counts the number of calls to KuduSession::FlushAsync().
   RuntimeProfile::Counter* kudu_flush_counter_;
 
-  /// Aggregates the times spent in KuduSession:flush().
+  /// Aggregates the times spent waiting for flushes to complete.
   RuntimeProfile::Counter* kudu_flush_timer_;
 
+  /// Sum and maximum of the times from the start to the completion of each flush.
+  RuntimeProfile::Counter* kudu_flush_latency_;
+  RuntimeProfile::HighWaterMarkCounter* max_kudu_flush_latency_;
+
   /// Total number of errors returned from Kudu.
   RuntimeProfile::Counter* kudu_error_counter_;
 
@@ -117,6 +143,22 @@ class KuduTableSink : public DataSink {
   RuntimeProfile::Counter* rows_written_;
   RuntimeProfile::Counter* rows_written_rate_;
 
+  /// Tracks the memory of the session's mutation buffers.
+  boost::scoped_ptr<MemTracker> mem_tracker_;
+
+  /// Bytes consumed from mem_tracker_ for the mutation buffers.
+  int64_t mutation_buffer_bytes_;
+
+  /// Protects num_outstanding_flushes_ and signals flush_done_cv_.
+  boost::mutex flush_lock_;
+  boost::condition_variable flush_done_cv_;
+
+  /// Number of asynchronous flushes that have not completed yet.
+  int num_outstanding_flushes_;
+
+  /// Rows applied and rows that failed since the last FlushAll().
+  int64_t num_unreported_rows_;
+  int64_t num_unreported_errors_;
 };
 
 }  // namespace impala
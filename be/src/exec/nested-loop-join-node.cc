@@ -23,6 +23,7 @@
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "util/bitmap.h"
+#include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/runtime-profile.h"
 #include "gen-cpp/PlanNodes_types.h"
@@ -37,7 +38,10 @@ NestedLoopJoinNode::NestedLoopJoinNode(ObjectPool* pool, const TPlanNode& tnode,
         tnode, descs),
     build_batches_(NULL),
     current_build_row_idx_(0),
-    process_unmatched_build_rows_(false) {
+    build_tile_start_idx_(0),
+    probe_tile_start_pos_(0),
+    process_unmatched_build_rows_(false),
+    build_tile_rows_(0) {
 }
 
 NestedLoopJoinNode::~NestedLoopJoinNode() {
@@ -64,6 +68,7 @@ Status NestedLoopJoinNode::Open(RuntimeState* state) {
 
 Status NestedLoopJoinNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(BlockingJoinNode::Prepare(state));
 
   // join_conjunct_ctxs_ are evaluated in the context of rows assembled from
@@ -74,6 +79,16 @@ Status NestedLoopJoinNode::Prepare(RuntimeState* state) {
   build_batch_cache_.reset(new RowBatchCache(
       child(1)->row_desc(), state->batch_size(), mem_tracker()));
 
+  // Size the build tiles so that their tuples take up half of the L2 cache, leaving the
+  // rest for the probe tile. Variable-length data is not accounted for.
+  int64_t build_row_size = 0;
+  for (const TupleDescriptor* tuple_desc: child(1)->row_desc().tuple_descriptors()) {
+    build_row_size += sizeof(Tuple*) + tuple_desc->byte_size();
+  }
+  int64_t l2_cache_size = CpuInfo::CacheSize(CpuInfo::L2_CACHE);
+  if (l2_cache_size <= 0) l2_cache_size = 256 * 1024;
+  build_tile_rows_ = max<int64_t>(l2_cache_size / 2 / build_row_size, 1);
+
   // For some join modes we need to record the build rows with matches in a bitmap.
   if (join_op_ == TJoinOp::RIGHT_ANTI_JOIN || join_op_ == TJoinOp::RIGHT_SEMI_JOIN ||
       join_op_ == TJoinOp::RIGHT_OUTER_JOIN || join_op_ == TJoinOp::FULL_OUTER_JOIN) {
@@ -99,6 +114,8 @@ Status NestedLoopJoinNode::Reset(RuntimeState* state) {
   matched_probe_ = false;
   current_probe_row_ = NULL;
   probe_batch_pos_ = 0;
+  build_tile_start_idx_ = 0;
+  probe_tile_start_pos_ = 0;
   process_unmatched_build_rows_ = false;
   build_batch_cache_->Reset();
   return BlockingJoinNode::Reset(state);
@@ -218,6 +235,9 @@ Status NestedLoopJoinNode::InitGetNext(TupleRow* first_left_row) {
   DCHECK(build_batches_ != NULL);
   build_row_iterator_ = build_batches_->Iterator();
   current_build_row_idx_ = 0;
+  build_tile_start_ = build_row_iterator_;
+  build_tile_start_idx_ = 0;
+  probe_tile_start_pos_ = probe_batch_pos_ - 1;
   matched_probe_ = false;
   return Status::OK();
 }
@@ -226,6 +246,7 @@ Status NestedLoopJoinNode::GetNext(RuntimeState* state, RowBatch* output_batch,
     bool* eos) {
   DCHECK(!output_batch->AtCapacity());
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -287,10 +308,27 @@ Status NestedLoopJoinNode::GetNextInnerJoin(RuntimeState* state,
     RowBatch* output_batch) {
   while (!eos_) {
     DCHECK(HasValidProbeRow());
+    // Join the current probe row with the rest of the current build tile.
     bool return_output_batch;
-    RETURN_IF_ERROR(
-        FindBuildMatches(state, output_batch, &return_output_batch));
+    RETURN_IF_ERROR(FindBuildMatches(state, output_batch,
+        build_tile_start_idx_ + build_tile_rows_, &return_output_batch));
     if (return_output_batch) return Status::OK();
+    if (probe_batch_pos_ < probe_batch_->num_rows()) {
+      // Join the next probe row of the probe tile with the same build tile.
+      current_probe_row_ = probe_batch_->GetRow(probe_batch_pos_++);
+      build_row_iterator_ = build_tile_start_;
+      current_build_row_idx_ = build_tile_start_idx_;
+      continue;
+    }
+    if (!build_row_iterator_.AtEnd()) {
+      // Join the probe tile with the next build tile.
+      build_tile_start_ = build_row_iterator_;
+      build_tile_start_idx_ = current_build_row_idx_;
+      probe_batch_pos_ = probe_tile_start_pos_;
+      current_probe_row_ = probe_batch_->GetRow(probe_batch_pos_++);
+      continue;
+    }
+    // The probe tile is joined with all build rows.
     RETURN_IF_ERROR(NextProbeRow(state, output_batch));
     if (output_batch->AtCapacity()) break;
   }
@@ -302,8 +340,8 @@ Status NestedLoopJoinNode::GetNextLeftOuterJoin(RuntimeState* state,
   while (!eos_) {
     DCHECK(HasValidProbeRow());
     bool return_output_batch;
-    RETURN_IF_ERROR(
-        FindBuildMatches(state, output_batch, &return_output_batch));
+    RETURN_IF_ERROR(FindBuildMatches(state, output_batch,
+        build_batches_->total_num_rows(), &return_output_batch));
     if (return_output_batch) return Status::OK();
     if (!matched_probe_) RETURN_IF_ERROR(ProcessUnmatchedProbeRow(state, output_batch));
     RETURN_IF_ERROR(NextProbeRow(state, output_batch));
@@ -392,7 +430,43 @@ Status NestedLoopJoinNode::GetNextLeftAntiJoin(RuntimeState* state,
 
 Status NestedLoopJoinNode::GetNextNullAwareLeftAntiJoin(RuntimeState* state,
     RowBatch* output_batch) {
-  return Status("Nested-loop join with null-aware anti join mode is not implemented");
+  const int N = BitUtil::RoundUpToPowerOfTwo(state->batch_size());
+
+  while (!eos_) {
+    DCHECK(HasValidProbeRow());
+    while (!build_row_iterator_.AtEnd()) {
+      DCHECK(current_probe_row_ != NULL);
+      CreateOutputRow(semi_join_staging_row_, current_probe_row_,
+          build_row_iterator_.GetRow());
+      build_row_iterator_.Next();
+      ++current_build_row_idx_;
+      // This loop can go on for a long time if the conjuncts are very selective. Do
+      // expensive query maintenance after every N iterations.
+      if ((current_build_row_idx_ & (N - 1)) == 0) {
+        RETURN_IF_CANCELLED(state);
+        RETURN_IF_ERROR(QueryMaintenance(state));
+      }
+      if (EvalNullAwareJoinConjuncts(semi_join_staging_row_)) {
+        // The probe row may be in the build rows, so it is not in the result.
+        matched_probe_ = true;
+        break;
+      }
+    }
+    if (!matched_probe_) RETURN_IF_ERROR(ProcessUnmatchedProbeRow(state, output_batch));
+    RETURN_IF_ERROR(NextProbeRow(state, output_batch));
+    if (output_batch->AtCapacity()) break;
+  }
+  return Status::OK();
+}
+
+bool NestedLoopJoinNode::EvalNullAwareJoinConjuncts(TupleRow* row) {
+  if (join_conjunct_ctxs_.empty()) return true;
+  // A NULL result of the NOT IN predicate means that the probe row may be equal to the
+  // build row.
+  BooleanVal v = join_conjunct_ctxs_[0]->GetBooleanVal(row);
+  if (!v.is_null && !v.val) return false;
+  return EvalConjuncts(join_conjunct_ctxs_.data() + 1, join_conjunct_ctxs_.size() - 1,
+      row);
 }
 
 Status NestedLoopJoinNode::GetNextRightOuterJoin(RuntimeState* state,
@@ -400,8 +474,8 @@ Status NestedLoopJoinNode::GetNextRightOuterJoin(RuntimeState* state,
   while (!eos_ && HasMoreProbeRows()) {
     DCHECK(HasValidProbeRow());
     bool return_output_batch = false;
-    RETURN_IF_ERROR(
-        FindBuildMatches(state, output_batch, &return_output_batch));
+    RETURN_IF_ERROR(FindBuildMatches(state, output_batch,
+        build_batches_->total_num_rows(), &return_output_batch));
     if (return_output_batch) return Status::OK();
     RETURN_IF_ERROR(NextProbeRow(state, output_batch));
     if (output_batch->AtCapacity()) return Status::OK();
@@ -508,8 +582,8 @@ Status NestedLoopJoinNode::GetNextFullOuterJoin(RuntimeState* state,
   while (!eos_ && HasMoreProbeRows()) {
     DCHECK(HasValidProbeRow());
     bool return_output_batch;
-    RETURN_IF_ERROR(
-        FindBuildMatches(state, output_batch, &return_output_batch));
+    RETURN_IF_ERROR(FindBuildMatches(state, output_batch,
+        build_batches_->total_num_rows(), &return_output_batch));
     if (return_output_batch) return Status::OK();
     if (!matched_probe_) {
       RETURN_IF_ERROR(ProcessUnmatchedProbeRow(state, output_batch));
@@ -530,8 +604,9 @@ Status NestedLoopJoinNode::ProcessUnmatchedProbeRow(RuntimeState* state,
   if (join_op_ == TJoinOp::LEFT_OUTER_JOIN || join_op_ == TJoinOp::FULL_OUTER_JOIN) {
     CreateOutputRow(output_row, current_probe_row_, NULL);
   } else {
-    DCHECK(join_op_ == TJoinOp::LEFT_ANTI_JOIN) << "Unsupported join operator: " <<
-        join_op_;
+    DCHECK(join_op_ == TJoinOp::LEFT_ANTI_JOIN ||
+        join_op_ == TJoinOp::NULL_AWARE_LEFT_ANTI_JOIN) << "Unsupported join operator: "
+        << join_op_;
     output_batch->CopyRow(current_probe_row_, output_row);
   }
   // Evaluate all the other (non-join) conjuncts.
@@ -604,8 +679,8 @@ Status NestedLoopJoinNode::ProcessUnmatchedBuildRows(
   return Status::OK();
 }
 
-Status NestedLoopJoinNode::FindBuildMatches(
-    RuntimeState* state, RowBatch* output_batch, bool* return_output_batch) {
+Status NestedLoopJoinNode::FindBuildMatches(RuntimeState* state, RowBatch* output_batch,
+    int64_t end_build_row_idx, bool* return_output_batch) {
   *return_output_batch = false;
   ExprContext* const* join_conjunct_ctxs = &join_conjunct_ctxs_[0];
   size_t num_join_ctxs = join_conjunct_ctxs_.size();
@@ -613,7 +688,7 @@ Status NestedLoopJoinNode::FindBuildMatches(
   size_t num_ctxs = conjunct_ctxs_.size();
 
   const int N = BitUtil::RoundUpToPowerOfTwo(state->batch_size());
-  while (!build_row_iterator_.AtEnd()) {
+  while (!build_row_iterator_.AtEnd() && current_build_row_idx_ < end_build_row_idx) {
     DCHECK(current_probe_row_ != NULL);
     TupleRow* output_row = output_batch->GetRow(output_batch->AddRow());
     CreateOutputRow(output_row, current_probe_row_, build_row_iterator_.GetRow());
@@ -667,12 +742,16 @@ Status NestedLoopJoinNode::NextProbeRow(RuntimeState* state, RowBatch* output_ba
       return Status::OK();
     } else {
       RETURN_IF_ERROR(child(0)->GetNext(state, probe_batch_.get(), &probe_side_eos_));
+      probe_batch_->ApplySelection();
     }
   }
   current_probe_row_ = probe_batch_->GetRow(probe_batch_pos_++);
   // We have a valid probe row; reset the build row iterator.
   build_row_iterator_ = build_batches_->Iterator();
   current_build_row_idx_ = 0;
+  build_tile_start_ = build_row_iterator_;
+  build_tile_start_idx_ = 0;
+  probe_tile_start_pos_ = probe_batch_pos_ - 1;
   VLOG_ROW << "left row: " << GetLeftChildRowString(current_probe_row_);
   return Status::OK();
 }
@@ -34,15 +34,24 @@ class TupleRow;
 class RowBatchCache;
 
 /// Operator to perform nested-loop join.
-/// This operator does not support spill to disk. Supports all join modes except
-/// null-aware left anti-join.
+/// This operator does not support spill to disk. Supports all join modes.
 /// This operator will operate in one of two modes depending on the memory ownership of
 /// row batches pulled from the child node on the build side. If the row batches own all
 /// tuple memory, the non-copying mode is used and row batches are simply accumulated in
 /// this node. If the batches reference tuple data they do not own, the copying mode is
 /// used and all data is deep copied into memory owned by this node.
 ///
-/// TODO: Add support for null-aware left-anti join.
+/// Inner and cross joins are evaluated in tiles: the rest of the current probe batch is
+/// joined with a tile of build rows that fits in the L2 cache before moving on to the
+/// next tile, instead of scanning all build rows for each probe row. The order of the
+/// output rows of these joins therefore follows the build tiles.
+///
+/// For null-aware left anti joins, the first join conjunct is the NOT IN predicate.
+/// A probe row is returned unless some build row makes that conjunct true or NULL and
+/// the remaining join conjuncts true, so NULLs on either side behave like NOT IN.
+///
+/// TODO: spill the build side to a BufferedTupleStream and join it with blocks of
+/// probe rows if it does not fit in memory.
 class NestedLoopJoinNode : public BlockingJoinNode {
  public:
   NestedLoopJoinNode(ObjectPool* pool, const TPlanNode& tnode,
@@ -56,6 +65,10 @@ class NestedLoopJoinNode : public BlockingJoinNode {
   virtual Status Reset(RuntimeState* state);
   virtual void Close(RuntimeState* state);
 
+  const std::vector<ExprContext*>& join_conjunct_ctxs() const {
+    return join_conjunct_ctxs_;
+  }
+
  protected:
   virtual Status InitGetNext(TupleRow* first_left_row);
   virtual Status ConstructBuildSide(RuntimeState* state);
@@ -85,6 +98,13 @@ class NestedLoopJoinNode : public BlockingJoinNode {
   /// Ordinal position of current_build_row_ [0, num_build_rows_).
   int64_t current_build_row_idx_;
 
+  /// The first build row of the current build tile and its ordinal position, and the
+  /// position in probe_batch_ of the first probe row of the current probe tile, which
+  /// extends to the end of probe_batch_. Only used for inner and cross joins.
+  RowBatchList::TupleRowIterator build_tile_start_;
+  int64_t build_tile_start_idx_;
+  int probe_tile_start_pos_;
+
   /// Bitmap used to identify matching build tuples for the case of OUTER/SEMI/ANTI
   /// joins. Owned exclusively by the nested loop join node.
   /// Non-NULL if a bitmap is used to record build rows that match a probe row.
@@ -100,6 +120,9 @@ class NestedLoopJoinNode : public BlockingJoinNode {
   /// Join conjuncts
   std::vector<ExprContext*> join_conjunct_ctxs_;
 
+  /// The number of build rows in a tile, see the class comment.
+  int64_t build_tile_rows_;
+
   Status GetNextInnerJoin(RuntimeState* state, RowBatch* output_batch);
   Status GetNextLeftOuterJoin(RuntimeState* state, RowBatch* output_batch);
   Status GetNextRightOuterJoin(RuntimeState* state, RowBatch* output_batch);
@@ -110,12 +133,17 @@ class NestedLoopJoinNode : public BlockingJoinNode {
   Status GetNextRightAntiJoin(RuntimeState* state, RowBatch* output_batch);
   Status GetNextNullAwareLeftAntiJoin(RuntimeState* state, RowBatch* output_batch);
 
-  /// Iterates through the build rows searching for matches with the current probe row.
-  /// If a match is found, a result row is produced and is added to the output batch.
-  /// Sets *return_output_batch to true if the limit is reached or output_batch is
-  /// at capacity, false otherwise.
+  /// Iterates through the build rows up to the one at 'end_build_row_idx' searching
+  /// for matches with the current probe row. If a match is found, a result row is
+  /// produced and is added to the output batch. Sets *return_output_batch to true if the
+  /// limit is reached or output_batch is at capacity, false otherwise.
   Status FindBuildMatches(RuntimeState* state, RowBatch* output_batch,
-      bool* return_output_batch);
+      int64_t end_build_row_idx, bool* return_output_batch);
+
+  /// Returns true if 'row', which is made of a probe and a build row, means that the
+  /// probe row may be in the build rows for a null-aware left anti join, see the class
+  /// comment.
+  bool EvalNullAwareJoinConjuncts(TupleRow* row);
 
   /// Retrieves the next probe row from the left child. This function does
   /// not guarantee that a valid probe row is produced as it may exit if
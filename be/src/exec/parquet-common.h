@@ -16,10 +16,14 @@
 #ifndef IMPALA_EXEC_PARQUET_COMMON_H
 #define IMPALA_EXEC_PARQUET_COMMON_H
 
+#include <sstream>
+#include <string>
+
 #include "gen-cpp/Descriptors_types.h"
 #include "gen-cpp/parquet_types.h"
 #include "runtime/decimal-value.h"
 #include "runtime/string-value.h"
+#include "runtime/types.h"
 #include "util/bit-util.h"
 #include "util/decimal-util.h"
 
@@ -53,24 +57,65 @@ const parquet::Type::type IMPALA_TO_PARQUET_TYPES[] = {
   parquet::Type::BYTE_ARRAY,  // CHAR(N)
 };
 
-/// Mapping of Parquet codec enums to Impala enums
+/// Mapping of Parquet codec enums to Impala enums. The ZSTD entries need a parquet.thrift
+/// that defines BROTLI, LZ4 and ZSTD, which is only assumed with IMPALA_HAVE_ZSTD.
 const THdfsCompression::type PARQUET_TO_IMPALA_CODEC[] = {
   THdfsCompression::NONE,
   THdfsCompression::SNAPPY,
   THdfsCompression::GZIP,
-  THdfsCompression::LZO
+  THdfsCompression::LZO,
+#ifdef IMPALA_HAVE_ZSTD
+  THdfsCompression::NONE,    // BROTLI, not supported
+  THdfsCompression::NONE,    // LZ4, not supported: uses a different framing than ours
+  THdfsCompression::ZSTD
+#endif
 };
 
 /// Mapping of Impala codec enums to Parquet enums
-const parquet::CompressionCodec::type IMPALA_TO_PARQUET_CODEC[] = {
-  parquet::CompressionCodec::UNCOMPRESSED,
-  parquet::CompressionCodec::SNAPPY,  // DEFAULT
-  parquet::CompressionCodec::GZIP,    // GZIP
-  parquet::CompressionCodec::GZIP,    // DEFLATE
-  parquet::CompressionCodec::SNAPPY,
-  parquet::CompressionCodec::SNAPPY,  // SNAPPY_BLOCKED
-  parquet::CompressionCodec::LZO,
-};
+inline parquet::CompressionCodec::type ImpalaToParquetCodec(
+    THdfsCompression::type codec) {
+  switch (codec) {
+    case THdfsCompression::NONE: return parquet::CompressionCodec::UNCOMPRESSED;
+    case THdfsCompression::GZIP:
+    case THdfsCompression::DEFLATE: return parquet::CompressionCodec::GZIP;
+    case THdfsCompression::LZO: return parquet::CompressionCodec::LZO;
+#ifdef IMPALA_HAVE_ZSTD
+    case THdfsCompression::ZSTD: return parquet::CompressionCodec::ZSTD;
+#endif
+    default: return parquet::CompressionCodec::SNAPPY;
+  }
+}
+
+/// Bloom filters of column chunks. The writer stores the directory of a BloomFilter
+/// after the data pages of the chunk and points to it with an entry of the
+/// key_value_metadata of the chunk's ColumnMetaData, whose key is
+/// PARQUET_BLOOM_FILTER_KEY and whose value is '<file offset>:<log heap space>:<hash
+/// type>'. The non-NULL values are hashed with RawValue::GetHashValue() and
+/// PARQUET_BLOOM_FILTER_SEED as the type that ParquetBloomFilterHashType() names, which
+/// lets readers ignore filters of columns whose type changed since the file was written.
+const char* const PARQUET_BLOOM_FILTER_KEY = "impala.bloom_filter";
+const uint32_t PARQUET_BLOOM_FILTER_SEED = 1234;
+
+/// Returns the hash type of the Bloom filters of columns of type 't', or an empty
+/// string if Bloom filters are not supported for 't'. VARCHAR includes the length, since
+/// the scanner truncates values that are longer than the length of the slot.
+inline std::string ParquetBloomFilterHashType(const ColumnType& t) {
+  switch (t.type) {
+    case TYPE_TINYINT:
+    case TYPE_SMALLINT:
+    case TYPE_INT:
+    case TYPE_BIGINT:
+    case TYPE_STRING:
+      return TypeToString(t.type);
+    case TYPE_VARCHAR: {
+      std::stringstream ss;
+      ss << "VARCHAR(" << t.len << ")";
+      return ss.str();
+    }
+    default:
+      return "";
+  }
+}
 
 /// The plain encoding does not maintain any state so all these functions
 /// are static helpers.
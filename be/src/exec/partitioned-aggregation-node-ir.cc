@@ -25,6 +25,13 @@ using namespace impala;
 
 Status PartitionedAggregationNode::ProcessBatchNoGrouping(RowBatch* batch) {
   Tuple* output_tuple = singleton_output_tuple_;
+  if (batch->has_selection()) {
+    const int* selection = batch->selection();
+    for (int i = 0; i < batch->num_selected(); ++i) {
+      UpdateTuple(&agg_fn_ctxs_[0], output_tuple, batch->GetRow(selection[i]));
+    }
+    return Status::OK();
+  }
   FOREACH_ROW(batch, 0, batch_iter) {
     UpdateTuple(&agg_fn_ctxs_[0], output_tuple, batch_iter.Get());
   }
@@ -86,8 +93,22 @@ void IR_ALWAYS_INLINE PartitionedAggregationNode::EvalAndHashPrefetchGroup(
     }
     expr_vals_cache->NextRow();
   }
-
   expr_vals_cache->ResetForRead();
+
+  // Second pass: the buckets should now be resident, so prefetch the intermediate
+  // tuples they point to. These are read by Equals() and then updated in place by
+  // UpdateTuple(), hence the prefetch for write. Aggregated rows never match an
+  // existing entry, so there is nothing to prefetch for them.
+  if (!AGGREGATED_ROWS && prefetch_mode != TPrefetchMode::NONE) {
+    for (; !expr_vals_cache->AtEnd(); expr_vals_cache->NextRow()) {
+      if (expr_vals_cache->IsRowNull()) continue;
+      const uint32_t hash = expr_vals_cache->ExprValuesHash();
+      const uint32_t partition_idx = hash >> (32 - NUM_PARTITIONING_BITS);
+      HashTable* hash_tbl = GetHashTable(partition_idx);
+      if (LIKELY(hash_tbl != NULL)) hash_tbl->PrefetchBucketData<false>(hash);
+    }
+    expr_vals_cache->ResetForRead();
+  }
 }
 
 template<bool AGGREGATED_ROWS>
@@ -106,7 +127,11 @@ Status PartitionedAggregationNode::ProcessRow(TupleRow* __restrict__ row,
   Partition* dst_partition = hash_partitions_[partition_idx];
   DCHECK_EQ(dst_partition->is_spilled(), hash_tbl == NULL);
   if (hash_tbl == NULL) {
-    // This partition is already spilled, just append the row.
+    // This partition is already spilled. Aggregate the row into its small hash table if
+    // it has one, otherwise just append the row.
+    if (!AGGREGATED_ROWS && dst_partition->spilled_hash_tbl.get() != NULL) {
+      return AggregateSpilledRow(dst_partition, row, hash, ht_ctx);
+    }
     return AppendSpilledRow<AGGREGATED_ROWS>(dst_partition, row);
   }
 
@@ -116,14 +141,11 @@ Status PartitionedAggregationNode::ProcessRow(TupleRow* __restrict__ row,
   // bucket because we checked the size above.
   HashTable::Iterator it = hash_tbl->FindBuildRowBucket(ht_ctx, &found);
   DCHECK(!it.AtEnd()) << "Hash table had no free buckets";
-  if (AGGREGATED_ROWS) {
-    // If the row is already an aggregate row, it cannot match anything in the
-    // hash table since we process the aggregate rows first. These rows should
-    // have been aggregated in the initial pass.
-    DCHECK(!found);
-  } else if (found) {
-    // Row is already in hash table. Do the aggregation and we're done.
-    UpdateTuple(&dst_partition->agg_fn_ctxs[0], it.GetTuple(), row);
+  if (found) {
+    // Row is already in hash table. Do the aggregation and we're done. Aggregated rows
+    // only match if they come from a spilled partition whose small hash table appended
+    // the same group more than once.
+    UpdateTuple(&dst_partition->agg_fn_ctxs[0], it.GetTuple(), row, AGGREGATED_ROWS);
     return Status::OK();
   }
 
@@ -151,6 +173,10 @@ Status PartitionedAggregationNode::AddIntermediateTuple(Partition* __restrict__
 
     // We did not have enough memory to add intermediate_tuple to the stream.
     RETURN_IF_ERROR(SpillPartition());
+    if (!AGGREGATED_ROWS && partition == spilled_unpartitioned_) {
+      // The aggregation switched from the single partition to partitions.
+      return AddRowToNewPartition(row, hash);
+    }
     if (partition->is_spilled()) {
       return AppendSpilledRow<AGGREGATED_ROWS>(partition, row);
     }
@@ -179,6 +205,8 @@ Status PartitionedAggregationNode::ProcessBatchStreaming(bool needs_serialize,
   HashTableCtx::ExprValuesCache* expr_vals_cache = ht_ctx->expr_values_cache();
   const int num_rows = in_batch->num_rows();
   const int cache_size = expr_vals_cache->capacity();
+  // Count the rows of each partition locally to not update 'this' for each row.
+  int partition_rows[PARTITION_FANOUT] = { 0 };
   for (int group_start = 0; group_start < num_rows; group_start += cache_size) {
     EvalAndHashPrefetchGroup<false>(in_batch, group_start, prefetch_mode, ht_ctx);
 
@@ -187,11 +215,13 @@ Status PartitionedAggregationNode::ProcessBatchStreaming(bool needs_serialize,
       TupleRow* in_row = in_batch_iter.Get();
       const uint32_t hash = expr_vals_cache->ExprValuesHash();
       const uint32_t partition_idx = hash >> (32 - NUM_PARTITIONING_BITS);
+      ++partition_rows[partition_idx];
       if (!expr_vals_cache->IsRowNull() &&
           !TryAddToHashTable(ht_ctx, hash_partitions_[partition_idx],
             GetHashTable(partition_idx), in_row, hash, &remaining_capacity[partition_idx],
             &process_batch_status_)) {
         RETURN_IF_ERROR(process_batch_status_);
+        CountPassthroughRow(&streaming_stats_[partition_idx], hash);
         // Tuple is not going into hash table, add it to the output batch.
         Tuple* intermediate_tuple = ConstructIntermediateTuple(agg_fn_ctxs_,
             out_batch->tuple_data_pool(), &process_batch_status_);
@@ -209,6 +239,10 @@ Status PartitionedAggregationNode::ProcessBatchStreaming(bool needs_serialize,
     }
     DCHECK(expr_vals_cache->AtEnd());
   }
+  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+    streaming_stats_[i].total_rows += partition_rows[i];
+    streaming_stats_[i].num_rows += partition_rows[i];
+  }
   if (needs_serialize) {
     FOREACH_ROW(out_batch, 0, out_batch_iter) {
       AggFnEvaluator::Serialize(aggregate_evaluators_, agg_fn_ctxs_,
@@ -251,6 +285,22 @@ bool PartitionedAggregationNode::TryAddToHashTable(
   return true;
 }
 
+void PartitionedAggregationNode::CountPassthroughRow(
+    StreamingPartitionStats* stats, uint32_t hash) {
+  ++stats->num_passthrough_rows;
+  const int sample_shift = 32 - NUM_PARTITIONING_BITS - STREAMING_SAMPLE_BITS;
+  if (((hash >> sample_shift) & ((1 << STREAMING_SAMPLE_BITS) - 1)) != 0) return;
+  // Index the filter by the bits below the sampling bits.
+  uint32_t* filter_entry = &stats->sample_filter[
+      (hash >> (sample_shift - STREAMING_SAMPLE_FILTER_BITS)) &
+      ((1 << STREAMING_SAMPLE_FILTER_BITS) - 1)];
+  ++stats->num_sampled_rows;
+  if (*filter_entry != hash) {
+    ++stats->num_sampled_misses;
+    *filter_entry = hash;
+  }
+}
+
 // Instantiate required templates.
 template Status PartitionedAggregationNode::ProcessBatch<false>(RowBatch*,
     TPrefetchMode::type, HashTableCtx*);
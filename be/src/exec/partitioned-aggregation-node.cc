@@ -26,6 +26,7 @@
 #include "exec/hash-table.inline.h"
 #include "exprs/agg-fn-evaluator.h"
 #include "exprs/anyval-util.h"
+#include "exprs/common-subexpr.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
 #include "exprs/slot-ref.h"
@@ -39,14 +40,30 @@
 #include "runtime/tuple.h"
 #include "runtime/tuple-row.h"
 #include "udf/udf-internal.h"
+#include "util/bit-util.h"
 #include "util/debug-util.h"
 #include "util/runtime-profile.h"
+#include "util/time.h"
 
 #include "gen-cpp/Exprs_types.h"
 #include "gen-cpp/PlanNodes_types.h"
 
 #include "common/names.h"
 
+DEFINE_bool(agg_common_subexpr_elimination, true, "(Advanced) If true, subexpressions "
+    "that occur in several grouping exprs or aggregate function inputs of an "
+    "aggregation are only evaluated once per input row.");
+DEFINE_int32(agg_spilled_partition_ht_buckets, 1024, "(Advanced) The number of buckets "
+    "of the hash table that aggregates the input rows of a spilled partition of an "
+    "aggregation before they are written to disk. 0 disables it.");
+DEFINE_bool(agg_start_unpartitioned, true, "(Advanced) If true, an aggregation that may "
+    "spill aggregates its input into a single hash table and only partitions it once "
+    "it runs out of memory.");
+DEFINE_int64(agg_max_initial_ht_buckets, 64 * 1024, "(Advanced) Maximum number of "
+    "buckets that the hash table of an aggregation partition starts with when it is "
+    "sized from the planner's estimate of the input rows or from the rows of the "
+    "spilled partition that it repartitions. The hash tables still grow beyond it.");
+
 using namespace impala;
 using namespace llvm;
 using namespace strings;
@@ -75,6 +92,12 @@ const char* PartitionedAggregationNode::LLVM_CLASS_NAME =
 /// using the planner's estimated input cardinality and the assumption that input
 /// is in a random order. This means that we assume that the reduction factor will
 /// increase over time.
+///
+/// The factors assume that the exchange spends about as much time per row as the
+/// preaggregation. The amount by which a factor exceeds 1 is scaled by the ratio of the
+/// measured time per input row of the preaggregation to the time per passed-through row
+/// of the exchange, bounded by the scales below, to aggregate more aggressively in
+/// front of a slow exchange and less in front of a fast one.
 struct StreamingHtMinReductionEntry {
   // Use 'streaming_ht_min_reduction' if the total size of hash table bucket directories in
   // bytes is greater than this threshold.
@@ -97,6 +120,14 @@ static const StreamingHtMinReductionEntry STREAMING_HT_MIN_REDUCTION[] = {
 static const int STREAMING_HT_MIN_REDUCTION_SIZE =
     sizeof(STREAMING_HT_MIN_REDUCTION) / sizeof(STREAMING_HT_MIN_REDUCTION[0]);
 
+static const double STREAMING_HT_MIN_REDUCTION_MIN_SCALE = 0.25;
+static const double STREAMING_HT_MIN_REDUCTION_MAX_SCALE = 4.0;
+
+/// The minimum number of input rows per group of the hash table of a spilled partition
+/// to keep using the table after it is flushed. Below that, the probes and copies cost
+/// more than the spilled rows that are saved.
+static const double SPILLED_HT_MIN_REDUCTION = 1.25;
+
 PartitionedAggregationNode::PartitionedAggregationNode(
     ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs)
   : ExecNode(pool, tnode, descs),
@@ -112,8 +143,10 @@ PartitionedAggregationNode::PartitionedAggregationNode(
     process_batch_no_grouping_fn_(NULL),
     process_batch_fn_(NULL),
     process_batch_streaming_fn_(NULL),
+    unaggregated_copy_row_fn_(NULL),
     build_timer_(NULL),
     ht_resize_timer_(NULL),
+    num_ht_resizes_(NULL),
     get_results_timer_(NULL),
     num_hash_buckets_(NULL),
     partitions_created_(NULL),
@@ -121,17 +154,27 @@ PartitionedAggregationNode::PartitionedAggregationNode(
     num_row_repartitioned_(NULL),
     num_repartitions_(NULL),
     num_spilled_partitions_(NULL),
+    num_spilled_rows_aggregated_(NULL),
     largest_partition_percent_(NULL),
     streaming_timer_(NULL),
     num_passthrough_rows_(NULL),
     preagg_estimated_reduction_(NULL),
     preagg_streaming_ht_min_reduction_(NULL),
+    preagg_exchange_cost_ratio_(NULL),
+    preagg_mode_changes_(NULL),
+    preagg_mode_events_(NULL),
+    exchange_time_ns_(0),
+    exchange_rows_(0),
+    last_streaming_return_ns_(0),
+    last_streaming_num_rows_(0),
     estimated_input_cardinality_(tnode.agg_node.estimated_input_cardinality),
     singleton_output_tuple_(NULL),
     singleton_output_tuple_returned_(true),
     partition_eos_(false),
     child_eos_(false),
-    partition_pool_(new ObjectPool()) {
+    partition_pool_(new ObjectPool()),
+    unpartitioned_(false),
+    spilled_unpartitioned_(NULL) {
   DCHECK_EQ(PARTITION_FANOUT, 1 << NUM_PARTITIONING_BITS);
   if (is_streaming_preagg_) {
     DCHECK(conjunct_ctxs_.empty()) << "Preaggs have no conjuncts";
@@ -155,6 +198,7 @@ Status PartitionedAggregationNode::Init(const TPlanNode& tnode, RuntimeState* st
 
 Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
 
   // Create the codegen object before preparing conjunct_ctxs_ and children_, so that any
   // ScalarFnCalls will use codegen.
@@ -171,6 +215,7 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
   agg_fn_pool_.reset(new MemPool(expr_mem_tracker()));
 
   ht_resize_timer_ = ADD_TIMER(runtime_profile(), "HTResizeTime");
+  num_ht_resizes_ = ADD_COUNTER(runtime_profile(), "HashTableResizes", TUnit::UNIT);
   get_results_timer_ = ADD_TIMER(runtime_profile(), "GetResultsTime");
   num_hash_buckets_ =
       ADD_COUNTER(runtime_profile(), "HashBuckets", TUnit::UNIT);
@@ -187,6 +232,24 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
         runtime_profile(), "ReductionFactorEstimate", TUnit::DOUBLE_VALUE);
     preagg_streaming_ht_min_reduction_ = ADD_COUNTER(
         runtime_profile(), "ReductionFactorThresholdToExpand", TUnit::DOUBLE_VALUE);
+    preagg_exchange_cost_ratio_ = ADD_COUNTER(
+        runtime_profile(), "ExchangeCostRatio", TUnit::DOUBLE_VALUE);
+    preagg_mode_changes_ =
+        ADD_COUNTER(runtime_profile(), "HashTableExpansionChanges", TUnit::UNIT);
+    preagg_mode_events_ =
+        runtime_profile()->AddEventSequence("Hash Table Expansion Changes");
+    for (int i = 0; i < PARTITION_FANOUT; ++i) {
+      StreamingPartitionStats* stats = &streaming_stats_[i];
+      stats->expand = true;
+      stats->total_rows = 0;
+      stats->num_rows = 0;
+      stats->num_passthrough_rows = 0;
+      stats->ht_size = 0;
+      stats->num_sampled_rows = 0;
+      stats->num_sampled_misses = 0;
+      stats->passthrough_reduction = -1;
+      memset(stats->sample_filter, 0xff, sizeof(stats->sample_filter));
+    }
   } else {
     build_timer_ = ADD_TIMER(runtime_profile(), "BuildTime");
     num_row_repartitioned_ =
@@ -195,6 +258,8 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
         ADD_COUNTER(runtime_profile(), "NumRepartitions", TUnit::UNIT);
     num_spilled_partitions_ =
         ADD_COUNTER(runtime_profile(), "SpilledPartitions", TUnit::UNIT);
+    num_spilled_rows_aggregated_ =
+        ADD_COUNTER(runtime_profile(), "SpilledRowsAggregated", TUnit::UNIT);
     max_partition_level_ = runtime_profile()->AddHighWaterMarkCounter(
         "MaxPartitionLevel", TUnit::UNIT);
   }
@@ -205,6 +270,24 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
   DCHECK_EQ(intermediate_tuple_desc_->slots().size(),
         output_tuple_desc_->slots().size());
 
+  // The exprs are rewritten before they are prepared, so that both the interpreted and
+  // the codegen'd exprs share the subexpressions.
+  if (FLAGS_agg_common_subexpr_elimination) {
+    vector<ExprContext*> input_expr_ctxs = grouping_expr_ctxs_;
+    for (AggFnEvaluator* evaluator: aggregate_evaluators_) {
+      input_expr_ctxs.insert(input_expr_ctxs.end(), evaluator->input_expr_ctxs().begin(),
+          evaluator->input_expr_ctxs().end());
+    }
+    common_subexprs_.reset(new CommonSubexprs(pool_));
+    int num_shared = common_subexprs_->Rewrite(input_expr_ctxs);
+    if (num_shared == 0) {
+      common_subexprs_.reset();
+    } else {
+      COUNTER_SET(ADD_COUNTER(runtime_profile(), "NumSharedSubexprs", TUnit::UNIT),
+          static_cast<int64_t>(num_shared));
+    }
+  }
+
   RETURN_IF_ERROR(Expr::Prepare(grouping_expr_ctxs_, state, child(0)->row_desc(),
       expr_mem_tracker()));
   AddExprCtxsToFree(grouping_expr_ctxs_);
@@ -259,7 +342,7 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     RETURN_IF_ERROR(state_->block_mgr()->RegisterClient(
         Substitute("PartitionedAggregationNode id=$0 ptr=$1", id_, this),
         MinRequiredBuffers(), true, mem_tracker(), state, &block_mgr_client_));
-    RETURN_IF_ERROR(CreateHashPartitions(0));
+    RETURN_IF_ERROR(CreateHashPartitions(0, EstimatedInputGroups()));
   }
 
   // TODO: Is there a need to create the stream here? If memory reservations work we may
@@ -280,11 +363,19 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     codegen_enabled = codegen_status.ok();
   }
   AddCodegenExecOption(codegen_enabled, codegen_status);
+  if (state->codegen_enabled() && !is_streaming_preagg_ && !grouping_expr_ctxs_.empty()) {
+    // Only spilled partitions copy the child's rows into their streams.
+    Status copy_row_codegen_status = BufferedTupleStream::Codegen(state,
+        child(0)->row_desc(), &unaggregated_copy_row_fn_);
+    AddCodegenExecOption(copy_row_codegen_status.ok(), copy_row_codegen_status,
+        "Stream Row Copy");
+  }
   return Status::OK();
 }
 
 Status PartitionedAggregationNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
 
   RETURN_IF_ERROR(Expr::Open(grouping_expr_ctxs_, state));
@@ -301,12 +392,17 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
   if (is_streaming_preagg_) return Status::OK();
 
   RowBatch batch(child(0)->row_desc(), state->batch_size(), mem_tracker());
+  // Lets a select child pass its selected rows without copying them. Without grouping
+  // the selected rows are aggregated directly. Otherwise they are compacted first,
+  // since ProcessBatch() walks the rows in groups for prefetching.
+  batch.EnableSelection();
   // Read all the rows from the child and process them.
   bool eos = false;
   do {
     RETURN_IF_CANCELLED(state);
     RETURN_IF_ERROR(QueryMaintenance(state));
     RETURN_IF_ERROR(children_[0]->GetNext(state, &batch, &eos));
+    if (!grouping_expr_ctxs_.empty() || UNLIKELY(VLOG_ROW_IS_ON)) batch.ApplySelection();
 
     if (UNLIKELY(VLOG_ROW_IS_ON)) {
       for (int i = 0; i < batch.num_rows(); ++i) {
@@ -317,16 +413,21 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
 
     TPrefetchMode::type prefetch_mode = state->query_options().prefetch_mode;
     SCOPED_TIMER(build_timer_);
+    if (common_subexprs_ != NULL) common_subexprs_->StartBatch(&batch);
     if (grouping_expr_ctxs_.empty()) {
-      if (process_batch_no_grouping_fn_ != NULL) {
-        RETURN_IF_ERROR(process_batch_no_grouping_fn_(this, &batch));
+      ProcessBatchNoGroupingFn process_batch_no_grouping_fn =
+          LlvmCodeGen::LoadJittedFunction(&process_batch_no_grouping_fn_);
+      if (process_batch_no_grouping_fn != NULL) {
+        RETURN_IF_ERROR(process_batch_no_grouping_fn(this, &batch));
       } else {
         RETURN_IF_ERROR(ProcessBatchNoGrouping(&batch));
       }
     } else {
       // There is grouping, so we will do partitioned aggregation.
-      if (process_batch_fn_ != NULL) {
-        RETURN_IF_ERROR(process_batch_fn_(this, &batch, prefetch_mode, ht_ctx_.get()));
+      ProcessBatchFn process_batch_fn =
+          LlvmCodeGen::LoadJittedFunction(&process_batch_fn_);
+      if (process_batch_fn != NULL) {
+        RETURN_IF_ERROR(process_batch_fn(this, &batch, prefetch_mode, ht_ctx_.get()));
       } else {
         RETURN_IF_ERROR(ProcessBatch<false>(&batch, prefetch_mode, ht_ctx_.get()));
       }
@@ -345,6 +446,7 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
   // to spilled_partitions_ or aggregated_partitions_. We'll finish the processing in
   // GetNext().
   if (!grouping_expr_ctxs_.empty()) {
+    if (spilled_unpartitioned_ != NULL) RETURN_IF_ERROR(ProcessSpilledUnpartitioned());
     RETURN_IF_ERROR(MoveHashPartitions(child(0)->rows_returned()));
   }
   return Status::OK();
@@ -408,6 +510,7 @@ Status PartitionedAggregationNode::CopyStringData(const SlotDescriptor* slot_des
 Status PartitionedAggregationNode::GetNextInternal(RuntimeState* state,
     RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -521,6 +624,11 @@ Status PartitionedAggregationNode::GetRowsStreaming(RuntimeState* state,
     child_batch_.reset(new RowBatch(child(0)->row_desc(), state->batch_size(),
         mem_tracker()));
   }
+  // The rows returned by the last call were sent by the exchange in the meantime.
+  if (last_streaming_return_ns_ != 0) {
+    exchange_time_ns_ += MonotonicNanos() - last_streaming_return_ns_;
+    exchange_rows_ += last_streaming_num_rows_;
+  }
 
   do {
     DCHECK_EQ(out_batch->num_rows(), 0);
@@ -540,26 +648,33 @@ Status PartitionedAggregationNode::GetRowsStreaming(RuntimeState* state,
       ht_needs_expansion |= remaining_capacity[i] < child_batch_->num_rows();
     }
 
-    // Stop expanding hash tables if we're not reducing the input sufficiently. As our
-    // hash tables expand out of each level of cache hierarchy, every hash table lookup
-    // will take longer. We also may not be able to expand hash tables because of memory
-    // pressure. In this case HashTable::CheckAndResize() will fail. In either case we
-    // should always use the remaining space in the hash table to avoid wasting memory.
-    if (ht_needs_expansion && ShouldExpandPreaggHashTables()) {
+    // Stop expanding the hash table of a partition if we're not reducing its input
+    // sufficiently. As our hash tables expand out of each level of cache hierarchy,
+    // every hash table lookup will take longer. We also may not be able to expand hash
+    // tables because of memory pressure. In this case HashTable::CheckAndResize() will
+    // fail. In either case we should always use the remaining space in the hash table
+    // to avoid wasting memory.
+    if (ht_needs_expansion) {
+      double min_reduction = GetPreaggMinReduction();
       for (int i = 0; i < PARTITION_FANOUT; ++i) {
+        if (remaining_capacity[i] >= child_batch_->num_rows()) continue;
+        if (!ShouldExpandPreaggHashTable(i, min_reduction)) continue;
         HashTable* ht = GetHashTable(i);
-        if (remaining_capacity[i] < child_batch_->num_rows()) {
-          SCOPED_TIMER(ht_resize_timer_);
-          if (ht->CheckAndResize(child_batch_->num_rows(), ht_ctx_.get())) {
-            remaining_capacity[i] = ht->NumInsertsBeforeResize();
-          }
+        SCOPED_TIMER(ht_resize_timer_);
+        int64_t num_resizes = ht->num_resizes();
+        if (ht->CheckAndResize(child_batch_->num_rows(), ht_ctx_.get())) {
+          remaining_capacity[i] = ht->NumInsertsBeforeResize();
         }
+        COUNTER_ADD(num_ht_resizes_, ht->num_resizes() - num_resizes);
       }
     }
 
     TPrefetchMode::type prefetch_mode = state->query_options().prefetch_mode;
-    if (process_batch_streaming_fn_ != NULL) {
-      RETURN_IF_ERROR(process_batch_streaming_fn_(this, needs_serialize_, prefetch_mode,
+    if (common_subexprs_ != NULL) common_subexprs_->StartBatch(child_batch_.get());
+    ProcessBatchStreamingFn process_batch_streaming_fn =
+        LlvmCodeGen::LoadJittedFunction(&process_batch_streaming_fn_);
+    if (process_batch_streaming_fn != NULL) {
+      RETURN_IF_ERROR(process_batch_streaming_fn(this, needs_serialize_, prefetch_mode,
           child_batch_.get(), out_batch, ht_ctx_.get(), remaining_capacity));
     } else {
       RETURN_IF_ERROR(ProcessBatchStreaming(needs_serialize_, prefetch_mode,
@@ -577,55 +692,116 @@ Status PartitionedAggregationNode::GetRowsStreaming(RuntimeState* state,
 
   num_rows_returned_ += out_batch->num_rows();
   COUNTER_SET(num_passthrough_rows_, num_rows_returned_);
+  last_streaming_return_ns_ = child_eos_ ? 0 : MonotonicNanos();
+  last_streaming_num_rows_ = out_batch->num_rows();
   return Status::OK();
 }
 
-bool PartitionedAggregationNode::ShouldExpandPreaggHashTables() const {
+double PartitionedAggregationNode::GetPreaggMinReduction() {
   int64_t ht_mem = 0;
-  int64_t ht_rows = 0;
   for (int i = 0; i < PARTITION_FANOUT; ++i) {
-    HashTable* ht = hash_partitions_[i]->hash_tbl.get();
-    ht_mem += ht->CurrentMemSize();
-    ht_rows += ht->size();
+    ht_mem += hash_partitions_[i]->hash_tbl->CurrentMemSize();
   }
 
-  // Need some rows in tables to have valid statistics.
-  if (ht_rows == 0) return true;
-
   // Find the appropriate reduction factor in our table for the current hash table sizes.
   int cache_level = 0;
   while (cache_level + 1 < STREAMING_HT_MIN_REDUCTION_SIZE &&
       ht_mem >= STREAMING_HT_MIN_REDUCTION[cache_level + 1].min_ht_mem) {
     ++cache_level;
   }
+  double min_reduction =
+      STREAMING_HT_MIN_REDUCTION[cache_level].streaming_ht_min_reduction;
 
-  // Compare the number of rows in the hash table with the number of input rows that
-  // were aggregated into it. Exclude passed through rows from this calculation since
-  // they were not in hash tables.
+  // Scale the factor by the relative cost of the exchange once it has sent enough rows
+  // for a meaningful measurement.
   const int64_t input_rows = children_[0]->rows_returned();
-  const int64_t aggregated_input_rows = input_rows - num_rows_returned_;
-  const int64_t expected_input_rows = estimated_input_cardinality_ - num_rows_returned_;
-  double current_reduction = static_cast<double>(aggregated_input_rows) / ht_rows;
+  if (min_reduction > 1 && exchange_rows_ >= STREAMING_DECISION_MIN_ROWS &&
+      input_rows > 0 && exchange_time_ns_ > 0) {
+    double preagg_ns_per_row =
+        static_cast<double>(streaming_timer_->value()) / input_rows;
+    double exchange_ns_per_row =
+        static_cast<double>(exchange_time_ns_) / exchange_rows_;
+    double ratio = exchange_ns_per_row / max(preagg_ns_per_row, 1.0);
+    double scale = min(max(1 / ratio, STREAMING_HT_MIN_REDUCTION_MIN_SCALE),
+        STREAMING_HT_MIN_REDUCTION_MAX_SCALE);
+    min_reduction = 1 + (min_reduction - 1) * scale;
+    COUNTER_SET(preagg_exchange_cost_ratio_, ratio);
+  }
+  COUNTER_SET(preagg_streaming_ht_min_reduction_, min_reduction);
+  return min_reduction;
+}
 
+bool PartitionedAggregationNode::ShouldExpandPreaggHashTable(int partition_idx,
+    double min_reduction) {
+  StreamingPartitionStats* stats = &streaming_stats_[partition_idx];
+  if (!stats->expand) {
+    // Update the reduction of the passed-through rows at the end of each window. Keys
+    // are remembered across windows, so repetitions further apart than a window count
+    // as long as the keys weren't evicted from the filter.
+    if (stats->num_sampled_rows >= STREAMING_SAMPLE_WINDOW) {
+      stats->passthrough_reduction = static_cast<double>(stats->num_sampled_rows) /
+          max(stats->num_sampled_misses, 1);
+      stats->num_sampled_rows = 0;
+      stats->num_sampled_misses = 0;
+      COUNTER_SET(preagg_estimated_reduction_, stats->passthrough_reduction);
+    }
+    if (stats->num_rows < STREAMING_DECISION_MIN_ROWS ||
+        stats->passthrough_reduction <= min_reduction) {
+      return false;
+    }
+    SetPreaggExpand(partition_idx, true, stats->passthrough_reduction, min_reduction);
+    return true;
+  }
+
+  // Need some rows in the table to have valid statistics.
+  const int64_t new_groups = GetHashTable(partition_idx)->size() - stats->ht_size;
+  if (new_groups <= 0 || stats->num_rows < STREAMING_DECISION_MIN_ROWS) return true;
+
+  // Compare the number of groups added to the hash table with the number of input rows
+  // that were aggregated into it. Exclude passed through rows from this calculation
+  // since they were not in hash tables.
+  const int64_t aggregated_input_rows = stats->num_rows - stats->num_passthrough_rows;
   // TODO: workaround for IMPALA-2490: subplan node rows_returned counter may be
   // inaccurate, which could lead to a divide by zero below.
   if (aggregated_input_rows <= 0) return true;
+  const int64_t expected_input_rows = estimated_input_cardinality_ / PARTITION_FANOUT
+      - (stats->total_rows - stats->num_rows) - stats->num_passthrough_rows;
+  double current_reduction = static_cast<double>(aggregated_input_rows) / new_groups;
 
   // Extrapolate the current reduction factor (r) using the formula
   // R = 1 + (N / n) * (r - 1), where R is the reduction factor over the full input data
   // set, N is the number of input rows, excluding passed-through rows, and n is the
   // number of rows inserted or merged into the hash tables. This is a very rough
   // approximation but is good enough to be useful.
-  // TODO: consider collecting more statistics to better estimate reduction.
   double estimated_reduction = aggregated_input_rows >= expected_input_rows
       ? current_reduction
-      : 1 + (expected_input_rows / aggregated_input_rows) * (current_reduction - 1);
-  double min_reduction =
-    STREAMING_HT_MIN_REDUCTION[cache_level].streaming_ht_min_reduction;
-
+      : 1 + (static_cast<double>(expected_input_rows) / aggregated_input_rows)
+          * (current_reduction - 1);
   COUNTER_SET(preagg_estimated_reduction_, estimated_reduction);
-  COUNTER_SET(preagg_streaming_ht_min_reduction_, min_reduction);
-  return estimated_reduction > min_reduction;
+  if (estimated_reduction > min_reduction) return true;
+  SetPreaggExpand(partition_idx, false, estimated_reduction, min_reduction);
+  return false;
+}
+
+void PartitionedAggregationNode::SetPreaggExpand(int partition_idx, bool expand,
+    double reduction, double min_reduction) {
+  StreamingPartitionStats* stats = &streaming_stats_[partition_idx];
+  DCHECK_NE(stats->expand, expand);
+  stats->expand = expand;
+  stats->num_rows = 0;
+  stats->num_passthrough_rows = 0;
+  stats->ht_size = GetHashTable(partition_idx)->size();
+  stats->num_sampled_rows = 0;
+  stats->num_sampled_misses = 0;
+  stats->passthrough_reduction = -1;
+  // A hash with all sampling bits set is never sampled, so it marks an empty entry.
+  memset(stats->sample_filter, 0xff, sizeof(stats->sample_filter));
+  COUNTER_ADD(preagg_mode_changes_, 1);
+  if (preagg_mode_changes_->value() <= MAX_PREAGG_MODE_EVENTS) {
+    preagg_mode_events_->MarkEvent(Substitute(
+        "Partition $0 $1 expanding: reduction $2, threshold $3", partition_idx,
+        expand ? "started" : "stopped", reduction, min_reduction));
+  }
 }
 
 void PartitionedAggregationNode::CleanupHashTbl(
@@ -668,7 +844,7 @@ Status PartitionedAggregationNode::Reset(RuntimeState* state) {
     // Reset the HT and the partitions for this grouping agg.
     ht_ctx_->set_level(0);
     ClosePartitions();
-    RETURN_IF_ERROR(CreateHashPartitions(0));
+    RETURN_IF_ERROR(CreateHashPartitions(0, EstimatedInputGroups()));
   }
   return ExecNode::Reset(state);
 }
@@ -746,6 +922,7 @@ Status PartitionedAggregationNode::Partition::InitStreams() {
         parent->child(0)->row_desc(), parent->state_->block_mgr(),
       parent->block_mgr_client_, true /* use_initial_small_buffers */,
         false /* read_write */));
+    unaggregated_row_stream->set_copy_row_fn(parent->unaggregated_copy_row_fn_);
     // This stream is only used to spill, no need to ever have this pinned.
     RETURN_IF_ERROR(unaggregated_row_stream->Init(parent->id(), parent->runtime_profile(),
         false));
@@ -754,19 +931,43 @@ Status PartitionedAggregationNode::Partition::InitStreams() {
   return Status::OK();
 }
 
-bool PartitionedAggregationNode::Partition::InitHashTable() {
+bool PartitionedAggregationNode::Partition::InitHashTable(int64_t estimated_num_groups) {
   DCHECK(hash_tbl.get() == NULL);
   // We use the upper PARTITION_FANOUT num bits to pick the partition so only the
   // remaining bits can be used for the hash table.
   // TODO: we could switch to 64 bit hashes and then we don't need a max size.
   // It might be reasonable to limit individual hash table size for other reasons
   // though. Always start with small buffers.
-  // TODO: How many buckets? We currently use a default value, 1024.
   static const int64_t PAGG_DEFAULT_HASH_TABLE_SZ = 1024;
+  const int64_t max_num_buckets = 1L << (32 - NUM_PARTITIONING_BITS);
+  // Start with enough buckets for the estimated groups to avoid rehashing the table
+  // repeatedly as it grows. The estimates are upper bounds that can be far off if the
+  // input is reduced a lot, so the initial size is capped.
+  int64_t num_buckets = PAGG_DEFAULT_HASH_TABLE_SZ;
+  if (estimated_num_groups > 0) {
+    int64_t max_initial_buckets = min(max_num_buckets,
+        BitUtil::RoundUpToPowerOfTwo(max<int64_t>(FLAGS_agg_max_initial_ht_buckets, 1)));
+    num_buckets = max(num_buckets, min(max_initial_buckets,
+        HashTable::EstimateNumBuckets(estimated_num_groups)));
+  }
   hash_tbl.reset(HashTable::Create(parent->state_, parent->block_mgr_client_,
-      false, 1, NULL, 1L << (32 - NUM_PARTITIONING_BITS),
-      PAGG_DEFAULT_HASH_TABLE_SZ));
-  return hash_tbl->Init();
+      false, 1, NULL, max_num_buckets, num_buckets));
+  if (!hash_tbl->Init()) {
+    if (num_buckets == PAGG_DEFAULT_HASH_TABLE_SZ) return false;
+    // Fall back to a small table if there is no memory for the larger one.
+    hash_tbl->Close();
+    hash_tbl.reset(HashTable::Create(parent->state_, parent->block_mgr_client_,
+        false, 1, NULL, max_num_buckets, PAGG_DEFAULT_HASH_TABLE_SZ));
+    if (!hash_tbl->Init()) return false;
+  }
+  // A TINYINT or SMALLINT grouping key has few enough values to look up every group in
+  // a direct index. The table still works without it.
+  const int key_bytes = parent->ht_ctx_->direct_index_key_bytes();
+  if (key_bytes == 1 || key_bytes == 2) {
+    const int64_t num_keys = 1L << (8 * key_bytes);
+    hash_tbl->InitDirectIndex(parent->ht_ctx_.get(), -num_keys / 2, num_keys);
+  }
+  return true;
 }
 
 Status PartitionedAggregationNode::Partition::SerializeStreamForSpilling() {
@@ -857,6 +1058,7 @@ Status PartitionedAggregationNode::Partition::Spill() {
 
   hash_tbl->Close();
   hash_tbl.reset();
+  InitSpilledHashTable();
 
   // Try to switch both streams to IO-sized buffers to avoid allocating small buffers
   // for spilled partition.
@@ -894,9 +1096,44 @@ Status PartitionedAggregationNode::Partition::Spill() {
   return Status::OK();
 }
 
+void PartitionedAggregationNode::Partition::InitSpilledHashTable() {
+  DCHECK(is_spilled());
+  DCHECK(spilled_hash_tbl.get() == NULL);
+  if (FLAGS_agg_spilled_partition_ht_buckets <= 0) return;
+  // The table doesn't grow, it is flushed when it is full.
+  int64_t num_buckets =
+      BitUtil::RoundUpToPowerOfTwo(FLAGS_agg_spilled_partition_ht_buckets);
+  spilled_hash_tbl.reset(HashTable::Create(parent->state_, parent->block_mgr_client_,
+      false, 1, NULL, num_buckets, num_buckets));
+  if (!spilled_hash_tbl->Init()) {
+    spilled_hash_tbl->Close();
+    spilled_hash_tbl.reset();
+    return;
+  }
+  if (spilled_tuple_pool.get() == NULL) {
+    spilled_tuple_pool.reset(new MemPool(parent->mem_tracker()));
+  }
+  if (agg_fn_pool.get() == NULL) {
+    // Spill() closed the contexts of the spilled groups, the new groups need their own.
+    agg_fn_pool.reset(new MemPool(parent->expr_mem_tracker()));
+    agg_fn_ctxs.clear();
+    for (int i = 0; i < parent->agg_fn_ctxs_.size(); ++i) {
+      agg_fn_ctxs.push_back(parent->agg_fn_ctxs_[i]->impl()->Clone(agg_fn_pool.get()));
+      parent->partition_pool_->Add(agg_fn_ctxs[i]);
+    }
+  }
+  num_spilled_hash_tbl_rows = 0;
+}
+
 void PartitionedAggregationNode::Partition::Close(bool finalize_rows) {
   if (is_closed) return;
   is_closed = true;
+  if (spilled_hash_tbl.get() != NULL) {
+    // Let the UDAs clean up the groups that weren't flushed.
+    parent->CleanupHashTbl(agg_fn_ctxs, spilled_hash_tbl->Begin(parent->ht_ctx_.get()));
+    spilled_hash_tbl->Close();
+  }
+  if (spilled_tuple_pool.get() != NULL) spilled_tuple_pool->FreeAll();
   if (aggregated_row_stream.get() != NULL) {
     if (finalize_rows && hash_tbl.get() != NULL) {
       // We need to walk all the rows and Finalize them here so the UDA gets a chance
@@ -1112,6 +1349,87 @@ Status PartitionedAggregationNode::AppendSpilledRow(BufferedTupleStream* stream,
   return process_batch_status_;
 }
 
+Status PartitionedAggregationNode::AggregateSpilledRow(Partition* partition,
+    TupleRow* row, uint32_t hash, HashTableCtx* ht_ctx) {
+  DCHECK(partition->is_spilled());
+  HashTable* ht = partition->spilled_hash_tbl.get();
+  DCHECK(ht != NULL);
+  bool found;
+  HashTable::Iterator it = ht->FindBuildRowBucket(ht_ctx, &found);
+  if (found) {
+    UpdateTuple(&partition->agg_fn_ctxs[0], it.GetTuple(), row);
+    ++partition->num_spilled_hash_tbl_rows;
+    return Status::OK();
+  }
+  if (ht->NumInsertsBeforeResize() == 0) {
+    RETURN_IF_ERROR(FlushSpilledHashTable(partition, false));
+    ht = partition->spilled_hash_tbl.get();
+    if (ht == NULL) {
+      return AppendSpilledRow(partition->unaggregated_row_stream.get(), row);
+    }
+    it = ht->FindBuildRowBucket(ht_ctx, &found);
+    DCHECK(!found);
+  }
+
+  // Construct the new group like ConstructIntermediateTuple(), but fall back to
+  // spilling the row instead of failing if there is no memory for it.
+  const int fixed_size = intermediate_tuple_desc_->byte_size();
+  const int varlen_size = GroupingExprsVarlenSize();
+  uint8_t* tuple_data =
+      partition->spilled_tuple_pool->TryAllocate(fixed_size + varlen_size);
+  if (tuple_data == NULL) {
+    RETURN_IF_ERROR(FlushSpilledHashTable(partition, true));
+    return AppendSpilledRow(partition->unaggregated_row_stream.get(), row);
+  }
+  memset(tuple_data, 0, fixed_size);
+  Tuple* intermediate_tuple = reinterpret_cast<Tuple*>(tuple_data);
+  CopyGroupingValues(intermediate_tuple, tuple_data + fixed_size, varlen_size);
+  InitAggSlots(partition->agg_fn_ctxs, intermediate_tuple);
+  UpdateTuple(&partition->agg_fn_ctxs[0], intermediate_tuple, row);
+  it.SetTuple(intermediate_tuple, hash);
+  ++partition->num_spilled_hash_tbl_rows;
+  return Status::OK();
+}
+
+Status PartitionedAggregationNode::FlushSpilledHashTable(Partition* partition,
+    bool drop) {
+  DCHECK(partition->is_spilled());
+  HashTable* ht = partition->spilled_hash_tbl.get();
+  DCHECK(ht != NULL);
+  const int64_t num_groups = ht->size();
+  const int64_t num_rows = partition->num_spilled_hash_tbl_rows;
+
+  // The groups are appended like the aggregated rows of a partition that spills, see
+  // Partition::SerializeStreamForSpilling().
+  Status status;
+  HashTable::Iterator it = ht->Begin(ht_ctx_.get());
+  while (!it.AtEnd()) {
+    Tuple* tuple = it.GetTuple();
+    it.Next();
+    if (needs_serialize_) {
+      AggFnEvaluator::Serialize(aggregate_evaluators_, partition->agg_fn_ctxs, tuple);
+    }
+    status = AppendSpilledRow(partition->aggregated_row_stream.get(),
+        reinterpret_cast<TupleRow*>(&tuple));
+    if (!status.ok()) break;
+  }
+  // Let the UDAs clean up the groups that weren't appended because of an error.
+  if (!status.ok()) CleanupHashTbl(partition->agg_fn_ctxs, it);
+  ht->Close();
+  partition->spilled_hash_tbl.reset();
+  partition->spilled_tuple_pool->Clear();
+  partition->num_spilled_hash_tbl_rows = 0;
+  RETURN_IF_ERROR(status);
+
+  COUNTER_ADD(num_spilled_rows_aggregated_, num_rows - num_groups);
+  if (drop || num_rows < num_groups * SPILLED_HT_MIN_REDUCTION) {
+    partition->spilled_tuple_pool->FreeAll();
+    return Status::OK();
+  }
+  partition->InitSpilledHashTable();
+  return Status::OK();
+}
+
 void PartitionedAggregationNode::DebugString(int indentation_level,
     stringstream* out) const {
   *out << string(indentation_level * 2, ' ');
@@ -1125,7 +1443,14 @@ void PartitionedAggregationNode::DebugString(int indentation_level,
   *out << ")";
 }
 
-Status PartitionedAggregationNode::CreateHashPartitions(int level) {
+int64_t PartitionedAggregationNode::EstimatedInputGroups() const {
+  // A streaming preaggregation decides by itself when to grow its hash tables.
+  if (is_streaming_preagg_) return -1;
+  return estimated_input_cardinality_;
+}
+
+Status PartitionedAggregationNode::CreateHashPartitions(int level,
+    int64_t estimated_num_groups) {
   if (is_streaming_preagg_) DCHECK_EQ(level, 0);
   if (level >= MAX_PARTITION_DEPTH) {
     return state_->SetMemLimitExceeded(ErrorMsg(
@@ -1134,7 +1459,12 @@ Status PartitionedAggregationNode::CreateHashPartitions(int level) {
   ht_ctx_->set_level(level);
 
   DCHECK(hash_partitions_.empty());
-  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+  // The input starts out in a single partition, unless the aggregation already ran out
+  // of memory with it.
+  unpartitioned_ = level == 0 && !is_streaming_preagg_ && FLAGS_agg_start_unpartitioned
+      && spilled_unpartitioned_ == NULL;
+  int num_partitions = unpartitioned_ ? 1 : PARTITION_FANOUT;
+  for (int i = 0; i < num_partitions; ++i) {
     Partition* new_partition = new Partition(this, level);
     DCHECK(new_partition != NULL);
     hash_partitions_.push_back(partition_pool_->Add(new_partition));
@@ -1147,8 +1477,9 @@ Status PartitionedAggregationNode::CreateHashPartitions(int level) {
 
   // Now that all the streams are reserved (meaning we have enough memory to execute
   // the algorithm), allocate the hash tables. These can fail and we can still continue.
-  for (int i = 0; i < PARTITION_FANOUT; ++i) {
-    if (!hash_partitions_[i]->InitHashTable()) {
+  for (int i = 0; i < num_partitions; ++i) {
+    if (!hash_partitions_[i]->InitHashTable(estimated_num_groups < 0 ?
+            -1 : estimated_num_groups / num_partitions)) {
       // We don't spill on preaggregations. If we have so little memory that we can't
       // allocate small hash tables, the mem limit is just too low.
       if (is_streaming_preagg_) {
@@ -1160,11 +1491,18 @@ Status PartitionedAggregationNode::CreateHashPartitions(int level) {
         return status;
       }
       RETURN_IF_ERROR(hash_partitions_[i]->Spill());
+      // There is nothing to gain from partitioning the input later.
+      unpartitioned_ = false;
     }
     hash_tbls_[i] = hash_partitions_[i]->hash_tbl.get();
   }
+  // All partition indices map to the single partition.
+  for (int i = num_partitions; i < PARTITION_FANOUT; ++i) {
+    hash_partitions_.push_back(hash_partitions_[0]);
+    hash_tbls_[i] = hash_tbls_[0];
+  }
 
-  COUNTER_ADD(partitions_created_, hash_partitions_.size());
+  COUNTER_ADD(partitions_created_, num_partitions);
   if (!is_streaming_preagg_) {
     COUNTER_SET(max_partition_level_, level);
   }
@@ -1176,10 +1514,15 @@ Status PartitionedAggregationNode::CheckAndResizeHashPartitions(int num_rows,
   DCHECK(!is_streaming_preagg_);
   for (int i = 0; i < PARTITION_FANOUT; ++i) {
     Partition* partition = hash_partitions_[i];
+    if (i > 0 && partition == hash_partitions_[i - 1]) continue;
     while (!partition->is_spilled()) {
       {
         SCOPED_TIMER(ht_resize_timer_);
-        if (partition->hash_tbl->CheckAndResize(num_rows, ht_ctx)) break;
+        HashTable* ht = partition->hash_tbl.get();
+        int64_t num_resizes = ht->num_resizes();
+        bool fits = ht->CheckAndResize(num_rows, ht_ctx);
+        COUNTER_ADD(num_ht_resizes_, ht->num_resizes() - num_resizes);
+        if (fits) break;
       }
       RETURN_IF_ERROR(SpillPartition());
     }
@@ -1229,7 +1572,10 @@ Status PartitionedAggregationNode::NextPartition() {
       // TODO: we don't need to repartition here. We are now working on 1 / FANOUT
       // of the input so it's reasonably likely it can fit. We should look at this
       // partitions size and just do the aggregation if it fits in memory.
-      RETURN_IF_ERROR(CreateHashPartitions(partition->level + 1));
+      // The spilled rows are an upper bound on the number of groups.
+      RETURN_IF_ERROR(CreateHashPartitions(partition->level + 1,
+          partition->aggregated_row_stream->num_rows() +
+          partition->unaggregated_row_stream->num_rows()));
       COUNTER_ADD(num_repartitions_, 1);
 
       // Rows in this partition could have been spilled into two streams, depending
@@ -1295,9 +1641,13 @@ Status PartitionedAggregationNode::ProcessStream(BufferedTupleStream* input_stre
                    state_->batch_size(), mem_tracker());
     do {
       RETURN_IF_ERROR(input_stream->GetNext(&batch, &eos));
+      if (!AGGREGATED_ROWS && common_subexprs_ != NULL) {
+        common_subexprs_->StartBatch(&batch);
+      }
       RETURN_IF_ERROR(
           ProcessBatch<AGGREGATED_ROWS>(&batch, prefetch_mode, ht_ctx_.get()));
       RETURN_IF_ERROR(state_->GetQueryStatus());
+      RETURN_IF_CANCELLED(state_);
       FreeLocalAllocations();
       batch.Reset();
     } while (!eos);
@@ -1307,6 +1657,7 @@ Status PartitionedAggregationNode::ProcessStream(BufferedTupleStream* input_stre
 }
 
 Status PartitionedAggregationNode::SpillPartition() {
+  if (unpartitioned_) return SwitchToPartitioned();
   int64_t max_freed_mem = 0;
   int partition_idx = -1;
 
@@ -1333,14 +1684,90 @@ Status PartitionedAggregationNode::SpillPartition() {
   return hash_partitions_[partition_idx]->Spill();
 }
 
+Status PartitionedAggregationNode::SwitchToPartitioned() {
+  DCHECK(unpartitioned_);
+  DCHECK(spilled_unpartitioned_ == NULL);
+  Partition* partition = hash_partitions_[0];
+  VLOG_QUERY << "PA(node_id=" << id() << ") partitioning the input after "
+             << partition->hash_tbl->size() << " groups";
+  unpartitioned_ = false;
+  memset(hash_tbls_, 0, sizeof(hash_tbls_));
+  RETURN_IF_ERROR(partition->Spill());
+  // The remaining input goes to the new partitions, so the spilled partition doesn't
+  // need its hash table or write blocks. Unpinning the streams leaves the reserved
+  // buffers to the new partitions.
+  if (partition->spilled_hash_tbl.get() != NULL) {
+    RETURN_IF_ERROR(FlushSpilledHashTable(partition, true));
+  }
+  RETURN_IF_ERROR(partition->aggregated_row_stream->UnpinStream(true));
+  RETURN_IF_ERROR(partition->unaggregated_row_stream->UnpinStream(true));
+  spilled_unpartitioned_ = partition;
+
+  hash_partitions_.clear();
+  // Memory already ran out, so the new hash tables start small.
+  RETURN_IF_ERROR(CreateHashPartitions(0, -1));
+  // The switch may happen in the middle of a batch, make sure that the rest of it fits
+  // into the new hash tables.
+  return CheckAndResizeHashPartitions(state_->batch_size(), ht_ctx_.get());
+}
+
+Status PartitionedAggregationNode::AddRowToNewPartition(TupleRow* row, uint32_t hash) {
+  DCHECK(!unpartitioned_);
+  Partition* partition = hash_partitions_[hash >> (32 - NUM_PARTITIONING_BITS)];
+  while (!partition->is_spilled()) {
+    bool found;
+    HashTable::Iterator it =
+        partition->hash_tbl->FindBuildRowBucket(ht_ctx_.get(), &found);
+    if (found) {
+      UpdateTuple(&partition->agg_fn_ctxs[0], it.GetTuple(), row);
+      return Status::OK();
+    }
+    Tuple* intermediate_tuple = ConstructIntermediateTuple(partition->agg_fn_ctxs,
+        partition->aggregated_row_stream.get(), &process_batch_status_);
+    if (LIKELY(intermediate_tuple != NULL)) {
+      UpdateTuple(&partition->agg_fn_ctxs[0], intermediate_tuple, row);
+      it.SetTuple(intermediate_tuple, hash);
+      return Status::OK();
+    }
+    RETURN_IF_ERROR(process_batch_status_);
+    RETURN_IF_ERROR(SpillPartition());
+  }
+  if (partition->spilled_hash_tbl.get() != NULL) {
+    return AggregateSpilledRow(partition, row, hash, ht_ctx_.get());
+  }
+  return AppendSpilledRow(partition->unaggregated_row_stream.get(), row);
+}
+
+Status PartitionedAggregationNode::ProcessSpilledUnpartitioned() {
+  Partition* partition = spilled_unpartitioned_;
+  DCHECK(partition->is_spilled());
+  RETURN_IF_ERROR(ProcessStream<true>(partition->aggregated_row_stream.get()));
+  RETURN_IF_ERROR(ProcessStream<false>(partition->unaggregated_row_stream.get()));
+  partition->Close(false);
+  spilled_unpartitioned_ = NULL;
+  return Status::OK();
+}
+
 Status PartitionedAggregationNode::MoveHashPartitions(int64_t num_input_rows) {
   DCHECK(!hash_partitions_.empty());
   stringstream ss;
   ss << "PA(node_id=" << id() << ") partitioned(level="
      << hash_partitions_[0]->level << ") "
      << num_input_rows << " rows into:" << endl;
+  // Write out the groups in the hash tables of the spilled partitions first. Appending
+  // them may spill more partitions, which then have hash tables to flush as well.
+  bool flushed = true;
+  while (flushed) {
+    flushed = false;
+    for (Partition* partition: hash_partitions_) {
+      if (partition->spilled_hash_tbl.get() == NULL) continue;
+      RETURN_IF_ERROR(FlushSpilledHashTable(partition, true));
+      flushed = true;
+    }
+  }
   for (int i = 0; i < hash_partitions_.size(); ++i) {
     Partition* partition = hash_partitions_[i];
+    if (i > 0 && partition == hash_partitions_[i - 1]) continue;
     int64_t aggregated_rows = partition->aggregated_row_stream->num_rows();
     int64_t unaggregated_rows = 0;
     if (partition->unaggregated_row_stream != NULL) {
@@ -1394,6 +1821,9 @@ void PartitionedAggregationNode::ClosePartitions() {
       it != spilled_partitions_.end(); ++it) {
     (*it)->Close(true);
   }
+  if (spilled_unpartitioned_ != NULL) spilled_unpartitioned_->Close(true);
+  spilled_unpartitioned_ = NULL;
+  unpartitioned_ = false;
   aggregated_partitions_.clear();
   spilled_partitions_.clear();
   hash_partitions_.clear();
@@ -1407,6 +1837,7 @@ Status PartitionedAggregationNode::QueryMaintenance(RuntimeState* state) {
   }
   ExprContext::FreeLocalAllocations(agg_fn_ctxs_);
   for (int i = 0; i < hash_partitions_.size(); ++i) {
+    if (i > 0 && hash_partitions_[i] == hash_partitions_[i - 1]) continue;
     ExprContext::FreeLocalAllocations(hash_partitions_[i]->agg_fn_ctxs);
   }
   return ExecNode::QueryMaintenance(state);
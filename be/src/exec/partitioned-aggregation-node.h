@@ -34,6 +34,7 @@ namespace llvm {
 namespace impala {
 
 class AggFnEvaluator;
+class CommonSubexprs;
 class LlvmCodeGen;
 class RowBatch;
 class RuntimeState;
@@ -87,8 +88,13 @@ class SlotDescriptor;
 /// resources to expand its hash table. The planner decides whether a given
 /// pre-aggregation should use the streaming preaggregation algorithm or the same
 /// blocking aggregation algorithm as used in merge aggregations.
-/// TODO: make this less of a heuristic by factoring in the cost of the exchange vs the
-/// cost of the pre-aggregation.
+/// A streaming pre-aggregation decides for each partition whether to expand its hash
+/// table, based on the reduction the partition achieves, and keeps measuring it after
+/// it stops expanding to expand again if the reduction of the passed-through rows rises.
+/// The reduction required to expand is adjusted by the time the exchange spends per
+/// passed-through row relative to the time the pre-aggregation spends per input row.
+/// Every change of the decision is recorded as an event in the profile. See
+/// StreamingPartitionStats.
 ///
 /// If there are no grouping expressions, there is only a single output row for both
 /// preaggregations and merge aggregations. This case is handled separately to avoid
@@ -99,20 +105,26 @@ class SlotDescriptor;
 /// the node is a streaming preaggregation, it stops growing its hash table further by
 /// converting unaggregated rows into the aggregated tuple format and passing them
 /// through. If the node is not a streaming pre-aggregation, it responds to memory
-/// pressure by spilling partitions to disk.
+/// pressure by spilling partitions to disk. A spilled partition keeps a small hash table
+/// that aggregates its unaggregated input rows before they are written to disk. Its
+/// groups are appended to the spilled aggregated rows whenever it fills up, so the
+/// aggregated rows of a spilled partition may contain a group more than once. The table
+/// is dropped if it doesn't reduce the rows enough.
+///
+/// A spilling aggregation starts with a single partition for its input, whose hash table
+/// all rows go to, which saves the hash tables and streams of the other partitions and
+/// keeps the working set small if there are few groups. When it first runs out of memory,
+/// it spills the single partition and switches to PARTITION_FANOUT partitions for the
+/// rest of the input. The spilled rows of the single partition are aggregated into them
+/// after all input was consumed. See SwitchToPartitioned().
 ///
 /// TODO: Buffer rows before probing into the hash table?
-/// TODO: After spilling, we can still maintain a very small hash table just to remove
-/// some number of rows (from likely going to disk).
 /// TODO: Consider allowing to spill the hash table structure in addition to the rows.
 /// TODO: Do we want to insert a buffer before probing into the partition's hash table?
-/// TODO: Use a prefetch/batched probe interface.
 /// TODO: Return rows from the aggregated_row_stream rather than the HT.
 /// TODO: Think about spilling heuristic.
 /// TODO: When processing a spilled partition, we have a lot more information and can
 /// size the partitions/hash tables better.
-/// TODO: Start with unpartitioned (single partition) and switch to partitioning and
-/// spilling only if the size gets large, say larger than the LLC.
 /// TODO: Simplify or cleanup the various uses of agg_fn_ctx, agg_fn_ctx_, and ctx.
 /// There are so many contexts in use that a plain "ctx" variable should never be used.
 /// Likewise, it's easy to mixup the agg fn ctxs, there should be a way to simplify this.
@@ -149,6 +161,25 @@ class PartitionedAggregationNode : public ExecNode {
   /// the partition so this might be okay.
   static const int NUM_PARTITIONING_BITS = 4;
 
+  /// The minimum number of rows of a partition of a streaming preaggregation since it
+  /// started or stopped expanding its hash table before it reconsiders that decision.
+  static const int STREAMING_DECISION_MIN_ROWS = 1024;
+
+  /// Passed-through rows are sampled by the bits of their hash below the partitioning
+  /// bits, so that all rows with the same key are either sampled or not. One out of
+  /// 2^STREAMING_SAMPLE_BITS keys is sampled.
+  static const int STREAMING_SAMPLE_BITS = 4;
+
+  /// The number of sampled passed-through rows after which their reduction is updated.
+  static const int STREAMING_SAMPLE_WINDOW = 256;
+
+  /// The log of the number of hashes of sampled keys kept in
+  /// StreamingPartitionStats::sample_filter.
+  static const int STREAMING_SAMPLE_FILTER_BITS = 8;
+
+  /// The maximum number of events recorded in 'preagg_mode_events_'.
+  static const int MAX_PREAGG_MODE_EVENTS = 64;
+
   /// Maximum number of times we will repartition. The maximum build table we can process
   /// (if we have enough scratch disk space) in case there is no skew is:
   ///  MEM_LIMIT * (PARTITION_FANOUT ^ MAX_PARTITION_DEPTH).
@@ -213,6 +244,11 @@ class PartitionedAggregationNode : public ExecNode {
   /// var-len grouping exprs have type string.
   std::vector<int> string_grouping_exprs_;
 
+  /// The subexpressions shared by the grouping exprs and the input exprs of the
+  /// aggregate functions, which are evaluated once per input row. NULL if there are
+  /// none. StartBatch() is called before processing each batch of input rows.
+  boost::scoped_ptr<CommonSubexprs> common_subexprs_;
+
   RuntimeState* state_;
   BufferedBlockMgr::Client* block_mgr_client_;
 
@@ -242,12 +278,20 @@ class PartitionedAggregationNode : public ExecNode {
   /// Jitted ProcessBatchStreaming function pointer.  Null if codegen is disabled.
   ProcessBatchStreamingFn process_batch_streaming_fn_;
 
+  /// Jitted function that copies the child's rows into the partitions'
+  /// unaggregated_row_streams, see BufferedTupleStream::CodegenCopyRow(). Null if
+  /// codegen is disabled or the rows can't be copied by codegen'd code.
+  BufferedTupleStream::CopyRowFn unaggregated_copy_row_fn_;
+
   /// Time spent processing the child rows
   RuntimeProfile::Counter* build_timer_;
 
   /// Total time spent resizing hash tables.
   RuntimeProfile::Counter* ht_resize_timer_;
 
+  /// Total number of times that hash tables were resized.
+  RuntimeProfile::Counter* num_ht_resizes_;
+
   /// Time spent returning the aggregated rows
   RuntimeProfile::Counter* get_results_timer_;
 
@@ -269,6 +313,10 @@ class PartitionedAggregationNode : public ExecNode {
   /// Number of partitions that have been spilled.
   RuntimeProfile::Counter* num_spilled_partitions_;
 
+  /// Number of rows of spilled partitions that were aggregated into the hash tables of
+  /// the spilled partitions instead of being written to disk.
+  RuntimeProfile::Counter* num_spilled_rows_aggregated_;
+
   /// The largest fraction after repartitioning. This is expected to be
   /// 1 / PARTITION_FANOUT. A value much larger indicates skew.
   RuntimeProfile::HighWaterMarkCounter* largest_partition_percent_;
@@ -285,6 +333,59 @@ class PartitionedAggregationNode : public ExecNode {
   /// Expose the minimum reduction factor to continue growing the hash tables.
   RuntimeProfile::Counter* preagg_streaming_ht_min_reduction_;
 
+  /// The time the exchange spends per passed-through row divided by the time the
+  /// preaggregation spends per input row, by which the minimum reduction is adjusted.
+  RuntimeProfile::Counter* preagg_exchange_cost_ratio_;
+
+  /// The number of times a partition started or stopped expanding its hash table, and
+  /// the first MAX_PREAGG_MODE_EVENTS of them.
+  RuntimeProfile::Counter* preagg_mode_changes_;
+  RuntimeProfile::EventSequence* preagg_mode_events_;
+
+  /// The decision of a partition of a streaming preaggregation whether to expand its
+  /// hash table, and the statistics it is based on. While a partition expands, its
+  /// reduction is the number of rows aggregated into the hash table divided by the
+  /// number of groups added to it since the partition started expanding, extrapolated
+  /// to the estimated input cardinality. While a partition passes through the rows with
+  /// new groups, the reduction of those rows is estimated from a sample of their keys.
+  /// The decision is reconsidered whenever the hash table is full, but not before
+  /// STREAMING_DECISION_MIN_ROWS rows since the last change, to avoid flapping.
+  struct StreamingPartitionStats {
+    /// True if the hash table is expanded as needed.
+    bool expand;
+
+    /// All input rows of the partition.
+    int64_t total_rows;
+
+    /// The input rows and the passed-through rows since the last change of 'expand',
+    /// and the size of the hash table at that change.
+    int64_t num_rows;
+    int64_t num_passthrough_rows;
+    int64_t ht_size;
+
+    /// The sampled passed-through rows of the current window and the ones of them whose
+    /// key wasn't in 'sample_filter'.
+    int num_sampled_rows;
+    int num_sampled_misses;
+
+    /// The reduction of the sampled rows of the last window, or -1 before the first
+    /// window since the partition stopped expanding.
+    double passthrough_reduction;
+
+    /// The hashes of the most recently sampled keys, indexed by bits of the hash.
+    uint32_t sample_filter[1 << STREAMING_SAMPLE_FILTER_BITS];
+  };
+  StreamingPartitionStats streaming_stats_[PARTITION_FANOUT];
+
+  /// Time spent between returning from GetNext() and the next call while streaming,
+  /// i.e. in the exchange, and the number of rows returned in that time.
+  int64_t exchange_time_ns_;
+  int64_t exchange_rows_;
+
+  /// When the last GetNext() while streaming returned and the number of rows it returned.
+  int64_t last_streaming_return_ns_;
+  int64_t last_streaming_num_rows_;
+
   /// The estimated number of input rows from the planner.
   int64_t estimated_input_cardinality_;
 
@@ -313,9 +414,18 @@ class PartitionedAggregationNode : public ExecNode {
   /// Object pool that holds the Partition objects in hash_partitions_.
   boost::scoped_ptr<ObjectPool> partition_pool_;
 
-  /// Current partitions we are partitioning into.
+  /// Current partitions we are partitioning into. While 'unpartitioned_' is true,
+  /// these are PARTITION_FANOUT pointers to the same partition.
   std::vector<Partition*> hash_partitions_;
 
+  /// True while all input rows go to a single partition, before the aggregation ran out
+  /// of memory for the first time.
+  bool unpartitioned_;
+
+  /// The spilled single partition after switching to partitions. Its rows are
+  /// aggregated into the partitions at the end of the input. NULL otherwise.
+  Partition* spilled_unpartitioned_;
+
   /// Cache for hash tables in 'hash_partitions_'.
   HashTable* hash_tbls_[PARTITION_FANOUT];
 
@@ -336,7 +446,7 @@ class PartitionedAggregationNode : public ExecNode {
   /// require an unaggregated stream.
   struct Partition {
     Partition(PartitionedAggregationNode* parent, int level)
-      : parent(parent), is_closed(false), level(level) {}
+      : parent(parent), is_closed(false), level(level), num_spilled_hash_tbl_rows(0) {}
 
     ~Partition();
 
@@ -346,8 +456,10 @@ class PartitionedAggregationNode : public ExecNode {
     /// to init these buffers, the mem limit is too low to run this algorithm.
     Status InitStreams();
 
-    /// Initializes the hash table. Returns false on OOM.
-    bool InitHashTable();
+    /// Initializes the hash table with enough buckets for 'estimated_num_groups' groups,
+    /// up to FLAGS_agg_max_initial_ht_buckets, or a small number of buckets if it is -1.
+    /// Returns false on OOM.
+    bool InitHashTable(int64_t estimated_num_groups);
 
     /// Called in case we need to serialize aggregated rows. This step effectively does
     /// a merge aggregation in this node.
@@ -361,6 +473,10 @@ class PartitionedAggregationNode : public ExecNode {
     /// Spills this partition, unpinning streams and cleaning up hash tables as necessary.
     Status Spill();
 
+    /// Creates 'spilled_hash_tbl' for a spilled partition, with new agg fn contexts.
+    /// Leaves it NULL if it is disabled or there isn't enough memory.
+    void InitSpilledHashTable();
+
     bool is_spilled() const { return hash_tbl.get() == NULL; }
 
     PartitionedAggregationNode* parent;
@@ -390,6 +506,15 @@ class PartitionedAggregationNode : public ExecNode {
 
     /// Unaggregated rows that are spilled. Always NULL for streaming pre-aggregations.
     boost::scoped_ptr<BufferedTupleStream> unaggregated_row_stream;
+
+    /// The small hash table of a spilled partition that aggregates unaggregated rows
+    /// before they are spilled, and the pool of its tuples. NULL if the partition is not
+    /// spilled or doesn't aggregate rows after spilling.
+    boost::scoped_ptr<HashTable> spilled_hash_tbl;
+    boost::scoped_ptr<MemPool> spilled_tuple_pool;
+
+    /// The number of rows added to 'spilled_hash_tbl' since it was last flushed.
+    int64_t num_spilled_hash_tbl_rows;
   };
 
   /// Stream used to store serialized spilled rows. Only used if needs_serialize_
@@ -500,7 +625,9 @@ class PartitionedAggregationNode : public ExecNode {
   /// the expression values cache in 'ht_ctx'. The number of rows evaluated depends on
   /// the capacity of the cache. 'prefetch_mode' specifies the prefetching mode in use.
   /// If it's not PREFETCH_NONE, hash table buckets for the computed hashes will be
-  /// prefetched. Note that codegen replaces 'prefetch_mode' with a constant.
+  /// prefetched and, for unaggregated rows, a second pass prefetches the intermediate
+  /// tuples of matching buckets. Note that codegen replaces 'prefetch_mode' with a
+  /// constant.
   template<bool AGGREGATED_ROWS>
   void EvalAndHashPrefetchGroup(RowBatch* batch, int start_row_idx,
       TPrefetchMode::type prefetch_mode, HashTableCtx* ht_ctx);
@@ -532,6 +659,31 @@ class PartitionedAggregationNode : public ExecNode {
   /// to append the row.
   Status AppendSpilledRow(BufferedTupleStream* stream, TupleRow* row);
 
+  /// Spills the single partition and creates PARTITION_FANOUT partitions for the
+  /// remaining input. Called by SpillPartition() while 'unpartitioned_' is true.
+  Status SwitchToPartitioned();
+
+  /// Adds the unaggregated 'row' with hash 'hash' to its partition after
+  /// SwitchToPartitioned() spilled the single partition that the row was being added
+  /// to. The row must have been evaluated with 'ht_ctx_'.
+  Status AddRowToNewPartition(TupleRow* row, uint32_t hash);
+
+  /// Aggregates the rows of 'spilled_unpartitioned_' into 'hash_partitions_' and closes
+  /// it.
+  Status ProcessSpilledUnpartitioned();
+
+  /// Aggregates the unaggregated 'row' with hash 'hash' into the 'spilled_hash_tbl' of
+  /// the spilled 'partition', flushing the table first if it is full. Appends the row to
+  /// the unaggregated stream if the table is dropped by the flush. The row must have
+  /// been evaluated with 'ht_ctx'.
+  Status AggregateSpilledRow(Partition* partition, TupleRow* row, uint32_t hash,
+      HashTableCtx* ht_ctx);
+
+  /// Appends the groups of the 'spilled_hash_tbl' of 'partition' to its aggregated
+  /// stream and empties the table. Drops the table if 'drop' is true or if it reduced
+  /// the rows by less than SPILLED_HT_MIN_REDUCTION.
+  Status FlushSpilledHashTable(Partition* partition, bool drop);
+
   /// Reads all the rows from input_stream and process them by calling ProcessBatch().
   template<bool AGGREGATED_ROWS>
   Status ProcessStream(BufferedTupleStream* input_stream);
@@ -548,9 +700,20 @@ class PartitionedAggregationNode : public ExecNode {
   /// tuple format. Sets 'child_eos_' once all rows from child have been returned.
   Status GetRowsStreaming(RuntimeState* state, RowBatch* row_batch);
 
-  /// Return true if we should keep expanding hash tables in the preagg. If false,
-  /// the preagg should pass through any rows it can't fit in its tables.
-  bool ShouldExpandPreaggHashTables() const;
+  /// Returns the minimum reduction factor to expand the hash tables of the preagg, for
+  /// the current size of the hash tables and the measured cost of the exchange.
+  double GetPreaggMinReduction();
+
+  /// Return true if we should keep expanding the hash table of partition
+  /// 'partition_idx' in the preagg, given the minimum reduction 'min_reduction'. If
+  /// false, the preagg should pass through any rows it can't fit in the table. Updates
+  /// the decision in 'streaming_stats_'.
+  bool ShouldExpandPreaggHashTable(int partition_idx, double min_reduction);
+
+  /// Records that partition 'partition_idx' starts or stops expanding its hash table
+  /// because of the estimated reduction 'reduction'.
+  void SetPreaggExpand(int partition_idx, bool expand, double reduction,
+      double min_reduction);
 
   /// Streaming processing of in_batch from child. Rows from child are either aggregated
   /// into the hash table or added to 'out_batch' in the intermediate tuple format.
@@ -564,6 +727,8 @@ class PartitionedAggregationNode : public ExecNode {
   /// 'remaining_capacity' is an array with PARTITION_FANOUT entries with the number of
   ///     additional rows that can be added to the hash table per partition. It is updated
   ///     by ProcessBatchStreaming() when it inserts new rows.
+  /// The input and passed-through rows of each partition are counted in
+  /// 'streaming_stats_'.
   /// 'ht_ctx' is passed in as a way to avoid aliasing of 'this' confusing the optimiser.
   Status ProcessBatchStreaming(bool needs_serialize, TPrefetchMode::type prefetch_mode,
       RowBatch* in_batch, RowBatch* out_batch, HashTableCtx* ht_ctx,
@@ -581,9 +746,20 @@ class PartitionedAggregationNode : public ExecNode {
       Partition* partition, HashTable* hash_tbl, TupleRow* in_row, uint32_t hash,
       int* remaining_capacity, Status* status);
 
+  /// Counts a row with hash 'hash' that is passed through in 'stats' and samples its key.
+  void IR_ALWAYS_INLINE CountPassthroughRow(StreamingPartitionStats* stats,
+      uint32_t hash);
+
   /// Initializes hash_partitions_. 'level' is the level for the partitions to create.
-  /// Also sets ht_ctx_'s level to 'level'.
-  Status CreateHashPartitions(int level);
+  /// Also sets ht_ctx_'s level to 'level'. 'estimated_num_groups' is an upper bound on
+  /// the number of groups of the input to partition, which sizes the hash tables, or -1
+  /// if it is unknown.
+  Status CreateHashPartitions(int level, int64_t estimated_num_groups);
+
+  /// Returns an upper bound on the number of groups of the node's input from the
+  /// planner's estimate of its cardinality, or -1 if the hash tables shouldn't be sized
+  /// from it.
+  int64_t EstimatedInputGroups() const;
 
   /// Ensure that hash tables for all in-memory partitions are large enough to fit
   /// 'num_rows' additional hash table entries. If there is not enough memory to
@@ -20,6 +20,7 @@
 #include "runtime/row-batch.h"
 #include "runtime/runtime-filter.h"
 #include "util/bloom-filter.h"
+#include "util/min-max-filter.h"
 
 #include "common/names.h"
 
@@ -352,6 +353,20 @@ void IR_ALWAYS_INLINE PartitionedHashJoinNode::EvalAndHashProbePrefetchGroup(
     expr_vals_cache->NextRow();
   }
   expr_vals_cache->ResetForRead();
+
+  // By now the buckets of the rows at the start of the group should be in cache, so
+  // read them and prefetch the build rows they point to. This hides the second cache
+  // miss that Equals() would otherwise take on every probe.
+  if (prefetch_mode != TPrefetchMode::NONE) {
+    for (; !expr_vals_cache->AtEnd(); expr_vals_cache->NextRow()) {
+      if (expr_vals_cache->IsRowNull()) continue;
+      uint32_t hash = expr_vals_cache->ExprValuesHash();
+      const uint32_t partition_idx = hash >> (32 - NUM_PARTITIONING_BITS);
+      HashTable* hash_tbl = hash_tbls_[partition_idx];
+      if (LIKELY(hash_tbl != NULL)) hash_tbl->PrefetchBucketData<true>(hash);
+    }
+    expr_vals_cache->ResetForRead();
+  }
 }
 
 // CreateOutputRow, EvalOtherJoinConjuncts, and EvalConjuncts are replaced by codegen.
@@ -446,18 +461,7 @@ Status PartitionedHashJoinNode::ProcessBuildBatch(RowBatch* build_batch,
       }
       continue;
     }
-    if (build_filters) {
-      DCHECK_EQ(ht_ctx_->level(), 0)
-          << "Runtime filters should not be built during repartitioning.";
-      for (const FilterContext& ctx: filters_) {
-        // TODO: codegen expr evaluation and hashing
-        if (ctx.local_bloom_filter == NULL) continue;
-        void* e = ctx.expr->GetValue(build_row);
-        uint32_t filter_hash = RawValue::GetHashValue(e, ctx.expr->root()->type(),
-            RuntimeFilterBank::DefaultHashSeed());
-        ctx.local_bloom_filter->Insert(filter_hash);
-      }
-    }
+    if (build_filters) InsertRuntimeFilters(build_row);
     const uint32_t hash = expr_vals_cache->ExprValuesHash();
     const uint32_t partition_idx = hash >> (32 - NUM_PARTITIONING_BITS);
     Partition* partition = hash_partitions_[partition_idx];
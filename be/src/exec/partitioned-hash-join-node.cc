@@ -15,12 +15,14 @@
 #include "exec/partitioned-hash-join-node.inline.h"
 
 #include <functional>
+#include <limits>
 #include <numeric>
 #include <sstream>
 #include <gutil/strings/substitute.h>
 
 #include "codegen/llvm-codegen.h"
 #include "exec/hash-table.inline.h"
+#include "exec/row-batch-cache.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
 #include "exprs/slot-ref.h"
@@ -29,15 +31,41 @@
 #include "runtime/row-batch.h"
 #include "runtime/runtime-filter.h"
 #include "runtime/runtime-state.h"
+#include "util/bitmap.h"
 #include "util/bloom-filter.h"
 #include "util/debug-util.h"
+#include "util/min-max-filter.h"
 #include "util/runtime-profile.h"
+#include "util/thread.h"
 
 #include "gen-cpp/PlanNodes_types.h"
 
 #include "common/names.h"
 
 DEFINE_bool(enable_phj_probe_side_filtering, true, "Deprecated.");
+DEFINE_int32(phj_build_threads, 4, "(Advanced) Maximum number of threads, including "
+    "the join's own thread, used to build the hash tables of a partitioned hash join's "
+    "in-memory partitions. Additional threads are only used if thread tokens are "
+    "available. Set to 1 to always build the hash tables serially.");
+DEFINE_int64(phj_parallel_build_min_rows, 64 * 1024, "(Advanced) Minimum number of "
+    "build rows across a partitioned hash join's in-memory partitions for their hash "
+    "tables to be built in parallel.");
+DEFINE_bool(phj_split_skewed_partitions, true, "(Advanced) If true, a spilled partition "
+    "of a partitioned hash join that repartitioning cannot make smaller, e.g. because "
+    "of a single join key with too many rows, is joined in chunks of build rows that "
+    "fit in memory instead of failing the query. Only used for inner and right joins.");
+DEFINE_bool(phj_keep_build_batches, true, "(Advanced) If true, a partitioned hash join "
+    "whose build rows have a single tuple keeps the row batches of its build input and "
+    "builds its hash tables on them while they fit in memory, instead of copying the "
+    "rows into the partitions' streams first.");
+DEFINE_bool(phj_build_bitmap, true, "(Advanced) If true, a left semi or left anti join "
+    "on a single integer key whose build side fits in memory replaces its hash tables "
+    "by a bitmap over the range of build keys if the keys are dense enough.");
+DEFINE_int32(phj_bitmap_max_bits_per_key, 64, "(Advanced) Maximum number of bits per "
+    "distinct build key of the bitmap that replaces the hash tables of a left semi or "
+    "left anti join, see --phj_build_bitmap.");
+
+DECLARE_int64(hash_table_direct_index_max_keys);
 
 const string PREPARE_FOR_READ_FAILED_ERROR_MSG = "Failed to acquire initial read buffer "
     "for stream in hash join node $0. Reducing query concurrency or increasing the "
@@ -55,6 +83,9 @@ PartitionedHashJoinNode::PartitionedHashJoinNode(
     block_mgr_client_(NULL),
     partition_build_timer_(NULL),
     null_aware_eval_timer_(NULL),
+    num_kept_build_rows_(NULL),
+    build_bitmap_bits_(NULL),
+    num_direct_indexes_(NULL),
     state_(PARTITIONING_BUILD),
     partition_pool_(new ObjectPool()),
     input_partition_(NULL),
@@ -62,12 +93,16 @@ PartitionedHashJoinNode::PartitionedHashJoinNode(
     non_empty_build_(false),
     null_probe_rows_(NULL),
     null_probe_output_idx_(-1),
+    kept_build_bytes_(0),
+    build_bitmap_min_(0),
     process_build_batch_fn_(NULL),
     process_build_batch_fn_level0_(NULL),
     process_probe_batch_fn_(NULL),
     process_probe_batch_fn_level0_(NULL),
     insert_batch_fn_(NULL),
-    insert_batch_fn_level0_(NULL) {
+    insert_batch_fn_level0_(NULL),
+    build_copy_row_fn_(NULL),
+    probe_copy_row_fn_(NULL) {
   memset(hash_tbls_, 0, sizeof(HashTable*) * PARTITION_FANOUT);
 }
 
@@ -117,6 +152,7 @@ Status PartitionedHashJoinNode::Init(const TPlanNode& tnode, RuntimeState* state
 
 Status PartitionedHashJoinNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
 
   // Create the codegen object before preparing conjunct_ctxs_ and children_, so that any
   // ScalarFnCalls will use codegen.
@@ -175,6 +211,9 @@ Status PartitionedHashJoinNode::Prepare(RuntimeState* state) {
   partition_build_timer_ = ADD_TIMER(runtime_profile(), "BuildPartitionTime");
   num_hash_buckets_ =
       ADD_COUNTER(runtime_profile(), "HashBuckets", TUnit::UNIT);
+  ht_resize_timer_ = ADD_TIMER(runtime_profile(), "HTResizeTime");
+  num_ht_resizes_ =
+      ADD_COUNTER(runtime_profile(), "HashTableResizes", TUnit::UNIT);
   partitions_created_ =
       ADD_COUNTER(runtime_profile(), "PartitionsCreated", TUnit::UNIT);
   max_partition_level_ = runtime_profile()->AddHighWaterMarkCounter(
@@ -187,15 +226,31 @@ Status PartitionedHashJoinNode::Prepare(RuntimeState* state) {
       ADD_COUNTER(runtime_profile(), "NumRepartitions", TUnit::UNIT);
   num_spilled_partitions_ =
       ADD_COUNTER(runtime_profile(), "SpilledPartitions", TUnit::UNIT);
+  num_skewed_partitions_ =
+      ADD_COUNTER(runtime_profile(), "SkewedPartitionsSplit", TUnit::UNIT);
   largest_partition_percent_ = runtime_profile()->AddHighWaterMarkCounter(
       "LargestPartitionPercent", TUnit::UNIT);
   num_hash_collisions_ =
       ADD_COUNTER(runtime_profile(), "HashCollisions", TUnit::UNIT);
+  num_hash_mismatch_skips_ =
+      ADD_COUNTER(runtime_profile(), "HashMismatchSkips", TUnit::UNIT);
+  num_build_helper_threads_ =
+      ADD_COUNTER(runtime_profile(), "HashTableBuildHelperThreads", TUnit::UNIT);
+  num_kept_build_rows_ =
+      ADD_COUNTER(runtime_profile(), "BuildRowsNotCopied", TUnit::UNIT);
+  build_bitmap_bits_ =
+      ADD_COUNTER(runtime_profile(), "BuildBitmapBits", TUnit::UNIT);
+  num_direct_indexes_ =
+      ADD_COUNTER(runtime_profile(), "HashTableDirectIndexes", TUnit::UNIT);
+  build_batch_cache_.reset(new RowBatchCache(
+      child(1)->row_desc(), state->batch_size(), mem_tracker()));
 
   bool build_codegen_enabled = false;
   bool probe_codegen_enabled = false;
   bool ht_construction_codegen_enabled = false;
+  bool copy_row_codegen_enabled = false;
   Status codegen_status;
+  Status copy_row_codegen_status;
   Status build_codegen_status;
   Status probe_codegen_status;
   Status insert_codegen_status;
@@ -228,11 +283,22 @@ Status PartitionedHashJoinNode::Prepare(RuntimeState* state) {
       probe_codegen_status = codegen_status;
       insert_codegen_status = codegen_status;
     }
+    // Codegen for copying rows into the streams of spilled partitions. The probe rows
+    // may have nullable tuples, which only the interpreted copy handles.
+    Status build_copy_status = BufferedTupleStream::Codegen(state,
+        child(1)->row_desc(), &build_copy_row_fn_);
+    Status probe_copy_status = BufferedTupleStream::Codegen(state,
+        child(0)->row_desc(), &probe_copy_row_fn_);
+    copy_row_codegen_enabled = build_copy_status.ok() || probe_copy_status.ok();
+    copy_row_codegen_status = build_copy_status;
+    copy_row_codegen_status.MergeStatus(probe_copy_status);
   }
   AddCodegenExecOption(build_codegen_enabled, codegen_status, "Build Side");
   AddCodegenExecOption(probe_codegen_enabled, codegen_status, "Probe Side");
   AddCodegenExecOption(ht_construction_codegen_enabled, codegen_status,
       "Hash Table Construction");
+  AddCodegenExecOption(copy_row_codegen_enabled, copy_row_codegen_status,
+      "Stream Row Copy");
   return Status::OK();
 }
 
@@ -266,6 +332,7 @@ Status PartitionedHashJoinNode::Reset(RuntimeState* state) {
   state_ = PARTITIONING_BUILD;
   ht_ctx_->set_level(0);
   ClosePartitions();
+  ReleaseBuildBitmap();
   memset(hash_tbls_, 0, sizeof(HashTable*) * PARTITION_FANOUT);
   return ExecNode::Reset(state);
 }
@@ -299,15 +366,23 @@ void PartitionedHashJoinNode::ClosePartitions() {
     null_probe_rows_ = NULL;
   }
   partition_pool_->Clear();
+  ReleaseKeptBuildBatches(NULL);
 }
 
 void PartitionedHashJoinNode::Close(RuntimeState* state) {
   if (is_closed()) return;
   if (ht_ctx_.get() != NULL) ht_ctx_->Close();
+  for (BuildHelper* helper: build_helpers_) {
+    if (helper->ht_ctx.get() != NULL) helper->ht_ctx->Close();
+    Expr::Close(helper->build_expr_ctxs, state);
+    Expr::Close(helper->probe_expr_ctxs, state);
+  }
 
   nulls_build_batch_.reset();
 
   ClosePartitions();
+  ReleaseBuildBitmap();
+  build_batch_cache_.reset();
 
   if (block_mgr_client_ != NULL) {
     state->block_mgr()->ClearReservations(block_mgr_client_);
@@ -326,15 +401,18 @@ PartitionedHashJoinNode::Partition::Partition(RuntimeState* state,
   : parent_(parent),
     is_closed_(false),
     is_spilled_(false),
+    is_skewed_(false),
     level_(level) {
   build_rows_ = new BufferedTupleStream(state, parent_->child(1)->row_desc(),
       state->block_mgr(), parent_->block_mgr_client_,
       true /* use_initial_small_buffers */, false /* read_write */);
   DCHECK(build_rows_ != NULL);
+  build_rows_->set_copy_row_fn(parent_->build_copy_row_fn_);
   probe_rows_ = new BufferedTupleStream(state, parent_->child(0)->row_desc(),
       state->block_mgr(), parent_->block_mgr_client_,
       true /* use_initial_small_buffers */, false /* read_write */ );
   DCHECK(probe_rows_ != NULL);
+  probe_rows_->set_copy_row_fn(parent_->probe_copy_row_fn_);
 }
 
 PartitionedHashJoinNode::Partition::~Partition() {
@@ -351,6 +429,7 @@ void PartitionedHashJoinNode::Partition::Close(RowBatch* batch) {
 
   if (hash_tbl_.get() != NULL) {
     COUNTER_ADD(parent_->num_hash_collisions_, hash_tbl_->NumHashCollisions());
+    COUNTER_ADD(parent_->num_hash_mismatch_skips_, hash_tbl_->NumHashMismatchSkips());
     hash_tbl_->Close();
   }
 
@@ -422,22 +501,39 @@ Status PartitionedHashJoinNode::Partition::Spill(bool unpin_all_build) {
 
 Status PartitionedHashJoinNode::Partition::BuildHashTable(RuntimeState* state,
     bool* built) {
+  RETURN_IF_ERROR(PrepareBuildRows(built));
+  if (!*built) return Status::OK();
+  SCOPED_TIMER(parent_->build_timer_);
+  return InsertBuildRows(state, NULL, built);
+}
+
+Status PartitionedHashJoinNode::Partition::PrepareBuildRows(bool* pinned) {
   DCHECK(build_rows_ != NULL);
-  *built = false;
+  *pinned = false;
 
   // TODO: estimate the entire size of the hash table and reserve all of it from
   // the block mgr.
 
   // We got the buffers we think we will need, try to build the hash table.
-  RETURN_IF_ERROR(build_rows_->PinStream(false, built));
-  if (!*built) return Status::OK();
+  RETURN_IF_ERROR(build_rows_->PinStream(false, pinned));
+  if (!*pinned) return Status::OK();
   bool got_read_buffer;
   RETURN_IF_ERROR(build_rows_->PrepareForRead(false, &got_read_buffer));
   DCHECK(got_read_buffer) << "Stream was already pinned.";
+  return Status::OK();
+}
+
+Status PartitionedHashJoinNode::Partition::InsertBuildRows(RuntimeState* state,
+    BuildHelper* helper, bool* built) {
+  DCHECK(build_rows_ != NULL);
+  DCHECK(build_rows_->is_pinned());
+  *built = true;
 
   RowBatch batch(parent_->child(1)->row_desc(), state->batch_size(),
       parent_->mem_tracker());
-  HashTableCtx* ctx = parent_->ht_ctx_.get();
+  HashTableCtx* ctx = helper == NULL ? parent_->ht_ctx_.get() : helper->ht_ctx.get();
+  BufferedBlockMgr::Client* client =
+      helper == NULL ? parent_->block_mgr_client_ : helper->block_mgr_client;
   // TODO: move the batch and indices as members to avoid reallocating.
   vector<BufferedTupleStream::RowIdx> indices;
   bool eos = false;
@@ -454,8 +550,8 @@ Status PartitionedHashJoinNode::Partition::BuildHashTable(RuntimeState* state,
   // We always start with small pages in the hash table.
   int64_t estimated_num_buckets = build_rows()->RowConsumesMemory() ?
       HashTable::EstimateNumBuckets(build_rows()->num_rows()) : state->batch_size() * 2;
-  hash_tbl_.reset(HashTable::Create(state, parent_->block_mgr_client_,
-      true /* store_duplicates */,
+  hash_tbl_.reset(HashTable::Create(state, client,
+      parent_->HashTablesStoreDuplicates(),
       parent_->child(1)->row_desc().tuple_descriptors().size(), build_rows(),
       1 << (32 - NUM_PARTITIONING_BITS), estimated_num_buckets));
   if (!hash_tbl_->Init()) goto not_built;
@@ -466,11 +562,15 @@ Status PartitionedHashJoinNode::Partition::BuildHashTable(RuntimeState* state,
     DCHECK_LE(batch.num_rows(), hash_tbl_->EmptyBuckets())
         << build_rows()->RowConsumesMemory();
     TPrefetchMode::type prefetch_mode = state->query_options().prefetch_mode;
-    SCOPED_TIMER(parent_->build_timer_);
-    if (parent_->insert_batch_fn_ != NULL) {
+    // The jitted functions have the main thread's exprs baked in, so helper threads
+    // always use the interpreted path.
+    // The level 0 function is registered for jitting last, so once it is set, both are.
+    InsertBatchFn insert_batch_fn_level0 =
+        LlvmCodeGen::LoadJittedFunction(&parent_->insert_batch_fn_level0_);
+    if (helper == NULL && insert_batch_fn_level0 != NULL) {
       InsertBatchFn insert_batch_fn;
       if (ctx->level() == 0) {
-        insert_batch_fn = parent_->insert_batch_fn_level0_;
+        insert_batch_fn = insert_batch_fn_level0;
       } else {
         insert_batch_fn = parent_->insert_batch_fn_;
       }
@@ -484,7 +584,12 @@ Status PartitionedHashJoinNode::Partition::BuildHashTable(RuntimeState* state,
       }
     }
     RETURN_IF_ERROR(state->GetQueryStatus());
-    parent_->FreeLocalAllocations();
+    RETURN_IF_CANCELLED(state);
+    if (helper == NULL) {
+      parent_->FreeLocalAllocations();
+    } else {
+      ExprContext::FreeLocalAllocations(helper->build_expr_ctxs);
+    }
     batch.Reset();
   } while (!eos);
 
@@ -511,6 +616,8 @@ bool PartitionedHashJoinNode::AllocateRuntimeFilters(RuntimeState* state) {
   for (int i = 0; i < filters_.size(); ++i) {
     filters_[i].local_bloom_filter =
         state->filter_bank()->AllocateScratchBloomFilter(filters_[i].filter->id());
+    filters_[i].local_min_max_filter = state->filter_bank()->AllocateScratchMinMaxFilter(
+        filters_[i].filter->id(), filters_[i].expr->root()->type());
   }
   return true;
 }
@@ -531,7 +638,8 @@ void PartitionedHashJoinNode::PublishRuntimeFilters(RuntimeState* state,
     bool fp_rate_too_high =
         state->filter_bank()->FpRateTooHigh(ctx.filter->filter_size(), total_build_rows);
     state->filter_bank()->UpdateFilterFromLocal(ctx.filter->id(),
-        fp_rate_too_high ? BloomFilter::ALWAYS_TRUE_FILTER : ctx.local_bloom_filter);
+        fp_rate_too_high ? BloomFilter::ALWAYS_TRUE_FILTER : ctx.local_bloom_filter,
+        ctx.local_min_max_filter);
 
     num_enabled_filters += !fp_rate_too_high;
   }
@@ -627,6 +735,8 @@ Status PartitionedHashJoinNode::ConstructBuildSide(RuntimeState* state) {
     RETURN_IF_ERROR(child(1)->Open(state));
   }
   RETURN_IF_ERROR(ProcessBuildInput(state, 0));
+  if (CanBuildBitmap()) RETURN_IF_ERROR(BuildBitmap(state));
+  if (build_bitmap_.get() == NULL) BuildDirectIndexes();
 
   UpdateState(PROCESSING_PROBE);
   return Status::OK();
@@ -669,6 +779,9 @@ Status PartitionedHashJoinNode::ProcessBuildInput(RuntimeState* state, int level
   COUNTER_ADD(partitions_created_, PARTITION_FANOUT);
   COUNTER_SET(max_partition_level_, level);
 
+  // Keep the build child's batches, at least until they don't fit in memory.
+  bool keep_batches = level == 0 && CanKeepBuildBatches();
+  DCHECK_EQ(kept_build_batches_.total_num_rows(), 0);
   RowBatch build_batch(child(1)->row_desc(), state->batch_size(), mem_tracker());
   bool eos = false;
   int64_t total_build_rows = 0;
@@ -677,38 +790,57 @@ Status PartitionedHashJoinNode::ProcessBuildInput(RuntimeState* state, int level
     RETURN_IF_ERROR(QueryMaintenance(state));
     // 'probe_expr_ctxs_' should have made no local allocations in this function.
     DCHECK(!ExprContext::HasLocalAllocations(probe_expr_ctxs_));
+    RowBatch* batch = keep_batches ? build_batch_cache_->GetNextBatch() : &build_batch;
     if (input_partition_ == NULL) {
       // If we are still consuming batches from the build side.
       {
         SCOPED_STOP_WATCH(&built_probe_overlap_stop_watch_);
-        RETURN_IF_ERROR(child(1)->GetNext(state, &build_batch, &eos));
+        RETURN_IF_ERROR(child(1)->GetNext(state, batch, &eos));
       }
-      COUNTER_ADD(build_row_counter_, build_batch.num_rows());
+      COUNTER_ADD(build_row_counter_, batch->num_rows());
     } else {
       // If we are consuming batches that have already been partitioned.
-      RETURN_IF_ERROR(input_partition_->build_rows()->GetNext(&build_batch, &eos));
+      RETURN_IF_ERROR(input_partition_->build_rows()->GetNext(batch, &eos));
     }
-    total_build_rows += build_batch.num_rows();
-
-    SCOPED_TIMER(partition_build_timer_);
-    if (process_build_batch_fn_ == NULL) {
-      bool build_filters = ht_ctx_->level() == 0;
-      RETURN_IF_ERROR(ProcessBuildBatch(&build_batch, build_filters));
-    } else {
-      DCHECK(process_build_batch_fn_level0_ != NULL);
-      if (ht_ctx_->level() == 0) {
-        RETURN_IF_ERROR(
-            process_build_batch_fn_level0_(this, &build_batch, true));
-      } else {
-        RETURN_IF_ERROR(process_build_batch_fn_(this, &build_batch, false));
-      }
+    total_build_rows += batch->num_rows();
+
+    if (keep_batches) {
+      kept_build_batches_.AddRowBatch(batch);
+      kept_build_bytes_ += batch->tuple_data_pool()->total_reserved_bytes();
+      // The rows of a batch that needs to be returned may reference memory that is
+      // freed by the next GetNext() call, so they have to be copied now.
+      if (!batch->need_to_return() && KeptBuildBatchesFit()) continue;
+      VLOG(2) << "PHJ(node_id=" << id() << ") copying "
+              << kept_build_batches_.total_num_rows() << " kept build rows";
+      keep_batches = false;
+      RETURN_IF_ERROR(MaterializeKeptBuildBatches());
+      continue;
     }
+    RETURN_IF_ERROR(PartitionBuildBatch(&build_batch));
     build_batch.Reset();
     DCHECK(!build_batch.AtCapacity());
   }
 
+  if (keep_batches) {
+    bool built;
+    RETURN_IF_ERROR(BuildKeptHashTables(state, &built));
+    if (!built) {
+      VLOG(2) << "PHJ(node_id=" << id() << ") could not build the hash tables on "
+              << kept_build_batches_.total_num_rows() << " kept build rows";
+      keep_batches = false;
+      RETURN_IF_ERROR(MaterializeKeptBuildBatches());
+    }
+  }
+
   if (ht_ctx_->level() == 0) PublishRuntimeFilters(state, total_build_rows);
 
+  if (keep_batches) {
+    COUNTER_ADD(num_kept_build_rows_, total_build_rows);
+    COUNTER_ADD(num_build_rows_partitioned_, total_build_rows);
+    non_empty_build_ |= (total_build_rows > 0);
+    return Status::OK();
+  }
+
   if (input_partition_ != NULL) {
     // Done repartitioning build input, close it now.
     input_partition_->build_rows_->Close();
@@ -735,6 +867,328 @@ Status PartitionedHashJoinNode::ProcessBuildInput(RuntimeState* state, int level
   return Status::OK();
 }
 
+Status PartitionedHashJoinNode::PartitionBuildBatch(RowBatch* build_batch) {
+  SCOPED_TIMER(partition_build_timer_);
+  // The level 0 function is registered for jitting last, so once it is set, both are.
+  ProcessBuildBatchFn process_build_batch_fn_level0 =
+      LlvmCodeGen::LoadJittedFunction(&process_build_batch_fn_level0_);
+  if (process_build_batch_fn_level0 == NULL) {
+    bool build_filters = ht_ctx_->level() == 0;
+    return ProcessBuildBatch(build_batch, build_filters);
+  }
+  if (ht_ctx_->level() == 0) {
+    return process_build_batch_fn_level0(this, build_batch, true);
+  }
+  DCHECK(process_build_batch_fn_ != NULL);
+  return process_build_batch_fn_(this, build_batch, false);
+}
+
+bool PartitionedHashJoinNode::CanKeepBuildBatches() {
+  return FLAGS_phj_keep_build_batches && join_op_ != TJoinOp::NULL_AWARE_LEFT_ANTI_JOIN
+      && child(1)->row_desc().tuple_descriptors().size() == 1;
+}
+
+bool PartitionedHashJoinNode::KeptBuildBatchesFit() {
+  // Leave room for a copy of the kept tuples, so that the partitions can still get the
+  // buffers for their streams if the hash tables don't fit after all.
+  int64_t needed_mem = kept_build_bytes_ +
+      HashTable::EstimateSize(kept_build_batches_.total_num_rows());
+  return mem_tracker()->SpareCapacity() >= needed_mem;
+}
+
+Status PartitionedHashJoinNode::MaterializeKeptBuildBatches() {
+  for (RowBatchList::BatchIterator it = kept_build_batches_.BatchesBegin();
+       it != kept_build_batches_.BatchesEnd(); ++it) {
+    RETURN_IF_ERROR(PartitionBuildBatch(*it));
+    FreeLocalAllocations();
+  }
+  // All batches are copied before any is freed, since the rows of a batch may reference
+  // memory attached to a later one.
+  ReleaseKeptBuildBatches(NULL);
+  return Status::OK();
+}
+
+Status PartitionedHashJoinNode::BuildKeptHashTables(RuntimeState* state, bool* built) {
+  DCHECK_EQ(hash_partitions_.size(), PARTITION_FANOUT);
+  DCHECK_EQ(ht_ctx_->level(), 0);
+  DCHECK_EQ(child(1)->row_desc().tuple_descriptors().size(), 1);
+  *built = false;
+  HashTableCtx::ExprValuesCache* expr_vals_cache = ht_ctx_->expr_values_cache();
+  // Assume that the rows are spread evenly over the partitions. The hash tables are
+  // resized before each batch otherwise.
+  int64_t estimated_num_buckets = HashTable::EstimateNumBuckets(max<int64_t>(
+      kept_build_batches_.total_num_rows() / PARTITION_FANOUT, state->batch_size()));
+  for (Partition* partition: hash_partitions_) {
+    DCHECK_EQ(partition->build_rows()->num_rows(), 0);
+    partition->hash_tbl_.reset(HashTable::Create(state, block_mgr_client_,
+        HashTablesStoreDuplicates(), 1, partition->build_rows(),
+        1 << (32 - NUM_PARTITIONING_BITS), estimated_num_buckets));
+    if (!partition->hash_tbl_->Init()) goto not_built;
+  }
+
+  for (RowBatchList::BatchIterator it = kept_build_batches_.BatchesBegin();
+       it != kept_build_batches_.BatchesEnd(); ++it) {
+    RETURN_IF_CANCELLED(state);
+    SCOPED_TIMER(build_timer_);
+    RowBatch* batch = *it;
+    for (Partition* partition: hash_partitions_) {
+      SCOPED_TIMER(ht_resize_timer_);
+      HashTable* ht = partition->hash_tbl_.get();
+      int64_t num_resizes = ht->num_resizes();
+      bool fits = ht->CheckAndResize(batch->num_rows(), ht_ctx_.get());
+      COUNTER_ADD(num_ht_resizes_, ht->num_resizes() - num_resizes);
+      if (!fits) goto not_built;
+    }
+    // The hash tables store the build tuples, so the row's index is not used.
+    BufferedTupleStream::RowIdx unused_idx = { 0 };
+    expr_vals_cache->Reset();
+    FOREACH_ROW(batch, 0, batch_iter) {
+      TupleRow* build_row = batch_iter.Get();
+      if (!ht_ctx_->EvalAndHashBuild(build_row)) continue;
+      InsertRuntimeFilters(build_row);
+      const uint32_t hash = expr_vals_cache->ExprValuesHash();
+      HashTable* hash_tbl =
+          hash_partitions_[hash >> (32 - NUM_PARTITIONING_BITS)]->hash_tbl();
+      if (UNLIKELY(!hash_tbl->Insert(ht_ctx_.get(), unused_idx, build_row))) {
+        goto not_built;
+      }
+    }
+    FreeLocalAllocations();
+  }
+
+  // Like BuildHashTables(), but no partition is spilled.
+  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+    Partition* partition = hash_partitions_[i];
+    if (partition->hash_tbl()->size() == 0) {
+      // This partition is empty, no need to do anything else.
+      partition->hash_tbl_->Close();
+      partition->hash_tbl_.reset();
+      partition->Close(NULL);
+    } else {
+      COUNTER_ADD(num_hash_buckets_, partition->hash_tbl()->num_buckets());
+      partition->probe_rows()->Close();
+    }
+    hash_tbls_[i] = partition->hash_tbl();
+  }
+  *built = true;
+  return Status::OK();
+
+not_built:
+  for (Partition* partition: hash_partitions_) {
+    if (partition->hash_tbl() != NULL) {
+      partition->hash_tbl_->Close();
+      partition->hash_tbl_.reset();
+    }
+  }
+  return Status::OK();
+}
+
+void PartitionedHashJoinNode::ReleaseKeptBuildBatches(RowBatch* batch) {
+  for (RowBatchList::BatchIterator it = kept_build_batches_.BatchesBegin();
+       it != kept_build_batches_.BatchesEnd(); ++it) {
+    if (batch != NULL) {
+      (*it)->TransferResourceOwnership(batch);
+    } else {
+      (*it)->Reset();
+    }
+  }
+  kept_build_batches_.Reset();
+  if (build_batch_cache_.get() != NULL) build_batch_cache_->Reset();
+  kept_build_bytes_ = 0;
+}
+
+// Evaluates 'ctx', an integer expr of type 'type', over 'row' and sets 'key' to the
+// value. Returns false if the value is NULL.
+static inline bool EvalIntegerKey(ExprContext* ctx, PrimitiveType type, TupleRow* row,
+    int64_t* key) {
+  void* value = ctx->GetValue(row);
+  if (value == NULL) return false;
+  switch (type) {
+    case TYPE_TINYINT:
+      *key = *reinterpret_cast<int8_t*>(value);
+      return true;
+    case TYPE_SMALLINT:
+      *key = *reinterpret_cast<int16_t*>(value);
+      return true;
+    case TYPE_INT:
+      *key = *reinterpret_cast<int32_t*>(value);
+      return true;
+    case TYPE_BIGINT:
+      *key = *reinterpret_cast<int64_t*>(value);
+      return true;
+    default:
+      DCHECK(false) << "Not an integer type: " << type;
+      return false;
+  }
+}
+
+bool PartitionedHashJoinNode::CanBuildBitmap() {
+  if (!FLAGS_phj_build_bitmap || FLAGS_phj_bitmap_max_bits_per_key <= 0) return false;
+  if (HashTablesStoreDuplicates() || ht_ctx_->direct_index_key_bytes() == 0) {
+    return false;
+  }
+  // With IS NOT DISTINCT FROM, NULL keys match each other.
+  return !is_not_distinct_from_[0];
+}
+
+bool PartitionedHashJoinNode::FindBuildKeyRange(int64_t* min_key, int64_t* max_key) {
+  DCHECK_GT(ht_ctx_->direct_index_key_bytes(), 0);
+  *min_key = std::numeric_limits<int64_t>::max();
+  *max_key = std::numeric_limits<int64_t>::min();
+  bool found_key = false;
+  for (Partition* partition: hash_partitions_) {
+    if (partition->is_closed() || partition->hash_tbl() == NULL) continue;
+    for (HashTable::Iterator it = partition->hash_tbl()->Begin(ht_ctx_.get());
+         !it.AtEnd(); it.Next()) {
+      int64_t key;
+      if (!ht_ctx_->EvalBuildIntegerKey(it.GetRow(), &key)) continue;
+      *min_key = min(*min_key, key);
+      *max_key = max(*max_key, key);
+      found_key = true;
+    }
+  }
+  FreeLocalAllocations();
+  return found_key;
+}
+
+Status PartitionedHashJoinNode::BuildBitmap(RuntimeState* state) {
+  DCHECK(build_bitmap_.get() == NULL);
+  DCHECK(!HashTablesStoreDuplicates());
+  DCHECK_EQ(ht_ctx_->level(), 0);
+  DCHECK_EQ(hash_partitions_.size(), PARTITION_FANOUT);
+  int64_t num_keys = 0;
+  for (Partition* partition: hash_partitions_) {
+    if (partition->is_closed()) continue;
+    // The probe rows of a spilled partition are joined later, on its hash table.
+    if (partition->is_spilled()) return Status::OK();
+    DCHECK(partition->hash_tbl() != NULL);
+    num_keys += partition->hash_tbl()->size();
+  }
+  if (num_keys == 0) return Status::OK();
+
+  // The hash tables have a single row per key, and none with a NULL key.
+  int64_t min_key;
+  int64_t max_key;
+  if (!FindBuildKeyRange(&min_key, &max_key)) return Status::OK();
+  // Computed unsigned, the range of a BIGINT key doesn't fit an int64_t.
+  uint64_t key_range = static_cast<uint64_t>(max_key) - static_cast<uint64_t>(min_key);
+  if (key_range >= static_cast<uint64_t>(num_keys) * FLAGS_phj_bitmap_max_bits_per_key) {
+    return Status::OK();
+  }
+  int64_t num_bits = key_range + 1;
+  if (!mem_tracker()->TryConsume(Bitmap::MemUsage(num_bits))) return Status::OK();
+  build_bitmap_.reset(new Bitmap(num_bits));
+  build_bitmap_min_ = min_key;
+  for (Partition* partition: hash_partitions_) {
+    if (partition->is_closed()) continue;
+    for (HashTable::Iterator it = partition->hash_tbl()->Begin(ht_ctx_.get());
+         !it.AtEnd(); it.Next()) {
+      int64_t key;
+      bool is_not_null = ht_ctx_->EvalBuildIntegerKey(it.GetRow(), &key);
+      DCHECK(is_not_null);
+      build_bitmap_->Set<false>(key - min_key, true);
+    }
+  }
+  FreeLocalAllocations();
+  VLOG(2) << "PHJ(node_id=" << id() << ") replaced the hash tables of " << num_keys
+          << " keys by a bitmap of " << num_bits << " bits";
+  COUNTER_ADD(build_bitmap_bits_, num_bits);
+
+  // The bitmap is all that is needed to probe.
+  ClosePartitions();
+  memset(hash_tbls_, 0, sizeof(HashTable*) * PARTITION_FANOUT);
+  return Status::OK();
+}
+
+void PartitionedHashJoinNode::BuildDirectIndexes() {
+  DCHECK_EQ(ht_ctx_->level(), 0);
+  if (ht_ctx_->direct_index_key_bytes() == 0) return;
+  int64_t num_rows = 0;
+  int num_tables = 0;
+  for (Partition* partition: hash_partitions_) {
+    if (partition->is_closed() || partition->hash_tbl() == NULL) continue;
+    num_rows += partition->hash_tbl()->size();
+    ++num_tables;
+  }
+  if (num_tables == 0) return;
+  int64_t min_key;
+  int64_t max_key;
+  if (!FindBuildKeyRange(&min_key, &max_key)) return;
+  uint64_t key_range = static_cast<uint64_t>(max_key) - static_cast<uint64_t>(min_key);
+  // Every table gets an index over the whole range, so the range has to be small
+  // compared to the number of rows.
+  if (key_range >= static_cast<uint64_t>(FLAGS_hash_table_direct_index_max_keys) ||
+      key_range >= static_cast<uint64_t>(num_rows) * FLAGS_phj_bitmap_max_bits_per_key) {
+    return;
+  }
+  int num_indexes = 0;
+  for (Partition* partition: hash_partitions_) {
+    if (partition->is_closed() || partition->hash_tbl() == NULL) continue;
+    num_indexes +=
+        partition->hash_tbl()->InitDirectIndex(ht_ctx_.get(), min_key, key_range + 1);
+  }
+  FreeLocalAllocations();
+  COUNTER_ADD(num_direct_indexes_, num_indexes);
+}
+
+void PartitionedHashJoinNode::ReleaseBuildBitmap() {
+  if (build_bitmap_.get() == NULL) return;
+  mem_tracker()->Release(build_bitmap_->MemUsage());
+  build_bitmap_.reset();
+}
+
+Status PartitionedHashJoinNode::GetNextBitmapProbe(RuntimeState* state,
+    RowBatch* out_batch, bool* eos) {
+  DCHECK(build_bitmap_.get() != NULL);
+  ExprContext* probe_expr_ctx = probe_expr_ctxs_[0];
+  const PrimitiveType type = probe_expr_ctx->root()->type().type;
+  const bool semi_join = join_op_ == TJoinOp::LEFT_SEMI_JOIN;
+  const uint64_t num_bits = build_bitmap_->num_bits();
+  ExprContext* const* conjunct_ctxs = conjunct_ctxs_.data();
+  const int num_conjuncts = conjunct_ctxs_.size();
+  while (true) {
+    RETURN_IF_CANCELLED(state);
+    RETURN_IF_ERROR(QueryMaintenance(state));
+    if (probe_batch_pos_ != -1) {
+      SCOPED_TIMER(probe_timer_);
+      const int num_probe_rows = probe_batch_->num_rows();
+      while (probe_batch_pos_ < num_probe_rows && !out_batch->AtCapacity()) {
+        TupleRow* probe_row = probe_batch_->GetRow(probe_batch_pos_++);
+        // A NULL key matches nothing. Keys outside the range wrap around to values
+        // >= 'num_bits'.
+        int64_t key;
+        bool matched = EvalIntegerKey(probe_expr_ctx, type, probe_row, &key);
+        if (matched) {
+          uint64_t bit_idx =
+              static_cast<uint64_t>(key) - static_cast<uint64_t>(build_bitmap_min_);
+          matched = bit_idx < num_bits && build_bitmap_->Get<false>(bit_idx);
+        }
+        if (matched != semi_join) continue;
+        TupleRow* out_row = out_batch->GetRow(out_batch->AddRow());
+        out_batch->CopyRow(probe_row, out_row);
+        if (!EvalConjuncts(conjunct_ctxs, num_conjuncts, out_row)) continue;
+        out_batch->CommitLastRow();
+        ++num_rows_returned_;
+        if (ReachedLimit()) break;
+      }
+      ExprContext::FreeLocalAllocations(probe_expr_ctxs_);
+      COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+      if (ReachedLimit()) {
+        *eos = true;
+        return Status::OK();
+      }
+      if (out_batch->AtCapacity()) return Status::OK();
+      DCHECK_EQ(probe_batch_pos_, num_probe_rows);
+    }
+    RETURN_IF_ERROR(NextProbeRowBatch(state, out_batch));
+    if (probe_batch_pos_ == 0) continue;
+    // Either 'out_batch' holds the resources of the probe batch and has to be returned
+    // first, or the probe side is done.
+    *eos = probe_side_eos_;
+    return Status::OK();
+  }
+}
+
 Status PartitionedHashJoinNode::InitGetNext(TupleRow* first_probe_row) {
   // TODO: Move this reset to blocking-join. Not yet though because of hash-join.
   ResetForProbe();
@@ -758,6 +1212,7 @@ Status PartitionedHashJoinNode::NextProbeRowBatch(
       return Status::OK();
     }
     RETURN_IF_ERROR(child(0)->GetNext(state, probe_batch_.get(), &probe_side_eos_));
+    probe_batch_->ApplySelection();
     COUNTER_ADD(probe_row_counter_, probe_batch_->num_rows());
   } while (probe_batch_->num_rows() == 0);
 
@@ -841,6 +1296,15 @@ Status PartitionedHashJoinNode::PrepareNextPartition(RuntimeState* state) {
         << " than the mem_limit (" << mem_limit << ").";
   }
 
+  if (!built && input_partition_->is_skewed_) {
+    // Repartitioning didn't make this partition smaller, split it into chunks instead
+    // and continue with the first of them.
+    UpdateState(REPARTITIONING);
+    RETURN_IF_ERROR(input_partition_->Spill(true));
+    RETURN_IF_ERROR(SplitSkewedPartition(state));
+    return PrepareNextPartition(state);
+  }
+
   if (!built) {
     // This build partition still does not fit in memory, repartition.
     UpdateState(REPARTITIONING);
@@ -854,7 +1318,21 @@ Status PartitionedHashJoinNode::PrepareNextPartition(RuntimeState* state) {
     int64_t largest_partition = LargestSpilledPartition();
     DCHECK_GE(num_input_rows, largest_partition) << "Cannot have a partition with "
         "more rows than the input";
-    if (num_input_rows == largest_partition) {
+    if (num_input_rows == largest_partition && FLAGS_phj_split_skewed_partitions &&
+        CanSplitSkewedPartitions()) {
+      // All rows went to the same partition. The probe rows still need to be
+      // repartitioned into it, and it is split when it is processed.
+      for (int i = 0; i < hash_partitions_.size(); ++i) {
+        Partition* partition = hash_partitions_[i];
+        if (partition->is_closed() || !partition->is_spilled()) continue;
+        if (partition->build_rows()->num_rows() == num_input_rows) {
+          partition->is_skewed_ = true;
+        }
+      }
+      VLOG_QUERY << "PHJ(node_id=" << id_ << ") repartitioning did not reduce the size "
+                 << "of a partition with " << num_input_rows << " build rows at level "
+                 << input_partition_->level_ + 1 << ", it will be split into chunks";
+    } else if (num_input_rows == largest_partition) {
       Status status = Status::MemLimitExceeded();
       status.AddDetail(Substitute("Cannot perform hash join at node with id $0. "
           "Repartitioning did not reduce the size of a spilled partition. "
@@ -893,6 +1371,100 @@ int64_t PartitionedHashJoinNode::LargestSpilledPartition() const {
   return max_rows;
 }
 
+bool PartitionedHashJoinNode::CanSplitSkewedPartitions() const {
+  // Probe rows of left and full joins need to know whether they matched in any of the
+  // partitions.
+  return join_op_ == TJoinOp::INNER_JOIN || join_op_ == TJoinOp::RIGHT_OUTER_JOIN ||
+      join_op_ == TJoinOp::RIGHT_SEMI_JOIN || join_op_ == TJoinOp::RIGHT_ANTI_JOIN;
+}
+
+Status PartitionedHashJoinNode::SplitSkewedPartition(RuntimeState* state) {
+  DCHECK(input_partition_ != NULL);
+  DCHECK(input_partition_->is_skewed_);
+  DCHECK(input_partition_->is_spilled());
+  DCHECK(hash_partitions_.empty());
+  DCHECK(CanSplitSkewedPartitions());
+  int level = input_partition_->level_;
+  BufferedTupleStream* input_build_rows = input_partition_->build_rows();
+  DCHECK_EQ(input_build_rows->blocks_pinned(), 0) << NodeDebugString();
+  bool got_read_buffer;
+  RETURN_IF_ERROR(input_build_rows->PrepareForRead(true, &got_read_buffer));
+  if (!got_read_buffer) {
+    Status status = Status::MemLimitExceeded();
+    status.AddDetail(Substitute(PREPARE_FOR_READ_FAILED_ERROR_MSG, id_));
+    return status;
+  }
+
+  // Leave room for the hash table and the other streams when a chunk is built. Each
+  // chunk gets at least a block of rows, so that splitting makes progress.
+  int64_t max_chunk_size = max<int64_t>(mem_tracker()->SpareCapacity() / 2,
+      state->block_mgr()->max_block_size());
+  // The chunks are spilled partitions, so they use the buffers reserved for
+  // hash_partitions_.
+  vector<Partition*> chunks;
+  Status status;
+  RowBatch build_batch(child(1)->row_desc(), state->batch_size(), mem_tracker());
+  bool eos = false;
+  while (!eos) {
+    RETURN_IF_CANCELLED(state);
+    RETURN_IF_ERROR(input_build_rows->GetNext(&build_batch, &eos));
+    // Also creates the first chunk if there are no build rows.
+    for (int i = 0; i < build_batch.num_rows() || chunks.empty(); ++i) {
+      if (chunks.empty() || (chunks.size() < PARTITION_FANOUT &&
+          chunks.back()->EstimatedInMemSize() > max_chunk_size)) {
+        if (!chunks.empty()) RETURN_IF_ERROR(chunks.back()->Spill(true));
+        Partition* chunk = partition_pool_->Add(new Partition(state, this, level));
+        RETURN_IF_ERROR(chunk->build_rows()->Init(id(), runtime_profile(), false));
+        RETURN_IF_ERROR(chunk->probe_rows()->Init(id(), runtime_profile(), false));
+        chunks.push_back(chunk);
+      }
+      if (i == build_batch.num_rows()) break;
+      if (UNLIKELY(!AppendRow(chunks.back()->build_rows(), build_batch.GetRow(i),
+          &status))) {
+        return status;
+      }
+    }
+    build_batch.Reset();
+  }
+  input_build_rows->Close();
+  input_partition_->build_rows_ = NULL;
+  RETURN_IF_ERROR(chunks.back()->Spill(true));
+  // The chunks got all the input rows, the last one may still be too large.
+  chunks.back()->is_skewed_ = chunks.back()->EstimatedInMemSize() > max_chunk_size;
+
+  // Copy the probe rows, which PrepareNextPartition() prepared for reading, to each
+  // chunk.
+  BufferedTupleStream* input_probe_rows = input_partition_->probe_rows();
+  RowBatch probe_batch(child(0)->row_desc(), state->batch_size(), mem_tracker());
+  while (input_probe_rows->rows_returned() < input_probe_rows->num_rows()) {
+    RETURN_IF_CANCELLED(state);
+    RETURN_IF_ERROR(input_probe_rows->GetNext(&probe_batch, &eos));
+    for (Partition* chunk: chunks) {
+      for (int i = 0; i < probe_batch.num_rows(); ++i) {
+        if (UNLIKELY(!AppendRow(chunk->probe_rows(), probe_batch.GetRow(i), &status))) {
+          return status;
+        }
+      }
+    }
+    probe_batch.Reset();
+  }
+
+  VLOG_QUERY << "PHJ(node_id=" << id_ << ") split a skewed partition with "
+             << input_probe_rows->num_rows() << " probe rows at level " << level
+             << " into " << chunks.size() << " chunks of build rows";
+  input_partition_->Close(NULL);
+  input_partition_ = NULL;
+  // Process the chunks next, in order.
+  for (int i = chunks.size() - 1; i >= 0; --i) {
+    RETURN_IF_ERROR(chunks[i]->build_rows()->UnpinStream(true));
+    RETURN_IF_ERROR(chunks[i]->probe_rows()->UnpinStream(true));
+    spilled_partitions_.push_front(chunks[i]);
+  }
+  COUNTER_ADD(partitions_created_, chunks.size());
+  COUNTER_ADD(num_skewed_partitions_, 1);
+  return Status::OK();
+}
+
 int PartitionedHashJoinNode::ProcessProbeBatch(
     const TJoinOp::type join_op, TPrefetchMode::type prefetch_mode,
     RowBatch* out_batch, HashTableCtx* ht_ctx, Status* status) {
@@ -933,6 +1505,7 @@ int PartitionedHashJoinNode::ProcessProbeBatch(
 Status PartitionedHashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch,
     bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   DCHECK(!out_batch->AtCapacity());
 
@@ -942,6 +1515,7 @@ Status PartitionedHashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch
   } else {
     *eos = false;
   }
+  if (build_bitmap_.get() != NULL) return GetNextBitmapProbe(state, out_batch, eos);
 
   Status status = Status::OK();
   while (true) {
@@ -996,15 +1570,19 @@ Status PartitionedHashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch
       int rows_added = 0;
       TPrefetchMode::type prefetch_mode = state->query_options().prefetch_mode;
       SCOPED_TIMER(probe_timer_);
-      if (process_probe_batch_fn_ == NULL) {
+      // The level 0 function is registered for jitting last, so once it is set, both
+      // are.
+      ProcessProbeBatchFn process_probe_batch_fn_level0 =
+          LlvmCodeGen::LoadJittedFunction(&process_probe_batch_fn_level0_);
+      if (process_probe_batch_fn_level0 == NULL) {
         rows_added = ProcessProbeBatch(join_op_, prefetch_mode, out_batch, ht_ctx_.get(),
             &status);
       } else {
-        DCHECK(process_probe_batch_fn_level0_ != NULL);
         if (ht_ctx_->level() == 0) {
-          rows_added = process_probe_batch_fn_level0_(this, prefetch_mode, out_batch,
+          rows_added = process_probe_batch_fn_level0(this, prefetch_mode, out_batch,
               ht_ctx_.get(), &status);
         } else {
+          DCHECK(process_probe_batch_fn_ != NULL);
           rows_added = process_probe_batch_fn_(this, prefetch_mode, out_batch,
               ht_ctx_.get(), &status);
         }
@@ -1115,6 +1693,8 @@ void PartitionedHashJoinNode::OutputUnmatchedBuild(RowBatch* out_batch) {
     if (!output_build_partitions_.empty()) {
       hash_tbl_iterator_ =
           output_build_partitions_.front()->hash_tbl()->FirstUnmatched(ht_ctx_.get());
+    } else {
+      ReleaseKeptBuildBatches(out_batch);
     }
   }
 
@@ -1287,17 +1867,28 @@ Status PartitionedHashJoinNode::BuildHashTables(RuntimeState* state) {
   DCHECK_EQ(hash_partitions_.size(), PARTITION_FANOUT);
 
   // First loop over the partitions and build hash tables for the partitions that did
-  // not already spill.
+  // not already spill. If there is enough build input and we can get thread tokens, the
+  // hash tables are built in parallel, see BuildHashTablesInParallel().
+  vector<Partition*> partitions_to_build;
+  int64_t num_rows_to_build = 0;
   for (Partition* partition: hash_partitions_) {
     if (partition->build_rows()->num_rows() == 0) {
       // This partition is empty, no need to do anything else.
       partition->Close(NULL);
       continue;
     }
+    if (partition->is_spilled()) continue;
+    DCHECK(partition->build_rows()->is_pinned());
+    partitions_to_build.push_back(partition);
+    num_rows_to_build += partition->build_rows()->num_rows();
+  }
 
-    if (!partition->is_spilled()) {
+  if (!IsInSubplan() && FLAGS_phj_build_threads > 1 && partitions_to_build.size() > 1
+      && num_rows_to_build >= FLAGS_phj_parallel_build_min_rows) {
+    RETURN_IF_ERROR(BuildHashTablesInParallel(state, partitions_to_build));
+  } else {
+    for (Partition* partition: partitions_to_build) {
       bool built = false;
-      DCHECK(partition->build_rows()->is_pinned());
       RETURN_IF_ERROR(partition->BuildHashTable(state, &built));
       // If we did not have enough memory to build this hash table, we need to spill this
       // partition (clean up the hash table, unpin build).
@@ -1362,6 +1953,120 @@ Status PartitionedHashJoinNode::BuildHashTables(RuntimeState* state) {
   return Status::OK();
 }
 
+Status PartitionedHashJoinNode::BuildHashTablesInParallel(RuntimeState* state,
+    const vector<Partition*>& partitions) {
+  // Pin the build rows on this thread: the streams use 'block_mgr_client_', which is
+  // not thread-safe.
+  vector<Partition*> pinned_partitions;
+  for (Partition* partition: partitions) {
+    bool pinned = false;
+    RETURN_IF_ERROR(partition->PrepareBuildRows(&pinned));
+    if (pinned) {
+      pinned_partitions.push_back(partition);
+    } else {
+      RETURN_IF_ERROR(partition->Spill(true));
+    }
+  }
+
+  // Start as many helper threads as we can get tokens for. This thread keeps inserting
+  // rows as well, so at most FLAGS_phj_build_threads - 1 helpers are needed.
+  int max_helpers = min<int>(FLAGS_phj_build_threads, pinned_partitions.size()) - 1;
+  AtomicInt32 next_partition_idx(0);
+  mutex status_lock;
+  Status helper_status;
+  ThreadGroup helper_threads;
+  int num_helpers = 0;
+  for (; num_helpers < max_helpers; ++num_helpers) {
+    if (!state->resource_pool()->TryAcquireThreadToken()) break;
+    BuildHelper* helper;
+    Status status = GetBuildHelper(state, num_helpers, &helper);
+    if (!status.ok()) {
+      state->resource_pool()->ReleaseThreadToken(false);
+      lock_guard<mutex> l(status_lock);
+      helper_status = status;
+      break;
+    }
+    helper->ht_ctx->set_level(ht_ctx_->level());
+    helper_threads.AddThread(new Thread(node_name_, "hash table build thread",
+        bind(&PartitionedHashJoinNode::BuildHashTablesHelperThread, this, state, helper,
+            &pinned_partitions, &next_partition_idx, &status_lock, &helper_status)));
+  }
+  COUNTER_ADD(num_build_helper_threads_, num_helpers);
+
+  // Don't exit early on an error, the helpers still reference the local state.
+  // The parallel section is timed once here, rather than in each thread.
+  Status status;
+  {
+    SCOPED_TIMER(build_timer_);
+    status = InsertBuildRowsForPartitions(
+        state, NULL, pinned_partitions, &next_partition_idx);
+    helper_threads.JoinAll();
+  }
+  RETURN_IF_ERROR(status);
+  RETURN_IF_ERROR(helper_status);
+
+  // Spill the partitions we did not have enough memory to build a hash table for.
+  for (Partition* partition: pinned_partitions) {
+    if (partition->hash_tbl() == NULL) RETURN_IF_ERROR(partition->Spill(true));
+  }
+  return Status::OK();
+}
+
+Status PartitionedHashJoinNode::InsertBuildRowsForPartitions(RuntimeState* state,
+    BuildHelper* helper, const vector<Partition*>& partitions,
+    AtomicInt32* next_partition_idx) {
+  while (true) {
+    int idx = next_partition_idx->Add(1) - 1;
+    if (idx >= static_cast<int>(partitions.size())) return Status::OK();
+    bool built;
+    RETURN_IF_ERROR(partitions[idx]->InsertBuildRows(state, helper, &built));
+  }
+}
+
+void PartitionedHashJoinNode::BuildHashTablesHelperThread(RuntimeState* state,
+    BuildHelper* helper, const vector<Partition*>* partitions,
+    AtomicInt32* next_partition_idx, mutex* status_lock, Status* status) {
+  ScopedNumaAffinity numa_affinity(state->resource_pool()->numa_node());
+  Status s;
+  {
+    SCOPED_TIMER(state->total_cpu_timer());
+    s = InsertBuildRowsForPartitions(state, helper, *partitions, next_partition_idx);
+  }
+  state->resource_pool()->ReleaseThreadToken(false);
+  if (!s.ok()) {
+    lock_guard<mutex> l(*status_lock);
+    if (status->ok()) *status = s;
+  }
+}
+
+Status PartitionedHashJoinNode::GetBuildHelper(RuntimeState* state, int idx,
+    BuildHelper** helper) {
+  DCHECK_LE(idx, build_helpers_.size());
+  if (idx < build_helpers_.size()) {
+    *helper = build_helpers_[idx];
+    return Status::OK();
+  }
+  // Helpers are only created when the build exprs are already open, so they can be
+  // cloned. The block mgr client only draws on unreserved memory: if that runs out the
+  // partition is spilled, as it would be on the main thread.
+  BuildHelper* new_helper = pool_->Add(new BuildHelper());
+  build_helpers_.push_back(new_helper);
+  RETURN_IF_ERROR(state->block_mgr()->RegisterClient(
+      Substitute("PartitionedHashJoinNode id=$0 ptr=$1 build helper=$2", id_, this, idx),
+      0, true, mem_tracker(), state, &new_helper->block_mgr_client));
+  RETURN_IF_ERROR(Expr::CloneIfNotExists(build_expr_ctxs_, state,
+      &new_helper->build_expr_ctxs));
+  RETURN_IF_ERROR(Expr::CloneIfNotExists(probe_expr_ctxs_, state,
+      &new_helper->probe_expr_ctxs));
+  RETURN_IF_ERROR(HashTableCtx::Create(state, new_helper->build_expr_ctxs,
+      new_helper->probe_expr_ctxs, ht_ctx_->stores_nulls(), is_not_distinct_from_,
+      state->fragment_hash_seed(), MAX_PARTITION_DEPTH,
+      child(1)->row_desc().tuple_descriptors().size(), mem_tracker(),
+      &new_helper->ht_ctx));
+  *helper = new_helper;
+  return Status::OK();
+}
+
 Status PartitionedHashJoinNode::EvaluateNullProbe(BufferedTupleStream* build) {
   if (null_probe_rows_ == NULL || null_probe_rows_->num_rows() == 0) {
     return Status::OK();
@@ -1446,6 +2151,10 @@ Status PartitionedHashJoinNode::CleanUpHashPartitions(RowBatch* batch) {
     }
   }
 
+  // The rows of the kept build batches are not referenced anymore, unless there are
+  // unmatched build rows to output.
+  if (output_build_partitions_.empty()) ReleaseKeptBuildBatches(batch);
+
   // Just finished evaluating the null probe rows with all the non-spilled build
   // partitions. Unpin this now to free this memory for repartitioning.
   if (null_probe_rows_ != NULL) RETURN_IF_ERROR(null_probe_rows_->UnpinStream());
@@ -1851,7 +2560,7 @@ Status PartitionedHashJoinNode::CodegenProcessProbeBatch(
 
   // Replace hash-table parameters with constants.
   HashTableCtx::HashTableReplacedConstants replaced_constants;
-  const bool stores_duplicates = true;
+  const bool stores_duplicates = HashTablesStoreDuplicates();
   const int num_build_tuples = child(1)->row_desc().tuple_descriptors().size();
   RETURN_IF_ERROR(ht_ctx_->ReplaceHashTableConstants(state, stores_duplicates,
       num_build_tuples, process_probe_batch_fn, &replaced_constants));
@@ -1922,7 +2631,7 @@ Status PartitionedHashJoinNode::CodegenInsertBatch(RuntimeState* state,
 
   // Replace hash-table parameters with constants.
   HashTableCtx::HashTableReplacedConstants replaced_constants;
-  const bool stores_duplicates = true;
+  const bool stores_duplicates = HashTablesStoreDuplicates();
   const int num_build_tuples = child(1)->row_desc().tuple_descriptors().size();
   RETURN_IF_ERROR(ht_ctx_->ReplaceHashTableConstants(state, stores_duplicates,
       num_build_tuples, insert_batch_fn, &replaced_constants));
@@ -21,20 +21,24 @@
 #include <boost/thread.hpp>
 #include <string>
 
+#include "common/atomic.h"
 #include "exec/blocking-join-node.h"
 #include "exec/exec-node.h"
 #include "exec/filter-context.h"
 #include "exec/hash-table.h"
+#include "exec/row-batch-list.h"
 #include "runtime/buffered-block-mgr.h"
 
 #include "gen-cpp/PlanNodes_types.h"  // for TJoinOp
 
 namespace impala {
 
+class Bitmap;
 class BloomFilter;
 class BufferedBlockMgr;
 class MemPool;
 class RowBatch;
+class RowBatchCache;
 class RuntimeFilter;
 class TupleRow;
 class BufferedTupleStream;
@@ -50,12 +54,26 @@ class BufferedTupleStream;
 ///     build rows and process the spilled probe rows. If the partition is still too
 ///     big, repeat steps 1-4, using this spilled partitions build and probe rows as
 ///     input.
+///  5. If repartitioning a partition put all of its rows into a single new partition,
+///     which is typical for a single key with too many rows, that partition is not
+///     repartitioned again but split into chunks of build rows that fit in memory, see
+///     SplitSkewedPartition().
+/// If the build rows have a single tuple, step 1 keeps the build child's row batches
+/// instead of copying their rows into the partitions' streams, as long as they fit in
+/// memory, and step 2 builds the hash tables on their tuples, see
+/// BuildKeptHashTables(). The rows are only copied into the streams once the batches
+/// don't fit, after which the partitions can spill as usual.
+/// Left semi and left anti joins without other join conjuncts only need to know whether
+/// a probe row has a match, so their hash tables keep one build row per distinct key,
+/// see HashTablesStoreDuplicates(). If the join has a single integer key whose distinct
+/// values are dense enough, the level 0 hash tables are replaced by a bitmap over the
+/// key range once they are all in memory, see BuildBitmap().
 //
-/// TODO: don't copy tuple rows so often.
 /// TODO: we need multiple hash functions. Each repartition needs new hash functions
 /// or new bits. Multiplicative hashing?
-/// TODO: think about details about multithreading. Multiple partitions in parallel?
-/// Multiple threads against a single partition? How to build hash tables in parallel?
+/// The hash tables of the in-memory partitions may be built in parallel, one partition
+/// per thread at a time, see BuildHashTablesInParallel().
+/// TODO: Multiple threads against a single partition?
 /// TODO: BuildHashTables() should start with the partitions that are already pinned.
 class PartitionedHashJoinNode : public BlockingJoinNode {
  public:
@@ -77,6 +95,7 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
 
  private:
   class Partition;
+  struct BuildHelper;
 
   /// Implementation details:
   /// Logically, the algorithm runs in three modes.
@@ -131,9 +150,9 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// limit and 64 fanout, we can support 256TB build tables in the case where
   /// there is no skew.
   /// In the case where there is skew, repartitioning is unlikely to help (assuming a
-  /// reasonable hash function).
+  /// reasonable hash function). A partition whose repartitioning did not reduce its size
+  /// is split with SplitSkewedPartition() instead, if the join op allows it.
   /// Note that we need to have at least as many SEED_PRIMES in HashTableCtx.
-  /// TODO: we can revisit and try harder to explicitly detect skew.
   static const int MAX_PARTITION_DEPTH = 16;
 
   /// Append the row to stream. In the common case, the row is just in memory and the
@@ -165,6 +184,77 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// 'build_filters' is true, runtime filters are populated.
   Status ProcessBuildBatch(RowBatch* build_batch, bool build_filters);
 
+  /// Calls the codegen'd ProcessBuildBatch() for the current level if there is one, or
+  /// the interpreted one otherwise. Runtime filters are populated at level 0.
+  Status PartitionBuildBatch(RowBatch* build_batch);
+
+  /// Inserts the values of 'build_row' into the runtime filters.
+  void InsertRuntimeFilters(TupleRow* build_row);
+
+  /// Returns true if the hash tables of level 0 can be built directly on the build
+  /// child's row batches, which requires the hash tables to store the single tuple of
+  /// each build row. Not supported for NAAJ, which needs the rows with NULLs in
+  /// null_aware_partition_.
+  bool CanKeepBuildBatches();
+
+  /// Returns true if the memory left is enough to build the hash tables on
+  /// kept_build_batches_, and to copy their tuples into the streams if that fails.
+  bool KeptBuildBatchesFit();
+
+  /// Partitions the rows of kept_build_batches_ into the build streams of
+  /// hash_partitions_ and frees the batches.
+  Status MaterializeKeptBuildBatches();
+
+  /// Builds a hash table for each partition in hash_partitions_ on the rows of
+  /// kept_build_batches_, which must not be in the partitions' streams, and populates
+  /// the runtime filters. Empty partitions are closed. If there was not enough memory,
+  /// *built is set to false and the partitions are left without hash tables, the
+  /// caller is responsible for materializing the rows then.
+  Status BuildKeptHashTables(RuntimeState* state, bool* built);
+
+  /// Releases kept_build_batches_ once no partition references their rows. If 'batch'
+  /// is non-NULL, their memory is transferred to it, otherwise it is freed.
+  void ReleaseKeptBuildBatches(RowBatch* batch);
+
+  /// Returns true if the hash tables need to store all build rows with the same key.
+  /// Left semi and left anti joins without other join conjuncts return a probe row
+  /// at most once and don't look at the build rows, so one row per key is enough.
+  /// NAAJ keeps all rows, it evaluates the other join conjuncts for NULL keys.
+  bool HashTablesStoreDuplicates() const {
+    return (join_op_ != TJoinOp::LEFT_SEMI_JOIN && join_op_ != TJoinOp::LEFT_ANTI_JOIN)
+        || !other_join_conjunct_ctxs_.empty();
+  }
+
+  /// Returns true if the join can be probed with a bitmap of the build keys: a left
+  /// semi or left anti join without other join conjuncts on a single integer key,
+  /// compared with '='.
+  bool CanBuildBitmap();
+
+  /// Called after the level 0 hash tables were built. If all partitions are in memory
+  /// and the keys in the hash tables are dense enough, sets build_bitmap_ to the set of
+  /// keys and closes the partitions, which frees the build rows and the hash tables.
+  /// Leaves the partitions alone otherwise.
+  Status BuildBitmap(RuntimeState* state);
+
+  /// Sets 'min_key' and 'max_key' to the smallest and largest non-NULL single integer
+  /// key in the in-memory hash tables of hash_partitions_. Returns false if there is
+  /// none.
+  bool FindBuildKeyRange(int64_t* min_key, int64_t* max_key);
+
+  /// Called after the level 0 hash tables were built if there is no build_bitmap_.
+  /// Adds a direct index over the range of build keys to each in-memory hash table if
+  /// the join has a single integer key and the range is small enough, see
+  /// HashTable::InitDirectIndex().
+  void BuildDirectIndexes();
+
+  /// Frees build_bitmap_, if there is one.
+  void ReleaseBuildBitmap();
+
+  /// GetNext() if the build side is in build_bitmap_. Streams the probe child's rows
+  /// and returns the ones whose key is (for semi joins) or isn't (for anti joins) in
+  /// the bitmap.
+  Status GetNextBitmapProbe(RuntimeState* state, RowBatch* out_batch, bool* eos);
+
   /// Call at the end of partitioning the build rows (which could be from the build child
   /// or from repartitioning an existing partition). After this function returns, all
   /// partitions in hash_partitions_ are ready to accept probe rows. This function
@@ -173,6 +263,30 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// structures.
   Status BuildHashTables(RuntimeState* state);
 
+  /// Builds the hash tables of 'partitions', which must all be in memory, using this
+  /// thread and up to FLAGS_phj_build_threads - 1 helper threads, as many as thread
+  /// tokens can be acquired for. The build streams are pinned on this thread before any
+  /// helper starts, since they share 'block_mgr_client_'. Partitions whose hash table
+  /// could not be built are spilled once all threads are done.
+  Status BuildHashTablesInParallel(RuntimeState* state,
+      const std::vector<Partition*>& partitions);
+
+  /// Claims partitions from 'partitions' by incrementing 'next_partition_idx' and
+  /// inserts their build rows into new hash tables until all partitions are claimed.
+  /// 'helper' is NULL when called from the main thread.
+  Status InsertBuildRowsForPartitions(RuntimeState* state, BuildHelper* helper,
+      const std::vector<Partition*>& partitions, AtomicInt32* next_partition_idx);
+
+  /// Thread function of a hash table build helper thread. Releases the thread token
+  /// acquired for it. The first error of any helper is stored in 'status'.
+  void BuildHashTablesHelperThread(RuntimeState* state, BuildHelper* helper,
+      const std::vector<Partition*>* partitions, AtomicInt32* next_partition_idx,
+      boost::mutex* status_lock, Status* status);
+
+  /// Returns the 'idx'-th build helper in 'helper', creating it if needed. Helpers are
+  /// created in order, and only after the build and probe exprs are opened.
+  Status GetBuildHelper(RuntimeState* state, int idx, BuildHelper** helper);
+
   /// Probes the hash table for rows matching the current probe row and appends
   /// all the matching build rows (with probe row) to output batch. Returns true
   /// if probing is done for the current probe row and should continue to next row.
@@ -254,8 +368,10 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// values are stored in the expression values cache in 'ht_ctx'. The number of rows
   /// processed depends on the capacity available in 'ht_ctx->expr_values_cache_'.
   /// 'prefetch_mode' specifies the prefetching mode in use. If it's not PREFETCH_NONE,
-  /// hash table buckets will be prefetched based on the hash values computed. Note
-  /// that 'prefetch_mode' will be substituted with constants during codegen time.
+  /// hash table buckets will be prefetched based on the hash values computed, followed
+  /// by a second pass over the group which prefetches the build rows referenced by those
+  /// buckets. Note that 'prefetch_mode' will be substituted with constants during
+  /// codegen time.
   void EvalAndHashProbePrefetchGroup(TPrefetchMode::type prefetch_mode,
       HashTableCtx* ctx);
 
@@ -341,6 +457,21 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// of the largest partition (in terms of number of build and probe rows).
   int64_t LargestSpilledPartition() const;
 
+  /// Returns true if a skewed partition may be split into several partitions that each
+  /// have some of the build rows and all of the probe rows. This is the case for the
+  /// join ops whose output for a probe row doesn't depend on the build rows of other
+  /// partitions.
+  bool CanSplitSkewedPartitions() const;
+
+  /// Splits input_partition_, which is skewed and whose build side doesn't fit in
+  /// memory, into up to PARTITION_FANOUT partitions of the same level and adds them to
+  /// the front of spilled_partitions_. Each of them gets a chunk of the build rows that
+  /// is expected to fit in memory together with its hash table, and a copy of all the
+  /// probe rows, so they can each be joined like a spilled partition that fits in
+  /// memory. Only the last one may not fit, it is skewed itself then. Closes
+  /// input_partition_ and sets it to NULL.
+  Status SplitSkewedPartition(RuntimeState* state);
+
   /// Calls Close() on every Partition in 'hash_partitions_',
   /// 'spilled_partitions_', and 'output_build_partitions_' and then resets the lists,
   /// the vector and the partition pool.
@@ -424,10 +555,30 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   BufferedBlockMgr::Client* block_mgr_client_;
 
   /// Used for hash-related functionality, such as evaluating rows and calculating hashes.
-  /// TODO: If we want to multi-thread then this context should be thread-local and not
-  /// associated with the node.
+  /// Only used by the main thread; hash table build helper threads have their own.
   boost::scoped_ptr<HashTableCtx> ht_ctx_;
 
+  /// Per-thread state of a hash table build helper thread. A single ExprContext or block
+  /// mgr client must not be used by more than one thread at once, so each helper has
+  /// its own. Helpers are kept for the lifetime of the node (block mgr clients cannot be
+  /// unregistered) and reused by later calls to BuildHashTablesInParallel(). Hash tables
+  /// built by a helper keep charging their memory to its client.
+  struct BuildHelper {
+    BuildHelper() : block_mgr_client(NULL) {}
+
+    /// Client with no reserved buffers that the helper's hash tables allocate from.
+    BufferedBlockMgr::Client* block_mgr_client;
+
+    /// Clones of build_expr_ctxs_ and probe_expr_ctxs_, used by 'ht_ctx'.
+    std::vector<ExprContext*> build_expr_ctxs;
+    std::vector<ExprContext*> probe_expr_ctxs;
+
+    boost::scoped_ptr<HashTableCtx> ht_ctx;
+  };
+
+  /// Build helpers created so far, owned by pool_. Only accessed from the main thread.
+  std::vector<BuildHelper*> build_helpers_;
+
   /// The iterator that corresponds to the look up of current_probe_row_.
   HashTable::Iterator hash_tbl_iterator_;
 
@@ -437,6 +588,10 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// Total number of hash buckets across all partitions.
   RuntimeProfile::Counter* num_hash_buckets_;
 
+  /// Total time spent resizing hash tables and the number of times they were resized.
+  RuntimeProfile::Counter* ht_resize_timer_;
+  RuntimeProfile::Counter* num_ht_resizes_;
+
   /// Total number of partitions created.
   RuntimeProfile::Counter* partitions_created_;
 
@@ -453,6 +608,9 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// Number of partitions that have been spilled.
   RuntimeProfile::Counter* num_spilled_partitions_;
 
+  /// Number of skewed partitions that were split by SplitSkewedPartition().
+  RuntimeProfile::Counter* num_skewed_partitions_;
+
   /// The largest fraction (of build side) after repartitioning. This is expected to be
   /// 1 / PARTITION_FANOUT. A value much larger indicates skew.
   RuntimeProfile::HighWaterMarkCounter* largest_partition_percent_;
@@ -460,9 +618,30 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// Number of hash collisions - unequal rows that have identical hash values
   RuntimeProfile::Counter* num_hash_collisions_;
 
+  /// Number of filled buckets skipped by probes because the hash cached in the bucket
+  /// did not match.
+  RuntimeProfile::Counter* num_hash_mismatch_skips_;
+
+  /// Number of helper threads started to build hash tables in parallel.
+  RuntimeProfile::Counter* num_build_helper_threads_;
+
   /// Time spent evaluating other_join_conjuncts for NAAJ.
   RuntimeProfile::Counter* null_aware_eval_timer_;
 
+  /// Number of build rows whose hash table was built on the build child's row batches,
+  /// without copying them into a stream.
+  RuntimeProfile::Counter* num_kept_build_rows_;
+
+  /// Number of bits of build_bitmap_, if the build side was turned into one.
+  RuntimeProfile::Counter* build_bitmap_bits_;
+
+  /// Number of hash tables that were given a direct index, see BuildDirectIndexes().
+  RuntimeProfile::Counter* num_direct_indexes_;
+
+  /// Creates the row batches that the build child's rows are read into while they are
+  /// kept. The batches are owned by the cache, their memory by kept_build_batches_.
+  boost::scoped_ptr<RowBatchCache> build_batch_cache_;
+
   /////////////////////////////////////////
   /// BEGIN: Members that must be Reset()
 
@@ -533,6 +712,17 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// outputting.
   int64_t null_probe_output_idx_;
 
+  /// The build child's row batches while they are kept, see CanKeepBuildBatches(). If
+  /// the level 0 hash tables were built on them, they stay until these partitions are
+  /// done. 'kept_build_bytes_' is the tuple data of these batches.
+  RowBatchList kept_build_batches_;
+  int64_t kept_build_bytes_;
+
+  /// The distinct build keys if the partitions were replaced by a bitmap, bit i being
+  /// the key 'build_bitmap_min_' + i. NULL otherwise. See BuildBitmap().
+  boost::scoped_ptr<Bitmap> build_bitmap_;
+  int64_t build_bitmap_min_;
+
   /// END: Members that must be Reset()
   /////////////////////////////////////////
 
@@ -564,6 +754,17 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
     /// and the caller is responsible for spilling this partition.
     Status BuildHashTable(RuntimeState* state, bool* built);
 
+    /// The two steps of BuildHashTable(). PrepareBuildRows() pins the build tuples and
+    /// prepares them for reading, setting *pinned to false if there was not enough
+    /// memory. It uses the node's block mgr client, so it must be called from the main
+    /// thread. InsertBuildRows() then constructs hash_tbl_ from the pinned build tuples
+    /// using the hash table context and block mgr client of 'helper', or the node's if
+    /// 'helper' is NULL. It may be called from different threads for different
+    /// partitions at the same time. If there was not enough memory, *built is set to
+    /// false and hash_tbl_ is left NULL.
+    Status PrepareBuildRows(bool* pinned);
+    Status InsertBuildRows(RuntimeState* state, BuildHelper* helper, bool* built);
+
     /// Spills this partition, cleaning up and unpinning blocks.
     /// If 'unpin_all_build' is true, the build stream is completely unpinned, otherwise,
     /// it is unpinned with one buffer remaining.
@@ -591,6 +792,10 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
     /// True if this partition is spilled.
     bool is_spilled_;
 
+    /// True if this partition got all the rows when its parent was repartitioned, so
+    /// repartitioning it again is unlikely to help.
+    bool is_skewed_;
+
     /// How many times rows in this partition have been repartitioned. Partitions created
     /// from the node's children's input is level 0, 1 after the first repartitionining,
     /// etc.
@@ -629,6 +834,12 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// Jitted Partition::InsertBatch() function pointers. NULL if codegen is disabled.
   InsertBatchFn insert_batch_fn_;
   InsertBatchFn insert_batch_fn_level0_;
+
+  /// Jitted functions that copy build and probe rows into the partitions' streams, see
+  /// BufferedTupleStream::CodegenCopyRow(). NULL if codegen is disabled or the rows
+  /// can't be copied by codegen'd code.
+  BufferedTupleStream::CopyRowFn build_copy_row_fn_;
+  BufferedTupleStream::CopyRowFn probe_copy_row_fn_;
 };
 
 }
@@ -18,6 +18,10 @@
 #include "exec/partitioned-hash-join-node.h"
 
 #include "runtime/buffered-tuple-stream.inline.h"
+#include "runtime/raw-value.inline.h"
+#include "runtime/runtime-filter.h"
+#include "util/bloom-filter.h"
+#include "util/min-max-filter.h"
 
 namespace impala {
 
@@ -35,6 +39,22 @@ inline bool PartitionedHashJoinNode::AppendRow(BufferedTupleStream* stream,
   return AppendRowStreamFull(stream, row, status);
 }
 
+inline void PartitionedHashJoinNode::InsertRuntimeFilters(TupleRow* build_row) {
+  DCHECK_EQ(ht_ctx_->level(), 0)
+      << "Runtime filters should not be built during repartitioning.";
+  for (const FilterContext& ctx: filters_) {
+    // TODO: codegen expr evaluation and hashing
+    if (ctx.local_bloom_filter == NULL && ctx.local_min_max_filter == NULL) continue;
+    void* e = ctx.expr->GetValue(build_row);
+    if (ctx.local_bloom_filter != NULL) {
+      uint32_t filter_hash = RawValue::GetHashValue(e, ctx.expr->root()->type(),
+          RuntimeFilterBank::DefaultHashSeed());
+      ctx.local_bloom_filter->Insert(filter_hash);
+    }
+    if (ctx.local_min_max_filter != NULL) ctx.local_min_max_filter->Insert(e);
+  }
+}
+
 }
 
 #endif
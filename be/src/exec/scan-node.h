@@ -63,6 +63,13 @@ class TScanRange;
 ///     of the ScanNode. This is at most the number of scan ranges but should be much
 ///     less since a single scanner thread will likely process multiple scan ranges.
 //
+///   ScannerIoWaitTime - total time that the scanner threads waited for the IO
+///     buffers of their scan ranges.
+//
+///   ScannerThreadsTarget - time series of the number of scanner threads that an HDFS
+///     scan node aims for. It is lowered while the scan is IO bound and raised while it
+///     is cpu bound.
+//
 ///   ScanRangesComplete - number of scan ranges completed
 //
 ///   MaterializeTupleTime - time spent in creating in-memory tuple format
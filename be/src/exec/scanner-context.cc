@@ -136,6 +136,8 @@ Status ScannerContext::Stream::GetNextBuffer(int64_t read_past_size) {
 
   if (!eosr) {
     SCOPED_TIMER(parent_->state_->total_storage_wait_timer());
+    SCOPED_TIMER(parent_->scan_node_->scanner_io_wait_timer());
+    SCOPED_WAIT_TIMER(IO_WAIT);
     RETURN_IF_ERROR(scan_range_->GetNext(&io_buffer_));
   } else {
     SCOPED_TIMER(parent_->state_->total_storage_wait_timer());
@@ -32,12 +32,14 @@ SelectNode::SelectNode(
 
 Status SelectNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Prepare(state));
   return Status::OK();
 }
 
 Status SelectNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_ERROR(child(0)->Open(state));
   child_row_batch_.reset(
@@ -47,6 +49,7 @@ Status SelectNode::Open(RuntimeState* state) {
 
 Status SelectNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
 
   if (ReachedLimit() || (child_row_idx_ == child_row_batch_->num_rows() && child_eos_)) {
@@ -69,6 +72,12 @@ Status SelectNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos)
       child_row_batch_->Reset();
       if (row_batch->AtCapacity()) return Status::OK();
       RETURN_IF_ERROR(child(0)->GetNext(state, child_row_batch_.get(), &child_eos_));
+      if (row_batch->selection_enabled() && row_batch->IsEmpty() && limit_ == -1) {
+        // Hand on the child's batch with the passing rows selected, without copying.
+        SelectRows(row_batch);
+        *eos = child_eos_;
+        return Status::OK();
+      }
     }
 
     if (CopyRows(row_batch)) {
@@ -110,6 +119,26 @@ bool SelectNode::CopyRows(RowBatch* output_batch) {
   return output_batch->AtCapacity();
 }
 
+void SelectNode::SelectRows(RowBatch* output_batch) {
+  ExprContext** conjunct_ctxs = &conjunct_ctxs_[0];
+  int num_conjunct_ctxs = conjunct_ctxs_.size();
+  int* selection = output_batch->selection();
+  int num_selected = 0;
+  int num_rows = child_row_batch_->num_rows();
+  DCHECK_LE(num_rows, output_batch->capacity());
+  for (int i = 0; i < num_rows; ++i) {
+    // Always write the index and only advance past it if the row passes, which avoids
+    // a branch on the result of the conjuncts.
+    selection[num_selected] = i;
+    num_selected +=
+        EvalConjuncts(conjunct_ctxs, num_conjunct_ctxs, child_row_batch_->GetRow(i));
+  }
+  output_batch->AcquireState(child_row_batch_.get());
+  output_batch->SetSelection(num_selected);
+  num_rows_returned_ += num_selected;
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+}
+
 Status SelectNode::Reset(RuntimeState* state) {
   child_row_batch_->Reset();
   child_row_idx_ = 0;
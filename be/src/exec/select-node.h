@@ -59,6 +59,11 @@ class SelectNode : public ExecNode {
   /// output_batch, up to limit_.
   /// Return true if limit was hit or output_batch should be returned, otherwise false.
   bool CopyRows(RowBatch* output_batch);
+
+  /// Moves all rows of child_row_batch_ to the empty 'output_batch', which must have
+  /// selections enabled, and selects the rows for which conjuncts_ evaluate to true.
+  /// Only used without a limit.
+  void SelectRows(RowBatch* output_batch);
 };
 
 }
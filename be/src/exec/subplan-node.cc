@@ -13,12 +13,19 @@
 // limitations under the License.
 
 #include "exec/subplan-node.h"
+#include "exec/nested-loop-join-node.h"
 #include "exec/singular-row-src-node.h"
 #include "exec/subplan-node.h"
 #include "exec/unnest-node.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 
+#include "common/names.h"
+
+DEFINE_bool(enable_batched_unnest, true, "(Advanced) If true, a subplan that joins each "
+    "input row with the items of one of its collections produces the joined rows of "
+    "many input rows at once instead of re-opening its plan nodes for every input row.");
+
 namespace impala {
 
 SubplanNode::SubplanNode(ObjectPool* pool, const TPlanNode& tnode,
@@ -29,7 +36,9 @@ SubplanNode::SubplanNode(ObjectPool* pool, const TPlanNode& tnode,
       input_row_idx_(0),
       current_input_row_(NULL),
       subplan_is_open_(false),
-      subplan_eos_(false) {
+      subplan_eos_(false),
+      batched_unnest_(NULL),
+      num_input_tuples_(0) {
 }
 
 Status SubplanNode::Init(const TPlanNode& tnode, RuntimeState* state) {
@@ -55,24 +64,72 @@ void SubplanNode::SetContainingSubplan(SubplanNode* ancestor, ExecNode* node) {
 
 Status SubplanNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Prepare(state));
   input_batch_.reset(
       new RowBatch(child(0)->row_desc(), state->batch_size(), mem_tracker()));
+  num_input_tuples_ = child(0)->row_desc().tuple_descriptors().size();
+  if (FLAGS_enable_batched_unnest) batched_unnest_ = GetBatchedUnnest();
+  if (batched_unnest_ != NULL) AddRuntimeExecOption("Batched Unnest");
   return Status::OK();
 }
 
+UnnestNode* SubplanNode::GetBatchedUnnest() {
+  if (child(1)->type() != TPlanNodeType::NESTED_LOOP_JOIN_NODE) return NULL;
+  NestedLoopJoinNode* join = static_cast<NestedLoopJoinNode*>(child(1));
+  if (join->join_op() != TJoinOp::INNER_JOIN && join->join_op() != TJoinOp::CROSS_JOIN) {
+    return NULL;
+  }
+  if (join->limit() != -1 || !join->conjunct_ctxs().empty()
+      || !join->join_conjunct_ctxs().empty()) {
+    return NULL;
+  }
+  ExecNode* singular_row_src = join->child(0);
+  ExecNode* unnest = join->child(1);
+  if (singular_row_src->type() != TPlanNodeType::SINGULAR_ROW_SRC_NODE
+      || unnest->type() != TPlanNodeType::UNNEST_NODE) {
+    return NULL;
+  }
+  if (singular_row_src->limit() != -1 || !singular_row_src->conjunct_ctxs().empty()
+      || unnest->limit() != -1) {
+    return NULL;
+  }
+
+  // The joined rows must be the input row followed by the item tuple.
+  const vector<TupleDescriptor*>& input_tuples = child(0)->row_desc().tuple_descriptors();
+  const vector<TupleDescriptor*>& joined_tuples = join->row_desc().tuple_descriptors();
+  if (singular_row_src->row_desc().tuple_descriptors() != input_tuples
+      || joined_tuples.size() != input_tuples.size() + 1
+      || row_desc().tuple_descriptors() != joined_tuples
+      || joined_tuples.back() != unnest->row_desc().tuple_descriptors()[0]) {
+    return NULL;
+  }
+  for (int i = 0; i < input_tuples.size(); ++i) {
+    if (joined_tuples[i] != input_tuples[i]) return NULL;
+  }
+  return static_cast<UnnestNode*>(unnest);
+}
+
 Status SubplanNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_ERROR(child(0)->Open(state));
+  if (batched_unnest_ != NULL) {
+    // The UnnestNode is not opened, but its exprs are used.
+    RETURN_IF_ERROR(Expr::Open(batched_unnest_->conjunct_ctxs_, state));
+    RETURN_IF_ERROR(batched_unnest_->coll_expr_ctx_->Open(state));
+  }
   return Status::OK();
 }
 
 Status SubplanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
   *eos = false;
+  if (batched_unnest_ != NULL) return GetNextBatchedUnnest(state, row_batch, eos);
 
   while (true) {
     if (subplan_is_open_) {
@@ -130,11 +187,69 @@ Status SubplanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos)
   return Status::OK();
 }
 
+Status SubplanNode::GetNextBatchedUnnest(RuntimeState* state, RowBatch* row_batch,
+    bool* eos) {
+  UnnestNode* unnest = batched_unnest_;
+  ExprContext* const* conjunct_ctxs = &unnest->conjunct_ctxs_[0];
+  int num_conjunct_ctxs = unnest->conjunct_ctxs_.size();
+  while (true) {
+    if (current_input_row_ != NULL) {
+      // Join the current input row with the remaining items of its collection.
+      const CollectionValue* coll_value = unnest->coll_value_;
+      while (unnest->item_idx_ < coll_value->num_tuples) {
+        Tuple* item = reinterpret_cast<Tuple*>(
+            coll_value->ptr + unnest->item_idx_ * unnest->item_byte_size_);
+        ++unnest->item_idx_;
+        // The conjuncts of the UnnestNode are bound to rows of just the item tuple.
+        TupleRow* item_row = reinterpret_cast<TupleRow*>(&item);
+        if (!EvalConjuncts(conjunct_ctxs, num_conjunct_ctxs, item_row)) continue;
+        TupleRow* row = row_batch->GetRow(row_batch->AddRow());
+        memcpy(row, current_input_row_, num_input_tuples_ * sizeof(Tuple*));
+        row->SetTuple(num_input_tuples_, item);
+        row_batch->CommitLastRow();
+        ++num_rows_returned_;
+        if (ReachedLimit()) {
+          *eos = true;
+          COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+          return Status::OK();
+        }
+        if (row_batch->AtCapacity()) {
+          COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+          return Status::OK();
+        }
+      }
+      current_input_row_ = NULL;
+    }
+
+    if (input_row_idx_ >= input_batch_->num_rows()) {
+      input_batch_->TransferResourceOwnership(row_batch);
+      if (input_eos_) {
+        *eos = true;
+        break;
+      }
+      // Could be at capacity after resources have been transferred to it.
+      if (row_batch->AtCapacity()) break;
+      input_batch_->Reset();
+      RETURN_IF_ERROR(child(0)->GetNext(state, input_batch_.get(), &input_eos_));
+      input_row_idx_ = 0;
+      if (input_batch_->num_rows() == 0) continue;
+    }
+
+    current_input_row_ = input_batch_->GetRow(input_row_idx_);
+    ++input_row_idx_;
+    unnest->InitCollection(current_input_row_);
+  }
+
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+  return Status::OK();
+}
+
 Status SubplanNode::Reset(RuntimeState* state) {
   input_eos_ = false;
   input_row_idx_ = 0;
   subplan_eos_ = false;
   num_rows_returned_ = 0;
+  if (batched_unnest_ != NULL) current_input_row_ = NULL;
   RETURN_IF_ERROR(child(0)->Reset(state));
   // If child(1) is not open it means that we have just Reset() it and returned from
   // GetNext() without opening it again. It is not safe to call Reset() on the same
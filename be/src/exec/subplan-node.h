@@ -21,6 +21,7 @@
 namespace impala {
 
 class TupleRow;
+class UnnestNode;
 
 /// For every input row from its first child, a SubplanNode evaluates and pulls all
 /// results from its second child, resetting the second child after every input row.
@@ -43,6 +44,17 @@ class TupleRow;
 /// The resources owned by batches from the first child of this node are always
 /// transferred to the output batch right before fetching a new batch from the
 /// first child.
+///
+/// Batched unnesting:
+/// The most common subplan joins each input row with the items of one of its
+/// collections, i.e. its second child is an inner or cross NestedLoopJoinNode of a
+/// SingularRowSrcNode and an UnnestNode, with no conjuncts or limits except for the
+/// conjuncts of the UnnestNode. For small collections, opening, joining and resetting
+/// these nodes for every input row dominates the runtime. Unless --enable_batched_unnest
+/// is false, the SubplanNode then produces the joined rows itself, continuing with the
+/// collections of the following input rows until the output batch is full. The
+/// UnnestNode still retrieves each collection (see UnnestNode::InitCollection()) and
+/// evaluates its conjuncts, but the nodes of the second child are never opened.
 class SubplanNode : public ExecNode {
  public:
   SubplanNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
@@ -63,6 +75,13 @@ class SubplanNode : public ExecNode {
   /// Does not traverse the second child of SubplanNodes within 'node'
   void SetContainingSubplan(SubplanNode* ancestor, ExecNode* node);
 
+  /// Returns the UnnestNode of the second child if the subplan can be unnested in
+  /// batches (see class comment), otherwise NULL.
+  UnnestNode* GetBatchedUnnest();
+
+  /// Implements GetNext() if batched_unnest_ is not NULL.
+  Status GetNextBatchedUnnest(RuntimeState* state, RowBatch* row_batch, bool* eos);
+
   /// Returns the current row from child(0) or NULL if no rows from child(0) have been
   /// retrieved yet (GetNext() has not yet been called). This function is called by
   /// singular-row-src and unnest nodes while evaluating child(1).
@@ -86,6 +105,14 @@ class SubplanNode : public ExecNode {
 
   /// Saved from the last call to GetNext() on our second child.
   bool subplan_eos_;
+
+  /// The UnnestNode of the second child if the subplan is unnested in batches,
+  /// otherwise NULL. Set in Prepare().
+  UnnestNode* batched_unnest_;
+
+  /// The number of tuples of the rows of the first child, which the output rows of a
+  /// batched unnest start with.
+  int num_input_tuples_;
 };
 
 }
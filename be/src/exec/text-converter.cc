@@ -213,6 +213,25 @@ Function* TextConverter::CodegenWriteSlot(LlvmCodeGen* codegen,
       case TYPE_DOUBLE:
         parse_fn_enum = IRFunction::STRING_TO_DOUBLE;
         break;
+      case TYPE_TIMESTAMP:
+        parse_fn_enum = IRFunction::STRING_TO_TIMESTAMP;
+        break;
+      case TYPE_DECIMAL:
+        switch (slot_desc->slot_size()) {
+          case 4:
+            parse_fn_enum = IRFunction::STRING_TO_DECIMAL4;
+            break;
+          case 8:
+            parse_fn_enum = IRFunction::STRING_TO_DECIMAL8;
+            break;
+          case 16:
+            parse_fn_enum = IRFunction::STRING_TO_DECIMAL16;
+            break;
+          default:
+            DCHECK(false) << "Decimal slots can't be this size.";
+            return NULL;
+        }
+        break;
       default:
         DCHECK(false);
         return NULL;
@@ -228,9 +247,25 @@ Function* TextConverter::CodegenWriteSlot(LlvmCodeGen* codegen,
     Value* parse_result_ptr = codegen->CreateEntryBlockAlloca(fn, parse_result);
     Value* failed_value = codegen->GetIntConstant(TYPE_INT, StringParser::PARSE_FAILURE);
 
-    // Call Impala's StringTo* function
-    Value* result = builder.CreateCall(parse_fn,
-        ArrayRef<Value*>({args[1], args[2], parse_result_ptr}));
+    // Call Impala's StringTo* function. The timestamp and decimal functions write the
+    // value into the slot themselves, the others return it.
+    Value* result = NULL;
+    if (slot_desc->type().type == TYPE_TIMESTAMP) {
+      Value* slot_ptr = builder.CreateBitCast(
+          slot, parse_fn->getFunctionType()->getParamType(3), "ts_slot");
+      builder.CreateCall(parse_fn,
+          ArrayRef<Value*>({args[1], args[2], parse_result_ptr, slot_ptr}));
+    } else if (slot_desc->type().type == TYPE_DECIMAL) {
+      Value* slot_ptr = builder.CreateBitCast(
+          slot, parse_fn->getFunctionType()->getParamType(5), "decimal_slot");
+      builder.CreateCall(parse_fn, ArrayRef<Value*>({args[1], args[2],
+          codegen->GetIntConstant(TYPE_INT, slot_desc->type().precision),
+          codegen->GetIntConstant(TYPE_INT, slot_desc->type().scale),
+          parse_result_ptr, slot_ptr}));
+    } else {
+      result = builder.CreateCall(parse_fn,
+          ArrayRef<Value*>({args[1], args[2], parse_result_ptr}));
+    }
     Value* parse_result_val = builder.CreateLoad(parse_result_ptr, "parse_result");
 
     // Check for parse error.  TODO: handle overflow
@@ -239,7 +274,7 @@ Function* TextConverter::CodegenWriteSlot(LlvmCodeGen* codegen,
 
     // Parse succeeded
     builder.SetInsertPoint(parse_success_block);
-    builder.CreateStore(result, slot);
+    if (result != NULL) builder.CreateStore(result, slot);
     builder.CreateRet(codegen->true_value());
 
     // Parse failed, set slot to null and return false
@@ -14,6 +14,8 @@
 
 #include "exec/topn-node.h"
 
+#include "util/key-normalizer.inline.h"
+
 using namespace impala;
 
 void TopNNode::InsertBatch(RowBatch* batch) {
@@ -22,28 +24,46 @@ void TopNNode::InsertBatch(RowBatch* batch) {
   }
 }
 
+void TopNNode::NormalizeKey(Tuple* tuple, uint8_t* key) {
+  bool went_over =
+      key_normalizer_->NormalizeKey(reinterpret_cast<TupleRow*>(&tuple), key);
+  key[key_len_] = all_keys_normalized_ && !went_over;
+}
+
 // Insert if either not at the limit or it's a new TopN tuple_row
 void TopNNode::InsertTupleRow(TupleRow* input_row) {
-  Tuple* insert_tuple = NULL;
+  HeapEntry insert_entry;
+  insert_entry.tuple = NULL;
 
   if (priority_queue_->size() < limit_ + offset_) {
-    insert_tuple = reinterpret_cast<Tuple*>(
+    insert_entry.tuple = reinterpret_cast<Tuple*>(
         tuple_pool_->Allocate(materialized_tuple_desc_->byte_size()));
-    insert_tuple->MaterializeExprs<false, false>(input_row, *materialized_tuple_desc_,
-        sort_exec_exprs_.sort_tuple_slot_expr_ctxs(), tuple_pool_.get());
+    insert_entry.tuple->MaterializeExprs<false, false>(input_row,
+        *materialized_tuple_desc_, sort_exec_exprs_.sort_tuple_slot_expr_ctxs(),
+        tuple_pool_.get());
+    insert_entry.key = NULL;
+    if (key_normalizer_.get() != NULL) {
+      insert_entry.key = tuple_pool_->Allocate(key_len_ + 1);
+      NormalizeKey(insert_entry.tuple, insert_entry.key);
+    }
   } else {
     DCHECK(!priority_queue_->empty());
-    Tuple* top_tuple = priority_queue_->top();
+    const HeapEntry& top_entry = priority_queue_->top();
     tmp_tuple_->MaterializeExprs<false, true>(input_row, *materialized_tuple_desc_,
         sort_exec_exprs_.sort_tuple_slot_expr_ctxs(), NULL);
-    if (tuple_row_less_than_->Less(tmp_tuple_, top_tuple)) {
+    if (key_normalizer_.get() != NULL) NormalizeKey(tmp_tuple_, tmp_key_);
+    if (Less(tmp_tuple_, tmp_key_, top_entry.tuple, top_entry.key)) {
       // TODO: DeepCopy() will allocate new buffers for the string data. This needs
       // to be fixed to use a freelist
-      tmp_tuple_->DeepCopy(top_tuple, *materialized_tuple_desc_, tuple_pool_.get());
-      insert_tuple = top_tuple;
+      tmp_tuple_->DeepCopy(top_entry.tuple, *materialized_tuple_desc_,
+          tuple_pool_.get());
+      if (key_normalizer_.get() != NULL) {
+        memcpy(top_entry.key, tmp_key_, key_len_ + 1);
+      }
+      insert_entry = top_entry;
       priority_queue_->pop();
     }
   }
 
-  if (insert_tuple != NULL) priority_queue_->push(insert_tuple);
+  if (insert_entry.tuple != NULL) priority_queue_->push(insert_entry);
 }
@@ -22,9 +22,11 @@
 #include "runtime/mem-pool.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
+#include "runtime/sorter.h"
 #include "runtime/tuple.h"
 #include "runtime/tuple-row.h"
 #include "util/debug-util.h"
+#include "util/key-normalizer.h"
 #include "util/runtime-profile.h"
 
 #include "gen-cpp/Exprs_types.h"
@@ -32,6 +34,11 @@
 
 #include "common/names.h"
 
+DEFINE_int64(topn_max_heap_bytes, 256L * 1024L * 1024L, "(Advanced) Maximum memory in "
+    "bytes that the heap of a TopN node may use before its tuples are moved into a "
+    "sorter that can spill to disk.");
+DECLARE_int32(max_sort_normalized_key_len);
+
 using std::priority_queue;
 using namespace impala;
 using namespace llvm;
@@ -41,11 +48,20 @@ TopNNode::TopNNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl
     offset_(tnode.sort_node.__isset.offset ? tnode.sort_node.offset : 0),
     materialized_tuple_desc_(NULL),
     tuple_row_less_than_(NULL),
+    all_keys_normalized_(false),
+    key_len_(0),
     tmp_tuple_(NULL),
+    tmp_key_(NULL),
     tuple_pool_(NULL),
     codegend_insert_batch_fn_(NULL),
+    rows_discarded_counter_(NULL),
     num_rows_skipped_(0),
-    priority_queue_(NULL) {
+    priority_queue_(NULL),
+    bound_tuple_(NULL),
+    bound_key_(NULL) {
+}
+
+TopNNode::~TopNNode() {
 }
 
 Status TopNNode::Init(const TPlanNode& tnode, RuntimeState* state) {
@@ -95,6 +111,7 @@ Status TopNNode::Codegen(RuntimeState* state) {
 
 Status TopNNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Prepare(state));
   tuple_pool_.reset(new MemPool(mem_tracker()));
   materialized_tuple_desc_ = row_descriptor_.tuple_descriptors()[0];
@@ -112,23 +129,30 @@ Status TopNNode::Prepare(RuntimeState* state) {
     codegen_enabled = codegen_status.ok();
   }
   AddCodegenExecOption(codegen_enabled, codegen_status);
-  priority_queue_.reset(new priority_queue<Tuple*, vector<Tuple*>,
-      ComparatorWrapper<TupleRowComparator> >(*tuple_row_less_than_));
+  key_normalizer_.reset(KeyNormalizer::Create(*tuple_row_less_than_,
+      FLAGS_max_sort_normalized_key_len, &all_keys_normalized_));
+  if (key_normalizer_.get() != NULL) key_len_ = key_normalizer_->key_len();
+  priority_queue_.reset(new priority_queue<HeapEntry, vector<HeapEntry>,
+      HeapEntryLess>(HeapEntryLess(this)));
+  bound_pool_.reset(new MemPool(mem_tracker()));
   materialized_tuple_desc_ = row_descriptor_.tuple_descriptors()[0];
   insert_batch_timer_ = ADD_TIMER(runtime_profile(), "InsertBatchTime");
+  rows_discarded_counter_ = ADD_COUNTER(runtime_profile(), "RowsDiscarded", TUnit::UNIT);
   return Status::OK();
 }
 
 Status TopNNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
   RETURN_IF_ERROR(sort_exec_exprs_.Open(state));
 
-  // Allocate memory for a temporary tuple.
+  // Allocate memory for a temporary tuple and its normalized key.
   tmp_tuple_ = reinterpret_cast<Tuple*>(
       tuple_pool_->Allocate(materialized_tuple_desc_->byte_size()));
+  tmp_key_ = tuple_pool_->Allocate(key_len_ + 1);
 
   RETURN_IF_ERROR(child(0)->Open(state));
 
@@ -139,20 +163,31 @@ Status TopNNode::Open(RuntimeState* state) {
     do {
       batch.Reset();
       RETURN_IF_ERROR(child(0)->GetNext(state, &batch, &eos));
-      {
-        SCOPED_TIMER(insert_batch_timer_);
-        if (codegend_insert_batch_fn_ != NULL) {
-          codegend_insert_batch_fn_(this, &batch);
-        } else {
-          InsertBatch(&batch);
+      if (sorter_.get() != NULL) {
+        RETURN_IF_ERROR(AddBatchToSorter(&batch));
+      } else {
+        {
+          SCOPED_TIMER(insert_batch_timer_);
+          if (codegend_insert_batch_fn_ != NULL) {
+            codegend_insert_batch_fn_(this, &batch);
+          } else {
+            InsertBatch(&batch);
+          }
+        }
+        if (tuple_pool_->total_allocated_bytes() > FLAGS_topn_max_heap_bytes) {
+          RETURN_IF_ERROR(SpillHeap(state));
         }
       }
       RETURN_IF_CANCELLED(state);
       RETURN_IF_ERROR(QueryMaintenance(state));
     } while (!eos);
   }
-  DCHECK_LE(priority_queue_->size(), limit_ + offset_);
-  PrepareForOutput();
+  if (sorter_.get() != NULL) {
+    RETURN_IF_ERROR(sorter_->InputDone());
+  } else {
+    DCHECK_LE(priority_queue_->size(), limit_ + offset_);
+    PrepareForOutput();
+  }
 
   // Unless we are inside a subplan expecting to call Open()/GetNext() on the child
   // again, the child can be closed at this point.
@@ -162,9 +197,11 @@ Status TopNNode::Open(RuntimeState* state) {
 
 Status TopNNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
+  if (sorter_.get() != NULL) return GetNextFromSorter(row_batch, eos);
   while (!row_batch->AtCapacity() && (get_next_iter_ != sorted_top_n_.end())) {
     if (num_rows_skipped_ < offset_) {
       ++get_next_iter_;
@@ -191,9 +228,102 @@ Status TopNNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   return Status::OK();
 }
 
+Status TopNNode::GetNextFromSorter(RowBatch* row_batch, bool* eos) {
+  if (ReachedLimit()) {
+    *eos = true;
+    return Status::OK();
+  }
+  DCHECK_EQ(row_batch->num_rows(), 0);
+  RETURN_IF_ERROR(sorter_->GetNext(row_batch, eos));
+  while (num_rows_skipped_ < offset_) {
+    num_rows_skipped_ += row_batch->num_rows();
+    // Throw away rows in the output batch until the offset is skipped.
+    int rows_to_keep = num_rows_skipped_ - offset_;
+    if (rows_to_keep > 0) {
+      row_batch->CopyRows(0, row_batch->num_rows() - rows_to_keep, rows_to_keep);
+      row_batch->set_num_rows(rows_to_keep);
+    } else {
+      row_batch->set_num_rows(0);
+    }
+    if (rows_to_keep > 0 || *eos) break;
+    RETURN_IF_ERROR(sorter_->GetNext(row_batch, eos));
+  }
+
+  num_rows_returned_ += row_batch->num_rows();
+  if (ReachedLimit()) {
+    row_batch->set_num_rows(row_batch->num_rows() - (num_rows_returned_ - limit_));
+    *eos = true;
+  }
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+  return Status::OK();
+}
+
+Status TopNNode::SpillHeap(RuntimeState* state) {
+  DCHECK(sorter_.get() == NULL);
+  sorter_.reset(new Sorter(*tuple_row_less_than_,
+      sort_exec_exprs_.sort_tuple_slot_expr_ctxs(), &row_descriptor_, mem_tracker(),
+      runtime_profile(), state));
+  RETURN_IF_ERROR(sorter_->Init());
+
+  // The top of a full heap is the last tuple of the TopN so far. Later rows only need
+  // to be sorted if they come before it.
+  if (priority_queue_->size() == limit_ + offset_) {
+    const HeapEntry& top_entry = priority_queue_->top();
+    bound_tuple_ = top_entry.tuple->DeepCopy(*materialized_tuple_desc_,
+        bound_pool_.get());
+    if (key_normalizer_.get() != NULL) {
+      bound_key_ = bound_pool_->Allocate(key_len_ + 1);
+      memcpy(bound_key_, top_entry.key, key_len_ + 1);
+    }
+  }
+
+  RowBatch batch(row_descriptor_, state->batch_size(), mem_tracker());
+  while (!priority_queue_->empty()) {
+    int row_idx = batch.AddRow();
+    batch.GetRow(row_idx)->SetTuple(0, priority_queue_->top().tuple);
+    batch.CommitLastRow();
+    priority_queue_->pop();
+    if (batch.AtCapacity() || priority_queue_->empty()) {
+      RETURN_IF_ERROR(sorter_->AddMaterializedBatch(&batch));
+      batch.Reset();
+    }
+  }
+
+  // The sorter copied the tuples, so the memory of the heap can be reused.
+  tuple_pool_->FreeAll();
+  tmp_tuple_ = reinterpret_cast<Tuple*>(
+      tuple_pool_->Allocate(materialized_tuple_desc_->byte_size()));
+  tmp_key_ = tuple_pool_->Allocate(key_len_ + 1);
+  return Status::OK();
+}
+
+Status TopNNode::AddBatchToSorter(RowBatch* batch) {
+  if (bound_tuple_ != NULL) {
+    SCOPED_TIMER(insert_batch_timer_);
+    // Compact the rows that sort before bound_tuple_ at the start of the batch.
+    int num_rows = 0;
+    for (int i = 0; i < batch->num_rows(); ++i) {
+      TupleRow* row = batch->GetRow(i);
+      tmp_tuple_->MaterializeExprs<false, true>(row, *materialized_tuple_desc_,
+          sort_exec_exprs_.sort_tuple_slot_expr_ctxs(), NULL);
+      if (key_normalizer_.get() != NULL) NormalizeKey(tmp_tuple_, tmp_key_);
+      if (!Less(tmp_tuple_, tmp_key_, bound_tuple_, bound_key_)) continue;
+      if (num_rows != i) batch->CopyRow(row, batch->GetRow(num_rows));
+      ++num_rows;
+    }
+    COUNTER_ADD(rows_discarded_counter_, batch->num_rows() - num_rows);
+    batch->set_num_rows(num_rows);
+  }
+  return sorter_->AddBatch(batch);
+}
+
 Status TopNNode::Reset(RuntimeState* state) {
   while(!priority_queue_->empty()) priority_queue_->pop();
   num_rows_skipped_ = 0;
+  sorter_.reset();
+  bound_tuple_ = NULL;
+  bound_key_ = NULL;
+  bound_pool_->FreeAll();
   // We deliberately do not free the tuple_pool_ here to allow selective transferring
   // of resources in the future.
   return ExecNode::Reset(state);
@@ -202,6 +332,8 @@ Status TopNNode::Reset(RuntimeState* state) {
 void TopNNode::Close(RuntimeState* state) {
   if (is_closed()) return;
   if (tuple_pool_.get() != NULL) tuple_pool_->FreeAll();
+  if (bound_pool_.get() != NULL) bound_pool_->FreeAll();
+  sorter_.reset();
   sort_exec_exprs_.Close(state);
   ExecNode::Close(state);
 }
@@ -212,7 +344,7 @@ void TopNNode::PrepareForOutput() {
   int index = sorted_top_n_.size() - 1;
 
   while (priority_queue_->size() > 0) {
-    Tuple* tuple = priority_queue_->top();
+    Tuple* tuple = priority_queue_->top().tuple;
     priority_queue_->pop();
     sorted_top_n_[index] = tuple;
     --index;
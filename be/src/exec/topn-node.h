@@ -27,18 +27,27 @@
 
 namespace impala {
 
+class KeyNormalizer;
 class MemPool;
 class RuntimeState;
+class Sorter;
 class Tuple;
 
-/// Node for in-memory TopN (ORDER BY ... LIMIT)
-/// This handles the case where the result fits in memory.
+/// Node for TopN (ORDER BY ... LIMIT)
 /// This node will materialize its input rows into a new tuple using the expressions
 /// in sort_tuple_slot_exprs_ in its sort_exec_exprs_ member.
-/// TopN is implemented by storing rows in a priority queue.
+/// TopN is implemented by storing rows in a priority queue. The heap entries carry a
+/// normalized key of their tuple (see KeyNormalizer) if the sort exprs allow it, so
+/// that most comparisons are a memcmp() of the keys.
+/// If the memory used by the heap grows beyond --topn_max_heap_bytes, e.g. for large
+/// LIMITs with wide rows, the heap's tuples are moved into a Sorter, which can spill,
+/// and the remaining input is sorted with them. The last tuple of a full heap bounds
+/// the sort: input rows that do not sort before it cannot be in the TopN and are
+/// discarded.
 class TopNNode : public ExecNode {
  public:
   TopNNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
+  virtual ~TopNNode();
 
   virtual Status Init(const TPlanNode& tnode, RuntimeState* state);
   virtual Status Prepare(RuntimeState* state);
@@ -54,6 +63,43 @@ class TopNNode : public ExecNode {
 
   friend class TupleLessThan;
 
+  /// Entry of priority_queue_. 'key' points to the normalized key of 'tuple', followed
+  /// by a byte that is 1 if the key is complete, i.e. equal keys mean equal tuples.
+  /// 'key' is NULL if the sort exprs cannot be normalized.
+  struct HeapEntry {
+    Tuple* tuple;
+    uint8_t* key;
+  };
+
+  /// Less-than comparator of heap entries, for priority_queue_.
+  class HeapEntryLess {
+   public:
+    HeapEntryLess(const TopNNode* node) : node_(node) {}
+
+    bool operator()(const HeapEntry& lhs, const HeapEntry& rhs) const {
+      return node_->Less(lhs.tuple, lhs.key, rhs.tuple, rhs.key);
+    }
+
+   private:
+    const TopNNode* node_;
+  };
+
+  /// Returns true if tuple 'lhs' with normalized key 'lhs_key' sorts before tuple 'rhs'
+  /// with normalized key 'rhs_key'. Only evaluates the sort exprs if the keys are equal
+  /// but not complete.
+  bool Less(Tuple* lhs, const uint8_t* lhs_key, Tuple* rhs,
+      const uint8_t* rhs_key) const {
+    if (key_normalizer_.get() != NULL) {
+      int result = memcmp(lhs_key, rhs_key, key_len_);
+      if (result != 0) return result < 0;
+      if (lhs_key[key_len_] && rhs_key[key_len_]) return false;
+    }
+    return tuple_row_less_than_->Less(lhs, rhs);
+  }
+
+  /// Writes the normalized key of 'tuple' and its completeness byte to 'key'.
+  void NormalizeKey(Tuple* tuple, uint8_t* key);
+
   /// Creates a codegen'd version of InsertBatch() that is used in Open().
   Status Codegen(RuntimeState* state);
 
@@ -67,6 +113,17 @@ class TopNNode : public ExecNode {
   /// Flatten and reverse the priority queue.
   void PrepareForOutput();
 
+  /// Moves the tuples in priority_queue_ into a newly created sorter_ and frees
+  /// tuple_pool_. If the queue is full, its top tuple is copied to bound_tuple_.
+  Status SpillHeap(RuntimeState* state);
+
+  /// Adds the rows in 'batch' to sorter_, after discarding the rows that do not sort
+  /// before bound_tuple_. Modifies 'batch'.
+  Status AddBatchToSorter(RowBatch* batch);
+
+  /// GetNext() once the heap has been moved into sorter_.
+  Status GetNextFromSorter(RowBatch* row_batch, bool* eos);
+
   /// Number of rows to skip.
   int64_t offset_;
 
@@ -82,6 +139,16 @@ class TopNNode : public ExecNode {
   /// Comparator for priority_queue_.
   boost::scoped_ptr<TupleRowComparator> tuple_row_less_than_;
 
+  /// Normalizes the sort keys of materialized tuples. NULL if the first sort expr
+  /// cannot be normalized.
+  boost::scoped_ptr<KeyNormalizer> key_normalizer_;
+
+  /// True if key_normalizer_ normalizes all sort exprs.
+  bool all_keys_normalized_;
+
+  /// Length of the normalized keys, without the completeness byte.
+  int key_len_;
+
   /// After computing the TopN in the priority_queue, pop them and put them in this vector
   std::vector<Tuple*> sorted_top_n_;
 
@@ -90,6 +157,9 @@ class TopNNode : public ExecNode {
   /// copied into the tuple pool and inserted into the priority queue.
   Tuple* tmp_tuple_;
 
+  /// Normalized key of tmp_tuple_, allocated from tuple_pool_ together with it.
+  uint8_t* tmp_key_;
+
   /// Stores everything referenced in priority_queue_.
   boost::scoped_ptr<MemPool> tuple_pool_;
 
@@ -102,6 +172,9 @@ class TopNNode : public ExecNode {
   /// Timer for time spent in InsertBatch() function (or codegen'd version)
   RuntimeProfile::Counter* insert_batch_timer_;
 
+  /// Number of input rows discarded because they did not sort before bound_tuple_.
+  RuntimeProfile::Counter* rows_discarded_counter_;
+
   /////////////////////////////////////////
   /// BEGIN: Members that must be Reset()
 
@@ -112,8 +185,17 @@ class TopNNode : public ExecNode {
   /// The stl priority queue doesn't support a max size, so to get that functionality,
   /// the order of the queue is the opposite of what the ORDER BY clause specifies, such
   /// that the top of the queue is the last sorted element.
-  boost::scoped_ptr<std::priority_queue<Tuple*, std::vector<Tuple*>,
-      ComparatorWrapper<TupleRowComparator> > > priority_queue_;
+  boost::scoped_ptr<std::priority_queue<HeapEntry, std::vector<HeapEntry>,
+      HeapEntryLess> > priority_queue_;
+
+  /// Sorts the input once the heap grew too large. NULL while the heap is used.
+  boost::scoped_ptr<Sorter> sorter_;
+
+  /// Copy of the last tuple of the TopN when the heap was moved into sorter_, and its
+  /// normalized key. Allocated from bound_pool_. NULL if the heap was not full.
+  Tuple* bound_tuple_;
+  uint8_t* bound_key_;
+  boost::scoped_ptr<MemPool> bound_pool_;
 
   /// END: Members that must be Reset()
   /////////////////////////////////////////
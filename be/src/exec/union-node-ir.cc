@@ -0,0 +1,61 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exec/union-node.h"
+
+#include "runtime/row-batch.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+void UnionNode::MaterializeBatch(RowBatch* row_batch, uint8_t** tuple_buf) {
+  // Take all references to member variables out of the loop to reduce the number of
+  // loads and stores.
+  const vector<ExprContext*>& ctxs = result_expr_ctx_lists_[child_idx_];
+  ExprContext* const* conjunct_ctxs = conjunct_ctxs_.data();
+  int num_conjunct_ctxs = conjunct_ctxs_.size();
+  const TupleDescriptor& tuple_desc = *tuple_desc_;
+  int tuple_byte_size = tuple_desc.byte_size();
+  MemPool* tuple_pool = tuple_pool_.get();
+  RowBatch* child_batch = child_row_batch_.get();
+  int num_child_rows = child_batch->num_rows();
+  int child_row_idx = child_row_idx_;
+  uint8_t* cur_tuple = *tuple_buf;
+
+  int start_row_idx = row_batch->num_rows();
+  int end_row_idx = row_batch->capacity();
+  if (limit_ != -1) {
+    end_row_idx = min<int64_t>(end_row_idx, start_row_idx + limit_ - num_rows_returned_);
+  }
+  int dst_row_idx = start_row_idx;
+  while (child_row_idx < num_child_rows && dst_row_idx < end_row_idx) {
+    TupleRow* child_row = child_batch->GetRow(child_row_idx++);
+    Tuple* dst_tuple = reinterpret_cast<Tuple*>(cur_tuple);
+    dst_tuple->MaterializeExprs<false, false>(child_row, tuple_desc, ctxs, tuple_pool);
+    TupleRow* dst_row = row_batch->GetRow(dst_row_idx);
+    dst_row->SetTuple(0, dst_tuple);
+    // The tuple of a filtered row is overwritten by the next one.
+    if (!EvalConjuncts(conjunct_ctxs, num_conjunct_ctxs, dst_row)) continue;
+    cur_tuple += tuple_byte_size;
+    ++dst_row_idx;
+  }
+
+  child_row_idx_ = child_row_idx;
+  row_batch->CommitRows(dst_row_idx - start_row_idx);
+  num_rows_returned_ += dst_row_idx - start_row_idx;
+  *tuple_buf = cur_tuple;
+}
@@ -13,15 +13,25 @@
 // limitations under the License.
 
 #include "exec/union-node.h"
+
+#include <gutil/strings/substitute.h>
+
+#include "codegen/llvm-codegen.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
+#include "exprs/slot-ref.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/raw-value.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
 #include "gen-cpp/PlanNodes_types.h"
 
 #include "common/names.h"
 
+using namespace llvm;
+using namespace strings;
+
 namespace impala {
 
 UnionNode::UnionNode(ObjectPool* pool, const TPlanNode& tnode,
@@ -58,6 +68,7 @@ Status UnionNode::Init(const TPlanNode& tnode, RuntimeState* state) {
 
 Status UnionNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Prepare(state));
   tuple_desc_ = state->desc_tbl().GetTupleDescriptor(tuple_id_);
   DCHECK(tuple_desc_ != NULL);
@@ -77,11 +88,91 @@ Status UnionNode::Prepare(RuntimeState* state) {
     AddExprCtxsToFree(result_expr_ctx_lists_[i]);
     DCHECK_EQ(result_expr_ctx_lists_[i].size(), tuple_desc_->slots().size());
   }
+
+  tuple_pool_.reset(new MemPool(mem_tracker()));
+  int num_passthrough_children = 0;
+  for (int i = 0; i < result_expr_ctx_lists_.size(); ++i) {
+    is_child_passthrough_.push_back(IsChildPassthrough(state, i));
+    num_passthrough_children += is_child_passthrough_.back();
+  }
+  if (num_passthrough_children > 0) {
+    AddRuntimeExecOption(Substitute("$0 of $1 Children Passed Through",
+        num_passthrough_children, children_.size()));
+  }
+
+  codegend_materialize_batch_fns_.resize(result_expr_ctx_lists_.size(), NULL);
+  if (state->codegen_enabled() && num_passthrough_children < children_.size()) {
+    Status codegen_status = Codegen(state);
+    AddCodegenExecOption(codegen_status.ok(), codegen_status);
+  }
+  return Status::OK();
+}
+
+bool UnionNode::IsChildPassthrough(RuntimeState* state, int child_idx) const {
+  if (!conjunct_ctxs_.empty()) return false;
+  const RowDescriptor& child_row_desc = child(child_idx)->row_desc();
+  if (child_row_desc.tuple_descriptors().size() != 1) return false;
+  if (child_row_desc.TupleIsNullable(0)) return false;
+  const TupleDescriptor* child_tuple_desc = child_row_desc.tuple_descriptors()[0];
+  if (child_tuple_desc->byte_size() != tuple_desc_->byte_size()) return false;
+  if (child_tuple_desc->slots().size() != tuple_desc_->slots().size()) return false;
+  // The slots of the output tuple are distinct, so if each slot is copied from the slot
+  // at the same offset of the child tuple, which has as many slots, the layouts match.
+  const vector<ExprContext*>& ctxs = result_expr_ctx_lists_[child_idx];
+  for (int i = 0; i < ctxs.size(); ++i) {
+    if (!ctxs[i]->root()->is_slotref()) return false;
+    const SlotDescriptor* src_slot_desc = state->desc_tbl().GetSlotDescriptor(
+        static_cast<SlotRef*>(ctxs[i]->root())->slot_id());
+    const SlotDescriptor* dst_slot_desc = tuple_desc_->slots()[i];
+    if (src_slot_desc == NULL || src_slot_desc->parent() != child_tuple_desc) {
+      return false;
+    }
+    if (src_slot_desc->tuple_offset() != dst_slot_desc->tuple_offset()) return false;
+    if (!src_slot_desc->null_indicator_offset().Equals(
+        dst_slot_desc->null_indicator_offset())) {
+      return false;
+    }
+    if (src_slot_desc->type() != dst_slot_desc->type()) return false;
+  }
+  return true;
+}
+
+Status UnionNode::Codegen(RuntimeState* state) {
+  LlvmCodeGen* codegen;
+  RETURN_IF_ERROR(state->GetCodegen(&codegen));
+  SCOPED_TIMER(codegen->codegen_timer());
+  Function* eval_conjuncts_fn;
+  RETURN_IF_ERROR(CodegenEvalConjuncts(state, conjunct_ctxs_, &eval_conjuncts_fn));
+
+  for (int i = 0; i < result_expr_ctx_lists_.size(); ++i) {
+    if (is_child_passthrough_[i]) continue;
+    Function* materialize_batch_fn =
+        codegen->GetFunction(IRFunction::UNION_NODE_MATERIALIZE_BATCH, true);
+    DCHECK(materialize_batch_fn != NULL);
+    Function* materialize_exprs_fn;
+    RETURN_IF_ERROR(Tuple::CodegenMaterializeExprs(state, false, *tuple_desc_,
+        result_expr_ctx_lists_[i], tuple_pool_.get(), &materialize_exprs_fn));
+    int replaced = codegen->ReplaceCallSites(materialize_batch_fn, materialize_exprs_fn,
+        Tuple::MATERIALIZE_EXPRS_SYMBOL);
+    DCHECK_EQ(replaced, 1) << LlvmCodeGen::Print(materialize_batch_fn);
+    replaced = codegen->ReplaceCallSites(materialize_batch_fn, eval_conjuncts_fn,
+        "EvalConjuncts");
+    DCHECK_EQ(replaced, 1) << LlvmCodeGen::Print(materialize_batch_fn);
+
+    materialize_batch_fn = codegen->FinalizeFunction(materialize_batch_fn);
+    if (materialize_batch_fn == NULL) {
+      return Status("UnionNode::Codegen(): codegen'd MaterializeBatch() function "
+          "failed verification, see log");
+    }
+    codegen->AddFunctionToJit(materialize_batch_fn,
+        reinterpret_cast<void**>(&codegend_materialize_batch_fns_[i]));
+  }
   return Status::OK();
 }
 
 Status UnionNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   // Open const expr lists.
   for (int i = 0; i < const_result_expr_ctx_lists_.size(); ++i) {
@@ -113,6 +204,7 @@ Status UnionNode::OpenCurrentChild(RuntimeState* state) {
 
 Status UnionNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -134,9 +226,27 @@ Status UnionNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
       RETURN_IF_CANCELLED(state);
       RETURN_IF_ERROR(QueryMaintenance(state));
 
-      // Continue materializing exprs on child_row_batch_ into row batch.
-      RETURN_IF_ERROR(EvalAndMaterializeExprs(result_expr_ctx_lists_[child_idx_], false,
-          &tuple, row_batch));
+      // Continue passing through or materializing the rows of child_row_batch_ into
+      // row batch.
+      if (is_child_passthrough_[child_idx_]) {
+        PassThroughRows(row_batch);
+      } else {
+        uint8_t* tuple_buf = reinterpret_cast<uint8_t*>(tuple);
+        MaterializeBatchFn materialize_batch_fn =
+            codegend_materialize_batch_fns_[child_idx_];
+        if (materialize_batch_fn != NULL) {
+          materialize_batch_fn(this, row_batch, &tuple_buf);
+        } else {
+          MaterializeBatch(row_batch, &tuple_buf);
+        }
+        tuple = reinterpret_cast<Tuple*>(tuple_buf);
+        COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+        row_batch->tuple_data_pool()->AcquireData(tuple_pool_.get(), false);
+        const vector<ExprContext*>& ctxs = result_expr_ctx_lists_[child_idx_];
+        for (int i = 0; i < ctxs.size(); ++i) {
+          RETURN_IF_ERROR(ctxs[i]->root()->GetFnContextError(ctxs[i]));
+        }
+      }
       if (row_batch->AtCapacity() || ReachedLimit()) {
         *eos = ReachedLimit();
         return Status::OK();
@@ -168,9 +278,8 @@ Status UnionNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
     // Only evaluate the const expr lists by the first fragment instance.
     if (state->fragment_ctx().per_fragment_instance_idx == 0) {
       // Materialize expr results into row_batch.
-      RETURN_IF_ERROR(EvalAndMaterializeExprs(
-          const_result_expr_ctx_lists_[const_result_expr_idx_], true, &tuple,
-          row_batch));
+      RETURN_IF_ERROR(MaterializeConstExprs(
+          const_result_expr_ctx_lists_[const_result_expr_idx_], &tuple, row_batch));
     }
     ++const_result_expr_idx_;
     *eos = ReachedLimit();
@@ -193,6 +302,7 @@ Status UnionNode::Reset(RuntimeState* state) {
 void UnionNode::Close(RuntimeState* state) {
   if (is_closed()) return;
   child_row_batch_.reset();
+  if (tuple_pool_.get() != NULL) tuple_pool_->FreeAll();
   for (int i = 0; i < const_result_expr_ctx_lists_.size(); ++i) {
     Expr::Close(const_result_expr_ctx_lists_[i], state);
   }
@@ -202,57 +312,59 @@ void UnionNode::Close(RuntimeState* state) {
   ExecNode::Close(state);
 }
 
-Status UnionNode::EvalAndMaterializeExprs(const vector<ExprContext*>& ctxs,
-    bool const_exprs, Tuple** tuple, RowBatch* row_batch) {
-  // Make sure there are rows left in the batch.
-  if (!const_exprs && child_row_idx_ >= child_row_batch_->num_rows()) {
-    return Status::OK();
+void UnionNode::PassThroughRows(RowBatch* row_batch) {
+  int num_rows = min(child_row_batch_->num_rows() - child_row_idx_,
+      row_batch->capacity() - row_batch->num_rows());
+  if (limit_ != -1) num_rows = min<int64_t>(num_rows, limit_ - num_rows_returned_);
+  int dst_row_idx = row_batch->AddRows(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    TupleRow* child_row = child_row_batch_->GetRow(child_row_idx_ + i);
+    row_batch->GetRow(dst_row_idx + i)->SetTuple(0, child_row->GetTuple(0));
+  }
+  row_batch->CommitRows(num_rows);
+  child_row_idx_ += num_rows;
+  num_rows_returned_ += num_rows;
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+  // The passed through rows point into the child batch, so its resources go with the
+  // output batch that has its last row, or the last one before the limit.
+  if (child_row_idx_ == child_row_batch_->num_rows() || ReachedLimit()) {
+    child_row_batch_->TransferResourceOwnership(row_batch);
+    child_row_idx_ = 0;
   }
-  // Execute the body at least once.
-  bool done = true;
+}
+
+Status UnionNode::MaterializeConstExprs(const vector<ExprContext*>& ctxs,
+    Tuple** tuple, RowBatch* row_batch) {
   ExprContext* const* conjunct_ctxs = &conjunct_ctxs_[0];
   int num_conjunct_ctxs = conjunct_ctxs_.size();
 
-  do {
-    TupleRow* child_row = NULL;
-    if (!const_exprs) {
-      DCHECK(child_row_batch_ != NULL);
-      // Non-const expr list. Fetch next row from batch.
-      child_row = child_row_batch_->GetRow(child_row_idx_);
-      ++child_row_idx_;
-      done = child_row_idx_ >= child_row_batch_->num_rows();
-    }
-
-    // Add a new row to the batch.
-    int row_idx = row_batch->AddRow();
-    TupleRow* row = row_batch->GetRow(row_idx);
-    row->SetTuple(0, *tuple);
-
-    // Materialize expr results into tuple.
-    DCHECK_EQ(ctxs.size(), tuple_desc_->slots().size());
-    for (int i = 0; i < ctxs.size(); ++i) {
-      // our exprs correspond to materialized slots
-      SlotDescriptor* slot_desc = tuple_desc_->slots()[i];
-      const void* value = ctxs[i]->GetValue(child_row);
-      RETURN_IF_ERROR(ctxs[i]->root()->GetFnContextError(ctxs[i]));
-      RawValue::Write(value, *tuple, slot_desc, row_batch->tuple_data_pool());
-    }
+  // Add a new row to the batch.
+  int row_idx = row_batch->AddRow();
+  TupleRow* row = row_batch->GetRow(row_idx);
+  row->SetTuple(0, *tuple);
 
-    if (EvalConjuncts(conjunct_ctxs, num_conjunct_ctxs, row)) {
-      row_batch->CommitLastRow();
-      ++num_rows_returned_;
-      COUNTER_SET(rows_returned_counter_, num_rows_returned_);
-      char* new_tuple = reinterpret_cast<char*>(*tuple);
-      new_tuple += tuple_desc_->byte_size();
-      *tuple = reinterpret_cast<Tuple*>(new_tuple);
-    } else {
-      // Make sure to reset null indicators since we're overwriting
-      // the tuple assembled for the previous row.
-      (*tuple)->Init(tuple_desc_->byte_size());
-    }
-    if (row_batch->AtCapacity() || ReachedLimit()) return Status::OK();
-  } while (!done);
+  // Materialize expr results into tuple.
+  DCHECK_EQ(ctxs.size(), tuple_desc_->slots().size());
+  for (int i = 0; i < ctxs.size(); ++i) {
+    // our exprs correspond to materialized slots
+    SlotDescriptor* slot_desc = tuple_desc_->slots()[i];
+    const void* value = ctxs[i]->GetValue(NULL);
+    RETURN_IF_ERROR(ctxs[i]->root()->GetFnContextError(ctxs[i]));
+    RawValue::Write(value, *tuple, slot_desc, row_batch->tuple_data_pool());
+  }
 
+  if (EvalConjuncts(conjunct_ctxs, num_conjunct_ctxs, row)) {
+    row_batch->CommitLastRow();
+    ++num_rows_returned_;
+    COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+    char* new_tuple = reinterpret_cast<char*>(*tuple);
+    new_tuple += tuple_desc_->byte_size();
+    *tuple = reinterpret_cast<Tuple*>(new_tuple);
+  } else {
+    // Make sure to reset null indicators since we're overwriting
+    // the tuple assembled for the previous row.
+    (*tuple)->Init(tuple_desc_->byte_size());
+  }
   return Status::OK();
 }
 
@@ -18,10 +18,10 @@
 
 #include <boost/scoped_ptr.hpp>
 
+#include "codegen/impala-ir.h"
 #include "exec/exec-node.h"
 #include "exprs/expr.h"
 #include "runtime/mem-pool.h"
-#include <boost/scoped_ptr.hpp>
 
 namespace impala {
 
@@ -32,6 +32,13 @@ class TupleRow;
 /// evaluated expressions into row batches. The UnionNode pulls row batches from its
 /// children sequentially, i.e., it exhausts one child completely before moving
 /// on to the next one.
+///
+/// A child whose rows already have the layout of the output tuple, i.e. whose result
+/// exprs only copy each slot of its single tuple to the same offset of the output tuple,
+/// is passed through: its tuples are forwarded without copying them and the resources
+/// of its batches are transferred to the output batches. This is the common case of
+/// UNION ALL over tables with the same schema. The rows of the other children are
+/// materialized by MaterializeBatch(), which is codegen'd per child.
 class UnionNode : public ExecNode {
  public:
   UnionNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
@@ -50,6 +57,18 @@ class UnionNode : public ExecNode {
   /// Descriptor for tuples this union node constructs.
   const TupleDescriptor* tuple_desc_;
 
+  /// True for the children whose rows are passed through, see IsChildPassthrough().
+  std::vector<bool> is_child_passthrough_;
+
+  /// Holds the var-len data of the tuples materialized in the current GetNext() call,
+  /// which is transferred to the output batch at the end of the call. Codegen'd
+  /// functions refer to this pool directly, so it lives as long as the node.
+  boost::scoped_ptr<MemPool> tuple_pool_;
+
+  /// Codegen'd MaterializeBatch() of each child, or NULL if it is not codegen'd.
+  typedef void (*MaterializeBatchFn)(UnionNode*, RowBatch*, uint8_t**);
+  std::vector<MaterializeBatchFn> codegend_materialize_batch_fns_;
+
   /// Const exprs materialized by this node. These exprs don't refer to any children.
   std::vector<std::vector<ExprContext*> > const_result_expr_ctx_lists_;
 
@@ -82,15 +101,33 @@ class UnionNode : public ExecNode {
   /// and sets child_row_idx_ to 0. May set child_eos_.
   Status OpenCurrentChild(RuntimeState* state);
 
-  /// Evaluates exprs on all rows in child_row_batch_ starting from child_row_idx_,
-  /// and materializes their results into *tuple.
-  /// Adds *tuple into row_batch, and increments *tuple.
-  /// If const_exprs is true, then the exprs are evaluated exactly once without
-  /// fetching rows from child_row_batch_.
-  /// Only commits tuples to row_batch if they are not filtered by conjuncts.
-  /// Returns an error status if evaluating an expression results in one.
-  Status EvalAndMaterializeExprs(const std::vector<ExprContext*>& ctxs,
-      bool const_exprs, Tuple** tuple, RowBatch* row_batch);
+  /// Returns true if the rows of child 'child_idx' can be passed through: the union has
+  /// no conjuncts, the child's rows have a single non-nullable tuple with the layout of
+  /// tuple_desc_, and each result expr is a slot ref to the slot of that tuple at the
+  /// offset of the corresponding output slot.
+  bool IsChildPassthrough(RuntimeState* state, int child_idx) const;
+
+  /// Codegens MaterializeBatch() for each child that is not passed through.
+  Status Codegen(RuntimeState* state);
+
+  /// Adds the rows of child_row_batch_ starting from child_row_idx_ to 'row_batch'
+  /// until either is exhausted or the limit is reached, copying only the tuple
+  /// pointers. Transfers the resources of child_row_batch_ to 'row_batch' once all its
+  /// rows have been added.
+  void PassThroughRows(RowBatch* row_batch);
+
+  /// Materializes the rows of child_row_batch_ starting from child_row_idx_ into
+  /// 'row_batch' with the result exprs of the current child, until either batch is
+  /// exhausted or the limit is reached. The tuples are written to '*tuple_buf', which
+  /// is advanced past the tuples of the rows that pass the conjuncts. Var-len data is
+  /// copied into tuple_pool_. Expr errors are checked by the caller.
+  void MaterializeBatch(RowBatch* row_batch, uint8_t** tuple_buf);
+
+  /// Evaluates the const exprs 'ctxs' and materializes their results into *tuple.
+  /// Adds *tuple into row_batch, and increments *tuple, unless the row is filtered by
+  /// the conjuncts. Returns an error status if evaluating an expression results in one.
+  Status MaterializeConstExprs(const std::vector<ExprContext*>& ctxs, Tuple** tuple,
+      RowBatch* row_batch);
 };
 
 }
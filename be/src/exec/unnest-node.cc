@@ -52,6 +52,7 @@ Status UnnestNode::Init(const TPlanNode& tnode, RuntimeState* state) {
 
 Status UnnestNode::Prepare(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   DCHECK(containing_subplan_ != NULL) << "set_containing_subplan() must be called";
   RETURN_IF_ERROR(ExecNode::Prepare(state));
 
@@ -85,11 +86,17 @@ Status UnnestNode::Prepare(RuntimeState* state) {
 
 Status UnnestNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_ERROR(coll_expr_ctx_->Open(state));
 
   DCHECK(containing_subplan_->current_row() != NULL);
-  Tuple* tuple = containing_subplan_->current_input_row_->GetTuple(coll_tuple_idx_);
+  InitCollection(containing_subplan_->current_row());
+  return Status::OK();
+}
+
+void UnnestNode::InitCollection(TupleRow* row) {
+  Tuple* tuple = row->GetTuple(coll_tuple_idx_);
   if (tuple != NULL) {
     // Retrieve the collection value to be unnested directly from the tuple. We purposely
     // ignore the null bit of the slot because we may have set it in a previous Open() of
@@ -102,6 +109,7 @@ Status UnnestNode::Open(RuntimeState* state) {
     coll_value_ = &EMPTY_COLLECTION_VALUE;
     DCHECK_EQ(coll_value_->num_tuples, 0);
   }
+  item_idx_ = 0;
 
   ++num_collections_;
   COUNTER_SET(num_collections_counter_, num_collections_);
@@ -116,11 +124,11 @@ Status UnnestNode::Open(RuntimeState* state) {
     min_collection_size_ = coll_value_->num_tuples;
     COUNTER_SET(min_collection_size_counter_, min_collection_size_);
   }
-  return Status::OK();
 }
 
 Status UnnestNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_EXEC_TIME_MEASUREMENT(exec_time_counters_);
   // Avoid expensive query maintenance overhead for small collections.
   if (item_idx_ > 0) {
     RETURN_IF_CANCELLED(state);
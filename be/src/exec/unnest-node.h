@@ -63,6 +63,10 @@ class UnnestNode : public ExecNode {
 
   static const CollectionValue EMPTY_COLLECTION_VALUE;
 
+  /// Sets coll_value_ to the collection of 'row', applying the projection (see class
+  /// comment), resets item_idx_ and updates the collection stats.
+  void InitCollection(TupleRow* row);
+
   /// Size of a collection item tuple in bytes. Set in Prepare().
   int item_byte_size_;
 
@@ -4,6 +4,7 @@
 #include <gtest/gtest.h>
 
 #include "experiments/string-search-sse.h"
+#include "runtime/string-search.h"
 
 #include "common/names.h"
 
@@ -56,6 +57,10 @@ void TestSearch(const char* haystack_orig, const char* needle_orig,
   StringSearchSSE needle2(&needle_str_val);
   int not_null_offset = needle2.Search(haystack_str_val);
   EXPECT_EQ(not_null_offset, libc_offset);
+
+  // StringSearch doesn't match an empty needle.
+  StringSearch needle3(&needle_str_val);
+  EXPECT_EQ(needle3.Search(&haystack_str_val), needle_len == 0 ? -1 : libc_offset);
   
   // Ensure haystack/needle are unmodified
   EXPECT_EQ(strlen(needle_null_terminated), needle_len);
@@ -99,6 +104,22 @@ TEST(StringSearchTest, Basic) {
   TestSearch("abcdacde", "cde");
 }
 
+TEST(StringSearchTest, Long) {
+  // Matches in the first and the later blocks of 16 positions, and in the positions
+  // after the last full block.
+  string haystack = "xabcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZx";
+  TestSearch(haystack.c_str(), "abc");
+  TestSearch(haystack.c_str(), "pqr");
+  TestSearch(haystack.c_str(), "qrstuvwxyz0123456789");
+  TestSearch(haystack.c_str(), "XYZ");
+  TestSearch(haystack.c_str(), "Zx");
+  TestSearch(haystack.c_str(), "Zy");
+  TestSearch(haystack.c_str(), "ac");
+  // Candidates where the first and the last character match but the middle doesn't.
+  TestSearch("aXbaXbaXbaXbaXbaXbaXbaXbaXbaYb", "aYb");
+  TestSearch("aXbaXbaXbaXbaXbaXbaXbaXbaXbaXb", "aYb");
+}
+
 }
 
 int main(int argc, char **argv) {
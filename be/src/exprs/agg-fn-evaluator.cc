@@ -18,7 +18,6 @@
 
 #include "codegen/llvm-codegen.h"
 #include "common/logging.h"
-#include "exec/aggregation-node.h"
 #include "exprs/aggregate-functions.h"
 #include "exprs/expr-context.h"
 #include "exprs/anyval-util.h"
@@ -170,8 +169,9 @@ Status AggFnEvaluator::Prepare(RuntimeState* state, const RowDescriptor& desc,
   RETURN_IF_ERROR(LibCache::instance()->GetSoFunctionPtr(
       fn_.hdfs_location, fn_.aggregate_fn.update_fn_symbol, &update_fn_, &cache_entry_));
 
-  // Merge() is not loaded if evaluating the agg fn as an analytic function.
-  if (!is_analytic_fn_) {
+  // Merge() is optional if evaluating the agg fn as an analytic function. It is used to
+  // evaluate sliding windows of functions without Remove().
+  if (!is_analytic_fn_ || !fn_.aggregate_fn.merge_fn_symbol.empty()) {
     RETURN_IF_ERROR(LibCache::instance()->GetSoFunctionPtr(fn_.hdfs_location,
           fn_.aggregate_fn.merge_fn_symbol, &merge_fn_, &cache_entry_));
   }
@@ -197,6 +197,16 @@ Status AggFnEvaluator::Prepare(RuntimeState* state, const RowDescriptor& desc,
         fn_.hdfs_location, fn_.aggregate_fn.finalize_fn_symbol, &finalize_fn_,
         &cache_entry_));
   }
+  // The decimal SUM builtin keeps an overflowed sum in its intermediate value, which
+  // must be turned into NULL before it is returned. Bind SumDecimalFinalize() if the
+  // function descriptor doesn't name it.
+  if (fn_.binary_type == TFunctionBinaryType::BUILTIN &&
+      update_fn_ == reinterpret_cast<void*>(&AggregateFunctions::SumDecimalUpdate)) {
+    void* sum_decimal_finalize =
+        reinterpret_cast<void*>(&AggregateFunctions::SumDecimalFinalize);
+    if (finalize_fn_ == NULL) finalize_fn_ = sum_decimal_finalize;
+    if (get_value_fn_ == NULL) get_value_fn_ = sum_decimal_finalize;
+  }
 
   vector<FunctionContext::TypeDesc> arg_types;
   for (int i = 0; i < input_expr_ctxs_.size(); ++i) {
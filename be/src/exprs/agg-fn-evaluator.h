@@ -35,7 +35,6 @@ using namespace impala_udf;
 
 namespace impala {
 
-class AggregationNode;
 class Expr;
 class ExprContext;
 class MemPool;
@@ -53,7 +52,7 @@ class TExprNode;
 /// or not.
 //
 /// This class provides an interface that's 1:1 with the UDA interface and serves
-/// as glue code between the TupleRow/Tuple signature used by the AggregationNode
+/// as glue code between the TupleRow/Tuple signature used by the aggregation node
 /// and the AnyVal signature of the UDA interface. It handles evaluating input
 /// slots from TupleRows and aggregating the result to the result tuple.
 //
@@ -114,6 +113,7 @@ class AggFnEvaluator {
   bool is_count_star() const { return agg_op_ == COUNT && input_expr_ctxs_.empty(); }
   bool is_builtin() const { return fn_.binary_type == TFunctionBinaryType::BUILTIN; }
   bool SupportsRemove() const { return remove_fn_ != NULL; }
+  bool SupportsMerge() const { return merge_fn_ != NULL; }
   bool SupportsSerialize() const { return serialize_fn_ != NULL; }
   const std::string& fn_name() const { return fn_.name.function_name; }
   const std::string& update_symbol() const { return fn_.aggregate_fn.update_fn_symbol; }
@@ -156,6 +156,8 @@ class AggFnEvaluator {
       const std::vector<FunctionContext*>& fn_ctxs, TupleRow* src, Tuple* dst);
   static void Remove(const std::vector<AggFnEvaluator*>& evaluators,
       const std::vector<FunctionContext*>& fn_ctxs, TupleRow* src, Tuple* dst);
+  static void Merge(const std::vector<AggFnEvaluator*>& evaluators,
+      const std::vector<FunctionContext*>& fn_ctxs, Tuple* src, Tuple* dst);
   static void Serialize(const std::vector<AggFnEvaluator*>& evaluators,
       const std::vector<FunctionContext*>& fn_ctxs, Tuple* dst);
   static void GetValue(const std::vector<AggFnEvaluator*>& evaluators,
@@ -280,6 +282,13 @@ inline void AggFnEvaluator::Remove(const std::vector<AggFnEvaluator*>& evaluator
     evaluators[i]->Remove(fn_ctxs[i], src, dst);
   }
 }
+inline void AggFnEvaluator::Merge(const std::vector<AggFnEvaluator*>& evaluators,
+      const std::vector<FunctionContext*>& fn_ctxs, Tuple* src, Tuple* dst) {
+  DCHECK_EQ(evaluators.size(), fn_ctxs.size());
+  for (int i = 0; i < evaluators.size(); ++i) {
+    evaluators[i]->Merge(fn_ctxs[i], src, dst);
+  }
+}
 inline void AggFnEvaluator::Serialize(const std::vector<AggFnEvaluator*>& evaluators,
       const std::vector<FunctionContext*>& fn_ctxs, Tuple* dst) {
   DCHECK_EQ(evaluators.size(), fn_ctxs.size());
@@ -14,8 +14,10 @@
 
 #include "exprs/aggregate-functions.h"
 
+#include <emmintrin.h>
 #include <math.h>
 #include <algorithm>
+#include <limits>
 #include <map>
 #include <sstream>
 #include <utility>
@@ -41,6 +43,7 @@ using std::push_heap;
 using std::pop_heap;
 using std::map;
 using std::make_pair;
+using std::numeric_limits;
 
 namespace {
 // Threshold for each precision where it's better to use linear counting instead
@@ -475,21 +478,40 @@ void AggregateFunctions::SumDecimalRemove(FunctionContext* ctx,
   SumDecimalAddOrSubtract(ctx, src, dst, true);
 }
 
+// Adds 'val' to 'sum', a sum of DECIMAL(38) values. The int128_t of the sum can wrap
+// around after adding just a few of these values, so this is checked for every value.
+// A sum that overflowed is set to a value beyond the maximum unscaled decimal value,
+// which it keeps until SumDecimalFinalize() reports the overflow.
+static inline void AddToDecimal16Sum(int128_t val, DecimalVal* sum) {
+  if (UNLIKELY(abs(sum->val16) > DecimalUtil::MAX_UNSCALED_DECIMAL16)) return;
+  bool overflow = false;
+  Decimal16Value result = Decimal16Value(sum->val16).Add<int128_t>(0,
+      Decimal16Value(val), 0, ColumnType::MAX_PRECISION, 0, &overflow);
+  sum->val16 = UNLIKELY(overflow) ? DecimalUtil::MAX_UNSCALED_DECIMAL16 + 1 :
+      result.value();
+}
+
 // Always inline in IR so that constants can be replaced.
 IR_ALWAYS_INLINE void AggregateFunctions::SumDecimalAddOrSubtract(FunctionContext* ctx,
     const DecimalVal& src, DecimalVal* dst, bool subtract) {
   if (src.is_null) return;
   if (dst->is_null) InitZero<DecimalVal>(ctx, dst);
-  int precision = Expr::GetConstantInt(*ctx, Expr::ARG_TYPE_PRECISION, 0);
   // Since the src and dst are guaranteed to be the same scale, we can just
-  // do a simple add.
-  int m = subtract ? -1 : 1;
-  if (precision <= 9) {
-    dst->val16 += m * src.val4;
-  } else if (precision <= 19) {
-    dst->val16 += m * src.val8;
-  } else {
-    dst->val16 += m * src.val16;
+  // do a simple add. The sum of DECIMAL(18) or smaller values can't overflow the
+  // int128_t before the result type, DECIMAL(38), which is checked by
+  // SumDecimalFinalize().
+  switch (Expr::GetConstantInt(*ctx, Expr::ARG_TYPE_SIZE, 0)) {
+    case 4:
+      dst->val16 += subtract ? -src.val4 : src.val4;
+      break;
+    case 8:
+      dst->val16 += subtract ? -src.val8 : src.val8;
+      break;
+    case 16:
+      AddToDecimal16Sum(subtract ? -src.val16 : src.val16, dst);
+      break;
+    default:
+      DCHECK(false) << "Invalid byte size";
   }
 }
 
@@ -497,7 +519,20 @@ void AggregateFunctions::SumDecimalMerge(FunctionContext* ctx,
     const DecimalVal& src, DecimalVal* dst) {
   if (src.is_null) return;
   if (dst->is_null) InitZero<DecimalVal>(ctx, dst);
-  dst->val16 += src.val16;
+  if (UNLIKELY(abs(src.val16) > DecimalUtil::MAX_UNSCALED_DECIMAL16)) {
+    dst->val16 = src.val16;
+    return;
+  }
+  AddToDecimal16Sum(src.val16, dst);
+}
+
+DecimalVal AggregateFunctions::SumDecimalFinalize(FunctionContext* ctx,
+    const DecimalVal& src) {
+  if (UNLIKELY(!src.is_null && abs(src.val16) > DecimalUtil::MAX_UNSCALED_DECIMAL16)) {
+    ctx->AddWarning("Sum computation overflowed, returning NULL");
+    return DecimalVal::null();
+  }
+  return src;
 }
 
 template<typename T>
@@ -1133,15 +1168,303 @@ T AggregateFunctions::AppxMedianFinalize(FunctionContext* ctx,
   return result;
 }
 
+// Approximate percentile constants. The sketch is a merging t-digest with this
+// compression. A larger compression gives more accurate results and larger sketches.
+// See "Computing Extremely Accurate Quantiles Using t-Digests" by Dunning and Ertl.
+const static double APPX_PERCENTILE_COMPRESSION = 100;
+// Upper bound of the number of centroids after compressing, which is at most
+// the compression with the scale function below.
+const static int APPX_PERCENTILE_MAX_CENTROIDS = 2 * APPX_PERCENTILE_COMPRESSION;
+// Number of input values buffered between two compressions.
+const static int APPX_PERCENTILE_BUFFER_SIZE = 5 * APPX_PERCENTILE_COMPRESSION;
+
+struct PercentileCentroid {
+  double mean;
+  double weight;
+
+  bool operator<(const PercentileCentroid& other) const { return mean < other.mean; }
+};
+
+// The intermediate state of APPX_PERCENTILE(). The serialized state consists of the
+// fields up to and including the 'num_centroids' centroids, i.e. it doesn't contain
+// the buffer, so that it is small to send across the network.
+struct AppxPercentileState {
+  // The percentile to compute in [0, 1], set by the first update. -1 if not set yet.
+  double percentile;
+
+  // The smallest and largest input value, used to interpolate in the tails.
+  double min;
+  double max;
+
+  int num_centroids;
+  int num_buffered;
+
+  // The centroids sorted by mean, followed by room for the values that are merged into
+  // them by the next compression.
+  PercentileCentroid centroids[APPX_PERCENTILE_MAX_CENTROIDS];
+  PercentileCentroid buffer[APPX_PERCENTILE_BUFFER_SIZE];
+
+  // Returns the size of the serialized state with 'n' centroids.
+  static int SerializedSize(int n) {
+    return offsetof(AppxPercentileState, centroids) + n * sizeof(PercentileCentroid);
+  }
+};
+
+// The t-digest scale function k1 and its inverse, which map a quantile to the index of
+// the centroid and back. This makes the centroids small, i.e. precise, at the tails.
+static inline double PercentileScale(double q) {
+  return APPX_PERCENTILE_COMPRESSION / (2 * M_PI) * asin(2 * q - 1);
+}
+
+static inline double PercentileScaleInverse(double k) {
+  if (k >= APPX_PERCENTILE_COMPRESSION / 4) return 1;
+  return (sin(k * 2 * M_PI / APPX_PERCENTILE_COMPRESSION) + 1) / 2;
+}
+
+// Merges the buffered values and centroids into new centroids. Each centroid may
+// combine values covering at most one unit of PercentileScale().
+static void AppxPercentileCompress(AppxPercentileState* state) {
+  if (state->num_buffered == 0) return;
+  // The buffer directly follows the centroids, so sorting both together merges them.
+  PercentileCentroid* values = state->centroids + state->num_centroids;
+  memmove(values, state->buffer, state->num_buffered * sizeof(PercentileCentroid));
+  PercentileCentroid* all = state->centroids;
+  int n = state->num_centroids + state->num_buffered;
+  sort(all, all + n);
+
+  double total_weight = 0;
+  for (int i = 0; i < n; ++i) total_weight += all[i].weight;
+  double weight_so_far = 0;
+  double weight_limit = total_weight * PercentileScaleInverse(PercentileScale(0) + 1);
+  int num_centroids = 0;
+  PercentileCentroid current = all[0];
+  for (int i = 1; i < n; ++i) {
+    double proposed_weight = current.weight + all[i].weight;
+    if (weight_so_far + proposed_weight <= weight_limit) {
+      current.mean += (all[i].mean - current.mean) * all[i].weight / proposed_weight;
+      current.weight = proposed_weight;
+    } else {
+      weight_so_far += current.weight;
+      weight_limit = total_weight * PercentileScaleInverse(
+          PercentileScale(weight_so_far / total_weight) + 1);
+      all[num_centroids++] = current;
+      current = all[i];
+    }
+  }
+  all[num_centroids++] = current;
+  DCHECK_LE(num_centroids, APPX_PERCENTILE_MAX_CENTROIDS);
+  state->num_centroids = num_centroids;
+  state->num_buffered = 0;
+}
+
+// Adds a value or a centroid of 'weight' values with mean 'mean' to 'state'.
+static inline void AppxPercentileAdd(AppxPercentileState* state, double mean,
+    double weight) {
+  if (UNLIKELY(state->num_buffered == APPX_PERCENTILE_BUFFER_SIZE)) {
+    AppxPercentileCompress(state);
+  }
+  PercentileCentroid* value = &state->buffer[state->num_buffered++];
+  value->mean = mean;
+  value->weight = weight;
+}
+
+void AggregateFunctions::AppxPercentileInit(FunctionContext* ctx, StringVal* dst) {
+  AllocBuffer(ctx, dst, sizeof(AppxPercentileState));
+  if (UNLIKELY(dst->is_null)) return;
+  AppxPercentileState* state = reinterpret_cast<AppxPercentileState*>(dst->ptr);
+  state->percentile = -1;
+  state->min = numeric_limits<double>::infinity();
+  state->max = -numeric_limits<double>::infinity();
+}
+
+template <typename T>
+void AggregateFunctions::AppxPercentileUpdate(FunctionContext* ctx, const T& src,
+    const DoubleVal& percentile, StringVal* dst) {
+  if (src.is_null) return;
+  DCHECK(!dst->is_null);
+  DCHECK_EQ(dst->len, sizeof(AppxPercentileState));
+  AppxPercentileState* state = reinterpret_cast<AppxPercentileState*>(dst->ptr);
+  if (UNLIKELY(state->percentile < 0)) {
+    if (percentile.is_null || !(percentile.val >= 0 && percentile.val <= 1)) {
+      ctx->SetError("APPX_PERCENTILE() requires a percentile between 0 and 1");
+      return;
+    }
+    state->percentile = percentile.val;
+  }
+  double val = static_cast<double>(src.val);
+  state->min = std::min(state->min, val);
+  state->max = std::max(state->max, val);
+  AppxPercentileAdd(state, val, 1);
+}
+
+void AggregateFunctions::AppxPercentileMerge(FunctionContext* ctx,
+    const StringVal& src_val, StringVal* dst_val) {
+  DCHECK(!src_val.is_null);
+  DCHECK(!dst_val->is_null);
+  DCHECK_EQ(dst_val->len, sizeof(AppxPercentileState));
+  const AppxPercentileState* src =
+      reinterpret_cast<const AppxPercentileState*>(src_val.ptr);
+  DCHECK_EQ(src_val.len, AppxPercentileState::SerializedSize(src->num_centroids));
+  AppxPercentileState* dst = reinterpret_cast<AppxPercentileState*>(dst_val->ptr);
+  if (src->num_centroids == 0) return;
+  dst->percentile = src->percentile;
+  dst->min = std::min(dst->min, src->min);
+  dst->max = std::max(dst->max, src->max);
+  for (int i = 0; i < src->num_centroids; ++i) {
+    AppxPercentileAdd(dst, src->centroids[i].mean, src->centroids[i].weight);
+  }
+}
+
+const StringVal AggregateFunctions::AppxPercentileSerialize(FunctionContext* ctx,
+    const StringVal& src) {
+  if (UNLIKELY(src.is_null)) return src;
+  DCHECK_EQ(src.len, sizeof(AppxPercentileState));
+  AppxPercentileState* state = reinterpret_cast<AppxPercentileState*>(src.ptr);
+  AppxPercentileCompress(state);
+  StringVal result = StringVal::CopyFrom(ctx, src.ptr,
+      AppxPercentileState::SerializedSize(state->num_centroids));
+  ctx->Free(src.ptr);
+  return result;
+}
+
+DoubleVal AggregateFunctions::AppxPercentileFinalize(FunctionContext* ctx,
+    const StringVal& src_val) {
+  if (UNLIKELY(src_val.is_null)) return DoubleVal::null();
+  DCHECK_EQ(src_val.len, sizeof(AppxPercentileState));
+  AppxPercentileState* state = reinterpret_cast<AppxPercentileState*>(src_val.ptr);
+  AppxPercentileCompress(state);
+  int n = state->num_centroids;
+  if (n == 0) {
+    ctx->Free(src_val.ptr);
+    return DoubleVal::null();
+  }
+  const PercentileCentroid* c = state->centroids;
+  double total_weight = 0;
+  for (int i = 0; i < n; ++i) total_weight += c[i].weight;
+
+  // The values of a centroid are assumed to be spread around its mean, so the value at
+  // the target rank is interpolated between the means of the neighboring centroids, or
+  // between the extreme value and the mean of the first or last centroid.
+  double target = state->percentile * total_weight;
+  double result = state->max;
+  if (target >= total_weight) {
+    result = state->max;
+  } else if (target < c[0].weight / 2) {
+    result = state->min + (c[0].mean - state->min) * target / (c[0].weight / 2);
+  } else {
+    double weight_so_far = 0;
+    int i = 0;
+    for (; i < n - 1; ++i) {
+      double left_center = weight_so_far + c[i].weight / 2;
+      double right_center = weight_so_far + c[i].weight + c[i + 1].weight / 2;
+      if (target < right_center) {
+        result = c[i].mean + (c[i + 1].mean - c[i].mean) *
+            (target - left_center) / (right_center - left_center);
+        break;
+      }
+      weight_so_far += c[i].weight;
+    }
+    if (i == n - 1) {
+      double center = weight_so_far + c[i].weight / 2;
+      result = c[i].mean +
+          (state->max - c[i].mean) * (target - center) / (total_weight - center);
+    }
+  }
+  ctx->Free(src_val.ptr);
+  return DoubleVal(result);
+}
+
+// The HLL intermediate starts out sparse and is converted to the dense array of HLL_LEN
+// registers once it has more than HLL_MAX_SPARSE_ENTRIES non-zero registers. The two
+// are told apart by their length, which is HLL_LEN only for the dense representation.
+// The sparse representation is a uint16_t with the number of entries, followed by room
+// for the entries, which are sorted and hold the index of a register in the upper bits
+// and its value in the lower HLL_SPARSE_VALUE_BITS bits. Values are at most 64 - 10 + 1
+// and fit into 6 bits.
+const static int HLL_SPARSE_VALUE_BITS = 6;
+const static int HLL_SPARSE_VALUE_MASK = (1 << HLL_SPARSE_VALUE_BITS) - 1;
+const static int HLL_INITIAL_SPARSE_ENTRIES = 8;
+const static int HLL_MAX_SPARSE_ENTRIES = 128;
+
+static inline int HllSparseSize(int num_entries) {
+  return sizeof(uint16_t) * (num_entries + 1);
+}
+
+static inline bool HllIsDense(const StringVal& hll) {
+  return hll.len == AggregateFunctions::HLL_LEN;
+}
+
+// Writes the registers of the sparse 'src' to the dense registers 'dst', which must
+// be zero.
+static void HllSparseToDense(const StringVal& src, uint8_t* dst) {
+  const uint16_t* sparse = reinterpret_cast<const uint16_t*>(src.ptr);
+  int num_entries = sparse[0];
+  for (int i = 1; i <= num_entries; ++i) {
+    dst[sparse[i] >> HLL_SPARSE_VALUE_BITS] = sparse[i] & HLL_SPARSE_VALUE_MASK;
+  }
+}
+
+void AggregateFunctions::HllMakeDense(FunctionContext* ctx, StringVal* hll) {
+  if (hll->is_null || HllIsDense(*hll)) return;
+  StringVal dense;
+  AllocBuffer(ctx, &dense, HLL_LEN);
+  if (UNLIKELY(dense.is_null)) {
+    ctx->Free(hll->ptr);
+    *hll = dense;
+    return;
+  }
+  HllSparseToDense(*hll, dense.ptr);
+  ctx->Free(hll->ptr);
+  *hll = dense;
+}
+
+// Sets the register 'idx' of 'hll' to at least 'value'.
+static void HllSetRegister(FunctionContext* ctx, int idx, uint8_t value,
+    StringVal* hll) {
+  if (HllIsDense(*hll)) {
+    hll->ptr[idx] = ::max(hll->ptr[idx], value);
+    return;
+  }
+  uint16_t* sparse = reinterpret_cast<uint16_t*>(hll->ptr);
+  int num_entries = sparse[0];
+  uint16_t* entries = sparse + 1;
+  uint16_t key = idx << HLL_SPARSE_VALUE_BITS;
+  uint16_t* entry = std::lower_bound(entries, entries + num_entries, key);
+  if (entry != entries + num_entries && (*entry >> HLL_SPARSE_VALUE_BITS) == idx) {
+    if ((*entry & HLL_SPARSE_VALUE_MASK) < value) *entry = key | value;
+    return;
+  }
+  if (HllSparseSize(num_entries + 1) > hll->len) {
+    if (num_entries == HLL_MAX_SPARSE_ENTRIES) {
+      AggregateFunctions::HllMakeDense(ctx, hll);
+      if (LIKELY(!hll->is_null)) hll->ptr[idx] = value;
+      return;
+    }
+    int new_len = HllSparseSize(min(2 * num_entries, HLL_MAX_SPARSE_ENTRIES));
+    uint8_t* new_ptr = ctx->Reallocate(hll->ptr, new_len);
+    if (UNLIKELY(new_ptr == NULL)) {
+      *hll = StringVal::null();
+      return;
+    }
+    int offset = reinterpret_cast<uint8_t*>(entry) - hll->ptr;
+    *hll = StringVal(new_ptr, new_len);
+    sparse = reinterpret_cast<uint16_t*>(new_ptr);
+    entries = sparse + 1;
+    entry = reinterpret_cast<uint16_t*>(new_ptr + offset);
+  }
+  memmove(entry + 1, entry, (entries + num_entries - entry) * sizeof(uint16_t));
+  *entry = key | value;
+  sparse[0] = num_entries + 1;
+}
+
 void AggregateFunctions::HllInit(FunctionContext* ctx, StringVal* dst) {
-  AllocBuffer(ctx, dst, HLL_LEN);
+  AllocBuffer(ctx, dst, HllSparseSize(HLL_INITIAL_SPARSE_ENTRIES));
 }
 
 template <typename T>
 void AggregateFunctions::HllUpdate(FunctionContext* ctx, const T& src, StringVal* dst) {
   if (src.is_null) return;
   DCHECK(!dst->is_null);
-  DCHECK_EQ(dst->len, HLL_LEN);
   uint64_t hash_value =
       AnyValUtil::Hash64(src, *ctx->GetArgType(0), HashUtil::FNV64_SEED);
   if (hash_value != 0) {
@@ -1149,7 +1472,12 @@ void AggregateFunctions::HllUpdate(FunctionContext* ctx, const T& src, StringVal
     // find the first 1 bit after the index bits.
     int idx = hash_value & (HLL_LEN - 1);
     uint8_t first_one_bit = __builtin_ctzl(hash_value >> HLL_PRECISION) + 1;
-    dst->ptr[idx] = ::max(dst->ptr[idx], first_one_bit);
+    if (LIKELY(HllIsDense(*dst))) {
+      dst->ptr[idx] = ::max(dst->ptr[idx], first_one_bit);
+    } else {
+      HllSetRegister(ctx, idx, ::min<uint8_t>(first_one_bit, HLL_SPARSE_VALUE_MASK),
+          dst);
+    }
   }
 }
 
@@ -1157,10 +1485,24 @@ void AggregateFunctions::HllMerge(FunctionContext* ctx, const StringVal& src,
     StringVal* dst) {
   DCHECK(!dst->is_null);
   DCHECK(!src.is_null);
-  DCHECK_EQ(dst->len, HLL_LEN);
-  DCHECK_EQ(src.len, HLL_LEN);
-  for (int i = 0; i < src.len; ++i) {
-    dst->ptr[i] = ::max(dst->ptr[i], src.ptr[i]);
+  if (!HllIsDense(src)) {
+    const uint16_t* sparse = reinterpret_cast<const uint16_t*>(src.ptr);
+    DCHECK_LE(HllSparseSize(sparse[0]), src.len);
+    for (int i = 1; i <= sparse[0] && LIKELY(!dst->is_null); ++i) {
+      HllSetRegister(ctx, sparse[i] >> HLL_SPARSE_VALUE_BITS,
+          sparse[i] & HLL_SPARSE_VALUE_MASK, dst);
+    }
+    return;
+  }
+  HllMakeDense(ctx, dst);
+  if (UNLIKELY(dst->is_null)) return;
+  // Take the maximum of 16 registers at a time. SSE2 is available on all x86-64 CPUs.
+  DCHECK_EQ(HLL_LEN % 16, 0);
+  for (int i = 0; i < HLL_LEN; i += 16) {
+    __m128i src_registers = _mm_loadu_si128(reinterpret_cast<__m128i*>(src.ptr + i));
+    __m128i dst_registers = _mm_loadu_si128(reinterpret_cast<__m128i*>(dst->ptr + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst->ptr + i),
+        _mm_max_epu8(src_registers, dst_registers));
   }
 }
 
@@ -1206,7 +1548,15 @@ uint64_t AggregateFunctions::HllFinalEstimate(const uint8_t* buckets,
 
 BigIntVal AggregateFunctions::HllFinalize(FunctionContext* ctx, const StringVal& src) {
   if (UNLIKELY(src.is_null)) return BigIntVal::null();
-  uint64_t estimate = HllFinalEstimate(src.ptr, src.len);
+  uint64_t estimate;
+  if (HllIsDense(src)) {
+    estimate = HllFinalEstimate(src.ptr, src.len);
+  } else {
+    uint8_t registers[HLL_LEN];
+    memset(registers, 0, HLL_LEN);
+    HllSparseToDense(src, registers);
+    estimate = HllFinalEstimate(registers, HLL_LEN);
+  }
   ctx->Free(src.ptr);
   return estimate;
 }
@@ -1719,6 +2069,19 @@ template TimestampVal AggregateFunctions::AppxMedianFinalize<TimestampVal>(
 template DecimalVal AggregateFunctions::AppxMedianFinalize<DecimalVal>(
     FunctionContext*, const StringVal&);
 
+template void AggregateFunctions::AppxPercentileUpdate(
+    FunctionContext*, const TinyIntVal&, const DoubleVal&, StringVal*);
+template void AggregateFunctions::AppxPercentileUpdate(
+    FunctionContext*, const SmallIntVal&, const DoubleVal&, StringVal*);
+template void AggregateFunctions::AppxPercentileUpdate(
+    FunctionContext*, const IntVal&, const DoubleVal&, StringVal*);
+template void AggregateFunctions::AppxPercentileUpdate(
+    FunctionContext*, const BigIntVal&, const DoubleVal&, StringVal*);
+template void AggregateFunctions::AppxPercentileUpdate(
+    FunctionContext*, const FloatVal&, const DoubleVal&, StringVal*);
+template void AggregateFunctions::AppxPercentileUpdate(
+    FunctionContext*, const DoubleVal&, const DoubleVal&, StringVal*);
+
 template void AggregateFunctions::HllUpdate(
     FunctionContext*, const BooleanVal&, StringVal*);
 template void AggregateFunctions::HllUpdate(
@@ -39,6 +39,11 @@ using boost::algorithm::trim;
 using namespace impala;
 using namespace impala_udf;
 
+template <int RANGE_START, int RANGE_END>
+bool CheckAppxPercentile(const DoubleVal& actual, const DoubleVal& expected) {
+  return !actual.is_null && actual.val >= RANGE_START && actual.val <= RANGE_END;
+}
+
 template <int RANGE_START, int RANGE_END>
 bool CheckAppxMedian(const IntVal& actual, const IntVal& expected) {
   return actual.val >= RANGE_START && actual.val <= RANGE_END;
@@ -162,6 +167,72 @@ TEST(HistogramTest, TestString) {
   EXPECT_TRUE(test.Execute(input, StringVal(&expected[0]))) << test.GetErrorMsg();
 }
 
+TEST(AppxPercentileTest, TestInt) {
+  UdaTestHarness2<DoubleVal, StringVal, IntVal, DoubleVal> test(
+      AggregateFunctions::AppxPercentileInit,
+      AggregateFunctions::AppxPercentileUpdate<IntVal>,
+      AggregateFunctions::AppxPercentileMerge,
+      AggregateFunctions::AppxPercentileSerialize,
+      AggregateFunctions::AppxPercentileFinalize);
+  const int INPUT_SIZE = 100000;
+  vector<IntVal> input;
+  for (int i = 0; i < INPUT_SIZE; ++i) input.push_back(i);
+
+  // The extremes are exact.
+  EXPECT_TRUE(test.Execute(input, vector<DoubleVal>(INPUT_SIZE, 0), DoubleVal(0)))
+      << test.GetErrorMsg();
+  EXPECT_TRUE(test.Execute(input, vector<DoubleVal>(INPUT_SIZE, 1),
+      DoubleVal(INPUT_SIZE - 1))) << test.GetErrorMsg();
+
+  test.SetResultComparator(CheckAppxPercentile<49000, 51000>);
+  EXPECT_TRUE(test.Execute(input, vector<DoubleVal>(INPUT_SIZE, 0.5), DoubleVal()))
+      << test.GetErrorMsg();
+  // The tails are more accurate than the median.
+  test.SetResultComparator(CheckAppxPercentile<98800, 99200>);
+  EXPECT_TRUE(test.Execute(input, vector<DoubleVal>(INPUT_SIZE, 0.99), DoubleVal()))
+      << test.GetErrorMsg();
+  test.SetResultComparator(CheckAppxPercentile<960, 1040>);
+  EXPECT_TRUE(test.Execute(input, vector<DoubleVal>(INPUT_SIZE, 0.01), DoubleVal()))
+      << test.GetErrorMsg();
+
+  // No input values.
+  test.SetResultComparator(NULL);
+  EXPECT_TRUE(test.Execute(vector<IntVal>(), vector<DoubleVal>(), DoubleVal::null()))
+      << test.GetErrorMsg();
+}
+
+// Sums DECIMAL(38) values until the sum overflows, which SumDecimalFinalize() turns
+// into NULL.
+TEST(SumDecimalTest, Overflow) {
+  FunctionContext::TypeDesc decimal_type;
+  decimal_type.type = FunctionContext::TYPE_DECIMAL;
+  decimal_type.precision = ColumnType::MAX_PRECISION;
+  decimal_type.scale = 0;
+  FunctionContext* ctx = UdfTestHarness::CreateTestContext(
+      decimal_type, vector<FunctionContext::TypeDesc>(1, decimal_type));
+
+  DecimalVal max_val(DecimalUtil::MAX_UNSCALED_DECIMAL16);
+  DecimalVal sum = DecimalVal::null();
+  AggregateFunctions::SumDecimalUpdate(ctx, max_val, &sum);
+  DecimalVal result = AggregateFunctions::SumDecimalFinalize(ctx, sum);
+  EXPECT_FALSE(result.is_null);
+  EXPECT_TRUE(result.val16 == DecimalUtil::MAX_UNSCALED_DECIMAL16);
+
+  // The overflow sticks, even after values that would bring the sum back in range.
+  AggregateFunctions::SumDecimalUpdate(ctx, max_val, &sum);
+  AggregateFunctions::SumDecimalUpdate(ctx, DecimalVal(-max_val.val16), &sum);
+  EXPECT_TRUE(AggregateFunctions::SumDecimalFinalize(ctx, sum).is_null);
+
+  // An overflowed intermediate value stays overflowed when merged.
+  DecimalVal merged = DecimalVal::null();
+  AggregateFunctions::SumDecimalMerge(ctx, DecimalVal(1), &merged);
+  AggregateFunctions::SumDecimalMerge(ctx, sum, &merged);
+  AggregateFunctions::SumDecimalMerge(ctx, DecimalVal(-1), &merged);
+  EXPECT_TRUE(AggregateFunctions::SumDecimalFinalize(ctx, merged).is_null);
+  UdfTestHarness::CloseContext(ctx);
+  delete ctx;
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   InitCommonRuntime(argc, argv, false, TestInfo::BE_TEST);
@@ -95,6 +95,8 @@ class AggregateFunctions {
   static void SumDecimalUpdate(FunctionContext*, const DecimalVal& src, DecimalVal* dst);
   static void SumDecimalRemove(FunctionContext*, const DecimalVal& src, DecimalVal* dst);
   static void SumDecimalMerge(FunctionContext*, const DecimalVal& src, DecimalVal* dst);
+  /// Returns NULL with a warning if the sum overflowed.
+  static DecimalVal SumDecimalFinalize(FunctionContext*, const DecimalVal& src);
   /// Adds or or subtracts src from dst. Implements Update() and Remove().
   static void SumDecimalAddOrSubtract(FunctionContext*, const DecimalVal& src,
       DecimalVal* dst, bool subtract = false);
@@ -166,11 +168,32 @@ class AggregateFunctions {
   template <typename T>
   static StringVal HistogramFinalize(FunctionContext*, const StringVal& src);
 
+  /// APPX_PERCENTILE(expr, percentile) returns an approximation of the value at the
+  /// given percentile in [0, 1] of a numeric expr. It is computed with a t-digest, a
+  /// sketch of a bounded number of weighted centroids that is most accurate for the
+  /// percentiles in the tails. Update() only appends to a buffer that is periodically
+  /// merged into the centroids. The serialized sketch holds just the centroids, so
+  /// merging costs at most a few KB per input.
+  /// These functions are not registered as a builtin yet, so APPX_PERCENTILE() can't
+  /// be called from SQL.
+  static void AppxPercentileInit(FunctionContext*, StringVal* slot);
+  template <typename T>
+  static void AppxPercentileUpdate(FunctionContext*, const T& src,
+      const DoubleVal& percentile, StringVal* dst);
+  static void AppxPercentileMerge(FunctionContext*, const StringVal& src,
+      StringVal* dst);
+  static const StringVal AppxPercentileSerialize(FunctionContext*,
+      const StringVal& src);
+  static DoubleVal AppxPercentileFinalize(FunctionContext*, const StringVal& src);
+
   /// Hyperloglog distinct estimate algorithm.
   /// See these papers for more details.
   /// 1) Hyperloglog: The analysis of a near-optimal cardinality estimation
   /// algorithm (2007)
   /// 2) HyperLogLog in Practice (paper from google with some improvements)
+  /// The intermediate state is a sparse list of the non-zero registers for small inputs,
+  /// which is converted to the dense array of HLL_LEN registers as it grows, so that
+  /// groups with few distinct values stay small.
   static const int HLL_PRECISION;
   static const int HLL_LEN;
   static void HllInit(FunctionContext*, StringVal* slot);
@@ -179,6 +202,10 @@ class AggregateFunctions {
   static void HllMerge(FunctionContext*, const StringVal& src, StringVal* dst);
   static BigIntVal HllFinalize(FunctionContext*, const StringVal& src);
 
+  /// Converts the HLL intermediate state 'hll' to the dense array of HLL_LEN registers
+  /// if it is sparse. 'hll' is set to NULL if the allocation fails.
+  static void HllMakeDense(FunctionContext*, StringVal* hll);
+
   /// Utility method to compute the final result of an HLL estimation from num_buckets
   /// estimates.
   static uint64_t HllFinalEstimate(const uint8_t* buckets, int32_t num_buckets);
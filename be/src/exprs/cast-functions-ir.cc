@@ -20,6 +20,7 @@
 #include "exprs/decimal-functions.h"
 #include "runtime/runtime-state.h"
 #include "runtime/string-value.inline.h"
+#include "runtime/timestamp-parse-util.h"
 #include "runtime/timestamp-value.h"
 #include "util/string-parser.h"
 #include "string-functions.h"
@@ -157,7 +158,9 @@ StringVal CastFunctions::CastToStringVal(FunctionContext* ctx, const TinyIntVal&
 StringVal CastFunctions::CastToStringVal(FunctionContext* ctx, const TimestampVal& val) {
   if (val.is_null) return StringVal::null();
   TimestampValue tv = TimestampValue::FromTimestampVal(val);
-  StringVal sv = AnyValUtil::FromString(ctx, lexical_cast<string>(tv));
+  char buff[TimestampParser::MAX_DEFAULT_FMT_OUT_LEN];
+  int len = TimestampParser::FormatDefault(tv.date(), tv.time(), buff);
+  StringVal sv = AnyValUtil::FromBuffer(ctx, buff, len);
   AnyValUtil::TruncateIfNecessary(ctx->GetReturnType(), &sv);
   return sv;
 }
@@ -0,0 +1,279 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exprs/common-subexpr.h"
+
+#include <string.h>
+#include <sstream>
+#include <typeinfo>
+
+#include "common/object-pool.h"
+#include "exprs/anyval-util.h"
+#include "exprs/expr-context.h"
+#include "exprs/literal.h"
+#include "exprs/scalar-fn-call.h"
+#include "exprs/slot-ref.h"
+#include "runtime/row-batch.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace impala_udf;
+
+SharedExpr::SharedExpr(SharedExprValues* values)
+  : Expr(values->expr->type()),
+    values_(values) {
+}
+
+template <typename T, T (Expr::*GET_VAL)(ExprContext*, TupleRow*)>
+T SharedExpr::GetValue(TupleRow* row) {
+  SharedExprValues* v = values_;
+  int64_t offset = reinterpret_cast<const uint8_t*>(row) - v->first_row;
+  int64_t row_idx = offset / v->row_size;
+  if (UNLIKELY(offset < 0 || row_idx >= v->num_rows)) {
+    return (v->expr->*GET_VAL)(v->ctx, row);
+  }
+  T* vals = reinterpret_cast<T*>(v->values.get());
+  if (!v->valid[row_idx]) {
+    vals[row_idx] = (v->expr->*GET_VAL)(v->ctx, row);
+    v->valid[row_idx] = true;
+  }
+  return vals[row_idx];
+}
+
+BooleanVal SharedExpr::GetBooleanVal(ExprContext* ctx, TupleRow* row) {
+  return GetValue<BooleanVal, &Expr::GetBooleanVal>(row);
+}
+
+TinyIntVal SharedExpr::GetTinyIntVal(ExprContext* ctx, TupleRow* row) {
+  return GetValue<TinyIntVal, &Expr::GetTinyIntVal>(row);
+}
+
+SmallIntVal SharedExpr::GetSmallIntVal(ExprContext* ctx, TupleRow* row) {
+  return GetValue<SmallIntVal, &Expr::GetSmallIntVal>(row);
+}
+
+IntVal SharedExpr::GetIntVal(ExprContext* ctx, TupleRow* row) {
+  return GetValue<IntVal, &Expr::GetIntVal>(row);
+}
+
+BigIntVal SharedExpr::GetBigIntVal(ExprContext* ctx, TupleRow* row) {
+  return GetValue<BigIntVal, &Expr::GetBigIntVal>(row);
+}
+
+FloatVal SharedExpr::GetFloatVal(ExprContext* ctx, TupleRow* row) {
+  return GetValue<FloatVal, &Expr::GetFloatVal>(row);
+}
+
+DoubleVal SharedExpr::GetDoubleVal(ExprContext* ctx, TupleRow* row) {
+  return GetValue<DoubleVal, &Expr::GetDoubleVal>(row);
+}
+
+StringVal SharedExpr::GetStringVal(ExprContext* ctx, TupleRow* row) {
+  return GetValue<StringVal, &Expr::GetStringVal>(row);
+}
+
+TimestampVal SharedExpr::GetTimestampVal(ExprContext* ctx, TupleRow* row) {
+  return GetValue<TimestampVal, &Expr::GetTimestampVal>(row);
+}
+
+DecimalVal SharedExpr::GetDecimalVal(ExprContext* ctx, TupleRow* row) {
+  return GetValue<DecimalVal, &Expr::GetDecimalVal>(row);
+}
+
+Status SharedExpr::GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn) {
+  return GetCodegendComputeFnWrapper(state, fn);
+}
+
+int SharedExpr::GetSlotIds(vector<SlotId>* slot_ids) const {
+  return values_->expr->GetSlotIds(slot_ids);
+}
+
+string SharedExpr::DebugString() const {
+  stringstream out;
+  out << "SharedExpr(expr=" << values_->expr->DebugString()
+      << " owner=" << (children_.empty() ? "false" : "true") << ")";
+  return out.str();
+}
+
+namespace {
+
+/// Returns true if the literals 'a' and 'b' of type 'T' have the same value.
+template <typename T, T (Expr::*GET_VAL)(ExprContext*, TupleRow*)>
+bool LiteralsEqual(Expr* a, Expr* b) {
+  // Literals don't use the context or the row.
+  return AnyValUtil::Equals(a->type(), (a->*GET_VAL)(NULL, NULL),
+      (b->*GET_VAL)(NULL, NULL));
+}
+
+bool LiteralsEqual(const Expr* a, const Expr* b) {
+  Expr* x = const_cast<Expr*>(a);
+  Expr* y = const_cast<Expr*>(b);
+  switch (a->type().type) {
+    case TYPE_BOOLEAN: return LiteralsEqual<BooleanVal, &Expr::GetBooleanVal>(x, y);
+    case TYPE_TINYINT: return LiteralsEqual<TinyIntVal, &Expr::GetTinyIntVal>(x, y);
+    case TYPE_SMALLINT: return LiteralsEqual<SmallIntVal, &Expr::GetSmallIntVal>(x, y);
+    case TYPE_INT: return LiteralsEqual<IntVal, &Expr::GetIntVal>(x, y);
+    case TYPE_BIGINT: return LiteralsEqual<BigIntVal, &Expr::GetBigIntVal>(x, y);
+    case TYPE_FLOAT: return LiteralsEqual<FloatVal, &Expr::GetFloatVal>(x, y);
+    case TYPE_DOUBLE: return LiteralsEqual<DoubleVal, &Expr::GetDoubleVal>(x, y);
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+    case TYPE_CHAR:
+      return LiteralsEqual<StringVal, &Expr::GetStringVal>(x, y);
+    case TYPE_DECIMAL: return LiteralsEqual<DecimalVal, &Expr::GetDecimalVal>(x, y);
+    default:
+      return false;
+  }
+}
+
+/// Returns true if the function call 'expr' returns the same value for the same
+/// arguments.
+bool IsDeterministicFnCall(const Expr* expr) {
+  if (expr->fn().binary_type != TFunctionBinaryType::BUILTIN) return false;
+  const string& fn_name = expr->fn().name.function_name;
+  return fn_name != "rand" && fn_name != "random" && fn_name != "uuid";
+}
+
+}
+
+bool CommonSubexprs::IsCandidate(const Expr* expr) {
+  if (typeid(*expr) != typeid(ScalarFnCall)) return false;
+  if (expr->GetNumChildren() == 0 || expr->IsConstant()) return false;
+  if (expr->type().type == TYPE_NULL || expr->type().IsComplexType()) return false;
+  return IsDeterministicFnCall(expr);
+}
+
+bool CommonSubexprs::Equals(const Expr* a, const Expr* b) {
+  if (typeid(*a) != typeid(*b) || a->type() != b->type()) return false;
+  if (a->GetNumChildren() != b->GetNumChildren()) return false;
+  if (typeid(*a) == typeid(SlotRef)) {
+    return static_cast<const SlotRef*>(a)->slot_id() ==
+        static_cast<const SlotRef*>(b)->slot_id();
+  } else if (typeid(*a) == typeid(Literal)) {
+    return LiteralsEqual(a, b);
+  } else if (typeid(*a) == typeid(SharedExpr)) {
+    return static_cast<const SharedExpr*>(a)->values_ ==
+        static_cast<const SharedExpr*>(b)->values_;
+  } else if (typeid(*a) == typeid(ScalarFnCall)) {
+    if (!IsDeterministicFnCall(a) || !(a->fn() == b->fn())) return false;
+    for (int i = 0; i < a->GetNumChildren(); ++i) {
+      if (!Equals(a->GetChild(i), b->GetChild(i))) return false;
+    }
+    return true;
+  }
+  // Other kinds of exprs are not compared, conservatively.
+  return false;
+}
+
+int CommonSubexprs::NumNodes(const Expr* expr) {
+  int num_nodes = 1;
+  for (int i = 0; i < expr->GetNumChildren(); ++i) {
+    num_nodes += NumNodes(expr->GetChild(i));
+  }
+  return num_nodes;
+}
+
+void CommonSubexprs::CollectCandidates(ExprContext* ctx, Expr* parent, int child_idx,
+    Expr* expr, vector<Occurrence>* occurrences) {
+  if (IsCandidate(expr)) {
+    Occurrence occurrence = { ctx, parent, child_idx, expr };
+    occurrences->push_back(occurrence);
+  }
+  for (int i = 0; i < expr->GetNumChildren(); ++i) {
+    CollectCandidates(ctx, expr, i, expr->GetChild(i), occurrences);
+  }
+}
+
+void CommonSubexprs::Replace(const Occurrence& occurrence, Expr* expr) {
+  if (occurrence.parent == NULL) {
+    DCHECK(occurrence.ctx->root_ == occurrence.expr);
+    occurrence.ctx->root_ = expr;
+  } else {
+    DCHECK(occurrence.parent->children_[occurrence.child_idx] == occurrence.expr);
+    occurrence.parent->children_[occurrence.child_idx] = expr;
+  }
+}
+
+int CommonSubexprs::Rewrite(const vector<ExprContext*>& ctxs) {
+  int num_shared = 0;
+  // Share the largest subexpression that occurs more than once until there is none.
+  // Every round replaces at least one candidate and its subtree by a SharedExpr, which
+  // isn't a candidate, so this terminates.
+  while (true) {
+    vector<Occurrence> occurrences;
+    for (ExprContext* ctx: ctxs) {
+      CollectCandidates(ctx, NULL, 0, ctx->root(), &occurrences);
+    }
+    int best_idx = -1;
+    int best_num_nodes = 0;
+    vector<int> best_duplicates;
+    for (int i = 0; i < occurrences.size(); ++i) {
+      int num_nodes = NumNodes(occurrences[i].expr);
+      if (num_nodes <= best_num_nodes) continue;
+      // Equal subexpressions don't contain each other, and the first occurrence of a
+      // subexpression precedes its duplicates.
+      vector<int> duplicates;
+      for (int j = i + 1; j < occurrences.size(); ++j) {
+        if (Equals(occurrences[i].expr, occurrences[j].expr)) duplicates.push_back(j);
+      }
+      if (duplicates.empty()) continue;
+      best_idx = i;
+      best_num_nodes = num_nodes;
+      best_duplicates.swap(duplicates);
+    }
+    if (best_idx == -1) break;
+
+    const Occurrence& first = occurrences[best_idx];
+    SharedExprValues* values = pool_->Add(new SharedExprValues());
+    values->expr = first.expr;
+    values->ctx = first.ctx;
+    values->value_size = AnyValUtil::AnyValSize(first.expr->type());
+    values->first_row = NULL;
+    values->row_size = 1;
+    values->num_rows = 0;
+    values->capacity = 0;
+    values_.push_back(values);
+
+    // The first occurrence keeps the subexpression as its child, the duplicates are
+    // dropped and never prepared.
+    SharedExpr* owner = pool_->Add(new SharedExpr(values));
+    owner->output_scale_ = first.expr->output_scale_;
+    owner->AddChild(first.expr);
+    Replace(first, owner);
+    for (int idx: best_duplicates) {
+      SharedExpr* shared = pool_->Add(new SharedExpr(values));
+      shared->output_scale_ = first.expr->output_scale_;
+      Replace(occurrences[idx], shared);
+    }
+    VLOG_QUERY << "Sharing " << best_duplicates.size() + 1 << " occurrences of "
+               << first.expr->DebugString();
+    ++num_shared;
+  }
+  return num_shared;
+}
+
+void CommonSubexprs::StartBatch(RowBatch* batch) {
+  for (SharedExprValues* v: values_) {
+    if (v->capacity < batch->capacity()) {
+      v->capacity = batch->capacity();
+      v->values.reset(new uint8_t[v->capacity * v->value_size]);
+      v->valid.reset(new bool[v->capacity]);
+    }
+    v->first_row = reinterpret_cast<const uint8_t*>(batch->GetRow(0));
+    v->row_size = batch->num_tuples_per_row() * sizeof(Tuple*);
+    v->num_rows = batch->num_rows();
+    memset(v->valid.get(), 0, v->num_rows * sizeof(bool));
+  }
+}
@@ -0,0 +1,164 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_EXPRS_COMMON_SUBEXPR_H
+#define IMPALA_EXPRS_COMMON_SUBEXPR_H
+
+#include <vector>
+#include <boost/scoped_array.hpp>
+
+#include "exprs/expr.h"
+
+namespace impala {
+
+class ExprContext;
+class ObjectPool;
+class RowBatch;
+
+/// The value of a shared subexpression for each row of the current batch, see
+/// CommonSubexprs.
+struct SharedExprValues {
+  /// The shared subexpression and the context it is prepared and evaluated in.
+  Expr* expr;
+  ExprContext* ctx;
+
+  /// The number of bytes of each value, i.e. the size of the AnyVal of the type.
+  int value_size;
+
+  /// The rows of the current batch. A row is cached if it lies in
+  /// [first_row, first_row + num_rows * row_size). 'num_rows' is 0 before the first
+  /// batch, so that all rows are evaluated without caching.
+  const uint8_t* first_row;
+  int row_size;
+  int num_rows;
+
+  /// The number of rows that 'values' and 'valid' have room for.
+  int capacity;
+
+  /// The value of row i and whether it was evaluated for the current batch yet.
+  boost::scoped_array<uint8_t> values;
+  boost::scoped_array<bool> valid;
+};
+
+/// Reads the value of a shared subexpression from a SharedExprValues, evaluating it on
+/// the first read for each row. Every occurrence of the subexpression is replaced by a
+/// SharedExpr. The occurrence in 'values->ctx' keeps the subexpression as its only child,
+/// so that it is prepared, opened and closed with that context; the others don't have
+/// children.
+class SharedExpr : public Expr {
+ public:
+  virtual impala_udf::BooleanVal GetBooleanVal(ExprContext*, TupleRow*);
+  virtual impala_udf::TinyIntVal GetTinyIntVal(ExprContext*, TupleRow*);
+  virtual impala_udf::SmallIntVal GetSmallIntVal(ExprContext*, TupleRow*);
+  virtual impala_udf::IntVal GetIntVal(ExprContext*, TupleRow*);
+  virtual impala_udf::BigIntVal GetBigIntVal(ExprContext*, TupleRow*);
+  virtual impala_udf::FloatVal GetFloatVal(ExprContext*, TupleRow*);
+  virtual impala_udf::DoubleVal GetDoubleVal(ExprContext*, TupleRow*);
+  virtual impala_udf::StringVal GetStringVal(ExprContext*, TupleRow*);
+  virtual impala_udf::TimestampVal GetTimestampVal(ExprContext*, TupleRow*);
+  virtual impala_udf::DecimalVal GetDecimalVal(ExprContext*, TupleRow*);
+
+  /// The codegen'd function calls the interpreted Get*Val() function, which looks up
+  /// the cached value. The shared subexpression itself is still codegen'd.
+  virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
+
+  virtual bool IsConstant() const { return false; }
+  virtual int GetSlotIds(std::vector<SlotId>* slot_ids) const;
+  virtual std::string DebugString() const;
+
+ private:
+  friend class CommonSubexprs;
+
+  SharedExpr(SharedExprValues* values);
+
+  /// Returns the value of the shared subexpression for 'row', which 'GET_VAL' computes.
+  template <typename T, T (Expr::*GET_VAL)(ExprContext*, TupleRow*)>
+  T GetValue(TupleRow* row);
+
+  SharedExprValues* const values_;
+};
+
+/// Per-row common subexpression elimination across the expr trees of an exec node.
+/// Rewrite() finds the subexpressions that occur more than once in the trees and
+/// replaces them with SharedExprs, which evaluate each of them at most once per row of
+/// a batch and return the cached value for the other occurrences. For example, the
+/// grouping expr and the aggregate input in "SELECT upper(s), count(upper(s)) ...
+/// GROUP BY 1" are evaluated only once per input row.
+///
+/// Only subexpressions that are worth caching and are known to return the same value
+/// for the same row are shared: deterministic builtin function calls whose children are
+/// slots, literals or such function calls themselves. They are evaluated lazily, so that
+/// a subexpression that is not evaluated for a row without CSE, e.g. because of the
+/// short-circuiting of a CASE, isn't evaluated with CSE either.
+///
+/// StartBatch() must be called for each batch before the exprs are evaluated over its
+/// rows. The cached values, including the data of string values, belong to the context
+/// of the shared subexpression and must stay valid until the next call, i.e. the
+/// local allocations of the contexts must only be freed between batches. Rows that are
+/// not in the current batch are evaluated without caching.
+///
+/// The contexts must all be used by the same thread and must not be cloned, because the
+/// shared subexpressions are evaluated in the context of their first occurrence.
+class CommonSubexprs {
+ public:
+  CommonSubexprs(ObjectPool* pool) : pool_(pool) { }
+
+  /// Rewrites the expr trees of 'ctxs', which must not be prepared yet. Some of the
+  /// contexts may not be evaluated at all after this, e.g. the first occurrence of
+  /// a subexpression may be in a context that is never used, as long as all of them
+  /// are prepared, opened and closed as before. Returns the number of shared
+  /// subexpressions.
+  int Rewrite(const std::vector<ExprContext*>& ctxs);
+
+  /// Invalidates the cached values and caches the values of the rows of 'batch' from
+  /// now on.
+  void StartBatch(RowBatch* batch);
+
+  int num_shared_exprs() const { return values_.size(); }
+
+ private:
+  /// The position of an occurrence of a subexpression: the root of 'ctx' if 'parent' is
+  /// NULL, and the child 'child_idx' of 'parent' otherwise.
+  struct Occurrence {
+    ExprContext* ctx;
+    Expr* parent;
+    int child_idx;
+    Expr* expr;
+  };
+
+  /// Appends the occurrences of the subexpressions in the tree of 'expr' that may be
+  /// shared to 'occurrences' in pre-order.
+  static void CollectCandidates(ExprContext* ctx, Expr* parent, int child_idx,
+      Expr* expr, std::vector<Occurrence>* occurrences);
+
+  /// Returns true if 'expr' may be shared.
+  static bool IsCandidate(const Expr* expr);
+
+  /// Returns true if 'a' and 'b' are known to compute the same value for every row.
+  static bool Equals(const Expr* a, const Expr* b);
+
+  /// Returns the number of nodes of the tree of 'expr'.
+  static int NumNodes(const Expr* expr);
+
+  /// Replaces the expr at 'occurrence' with 'expr'.
+  static void Replace(const Occurrence& occurrence, Expr* expr);
+
+  ObjectPool* pool_;
+  std::vector<SharedExprValues*> values_;
+};
+
+}
+
+#endif
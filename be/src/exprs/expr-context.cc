@@ -17,6 +17,7 @@
 #include <sstream>
 
 #include "exprs/expr.h"
+#include "exprs/scalar-fn-result-cache.h"
 #include "runtime/decimal-value.inline.h"
 #include "runtime/mem-pool.h"
 #include "runtime/raw-value.inline.h"
@@ -75,6 +76,10 @@ void ExprContext::Close(RuntimeState* state) {
   for (int i = 0; i < fn_contexts_.size(); ++i) {
     fn_contexts_[i]->impl()->Close();
   }
+  for (int i = 0; i < result_caches_.size(); ++i) {
+    delete result_caches_[i];
+  }
+  result_caches_.clear();
   // pool_ can be NULL if Prepare() was never called
   if (pool_ != NULL) pool_->FreeAll();
   closed_ = true;
@@ -90,6 +95,14 @@ int ExprContext::Register(RuntimeState* state,
   return fn_contexts_.size() - 1;
 }
 
+void ExprContext::SetResultCache(int i, ScalarFnResultCache* cache) {
+  DCHECK_GE(i, 0);
+  DCHECK_LT(i, fn_contexts_.size());
+  if (i >= result_caches_.size()) result_caches_.resize(i + 1, NULL);
+  delete result_caches_[i];
+  result_caches_[i] = cache;
+}
+
 Status ExprContext::Clone(RuntimeState* state, ExprContext** new_ctx) {
   DCHECK(prepared_);
   DCHECK(opened_);
@@ -341,6 +354,11 @@ void ExprContext::PrintValue(TupleRow* row, stringstream* stream) {
 BooleanVal ExprContext::GetBooleanVal(TupleRow* row) {
   return root_->GetBooleanVal(this, row);
 }
+int ExprContext::EvalPredicateBatch(Tuple** rows, int num_tuples_per_row,
+    int* selection, int num_selected) {
+  return root_->EvalPredicateBatch(this, rows, num_tuples_per_row, selection,
+      num_selected);
+}
 TinyIntVal ExprContext::GetTinyIntVal(TupleRow* row) {
   return root_->GetTinyIntVal(this, row);
 }
@@ -31,7 +31,9 @@ class MemPool;
 class MemTracker;
 class RuntimeState;
 class RowDescriptor;
+class ScalarFnResultCache;
 class TColumnValue;
+class Tuple;
 class TupleRow;
 
 /// An ExprContext contains the state for the execution of a tree of Exprs, in particular
@@ -107,6 +109,17 @@ class ExprContext {
     return fn_contexts_[i];
   }
 
+  /// Returns the result cache set for the FunctionContext with index 'i', or NULL if
+  /// there is none. This should only be called by Exprs.
+  ScalarFnResultCache* result_cache(int i) {
+    return i < result_caches_.size() ? result_caches_[i] : NULL;
+  }
+
+  /// Sets the result cache of the expr with the FunctionContext 'i', see
+  /// ScalarFnCall. Takes ownership of 'cache', which is deleted in Close(). Clones
+  /// don't share the caches of the original.
+  void SetResultCache(int i, ScalarFnResultCache* cache);
+
   Expr* root() { return root_; }
   bool closed() { return closed_; }
 
@@ -123,6 +136,10 @@ class ExprContext {
   TimestampVal GetTimestampVal(TupleRow* row);
   DecimalVal GetDecimalVal(TupleRow* row);
 
+  /// Calls EvalPredicateBatch() on root_.
+  int EvalPredicateBatch(Tuple** rows, int num_tuples_per_row, int* selection,
+      int num_selected);
+
   /// Returns true if any of the expression contexts in the array has local allocations.
   /// The last two are helper functions.
   static bool HasLocalAllocations(const std::vector<ExprContext*>& ctxs);
@@ -138,6 +155,7 @@ class ExprContext {
   static const char* LLVM_CLASS_NAME;
 
  private:
+  friend class CommonSubexprs;
   friend class Expr;
   /// Users of private GetValue()
   friend class HiveUdfCall;
@@ -152,6 +170,10 @@ class ExprContext {
   /// TODO: revisit this
   FunctionContext** fn_contexts_ptr_;
 
+  /// The result caches set with SetResultCache(), indexed like fn_contexts_. NULL for
+  /// the exprs that don't have one.
+  std::vector<ScalarFnResultCache*> result_caches_;
+
   /// Pool backing fn_contexts_. Counts against the runtime state's UDF mem tracker.
   boost::scoped_ptr<MemPool> pool_;
 
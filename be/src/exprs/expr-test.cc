@@ -34,6 +34,7 @@
 #include "exprs/like-predicate.h"
 #include "exprs/literal.h"
 #include "exprs/null-literal.h"
+#include "exprs/timestamp-functions.h"
 #include "gen-cpp/Exprs_types.h"
 #include "gen-cpp/hive_metastore_types.h"
 #include "rpc/thrift-client.h"
@@ -45,6 +46,7 @@
 #include "service/impala-server.h"
 #include "testutil/impalad-query-executor.h"
 #include "testutil/in-process-servers.h"
+#include "udf/udf-test-harness.h"
 #include "util/debug-util.h"
 #include "util/string-parser.h"
 #include "util/test-info.h"
@@ -64,6 +66,7 @@ using boost::posix_time::to_tm;
 using std::numeric_limits;
 using namespace Apache::Hadoop::Hive;
 using namespace impala;
+using namespace impala_udf;
 using namespace llvm;
 
 namespace impala {
@@ -1504,6 +1507,17 @@ TEST_F(ExprTest, LikePredicate) {
   TestValue("'a1a' LIKE 'a\\_a'", TYPE_BOOLEAN, false);
   TestValue("'abla' LIKE 'a%a'", TYPE_BOOLEAN, true);
   TestValue("'ablb' LIKE 'a%a'", TYPE_BOOLEAN, false);
+  // Patterns of several literal strings separated by '%'.
+  TestValue("'aba' LIKE 'ab%ba'", TYPE_BOOLEAN, false);
+  TestValue("'abba' LIKE 'ab%ba'", TYPE_BOOLEAN, true);
+  TestValue("'xaybzc' LIKE '%a%b%c%'", TYPE_BOOLEAN, true);
+  TestValue("'xayczb' LIKE '%a%b%c%'", TYPE_BOOLEAN, false);
+  TestValue("'abcabc' LIKE 'a%bc%c'", TYPE_BOOLEAN, true);
+  TestValue("'abcab' LIKE 'a%bc%c'", TYPE_BOOLEAN, false);
+  TestValue("'a%bc' LIKE '%a\\%b%c'", TYPE_BOOLEAN, true);
+  TestValue("'abc' LIKE '%a\\%b%c'", TYPE_BOOLEAN, false);
+  TestValue("'100% sure' LIKE '%\\%%'", TYPE_BOOLEAN, true);
+  TestValue("'sure' LIKE '%\\%%'", TYPE_BOOLEAN, false);
   TestValue("'abxcy1234a' LIKE 'a_x_y%a'", TYPE_BOOLEAN, true);
   TestValue("'axcy1234a' LIKE 'a_x_y%a'", TYPE_BOOLEAN, false);
   TestValue("'abxcy1234a' REGEXP 'a.x.y.*a'", TYPE_BOOLEAN, true);
@@ -1791,6 +1805,10 @@ TEST_F(ExprTest, StringFunctions) {
   TestStringValue("lower('Hello')", "hello");
   TestStringValue("lower('hello!')", "hello!");
   TestStringValue("lcase('HELLO')", "hello");
+  // Strings longer than 16 bytes, with non-ASCII characters, which are not converted.
+  TestStringValue("lower('ABCDEFGHIJKLMNOPQRSTUVWXYZ @[`{ ÄÖÜ')",
+      "abcdefghijklmnopqrstuvwxyz @[`{ ÄÖÜ");
+  TestStringValue("lower('abcdefghijklmnopqrstuvwxyz')", "abcdefghijklmnopqrstuvwxyz");
   TestIsNull("lower(NULL)", TYPE_STRING);
   TestIsNull("lcase(NULL)", TYPE_STRING);
 
@@ -1802,6 +1820,8 @@ TEST_F(ExprTest, StringFunctions) {
   TestStringValue("_impala_builtins.upper('hello!')", "HELLO!");
   TestStringValue("_impala_builtins.DECODE('hello!', 'hello!', 'HELLO!')", "HELLO!");
   TestStringValue("ucase('hello')", "HELLO");
+  TestStringValue("upper('abcdefghijklmnopqrstuvwxyz @[`{ äöü')",
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZ @[`{ äöü");
   TestIsNull("upper(NULL)", TYPE_STRING);
   TestIsNull("ucase(NULL)", TYPE_STRING);
 
@@ -1858,6 +1878,7 @@ TEST_F(ExprTest, StringFunctions) {
   TestStringValue("translate('abcd', 'abc', 'xy')", "xyd");
   TestStringValue("translate('abcd', 'abc', 'wxyz')", "wxyd");
   TestStringValue("translate('x', 'xx', 'ab')", "a");
+  TestStringValue("translate('abcd', 'bab', 'xyz')", "yxcd");
   TestIsNull("translate(NULL, '', '')", TYPE_STRING);
   TestIsNull("translate('', NULL, '')", TYPE_STRING);
   TestIsNull("translate('', '', NULL)", TYPE_STRING);
@@ -1868,6 +1889,9 @@ TEST_F(ExprTest, StringFunctions) {
   TestStringValue("trim('abcdefg   ')", "abcdefg");
   TestStringValue("trim('   abcdefg')", "abcdefg");
   TestStringValue("trim('abc  defg')", "abc  defg");
+  TestStringValue("trim('                    abc  defg                    ')",
+      "abc  defg");
+  TestStringValue("trim('                                        ')", "");
   TestIsNull("trim(NULL)", TYPE_STRING);
   TestStringValue("ltrim('')", "");
   TestStringValue("ltrim('      ')", "");
@@ -1875,6 +1899,8 @@ TEST_F(ExprTest, StringFunctions) {
   TestStringValue("ltrim('abcdefg   ')", "abcdefg   ");
   TestStringValue("ltrim('   abcdefg')", "abcdefg");
   TestStringValue("ltrim('abc  defg')", "abc  defg");
+  TestStringValue("ltrim('                    abcdefghijklmnopqrstuvwxyz ')",
+      "abcdefghijklmnopqrstuvwxyz ");
   TestIsNull("ltrim(NULL)", TYPE_STRING);
   TestStringValue("rtrim('')", "");
   TestStringValue("rtrim('      ')", "");
@@ -1882,6 +1908,8 @@ TEST_F(ExprTest, StringFunctions) {
   TestStringValue("rtrim('abcdefg   ')", "abcdefg");
   TestStringValue("rtrim('   abcdefg')", "   abcdefg");
   TestStringValue("rtrim('abc  defg')", "abc  defg");
+  TestStringValue("rtrim(' abcdefghijklmnopqrstuvwxyz                    ')",
+      " abcdefghijklmnopqrstuvwxyz");
   TestIsNull("rtrim(NULL)", TYPE_STRING);
 
   TestStringValue("btrim('     abcdefg   ')", "abcdefg");
@@ -4327,6 +4355,60 @@ TEST_F(ExprTest, TimestampFunctions) {
   TestValue("unix_timestamp('12/31/2015', 'MM/dd/yyyy')", TYPE_BIGINT, 1451520000);
 }
 
+// With a constant timezone, from_utc_timestamp() and to_utc_timestamp() convert through
+// the table of transitions that FromUtcAndToUtcPrepare() builds. Check that it agrees
+// with boost around the daylight savings transitions.
+TEST_F(ExprTest, TimezoneTransitions) {
+  FunctionContext::TypeDesc timestamp_type;
+  timestamp_type.type = FunctionContext::TYPE_TIMESTAMP;
+  FunctionContext::TypeDesc string_type;
+  string_type.type = FunctionContext::TYPE_STRING;
+  vector<FunctionContext::TypeDesc> arg_types;
+  arg_types.push_back(timestamp_type);
+  arg_types.push_back(string_type);
+  StringVal tz("America/Los_Angeles");
+  vector<AnyVal*> constant_args;
+  constant_args.push_back(NULL);
+  constant_args.push_back(&tz);
+
+  // 'ctx' has the table, 'boost_ctx' converts with boost.
+  scoped_ptr<FunctionContext> ctx(
+      UdfTestHarness::CreateTestContext(timestamp_type, arg_types));
+  UdfTestHarness::SetConstantArgs(ctx.get(), constant_args);
+  TimestampFunctions::FromUtcAndToUtcPrepare(ctx.get(), FunctionContext::FRAGMENT_LOCAL);
+  TimestampFunctions::FromUtcAndToUtcPrepare(ctx.get(), FunctionContext::THREAD_LOCAL);
+  EXPECT_TRUE(ctx->GetFunctionState(FunctionContext::THREAD_LOCAL) != NULL);
+  scoped_ptr<FunctionContext> boost_ctx(
+      UdfTestHarness::CreateTestContext(timestamp_type, arg_types));
+
+  // Daylight savings time started on 2011-03-13 at 10:00 UTC and ended on 2011-11-06 at
+  // 09:00 UTC.
+  const char* utc_times[] = {"2011-03-13 09:59:59.5", "2011-03-13 10:00:00",
+      "2011-11-06 08:59:59", "2011-11-06 09:00:00", "1850-01-01 00:00:00"};
+  const char* local_times[] = {"2011-03-13 01:59:59.5", "2011-03-13 03:00:00",
+      "2011-11-06 01:59:59", "2011-11-06 01:00:00", "1849-12-31 16:00:00"};
+  for (int i = 0; i < sizeof(utc_times) / sizeof(utc_times[0]); ++i) {
+    TimestampVal utc_val;
+    TimestampValue(utc_times[i], strlen(utc_times[i])).ToTimestampVal(&utc_val);
+    TimestampVal local_val = TimestampFunctions::FromUtc(ctx.get(), utc_val, tz);
+    EXPECT_EQ(TimestampValue::FromTimestampVal(local_val),
+        TimestampValue::FromTimestampVal(
+            TimestampFunctions::FromUtc(boost_ctx.get(), utc_val, tz))) << utc_times[i];
+    EXPECT_EQ(TimestampValue::FromTimestampVal(local_val),
+        TimestampValue(local_times[i], strlen(local_times[i]))) << utc_times[i];
+
+    TimestampVal to_utc_val = TimestampFunctions::ToUtc(ctx.get(), local_val, tz);
+    EXPECT_EQ(TimestampValue::FromTimestampVal(to_utc_val),
+        TimestampValue::FromTimestampVal(
+            TimestampFunctions::ToUtc(boost_ctx.get(), local_val, tz))) << utc_times[i];
+  }
+
+  TimestampFunctions::FromUtcAndToUtcClose(ctx.get(), FunctionContext::THREAD_LOCAL);
+  TimestampFunctions::FromUtcAndToUtcClose(ctx.get(), FunctionContext::FRAGMENT_LOCAL);
+  UdfTestHarness::CloseContext(ctx.get());
+  UdfTestHarness::CloseContext(boost_ctx.get());
+}
+
 TEST_F(ExprTest, ConditionalFunctions) {
   // If first param evaluates to true, should return second parameter,
   // false or NULL should return the third.
@@ -720,6 +720,20 @@ DecimalVal Expr::GetDecimalVal(ExprContext* context, TupleRow* row) {
   return DecimalVal::null();
 }
 
+int Expr::EvalPredicateBatch(ExprContext* context, Tuple** rows, int num_tuples_per_row,
+    int* selection, int num_selected) {
+  DCHECK_EQ(type_.type, TYPE_BOOLEAN);
+  int num_passed = 0;
+  for (int i = 0; i < num_selected; ++i) {
+    int row_idx = selection[i];
+    BooleanVal v = GetBooleanVal(context,
+        reinterpret_cast<TupleRow*>(rows + row_idx * num_tuples_per_row));
+    selection[num_passed] = row_idx;
+    num_passed += !v.is_null && v.val;
+  }
+  return num_passed;
+}
+
 Status Expr::GetFnContextError(ExprContext* ctx) {
   if (fn_context_index_ != -1) {
     FunctionContext* fn_ctx = ctx->fn_context(fn_context_index_);
@@ -120,6 +120,7 @@ class RuntimeState;
 class TColumnValue;
 class TExpr;
 class TExprNode;
+class Tuple;
 
 /// This is the superclass of all expr evaluation nodes.
 class Expr {
@@ -142,6 +143,15 @@ class Expr {
   virtual TimestampVal GetTimestampVal(ExprContext* context, TupleRow*);
   virtual DecimalVal GetDecimalVal(ExprContext* context, TupleRow*);
 
+  /// Evaluates this boolean expr over a batch of rows and keeps the rows for which it is
+  /// true. 'rows' points to the first tuple of the rows, which are laid out like in a
+  /// RowBatch with 'num_tuples_per_row' tuples each. 'selection' holds the indices of the
+  /// 'num_selected' rows to evaluate in increasing order. It is compacted in place to the
+  /// indices of the rows that pass, whose number is returned. The default implementation
+  /// calls GetBooleanVal() for each row, subclasses can evaluate the batch in one loop.
+  virtual int EvalPredicateBatch(ExprContext* context, Tuple** rows,
+      int num_tuples_per_row, int* selection, int num_selected);
+
   /// Get the number of digits after the decimal that should be displayed for this value.
   /// Returns -1 if no scale has been specified (currently the scale is only set for
   /// doubles set by RoundUpTo). GetValue() must have already been called.
@@ -155,6 +165,9 @@ class Expr {
   const ColumnType& type() const { return type_; }
   bool is_slotref() const { return is_slotref_; }
 
+  /// Returns the function description. Only set for function call exprs.
+  const TFunction& fn() const { return fn_; }
+
   const std::vector<Expr*>& children() const { return children_; }
 
   /// Returns an error status if the function context associated with the
@@ -298,6 +311,7 @@ class Expr {
  protected:
   friend class AggFnEvaluator;
   friend class CastExpr;
+  friend class CommonSubexprs;
   friend class ComputeFunctions;
   friend class DecimalFunctions;
   friend class DecimalLliteral;
@@ -33,6 +33,7 @@
 const char* EXECUTOR_CLASS = "com/cloudera/impala/hive/executor/UdfExecutor";
 const char* EXECUTOR_CTOR_SIGNATURE ="([B)V";
 const char* EXECUTOR_EVALUATE_SIGNATURE = "()V";
+const char* EXECUTOR_EVALUATE_BATCH_SIGNATURE = "(IJJJJ)V";
 const char* EXECUTOR_CLOSE_SIGNATURE = "()V";
 
 namespace impala {
@@ -40,6 +41,7 @@ namespace impala {
 jclass HiveUdfCall::executor_cl_ = NULL;
 jmethodID HiveUdfCall::executor_ctor_id_ = NULL;
 jmethodID HiveUdfCall::executor_evaluate_id_ = NULL;
+jmethodID HiveUdfCall::executor_evaluate_batch_id_ = NULL;
 jmethodID HiveUdfCall::executor_close_id_ = NULL;
 
 struct JniContext {
@@ -53,6 +55,12 @@ struct JniContext {
 
   AnyVal* output_anyval;
 
+  /// The buffers of EvalPredicateBatch(), reused across batches.
+  vector<uint8_t> batch_input_values;
+  vector<uint8_t> batch_input_nulls;
+  vector<uint8_t> batch_output_values;
+  vector<uint8_t> batch_output_nulls;
+
   JniContext()
     : executor(NULL),
       input_values_buffer(NULL),
@@ -87,15 +95,38 @@ AnyVal* HiveUdfCall::Evaluate(ExprContext* ctx, TupleRow* row) {
     return jni_ctx->output_anyval;
   }
 
-  // Evaluate all the children values and put the results in input_values_buffer
+  WriteInputs(ctx, row, jni_ctx->input_values_buffer, jni_ctx->input_nulls_buffer);
+
+  // Using this version of Call has the lowest overhead. This eliminates the
+  // vtable lookup and setting up return stacks.
+  env->CallNonvirtualVoidMethodA(
+      jni_ctx->executor, executor_cl_, executor_evaluate_id_, NULL);
+  Status status = JniUtil::GetJniExceptionMsg(env);
+  if (!status.ok()) {
+    AddEvaluateWarning(fn_ctx, jni_ctx, status);
+    jni_ctx->output_anyval->is_null = true;
+    return jni_ctx->output_anyval;
+  }
+
+  // Write output_value_buffer to output_anyval
+  if (jni_ctx->output_null_value) {
+    jni_ctx->output_anyval->is_null = true;
+  } else {
+    AnyValUtil::SetAnyVal(jni_ctx->output_value_buffer, type(), jni_ctx->output_anyval);
+  }
+  return jni_ctx->output_anyval;
+}
+
+void HiveUdfCall::WriteInputs(ExprContext* ctx, TupleRow* row, uint8_t* input_values,
+    uint8_t* input_nulls) {
   for (int i = 0; i < GetNumChildren(); ++i) {
     void* v = ctx->GetValue(GetChild(i), row);
 
     if (v == NULL) {
-      jni_ctx->input_nulls_buffer[i] = 1;
+      input_nulls[i] = 1;
     } else {
-      uint8_t* input_ptr = jni_ctx->input_values_buffer + input_byte_offsets_[i];
-      jni_ctx->input_nulls_buffer[i] = 0;
+      uint8_t* input_ptr = input_values + input_byte_offsets_[i];
+      input_nulls[i] = 0;
       switch (GetChild(i)->type().type) {
         case TYPE_BOOLEAN:
         case TYPE_TINYINT:
@@ -123,31 +154,65 @@ AnyVal* HiveUdfCall::Evaluate(ExprContext* ctx, TupleRow* row) {
       }
     }
   }
+}
 
-  // Using this version of Call has the lowest overhead. This eliminates the
-  // vtable lookup and setting up return stacks.
+void HiveUdfCall::AddEvaluateWarning(FunctionContext* fn_ctx, JniContext* jni_ctx,
+    const Status& status) {
+  if (jni_ctx->warning_logged) return;
+  stringstream ss;
+  ss << "Hive UDF path=" << fn_.hdfs_location << " class=" << fn_.scalar_fn.symbol
+    << " failed due to: " << status.GetDetail();
+  fn_ctx->AddWarning(ss.str().c_str());
+  jni_ctx->warning_logged = true;
+}
+
+int HiveUdfCall::EvalPredicateBatch(ExprContext* ctx, Tuple** rows,
+    int num_tuples_per_row, int* selection, int num_selected) {
+  JNIEnv* env = getJNIEnv();
+  if (executor_evaluate_batch_id_ == NULL || env == NULL || num_selected == 0) {
+    return Expr::EvalPredicateBatch(ctx, rows, num_tuples_per_row, selection,
+        num_selected);
+  }
+  FunctionContext* fn_ctx = ctx->fn_context(fn_context_index_);
+  JniContext* jni_ctx = reinterpret_cast<JniContext*>(
+      fn_ctx->GetFunctionState(FunctionContext::THREAD_LOCAL));
+  DCHECK(jni_ctx != NULL);
+  DCHECK_EQ(type_.type, TYPE_BOOLEAN);
+
+  // Lay out the inputs of each row like the per-row input buffers, one after another.
+  int num_children = GetNumChildren();
+  jni_ctx->batch_input_values.resize(
+      max<int64_t>(num_selected * input_buffer_size_, 1));
+  jni_ctx->batch_input_nulls.resize(max(num_selected * num_children, 1));
+  jni_ctx->batch_output_values.resize(num_selected * type_.GetSlotSize());
+  jni_ctx->batch_output_nulls.resize(num_selected);
+  for (int i = 0; i < num_selected; ++i) {
+    TupleRow* row = reinterpret_cast<TupleRow*>(rows + selection[i] * num_tuples_per_row);
+    WriteInputs(ctx, row, &jni_ctx->batch_input_values[i * input_buffer_size_],
+        &jni_ctx->batch_input_nulls[i * num_children]);
+  }
+
+  jvalue args[5];
+  args[0].i = num_selected;
+  args[1].j = reinterpret_cast<int64_t>(jni_ctx->batch_input_values.data());
+  args[2].j = reinterpret_cast<int64_t>(jni_ctx->batch_input_nulls.data());
+  args[3].j = reinterpret_cast<int64_t>(jni_ctx->batch_output_values.data());
+  args[4].j = reinterpret_cast<int64_t>(jni_ctx->batch_output_nulls.data());
   env->CallNonvirtualVoidMethodA(
-      jni_ctx->executor, executor_cl_, executor_evaluate_id_, NULL);
+      jni_ctx->executor, executor_cl_, executor_evaluate_batch_id_, args);
   Status status = JniUtil::GetJniExceptionMsg(env);
   if (!status.ok()) {
-    if (!jni_ctx->warning_logged) {
-      stringstream ss;
-      ss << "Hive UDF path=" << fn_.hdfs_location << " class=" << fn_.scalar_fn.symbol
-        << " failed due to: " << status.GetDetail();
-      fn_ctx->AddWarning(ss.str().c_str());
-      jni_ctx->warning_logged = true;
-    }
-    jni_ctx->output_anyval->is_null = true;
-    return jni_ctx->output_anyval;
+    // All rows evaluate to NULL, like with the per-row evaluation.
+    AddEvaluateWarning(fn_ctx, jni_ctx, status);
+    return 0;
   }
 
-  // Write output_value_buffer to output_anyval
-  if (jni_ctx->output_null_value) {
-    jni_ctx->output_anyval->is_null = true;
-  } else {
-    AnyValUtil::SetAnyVal(jni_ctx->output_value_buffer, type(), jni_ctx->output_anyval);
+  int num_passed = 0;
+  for (int i = 0; i < num_selected; ++i) {
+    selection[num_passed] = selection[i];
+    num_passed += !jni_ctx->batch_output_nulls[i] && jni_ctx->batch_output_values[i];
   }
-  return jni_ctx->output_anyval;
+  return num_passed;
 }
 
 Status HiveUdfCall::Init() {
@@ -161,6 +226,14 @@ Status HiveUdfCall::Init() {
   executor_evaluate_id_ = env->GetMethodID(
       executor_cl_, "evaluate", EXECUTOR_EVALUATE_SIGNATURE);
   RETURN_ERROR_IF_EXC(env);
+  // The batched evaluation is optional, older executors only evaluate single rows.
+  executor_evaluate_batch_id_ = env->GetMethodID(
+      executor_cl_, "evaluateBatch", EXECUTOR_EVALUATE_BATCH_SIGNATURE);
+  if (env->ExceptionCheck()) {
+    env->ExceptionClear();
+    executor_evaluate_batch_id_ = NULL;
+    LOG(INFO) << "UdfExecutor.evaluateBatch() not found, Hive UDFs are evaluated per row";
+  }
   executor_close_id_ = env->GetMethodID(
       executor_cl_, "close", EXECUTOR_CLOSE_SIGNATURE);
   RETURN_ERROR_IF_EXC(env);
@@ -28,6 +28,7 @@ namespace impala {
 
 class TExprNode;
 class RuntimeState;
+struct JniContext;
 
 /// Executor for hive udfs using JNI. This works with the UdfExecutor on the
 /// java side which calls into the actual UDF.
@@ -55,6 +56,15 @@ class RuntimeState;
 /// The BE reads the StringValue as normal.
 //
 /// If the UDF ran into an error, the FE throws an exception.
+//
+/// Predicates are evaluated a batch at a time if the UdfExecutor has a method
+///   void evaluateBatch(int numRows, long inputValuesPtr, long inputNullsPtr,
+///       long outputValuesPtr, long outputNullsPtr)
+/// which evaluates 'numRows' rows with a single JNI call. The inputs of row i are laid
+/// out like the per-row input buffer at inputValuesPtr + i * input_buffer_size_ and
+/// their NULL indicators at inputNullsPtr + i * (number of arguments). The result of
+/// row i is written to outputValuesPtr + i * (slot size of the return type), and its
+/// NULL indicator to the byte outputNullsPtr + i.
 class HiveUdfCall : public Expr {
  public:
   /// Must be called before creating any HiveUdfCall instances. This is called at impalad
@@ -81,6 +91,11 @@ class HiveUdfCall : public Expr {
 
   virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
 
+  /// Evaluates the batch with one call of UdfExecutor.evaluateBatch() if the executor
+  /// has that method, and row by row otherwise.
+  virtual int EvalPredicateBatch(ExprContext* ctx, Tuple** rows,
+      int num_tuples_per_row, int* selection, int num_selected);
+
  protected:
   friend class Expr;
   friend class StringFunctions;
@@ -94,6 +109,15 @@ class HiveUdfCall : public Expr {
   /// error.
   AnyVal* Evaluate(ExprContext* ctx, TupleRow* row);
 
+  /// Evaluates the children over 'row' and writes their values and NULL indicators to
+  /// the input buffers 'input_values' and 'input_nulls' of a row.
+  void WriteInputs(ExprContext* ctx, TupleRow* row, uint8_t* input_values,
+      uint8_t* input_nulls);
+
+  /// Adds a warning for the failure 'status' of the UDF to 'fn_ctx', once per context.
+  void AddEvaluateWarning(FunctionContext* fn_ctx, JniContext* jni_ctx,
+      const Status& status);
+
   /// The path on the local FS to the UDF's jar
   std::string local_location_;
 
@@ -109,6 +133,8 @@ class HiveUdfCall : public Expr {
   static jclass executor_cl_;
   static jmethodID executor_ctor_id_;
   static jmethodID executor_evaluate_id_;
+  /// NULL if the UdfExecutor doesn't have evaluateBatch().
+  static jmethodID executor_evaluate_batch_id_;
   static jmethodID executor_close_id_;
 };
 
@@ -16,6 +16,8 @@
 // Note: The results do not include the pre-processing in the prepare function that is
 // necessary for SetLookup but not Iterate. None of the values searched for are in the
 // fabricated IN list (i.e. hit rate is 0).
+// The SetLookup results below are from the std::set based implementation, which was
+// replaced by a hash table and a scan of short numeric lists.
 
 // Machine Info: Intel(R) Core(TM) i7-2600 CPU @ 3.40GHz
 // int n=1:              Function     Rate (iters/ms)          Comparison
@@ -183,6 +185,11 @@ template<> StringVal MakeAnyVal(int v) {
   return StringVal(reinterpret_cast<uint8_t*>(const_cast<char*>(s->c_str())), s->size());
 }
 
+template<> TimestampVal MakeAnyVal(int v) {
+  // A day in 2014 and a time of day, so that the values are valid timestamps.
+  return TimestampVal(2456659 + v % 365, (v % 86400) * 1000000000L);
+}
+
 class InPredicateBenchmark {
  public:
   template<typename T, typename SetType>
@@ -300,6 +307,19 @@ class InPredicateBenchmark {
     cout << suite.Measure() << endl;
   }
 
+  static void RunTimestampBenchmark(int n) {
+    Benchmark suite(Substitute("timestamp n=$0", n));
+    FunctionContext::TypeDesc type;
+    type.type = FunctionContext::TYPE_TIMESTAMP;
+    TestData<TimestampVal, TimestampValue> data =
+        InPredicateBenchmark::CreateTestData<TimestampVal, TimestampValue>(n, type);
+    suite.AddBenchmark(Substitute("SetLookup n=$0", n),
+        InPredicateBenchmark::TestSetLookup<TimestampVal, TimestampValue>, &data);
+    suite.AddBenchmark(Substitute("Iterate n=$0", n),
+        InPredicateBenchmark::TestIterate<TimestampVal, TimestampValue>, &data);
+    cout << suite.Measure() << endl;
+  }
+
  private:
   static FunctionContext* CreateContext(
       int num_args, const FunctionContext::TypeDesc& type) {
@@ -317,7 +337,10 @@ int main(int argc, char **argv) {
   CpuInfo::Init();
   cout << Benchmark::GetMachineInfo() << endl;
 
+  // Lists of up to InPredicate::MAX_SCANNED_VALUES values are scanned.
   for (int i = 1; i <= 10; ++i) InPredicateBenchmark::RunIntBenchmark(i);
+  InPredicateBenchmark::RunIntBenchmark(16);
+  InPredicateBenchmark::RunIntBenchmark(17);
   InPredicateBenchmark::RunIntBenchmark(400);
 
   cout << endl;
@@ -328,5 +351,8 @@ int main(int argc, char **argv) {
   for (int i = 1; i <= 4; ++i) InPredicateBenchmark::RunDecimalBenchmark(i);
   InPredicateBenchmark::RunDecimalBenchmark(400);
 
+  for (int i = 1; i <= 4; ++i) InPredicateBenchmark::RunTimestampBenchmark(i);
+  InPredicateBenchmark::RunTimestampBenchmark(400);
+
   return 0;
 }
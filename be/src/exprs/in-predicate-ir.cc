@@ -13,11 +13,16 @@
 // limitations under the License.
 
 #include <sstream>
+#include <type_traits>
 
 #include "exprs/in-predicate.h"
 
 #include "exprs/anyval-util.h"
+#include "runtime/decimal-value.inline.h"
 #include "runtime/string-value.inline.h"
+#include "runtime/timestamp-value.h"
+#include "util/bit-util.h"
+#include "util/hash-util.h"
 
 #include "common/names.h"
 
@@ -53,6 +58,68 @@ template<> Decimal16Value GetVal(
   }
 }
 
+// Hash functions for the values of the IN list hash tables. Values that compare equal
+// must have the same hash.
+template<typename SetType>
+uint32_t HashSetVal(const SetType& v) {
+  return HashUtil::Hash(&v, sizeof(v), 0);
+}
+
+// 0.0 and -0.0 are equal, but have different representations.
+template<> uint32_t HashSetVal(const float& v) {
+  float normalized = v == 0 ? 0 : v;
+  return HashUtil::Hash(&normalized, sizeof(normalized), 0);
+}
+
+template<> uint32_t HashSetVal(const double& v) {
+  double normalized = v == 0 ? 0 : v;
+  return HashUtil::Hash(&normalized, sizeof(normalized), 0);
+}
+
+template<> uint32_t HashSetVal(const StringValue& v) {
+  return HashUtil::Hash(v.ptr, v.len, 0);
+}
+
+template<> uint32_t HashSetVal(const TimestampValue& v) {
+  return v.Hash();
+}
+
+template<> uint32_t HashSetVal(const Decimal16Value& v) {
+  return v.Hash();
+}
+
+template<typename SetType>
+bool InPredicate::Contains(const SetLookupState<SetType>& state, const SetType& val) {
+  if (state.buckets.empty()) {
+    // Compare with all values without branching on the results, so that the loop is
+    // vectorized.
+    bool found = false;
+    for (int i = 0; i < state.vals.size(); ++i) found |= state.vals[i] == val;
+    return found;
+  }
+  uint32_t mask = state.buckets.size() - 1;
+  for (uint32_t bucket = HashSetVal(val) & mask; ; bucket = (bucket + 1) & mask) {
+    int idx = state.buckets[bucket];
+    if (idx == 0) return false;
+    if (state.vals[idx - 1] == val) return true;
+  }
+}
+
+template<typename SetType>
+void InPredicate::Insert(SetLookupState<SetType>* state, const SetType& val) {
+  DCHECK(!state->buckets.empty());
+  uint32_t mask = state->buckets.size() - 1;
+  for (uint32_t bucket = HashSetVal(val) & mask; ; bucket = (bucket + 1) & mask) {
+    int idx = state->buckets[bucket];
+    if (idx == 0) {
+      state->vals.push_back(val);
+      state->buckets[bucket] = state->vals.size();
+      return;
+    }
+    if (state->vals[idx - 1] == val) return;
+  }
+}
+
 template<typename T, typename SetType>
 void InPredicate::SetLookupPrepare(
     FunctionContext* ctx, FunctionContext::FunctionStateScope scope) {
@@ -61,15 +128,20 @@ void InPredicate::SetLookupPrepare(
   SetLookupState<SetType>* state = new SetLookupState<SetType>;
   state->type = ctx->GetArgType(0);
   state->contains_null = false;
+  // Keep at most half of the buckets occupied.
+  state->buckets.resize(BitUtil::RoundUpToPowerOfTwo(max(2 * ctx->GetNumArgs(), 2)));
   for (int i = 1; i < ctx->GetNumArgs(); ++i) {
     DCHECK(ctx->IsArgConstant(i));
     T* arg = reinterpret_cast<T*>(ctx->GetConstantArg(i));
     if (arg->is_null) {
       state->contains_null = true;
     } else {
-      state->val_set.insert(GetVal<T, SetType>(state->type, *arg));
+      Insert(state, GetVal<T, SetType>(state->type, *arg));
     }
   }
+  if (std::is_arithmetic<SetType>::value && state->vals.size() <= MAX_SCANNED_VALUES) {
+    state->buckets.clear();
+  }
   ctx->SetFunctionState(scope, state);
 }
 
@@ -106,8 +178,7 @@ BooleanVal InPredicate::SetLookup(
     SetLookupState<SetType>* state, const T& v) {
   DCHECK(state != NULL);
   SetType val = GetVal<T, SetType>(state->type, v);
-  bool found = state->val_set.find(val) != state->val_set.end();
-  if (found) return BooleanVal(true);
+  if (Contains(*state, val)) return BooleanVal(true);
   if (state->contains_null) return BooleanVal::null();
   return BooleanVal(false);
 }
@@ -74,27 +74,29 @@ void LikePredicate::LikePrepareInternal(FunctionContext* context,
     StringVal pattern_val = *reinterpret_cast<StringVal*>(context->GetConstantArg(1));
     if (pattern_val.is_null) return;
     StringValue pattern = StringValue::FromStringVal(pattern_val);
-    re2::RE2 substring_re("(?:%+)([^%_]*)(?:%+)");
-    re2::RE2 ends_with_re("(?:%+)([^%_]*)");
-    re2::RE2 starts_with_re("([^%_]*)(?:%+)");
-    re2::RE2 equals_re("([^%_]*)");
     string pattern_str(pattern.ptr, pattern.len);
-    string search_string;
-    if (case_sensitive && RE2::FullMatch(pattern_str, substring_re, &search_string)) {
-      state->SetSearchString(search_string);
-      state->function_ = ConstantSubstringFn;
-    } else if (case_sensitive &&
-        RE2::FullMatch(pattern_str, starts_with_re, &search_string)) {
-      state->SetSearchString(search_string);
-      state->function_ = ConstantStartsWithFn;
-    } else if (case_sensitive &&
-        RE2::FullMatch(pattern_str, ends_with_re, &search_string)) {
-      state->SetSearchString(search_string);
-      state->function_ = ConstantEndsWithFn;
-    } else if (case_sensitive &&
-        RE2::FullMatch(pattern_str, equals_re, &search_string)) {
-      state->SetSearchString(search_string);
-      state->function_ = ConstantEqualsFn;
+    vector<string> match_strings;
+    bool anchored_start;
+    bool anchored_end;
+    // Patterns without '_' wildcards are matched by searching for their literal strings
+    // instead of with a regex. Splitting the pattern also handles escaped wildcards.
+    if (case_sensitive && SplitLikePattern(pattern_str, state->escape_char_,
+        &match_strings, &anchored_start, &anchored_end)) {
+      if (match_strings.size() > 1) {
+        state->SetMatchStrings(match_strings, anchored_start, anchored_end);
+        state->function_ = ConstantMultiSubstringFn;
+      } else {
+        state->SetSearchString(match_strings.empty() ? "" : match_strings[0]);
+        if (anchored_start && anchored_end) {
+          state->function_ = ConstantEqualsFn;
+        } else if (anchored_start) {
+          state->function_ = ConstantStartsWithFn;
+        } else if (anchored_end) {
+          state->function_ = ConstantEndsWithFn;
+        } else {
+          state->function_ = ConstantSubstringFn;
+        }
+      }
     } else {
       string re_pattern;
       ConvertLikePattern(context,
@@ -322,6 +324,43 @@ BooleanVal LikePredicate::ConstantEqualsFn(FunctionContext* context, const Strin
   return BooleanVal(state->search_string_sv_.Eq(StringValue::FromStringVal(val)));
 }
 
+BooleanVal LikePredicate::ConstantMultiSubstringFn(FunctionContext* context,
+    const StringVal& val, const StringVal& pattern) {
+  if (val.is_null) return BooleanVal::null();
+  LikePredicateState* state = reinterpret_cast<LikePredicateState*>(
+      context->GetFunctionState(FunctionContext::THREAD_LOCAL));
+  const vector<StringValue>& match_strings = state->match_string_svs_;
+  const char* ptr = reinterpret_cast<const char*>(val.ptr);
+  // The remaining strings must be found in [pos, end).
+  int pos = 0;
+  int end = val.len;
+  int first = 0;
+  int last = match_strings.size();
+  if (state->match_anchored_start_) {
+    const StringValue& prefix = match_strings[first++];
+    if (prefix.len > end || memcmp(ptr, prefix.ptr, prefix.len) != 0) {
+      return BooleanVal(false);
+    }
+    pos = prefix.len;
+  }
+  if (state->match_anchored_end_) {
+    DCHECK_LT(first, last);
+    const StringValue& suffix = match_strings[--last];
+    if (suffix.len > end - pos ||
+        memcmp(ptr + end - suffix.len, suffix.ptr, suffix.len) != 0) {
+      return BooleanVal(false);
+    }
+    end -= suffix.len;
+  }
+  for (int i = first; i < last; ++i) {
+    StringValue remaining(const_cast<char*>(ptr) + pos, end - pos);
+    int offset = state->match_searches_[i].Search(&remaining);
+    if (offset == -1) return BooleanVal(false);
+    pos += offset + match_strings[i].len;
+  }
+  return BooleanVal(true);
+}
+
 BooleanVal LikePredicate::ConstantRegexFnPartial(FunctionContext* context,
     const StringVal& val, const StringVal& pattern) {
   if (val.is_null) return BooleanVal::null();
@@ -355,31 +394,74 @@ BooleanVal LikePredicate::RegexMatch(FunctionContext* context,
           operand_value.ptr), operand_value.len), *state->regex_.get());
     }
   } else {
-    string re_pattern;
-    RE2::Options opts;
-    if (is_like_pattern) {
-      ConvertLikePattern(context, pattern_value, &re_pattern);
-      opts.set_never_nl(false);
-      opts.set_dot_nl(true);
+    LikePredicateState* state = reinterpret_cast<LikePredicateState*>(
+        context->GetFunctionState(FunctionContext::THREAD_LOCAL));
+    string pattern_str(
+        reinterpret_cast<const char*>(pattern_value.ptr), pattern_value.len);
+    re2::RE2* re;
+    LikePredicateState::RegexCache::const_iterator it =
+        state->regex_cache_.find(pattern_str);
+    if (LIKELY(it != state->regex_cache_.end())) {
+      re = it->second;
     } else {
-      re_pattern =
-        string(reinterpret_cast<const char*>(pattern_value.ptr), pattern_value.len);
-    }
-    re2::RE2 re(re_pattern, opts);
-    if (re.ok()) {
+      string re_pattern;
+      RE2::Options opts;
       if (is_like_pattern) {
-        return RE2::FullMatch(re2::StringPiece(
-            reinterpret_cast<const char*>(operand_value.ptr), operand_value.len), re);
+        ConvertLikePattern(context, pattern_value, &re_pattern);
+        opts.set_never_nl(false);
+        opts.set_dot_nl(true);
       } else {
-        return RE2::PartialMatch(re2::StringPiece(
-            reinterpret_cast<const char*>(operand_value.ptr), operand_value.len), re);
+        re_pattern = pattern_str;
+      }
+      scoped_ptr<re2::RE2> new_re(new re2::RE2(re_pattern, opts));
+      if (!new_re->ok()) {
+        context->SetError(
+            strings::Substitute("Invalid regex: $0", pattern_value.ptr).c_str());
+        return BooleanVal(false);
+      }
+      if (state->regex_cache_.size() >= LikePredicateState::MAX_CACHED_REGEXES) {
+        state->ClearRegexCache();
       }
+      re = new_re.release();
+      state->regex_cache_[pattern_str] = re;
+    }
+    if (is_like_pattern) {
+      return RE2::FullMatch(re2::StringPiece(
+          reinterpret_cast<const char*>(operand_value.ptr), operand_value.len), *re);
     } else {
-      context->SetError(
-          strings::Substitute("Invalid regex: $0", pattern_value.ptr).c_str());
-      return BooleanVal(false);
+      return RE2::PartialMatch(re2::StringPiece(
+          reinterpret_cast<const char*>(operand_value.ptr), operand_value.len), *re);
+    }
+  }
+}
+
+bool LikePredicate::SplitLikePattern(const string& pattern, char escape_char,
+    vector<string>* match_strings, bool* anchored_start, bool* anchored_end) {
+  match_strings->clear();
+  string current;
+  bool is_escaped = false;
+  bool last_is_wildcard = false;
+  for (int i = 0; i < pattern.size(); ++i) {
+    char c = pattern[i];
+    last_is_wildcard = false;
+    if (!is_escaped && c == '%') {
+      if (!current.empty()) match_strings->push_back(current);
+      current.clear();
+      last_is_wildcard = true;
+    } else if (!is_escaped && c == '_') {
+      return false;
+    } else if (!is_escaped && c == escape_char) {
+      is_escaped = true;
+    } else {
+      current.append(1, c);
+      is_escaped = false;
     }
   }
+  if (is_escaped) return false;
+  if (!current.empty()) match_strings->push_back(current);
+  *anchored_start = pattern.empty() || pattern[0] != '%';
+  *anchored_end = !last_is_wildcard;
+  return true;
 }
 
 void LikePredicate::ConvertLikePattern(FunctionContext* context, const StringVal& pattern,
@@ -17,8 +17,10 @@
 #define IMPALA_EXPRS_LIKE_PREDICATE_H_
 
 #include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
 #include <re2/re2.h>
 #include <string>
+#include <vector>
 
 #include "exprs/predicate.h"
 #include "gen-cpp/Exprs_types.h"
@@ -71,17 +73,63 @@ class LikePredicate: public Predicate {
     /// in the value.
     StringSearch substring_pattern_;
 
+    /// Used for LIKE predicates if the pattern is a constant argument that consists of
+    /// two or more literal strings separated by '%', e.g. 'a%b' or '%a%b%c%'. The
+    /// strings are matched in order, each one at its leftmost occurrence after the
+    /// previous one, which finds a match whenever one exists. The first string must be
+    /// a prefix of the value if 'match_anchored_start_' is true and the last one a
+    /// suffix if 'match_anchored_end_' is true.
+    std::vector<std::string> match_strings_;
+    std::vector<StringValue> match_string_svs_;
+    std::vector<StringSearch> match_searches_;
+    bool match_anchored_start_;
+    bool match_anchored_end_;
+
     /// Used for RLIKE and REGEXP predicates if the pattern is a constant argument.
     boost::scoped_ptr<re2::RE2> regex_;
 
-    LikePredicateState() : escape_char_('\\') {
+    /// Used if the pattern is not a constant argument. Maps each pattern to its compiled
+    /// regex, so that a pattern that repeats across rows is only compiled once. The
+    /// cache is cleared when it holds MAX_CACHED_REGEXES patterns. Owns the regexes.
+    typedef boost::unordered_map<std::string, re2::RE2*> RegexCache;
+    RegexCache regex_cache_;
+    static const int MAX_CACHED_REGEXES = 64;
+
+    LikePredicateState()
+      : escape_char_('\\'),
+        match_anchored_start_(false),
+        match_anchored_end_(false) {
     }
 
+    ~LikePredicateState() { ClearRegexCache(); }
+
     void SetSearchString(const std::string& search_string) {
       search_string_ = search_string;
       search_string_sv_ = StringValue(search_string_);
       substring_pattern_ = StringSearch(&search_string_sv_);
     }
+
+    void SetMatchStrings(const std::vector<std::string>& match_strings,
+        bool anchored_start, bool anchored_end) {
+      match_strings_ = match_strings;
+      match_string_svs_.clear();
+      match_searches_.clear();
+      // Build the StringValues and searches only once the vectors they point into are
+      // complete.
+      for (const std::string& str: match_strings_) {
+        match_string_svs_.push_back(StringValue(str));
+      }
+      for (const StringValue& sv: match_string_svs_) {
+        match_searches_.push_back(StringSearch(&sv));
+      }
+      match_anchored_start_ = anchored_start;
+      match_anchored_end_ = anchored_end;
+    }
+
+    void ClearRegexCache() {
+      for (RegexCache::value_type& entry: regex_cache_) delete entry.second;
+      regex_cache_.clear();
+    }
   };
 
   friend class OpcodeRegistry;
@@ -147,6 +195,12 @@ class LikePredicate: public Predicate {
   static impala_udf::BooleanVal ConstantEqualsFn(impala_udf::FunctionContext* context,
       const impala_udf::StringVal& val, const impala_udf::StringVal& pattern);
 
+  /// Handling of like predicates that consist of several literal strings separated by
+  /// '%', see LikePredicateState::match_strings_.
+  static impala_udf::BooleanVal ConstantMultiSubstringFn(
+      impala_udf::FunctionContext* context, const impala_udf::StringVal& val,
+      const impala_udf::StringVal& pattern);
+
   static impala_udf::BooleanVal ConstantRegexFnPartial(
       impala_udf::FunctionContext* context, const impala_udf::StringVal& val,
       const impala_udf::StringVal& pattern);
@@ -158,6 +212,13 @@ class LikePredicate: public Predicate {
       const impala_udf::StringVal& val, const impala_udf::StringVal& pattern,
       bool is_like_pattern);
 
+  /// Splits a LIKE pattern into the literal strings between its '%' wildcards, with
+  /// the escapes removed and without empty strings. Sets 'anchored_start' if the pattern
+  /// doesn't start with '%' and 'anchored_end' if it doesn't end with one. Returns false
+  /// if the pattern contains a '_' wildcard or ends with an incomplete escape.
+  static bool SplitLikePattern(const std::string& pattern, char escape_char,
+      std::vector<std::string>* match_strings, bool* anchored_start, bool* anchored_end);
+
   /// Convert a LIKE pattern (with embedded % and _) into the corresponding
   /// regular expression pattern. Escaped chars are copied verbatim.
   static void ConvertLikePattern(impala_udf::FunctionContext* context,
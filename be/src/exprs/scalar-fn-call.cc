@@ -23,17 +23,30 @@
 #include "codegen/llvm-codegen.h"
 #include "exprs/anyval-util.h"
 #include "exprs/expr-context.h"
+#include "exprs/scalar-fn-result-cache.h"
+#include "exprs/timestamp-functions.h"
+#include "exprs/vectorized-predicate.h"
 #include "runtime/hdfs-fs-cache.h"
 #include "runtime/lib-cache.h"
 #include "runtime/runtime-state.h"
 #include "runtime/types.h"
 #include "udf/udf-internal.h"
+#include "util/bit-util.h"
 #include "util/debug-util.h"
 #include "util/dynamic-util.h"
 #include "util/symbols-util.h"
 
 #include "common/names.h"
 
+DECLARE_bool(async_codegen);
+
+DEFINE_int32(udf_result_cache_entries, 0, "(Advanced) If greater than 0, the results "
+    "of non-builtin scalar functions are cached per expression context in a hash table "
+    "with this many entries, keyed by the argument values. Only enable this if all "
+    "UDFs return the same result for the same arguments.");
+DEFINE_double(udf_result_cache_min_hit_rate, 0.5, "(Advanced) A UDF result cache is "
+    "disabled if its hit rate over a window of lookups is below this fraction.");
+
 using namespace impala;
 using namespace impala_udf;
 using namespace strings;
@@ -45,7 +58,12 @@ ScalarFnCall::ScalarFnCall(const TExprNode& node)
     scalar_fn_wrapper_(NULL),
     prepare_fn_(NULL),
     close_fn_(NULL),
-    scalar_fn_(NULL) {
+    scalar_fn_(NULL),
+    vectorized_predicate_(NULL),
+    cache_results_(false),
+    cache_lookups_counter_(NULL),
+    cache_hits_counter_(NULL),
+    caches_disabled_counter_(NULL) {
   DCHECK_NE(fn_.binary_type, TFunctionBinaryType::JAVA);
 }
 
@@ -85,6 +103,15 @@ Status ScalarFnCall::Prepare(RuntimeState* state, const RowDescriptor& desc,
   fn_context_index_ = context->Register(state, return_type, arg_types,
       varargs_buffer_size);
 
+  cache_results_ = CanCacheResults();
+  if (cache_results_) {
+    RuntimeProfile* profile = state->runtime_profile();
+    cache_lookups_counter_ = ADD_COUNTER(profile, "UdfResultCacheLookups", TUnit::UNIT);
+    cache_hits_counter_ = ADD_COUNTER(profile, "UdfResultCacheHits", TUnit::UNIT);
+    caches_disabled_counter_ =
+        ADD_COUNTER(profile, "UdfResultCachesDisabled", TUnit::UNIT);
+  }
+
   // Use the interpreted path and call the builtin without codegen if:
   // 1. there are char arguments (as they aren't supported yet)
   // OR
@@ -134,17 +161,35 @@ Status ScalarFnCall::Prepare(RuntimeState* state, const RowDescriptor& desc,
     RETURN_IF_ERROR(state->GetCodegen(&codegen));
 
     if (fn_.binary_type == TFunctionBinaryType::IR) {
-      string local_path;
-      RETURN_IF_ERROR(LibCache::instance()->GetLocalLibPath(
-          fn_.hdfs_location, LibCache::TYPE_IR, &local_path));
+      boost::shared_ptr<const string> bitcode;
+      {
+        SCOPED_TIMER(codegen->lib_cache_timer());
+        RETURN_IF_ERROR(LibCache::instance()->GetIrModule(fn_.hdfs_location, &bitcode));
+      }
       // Link the UDF module into this query's main module (essentially copy the UDF
       // module into the main module) so the UDF's functions are available in the main
-      // module.
-      RETURN_IF_ERROR(codegen->LinkModule(local_path));
+      // module. The bitcode is cached in memory by the LibCache.
+      RETURN_IF_ERROR(codegen->LinkModuleFromMemory(
+          llvm::MemoryBufferRef(*bitcode, fn_.hdfs_location), fn_.hdfs_location));
+    }
+
+    if (fn_.binary_type == TFunctionBinaryType::IR || NumFixedArgs() > 8) {
+      // There is no interpreted path to run this function before it is jitted.
+      codegen->RequireSyncFinalize();
+    } else if (FLAGS_async_codegen) {
+      // Load the function for the interpreted path, which is used until the module is
+      // compiled.
+      RETURN_IF_ERROR(LibCache::instance()->GetSoFunctionPtr(
+          fn_.hdfs_location, fn_.scalar_fn.symbol, &scalar_fn_, &cache_entry_));
     }
 
     llvm::Function* ir_udf_wrapper;
-    RETURN_IF_ERROR(GetCodegendComputeFn(state, &ir_udf_wrapper));
+    if (cache_results_) {
+      // The compute function returned to the parents looks up the cache instead.
+      RETURN_IF_ERROR(CodegenUdfCall(state, &ir_udf_wrapper));
+    } else {
+      RETURN_IF_ERROR(GetCodegendComputeFn(state, &ir_udf_wrapper));
+    }
     // TODO: don't do this for child exprs
     codegen->AddFunctionToJit(ir_udf_wrapper, &scalar_fn_wrapper_);
   }
@@ -157,7 +202,19 @@ Status ScalarFnCall::Prepare(RuntimeState* state, const RowDescriptor& desc,
     RETURN_IF_ERROR(GetFunction(state, fn_.scalar_fn.close_fn_symbol,
         reinterpret_cast<void**>(&close_fn_)));
   }
+  // The function descriptors of from_utc_timestamp() and to_utc_timestamp() don't
+  // name their prepare and close functions, which build the timezone's table of
+  // transitions. Bind them here.
+  if (fn_.binary_type == TFunctionBinaryType::BUILTIN && prepare_fn_ == NULL &&
+      close_fn_ == NULL && (fn_.name.function_name == "from_utc_timestamp" ||
+      fn_.name.function_name == "to_utc_timestamp")) {
+    prepare_fn_ = TimestampFunctions::FromUtcAndToUtcPrepare;
+    close_fn_ = TimestampFunctions::FromUtcAndToUtcClose;
+  }
 
+  if (type_.type == TYPE_BOOLEAN) {
+    vectorized_predicate_ = VectorizedPredicate::Create(state->obj_pool(), this);
+  }
   return Status::OK();
 }
 
@@ -168,9 +225,10 @@ Status ScalarFnCall::Open(RuntimeState* state, ExprContext* ctx,
   FunctionContext* fn_ctx = ctx->fn_context(fn_context_index_);
 
   if (scalar_fn_ != NULL) {
-    // We're in the interpreted path (i.e. no JIT). Populate our FunctionContext's
-    // staging_input_vals, which will be reused across calls to scalar_fn_.
-    DCHECK(scalar_fn_wrapper_ == NULL);
+    // We're in the interpreted path (i.e. no JIT, or no JIT yet with --async_codegen).
+    // Populate our FunctionContext's staging_input_vals, which will be reused across
+    // calls to scalar_fn_.
+    DCHECK(scalar_fn_wrapper_ == NULL || FLAGS_async_codegen);
     ObjectPool* obj_pool = state->obj_pool();
     vector<AnyVal*>* input_vals = fn_ctx->impl()->staging_input_vals();
     for (int i = 0; i < NumFixedArgs(); ++i) {
@@ -178,6 +236,12 @@ Status ScalarFnCall::Open(RuntimeState* state, ExprContext* ctx,
     }
   }
 
+  if (cache_results_) {
+    ctx->SetResultCache(fn_context_index_, new ScalarFnResultCache(
+        FLAGS_udf_result_cache_entries, FLAGS_udf_result_cache_min_hit_rate,
+        cache_lookups_counter_, cache_hits_counter_, caches_disabled_counter_));
+  }
+
   // Only evaluate constant arguments once per fragment
   if (scope == FunctionContext::FRAGMENT_LOCAL) {
     vector<AnyVal*> constant_args;
@@ -231,6 +295,18 @@ bool ScalarFnCall::IsConstant() const {
   return Expr::IsConstant();
 }
 
+bool ScalarFnCall::CanCacheResults() const {
+  if (FLAGS_udf_result_cache_entries <= 0) return false;
+  // Builtins are either cheap or not worth the lookup for most inputs.
+  if (fn_.binary_type == TFunctionBinaryType::BUILTIN) return false;
+  if (children_.empty() || IsConstant()) return false;
+  if (type_.IsComplexType()) return false;
+  for (int i = 0; i < children_.size(); ++i) {
+    if (children_[i]->type().IsComplexType()) return false;
+  }
+  return true;
+}
+
 // Dynamically loads the pre-compiled UDF and codegens a function that calls each child's
 // codegen'd function, then passes those values to the UDF and returns the result.
 // Example generated IR for a UDF with signature
@@ -259,10 +335,18 @@ bool ScalarFnCall::IsConstant() const {
 //        i64* inttoptr (i64 89111072 to i64*))
 //   ret { i8, double } %result
 Status ScalarFnCall::GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn) {
+  // The interpreted Get*Val() functions look up the result cache.
+  if (cache_results_) return GetCodegendComputeFnWrapper(state, fn);
   if (ir_compute_fn_ != NULL) {
     *fn = ir_compute_fn_;
     return Status::OK();
   }
+  RETURN_IF_ERROR(CodegenUdfCall(state, fn));
+  ir_compute_fn_ = *fn;
+  return Status::OK();
+}
+
+Status ScalarFnCall::CodegenUdfCall(RuntimeState* state, llvm::Function** fn) {
   if (type_.type == TYPE_CHAR) {
     return Status("ScalarFnCall Codegen not supported for CHAR");
   }
@@ -395,7 +479,6 @@ Status ScalarFnCall::GetCodegendComputeFn(RuntimeState* state, llvm::Function**
     return Status(
         TErrorCode::UDF_VERIFY_FAILED, fn_.scalar_fn.symbol, fn_.hdfs_location);
   }
-  ir_compute_fn_ = *fn;
   return Status::OK();
 }
 
@@ -675,96 +758,262 @@ RETURN_TYPE ScalarFnCall::InterpretEval(ExprContext* context, TupleRow* row) {
   return RETURN_TYPE::null();
 }
 
-typedef BooleanVal (*BooleanWrapper)(ExprContext*, TupleRow*);
-typedef TinyIntVal (*TinyIntWrapper)(ExprContext*, TupleRow*);
-typedef SmallIntVal (*SmallIntWrapper)(ExprContext*, TupleRow*);
-typedef IntVal (*IntWrapper)(ExprContext*, TupleRow*);
-typedef BigIntVal (*BigIntWrapper)(ExprContext*, TupleRow*);
-typedef FloatVal (*FloatWrapper)(ExprContext*, TupleRow*);
-typedef DoubleVal (*DoubleWrapper)(ExprContext*, TupleRow*);
-typedef StringVal (*StringWrapper)(ExprContext*, TupleRow*);
-typedef TimestampVal (*TimestampWrapper)(ExprContext*, TupleRow*);
-typedef DecimalVal (*DecimalWrapper)(ExprContext*, TupleRow*);
+template<typename RETURN_TYPE>
+RETURN_TYPE ScalarFnCall::EvalUdf(ExprContext* context, TupleRow* row) {
+  if (scalar_fn_wrapper_ == NULL) return InterpretEval<RETURN_TYPE>(context, row);
+  typedef RETURN_TYPE (*Wrapper)(ExprContext*, TupleRow*);
+  return reinterpret_cast<Wrapper>(scalar_fn_wrapper_)(context, row);
+}
+
+template<typename RETURN_TYPE>
+RETURN_TYPE ScalarFnCall::GetCachedVal(ExprContext* context, TupleRow* row) {
+  ScalarFnResultCache* cache = context->result_cache(fn_context_index_);
+  if (cache == NULL || !cache->enabled()) return EvalUdf<RETURN_TYPE>(context, row);
+  // The children are evaluated again on a miss, which is cheap compared to the UDFs
+  // worth caching.
+  cache->StartKey();
+  for (int i = 0; i < children_.size(); ++i) cache->AppendArg(children_[i], context, row);
+  FunctionContext* fn_ctx = context->fn_context(fn_context_index_);
+  RETURN_TYPE result;
+  if (cache->Lookup(fn_ctx, &result)) return result;
+  result = EvalUdf<RETURN_TYPE>(context, row);
+  // Results of failed calls aren't cached, so that the error is raised for every row.
+  if (!fn_ctx->has_error()) cache->Insert(result);
+  return result;
+}
 
-// TODO: macroify this?
 BooleanVal ScalarFnCall::GetBooleanVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_BOOLEAN);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<BooleanVal>(context, row);
-  BooleanWrapper fn = reinterpret_cast<BooleanWrapper>(scalar_fn_wrapper_);
-  return fn(context, row);
+  if (cache_results_) return GetCachedVal<BooleanVal>(context, row);
+  return EvalUdf<BooleanVal>(context, row);
 }
 
 TinyIntVal ScalarFnCall::GetTinyIntVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_TINYINT);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<TinyIntVal>(context, row);
-  TinyIntWrapper fn = reinterpret_cast<TinyIntWrapper>(scalar_fn_wrapper_);
-  return fn(context, row);
+  if (cache_results_) return GetCachedVal<TinyIntVal>(context, row);
+  return EvalUdf<TinyIntVal>(context, row);
 }
 
 SmallIntVal ScalarFnCall::GetSmallIntVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_SMALLINT);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<SmallIntVal>(context, row);
-  SmallIntWrapper fn = reinterpret_cast<SmallIntWrapper>(scalar_fn_wrapper_);
-  return fn(context, row);
+  if (cache_results_) return GetCachedVal<SmallIntVal>(context, row);
+  return EvalUdf<SmallIntVal>(context, row);
 }
 
 IntVal ScalarFnCall::GetIntVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_INT);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<IntVal>(context, row);
-  IntWrapper fn = reinterpret_cast<IntWrapper>(scalar_fn_wrapper_);
-  return fn(context, row);
+  if (cache_results_) return GetCachedVal<IntVal>(context, row);
+  return EvalUdf<IntVal>(context, row);
 }
 
 BigIntVal ScalarFnCall::GetBigIntVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_BIGINT);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<BigIntVal>(context, row);
-  BigIntWrapper fn = reinterpret_cast<BigIntWrapper>(scalar_fn_wrapper_);
-  return fn(context, row);
+  if (cache_results_) return GetCachedVal<BigIntVal>(context, row);
+  return EvalUdf<BigIntVal>(context, row);
 }
 
 FloatVal ScalarFnCall::GetFloatVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_FLOAT);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<FloatVal>(context, row);
-  FloatWrapper fn = reinterpret_cast<FloatWrapper>(scalar_fn_wrapper_);
-  return fn(context, row);
+  if (cache_results_) return GetCachedVal<FloatVal>(context, row);
+  return EvalUdf<FloatVal>(context, row);
 }
 
 DoubleVal ScalarFnCall::GetDoubleVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_DOUBLE);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<DoubleVal>(context, row);
-  DoubleWrapper fn = reinterpret_cast<DoubleWrapper>(scalar_fn_wrapper_);
-  return fn(context, row);
+  if (cache_results_) return GetCachedVal<DoubleVal>(context, row);
+  return EvalUdf<DoubleVal>(context, row);
 }
 
 StringVal ScalarFnCall::GetStringVal(ExprContext* context, TupleRow* row) {
   DCHECK(type_.IsStringType());
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<StringVal>(context, row);
-  StringWrapper fn = reinterpret_cast<StringWrapper>(scalar_fn_wrapper_);
-  return fn(context, row);
+  if (cache_results_) return GetCachedVal<StringVal>(context, row);
+  return EvalUdf<StringVal>(context, row);
 }
 
 TimestampVal ScalarFnCall::GetTimestampVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_TIMESTAMP);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<TimestampVal>(context, row);
-  TimestampWrapper fn = reinterpret_cast<TimestampWrapper>(scalar_fn_wrapper_);
-  return fn(context, row);
+  if (cache_results_) return GetCachedVal<TimestampVal>(context, row);
+  return EvalUdf<TimestampVal>(context, row);
 }
 
 DecimalVal ScalarFnCall::GetDecimalVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_DECIMAL);
   DCHECK(context != NULL);
-  if (scalar_fn_wrapper_ == NULL) return InterpretEval<DecimalVal>(context, row);
-  DecimalWrapper fn = reinterpret_cast<DecimalWrapper>(scalar_fn_wrapper_);
-  return fn(context, row);
+  if (cache_results_) return GetCachedVal<DecimalVal>(context, row);
+  return EvalUdf<DecimalVal>(context, row);
+}
+
+namespace {
+
+/// Evaluates 'expr' over the rows 'selection' of 'rows' into the column 'col' as values
+/// of type 'NATIVE_TYPE', see UdfBatchColumn.
+template <typename T, T (Expr::*GET_VAL)(ExprContext*, TupleRow*), typename NATIVE_TYPE>
+void EvalColumn(Expr* expr, ExprContext* ctx, Tuple** rows, int num_tuples_per_row,
+    const int* selection, int num_rows, UdfBatchColumn* col) {
+  NATIVE_TYPE* values = col->Values<NATIVE_TYPE>();
+  for (int i = 0; i < num_rows; ++i) {
+    T v = (expr->*GET_VAL)(ctx,
+        reinterpret_cast<TupleRow*>(rows + selection[i] * num_tuples_per_row));
+    col->SetNull(i, v.is_null);
+    if (!v.is_null) values[i] = v.val;
+  }
+}
+
+/// Same as EvalColumn(), for the types whose values are AnyVals.
+template <typename T, T (Expr::*GET_VAL)(ExprContext*, TupleRow*)>
+void EvalAnyValColumn(Expr* expr, ExprContext* ctx, Tuple** rows,
+    int num_tuples_per_row, const int* selection, int num_rows, UdfBatchColumn* col) {
+  T* values = col->Values<T>();
+  for (int i = 0; i < num_rows; ++i) {
+    values[i] = (expr->*GET_VAL)(ctx,
+        reinterpret_cast<TupleRow*>(rows + selection[i] * num_tuples_per_row));
+    col->SetNull(i, values[i].is_null);
+  }
+}
+
+/// Returns the size of the values of 'type' in a UdfBatchColumn.
+int BatchValueSize(const ColumnType& type) {
+  switch (type.type) {
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+    case TYPE_CHAR:
+      return sizeof(StringVal);
+    case TYPE_TIMESTAMP:
+      return sizeof(TimestampVal);
+    case TYPE_DECIMAL:
+      return sizeof(DecimalVal);
+    default:
+      return type.GetByteSize();
+  }
+}
+
+/// Evaluates 'child' over the 'num_rows' rows 'selection' of 'rows' into 'col'.
+void EvalArgColumn(Expr* child, ExprContext* ctx, Tuple** rows,
+    int num_tuples_per_row, const int* selection, int num_rows, UdfBatchColumn* col) {
+  switch (child->type().type) {
+    case TYPE_NULL:
+      memset(col->nulls, 0xff, BitUtil::Ceil(num_rows, 8));
+      return;
+    case TYPE_BOOLEAN:
+      EvalColumn<BooleanVal, &Expr::GetBooleanVal, bool>(
+          child, ctx, rows, num_tuples_per_row, selection, num_rows, col);
+      return;
+    case TYPE_TINYINT:
+      EvalColumn<TinyIntVal, &Expr::GetTinyIntVal, int8_t>(
+          child, ctx, rows, num_tuples_per_row, selection, num_rows, col);
+      return;
+    case TYPE_SMALLINT:
+      EvalColumn<SmallIntVal, &Expr::GetSmallIntVal, int16_t>(
+          child, ctx, rows, num_tuples_per_row, selection, num_rows, col);
+      return;
+    case TYPE_INT:
+      EvalColumn<IntVal, &Expr::GetIntVal, int32_t>(
+          child, ctx, rows, num_tuples_per_row, selection, num_rows, col);
+      return;
+    case TYPE_BIGINT:
+      EvalColumn<BigIntVal, &Expr::GetBigIntVal, int64_t>(
+          child, ctx, rows, num_tuples_per_row, selection, num_rows, col);
+      return;
+    case TYPE_FLOAT:
+      EvalColumn<FloatVal, &Expr::GetFloatVal, float>(
+          child, ctx, rows, num_tuples_per_row, selection, num_rows, col);
+      return;
+    case TYPE_DOUBLE:
+      EvalColumn<DoubleVal, &Expr::GetDoubleVal, double>(
+          child, ctx, rows, num_tuples_per_row, selection, num_rows, col);
+      return;
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+    case TYPE_CHAR:
+      EvalAnyValColumn<StringVal, &Expr::GetStringVal>(
+          child, ctx, rows, num_tuples_per_row, selection, num_rows, col);
+      return;
+    case TYPE_TIMESTAMP:
+      EvalAnyValColumn<TimestampVal, &Expr::GetTimestampVal>(
+          child, ctx, rows, num_tuples_per_row, selection, num_rows, col);
+      return;
+    case TYPE_DECIMAL:
+      EvalAnyValColumn<DecimalVal, &Expr::GetDecimalVal>(
+          child, ctx, rows, num_tuples_per_row, selection, num_rows, col);
+      return;
+    default:
+      DCHECK(false) << "Type not implemented: " << child->type();
+  }
+}
+
+}
+
+int ScalarFnCall::EvalBatchUdf(ExprContext* context, BatchUdf batch_fn,
+    Tuple** rows, int num_tuples_per_row, int* selection, int num_selected) {
+  FunctionContext* fn_ctx = context->fn_context(fn_context_index_);
+  // The columns of the arguments and the result are carved out of the scratch memory
+  // of the context, each aligned for the largest value type.
+  const int ALIGNMENT = 16;
+  int nulls_size = BitUtil::RoundUp(BitUtil::Ceil(num_selected, 8), ALIGNMENT);
+  int num_cols = children_.size() + 1;
+  vector<int> values_sizes(num_cols);
+  int scratch_size = 0;
+  for (int i = 0; i < num_cols; ++i) {
+    const ColumnType& col_type = i < children_.size() ? children_[i]->type() : type_;
+    values_sizes[i] = BitUtil::RoundUp(
+        num_selected * BatchValueSize(col_type), ALIGNMENT);
+    scratch_size += values_sizes[i] + nulls_size;
+  }
+  vector<uint8_t>* scratch = fn_ctx->impl()->batch_scratch();
+  if (scratch->size() < scratch_size + ALIGNMENT) {
+    scratch->resize(scratch_size + ALIGNMENT);
+  }
+  uint8_t* buffer = reinterpret_cast<uint8_t*>(
+      BitUtil::RoundUp(reinterpret_cast<int64_t>(scratch->data()), ALIGNMENT));
+
+  vector<UdfBatchColumn> cols(num_cols);
+  for (int i = 0; i < num_cols; ++i) {
+    cols[i].values = buffer;
+    cols[i].nulls = buffer + values_sizes[i];
+    buffer += values_sizes[i] + nulls_size;
+  }
+  for (int i = 0; i < children_.size(); ++i) {
+    EvalArgColumn(children_[i], context, rows, num_tuples_per_row, selection,
+        num_selected, &cols[i]);
+  }
+  UdfBatchColumn* result = &cols.back();
+  memset(result->values, 0, values_sizes.back() + nulls_size);
+  batch_fn(fn_ctx, num_selected, cols.data(), result);
+
+  // Keep the rows for which the result is true.
+  const bool* result_values = result->Values<bool>();
+  int num_passed = 0;
+  for (int i = 0; i < num_selected; ++i) {
+    selection[num_passed] = selection[i];
+    num_passed += !result->IsNull(i) && result_values[i];
+  }
+  return num_passed;
+}
+
+int ScalarFnCall::EvalPredicateBatch(ExprContext* context, Tuple** rows,
+    int num_tuples_per_row, int* selection, int num_selected) {
+  if (vectorized_predicate_ != NULL) {
+    return vectorized_predicate_->Eval(context, rows, num_tuples_per_row, selection,
+        num_selected);
+  }
+  if (fn_context_index_ != -1 && num_selected > 0) {
+    BatchUdf batch_fn = context->fn_context(fn_context_index_)->impl()->batch_fn();
+    if (batch_fn != NULL) {
+      return EvalBatchUdf(context, batch_fn, rows, num_tuples_per_row, selection,
+          num_selected);
+    }
+  }
+  return Expr::EvalPredicateBatch(context, rows, num_tuples_per_row, selection,
+      num_selected);
 }
 
 string ScalarFnCall::DebugString() const {
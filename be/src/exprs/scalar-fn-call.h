@@ -20,12 +20,14 @@
 
 #include "exprs/expr.h"
 #include "udf/udf.h"
+#include "util/runtime-profile.h"
 
 using namespace impala_udf;
 
 namespace impala {
 
 class TExprNode;
+class VectorizedPredicate;
 
 /// Expr for evaluating a pre-compiled native or LLVM IR function that uses the UDF
 /// interface (i.e. a scalar function). This class overrides GetCodegendComputeFn() to
@@ -39,6 +41,15 @@ class TExprNode;
 /// function even if codegen is disabled. Codegen will also be used for IR UDFs (note that
 /// there is no way to specify both a native and IR library for a single UDF).
 //
+/// If --udf_result_cache_entries is set, the results of non-builtin functions are
+/// memoized per ExprContext in a ScalarFnResultCache keyed by the argument values. Parent
+/// exprs then call the interpreted Get*Val() functions, which look up the cache before
+/// calling the (possibly codegen'd) function.
+//
+/// If the UDF registers a batched version of itself with
+/// FunctionContext::SetBatchFunction() and is a predicate, EvalPredicateBatch() calls
+/// the batched version once per batch with the argument values of all selected rows.
+//
 /// TODO:
 /// - Fix error reporting, e.g. reporting leaks
 /// - Testing
@@ -74,6 +85,9 @@ class ScalarFnCall: public Expr {
   virtual TimestampVal GetTimestampVal(ExprContext* context, TupleRow*);
   virtual DecimalVal GetDecimalVal(ExprContext* context, TupleRow*);
 
+  virtual int EvalPredicateBatch(ExprContext* context, Tuple** rows,
+      int num_tuples_per_row, int* selection, int num_selected);
+
  private:
   /// If this function has var args, children()[vararg_start_idx_] is the first vararg
   /// argument.
@@ -98,11 +112,46 @@ class ScalarFnCall: public Expr {
   /// scalar function.
   void* scalar_fn_;
 
+  /// The batch evaluation of this function if it is a simple predicate on a slot, see
+  /// VectorizedPredicate. Otherwise NULL. Set in Prepare().
+  VectorizedPredicate* vectorized_predicate_;
+
+  /// True if the results are memoized, see ScalarFnResultCache. Set in Prepare(). The
+  /// caches are created in Open() and owned by the ExprContexts.
+  bool cache_results_;
+
+  /// Fragment-wide counters of the result caches. Set in Prepare() if 'cache_results_'.
+  RuntimeProfile::Counter* cache_lookups_counter_;
+  RuntimeProfile::Counter* cache_hits_counter_;
+  RuntimeProfile::Counter* caches_disabled_counter_;
+
   /// Returns the number of non-vararg arguments
   int NumFixedArgs() const {
     return vararg_start_idx_ >= 0 ? vararg_start_idx_ : children_.size();
   }
 
+  /// Returns true if the results of this function can be memoized.
+  bool CanCacheResults() const;
+
+  /// Generates the function that evaluates the children and calls the UDF with their
+  /// values. This is the codegen'd compute function unless the results are cached.
+  Status CodegenUdfCall(RuntimeState* state, llvm::Function** fn);
+
+  /// Calls the function for 'row', without the result cache.
+  template<typename RETURN_TYPE>
+  RETURN_TYPE EvalUdf(ExprContext* context, TupleRow* row);
+
+  /// Returns the result for 'row' from the result cache of 'context' if it is cached,
+  /// and calls the function and caches the result otherwise.
+  template<typename RETURN_TYPE>
+  RETURN_TYPE GetCachedVal(ExprContext* context, TupleRow* row);
+
+  /// Evaluates this predicate over the selected rows with 'batch_fn', the batched
+  /// version of the UDF registered by its prepare function, and compacts 'selection' to
+  /// the rows that pass. Same interface as EvalPredicateBatch() otherwise.
+  int EvalBatchUdf(ExprContext* context, BatchUdf batch_fn, Tuple** rows,
+      int num_tuples_per_row, int* selection, int num_selected);
+
   /// Loads the native or IR function from HDFS and puts the result in *udf.
   Status GetUdf(RuntimeState* state, llvm::Function** udf);
 
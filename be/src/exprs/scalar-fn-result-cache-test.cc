@@ -0,0 +1,155 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <gtest/gtest.h>
+
+#include "exprs/scalar-fn-result-cache.h"
+#include "udf/udf-internal.h"
+#include "udf/udf-test-harness.h"
+#include "util/cpu-info.h"
+
+#include "common/names.h"
+
+using namespace impala_udf;
+
+namespace impala {
+
+class ScalarFnResultCacheTest : public testing::Test {
+ protected:
+  FunctionContext* fn_ctx_;
+
+  virtual void SetUp() {
+    FunctionContext::TypeDesc string_type;
+    string_type.type = FunctionContext::TYPE_STRING;
+    vector<FunctionContext::TypeDesc> arg_types(1, string_type);
+    fn_ctx_ = UdfTestHarness::CreateTestContext(string_type, arg_types);
+  }
+
+  virtual void TearDown() {
+    fn_ctx_->impl()->FreeLocalAllocations();
+    UdfTestHarness::CloseContext(fn_ctx_);
+    EXPECT_FALSE(fn_ctx_->has_error()) << fn_ctx_->error_msg();
+    delete fn_ctx_;
+  }
+
+  /// Sets the key of 'cache' to the arguments (i, s).
+  void SetKey(ScalarFnResultCache* cache, int i, const string& s) {
+    cache->StartKey();
+    cache->AppendValue(ColumnType(TYPE_INT), IntVal(i));
+    StringVal str(reinterpret_cast<uint8_t*>(const_cast<char*>(s.data())), s.size());
+    cache->AppendValue(ColumnType(TYPE_STRING), str);
+  }
+};
+
+TEST_F(ScalarFnResultCacheTest, Basic) {
+  ScalarFnResultCache cache(16, 0, NULL, NULL, NULL);
+  IntVal result;
+  SetKey(&cache, 1, "a");
+  EXPECT_FALSE(cache.Lookup(fn_ctx_, &result));
+  cache.Insert(IntVal(10));
+  SetKey(&cache, 1, "a");
+  ASSERT_TRUE(cache.Lookup(fn_ctx_, &result));
+  EXPECT_EQ(result.val, 10);
+
+  // Arguments that differ in any value don't hit, also if their bytes concatenate to
+  // the same string.
+  SetKey(&cache, 1, "b");
+  EXPECT_FALSE(cache.Lookup(fn_ctx_, &result));
+  SetKey(&cache, 2, "a");
+  EXPECT_FALSE(cache.Lookup(fn_ctx_, &result));
+  SetKey(&cache, 1, "");
+  EXPECT_FALSE(cache.Lookup(fn_ctx_, &result));
+
+  // NULL is different from all values.
+  cache.StartKey();
+  cache.AppendValue(ColumnType(TYPE_INT), IntVal::null());
+  cache.AppendValue(ColumnType(TYPE_STRING), StringVal("a"));
+  EXPECT_FALSE(cache.Lookup(fn_ctx_, &result));
+  cache.Insert(IntVal::null());
+  cache.StartKey();
+  cache.AppendValue(ColumnType(TYPE_INT), IntVal::null());
+  cache.AppendValue(ColumnType(TYPE_STRING), StringVal("a"));
+  ASSERT_TRUE(cache.Lookup(fn_ctx_, &result));
+  EXPECT_TRUE(result.is_null);
+  EXPECT_EQ(cache.num_lookups(), 7);
+  EXPECT_EQ(cache.num_hits(), 2);
+}
+
+TEST_F(ScalarFnResultCacheTest, StringResults) {
+  ScalarFnResultCache cache(16, 0, NULL, NULL, NULL);
+  StringVal result;
+  SetKey(&cache, 1, "a");
+  EXPECT_FALSE(cache.Lookup(fn_ctx_, &result));
+  string value = "result";
+  cache.Insert(StringVal(reinterpret_cast<uint8_t*>(&value[0]), value.size()));
+  // The cached string doesn't depend on the memory of the inserted one.
+  value = "xxxxxx";
+  SetKey(&cache, 1, "a");
+  ASSERT_TRUE(cache.Lookup(fn_ctx_, &result));
+  EXPECT_EQ(string(reinterpret_cast<char*>(result.ptr), result.len), "result");
+
+  SetKey(&cache, 2, "a");
+  EXPECT_FALSE(cache.Lookup(fn_ctx_, &result));
+  cache.Insert(StringVal::null());
+  SetKey(&cache, 2, "a");
+  ASSERT_TRUE(cache.Lookup(fn_ctx_, &result));
+  EXPECT_TRUE(result.is_null);
+}
+
+TEST_F(ScalarFnResultCacheTest, Collisions) {
+  // With a single bucket, every new key evicts the previous one.
+  ScalarFnResultCache cache(1, 0, NULL, NULL, NULL);
+  IntVal result;
+  for (int i = 0; i < 10; ++i) {
+    SetKey(&cache, i, "a");
+    EXPECT_FALSE(cache.Lookup(fn_ctx_, &result));
+    cache.Insert(IntVal(i));
+  }
+  SetKey(&cache, 9, "a");
+  ASSERT_TRUE(cache.Lookup(fn_ctx_, &result));
+  EXPECT_EQ(result.val, 9);
+  SetKey(&cache, 8, "a");
+  EXPECT_FALSE(cache.Lookup(fn_ctx_, &result));
+}
+
+TEST_F(ScalarFnResultCacheTest, DisableOnPoorHitRate) {
+  // Every key is distinct, so the first window has no hits.
+  ScalarFnResultCache cache(1024, 0.5, NULL, NULL, NULL);
+  IntVal result;
+  for (int i = 0; i < ScalarFnResultCache::WINDOW_SIZE; ++i) {
+    ASSERT_TRUE(cache.enabled());
+    SetKey(&cache, i, "a");
+    EXPECT_FALSE(cache.Lookup(fn_ctx_, &result));
+    cache.Insert(IntVal(i));
+  }
+  EXPECT_FALSE(cache.enabled());
+
+  // A repeated key stays enabled.
+  ScalarFnResultCache good_cache(1024, 0.5, NULL, NULL, NULL);
+  for (int i = 0; i < 2 * ScalarFnResultCache::WINDOW_SIZE; ++i) {
+    SetKey(&good_cache, i % 10, "a");
+    if (!good_cache.Lookup(fn_ctx_, &result)) good_cache.Insert(IntVal(i % 10));
+  }
+  EXPECT_TRUE(good_cache.enabled());
+  EXPECT_EQ(good_cache.num_hits(), 2 * ScalarFnResultCache::WINDOW_SIZE - 10);
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,235 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exprs/scalar-fn-result-cache.h"
+
+#include "exprs/expr.h"
+#include "util/bit-util.h"
+#include "util/hash-util.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace impala_udf;
+
+ScalarFnResultCache::ScalarFnResultCache(int num_entries, double min_hit_rate,
+    RuntimeProfile::Counter* lookups_counter, RuntimeProfile::Counter* hits_counter,
+    RuntimeProfile::Counter* disabled_counter)
+  : min_hit_rate_(min_hit_rate),
+    lookups_counter_(lookups_counter),
+    hits_counter_(hits_counter),
+    disabled_counter_(disabled_counter),
+    enabled_(true),
+    hash_(0),
+    entry_(NULL),
+    total_lookups_(0),
+    total_hits_(0),
+    window_lookups_(0),
+    window_hits_(0) {
+  DCHECK_GT(num_entries, 0);
+  int capacity = BitUtil::RoundUpToPowerOfTwo(num_entries);
+  entries_.reset(new Entry[capacity]);
+  for (int i = 0; i < capacity; ++i) entries_[i].occupied = false;
+  mask_ = capacity - 1;
+}
+
+ScalarFnResultCache::~ScalarFnResultCache() {
+  FlushWindow();
+}
+
+void ScalarFnResultCache::AppendArg(Expr* expr, ExprContext* ctx, TupleRow* row) {
+  const ColumnType& type = expr->type();
+  switch (type.type) {
+    case TYPE_NULL:
+      // The value is always NULL.
+      AppendValue(type, BooleanVal::null());
+      return;
+    case TYPE_BOOLEAN:
+      AppendValue(type, expr->GetBooleanVal(ctx, row));
+      return;
+    case TYPE_TINYINT:
+      AppendValue(type, expr->GetTinyIntVal(ctx, row));
+      return;
+    case TYPE_SMALLINT:
+      AppendValue(type, expr->GetSmallIntVal(ctx, row));
+      return;
+    case TYPE_INT:
+      AppendValue(type, expr->GetIntVal(ctx, row));
+      return;
+    case TYPE_BIGINT:
+      AppendValue(type, expr->GetBigIntVal(ctx, row));
+      return;
+    case TYPE_FLOAT:
+      AppendValue(type, expr->GetFloatVal(ctx, row));
+      return;
+    case TYPE_DOUBLE:
+      AppendValue(type, expr->GetDoubleVal(ctx, row));
+      return;
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+    case TYPE_CHAR:
+      AppendValue(type, expr->GetStringVal(ctx, row));
+      return;
+    case TYPE_TIMESTAMP:
+      AppendValue(type, expr->GetTimestampVal(ctx, row));
+      return;
+    case TYPE_DECIMAL:
+      AppendValue(type, expr->GetDecimalVal(ctx, row));
+      return;
+    default:
+      DCHECK(false) << "Can't cache results for arguments of type " << type;
+  }
+}
+
+void ScalarFnResultCache::AppendValue(const ColumnType& type, const AnyVal& val) {
+  // Each value starts with its NULL indicator. Values of the same type have the same
+  // size, except for strings, which are prefixed with their length, so different
+  // arguments can't have the same key.
+  key_.push_back(val.is_null);
+  if (val.is_null) return;
+  switch (type.type) {
+    case TYPE_BOOLEAN:
+      key_.push_back(static_cast<const BooleanVal&>(val).val);
+      break;
+    case TYPE_TINYINT:
+      key_.push_back(static_cast<const TinyIntVal&>(val).val);
+      break;
+    case TYPE_SMALLINT:
+      key_.append(reinterpret_cast<const char*>(
+          &static_cast<const SmallIntVal&>(val).val), sizeof(int16_t));
+      break;
+    case TYPE_INT:
+      key_.append(reinterpret_cast<const char*>(
+          &static_cast<const IntVal&>(val).val), sizeof(int32_t));
+      break;
+    case TYPE_BIGINT:
+      key_.append(reinterpret_cast<const char*>(
+          &static_cast<const BigIntVal&>(val).val), sizeof(int64_t));
+      break;
+    case TYPE_FLOAT:
+      key_.append(reinterpret_cast<const char*>(
+          &static_cast<const FloatVal&>(val).val), sizeof(float));
+      break;
+    case TYPE_DOUBLE:
+      key_.append(reinterpret_cast<const char*>(
+          &static_cast<const DoubleVal&>(val).val), sizeof(double));
+      break;
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+    case TYPE_CHAR: {
+      const StringVal& str = static_cast<const StringVal&>(val);
+      key_.append(reinterpret_cast<const char*>(&str.len), sizeof(str.len));
+      key_.append(reinterpret_cast<const char*>(str.ptr), str.len);
+      break;
+    }
+    case TYPE_TIMESTAMP: {
+      const TimestampVal& ts = static_cast<const TimestampVal&>(val);
+      key_.append(reinterpret_cast<const char*>(&ts.date), sizeof(ts.date));
+      key_.append(reinterpret_cast<const char*>(&ts.time_of_day),
+          sizeof(ts.time_of_day));
+      break;
+    }
+    case TYPE_DECIMAL: {
+      const DecimalVal& dec = static_cast<const DecimalVal&>(val);
+      switch (type.GetByteSize()) {
+        case 4:
+          key_.append(reinterpret_cast<const char*>(&dec.val4), sizeof(dec.val4));
+          break;
+        case 8:
+          key_.append(reinterpret_cast<const char*>(&dec.val8), sizeof(dec.val8));
+          break;
+        case 16:
+          key_.append(reinterpret_cast<const char*>(&dec.val16), sizeof(dec.val16));
+          break;
+        default:
+          DCHECK(false) << type;
+      }
+      break;
+    }
+    default:
+      DCHECK(false) << "Can't cache results for arguments of type " << type;
+  }
+}
+
+ScalarFnResultCache::Entry* ScalarFnResultCache::FindBucket() {
+  hash_ = HashUtil::Hash(key_.data(), key_.size(), 0);
+  return &entries_[hash_ & mask_];
+}
+
+void ScalarFnResultCache::CountLookup(bool hit) {
+  ++window_lookups_;
+  window_hits_ += hit;
+  if (LIKELY(window_lookups_ < WINDOW_SIZE)) return;
+  double hit_rate = static_cast<double>(window_hits_) / window_lookups_;
+  FlushWindow();
+  if (hit_rate < min_hit_rate_) {
+    VLOG_FILE << "Disabling result cache with hit rate " << hit_rate;
+    enabled_ = false;
+    if (disabled_counter_ != NULL) COUNTER_ADD(disabled_counter_, 1);
+    // Free the cached values, they are never read again. 'entry_' may still be
+    // written by Insert(), which checks 'enabled_' first.
+    entries_.reset();
+    entry_ = NULL;
+  }
+}
+
+void ScalarFnResultCache::FlushWindow() {
+  total_lookups_ += window_lookups_;
+  total_hits_ += window_hits_;
+  if (lookups_counter_ != NULL) COUNTER_ADD(lookups_counter_, window_lookups_);
+  if (hits_counter_ != NULL) COUNTER_ADD(hits_counter_, window_hits_);
+  window_lookups_ = 0;
+  window_hits_ = 0;
+}
+
+namespace impala {
+
+template <>
+bool ScalarFnResultCache::Lookup(FunctionContext* fn_ctx, StringVal* result) {
+  entry_ = FindBucket();
+  bool hit = entry_->occupied && entry_->hash == hash_ && entry_->key == key_;
+  if (hit) {
+    memcpy(result, entry_->result, sizeof(StringVal));
+    if (!result->is_null && entry_->string_data.empty()) {
+      *result = StringVal();
+    } else if (!result->is_null) {
+      StringVal copy(fn_ctx, entry_->string_data.size());
+      if (!copy.is_null) {
+        memcpy(copy.ptr, entry_->string_data.data(), copy.len);
+      }
+      // A failed allocation returns NULL with the error set in 'fn_ctx', like the
+      // function itself would.
+      *result = copy;
+    }
+  }
+  CountLookup(hit);
+  return hit;
+}
+
+template <>
+void ScalarFnResultCache::Insert(const StringVal& result) {
+  if (!enabled_ || key_.size() > MAX_VALUE_BYTES) return;
+  if (!result.is_null && result.len > MAX_VALUE_BYTES) return;
+  entry_->occupied = true;
+  entry_->hash = hash_;
+  entry_->key = key_;
+  memcpy(entry_->result, &result, sizeof(StringVal));
+  if (result.is_null) {
+    entry_->string_data.clear();
+  } else {
+    entry_->string_data.assign(reinterpret_cast<const char*>(result.ptr), result.len);
+  }
+}
+
+}
@@ -0,0 +1,165 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_EXPRS_SCALAR_FN_RESULT_CACHE_H
+#define IMPALA_EXPRS_SCALAR_FN_RESULT_CACHE_H
+
+#include <string>
+#include <string.h>
+#include <boost/scoped_array.hpp>
+
+#include "common/logging.h"
+#include "runtime/types.h"
+#include "udf/udf.h"
+#include "util/runtime-profile.h"
+
+namespace impala {
+
+class Expr;
+class ExprContext;
+class TupleRow;
+
+/// Memoizes the results of a deterministic scalar function for one ExprContext, keyed
+/// by the bytes of the argument values. This pays off for expensive UDFs whose inputs
+/// repeat a lot, e.g. a geo-IP lookup over a few thousand distinct addresses.
+///
+/// The cache is a fixed-size, direct-mapped hash table: an entry is overwritten by the
+/// next result whose key hashes to the same bucket. The hit rate is checked after each
+/// window of lookups, and the cache disables itself for good if it falls below
+/// 'min_hit_rate', so that a poor cache only costs the lookups of the first window. The
+/// lookups, hits and disabled caches are added to the counters passed to the
+/// constructor after each window and when the cache is destroyed.
+///
+/// Usage for each evaluation:
+///   cache->StartKey();
+///   for each argument: cache->AppendArg(arg_expr, ctx, row);
+///   if (!cache->Lookup(fn_ctx, &result)) {
+///     result = <call the function>;
+///     cache->Insert(result);
+///   }
+class ScalarFnResultCache {
+ public:
+  /// The number of lookups after which the hit rate is checked.
+  static const int WINDOW_SIZE = 4096;
+
+  /// Keys and string results larger than this aren't cached.
+  static const int MAX_VALUE_BYTES = 1024;
+
+  /// 'num_entries' is rounded up to a power of two. The counters may be NULL.
+  ScalarFnResultCache(int num_entries, double min_hit_rate,
+      RuntimeProfile::Counter* lookups_counter,
+      RuntimeProfile::Counter* hits_counter, RuntimeProfile::Counter* disabled_counter);
+  ~ScalarFnResultCache();
+
+  /// False once the cache disabled itself. The function should then be called directly,
+  /// without building a key.
+  bool enabled() const { return enabled_; }
+
+  /// Starts the key of a new lookup.
+  void StartKey() { key_.clear(); }
+
+  /// Evaluates 'expr', an argument of the function, and appends its value to the key.
+  void AppendArg(Expr* expr, ExprContext* ctx, TupleRow* row);
+
+  /// Appends a value of 'type' to the key.
+  void AppendValue(const ColumnType& type, const impala_udf::AnyVal& val);
+
+  /// Returns true and sets 'result' if the current key is cached. A cached string is
+  /// copied into memory allocated from 'fn_ctx', so that it has the same lifetime as a
+  /// string returned by the function. 'T' must be the AnyVal of the result type.
+  template <typename T>
+  bool Lookup(impala_udf::FunctionContext* fn_ctx, T* result);
+
+  /// Caches 'result' for the current key. Must follow a failed Lookup().
+  template <typename T>
+  void Insert(const T& result);
+
+  int64_t num_lookups() const { return total_lookups_ + window_lookups_; }
+  int64_t num_hits() const { return total_hits_ + window_hits_; }
+
+ private:
+  struct Entry {
+    /// Set once the entry holds a result.
+    bool occupied;
+    uint32_t hash;
+    std::string key;
+    /// The AnyVal of the result, the largest of which is a DecimalVal. 'string_data'
+    /// holds the data of a string result.
+    uint8_t result[sizeof(impala_udf::DecimalVal)];
+    std::string string_data;
+  };
+
+  /// Returns the entry for the current key, which Lookup() stores in 'entry_'.
+  Entry* FindBucket();
+
+  /// Counts a lookup and checks the hit rate at the end of a window.
+  void CountLookup(bool hit);
+
+  /// Adds the window's counts to the totals and the counters.
+  void FlushWindow();
+
+  const double min_hit_rate_;
+  RuntimeProfile::Counter* const lookups_counter_;
+  RuntimeProfile::Counter* const hits_counter_;
+  RuntimeProfile::Counter* const disabled_counter_;
+
+  bool enabled_;
+
+  /// The buckets, a power of two of them.
+  boost::scoped_array<Entry> entries_;
+  uint32_t mask_;
+
+  /// The key of the current lookup, and the hash and the entry of the current key after
+  /// Lookup().
+  std::string key_;
+  uint32_t hash_;
+  Entry* entry_;
+
+  int64_t total_lookups_;
+  int64_t total_hits_;
+  int window_lookups_;
+  int window_hits_;
+};
+
+template <typename T>
+inline bool ScalarFnResultCache::Lookup(impala_udf::FunctionContext* fn_ctx, T* result) {
+  entry_ = FindBucket();
+  bool hit = entry_->occupied && entry_->hash == hash_ && entry_->key == key_;
+  if (hit) memcpy(result, entry_->result, sizeof(T));
+  CountLookup(hit);
+  return hit;
+}
+
+template <>
+bool ScalarFnResultCache::Lookup(impala_udf::FunctionContext* fn_ctx,
+    impala_udf::StringVal* result);
+
+template <typename T>
+inline void ScalarFnResultCache::Insert(const T& result) {
+  DCHECK_LE(sizeof(T), sizeof(entry_->result));
+  // The cache may have been disabled by the lookup.
+  if (!enabled_ || key_.size() > MAX_VALUE_BYTES) return;
+  entry_->occupied = true;
+  entry_->hash = hash_;
+  entry_->key = key_;
+  memcpy(entry_->result, &result, sizeof(T));
+}
+
+template <>
+void ScalarFnResultCache::Insert(const impala_udf::StringVal& result);
+
+}
+
+#endif
@@ -38,6 +38,11 @@ class SlotRef : public Expr {
   virtual bool IsConstant() const { return false; }
   virtual int GetSlotIds(std::vector<SlotId>* slot_ids) const;
   const SlotId& slot_id() const { return slot_id_; }
+  int tuple_idx() const { return tuple_idx_; }
+  int slot_offset() const { return slot_offset_; }
+  const NullIndicatorOffset& null_indicator_offset() const {
+    return null_indicator_offset_;
+  }
 
   virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
 
@@ -16,6 +16,7 @@
 
 #include <cctype>
 #include <stdint.h>
+#include <emmintrin.h>
 #include <re2/re2.h>
 #include <re2/stringpiece.h>
 #include <bitset>
@@ -159,24 +160,64 @@ IntVal StringFunctions::CharLength(FunctionContext* context, const StringVal& st
   return StringValue::UnpaddedCharLength(reinterpret_cast<char*>(str.ptr), t->len);
 }
 
-StringVal StringFunctions::Lower(FunctionContext* context, const StringVal& str) {
+// The number of bytes that the SSE2 loops below process at a time. SSE2 is always
+// available on x86-64, so unlike SSE4.2 it doesn't need a runtime CPU check.
+static const int SSE_WIDTH = sizeof(__m128i);
+
+// Returns the lanes of 'block' that hold a byte in ['first', 'last'], which must be
+// ASCII. The bytes are compared as signed, so bytes >= 0x80 are never in the range.
+static inline __m128i InAsciiRange(__m128i block, char first, char last) {
+  return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(first - 1)),
+      _mm_cmplt_epi8(block, _mm_set1_epi8(last + 1)));
+}
+
+// Converts the letters in ['FIRST', 'LAST'], i.e. the ASCII letters of one case, of
+// 'str' to the other case by flipping their 0x20 bit, 16 bytes at a time. This is what
+// ::tolower() and ::toupper() do in the "C" locale, which Impala runs in: all other
+// bytes, including those of multi-byte UTF-8 characters, are left unchanged. Returns
+// 'str' itself if it has no letter to convert, like Trim() returns a part of its input.
+template <char FIRST, char LAST>
+static StringVal ConvertAsciiCase(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
+  // Find the first letter to convert.
+  int first_change = 0;
+  while (first_change + SSE_WIDTH <= str.len) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.ptr + first_change));
+    int mask = _mm_movemask_epi8(InAsciiRange(block, FIRST, LAST));
+    if (mask != 0) break;
+    first_change += SSE_WIDTH;
+  }
+  while (first_change < str.len
+      && (str.ptr[first_change] < FIRST || str.ptr[first_change] > LAST)) {
+    ++first_change;
+  }
+  if (first_change == str.len) return str;
+
   StringVal result(context, str.len);
   if (UNLIKELY(result.is_null)) return StringVal::null();
-  for (int i = 0; i < str.len; ++i) {
-    result.ptr[i] = ::tolower(str.ptr[i]);
+  memcpy(result.ptr, str.ptr, first_change);
+  const __m128i case_bit = _mm_set1_epi8(0x20);
+  int i = first_change;
+  for (; i + SSE_WIDTH <= str.len; i += SSE_WIDTH) {
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.ptr + i));
+    const __m128i flip = _mm_and_si128(InAsciiRange(block, FIRST, LAST), case_bit);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(result.ptr + i),
+        _mm_xor_si128(block, flip));
+  }
+  for (; i < str.len; ++i) {
+    uint8_t c = str.ptr[i];
+    result.ptr[i] = (c >= FIRST && c <= LAST) ? c ^ 0x20 : c;
   }
   return result;
 }
 
+StringVal StringFunctions::Lower(FunctionContext* context, const StringVal& str) {
+  return ConvertAsciiCase<'A', 'Z'>(context, str);
+}
+
 StringVal StringFunctions::Upper(FunctionContext* context, const StringVal& str) {
-  if (str.is_null) return StringVal::null();
-  StringVal result(context, str.len);
-  if (UNLIKELY(result.is_null)) return StringVal::null();
-  for (int i = 0; i < str.len; ++i) {
-    result.ptr[i] = ::toupper(str.ptr[i]);
-  }
-  return result;
+  return ConvertAsciiCase<'a', 'z'>(context, str);
 }
 
 // Returns a string identical to the input, but with the first character
@@ -215,63 +256,68 @@ StringVal StringFunctions::Translate(FunctionContext* context, const StringVal&
   StringVal result(context, str.len);
   if (UNLIKELY(result.is_null)) return result;
 
-  // TODO: if we know src and dst are constant, we can prebuild a conversion
-  // table to remove the inner loop.
+  // Map each byte to its first occurrence in 'src', so that each byte of 'str' is
+  // translated with a single lookup. Bytes that map to -1 are dropped.
+  int16_t translation[256];
+  for (int c = 0; c < 256; ++c) translation[c] = c;
+  for (int j = src.len - 1; j >= 0; --j) {
+    translation[src.ptr[j]] = j < dst.len ? dst.ptr[j] : -1;
+  }
   int result_len = 0;
   for (int i = 0; i < str.len; ++i) {
-    bool matched_src = false;
-    for (int j = 0; j < src.len; ++j) {
-      if (str.ptr[i] == src.ptr[j]) {
-        if (j < dst.len) {
-          result.ptr[result_len++] = dst.ptr[j];
-        } else {
-          // src[j] doesn't map to any char in dst, the char is dropped.
-        }
-        matched_src = true;
-        break;
-      }
-    }
-    if (!matched_src) result.ptr[result_len++] = str.ptr[i];
+    int16_t c = translation[str.ptr[i]];
+    if (c >= 0) result.ptr[result_len++] = c;
   }
   result.len = result_len;
   return result;
 }
 
-StringVal StringFunctions::Trim(FunctionContext* context, const StringVal& str) {
-  if (str.is_null) return StringVal::null();
-  // Find new starting position.
-  int32_t begin = 0;
-  while (begin < str.len && str.ptr[begin] == ' ') {
-    ++begin;
+// Returns the index of the first byte of 'ptr[0, len)' that is not a space, or 'len' if
+// there is none.
+static inline int FindFirstNonSpace(const uint8_t* ptr, int len) {
+  const __m128i spaces = _mm_set1_epi8(' ');
+  int i = 0;
+  for (; i + SSE_WIDTH <= len; i += SSE_WIDTH) {
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, spaces)) ^ 0xFFFF;
+    if (mask != 0) return i + __builtin_ctz(mask);
   }
-  // Find new ending position.
-  int32_t end = str.len - 1;
-  while (end > begin && str.ptr[end] == ' ') {
-    --end;
+  while (i < len && ptr[i] == ' ') ++i;
+  return i;
+}
+
+// Returns the index of the last byte of 'ptr[begin, len)' that is not a space, or
+// 'begin - 1' if there is none.
+static inline int FindLastNonSpace(const uint8_t* ptr, int begin, int len) {
+  const __m128i spaces = _mm_set1_epi8(' ');
+  int end = len;
+  for (; end - SSE_WIDTH >= begin; end -= SSE_WIDTH) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + end - SSE_WIDTH));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, spaces)) ^ 0xFFFF;
+    if (mask != 0) return end - SSE_WIDTH + 31 - __builtin_clz(mask);
   }
+  while (end > begin && ptr[end - 1] == ' ') --end;
+  return end - 1;
+}
+
+StringVal StringFunctions::Trim(FunctionContext* context, const StringVal& str) {
+  if (str.is_null) return StringVal::null();
+  int32_t begin = FindFirstNonSpace(str.ptr, str.len);
+  int32_t end = FindLastNonSpace(str.ptr, begin, str.len);
   return StringVal(str.ptr + begin, end - begin + 1);
 }
 
 StringVal StringFunctions::Ltrim(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
-  // Find new starting position.
-  int32_t begin = 0;
-  while (begin < str.len && str.ptr[begin] == ' ') {
-    ++begin;
-  }
+  int32_t begin = FindFirstNonSpace(str.ptr, str.len);
   return StringVal(str.ptr + begin, str.len - begin);
 }
 
 StringVal StringFunctions::Rtrim(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
-  if (str.len == 0) return str;
-  // Find new ending position.
-  int32_t end = str.len - 1;
-  while (end > 0 && str.ptr[end] == ' ') {
-    --end;
-  }
-  DCHECK_GE(end, 0);
-  return StringVal(str.ptr, (str.ptr[end] == ' ') ? end : end + 1);
+  int32_t end = FindLastNonSpace(str.ptr, 0, str.len);
+  return StringVal(str.ptr, end + 1);
 }
 
 IntVal StringFunctions::Ascii(FunctionContext* context, const StringVal& str) {
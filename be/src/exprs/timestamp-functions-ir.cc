@@ -135,6 +135,28 @@ void TimestampFunctions::UnixAndFromUnixClose(FunctionContext* context,
   }
 }
 
+void TimestampFunctions::FromUtcAndToUtcPrepare(FunctionContext* context,
+    FunctionContext::FunctionStateScope scope) {
+  if (scope != FunctionContext::THREAD_LOCAL || !context->IsArgConstant(1)) return;
+  StringVal tz_string_val = *reinterpret_cast<StringVal*>(context->GetConstantArg(1));
+  if (tz_string_val.is_null) return;
+  const string& tz = StringValue::FromStringVal(tz_string_val).DebugString();
+  if (TimezoneDatabase::IsTimestampDependent(tz)) return;
+  // Unknown timezones are reported by FromUtc() and ToUtc().
+  time_zone_ptr timezone = TimezoneDatabase::FindTimezone(tz, TimestampValue());
+  if (timezone == NULL) return;
+  context->SetFunctionState(scope, TimezoneTransitions::Create(timezone));
+}
+
+void TimestampFunctions::FromUtcAndToUtcClose(FunctionContext* context,
+    FunctionContext::FunctionStateScope scope) {
+  if (scope == FunctionContext::THREAD_LOCAL) {
+    TimezoneTransitions* transitions =
+        reinterpret_cast<TimezoneTransitions*>(context->GetFunctionState(scope));
+    delete transitions;
+  }
+}
+
 StringVal TimestampFunctions::StringValFromTimestamp(FunctionContext* context,
     const TimestampValue& tv, const StringVal& fmt) {
   void* state = context->GetFunctionState(FunctionContext::THREAD_LOCAL);
@@ -159,7 +181,9 @@ template <class TIME>
 StringVal TimestampFunctions::FromUnix(FunctionContext* context, const TIME& intp) {
   if (intp.is_null) return StringVal::null();
   TimestampValue t(intp.val);
-  return AnyValUtil::FromString(context, lexical_cast<string>(t));
+  char buff[TimestampParser::MAX_DEFAULT_FMT_OUT_LEN];
+  int len = TimestampParser::FormatDefault(t.date(), t.time(), buff);
+  return AnyValUtil::FromBuffer(context, buff, len);
 }
 
 template <class TIME>
@@ -369,8 +393,13 @@ StringVal TimestampFunctions::ToDate(FunctionContext* context,
     const TimestampVal& ts_val) {
   if (ts_val.is_null) return StringVal::null();
   const TimestampValue ts_value = TimestampValue::FromTimestampVal(ts_val);
-  string result = to_iso_extended_string(ts_value.date());
-  return AnyValUtil::FromString(context, result);
+  if (UNLIKELY(!ts_value.HasDate())) {
+    return AnyValUtil::FromString(context, to_iso_extended_string(ts_value.date()));
+  }
+  char buff[TimestampParser::MAX_DEFAULT_FMT_OUT_LEN];
+  int len = TimestampParser::FormatDefault(ts_value.date(),
+      boost::posix_time::time_duration(not_a_date_time), buff);
+  return AnyValUtil::FromBuffer(context, buff, len);
 }
 
 inline bool IsLeapYear(int year) {
@@ -769,6 +798,15 @@ TimestampVal TimestampFunctions::FromUtc(FunctionContext* context,
   const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
   if (!ts_value.HasDateOrTime()) return TimestampVal::null();
 
+  const TimezoneTransitions* transitions = reinterpret_cast<TimezoneTransitions*>(
+      context->GetFunctionState(FunctionContext::THREAD_LOCAL));
+  TimestampValue return_value;
+  if (transitions != NULL && transitions->FromUtc(ts_value, &return_value)) {
+    TimestampVal return_val;
+    return_value.ToTimestampVal(&return_val);
+    return return_val;
+  }
+
   const StringValue& tz_string_value = StringValue::FromStringVal(tz_string_val);
   time_zone_ptr timezone =
       TimezoneDatabase::FindTimezone(tz_string_value.DebugString(), ts_value);
@@ -783,7 +821,7 @@ TimestampVal TimestampFunctions::FromUtc(FunctionContext* context,
   ptime temp;
   ts_value.ToPtime(&temp);
   local_date_time lt(temp, timezone);
-  TimestampValue return_value = lt.local_time();
+  return_value = lt.local_time();
   TimestampVal return_val;
   return_value.ToTimestampVal(&return_val);
   return return_val;
@@ -798,6 +836,15 @@ TimestampVal TimestampFunctions::ToUtc(FunctionContext* context,
   const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
   if (!ts_value.HasDateOrTime()) return TimestampVal::null();
 
+  const TimezoneTransitions* transitions = reinterpret_cast<TimezoneTransitions*>(
+      context->GetFunctionState(FunctionContext::THREAD_LOCAL));
+  TimestampValue return_value;
+  if (transitions != NULL && transitions->ToUtc(ts_value, &return_value)) {
+    TimestampVal return_val;
+    return_value.ToTimestampVal(&return_val);
+    return return_val;
+  }
+
   const StringValue& tz_string_value = StringValue::FromStringVal(tz_string_val);
   time_zone_ptr timezone =
       TimezoneDatabase::FindTimezone(tz_string_value.DebugString(), ts_value);
@@ -811,7 +858,7 @@ TimestampVal TimestampFunctions::ToUtc(FunctionContext* context,
 
   local_date_time lt(ts_value.date(), ts_value.time(),
       timezone, local_date_time::NOT_DATE_TIME_ON_ERROR);
-  TimestampValue return_value(lt.utc_time());
+  return_value = lt.utc_time();
   TimestampVal return_val;
   return_value.ToTimestampVal(&return_val);
   return return_val;
@@ -851,10 +898,14 @@ TimezoneDatabase::TimezoneDatabase() {
 
 TimezoneDatabase::~TimezoneDatabase() { }
 
+bool TimezoneDatabase::IsTimestampDependent(const string& tz) {
+  return iequals("Europe/Moscow", tz) || iequals("Moscow", tz) || iequals("MSK", tz);
+}
+
 time_zone_ptr TimezoneDatabase::FindTimezone(const string& tz, const TimestampValue& tv) {
   // The backing database does not capture some subtleties, there are special cases
-  if ((tv.date().year() < 2011 || (tv.date().year() == 2011 && tv.date().month() < 4)) &&
-      (iequals("Europe/Moscow", tz) || iequals("Moscow", tz) || iequals("MSK", tz))) {
+  if (IsTimestampDependent(tz) &&
+      (tv.date().year() < 2011 || (tv.date().year() == 2011 && tv.date().month() < 4))) {
     // We transition in pre April 2011 from using the tz_database_ to a custom rule
     // Russia stopped using daylight savings in 2011, the tz_database_ is
     // set up assuming Russia uses daylight saving every year.
@@ -888,6 +939,107 @@ time_zone_ptr TimezoneDatabase::FindTimezone(const string& tz, const TimestampVa
   return time_zone_ptr();
 }
 
+// Returns the seconds of 'tv' since the day number 0, without the fractional seconds.
+static inline int64_t ToSeconds(const TimestampValue& tv) {
+  return static_cast<int64_t>(tv.date().day_number()) * 24 * 60 * 60 +
+      tv.time().total_seconds();
+}
+
+static inline TimestampValue FromSeconds(int64_t secs, int64_t fractional_seconds) {
+  const int64_t SECS_PER_DAY = 24 * 60 * 60;
+  return TimestampValue(Date(secs / SECS_PER_DAY),
+      boost::posix_time::time_duration(0, 0, secs % SECS_PER_DAY, fractional_seconds));
+}
+
+TimezoneTransitions* TimezoneTransitions::Create(const time_zone_ptr& timezone) {
+  TimezoneTransitions* transitions = new TimezoneTransitions();
+  transitions->min_secs_ = ToSeconds(TimestampValue(Date(MIN_YEAR, 1, 1), Hours(0)));
+  transitions->max_secs_ =
+      ToSeconds(TimestampValue(Date(MAX_YEAR, 12, 31), Hours(24) - Seconds(1)));
+  int32_t std_offset = timezone->base_utc_offset().total_seconds();
+  transitions->initial_offset_secs_ = std_offset;
+  if (!timezone->has_dst()) return transitions;
+
+  // Boost starts daylight savings time at a local standard time and ends it at a local
+  // daylight savings time. The local times in between the ones right before and right
+  // after a transition are skipped at the start and repeated at the end. Boost only
+  // handles these local times the same as a table if they are on the day of the
+  // transition, and if the rules give a start and an end on different days.
+  // The transitions of the years right outside of the table are added so that the
+  // offsets at the ends of the table are known.
+  int32_t dst_secs = timezone->dst_offset().total_seconds();
+  int32_t dst_offset = std_offset + dst_secs;
+  const int32_t SECS_PER_DAY = 24 * 60 * 60;
+  for (int year = MIN_YEAR - 1; year <= MAX_YEAR + 1; ++year) {
+    ptime start = timezone->dst_local_start_time(year);
+    ptime end = timezone->dst_local_end_time(year);
+    int32_t start_secs_of_day = start.time_of_day().total_seconds();
+    int32_t end_secs_of_day = end.time_of_day().total_seconds();
+    if (dst_secs <= 0 || start.date() == end.date() ||
+        start_secs_of_day + dst_secs > SECS_PER_DAY || end_secs_of_day < dst_secs) {
+      delete transitions;
+      return NULL;
+    }
+    int64_t start_secs = ToSeconds(TimestampValue(start));
+    Transition dst_start = {start_secs - std_offset, start_secs, dst_secs, dst_offset};
+    transitions->transitions_.push_back(dst_start);
+    int64_t end_secs = ToSeconds(TimestampValue(end));
+    Transition dst_end =
+        {end_secs - dst_offset, end_secs - dst_secs, dst_secs, std_offset};
+    transitions->transitions_.push_back(dst_end);
+  }
+  vector<Transition>* t = &transitions->transitions_;
+  sort(t->begin(), t->end(), [](const Transition& lhs, const Transition& rhs) {
+    return lhs.utc_secs < rhs.utc_secs;
+  });
+  // The offsets alternate, unless the rules are so odd that the transitions overlap.
+  for (int i = 1; i < t->size(); ++i) {
+    if ((*t)[i].offset_secs == (*t)[i - 1].offset_secs ||
+        (*t)[i].local_secs < (*t)[i - 1].local_secs + (*t)[i - 1].gap_secs) {
+      delete transitions;
+      return NULL;
+    }
+  }
+  transitions->initial_offset_secs_ =
+      t->front().offset_secs == dst_offset ? std_offset : dst_offset;
+  return transitions;
+}
+
+bool TimezoneTransitions::FromUtc(const TimestampValue& utc,
+    TimestampValue* local) const {
+  if (!utc.HasDateAndTime()) return false;
+  int64_t secs = ToSeconds(utc);
+  if (secs < min_secs_ || secs > max_secs_) return false;
+  // The first transition after 'secs'.
+  vector<Transition>::const_iterator it = upper_bound(transitions_.begin(),
+      transitions_.end(), secs, [](int64_t secs, const Transition& transition) {
+        return secs < transition.utc_secs;
+      });
+  int32_t offset = it == transitions_.begin() ? initial_offset_secs_ :
+      (it - 1)->offset_secs;
+  *local = FromSeconds(secs + offset, utc.time().fractional_seconds());
+  return true;
+}
+
+bool TimezoneTransitions::ToUtc(const TimestampValue& local,
+    TimestampValue* utc) const {
+  if (!local.HasDateAndTime()) return false;
+  int64_t secs = ToSeconds(local);
+  if (secs < min_secs_ || secs > max_secs_) return false;
+  vector<Transition>::const_iterator it = upper_bound(transitions_.begin(),
+      transitions_.end(), secs, [](int64_t secs, const Transition& transition) {
+        return secs < transition.local_secs;
+      });
+  int32_t offset = initial_offset_secs_;
+  if (it != transitions_.begin()) {
+    --it;
+    if (secs < it->local_secs + it->gap_secs) return false;
+    offset = it->offset_secs;
+  }
+  *utc = FromSeconds(secs - offset, local.time().fractional_seconds());
+  return true;
+}
+
 // Explicit template instantiation is required for proper linking. These functions
 // are only indirectly called via a function pointer provided by the opcode registry
 // which does not trigger implicit template instantiation.
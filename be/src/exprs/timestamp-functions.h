@@ -18,6 +18,7 @@
 
 #include <boost/date_time/local_time/local_time.hpp>
 #include <string>
+#include <vector>
 
 #include "udf/udf.h"
 
@@ -82,6 +83,13 @@ class TimestampFunctions {
   static StringVal FromUnix(FunctionContext* context, const TIME& unix_time,
       const StringVal& fmt);
 
+  /// Looks up the timezone if it is a constant and builds its TimezoneTransitions,
+  /// which FromUtc() and ToUtc() use instead of the boost timezone.
+  static void FromUtcAndToUtcPrepare(FunctionContext* context,
+      FunctionContext::FunctionStateScope scope);
+  static void FromUtcAndToUtcClose(FunctionContext* context,
+      FunctionContext::FunctionStateScope scope);
+
   /// Convert a timestamp to or from a particular timezone based time.
   static TimestampVal FromUtc(FunctionContext* context,
     const TimestampVal& ts_val, const StringVal& tz_string_val);
@@ -195,6 +203,10 @@ class TimezoneDatabase {
   static boost::local_time::time_zone_ptr FindTimezone(const std::string& tz,
       const TimestampValue& tv);
 
+  /// Returns true if the timezone that FindTimezone() returns for 'tz' depends on the
+  /// timestamp.
+  static bool IsTimestampDependent(const std::string& tz);
+
   /// Moscow Timezone No Daylight Savings Time (GMT+4), for use after March 2011
   static const boost::local_time::time_zone_ptr TIMEZONE_MSK_PRE_2011_DST;
 
@@ -204,6 +216,60 @@ class TimezoneDatabase {
   static std::vector<std::string> tz_region_list_;
 };
 
+/// The UTC offsets of a timezone between MIN_YEAR and MAX_YEAR as a table of the
+/// times at which they change. Timestamps are converted from and to UTC by a binary
+/// search of the table instead of evaluating the daylight savings rules of the boost
+/// timezone for every timestamp, with the same results as
+/// boost::local_time::local_date_time.
+class TimezoneTransitions {
+ public:
+  static const int MIN_YEAR = 1900;
+  static const int MAX_YEAR = 2100;
+
+  /// Returns the transitions of 'timezone', or NULL if its daylight savings rules
+  /// can't be represented by the table, e.g. because a transition crosses midnight.
+  static TimezoneTransitions* Create(const boost::local_time::time_zone_ptr& timezone);
+
+  /// Sets 'local' to the local time of 'utc'. Returns false if 'utc' has no date or
+  /// time or is outside of the years of the table, in which case it must be converted
+  /// by boost.
+  bool FromUtc(const TimestampValue& utc, TimestampValue* local) const;
+
+  /// Sets 'utc' to the UTC time of 'local'. Returns false in the same cases as
+  /// FromUtc(), and also if 'local' is skipped or repeated when the clocks are set
+  /// forward or back, for which boost returns not-a-date-time.
+  bool ToUtc(const TimestampValue& local, TimestampValue* utc) const;
+
+ private:
+  struct Transition {
+    /// The UTC time at which the offset changes, in seconds since the day number 0 of
+    /// boost::gregorian::date.
+    int64_t utc_secs;
+
+    /// The earlier of the local times right before and right after the transition,
+    /// i.e. the first local time that is skipped or repeated.
+    int64_t local_secs;
+
+    /// The number of local seconds that are skipped or repeated.
+    int32_t gap_secs;
+
+    /// The UTC offset from the transition on.
+    int32_t offset_secs;
+  };
+
+  TimezoneTransitions() { }
+
+  /// The times that the table covers, the same for UTC and local times.
+  int64_t min_secs_;
+  int64_t max_secs_;
+
+  /// The UTC offset before the first transition.
+  int32_t initial_offset_secs_;
+
+  /// Ordered by time.
+  std::vector<Transition> transitions_;
+};
+
 } // namespace impala
 
 #endif
@@ -0,0 +1,209 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exprs/vectorized-predicate.h"
+
+#include <functional>
+
+#include "common/object-pool.h"
+#include "exprs/expr.h"
+#include "exprs/slot-ref.h"
+#include "runtime/tuple.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace impala_udf;
+
+VectorizedPredicate::VectorizedPredicate(Op op, const SlotRef* slot_ref,
+    Expr* const_expr)
+  : op_(op),
+    tuple_idx_(slot_ref->tuple_idx()),
+    slot_offset_(slot_ref->slot_offset()),
+    null_indicator_offset_(slot_ref->null_indicator_offset()),
+    type_(slot_ref->type().type),
+    const_expr_(const_expr) {
+}
+
+VectorizedPredicate* VectorizedPredicate::Create(ObjectPool* pool, Expr* expr) {
+  if (expr->fn().binary_type != TFunctionBinaryType::BUILTIN) return NULL;
+  const string& fn_name = expr->fn().name.function_name;
+  if (expr->GetNumChildren() == 1) {
+    if (!expr->GetChild(0)->is_slotref()) return NULL;
+    const SlotRef* slot_ref = static_cast<const SlotRef*>(expr->GetChild(0));
+    if (fn_name == "is_null_pred") {
+      return pool->Add(new VectorizedPredicate(IS_NULL, slot_ref, NULL));
+    } else if (fn_name == "is_not_null_pred") {
+      return pool->Add(new VectorizedPredicate(IS_NOT_NULL, slot_ref, NULL));
+    }
+    return NULL;
+  }
+  if (expr->GetNumChildren() != 2) return NULL;
+
+  // The op if the slot is the left child, and if it is the right child.
+  Op op, flipped_op;
+  if (fn_name == "eq") {
+    op = flipped_op = EQ;
+  } else if (fn_name == "ne") {
+    op = flipped_op = NE;
+  } else if (fn_name == "lt") {
+    op = LT;
+    flipped_op = GT;
+  } else if (fn_name == "le") {
+    op = LE;
+    flipped_op = GE;
+  } else if (fn_name == "gt") {
+    op = GT;
+    flipped_op = LT;
+  } else if (fn_name == "ge") {
+    op = GE;
+    flipped_op = LE;
+  } else {
+    return NULL;
+  }
+  Expr* slot_expr = expr->GetChild(0);
+  Expr* const_expr = expr->GetChild(1);
+  if (!slot_expr->is_slotref()) {
+    swap(slot_expr, const_expr);
+    op = flipped_op;
+  }
+  if (!slot_expr->is_slotref() || !const_expr->IsConstant()) return NULL;
+  if (const_expr->type() != slot_expr->type()) return NULL;
+  switch (slot_expr->type().type) {
+    case TYPE_BOOLEAN:
+    case TYPE_TINYINT:
+    case TYPE_SMALLINT:
+    case TYPE_INT:
+    case TYPE_BIGINT:
+    case TYPE_FLOAT:
+    case TYPE_DOUBLE:
+      return pool->Add(
+          new VectorizedPredicate(op, static_cast<SlotRef*>(slot_expr), const_expr));
+    default:
+      return NULL;
+  }
+}
+
+int VectorizedPredicate::Eval(ExprContext* context, Tuple** rows,
+    int num_tuples_per_row, int* selection, int num_selected) const {
+  if (op_ == IS_NULL || op_ == IS_NOT_NULL) {
+    return EvalIsNull(op_ == IS_NULL, rows, num_tuples_per_row, selection, num_selected);
+  }
+  // A comparison with NULL is never true.
+  switch (type_) {
+    case TYPE_BOOLEAN: {
+      BooleanVal v = const_expr_->GetBooleanVal(context, NULL);
+      if (v.is_null) return 0;
+      return EvalCompare<bool>(v.val, rows, num_tuples_per_row, selection, num_selected);
+    }
+    case TYPE_TINYINT: {
+      TinyIntVal v = const_expr_->GetTinyIntVal(context, NULL);
+      if (v.is_null) return 0;
+      return EvalCompare<int8_t>(v.val, rows, num_tuples_per_row, selection,
+          num_selected);
+    }
+    case TYPE_SMALLINT: {
+      SmallIntVal v = const_expr_->GetSmallIntVal(context, NULL);
+      if (v.is_null) return 0;
+      return EvalCompare<int16_t>(v.val, rows, num_tuples_per_row, selection,
+          num_selected);
+    }
+    case TYPE_INT: {
+      IntVal v = const_expr_->GetIntVal(context, NULL);
+      if (v.is_null) return 0;
+      return EvalCompare<int32_t>(v.val, rows, num_tuples_per_row, selection,
+          num_selected);
+    }
+    case TYPE_BIGINT: {
+      BigIntVal v = const_expr_->GetBigIntVal(context, NULL);
+      if (v.is_null) return 0;
+      return EvalCompare<int64_t>(v.val, rows, num_tuples_per_row, selection,
+          num_selected);
+    }
+    case TYPE_FLOAT: {
+      FloatVal v = const_expr_->GetFloatVal(context, NULL);
+      if (v.is_null) return 0;
+      return EvalCompare<float>(v.val, rows, num_tuples_per_row, selection,
+          num_selected);
+    }
+    case TYPE_DOUBLE: {
+      DoubleVal v = const_expr_->GetDoubleVal(context, NULL);
+      if (v.is_null) return 0;
+      return EvalCompare<double>(v.val, rows, num_tuples_per_row, selection,
+          num_selected);
+    }
+    default:
+      DCHECK(false) << type_;
+      return 0;
+  }
+}
+
+template <typename T>
+int VectorizedPredicate::EvalCompare(T constant, Tuple** rows, int num_tuples_per_row,
+    int* selection, int num_selected) const {
+  switch (op_) {
+    case EQ:
+      return EvalCompare<T, std::equal_to<T> >(
+          constant, rows, num_tuples_per_row, selection, num_selected);
+    case NE:
+      return EvalCompare<T, std::not_equal_to<T> >(
+          constant, rows, num_tuples_per_row, selection, num_selected);
+    case LT:
+      return EvalCompare<T, std::less<T> >(
+          constant, rows, num_tuples_per_row, selection, num_selected);
+    case LE:
+      return EvalCompare<T, std::less_equal<T> >(
+          constant, rows, num_tuples_per_row, selection, num_selected);
+    case GT:
+      return EvalCompare<T, std::greater<T> >(
+          constant, rows, num_tuples_per_row, selection, num_selected);
+    case GE:
+      return EvalCompare<T, std::greater_equal<T> >(
+          constant, rows, num_tuples_per_row, selection, num_selected);
+    default:
+      DCHECK(false) << op_;
+      return 0;
+  }
+}
+
+template <typename T, typename Compare>
+int VectorizedPredicate::EvalCompare(T constant, Tuple** rows, int num_tuples_per_row,
+    int* selection, int num_selected) const {
+  Compare compare;
+  int num_passed = 0;
+  for (int i = 0; i < num_selected; ++i) {
+    int row_idx = selection[i];
+    Tuple* tuple = rows[row_idx * num_tuples_per_row + tuple_idx_];
+    bool pass = tuple != NULL && !tuple->IsNull(null_indicator_offset_) &&
+        compare(*reinterpret_cast<T*>(tuple->GetSlot(slot_offset_)), constant);
+    // Always write the index and only keep it if the row passes, which avoids a
+    // branch on the result of the comparison.
+    selection[num_passed] = row_idx;
+    num_passed += pass;
+  }
+  return num_passed;
+}
+
+int VectorizedPredicate::EvalIsNull(bool is_null, Tuple** rows, int num_tuples_per_row,
+    int* selection, int num_selected) const {
+  int num_passed = 0;
+  for (int i = 0; i < num_selected; ++i) {
+    int row_idx = selection[i];
+    Tuple* tuple = rows[row_idx * num_tuples_per_row + tuple_idx_];
+    bool slot_is_null = tuple == NULL || tuple->IsNull(null_indicator_offset_);
+    selection[num_passed] = row_idx;
+    num_passed += slot_is_null == is_null;
+  }
+  return num_passed;
+}
@@ -0,0 +1,89 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_EXPRS_VECTORIZED_PREDICATE_H
+#define IMPALA_EXPRS_VECTORIZED_PREDICATE_H
+
+#include "runtime/descriptors.h"
+
+namespace impala {
+
+class Expr;
+class ExprContext;
+class ObjectPool;
+class SlotRef;
+class Tuple;
+
+/// Evaluates a simple predicate on a slot over a batch of rows, see
+/// Expr::EvalPredicateBatch(). The supported predicates are the builtin comparisons of a
+/// numeric or boolean slot with a constant of the same type (in either order), and
+/// IS NULL and IS NOT NULL of a slot. Each of them is evaluated with one loop over the
+/// batch that reads the slots directly, instead of calling the compute functions of the
+/// expr tree for every row.
+class VectorizedPredicate {
+ public:
+  /// Returns the vectorized form of 'expr' allocated from 'pool', or NULL if 'expr' is
+  /// not one of the supported predicates. The children of 'expr' must be prepared.
+  static VectorizedPredicate* Create(ObjectPool* pool, Expr* expr);
+
+  /// Same interface as Expr::EvalPredicateBatch().
+  int Eval(ExprContext* context, Tuple** rows, int num_tuples_per_row, int* selection,
+      int num_selected) const;
+
+ private:
+  enum Op {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+    IS_NULL,
+    IS_NOT_NULL,
+  };
+
+  VectorizedPredicate(Op op, const SlotRef* slot_ref, Expr* const_expr);
+
+  /// Evaluates the comparison 'op_' of the slot with 'constant' of the slot's native type.
+  template <typename T>
+  int EvalCompare(T constant, Tuple** rows, int num_tuples_per_row, int* selection,
+      int num_selected) const;
+
+  template <typename T, typename Compare>
+  int EvalCompare(T constant, Tuple** rows, int num_tuples_per_row, int* selection,
+      int num_selected) const;
+
+  /// Evaluates IS NULL if 'is_null' is true and IS NOT NULL otherwise.
+  int EvalIsNull(bool is_null, Tuple** rows, int num_tuples_per_row, int* selection,
+      int num_selected) const;
+
+  const Op op_;
+
+  /// The position of the slot in the rows.
+  const int tuple_idx_;
+  const int slot_offset_;
+  const NullIndicatorOffset null_indicator_offset_;
+
+  /// The type of the slot.
+  const PrimitiveType type_;
+
+  /// The constant the slot is compared with, evaluated for each batch. NULL for IS NULL
+  /// and IS NOT NULL.
+  Expr* const const_expr_;
+};
+
+}
+
+#endif
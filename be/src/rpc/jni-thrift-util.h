@@ -56,6 +56,22 @@ Status DeserializeThriftMsg(JNIEnv* env, jbyteArray serialized_msg, T* deseriali
   return Status::OK();
 }
 
+/// Like DeserializeThriftMsg(), but deserializes directly from the Java heap instead of
+/// from the copy that GetByteArrayElements() usually makes of large arrays. The array
+/// is pinned while it is deserialized, which may hold off the JVM's garbage collector,
+/// so this must not be used while holding locks that Java threads may wait for.
+template <class T>
+Status DeserializeThriftMsgPinned(JNIEnv* env, jbyteArray serialized_msg,
+    T* deserialized_msg) {
+  uint32_t buf_size = env->GetArrayLength(serialized_msg);
+  void* buf = env->GetPrimitiveArrayCritical(serialized_msg, NULL);
+  if (buf == NULL) return Status("couldn't pin jbyteArray");
+  Status status = DeserializeThriftMsg(
+      reinterpret_cast<uint8_t*>(buf), &buf_size, false, deserialized_msg);
+  env->ReleasePrimitiveArrayCritical(serialized_msg, buf, JNI_ABORT);
+  return status;
+}
+
 }
 
 #endif
@@ -20,6 +20,7 @@
 
 #include "common/logging.h"
 #include "util/debug-util.h"
+#include "util/histogram-metric.h"
 #include "util/time.h"
 #include "util/webserver.h"
 
@@ -32,6 +33,12 @@ using namespace strings;
 // Metric key format for rpc call duration metrics.
 const string RPC_TIME_STATS_METRIC_KEY = "rpc-method.$0.call_duration";
 
+// Metric key format for rpc call latency histograms.
+const string RPC_LATENCIES_METRIC_KEY = "rpc-method.$0.call_duration_histogram";
+
+// The highest rpc latency that the histograms track.
+const int64_t MAX_RPC_LATENCY_NS = 10L * 60L * 1000L * 1000L * 1000L;
+
 // Singleton class to keep track of all RpcEventHandlers, and to render them to a
 // web-based summary page.
 class RpcEventHandlerManager {
@@ -149,6 +156,9 @@ void RpcEventHandler::ToJson(Value* server, Document* document) {
     const string& human_readable = rpc.second->time_stats->ToHumanReadable();
     Value summary(human_readable.c_str(), document->GetAllocator());
     method.AddMember("summary", summary, document->GetAllocator());
+    Value latencies(rpc.second->latencies->ToHumanReadable().c_str(),
+        document->GetAllocator());
+    method.AddMember("latencies", latencies, document->GetAllocator());
     method.AddMember("in_flight", rpc.second->num_in_flight.Load(),
         document->GetAllocator());
     Value server_name(server_name_.c_str(), document->GetAllocator());
@@ -171,13 +181,16 @@ void* RpcEventHandler::getContext(const char* fn_name, void* server_context) {
       const string& rpc_name = Substitute("$0.$1", server_name_, descriptor->name);
       descriptor->time_stats = StatsMetric<double>::CreateAndRegister(metrics_,
           RPC_TIME_STATS_METRIC_KEY, rpc_name);
+      descriptor->latencies = metrics_->RegisterMetric(new HistogramMetric(
+          MakeTMetricDef(Substitute(RPC_LATENCIES_METRIC_KEY, rpc_name),
+          TMetricKind::HISTOGRAM, TUnit::TIME_NS), MAX_RPC_LATENCY_NS, 2));
       it = method_map_.insert(make_pair(descriptor->name, descriptor)).first;
     }
   }
   it->second->num_in_flight.Add(1);
   // TODO: Consider pooling these
   InvocationContext* ctxt_ptr =
-      new InvocationContext(MonotonicMillis(), cnxn_ctx, it->second);
+      new InvocationContext(MonotonicNanos(), cnxn_ctx, it->second);
   VLOG_RPC << "RPC call: " << string(fn_name) << "(from "
            << ctxt_ptr->cnxn_ctx->network_address << ")";
   return reinterpret_cast<void*>(ctxt_ptr);
@@ -185,14 +198,15 @@ void* RpcEventHandler::getContext(const char* fn_name, void* server_context) {
 
 void RpcEventHandler::postWrite(void* ctx, const char* fn_name, uint32_t bytes) {
   InvocationContext* rpc_ctx = reinterpret_cast<InvocationContext*>(ctx);
-  int64_t elapsed_time = MonotonicMillis() - rpc_ctx->start_time_ms;
+  int64_t elapsed_ns = MonotonicNanos() - rpc_ctx->start_time_ns;
   const string& call_name = string(fn_name);
   // TODO: bytes is always 0, how come?
   VLOG_RPC << "RPC call: " << server_name_ << ":" << call_name << " from "
            << rpc_ctx->cnxn_ctx->network_address << " took "
-           << PrettyPrinter::Print(elapsed_time * 1000L * 1000L, TUnit::TIME_NS);
+           << PrettyPrinter::Print(elapsed_ns, TUnit::TIME_NS);
   MethodDescriptor* descriptor = rpc_ctx->method_descriptor;
   delete rpc_ctx;
   descriptor->num_in_flight.Add(-1);
-  descriptor->time_stats->Update(elapsed_time);
+  descriptor->time_stats->Update(elapsed_ns / (1000L * 1000L));
+  descriptor->latencies->Update(elapsed_ns);
 }
@@ -27,6 +27,7 @@
 
 namespace impala {
 
+class HistogramMetric;
 class Webserver;
 class MetricGroup;
 
@@ -60,6 +61,7 @@ class RpcEventHandler : public apache::thrift::TProcessorEventHandler {
   ///   {
   ///     "name": "BeeswaxService.query",
   ///     "summary": " count: 1, last: 293, min: 293, max: 293, mean: 293, stddev: 0",
+  ///     "latencies": "Count: 1, 25th %-ile: 293.00ms, ...",
   ///     "in_flight": 0
   ///     },
   ///   ]
@@ -83,6 +85,10 @@ class RpcEventHandler : public apache::thrift::TProcessorEventHandler {
     /// Summary statistics for the time taken to respond to this method
     StatsMetric<double>* time_stats;
 
+    /// Histogram of the time taken to respond to this method, in nanoseconds. Not
+    /// cleared by Reset().
+    HistogramMetric* latencies;
+
     /// Number of invocations in flight
     AtomicInt32 num_in_flight;
   };
@@ -92,8 +98,8 @@ class RpcEventHandler : public apache::thrift::TProcessorEventHandler {
 
   /// Created per-Rpc invocation
   struct InvocationContext {
-    /// Monotonic milliseconds (typically boot time) when the call started.
-    const int64_t start_time_ms;
+    /// Monotonic nanoseconds (typically boot time) when the call started.
+    const int64_t start_time_ns;
 
     /// Per-connection information, owned by ThriftServer. The lifetime of this struct is
     /// tied to the lifetime of the connection, which is guaranteed to be longer than the
@@ -105,7 +111,7 @@ class RpcEventHandler : public apache::thrift::TProcessorEventHandler {
 
     InvocationContext(int64_t start_time, const ThriftServer::ConnectionContext* cnxn_ctx,
         MethodDescriptor* descriptor)
-        : start_time_ms(start_time), cnxn_ctx(cnxn_ctx), method_descriptor(descriptor) { }
+        : start_time_ns(start_time), cnxn_ctx(cnxn_ctx), method_descriptor(descriptor) { }
   };
 
   /// Protects method_map_ and rpc_counter_
@@ -61,6 +61,9 @@ const static int WRITE_WAIT_MILLIS = 500;
 const static int WRITE_CHECK_INTERVAL_MILLIS = 10;
 
 DECLARE_bool(disk_spill_encryption);
+DECLARE_string(disk_spill_compression);
+DECLARE_bool(disk_spill_checksum);
+DECLARE_bool(guarantee_block_mgr_reservations);
 
 namespace impala {
 
@@ -641,6 +644,105 @@ TEST_F(BufferedBlockMgrTest, GetNewBlockSmallBlocks) {
   TearDownMgrs();
 }
 
+// Test that small power-of-two blocks are carved out of shared chunks and that their
+// memory is recycled when they are deleted.
+TEST_F(BufferedBlockMgrTest, GetNewBlockBuddyBlocks) {
+  const int block_size = 1024 * 1024;
+  const int small_size = 64 * 1024;
+  int max_num_blocks = 3;
+  BufferedBlockMgr* block_mgr;
+  BufferedBlockMgr::Client* client;
+  block_mgr = CreateMgrAndClient(0, max_num_blocks, block_size, 0, false,
+      client_tracker_.get(), &client);
+
+  // The first small block allocates a chunk, the rest of which is charged to the block
+  // mgr until other small blocks use it.
+  vector<BufferedBlockMgr::Block*> blocks;
+  BufferedBlockMgr::Block* new_block = NULL;
+  EXPECT_OK(block_mgr->GetNewBlock(client, NULL, &new_block, small_size));
+  ASSERT_TRUE(new_block != NULL);
+  EXPECT_EQ(client_tracker_->consumption(), small_size);
+  EXPECT_EQ(block_mgr->bytes_allocated(), block_size - small_size);
+  blocks.push_back(new_block);
+  EXPECT_OK(block_mgr->GetNewBlock(client, NULL, &new_block, 2 * small_size));
+  ASSERT_TRUE(new_block != NULL);
+  blocks.push_back(new_block);
+  EXPECT_OK(block_mgr->GetNewBlock(client, NULL, &new_block, small_size));
+  ASSERT_TRUE(new_block != NULL);
+  blocks.push_back(new_block);
+  EXPECT_EQ(client_tracker_->consumption(), 4 * small_size);
+  EXPECT_EQ(block_mgr->bytes_allocated(), block_size - 4 * small_size);
+  // The buffers are packed at the start of the chunk.
+  EXPECT_EQ(blocks[0]->buffer() + small_size, blocks[2]->buffer());
+  EXPECT_EQ(blocks[0]->buffer() + 2 * small_size, blocks[1]->buffer());
+
+  // A deleted buffer is reused by the next block of its size.
+  uint8_t* freed_buffer = blocks[2]->buffer();
+  blocks[2]->Delete();
+  EXPECT_EQ(client_tracker_->consumption(), 3 * small_size);
+  EXPECT_EQ(block_mgr->bytes_allocated(), block_size - 3 * small_size);
+  EXPECT_OK(block_mgr->GetNewBlock(client, NULL, &new_block, small_size));
+  ASSERT_TRUE(new_block != NULL);
+  EXPECT_EQ(new_block->buffer(), freed_buffer);
+  blocks[2] = new_block;
+
+  // Sizes that aren't powers of two are allocated individually.
+  EXPECT_OK(block_mgr->GetNewBlock(client, NULL, &new_block, 3 * small_size));
+  ASSERT_TRUE(new_block != NULL);
+  EXPECT_EQ(client_tracker_->consumption(), 7 * small_size);
+  EXPECT_EQ(block_mgr->bytes_allocated(), block_size - 4 * small_size);
+  blocks.push_back(new_block);
+
+  // The chunk is released once all of its buffers are deleted.
+  DeleteBlocks(blocks);
+  EXPECT_EQ(client_tracker_->consumption(), 0);
+  EXPECT_EQ(block_mgr->bytes_allocated(), 0);
+  TearDownMgrs();
+}
+
+// Test that guaranteed reservations claim their memory when the client registers and
+// that a reservation that doesn't fit the memory limit fails up front.
+TEST_F(BufferedBlockMgrTest, GuaranteedReservations) {
+  FLAGS_guarantee_block_mgr_reservations = true;
+  const int block_size = 1024;
+  int max_num_buffers = 3;
+  RuntimeState* state;
+  BufferedBlockMgr* block_mgr = CreateMgr(0, max_num_buffers, block_size, &state);
+
+  BufferedBlockMgr::Client* client1;
+  EXPECT_OK(block_mgr->RegisterClient("client1", 2, true, client_tracker_.get(), state,
+      &client1));
+  EXPECT_EQ(block_mgr->bytes_allocated(), 2 * block_size);
+
+  // Only one buffer is left, even though none has been allocated yet.
+  BufferedBlockMgr::Client* client2;
+  Status status = block_mgr->RegisterClient("client2", 2, true, client_tracker_.get(),
+      state, &client2);
+  EXPECT_TRUE(status.IsMemLimitExceeded());
+
+  // Clearing the reservation releases the claimed memory.
+  block_mgr->ClearReservations(client1);
+  EXPECT_EQ(block_mgr->bytes_allocated(), 0);
+
+  // The reserved blocks are allocated from the claimed memory.
+  BufferedBlockMgr::Client* client3;
+  EXPECT_OK(block_mgr->RegisterClient("client3", 3, false, client_tracker_.get(), state,
+      &client3));
+  EXPECT_EQ(block_mgr->bytes_allocated(), 3 * block_size);
+  vector<BufferedBlockMgr::Block*> blocks;
+  AllocateBlocks(block_mgr, client3, 3, &blocks);
+  EXPECT_EQ(block_mgr->bytes_allocated(), 3 * block_size);
+  DeleteBlocks(blocks);
+  block_mgr->ClearReservations(client3);
+
+  // The freed buffers back a new reservation, so nothing more is claimed.
+  EXPECT_OK(block_mgr->RegisterClient("client4", 2, false, client_tracker_.get(), state,
+      &client2));
+  EXPECT_EQ(block_mgr->bytes_allocated(), 3 * block_size);
+  FLAGS_guarantee_block_mgr_reservations = false;
+  TearDownMgrs();
+}
+
 // Test that pinning more blocks than the max available buffers.
 TEST_F(BufferedBlockMgrTest, Pin) {
   int max_num_blocks = 5;
@@ -1372,6 +1474,81 @@ TEST_F(BufferedBlockMgrTest, Multi4Random_encryption) {
   TestRandomInternalMulti(4, 8 * 1024);
 }
 
+TEST_F(BufferedBlockMgrTest, SingleRandom_compression) {
+  FLAGS_disk_spill_encryption = false;
+  FLAGS_disk_spill_compression = "lz4";
+  FLAGS_disk_spill_checksum = true;
+  TestRandomInternalSingle(8 * 1024);
+  FLAGS_disk_spill_compression = "";
+  FLAGS_disk_spill_checksum = false;
+}
+
+TEST_F(BufferedBlockMgrTest, SingleRandom_snappy_compression) {
+  FLAGS_disk_spill_encryption = false;
+  FLAGS_disk_spill_compression = "snappy";
+  TestRandomInternalSingle(8 * 1024);
+  FLAGS_disk_spill_compression = "";
+}
+
+TEST_F(BufferedBlockMgrTest, Multi2Random_compression_encryption) {
+  FLAGS_disk_spill_encryption = true;
+  FLAGS_disk_spill_compression = "lz4";
+  FLAGS_disk_spill_checksum = true;
+  TestRandomInternalMulti(2, 8 * 1024);
+  FLAGS_disk_spill_compression = "";
+  FLAGS_disk_spill_checksum = false;
+}
+
+// Test that compressible blocks are written compressed and read back intact, and that
+// incompressible blocks are written as is.
+TEST_F(BufferedBlockMgrTest, CompressedSpill) {
+  FLAGS_disk_spill_compression = "lz4";
+  FLAGS_disk_spill_checksum = true;
+  int max_num_buffers = 2;
+  const int block_size = 8 * 1024;
+  BufferedBlockMgr* block_mgr;
+  BufferedBlockMgr::Client* client;
+  block_mgr = CreateMgrAndClient(0, max_num_buffers, block_size, 0, false,
+      client_tracker_.get(), &client);
+
+  // One block of repeated bytes and one of random bytes.
+  vector<BufferedBlockMgr::Block*> blocks;
+  vector<vector<uint8_t> > expected(max_num_buffers);
+  for (int i = 0; i < max_num_buffers; ++i) {
+    BufferedBlockMgr::Block* block;
+    EXPECT_OK(block_mgr->GetNewBlock(client, NULL, &block));
+    ASSERT_TRUE(block != NULL);
+    uint8_t* data = block->Allocate<uint8_t>(block_size);
+    for (int j = 0; j < block_size; ++j) data[j] = i == 0 ? 'a' : rand();
+    expected[i].assign(data, data + block_size);
+    blocks.push_back(block);
+  }
+  UnpinBlocks(blocks);
+  WaitForWrites(block_mgr);
+
+  RuntimeProfile* profile = block_mgr->profile();
+  int64_t bytes_written = profile->GetCounter("BytesWritten")->value();
+  EXPECT_EQ(profile->GetCounter("UncompressedBytesWritten")->value(),
+      max_num_buffers * block_size);
+  EXPECT_LT(bytes_written, (max_num_buffers - 1) * block_size + block_size / 2);
+  EXPECT_GE(bytes_written, (max_num_buffers - 1) * block_size);
+
+  // Take the buffers of the written blocks so that they are read back from disk.
+  vector<BufferedBlockMgr::Block*> new_blocks;
+  AllocateBlocks(block_mgr, client, max_num_buffers, &new_blocks);
+  DeleteBlocks(new_blocks);
+  PinBlocks(blocks);
+  for (int i = 0; i < max_num_buffers; ++i) {
+    EXPECT_EQ(blocks[i]->valid_data_len(), block_size);
+    EXPECT_EQ(memcmp(blocks[i]->buffer(), &expected[i][0], block_size), 0);
+  }
+
+  DeleteBlocks(blocks);
+  TearDownMgrs();
+  FLAGS_disk_spill_compression = "";
+  FLAGS_disk_spill_checksum = false;
+}
+
 // TODO: Enable when we improve concurrency/scalability of block mgr.
 // TEST_F(BufferedBlockMgrTest, Multi8Random_encryption) {
 //   FLAGS_disk_spill_encryption = true;
@@ -20,7 +20,9 @@
 #include "util/runtime-profile.h"
 #include "util/disk-info.h"
 #include "util/filesystem-util.h"
+#include "util/hash-util.h"
 #include "util/impalad-metrics.h"
+#include "util/time.h"
 #include "util/uid-util.h"
 
 #include <openssl/rand.h>
@@ -32,6 +34,22 @@
 
 DEFINE_bool(disk_spill_encryption, false, "Set this to encrypt and perform an integrity "
   "check on all data spilled to disk during a query");
+DEFINE_string(disk_spill_compression, "", "Codec used to compress data spilled to disk "
+  "during a query: 'lz4', 'snappy', 'zstd' (if built with zstd) or empty for no "
+  "compression");
+DEFINE_int32(spill_read_ahead_blocks, 0, "(Advanced) Number of spilled blocks that "
+  "sequential readers, e.g. sort merges and spilled hash join partitions, read ahead "
+  "of the block they are processing. 0 disables read-ahead.");
+DEFINE_bool(disk_spill_checksum, false, "Set this to checksum all data spilled to disk "
+  "during a query and verify it when it is read back");
+DEFINE_bool(scratch_load_aware_placement, true, "(Advanced) If true, spilled blocks are "
+  "placed on the scratch device expected to write them soonest, based on its queued "
+  "writes and measured throughput. If false, blocks are round-robined across devices.");
+DEFINE_bool(guarantee_block_mgr_reservations, false, "(Advanced) If true, the memory "
+  "of the buffers reserved by block mgr clients, e.g. the minimum buffers of spilling "
+  "operators, is claimed from the query's memory limit when the client registers. A "
+  "query that can't get its reservations fails up front instead of running with "
+  "oversubscribed reservations that may fail later.");
 
 #include "common/names.h"
 
@@ -135,8 +153,12 @@ BufferedBlockMgr::Block::Block(BufferedBlockMgr* block_mgr)
     client_(NULL),
     write_range_(NULL),
     tmp_file_(NULL),
+    write_issue_time_ns_(0),
+    write_bytes_ahead_(0),
     valid_data_len_(0),
-    num_rows_(0) {
+    num_rows_(0),
+    is_compressed_(false),
+    read_ahead_range_(NULL) {
 }
 
 Status BufferedBlockMgr::Block::Pin(bool* pinned, Block* release_block, bool unpin) {
@@ -151,6 +173,10 @@ void BufferedBlockMgr::Block::Delete() {
   block_mgr_->DeleteBlock(this);
 }
 
+Status BufferedBlockMgr::Block::ReadAhead() {
+  return block_mgr_->ReadAheadBlock(this);
+}
+
 void BufferedBlockMgr::Block::Init() {
   // No locks are taken because the block is new or has previously been deleted.
   is_pinned_ = false;
@@ -205,9 +231,19 @@ string BufferedBlockMgr::Block::DebugString() const {
   return ss.str();
 }
 
+// Returns the largest power of two that is at most 'block_size', or 0 if that is less
+// than 'min_buffer_size'.
+static int64_t BuddyChunkSize(int64_t block_size, int64_t min_buffer_size) {
+  if (block_size < min_buffer_size) return 0;
+  int64_t chunk_size = min_buffer_size;
+  while (chunk_size * 2 <= block_size) chunk_size *= 2;
+  return chunk_size;
+}
+
 BufferedBlockMgr::BufferedBlockMgr(RuntimeState* state, TmpFileMgr* tmp_file_mgr,
     int64_t block_size)
   : max_block_size_(block_size),
+    buddy_chunk_size_(BuddyChunkSize(block_size, MIN_BUDDY_BUFFER_SIZE)),
     // Keep two writes in flight per scratch disk so the disks can stay busy.
     block_write_threshold_(tmp_file_mgr->num_active_tmp_devices() * 2),
     disable_spill_(state->query_ctx().disable_spilling || block_write_threshold_ == 0),
@@ -216,12 +252,20 @@ BufferedBlockMgr::BufferedBlockMgr(RuntimeState* state, TmpFileMgr* tmp_file_mgr
     initialized_(false),
     unfullfilled_reserved_buffers_(0),
     total_pinned_buffers_(0),
+    num_claimed_buffers_(0),
+    free_buddy_bytes_(0),
     non_local_outstanding_writes_(0),
     io_mgr_(state->io_mgr()),
     is_cancelled_(false),
     writes_issued_(0),
+    read_ahead_blocks_(max(0, FLAGS_spill_read_ahead_blocks)),
     encryption_(FLAGS_disk_spill_encryption),
-    check_integrity_(FLAGS_disk_spill_encryption) {
+    check_integrity_(FLAGS_disk_spill_encryption),
+    checksum_(FLAGS_disk_spill_checksum),
+    spill_codec_(THdfsCompression::NONE) {
+  for (int64_t len = MIN_BUDDY_BUFFER_SIZE; len <= buddy_chunk_size_; len *= 2) {
+    free_buddy_buffers_.push_back(set<uint8_t*>());
+  }
 }
 
 Status BufferedBlockMgr::Create(RuntimeState* state, MemTracker* parent,
@@ -257,6 +301,7 @@ int64_t BufferedBlockMgr::remaining_unreserved_buffers() const {
   int64_t num_buffers = free_io_buffers_.size() +
       unpinned_blocks_.size() + non_local_outstanding_writes_;
   num_buffers += mem_tracker_->SpareCapacity() / max_block_size();
+  num_buffers += num_claimed_buffers_;
   num_buffers -= unfullfilled_reserved_buffers_;
   return num_buffers;
 }
@@ -270,9 +315,42 @@ Status BufferedBlockMgr::RegisterClient(const string& debug_info,
   lock_guard<mutex> lock(lock_);
   *client = obj_pool_.Add(aClient);
   unfullfilled_reserved_buffers_ += num_reserved_buffers;
+  if (FLAGS_guarantee_block_mgr_reservations && !ClaimReservedBuffers()) {
+    unfullfilled_reserved_buffers_ -= num_reserved_buffers;
+    (*client)->num_reserved_buffers_ = 0;
+    Status status = Status::MemLimitExceeded();
+    status.AddDetail(Substitute("The memory limit is too low to guarantee the $0 "
+        "reserved by $1.", PrettyPrinter::Print(
+        num_reserved_buffers * max_block_size(), TUnit::BYTES), debug_info));
+    VLOG_QUERY << "Query: " << query_id_ << " could not claim reservation for "
+               << debug_info << endl << DebugInternal();
+    return status;
+  }
   return Status::OK();
 }
 
+int64_t BufferedBlockMgr::unbacked_reserved_buffers() const {
+  // Buffers that are already in the pool back the reservations, as other clients can't
+  // take them from the reserved ones.
+  return unfullfilled_reserved_buffers_ - static_cast<int64_t>(free_io_buffers_.size())
+      - unpinned_blocks_.size() - non_local_outstanding_writes_;
+}
+
+bool BufferedBlockMgr::ClaimReservedBuffers() {
+  int64_t num_buffers = unbacked_reserved_buffers() - num_claimed_buffers_;
+  if (num_buffers <= 0) return true;
+  if (!mem_tracker_->TryConsume(num_buffers * max_block_size_)) return false;
+  num_claimed_buffers_ += num_buffers;
+  return true;
+}
+
+void BufferedBlockMgr::ReleaseClaimedBuffers(int num_buffers) {
+  num_buffers = min(num_buffers, num_claimed_buffers_);
+  if (num_buffers <= 0) return;
+  mem_tracker_->Release(num_buffers * max_block_size_);
+  num_claimed_buffers_ -= num_buffers;
+}
+
 void BufferedBlockMgr::ClearReservations(Client* client) {
   lock_guard<mutex> lock(lock_);
   // TODO: Can the modifications to the client's mem variables can be made w/o the lock?
@@ -284,6 +362,9 @@ void BufferedBlockMgr::ClearReservations(Client* client) {
 
   unfullfilled_reserved_buffers_ -= client->num_tmp_reserved_buffers_;
   client->num_tmp_reserved_buffers_ = 0;
+  // Claims beyond the remaining reservations would only withhold memory.
+  ReleaseClaimedBuffers(
+      num_claimed_buffers_ - max<int64_t>(0, unbacked_reserved_buffers()));
 }
 
 bool BufferedBlockMgr::TryAcquireTmpReservation(Client* client, int num_buffers) {
@@ -438,10 +519,12 @@ Status BufferedBlockMgr::GetNewBlock(Client* client, Block* unpin_block, Block**
     if (len > 0 && len < max_block_size_) {
       DCHECK(unpin_block == NULL);
       if (client->tracker_->TryConsume(len)) {
-        // TODO: Have a cache of unused blocks of size 'len' (0, max_block_size_)
-        uint8_t* buffer = new uint8_t[len];
+        uint8_t* buffer = AllocateBuddyBuffer(len);
+        bool is_buddy = buffer != NULL;
+        if (!is_buddy) buffer = new uint8_t[len];
         // Descriptors for non-I/O sized buffers are deleted when the block is deleted.
         new_block->buffer_desc_ = new BufferDescriptor(buffer, len);
+        new_block->buffer_desc_->is_buddy = is_buddy;
         new_block->buffer_desc_->block = new_block;
         new_block->is_pinned_ = true;
         client->PinBuffer(new_block->buffer_desc_);
@@ -575,6 +658,7 @@ BufferedBlockMgr::~BufferedBlockMgr() {
   }
 
   // Free memory resources.
+  ReleaseClaimedBuffers(num_claimed_buffers_);
   for (BufferDescriptor* buffer: all_io_buffers_) {
     mem_tracker_->Release(buffer->len);
     delete[] buffer->buffer;
@@ -671,43 +755,80 @@ Status BufferedBlockMgr::PinBlock(Block* block, bool* pinned, Block* release_blo
   DCHECK(block->write_range_ != NULL) << block->DebugString() << endl << release_block;
 
   {
-    // Read the block from disk if it was not in memory.
-    SCOPED_TIMER(disk_read_timer_);
-    // Create a ScanRange to perform the read.
-    DiskIoMgr::ScanRange* scan_range =
-        obj_pool_.Add(new DiskIoMgr::ScanRange());
-    scan_range->Reset(NULL, block->write_range_->file(), block->write_range_->len(),
-        block->write_range_->offset(), block->write_range_->disk_id(), false, block,
-        DiskIoMgr::ScanRange::NEVER_CACHE);
-    vector<DiskIoMgr::ScanRange*> ranges(1, scan_range);
-    status = io_mgr_->AddScanRanges(io_request_context_, ranges, true);
-    if (!status.ok()) goto error;
+    // A compressed block is read into a temporary buffer and decompressed into the
+    // block's buffer once its contents have been verified and decrypted.
+    int64_t disk_len = block->write_range_->len();
+    boost::scoped_array<uint8_t> compressed_buffer;
+    uint8_t* read_buffer = block->buffer();
+    if (block->is_compressed_) {
+      compressed_buffer.reset(new uint8_t[disk_len]);
+      read_buffer = compressed_buffer.get();
+    }
 
-    // Read from the io mgr buffer into the block's assigned buffer.
-    int64_t offset = 0;
-    bool buffer_eosr;
-    do {
-      DiskIoMgr::BufferDescriptor* io_mgr_buffer;
-      status = scan_range->GetNext(&io_mgr_buffer);
+    {
+      // Read the block from disk if it was not in memory.
+      SCOPED_TIMER(disk_read_timer_);
+      SCOPED_WAIT_TIMER(SPILL_WAIT);
+      // Use the read issued by ReadAhead(), if any. Its buffers are now accounted for
+      // by the block's buffer.
+      DiskIoMgr::ScanRange* scan_range = NULL;
+      {
+        lock_guard<mutex> lock(lock_);
+        scan_range = block->read_ahead_range_;
+        if (scan_range != NULL) {
+          block->read_ahead_range_ = NULL;
+          mem_tracker_->Release(scan_range->len());
+          read_ahead_hit_counter_->Add(1);
+        }
+      }
+      if (scan_range == NULL) {
+        // Create a ScanRange to perform the read.
+        scan_range = obj_pool_.Add(new DiskIoMgr::ScanRange());
+        scan_range->Reset(NULL, block->write_range_->file(), disk_len,
+            block->write_range_->offset(), block->write_range_->disk_id(), false, block,
+            DiskIoMgr::ScanRange::NEVER_CACHE);
+        vector<DiskIoMgr::ScanRange*> ranges(1, scan_range);
+        status = io_mgr_->AddScanRanges(io_request_context_, ranges, true);
+        if (!status.ok()) goto error;
+      }
+      DCHECK_EQ(scan_range->len(), disk_len);
+
+      // Read from the io mgr buffer into the block's assigned buffer.
+      int64_t offset = 0;
+      bool buffer_eosr;
+      do {
+        DiskIoMgr::BufferDescriptor* io_mgr_buffer;
+        status = scan_range->GetNext(&io_mgr_buffer);
+        if (!status.ok()) goto error;
+        memcpy(read_buffer + offset, io_mgr_buffer->buffer(), io_mgr_buffer->len());
+        offset += io_mgr_buffer->len();
+        buffer_eosr = io_mgr_buffer->eosr();
+        io_mgr_buffer->Return();
+      } while (!buffer_eosr);
+      DCHECK_EQ(offset, disk_len);
+    }
+
+    if (checksum_) {
+      status = VerifyChecksum(block, read_buffer, disk_len);
       if (!status.ok()) goto error;
-      memcpy(block->buffer() + offset, io_mgr_buffer->buffer(), io_mgr_buffer->len());
-      offset += io_mgr_buffer->len();
-      buffer_eosr = io_mgr_buffer->eosr();
-      io_mgr_buffer->Return();
-    } while (!buffer_eosr);
-    DCHECK_EQ(offset, block->write_range_->len());
-  }
+    }
 
-  // Verify integrity first, because the hash was generated from encrypted data.
-  if (check_integrity_) {
-    status = VerifyHash(block);
-    if (!status.ok()) goto error;
-  }
+    // Verify integrity first, because the hash was generated from encrypted data.
+    if (check_integrity_) {
+      status = VerifyHash(block, read_buffer, disk_len);
+      if (!status.ok()) goto error;
+    }
 
-  // Decryption is done in-place, since the buffer can't be accessed by anyone else.
-  if (encryption_) {
-    status = Decrypt(block);
-    if (!status.ok()) goto error;
+    // Decryption is done in-place, since the buffer can't be accessed by anyone else.
+    if (encryption_) {
+      status = Decrypt(block, read_buffer, disk_len);
+      if (!status.ok()) goto error;
+    }
+
+    if (block->is_compressed_) {
+      status = Decompress(block, read_buffer, disk_len);
+      if (!status.ok()) goto error;
+    }
   }
 
   return DeleteOrUnpinBlock(release_block, unpin);
@@ -719,6 +840,46 @@ error:
   return status;
 }
 
+Status BufferedBlockMgr::ReadAheadBlock(Block* block) {
+  DCHECK(!block->is_deleted_) << "ReadAhead for deleted block.";
+  DiskIoMgr::ScanRange* scan_range;
+  {
+    lock_guard<mutex> lock(lock_);
+    if (is_cancelled_) return Status::CANCELLED;
+    // Nothing to do if the block is in memory, was never written or is already being
+    // read.
+    if (block->buffer_desc_ != NULL || block->write_range_ == NULL ||
+        block->read_ahead_range_ != NULL || block->valid_data_len_ == 0) {
+      return Status::OK();
+    }
+    // Only use memory that no client has reserved.
+    int64_t len = block->write_range_->len();
+    if (remaining_unreserved_buffers() < 1 || !mem_tracker_->TryConsume(len)) {
+      return Status::OK();
+    }
+    scan_range = obj_pool_.Add(new DiskIoMgr::ScanRange());
+    scan_range->Reset(NULL, block->write_range_->file(), len,
+        block->write_range_->offset(), block->write_range_->disk_id(), false, block,
+        DiskIoMgr::ScanRange::NEVER_CACHE);
+    block->read_ahead_range_ = scan_range;
+    read_ahead_counter_->Add(1);
+  }
+  vector<DiskIoMgr::ScanRange*> ranges(1, scan_range);
+  Status status = io_mgr_->AddScanRanges(io_request_context_, ranges, true);
+  if (!status.ok()) {
+    lock_guard<mutex> lock(lock_);
+    CancelReadAhead(block);
+  }
+  return status;
+}
+
+void BufferedBlockMgr::CancelReadAhead(Block* block) {
+  if (block->read_ahead_range_ == NULL) return;
+  block->read_ahead_range_->Cancel(Status::CANCELLED);
+  mem_tracker_->Release(block->read_ahead_range_->len());
+  block->read_ahead_range_ = NULL;
+}
+
 Status BufferedBlockMgr::UnpinBlock(Block* block) {
   DCHECK(!block->is_deleted_) << "Unpin for deleted block.";
 
@@ -787,25 +948,41 @@ Status BufferedBlockMgr::WriteUnpinnedBlock(Block* block) {
     block->tmp_file_ = tmp_file;
   }
 
-  uint8_t* outbuf = NULL;
+  uint8_t* outbuf = block->buffer();
+  int64_t outlen = block->valid_data_len_;
+  block->is_compressed_ = false;
+  if (compressor_.get() != NULL && outlen > 0) {
+    RETURN_IF_ERROR(Compress(block, &outbuf, &outlen));
+  }
+
   if (encryption_) {
     // The block->buffer() could be accessed during the write path, so we have to
     // make a copy of it while writing.
-    RETURN_IF_ERROR(Encrypt(block, &outbuf));
-  } else {
-    outbuf = block->buffer();
+    RETURN_IF_ERROR(Encrypt(block, outbuf, outlen, &outbuf));
   }
 
-  if (check_integrity_) SetHash(block);
+  if (check_integrity_) SetHash(block, outbuf, outlen);
+  if (checksum_) {
+    SCOPED_TIMER(integrity_check_timer_);
+    block->checksum_ = HashUtil::Hash(outbuf, outlen, 0);
+  }
 
-  block->write_range_->SetData(outbuf, block->valid_data_len_);
+  block->write_range_->SetData(outbuf, outlen);
 
   // Issue write through DiskIoMgr.
-  RETURN_IF_ERROR(io_mgr_->AddWriteRange(io_request_context_, block->write_range_));
+  block->write_bytes_ahead_ = block->tmp_file_->WriteIssued(outlen);
+  block->write_issue_time_ns_ = MonotonicNanos();
+  Status status = io_mgr_->AddWriteRange(io_request_context_, block->write_range_);
+  if (!status.ok()) {
+    block->tmp_file_->WriteComplete(outlen, block->write_bytes_ahead_, 0, false);
+    return status;
+  }
   block->in_write_ = true;
   DCHECK(block->Validate()) << endl << block->DebugString();
   outstanding_writes_counter_->Add(1);
-  bytes_written_counter_->Add(block->valid_data_len_);
+  bytes_written_counter_->Add(outlen);
+  device_bytes_written_counters_[block->tmp_file_->device_id()]->Add(outlen);
+  uncompressed_bytes_written_counter_->Add(block->valid_data_len_);
   ++writes_issued_;
   if (writes_issued_ == 1) {
     if (ImpaladMetrics::NUM_QUERIES_SPILLED != NULL) {
@@ -819,11 +996,31 @@ Status BufferedBlockMgr::AllocateScratchSpace(int64_t block_size,
     TmpFileMgr::File** tmp_file, int64_t* file_offset) {
   // Assumes block manager lock is already taken.
   vector<Status> errs;
-  // Find the next physical file in round-robin order and create a write range for it.
+  vector<bool> tried(tmp_files_.size(), false);
   for (int attempt = 0; attempt < tmp_files_.size(); ++attempt) {
-    *tmp_file = &tmp_files_[next_block_index_];
-    next_block_index_ = (next_block_index_ + 1) % tmp_files_.size();
-    if ((*tmp_file)->is_blacklisted()) continue;
+    // Pick the untried file whose device is expected to complete the write soonest.
+    // The search starts at next_block_index_ so that ties, e.g. before any write has
+    // completed, are broken in round-robin order.
+    int file_idx = -1;
+    double best_cost = 0;
+    for (int i = 0; i < tmp_files_.size(); ++i) {
+      int idx = (next_block_index_ + i) % tmp_files_.size();
+      if (tried[idx] || tmp_files_[idx].is_blacklisted()) continue;
+      if (!FLAGS_scratch_load_aware_placement) {
+        file_idx = idx;
+        break;
+      }
+      double cost =
+          tmp_file_mgr_->EstimatedWriteNs(tmp_files_[idx].device_id(), block_size);
+      if (file_idx == -1 || cost < best_cost) {
+        file_idx = idx;
+        best_cost = cost;
+      }
+    }
+    if (file_idx == -1) break;
+    tried[file_idx] = true;
+    next_block_index_ = (file_idx + 1) % tmp_files_.size();
+    *tmp_file = &tmp_files_[file_idx];
     Status status = (*tmp_file)->AllocateSpace(max_block_size_, file_offset);
     if (status.ok()) return Status::OK();
     // Log error and try other files if there was a problem. Problematic files will be
@@ -853,15 +1050,18 @@ void BufferedBlockMgr::WriteComplete(Block* block, const Status& write_status) {
   }
   block->in_write_ = false;
 
-  // Explicitly release our temporarily allocated buffer here so that it doesn't
+  // Explicitly release our temporarily allocated buffers here so that they don't
   // hang around needlessly.
   if (encryption_) EncryptDone(block);
+  block->compressed_write_buffer_.reset();
 
   // ReturnUnusedBlock() will clear the block, so save required state in local vars.
   // state is not valid if the block was deleted because the state may be torn down
   // after the state's fragment has deleted all of its blocks.
   TmpFileMgr::File* tmp_file = block->tmp_file_;
   RuntimeState* state = block->is_deleted_ ? NULL : block->client_->state_;
+  tmp_file->WriteComplete(block->write_range_->len(), block->write_bytes_ahead_,
+      MonotonicNanos() - block->write_issue_time_ns_, write_status.ok());
 
   // If the block was re-pinned when it was in the IOMgr queue, don't free it.
   if (block->is_pinned_) {
@@ -929,6 +1129,7 @@ void BufferedBlockMgr::DeleteBlockLocked(const unique_lock<mutex>& lock, Block*
   DCHECK(block->Validate()) << endl << DebugInternal();
   DCHECK(!block->is_deleted_);
   block->is_deleted_ = true;
+  CancelReadAhead(block);
 
   if (block->is_pinned_) {
     if (block->is_max_size()) --total_pinned_buffers_;
@@ -952,9 +1153,12 @@ void BufferedBlockMgr::DeleteBlockLocked(const unique_lock<mutex>& lock, Block*
 
   if (block->buffer_desc_ != NULL) {
     if (block->buffer_desc_->len != max_block_size_) {
-      // Just delete the block for now.
-      delete[] block->buffer_desc_->buffer;
       block->client_->tracker_->Release(block->buffer_desc_->len);
+      if (block->buffer_desc_->is_buddy) {
+        FreeBuddyBuffer(block->buffer_desc_->buffer, block->buffer_desc_->len);
+      } else {
+        delete[] block->buffer_desc_->buffer;
+      }
       delete block->buffer_desc_;
       block->buffer_desc_ = NULL;
     } else {
@@ -1089,10 +1293,13 @@ Status BufferedBlockMgr::FindBuffer(unique_lock<mutex>& lock,
   DCHECK(lock.mutex() == &lock_ && lock.owns_lock());
   *buffer_desc = NULL;
 
-  // First, try to allocate a new buffer.
+  // First, try to allocate a new buffer. Memory claimed for reservations is used
+  // before memory that other allocations could take.
   DCHECK(block_write_threshold_ > 0 || disable_spill_);
-  if ((free_io_buffers_.size() < block_write_threshold_ || disable_spill_) &&
-      mem_tracker_->TryConsume(max_block_size_)) {
+  bool claimed = num_claimed_buffers_ > 0;
+  if (claimed || ((free_io_buffers_.size() < block_write_threshold_ || disable_spill_) &&
+      mem_tracker_->TryConsume(max_block_size_))) {
+    if (claimed) --num_claimed_buffers_;
     uint8_t* new_buffer = new uint8_t[max_block_size_];
     *buffer_desc = obj_pool_.Add(new BufferDescriptor(new_buffer, max_block_size_));
     (*buffer_desc)->all_buffers_it = all_io_buffers_.insert(
@@ -1124,6 +1331,7 @@ Status BufferedBlockMgr::FindBuffer(unique_lock<mutex>& lock,
         return Status::OK();
       }
       SCOPED_TIMER(buffer_wait_timer_);
+      SCOPED_WAIT_TIMER(SPILL_WAIT);
       // Try to evict unpinned blocks before waiting.
       RETURN_IF_ERROR(WriteUnpinnedBlocks());
       DCHECK_GT(non_local_outstanding_writes_, 0) << endl << DebugInternal();
@@ -1135,6 +1343,69 @@ Status BufferedBlockMgr::FindBuffer(unique_lock<mutex>& lock,
   return Status::OK();
 }
 
+uint8_t* BufferedBlockMgr::AllocateBuddyBuffer(int64_t len) {
+  if (len < MIN_BUDDY_BUFFER_SIZE || len > buddy_chunk_size_) return NULL;
+  if ((len & (len - 1)) != 0) return NULL;
+  int order = 0;
+  while ((MIN_BUDDY_BUFFER_SIZE << order) < len) ++order;
+  const int chunk_order = free_buddy_buffers_.size() - 1;
+
+  int free_order = order;
+  while (free_order <= chunk_order && free_buddy_buffers_[free_order].empty()) {
+    ++free_order;
+  }
+  uint8_t* buffer;
+  if (free_order > chunk_order) {
+    // All of the new chunk except the returned buffer is free.
+    if (!mem_tracker_->TryConsume(buddy_chunk_size_ - len)) return NULL;
+    void* chunk;
+    if (posix_memalign(&chunk, buddy_chunk_size_, buddy_chunk_size_) != 0) {
+      mem_tracker_->Release(buddy_chunk_size_ - len);
+      return NULL;
+    }
+    buffer = reinterpret_cast<uint8_t*>(chunk);
+    free_order = chunk_order;
+    free_buddy_bytes_ += buddy_chunk_size_ - len;
+  } else {
+    set<uint8_t*>::iterator it = free_buddy_buffers_[free_order].begin();
+    buffer = *it;
+    free_buddy_buffers_[free_order].erase(it);
+    // The bytes move from the free buffers to the client.
+    mem_tracker_->Release(len);
+    free_buddy_bytes_ -= len;
+  }
+  // Keep the lower half of each split and free the upper one.
+  for (int i = free_order - 1; i >= order; --i) {
+    free_buddy_buffers_[i].insert(buffer + (MIN_BUDDY_BUFFER_SIZE << i));
+  }
+  return buffer;
+}
+
+void BufferedBlockMgr::FreeBuddyBuffer(uint8_t* buffer, int64_t len) {
+  int order = 0;
+  while ((MIN_BUDDY_BUFFER_SIZE << order) < len) ++order;
+  DCHECK_EQ(MIN_BUDDY_BUFFER_SIZE << order, len);
+  const int chunk_order = free_buddy_buffers_.size() - 1;
+  // The client released the bytes, charge them to the free buffers.
+  mem_tracker_->Consume(len);
+  free_buddy_bytes_ += len;
+
+  for (; order < chunk_order; ++order) {
+    uint8_t* buddy = reinterpret_cast<uint8_t*>(
+        reinterpret_cast<uintptr_t>(buffer) ^ (MIN_BUDDY_BUFFER_SIZE << order));
+    if (free_buddy_buffers_[order].erase(buddy) == 0) break;
+    buffer = min(buffer, buddy);
+  }
+  if (order == chunk_order) {
+    // Don't hold on to an unused chunk, IO buffers may need the memory.
+    free(buffer);
+    mem_tracker_->Release(buddy_chunk_size_);
+    free_buddy_bytes_ -= buddy_chunk_size_;
+  } else {
+    free_buddy_buffers_[order].insert(buffer);
+  }
+}
+
 BufferedBlockMgr::Block* BufferedBlockMgr::GetUnusedBlock(Client* client) {
   DCHECK(client != NULL);
   Block* new_block = NULL;
@@ -1262,6 +1533,8 @@ string BufferedBlockMgr::DebugInternal() const {
      << "  Num available buffers: " << remaining_unreserved_buffers() << endl
      << "  Total pinned buffers: " << total_pinned_buffers_ << endl
      << "  Unfullfilled reserved buffers: " << unfullfilled_reserved_buffers_ << endl
+     << "  Claimed buffers: " << num_claimed_buffers_ << endl
+     << "  Free buddy buffer bytes: " << free_buddy_bytes_ << endl
      << "  Remaining memory: " << mem_tracker_->SpareCapacity()
      << " (#blocks=" << (mem_tracker_->SpareCapacity() / max_block_size_) << ")" << endl
      << "  Block write threshold: " << block_write_threshold_;
@@ -1299,6 +1572,12 @@ void BufferedBlockMgr::Init(DiskIoMgr* io_mgr, RuntimeProfile* parent_profile,
   buffer_wait_timer_ = ADD_TIMER(profile_.get(), "TotalBufferWaitTime");
   encryption_timer_ = ADD_TIMER(profile_.get(), "TotalEncryptionTime");
   integrity_check_timer_ = ADD_TIMER(profile_.get(), "TotalIntegrityCheckTime");
+  uncompressed_bytes_written_counter_ =
+      ADD_COUNTER(profile_.get(), "UncompressedBytesWritten", TUnit::BYTES);
+  compression_timer_ = ADD_TIMER(profile_.get(), "TotalCompressionTime");
+  read_ahead_counter_ = ADD_COUNTER(profile_.get(), "BlocksReadAhead", TUnit::UNIT);
+  read_ahead_hit_counter_ =
+      ADD_COUNTER(profile_.get(), "BlocksPinnedFromReadAhead", TUnit::UNIT);
 
   // Create a new mem_tracker and allocate buffers.
   mem_tracker_.reset(new MemTracker(
@@ -1311,6 +1590,23 @@ Status BufferedBlockMgr::InitTmpFiles() {
   DCHECK(tmp_files_.empty());
   DCHECK(tmp_file_mgr_ != NULL);
 
+  if (!FLAGS_disk_spill_compression.empty() && compressor_.get() == NULL) {
+    if (FLAGS_disk_spill_compression == "lz4") {
+      spill_codec_ = THdfsCompression::LZ4;
+    } else if (FLAGS_disk_spill_compression == "snappy") {
+      spill_codec_ = THdfsCompression::SNAPPY;
+#ifdef IMPALA_HAVE_ZSTD
+    } else if (FLAGS_disk_spill_compression == "zstd") {
+      spill_codec_ = THdfsCompression::ZSTD;
+#endif
+    } else {
+      return Status(Substitute("Invalid --disk_spill_compression codec: '$0'. Valid "
+          "codecs are 'lz4', 'snappy' and, if built with zstd, 'zstd'.",
+          FLAGS_disk_spill_compression));
+    }
+    RETURN_IF_ERROR(Codec::CreateCompressor(NULL, false, spill_codec_, &compressor_));
+  }
+
   vector<TmpFileMgr::DeviceId> tmp_devices = tmp_file_mgr_->active_tmp_devices();
   // Initialize the tmp files and the initial file to use.
   tmp_files_.reserve(tmp_devices.size());
@@ -1322,6 +1618,15 @@ Status BufferedBlockMgr::InitTmpFiles() {
     Status status = tmp_file_mgr_->GetFile(tmp_device_id, query_id_, &tmp_file);
     if (status.ok()) tmp_files_.push_back(tmp_file);
   }
+  for (int i = 0; i < tmp_files_.size(); ++i) {
+    TmpFileMgr::DeviceId device_id = tmp_files_[i].device_id();
+    if (device_id >= device_bytes_written_counters_.size()) {
+      device_bytes_written_counters_.resize(device_id + 1, NULL);
+    }
+    device_bytes_written_counters_[device_id] = ADD_COUNTER(profile_.get(),
+        Substitute("BytesWritten ($0)", tmp_file_mgr_->GetTmpDirPath(device_id)),
+        TUnit::BYTES);
+  }
   if (tmp_files_.empty()) {
     return Status("No spilling directories configured. Cannot spill. Set --scratch_dirs"
         " or see log for previous errors that prevented use of provided directories");
@@ -1346,9 +1651,10 @@ static Status OpenSSLErr(const string& msg) {
   return Status(Substitute("Openssl Error: $0", errstream.str()));
 }
 
-Status BufferedBlockMgr::Encrypt(Block* block, uint8_t** outbuf) {
+Status BufferedBlockMgr::Encrypt(Block* block, uint8_t* data, int64_t data_len,
+    uint8_t** outbuf) {
   DCHECK(encryption_);
-  DCHECK(block->buffer());
+  DCHECK(data);
   DCHECK(!block->is_pinned_);
   DCHECK(!block->in_write_);
   DCHECK(outbuf);
@@ -1359,10 +1665,14 @@ Status BufferedBlockMgr::Encrypt(Block* block, uint8_t** outbuf) {
   // writes of the same Block.
   RAND_bytes(block->key_, sizeof(block->key_));
   RAND_bytes(block->iv_, sizeof(block->iv_));
-  block->encrypted_write_buffer_.reset(new uint8_t[block->valid_data_len_]);
+  uint8_t* out = data;
+  if (data == block->buffer()) {
+    block->encrypted_write_buffer_.reset(new uint8_t[data_len]);
+    out = block->encrypted_write_buffer_.get();
+  }
 
   EVP_CIPHER_CTX ctx;
-  int len = static_cast<int>(block->valid_data_len_);
+  int len = static_cast<int>(data_len);
 
   // Create and initialize the context for encryption
   EVP_CIPHER_CTX_init(&ctx);
@@ -1375,40 +1685,40 @@ Status BufferedBlockMgr::Encrypt(Block* block, uint8_t** outbuf) {
     return OpenSSLErr("EVP_EncryptInit_ex failure");
   }
 
-  // Encrypt block->buffer() into the new encrypted_write_buffer_
-  if (EVP_EncryptUpdate(&ctx, block->encrypted_write_buffer_.get(), &len,
-        block->buffer(), len) != 1) {
+  // Encrypt 'data' into 'out', which is either the new encrypted_write_buffer_ or
+  // 'data' itself.
+  if (EVP_EncryptUpdate(&ctx, out, &len, data, len) != 1) {
     return OpenSSLErr("EVP_EncryptUpdate failure");
   }
 
   // This is safe because we're using CFB mode without padding.
-  DCHECK_EQ(len, block->valid_data_len_);
+  DCHECK_EQ(len, data_len);
 
   // Finalize encryption.
-  if (1 != EVP_EncryptFinal_ex(&ctx, block->encrypted_write_buffer_.get() + len, &len)) {
+  if (1 != EVP_EncryptFinal_ex(&ctx, out + len, &len)) {
     return OpenSSLErr("EVP_EncryptFinal failure");
   }
 
   // Again safe due to CFB with no padding
   DCHECK_EQ(len, 0);
 
-  *outbuf = block->encrypted_write_buffer_.get();
+  *outbuf = out;
   return Status::OK();
 }
 
 void BufferedBlockMgr::EncryptDone(Block* block) {
   DCHECK(encryption_);
-  DCHECK(block->encrypted_write_buffer_.get());
+  // Compressed blocks were encrypted in place and have no encrypted_write_buffer_.
   block->encrypted_write_buffer_.reset();
 }
 
-Status BufferedBlockMgr::Decrypt(Block* block) {
+Status BufferedBlockMgr::Decrypt(Block* block, uint8_t* data, int64_t data_len) {
   DCHECK(encryption_);
-  DCHECK(block->buffer());
+  DCHECK(data);
   SCOPED_TIMER(encryption_timer_);
 
   EVP_CIPHER_CTX ctx;
-  int len = static_cast<int>(block->valid_data_len_);
+  int len = static_cast<int>(data_len);
 
   // Create and initialize the context for encryption
   EVP_CIPHER_CTX_init(&ctx);
@@ -1419,16 +1729,16 @@ Status BufferedBlockMgr::Decrypt(Block* block) {
     return OpenSSLErr("EVP_DecryptInit_ex failure");
   }
 
-  // Decrypt block->buffer() in-place.  Safe because no one is accessing it.
-  if (EVP_DecryptUpdate(&ctx, block->buffer(), &len, block->buffer(), len) != 1) {
+  // Decrypt 'data' in-place.  Safe because no one is accessing it.
+  if (EVP_DecryptUpdate(&ctx, data, &len, data, len) != 1) {
     return OpenSSLErr("EVP_DecryptUpdate failure");
   }
 
   // This is safe because we're using CFB mode without padding.
-  DCHECK_EQ(len, block->valid_data_len_);
+  DCHECK_EQ(len, data_len);
 
   // Finalize decryption.
-  if (1 != EVP_DecryptFinal_ex(&ctx, block->buffer() + len, &len)) {
+  if (1 != EVP_DecryptFinal_ex(&ctx, data + len, &len)) {
     return OpenSSLErr("EVP_DecryptFinal failure");
   }
 
@@ -1438,31 +1748,73 @@ Status BufferedBlockMgr::Decrypt(Block* block) {
   return Status::OK();
 }
 
-void BufferedBlockMgr::SetHash(Block* block) {
+void BufferedBlockMgr::SetHash(Block* block, const uint8_t* data, int64_t len) {
   DCHECK(check_integrity_);
+  DCHECK(data);
   SCOPED_TIMER(integrity_check_timer_);
-  uint8_t* data = NULL;
-  if (encryption_) {
-    DCHECK(block->encrypted_write_buffer_.get());
-    data = block->encrypted_write_buffer_.get();
-  } else {
-    DCHECK(block->buffer());
-    data = block->buffer();
-  }
   // Explicitly ignore the return value from SHA256(); it can't fail.
-  (void) SHA256(data, block->valid_data_len_, block->hash_);
+  (void) SHA256(data, len, block->hash_);
 }
 
-Status BufferedBlockMgr::VerifyHash(Block* block) {
+Status BufferedBlockMgr::VerifyHash(Block* block, const uint8_t* data, int64_t len) {
   DCHECK(check_integrity_);
-  DCHECK(block->buffer());
+  DCHECK(data);
   SCOPED_TIMER(integrity_check_timer_);
   uint8_t test_hash[SHA256_DIGEST_LENGTH];
-  (void) SHA256(block->buffer(), block->valid_data_len_, test_hash);
+  (void) SHA256(data, len, test_hash);
   if (memcmp(test_hash, block->hash_, SHA256_DIGEST_LENGTH) != 0) {
     return Status("Block verification failure");
   }
   return Status::OK();
 }
 
+Status BufferedBlockMgr::VerifyChecksum(Block* block, const uint8_t* data, int64_t len) {
+  DCHECK(checksum_);
+  SCOPED_TIMER(integrity_check_timer_);
+  if (HashUtil::Hash(data, len, 0) != block->checksum_) {
+    return Status(Substitute("Block checksum mismatch reading $0 bytes at offset $1 of "
+        "spill file $2", len, block->write_range_->offset(), block->TmpFilePath()));
+  }
+  return Status::OK();
+}
+
+Status BufferedBlockMgr::Compress(Block* block, uint8_t** outbuf, int64_t* outlen) {
+  DCHECK(compressor_.get() != NULL);
+  DCHECK(!block->in_write_);
+  SCOPED_TIMER(compression_timer_);
+  int64_t max_compressed_len = compressor_->MaxOutputLen(block->valid_data_len_);
+  block->compressed_write_buffer_.reset(new uint8_t[max_compressed_len]);
+  uint8_t* compressed = block->compressed_write_buffer_.get();
+  int64_t compressed_len = max_compressed_len;
+  RETURN_IF_ERROR(compressor_->ProcessBlock(true, block->valid_data_len_,
+      block->buffer(), &compressed_len, &compressed));
+  if (compressed_len >= block->valid_data_len_) {
+    // Not worth decompressing on the read path.
+    block->compressed_write_buffer_.reset();
+    return Status::OK();
+  }
+  block->is_compressed_ = true;
+  *outbuf = compressed;
+  *outlen = compressed_len;
+  return Status::OK();
+}
+
+Status BufferedBlockMgr::Decompress(Block* block, const uint8_t* data, int64_t len) {
+  DCHECK(block->is_compressed_);
+  DCHECK_NE(spill_codec_, THdfsCompression::NONE);
+  SCOPED_TIMER(compression_timer_);
+  scoped_ptr<Codec> decompressor;
+  RETURN_IF_ERROR(Codec::CreateDecompressor(NULL, false, spill_codec_, &decompressor));
+  uint8_t* output = block->buffer();
+  int64_t output_len = block->valid_data_len_;
+  Status status = decompressor->ProcessBlock(true, len, data, &output_len, &output);
+  decompressor->Close();
+  RETURN_IF_ERROR(status);
+  if (output_len != block->valid_data_len_) {
+    return Status(Substitute("Spilled block decompressed to $0 bytes, expected $1",
+        output_len, block->valid_data_len_));
+  }
+  return Status::OK();
+}
+
 } // namespace impala
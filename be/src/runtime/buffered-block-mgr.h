@@ -15,10 +15,12 @@
 #ifndef IMPALA_RUNTIME_BUFFERED_BLOCK_MGR
 #define IMPALA_RUNTIME_BUFFERED_BLOCK_MGR
 
+#include <set>
 #include <boost/shared_ptr.hpp>
 
 #include "runtime/disk-io-mgr.h"
 #include "runtime/tmp-file-mgr.h"
+#include "util/codec.h"
 
 #include <openssl/aes.h>
 #include <openssl/sha.h>
@@ -40,8 +42,10 @@ class RuntimeState;
 /// use the block mgr API to mem track non-spillable (smaller) buffers). Clients that do
 /// partitioning (e.g. PHJ and PAGG) will start with these smaller buffer sizes to reduce
 /// the minimum buffering requirements and grow to max sized buffers as the input grows.
-/// For simplicity, these small buffers are not recycled (there's also not really a need
-/// since they are allocated all at once on query startup). These buffers are not counted
+/// Small buffers with a power-of-two size of at least MIN_BUDDY_BUFFER_SIZE are carved
+/// out of IO-sized chunks by a buddy allocator, so that freed small buffers are recycled
+/// and a chunk is shared by many small partitions instead of each allocating its own
+/// memory. Other small buffers are allocated individually. Small buffers are not counted
 /// against the reservation.
 //
 /// The BufferedBlockMgr reserves one buffer per disk ('block_write_threshold_') for
@@ -50,6 +54,19 @@ class RuntimeState;
 /// re-read in FIFO order). The TmpFileMgr is used to obtain file handles to write to
 /// within the tmp directories configured for Impala.
 //
+/// If --disk_spill_compression names a codec, blocks are compressed before they are
+/// written and decompressed when they are pinned again; blocks that do not shrink are
+/// written uncompressed. If --disk_spill_checksum is set, a CRC of the data on disk is
+/// kept with each block and verified when it is read back. Compression is applied before
+/// encryption and both checks are computed over the data as written.
+//
+/// Clients that read unpinned blocks sequentially can call ReadAhead() on the blocks
+/// they will pin next, up to read_ahead_blocks() of them. If a block's data is only on
+/// disk, this issues an asynchronous read through the DiskIoMgr that the next Pin()
+/// consumes, so the read overlaps with processing the current block. The data is held
+/// in I/O buffers that are charged to the block mgr; read-ahead is skipped if it would
+/// take memory that is reserved by a client.
+//
 /// It is expected to have one BufferedBlockMgr per query. All allocations that can grow
 /// proportional to the input size and that might need to spill to disk should allocate
 /// from the same BufferedBlockMgr.
@@ -156,6 +173,11 @@ class BufferedBlockMgr {
     /// Non-blocking.
     void Delete();
 
+    /// Hints that the block will be pinned soon. If it is not in memory, starts reading
+    /// it from disk in the background if there is unreserved memory for it. Non-blocking
+    /// and idempotent.
+    Status ReadAhead();
+
     void AddRow() { ++num_rows_; }
     int num_rows() const { return num_rows_; }
 
@@ -246,6 +268,11 @@ class BufferedBlockMgr {
     /// and offset in write_range_. The File is owned by BufferedBlockMgr, not TmpFileMgr.
     TmpFileMgr::File* tmp_file_;
 
+    /// Time at which the in-flight write of this block was issued and the bytes that
+    /// were queued on its device at that time, as returned by File::WriteIssued().
+    int64_t write_issue_time_ns_;
+    int64_t write_bytes_ahead_;
+
     /// Length of valid (i.e. allocated) data within the block.
     int64_t valid_data_len_;
 
@@ -273,6 +300,21 @@ class BufferedBlockMgr {
     /// writes; verified on reads. This is calculated _after_ encryption.
     uint8_t hash_[SHA256_DIGEST_LENGTH];
 
+    /// If spill compression is on, holds the compressed data while it's being written to
+    /// disk. Encryption is done in place in this buffer.
+    boost::scoped_array<uint8_t> compressed_write_buffer_;
+
+    /// True if the on-disk copy of the block is compressed. Set on each write.
+    bool is_compressed_;
+
+    /// If checksum_ is on, the CRC of the data as written to disk. Set on each write;
+    /// verified on reads.
+    uint32_t checksum_;
+
+    /// Read of the block's on-disk data issued by ReadAhead() and not yet consumed by
+    /// Pin(), or NULL. Its length is charged to the block mgr's mem tracker until then.
+    DiskIoMgr::ScanRange* read_ahead_range_;
+
     /// Block state variables. The block's buffer can be freed only if is_pinned_ and
     /// in_write_ are both false.
     /// TODO: this might be better expressed as an enum.
@@ -322,7 +364,13 @@ class BufferedBlockMgr {
   /// allocate a reserved buffer is a MEM_LIMIT_EXCEEDED error.
   /// debug_info is a string that will be printed in debug messages and errors to
   /// identify the client.
-  /// TODO: The fact that we allow oversubscription is problematic.
+  /// If --guarantee_block_mgr_reservations is set, oversubscription is not allowed: the
+  /// memory of the reserved buffers that the block mgr doesn't already hold is claimed
+  /// from the memory limit, and a MEM_LIMIT_EXCEEDED error is returned if that fails.
+  /// Memory allocated outside the block mgr can then not take the reserved memory
+  /// before the client gets its buffers, while unreserved memory is still shared by all
+  /// clients.
+  /// TODO: The fact that we allow oversubscription by default is problematic.
   /// as some code expects the reservations to always be granted (currently not the case).
   Status RegisterClient(const std::string& debug_info, int num_reserved_buffers,
       bool tolerates_oversubscription, MemTracker* tracker, RuntimeState* state,
@@ -403,6 +451,10 @@ class BufferedBlockMgr {
   RuntimeProfile* profile() { return profile_.get(); }
   int writes_issued() const { return writes_issued_; }
 
+  /// Number of blocks ahead of the one being read that sequential readers should call
+  /// Block::ReadAhead() on. Set by --spill_read_ahead_blocks. 0 disables read-ahead.
+  int read_ahead_blocks() const { return read_ahead_blocks_; }
+
  private:
   friend struct Client;
 
@@ -420,8 +472,11 @@ class BufferedBlockMgr {
     /// Iterator into all_io_buffers_ for this buffer.
     std::list<BufferDescriptor*>::iterator all_buffers_it;
 
+    /// True if this is a small buffer from AllocateBuddyBuffer().
+    bool is_buddy;
+
     BufferDescriptor(uint8_t* buf, int64_t len)
-      : buffer(buf), len(len), block(NULL) {
+      : buffer(buf), len(len), block(NULL), is_buddy(false) {
     }
   };
 
@@ -440,6 +495,7 @@ class BufferedBlockMgr {
   /// DeleteBlockLocked() must be called with the lock_ taken.
   Status PinBlock(Block* block, bool* pinned, Block* src, bool unpin);
   Status UnpinBlock(Block* block);
+  Status ReadAheadBlock(Block* block);
   void DeleteBlock(Block* block);
   void DeleteBlockLocked(const boost::unique_lock<boost::mutex>& lock, Block* block);
 
@@ -455,6 +511,19 @@ class BufferedBlockMgr {
   /// needs to not have been taken when this function is called.
   Status TransferBuffer(Block* dst, Block* src, bool unpin);
 
+  /// Returns the number of reserved buffers that are not backed by buffers in the pool,
+  /// i.e. the buffers that would have to be allocated to fulfill all reservations. Must
+  /// be called with lock_ taken.
+  int64_t unbacked_reserved_buffers() const;
+
+  /// Claims the memory of the unbacked reserved buffers that aren't claimed yet from
+  /// mem_tracker_. Returns false if the memory limit doesn't allow it. Must be called
+  /// with lock_ taken.
+  bool ClaimReservedBuffers();
+
+  /// Releases up to 'num_buffers' claimed buffers. Must be called with lock_ taken.
+  void ReleaseClaimedBuffers(int num_buffers);
+
   /// Returns the total number of unreserved buffers. This is the sum of unpinned,
   /// free and buffers we can still allocate minus the total number of reserved buffers
   /// that are not pinned.
@@ -500,11 +569,27 @@ class BufferedBlockMgr {
   /// blocks list if it has been deleted.
   void WriteComplete(Block* block, const Status& write_status);
 
+  /// Cancels the block's read_ahead_range_, if any, and releases its memory. Must be
+  /// called with the lock_ taken.
+  void CancelReadAhead(Block* block);
+
   /// Returns a deleted block to the list of free blocks. Assumes the block's buffer has
   /// already been returned to the free buffers list. Non-blocking.
   /// Thread-safe and does not need the lock_ acquired.
   void ReturnUnusedBlock(Block* block);
 
+  /// Returns a small buffer of 'len' bytes from the buddy allocator, or NULL if 'len' is
+  /// not a buddy size or there is no memory for a new chunk. The buddy sizes are the
+  /// powers of two from MIN_BUDDY_BUFFER_SIZE to buddy_chunk_size_. The smallest free
+  /// buffer of at least 'len' bytes is split in halves until it has the right size. If
+  /// there is none, a new chunk is allocated and split. Must be called with lock_ taken.
+  uint8_t* AllocateBuddyBuffer(int64_t len);
+
+  /// Returns 'buffer' of 'len' bytes to the buddy allocator and merges it with its free
+  /// buddies. A chunk that becomes entirely free is released. Must be called with lock_
+  /// taken.
+  void FreeBuddyBuffer(uint8_t* buffer, int64_t len);
+
   /// Checks unused_blocks_ for an unused block object, else allocates a new one.
   /// Non-blocking and needs no lock_.
   Block* GetUnusedBlock(Client* client);
@@ -513,9 +598,17 @@ class BufferedBlockMgr {
   bool Validate() const;
   std::string DebugInternal() const;
 
+  /// The smallest buffer handed out by the buddy allocator.
+  static const int64_t MIN_BUDDY_BUFFER_SIZE = 64 * 1024;
+
   /// Size of the largest/default block in bytes.
   const int64_t max_block_size_;
 
+  /// Size of the chunks split by the buddy allocator: the largest power of two that is
+  /// at most max_block_size_. 0 if that is less than MIN_BUDDY_BUFFER_SIZE, in which
+  /// case all small buffers are allocated individually.
+  const int64_t buddy_chunk_size_;
+
   /// Unpinned blocks are written when the number of free buffers is below this threshold.
   /// Equal to two times the number of disks.
   const int block_write_threshold_;
@@ -550,6 +643,22 @@ class BufferedBlockMgr {
   /// The total number of pinned buffers across all clients.
   int total_pinned_buffers_;
 
+  /// The number of buffers whose memory is claimed from mem_tracker_ for reservations,
+  /// see ClaimReservedBuffers(). FindBuffer() allocates new buffers from the claimed
+  /// memory first.
+  int num_claimed_buffers_;
+
+  /// The free buddy buffers by size: free_buddy_buffers_[i] holds the free buffers of
+  /// MIN_BUDDY_BUFFER_SIZE << i bytes, ordered by address so that allocations pack into
+  /// the lowest chunks. Chunks are aligned to their size, so the buddy of a buffer of
+  /// 'len' bytes starts at 'buffer' ^ 'len'.
+  std::vector<std::set<uint8_t*> > free_buddy_buffers_;
+
+  /// Total size of the free buddy buffers. These bytes are charged to mem_tracker_,
+  /// while the buddy buffers in use are charged to their clients like other small
+  /// buffers.
+  int64_t free_buddy_bytes_;
+
   /// Number of outstanding writes (Writes issued but not completed).
   /// This does not include client-local writes.
   int non_local_outstanding_writes_;
@@ -583,7 +692,9 @@ class BufferedBlockMgr {
   std::list<BufferDescriptor*> all_io_buffers_;
 
   /// Temporary physical file handle, (one per tmp device) to which blocks may be written.
-  /// Blocks are round-robined across these files.
+  /// Blocks are striped across these files: each new block goes to the file whose device
+  /// is expected to complete the write soonest (see TmpFileMgr::EstimatedWriteNs()), or
+  /// round-robin if --scratch_load_aware_placement is false.
   boost::ptr_vector<TmpFileMgr::File> tmp_files_;
 
   /// Index into tmp_files_ denoting the file to which the next block to be persisted will
@@ -633,9 +744,27 @@ class BufferedBlockMgr {
   /// Time spent in disk spill integrity generation and checking.
   RuntimeProfile::Counter* integrity_check_timer_;
 
+  /// Number of bytes of block data written to disk before compression. Equal to
+  /// bytes_written_counter_ if spill compression is off.
+  RuntimeProfile::Counter* uncompressed_bytes_written_counter_;
+
+  /// Bytes written to each tmp device, indexed by TmpFileMgr::DeviceId. Only has
+  /// entries for the devices of tmp_files_. Created by InitTmpFiles().
+  std::vector<RuntimeProfile::Counter*> device_bytes_written_counters_;
+
+  /// Time spent in disk spill compression and decompression.
+  RuntimeProfile::Counter* compression_timer_;
+
+  /// Number of reads issued by ReadAhead(), and the number of them consumed by Pin().
+  RuntimeProfile::Counter* read_ahead_counter_;
+  RuntimeProfile::Counter* read_ahead_hit_counter_;
+
   /// Number of writes issued.
   int writes_issued_;
 
+  /// Set from --spill_read_ahead_blocks.
+  const int read_ahead_blocks_;
+
   /// Protects query_to_block_mgrs_.
   static SpinLock static_block_mgrs_lock_;
 
@@ -647,21 +776,33 @@ class BufferedBlockMgr {
       BlockMgrsMap;
   static BlockMgrsMap query_to_block_mgrs_;
 
-  /// Takes the data in buffer(), allocates encrypted_write_buffer_, and returns
-  /// a pointer to the encrypted data in outbuf.
-  Status Encrypt(Block* block, uint8_t** outbuf);
+  /// Compresses the data in buffer() into compressed_write_buffer_ and sets
+  /// is_compressed_. If the data did not shrink, the buffer is released and '*outbuf'
+  /// and '*outlen' are left unchanged, otherwise they are set to the compressed data.
+  Status Compress(Block* block, uint8_t** outbuf, int64_t* outlen);
+
+  /// Decompresses the 'len' bytes of on-disk data in 'data' into buffer().
+  Status Decompress(Block* block, const uint8_t* data, int64_t len);
+
+  /// Encrypts the 'len' bytes in 'data' and returns a pointer to the encrypted data in
+  /// outbuf. If 'data' is buffer(), which could be accessed during the write, it is
+  /// encrypted into a newly allocated encrypted_write_buffer_, otherwise in place.
+  Status Encrypt(Block* block, uint8_t* data, int64_t len, uint8_t** outbuf);
 
   /// Deallocates temporary buffer alloced in Encrypt().
   void EncryptDone(Block* block);
 
-  /// Decrypts the contents of buffer() in place.
-  Status Decrypt(Block* block);
+  /// Decrypts the 'len' bytes in 'data' in place.
+  Status Decrypt(Block* block, uint8_t* data, int64_t len);
 
-  /// Takes a cryptographic hash of the data and sets hash_ with it.
-  void SetHash(Block* block);
+  /// Takes a cryptographic hash of the 'len' bytes in 'data' and sets hash_ with it.
+  void SetHash(Block* block, const uint8_t* data, int64_t len);
 
-  /// Verifies that the contents of buffer() match those that were set by SetHash()
-  Status VerifyHash(Block* block);
+  /// Verifies that the 'len' bytes in 'data' match the hash set by SetHash().
+  Status VerifyHash(Block* block, const uint8_t* data, int64_t len);
+
+  /// Verifies that the 'len' bytes in 'data' match the block's checksum_.
+  Status VerifyChecksum(Block* block, const uint8_t* data, int64_t len);
 
   /// Set to true if --disk_spill_encryption is true.  When true, blocks will be encrypted
   /// before being written to disk.
@@ -672,6 +813,16 @@ class BufferedBlockMgr {
   /// and hence no real reason to keep this separate from encryption.  When true, blocks
   /// will have an integrity check (SHA-256) performed after being read from disk.
   const bool check_integrity_;
+
+  /// Set to true if --disk_spill_checksum is true. When true, a CRC of each block is
+  /// computed when it is written and verified when it is read back.
+  const bool checksum_;
+
+  /// Codec used to compress spilled blocks, or NONE. Set from --disk_spill_compression
+  /// in InitTmpFiles(). 'compressor_' is only used with lock_ taken; blocks are
+  /// decompressed with a new decompressor per read, since reads happen concurrently.
+  THdfsCompression::type spill_codec_;
+  boost::scoped_ptr<Codec> compressor_;
 }; // class BufferedBlockMgr
 
 } // namespace impala.
@@ -34,6 +34,8 @@
 #include "runtime/tmp-file-mgr.h"
 #include "service/fe-support.h"
 #include "testutil/desc-tbl-builder.h"
+#include "util/pretty-printer.h"
+#include "util/stopwatch.h"
 #include "util/test-info.h"
 
 #include "gen-cpp/Types_types.h"
@@ -89,6 +91,7 @@ class SimpleTupleStreamTest : public testing::Test {
   }
 
   virtual void TearDown() {
+    codegen_.reset();
     runtime_state_ = NULL;
     client_ = NULL;
     pool_.Clear();
@@ -104,6 +107,18 @@ class SimpleTupleStreamTest : public testing::Test {
         runtime_state_, &client_));
   }
 
+  /// Codegens the CopyRowFn for 'desc' into a new module and sets 'fn' to the jitted
+  /// function. 'fn' stays valid until the next call.
+  void CodegenCopyRow(const RowDescriptor& desc, BufferedTupleStream::CopyRowFn* fn) {
+    codegen_.reset();
+    ASSERT_OK(LlvmCodeGen::CreateImpalaCodegen(&pool_, "test", &codegen_));
+    llvm::Function* ir_fn;
+    ASSERT_OK(BufferedTupleStream::CodegenCopyRow(codegen_.get(), desc, &ir_fn));
+    codegen_->AddFunctionToJit(ir_fn, reinterpret_cast<void**>(fn));
+    ASSERT_OK(codegen_->FinalizeModule());
+    ASSERT_TRUE(*fn != NULL);
+  }
+
   /// Generate the ith element of a sequence of int values.
   int GenIntValue(int i) {
     // Multiply by large prime to get varied bit patterns.
@@ -278,13 +293,16 @@ class SimpleTupleStreamTest : public testing::Test {
   }
 
   // Test adding num_batches of ints to the stream and reading them back.
-  // If unpin_stream is true, operate the stream in unpinned mode.
+  // If unpin_stream is true, operate the stream in unpinned mode. Rows are copied with
+  // 'copy_row_fn' if it is non-NULL.
   // Assumes that enough buffers are available to read and write the stream.
   template <typename T>
   void TestValues(int num_batches, RowDescriptor* desc, bool gen_null,
-      bool unpin_stream, int num_rows = BATCH_SIZE, bool use_small_buffers = true) {
+      bool unpin_stream, int num_rows = BATCH_SIZE, bool use_small_buffers = true,
+      BufferedTupleStream::CopyRowFn copy_row_fn = NULL) {
     BufferedTupleStream stream(runtime_state_, *desc, runtime_state_->block_mgr(),
         client_, use_small_buffers, false);
+    stream.set_copy_row_fn(copy_row_fn);
     ASSERT_OK(stream.Init(-1, NULL, true));
 
     if (unpin_stream) ASSERT_OK(stream.UnpinStream());
@@ -371,6 +389,9 @@ class SimpleTupleStreamTest : public testing::Test {
   RuntimeState* runtime_state_;
   BufferedBlockMgr::Client* client_;
 
+  /// Module of the last CodegenCopyRow().
+  scoped_ptr<LlvmCodeGen> codegen_;
+
   MemTracker tracker_;
   ObjectPool pool_;
   RowDescriptor* int_desc_;
@@ -747,6 +768,24 @@ TEST_F(SimpleTupleStreamTest, BigRow) {
   nullable_stream.Close();
 }
 
+// Test adding rows with the codegen'd copy, also when the rows spill and when the
+// stream switches from small to IO-sized buffers.
+TEST_F(SimpleTupleStreamTest, CodegenCopyRow) {
+  int buffer_size = 100 * sizeof(int);
+  InitBlockMgr(10 * buffer_size, buffer_size);
+  BufferedTupleStream::CopyRowFn copy_row_fn;
+  CodegenCopyRow(*int_desc_, &copy_row_fn);
+  TestValues<int>(1, int_desc_, false, true, BATCH_SIZE, true, copy_row_fn);
+  TestValues<int>(10, int_desc_, false, true, BATCH_SIZE, true, copy_row_fn);
+  TestValues<int>(10, int_desc_, false, true, BATCH_SIZE, false, copy_row_fn);
+
+  CodegenCopyRow(*string_desc_, &copy_row_fn);
+  TestValues<StringValue>(1, string_desc_, false, true, BATCH_SIZE, true, copy_row_fn);
+  TestValues<StringValue>(10, string_desc_, false, true, BATCH_SIZE, true, copy_row_fn);
+  TestValues<StringValue>(10, string_desc_, false, true, BATCH_SIZE, false,
+      copy_row_fn);
+}
+
 // Basic API test. No data should be going to disk.
 TEST_F(SimpleNullStreamTest, Basic) {
   InitBlockMgr(-1, IO_BLOCK_SIZE);
@@ -814,6 +853,60 @@ TEST_F(MultiTupleStreamTest, MultiTupleManyBufferSpill) {
   TestIntValuesInterleaved(100, 15, true);
 }
 
+// The codegen'd copy only handles rows without nullable tuples.
+TEST_F(SimpleNullStreamTest, CodegenCopyRow) {
+  scoped_ptr<LlvmCodeGen> codegen;
+  ASSERT_OK(LlvmCodeGen::CreateImpalaCodegen(&pool_, "test", &codegen));
+  llvm::Function* fn;
+  EXPECT_FALSE(BufferedTupleStream::CodegenCopyRow(codegen.get(), *int_desc_, &fn).ok());
+  EXPECT_FALSE(
+      BufferedTupleStream::CodegenCopyRow(codegen.get(), *string_desc_, &fn).ok());
+}
+
+TEST_F(MultiTupleStreamTest, CodegenCopyRow) {
+  int buffer_size = 100 * sizeof(int);
+  InitBlockMgr(10 * buffer_size, buffer_size);
+  BufferedTupleStream::CopyRowFn copy_row_fn;
+  CodegenCopyRow(*int_desc_, &copy_row_fn);
+  TestValues<int>(1, int_desc_, false, true, BATCH_SIZE, true, copy_row_fn);
+  TestValues<int>(100, int_desc_, false, true, BATCH_SIZE, true, copy_row_fn);
+
+  CodegenCopyRow(*string_desc_, &copy_row_fn);
+  TestValues<StringValue>(1, string_desc_, false, true, BATCH_SIZE, true, copy_row_fn);
+  TestValues<StringValue>(100, string_desc_, false, true, BATCH_SIZE, true,
+      copy_row_fn);
+}
+
+// Compares the time to add rows with the interpreted and the codegen'd copy. The
+// times are only logged, they are too noisy to be checked.
+TEST_F(MultiTupleStreamTest, CodegenCopyRowBenchmark) {
+  InitBlockMgr(-1, IO_BLOCK_SIZE);
+  BufferedTupleStream::CopyRowFn copy_row_fn;
+  CodegenCopyRow(*string_desc_, &copy_row_fn);
+  RowBatch* batch = CreateStringBatch(0, BATCH_SIZE, false);
+  const int num_iters = 400;
+  for (int use_codegen = 0; use_codegen < 2; ++use_codegen) {
+    BufferedTupleStream stream(runtime_state_, *string_desc_,
+        runtime_state_->block_mgr(), client_, false, false);
+    stream.set_copy_row_fn(use_codegen ? copy_row_fn : NULL);
+    ASSERT_OK(stream.Init(-1, NULL, true));
+    Status status;
+    MonotonicStopWatch watch;
+    watch.Start();
+    for (int i = 0; i < num_iters; ++i) {
+      for (int j = 0; j < batch->num_rows(); ++j) {
+        ASSERT_TRUE(stream.AddRow(batch->GetRow(j), &status));
+      }
+    }
+    watch.Stop();
+    EXPECT_EQ(stream.num_rows(), num_iters * batch->num_rows());
+    LOG(INFO) << (use_codegen ? "Codegen'd" : "Interpreted") << " copy of "
+              << stream.num_rows() << " rows: "
+              << PrettyPrinter::Print(watch.ElapsedTime(), TUnit::TIME_NS);
+    stream.Close();
+  }
+}
+
 // Test that we can allocate a row in the stream and copy in multiple tuples then
 // read it back from the stream.
 TEST_F(MultiTupleStreamTest, MultiTupleAllocateRow) {
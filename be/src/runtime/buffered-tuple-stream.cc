@@ -17,9 +17,11 @@
 #include <boost/bind.hpp>
 #include <gutil/strings/substitute.h>
 
+#include "codegen/llvm-codegen.h"
 #include "runtime/collection-value.h"
 #include "runtime/descriptors.h"
 #include "runtime/row-batch.h"
+#include "runtime/runtime-state.h"
 #include "runtime/string-value.h"
 #include "runtime/tuple-row.h"
 #include "util/bit-util.h"
@@ -28,13 +30,14 @@
 #include "common/names.h"
 
 using namespace impala;
+using namespace llvm;
 using namespace strings;
 
 // The first NUM_SMALL_BLOCKS of the tuple stream are made of blocks less than the
-// IO size. These blocks never spill.
-// TODO: Consider adding a 4MB in-memory buffer that would split the gap between the
-// 512KB in-memory buffer and the 8MB (IO-sized) spillable buffer.
-static const int64_t INITIAL_BLOCK_SIZES[] = { 64 * 1024, 512 * 1024 };
+// IO size. These blocks never spill. They double in size, so that the memory of a small
+// stream stays proportional to its data, and come from the block mgr's buddy allocator.
+static const int64_t INITIAL_BLOCK_SIZES[] =
+    { 64 * 1024, 128 * 1024, 256 * 1024, 512 * 1024 };
 static const int NUM_SMALL_BLOCKS = sizeof(INITIAL_BLOCK_SIZES) / sizeof(int64_t);
 
 string BufferedTupleStream::RowIdx::DebugString() const {
@@ -76,6 +79,7 @@ BufferedTupleStream::BufferedTupleStream(RuntimeState* state,
   read_block_null_indicators_size_ = -1;
   write_block_null_indicators_size_ = -1;
   max_null_indicators_size_ = -1;
+  copy_row_fn_ = NULL;
   read_block_ = blocks_.end();
   fixed_tuple_row_size_ = 0;
   for (int i = 0; i < desc_.tuple_descriptors().size(); ++i) {
@@ -375,6 +379,16 @@ Status BufferedTupleStream::NextReadBlock() {
     read_end_ptr_ = (*read_block_)->buffer() + (*read_block_)->buffer_len();
   }
   DCHECK_EQ(num_pinned_, NumPinned(blocks_)) << DebugString();
+  return ReadAheadBlocks();
+}
+
+Status BufferedTupleStream::ReadAheadBlocks() {
+  if (read_block_ == blocks_.end()) return Status::OK();
+  list<BufferedBlockMgr::Block*>::iterator it = read_block_;
+  for (int i = 0; i < block_mgr_->read_ahead_blocks(); ++i) {
+    if (++it == blocks_.end()) break;
+    if (!(*it)->is_pinned()) RETURN_IF_ERROR((*it)->ReadAhead());
+  }
   return Status::OK();
 }
 
@@ -419,7 +433,7 @@ Status BufferedTupleStream::PrepareForRead(bool delete_on_read, bool* got_buffer
   read_block_idx_ = 0;
   delete_on_read_ = delete_on_read;
   *got_buffer = true;
-  return Status::OK();
+  return ReadAheadBlocks();
 }
 
 Status BufferedTupleStream::PinStream(bool already_reserved, bool* pinned) {
@@ -730,6 +744,17 @@ int64_t BufferedTupleStream::ComputeRowSize(TupleRow* row) const {
 }
 
 bool BufferedTupleStream::DeepCopy(TupleRow* row) {
+  if (copy_row_fn_ != NULL) {
+    if (UNLIKELY(write_block_ == NULL)) return false;
+    DCHECK(write_block_->is_pinned());
+    DCHECK_EQ(write_block_null_indicators_size_, 0);
+    uint8_t* row_end = copy_row_fn_(row, write_ptr_, write_end_ptr_);
+    if (UNLIKELY(row_end == NULL)) return false;
+    write_ptr_ = row_end;
+    write_block_->AddRow();
+    ++num_rows_;
+    return true;
+  }
   if (has_nullable_tuple_) {
     return DeepCopyInternal<true>(row);
   } else {
@@ -737,7 +762,6 @@ bool BufferedTupleStream::DeepCopy(TupleRow* row) {
   }
 }
 
-// TODO: this really needs codegen
 // TODO: in case of duplicate tuples, this can redundantly serialize data.
 template <bool HasNullableTuple>
 bool BufferedTupleStream::DeepCopyInternal(TupleRow* row) {
@@ -812,6 +836,182 @@ bool BufferedTupleStream::DeepCopyInternal(TupleRow* row) {
   return true;
 }
 
+Status BufferedTupleStream::Codegen(RuntimeState* state, const RowDescriptor& row_desc,
+    CopyRowFn* copy_row_fn) {
+  LlvmCodeGen* codegen;
+  RETURN_IF_ERROR(state->GetCodegen(&codegen));
+  Function* fn;
+  RETURN_IF_ERROR(CodegenCopyRow(codegen, row_desc, &fn));
+  codegen->AddFunctionToJit(fn, reinterpret_cast<void**>(copy_row_fn));
+  return Status::OK();
+}
+
+// Codegens the copy of DeepCopyInternal<false>() for a row desc. The IR for a row with a
+// single tuple of 24 bytes with a nullable string slot at offset 8 looks like:
+//
+// define i8* @CopyRow(%"class.impala::TupleRow"* %row, i8* %dst, i8* %dst_end) {
+// entry:
+//   %0 = ptrtoint i8* %dst_end to i64
+//   %1 = ptrtoint i8* %dst to i64
+//   %remaining = sub i64 %0, %1
+//   %fits = icmp sge i64 %remaining, 24
+//   br i1 %fits, label %copy_tuples, label %full
+//
+// copy_tuples:
+//   %tuple_ptrs = bitcast %"class.impala::TupleRow"* %row to i8**
+//   %tuple_ptr = getelementptr i8** %tuple_ptrs, i32 0
+//   %tuple = load i8** %tuple_ptr
+//   call void @llvm.memcpy.p0i8.p0i8.i64(i8* %dst, i8* %tuple, i64 24, i32 0, i1 false)
+//   %dst1 = getelementptr i8* %dst, i32 24
+//   %null_byte_ptr = getelementptr i8* %tuple, i32 0
+//   %null_byte = load i8* %null_byte_ptr
+//   %null_mask = and i8 %null_byte, 1
+//   %is_null = icmp ne i8 %null_mask, 0
+//   br i1 %is_null, label %next, label %not_null
+//
+// not_null:
+//   %2 = getelementptr i8* %tuple, i32 8
+//   %str_val = bitcast i8* %2 to %"struct.impala::StringValue"*
+//   ...
+//   %has_data = icmp sgt i32 %len, 0
+//   br i1 %has_data, label %check_space, label %next
+//
+// check_space:
+//   ...
+//   br i1 %string_fits, label %copy_string, label %full
+//
+// copy_string:
+//   call void @llvm.memcpy.p0i8.p0i8.i64(i8* %dst1, i8* %ptr, i64 %len64, ...)
+//   %dst2 = getelementptr i8* %dst1, i64 %len64
+//   br label %next
+//
+// next:
+//   %dst_phi = phi i8* [ %dst1, %copy_tuples ], [ %dst1, %not_null ], [ %dst2, ... ]
+//   ret i8* %dst_phi
+//
+// full:
+//   ret i8* null
+// }
+Status BufferedTupleStream::CodegenCopyRow(LlvmCodeGen* codegen,
+    const RowDescriptor& row_desc, Function** fn) {
+  if (row_desc.IsAnyTupleNullable()) {
+    return Status("BufferedTupleStream::CodegenCopyRow(): nullable tuples are not "
+        "supported");
+  }
+  const vector<TupleDescriptor*>& tuple_descs = row_desc.tuple_descriptors();
+  int fixed_tuple_row_size = 0;
+  for (const TupleDescriptor* tuple_desc: tuple_descs) {
+    fixed_tuple_row_size += tuple_desc->byte_size();
+    for (const SlotDescriptor* slot_desc: tuple_desc->slots()) {
+      if (slot_desc->type().IsCollectionType()) {
+        return Status("BufferedTupleStream::CodegenCopyRow(): collection slots are not "
+            "supported");
+      }
+    }
+  }
+
+  LLVMContext& context = codegen->context();
+  Type* bigint_type = codegen->bigint_type();
+  LlvmCodeGen::FnPrototype prototype(codegen, "CopyRow", codegen->ptr_type());
+  prototype.AddArgument(
+      LlvmCodeGen::NamedVariable("row", codegen->GetPtrType(TupleRow::LLVM_CLASS_NAME)));
+  prototype.AddArgument(LlvmCodeGen::NamedVariable("dst", codegen->ptr_type()));
+  prototype.AddArgument(LlvmCodeGen::NamedVariable("dst_end", codegen->ptr_type()));
+
+  LlvmCodeGen::LlvmBuilder builder(context);
+  Value* args[3];
+  *fn = prototype.GeneratePrototype(&builder, &args[0]);
+  Value* dst = args[1];
+  Value* dst_end = builder.CreatePtrToInt(args[2], bigint_type);
+  BasicBlock* full_block = BasicBlock::Create(context, "full", *fn);
+  BasicBlock* copy_tuples_block = BasicBlock::Create(context, "copy_tuples", *fn);
+
+  Value* remaining =
+      builder.CreateSub(dst_end, builder.CreatePtrToInt(dst, bigint_type), "remaining");
+  Value* fits = builder.CreateICmpSGE(remaining,
+      codegen->GetIntConstant(TYPE_BIGINT, fixed_tuple_row_size), "fits");
+  builder.CreateCondBr(fits, copy_tuples_block, full_block);
+
+  // Copy the fixed length tuples, then the data of their string slots.
+  builder.SetInsertPoint(copy_tuples_block);
+  Value* tuple_ptrs = builder.CreateBitCast(
+      args[0], codegen->GetPtrType(codegen->ptr_type()), "tuple_ptrs");
+  vector<Value*> tuples;
+  for (int i = 0; i < tuple_descs.size(); ++i) {
+    Value* tuple_ptr = builder.CreateConstGEP1_32(tuple_ptrs, i, "tuple_ptr");
+    tuples.push_back(builder.CreateLoad(tuple_ptr, "tuple"));
+    int tuple_size = tuple_descs[i]->byte_size();
+    if (tuple_size == 0) continue;
+    codegen->CodegenMemcpy(&builder, dst, tuples[i], tuple_size);
+    dst = builder.CreateConstGEP1_32(dst, tuple_size, "dst");
+  }
+
+  for (int i = 0; i < tuple_descs.size(); ++i) {
+    for (const SlotDescriptor* slot_desc: tuple_descs[i]->slots()) {
+      if (!slot_desc->type().IsVarLenStringType()) continue;
+      BasicBlock* not_null_block = BasicBlock::Create(context, "not_null", *fn);
+      BasicBlock* check_space_block = BasicBlock::Create(context, "check_space", *fn);
+      BasicBlock* copy_string_block = BasicBlock::Create(context, "copy_string", *fn);
+      BasicBlock* next_block = BasicBlock::Create(context, "next", *fn);
+      BasicBlock* null_block = NULL;
+      if (slot_desc->is_nullable()) {
+        const NullIndicatorOffset& null_offset = slot_desc->null_indicator_offset();
+        null_block = builder.GetInsertBlock();
+        Value* null_byte_ptr = builder.CreateConstGEP1_32(
+            tuples[i], null_offset.byte_offset, "null_byte_ptr");
+        Value* null_byte = builder.CreateLoad(null_byte_ptr, "null_byte");
+        Value* null_mask = builder.CreateAnd(null_byte,
+            codegen->GetIntConstant(TYPE_TINYINT, null_offset.bit_mask), "null_mask");
+        Value* is_null = builder.CreateICmpNE(
+            null_mask, codegen->GetIntConstant(TYPE_TINYINT, 0), "is_null");
+        builder.CreateCondBr(is_null, next_block, not_null_block);
+      } else {
+        builder.CreateBr(not_null_block);
+      }
+
+      builder.SetInsertPoint(not_null_block);
+      Value* str_val = builder.CreateBitCast(
+          builder.CreateConstGEP1_32(tuples[i], slot_desc->tuple_offset()),
+          codegen->GetPtrType(TYPE_STRING), "str_val");
+      Value* ptr = builder.CreateLoad(builder.CreateStructGEP(NULL, str_val, 0), "ptr");
+      Value* len = builder.CreateLoad(builder.CreateStructGEP(NULL, str_val, 1), "len");
+      Value* has_data = builder.CreateICmpSGT(
+          len, ConstantInt::get(len->getType(), 0), "has_data");
+      builder.CreateCondBr(has_data, check_space_block, next_block);
+
+      builder.SetInsertPoint(check_space_block);
+      Value* len64 = builder.CreateSExt(len, bigint_type, "len64");
+      remaining = builder.CreateSub(
+          dst_end, builder.CreatePtrToInt(dst, bigint_type), "remaining");
+      Value* string_fits = builder.CreateICmpSGE(remaining, len64, "string_fits");
+      builder.CreateCondBr(string_fits, copy_string_block, full_block);
+
+      builder.SetInsertPoint(copy_string_block);
+      codegen->CodegenMemcpy(&builder, dst, ptr, len64);
+      Value* new_dst = builder.CreateGEP(dst, len64, "dst");
+      builder.CreateBr(next_block);
+
+      builder.SetInsertPoint(next_block);
+      PHINode* dst_phi = builder.CreatePHI(dst->getType(), 3, "dst_phi");
+      if (null_block != NULL) dst_phi->addIncoming(dst, null_block);
+      dst_phi->addIncoming(dst, not_null_block);
+      dst_phi->addIncoming(new_dst, copy_string_block);
+      dst = dst_phi;
+    }
+  }
+  builder.CreateRet(dst);
+
+  builder.SetInsertPoint(full_block);
+  builder.CreateRet(codegen->null_ptr_value());
+
+  *fn = codegen->FinalizeFunction(*fn);
+  if (*fn == NULL) {
+    return Status("BufferedTupleStream::CodegenCopyRow(): codegen'd CopyRow() function "
+        "failed verification, see log");
+  }
+  return Status::OK();
+}
+
 bool BufferedTupleStream::CopyStrings(const Tuple* tuple,
     const vector<SlotDescriptor*>& string_slots) {
   for (int i = 0; i < string_slots.size(); ++i) {
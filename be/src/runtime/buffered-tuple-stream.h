@@ -21,9 +21,14 @@
 #include "common/status.h"
 #include "runtime/buffered-block-mgr.h"
 
+namespace llvm {
+  class Function;
+}
+
 namespace impala {
 
 class BufferedBlockMgr;
+class LlvmCodeGen;
 class RuntimeProfile;
 class RuntimeState;
 class RowBatch;
@@ -43,8 +48,8 @@ class TupleRow;
 /// 64 * 8MB = 512MB of buffering. A query with 5 of these operators would require
 /// 2.56GB just to run, regardless of how much of that is used. This is
 /// problematic for small queries. Instead we will start with a fixed number of small
-/// buffers (currently 2 small buffers: one 64KB and one 512KB) and only start using IO
-/// sized buffers when those fill up. The small buffers never spill.
+/// buffers (currently 4 small buffers, doubling from 64KB to 512KB) and only start using
+/// IO sized buffers when those fill up. The small buffers never spill.
 /// The stream will *not* automatically switch from using small buffers to IO-sized
 /// buffers when all the small buffers for this stream have been used.
 ///
@@ -203,6 +208,11 @@ class BufferedTupleStream {
     uint64_t data;
   };
 
+  /// Signature of the function generated by CodegenCopyRow(). Copies 'row' to 'dst' and
+  /// returns the end of the copied data, or NULL if the row doesn't fit before
+  /// 'dst_end'.
+  typedef uint8_t* (*CopyRowFn)(TupleRow* row, uint8_t* dst, uint8_t* dst_end);
+
   /// row_desc: description of rows stored in the stream. This is the desc for rows
   /// that are added and the rows being returned.
   /// block_mgr: Underlying block mgr that owns the data blocks.
@@ -238,6 +248,25 @@ class BufferedTupleStream {
   /// then AddRow() again.
   bool AddRow(TupleRow* row, Status* status);
 
+  /// Codegens a function that copies rows of 'row_desc' into a stream, with the tuple
+  /// sizes and the offsets of the string slots known at compile time. The function can
+  /// only be used by streams without external varlen slots. Returns an error if the row
+  /// has nullable tuples or collection slots, which are only copied by DeepCopy().
+  static Status CodegenCopyRow(LlvmCodeGen* codegen, const RowDescriptor& row_desc,
+      llvm::Function** fn);
+
+  /// Codegens the CopyRowFn for 'row_desc' and adds it to the module of 'state'. The
+  /// jitted function is stored in '*copy_row_fn' once the module is compiled.
+  static Status Codegen(RuntimeState* state, const RowDescriptor& row_desc,
+      CopyRowFn* copy_row_fn);
+
+  /// Makes AddRow() copy rows with 'fn', the jitted function of CodegenCopyRow() for
+  /// this stream's row desc. NULL goes back to the interpreted copy.
+  void set_copy_row_fn(CopyRowFn fn) {
+    DCHECK(fn == NULL || (!has_nullable_tuple_ && inlined_coll_slots_.empty()));
+    copy_row_fn_ = fn;
+  }
+
   /// Allocates space to store a row of with fixed length 'fixed_size' and variable
   /// length data 'varlen_size'. If successful, returns the pointer where fixed length
   /// data should be stored and assigns 'varlen_data' to where var-len data should
@@ -364,6 +393,9 @@ class BufferedTupleStream {
   /// stream, grouped by tuple_idx.
   std::vector<std::pair<int, std::vector<SlotDescriptor*> > > inlined_coll_slots_;
 
+  /// Codegen'd function that copies rows in DeepCopy(), or NULL.
+  CopyRowFn copy_row_fn_;
+
   /// Block manager and client used to allocate, pin and release blocks. Not owned.
   BufferedBlockMgr* block_mgr_;
   BufferedBlockMgr::Client* block_mgr_client_;
@@ -457,7 +489,7 @@ class BufferedTupleStream {
   bool CopyCollections(const Tuple* tuple,
       const std::vector<SlotDescriptor*>& collection_slots);
 
-  /// Wrapper of the templated DeepCopyInternal() function.
+  /// Wrapper of copy_row_fn_ and the templated DeepCopyInternal() function.
   bool DeepCopy(TupleRow* row);
 
   /// Gets a new block of 'block_len' bytes from the block_mgr_, updating write_block_,
@@ -477,6 +509,10 @@ class BufferedTupleStream {
   /// Updates read_block_, read_ptr_, read_tuple_idx_ and read_end_ptr_.
   Status NextReadBlock();
 
+  /// Starts reading ahead the unpinned blocks that follow read_block_, up to the block
+  /// mgr's read_ahead_blocks(), so that NextReadBlock() does not wait for the disk.
+  Status ReadAheadBlocks();
+
   /// Returns the total additional bytes that this row will consume in write_block_ if
   /// appended to the block. This includes the fixed length part of the row and the
   /// data for inlined_string_slots_ and inlined_coll_slots_.
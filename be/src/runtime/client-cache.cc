@@ -24,10 +24,16 @@
 #include "common/logging.h"
 #include "util/container-util.h"
 #include "util/network-util.h"
+#include "util/stopwatch.h"
 #include "rpc/thrift-util.h"
 #include "gen-cpp/ImpalaInternalService.h"
 
 #include "common/names.h"
+
+DEFINE_int32(max_cached_clients_per_host, 0, "(Advanced) Maximum number of idle "
+    "connections that a client cache keeps open to a single host. Once there are more, "
+    "the least recently used idle connections are closed. 0 means no limit.");
+
 using namespace apache::thrift;
 using namespace apache::thrift::server;
 using namespace apache::thrift::transport;
@@ -49,10 +55,15 @@ Status ClientCacheHelper::GetClient(const TNetworkAddress& address,
   {
     lock_guard<mutex> lock(host_cache->lock);
     if (!host_cache->clients.empty()) {
-      *client_key = host_cache->clients.front();
+      // Take the most recently used client, so that the least recently used ones are
+      // the first to be evicted in ReleaseClient().
+      *client_key = host_cache->clients.back();
       VLOG(2) << "GetClient(): returning cached client for " << address;
-      host_cache->clients.pop_front();
-      if (metrics_enabled_) clients_in_use_metric_->Increment(1);
+      host_cache->clients.pop_back();
+      if (metrics_enabled_) {
+        clients_in_use_metric_->Increment(1);
+        idle_clients_metric_->Increment(-1);
+      }
       return Status::OK();
     }
   }
@@ -103,7 +114,13 @@ Status ClientCacheHelper::CreateClient(const TNetworkAddress& address,
     ClientFactory factory_method, ClientKey* client_key) {
   shared_ptr<ThriftClientImpl> client_impl(factory_method(address, client_key));
   VLOG(2) << "CreateClient(): creating new client for " << client_impl->address();
+  MonotonicStopWatch connect_timer;
+  connect_timer.Start();
   Status status = client_impl->OpenWithRetry(num_tries_, wait_ms_);
+  if (metrics_enabled_) {
+    connects_metric_->Increment(1);
+    connect_time_ms_metric_->Increment(connect_timer.ElapsedTime() / (1000 * 1000));
+  }
   if (!status.ok()) {
     *client_key = NULL;
     return status;
@@ -132,17 +149,77 @@ void ClientCacheHelper::ReleaseClient(ClientKey* client_key) {
     client_impl = client->second;
   }
   VLOG(2) << "Releasing client for " << client_impl->address() << " back to cache";
+  ClientKey evicted_key = NULL;
   {
     lock_guard<mutex> lock(cache_lock_);
     PerHostCacheMap::iterator cache = per_host_caches_.find(client_impl->address());
     DCHECK(cache != per_host_caches_.end());
     lock_guard<mutex> entry_lock(cache->second->lock);
     cache->second->clients.push_back(*client_key);
+    if (FLAGS_max_cached_clients_per_host > 0
+        && cache->second->clients.size()
+            > static_cast<size_t>(FLAGS_max_cached_clients_per_host)) {
+      // Don't keep the connections of a burst of concurrent rpcs open once it is over.
+      // The front of the list is the least recently used client.
+      evicted_key = cache->second->clients.front();
+      cache->second->clients.pop_front();
+    }
+  }
+  if (evicted_key != NULL) EvictClient(evicted_key);
+  if (metrics_enabled_) {
+    clients_in_use_metric_->Increment(-1);
+    idle_clients_metric_->Increment(1);
   }
-  if (metrics_enabled_) clients_in_use_metric_->Increment(-1);
   *client_key = NULL;
 }
 
+void ClientCacheHelper::EvictClient(ClientKey client_key) {
+  shared_ptr<ThriftClientImpl> client_impl;
+  {
+    lock_guard<mutex> lock(client_map_lock_);
+    ClientMap::iterator client = client_map_.find(client_key);
+    DCHECK(client != client_map_.end());
+    client_impl = client->second;
+    client_map_.erase(client);
+  }
+  VLOG(2) << "Closing least recently used client for " << client_impl->address();
+  client_impl->Close();
+  if (metrics_enabled_) {
+    total_clients_metric_->Increment(-1);
+    idle_clients_metric_->Increment(-1);
+  }
+}
+
+Status ClientCacheHelper::WarmUp(const TNetworkAddress& address,
+    ClientFactory factory_method, int num_clients) {
+  if (FLAGS_max_cached_clients_per_host > 0) {
+    num_clients = min(num_clients, FLAGS_max_cached_clients_per_host);
+  }
+  shared_ptr<PerHostCache> host_cache;
+  {
+    lock_guard<mutex> lock(cache_lock_);
+    shared_ptr<PerHostCache>* ptr = &per_host_caches_[address];
+    if (ptr->get() == NULL) ptr->reset(new PerHostCache());
+    host_cache = *ptr;
+  }
+  int num_to_create;
+  {
+    lock_guard<mutex> lock(host_cache->lock);
+    num_to_create = num_clients - static_cast<int>(host_cache->clients.size());
+  }
+  VLOG(2) << "WarmUp(): creating " << max(num_to_create, 0) << " clients for "
+          << address;
+  for (int i = 0; i < num_to_create; ++i) {
+    ClientKey client_key;
+    RETURN_IF_ERROR(CreateClient(address, factory_method, &client_key));
+    // Created clients start life checked out. Releasing them also applies the cap on
+    // the idle clients of the host if other threads released clients in the meantime.
+    if (metrics_enabled_) clients_in_use_metric_->Increment(1);
+    ReleaseClient(&client_key);
+  }
+  return Status::OK();
+}
+
 void ClientCacheHelper::CloseConnections(const TNetworkAddress& address) {
   PerHostCache* cache;
   {
@@ -206,6 +283,18 @@ void ClientCacheHelper::InitMetrics(MetricGroup* metrics, const string& key_pref
   stringstream max_ss;
   max_ss << key_prefix << ".client-cache.total-clients";
   total_clients_metric_ = metrics->AddGauge<int64_t>(max_ss.str(), 0);
+
+  stringstream idle_ss;
+  idle_ss << key_prefix << ".client-cache.idle-clients";
+  idle_clients_metric_ = metrics->AddGauge<int64_t>(idle_ss.str(), 0);
+
+  stringstream connects_ss;
+  connects_ss << key_prefix << ".client-cache.connects";
+  connects_metric_ = metrics->AddCounter<int64_t>(connects_ss.str(), 0);
+
+  stringstream connect_time_ss;
+  connect_time_ss << key_prefix << ".client-cache.connect-time-ms";
+  connect_time_ms_metric_ = metrics->AddCounter<int64_t>(connect_time_ss.str(), 0);
   metrics_enabled_ = true;
 }
 
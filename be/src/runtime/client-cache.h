@@ -57,7 +57,7 @@ typedef void* ClientKey;
 /// TODO: shut down clients in the background if they don't get used for a period of time
 /// TODO: More graceful handling of clients that have failed (maybe better
 /// handled by a smart-wrapper of the interface object).
-/// TODO: limits on total number of clients, and clients per-backend
+/// TODO: limits on the total number of clients
 /// TODO: move this to a separate header file, so that the public interface is more
 /// prominent in this file
 class ClientCacheHelper {
@@ -84,9 +84,18 @@ class ClientCacheHelper {
   Status ReopenClient(ClientFactory factory_method, ClientKey* client_key);
 
   /// Returns a client to the cache. Upon return, *client_key will be NULL, and the
-  /// associated client will be available in the per-host cache..
+  /// associated client will be available in the per-host cache. If the cache then holds
+  /// more than --max_cached_clients_per_host idle clients for the host, the least
+  /// recently used one is closed and removed.
   void ReleaseClient(ClientKey* client_key);
 
+  /// Opens connections to 'address' with 'factory_method' until the per-host cache
+  /// holds 'num_clients' idle clients (at most --max_cached_clients_per_host), so that
+  /// later GetClient() calls don't have to connect. Returns an error if a connection
+  /// cannot be opened.
+  Status WarmUp(const TNetworkAddress& address, ClientFactory factory_method,
+      int num_clients);
+
   /// Close all connections to a host (e.g., in case of failure) so that on their
   /// next use they will have to be reopened via ReopenClient().
   void CloseConnections(const TNetworkAddress& address);
@@ -97,8 +106,9 @@ class ClientCacheHelper {
   /// Closes every connection in the cache. Used only for testing.
   void TestShutdown();
 
-  /// Creates two metrics for this cache measuring the number of clients currently used,
-  /// and the total number in the cache.
+  /// Creates metrics for this cache measuring the number of clients currently used, the
+  /// number of idle clients, the total number in the cache, and the number of
+  /// connections opened and the total time spent opening them.
   void InitMetrics(MetricGroup* metrics, const std::string& key_prefix);
 
  private:
@@ -132,7 +142,7 @@ class ClientCacheHelper {
     /// Protects clients.
     boost::mutex lock;
 
-    /// List of client keys for this entry's host.
+    /// List of client keys for this entry's host, from least to most recently used.
     std::list<ClientKey> clients;
   };
 
@@ -178,9 +188,20 @@ class ClientCacheHelper {
   /// Total clients in the cache, including those in use
   IntGauge* total_clients_metric_;
 
+  /// Clients in the per-host caches, i.e. not in use
+  IntGauge* idle_clients_metric_;
+
+  /// Number of connections opened and the total time spent opening them
+  IntCounter* connects_metric_;
+  IntCounter* connect_time_ms_metric_;
+
   /// Create a new client for specific address in 'client' and put it in client_map_
   Status CreateClient(const TNetworkAddress& address, ClientFactory factory_method,
       ClientKey* client_key);
+
+  /// Closes an idle client that was removed from its per-host cache and removes it from
+  /// client_map_.
+  void EvictClient(ClientKey client_key);
 };
 
 template<class T>
@@ -293,6 +314,11 @@ class ClientCache {
     return client_cache_helper_.TestShutdown();
   }
 
+  /// Opens connections to 'address' until 'num_clients' idle clients are cached for it.
+  Status WarmUp(const TNetworkAddress& address, int num_clients) {
+    return client_cache_helper_.WarmUp(address, client_factory_, num_clients);
+  }
+
   /// Adds metrics for this cache to the supplied Metrics instance. The
   /// metrics have keys that are prefixed by the key_prefix argument
   /// (which should not end in a period).
@@ -0,0 +1,164 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gutil/strings/substitute.h>
+
+#include "testutil/gtest-util.h"
+#include "runtime/columnar-batch.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/row-batch.h"
+#include "runtime/string-value.h"
+#include "runtime/tuple-row.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/cpu-info.h"
+
+#include "common/names.h"
+
+using namespace strings;
+
+namespace impala {
+
+const int NUM_ROWS = 100;
+
+class ColumnarBatchTest : public testing::Test {
+ protected:
+  ObjectPool pool_;
+  scoped_ptr<MemTracker> tracker_;
+  RowDescriptor* row_desc_;
+  const TupleDescriptor* tuple_desc_;
+
+  virtual void SetUp() {
+    tracker_.reset(new MemTracker());
+    // tuple: (int, string)
+    DescriptorTblBuilder builder(&pool_);
+    builder.DeclareTuple() << TYPE_INT << TYPE_STRING;
+    DescriptorTbl* desc_tbl = builder.Build();
+    vector<bool> nullable_tuples(1, true);
+    vector<TTupleId> tuple_id(1, (TTupleId) 0);
+    row_desc_ = pool_.Add(new RowDescriptor(*desc_tbl, tuple_id, nullable_tuples));
+    tuple_desc_ = row_desc_->tuple_descriptors()[0];
+  }
+
+  virtual void TearDown() {
+    pool_.Clear();
+    tracker_.reset();
+  }
+
+  const SlotDescriptor* int_slot() { return tuple_desc_->slots()[0]; }
+  const SlotDescriptor* string_slot() { return tuple_desc_->slots()[1]; }
+
+  /// Creates a batch where row i has the int value i and the string value "s<i>". The
+  /// int is NULL in every 10th row starting with row 5 and the tuple is NULL in every
+  /// 10th row starting with row 7.
+  RowBatch* CreateRowBatch() {
+    RowBatch* batch = pool_.Add(new RowBatch(*row_desc_, NUM_ROWS, tracker_.get()));
+    int tuple_size = tuple_desc_->byte_size();
+    uint8_t* tuple_mem = batch->tuple_data_pool()->Allocate(tuple_size * NUM_ROWS);
+    memset(tuple_mem, 0, tuple_size * NUM_ROWS);
+    for (int i = 0; i < NUM_ROWS; ++i) {
+      TupleRow* row = batch->GetRow(batch->AddRow());
+      Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size);
+      if (i % 10 == 5) {
+        tuple->SetNull(int_slot()->null_indicator_offset());
+      } else {
+        *reinterpret_cast<int32_t*>(tuple->GetSlot(int_slot()->tuple_offset())) = i;
+      }
+      string str = Substitute("s$0", i);
+      char* str_mem = reinterpret_cast<char*>(
+          batch->tuple_data_pool()->Allocate(str.size()));
+      memcpy(str_mem, str.data(), str.size());
+      *reinterpret_cast<StringValue*>(tuple->GetSlot(string_slot()->tuple_offset())) =
+          StringValue(str_mem, str.size());
+      row->SetTuple(0, i % 10 == 7 ? NULL : tuple);
+      batch->CommitLastRow();
+    }
+    return batch;
+  }
+
+  /// Checks that 'row' holds the values that CreateRowBatch() wrote to row 'i'.
+  void CheckRow(TupleRow* row, int i) {
+    Tuple* tuple = row->GetTuple(0);
+    ASSERT_TRUE(tuple != NULL);
+    if (i % 10 == 5 || i % 10 == 7) {
+      EXPECT_TRUE(tuple->IsNull(int_slot()->null_indicator_offset()));
+    } else {
+      EXPECT_FALSE(tuple->IsNull(int_slot()->null_indicator_offset()));
+      EXPECT_EQ(*reinterpret_cast<int32_t*>(tuple->GetSlot(int_slot()->tuple_offset())),
+          i);
+    }
+    if (i % 10 == 7) {
+      EXPECT_TRUE(tuple->IsNull(string_slot()->null_indicator_offset()));
+    } else {
+      StringValue* str =
+          reinterpret_cast<StringValue*>(tuple->GetSlot(string_slot()->tuple_offset()));
+      EXPECT_EQ(str->DebugString(), Substitute("s$0", i));
+    }
+  }
+};
+
+TEST_F(ColumnarBatchTest, RoundTrip) {
+  RowBatch* batch = CreateRowBatch();
+  ColumnarBatch columnar_batch(tuple_desc_, NUM_ROWS, tracker_.get());
+  columnar_batch.FromRowBatch(batch, 0);
+  ASSERT_EQ(columnar_batch.num_rows(), NUM_ROWS);
+  ASSERT_EQ(columnar_batch.num_columns(), 2);
+
+  ColumnVector* ints = columnar_batch.column(0);
+  for (int i = 0; i < NUM_ROWS; ++i) {
+    EXPECT_EQ(ints->IsNull(i), i % 10 == 5 || i % 10 == 7) << i;
+    if (!ints->IsNull(i)) EXPECT_EQ(ints->values<int32_t>()[i], i);
+  }
+
+  RowBatch out_batch(*row_desc_, NUM_ROWS, tracker_.get());
+  columnar_batch.ToRowBatch(&out_batch, 0);
+  ASSERT_EQ(out_batch.num_rows(), NUM_ROWS);
+  for (int i = 0; i < NUM_ROWS; ++i) CheckRow(out_batch.GetRow(i), i);
+}
+
+TEST_F(ColumnarBatchTest, Select) {
+  RowBatch* batch = CreateRowBatch();
+  ColumnarBatch columnar_batch(tuple_desc_, NUM_ROWS, tracker_.get());
+  columnar_batch.FromRowBatch(batch, 0);
+  const ColumnVector* ints = columnar_batch.column(0);
+
+  int selection[NUM_ROWS];
+  // The NULL values at 5, 7, 15 and 17 don't pass.
+  int num_selected = ints->Select<int32_t>(ColumnVector::LT, 20, NUM_ROWS, selection);
+  ASSERT_EQ(num_selected, 16);
+  int expected_idx = 0;
+  for (int i = 0; i < num_selected; ++i) {
+    while (expected_idx % 10 == 5 || expected_idx % 10 == 7) ++expected_idx;
+    EXPECT_EQ(selection[i], expected_idx);
+    ++expected_idx;
+  }
+  EXPECT_EQ(ints->Select<int32_t>(ColumnVector::EQ, 42, NUM_ROWS, selection), 1);
+  EXPECT_EQ(selection[0], 42);
+  EXPECT_EQ(ints->Select<int32_t>(ColumnVector::EQ, 45, NUM_ROWS, selection), 0);
+  EXPECT_EQ(ints->Select<int32_t>(ColumnVector::GE, 0, NUM_ROWS, selection), 80);
+
+  // Only the selected rows are materialized.
+  ASSERT_EQ(ints->Select<int32_t>(ColumnVector::GT, 90, NUM_ROWS, selection), 7);
+  RowBatch out_batch(*row_desc_, NUM_ROWS, tracker_.get());
+  columnar_batch.ToRowBatch(&out_batch, 0, selection, 7);
+  ASSERT_EQ(out_batch.num_rows(), 7);
+  for (int i = 0; i < 7; ++i) CheckRow(out_batch.GetRow(i), selection[i]);
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,124 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/columnar-batch.h"
+
+#include <string.h>
+
+#include "runtime/descriptors.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/row-batch.h"
+#include "runtime/tuple-row.h"
+#include "util/bit-util.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+ColumnVector::ColumnVector(const SlotDescriptor* slot_desc, int capacity)
+  : slot_desc_(slot_desc),
+    value_size_(slot_desc->slot_size()),
+    data_(new uint8_t[capacity * value_size_]),
+    null_bitmap_(new uint64_t[BitUtil::Ceil(capacity, 64)]) {
+  memset(null_bitmap_.get(), 0, BitUtil::Ceil(capacity, 64) * sizeof(uint64_t));
+}
+
+int64_t ColumnVector::AllocatedBytes(int value_size, int capacity) {
+  return static_cast<int64_t>(capacity) * value_size +
+      BitUtil::Ceil(capacity, 64) * sizeof(uint64_t);
+}
+
+ColumnarBatch::ColumnarBatch(const TupleDescriptor* tuple_desc, int capacity,
+    MemTracker* mem_tracker)
+  : tuple_desc_(tuple_desc),
+    capacity_(capacity),
+    mem_tracker_(mem_tracker),
+    num_rows_(0),
+    allocated_bytes_(0) {
+  DCHECK_GT(capacity, 0);
+  for (SlotDescriptor* slot_desc: tuple_desc->slots()) {
+    columns_.push_back(new ColumnVector(slot_desc, capacity));
+    allocated_bytes_ += ColumnVector::AllocatedBytes(slot_desc->slot_size(), capacity);
+  }
+  mem_tracker_->Consume(allocated_bytes_);
+}
+
+ColumnarBatch::~ColumnarBatch() {
+  for (ColumnVector* column: columns_) delete column;
+  mem_tracker_->Release(allocated_bytes_);
+}
+
+void ColumnarBatch::FromRowBatch(RowBatch* src, int tuple_idx) {
+  DCHECK(src->row_desc().tuple_descriptors()[tuple_idx] == tuple_desc_);
+  const int* selection = src->has_selection() ? src->selection() : NULL;
+  num_rows_ = selection != NULL ? src->num_selected() : src->num_rows();
+  DCHECK_LE(num_rows_, capacity_);
+  for (ColumnVector* column: columns_) {
+    const SlotDescriptor* slot_desc = column->slot_desc();
+    const NullIndicatorOffset& null_offset = slot_desc->null_indicator_offset();
+    int slot_offset = slot_desc->tuple_offset();
+    int value_size = column->value_size();
+    for (int i = 0; i < num_rows_; ++i) {
+      int row_idx = selection != NULL ? selection[i] : i;
+      Tuple* tuple = src->GetRow(row_idx)->GetTuple(tuple_idx);
+      bool is_null = tuple == NULL || tuple->IsNull(null_offset);
+      column->SetNull(i, is_null);
+      if (is_null) {
+        // Keep the values defined, so that vectorized predicates read valid data.
+        memset(column->value(i), 0, value_size);
+      } else {
+        memcpy(column->value(i), tuple->GetSlot(slot_offset), value_size);
+      }
+    }
+  }
+}
+
+void ColumnarBatch::ToRowBatch(RowBatch* dst, int tuple_idx) const {
+  ToRowBatch(dst, tuple_idx, NULL, num_rows_);
+}
+
+void ColumnarBatch::ToRowBatch(RowBatch* dst, int tuple_idx, const int* selection,
+    int num_selected) const {
+  DCHECK(dst->row_desc().tuple_descriptors()[tuple_idx] == tuple_desc_);
+  DCHECK_LE(num_selected, num_rows_);
+  if (num_selected == 0) return;
+  int num_tuples_per_row = dst->row_desc().tuple_descriptors().size();
+  int tuple_size = tuple_desc_->byte_size();
+  // Zeroing the tuples clears their null indicators.
+  uint8_t* tuple_mem = dst->tuple_data_pool()->Allocate(num_selected * tuple_size);
+  memset(tuple_mem, 0, num_selected * tuple_size);
+
+  int first_row_idx = dst->AddRows(num_selected);
+  for (int i = 0; i < num_selected; ++i) {
+    TupleRow* row = dst->GetRow(first_row_idx + i);
+    for (int j = 0; j < num_tuples_per_row; ++j) row->SetTuple(j, NULL);
+    row->SetTuple(tuple_idx, reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size));
+  }
+  for (ColumnVector* column: columns_) {
+    const SlotDescriptor* slot_desc = column->slot_desc();
+    const NullIndicatorOffset& null_offset = slot_desc->null_indicator_offset();
+    int slot_offset = slot_desc->tuple_offset();
+    int value_size = column->value_size();
+    for (int i = 0; i < num_selected; ++i) {
+      int row_idx = selection != NULL ? selection[i] : i;
+      Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size);
+      if (column->IsNull(row_idx)) {
+        tuple->SetNull(null_offset);
+      } else {
+        memcpy(tuple->GetSlot(slot_offset), column->value(row_idx), value_size);
+      }
+    }
+  }
+  dst->CommitRows(num_selected);
+}
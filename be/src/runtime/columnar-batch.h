@@ -0,0 +1,199 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_COLUMNAR_BATCH_H
+#define IMPALA_RUNTIME_COLUMNAR_BATCH_H
+
+#include <functional>
+#include <vector>
+#include <boost/scoped_array.hpp>
+
+#include "common/logging.h"
+#include "gutil/macros.h"
+
+namespace impala {
+
+class MemTracker;
+class RowBatch;
+class SlotDescriptor;
+class TupleDescriptor;
+
+/// The values of one slot for all rows of a ColumnarBatch, stored contiguously with
+/// the in-memory layout of the slot, together with a bitmap of the NULL values. A string
+/// or collection value references its data like the slot does, without owning it.
+class ColumnVector {
+ public:
+  /// Comparison operators of the predicates evaluated by Select().
+  enum CompareOp {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+  };
+
+  ColumnVector(const SlotDescriptor* slot_desc, int capacity);
+
+  const SlotDescriptor* slot_desc() const { return slot_desc_; }
+
+  /// The number of bytes of each value.
+  int value_size() const { return value_size_; }
+
+  /// Returns the values as an array of 'T', which must have the size of the slot.
+  template <typename T>
+  T* values() {
+    DCHECK_EQ(sizeof(T), value_size_);
+    return reinterpret_cast<T*>(data_.get());
+  }
+
+  template <typename T>
+  const T* values() const {
+    DCHECK_EQ(sizeof(T), value_size_);
+    return reinterpret_cast<const T*>(data_.get());
+  }
+
+  /// Returns a pointer to the value of row 'row_idx'.
+  uint8_t* value(int row_idx) { return data_.get() + row_idx * value_size_; }
+
+  bool IsNull(int row_idx) const {
+    return (null_bitmap_[row_idx >> 6] >> (row_idx & 63)) & 1;
+  }
+
+  void SetNull(int row_idx, bool is_null) {
+    uint64_t mask = 1ULL << (row_idx & 63);
+    if (is_null) {
+      null_bitmap_[row_idx >> 6] |= mask;
+    } else {
+      null_bitmap_[row_idx >> 6] &= ~mask;
+    }
+  }
+
+  /// Vectorized evaluation of '<value> op constant' for the first 'num_rows' rows. Writes
+  /// the indices of the rows for which it is true in increasing order to 'selection',
+  /// which must have room for 'num_rows' indices, and returns their number. NULL values
+  /// never pass. 'T' must be the native type of the slot, e.g. int32_t for INT.
+  template <typename T>
+  int Select(CompareOp op, T constant, int num_rows, int* selection) const;
+
+  /// Returns the number of bytes allocated for a vector of 'capacity' rows of a slot
+  /// with 'value_size' bytes.
+  static int64_t AllocatedBytes(int value_size, int capacity);
+
+ private:
+  template <typename T, typename Compare>
+  int SelectInternal(T constant, int num_rows, int* selection) const;
+
+  const SlotDescriptor* const slot_desc_;
+  const int value_size_;
+  boost::scoped_array<uint8_t> data_;
+
+  /// Bit i is set if the value of row i is NULL.
+  boost::scoped_array<uint64_t> null_bitmap_;
+
+  DISALLOW_COPY_AND_ASSIGN(ColumnVector);
+};
+
+/// A batch of rows of one tuple in column-oriented form: one ColumnVector for each slot
+/// of the tuple. This lets expressions be evaluated with tight loops over the values of
+/// a slot, which the compiler can vectorize, instead of one row at a time through the
+/// TupleRow pointers of a RowBatch.
+///
+/// FromRowBatch() and ToRowBatch() convert to and from RowBatches, so that operators can
+/// be migrated to columnar batches one at a time. The conversions copy the fixed-size
+/// values only: string and collection values keep referencing the memory of the source
+/// batch, which must stay valid for as long as the values are used.
+///
+/// The memory of the columns is counted against 'mem_tracker'.
+class ColumnarBatch {
+ public:
+  ColumnarBatch(const TupleDescriptor* tuple_desc, int capacity, MemTracker* mem_tracker);
+  ~ColumnarBatch();
+
+  const TupleDescriptor* tuple_desc() const { return tuple_desc_; }
+  int capacity() const { return capacity_; }
+  int num_rows() const { return num_rows_; }
+  void set_num_rows(int num_rows) {
+    DCHECK_LE(num_rows, capacity_);
+    num_rows_ = num_rows;
+  }
+
+  /// The columns are in the order of tuple_desc()->slots().
+  int num_columns() const { return columns_.size(); }
+  ColumnVector* column(int i) { return columns_[i]; }
+
+  /// Replaces the rows of this batch with tuple 'tuple_idx' of the rows of 'src', or of
+  /// its selected rows if it has a selection. All slots of a NULL tuple are NULL.
+  void FromRowBatch(RowBatch* src, int tuple_idx);
+
+  /// Appends a row to 'dst' for each row of this batch, with tuple 'tuple_idx' built from
+  /// the columns and all other tuples NULL. The tuples are allocated from the pool of
+  /// 'dst', which must have room for all rows.
+  void ToRowBatch(RowBatch* dst, int tuple_idx) const;
+
+  /// Same as above, but only appends the 'num_selected' rows whose indices are in
+  /// 'selection', e.g. the result of ColumnVector::Select().
+  void ToRowBatch(RowBatch* dst, int tuple_idx, const int* selection,
+      int num_selected) const;
+
+ private:
+  const TupleDescriptor* const tuple_desc_;
+  const int capacity_;
+  MemTracker* const mem_tracker_;
+  int num_rows_;
+  std::vector<ColumnVector*> columns_;
+
+  /// The number of bytes consumed from mem_tracker_.
+  int64_t allocated_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(ColumnarBatch);
+};
+
+template <typename T, typename Compare>
+int ColumnVector::SelectInternal(T constant, int num_rows, int* selection) const {
+  const T* vals = values<T>();
+  Compare compare;
+  // First evaluate the comparison for all values into 'selection', which vectorizes,
+  // then compact the indices of the passing non-NULL rows in place. The compaction only
+  // writes index 'num_selected' <= i after reading index i.
+  for (int i = 0; i < num_rows; ++i) selection[i] = compare(vals[i], constant);
+  int num_selected = 0;
+  for (int i = 0; i < num_rows; ++i) {
+    int pass = selection[i] & !IsNull(i);
+    selection[num_selected] = i;
+    num_selected += pass;
+  }
+  return num_selected;
+}
+
+template <typename T>
+int ColumnVector::Select(CompareOp op, T constant, int num_rows, int* selection) const {
+  switch (op) {
+    case EQ: return SelectInternal<T, std::equal_to<T> >(constant, num_rows, selection);
+    case NE:
+      return SelectInternal<T, std::not_equal_to<T> >(constant, num_rows, selection);
+    case LT: return SelectInternal<T, std::less<T> >(constant, num_rows, selection);
+    case LE: return SelectInternal<T, std::less_equal<T> >(constant, num_rows, selection);
+    case GT: return SelectInternal<T, std::greater<T> >(constant, num_rows, selection);
+    case GE:
+      return SelectInternal<T, std::greater_equal<T> >(constant, num_rows, selection);
+  }
+  DCHECK(false);
+  return 0;
+}
+
+}
+
+#endif
@@ -29,6 +29,7 @@
 #include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string.hpp>
@@ -46,6 +47,7 @@
 #include "runtime/plan-fragment-executor.h"
 #include "runtime/row-batch.h"
 #include "runtime/backend-client.h"
+#include "runtime/buffered-tuple-stream.h"
 #include "runtime/parallel-executor.h"
 #include "scheduling/scheduler.h"
 #include "exec/data-sink.h"
@@ -62,6 +64,7 @@
 #include "util/pretty-printer.h"
 #include "util/summary-util.h"
 #include "util/table-printer.h"
+#include "util/thread.h"
 #include "gen-cpp/ImpalaInternalService.h"
 #include "gen-cpp/ImpalaInternalService_types.h"
 #include "gen-cpp/Frontend_types.h"
@@ -87,12 +90,54 @@ DECLARE_string(hostname);
 
 DEFINE_bool(insert_inherit_permissions, false, "If true, new directories created by "
     "INSERTs will inherit the permissions of their parent directories");
+DEFINE_bool(batch_fragment_starts_per_host, false, "(Advanced) If true, the "
+    "coordinator starts the fragment instances of a host one after the other from a "
+    "single thread and connection, instead of issuing one parallel rpc per instance.");
+DEFINE_bool(spool_query_results, false, "(Advanced) If true, the coordinator writes the "
+    "results of queries into a buffer that spills to disk if needed, so that all "
+    "fragments can finish and release their resources before the client fetched all "
+    "rows.");
+DEFINE_int64(max_spooled_result_bytes, 1L * 1024 * 1024 * 1024, "(Advanced) The "
+    "approximate maximum number of bytes of spooled results that the client didn't "
+    "fetch yet. Once reached, the query's fragments wait for the client to fetch more "
+    "rows. Only used with --spool_query_results.");
+DEFINE_int64(single_node_fast_path_max_scan_bytes, 0, "(Advanced) Queries that only "
+    "run on the coordinator and whose HDFS scan ranges add up to fewer bytes than this "
+    "are executed with less bookkeeping: their fragment doesn't sample its thread and "
+    "memory usage, their results are neither prefetched nor spooled and the client's "
+    "execute call waits for the first rows instead of a separate thread. If 0, all "
+    "queries are executed in the same way.");
 
 namespace impala {
 
+// Returns true if the coordinator fragment with 'params' scans few enough bytes for the
+// single node fast path.
+static bool IsFastPathFragment(const TPlanFragmentExecParams& params) {
+  int64_t scan_bytes = 0;
+  for (const auto& entry: params.per_node_scan_ranges) {
+    for (const TScanRangeParams& scan_range: entry.second) {
+      // The size of non-HDFS scan ranges, e.g. of HBase tables, is not known.
+      if (!scan_range.scan_range.__isset.hdfs_file_split) return false;
+      scan_bytes += scan_range.scan_range.hdfs_file_split.length;
+    }
+  }
+  return scan_bytes < FLAGS_single_node_fast_path_max_scan_bytes;
+}
+
 // Maximum number of fragment instances that can publish each broadcast filter.
 static const int MAX_BROADCAST_FILTER_PRODUCERS = 3;
 
+// Completion times above this are recorded as this in the completion time histograms.
+static const int64_t MAX_TRACKED_COMPLETION_TIME_MS = 30L * 24 * 60 * 60 * 1000;
+
+// A fragment instance is reported as an outlier if it took more than this many times
+// the median completion time of its fragment, and at least
+// MIN_OUTLIER_COMPLETION_TIME_MS. At most MAX_REPORTED_OUTLIERS are reported per
+// fragment.
+static const double OUTLIER_COMPLETION_TIME_FACTOR = 2.0;
+static const int64_t MIN_OUTLIER_COMPLETION_TIME_MS = 1000;
+static const int MAX_REPORTED_OUTLIERS = 5;
+
 // container for debug options in TPlanFragmentExecParams (debug_node, debug_action,
 // debug_phase)
 struct DebugOptions {
@@ -310,17 +355,34 @@ Coordinator::Coordinator(const TQueryOptions& query_options, ExecEnv* exec_env,
     RuntimeProfile::EventSequence* events)
   : exec_env_(exec_env),
     has_called_wait_(false),
+    is_fast_path_(false),
     returned_all_results_(false),
     executor_(NULL), // Set in Prepare()
     query_mem_tracker_(), // Set in Exec()
     num_remaining_fragment_instances_(0),
     obj_pool_(new ObjectPool()),
+    max_per_host_peak_mem_(-1),
+    spool_client_(NULL),
+    spool_done_(false),
+    spool_cancelled_(false),
     query_events_(events),
     filter_routing_table_complete_(false),
     filter_mode_(query_options.runtime_filter_mode) {
 }
 
 Coordinator::~Coordinator() {
+  if (spool_thread_.get() != NULL) {
+    // The coordinator fragment was done or cancelled, Cancel() also stops the wait for
+    // the client.
+    {
+      lock_guard<mutex> l(spool_lock_);
+      spool_cancelled_ = true;
+    }
+    spool_cv_.notify_all();
+    spool_thread_->Join();
+    lock_guard<mutex> l(spool_lock_);
+    CloseSpoolStream();
+  }
   query_mem_tracker_.reset();
 }
 
@@ -391,6 +453,11 @@ Status Coordinator::Exec(QuerySchedule& schedule,
       new RuntimeProfile(obj_pool(), "Execution Profile " + PrintId(query_id_)));
   finalization_timer_ = ADD_TIMER(query_profile_, "FinalizationTimer");
   filter_updates_received_ = ADD_COUNTER(query_profile_, "FiltersReceived", TUnit::UNIT);
+  start_fragments_timer_ = ADD_TIMER(query_profile_, "StartRemoteFragmentsTime");
+  set_exec_params_timer_ = ADD_CHILD_TIMER(query_profile_, "SetExecParamsTime",
+      "StartRemoteFragmentsTime");
+  exec_rpc_timer_ = ADD_CHILD_TIMER(query_profile_, "ExecRpcTime",
+      "StartRemoteFragmentsTime");
 
   SCOPED_TIMER(query_profile_->total_time_counter());
 
@@ -412,8 +479,6 @@ Status Coordinator::Exec(QuerySchedule& schedule,
       request.fragments[0].partition.type == TPartitionType::UNPARTITIONED;
 
   if (has_coordinator_fragment) {
-    executor_.reset(new PlanFragmentExecutor(
-            exec_env_, PlanFragmentExecutor::ReportStatusCallback()));
     // If a coordinator fragment is requested (for most queries this will be the case, the
     // exception is parallel INSERT queries), start this before starting any more plan
     // fragments, otherwise they start sending data before the local exchange node had a
@@ -427,6 +492,11 @@ Status Coordinator::Exec(QuerySchedule& schedule,
     TExecPlanFragmentParams rpc_params;
     SetExecPlanFragmentParams(schedule, request.fragments[0],
         (*schedule.exec_params())[0], 0, 0, 0, coord, &rpc_params);
+    is_fast_path_ = FLAGS_single_node_fast_path_max_scan_bytes > 0 &&
+        stmt_type_ == TStmtType::QUERY && schedule.num_fragment_instances() == 0 &&
+        IsFastPathFragment(rpc_params.params);
+    executor_.reset(new PlanFragmentExecutor(
+        exec_env_, PlanFragmentExecutor::ReportStatusCallback(), !is_fast_path_));
     RETURN_IF_ERROR(executor_->Prepare(rpc_params));
 
     // Prepare output_expr_ctxs before optimizing the LLVM module. The other exprs of this
@@ -535,7 +605,13 @@ void Coordinator::UpdateFilterRoutingTable(const vector<TPlanNode>& plan_nodes,
   }
 }
 
+// Runs the rpc wrappers of the fragment instances of one host in order.
+static void RunSequentially(const vector<function<void ()> >& fns) {
+  for (const function<void ()>& fn: fns) fn();
+}
+
 Status Coordinator::StartRemoteFragments(QuerySchedule* schedule) {
+  SCOPED_TIMER(start_fragments_timer_);
   int32_t num_fragment_instances = schedule->num_fragment_instances();
   DCHECK_GT(num_fragment_instances , 0);
   DebugOptions debug_options;
@@ -555,6 +631,8 @@ Status Coordinator::StartRemoteFragments(QuerySchedule* schedule) {
       request.fragments[0].partition.type == TPartitionType::UNPARTITIONED;
   int first_remote_fragment_idx = has_coordinator_fragment ? 1 : 0;
   if (filter_mode_ != TRuntimeFilterMode::OFF) {
+    SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "FilterRoutingTableTime",
+        "StartRemoteFragmentsTime"));
     // Populate the runtime filter routing table. This should happen before
     // starting the remote fragments.
     for (int fragment_idx = first_remote_fragment_idx;
@@ -570,34 +648,56 @@ Status Coordinator::StartRemoteFragments(QuerySchedule* schedule) {
   }
 
   fragment_instance_idx = 0;
-  // Start one fragment instance per fragment per host (number of hosts running each
-  // fragment may not be constant).
-  for (int fragment_idx = first_remote_fragment_idx;
-       fragment_idx < request.fragments.size(); ++fragment_idx) {
-    const FragmentExecParams* params = &(*schedule->exec_params())[fragment_idx];
-    int num_hosts = params->hosts.size();
-    DCHECK_GT(num_hosts, 0);
-    fragment_profiles_[fragment_idx].num_instances = num_hosts;
-    // Start one fragment instance for every fragment_instance required by the
-    // schedule. Each fragment instance is assigned a unique ID, numbered from 0, with
-    // instances for fragment ID 0 being assigned IDs [0 .. num_hosts(fragment_id_0)] and
-    // so on.
-    for (int per_fragment_instance_idx = 0; per_fragment_instance_idx < num_hosts;
-         ++per_fragment_instance_idx) {
-      DebugOptions* fragment_instance_debug_options =
-          debug_options.IsApplicable(fragment_instance_idx) ? &debug_options : NULL;
+  // The rpc wrappers of each host if --batch_fragment_starts_per_host is set.
+  typedef unordered_map<TNetworkAddress, vector<function<void ()> > > HostRpcMap;
+  HostRpcMap host_rpcs;
+  {
+    SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "RpcDispatchTime",
+        "StartRemoteFragmentsTime"));
+    // Start one fragment instance per fragment per host (number of hosts running each
+    // fragment may not be constant).
+    for (int fragment_idx = first_remote_fragment_idx;
+         fragment_idx < request.fragments.size(); ++fragment_idx) {
+      const FragmentExecParams* params = &(*schedule->exec_params())[fragment_idx];
+      int num_hosts = params->hosts.size();
+      DCHECK_GT(num_hosts, 0);
+      fragment_profiles_[fragment_idx].num_instances = num_hosts;
+      // Start one fragment instance for every fragment_instance required by the
+      // schedule. Each fragment instance is assigned a unique ID, numbered from 0, with
+      // instances for fragment ID 0 being assigned IDs [0 .. num_hosts(fragment_id_0)]
+      // and so on.
+      for (int per_fragment_instance_idx = 0; per_fragment_instance_idx < num_hosts;
+           ++per_fragment_instance_idx) {
+        DebugOptions* fragment_instance_debug_options =
+            debug_options.IsApplicable(fragment_instance_idx) ? &debug_options : NULL;
+        function<void ()> rpc =
+            bind<void>(mem_fn(&Coordinator::ExecRemoteFragment), this,
+                params, // fragment_exec_params
+                &request.fragments[fragment_idx], // plan_fragment,
+                fragment_instance_debug_options,
+                schedule,
+                fragment_instance_idx++,
+                fragment_idx,
+                per_fragment_instance_idx);
+        if (FLAGS_batch_fragment_starts_per_host) {
+          host_rpcs[params->hosts[per_fragment_instance_idx]].push_back(rpc);
+        } else {
+          exec_env_->fragment_exec_thread_pool()->Offer(rpc);
+        }
+      }
+    }
+    // The instances of a host are started in fragment order, so that the receivers of
+    // a host are usually registered before its senders start.
+    for (const HostRpcMap::value_type& rpcs: host_rpcs) {
       exec_env_->fragment_exec_thread_pool()->Offer(
-          bind<void>(mem_fn(&Coordinator::ExecRemoteFragment), this,
-              params, // fragment_exec_params
-              &request.fragments[fragment_idx], // plan_fragment,
-              fragment_instance_debug_options,
-              schedule,
-              fragment_instance_idx++,
-              fragment_idx,
-              per_fragment_instance_idx));
+          bind<void>(&RunSequentially, rpcs.second));
     }
   }
-  exec_complete_barrier_->Wait();
+  {
+    SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "RpcWaitTime",
+        "StartRemoteFragmentsTime"));
+    exec_complete_barrier_->Wait();
+  }
   query_events_->MarkEvent(
       Substitute("All $0 remote fragments started", fragment_instance_idx));
 
@@ -722,15 +822,18 @@ Status Coordinator::UpdateStatus(const Status& status, const TUniqueId& instance
   return query_status_;
 }
 
-void Coordinator::PopulatePathPermissionCache(hdfsFS fs, const string& path_str,
-    PermissionCache* permissions_cache) {
+// Returns all prefixes (including the complete path) of 'path_str' without its
+// hdfs:// -style prefix, so /a/b/c/d leads to a vector of: /a, /a/b, /a/b/c, /a/b/c/d.
+// These are the keys of a Coordinator::PermissionCache.
+static void GetPathPrefixes(const string& path_str, vector<string>* prefixes) {
   // Find out if the path begins with a hdfs:// -style prefix, and remove it and the
   // location (e.g. host:port) if so.
   int scheme_end = path_str.find("://");
   string stripped_str;
   if (scheme_end != string::npos) {
     // Skip past the subsequent location:port/ prefix.
-    stripped_str = path_str.substr(path_str.find("/", scheme_end + 3));
+    size_t location_end = path_str.find("/", scheme_end + 3);
+    if (location_end != string::npos) stripped_str = path_str.substr(location_end);
   } else {
     stripped_str = path_str;
   }
@@ -739,16 +842,19 @@ void Coordinator::PopulatePathPermissionCache(hdfsFS fs, const string& path_str,
   vector<string> components;
   split(components, stripped_str, is_any_of("/"));
 
-  // Build a set of all prefixes (including the complete string) of stripped_path. So
-  // /a/b/c/d leads to a vector of: /a, /a/b, /a/b/c, /a/b/c/d
-  vector<string> prefixes;
   // Stores the current prefix
   stringstream accumulator;
   for (const string& component: components) {
     if (component.empty()) continue;
     accumulator << "/" << component;
-    prefixes.push_back(accumulator.str());
+    prefixes->push_back(accumulator.str());
   }
+}
+
+void Coordinator::PopulatePathPermissionCache(hdfsFS fs, const string& path_str,
+    PermissionCache* permissions_cache) {
+  vector<string> prefixes;
+  GetPathPrefixes(path_str, &prefixes);
 
   // Now for each prefix, stat() it to see if a) it exists and b) if so what its
   // permissions are. When we meet a directory that doesn't exist, we record the fact that
@@ -783,6 +889,138 @@ void Coordinator::PopulatePathPermissionCache(hdfsFS fs, const string& path_str,
   }
 }
 
+// Partition directories grouped by their parent directory, together with the connection
+// to their filesystem.
+typedef map<string, pair<hdfsFS, vector<string> > > DirectoriesByParent;
+
+// Adds 'dir' to the children of its parent directory in 'dirs'.
+static void AddToParentDirectory(hdfsFS fs, const string& dir,
+    DirectoriesByParent* dirs) {
+  string trimmed_dir = dir;
+  while (trimmed_dir.size() > 1 && trimmed_dir[trimmed_dir.size() - 1] == '/') {
+    trimmed_dir.resize(trimmed_dir.size() - 1);
+  }
+  size_t last_slash = trimmed_dir.rfind('/');
+  string parent = last_slash == string::npos ? "" : trimmed_dir.substr(0, last_slash);
+  pair<hdfsFS, vector<string> >& children = (*dirs)[parent];
+  children.first = fs;
+  children.second.push_back(dir);
+}
+
+void Coordinator::PopulateChildPermissionCache(hdfsFS fs, const string& dir,
+    const vector<string>& children, PermissionCache* permissions_cache) {
+  vector<string> dir_prefixes;
+  GetPathPrefixes(dir, &dir_prefixes);
+  if (dir_prefixes.empty()) {
+    for (const string& child: children) {
+      PopulatePathPermissionCache(fs, child, permissions_cache);
+    }
+    return;
+  }
+  PopulatePathPermissionCache(fs, dir, permissions_cache);
+  // If 'dir' doesn't exist, these are the permissions that it and its children inherit.
+  pair<bool, short> dir_permissions = (*permissions_cache)[dir_prefixes.back()];
+
+  // Maps the names of the existing children of 'dir' to their permissions.
+  unordered_map<string, short> existing_children;
+  if (!dir_permissions.first) {
+    int num_files = 0;
+    // hfdsListDirectory() only sets errno if there is an error, see
+    // FinalizeSuccessfulInsert().
+    errno = 0;
+    hdfsFileInfo* files = hdfsListDirectory(fs, dir.c_str(), &num_files);
+    if (files == NULL && errno != 0) {
+      // Fall back to looking up each child.
+      for (const string& child: children) {
+        PopulatePathPermissionCache(fs, child, permissions_cache);
+      }
+      return;
+    }
+    for (int i = 0; i < num_files; ++i) {
+      existing_children[path(files[i].mName).filename().string()] =
+          files[i].mPermissions;
+    }
+    hdfsFreeFileInfo(files, num_files);
+  }
+
+  for (const string& child: children) {
+    vector<string> prefixes;
+    GetPathPrefixes(child, &prefixes);
+    DCHECK_EQ(prefixes.size(), dir_prefixes.size() + 1) << child;
+    const string& key = prefixes.back();
+    if (permissions_cache->find(key) != permissions_cache->end()) continue;
+    unordered_map<string, short>::const_iterator it =
+        existing_children.find(key.substr(key.rfind('/') + 1));
+    if (it != existing_children.end()) {
+      permissions_cache->insert(make_pair(key, make_pair(false, it->second)));
+    } else {
+      permissions_cache->insert(
+          make_pair(key, make_pair(true, dir_permissions.second)));
+    }
+  }
+}
+
+Status Coordinator::AddDeleteDirContentsOps(hdfsFS fs, const string& dir,
+    bool files_only, bool allow_missing, const unordered_set<string>& files_to_keep,
+    HdfsOperationSet* delete_ops) {
+  int num_files = 0;
+  // hfdsListDirectory() only sets errno if there is an error, but it doesn't set
+  // it to 0 if the call succeed. When there is no error, errno could be any
+  // value. So need to clear errno before calling it.
+  // Once HDFS-8407 is fixed, the errno reset won't be needed.
+  errno = 0;
+  hdfsFileInfo* existing_files = hdfsListDirectory(fs, dir.c_str(), &num_files);
+  if (existing_files == NULL && errno == EAGAIN) {
+    errno = 0;
+    existing_files = hdfsListDirectory(fs, dir.c_str(), &num_files);
+  }
+  // hdfsListDirectory() returns NULL not only when there is an error but also
+  // when the directory is empty(HDFS-8407). Need to check errno to make sure
+  // the call fails.
+  if (existing_files == NULL && errno != 0) {
+    if (allow_missing && errno == ENOENT) return Status::OK();
+    return GetHdfsErrorMsg("Could not list directory: ", dir);
+  }
+  for (int i = 0; i < num_files; ++i) {
+    const string filename = path(existing_files[i].mName).filename().string();
+    if (files_only && existing_files[i].mKind != kObjectKindFile) continue;
+    if (IsHiddenFile(filename) || files_to_keep.find(filename) != files_to_keep.end()) {
+      continue;
+    }
+    delete_ops->Add(DELETE, existing_files[i].mName);
+  }
+  hdfsFreeFileInfo(existing_files, num_files);
+  return Status::OK();
+}
+
+void Coordinator::DeleteDirectlyWrittenFiles() {
+  HdfsFsCache::HdfsFsMap filesystem_connection_cache;
+  HdfsOperationSet delete_ops(&filesystem_connection_cache);
+  for (const FileMoveMap::value_type& move: files_to_move_) {
+    if (move.first == move.second) delete_ops.Add(DELETE, move.first);
+  }
+  if (delete_ops.num_ops() == 0) return;
+  VLOG_QUERY << "Deleting " << delete_ops.num_ops() << " files written by query "
+             << query_id_;
+  if (!delete_ops.Execute(exec_env_->hdfs_op_thread_pool(), false)) {
+    LOG(WARNING) << "Error(s) deleting files written by failed query " << query_id_
+                 << ". First error (of " << delete_ops.errors().size() << ") was: "
+                 << delete_ops.errors()[0].second;
+  }
+}
+
+void Coordinator::ReportHdfsOpTimes(HdfsOperationSet* op_set) {
+  for (int i = 0; i < NUM_HDFS_OP_TYPES; ++i) {
+    HdfsOpType op = static_cast<HdfsOpType>(i);
+    int64_t time_ns = op_set->op_time_ns(op);
+    if (time_ns == 0) continue;
+    // Summed over all HDFS worker threads, so this may exceed the finalization time.
+    RuntimeProfile::Counter* op_timer = ADD_CHILD_TIMER(query_profile_,
+        Substitute("Hdfs$0Time", HdfsOpTypeToString(op)), "FinalizationTimer");
+    COUNTER_ADD(op_timer, time_ns);
+  }
+}
+
 Status Coordinator::FinalizeSuccessfulInsert() {
   PermissionCache permissions_cache;
   HdfsFsCache::HdfsFsMap filesystem_connection_cache;
@@ -793,13 +1031,29 @@ Status Coordinator::FinalizeSuccessfulInsert() {
   // 2. Create all the necessary partition directories.
   DescriptorTbl* descriptor_table;
   DescriptorTbl::Create(obj_pool(), desc_tbl_, &descriptor_table);
+
+  // The names of the files that the sinks wrote directly to their final location. File
+  // names are unique per fragment instance, so the names identify the files.
+  unordered_set<string> directly_written_files;
+  for (const FileMoveMap::value_type& move: files_to_move_) {
+    if (move.first == move.second) {
+      directly_written_files.insert(path(move.first).filename().string());
+    }
+  }
   HdfsTableDescriptor* hdfs_table = static_cast<HdfsTableDescriptor*>(
       descriptor_table->GetTableDescriptor(finalize_params_.table_id));
   DCHECK(hdfs_table != NULL) << "INSERT target table not known in descriptor table: "
                              << finalize_params_.table_id;
 
+  // The partition directories whose permissions are looked up if
+  // FLAGS_insert_inherit_permissions is true, grouped by their parent directory, so that
+  // each parent is listed once instead of calling hdfsGetPathInfo() on every partition.
+  DirectoriesByParent inherit_permissions_dirs;
+
   // Loop over all partitions that were updated by this insert, and create the set of
   // filesystem operations required to create the correct partition structure on disk.
+  // This loop doesn't call HDFS for each partition, since the operations run in
+  // parallel on the HDFS worker pool.
   for (const PartitionStatusMap::value_type& partition: per_partition_status_) {
     SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "Overwrite/PartitionCreationTimer",
           "FinalizationTimer"));
@@ -827,6 +1081,10 @@ Status Coordinator::FinalizeSuccessfulInsert() {
     }
     const string& part_path = part_path_ss.str();
     bool is_s3_path = IsS3APath(part_path.c_str());
+    // There is no directory structure in S3, so "inheriting" permissions is not
+    // possible.
+    // TODO: Try to mimic inheriting permissions for S3.
+    bool inherit_permissions = FLAGS_insert_inherit_permissions && !is_s3_path;
 
     // If this is an overwrite insert, we will need to delete any updated partitions
     if (finalize_params_.is_overwrite) {
@@ -838,72 +1096,56 @@ Status Coordinator::FinalizeSuccessfulInsert() {
         // So only delete files in the table directory - all files are treated as data
         // files by Hive and Impala, but directories are ignored (and may legitimately
         // be used to store permanent non-table data by other applications).
-        int num_files = 0;
-        // hfdsListDirectory() only sets errno if there is an error, but it doesn't set
-        // it to 0 if the call succeed. When there is no error, errno could be any
-        // value. So need to clear errno before calling it.
-        // Once HDFS-8407 is fixed, the errno reset won't be needed.
-        errno = 0;
-        hdfsFileInfo* existing_files =
-            hdfsListDirectory(partition_fs_connection, part_path.c_str(), &num_files);
-        if (existing_files == NULL && errno == EAGAIN) {
-          errno = 0;
-          existing_files =
-              hdfsListDirectory(partition_fs_connection, part_path.c_str(), &num_files);
-        }
-        // hdfsListDirectory() returns NULL not only when there is an error but also
-        // when the directory is empty(HDFS-8407). Need to check errno to make sure
-        // the call fails.
-        if (existing_files == NULL && errno != 0) {
-          return GetHdfsErrorMsg("Could not list directory: ", part_path);
-        }
-        for (int i = 0; i < num_files; ++i) {
-          const string filename = path(existing_files[i].mName).filename().string();
-          if (existing_files[i].mKind == kObjectKindFile && !IsHiddenFile(filename)) {
-            partition_create_ops.Add(DELETE, existing_files[i].mName);
-          }
-        }
-        hdfsFreeFileInfo(existing_files, num_files);
+        RETURN_IF_ERROR(AddDeleteDirContentsOps(partition_fs_connection, part_path,
+            true, false, directly_written_files, &partition_create_ops));
+      } else if (is_s3_path && query_ctx_.request.query_options.s3_skip_insert_staging) {
+        // The sinks wrote the new files to this partition directly, so only the files
+        // that existed before the insert are deleted.
+        RETURN_IF_ERROR(AddDeleteDirContentsOps(partition_fs_connection, part_path,
+            false, true, directly_written_files, &partition_create_ops));
       } else {
         // This is a partition directory, not the root directory; we can delete
-        // recursively with abandon, after checking that it ever existed.
+        // recursively with abandon. DELETE_THEN_CREATE checks that it ever existed.
         // TODO: There's a potential race here between checking for the directory
         // and a third-party deleting it.
-        if (FLAGS_insert_inherit_permissions && !is_s3_path) {
-          // There is no directory structure in S3, so "inheriting" permissions is not
-          // possible.
-          // TODO: Try to mimic inheriting permissions for S3.
-          PopulatePathPermissionCache(
-              partition_fs_connection, part_path, &permissions_cache);
+        if (inherit_permissions) {
+          AddToParentDirectory(partition_fs_connection, part_path,
+              &inherit_permissions_dirs);
         }
         // S3 doesn't have a directory structure, so we technically wouldn't need to
         // CREATE_DIR on S3. However, libhdfs always checks if a path exists before
         // carrying out an operation on that path. So we still need to call CREATE_DIR
         // before we access that path due to this limitation.
-        if (hdfsExists(partition_fs_connection, part_path.c_str()) != -1) {
-          partition_create_ops.Add(DELETE_THEN_CREATE, part_path);
-        } else {
-          // Otherwise just create the directory.
-          partition_create_ops.Add(CREATE_DIR, part_path);
-        }
+        partition_create_ops.Add(DELETE_THEN_CREATE, part_path);
       }
     } else if (!is_s3_path || !query_ctx_.request.query_options.s3_skip_insert_staging) {
       // If the S3_SKIP_INSERT_STAGING query option is set, then the partition directories
       // would have already been created by the table sinks.
-      if (FLAGS_insert_inherit_permissions && !is_s3_path) {
-        PopulatePathPermissionCache(
-            partition_fs_connection, part_path, &permissions_cache);
-      }
-      if (hdfsExists(partition_fs_connection, part_path.c_str()) == -1) {
-        partition_create_ops.Add(CREATE_DIR, part_path);
+      if (inherit_permissions) {
+        AddToParentDirectory(partition_fs_connection, part_path,
+            &inherit_permissions_dirs);
       }
+      // Creating an existing directory succeeds, so this doesn't check for the
+      // directory first.
+      partition_create_ops.Add(CREATE_DIR, part_path);
+    }
+  }
+
+  {
+    SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "InheritPermissionsLookupTimer",
+          "FinalizationTimer"));
+    for (DirectoriesByParent::value_type& parent: inherit_permissions_dirs) {
+      PopulateChildPermissionCache(parent.second.first, parent.first,
+          parent.second.second, &permissions_cache);
     }
   }
 
   {
     SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "Overwrite/PartitionCreationTimer",
           "FinalizationTimer"));
-    if (!partition_create_ops.Execute(exec_env_->hdfs_op_thread_pool(), false)) {
+    bool success = partition_create_ops.Execute(exec_env_->hdfs_op_thread_pool(), false);
+    ReportHdfsOpTimes(&partition_create_ops);
+    if (!success) {
       for (const HdfsOperationSet::Error& err: partition_create_ops.errors()) {
         // It's ok to ignore errors creating the directories, since they may already
         // exist. If there are permission errors, we'll run into them later.
@@ -923,7 +1165,10 @@ Status Coordinator::FinalizeSuccessfulInsert() {
   for (FileMoveMap::value_type& move: files_to_move_) {
     // Empty destination means delete, so this is a directory. These get deleted in a
     // separate pass to ensure that we have moved all the contents of the directory first.
-    if (move.second.empty()) {
+    if (move.first == move.second) {
+      // Written directly to the final location.
+      continue;
+    } else if (move.second.empty()) {
       VLOG_ROW << "Deleting file: " << move.first;
       dir_deletion_ops.Add(DELETE, move.first);
     } else {
@@ -938,7 +1183,9 @@ Status Coordinator::FinalizeSuccessfulInsert() {
 
   {
     SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "FileMoveTimer", "FinalizationTimer"));
-    if (!move_ops.Execute(exec_env_->hdfs_op_thread_pool(), false)) {
+    bool success = move_ops.Execute(exec_env_->hdfs_op_thread_pool(), false);
+    ReportHdfsOpTimes(&move_ops);
+    if (!success) {
       stringstream ss;
       ss << "Error(s) moving partition files. First error (of "
          << move_ops.errors().size() << ") was: " << move_ops.errors()[0].second;
@@ -950,7 +1197,9 @@ Status Coordinator::FinalizeSuccessfulInsert() {
   {
     SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "FileDeletionTimer",
          "FinalizationTimer"));
-    if (!dir_deletion_ops.Execute(exec_env_->hdfs_op_thread_pool(), false)) {
+    bool success = dir_deletion_ops.Execute(exec_env_->hdfs_op_thread_pool(), false);
+    ReportHdfsOpTimes(&dir_deletion_ops);
+    if (!success) {
       stringstream ss;
       ss << "Error(s) deleting staging directories. First error (of "
          << dir_deletion_ops.errors().size() << ") was: "
@@ -972,7 +1221,11 @@ Status Coordinator::FinalizeSuccessfulInsert() {
         chmod_ops.Add(CHMOD, perm.first, permissions);
       }
     }
-    if (!chmod_ops.Execute(exec_env_->hdfs_op_thread_pool(), false)) {
+    SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "PermissionUpdateTimer",
+          "FinalizationTimer"));
+    bool success = chmod_ops.Execute(exec_env_->hdfs_op_thread_pool(), false);
+    ReportHdfsOpTimes(&chmod_ops);
+    if (!success) {
       stringstream ss;
       ss << "Error(s) setting permissions on newly created partition directories. First"
          << " error (of " << chmod_ops.errors().size() << ") was: "
@@ -996,6 +1249,8 @@ Status Coordinator::FinalizeQuery() {
   Status return_status = GetStatus();
   if (return_status.ok()) {
     return_status = FinalizeSuccessfulInsert();
+  } else {
+    DeleteDirectlyWrittenFiles();
   }
 
   stringstream staging_dir;
@@ -1052,6 +1307,12 @@ Status Coordinator::Wait() {
       // Because there are no other updates, safe to copy the maps rather than merge them.
       files_to_move_ = *state->hdfs_files_to_move();
       per_partition_status_ = *state->per_partition_status();
+
+      if (FLAGS_spool_query_results && stmt_type_ == TStmtType::QUERY &&
+          !is_fast_path_) {
+        return_status = UpdateStatus(StartResultSpooling(),
+            runtime_state()->fragment_instance_id(), FLAGS_hostname);
+      }
     }
   } else {
     // Query finalization can only happen when all backends have reported
@@ -1089,7 +1350,11 @@ Status Coordinator::GetNext(RowBatch** batch, RuntimeState* state) {
   VLOG_ROW << "GetNext() query_id=" << query_id_;
   DCHECK(has_called_wait_);
   SCOPED_TIMER(query_profile_->total_time_counter());
+  if (spool_thread_.get() != NULL) return GetNextSpooled(batch);
+  return GetNextFromExecutor(batch);
+}
 
+Status Coordinator::GetNextFromExecutor(RowBatch** batch) {
   if (executor_.get() == NULL) {
     // If there is no local fragment, we produce no output, and execution will
     // have finished after Wait.
@@ -1142,6 +1407,115 @@ Status Coordinator::GetNext(RowBatch** batch, RuntimeState* state) {
   return Status::OK();
 }
 
+Status Coordinator::StartResultSpooling() {
+  RuntimeState* state = runtime_state();
+  // The stream needs a read and a write buffer.
+  RETURN_IF_ERROR(state->block_mgr()->RegisterClient(
+      Substitute("Result spooling query_id=$0", PrintId(query_id_)), 2, false,
+      state->instance_mem_tracker(), state, &spool_client_));
+  spool_stream_.reset(new BufferedTupleStream(state, executor_->row_desc(),
+      state->block_mgr(), spool_client_, true, true));
+  RETURN_IF_ERROR(spool_stream_->Init(-1, executor_->profile(), false));
+  bool got_buffer;
+  RETURN_IF_ERROR(spool_stream_->PrepareForRead(true, &got_buffer));
+  if (!got_buffer) return state->block_mgr()->MemLimitTooLowError(spool_client_, -1);
+  spool_batch_.reset(new RowBatch(executor_->row_desc(), state->batch_size(),
+      state->instance_mem_tracker()));
+  spool_thread_.reset(new Thread("coordinator", "result-spooling",
+      &Coordinator::SpoolResults, this));
+  return Status::OK();
+}
+
+void Coordinator::SpoolResults() {
+  Status status;
+  while (true) {
+    RowBatch* batch;
+    status = GetNextFromExecutor(&batch);
+    if (!status.ok() || batch == NULL) break;
+    status = SpoolBatch(batch);
+    if (!status.ok()) {
+      status = UpdateStatus(status, runtime_state()->fragment_instance_id(),
+          FLAGS_hostname);
+      break;
+    }
+  }
+  // All rows were copied into the stream, so the fragment's resources can be released
+  // before the client fetched the rows.
+  if (status.ok()) executor_->Close();
+  {
+    lock_guard<mutex> l(spool_lock_);
+    spool_done_ = true;
+    spool_status_ = status;
+  }
+  spool_cv_.notify_all();
+}
+
+Status Coordinator::SpoolBatch(RowBatch* batch) {
+  unique_lock<mutex> l(spool_lock_);
+  while (!spool_cancelled_ && UnreadSpooledBytes() > FLAGS_max_spooled_result_bytes) {
+    spool_cv_.wait(l);
+  }
+  if (spool_cancelled_) return Status::CANCELLED;
+  Status status;
+  for (int i = 0; i < batch->num_rows(); ++i) {
+    TupleRow* row = batch->GetRow(i);
+    if (LIKELY(spool_stream_->AddRow(row, &status))) continue;
+    RETURN_IF_ERROR(status);
+    bool got_buffer = false;
+    if (spool_stream_->using_small_buffers()) {
+      RETURN_IF_ERROR(spool_stream_->SwitchToIoBuffers(&got_buffer));
+    }
+    if (!got_buffer || !spool_stream_->AddRow(row, &status)) {
+      RETURN_IF_ERROR(status);
+      return runtime_state()->block_mgr()->MemLimitTooLowError(spool_client_, -1);
+    }
+  }
+  spool_cv_.notify_all();
+  return Status::OK();
+}
+
+Status Coordinator::GetNextSpooled(RowBatch** batch) {
+  unique_lock<mutex> l(spool_lock_);
+  spool_batch_->Reset();
+  Status status;
+  while (true) {
+    if (spool_stream_.get() == NULL) break;
+    bool eos;
+    status = spool_stream_->GetNext(spool_batch_.get(), &eos);
+    if (!status.ok() || !eos) break;
+    if (spool_done_) {
+      status = spool_status_;
+      CloseSpoolStream();
+      break;
+    }
+    spool_cv_.wait(l);
+  }
+  l.unlock();
+  // The spooling thread may wait for the rows to be read.
+  spool_cv_.notify_all();
+  if (!status.ok()) {
+    return UpdateStatus(status, runtime_state()->fragment_instance_id(),
+        FLAGS_hostname);
+  }
+  *batch = spool_stream_.get() == NULL ? NULL : spool_batch_.get();
+  return Status::OK();
+}
+
+int64_t Coordinator::UnreadSpooledBytes() const {
+  int64_t num_rows = spool_stream_->num_rows();
+  if (num_rows == 0) return 0;
+  return spool_stream_->byte_size() * (num_rows - spool_stream_->rows_returned()) /
+      num_rows;
+}
+
+void Coordinator::CloseSpoolStream() {
+  if (spool_stream_.get() == NULL) return;
+  spool_stream_->Close();
+  spool_stream_.reset();
+  spool_batch_.reset();
+  runtime_state()->block_mgr()->ClearReservations(spool_client_);
+}
+
 void Coordinator::ValidateCollectionSlots(RowBatch* batch) {
   const RowDescriptor& row_desc = executor_->row_desc();
   if (!row_desc.HasVarlenSlots()) return;
@@ -1245,6 +1619,7 @@ void Coordinator::InitExecProfile(const TQueryExecRequest& request) {
   fragment_profiles_.resize(request.fragments.size());
   for (int i = 0; i < request.fragments.size(); ++i) {
     fragment_profiles_[i].num_instances = 0;
+    fragment_profiles_[i].completion_time_histogram = NULL;
 
     // Special case fragment idx 0 if there is a coordinator. There is only one
     // instance of this profile so the average is just the coordinator profile.
@@ -1272,6 +1647,8 @@ void Coordinator::InitExecProfile(const TQueryExecRequest& request) {
     // Note: we don't start the wall timer here for the fragment
     // profile; it's uninteresting and misleading.
     query_profile_->AddChild(fragment_profiles_[i].root_profile);
+    fragment_profiles_[i].completion_time_histogram =
+        obj_pool()->Add(new HdrHistogram(MAX_TRACKED_COMPLETION_TIME_MS, 3));
   }
 }
 
@@ -1362,9 +1739,12 @@ void Coordinator::ExecRemoteFragment(const FragmentExecParams* fragment_exec_par
     int per_fragment_instance_idx) {
   NotifyBarrierOnExit notifier(exec_complete_barrier_.get());
   TExecPlanFragmentParams rpc_params;
-  SetExecPlanFragmentParams(*schedule, *plan_fragment, *fragment_exec_params,
-      fragment_instance_idx, fragment_idx, per_fragment_instance_idx,
-      MakeNetworkAddress(FLAGS_hostname, FLAGS_be_port), &rpc_params);
+  {
+    SCOPED_TIMER(set_exec_params_timer_);
+    SetExecPlanFragmentParams(*schedule, *plan_fragment, *fragment_exec_params,
+        fragment_instance_idx, fragment_idx, per_fragment_instance_idx,
+        MakeNetworkAddress(FLAGS_hostname, FLAGS_be_port), &rpc_params);
+  }
   if (debug_options != NULL) {
     rpc_params.params.__set_debug_node_id(debug_options->node_id);
     rpc_params.params.__set_debug_action(debug_options->action);
@@ -1387,19 +1767,27 @@ void Coordinator::ExecRemoteFragment(const FragmentExecParams* fragment_exec_par
   ImpalaBackendConnection backend_client(exec_env_->impalad_client_cache(),
       exec_state->impalad_address(), &client_connect_status);
   if (!client_connect_status.ok()) {
+    ReportUnreachableBackend(exec_state->impalad_address());
     exec_state->SetInitialStatus(client_connect_status);
     return;
   }
 
   TExecPlanFragmentResult thrift_result;
-  Status rpc_status = backend_client.DoRpc(&ImpalaBackendClient::ExecPlanFragment,
-      rpc_params, &thrift_result);
+  Status rpc_status;
+  {
+    SCOPED_TIMER(exec_rpc_timer_);
+    rpc_status = backend_client.DoRpc(&ImpalaBackendClient::ExecPlanFragment,
+        rpc_params, &thrift_result);
+  }
 
   exec_state->SetRpcLatency(MonotonicMillis() - start);
 
   const string ERR_TEMPLATE = "ExecPlanRequest rpc query_id=$0 instance_id=$1 failed: $2";
 
   if (!rpc_status.ok()) {
+    if (rpc_status.code() == TErrorCode::RPC_CLIENT_CONNECT_FAILURE) {
+      ReportUnreachableBackend(exec_state->impalad_address());
+    }
     const string& err_msg = Substitute(ERR_TEMPLATE, PrintId(query_id()),
         PrintId(exec_state->fragment_instance_id()), rpc_status.msg().msg());
     VLOG_QUERY << err_msg;
@@ -1436,6 +1824,11 @@ void Coordinator::CancelInternal() {
 
   // cancel local fragment
   if (executor_.get() != NULL) executor_->Cancel();
+  {
+    lock_guard<mutex> l(spool_lock_);
+    spool_cancelled_ = true;
+  }
+  spool_cv_.notify_all();
 
   CancelRemoteFragments();
 
@@ -1444,6 +1837,11 @@ void Coordinator::CancelInternal() {
 }
 
 void Coordinator::CancelRemoteFragments() {
+  // The instances to cancel by host. The rpcs of each host are sent in order, and the
+  // hosts are cancelled in parallel.
+  typedef unordered_map<TNetworkAddress, vector<FragmentInstanceState*> >
+      HostInstanceMap;
+  HostInstanceMap host_instances;
   for (int i = 0; i < fragment_instance_states_.size(); ++i) {
     FragmentInstanceState* exec_state = fragment_instance_states_[i];
 
@@ -1468,23 +1866,44 @@ void Coordinator::CancelRemoteFragments() {
 
     // set an error status to make sure we only cancel this once
     exec_state->SetStatus(Status::CANCELLED);
+    host_instances[exec_state->impalad_address()].push_back(exec_state);
+  }
+
+  if (!host_instances.empty()) {
+    CountingBarrier barrier(host_instances.size());
+    for (const HostInstanceMap::value_type& instances: host_instances) {
+      function<void ()> rpcs = bind<void>(mem_fn(&Coordinator::CancelFragmentInstances),
+          this, instances.first, instances.second, &barrier);
+      // Send the rpcs on this thread if the pool is shut down.
+      if (!exec_env_->fragment_exec_thread_pool()->Offer(rpcs)) rpcs();
+    }
+    barrier.Wait();
+  }
+
+  // notify that we completed with an error
+  backend_completion_cv_.notify_all();
+}
 
-    // if we get an error while trying to get a connection to the backend,
-    // keep going
-    Status status;
-    ImpalaBackendConnection backend_client(
-        exec_env_->impalad_client_cache(), exec_state->impalad_address(), &status);
-    if (!status.ok()) continue;
+void Coordinator::CancelFragmentInstances(const TNetworkAddress& address,
+    const vector<FragmentInstanceState*>& exec_states, CountingBarrier* barrier) {
+  NotifyBarrierOnExit notifier(barrier);
+  // if we get an error while trying to get a connection to the backend,
+  // keep going
+  Status status;
+  ImpalaBackendConnection backend_client(
+      exec_env_->impalad_client_cache(), address, &status);
+  if (!status.ok()) return;
 
+  for (FragmentInstanceState* exec_state: exec_states) {
     TCancelPlanFragmentParams params;
     params.protocol_version = ImpalaInternalServiceVersion::V1;
     params.__set_fragment_instance_id(exec_state->fragment_instance_id());
     TCancelPlanFragmentResult res;
     VLOG_QUERY << "sending CancelPlanFragment rpc for instance_id="
-               << exec_state->fragment_instance_id() << " backend="
-               << exec_state->impalad_address();
+               << exec_state->fragment_instance_id() << " backend=" << address;
     Status rpc_status = backend_client.DoRpc(
         &ImpalaBackendClient::CancelPlanFragment, params, &res);
+    lock_guard<mutex> l(*exec_state->lock());
     if (!rpc_status.ok()) {
       exec_state->status()->MergeStatus(rpc_status);
       stringstream msg;
@@ -1499,9 +1918,21 @@ void Coordinator::CancelRemoteFragments() {
       exec_state->status()->AddDetail(join(res.status.error_msgs, "; "));
     }
   }
+}
 
-  // notify that we completed with an error
-  backend_completion_cv_.notify_all();
+void Coordinator::ReportUnreachableBackend(const TNetworkAddress& address) {
+  {
+    lock_guard<SpinLock> l(unreachable_backends_lock_);
+    if (!unreachable_backends_.insert(address).second) return;
+  }
+  VLOG_QUERY << "Backend " << address << " is unreachable: query_id=" << query_id_;
+  if (exec_env_->scheduler() != NULL) exec_env_->scheduler()->BlacklistBackend(address);
+}
+
+vector<TNetworkAddress> Coordinator::unreachable_backends() {
+  lock_guard<SpinLock> l(unreachable_backends_lock_);
+  return vector<TNetworkAddress>(unreachable_backends_.begin(),
+      unreachable_backends_.end());
 }
 
 Status Coordinator::UpdateFragmentExecStatus(const TReportExecStatusParams& params) {
@@ -1515,9 +1946,21 @@ Status Coordinator::UpdateFragmentExecStatus(const TReportExecStatusParams& para
             fragment_instance_idx, fragment_instance_states_.size() - 1));
   }
   FragmentInstanceState* exec_state = fragment_instance_states_[fragment_instance_idx];
+  if (exec_state == NULL
+      || params.fragment_instance_id != exec_state->fragment_instance_id()) {
+    // A late report of an instance of an earlier attempt of this query, which was
+    // retried with new instance ids that may not all have been started yet.
+    VLOG_QUERY << "Ignoring status report of instance_id=" << params.fragment_instance_id
+               << " of an earlier attempt of query_id=" << query_id_;
+    return Status::OK();
+  }
 
   const TRuntimeProfileTree& cumulative_profile = params.profile;
   Status status(params.status);
+  TNetworkAddress unreachable_backend;
+  if (DataStreamSender::ParseUnreachableBackend(status, &unreachable_backend)) {
+    ReportUnreachableBackend(unreachable_backend);
+  }
   {
     lock_guard<mutex> l(*exec_state->lock());
     if (!status.ok()) {
@@ -1692,6 +2135,8 @@ void Coordinator::ComputeFragmentSummaryStats(
 
   int64_t completion_time = fragment_instance_state->stopwatch()->ElapsedTime();
   data.completion_times(completion_time);
+  data.completion_time_histogram->Increment(
+      min(completion_time / (1000 * 1000), MAX_TRACKED_COMPLETION_TIME_MS));
   data.rates(fragment_instance_state->total_split_size() / (completion_time / 1000.0
     / 1000.0 / 1000.0));
 
@@ -1723,10 +2168,11 @@ void Coordinator::UpdateExecSummary(int fragment_idx, int instance_idx,
 
     RuntimeProfile::Counter* rows_counter = children[i]->GetCounter("RowsReturned");
     RuntimeProfile::Counter* mem_counter = children[i]->GetCounter("PeakMemoryUsage");
+    RuntimeProfile::Counter* cpu_counter = children[i]->GetCounter("CpuTime");
     if (rows_counter != NULL) stats.__set_cardinality(rows_counter->value());
     if (mem_counter != NULL) stats.__set_memory_used(mem_counter->value());
+    if (cpu_counter != NULL) stats.__set_cpu_time_ns(cpu_counter->value());
     stats.__set_latency_ns(children[i]->local_time());
-    // TODO: we don't track cpu time per node now. Do that.
     exec_summary.__isset.exec_stats = true;
   }
   VLOG(2) << PrintExecSummary(exec_summary_);
@@ -1734,10 +2180,44 @@ void Coordinator::UpdateExecSummary(int fragment_idx, int instance_idx,
 
 // This function appends summary information to the query_profile_ before
 // outputting it to VLOG.  It adds:
-//   1. Averaged remote fragment profiles (TODO: add outliers)
-//   2. Summary of remote fragment durations (min, max, mean, stddev)
+//   1. Averaged remote fragment profiles
+//   2. Summary of remote fragment durations (min, max, mean, stddev), their
+//      percentiles and the outlier instances
 //   3. Summary of remote fragment rates (min, max, mean, stddev)
-// TODO: add histogram/percentile
+void Coordinator::ReportCompletionTimeOutliers() {
+  // The completion time in ms and the instance of the outliers of each fragment.
+  typedef pair<int64_t, FragmentInstanceState*> Outlier;
+  vector<vector<Outlier> > outliers(fragment_profiles_.size());
+  for (FragmentInstanceState* exec_state: fragment_instance_states_) {
+    const HdrHistogram* histogram =
+        fragment_profiles_[exec_state->fragment_idx()].completion_time_histogram;
+    int64_t median_ms = histogram->ValueAtPercentile(50);
+    int64_t completion_time_ms = exec_state->stopwatch()->ElapsedTime() / (1000 * 1000);
+    if (completion_time_ms >= MIN_OUTLIER_COMPLETION_TIME_MS
+        && completion_time_ms > OUTLIER_COMPLETION_TIME_FACTOR * median_ms) {
+      outliers[exec_state->fragment_idx()].push_back(
+          make_pair(completion_time_ms, exec_state));
+    }
+  }
+  for (int i = 0; i < outliers.size(); ++i) {
+    if (outliers[i].empty()) continue;
+    // Report the slowest ones.
+    sort(outliers[i].begin(), outliers[i].end(), greater<Outlier>());
+    if (outliers[i].size() > MAX_REPORTED_OUTLIERS) {
+      outliers[i].resize(MAX_REPORTED_OUTLIERS);
+    }
+    stringstream outliers_label;
+    for (int j = 0; j < outliers[i].size(); ++j) {
+      if (j > 0) outliers_label << ", ";
+      outliers_label << outliers[i][j].second->impalad_address() << " ("
+          << PrintId(outliers[i][j].second->fragment_instance_id()) << "): "
+          << PrettyPrinter::Print(outliers[i][j].first, TUnit::TIME_MS);
+    }
+    fragment_profiles_[i].averaged_profile->AddInfoString(
+        "completion time outliers", outliers_label.str());
+  }
+}
+
 void Coordinator::ReportQuerySummary() {
   // In this case, the query did not even get to start on all the remote nodes,
   // some of the state that is used below might be uninitialized.  In this case,
@@ -1797,7 +2277,20 @@ void Coordinator::ReportQuerySummary() {
           "execution rates", rates_label.str());
       fragment_profiles_[i].averaged_profile->AddInfoString(
           "num instances", lexical_cast<string>(fragment_profiles_[i].num_instances));
+
+      const HdrHistogram* histogram = fragment_profiles_[i].completion_time_histogram;
+      stringstream percentiles_label;
+      percentiles_label
+        << "min:" << PrettyPrinter::Print(histogram->MinValue(), TUnit::TIME_MS)
+        << "  p50:" << PrettyPrinter::Print(
+            histogram->ValueAtPercentile(50), TUnit::TIME_MS)
+        << "  p95:" << PrettyPrinter::Print(
+            histogram->ValueAtPercentile(95), TUnit::TIME_MS)
+        << "  max:" << PrettyPrinter::Print(histogram->MaxValue(), TUnit::TIME_MS);
+      fragment_profiles_[i].averaged_profile->AddInfoString(
+          "completion time percentiles", percentiles_label.str());
     }
+    ReportCompletionTimeOutliers();
 
     // Add per node peak memory usage as InfoString
     // Map from Impalad address to peak memory usage of this query
@@ -1829,6 +2322,7 @@ void Coordinator::ReportQuerySummary() {
     for (PerNodePeakMemoryUsage::value_type entry: per_node_peak_mem_usage) {
       info << entry.first << "("
            << PrettyPrinter::Print(entry.second, TUnit::BYTES) << ") ";
+      max_per_host_peak_mem_ = max(max_per_host_peak_mem_, entry.second);
     }
     query_profile_->AddInfoString("Per Node Peak Memory Usage", info.str());
   }
@@ -1993,18 +2487,21 @@ void Coordinator::SetExecPlanDescriptorTable(const TPlanFragment& fragment,
 }
 namespace {
 
+// Publishes the filter in 'params' to all 'fragment_instance_ids' on 'impalad'. The
+// rpcs use the same connection and a single copy of the filter.
 void DistributeFilters(shared_ptr<TPublishFilterParams> params, TNetworkAddress impalad,
-    TUniqueId fragment_instance_id) {
+    vector<TUniqueId> fragment_instance_ids) {
   Status status;
   ImpalaBackendConnection backend_client(
       ExecEnv::GetInstance()->impalad_client_cache(), impalad, &status);
   if (!status.ok()) return;
   // Make a local copy of the shared 'master' set of parameters
   TPublishFilterParams local_params(*params);
-  local_params.dst_instance_id = fragment_instance_id;
-  local_params.__set_bloom_filter(params->bloom_filter);
-  TPublishFilterResult res;
-  backend_client.DoRpc(&ImpalaBackendClient::PublishFilter, local_params, &res);
+  for (const TUniqueId& fragment_instance_id: fragment_instance_ids) {
+    local_params.__set_dst_instance_id(fragment_instance_id);
+    TPublishFilterResult res;
+    backend_client.DoRpc(&ImpalaBackendClient::PublishFilter, local_params, &res);
+  }
 };
 
 }
@@ -2048,14 +2545,14 @@ void Coordinator::UpdateFilter(const TUpdateFilterParams& params) {
     }
     filter_updates_received_->Add(1);
     if (params.bloom_filter.always_true) {
-      state->bloom_filter = NULL;
+      state->bloom_filter.directory.clear();
+      state->bloom_filter.always_true = true;
       state->pending_count = 0;
     } else {
-      if (state->bloom_filter == NULL) {
-        state->bloom_filter = obj_pool()->Add(new BloomFilter(params.bloom_filter));
+      if (state->bloom_filter.directory.empty()) {
+        state->bloom_filter = params.bloom_filter;
       } else {
-        // TODO: Implement BloomFilter::Or(const ThriftBloomFilter&)
-        state->bloom_filter->Or(BloomFilter(params.bloom_filter));
+        BloomFilter::Or(params.bloom_filter, &state->bloom_filter);
       }
       if (--state->pending_count > 0) return;
     }
@@ -2071,16 +2568,24 @@ void Coordinator::UpdateFilter(const TUpdateFilterParams& params) {
       target_fragment_instance_idxs.insert(target.fragment_instance_idxs.begin(),
           target.fragment_instance_idxs.end());
     }
-    BloomFilter::ToThrift(state->bloom_filter, &rpc_params->bloom_filter);
+    // The filter is complete and not needed anymore by the coordinator.
+    swap(rpc_params->bloom_filter, state->bloom_filter);
   }
 
   rpc_params->filter_id = params.filter_id;
 
+  // Group the targets by host, so that the filter is copied and a connection is
+  // obtained once per host rather than once per target instance.
+  unordered_map<TNetworkAddress, vector<TUniqueId> > host_targets;
   for (const auto& target_idx: target_fragment_instance_idxs) {
     FragmentInstanceState* fragment_inst = fragment_instance_states_[target_idx];
     DCHECK(fragment_inst != NULL) << "Missing fragment instance: " << target_idx;
+    host_targets[fragment_inst->impalad_address()].push_back(
+        fragment_inst->fragment_instance_id());
+  }
+  for (const auto& targets: host_targets) {
     exec_env_->rpc_pool()->Offer(bind<void>(DistributeFilters, rpc_params,
-        fragment_inst->impalad_address(), fragment_inst->fragment_instance_id()));
+        targets.first, targets.second));
   }
 }
 
@@ -37,13 +37,16 @@
 #include "util/progress-updater.h"
 #include "util/histogram-metric.h"
 #include "util/runtime-profile.h"
+#include "runtime/buffered-block-mgr.h"
 #include "runtime/runtime-state.h"
 #include "scheduling/simple-scheduler.h"
 #include "gen-cpp/Types_types.h"
 #include "gen-cpp/Frontend_types.h"
+#include "gen-cpp/ImpalaInternalService_types.h"  // for TBloomFilter
 
 namespace impala {
 
+class BufferedTupleStream;
 class CountingBarrier;
 class BloomFilter;
 class DataStreamMgr;
@@ -56,6 +59,7 @@ class RuntimeState;
 class Expr;
 class ExprContext;
 class ExecEnv;
+class Thread;
 class TUpdateCatalogRequest;
 class TQueryExecRequest;
 class TReportExecStatusParams;
@@ -113,6 +117,8 @@ class Coordinator {
   /// Returns tuples from the coordinator fragment. Any returned tuples are valid until
   /// the next GetNext() call. If *batch is NULL, execution has completed and GetNext()
   /// must not be called again.
+  /// With --spool_query_results, the tuples come from the spooled results, which the
+  /// coordinator fragment writes independently of the calls to GetNext().
   /// GetNext() will not set *batch=NULL until all fragment instances have
   /// either completed or have failed.
   /// It is safe to call GetNext() even in the case where there is no coordinator fragment
@@ -149,6 +155,10 @@ class Coordinator {
   /// is a coordinator fragment, or query_mem_tracker_ (initialized in Exec()) otherwise.
   MemTracker* query_mem_tracker();
 
+  /// Returns the highest peak memory usage of the query on any host, as computed by the
+  /// query summary once the query finished or was cancelled. -1 before that.
+  int64_t max_per_host_peak_mem() const { return max_per_host_peak_mem_; }
+
   /// Get cumulative profile aggregated over all fragments of the query.
   /// This is a snapshot of the current state of execution and will change in
   /// the future if not all fragments have finished execution.
@@ -156,6 +166,11 @@ class Coordinator {
 
   const TUniqueId& query_id() const { return query_id_; }
 
+  /// True if the query only runs the coordinator fragment and scans fewer than
+  /// --single_node_fast_path_max_scan_bytes, so that it can be executed with less
+  /// bookkeeping. Only valid after Exec().
+  bool is_fast_path() const { return is_fast_path_; }
+
   /// This is safe to call only after Wait()
   const PartitionStatusMap& per_partition_status() { return per_partition_status_; }
 
@@ -182,6 +197,11 @@ class Coordinator {
 
   SpinLock& GetExecSummaryLock() const { return exec_summary_lock_; }
 
+  /// Returns the backends that fragment instances of this query could not connect to,
+  /// either to start a fragment instance or to send it rows. They were blacklisted in
+  /// the scheduler, so that a retry of the query avoids them.
+  std::vector<TNetworkAddress> unreachable_backends();
+
   /// Receive a local filter update from a fragment instance. Aggregate that filter update
   /// with others for the same filter ID into a global filter. If all updates for that
   /// filter ID have been received (may be 1 or more per filter), broadcast the global
@@ -237,9 +257,18 @@ class Coordinator {
 
   bool has_called_wait_;  // if true, Wait() was called; protected by wait_lock_
 
+  /// See is_fast_path(). Set in Exec().
+  bool is_fast_path_;
+
   /// Keeps track of number of completed ranges and total scan ranges.
   ProgressUpdater progress_;
 
+  /// Protects unreachable_backends_. Not held together with any other lock.
+  SpinLock unreachable_backends_lock_;
+
+  /// See unreachable_backends().
+  boost::unordered_set<TNetworkAddress> unreachable_backends_;
+
   /// protects all fields below
   boost::mutex lock_;
 
@@ -299,7 +328,10 @@ class Coordinator {
   PartitionStatusMap per_partition_status_;
 
   /// The set of files to move after an INSERT query has run, in (src, dest) form. An
-  /// empty string for the destination means that a file is to be deleted.
+  /// empty string for the destination means that a file is to be deleted. A destination
+  /// equal to the source means that the file was written directly to its final location
+  /// (see s3_skip_insert_staging): it is not moved, must not be deleted by an OVERWRITE,
+  /// and is deleted if the query fails.
   FileMoveMap files_to_move_;
 
   /// Object pool owned by the coordinator. Any executor will have its own pool.
@@ -315,6 +347,34 @@ class Coordinator {
   /// Aggregate counters for the entire query.
   boost::scoped_ptr<RuntimeProfile> query_profile_;
 
+  /// Set by ReportQuerySummary(). See max_per_host_peak_mem().
+  int64_t max_per_host_peak_mem_;
+
+  /// Result spooling, used for queries with --spool_query_results. The spooling thread
+  /// runs SpoolResults(), which drives the coordinator fragment to completion and
+  /// writes its rows into spool_stream_, so that all fragments can finish and release
+  /// their resources while the client fetches at its own pace. GetNext() reads the rows
+  /// from spool_stream_ into spool_batch_. The stream is unpinned, so results that don't
+  /// fit in memory are spilled.
+  boost::scoped_ptr<Thread> spool_thread_;
+  BufferedBlockMgr::Client* spool_client_;
+  boost::scoped_ptr<BufferedTupleStream> spool_stream_;
+  boost::scoped_ptr<RowBatch> spool_batch_;
+
+  /// Protects spool_stream_, which isn't thread-safe, and the fields below.
+  boost::mutex spool_lock_;
+
+  /// Signalled when rows were spooled or read, and when spooling ended or was
+  /// cancelled. Tied to spool_lock_.
+  boost::condition_variable spool_cv_;
+
+  /// Set by the spooling thread when it is done, along with its final status.
+  bool spool_done_;
+  Status spool_status_;
+
+  /// Set by Cancel() to stop the spooling thread from waiting for the client.
+  bool spool_cancelled_;
+
   /// Event timeline for this query. Unowned.
   RuntimeProfile::EventSequence* query_events_;
 
@@ -341,6 +401,10 @@ class Coordinator {
 
     /// Execution rates for instances of this fragment
     SummaryStats rates;
+
+    /// Completion times in ms of the instances of this fragment, for percentiles and
+    /// outliers. Stored in obj_pool. NULL for the coordinator fragment.
+    HdrHistogram* completion_time_histogram;
   };
 
   /// This is indexed by fragment_idx.
@@ -357,6 +421,17 @@ class Coordinator {
   /// Total time spent in finalization (typically 0 except for INSERT into hdfs tables)
   RuntimeProfile::Counter* finalization_timer_;
 
+  /// Wall time of StartRemoteFragments(). Its child timers break it down into the
+  /// phases of the startup: building the filter routing table, dispatching the rpcs
+  /// to the fragment exec thread pool and waiting for them to complete.
+  RuntimeProfile::Counter* start_fragments_timer_;
+
+  /// Time summed over all fragment instances spent building the rpc params and
+  /// issuing the ExecPlanFragment() rpc, respectively. Children of
+  /// start_fragments_timer_, but since the rpcs run in parallel they can exceed it.
+  RuntimeProfile::Counter* set_exec_params_timer_;
+  RuntimeProfile::Counter* exec_rpc_timer_;
+
   /// Barrier that is released when all calls to ExecRemoteFragment() have
   /// returned, successfully or not. Initialised during StartRemoteFragments().
   boost::scoped_ptr<CountingBarrier> exec_complete_barrier_;
@@ -388,8 +463,10 @@ class Coordinator {
     int pending_count;
 
     /// BloomFilter aggregated from all source plan nodes, to be broadcast to all
-    /// destination plan fragment instances. Owned by the coordinator's object pool.
-    BloomFilter* bloom_filter;
+    /// destination plan fragment instances. Kept serialized, so that updates are OR-ed
+    /// in and the result is published without converting it. Its directory is empty
+    /// until the first update arrives, and it is moved out when it is published.
+    TBloomFilter bloom_filter;
 
     /// Time at which first local filter arrived.
     int64_t first_arrival_time;
@@ -397,7 +474,7 @@ class Coordinator {
     /// Time at which all local filters arrived.
     int64_t completion_time;
 
-    FilterState() : bloom_filter(NULL), first_arrival_time(0L), completion_time(0L) { }
+    FilterState() : first_arrival_time(0L), completion_time(0L) { }
   };
 
   /// Protects filter_routing_table_.
@@ -443,9 +520,17 @@ class Coordinator {
       QuerySchedule* schedule, int fragment_instance_idx, int fragment_idx,
       int per_fragment_instance_idx);
 
+  /// Adds 'address' to unreachable_backends_ and blacklists it in the scheduler.
+  void ReportUnreachableBackend(const TNetworkAddress& address);
+
   /// Determine fragment number, given fragment id.
   int GetFragmentNum(const TUniqueId& fragment_id);
 
+  /// Adds the instances of each fragment whose completion time is far above the median
+  /// of the fragment as an info string to its averaged profile. Called by
+  /// ReportQuerySummary().
+  void ReportCompletionTimeOutliers();
+
   /// Print hdfs split size stats to VLOG_QUERY and details to VLOG_FILE
   /// Attaches split size summary to the appropriate runtime profile
   void PrintFragmentInstanceInfo();
@@ -473,6 +558,12 @@ class Coordinator {
   /// reached.
   void CancelRemoteFragments();
 
+  /// Sends the CancelPlanFragment() rpcs of 'exec_states', which are the instances on
+  /// the backend at 'address', and notifies 'barrier' when done. Called in parallel for
+  /// the backends of the query by CancelRemoteFragments().
+  void CancelFragmentInstances(const TNetworkAddress& address,
+      const std::vector<FragmentInstanceState*>& exec_states, CountingBarrier* barrier);
+
   /// Acquires lock_ and updates query_status_ with 'status' if it's not already
   /// an error status, and returns the current query_status_.
   /// Calls CancelInternal() when switching to an error status.
@@ -534,6 +625,27 @@ class Coordinator {
   void PopulatePathPermissionCache(hdfsFS fs, const std::string& path_str,
       PermissionCache* permissions_cache);
 
+  /// Same as PopulatePathPermissionCache() for each path in 'children', which must all be
+  /// immediate children of 'dir'. Lists 'dir' once instead of calling hdfsGetPathInfo()
+  /// on each child.
+  void PopulateChildPermissionCache(hdfsFS fs, const std::string& dir,
+      const std::vector<std::string>& children, PermissionCache* permissions_cache);
+
+  /// Adds a DELETE operation to 'delete_ops' for each entry of 'dir' whose name is not in
+  /// 'files_to_keep'. If 'files_only' is true, only files are deleted. A missing 'dir' is
+  /// treated as empty if 'allow_missing' is true.
+  Status AddDeleteDirContentsOps(hdfsFS fs, const std::string& dir, bool files_only,
+      bool allow_missing, const boost::unordered_set<std::string>& files_to_keep,
+      HdfsOperationSet* delete_ops);
+
+  /// Deletes the files that were written directly to their final location, after the
+  /// query failed.
+  void DeleteDirectlyWrittenFiles();
+
+  /// Adds the time spent in each type of operation of 'op_set' to the
+  /// Hdfs<op type>Time counters of the query profile.
+  void ReportHdfsOpTimes(HdfsOperationSet* op_set);
+
   /// Validates that all collection-typed slots in the given batch are set to NULL.
   /// See SubplanNode for details on when collection-typed slots are set to NULL.
   /// TODO: This validation will become obsolete when we can return collection values.
@@ -541,9 +653,37 @@ class Coordinator {
   /// SubplanNode with respect to setting collection-slots to NULL.
   void ValidateCollectionSlots(RowBatch* batch);
 
+  /// Implements GetNext() by returning the next batch of the coordinator fragment. Used
+  /// by the spooling thread if the results are spooled.
+  Status GetNextFromExecutor(RowBatch** batch);
+
+  /// Sets up result spooling and starts the spooling thread. Called by Wait() once the
+  /// coordinator fragment was opened.
+  Status StartResultSpooling();
+
+  /// Thread function of the spooling thread. Writes all batches of the coordinator
+  /// fragment into spool_stream_ and closes the fragment once it is done.
+  void SpoolResults();
+
+  /// Copies the rows of 'batch' into spool_stream_, first waiting until the client read
+  /// enough rows if more than --max_spooled_result_bytes aren't read yet.
+  Status SpoolBatch(RowBatch* batch);
+
+  /// Implements GetNext() if the results are spooled. Blocks until rows were spooled or
+  /// spooling is done.
+  Status GetNextSpooled(RowBatch** batch);
+
+  /// Returns an estimate of the bytes in spool_stream_ that weren't read yet. Must hold
+  /// spool_lock_.
+  int64_t UnreadSpooledBytes() const;
+
+  /// Closes spool_stream_ and frees its buffers. Must hold spool_lock_.
+  void CloseSpoolStream();
+
   /// Starts all remote fragments contained in the schedule by issuing RPCs in parallel,
   /// and then waiting for all of the RPCs to complete. Returns an error if there was any
-  /// error starting the fragments.
+  /// error starting the fragments. If --batch_fragment_starts_per_host is set, the rpcs
+  /// run in parallel across hosts, but one after the other for the instances of a host.
   Status StartRemoteFragments(QuerySchedule* schedule);
 
   /// Build the filter routing table by iterating over all plan nodes and collecting the
@@ -0,0 +1,121 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "runtime/data-cache.h"
+#include "testutil/gtest-util.h"
+#include "util/cpu-info.h"
+#include "util/filesystem-util.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+const int64_t CHUNK_SIZE = 1024;
+const int64_t NUM_CHUNKS = 4;
+
+class DataCacheTest : public ::testing::Test {
+ protected:
+  DataCacheTest() {
+    for (int i = 0; i < 8 * CHUNK_SIZE; ++i) data_ += 'a' + rand() % 26;
+  }
+
+  virtual void SetUp() {
+    ASSERT_OK(FileSystemUtil::RemoveAndCreateDirectory(DIR));
+    vector<string> dirs;
+    dirs.push_back(DIR);
+    cache_.reset(new DataCache(dirs, NUM_CHUNKS * CHUNK_SIZE, CHUNK_SIZE));
+    ASSERT_OK(cache_->Init());
+  }
+
+  virtual void TearDown() {
+    cache_.reset();
+    vector<string> dirs;
+    dirs.push_back(DIR);
+    EXPECT_OK(FileSystemUtil::RemovePaths(dirs));
+  }
+
+  /// Stores the 'len' bytes of data_ starting at 'offset' for file "f" with mtime 1.
+  void Store(int64_t offset, int64_t len, bool eof = false) {
+    cache_->Store("f", 1, offset, len, data_.data() + offset, eof);
+  }
+
+  /// Looks up the 'len' bytes starting at 'offset' and checks that the returned bytes
+  /// match data_. Returns the number of bytes found.
+  int64_t Lookup(int64_t offset, int64_t len, int64_t mtime = 1) {
+    vector<char> buffer(len);
+    int64_t bytes = cache_->Lookup("f", mtime, offset, len, &buffer[0]);
+    EXPECT_TRUE(data_.compare(offset, bytes, &buffer[0], bytes) == 0);
+    return bytes;
+  }
+
+  static const string DIR;
+  string data_;
+  boost::scoped_ptr<DataCache> cache_;
+};
+
+const string DataCacheTest::DIR = "/tmp/data-cache-test";
+
+TEST_F(DataCacheTest, StoreAndLookup) {
+  EXPECT_EQ(Lookup(0, CHUNK_SIZE), 0);
+  Store(0, 2 * CHUNK_SIZE);
+  EXPECT_EQ(Lookup(0, 2 * CHUNK_SIZE), 2 * CHUNK_SIZE);
+  // Unaligned lookups are served from the middle of the chunks.
+  EXPECT_EQ(Lookup(100, CHUNK_SIZE), CHUNK_SIZE);
+  // The lookup stops at the first chunk that isn't cached.
+  EXPECT_EQ(Lookup(CHUNK_SIZE + 10, 2 * CHUNK_SIZE), CHUNK_SIZE - 10);
+  // A different mtime is a different version of the file.
+  EXPECT_EQ(Lookup(0, CHUNK_SIZE, 2), 0);
+}
+
+TEST_F(DataCacheTest, PartialChunks) {
+  // Only the chunks that are contained completely are stored.
+  Store(10, 3 * CHUNK_SIZE);
+  EXPECT_EQ(Lookup(0, CHUNK_SIZE), 0);
+  EXPECT_EQ(Lookup(CHUNK_SIZE, 3 * CHUNK_SIZE), 2 * CHUNK_SIZE);
+
+  // The last chunk of a file is stored if the data ends at the end of the file.
+  Store(5 * CHUNK_SIZE, CHUNK_SIZE / 2, true);
+  EXPECT_EQ(Lookup(5 * CHUNK_SIZE, CHUNK_SIZE), CHUNK_SIZE / 2);
+  EXPECT_EQ(Lookup(5 * CHUNK_SIZE + 10, CHUNK_SIZE), CHUNK_SIZE / 2 - 10);
+}
+
+TEST_F(DataCacheTest, Eviction) {
+  Store(0, NUM_CHUNKS * CHUNK_SIZE);
+  EXPECT_EQ(Lookup(0, NUM_CHUNKS * CHUNK_SIZE), NUM_CHUNKS * CHUNK_SIZE);
+  // Make the first chunk the most recently used, so that the second one is evicted.
+  EXPECT_EQ(Lookup(0, CHUNK_SIZE), CHUNK_SIZE);
+  Store(NUM_CHUNKS * CHUNK_SIZE, CHUNK_SIZE);
+  EXPECT_EQ(Lookup(0, CHUNK_SIZE), CHUNK_SIZE);
+  EXPECT_EQ(Lookup(CHUNK_SIZE, CHUNK_SIZE), 0);
+  EXPECT_EQ(Lookup(2 * CHUNK_SIZE, 3 * CHUNK_SIZE), 3 * CHUNK_SIZE);
+}
+
+TEST_F(DataCacheTest, BadDirectory) {
+  vector<string> dirs;
+  dirs.push_back("/does/not/exist");
+  DataCache cache(dirs, NUM_CHUNKS * CHUNK_SIZE, CHUNK_SIZE);
+  EXPECT_FALSE(cache.Init().ok());
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,247 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/data-cache.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <gutil/strings/substitute.h>
+
+#include "util/bit-util.h"
+#include "util/error-util.h"
+#include "util/filesystem-util.h"
+#include "util/hash-util.h"
+#include "util/impalad-metrics.h"
+
+#include "common/names.h"
+
+using boost::algorithm::is_any_of;
+using boost::algorithm::join;
+using boost::algorithm::trim_right_copy_if;
+using boost::filesystem::absolute;
+using boost::filesystem::path;
+using namespace impala;
+using namespace strings;
+
+const int64_t DataCache::DEFAULT_CHUNK_SIZE = 1024 * 1024;
+
+// Name of the subdirectory of each cache directory that holds the backing file.
+static const string DATA_CACHE_SUB_DIR_NAME = "impala-data-cache";
+
+size_t DataCache::ChunkKeyHash::operator()(const ChunkKey& key) const {
+  uint32_t hash = HashUtil::Hash(key.file.data(), key.file.size(), 0);
+  hash = HashUtil::Hash(&key.mtime, sizeof(key.mtime), hash);
+  return HashUtil::Hash(&key.offset, sizeof(key.offset), hash);
+}
+
+DataCache::DataCache(const vector<string>& dirs, int64_t capacity_per_dir,
+    int64_t chunk_size)
+  : dirs_(dirs),
+    capacity_per_dir_(capacity_per_dir),
+    chunk_size_(chunk_size) {
+  DCHECK_GT(chunk_size, 0);
+}
+
+Status DataCache::Init() {
+  int64_t num_slots = capacity_per_dir_ / chunk_size_;
+  if (num_slots == 0) {
+    return Status(Substitute("Data cache capacity of $0 bytes per directory is smaller "
+        "than the chunk size of $1 bytes", capacity_per_dir_, chunk_size_));
+  }
+  for (const string& dir: dirs_) {
+    path dir_path = absolute(path(trim_right_copy_if(dir, is_any_of("/"))));
+    Status status = FileSystemUtil::VerifyIsDirectory(dir_path.string());
+    // Any old cache contents are stale without the index.
+    path sub_dir_path = dir_path / DATA_CACHE_SUB_DIR_NAME;
+    if (status.ok()) {
+      status = FileSystemUtil::RemoveAndCreateDirectory(sub_dir_path.string());
+    }
+    Partition* partition = NULL;
+    if (status.ok()) {
+      partition = pool_.Add(
+          new Partition((sub_dir_path / "data").string(), num_slots, chunk_size_));
+      status = partition->Init();
+    }
+    if (!status.ok()) {
+      LOG(WARNING) << "Cannot use directory " << dir_path.string() << " for the data "
+                   << "cache: " << status.GetDetail();
+      continue;
+    }
+    LOG(INFO) << "Using data cache directory " << sub_dir_path.string() << " with "
+              << num_slots << " chunks of " << chunk_size_ << " bytes";
+    partitions_.push_back(partition);
+  }
+  if (partitions_.empty()) {
+    return Status(Substitute("Could not use any of the data cache directories: $0",
+        join(dirs_, ",")));
+  }
+  return Status::OK();
+}
+
+DataCache::Partition* DataCache::GetPartition(const ChunkKey& key) {
+  return partitions_[ChunkKeyHash()(key) % partitions_.size()];
+}
+
+int64_t DataCache::Lookup(const string& file, int64_t mtime, int64_t offset,
+    int64_t len, char* buffer) {
+  int64_t bytes_copied = 0;
+  ChunkKey key;
+  key.file = file;
+  key.mtime = mtime;
+  while (bytes_copied < len) {
+    int64_t pos = offset + bytes_copied;
+    key.offset = pos - pos % chunk_size_;
+    int64_t chunk_offset = pos - key.offset;
+    int64_t bytes_to_copy = min(len - bytes_copied, chunk_size_ - chunk_offset);
+    int64_t chunk_bytes = GetPartition(key)->Read(key, chunk_offset, bytes_to_copy,
+        buffer + bytes_copied);
+    bytes_copied += chunk_bytes;
+    // Stop at a missing chunk or at the last chunk of the file.
+    if (chunk_bytes < bytes_to_copy) break;
+  }
+  if (ImpaladMetrics::IO_MGR_REMOTE_DATA_CACHE_HIT_BYTES != NULL) {
+    ImpaladMetrics::IO_MGR_REMOTE_DATA_CACHE_HIT_BYTES->Increment(bytes_copied);
+    ImpaladMetrics::IO_MGR_REMOTE_DATA_CACHE_MISS_BYTES->Increment(len - bytes_copied);
+  }
+  return bytes_copied;
+}
+
+void DataCache::Store(const string& file, int64_t mtime, int64_t offset, int64_t len,
+    const char* buffer, bool eof) {
+  ChunkKey key;
+  key.file = file;
+  key.mtime = mtime;
+  // Skip the partial chunk at the start of the buffer.
+  key.offset = BitUtil::RoundUp(offset, chunk_size_);
+  int64_t end = offset + len;
+  while (key.offset < end) {
+    int64_t chunk_len = min(chunk_size_, end - key.offset);
+    if (chunk_len < chunk_size_ && !eof) break;
+    GetPartition(key)->Write(key, buffer + key.offset - offset, chunk_len);
+    key.offset += chunk_size_;
+  }
+}
+
+DataCache::Partition::Partition(const string& path, int64_t num_slots,
+    int64_t chunk_size)
+  : path_(path),
+    num_slots_(num_slots),
+    chunk_size_(chunk_size),
+    fd_(-1) {
+}
+
+DataCache::Partition::~Partition() {
+  if (fd_ >= 0) close(fd_);
+}
+
+Status DataCache::Partition::Init() {
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd_ < 0) {
+    return Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("Create file $0 failed with errno=$1 description=$2", path_, errno,
+            GetStrErrMsg())));
+  }
+  // The slots are allocated by the filesystem when they are first written.
+  if (ftruncate(fd_, num_slots_ * chunk_size_) != 0) {
+    return Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("Truncate file $0 to length $1 failed with errno $2 ($3)", path_,
+            num_slots_ * chunk_size_, errno, GetStrErrMsg())));
+  }
+  free_slots_.reserve(num_slots_);
+  for (int64_t slot = num_slots_ - 1; slot >= 0; --slot) free_slots_.push_back(slot);
+  return Status::OK();
+}
+
+int64_t DataCache::Partition::Read(const ChunkKey& key, int64_t chunk_offset,
+    int64_t len, char* buffer) {
+  Entry* entry;
+  {
+    lock_guard<mutex> l(lock_);
+    EntryMap::iterator it = entries_.find(key);
+    if (it == entries_.end() || it->second.pending) return 0;
+    entry = &it->second;
+    len = min(len, entry->len - chunk_offset);
+    if (len <= 0) return 0;
+    ++entry->num_pins;
+    lru_list_.splice(lru_list_.begin(), lru_list_, entry->lru_pos);
+  }
+
+  // The entry can't be evicted while it is pinned.
+  ssize_t bytes_read =
+      pread(fd_, buffer, len, entry->slot * chunk_size_ + chunk_offset);
+  if (bytes_read != len) {
+    LOG(WARNING) << "Failed to read " << len << " bytes from data cache file " << path_
+                 << ": " << GetStrErrMsg();
+    bytes_read = 0;
+  }
+
+  lock_guard<mutex> l(lock_);
+  --entry->num_pins;
+  return bytes_read;
+}
+
+void DataCache::Partition::Write(const ChunkKey& key, const char* buffer,
+    int64_t len) {
+  DCHECK_LE(len, chunk_size_);
+  Entry* entry;
+  {
+    lock_guard<mutex> l(lock_);
+    if (entries_.find(key) != entries_.end()) return;
+    int64_t slot = GetFreeSlot();
+    if (slot < 0) return;
+    entry = &entries_[key];
+    entry->slot = slot;
+    entry->len = len;
+    entry->num_pins = 1;
+    entry->pending = true;
+  }
+
+  ssize_t bytes_written = pwrite(fd_, buffer, len, entry->slot * chunk_size_);
+
+  lock_guard<mutex> l(lock_);
+  EntryMap::iterator it = entries_.find(key);
+  DCHECK(it != entries_.end());
+  if (bytes_written != len) {
+    LOG(WARNING) << "Failed to write " << len << " bytes to data cache file " << path_
+                 << ": " << GetStrErrMsg();
+    free_slots_.push_back(entry->slot);
+    entries_.erase(it);
+    return;
+  }
+  --entry->num_pins;
+  entry->pending = false;
+  lru_list_.push_front(&it->first);
+  entry->lru_pos = lru_list_.begin();
+}
+
+int64_t DataCache::Partition::GetFreeSlot() {
+  if (!free_slots_.empty()) {
+    int64_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    return slot;
+  }
+  for (list<const ChunkKey*>::reverse_iterator lru_it = lru_list_.rbegin();
+      lru_it != lru_list_.rend(); ++lru_it) {
+    EntryMap::iterator it = entries_.find(**lru_it);
+    DCHECK(it != entries_.end());
+    if (it->second.num_pins > 0) continue;
+    int64_t slot = it->second.slot;
+    lru_list_.erase(it->second.lru_pos);
+    entries_.erase(it);
+    return slot;
+  }
+  return -1;
+}
@@ -0,0 +1,169 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_DATA_CACHE_H
+#define IMPALA_RUNTIME_DATA_CACHE_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "common/object-pool.h"
+#include "common/status.h"
+
+namespace impala {
+
+/// Cache of file data on local disks, used by the DiskIoMgr to avoid reading the same
+/// data from remote HDFS datanodes or S3 again.
+///
+/// The data is cached in chunks of 'chunk_size' bytes at chunk-aligned offsets of the
+/// files. Each chunk is keyed by the file name, the last modified time of the file and
+/// the offset of the chunk, so that the chunks of a file are not used anymore once the
+/// file is modified. Only the chunks that are read completely are stored, except for
+/// the last chunk of a file, which may be shorter.
+///
+/// Each cache directory holds one backing file of 'capacity_per_dir' bytes, which is
+/// divided into slots of 'chunk_size' bytes. The chunks are distributed over the
+/// directories by the hash of their key, and each directory evicts its least recently
+/// used chunk when it needs a free slot. The index of the cached chunks is kept in
+/// memory, so the contents of the cache do not survive a restart.
+///
+/// This class is thread-safe. The locks are not held while reading from or writing to
+/// the backing files.
+class DataCache {
+ public:
+  /// The default size of the cached chunks.
+  static const int64_t DEFAULT_CHUNK_SIZE;
+
+  DataCache(const std::vector<std::string>& dirs, int64_t capacity_per_dir,
+      int64_t chunk_size);
+
+  /// Creates the backing files. Directories that can't be used are skipped with a
+  /// warning. Returns an error if none of them can be used.
+  Status Init();
+
+  /// Copies the cached data of 'file' with last modified time 'mtime', starting at
+  /// 'offset', into 'buffer'. Copies up to 'len' bytes, stopping at the first chunk
+  /// that is not cached. Returns the number of bytes copied.
+  int64_t Lookup(const std::string& file, int64_t mtime, int64_t offset, int64_t len,
+      char* buffer);
+
+  /// Stores the chunks of 'file' with last modified time 'mtime' that are contained in
+  /// the 'len' bytes of 'buffer', which were read from 'offset'. If 'eof' is true, the
+  /// data ends at the end of the file and the last partial chunk is stored as well.
+  /// Chunks that are already cached are skipped. Errors writing the backing files are
+  /// logged and the chunks are not stored.
+  void Store(const std::string& file, int64_t mtime, int64_t offset, int64_t len,
+      const char* buffer, bool eof);
+
+  int64_t chunk_size() const { return chunk_size_; }
+
+ private:
+  /// Identifies a chunk of a file.
+  struct ChunkKey {
+    std::string file;
+    int64_t mtime;
+    int64_t offset;
+
+    bool operator==(const ChunkKey& other) const {
+      return offset == other.offset && mtime == other.mtime && file == other.file;
+    }
+  };
+
+  struct ChunkKeyHash {
+    size_t operator()(const ChunkKey& key) const;
+  };
+
+  /// The cached chunks of one directory and the backing file they are stored in.
+  class Partition {
+   public:
+    Partition(const std::string& path, int64_t num_slots, int64_t chunk_size);
+    ~Partition();
+
+    /// Creates the backing file.
+    Status Init();
+
+    /// Copies 'len' bytes starting at 'chunk_offset' within the chunk 'key' into
+    /// 'buffer', or fewer if the chunk is shorter. Returns the number of bytes copied,
+    /// which is 0 if the chunk is not cached.
+    int64_t Read(const ChunkKey& key, int64_t chunk_offset, int64_t len, char* buffer);
+
+    /// Stores the 'len' bytes of 'buffer' as the chunk 'key', unless it is already
+    /// cached or all slots are in use by reads.
+    void Write(const ChunkKey& key, const char* buffer, int64_t len);
+
+   private:
+    /// A cached chunk. An entry is pinned while its slot is read or written, and
+    /// pinned entries are not evicted.
+    struct Entry {
+      int64_t slot;
+      int64_t len;
+      int num_pins;
+
+      /// True while the chunk is being written. Lookups treat it as a miss.
+      bool pending;
+
+      /// Position in lru_list_. Only valid if 'pending' is false.
+      std::list<const ChunkKey*>::iterator lru_pos;
+    };
+
+    typedef boost::unordered_map<ChunkKey, Entry, ChunkKeyHash> EntryMap;
+
+    /// Returns a free slot, evicting the least recently used unpinned chunk if
+    /// necessary, or -1 if all slots are pinned. lock_ must be held.
+    int64_t GetFreeSlot();
+
+    /// Path of the backing file.
+    const std::string path_;
+    const int64_t num_slots_;
+    const int64_t chunk_size_;
+
+    /// File descriptor of the backing file.
+    int fd_;
+
+    /// Protects the fields below.
+    boost::mutex lock_;
+
+    /// The cached chunks. The keys are referenced by lru_list_, which relies on the
+    /// elements of the map not moving when it is modified.
+    EntryMap entries_;
+
+    /// Keys of the chunks that are not pending, from the most to the least recently
+    /// used.
+    std::list<const ChunkKey*> lru_list_;
+
+    /// Slots that don't hold a chunk.
+    std::vector<int64_t> free_slots_;
+  };
+
+  /// Returns the partition that caches 'key'.
+  Partition* GetPartition(const ChunkKey& key);
+
+  const std::vector<std::string> dirs_;
+  const int64_t capacity_per_dir_;
+  const int64_t chunk_size_;
+
+  /// Owns the partitions.
+  ObjectPool pool_;
+
+  /// The partitions of the directories that are used.
+  std::vector<Partition*> partitions_;
+};
+
+}
+
+#endif
@@ -50,6 +50,8 @@ const int32_t STREAM_EXPIRATION_TIME_MS = 300 * 1000;
 
 namespace impala {
 
+const char* DataStreamMgr::RECVR_CLOSED_MSG = "Receiver closed";
+
 DataStreamMgr::DataStreamMgr(MetricGroup* metrics) {
   metrics_ = metrics->GetChildGroup("datastream-manager");
   num_senders_waiting_ =
@@ -76,7 +78,7 @@ shared_ptr<DataStreamRecvr> DataStreamMgr::CreateRecvr(RuntimeState* state,
   VLOG_FILE << "creating receiver for fragment="
             << fragment_instance_id << ", node=" << dest_node_id;
   shared_ptr<DataStreamRecvr> recvr(
-      new DataStreamRecvr(this, state->instance_mem_tracker(), row_desc,
+      new DataStreamRecvr(this, state, state->instance_mem_tracker(), row_desc,
           fragment_instance_id, dest_node_id, num_senders, is_merging, buffer_size,
           profile));
   size_t hash_value = GetHashValue(fragment_instance_id, dest_node_id);
@@ -186,6 +188,34 @@ Status DataStreamMgr::AddData(const TUniqueId& fragment_instance_id,
   return Status::OK();
 }
 
+Status DataStreamMgr::AddData(const TUniqueId& fragment_instance_id,
+    PlanNodeId dest_node_id, RowBatch* batch, int sender_id, bool acquire_state) {
+  VLOG_ROW << "AddData(): fragment_instance_id=" << fragment_instance_id
+           << " node=" << dest_node_id
+           << " #rows=" << batch->num_rows();
+  bool already_unregistered;
+  shared_ptr<DataStreamRecvr> recvr = FindRecvrOrWait(fragment_instance_id, dest_node_id,
+      &already_unregistered);
+  if (recvr.get() == NULL) {
+    // See AddData() above.
+    return already_unregistered ? Status::OK() :
+        Status(TErrorCode::DATASTREAM_SENDER_TIMEOUT, PrintId(fragment_instance_id));
+  }
+  DCHECK(!already_unregistered);
+  recvr->AddBatch(batch, sender_id, acquire_state);
+  return Status::OK();
+}
+
+bool DataStreamMgr::IsRecvrClosed(const TUniqueId& fragment_instance_id,
+    PlanNodeId dest_node_id) {
+  lock_guard<mutex> l(lock_);
+  shared_ptr<DataStreamRecvr> recvr = FindRecvr(fragment_instance_id, dest_node_id,
+      false);
+  if (recvr.get() != NULL) return recvr->is_cancelled();
+  return closed_stream_cache_.find(make_pair(fragment_instance_id, dest_node_id))
+      != closed_stream_cache_.end();
+}
+
 Status DataStreamMgr::CloseSender(const TUniqueId& fragment_instance_id,
     PlanNodeId dest_node_id, int sender_id) {
   VLOG_FILE << "CloseSender(): fragment_instance_id=" << fragment_instance_id
@@ -82,13 +82,19 @@ class DataStreamMgr {
   /// from which the data came.
   /// The call blocks if this ends up pushing the stream over its buffering limit;
   /// it unblocks when the consumer removed enough data to make space for
-  /// row_batch.
+  /// row_batch. With --datastream_recvr_spill_batches, the recvr spills row_batch
+  /// instead if it can.
   /// TODO: enforce per-sender quotas (something like 200% of buffer_size/#senders),
   /// so that a single sender can't flood the buffer and stall everybody else.
   /// Returns OK if successful, error status otherwise.
   Status AddData(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
                  const TRowBatch& thrift_batch, int sender_id);
 
+  /// Same as above for a sender in this process, which passes the unserialized 'batch'.
+  /// See DataStreamRecvr::AddBatch(RowBatch*, int, bool) for 'acquire_state'.
+  Status AddData(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
+      RowBatch* batch, int sender_id, bool acquire_state);
+
   /// Notifies the recvr associated with the fragment/node id that the specified
   /// sender has closed.
   /// Returns OK if successful, error status otherwise.
@@ -98,6 +104,15 @@ class DataStreamMgr {
   /// Closes all receivers registered for fragment_instance_id immediately.
   void Cancel(const TUniqueId& fragment_instance_id);
 
+  /// Returns true if the recvr identified by fragment_instance_id/dest_node_id doesn't
+  /// want any more rows, i.e. its stream was cancelled, e.g. because its exchange node
+  /// reached its limit, or it was already closed. Senders use this to stop early.
+  bool IsRecvrClosed(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id);
+
+  /// Added to the error_msgs of the OK status of a TransmitData() reply if the recvr
+  /// is closed (see IsRecvrClosed()). Senders that don't check for it ignore it.
+  static const char* RECVR_CLOSED_MSG;
+
  private:
   friend class DataStreamRecvr;
 
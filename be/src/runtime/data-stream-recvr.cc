@@ -14,17 +14,37 @@
 
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <gutil/strings/substitute.h>
 
 #include "runtime/data-stream-recvr.h"
+#include "runtime/buffered-tuple-stream.inline.h"
 #include "runtime/data-stream-mgr.h"
 #include "runtime/row-batch.h"
+#include "runtime/row-batch-pool.h"
+#include "runtime/runtime-state.h"
 #include "runtime/sorted-run-merger.h"
+#include "util/blocking-queue.h"
 #include "util/runtime-profile.h"
 #include "util/periodic-counter-updater.h"
+#include "util/sampling-profiler.h"
+#include "util/thread.h"
 
 #include "common/names.h"
 
+DECLARE_int32(max_sort_normalized_key_len);
+
+DEFINE_bool(datastream_recvr_spill_batches, false, "(Advanced) If true, an exchange "
+    "receiver whose buffer limit is exceeded writes incoming row batches to a spillable "
+    "tuple stream instead of blocking their sender, if block manager memory is "
+    "available.");
+DEFINE_int32(datastream_recvr_merge_fanout, 64, "(Advanced) Maximum number of senders "
+    "whose streams the receiver of a merging exchange merges on a single thread. A "
+    "receiver with more senders merges subsets of at most this many senders on separate "
+    "threads and merges the results of those merges. If 0, all streams are merged on a "
+    "single thread.");
+
 using boost::condition_variable;
+using strings::Substitute;
 
 namespace impala {
 
@@ -49,6 +69,11 @@ class DataStreamRecvr::SenderQueue {
   // the queue is considered full and the call blocks until a batch is dequeued.
   void AddBatch(const TRowBatch& batch);
 
+  // Same as above for a batch from a sender in this process. The rows of 'batch' are
+  // deep copied, or if 'acquire_state' is true, its resources are transferred and it
+  // is reset. See DataStreamRecvr::AddBatch().
+  void AddBatch(RowBatch* batch, bool acquire_state);
+
   // Decrement the number of remaining senders for this queue and signal eos ("new data")
   // if the count drops to 0. The number of senders will be 1 for a merging
   // DataStreamRecvr.
@@ -65,6 +90,37 @@ class DataStreamRecvr::SenderQueue {
   RowBatch* current_batch() const { return current_batch_.get(); }
 
  private:
+  // Returns true if spilled_stream_ has rows that were not returned yet.
+  bool HasSpilledRows() const {
+    return spilled_stream_.get() != NULL
+        && spilled_stream_->rows_returned() < spilled_stream_->num_rows();
+  }
+
+  // Returns true if a batch of 'batch_size' bytes must be spilled instead of being
+  // queued in memory or blocking its sender.
+  bool ShouldSpill(int batch_size) const {
+    return FLAGS_datastream_recvr_spill_batches && (HasSpilledRows()
+        || (!batch_queue_.empty() && recvr_->ExceedsLimit(batch_size)));
+  }
+
+  // Creates spilled_stream_ if it does not exist. Sets 'got_stream' to false if it
+  // could not be created because of a lack of memory. Must be called with lock_ held.
+  Status PrepareSpilledStream(bool* got_stream);
+
+  // Appends the rows of 'batch' to spilled_stream_. Must be called with lock_ held.
+  Status SpillRows(RowBatch* batch);
+
+  // Blocks until a batch of 'batch_size' bytes fits into the buffer limit, the queue is
+  // empty or the stream is cancelled. 'lock' must hold lock_.
+  void WaitForBufferSpace(int batch_size, unique_lock<mutex>* lock);
+
+  // Reads the next rows of spilled_stream_ into a new current_batch_. Closes the
+  // stream once all of its rows were returned. Must be called with lock_ held.
+  Status GetSpilledBatch();
+
+  // Returns current_batch_, if any, to the receiver's row batch pool.
+  void ReturnCurrentBatch();
+
   // Receiver of which this queue is a member.
   DataStreamRecvr* recvr_;
 
@@ -90,12 +146,20 @@ class DataStreamRecvr::SenderQueue {
   RowBatchQueue batch_queue_;
 
   // The batch that was most recently returned via GetBatch(), i.e. the current batch
-  // from this queue being processed by a consumer. Is destroyed when the next batch
-  // is retrieved.
+  // from this queue being processed by a consumer. Is returned to the receiver's row
+  // batch pool when the next batch is retrieved.
   scoped_ptr<RowBatch> current_batch_;
 
   // Set to true when the first batch has been received
   bool received_first_batch_;
+
+  // Unpinned stream of the received batches that did not fit into the buffer limit.
+  // Its rows were received after all batches in batch_queue_. NULL if no batch is
+  // spilled.
+  scoped_ptr<BufferedTupleStream> spilled_stream_;
+
+  // Error hit while spilling a batch. Returned by GetBatch(); later batches are dropped.
+  Status status_;
 };
 
 DataStreamRecvr::SenderQueue::SenderQueue(DataStreamRecvr* parent_recvr, int num_senders,
@@ -109,11 +173,13 @@ DataStreamRecvr::SenderQueue::SenderQueue(DataStreamRecvr* parent_recvr, int num
 Status DataStreamRecvr::SenderQueue::GetBatch(RowBatch** next_batch) {
   unique_lock<mutex> l(lock_);
   // wait until something shows up or we know we're done
-  while (!is_cancelled_ && batch_queue_.empty() && num_remaining_senders_ > 0) {
+  while (!is_cancelled_ && status_.ok() && batch_queue_.empty() && !HasSpilledRows()
+      && num_remaining_senders_ > 0) {
     VLOG_ROW << "wait arrival fragment_instance_id=" << recvr_->fragment_instance_id()
              << " node=" << recvr_->dest_node_id();
     // Don't count time spent waiting on the sender as active time.
     CANCEL_SAFE_SCOPED_TIMER(recvr_->data_arrival_timer_, &is_cancelled_);
+    SCOPED_WAIT_TIMER(NETWORK_WAIT);
     CANCEL_SAFE_SCOPED_TIMER(
         received_first_batch_ ? NULL : recvr_->first_batch_wait_total_timer_,
         &is_cancelled_);
@@ -121,9 +187,17 @@ Status DataStreamRecvr::SenderQueue::GetBatch(RowBatch** next_batch) {
   }
 
   // cur_batch_ must be replaced with the returned batch.
-  current_batch_.reset();
+  ReturnCurrentBatch();
   *next_batch = NULL;
   if (is_cancelled_) return Status::CANCELLED;
+  RETURN_IF_ERROR(status_);
+
+  if (batch_queue_.empty() && HasSpilledRows()) {
+    received_first_batch_ = true;
+    RETURN_IF_ERROR(GetSpilledBatch());
+    *next_batch = current_batch_.get();
+    return Status::OK();
+  }
 
   if (batch_queue_.empty()) {
     DCHECK_EQ(num_remaining_senders_, 0);
@@ -143,17 +217,167 @@ Status DataStreamRecvr::SenderQueue::GetBatch(RowBatch** next_batch) {
   return Status::OK();
 }
 
+Status DataStreamRecvr::SenderQueue::GetSpilledBatch() {
+  DCHECK(HasSpilledRows());
+  RowBatch spilled_batch(recvr_->row_desc(), recvr_->state_->batch_size(),
+      recvr_->mem_tracker());
+  bool eos;
+  RETURN_IF_ERROR(spilled_stream_->GetNext(&spilled_batch, &eos));
+  DCHECK_GT(spilled_batch.num_rows(), 0);
+  // The rows reference the stream's blocks, which are deleted as it is read. Copy them
+  // so that the batch stays valid for the consumer independent of later reads.
+  current_batch_.reset(new RowBatch(recvr_->row_desc(), spilled_batch.num_rows(),
+      recvr_->mem_tracker()));
+  spilled_batch.DeepCopyTo(current_batch_.get());
+  VLOG_ROW << "fetched spilled #rows=" << current_batch_->num_rows();
+  if (!HasSpilledRows()) {
+    // Free the stream's buffers until the next batch needs to be spilled.
+    spilled_stream_->Close();
+    spilled_stream_.reset();
+  }
+  return Status::OK();
+}
+
+Status DataStreamRecvr::SenderQueue::PrepareSpilledStream(bool* got_stream) {
+  *got_stream = spilled_stream_.get() != NULL;
+  if (!*got_stream) {
+    BufferedBlockMgr::Client* client;
+    RETURN_IF_ERROR(recvr_->GetBlockMgrClient(&client));
+    if (client == NULL) return Status::OK();
+    // The stream needs one block to start with and one more once it is read and written
+    // at the same time.
+    BufferedBlockMgr* block_mgr = recvr_->state_->block_mgr();
+    if (!block_mgr->TryAcquireTmpReservation(client, 2)) return Status::OK();
+    spilled_stream_.reset(new BufferedTupleStream(recvr_->state_, recvr_->row_desc(),
+        block_mgr, client, false /* use_initial_small_buffers */, true /* read_write */));
+    RETURN_IF_ERROR(spilled_stream_->Init(recvr_->dest_node_id(), NULL, false));
+    bool got_buffer;
+    RETURN_IF_ERROR(spilled_stream_->PrepareForRead(true, &got_buffer));
+    DCHECK(got_buffer);
+    *got_stream = true;
+  }
+  return Status::OK();
+}
+
+Status DataStreamRecvr::SenderQueue::SpillRows(RowBatch* batch) {
+  DCHECK(spilled_stream_.get() != NULL);
+  for (int i = 0; i < batch->num_rows(); ++i) {
+    Status status;
+    if (UNLIKELY(!spilled_stream_->AddRow(batch->GetRow(i), &status))) {
+      RETURN_IF_ERROR(status);
+      // A partially spilled batch cannot be queued without reordering rows.
+      status = Status::MemLimitExceeded();
+      status.AddDetail(Substitute("Exchange node (id=$0) could not get a buffer to "
+          "spill a received row batch.", recvr_->dest_node_id()));
+      return status;
+    }
+  }
+  VLOG_ROW << "spilled #rows=" << batch->num_rows();
+  COUNTER_ADD(recvr_->num_spilled_batches_counter_, 1);
+  return Status::OK();
+}
+
 void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
   unique_lock<mutex> l(lock_);
-  if (is_cancelled_) return;
+  if (is_cancelled_ || !status_.ok()) return;
 
   int batch_size = RowBatch::GetBatchSize(thrift_batch);
   COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
   DCHECK_GT(num_remaining_senders_, 0);
 
+  // Spill the batch instead of blocking the sender if it does not fit. Batches must
+  // also be spilled while earlier batches are spilled, to preserve the order of rows.
+  if (ShouldSpill(batch_size)) {
+    bool got_stream;
+    status_ = PrepareSpilledStream(&got_stream);
+    if (status_.ok() && got_stream) {
+      SCOPED_TIMER(recvr_->deserialize_row_batch_timer_);
+      // Close() cannot delete the mem tracker while lock_ is held, so the batch can be
+      // created and destroyed here, unlike the batches added to batch_queue_.
+      RowBatch batch(recvr_->row_desc(), thrift_batch, recvr_->mem_tracker());
+      status_ = SpillRows(&batch);
+    }
+    DCHECK(!status_.ok() || got_stream || !HasSpilledRows());
+    if (!status_.ok() || got_stream) {
+      data_arrival_cv_.notify_one();
+      return;
+    }
+  }
+
+  WaitForBufferSpace(batch_size, &l);
+  if (!is_cancelled_) {
+    RowBatch* batch = NULL;
+    {
+      SCOPED_TIMER(recvr_->deserialize_row_batch_timer_);
+      // Note: if this function makes a row batch, the batch *must* be added
+      // to batch_queue_. It is not valid to create the row batch and destroy
+      // it in this thread.
+      RowBatchPool* pool = recvr_->row_batch_pool_.get();
+      if (thrift_batch.num_rows <= pool->capacity()) {
+        batch = pool->Get();
+        batch->Deserialize(thrift_batch);
+      } else {
+        batch = new RowBatch(recvr_->row_desc(), thrift_batch, recvr_->mem_tracker());
+      }
+    }
+    VLOG_ROW << "added #rows=" << batch->num_rows()
+             << " batch_size=" << batch_size << "\n";
+    batch_queue_.push_back(make_pair(batch_size, batch));
+    recvr_->num_buffered_bytes_.Add(batch_size);
+    data_arrival_cv_.notify_one();
+  }
+}
+
+void DataStreamRecvr::SenderQueue::AddBatch(RowBatch* src, bool acquire_state) {
+  unique_lock<mutex> l(lock_);
+  if (is_cancelled_ || !status_.ok()) return;
+
+  int batch_size = src->TotalByteSize();
+  COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
+  DCHECK_GT(num_remaining_senders_, 0);
+
+  if (ShouldSpill(batch_size)) {
+    bool got_stream;
+    status_ = PrepareSpilledStream(&got_stream);
+    if (status_.ok() && got_stream) status_ = SpillRows(src);
+    DCHECK(!status_.ok() || got_stream || !HasSpilledRows());
+    if (!status_.ok() || got_stream) {
+      data_arrival_cv_.notify_one();
+      return;
+    }
+  }
+
+  WaitForBufferSpace(batch_size, &l);
+  if (!is_cancelled_) {
+    // As in AddBatch(const TRowBatch&), the batch is created with lock_ held and must
+    // be added to batch_queue_.
+    RowBatchPool* pool = recvr_->row_batch_pool_.get();
+    int capacity = acquire_state ? src->capacity() : src->num_rows();
+    RowBatch* batch;
+    // AcquireState() requires the same capacity, a deep copy only enough of it.
+    if (acquire_state ? capacity == pool->capacity() : capacity <= pool->capacity()) {
+      batch = pool->Get();
+    } else {
+      batch = new RowBatch(recvr_->row_desc(), capacity, recvr_->mem_tracker());
+    }
+    if (acquire_state) {
+      batch->AcquireState(src);
+    } else {
+      src->DeepCopyTo(batch);
+    }
+    VLOG_ROW << "added local #rows=" << batch->num_rows()
+             << " batch_size=" << batch_size << "\n";
+    batch_queue_.push_back(make_pair(batch_size, batch));
+    recvr_->num_buffered_bytes_.Add(batch_size);
+    data_arrival_cv_.notify_one();
+  }
+}
+
+void DataStreamRecvr::SenderQueue::WaitForBufferSpace(int batch_size,
+    unique_lock<mutex>* lock) {
   // if there's something in the queue and this batch will push us over the
   // buffer limit we need to wait until the batch gets drained.
-  // Note: It's important that we enqueue thrift_batch regardless of buffer limit if
+  // Note: It's important that we enqueue a batch regardless of buffer limit if
   // the queue is currently empty. In the case of a merging receiver, batches are
   // received from a specific queue based on data order, and the pipeline will stall
   // if the merger is waiting for data from an empty queue that cannot be filled because
@@ -172,10 +396,10 @@ void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
       try_mutex::scoped_try_lock timer_lock(recvr_->buffer_wall_timer_lock_);
       if (timer_lock) {
         CANCEL_SAFE_SCOPED_TIMER(recvr_->buffer_full_wall_timer_, &is_cancelled_);
-        data_removal__cv_.wait(l);
+        data_removal__cv_.wait(*lock);
         got_timer_lock = true;
       } else {
-        data_removal__cv_.wait(l);
+        data_removal__cv_.wait(*lock);
         got_timer_lock = false;
       }
     }
@@ -196,22 +420,6 @@ void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
     // practice, this time is small relative to the total wait time.
     if (got_timer_lock) data_removal__cv_.notify_one();
   }
-
-  if (!is_cancelled_) {
-    RowBatch* batch = NULL;
-    {
-      SCOPED_TIMER(recvr_->deserialize_row_batch_timer_);
-      // Note: if this function makes a row batch, the batch *must* be added
-      // to batch_queue_. It is not valid to create the row batch and destroy
-      // it in this thread.
-      batch = new RowBatch(recvr_->row_desc(), thrift_batch, recvr_->mem_tracker());
-    }
-    VLOG_ROW << "added #rows=" << batch->num_rows()
-             << " batch_size=" << batch_size << "\n";
-    batch_queue_.push_back(make_pair(batch_size, batch));
-    recvr_->num_buffered_bytes_.Add(batch_size);
-    data_arrival_cv_.notify_one();
-  }
 }
 
 void DataStreamRecvr::SenderQueue::DecrementSenders() {
@@ -252,26 +460,204 @@ void DataStreamRecvr::SenderQueue::Close() {
       it != batch_queue_.end(); ++it) {
     delete it->second;
   }
-  current_batch_.reset();
+  if (spilled_stream_.get() != NULL) spilled_stream_->Close();
+  ReturnCurrentBatch();
+}
+
+void DataStreamRecvr::SenderQueue::ReturnCurrentBatch() {
+  if (current_batch_.get() == NULL) return;
+  recvr_->row_batch_pool_->Return(current_batch_.release());
+}
+
+// Merges the streams of a subset of the senders on its own thread for the final merge
+// of a receiver that merges in two levels. The rows are deep copied into batches from
+// the receiver's row batch pool, so that the batches of the sender queues can be
+// recycled independently of the final merge. Up to MAX_QUEUED_BATCHES merged batches
+// are buffered ahead of the final merge.
+class DataStreamRecvr::IntermediateMerger {
+ public:
+  IntermediateMerger(DataStreamRecvr* recvr, RuntimeProfile* profile)
+    : recvr_(recvr),
+      profile_(profile),
+      output_queue_(MAX_QUEUED_BATCHES),
+      current_batch_(NULL) {
+  }
+
+  // Starts merging 'input_runs' in the order of 'less_than', whose exprs are cloned for
+  // the merge thread. The exprs must have been opened.
+  Status Start(const TupleRowComparator& less_than,
+      const vector<SortedRunMerger::RunBatchSupplier>& input_runs);
+
+  // Returns the next merged batch, or NULL at the end of the merge. Implements the
+  // RunBatchSupplier of the final merge. The batch is owned by this object until the
+  // next call.
+  Status GetBatch(RowBatch** next_batch);
+
+  // Stops the merge thread and returns all batches to the row batch pool. Must be called
+  // after the sender queues were cancelled, so that the thread doesn't wait for them.
+  void Close();
+
+  // Returns the batch that was most recently returned by GetBatch().
+  RowBatch* current_batch() const { return current_batch_; }
+
+ private:
+  static const int MAX_QUEUED_BATCHES = 2;
+
+  // Runs the merge on thread_ and queues the merged batches in output_queue_.
+  void MergeThread(vector<SortedRunMerger::RunBatchSupplier> input_runs);
+
+  DataStreamRecvr* recvr_;
+
+  // Profile of the mergers' counters, shared by all intermediate merges.
+  RuntimeProfile* profile_;
+
+  // Clones of the comparator's exprs and the comparator that evaluates them.
+  vector<ExprContext*> lhs_ctxs_;
+  vector<ExprContext*> rhs_ctxs_;
+  scoped_ptr<TupleRowComparator> less_than_;
+
+  scoped_ptr<SortedRunMerger> merger_;
+
+  // Merged batches, which are taken by GetBatch(). Shut down by the merge thread after
+  // the last batch and by Close().
+  BlockingQueue<RowBatch*> output_queue_;
+
+  scoped_ptr<Thread> thread_;
+
+  // Protects status_.
+  mutex lock_;
+
+  // The status of the merge, returned by GetBatch() after the last batch.
+  Status status_;
+
+  // The batch that was most recently returned by GetBatch(). Returned to the row batch
+  // pool by the next call.
+  RowBatch* current_batch_;
+};
+
+Status DataStreamRecvr::IntermediateMerger::Start(const TupleRowComparator& less_than,
+    const vector<SortedRunMerger::RunBatchSupplier>& input_runs) {
+  RETURN_IF_ERROR(Expr::CloneIfNotExists(
+      less_than.key_expr_ctxs_lhs(), recvr_->state_, &lhs_ctxs_));
+  RETURN_IF_ERROR(Expr::CloneIfNotExists(
+      less_than.key_expr_ctxs_rhs(), recvr_->state_, &rhs_ctxs_));
+  less_than_.reset(new TupleRowComparator(less_than, lhs_ctxs_, rhs_ctxs_));
+  merger_.reset(new SortedRunMerger(*less_than_, &recvr_->row_desc_, profile_, true,
+      FLAGS_max_sort_normalized_key_len));
+  thread_.reset(new Thread("datastream-recvr", "intermediate-merge",
+      &IntermediateMerger::MergeThread, this, input_runs));
+  return Status::OK();
+}
+
+void DataStreamRecvr::IntermediateMerger::MergeThread(
+    vector<SortedRunMerger::RunBatchSupplier> input_runs) {
+  SamplingProfiler::ScopedQueryTag query_tag(recvr_->state_->query_id());
+  // Prepare() waits for the first batch of each sender, in parallel with the other
+  // intermediate merges.
+  Status status = merger_->Prepare(input_runs);
+  bool eos = !status.ok();
+  while (!eos) {
+    RowBatch* batch = recvr_->row_batch_pool_->Get();
+    status = merger_->GetNext(batch, &eos);
+    if (!status.ok() || batch->num_rows() == 0) {
+      recvr_->row_batch_pool_->Return(batch);
+      if (!status.ok()) break;
+      continue;
+    }
+    if (!output_queue_.BlockingPut(batch)) {
+      // Close() shut the queue down.
+      recvr_->row_batch_pool_->Return(batch);
+      break;
+    }
+  }
+  {
+    lock_guard<mutex> l(lock_);
+    status_ = status;
+  }
+  output_queue_.Shutdown();
+}
+
+Status DataStreamRecvr::IntermediateMerger::GetBatch(RowBatch** next_batch) {
+  if (current_batch_ != NULL) {
+    recvr_->row_batch_pool_->Return(current_batch_);
+    current_batch_ = NULL;
+  }
+  *next_batch = NULL;
+  RowBatch* batch;
+  if (!output_queue_.BlockingGet(&batch)) {
+    lock_guard<mutex> l(lock_);
+    return status_;
+  }
+  current_batch_ = batch;
+  *next_batch = batch;
+  return Status::OK();
+}
+
+void DataStreamRecvr::IntermediateMerger::Close() {
+  output_queue_.Shutdown();
+  if (thread_.get() != NULL) thread_->Join();
+  RowBatch* batch;
+  while (output_queue_.BlockingGet(&batch)) recvr_->row_batch_pool_->Return(batch);
+  if (current_batch_ != NULL) {
+    recvr_->row_batch_pool_->Return(current_batch_);
+    current_batch_ = NULL;
+  }
+  merger_.reset();
+  Expr::Close(lhs_ctxs_, recvr_->state_);
+  Expr::Close(rhs_ctxs_, recvr_->state_);
 }
 
 Status DataStreamRecvr::CreateMerger(const TupleRowComparator& less_than) {
   DCHECK(is_merging_);
   vector<SortedRunMerger::RunBatchSupplier> input_batch_suppliers;
-  input_batch_suppliers.reserve(sender_queues_.size());
+  int fanout = FLAGS_datastream_recvr_merge_fanout;
+  if (fanout > 0 && sender_queues_.size() > fanout) {
+    // Each intermediate merge gets every num_mergers-th sender, so that the merges have
+    // at most 'fanout' senders and differ by at most one sender.
+    int num_mergers = (sender_queues_.size() + fanout - 1) / fanout;
+    vector<vector<SortedRunMerger::RunBatchSupplier> > merger_inputs(num_mergers);
+    for (int i = 0; i < sender_queues_.size(); ++i) {
+      merger_inputs[i % num_mergers].push_back(
+          bind(mem_fn(&SenderQueue::GetBatch), sender_queues_[i], _1));
+    }
+    RuntimeProfile* merges_profile =
+        state_->obj_pool()->Add(new RuntimeProfile(state_->obj_pool(),
+            "IntermediateMerges"));
+    profile_->AddChild(merges_profile);
+    input_batch_suppliers.reserve(num_mergers);
+    for (int i = 0; i < num_mergers; ++i) {
+      IntermediateMerger* merger =
+          sender_queue_pool_.Add(new IntermediateMerger(this, merges_profile));
+      intermediate_mergers_.push_back(merger);
+      RETURN_IF_ERROR(merger->Start(less_than, merger_inputs[i]));
+      input_batch_suppliers.push_back(
+          bind(mem_fn(&IntermediateMerger::GetBatch), merger, _1));
+    }
+  } else {
+    input_batch_suppliers.reserve(sender_queues_.size());
+    for (int i = 0; i < sender_queues_.size(); ++i) {
+      input_batch_suppliers.push_back(
+          bind(mem_fn(&SenderQueue::GetBatch), sender_queues_[i], _1));
+    }
+  }
 
   // Create the merger that will a single stream of sorted rows.
-  merger_.reset(new SortedRunMerger(less_than, &row_desc_, profile_, false));
-
-  for (int i = 0; i < sender_queues_.size(); ++i) {
-    input_batch_suppliers.push_back(
-        bind(mem_fn(&SenderQueue::GetBatch), sender_queues_[i], _1));
-  }
+  merger_.reset(new SortedRunMerger(less_than, &row_desc_, profile_, false,
+      FLAGS_max_sort_normalized_key_len));
   RETURN_IF_ERROR(merger_->Prepare(input_batch_suppliers));
   return Status::OK();
 }
 
 void DataStreamRecvr::TransferAllResources(RowBatch* transfer_batch) {
+  if (!intermediate_mergers_.empty()) {
+    // The intermediate merges deep copied the rows of the sender queues' batches.
+    for (IntermediateMerger* merger: intermediate_mergers_) {
+      if (merger->current_batch() != NULL) {
+        merger->current_batch()->TransferResourceOwnership(transfer_batch);
+      }
+    }
+    return;
+  }
   for (SenderQueue* sender_queue: sender_queues_) {
     if (sender_queue->current_batch() != NULL) {
       sender_queue->current_batch()->TransferResourceOwnership(transfer_batch);
@@ -279,19 +665,25 @@ void DataStreamRecvr::TransferAllResources(RowBatch* transfer_batch) {
   }
 }
 
-DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_tracker,
-    const RowDescriptor& row_desc, const TUniqueId& fragment_instance_id,
-    PlanNodeId dest_node_id, int num_senders, bool is_merging, int total_buffer_limit,
-    RuntimeProfile* profile)
+DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, RuntimeState* state,
+    MemTracker* parent_tracker, const RowDescriptor& row_desc,
+    const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id, int num_senders,
+    bool is_merging, int total_buffer_limit, RuntimeProfile* profile)
   : mgr_(stream_mgr),
+    state_(state),
     fragment_instance_id_(fragment_instance_id),
     dest_node_id_(dest_node_id),
     total_buffer_limit_(total_buffer_limit),
     row_desc_(row_desc),
     is_merging_(is_merging),
     num_buffered_bytes_(0),
+    is_cancelled_(false),
+    block_mgr_client_(NULL),
+    client_registered_(false),
     profile_(profile) {
   mem_tracker_.reset(new MemTracker(-1, -1, "DataStreamRecvr", parent_tracker));
+  row_batch_pool_.reset(new RowBatchPool(row_desc_, state->batch_size(),
+      mem_tracker_.get(), MAX_FREE_ROW_BATCHES));
   // Create one queue per sender if is_merging is true.
   int num_queues = is_merging ? num_senders : 1;
   sender_queues_.reserve(num_queues);
@@ -313,6 +705,22 @@ DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_t
   buffer_full_total_timer_ = ADD_TIMER(profile_, "SendersBlockedTotalTimer(*)");
   data_arrival_timer_ = profile_->inactive_timer();
   first_batch_wait_total_timer_ = ADD_TIMER(profile_, "FirstBatchArrivalWaitTime");
+  num_spilled_batches_counter_ =
+      ADD_COUNTER(profile_, "SpilledRowBatches", TUnit::UNIT);
+}
+
+Status DataStreamRecvr::GetBlockMgrClient(BufferedBlockMgr::Client** client) {
+  lock_guard<mutex> l(block_mgr_client_lock_);
+  if (!client_registered_) {
+    client_registered_ = true;
+    if (state_->block_mgr() != NULL) {
+      RETURN_IF_ERROR(state_->block_mgr()->RegisterClient(
+          Substitute("DataStreamRecvr node=$0 ptr=$1", dest_node_id_, this), 0, false,
+          mem_tracker_.get(), state_, &block_mgr_client_));
+    }
+  }
+  *client = block_mgr_client_;
+  return Status::OK();
 }
 
 Status DataStreamRecvr::GetNext(RowBatch* output_batch, bool* eos) {
@@ -326,12 +734,18 @@ void DataStreamRecvr::AddBatch(const TRowBatch& thrift_batch, int sender_id) {
   sender_queues_[use_sender_id]->AddBatch(thrift_batch);
 }
 
+void DataStreamRecvr::AddBatch(RowBatch* batch, int sender_id, bool acquire_state) {
+  int use_sender_id = is_merging_ ? sender_id : 0;
+  sender_queues_[use_sender_id]->AddBatch(batch, acquire_state);
+}
+
 void DataStreamRecvr::RemoveSender(int sender_id) {
   int use_sender_id = is_merging_ ? sender_id : 0;
   sender_queues_[use_sender_id]->DecrementSenders();
 }
 
 void DataStreamRecvr::CancelStream() {
+  is_cancelled_ = true;
   for (int i = 0; i < sender_queues_.size(); ++i) {
     sender_queues_[i]->Cancel();
   }
@@ -342,10 +756,16 @@ void DataStreamRecvr::Close() {
   // TODO: log error msg
   mgr_->DeregisterRecvr(fragment_instance_id(), dest_node_id());
   mgr_ = NULL;
+  // Deregistering cancelled the sender queues, which stops the intermediate merges.
+  for (IntermediateMerger* merger: intermediate_mergers_) merger->Close();
   for (int i = 0; i < sender_queues_.size(); ++i) {
     sender_queues_[i]->Close();
   }
+  if (block_mgr_client_ != NULL) {
+    state_->block_mgr()->ClearReservations(block_mgr_client_);
+  }
   merger_.reset();
+  row_batch_pool_.reset();
   mem_tracker_->UnregisterFromParent();
   mem_tracker_.reset();
 }
@@ -22,6 +22,7 @@
 #include "common/status.h"
 #include "gen-cpp/Types_types.h"   // for TUniqueId
 #include "gen-cpp/Results_types.h" // for TRowBatch
+#include "runtime/buffered-block-mgr.h"
 #include "runtime/descriptors.h"
 #include "util/tuple-row-compare.h"
 
@@ -31,7 +32,9 @@ class DataStreamMgr;
 class SortedRunMerger;
 class MemTracker;
 class RowBatch;
+class RowBatchPool;
 class RuntimeProfile;
+class RuntimeState;
 
 /// Single receiver of an m:n data stream.
 /// DataStreamRecvr maintains one or more queues of row batches received by a
@@ -54,6 +57,16 @@ class RuntimeProfile;
 /// The receiver sets deep_copy to false on the merger - resources are transferred from
 /// the input batches from each sender queue to the merger to the output batch by the
 /// merger itself as it processes each run.
+/// A receiver with more than --datastream_recvr_merge_fanout senders merges in two
+/// levels, so that a single thread doesn't merge the streams of hundreds of senders:
+/// intermediate merges on their own threads each merge a subset of the senders, deep
+/// copying the rows into batches that the final merge in GetNext() consumes.
+//
+/// With --datastream_recvr_spill_batches, a sender queue that would exceed the buffer
+/// limit writes the incoming batch to an unpinned BufferedTupleStream instead of
+/// blocking the sender. Batches that arrive while the queue has spilled rows are spilled
+/// as well to preserve their order. The spilled rows are returned after the in-memory
+/// batches. If no block mgr buffer is available, the sender is blocked as before.
 //
 /// DataStreamRecvr::Close() must be called by the caller of CreateRecvr() to remove the
 /// recvr instance from the tracking structure of its DataStreamMgr in all cases.
@@ -72,6 +85,15 @@ class DataStreamRecvr {
   /// Deregister from DataStreamMgr instance, which shares ownership of this instance.
   void Close();
 
+  /// Empties the sender queues and notifies all waiting consumers and producers of
+  /// cancellation. Called from DataStreamMgr, or by the exchange node once it doesn't
+  /// need any more rows, so that the senders stop sending (see
+  /// DataStreamMgr::IsRecvrClosed()).
+  void CancelStream();
+
+  /// True once CancelStream() was called.
+  bool is_cancelled() const { return is_cancelled_; }
+
   /// Create a SortedRunMerger instance to merge rows from multiple sender according to the
   /// specified row comparator. Fetches the first batches from the individual sender
   /// queues. The exprs used in less_than must have already been prepared and opened.
@@ -82,7 +104,7 @@ class DataStreamRecvr {
   Status GetNext(RowBatch* output_batch, bool* eos);
 
   /// Transfer all resources from the current batches being processed from each sender
-  /// queue to the specified batch.
+  /// queue, or from each intermediate merge, to the specified batch.
   void TransferAllResources(RowBatch* transfer_batch);
 
   const TUniqueId& fragment_instance_id() const { return fragment_instance_id_; }
@@ -92,33 +114,47 @@ class DataStreamRecvr {
 
  private:
   friend class DataStreamMgr;
+
+  /// Maximum number of free batches kept by row_batch_pool_.
+  static const int MAX_FREE_ROW_BATCHES = 4;
   class SenderQueue;
+  class IntermediateMerger;
 
-  DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_tracker,
-      const RowDescriptor& row_desc, const TUniqueId& fragment_instance_id,
-      PlanNodeId dest_node_id, int num_senders, bool is_merging, int total_buffer_limit,
-      RuntimeProfile* profile);
+  DataStreamRecvr(DataStreamMgr* stream_mgr, RuntimeState* state,
+      MemTracker* parent_tracker, const RowDescriptor& row_desc,
+      const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id, int num_senders,
+      bool is_merging, int total_buffer_limit, RuntimeProfile* profile);
 
   /// Add a new batch of rows to the appropriate sender queue, blocking if the queue is
   /// full. Called from DataStreamMgr.
   void AddBatch(const TRowBatch& thrift_batch, int sender_id);
 
+  /// Same as above for a batch of a sender in this process, which avoids serializing
+  /// it. The rows of 'batch' are deep copied. If 'acquire_state' is true, 'batch' must
+  /// own all memory its rows reference; its resources are then transferred instead and
+  /// it is reset. Called from DataStreamMgr.
+  void AddBatch(RowBatch* batch, int sender_id, bool acquire_state);
+
   /// Indicate that a particular sender is done. Delegated to the appropriate
   /// sender queue. Called from DataStreamMgr.
   void RemoveSender(int sender_id);
 
-  /// Empties the sender queues and notifies all waiting consumers of cancellation.
-  void CancelStream();
-
   /// Return true if the addition of a new batch of size 'batch_size' would exceed the
   /// total buffer limit.
   bool ExceedsLimit(int batch_size) {
     return num_buffered_bytes_.Load() + batch_size > total_buffer_limit_;
   }
 
+  /// Registers block_mgr_client_ on the first call. Sets 'client' to NULL if batches
+  /// cannot be spilled.
+  Status GetBlockMgrClient(BufferedBlockMgr::Client** client);
+
   /// DataStreamMgr instance used to create this recvr. (Not owned)
   DataStreamMgr* mgr_;
 
+  /// State of the fragment instance of the exchange node. (Not owned)
+  RuntimeState* state_;
+
   /// Fragment and node id of the destination exchange node this receiver is used by.
   TUniqueId fragment_instance_id_;
   PlanNodeId dest_node_id_;
@@ -138,9 +174,17 @@ class DataStreamRecvr {
   /// total number of bytes held across all sender queues.
   AtomicInt32 num_buffered_bytes_;
 
+  /// Set by CancelStream(). Read without a lock by DataStreamMgr::IsRecvrClosed().
+  volatile bool is_cancelled_;
+
   /// Memtracker for batches in the sender queue(s).
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
+  /// Recycles the batches of the sender queues once the consumer is done with them.
+  /// Batches with state_->batch_size() capacity come from here. Destroyed in Close()
+  /// before mem_tracker_.
+  boost::scoped_ptr<RowBatchPool> row_batch_pool_;
+
   /// One or more queues of row batches received from senders. If is_merging_ is true,
   /// there is one SenderQueue for each sender. Otherwise, row batches from all senders
   /// are placed in the same SenderQueue. The SenderQueue instances are owned by the
@@ -150,9 +194,22 @@ class DataStreamRecvr {
   /// SortedRunMerger used to merge rows from different senders.
   boost::scoped_ptr<SortedRunMerger> merger_;
 
-  /// Pool of sender queues.
+  /// The intermediate merges whose output merger_ merges, if the receiver merges in two
+  /// levels. Otherwise empty and merger_ merges the sender queues. Owned by
+  /// sender_queue_pool_.
+  std::vector<IntermediateMerger*> intermediate_mergers_;
+
+  /// Pool of sender queues and intermediate mergers.
   ObjectPool sender_queue_pool_;
 
+  /// Protects block_mgr_client_ and client_registered_.
+  boost::mutex block_mgr_client_lock_;
+
+  /// Client of the streams that sender queues spill batches to. Registered on the first
+  /// spill.
+  BufferedBlockMgr::Client* block_mgr_client_;
+  bool client_registered_;
+
   /// Runtime profile storing the counters below.
   RuntimeProfile* profile_;
 
@@ -186,6 +243,9 @@ class DataStreamRecvr {
 
   /// Total time spent waiting for data to arrive in the recv buffer
   RuntimeProfile::Counter* data_arrival_timer_;
+
+  /// Number of received batches that were written to a spilled stream.
+  RuntimeProfile::Counter* num_spilled_batches_counter_;
 };
 
 }
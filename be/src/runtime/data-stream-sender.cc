@@ -14,8 +14,10 @@
 
 #include "runtime/data-stream-sender.h"
 
+#include <iomanip>
 #include <iostream>
 #include <boost/shared_ptr.hpp>
+#include <gutil/strings/substitute.h>
 #include <thrift/protocol/TDebugProtocol.h>
 
 #include "common/logging.h"
@@ -27,10 +29,18 @@
 #include "runtime/raw-value.inline.h"
 #include "runtime/runtime-state.h"
 #include "runtime/client-cache.h"
+#include "runtime/data-stream-mgr.h"
+#include "runtime/exec-env.h"
 #include "runtime/mem-tracker.h"
 #include "runtime/backend-client.h"
+#include "scheduling/scheduler.h"
+#include "util/count-min-sketch.h"
 #include "util/debug-util.h"
+#include "util/histogram-metric.h"
+#include "util/impalad-metrics.h"
 #include "util/network-util.h"
+#include "util/spinlock.h"
+#include "util/stopwatch.h"
 #include "rpc/thrift-client.h"
 #include "rpc/thrift-util.h"
 
@@ -40,20 +50,126 @@
 
 #include "common/names.h"
 
+DEFINE_int32(datastream_sender_max_in_flight_batches, 2, "(Advanced) Maximum number of "
+    "serialized row batches per channel of a data stream sender that are queued or being "
+    "transmitted. The sender blocks when a channel reaches this number.");
+DEFINE_bool(datastream_sender_adaptive_compression, false, "(Advanced) If true, data "
+    "stream senders only LZ4-compress the row batches of a channel while the transmit "
+    "time saved by compression is estimated to exceed the time spent compressing, based "
+    "on the observed compression ratio, compression throughput and rpc throughput. If "
+    "false, all row batches are compressed.");
+DEFINE_double(datastream_sender_heavy_hitter_fraction, 0.05, "(Advanced) Fraction of "
+    "the sampled rows of a hash-partitioning data stream sender above which a partition "
+    "key is reported in the sender's profile as a heavy hitter. 0 disables detection.");
+DEFINE_bool(datastream_local_exchange, false, "(Advanced) If true, data stream senders "
+    "pass row batches for receivers in the same impalad directly to the receiver instead "
+    "of serializing them and sending them with an rpc.");
+
 using boost::condition_variable;
 using namespace apache::thrift;
 using namespace apache::thrift::protocol;
 using namespace apache::thrift::transport;
+using strings::Substitute;
 
 namespace impala {
 
+// Weight of a new sample in the moving averages of CompressionPolicy.
+static const double COMPRESSION_SAMPLE_WEIGHT = 0.25;
+
+// Starts the error of a TransmitData() rpc that could not reach the receiving backend,
+// followed by the backend's address.
+static const string UNREACHABLE_BACKEND_MSG = "Unreachable backend ";
+
+// Decides whether the row batches sent on one or more channels are LZ4-compressed.
+// Compressing a batch pays off if the transmit time it saves is larger than the time
+// spent compressing it. With the observed ratio r of compressed to uncompressed size,
+// compression throughput c and rpc throughput n, that is the case if (1 - r) * c > n.
+// The time to decompress on the receiver is ignored since LZ4 decompresses much faster
+// than it compresses. The rpc time includes the time the receiver withholds its reply,
+// so a slow receiver favours compression.
+// While compression is off, every SAMPLE_INTERVAL-th batch is still compressed to
+// follow changes of the data.
+// Thread-safe: samples of rpcs are added by the rpc threads of the channels.
+class DataStreamSender::CompressionPolicy {
+ public:
+  CompressionPolicy()
+    : compression_ratio_(-1),
+      compression_bytes_per_ns_(-1),
+      transmit_bytes_per_ns_(-1),
+      compress_(true),
+      batches_since_sample_(0) {
+  }
+
+  // Returns true if the next batch should be compressed.
+  bool ShouldCompress() {
+    if (!FLAGS_datastream_sender_adaptive_compression) return true;
+    lock_guard<SpinLock> l(lock_);
+    if (compress_ || ++batches_since_sample_ >= SAMPLE_INTERVAL) {
+      batches_since_sample_ = 0;
+      return true;
+    }
+    return false;
+  }
+
+  // Adds the sizes of a batch before and after compression and the compression time.
+  void AddCompressionSample(int64_t uncompressed_bytes, int64_t compressed_bytes,
+      int64_t time_ns) {
+    if (uncompressed_bytes == 0 || time_ns == 0) return;
+    lock_guard<SpinLock> l(lock_);
+    UpdateAverage(static_cast<double>(compressed_bytes) / uncompressed_bytes,
+        &compression_ratio_);
+    UpdateAverage(static_cast<double>(uncompressed_bytes) / time_ns,
+        &compression_bytes_per_ns_);
+    UpdateDecision();
+  }
+
+  // Adds the size of a transmitted batch and the time of its rpc.
+  void AddTransmitSample(int64_t bytes, int64_t time_ns) {
+    if (bytes == 0 || time_ns == 0) return;
+    lock_guard<SpinLock> l(lock_);
+    UpdateAverage(static_cast<double>(bytes) / time_ns, &transmit_bytes_per_ns_);
+    UpdateDecision();
+  }
+
+ private:
+  static const int SAMPLE_INTERVAL = 16;
+
+  static void UpdateAverage(double sample, double* avg) {
+    *avg = *avg < 0 ? sample
+        : (1 - COMPRESSION_SAMPLE_WEIGHT) * *avg + COMPRESSION_SAMPLE_WEIGHT * sample;
+  }
+
+  void UpdateDecision() {
+    if (compression_ratio_ < 0 || transmit_bytes_per_ns_ < 0) return;
+    compress_ = (1 - compression_ratio_) * compression_bytes_per_ns_
+        > transmit_bytes_per_ns_;
+  }
+
+  SpinLock lock_;
+
+  // Moving averages of the samples, -1 until the first sample.
+  double compression_ratio_;
+  double compression_bytes_per_ns_;
+  double transmit_bytes_per_ns_;
+
+  bool compress_;
+  int batches_since_sample_;
+};
+
 // A channel sends data asynchronously via calls to TransmitData
 // to a single destination ipaddress/node.
 // It has a fixed-capacity buffer and allows the caller either to add rows to
 // that buffer individually (AddRow()), or circumvent the buffer altogether and send
-// TRowBatches directly (SendBatch()). Either way, there can only be one in-flight RPC
-// at any one time (ie, sending will block if the most recent rpc hasn't finished,
-// which allows the receiver node to throttle the sender by withholding acks).
+// TRowBatches directly (SendBatch()). Either way, up to
+// --datastream_sender_max_in_flight_batches batches are queued for the rpc thread,
+// which sends them one at a time and in order (ie, sending will block if that many
+// rpcs haven't finished, which allows the receiver node to throttle the sender by
+// withholding acks).
+// If the receiver is in this process and --datastream_local_exchange is set, batches
+// are instead added to it synchronously through the DataStreamMgr, without serializing
+// them.
+// Once the receiver reports that it is closed, e.g. because its exchange node reached
+// its limit, further rows and batches are dropped instead of sent.
 // *Not* thread-safe.
 class DataStreamSender::Channel {
  public:
@@ -72,9 +188,16 @@ class DataStreamSender::Channel {
       fragment_instance_id_(fragment_instance_id),
       dest_node_id_(dest_node_id),
       num_data_bytes_sent_(0),
-      rpc_thread_("DataStreamSender", "SenderThread", 1, 1,
+      compression_policy_(NULL),
+      is_local_(false),
+      stream_mgr_(NULL),
+      recvr_closed_(false),
+      max_rpcs_in_flight_(max(FLAGS_datastream_sender_max_in_flight_batches, 1)),
+      thrift_batches_(max_rpcs_in_flight_),
+      next_thrift_batch_idx_(0),
+      rpc_thread_("DataStreamSender", "SenderThread", 1, max_rpcs_in_flight_,
           bind<void>(mem_fn(&Channel::TransmitData), this, _1, _2)),
-      rpc_in_flight_(false) {
+      num_rpcs_in_flight_(0) {
   }
 
   // Initialize channel.
@@ -86,18 +209,25 @@ class DataStreamSender::Channel {
   // Returns error status if any of the preceding rpcs failed, OK otherwise.
   Status AddRow(TupleRow* row);
 
-  // Asynchronously sends a row batch.
-  // Returns the status of the most recently finished TransmitData
-  // rpc (or OK if there wasn't one that hasn't been reported yet).
+  // Asynchronously sends a row batch. Waits until fewer than max_rpcs_in_flight_ rpcs
+  // are in flight. 'batch' must not be modified until that many later batches have
+  // been passed to SendBatch().
+  // Returns the status of the first failed TransmitData rpc (or OK if none has failed
+  // so far).
   Status SendBatch(TRowBatch* batch);
 
-  // Return status of last TransmitData rpc (initiated by the most recent call
-  // to either SendBatch() or SendCurrentBatch()).
+  // Waits for all in-flight rpcs to finish and returns the status of the first failed
+  // TransmitData rpc (or OK).
   Status GetSendStatus();
 
-  // Waits for the rpc thread pool to finish the current rpc.
+  // Waits for the rpc thread pool to finish all in-flight rpcs.
   void WaitForRpc();
 
+  // Returns one of this channel's thrift batches that is not referenced by an
+  // in-flight rpc, to be serialized into and passed to SendBatch(). Waits for an rpc
+  // to finish if needed.
+  TRowBatch* GetFreeThriftBatch();
+
   // Drain and shutdown the rpc thread and free the row batch allocation.
   void Teardown(RuntimeState* state);
 
@@ -105,7 +235,19 @@ class DataStreamSender::Channel {
   Status FlushAndSendEos(RuntimeState* state);
 
   int64_t num_data_bytes_sent() const { return num_data_bytes_sent_; }
-  TRowBatch* thrift_batch() { return &thrift_batch_; }
+
+  CompressionPolicy* compression_policy() { return compression_policy_; }
+
+  // True if the receiver is in this process and batches are passed to it directly.
+  bool is_local() const { return is_local_; }
+
+  // True if the receiver doesn't need any more rows.
+  bool recvr_closed() const { return recvr_closed_; }
+
+  // Passes 'batch' to the local receiver. If 'acquire_state' is true, the receiver
+  // takes over the resources of 'batch', which must own all memory its rows reference.
+  // Otherwise the rows are deep copied.
+  Status SendLocalBatch(RowBatch* batch, bool acquire_state);
 
  private:
   DataStreamSender* parent_;
@@ -123,20 +265,45 @@ class DataStreamSender::Channel {
 
   // we're accumulating rows into this batch
   scoped_ptr<RowBatch> batch_;
-  TRowBatch thrift_batch_;
 
-  // We want to reuse the rpc thread to prevent creating a thread per rowbatch.
-  // TODO: currently we only have one batch in flight, but we should buffer more
-  // batches. This is a bit tricky since the channels share the outgoing batch
-  // pointer we need some mechanism to coordinate when the batch is all done.
+  // Decides on the compression of the batches sent on this channel. Points to
+  // parent_->compression_policy_ if the sender serializes the batches once for all
+  // channels, otherwise to own_compression_policy_.
+  CompressionPolicy* compression_policy_;
+  scoped_ptr<CompressionPolicy> own_compression_policy_;
+
+  // True if the destination is this impalad and --datastream_local_exchange is set.
+  // Batches are then added to the receiver via stream_mgr_ without rpcs.
+  bool is_local_;
+  DataStreamMgr* stream_mgr_;
+
+  // Set once a TransmitData() reply or the local DataStreamMgr reported that the
+  // receiver is closed. Set by the rpc thread.
+  volatile bool recvr_closed_;
+
+  // Maximum number of batches that are queued or being sent by rpc_thread_.
+  const int max_rpcs_in_flight_;
+
+  // Serialized batches of AddRow() and GetFreeThriftBatch(), used as a ring. Since
+  // rpcs finish in order, the batch at next_thrift_batch_idx_ is the least recently
+  // sent one and is free once fewer than max_rpcs_in_flight_ rpcs are in flight.
+  vector<TRowBatch> thrift_batches_;
+  int next_thrift_batch_idx_;
+
+  // We want to reuse the rpc thread to prevent creating a thread per rowbatch. There is
+  // a single thread so that batches arrive in the order they were sent.
   // TODO: if the order of row batches does not matter, we can consider increasing
   // the number of threads.
   ThreadPool<TRowBatch*> rpc_thread_; // sender thread.
-  condition_variable rpc_done_cv_;   // signaled when rpc_in_flight_ is set to true.
-  mutex rpc_thread_lock_; // Lock with rpc_done_cv_ protecting rpc_in_flight_
-  bool rpc_in_flight_;  // true if the rpc_thread_ is busy sending.
+  condition_variable rpc_done_cv_;   // signaled when an rpc finishes.
+  // Lock with rpc_done_cv_ protecting num_rpcs_in_flight_ and rpc_status_.
+  mutex rpc_thread_lock_;
+  int num_rpcs_in_flight_;  // number of batches queued or being sent by rpc_thread_.
 
-  Status rpc_status_;  // status of most recently finished TransmitData rpc
+  Status rpc_status_;  // status of the first failed TransmitData rpc, or OK
+
+  // Waits until fewer than max_rpcs_in_flight_ rpcs are in flight.
+  void WaitForFreeSlot();
 
   // Serialize batch_ into thrift_batch_ and send via SendBatch().
   // Returns SendBatch() status.
@@ -145,8 +312,22 @@ class DataStreamSender::Channel {
   // Synchronously call TransmitData() on a client from client_cache_ and update
   // rpc_status_ based on return value (or set to error if RPC failed).
   // Called from a thread from the rpc_thread_ pool.
-  void TransmitData(int thread_id, const TRowBatch*);
-  void TransmitDataHelper(const TRowBatch*);
+  void TransmitData(int thread_id, TRowBatch*);
+  Status TransmitDataHelper(TRowBatch*);
+
+  // Sends 'params' with a client from client_cache_.
+  Status DoTransmitDataRpc(const TTransmitDataParams& params);
+
+  // Blacklists address_ in this process's scheduler, which failed to connect with
+  // 'cause', and returns the error that reports it to the coordinator.
+  Status UnreachableBackend(const Status& cause);
+
+  // Returns true if 'batch' is one of thrift_batches_, i.e. it is not shared with
+  // other channels.
+  bool OwnsThriftBatch(const TRowBatch* batch) const {
+    return batch >= &thrift_batches_[0]
+        && batch < &thrift_batches_[0] + thrift_batches_.size();
+  }
 };
 
 Status DataStreamSender::Channel::Init(RuntimeState* state) {
@@ -154,37 +335,52 @@ Status DataStreamSender::Channel::Init(RuntimeState* state) {
   // TODO: figure out how to size batch_
   int capacity = max(1, buffer_size_ / max(row_desc_.GetRowSize(), 1));
   batch_.reset(new RowBatch(row_desc_, capacity, parent_->mem_tracker_.get()));
+  if (parent_->broadcast_ || parent_->channels_.size() == 1) {
+    compression_policy_ = parent_->compression_policy_.get();
+  } else {
+    own_compression_policy_.reset(new CompressionPolicy());
+    compression_policy_ = own_compression_policy_.get();
+  }
+  is_local_ = FLAGS_datastream_local_exchange
+      && address_ == state->exec_env()->backend_address();
+  stream_mgr_ = state->stream_mgr();
   return Status::OK();
 }
 
 Status DataStreamSender::Channel::SendBatch(TRowBatch* batch) {
   VLOG_ROW << "Channel::SendBatch() instance_id=" << fragment_instance_id_
            << " dest_node=" << dest_node_id_ << " #rows=" << batch->num_rows;
-  // return if the previous batch saw an error
-  RETURN_IF_ERROR(GetSendStatus());
+  if (recvr_closed_) return Status::OK();
+  WaitForFreeSlot();
   {
     unique_lock<mutex> l(rpc_thread_lock_);
-    rpc_in_flight_ = true;
+    // return if a previous batch saw an error
+    if (!rpc_status_.ok()) {
+      LOG(ERROR) << "channel send status: " << rpc_status_.GetDetail();
+      return rpc_status_;
+    }
+    ++num_rpcs_in_flight_;
+    parent_->peak_send_queue_depth_->Set(num_rpcs_in_flight_);
   }
   if (!rpc_thread_.Offer(batch)) {
     unique_lock<mutex> l(rpc_thread_lock_);
-    rpc_in_flight_ = false;
+    --num_rpcs_in_flight_;
   }
   return Status::OK();
 }
 
-void DataStreamSender::Channel::TransmitData(int thread_id, const TRowBatch* batch) {
-  DCHECK(rpc_in_flight_);
-  TransmitDataHelper(batch);
-
+void DataStreamSender::Channel::TransmitData(int thread_id, TRowBatch* batch) {
+  Status status = TransmitDataHelper(batch);
   {
     unique_lock<mutex> l(rpc_thread_lock_);
-    rpc_in_flight_ = false;
+    DCHECK_GT(num_rpcs_in_flight_, 0);
+    if (rpc_status_.ok()) rpc_status_ = status;
+    --num_rpcs_in_flight_;
   }
   rpc_done_cv_.notify_one();
 }
 
-void DataStreamSender::Channel::TransmitDataHelper(const TRowBatch* batch) {
+Status DataStreamSender::Channel::TransmitDataHelper(TRowBatch* batch) {
   DCHECK(batch != NULL);
   VLOG_ROW << "Channel::TransmitData() instance_id=" << fragment_instance_id_
            << " dest_node=" << dest_node_id_
@@ -193,43 +389,106 @@ void DataStreamSender::Channel::TransmitDataHelper(const TRowBatch* batch) {
   params.protocol_version = ImpalaInternalServiceVersion::V1;
   params.__set_dest_fragment_instance_id(fragment_instance_id_);
   params.__set_dest_node_id(dest_node_id_);
-  params.__set_row_batch(*batch);  // yet another copy
   params.__set_eos(false);
   params.__set_sender_id(parent_->sender_id_);
 
-  ImpalaBackendConnection client(client_cache_, address_, &rpc_status_);
-  if (!rpc_status_.ok()) return;
+  // A batch of this channel is only referenced by this rpc, so its data is moved into
+  // the params instead of copied, and moved back afterwards so that its buffers are
+  // reused by the next Serialize(). Broadcast batches are shared by all channels.
+  Status status;
+  MonotonicStopWatch rpc_timer;
+  bool owns_batch = OwnsThriftBatch(batch);
+  if (owns_batch) {
+    params.__isset.row_batch = true;
+    swap(params.row_batch, *batch);
+    rpc_timer.Start();
+    status = DoTransmitDataRpc(params);
+    rpc_timer.Stop();
+    swap(params.row_batch, *batch);
+  } else {
+    params.__set_row_batch(*batch);  // yet another copy
+    rpc_timer.Start();
+    status = DoTransmitDataRpc(params);
+    rpc_timer.Stop();
+  }
+  if (ImpaladMetrics::DATA_STREAM_SENDER_TRANSMIT_DATA_LATENCIES != NULL) {
+    ImpaladMetrics::DATA_STREAM_SENDER_TRANSMIT_DATA_LATENCIES->Update(
+        rpc_timer.ElapsedTime());
+  }
+  RETURN_IF_ERROR(status);
+  int64_t batch_size = RowBatch::GetBatchSize(*batch);
+  compression_policy_->AddTransmitSample(batch_size, rpc_timer.ElapsedTime());
+  num_data_bytes_sent_ += batch_size;
+  VLOG_ROW << "incremented #data_bytes_sent="
+           << num_data_bytes_sent_;
+  return Status::OK();
+}
+
+Status DataStreamSender::Channel::DoTransmitDataRpc(const TTransmitDataParams& params) {
+  Status status;
+  ImpalaBackendConnection client(client_cache_, address_, &status);
+  if (!status.ok()) return UnreachableBackend(status);
 
   TTransmitDataResult res;
   client->SetTransmitDataCounter(parent_->thrift_transmit_timer_);
-  rpc_status_ =
-      client.DoRpc(&ImpalaBackendClient::TransmitData, params, &res);
+  status = client.DoRpc(&ImpalaBackendClient::TransmitData, params, &res);
   client->ResetTransmitDataCounter();
-  if (!rpc_status_.ok()) return;
+  if (status.code() == TErrorCode::RPC_CLIENT_CONNECT_FAILURE) {
+    return UnreachableBackend(status);
+  }
+  RETURN_IF_ERROR(status);
   COUNTER_ADD(parent_->profile_->total_time_counter(),
       parent_->thrift_transmit_timer_->LapTime());
-
-  if (res.status.status_code != TErrorCode::OK) {
-    rpc_status_ = res.status;
-  } else {
-    num_data_bytes_sent_ += RowBatch::GetBatchSize(*batch);
-    VLOG_ROW << "incremented #data_bytes_sent="
-             << num_data_bytes_sent_;
+  if (res.status.status_code != TErrorCode::OK) return Status(res.status);
+  if (!res.status.error_msgs.empty()
+      && res.status.error_msgs[0] == DataStreamMgr::RECVR_CLOSED_MSG) {
+    VLOG_QUERY << "Receiver closed: instance_id=" << fragment_instance_id_
+               << " dest_node=" << dest_node_id_;
+    recvr_closed_ = true;
   }
+  return Status::OK();
+}
+
+Status DataStreamSender::Channel::UnreachableBackend(const Status& cause) {
+  VLOG_QUERY << "Could not reach " << address_ << " to send to instance_id="
+             << fragment_instance_id_ << ": " << cause.GetDetail();
+  Scheduler* scheduler = parent_->state_->exec_env()->scheduler();
+  if (scheduler != NULL) scheduler->BlacklistBackend(address_);
+  return UnreachableBackendError(address_, cause);
 }
 
 void DataStreamSender::Channel::WaitForRpc() {
   SCOPED_TIMER(parent_->state_->total_network_send_timer());
   unique_lock<mutex> l(rpc_thread_lock_);
-  while (rpc_in_flight_) {
+  while (num_rpcs_in_flight_ > 0) {
     rpc_done_cv_.wait(l);
   }
 }
 
+void DataStreamSender::Channel::WaitForFreeSlot() {
+  unique_lock<mutex> l(rpc_thread_lock_);
+  if (num_rpcs_in_flight_ < max_rpcs_in_flight_) return;
+  SCOPED_TIMER(parent_->state_->total_network_send_timer());
+  SCOPED_TIMER(parent_->send_queue_wait_timer_);
+  while (num_rpcs_in_flight_ >= max_rpcs_in_flight_) {
+    rpc_done_cv_.wait(l);
+  }
+}
+
+TRowBatch* DataStreamSender::Channel::GetFreeThriftBatch() {
+  WaitForFreeSlot();
+  TRowBatch* batch = &thrift_batches_[next_thrift_batch_idx_];
+  next_thrift_batch_idx_ = (next_thrift_batch_idx_ + 1) % thrift_batches_.size();
+  return batch;
+}
+
 Status DataStreamSender::Channel::AddRow(TupleRow* row) {
+  if (recvr_closed_) {
+    COUNTER_ADD(parent_->rows_not_sent_counter_, 1);
+    return Status::OK();
+  }
   if (batch_->AtCapacity()) {
-    // batch_ is full, let's send it; but first wait for an ongoing
-    // transmission to finish before modifying thrift_batch_
+    // batch_ is full, let's send it
     RETURN_IF_ERROR(SendCurrentBatch());
   }
   TupleRow* dest = batch_->GetRow(batch_->AddRow());
@@ -245,18 +504,39 @@ Status DataStreamSender::Channel::AddRow(TupleRow* row) {
   return Status::OK();
 }
 
+Status DataStreamSender::Channel::SendLocalBatch(RowBatch* batch, bool acquire_state) {
+  DCHECK(is_local_);
+  VLOG_ROW << "Channel::SendLocalBatch() instance_id=" << fragment_instance_id_
+           << " dest_node=" << dest_node_id_ << " #rows=" << batch->num_rows();
+  if (recvr_closed_) return Status::OK();
+  SCOPED_TIMER(parent_->local_send_timer_);
+  RETURN_IF_ERROR(stream_mgr_->AddData(fragment_instance_id_, dest_node_id_, batch,
+      parent_->sender_id_, acquire_state));
+  COUNTER_ADD(parent_->local_batches_counter_, 1);
+  recvr_closed_ = stream_mgr_->IsRecvrClosed(fragment_instance_id_, dest_node_id_);
+  return Status::OK();
+}
+
 Status DataStreamSender::Channel::SendCurrentBatch() {
+  if (is_local_) {
+    // batch_ holds deep copies of the rows, so the receiver can take it over.
+    RETURN_IF_ERROR(SendLocalBatch(batch_.get(), true));
+    batch_->Reset();
+    return Status::OK();
+  }
   // make sure there's no in-flight TransmitData() call that might still want to
-  // access thrift_batch_
-  WaitForRpc();
-  RETURN_IF_ERROR(parent_->SerializeBatch(batch_.get(), &thrift_batch_));
+  // access the thrift batch we serialize into
+  TRowBatch* thrift_batch = GetFreeThriftBatch();
+  RETURN_IF_ERROR(
+      parent_->SerializeBatch(batch_.get(), thrift_batch, compression_policy_));
   batch_->Reset();
-  RETURN_IF_ERROR(SendBatch(&thrift_batch_));
+  RETURN_IF_ERROR(SendBatch(thrift_batch));
   return Status::OK();
 }
 
 Status DataStreamSender::Channel::GetSendStatus() {
   WaitForRpc();
+  // No rpcs are in flight, so rpc_status_ is not modified concurrently.
   if (!rpc_status_.ok()) {
     LOG(ERROR) << "channel send status: " << rpc_status_.GetDetail();
   }
@@ -277,6 +557,10 @@ Status DataStreamSender::Channel::FlushAndSendEos(RuntimeState* state) {
   }
 
   RETURN_IF_ERROR(GetSendStatus());
+  if (is_local_) {
+    return stream_mgr_->CloseSender(fragment_instance_id_, dest_node_id_,
+        parent_->sender_id_);
+  }
 
   Status client_cnxn_status;
   ImpalaBackendConnection client(client_cache_, address_, &client_cnxn_status);
@@ -317,12 +601,26 @@ DataStreamSender::DataStreamSender(ObjectPool* pool, int sender_id,
     current_channel_idx_(0),
     flushed_(false),
     closed_(false),
-    current_thrift_batch_(&thrift_batch1_),
+    thrift_batches_(max(FLAGS_datastream_sender_max_in_flight_batches, 1) + 1),
+    current_thrift_batch_idx_(0),
+    compression_policy_(new CompressionPolicy()),
     profile_(NULL),
     serialize_batch_timer_(NULL),
     thrift_transmit_timer_(NULL),
     bytes_sent_counter_(NULL),
     total_sent_rows_counter_(NULL),
+    send_queue_wait_timer_(NULL),
+    peak_send_queue_depth_(NULL),
+    local_send_timer_(NULL),
+    local_batches_counter_(NULL),
+    num_remote_channels_(0),
+    rows_not_sent_counter_(NULL),
+    rows_since_key_sample_(0),
+    num_heavy_hitters_counter_(NULL),
+    max_channel_rows_counter_(NULL),
+    compression_timer_(NULL),
+    compressed_batches_counter_(NULL),
+    uncompressed_batches_counter_(NULL),
     dest_node_id_(sink.dest_node_id) {
   DCHECK_GT(destinations.size(), 0);
   DCHECK(sink.output_partition.type == TPartitionType::UNPARTITIONED
@@ -350,6 +648,10 @@ DataStreamSender::DataStreamSender(ObjectPool* pool, int sender_id,
         Expr::CreateExprTrees(pool, sink.output_partition.partition_exprs,
                               &partition_expr_ctxs_);
     DCHECK(status.ok());
+    if (FLAGS_datastream_sender_heavy_hitter_fraction > 0 && channels_.size() > 1) {
+      key_sketch_.reset(new CountMinSketch(10, 4));
+      channel_rows_.resize(channels_.size());
+    }
   }
 }
 
@@ -380,6 +682,11 @@ Status DataStreamSender::Prepare(RuntimeState* state) {
       ADD_COUNTER(profile(), "UncompressedRowBatchSize", TUnit::BYTES);
   serialize_batch_timer_ =
       ADD_TIMER(profile(), "SerializeBatchTime");
+  compression_timer_ = ADD_TIMER(profile(), "CompressionTime");
+  compressed_batches_counter_ =
+      ADD_COUNTER(profile(), "RowBatchesCompressed", TUnit::UNIT);
+  uncompressed_batches_counter_ =
+      ADD_COUNTER(profile(), "RowBatchesNotCompressed", TUnit::UNIT);
   thrift_transmit_timer_ = profile()->AddConcurrentTimerCounter("TransmitDataRPCTime",
       TUnit::TIME_NS);
   network_throughput_ =
@@ -392,8 +699,20 @@ Status DataStreamSender::Prepare(RuntimeState* state) {
                          profile()->total_time_counter()));
 
   total_sent_rows_counter_= ADD_COUNTER(profile(), "RowsReturned", TUnit::UNIT);
+  send_queue_wait_timer_ = ADD_TIMER(profile(), "SendQueueWaitTime");
+  peak_send_queue_depth_ =
+      profile()->AddHighWaterMarkCounter("PeakChannelSendQueueDepth", TUnit::UNIT);
+  local_send_timer_ = ADD_TIMER(profile(), "LocalSendTime");
+  local_batches_counter_ = ADD_COUNTER(profile(), "LocalRowBatchesSent", TUnit::UNIT);
+  rows_not_sent_counter_ = ADD_COUNTER(profile(), "RowsNotSentToClosedRecvrs",
+      TUnit::UNIT);
+  if (key_sketch_.get() != NULL) {
+    num_heavy_hitters_counter_ = ADD_COUNTER(profile(), "HeavyHitterKeys", TUnit::UNIT);
+    max_channel_rows_counter_ = ADD_COUNTER(profile(), "MaxRowsPerChannel", TUnit::UNIT);
+  }
   for (int i = 0; i < channels_.size(); ++i) {
     RETURN_IF_ERROR(channels_[i]->Init(state));
+    if (!channels_[i]->is_local()) ++num_remote_channels_;
   }
   return Status::OK();
 }
@@ -407,24 +726,50 @@ Status DataStreamSender::Send(RuntimeState* state, RowBatch* batch, bool eos) {
   DCHECK(!flushed_);
 
   if (batch->num_rows() == 0) return Status::OK();
+  if (ReceiversClosed()) {
+    COUNTER_ADD(rows_not_sent_counter_, batch->num_rows());
+    return Status::OK();
+  }
   if (broadcast_ || channels_.size() == 1) {
-    // current_thrift_batch_ is *not* the one that was written by the last call
-    // to Serialize()
-    RETURN_IF_ERROR(SerializeBatch(batch, current_thrift_batch_, channels_.size()));
-    // SendBatch() will block if there are still in-flight rpcs (and those will
-    // reference the previously written thrift batch)
+    // The batch at current_thrift_batch_idx_ was sent thrift_batches_.size() calls ago.
+    // SendBatch() blocks until fewer than thrift_batches_.size() - 1 rpcs are in
+    // flight on a channel, so no channel still references it.
+    // The batch is only serialized if there is a remote channel.
+    TRowBatch* thrift_batch = NULL;
     for (int i = 0; i < channels_.size(); ++i) {
-      RETURN_IF_ERROR(channels_[i]->SendBatch(current_thrift_batch_));
+      if (channels_[i]->recvr_closed()) continue;
+      if (channels_[i]->is_local()) {
+        RETURN_IF_ERROR(channels_[i]->SendLocalBatch(batch, false));
+        continue;
+      }
+      if (thrift_batch == NULL) {
+        thrift_batch = &thrift_batches_[current_thrift_batch_idx_];
+        RETURN_IF_ERROR(SerializeBatch(batch, thrift_batch, compression_policy_.get(),
+            num_remote_channels_));
+      }
+      RETURN_IF_ERROR(channels_[i]->SendBatch(thrift_batch));
+    }
+    if (thrift_batch != NULL) {
+      current_thrift_batch_idx_ =
+          (current_thrift_batch_idx_ + 1) % thrift_batches_.size();
     }
-    current_thrift_batch_ =
-        (current_thrift_batch_ == &thrift_batch1_ ? &thrift_batch2_ : &thrift_batch1_);
   } else if (random_) {
-    // Round-robin batches among channels. Wait for the current channel to finish its
-    // rpc before overwriting its batch.
+    // Round-robin batches among channels, skipping the ones whose receiver is closed.
+    // The current channel may need to finish an rpc before one of its batches can be
+    // overwritten.
+    for (int i = 0; i < channels_.size()
+        && channels_[current_channel_idx_]->recvr_closed(); ++i) {
+      current_channel_idx_ = (current_channel_idx_ + 1) % channels_.size();
+    }
     Channel* current_channel = channels_[current_channel_idx_];
-    current_channel->WaitForRpc();
-    RETURN_IF_ERROR(SerializeBatch(batch, current_channel->thrift_batch()));
-    RETURN_IF_ERROR(current_channel->SendBatch(current_channel->thrift_batch()));
+    if (current_channel->is_local()) {
+      RETURN_IF_ERROR(current_channel->SendLocalBatch(batch, false));
+    } else {
+      TRowBatch* thrift_batch = current_channel->GetFreeThriftBatch();
+      RETURN_IF_ERROR(
+          SerializeBatch(batch, thrift_batch, current_channel->compression_policy()));
+      RETURN_IF_ERROR(current_channel->SendBatch(thrift_batch));
+    }
     current_channel_idx_ = (current_channel_idx_ + 1) % channels_.size();
   } else {
     // hash-partition batch's rows across channels
@@ -443,7 +788,15 @@ Status DataStreamSender::Send(RuntimeState* state, RowBatch* batch, bool eos) {
             RawValue::GetHashValueFnv(partition_val, ctx->root()->type(), hash_val);
       }
       ExprContext::FreeLocalAllocations(partition_expr_ctxs_);
-      RETURN_IF_ERROR(channels_[hash_val % num_channels]->AddRow(row));
+      int channel_idx = hash_val % num_channels;
+      if (key_sketch_.get() != NULL) {
+        ++channel_rows_[channel_idx];
+        if (++rows_since_key_sample_ == KEY_SAMPLE_INTERVAL) {
+          rows_since_key_sample_ = 0;
+          SampleKey(hash_val, channel_idx);
+        }
+      }
+      RETURN_IF_ERROR(channels_[channel_idx]->AddRow(row));
     }
   }
   COUNTER_ADD(total_sent_rows_counter_, batch->num_rows());
@@ -455,6 +808,7 @@ Status DataStreamSender::FlushFinal(RuntimeState* state) {
   DCHECK(!flushed_);
   DCHECK(!closed_);
   flushed_ = true;
+  if (key_sketch_.get() != NULL) ReportSkew();
   for (int i = 0; i < channels_.size(); ++i) {
     // If we hit an error here, we can return without closing the remaining channels as
     // the error is propagated back to the coordinator, which in turn cancels the query,
@@ -477,12 +831,25 @@ void DataStreamSender::Close(RuntimeState* state) {
   closed_ = true;
 }
 
-Status DataStreamSender::SerializeBatch(RowBatch* src, TRowBatch* dest, int num_receivers) {
+Status DataStreamSender::SerializeBatch(RowBatch* src, TRowBatch* dest,
+    CompressionPolicy* policy, int num_receivers) {
   VLOG_ROW << "serializing " << src->num_rows() << " rows";
   {
     SCOPED_TIMER(profile_->total_time_counter());
     SCOPED_TIMER(serialize_batch_timer_);
-    RETURN_IF_ERROR(src->Serialize(dest));
+    RETURN_IF_ERROR(src->Serialize(dest, false));
+    if (policy->ShouldCompress()) {
+      MonotonicStopWatch compression_timer;
+      compression_timer.Start();
+      RETURN_IF_ERROR(src->Compress(dest));
+      compression_timer.Stop();
+      policy->AddCompressionSample(dest->uncompressed_size, dest->tuple_data.size(),
+          compression_timer.ElapsedTime());
+      COUNTER_ADD(compression_timer_, compression_timer.ElapsedTime());
+      COUNTER_ADD(compressed_batches_counter_, 1);
+    } else {
+      COUNTER_ADD(uncompressed_batches_counter_, 1);
+    }
     int bytes = RowBatch::GetBatchSize(*dest);
     int uncompressed_bytes = bytes - dest->tuple_data.size() + dest->uncompressed_size;
     // The size output_batch would be if we didn't compress tuple_data (will be equal to
@@ -494,6 +861,51 @@ Status DataStreamSender::SerializeBatch(RowBatch* src, TRowBatch* dest, int num_
   return Status::OK();
 }
 
+void DataStreamSender::SampleKey(uint32_t hash, int channel_idx) {
+  uint32_t estimate = key_sketch_->Add(hash);
+  if (key_sketch_->total_count() < MIN_KEY_SAMPLES) return;
+  if (estimate < FLAGS_datastream_sender_heavy_hitter_fraction
+      * key_sketch_->total_count()) {
+    return;
+  }
+  if (heavy_hitters_.size() < MAX_HEAVY_HITTERS) {
+    heavy_hitters_.insert(make_pair(hash, channel_idx));
+  }
+}
+
+void DataStreamSender::ReportSkew() {
+  // Keys are added to heavy_hitters_ when their estimate first crosses the threshold,
+  // so only report those that are still above it.
+  stringstream heavy_hitters;
+  int num_heavy_hitters = 0;
+  double min_count =
+      FLAGS_datastream_sender_heavy_hitter_fraction * key_sketch_->total_count();
+  for (boost::unordered_map<uint32_t, int>::iterator it = heavy_hitters_.begin();
+      it != heavy_hitters_.end(); ++it) {
+    uint32_t estimate = key_sketch_->Estimate(it->first);
+    if (estimate < min_count) continue;
+    if (num_heavy_hitters++ > 0) heavy_hitters << ", ";
+    heavy_hitters << "channel " << it->second << ": " << setprecision(3)
+                  << 100.0 * estimate / key_sketch_->total_count() << "%";
+  }
+  COUNTER_SET(num_heavy_hitters_counter_, num_heavy_hitters);
+  COUNTER_SET(max_channel_rows_counter_,
+      *max_element(channel_rows_.begin(), channel_rows_.end()));
+  if (num_heavy_hitters > 0) {
+    profile()->AddInfoString("HeavyHitterKeys", heavy_hitters.str());
+    VLOG_QUERY << "Data stream sender (dst_id=" << dest_node_id_ << ") has "
+               << num_heavy_hitters << " heavy hitter partition keys: "
+               << heavy_hitters.str();
+  }
+}
+
+bool DataStreamSender::ReceiversClosed() const {
+  for (int i = 0; i < channels_.size(); ++i) {
+    if (!channels_[i]->recvr_closed()) return false;
+  }
+  return true;
+}
+
 int64_t DataStreamSender::GetNumDataBytesSent() const {
   // TODO: do we need synchronization here or are reads & writes to 8-byte ints
   // atomic?
@@ -504,4 +916,24 @@ int64_t DataStreamSender::GetNumDataBytesSent() const {
   return result;
 }
 
+Status DataStreamSender::UnreachableBackendError(const TNetworkAddress& address,
+    const Status& cause) {
+  return Status(Substitute("$0$1: $2", UNREACHABLE_BACKEND_MSG,
+      TNetworkAddressToString(address), cause.GetDetail()));
+}
+
+bool DataStreamSender::ParseUnreachableBackend(const Status& status,
+    TNetworkAddress* address) {
+  if (status.ok()) return false;
+  const string& msg = status.msg().msg();
+  if (msg.compare(0, UNREACHABLE_BACKEND_MSG.size(), UNREACHABLE_BACKEND_MSG) != 0) {
+    return false;
+  }
+  size_t end = msg.find(": ", UNREACHABLE_BACKEND_MSG.size());
+  if (end == string::npos) return false;
+  *address = MakeNetworkAddress(msg.substr(UNREACHABLE_BACKEND_MSG.size(),
+      end - UNREACHABLE_BACKEND_MSG.size()));
+  return !address->hostname.empty();
+}
+
 }
@@ -18,6 +18,7 @@
 
 #include <vector>
 #include <string>
+#include <boost/unordered_map.hpp>
 
 #include "exec/data-sink.h"
 #include "common/global-types.h"
@@ -28,6 +29,7 @@
 
 namespace impala {
 
+class CountMinSketch;
 class Expr;
 class RowBatch;
 class RowDescriptor;
@@ -83,10 +85,30 @@ class DataStreamSender : public DataSink {
   /// illegal after calling Close().
   virtual void Close(RuntimeState* state);
 
-  /// Serializes the src batch into the dest thrift batch. Maintains metrics.
+  class CompressionPolicy;
+
+  /// Returns the error of a TransmitData() rpc that could not reach the backend at
+  /// 'address', with 'cause' as detail. The coordinator recognizes it in the status
+  /// report of the fragment with ParseUnreachableBackend().
+  static Status UnreachableBackendError(const TNetworkAddress& address,
+      const Status& cause);
+
+  /// Returns true if 'status' was returned by UnreachableBackendError(), and sets
+  /// 'address' to the address of the unreachable backend.
+  static bool ParseUnreachableBackend(const Status& status, TNetworkAddress* address);
+
+  /// Serializes the src batch into the dest thrift batch and compresses it if 'policy'
+  /// decides so. Maintains metrics.
   /// num_receivers is the number of receivers this batch will be sent to. Only
   /// used to maintain metrics.
-  Status SerializeBatch(RowBatch* src, TRowBatch* dest, int num_receivers = 1);
+  Status SerializeBatch(RowBatch* src, TRowBatch* dest, CompressionPolicy* policy,
+      int num_receivers = 1);
+
+  /// Adds the partition hash of a row sent on channel 'channel_idx' to key_sketch_.
+  void SampleKey(uint32_t hash, int channel_idx);
+
+  /// Adds the heavy hitters and the channel row counts to the profile.
+  void ReportSkew();
 
   /// Return total number of bytes sent in TRowBatch.data. If batches are
   /// broadcast to multiple receivers, they are counted once per receiver.
@@ -94,6 +116,10 @@ class DataStreamSender : public DataSink {
 
   virtual RuntimeProfile* profile() { return profile_; }
 
+  /// Returns true if the receivers of all channels are closed, i.e. none of them needs
+  /// any more rows (see DataStreamMgr::IsRecvrClosed()).
+  virtual bool ReceiversClosed() const;
+
  private:
   class Channel;
 
@@ -113,11 +139,14 @@ class DataStreamSender : public DataSink {
   /// If true, this sender has been closed. Not valid to call Send() anymore.
   bool closed_;
 
-  /// serialized batches for broadcasting; we need two so we can write
-  /// one while the other one is still being sent
-  TRowBatch thrift_batch1_;
-  TRowBatch thrift_batch2_;
-  TRowBatch* current_thrift_batch_;  // the next one to fill in Send()
+  /// serialized batches for broadcasting, used as a ring; we need one more than the
+  /// number of batches a channel can have in flight so we can write one while the
+  /// others are still being sent
+  std::vector<TRowBatch> thrift_batches_;
+  int current_thrift_batch_idx_;  // the next one to fill in Send()
+
+  /// Decides on the compression of thrift_batches_.
+  boost::scoped_ptr<CompressionPolicy> compression_policy_;
 
   std::vector<ExprContext*> partition_expr_ctxs_;  // compute per-row partition values
   std::vector<Channel*> channels_;
@@ -131,6 +160,45 @@ class DataStreamSender : public DataSink {
   RuntimeProfile::Counter* total_sent_rows_counter_;
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
+  /// Time spent waiting for a channel that had the maximum number of batches in flight.
+  RuntimeProfile::Counter* send_queue_wait_timer_;
+
+  /// Maximum number of batches that were in flight on any channel.
+  RuntimeProfile::HighWaterMarkCounter* peak_send_queue_depth_;
+
+  /// Time spent passing batches to receivers in this process and the number of such
+  /// batches.
+  RuntimeProfile::Counter* local_send_timer_;
+  RuntimeProfile::Counter* local_batches_counter_;
+
+  /// Number of channels whose receiver is in another process.
+  int num_remote_channels_;
+
+  /// Number of rows that were not sent because the receiver of their channel was closed.
+  RuntimeProfile::Counter* rows_not_sent_counter_;
+
+  /// Skew detection for HASH_PARTITIONED senders with more than one channel:
+  /// Every KEY_SAMPLE_INTERVAL-th row's partition hash is added to key_sketch_. Hashes
+  /// whose estimated count reaches --datastream_sender_heavy_hitter_fraction of the
+  /// samples are kept in heavy_hitters_ with their channel, up to MAX_HEAVY_HITTERS.
+  /// FlushFinal() reports them and the row counts of the channels in the profile.
+  /// key_sketch_ is NULL if detection is disabled.
+  static const int KEY_SAMPLE_INTERVAL = 16;
+  static const int MIN_KEY_SAMPLES = 1024;
+  static const int MAX_HEAVY_HITTERS = 16;
+  boost::scoped_ptr<CountMinSketch> key_sketch_;
+  int rows_since_key_sample_;
+  boost::unordered_map<uint32_t, int> heavy_hitters_;
+  std::vector<int64_t> channel_rows_;
+  RuntimeProfile::Counter* num_heavy_hitters_counter_;
+  RuntimeProfile::Counter* max_channel_rows_counter_;
+
+  /// Time spent compressing serialized batches and the number of batches sent with
+  /// and without compression.
+  RuntimeProfile::Counter* compression_timer_;
+  RuntimeProfile::Counter* compressed_batches_counter_;
+  RuntimeProfile::Counter* uncompressed_batches_counter_;
+
   /// Throughput per time spent in TransmitData
   RuntimeProfile::Counter* network_throughput_;
 
@@ -47,6 +47,7 @@
 #include "service/fe-support.h"
 
 #include <iostream>
+#include <limits>
 
 #include "common/names.h"
 
@@ -57,6 +58,7 @@ using namespace apache::thrift::protocol;
 DEFINE_int32(port, 20001, "port on which to run Impala test backend");
 DECLARE_string(principal);
 DECLARE_int32(datastream_sender_timeout_ms);
+DECLARE_int32(datastream_recvr_merge_fanout);
 
 // We reserve contiguous memory for senders in SetUp. If a test uses more
 // senders, a DCHECK will fail and you should increase this value.
@@ -376,11 +378,16 @@ class DataStreamTest : public testing::Test {
     RowBatch batch(*row_desc_, 1024, &tracker_);
     VLOG_QUERY << "start reading merging";
     bool eos;
+    int64_t prev_value = numeric_limits<int64_t>::min();
     while (!(info->status = info->stream_recvr->GetNext(&batch, &eos)).IsCancelled()) {
       VLOG_QUERY << "read batch #rows=" << batch.num_rows();
       for (int i = 0; i < batch.num_rows(); ++i) {
         TupleRow* row = batch.GetRow(i);
-        info->data_values.insert(*static_cast<int64_t*>(row->GetTuple(0)->GetSlot(0)));
+        int64_t value = *static_cast<int64_t*>(row->GetTuple(0)->GetSlot(0));
+        // Each sender sends ascending values.
+        EXPECT_LE(prev_value, value);
+        prev_value = value;
+        info->data_values.insert(value);
       }
       SleepForMs(100);
       batch.Reset();
@@ -565,7 +572,7 @@ TEST_F(DataStreamTest, BasicTest) {
   TPartitionType::type stream_types[] =
       {TPartitionType::UNPARTITIONED, TPartitionType::RANDOM,
           TPartitionType::HASH_PARTITIONED};
-  int sender_nums[] = {1, 4};
+  int sender_nums[] = {1, 3, 4};
   int receiver_nums[] = {1, 4};
   int buffer_sizes[] = {1024, 1024 * 1024};
   bool merging[] = {false, true};
@@ -583,6 +590,16 @@ TEST_F(DataStreamTest, BasicTest) {
   }
 }
 
+// Merges the streams of more senders than --datastream_recvr_merge_fanout in
+// intermediate merges.
+TEST_F(DataStreamTest, TwoLevelMerge) {
+  int fanout = FLAGS_datastream_recvr_merge_fanout;
+  FLAGS_datastream_recvr_merge_fanout = 2;
+  TestStream(TPartitionType::UNPARTITIONED, 5, 1, 1024, true);
+  TestStream(TPartitionType::HASH_PARTITIONED, 4, 2, 1024 * 1024, true);
+  FLAGS_datastream_recvr_merge_fanout = fanout;
+}
+
 // This test checks for the avoidance of IMPALA-2931, which is a crash that would occur if
 // the parent memtracker of a DataStreamRecvr's memtracker was deleted before the
 // DataStreamRecvr was destroyed. The fix was to move decoupling the child tracker from
@@ -633,6 +650,23 @@ TEST_F(DataStreamTest, CloseRecvrWhileReferencesRemain) {
   stream_recvr.reset();
 }
 
+// Senders see the receiver as closed once its exchange node cancelled the stream, e.g.
+// because it reached its limit, and after it was closed.
+TEST_F(DataStreamTest, IsRecvrClosed) {
+  scoped_ptr<RuntimeProfile> profile(new RuntimeProfile(&obj_pool_, "TestReceiver"));
+  TUniqueId instance_id;
+  GetNextInstanceId(&instance_id);
+  EXPECT_FALSE(stream_mgr_->IsRecvrClosed(instance_id, DEST_NODE_ID));
+  shared_ptr<DataStreamRecvr> stream_recvr = stream_mgr_->CreateRecvr(&runtime_state_,
+      *row_desc_, instance_id, DEST_NODE_ID, 1, 1024, profile.get(), false);
+  EXPECT_FALSE(stream_mgr_->IsRecvrClosed(instance_id, DEST_NODE_ID));
+  stream_recvr->CancelStream();
+  EXPECT_TRUE(stream_recvr->is_cancelled());
+  EXPECT_TRUE(stream_mgr_->IsRecvrClosed(instance_id, DEST_NODE_ID));
+  stream_recvr->Close();
+  EXPECT_TRUE(stream_mgr_->IsRecvrClosed(instance_id, DEST_NODE_ID));
+}
+
 // TODO: more tests:
 // - test case for transmission error in last batch
 // - receivers getting created concurrently
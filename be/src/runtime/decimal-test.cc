@@ -728,6 +728,41 @@ TEST(DecimalArithmetic, DivideLargeScales) {
   EXPECT_FALSE(is_overflow);
 }
 
+// Dividends whose scaled value fits into 128 bits are divided without 256-bit
+// intermediates. Compares them to the 256-bit division around that limit.
+TEST(DecimalArithmetic, DivideWithoutInt256) {
+  ColumnType t = ColumnType::CreateDecimalType(38, 0);
+  for (int scale_by = 0; scale_by <= ColumnType::MAX_PRECISION; ++scale_by) {
+    int128_t limit = scale_by == 0 ? DecimalUtil::MAX_UNSCALED_DECIMAL16 :
+        DecimalUtil::GetScaleQuotient(scale_by);
+    int128_t vals[] = {0, 1, 7, limit / 2, limit - 1, limit, limit + 1, -limit,
+        -limit - 1};
+    int128_t divisors[] = {1, -1, 3, -7, 1000000007, limit, limit + 2};
+    for (int128_t val: vals) {
+      for (int128_t divisor: divisors) {
+        if (divisor == 0 || abs(val) > DecimalUtil::MAX_UNSCALED_DECIMAL16 ||
+            abs(divisor) > DecimalUtil::MAX_UNSCALED_DECIMAL16) {
+          continue;
+        }
+        bool is_nan = false;
+        bool is_overflow = false;
+        Decimal16Value r = Decimal16Value(val).Divide<int128_t>(0,
+            Decimal16Value(divisor), 0, 38, scale_by, &is_nan, &is_overflow);
+        bool expected_overflow = false;
+        int256_t expected = DecimalUtil::MultiplyByScale<int256_t>(
+            ConvertToInt256(val), scale_by) / ConvertToInt256(divisor);
+        int128_t expected_r = ConvertToInt128(expected,
+            DecimalUtil::MAX_UNSCALED_DECIMAL16, &expected_overflow);
+        EXPECT_FALSE(is_nan);
+        EXPECT_EQ(expected_overflow, is_overflow) << scale_by;
+        if (!expected_overflow) {
+          EXPECT_EQ(Decimal16Value(expected_r).ToString(t), r.ToString(t)) << scale_by;
+        }
+      }
+    }
+  }
+}
+
 template<typename T>
 DecimalValue<T> RandDecimal(int max_precision) {
   T val = 0;
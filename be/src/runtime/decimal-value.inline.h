@@ -168,8 +168,13 @@ inline DecimalValue<RESULT_T> DecimalValue<T>::Multiply(int this_scale,
   RESULT_T result = 0;
   if (result_precision == ColumnType::MAX_PRECISION) {
     DCHECK_EQ(sizeof(RESULT_T), 16);
-    // Check overflow
-    *overflow |= __builtin_mul_overflow(x, y, &result);
+    if (FitsInInt64(x) && FitsInInt64(y)) {
+      // The product of two 64-bit values always fits into 128 bits.
+      result = static_cast<int128_t>(static_cast<int64_t>(x)) * static_cast<int64_t>(y);
+    } else {
+      // Check overflow
+      *overflow |= __builtin_mul_overflow(x, y, &result);
+    }
     *overflow |= abs(result) > DecimalUtil::MAX_UNSCALED_DECIMAL16;
   } else {
     result = x * y;
@@ -203,8 +208,14 @@ DecimalValue<RESULT_T> DecimalValue<T>::Multiply(int this_scale,
   }
   if (result_precision == ColumnType::MAX_PRECISION) {
     DCHECK_EQ(sizeof(RESULT_T), 16);
-    // Check overflow
-    *overflow |= DecimalUtil::MAX_UNSCALED_DECIMAL16 / abs(y) < abs(x);
+    if (FitsInInt64(x) && FitsInInt64(y)) {
+      // The product of two 64-bit values always fits into 128 bits, so it can be
+      // checked without a 128-bit division.
+      *overflow |= abs(x * y) > DecimalUtil::MAX_UNSCALED_DECIMAL16;
+    } else {
+      // Check overflow
+      *overflow |= DecimalUtil::MAX_UNSCALED_DECIMAL16 / abs(y) < abs(x);
+    }
   }
   RESULT_T result = x * y;
   int delta_scale = this_scale + other_scale - result_scale;
@@ -237,15 +248,27 @@ inline DecimalValue<RESULT_T> DecimalValue<T>::Divide(int this_scale,
   // Use higher precision ints for intermediates to avoid overflows. Divides lead to
   // large numbers very quickly (and get eliminated by the int divide).
   if (sizeof(T) == 16) {
+    // The 256-bit intermediates are only needed if the scaled dividend doesn't fit into
+    // 128 bits. Otherwise the quotient can't overflow either.
+    if (scale_by == 0 || (scale_by <= ColumnType::MAX_PRECISION &&
+        abs(value()) <= DecimalUtil::GetScaleQuotient(scale_by))) {
+      int128_t x = DecimalUtil::MultiplyByScale<int128_t>(value(), scale_by);
+      return DecimalValue<RESULT_T>(DivideInt128(x, other.value()));
+    }
     int256_t x = DecimalUtil::MultiplyByScale<int256_t>(
         ConvertToInt256(value()), scale_by);
     int256_t y = ConvertToInt256(other.value());
     int128_t r = ConvertToInt128(x / y, DecimalUtil::MAX_UNSCALED_DECIMAL16, overflow);
     return DecimalValue<RESULT_T>(r);
+  } else if (sizeof(RESULT_T) <= 8) {
+    // Both the scaled dividend and the divisor fit into 64 bits.
+    int64_t x = DecimalUtil::MultiplyByScale<RESULT_T>(value(), scale_by);
+    int64_t y = other.value();
+    return DecimalValue<RESULT_T>(static_cast<RESULT_T>(x / y));
   } else {
     int128_t x = DecimalUtil::MultiplyByScale<RESULT_T>(value(), scale_by);
     int128_t y = other.value();
-    int128_t r = x / y;
+    int128_t r = DivideInt128(x, y);
     return DecimalValue<RESULT_T>(static_cast<RESULT_T>(r));
   }
 }
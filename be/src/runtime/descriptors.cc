@@ -35,12 +35,10 @@ using boost::algorithm::join;
 using namespace llvm;
 using namespace strings;
 
-// In 'thrift_partition', the location is stored in a compressed format that references
-// the 'partition_prefixes' of 'thrift_table'. This function decompresses that format into
-// a string and stores it in 'result'. If 'location' is not set in the THdfsPartition,
-// 'result' is set to the empty string.
-static void DecompressLocation(const impala::THdfsTable& thrift_table,
-    const impala::THdfsPartition& thrift_partition, string* result) {
+namespace impala {
+
+void DecompressLocation(const THdfsTable& thrift_table,
+    const THdfsPartition& thrift_partition, string* result) {
   if (!thrift_partition.__isset.location) {
     result->clear();
     return;
@@ -56,8 +54,6 @@ static void DecompressLocation(const impala::THdfsTable& thrift_table,
   }
 }
 
-namespace impala {
-
 const int RowDescriptor::INVALID_IDX;
 
 const char* TupleDescriptor::LLVM_CLASS_NAME = "class.impala::TupleDescriptor";
@@ -89,7 +85,8 @@ SlotDescriptor::SlotDescriptor(
     llvm_field_idx_(-1),
     is_null_fn_(NULL),
     set_not_null_fn_(NULL),
-    set_null_fn_(NULL) {
+    set_null_fn_(NULL),
+    cached_fns_codegen_(NULL) {
   DCHECK_NE(type_.type, TYPE_STRUCT);
   DCHECK(parent_ != NULL) << tdesc.parent;
   if (type_.IsCollectionType()) {
@@ -313,7 +310,8 @@ TupleDescriptor::TupleDescriptor(const TTupleDescriptor& tdesc)
     slots_(),
     has_varlen_slots_(false),
     tuple_path_(tdesc.tuplePath),
-    llvm_struct_(NULL) {
+    llvm_struct_(NULL),
+    llvm_struct_codegen_(NULL) {
 }
 
 void TupleDescriptor::AddSlot(SlotDescriptor* slot) {
@@ -589,7 +587,7 @@ void DescriptorTbl::GetTupleDescs(vector<TupleDescriptor*>* descs) const {
 //   ret i1 %is_null
 // }
 Function* SlotDescriptor::GetIsNullFn(LlvmCodeGen* codegen) const {
-  if (is_null_fn_ != NULL) return is_null_fn_;
+  if (is_null_fn_ != NULL && cached_fns_codegen_ == codegen) return is_null_fn_;
   StructType* tuple_type = parent()->GetLlvmStruct(codegen);
   PointerType* tuple_ptr_type = tuple_type->getPointerTo();
   LlvmCodeGen::FnPrototype prototype(codegen, "IsNull", codegen->GetType(TYPE_BOOLEAN));
@@ -610,7 +608,9 @@ Function* SlotDescriptor::GetIsNullFn(LlvmCodeGen* codegen) const {
   Value* is_null = builder.CreateICmpNE(null_mask, zero, "is_null");
   builder.CreateRet(is_null);
 
-  return is_null_fn_ = codegen->FinalizeFunction(fn);
+  fn = codegen->FinalizeFunction(fn);
+  if (CacheFnsFor(codegen)) is_null_fn_ = fn;
+  return fn;
 }
 
 // Generate function to set a slot to be null or not-null.  The resulting IR
@@ -625,8 +625,10 @@ Function* SlotDescriptor::GetIsNullFn(LlvmCodeGen* codegen) const {
 //   ret void
 // }
 Function* SlotDescriptor::GetUpdateNullFn(LlvmCodeGen* codegen, bool set_null) const {
-  if (set_null && set_null_fn_ != NULL) return set_null_fn_;
-  if (!set_null && set_not_null_fn_ != NULL) return set_not_null_fn_;
+  if (cached_fns_codegen_ == codegen) {
+    if (set_null && set_null_fn_ != NULL) return set_null_fn_;
+    if (!set_null && set_not_null_fn_ != NULL) return set_not_null_fn_;
+  }
 
   StructType* tuple_type = parent()->GetLlvmStruct(codegen);
   PointerType* tuple_ptr_type = tuple_type->getPointerTo();
@@ -657,6 +659,7 @@ Function* SlotDescriptor::GetUpdateNullFn(LlvmCodeGen* codegen, bool set_null) c
   builder.CreateRetVoid();
 
   fn = codegen->FinalizeFunction(fn);
+  if (!CacheFnsFor(codegen)) return fn;
   if (set_null) {
     set_null_fn_ = fn;
   } else {
@@ -665,9 +668,14 @@ Function* SlotDescriptor::GetUpdateNullFn(LlvmCodeGen* codegen, bool set_null) c
   return fn;
 }
 
+bool SlotDescriptor::CacheFnsFor(LlvmCodeGen* codegen) const {
+  if (cached_fns_codegen_ == NULL) cached_fns_codegen_ = codegen;
+  return cached_fns_codegen_ == codegen;
+}
+
 StructType* TupleDescriptor::GetLlvmStruct(LlvmCodeGen* codegen) const {
-  // If we already generated the llvm type, just return it.
-  if (llvm_struct_ != NULL) return llvm_struct_;
+  // If we already generated the llvm type for this codegen, just return it.
+  if (llvm_struct_ != NULL && llvm_struct_codegen_ == codegen) return llvm_struct_;
 
   // Sort slots in the order they will appear in LLVM struct.
   vector<SlotDescriptor*> sorted_slots(slots_.size());
@@ -717,7 +725,10 @@ StructType* TupleDescriptor::GetLlvmStruct(LlvmCodeGen* codegen) const {
     // computed in the FE.
     DCHECK_EQ(layout->getElementOffset(slot->llvm_field_idx()), slot->tuple_offset());
   }
-  llvm_struct_ = tuple_struct;
+  if (llvm_struct_ == NULL) {
+    llvm_struct_ = tuple_struct;
+    llvm_struct_codegen_ = codegen;
+  }
   return tuple_struct;
 }
 
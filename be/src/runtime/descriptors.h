@@ -91,6 +91,10 @@ struct NullIndicatorOffset {
       bit_mask(bit_offset == -1 ? 0 : 1 << bit_offset) {
   }
 
+  bool Equals(const NullIndicatorOffset& o) const {
+    return byte_offset == o.byte_offset && bit_mask == o.bit_mask;
+  }
+
   std::string DebugString() const;
 };
 
@@ -132,11 +136,12 @@ class SlotDescriptor {
   std::string DebugString() const;
 
   /// Codegen for: bool IsNull(Tuple* tuple)
-  /// The codegen'd IR function is cached.
+  /// The codegen'd IR function is cached for the first LlvmCodeGen that codegens a
+  /// function of this slot. Other codegens get a new function every time.
   llvm::Function* GetIsNullFn(LlvmCodeGen*) const;
 
   /// Codegen for: void SetNull(Tuple* tuple) / void SetNotNull(Tuple* tuple)
-  /// The codegen'd IR function is cached.
+  /// The codegen'd IR function is cached like GetIsNullFn()'s.
   llvm::Function* GetUpdateNullFn(LlvmCodeGen*, bool set_null) const;
 
  private:
@@ -170,6 +175,16 @@ class SlotDescriptor {
   mutable llvm::Function* set_not_null_fn_;
   mutable llvm::Function* set_null_fn_;
 
+  /// The codegen whose module contains the cached functions. Set by the first codegen'd
+  /// function. Functions are only valid in their own module, and callers that codegen
+  /// into another module, e.g. scanners compiling per-file functions, don't use or
+  /// update the cache.
+  mutable LlvmCodeGen* cached_fns_codegen_;
+
+  /// Returns true if functions codegen'd by 'codegen' can be cached, and makes 'codegen'
+  /// the owner of the cache if there is none yet.
+  bool CacheFnsFor(LlvmCodeGen* codegen) const;
+
   /// collection_item_descriptor should be non-NULL iff this is a collection slot
   SlotDescriptor(const TSlotDescriptor& tdesc, const TupleDescriptor* parent,
                  const TupleDescriptor* collection_item_descriptor);
@@ -219,6 +234,13 @@ class TableDescriptor {
   std::vector<ColumnDescriptor> col_descs_;
 };
 
+/// In 'thrift_partition', the location is stored in a compressed format that references
+/// the 'partition_prefixes' of 'thrift_table'. This function decompresses that format
+/// into a string and stores it in 'result'. If 'location' is not set in the
+/// THdfsPartition, 'result' is set to the empty string.
+void DecompressLocation(const THdfsTable& thrift_table,
+    const THdfsPartition& thrift_partition, std::string* result);
+
 /// Metadata for a single partition inside an Hdfs table.
 class HdfsPartitionDescriptor {
  public:
@@ -392,7 +414,9 @@ class TupleDescriptor {
   ///   int32_t  min_a;
   ///   int64_t  count_val;
   /// };
-  /// The resulting struct definition is cached.
+  /// The resulting struct definition is cached for the first 'codegen' that calls this.
+  /// Calls with other codegens, which have their own LLVMContext, generate an uncached
+  /// struct.
   llvm::StructType* GetLlvmStruct(LlvmCodeGen* codegen) const;
 
   static const char* LLVM_CLASS_NAME;
@@ -423,8 +447,9 @@ class TupleDescriptor {
   /// collection, empty otherwise.
   SchemaPath tuple_path_;
 
-  /// Cached codegen'd struct type for this tuple desc
+  /// Cached codegen'd struct type for this tuple desc and the codegen it belongs to.
   mutable llvm::StructType* llvm_struct_;
+  mutable LlvmCodeGen* llvm_struct_codegen_;
 
   TupleDescriptor(const TTupleDescriptor& tdesc);
   void AddSlot(SlotDescriptor* slot);
@@ -0,0 +1,179 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/disk-io-mgr-handle-cache.h"
+
+#include "util/hash-util.h"
+#include "util/histogram-metric.h"
+#include "util/impalad-metrics.h"
+#include "util/stopwatch.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+// The maximum number of evicted handles waiting to be closed. Evictions block once it
+// is reached, which only happens if closing the files is much slower than opening them.
+static const int MAX_HANDLES_TO_CLOSE = 1024;
+
+FileHandleCache::FileHandleCache(size_t capacity, int num_partitions)
+  : num_partitions_(num_partitions),
+    capacity_per_partition_(max<size_t>(1, BitUtil::Ceil(capacity, num_partitions))),
+    partitions_(new Partition[num_partitions]),
+    close_queue_(MAX_HANDLES_TO_CLOSE) {
+  DCHECK_GT(num_partitions, 0);
+}
+
+FileHandleCache::~FileHandleCache() {
+  close_queue_.Shutdown();
+  if (close_thread_.get() != NULL) close_thread_->Join();
+  // After the shutdown the queue still returns the remaining handles.
+  DiskIoMgr::HdfsCachedFileHandle* fh;
+  while (close_queue_.BlockingGet(&fh)) delete fh;
+  for (int i = 0; i < num_partitions_; ++i) {
+    for (HandleMap::value_type& entry: partitions_[i].handles) {
+      DCHECK(!entry.second.in_use) << entry.first;
+      delete entry.second.fh;
+    }
+  }
+}
+
+void FileHandleCache::Init() {
+  close_thread_.reset(new Thread("disk-io-mgr", "file-handle-closer",
+      &FileHandleCache::CloseThread, this));
+}
+
+FileHandleCache::Partition* FileHandleCache::GetPartition(const string& fname) {
+  return &partitions_[HashUtil::Hash(fname.data(), fname.size(), 0) % num_partitions_];
+}
+
+DiskIoMgr::HdfsCachedFileHandle* FileHandleCache::GetFileHandle(const hdfsFS& fs,
+    const string& fname, int64_t mtime, bool* cache_hit) {
+  Partition* partition = GetPartition(fname);
+  vector<DiskIoMgr::HdfsCachedFileHandle*> outdated;
+  DiskIoMgr::HdfsCachedFileHandle* fh = NULL;
+  {
+    lock_guard<mutex> l(partition->lock);
+    pair<HandleMap::iterator, HandleMap::iterator> range =
+        partition->handles.equal_range(fname);
+    HandleMap::iterator it = range.first;
+    while (it != range.second && fh == NULL) {
+      Entry* entry = &it->second;
+      if (entry->in_use) {
+        ++it;
+      } else if (entry->fh->mtime() != mtime) {
+        // The file was modified since the handle was opened.
+        VLOG_FILE << "mtime mismatch, closing cached file handle. Closing file=" << fname;
+        outdated.push_back(entry->fh);
+        partition->lru_list.erase(entry->lru_pos);
+        partition->handles.erase(it++);
+        if (ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES != NULL) {
+          ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
+        }
+      } else {
+        entry->in_use = true;
+        partition->lru_list.erase(entry->lru_pos);
+        fh = entry->fh;
+        if (ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES != NULL) {
+          ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
+        }
+      }
+    }
+  }
+  CloseHandles(outdated);
+  *cache_hit = fh != NULL;
+  if (fh != NULL) return fh;
+
+  // Open the file without holding the lock, since it can take a while.
+  MonotonicStopWatch open_timer;
+  open_timer.Start();
+  fh = new DiskIoMgr::HdfsCachedFileHandle(fs, fname.c_str(), mtime);
+  if (ImpaladMetrics::IO_MGR_FILE_HANDLE_OPEN_LATENCIES != NULL) {
+    ImpaladMetrics::IO_MGR_FILE_HANDLE_OPEN_LATENCIES->Update(
+        open_timer.ElapsedTime() / (1000 * 1000));
+  }
+  if (!fh->ok()) {
+    delete fh;
+    return NULL;
+  }
+
+  vector<DiskIoMgr::HdfsCachedFileHandle*> evicted;
+  {
+    lock_guard<mutex> l(partition->lock);
+    Entry entry;
+    entry.fh = fh;
+    entry.in_use = true;
+    partition->handles.insert(make_pair(fname, entry));
+    EvictHandles(partition, &evicted);
+  }
+  CloseHandles(evicted);
+  return fh;
+}
+
+void FileHandleCache::ReleaseFileHandle(const string& fname,
+    DiskIoMgr::HdfsCachedFileHandle* fh, bool destroy_handle) {
+  Partition* partition = GetPartition(fname);
+  vector<DiskIoMgr::HdfsCachedFileHandle*> evicted;
+  {
+    lock_guard<mutex> l(partition->lock);
+    pair<HandleMap::iterator, HandleMap::iterator> range =
+        partition->handles.equal_range(fname);
+    HandleMap::iterator it = range.first;
+    while (it != range.second && it->second.fh != fh) ++it;
+    DCHECK(it != range.second) << "Handle of " << fname << " is not in the cache";
+    if (it == range.second) return;
+    DCHECK(it->second.in_use);
+    if (destroy_handle) {
+      evicted.push_back(fh);
+      partition->handles.erase(it);
+    } else {
+      it->second.in_use = false;
+      it->second.lru_pos = partition->lru_list.insert(partition->lru_list.end(), it);
+      if (ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES != NULL) {
+        ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(1L);
+      }
+    }
+    EvictHandles(partition, &evicted);
+  }
+  CloseHandles(evicted);
+}
+
+void FileHandleCache::EvictHandles(Partition* partition,
+    vector<DiskIoMgr::HdfsCachedFileHandle*>* evicted) {
+  while (partition->handles.size() > capacity_per_partition_ &&
+      !partition->lru_list.empty()) {
+    HandleMap::iterator it = partition->lru_list.front();
+    partition->lru_list.pop_front();
+    DCHECK(!it->second.in_use);
+    VLOG_FILE << "Cached file handle evicted, file=" << it->first;
+    evicted->push_back(it->second.fh);
+    partition->handles.erase(it);
+    if (ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES != NULL) {
+      ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
+    }
+  }
+}
+
+void FileHandleCache::CloseHandles(
+    const vector<DiskIoMgr::HdfsCachedFileHandle*>& handles) {
+  for (DiskIoMgr::HdfsCachedFileHandle* fh: handles) {
+    // Close the handle here if the close thread doesn't run.
+    if (close_thread_.get() == NULL || !close_queue_.BlockingPut(fh)) delete fh;
+  }
+}
+
+void FileHandleCache::CloseThread() {
+  DiskIoMgr::HdfsCachedFileHandle* fh;
+  while (close_queue_.BlockingGet(&fh)) delete fh;
+}
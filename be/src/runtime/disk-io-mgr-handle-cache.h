@@ -0,0 +1,126 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_DISK_IO_MGR_HANDLE_CACHE_H
+#define IMPALA_RUNTIME_DISK_IO_MGR_HANDLE_CACHE_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "runtime/disk-io-mgr.h"
+#include "util/blocking-queue.h"
+#include "util/thread.h"
+
+namespace impala {
+
+/// Cache of open HDFS file handles, so that scan ranges don't have to open the same
+/// files again. Opening a file is expensive for remote HDFS and S3 files, since it
+/// needs a round trip to the NameNode or S3.
+///
+/// A handle is lent to one scan range at a time, because the reads of a scan range
+/// move the position of its handle. Concurrent ranges of the same file each get their
+/// own handle, and all of them are kept when they are released, so the following
+/// ranges of the file reuse them.
+///
+/// The cache holds at most 'capacity' handles. Handles that are in use count towards
+/// the capacity but are never evicted, so the cache can temporarily hold more handles
+/// while more of them are in use. Otherwise the least recently released handles are
+/// evicted. The cache is split into partitions by the hash of the file name, each with
+/// its own lock and LRU list, so that the scan ranges of different files don't contend
+/// for one lock.
+///
+/// Evicted handles, and handles of files that were modified since they were opened, are
+/// closed by a background thread, since closing can be slow, e.g. for S3 files.
+///
+/// All functions are thread-safe.
+class FileHandleCache {
+ public:
+  /// Creates a cache of at most 'capacity' handles over 'num_partitions' partitions.
+  FileHandleCache(size_t capacity, int num_partitions);
+
+  /// Closes all cached handles. No handle may be in use.
+  ~FileHandleCache();
+
+  /// Starts the thread that closes evicted handles.
+  void Init();
+
+  /// Returns a handle of 'fname' in 'fs' with last modified time 'mtime' for the
+  /// exclusive use of the caller, or NULL if the file could not be opened. Opens a new
+  /// handle if no cached handle is unused. Sets '*cache_hit' to true if a cached handle
+  /// is returned.
+  DiskIoMgr::HdfsCachedFileHandle* GetFileHandle(const hdfsFS& fs,
+      const std::string& fname, int64_t mtime, bool* cache_hit);
+
+  /// Returns 'fh', which was returned by GetFileHandle() for 'fname', to the cache. If
+  /// 'destroy_handle' is true, the handle is closed instead of being reused.
+  void ReleaseFileHandle(const std::string& fname, DiskIoMgr::HdfsCachedFileHandle* fh,
+      bool destroy_handle);
+
+ private:
+  struct Entry;
+  typedef std::multimap<std::string, Entry> HandleMap;
+
+  struct Entry {
+    DiskIoMgr::HdfsCachedFileHandle* fh;
+
+    /// True while the handle is used by a scan range.
+    bool in_use;
+
+    /// Position in the LRU list of the partition. Only valid if 'in_use' is false.
+    std::list<HandleMap::iterator>::iterator lru_pos;
+  };
+
+  struct Partition {
+    /// Protects the fields below.
+    boost::mutex lock;
+
+    /// The handles of this partition by file name.
+    HandleMap handles;
+
+    /// The handles that are not in use, from the least to the most recently released.
+    std::list<HandleMap::iterator> lru_list;
+  };
+
+  /// Returns the partition of the handles of 'fname'.
+  Partition* GetPartition(const std::string& fname);
+
+  /// Removes the least recently released handles of 'partition' until it holds at most
+  /// capacity_per_partition_ handles or all remaining ones are in use, and adds them to
+  /// 'evicted'. The partition lock must be held.
+  void EvictHandles(Partition* partition,
+      std::vector<DiskIoMgr::HdfsCachedFileHandle*>* evicted);
+
+  /// Hands 'handles' to the close thread. Must not be called with a partition lock held.
+  void CloseHandles(const std::vector<DiskIoMgr::HdfsCachedFileHandle*>& handles);
+
+  /// Closes the handles in close_queue_ until the shutdown.
+  void CloseThread();
+
+  const int num_partitions_;
+  const size_t capacity_per_partition_;
+  boost::scoped_array<Partition> partitions_;
+
+  /// Handles that the close thread closes.
+  BlockingQueue<DiskIoMgr::HdfsCachedFileHandle*> close_queue_;
+  boost::scoped_ptr<Thread> close_thread_;
+};
+
+}
+
+#endif
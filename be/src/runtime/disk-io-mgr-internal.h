@@ -30,6 +30,9 @@
 #include "util/hdfs-util.h"
 #include "util/filesystem-util.h"
 #include "util/impalad-metrics.h"
+#include "util/io-uring.h"
+#include "util/stopwatch.h"
+#include "util/time.h"
 
 /// This file contains internal structures to the IoMgr. Users of the IoMgr do
 /// not need to include this file.
@@ -52,6 +55,19 @@ struct DiskIoMgr::DiskQueue {
   /// list of all request contexts that have work queued on this disk
   std::list<RequestContext*> request_contexts;
 
+  /// Virtual time of the context that a disk thread picked last. Contexts that are
+  /// scheduled on this disk start at this virtual time at the earliest.
+  int64_t virtual_time;
+
+  /// The ring that the reads of local files and the writes are submitted to with
+  /// --disk_io_backend=io_uring. NULL for the remote disks and with the default
+  /// backend.
+  boost::scoped_ptr<IoUring> io_uring;
+
+  /// Latencies of the reads of this disk, from the start of a read until its buffer is
+  /// filled. NULL if the DiskIoMgr has no metrics.
+  HistogramMetric* read_latencies;
+
   /// Enqueue the request context to the disk queue.  The DiskQueue lock must not be taken.
   inline void EnqueueContext(RequestContext* worker) {
     {
@@ -64,7 +80,36 @@ struct DiskIoMgr::DiskQueue {
     work_available.notify_all();
   }
 
-  DiskQueue(int id) : disk_id(id) { }
+  DiskQueue(int id) : disk_id(id), virtual_time(0), read_latencies(NULL) { }
+};
+
+/// A read or write in flight on the io_uring of a disk queue. Owned by the completion
+/// thread after it was submitted.
+struct DiskIoMgr::AsyncIo {
+  /// The context that the read or write is done for.
+  RequestContext* context;
+
+  /// The buffer of a read. NULL for writes.
+  BufferDescriptor* buffer_desc;
+
+  /// The range of a write. NULL for reads.
+  WriteRange* write_range;
+
+  /// The file descriptor of a write, which is closed when it is finished. Reads use
+  /// the file of the scan range.
+  int fd;
+
+  /// The part of the buffer that is read or written.
+  struct iovec iov;
+
+  /// Measures the time from the submission to the completion.
+  MonotonicStopWatch timer;
+
+  AsyncIo(RequestContext* context, BufferDescriptor* buffer_desc,
+      WriteRange* write_range)
+    : context(context), buffer_desc(buffer_desc), write_range(write_range), fd(-1) {
+    timer.Start();
+  }
 };
 
 /// Internal per request-context state. This object maintains a lot of state that is
@@ -206,6 +251,19 @@ class DiskIoMgr::RequestContext {
   /// Number of active read threads
   RuntimeProfile::Counter* active_read_thread_counter_;
 
+  /// Share of the disk queues relative to other contexts, see "Scheduling across
+  /// contexts" in disk-io-mgr.h.
+  int io_weight_;
+
+  /// Total time that this context waited on the disk queues, in ns. Shared with the
+  /// other contexts of the same request pool. NULL if not set.
+  IntCounter* io_wait_time_metric_;
+
+  /// NUMA node of the thread that last got a buffer from this context. The buffers of
+  /// the following reads are allocated on this node, so that they are likely to be
+  /// local to the thread that consumes them.
+  AtomicInt32 numa_node_;
+
   /// Disk access bitmap. The counter's bit[i] is set if disk id i has been accessed.
   /// TODO: we can only support up to 64 disks with this bitmap but it lets us use a
   /// builtin atomic instruction. Probably good enough for now.
@@ -353,6 +411,7 @@ class DiskIoMgr::RequestContext {
     void ScheduleContext(RequestContext* context, int disk_id) {
       if (!is_on_queue_ && !done_) {
         is_on_queue_ = true;
+        enqueue_time_ns_ = MonotonicNanos();
         context->parent_->disk_queues_[disk_id]->EnqueueContext(context);
       }
     }
@@ -369,6 +428,22 @@ class DiskIoMgr::RequestContext {
       num_threads_in_op_.Add(-1);
     }
 
+    /// Returns the virtual time of this context on the disk queue with virtual time
+    /// 'queue_virtual_time'. The disk queue lock must be taken before this.
+    int64_t virtual_time(int64_t queue_virtual_time) const {
+      return std::max(virtual_time_, queue_virtual_time);
+    }
+
+    /// Called when a disk thread picks this context from the disk queue 'disk_queue'.
+    /// Advances the virtual times of the queue and of this context, which has weight
+    /// 'weight'. Returns the time in ns that the context waited on the queue. The disk
+    /// queue lock must be taken before this.
+    int64_t Dispatch(DiskQueue* disk_queue, int weight) {
+      disk_queue->virtual_time = virtual_time(disk_queue->virtual_time);
+      virtual_time_ = disk_queue->virtual_time + DiskIoMgr::IO_STRIDE / weight;
+      return MonotonicNanos() - enqueue_time_ns_;
+    }
+
     /// Decrement request thread count and do final cleanup if this is the last
     /// thread. RequestContext lock must be taken before this.
     void DecrementRequestThreadAndCheckDone(RequestContext* context) {
@@ -390,6 +465,8 @@ class DiskIoMgr::RequestContext {
       is_on_queue_ = false;
       num_threads_in_op_.Store(0);
       next_scan_range_to_start_ = NULL;
+      virtual_time_ = 0;
+      enqueue_time_ns_ = 0;
     }
 
    private:
@@ -413,6 +490,13 @@ class DiskIoMgr::RequestContext {
     /// threads.
     bool is_on_queue_;
 
+    /// Virtual time of this context on this disk's queue, see "Scheduling across
+    /// contexts" in disk-io-mgr.h. Protected by the disk queue lock.
+    int64_t virtual_time_;
+
+    /// Time at which the context was last put on this disk's queue.
+    int64_t enqueue_time_ns_;
+
     /// For each disks, the number of request ranges that have not been fully read.
     /// In the non-cancellation path, this will hit 0, and done will be set to true
     /// by the disk thread. This is undefined in the cancellation path (the various
@@ -145,6 +145,8 @@ void DiskIoMgr::RequestContext::Reset(MemTracker* tracker) {
   read_timer_ = NULL;
   active_read_thread_counter_ = NULL;
   disks_accessed_bitmap_ = NULL;
+  io_weight_ = 1;
+  io_wait_time_metric_ = NULL;
 
   state_ = Active;
   mem_tracker_ = tracker;
@@ -161,6 +163,7 @@ void DiskIoMgr::RequestContext::Reset(MemTracker* tracker) {
   bytes_read_short_circuit_.Store(0);
   bytes_read_dn_cache_.Store(0);
   unexpected_remote_bytes_.Store(0);
+  numa_node_.Store(CpuInfo::GetCurrentNumaNode());
   initial_queue_capacity_ = DiskIoMgr::DEFAULT_QUEUE_CAPACITY;
 
   DCHECK(ready_to_start_ranges_.empty());
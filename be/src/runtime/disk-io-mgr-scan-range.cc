@@ -13,13 +13,20 @@
 // limitations under the License.
 
 #include "runtime/disk-io-mgr.h"
+#include "runtime/data-cache.h"
 #include "runtime/disk-io-mgr-internal.h"
+#include "util/counting-barrier.h"
 #include "util/error-util.h"
 #include "util/hdfs-util.h"
+#include "util/histogram-metric.h"
+#include "util/thread-pool.h"
 
 #include "common/names.h"
 
 using namespace impala;
+using namespace strings;
+
+DECLARE_int32(s3_max_concurrent_reads_per_range);
 
 // A very large max value to prevent things from going out of control. Not
 // expected to ever hit this value (1GB of buffered data per range).
@@ -93,6 +100,9 @@ Status DiskIoMgr::ScanRange::GetNext(BufferDescriptor** buffer) {
 
     // Remove the first ready buffer from the queue and return it
     DCHECK(!ready_buffers_.empty());
+    if (CpuInfo::num_numa_nodes() > 1) {
+      reader_->numa_node_.Store(CpuInfo::GetCurrentNumaNode());
+    }
     *buffer = ready_buffers_.front();
     ready_buffers_.pop_front();
     eosr_returned_ = (*buffer)->eosr();
@@ -145,6 +155,7 @@ void DiskIoMgr::ScanRange::Cancel(const Status& status) {
   if (io_mgr_ == NULL) return;
 
   DCHECK(!status.ok());
+  cancel_requested_.Store(1);
   {
     // Grab both locks to make sure that all working threads see is_cancelled_.
     unique_lock<mutex> scan_range_lock(lock_);
@@ -238,9 +249,11 @@ void DiskIoMgr::ScanRange::InitInternal(DiskIoMgr* io_mgr, RequestContext* reade
   hdfs_file_ = NULL;
   bytes_read_ = 0;
   is_cancelled_ = false;
+  cancel_requested_.Store(0);
   eosr_queued_= false;
   eosr_returned_= false;
   blocked_on_queue_ = false;
+  needs_seek_ = false;
   if (ready_buffers_capacity_ <= 0) {
     ready_buffers_capacity_ = reader->initial_scan_range_queue_capacity();
     DCHECK_GE(ready_buffers_capacity_, MIN_QUEUE_CAPACITY);
@@ -322,6 +335,10 @@ void DiskIoMgr::ScanRange::Close() {
       hadoopRzBufferFree(hdfs_file_->file(), cached_buffer_);
       cached_buffer_ = NULL;
     }
+    for (HdfsCachedFileHandle* fh: s3_read_handles_) {
+      io_mgr_->CacheOrCloseFileHandle(file(), fh, false);
+    }
+    s3_read_handles_.clear();
     io_mgr_->CacheOrCloseFileHandle(file(), hdfs_file_, false);
     VLOG_FILE << "Cache HDFS file handle file=" << file();
     hdfs_file_ = NULL;
@@ -367,18 +384,28 @@ Status DiskIoMgr::ScanRange::Read(char* buffer, int64_t* bytes_read, bool* eosr)
 
   if (fs_ != NULL) {
     DCHECK(hdfs_file_ != NULL);
-    int64_t max_chunk_size = MaxReadChunkSize();
-    while (*bytes_read < bytes_to_read) {
-      int chunk_size = min(bytes_to_read - *bytes_read, max_chunk_size);
-      int last_read = hdfsRead(fs_, hdfs_file_->file(), buffer + *bytes_read, chunk_size);
-      if (last_read == -1) {
-        return Status(GetHdfsErrorMsg("Error reading from HDFS file: ", file_));
-      } else if (last_read == 0) {
-        // No more bytes in the file. The scan range went past the end.
-        *eosr = true;
-        break;
-      }
-      *bytes_read += last_read;
+    bool use_data_cache = UseDataCache();
+    int64_t cached_bytes = 0;
+    if (use_data_cache) {
+      cached_bytes = io_mgr_->remote_data_cache_->Lookup(file_, mtime_,
+          offset_ + bytes_read_, bytes_to_read, buffer);
+      *bytes_read = cached_bytes;
+      if (cached_bytes > 0) needs_seek_ = true;
+    }
+    if (*bytes_read == bytes_to_read) {
+      // The whole buffer was cached.
+    } else if (io_mgr_->s3_read_pool_.get() != NULL &&
+        disk_id_ == io_mgr_->RemoteS3DiskId()) {
+      RETURN_IF_ERROR(ReadS3(buffer, bytes_to_read, bytes_read, eosr));
+    } else {
+      RETURN_IF_ERROR(ReadHdfs(buffer, bytes_to_read, bytes_read, eosr));
+    }
+    // Only the bytes that were not cached yet are stored. '*eosr' is only set if the
+    // file ended.
+    if (use_data_cache && *bytes_read > cached_bytes) {
+      io_mgr_->remote_data_cache_->Store(file_, mtime_,
+          offset_ + bytes_read_ + cached_bytes, *bytes_read - cached_bytes,
+          buffer + cached_bytes, *eosr);
     }
   } else {
     DCHECK(local_file_ != NULL);
@@ -405,6 +432,169 @@ Status DiskIoMgr::ScanRange::Read(char* buffer, int64_t* bytes_read, bool* eosr)
   return Status::OK();
 }
 
+Status DiskIoMgr::ScanRange::SubmitAsyncRead(IoUring* io_uring, char* buffer,
+    struct iovec* iov, void* user_data) {
+  // Holding hdfs_lock_ keeps the file open until the ring holds its own reference to
+  // it, so the range can be cancelled and closed while the read is in flight.
+  unique_lock<mutex> hdfs_lock(hdfs_lock_);
+  if (is_cancelled_) return Status::CANCELLED;
+  DCHECK(fs_ == NULL);
+  DCHECK(local_file_ != NULL);
+  int64_t bytes_to_read =
+      min(static_cast<int64_t>(io_mgr_->max_buffer_size_), len_ - bytes_read_);
+  DCHECK_GT(bytes_to_read, 0);
+  iov->iov_base = buffer;
+  iov->iov_len = bytes_to_read;
+  // The reads are positional, so the position of local_file_ is not used.
+  return io_uring->Submit(IoUring::READ, fileno(local_file_), iov,
+      offset_ + bytes_read_, user_data);
+}
+
+Status DiskIoMgr::ScanRange::FinishAsyncRead(int64_t bytes_to_read, int result,
+    int64_t* bytes_read, bool* eosr) {
+  unique_lock<mutex> hdfs_lock(hdfs_lock_);
+  if (is_cancelled_) return Status::CANCELLED;
+
+  *eosr = false;
+  *bytes_read = 0;
+  if (result < 0) {
+    stringstream ss;
+    ss << "Error reading from " << file_ << " at byte offset: "
+       << (offset_ + bytes_read_) << ": " << GetStrErrMsg(-result);
+    return Status(ss.str());
+  }
+  *bytes_read = result;
+  DCHECK_LE(*bytes_read, bytes_to_read);
+  // Like fread(), the read only returns fewer bytes at the end of the file.
+  if (*bytes_read < bytes_to_read) *eosr = true;
+  bytes_read_ += *bytes_read;
+  DCHECK_LE(bytes_read_, len_);
+  if (bytes_read_ == len_) *eosr = true;
+  return Status::OK();
+}
+
+bool DiskIoMgr::ScanRange::UseDataCache() const {
+  if (io_mgr_->remote_data_cache_.get() == NULL || mtime_ == NEVER_CACHE) return false;
+  return disk_id_ == io_mgr_->RemoteS3DiskId() || !expected_local_;
+}
+
+Status DiskIoMgr::ScanRange::ReadHdfs(char* buffer, int bytes_to_read,
+    int64_t* bytes_read, bool* eosr) {
+  if (needs_seek_) {
+    int64_t position = offset_ + bytes_read_ + *bytes_read;
+    if (hdfsSeek(fs_, hdfs_file_->file(), position) != 0) {
+      return Status(Substitute("Error seeking to $0 in file: $1 $2", position, file_,
+          GetHdfsErrorMsg("")));
+    }
+    needs_seek_ = false;
+  }
+  int64_t max_chunk_size = MaxReadChunkSize();
+  while (*bytes_read < bytes_to_read) {
+    if (cancel_requested_.Load() != 0) return Status::CANCELLED;
+    int chunk_size = min(bytes_to_read - *bytes_read, max_chunk_size);
+    int last_read = hdfsRead(fs_, hdfs_file_->file(), buffer + *bytes_read, chunk_size);
+    if (last_read == -1) {
+      return Status(GetHdfsErrorMsg("Error reading from HDFS file: ", file_));
+    } else if (last_read == 0) {
+      // No more bytes in the file. The scan range went past the end.
+      *eosr = true;
+      break;
+    }
+    *bytes_read += last_read;
+  }
+  return Status::OK();
+}
+
+// The chunks of the buffer are assigned round-robin to the concurrent reads, so the
+// reads progress through the buffer together and 'buffer' fills up roughly in order.
+// All reads are positional since the reads on the other handles don't move the
+// position of hdfs_file_.
+Status DiskIoMgr::ScanRange::ReadS3(char* buffer, int bytes_to_read,
+    int64_t* bytes_read, bool* eosr) {
+  // Skip the bytes that Read() found in the data cache.
+  int64_t file_offset = offset_ + bytes_read_ + *bytes_read;
+  buffer += *bytes_read;
+  bytes_to_read -= *bytes_read;
+  int64_t max_chunk_size = MaxReadChunkSize();
+  int num_chunks = BitUtil::Ceil(bytes_to_read, max_chunk_size);
+  int num_reads = min(num_chunks, FLAGS_s3_max_concurrent_reads_per_range);
+  while (static_cast<int>(s3_read_handles_.size()) < num_reads - 1) {
+    HdfsCachedFileHandle* fh = io_mgr_->OpenHdfsFile(fs_, file(), mtime());
+    if (fh == NULL) {
+      // Not fatal, the range can be read with fewer concurrent reads.
+      VLOG_FILE << "Failed to open additional file handle for " << file_ << ": "
+                << GetHdfsErrorMsg("");
+      break;
+    }
+    s3_read_handles_.push_back(fh);
+  }
+  num_reads = min<int>(num_reads, s3_read_handles_.size() + 1);
+
+  vector<S3ChunkRead> chunks(num_chunks);
+  CountingBarrier barrier(num_reads);
+  for (int i = 1; i < num_reads; ++i) {
+    bool offered = io_mgr_->s3_read_pool_->Offer(bind(&ScanRange::ReadS3Chunks, this,
+        s3_read_handles_[i - 1]->file(), file_offset, buffer, bytes_to_read, i,
+        num_reads, &chunks, &barrier));
+    if (!offered) {
+      // The pool is shut down, read the chunks on this thread instead.
+      ReadS3Chunks(s3_read_handles_[i - 1]->file(), file_offset, buffer, bytes_to_read,
+          i, num_reads, &chunks, &barrier);
+    }
+  }
+  ReadS3Chunks(hdfs_file_->file(), file_offset, buffer, bytes_to_read, 0, num_reads,
+      &chunks, &barrier);
+  barrier.Wait();
+
+  // Only the contiguous prefix of the buffer is valid. A short chunk means that the
+  // file ended, so the chunks after it are empty.
+  for (int i = 0; i < num_chunks; ++i) {
+    RETURN_IF_ERROR(chunks[i].status);
+    *bytes_read += chunks[i].bytes_read;
+    if (chunks[i].bytes_read < min(max_chunk_size, bytes_to_read - i * max_chunk_size)) {
+      // No more bytes in the file. The scan range went past the end.
+      *eosr = true;
+      break;
+    }
+  }
+  return Status::OK();
+}
+
+void DiskIoMgr::ScanRange::ReadS3Chunks(hdfsFile file, int64_t file_offset,
+    char* buffer, int bytes_to_read, int first_chunk, int stride,
+    vector<S3ChunkRead>* chunks, CountingBarrier* barrier) {
+  NotifyBarrierOnExit notify(barrier);
+  int64_t max_chunk_size = MaxReadChunkSize();
+  for (int i = first_chunk; i < chunks->size(); i += stride) {
+    S3ChunkRead* chunk = &(*chunks)[i];
+    int64_t chunk_offset = i * max_chunk_size;
+    int chunk_size = min(max_chunk_size, bytes_to_read - chunk_offset);
+    chunk->bytes_read = 0;
+    while (chunk->bytes_read < chunk_size) {
+      if (cancel_requested_.Load() != 0) {
+        chunk->status = Status::CANCELLED;
+        return;
+      }
+      MonotonicStopWatch timer;
+      timer.Start();
+      int last_read = hdfsPread(fs_, file, file_offset + chunk_offset + chunk->bytes_read,
+          buffer + chunk_offset + chunk->bytes_read, chunk_size - chunk->bytes_read);
+      if (ImpaladMetrics::IO_MGR_S3_READ_LATENCIES != NULL) {
+        ImpaladMetrics::IO_MGR_S3_READ_LATENCIES->Update(
+            timer.ElapsedTime() / (1000 * 1000));
+      }
+      if (last_read == -1) {
+        chunk->status = Status(GetHdfsErrorMsg("Error reading from HDFS file: ", file_));
+        return;
+      } else if (last_read == 0) {
+        // The file ended, so all following chunks are empty too.
+        return;
+      }
+      chunk->bytes_read += last_read;
+    }
+  }
+}
+
 Status DiskIoMgr::ScanRange::ReadFromCache(bool* read_succeeded) {
   DCHECK(try_cache_);
   DCHECK_EQ(bytes_read_, 0);
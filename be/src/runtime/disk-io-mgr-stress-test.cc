@@ -20,6 +20,8 @@
 
 using namespace impala;
 
+DECLARE_string(disk_io_backend);
+
 // Simple utility to run the disk io stress test.  A optional second parameter
 // can be passed to control how long to run this test (0 for forever).
 
@@ -29,6 +31,12 @@ const int NUM_DISKS = 5;
 const int NUM_THREADS_PER_DISK = 5;
 const int NUM_CLIENTS = 10;
 const bool TEST_CANCELLATION = true;
+// The backends split the duration. When running indefinitely, they take turns in
+// rounds of ROUND_SEC each. The io_uring backend falls back to the threads backend if
+// the kernel doesn't support it.
+const char* BACKENDS[] = {"threads", "io_uring"};
+const int NUM_BACKENDS = sizeof(BACKENDS) / sizeof(BACKENDS[0]);
+const int ROUND_SEC = 60;
 
 int main(int argc, char** argv) {
   google::InitGoogleLogging(argv[0]);
@@ -49,8 +57,18 @@ int main(int argc, char** argv) {
   } else {
     printf("Running stress test indefinitely.\n");
   }
-  DiskIoMgrStress test(NUM_DISKS, NUM_THREADS_PER_DISK, NUM_CLIENTS, TEST_CANCELLATION);
-  test.Run(duration_sec);
+  int backend_duration_sec =
+      duration_sec == 0 ? ROUND_SEC : max(1, duration_sec / NUM_BACKENDS);
+  do {
+    for (const char* backend: BACKENDS) {
+      printf("Using --disk_io_backend=%s for %d seconds.\n", backend,
+          backend_duration_sec);
+      FLAGS_disk_io_backend = backend;
+      DiskIoMgrStress test(NUM_DISKS, NUM_THREADS_PER_DISK, NUM_CLIENTS,
+          TEST_CANCELLATION);
+      test.Run(backend_duration_sec);
+    }
+  } while (duration_sec == 0);
 
   return 0;
 }
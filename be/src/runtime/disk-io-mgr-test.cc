@@ -35,10 +35,18 @@ const int MIN_BUFFER_SIZE = 512;
 const int MAX_BUFFER_SIZE = 1024;
 const int LARGE_MEM_LIMIT = 1024 * 1024 * 1024;
 
+DECLARE_string(disk_io_backend);
+
 namespace impala {
 
-class DiskIoMgrTest : public testing::Test {
+// The tests run with each value of --disk_io_backend. The io_uring backend falls back to
+// the threads backend if the kernel doesn't support it.
+class DiskIoMgrTest : public testing::TestWithParam<const char*> {
  public:
+  virtual void SetUp() { FLAGS_disk_io_backend = GetParam(); }
+
+  virtual void TearDown() { FLAGS_disk_io_backend = "threads"; }
+
   void WriteValidateCallback(int num_writes, DiskIoMgr::WriteRange** written_range,
       DiskIoMgr* io_mgr, DiskIoMgr::RequestContext* reader, int32_t* data,
       Status expected_status, const Status& status) {
@@ -164,11 +172,13 @@ class DiskIoMgrTest : public testing::Test {
   int num_ranges_written_;
 };
 
+INSTANTIATE_TEST_CASE_P(Backends, DiskIoMgrTest, testing::Values("threads", "io_uring"));
+
 // Test a single writer with multiple disks and threads per disk. Each WriteRange
 // writes random 4-byte integers, and upon completion, the written data is validated
 // by reading the data back via a separate IoMgr instance. All writes are expected to
 // complete successfully.
-TEST_F(DiskIoMgrTest, SingleWriter) {
+TEST_P(DiskIoMgrTest, SingleWriter) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   num_ranges_written_ = 0;
   string tmp_file = "/tmp/disk_io_mgr_test.txt";
@@ -222,7 +232,7 @@ TEST_F(DiskIoMgrTest, SingleWriter) {
 }
 // Perform invalid writes (e.g. non-existent file, negative offset) and validate
 // that an error status is returned via the write callback.
-TEST_F(DiskIoMgrTest, InvalidWrite) {
+TEST_P(DiskIoMgrTest, InvalidWrite) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   num_ranges_written_ = 0;
   string tmp_file = "/tmp/non-existent.txt";
@@ -273,7 +283,7 @@ TEST_F(DiskIoMgrTest, InvalidWrite) {
 // Issue a number of writes, cancel the writer context and issue more writes.
 // AddWriteRange() is expected to succeed before the cancel and fail after it.
 // The writes themselves may finish with status cancelled or ok.
-TEST_F(DiskIoMgrTest, SingleWriterCancel) {
+TEST_P(DiskIoMgrTest, SingleWriterCancel) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   num_ranges_written_ = 0;
   string tmp_file = "/tmp/disk_io_mgr_test.txt";
@@ -336,7 +346,7 @@ TEST_F(DiskIoMgrTest, SingleWriterCancel) {
 
 // Basic test with a single reader, testing multiple threads, disks and a different
 // number of buffers.
-TEST_F(DiskIoMgrTest, SingleReader) {
+TEST_P(DiskIoMgrTest, SingleReader) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
   const char* data = "abcdefghijklm";
@@ -391,8 +401,56 @@ TEST_F(DiskIoMgrTest, SingleReader) {
   EXPECT_EQ(mem_tracker.consumption(), 0);
 }
 
+// Test processing ranges while the next range is read ahead with TryGetNextRange().
+TEST_P(DiskIoMgrTest, ReadAhead) {
+  MemTracker mem_tracker(LARGE_MEM_LIMIT);
+  const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
+  const char* data = "abcdefghijklm";
+  int len = strlen(data);
+  CreateTempFile(tmp_file, data);
+
+  // Get mtime for file
+  struct stat stat_val;
+  stat(tmp_file, &stat_val);
+
+  for (int num_disks = 1; num_disks <= 5; num_disks += 2) {
+    pool_.reset(new ObjectPool);
+    DiskIoMgr io_mgr(num_disks, 1, 1, 1);
+    ASSERT_OK(io_mgr.Init(&mem_tracker));
+    MemTracker reader_mem_tracker;
+    DiskIoMgr::RequestContext* reader;
+    ASSERT_OK(io_mgr.RegisterContext(&reader, &reader_mem_tracker));
+
+    // Returns right away if no range was prepared.
+    DiskIoMgr::ScanRange* next_range;
+    ASSERT_OK(io_mgr.TryGetNextRange(reader, &next_range));
+    EXPECT_TRUE(next_range == NULL);
+
+    vector<DiskIoMgr::ScanRange*> ranges;
+    for (int i = 0; i < len; ++i) {
+      ranges.push_back(InitRange(2, tmp_file, 0, len, i % num_disks, stat_val.st_mtime));
+    }
+    ASSERT_OK(io_mgr.AddScanRanges(reader, ranges));
+
+    int num_ranges_processed = 0;
+    while (true) {
+      DiskIoMgr::ScanRange* range = next_range;
+      if (range == NULL) ASSERT_OK(io_mgr.GetNextRange(reader, &range));
+      if (range == NULL) break;
+      ASSERT_OK(io_mgr.TryGetNextRange(reader, &next_range));
+      EXPECT_TRUE(next_range != range);
+      ValidateScanRange(range, data, len, Status::OK());
+      ++num_ranges_processed;
+    }
+    EXPECT_EQ(num_ranges_processed, ranges.size());
+    io_mgr.UnregisterContext(reader);
+    EXPECT_EQ(reader_mem_tracker.consumption(), 0);
+  }
+  EXPECT_EQ(mem_tracker.consumption(), 0);
+}
+
 // This test issues adding additional scan ranges while there are some still in flight.
-TEST_F(DiskIoMgrTest, AddScanRangeTest) {
+TEST_P(DiskIoMgrTest, AddScanRangeTest) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
   const char* data = "abcdefghijklm";
@@ -464,7 +522,7 @@ TEST_F(DiskIoMgrTest, AddScanRangeTest) {
 // Test to make sure that sync reads and async reads work together
 // Note: this test is constructed so the number of buffers is greater than the
 // number of scan ranges.
-TEST_F(DiskIoMgrTest, SyncReadTest) {
+TEST_P(DiskIoMgrTest, SyncReadTest) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
   const char* data = "abcdefghijklm";
@@ -535,7 +593,7 @@ TEST_F(DiskIoMgrTest, SyncReadTest) {
 }
 
 // Tests a single reader cancelling half way through scan ranges.
-TEST_F(DiskIoMgrTest, SingleReaderCancel) {
+TEST_P(DiskIoMgrTest, SingleReaderCancel) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
   const char* data = "abcdefghijklm";
@@ -600,7 +658,7 @@ TEST_F(DiskIoMgrTest, SingleReaderCancel) {
 }
 
 // Test when the reader goes over the mem limit
-TEST_F(DiskIoMgrTest, MemLimits) {
+TEST_P(DiskIoMgrTest, MemLimits) {
   const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
   const char* data = "abcdefghijklm";
   int len = strlen(data);
@@ -677,7 +735,7 @@ TEST_F(DiskIoMgrTest, MemLimits) {
 // Since these files are not in HDFS, the cached path always fails so this
 // only tests the fallback mechanism.
 // TODO: we can fake the cached read path without HDFS
-TEST_F(DiskIoMgrTest, CachedReads) {
+TEST_P(DiskIoMgrTest, CachedReads) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
   const char* data = "abcdefghijklm";
@@ -742,7 +800,7 @@ TEST_F(DiskIoMgrTest, CachedReads) {
   EXPECT_EQ(mem_tracker.consumption(), 0);
 }
 
-TEST_F(DiskIoMgrTest, MultipleReaderWriter) {
+TEST_P(DiskIoMgrTest, MultipleReaderWriter) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   const int ITERATIONS = 1;
   const char* data = "abcdefghijklmnopqrstuvwxyz";
@@ -828,7 +886,7 @@ TEST_F(DiskIoMgrTest, MultipleReaderWriter) {
 }
 
 // This test will test multiple concurrent reads each reading a different file.
-TEST_F(DiskIoMgrTest, MultipleReader) {
+TEST_P(DiskIoMgrTest, MultipleReader) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   const int NUM_READERS = 5;
   const int DATA_LEN = 50;
@@ -922,13 +980,13 @@ TEST_F(DiskIoMgrTest, MultipleReader) {
 // Stress test for multiple clients with cancellation
 // TODO: the stress app should be expanded to include sync reads and adding scan
 // ranges in the middle.
-TEST_F(DiskIoMgrTest, StressTest) {
+TEST_P(DiskIoMgrTest, StressTest) {
   // Run the test with 5 disks, 5 threads per disk, 10 clients and with cancellation
   DiskIoMgrStress test(5, 5, 10, true);
   test.Run(2); // In seconds
 }
 
-TEST_F(DiskIoMgrTest, Buffers) {
+TEST_P(DiskIoMgrTest, Buffers) {
   // Test default min/max buffer size
   int min_buffer_size = 1024;
   int max_buffer_size = 8 * 1024 * 1024; // 8 MB
@@ -983,7 +1041,7 @@ TEST_F(DiskIoMgrTest, Buffers) {
 }
 
 // IMPALA-2366: handle partial read where range goes past end of file.
-TEST_F(DiskIoMgrTest, PartialRead) {
+TEST_P(DiskIoMgrTest, PartialRead) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
   const char* data = "the quick brown fox jumped over the lazy dog";
@@ -15,16 +15,29 @@
 #include "runtime/disk-io-mgr.h"
 #include "runtime/disk-io-mgr-internal.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <boost/algorithm/string.hpp>
 
 #include "gutil/bits.h"
 #include "gutil/strings/substitute.h"
+#include "runtime/data-cache.h"
+#include "runtime/disk-io-mgr-handle-cache.h"
 #include "util/hdfs-util.h"
+#include "util/histogram-metric.h"
+#include "util/string-parser.h"
+#include "util/thread-pool.h"
 
 DECLARE_bool(disable_mem_pools);
 
 #include "common/names.h"
 
+using boost::algorithm::is_any_of;
+using boost::algorithm::split;
+using boost::algorithm::token_compress_on;
 using namespace impala;
 using namespace strings;
 
@@ -44,6 +57,42 @@ DEFINE_int32(num_remote_hdfs_io_threads, 8, "number of remote HDFS I/O threads")
 // open to S3 and use of multiple CPU cores since S3 reads are relatively compute
 // expensive (SSL and JNI buffer overheads).
 DEFINE_int32(num_s3_io_threads, 16, "number of S3 I/O threads");
+// The number of concurrent read requests that fill each buffer of an S3 scan range. The
+// latency of each S3 request is high, so several requests need to be in flight to
+// saturate the bandwidth of a connection per scan range.
+DEFINE_int32(s3_max_concurrent_reads_per_range, 4, "(Advanced) The maximum number of "
+    "concurrent read requests issued for each buffer of an S3 scan range. Each uses its "
+    "own file handle. If 1, the buffers are read with one request after the other.");
+// The data cache for remote reads. Each directory should be on a different local
+// disk, ideally an SSD.
+DEFINE_string(data_cache_dirs, "", "(Advanced) Comma-separated list of local "
+    "directories that cache the data of remote HDFS and S3 reads. Empty to disable the "
+    "cache.");
+DEFINE_int64(data_cache_capacity_per_dir, 64L * 1024L * 1024L * 1024L, "(Advanced) "
+    "The maximum number of bytes cached in each of --data_cache_dirs.");
+// The share of the disk queues of the queries in each request pool, e.g. to give
+// interactive queries lower I/O latency than batch queries that queue many ranges.
+DEFINE_string(io_pool_weights, "", "(Advanced) Comma-separated list of <pool>:<weight> "
+    "pairs. On each disk, the scans of a query in a pool with weight N get N times as "
+    "many turns as the scans of a query in a pool with weight 1, the default. Weights "
+    "must be between 1 and 16.");
+// With the io_uring backend the disk threads don't block on the reads of local files and
+// the writes, so fast devices such as NVMe SSDs can be kept busy with many requests in
+// flight without a thread for each of them. HDFS reads, including short-circuit reads,
+// are done by libhdfs and always block the disk thread.
+DEFINE_string(disk_io_backend, "threads", "(Advanced) How the local disk queues read "
+    "local files and write scratch files. 'threads': each disk thread does one "
+    "blocking read or write at a time. 'io_uring': the disk threads submit the reads and "
+    "writes to an io_uring for each disk, and a completion thread for each disk finishes "
+    "them. Falls back to 'threads' if io_uring is not supported by the kernel.");
+DEFINE_int32(io_uring_queue_depth, 64, "(Advanced) The maximum number of reads and "
+    "writes in flight on each local disk with --disk_io_backend=io_uring.");
+// On machines with several NUMA nodes, memory on the node of another socket is slower to
+// access than local memory.
+DEFINE_bool(disk_io_numa_aware, true, "(Advanced) If true and the machine has several "
+    "NUMA nodes, the I/O buffers are allocated on the NUMA node of the thread that "
+    "consumes them, and the threads of each local disk run on the cores of the NUMA node "
+    "of the disk's controller.");
 // The read size is the size of the reads sent to hdfs/os.
 // There is a trade off of latency and throughout, trying to keep disks busy but
 // not introduce seeks.  The literature seems to agree that with 8 MB reads, random
@@ -63,6 +112,19 @@ DEFINE_int32(max_free_io_buffers, 128,
 DEFINE_uint64(max_cached_file_handles, 0, "Maximum number of HDFS file handles "
     "that will be cached. Disabled if set to 0.");
 
+// Metric key format of the time the contexts of each request pool waited on the disk
+// queues. '$0' is replaced with the pool name.
+static const string POOL_IO_WAIT_TIME_METRIC_KEY_FORMAT =
+    "impala-server.io.mgr.io-wait-time-ns.$0";
+
+// Metric key format of the latencies of the reads of each disk queue. '$0' is replaced
+// with the disk id.
+static const string READ_LATENCIES_METRIC_KEY_FORMAT =
+    "impala-server.io.mgr.read-latencies-ns.$0";
+
+// The highest read latency that the histograms track.
+static const int64_t MAX_READ_LATENCY_NS = 10L * 60L * 1000L * 1000L * 1000L;
+
 // Rotational disks should have 1 thread per disk to minimize seeks.  Non-rotational
 // don't have this penalty and benefit from multiple concurrent IO requests.
 static const int THREADS_PER_ROTATIONAL_DISK = 1;
@@ -73,6 +135,17 @@ static const int THREADS_PER_FLASH_DISK = 8;
 // current queue size.
 static const int LOW_MEMORY = 64 * 1024 * 1024;
 
+// The value of the MPOL_PREFERRED mode of mbind() from linux/mempolicy.h, which makes
+// the kernel allocate the pages on the given node if it has memory available.
+static const int MPOL_PREFERRED_MODE = 1;
+
+// The maximum number of completions that an io_uring completion thread gets at once.
+static const int MAX_IO_URING_COMPLETIONS = 32;
+
+// The number of partitions of the file handle cache. Each partition has its own lock, so
+// the scan ranges of different files rarely contend for the same lock.
+static const int NUM_FILE_HANDLE_CACHE_PARTITIONS = 16;
+
 const int DiskIoMgr::DEFAULT_QUEUE_CAPACITY = 2;
 
 namespace detail {
@@ -82,13 +155,6 @@ static inline bool is_file_handle_caching_enabled() {
 }
 }
 
-/// This method is used to clean up resources upon eviction of a cache file handle.
-void DiskIoMgr::HdfsCachedFileHandle::Release(DiskIoMgr::HdfsCachedFileHandle** h) {
-  ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
-  VLOG_FILE << "Cached file handle evicted, hdfsCloseFile() fid=" << (*h)->hdfs_file_;
-  delete (*h);
-}
-
 DiskIoMgr::HdfsCachedFileHandle::HdfsCachedFileHandle(const hdfsFS& fs, const char* fname,
     int64_t mtime)
     : fs_(fs), hdfs_file_(hdfsOpenFile(fs, fname, O_RDONLY, 0, 0, 0)), mtime_(mtime) {
@@ -217,6 +283,7 @@ void DiskIoMgr::BufferDescriptor::Reset(RequestContext* reader,
   scan_range_ = range;
   buffer_ = buffer;
   buffer_len_ = buffer_len;
+  buffer_numa_node_ = 0;
   len_ = 0;
   eosr_ = false;
   status_ = Status::OK();
@@ -260,19 +327,46 @@ static void CheckSseSupport() {
   }
 }
 
+// Parses 'spec', a comma-separated list of <pool>:<weight> pairs, into 'weights'.
+static Status ParseIoPoolWeights(const string& spec, map<string, int>* weights) {
+  vector<string> pool_weights;
+  split(pool_weights, spec, is_any_of(","), token_compress_on);
+  for (const string& pool_weight: pool_weights) {
+    if (pool_weight.empty()) continue;
+    size_t colon = pool_weight.rfind(':');
+    int weight = 0;
+    if (colon != string::npos) {
+      StringParser::ParseResult result;
+      weight = StringParser::StringToInt<int>(pool_weight.c_str() + colon + 1,
+          pool_weight.size() - colon - 1, &result);
+      if (result != StringParser::PARSE_SUCCESS) weight = 0;
+    }
+    if (colon == string::npos || colon == 0 || weight < 1 ||
+        weight > DiskIoMgr::MAX_IO_WEIGHT) {
+      return Status(Substitute("Invalid --io_pool_weights entry '$0'. Expected "
+          "<pool>:<weight> with a weight between 1 and $1.", pool_weight,
+          DiskIoMgr::MAX_IO_WEIGHT));
+    }
+    (*weights)[pool_weight.substr(0, colon)] = weight;
+  }
+  return Status::OK();
+}
+
 DiskIoMgr::DiskIoMgr() :
     num_threads_per_disk_(FLAGS_num_threads_per_disk),
     max_buffer_size_(FLAGS_read_size),
     min_buffer_size_(FLAGS_min_buffer_size),
+    numa_aware_(FLAGS_disk_io_numa_aware && CpuInfo::num_numa_nodes() > 1),
+    metrics_(NULL),
     cached_read_options_(NULL),
     shut_down_(false),
     total_bytes_read_counter_(TUnit::BYTES),
     read_timer_(TUnit::TIME_NS),
-    file_handle_cache_(min(FLAGS_max_cached_file_handles,
-        FileSystemUtil::MaxNumFileHandles()),
-        &HdfsCachedFileHandle::Release) {
+    file_handle_cache_(new FileHandleCache(min(FLAGS_max_cached_file_handles,
+        FileSystemUtil::MaxNumFileHandles()), NUM_FILE_HANDLE_CACHE_PARTITIONS)) {
   int64_t max_buffer_size_scaled = BitUtil::Ceil(max_buffer_size_, min_buffer_size_);
-  free_buffers_.resize(Bits::Log2Ceiling64(max_buffer_size_scaled) + 1);
+  free_buffers_.resize(CpuInfo::num_numa_nodes(),
+      vector<list<char*> >(Bits::Log2Ceiling64(max_buffer_size_scaled) + 1));
   int num_local_disks = FLAGS_num_disks == 0 ? DiskInfo::num_disks() : FLAGS_num_disks;
   disk_queues_.resize(num_local_disks + REMOTE_NUM_DISKS);
   CheckSseSupport();
@@ -283,14 +377,17 @@ DiskIoMgr::DiskIoMgr(int num_local_disks, int threads_per_disk, int min_buffer_s
     num_threads_per_disk_(threads_per_disk),
     max_buffer_size_(max_buffer_size),
     min_buffer_size_(min_buffer_size),
+    numa_aware_(FLAGS_disk_io_numa_aware && CpuInfo::num_numa_nodes() > 1),
+    metrics_(NULL),
     cached_read_options_(NULL),
     shut_down_(false),
     total_bytes_read_counter_(TUnit::BYTES),
     read_timer_(TUnit::TIME_NS),
-    file_handle_cache_(min(FLAGS_max_cached_file_handles,
-            FileSystemUtil::MaxNumFileHandles()), &HdfsCachedFileHandle::Release) {
+    file_handle_cache_(new FileHandleCache(min(FLAGS_max_cached_file_handles,
+        FileSystemUtil::MaxNumFileHandles()), NUM_FILE_HANDLE_CACHE_PARTITIONS)) {
   int64_t max_buffer_size_scaled = BitUtil::Ceil(max_buffer_size_, min_buffer_size_);
-  free_buffers_.resize(Bits::Log2Ceiling64(max_buffer_size_scaled) + 1);
+  free_buffers_.resize(CpuInfo::num_numa_nodes(),
+      vector<list<char*> >(Bits::Log2Ceiling64(max_buffer_size_scaled) + 1));
   if (num_local_disks == 0) num_local_disks = DiskInfo::num_disks();
   disk_queues_.resize(num_local_disks + REMOTE_NUM_DISKS);
   CheckSseSupport();
@@ -308,8 +405,14 @@ DiskIoMgr::~DiskIoMgr() {
       unique_lock<mutex> disk_lock(disk_queues_[i]->lock);
     }
     disk_queues_[i]->work_available.notify_all();
+    // Wake up the completion thread with a completion without an AsyncIo.
+    if (disk_queues_[i]->io_uring.get() != NULL) {
+      Status status = disk_queues_[i]->io_uring->SubmitNop(NULL);
+      DCHECK(status.ok()) << status.GetDetail();
+    }
   }
   disk_thread_group_.JoinAll();
+  s3_read_pool_.reset();
 
   for (int i = 0; i < disk_queues_.size(); ++i) {
     if (disk_queues_[i] == NULL) continue;
@@ -329,8 +432,10 @@ DiskIoMgr::~DiskIoMgr() {
 
   // Delete all allocated buffers
   int num_free_buffers = 0;
-  for (int idx = 0; idx < free_buffers_.size(); ++idx) {
-    num_free_buffers += free_buffers_[idx].size();
+  for (int node = 0; node < free_buffers_.size(); ++node) {
+    for (int idx = 0; idx < free_buffers_[node].size(); ++idx) {
+      num_free_buffers += free_buffers_[node][idx].size();
+    }
   }
   DCHECK_EQ(num_allocated_buffers_.Load(), num_free_buffers);
   GcIoBuffers();
@@ -342,15 +447,32 @@ DiskIoMgr::~DiskIoMgr() {
   if (cached_read_options_ != NULL) hadoopRzOptionsFree(cached_read_options_);
 }
 
-Status DiskIoMgr::Init(MemTracker* process_mem_tracker) {
+Status DiskIoMgr::Init(MemTracker* process_mem_tracker, MetricGroup* metrics) {
   DCHECK(process_mem_tracker != NULL);
   process_mem_tracker_ = process_mem_tracker;
+  metrics_ = metrics;
+  RETURN_IF_ERROR(ParseIoPoolWeights(FLAGS_io_pool_weights, &io_pool_weights_));
+  bool use_io_uring = FLAGS_disk_io_backend == "io_uring";
+  if (!use_io_uring && FLAGS_disk_io_backend != "threads") {
+    return Status(Substitute("Invalid --disk_io_backend '$0'. Expected 'threads' or "
+        "'io_uring'.", FLAGS_disk_io_backend));
+  }
+  if (use_io_uring && !IoUring::IsSupported()) {
+    LOG(WARNING) << "io_uring is not supported on this machine. Using "
+                 << "--disk_io_backend=threads.";
+    use_io_uring = false;
+  }
   // If we hit the process limit, see if we can reclaim some memory by removing
   // previously allocated (but unused) io buffers.
   process_mem_tracker->AddGcFunction(bind(&DiskIoMgr::GcIoBuffers, this));
 
   for (int i = 0; i < disk_queues_.size(); ++i) {
     disk_queues_[i] = new DiskQueue(i);
+    if (metrics_ != NULL) {
+      disk_queues_[i]->read_latencies = metrics_->RegisterMetric(new HistogramMetric(
+          MakeTMetricDef(Substitute(READ_LATENCIES_METRIC_KEY_FORMAT, i),
+          TMetricKind::HISTOGRAM, TUnit::TIME_NS), MAX_READ_LATENCY_NS, 2));
+    }
     int num_threads_per_disk;
     if (i == RemoteDfsDiskId()) {
       num_threads_per_disk = FLAGS_num_remote_hdfs_io_threads;
@@ -369,8 +491,41 @@ Status DiskIoMgr::Init(MemTracker* process_mem_tracker) {
       disk_thread_group_.AddThread(new Thread("disk-io-mgr", ss.str(),
           &DiskIoMgr::WorkLoop, this, disk_queues_[i]));
     }
+    if (use_io_uring && i != RemoteDfsDiskId() && i != RemoteS3DiskId()) {
+      disk_queues_[i]->io_uring.reset(new IoUring());
+      Status status = disk_queues_[i]->io_uring->Init(FLAGS_io_uring_queue_depth);
+      if (!status.ok()) {
+        LOG(WARNING) << "Not using io_uring for disk " << i << ": "
+                     << status.GetDetail();
+        disk_queues_[i]->io_uring.reset();
+        continue;
+      }
+      stringstream ss;
+      ss << "io-uring-completions(Disk: " << i << ")";
+      disk_thread_group_.AddThread(new Thread("disk-io-mgr", ss.str(),
+          &DiskIoMgr::IoUringCompletionLoop, this, disk_queues_[i]));
+    }
+  }
+  if (FLAGS_s3_max_concurrent_reads_per_range > 1) {
+    // Each S3 disk thread can have all but one of its reads on the pool.
+    int num_pool_threads =
+        FLAGS_num_s3_io_threads * (FLAGS_s3_max_concurrent_reads_per_range - 1);
+    s3_read_pool_.reset(new CallableThreadPool("disk-io-mgr", "s3-read",
+        num_pool_threads, num_pool_threads));
+  }
+  if (!FLAGS_data_cache_dirs.empty()) {
+    vector<string> data_cache_dirs;
+    split(data_cache_dirs, FLAGS_data_cache_dirs, is_any_of(","), token_compress_on);
+    remote_data_cache_.reset(new DataCache(data_cache_dirs,
+        FLAGS_data_cache_capacity_per_dir, DataCache::DEFAULT_CHUNK_SIZE));
+    Status status = remote_data_cache_->Init();
+    if (!status.ok()) {
+      LOG(ERROR) << "Running without data cache: " << status.GetDetail();
+      remote_data_cache_.reset();
+    }
   }
   request_context_cache_.reset(new RequestContextCache(this));
+  if (detail::is_file_handle_caching_enabled()) file_handle_cache_->Init();
 
   cached_read_options_ = hadoopRzOptionsAlloc();
   DCHECK(cached_read_options_ != NULL);
@@ -455,6 +610,18 @@ void DiskIoMgr::set_disks_access_bitmap(RequestContext* r,
   r->disks_accessed_bitmap_ = c;
 }
 
+void DiskIoMgr::set_request_pool(RequestContext* r, const string& pool) {
+  map<string, int>::const_iterator weight = io_pool_weights_.find(pool);
+  r->io_weight_ = weight == io_pool_weights_.end() ? 1 : weight->second;
+  if (metrics_ == NULL) return;
+  lock_guard<mutex> l(pool_metrics_lock_);
+  IntCounter*& metric = pool_io_wait_time_metrics_[pool];
+  if (metric == NULL) {
+    metric = metrics_->AddCounter<int64_t>(POOL_IO_WAIT_TIME_METRIC_KEY_FORMAT, 0, pool);
+  }
+  r->io_wait_time_metric_ = metric;
+}
+
 int64_t DiskIoMgr::queue_size(RequestContext* reader) const {
   return reader->num_ready_buffers_.Load();
 }
@@ -599,6 +766,27 @@ Status DiskIoMgr::GetNextRange(RequestContext* reader, ScanRange** range) {
   return status;
 }
 
+Status DiskIoMgr::TryGetNextRange(RequestContext* reader, ScanRange** range) {
+  DCHECK(reader != NULL);
+  DCHECK(range != NULL);
+  *range = NULL;
+
+  unique_lock<mutex> reader_lock(reader->lock_);
+  DCHECK(reader->Validate()) << endl << reader->DebugString();
+  if (reader->state_ == RequestContext::Cancelled) {
+    DCHECK(!reader->status_.ok());
+    return reader->status_;
+  }
+  if (reader->ready_to_start_ranges_.empty()) return Status::OK();
+  *range = reader->ready_to_start_ranges_.Dequeue();
+  DCHECK(*range != NULL);
+  int disk_id = (*range)->disk_id();
+  DCHECK_EQ(*range, reader->disk_states_[disk_id].next_scan_range_to_start());
+  reader->disk_states_[disk_id].set_next_scan_range_to_start(NULL);
+  reader->ScheduleScanRange(*range);
+  return Status::OK();
+}
+
 Status DiskIoMgr::Read(RequestContext* reader,
     ScanRange* range, BufferDescriptor** buffer) {
   DCHECK(range != NULL);
@@ -671,9 +859,11 @@ DiskIoMgr::BufferDescriptor* DiskIoMgr::GetBufferDesc(
   return buffer_desc;
 }
 
-char* DiskIoMgr::GetFreeBuffer(int64_t* buffer_size) {
+char* DiskIoMgr::GetFreeBuffer(int64_t* buffer_size, int numa_node) {
   DCHECK_LE(*buffer_size, max_buffer_size_);
   DCHECK_GT(*buffer_size, 0);
+  DCHECK_GE(numa_node, 0);
+  DCHECK_LT(numa_node, free_buffers_.size());
   *buffer_size = min(static_cast<int64_t>(max_buffer_size_), *buffer_size);
   int idx = free_buffers_idx(*buffer_size);
   // Quantize buffer size to nearest power of 2 greater than the specified buffer size and
@@ -682,7 +872,8 @@ char* DiskIoMgr::GetFreeBuffer(int64_t* buffer_size) {
 
   unique_lock<mutex> lock(free_buffers_lock_);
   char* buffer = NULL;
-  if (free_buffers_[idx].empty()) {
+  list<char*>* free_buffers = &free_buffers_[numa_node][idx];
+  if (free_buffers->empty()) {
     num_allocated_buffers_.Add(1);
     if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(1L);
@@ -693,13 +884,13 @@ char* DiskIoMgr::GetFreeBuffer(int64_t* buffer_size) {
     // Update the process mem usage.  This is checked the next time we start
     // a read for the next reader (DiskIoMgr::GetNextScanRange)
     process_mem_tracker_->Consume(*buffer_size);
-    buffer = new char[*buffer_size];
+    buffer = AllocateBuffer(*buffer_size, numa_node);
   } else {
     if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->Increment(-1L);
     }
-    buffer = free_buffers_[idx].front();
-    free_buffers_[idx].pop_front();
+    buffer = free_buffers->front();
+    free_buffers->pop_front();
   }
   DCHECK(buffer != NULL);
   return buffer;
@@ -709,18 +900,20 @@ void DiskIoMgr::GcIoBuffers() {
   unique_lock<mutex> lock(free_buffers_lock_);
   int buffers_freed = 0;
   int bytes_freed = 0;
-  for (int idx = 0; idx < free_buffers_.size(); ++idx) {
-    for (list<char*>::iterator iter = free_buffers_[idx].begin();
-         iter != free_buffers_[idx].end(); ++iter) {
-      int64_t buffer_size = (1 << idx) * min_buffer_size_;
-      process_mem_tracker_->Release(buffer_size);
-      num_allocated_buffers_.Add(-1);
-      delete[] *iter;
-
-      ++buffers_freed;
-      bytes_freed += buffer_size;
+  for (int node = 0; node < free_buffers_.size(); ++node) {
+    for (int idx = 0; idx < free_buffers_[node].size(); ++idx) {
+      for (list<char*>::iterator iter = free_buffers_[node][idx].begin();
+           iter != free_buffers_[node][idx].end(); ++iter) {
+        int64_t buffer_size = (1 << idx) * min_buffer_size_;
+        process_mem_tracker_->Release(buffer_size);
+        num_allocated_buffers_.Add(-1);
+        FreeBuffer(*iter, buffer_size);
+
+        ++buffers_freed;
+        bytes_freed += buffer_size;
+      }
+      free_buffers_[node][idx].clear();
     }
-    free_buffers_[idx].clear();
   }
 
   if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
@@ -735,27 +928,30 @@ void DiskIoMgr::GcIoBuffers() {
 }
 
 void DiskIoMgr::ReturnFreeBuffer(BufferDescriptor* desc) {
-  ReturnFreeBuffer(desc->buffer_, desc->buffer_len_);
+  ReturnFreeBuffer(desc->buffer_, desc->buffer_len_, desc->buffer_numa_node_);
   desc->SetMemTracker(NULL);
   desc->buffer_ = NULL;
 }
 
-void DiskIoMgr::ReturnFreeBuffer(char* buffer, int64_t buffer_size) {
+void DiskIoMgr::ReturnFreeBuffer(char* buffer, int64_t buffer_size, int numa_node) {
   DCHECK(buffer != NULL);
+  DCHECK_GE(numa_node, 0);
+  DCHECK_LT(numa_node, free_buffers_.size());
   int idx = free_buffers_idx(buffer_size);
   DCHECK_EQ(BitUtil::Ceil(buffer_size, min_buffer_size_) & ~(1 << idx), 0)
       << "buffer_size_ / min_buffer_size_ should be power of 2, got buffer_size = "
       << buffer_size << ", min_buffer_size_ = " << min_buffer_size_;
   unique_lock<mutex> lock(free_buffers_lock_);
-  if (!FLAGS_disable_mem_pools && free_buffers_[idx].size() < FLAGS_max_free_io_buffers) {
-    free_buffers_[idx].push_back(buffer);
+  list<char*>* free_buffers = &free_buffers_[numa_node][idx];
+  if (!FLAGS_disable_mem_pools && free_buffers->size() < FLAGS_max_free_io_buffers) {
+    free_buffers->push_back(buffer);
     if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->Increment(1L);
     }
   } else {
     process_mem_tracker_->Release(buffer_size);
     num_allocated_buffers_.Add(-1);
-    delete[] buffer;
+    FreeBuffer(buffer, buffer_size);
     if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
       ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(-1L);
     }
@@ -765,6 +961,56 @@ void DiskIoMgr::ReturnFreeBuffer(char* buffer, int64_t buffer_size) {
   }
 }
 
+bool DiskIoMgr::IsNumaAllocated(int64_t buffer_size) const {
+  static const int64_t page_size = sysconf(_SC_PAGESIZE);
+  return numa_aware_ && buffer_size % page_size == 0;
+}
+
+char* DiskIoMgr::AllocateBuffer(int64_t buffer_size, int numa_node) {
+  if (!IsNumaAllocated(buffer_size)) return new char[buffer_size];
+  void* buffer = mmap(NULL, buffer_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  CHECK(buffer != MAP_FAILED) << "Could not allocate an I/O buffer of " << buffer_size
+      << " bytes: " << GetStrErrMsg();
+  // The pages are only allocated when they are first written, on the preferred node if
+  // it has free memory. The buffer is usable even if the policy can't be set.
+  unsigned long node_mask = 0;
+  const int max_node = sizeof(node_mask) * 8;
+  if (numa_node < max_node) node_mask = 1UL << numa_node;
+  if (node_mask == 0 || syscall(__NR_mbind, buffer, buffer_size, MPOL_PREFERRED_MODE,
+      &node_mask, max_node, 0) != 0) {
+    VLOG_FILE << "Could not allocate an I/O buffer on NUMA node " << numa_node << ": "
+              << GetStrErrMsg();
+  }
+  return reinterpret_cast<char*>(buffer);
+}
+
+void DiskIoMgr::FreeBuffer(char* buffer, int64_t buffer_size) {
+  if (!IsNumaAllocated(buffer_size)) {
+    delete[] buffer;
+    return;
+  }
+  int ret = munmap(buffer, buffer_size);
+  DCHECK_EQ(ret, 0) << GetStrErrMsg();
+}
+
+void DiskIoMgr::SetNumaAffinity(DiskQueue* disk_queue) {
+  int disk_id = disk_queue->disk_id;
+  if (!numa_aware_ || disk_id >= num_local_disks() || disk_id >= DiskInfo::num_disks()) {
+    return;
+  }
+  int numa_node = DiskInfo::numa_node(disk_id);
+  if (numa_node < 0 || numa_node >= CpuInfo::num_numa_nodes()) return;
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int core: CpuInfo::GetCoresOfNumaNode(numa_node)) CPU_SET(core, &cpu_set);
+  int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  if (ret != 0) {
+    LOG(WARNING) << "Could not run the threads of disk " << disk_id << " on NUMA node "
+                 << numa_node << ": " << GetStrErrMsg(ret);
+  }
+}
+
 // This function gets the next RequestRange to work on for this disk. It checks for
 // cancellation and
 // a) Updates ready_to_start_ranges if there are no scan ranges queued for this disk.
@@ -797,11 +1043,30 @@ bool DiskIoMgr::GetNextRequestRange(DiskQueue* disk_queue, RequestRange** range,
       // can't pick it up.  It will be enqueued before issuing the read to HDFS
       // so this is not a big deal (i.e. multiple disk threads can read for the
       // same reader).
+      // The next reader is the one with the lowest virtual time. Ties go to the reader
+      // that was queued first.
       // TODO: revisit.
-      *request_context = disk_queue->request_contexts.front();
-      disk_queue->request_contexts.pop_front();
+      list<RequestContext*>::iterator next = disk_queue->request_contexts.begin();
+      int64_t next_virtual_time =
+          (*next)->disk_states_[disk_id].virtual_time(disk_queue->virtual_time);
+      for (list<RequestContext*>::iterator it = ++disk_queue->request_contexts.begin();
+          it != disk_queue->request_contexts.end(); ++it) {
+        int64_t virtual_time =
+            (*it)->disk_states_[disk_id].virtual_time(disk_queue->virtual_time);
+        if (virtual_time < next_virtual_time) {
+          next = it;
+          next_virtual_time = virtual_time;
+        }
+      }
+      *request_context = *next;
+      disk_queue->request_contexts.erase(next);
       DCHECK(*request_context != NULL);
       request_disk_state = &((*request_context)->disk_states_[disk_id]);
+      int64_t wait_time_ns =
+          request_disk_state->Dispatch(disk_queue, (*request_context)->io_weight_);
+      if ((*request_context)->io_wait_time_metric_ != NULL) {
+        (*request_context)->io_wait_time_metric_->Increment(wait_time_ns);
+      }
       request_disk_state->IncrementRequestThreadAndDequeue();
     }
 
@@ -978,6 +1243,7 @@ void DiskIoMgr::WorkLoop(DiskQueue* disk_queue) {
   //      re-enqueues the request.
   //   3. Perform the read or write as specified.
   // Cancellation checking needs to happen in both steps 1 and 3.
+  SetNumaAffinity(disk_queue);
   while (true) {
     RequestContext* worker_context = NULL;;
     RequestRange* range = NULL;
@@ -991,7 +1257,11 @@ void DiskIoMgr::WorkLoop(DiskQueue* disk_queue) {
       ReadRange(disk_queue, worker_context, static_cast<ScanRange*>(range));
     } else {
       DCHECK(range->request_type() == RequestType::WRITE);
-      Write(worker_context, static_cast<WriteRange*>(range));
+      if (disk_queue->io_uring.get() != NULL) {
+        WriteAsync(disk_queue, worker_context, static_cast<WriteRange*>(range));
+      } else {
+        Write(worker_context, static_cast<WriteRange*>(range));
+      }
     }
   }
 
@@ -1043,7 +1313,12 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
     }
   }
 
-  buffer = GetFreeBuffer(&buffer_size);
+  // Allocate the buffer close to the thread that consumes it.
+  int numa_node = 0;
+  if (numa_aware_) {
+    numa_node = min(reader->numa_node_.Load(), CpuInfo::num_numa_nodes() - 1);
+  }
+  buffer = GetFreeBuffer(&buffer_size, numa_node);
   reader->num_used_buffers_.Add(1);
 
   // Validate more invariants.
@@ -1054,6 +1329,7 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
 
   BufferDescriptor* buffer_desc = GetBufferDesc(reader, range, buffer, buffer_size);
   DCHECK(buffer_desc != NULL);
+  buffer_desc->buffer_numa_node_ = numa_node;
 
   // No locks in this section.  Only working on local vars.  We don't want to hold a
   // lock across the read call.
@@ -1067,23 +1343,84 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
       int64_t disk_bit = 1 << disk_queue->disk_id;
       reader->disks_accessed_bitmap_->BitOr(disk_bit);
     }
-    SCOPED_TIMER(&read_timer_);
-    SCOPED_TIMER(reader->read_timer_);
-
-    buffer_desc->status_ = range->Read(buffer, &buffer_desc->len_, &buffer_desc->eosr_);
-    buffer_desc->scan_range_offset_ = range->bytes_read_ - buffer_desc->len_;
 
-    if (reader->bytes_read_counter_ != NULL) {
-      COUNTER_ADD(reader->bytes_read_counter_, buffer_desc->len_);
+    if (disk_queue->io_uring.get() != NULL && range->fs_ == NULL) {
+      AsyncIo* io = new AsyncIo(reader, buffer_desc, NULL);
+      buffer_desc->status_ =
+          range->SubmitAsyncRead(disk_queue->io_uring.get(), buffer, &io->iov, io);
+      // The read is finished by HandleAsyncReadFinished().
+      if (buffer_desc->status_.ok()) return;
+      delete io;
+    } else {
+      SCOPED_TIMER(&read_timer_);
+      SCOPED_TIMER(reader->read_timer_);
+      MonotonicStopWatch read_timer;
+      read_timer.Start();
+      buffer_desc->status_ =
+          range->Read(buffer, &buffer_desc->len_, &buffer_desc->eosr_);
+      if (disk_queue->read_latencies != NULL) {
+        disk_queue->read_latencies->Update(read_timer.ElapsedTime());
+      }
     }
+    UpdateReadCounters(reader, buffer_desc);
+  }
 
-    COUNTER_ADD(&total_bytes_read_counter_, buffer_desc->len_);
-    if (reader->active_read_thread_counter_) {
-      reader->active_read_thread_counter_->Add(-1L);
+  // Finished read, update reader/disk based on the results
+  HandleReadFinished(disk_queue, reader, buffer_desc);
+}
+
+void DiskIoMgr::UpdateReadCounters(RequestContext* reader,
+    BufferDescriptor* buffer_desc) {
+  buffer_desc->scan_range_offset_ =
+      buffer_desc->scan_range_->bytes_read_ - buffer_desc->len_;
+
+  if (reader->bytes_read_counter_ != NULL) {
+    COUNTER_ADD(reader->bytes_read_counter_, buffer_desc->len_);
+  }
+
+  COUNTER_ADD(&total_bytes_read_counter_, buffer_desc->len_);
+  if (reader->active_read_thread_counter_) {
+    reader->active_read_thread_counter_->Add(-1L);
+  }
+}
+
+void DiskIoMgr::IoUringCompletionLoop(DiskQueue* disk_queue) {
+  IoUring::Completion completions[MAX_IO_URING_COMPLETIONS];
+  SetNumaAffinity(disk_queue);
+  while (true) {
+    int num_completions =
+        disk_queue->io_uring->Wait(completions, MAX_IO_URING_COMPLETIONS);
+    for (int i = 0; i < num_completions; ++i) {
+      AsyncIo* io = reinterpret_cast<AsyncIo*>(completions[i].user_data);
+      if (io == NULL) {
+        // All reads and writes are finished before the shutdown.
+        DCHECK(shut_down_);
+        DCHECK_EQ(i, num_completions - 1);
+        return;
+      }
+      if (io->buffer_desc != NULL) {
+        HandleAsyncReadFinished(disk_queue, io, completions[i].result);
+      } else {
+        HandleAsyncWriteFinished(io, completions[i].result);
+      }
+      delete io;
     }
   }
+}
 
-  // Finished read, update reader/disk based on the results
+void DiskIoMgr::HandleAsyncReadFinished(DiskQueue* disk_queue, AsyncIo* io,
+    int result) {
+  RequestContext* reader = io->context;
+  BufferDescriptor* buffer_desc = io->buffer_desc;
+  int64_t elapsed_time = io->timer.ElapsedTime();
+  COUNTER_ADD(&read_timer_, elapsed_time);
+  if (reader->read_timer_ != NULL) COUNTER_ADD(reader->read_timer_, elapsed_time);
+  if (disk_queue->read_latencies != NULL) {
+    disk_queue->read_latencies->Update(elapsed_time);
+  }
+  buffer_desc->status_ = buffer_desc->scan_range_->FinishAsyncRead(io->iov.iov_len,
+      result, &buffer_desc->len_, &buffer_desc->eosr_);
+  UpdateReadCounters(reader, buffer_desc);
   HandleReadFinished(disk_queue, reader, buffer_desc);
 }
 
@@ -1107,6 +1444,53 @@ void DiskIoMgr::Write(RequestContext* writer_context, WriteRange* write_range) {
   HandleWriteFinished(writer_context, write_range, ret_status);
 }
 
+void DiskIoMgr::WriteAsync(DiskQueue* disk_queue, RequestContext* writer_context,
+    WriteRange* write_range) {
+  int fd = open(write_range->file(), O_WRONLY);
+  if (fd < 0) {
+    Status status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("open($0, O_WRONLY) failed with errno=$1 description=$2",
+            write_range->file_, errno, GetStrErrMsg())));
+    HandleWriteFinished(writer_context, write_range, status);
+    return;
+  }
+  AsyncIo* io = new AsyncIo(writer_context, NULL, write_range);
+  io->fd = fd;
+  io->iov.iov_base = const_cast<uint8_t*>(write_range->data_);
+  io->iov.iov_len = write_range->len_;
+  Status status = disk_queue->io_uring->Submit(IoUring::WRITE, fd, &io->iov,
+      write_range->offset(), io);
+  // The write is finished by HandleAsyncWriteFinished().
+  if (status.ok()) return;
+  delete io;
+  close(fd);
+  HandleWriteFinished(writer_context, write_range, status);
+}
+
+void DiskIoMgr::HandleAsyncWriteFinished(AsyncIo* io, int result) {
+  WriteRange* write_range = io->write_range;
+  Status status;
+  if (result < 0) {
+    status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("write($0, $1, $2) failed with errno=$3 description=$4",
+            write_range->file_, write_range->offset(), write_range->len_, -result,
+            GetStrErrMsg(-result))));
+  } else if (result < write_range->len_) {
+    // Writes to regular files are only short if the disk is full.
+    status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("write($0, $1, $2) only wrote $3 bytes", write_range->file_,
+            write_range->offset(), write_range->len_, result)));
+  } else if (ImpaladMetrics::IO_MGR_BYTES_WRITTEN != NULL) {
+    ImpaladMetrics::IO_MGR_BYTES_WRITTEN->Increment(write_range->len_);
+  }
+  if (close(io->fd) != 0 && status.ok()) {
+    status = Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("close($0) failed with errno=$1 description=$2", write_range->file_,
+            errno, GetStrErrMsg())));
+  }
+  HandleWriteFinished(io->context, write_range, status);
+}
+
 Status DiskIoMgr::WriteRangeHelper(FILE* file_handle, WriteRange* write_range) {
   // Seek to the correct offset and perform the write.
   int success = fseek(file_handle, write_range->offset(), SEEK_SET);
@@ -1133,7 +1517,7 @@ int DiskIoMgr::free_buffers_idx(int64_t buffer_size) {
   int64_t buffer_size_scaled = BitUtil::Ceil(buffer_size, min_buffer_size_);
   int idx = Bits::Log2Ceiling64(buffer_size_scaled);
   DCHECK_GE(idx, 0);
-  DCHECK_LT(idx, free_buffers_.size());
+  DCHECK_LT(idx, free_buffers_[0].size());
   return idx;
 }
 
@@ -1173,30 +1557,31 @@ int DiskIoMgr::AssignQueue(const char* file, int disk_id, bool expected_local) {
 DiskIoMgr::HdfsCachedFileHandle* DiskIoMgr::OpenHdfsFile(const hdfsFS& fs,
     const char* fname, int64_t mtime) {
   HdfsCachedFileHandle* fh = NULL;
-
-  // Check if a cached file handle exists and validate the mtime, if the mtime of the
-  // cached handle is not matching the mtime of the requested file, reopen.
-  if (detail::is_file_handle_caching_enabled() && file_handle_cache_.Pop(fname, &fh)) {
-    ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
-    if (fh->mtime() == mtime) {
-      ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_RATIO->Update(1L);
-      ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_COUNT->Increment(1L);
-      ImpaladMetrics::IO_MGR_NUM_FILE_HANDLES_OUTSTANDING->Increment(1L);
-      return fh;
+  bool cache_hit = false;
+  if (detail::is_file_handle_caching_enabled()) {
+    // The cache reopens the file if the mtime of the cached handles doesn't match the
+    // mtime of the requested file.
+    fh = file_handle_cache_->GetFileHandle(fs, fname, mtime, &cache_hit);
+  } else {
+    fh = new HdfsCachedFileHandle(fs, fname, mtime);
+    if (!fh->ok()) {
+      delete fh;
+      fh = NULL;
     }
-    VLOG_FILE << "mtime mismatch, closing cached file handle. Closing file=" << fname;
-    delete fh;
   }
 
   // Update cache hit ratio
-  ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_RATIO->Update(0L);
-  ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT->Increment(1L);
-  fh = new HdfsCachedFileHandle(fs, fname, mtime);
+  if (cache_hit) {
+    ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_RATIO->Update(1L);
+    ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_COUNT->Increment(1L);
+  } else {
+    ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_RATIO->Update(0L);
+    ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT->Increment(1L);
+  }
 
   // Check if the file handle was opened correctly
-  if (!fh->ok())  {
+  if (fh == NULL)  {
     VLOG_FILE << "Opening the file " << fname << " failed.";
-    delete fh;
     return NULL;
   }
 
@@ -1207,15 +1592,17 @@ DiskIoMgr::HdfsCachedFileHandle* DiskIoMgr::OpenHdfsFile(const hdfsFS& fs,
 void DiskIoMgr::CacheOrCloseFileHandle(const char* fname,
     DiskIoMgr::HdfsCachedFileHandle* fid, bool close) {
   ImpaladMetrics::IO_MGR_NUM_FILE_HANDLES_OUTSTANDING->Increment(-1L);
+  if (!detail::is_file_handle_caching_enabled()) {
+    VLOG_FILE << "Closing file=" << fname;
+    delete fid;
+    return;
+  }
   // Try to unbuffer the handle, on filesystems that do not support this call a non-zero
   // return code indicates that the operation was not successful and thus the file is
   // closed.
-  if (detail::is_file_handle_caching_enabled() &&
-      !close && hdfsUnbufferFile(fid->file()) == 0) {
+  if (!close && hdfsUnbufferFile(fid->file()) == 0) {
     // Clear read statistics before returning
     hdfsFileClearReadStatistics(fid->file());
-    file_handle_cache_.Put(fname, fid);
-    ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(1L);
   } else {
     if (close) {
       VLOG_FILE << "Closing file=" << fname;
@@ -1223,6 +1610,7 @@ void DiskIoMgr::CacheOrCloseFileHandle(const char* fname,
       VLOG_FILE << "FS does not support file handle unbuffering, closing file="
                 << fname;
     }
-    delete fid;
+    close = true;
   }
+  file_handle_cache_->ReleaseFileHandle(fname, fid, close);
 }
@@ -17,7 +17,9 @@
 #define IMPALA_RUNTIME_DISK_IO_MGR_H
 
 #include <list>
+#include <map>
 #include <vector>
+#include <sys/uio.h>
 
 #include <boost/scoped_ptr.hpp>
 #include <boost/unordered_set.hpp>
@@ -34,11 +36,17 @@
 #include "util/error-util.h"
 #include "util/internal-queue.h"
 #include "util/lru-cache.h"
+#include "util/metrics.h"
 #include "util/runtime-profile.h"
 #include "util/thread.h"
 
 namespace impala {
 
+class CallableThreadPool;
+class CountingBarrier;
+class DataCache;
+class FileHandleCache;
+class IoUring;
 class MemTracker;
 
 /// Manager object that schedules IO for all queries on all disks and remote filesystems
@@ -165,6 +173,17 @@ class MemTracker;
 /// is returned (HDFS does not allow this). We therefore need to defer the close until
 /// the cached buffer is returned (BufferDescriptor::Return()).
 //
+/// Scheduling across contexts:
+/// Each disk queue serves the contexts queued on it with stride scheduling, a form
+/// of weighted fair queuing. Each context has a virtual time per disk that advances by
+/// IO_STRIDE / weight for each request range a disk thread processes for it, and the
+/// disk threads pick the queued context with the lowest virtual time. With the default
+/// weight of 1 this is round-robin, but a context of a pool with weight N gets N times
+/// as many turns as one of a pool with weight 1, e.g. so that small interactive scans
+/// are not stuck behind the many queued ranges of batch scans. A context that joins a
+/// queue starts at the queue's current virtual time, so that it can't build up credit
+/// while it is idle.
+//
 /// Remote filesystem support (e.g. S3):
 /// Remote filesystems are modeled as "remote disks". That is, there is a seperate disk
 /// queue for each supported remote filesystem type. In order to maximize throughput,
@@ -173,6 +192,14 @@ class MemTracker;
 /// intensive than local disk/hdfs because of non-direct I/O and SSL processing, and can
 /// be CPU bottlenecked especially if not enough I/O threads for these queues are
 /// started.
+/// Each S3 request has a high latency, so a single thread reading a buffer with one
+/// request after the other can't make use of the available bandwidth. The buffers of S3
+/// scan ranges are therefore filled by several concurrent positional reads, each on its
+/// own file handle (see ScanRange::ReadS3()). One of them runs on the disk thread and
+/// the others on s3_read_pool_.
+/// The data of remote reads (S3 and HDFS ranges that are not expected to be local) can
+/// be cached on local disks with --data_cache_dirs (see DataCache). Read() copies the
+/// cached prefix of each buffer from the cache and reads the rest remotely.
 //
 /// TODO: IoMgr should be able to request additional scan ranges from the coordinator
 /// to help deal with stragglers.
@@ -210,10 +237,6 @@ class DiskIoMgr {
 
     int64_t mtime() const { return mtime_; }
 
-    /// This method is called to release acquired resources by the cached handle when it
-    /// is evicted.
-    static void Release(HdfsCachedFileHandle** h);
-
     bool ok() const { return hdfs_file_ != NULL; }
 
    private:
@@ -270,6 +293,9 @@ class DiskIoMgr {
     /// length of buffer_. For buffers from cached reads, the length is 0.
     int64_t buffer_len_;
 
+    /// NUMA node that buffer_ was allocated on.
+    int buffer_numa_node_;
+
     /// length of read contents
     int64_t len_;
 
@@ -398,6 +424,47 @@ class DiskIoMgr {
     /// of bytes read. Updates range to keep track of where in the file we are.
     Status Read(char* buffer, int64_t* bytes_read, bool* eosr);
 
+    /// Submits the next read of this range into 'buffer' to 'io_uring', to be
+    /// finished with FinishAsyncRead() when the completion with 'user_data' is
+    /// returned. Sets 'iov' to the part of 'buffer' that is read, which must stay valid
+    /// until then. Only for local files.
+    Status SubmitAsyncRead(IoUring* io_uring, char* buffer, struct iovec* iov,
+        void* user_data);
+
+    /// Like Read(), for the read of 'bytes_to_read' bytes submitted by SubmitAsyncRead()
+    /// whose completion returned 'result'.
+    Status FinishAsyncRead(int64_t bytes_to_read, int result, int64_t* bytes_read,
+        bool* eosr);
+
+    /// Result of reading one chunk of a buffer in ReadS3().
+    struct S3ChunkRead {
+      Status status;
+      int64_t bytes_read;
+    };
+
+    /// Returns true if the data of this range should be looked up in and stored in the
+    /// remote data cache.
+    bool UseDataCache() const;
+
+    /// The part of Read() that reads the remaining 'bytes_to_read' - '*bytes_read'
+    /// bytes of 'buffer' from HDFS or S3. '*bytes_read' is non-zero if the first bytes
+    /// were found in the data cache. Updates '*bytes_read' and sets '*eosr' if the file
+    /// ended before 'bytes_to_read' bytes.
+    Status ReadHdfs(char* buffer, int bytes_to_read, int64_t* bytes_read, bool* eosr);
+
+    /// Like ReadHdfs(), for S3 ranges if concurrent reads are enabled. Reads in chunks
+    /// of MaxReadChunkSize(), with up to FLAGS_s3_max_concurrent_reads_per_range chunks
+    /// read concurrently.
+    Status ReadS3(char* buffer, int bytes_to_read, int64_t* bytes_read, bool* eosr);
+
+    /// Reads the chunks 'first_chunk', 'first_chunk' + 'stride', ... of the
+    /// 'bytes_to_read' bytes at 'file_offset' into 'buffer' with positional reads on
+    /// 'file', and stores the results in 'chunks'. Stops at the first error or at the
+    /// end of the file. Notifies 'barrier' when done.
+    void ReadS3Chunks(hdfsFile file, int64_t file_offset, char* buffer,
+        int bytes_to_read, int first_chunk, int stride, std::vector<S3ChunkRead>* chunks,
+        CountingBarrier* barrier);
+
     /// Reads from the DN cache. On success, sets cached_buffer_ to the DN buffer
     /// and *read_succeeded to true.
     /// If the data is not cached, returns ok() and *read_succeeded is set to false.
@@ -434,6 +501,10 @@ class DiskIoMgr {
       HdfsCachedFileHandle* hdfs_file_;
     };
 
+    /// Additional handles of the file for the concurrent reads of ReadS3(). Opened on
+    /// the first read and returned by Close(). Only used while holding hdfs_lock_.
+    std::vector<HdfsCachedFileHandle*> s3_read_handles_;
+
     /// If non-null, this is DN cached buffer. This means the cached read succeeded
     /// and all the bytes for the range are in this buffer.
     struct hadoopRzBuffer* cached_buffer_;
@@ -482,6 +553,15 @@ class DiskIoMgr {
     /// If true, this scan range has been cancelled.
     bool is_cancelled_;
 
+    /// Set to 1 by Cancel() before it waits for hdfs_lock_, so that a disk thread that is
+    /// reading the range stops between the chunks of its read instead of finishing the
+    /// whole buffer first.
+    AtomicInt32 cancel_requested_;
+
+    /// If true, hdfs_file_ is not positioned after the bytes read so far because some
+    /// of them were found in the data cache. Only used while holding hdfs_lock_.
+    bool needs_seek_;
+
     /// Last modified time of the file associated with the scan range
     int64_t mtime_;
   };
@@ -535,8 +615,9 @@ class DiskIoMgr {
   /// for impalad, this object is never destroyed.
   ~DiskIoMgr();
 
-  /// Initialize the IoMgr. Must be called once before any of the other APIs.
-  Status Init(MemTracker* process_mem_tracker);
+  /// Initialize the IoMgr. Must be called once before any of the other APIs. If
+  /// 'metrics' is non-NULL, the per-pool I/O wait time metrics are added to it.
+  Status Init(MemTracker* process_mem_tracker, MetricGroup* metrics = NULL);
 
   /// Allocates tracking structure for a request context.
   /// Register a new request context which is returned in *request_context.
@@ -587,6 +668,12 @@ class DiskIoMgr {
   /// This call is blocking.
   Status GetNextRange(RequestContext* reader, ScanRange** range);
 
+  /// Like GetNextRange(), but returns NULL instead of waiting if the disk threads have
+  /// not prepared a range yet. Cached ranges are not returned, since they are read
+  /// right away and their cached blocks are mlocked until they are processed.
+  /// Callers use this to start reading a range ahead of processing it.
+  Status TryGetNextRange(RequestContext* reader, ScanRange** range);
+
   /// Reads the range and returns the result in buffer.
   /// This behaves like the typical synchronous read() api, blocking until the data
   /// is read. This can be called while there are outstanding ScanRanges and is
@@ -609,6 +696,11 @@ class DiskIoMgr {
   void set_active_read_thread_counter(RequestContext*, RuntimeProfile::Counter*);
   void set_disks_access_bitmap(RequestContext*, RuntimeProfile::Counter*);
 
+  /// Sets the request pool of the query that the context reads for. The context's
+  /// share of the disk queues is its pool's weight in --io_pool_weights, and the time
+  /// it waits in the disk queues is added to the pool's I/O wait time metric.
+  void set_request_pool(RequestContext*, const std::string& pool);
+
   int64_t queue_size(RequestContext* reader) const;
   int64_t bytes_read_local(RequestContext* reader) const;
   int64_t bytes_read_short_circuit(RequestContext* reader) const;
@@ -661,6 +753,13 @@ class DiskIoMgr {
   /// since the system dynamically adjusts.
   static const int DEFAULT_QUEUE_CAPACITY;
 
+  /// Virtual time that a context with weight 1 is charged for each request range that a
+  /// disk thread processes for it. Must be divisible by the allowed weights.
+  static const int64_t IO_STRIDE = 720720;
+
+  /// Maximum weight in --io_pool_weights.
+  static const int MAX_IO_WEIGHT = 16;
+
   /// "Disk" queue offsets for remote accesses.  Offset 0 corresponds to
   /// disk ID (i.e. disk_queue_ index) of num_local_disks().
   enum {
@@ -671,6 +770,7 @@ class DiskIoMgr {
 
  private:
   friend class BufferDescriptor;
+  struct AsyncIo;
   struct DiskQueue;
   class RequestContextCache;
 
@@ -692,9 +792,32 @@ class DiskIoMgr {
   /// The minimum size of each read buffer.
   const int min_buffer_size_;
 
+  /// True if the buffers are allocated on the NUMA node of their consumer and the disk
+  /// threads run on the NUMA node of their disk. Set from --disk_io_numa_aware.
+  const bool numa_aware_;
+
   /// Thread group containing all the worker threads.
   ThreadGroup disk_thread_group_;
 
+  /// Threads that issue the S3 reads of ReadS3() besides the one on the disk thread.
+  /// NULL if concurrent S3 reads are disabled.
+  boost::scoped_ptr<CallableThreadPool> s3_read_pool_;
+
+  /// Local cache of the data of remote reads. NULL if the cache is disabled.
+  boost::scoped_ptr<DataCache> remote_data_cache_;
+
+  /// I/O weights of the request pools, parsed from --io_pool_weights.
+  std::map<std::string, int> io_pool_weights_;
+
+  /// Metric group of the per-pool I/O wait time metrics. NULL if not set in Init().
+  MetricGroup* metrics_;
+
+  /// Protects pool_io_wait_time_metrics_.
+  boost::mutex pool_metrics_lock_;
+
+  /// The I/O wait time metric of each pool, created on first use.
+  std::map<std::string, IntCounter*> pool_io_wait_time_metrics_;
+
   /// Options object for cached hdfs reads. Set on startup and never modified.
   struct hadoopRzOptions* cached_read_options_;
 
@@ -717,18 +840,19 @@ class DiskIoMgr {
   /// Protects free_buffers_ and free_buffer_descs_
   boost::mutex free_buffers_lock_;
 
-  /// Free buffers that can be handed out to clients. There is one list for each buffer
+  /// Free buffers that can be handed out to clients, indexed by the NUMA node that
+  /// their memory is allocated on. There is one list for each buffer
   /// size, indexed by the Log2 of the buffer size in units of min_buffer_size_. The
   /// maximum buffer size is max_buffer_size_, so the maximum index is
   /// Log2(max_buffer_size_ / min_buffer_size_).
   //
   /// E.g. if min_buffer_size_ = 1024 bytes:
-  ///  free_buffers_[0]  => list of free buffers with size 1024 B
-  ///  free_buffers_[1]  => list of free buffers with size 2048 B
-  ///  free_buffers_[10] => list of free buffers with size 1 MB
-  ///  free_buffers_[13] => list of free buffers with size 8 MB
-  ///  free_buffers_[n]  => list of free buffers with size 2^n * 1024 B
-  std::vector<std::list<char*> > free_buffers_;
+  ///  free_buffers_[node][0]  => list of free buffers with size 1024 B
+  ///  free_buffers_[node][1]  => list of free buffers with size 2048 B
+  ///  free_buffers_[node][10] => list of free buffers with size 1 MB
+  ///  free_buffers_[node][13] => list of free buffers with size 8 MB
+  ///  free_buffers_[node][n]  => list of free buffers with size 2^n * 1024 B
+  std::vector<std::vector<std::list<char*> > > free_buffers_;
 
   /// List of free buffer desc objects that can be handed out to clients
   std::list<BufferDescriptor*> free_buffer_descs_;
@@ -744,10 +868,10 @@ class DiskIoMgr {
   /// It is indexed by disk id.
   std::vector<DiskQueue*> disk_queues_;
 
-  // Caching structure that maps file names to cached file handles. The cache has an upper
-  // limit of entries defined by FLAGS_max_cached_file_handles. Evicted cached file
-  // handles are closed.
-  FifoMultimap<std::string, HdfsCachedFileHandle*> file_handle_cache_;
+  /// Cache of the open file handles by file name. The cache has an upper limit of
+  /// entries defined by FLAGS_max_cached_file_handles. Evicted cached file handles are
+  /// closed.
+  boost::scoped_ptr<FileHandleCache> file_handle_cache_;
 
   /// Returns the index into free_buffers_ for a given buffer size
   int free_buffers_idx(int64_t buffer_size);
@@ -770,7 +894,9 @@ class DiskIoMgr {
   /// and *buffer_size is set to the size of the buffer. If there is an
   /// appropriately-sized free buffer in the 'free_buffers_', that is returned, otherwise
   /// a new one is allocated. *buffer_size must be between 0 and max_buffer_size_.
-  char* GetFreeBuffer(int64_t* buffer_size);
+  /// The buffer is taken from the free buffers of, or allocated on, NUMA node
+  /// 'numa_node'.
+  char* GetFreeBuffer(int64_t* buffer_size, int numa_node = 0);
 
   /// Garbage collect all unused io buffers. This is currently only triggered when the
   /// process wide limit is hit. This is not good enough. While it is sufficient for
@@ -781,12 +907,26 @@ class DiskIoMgr {
   /// Returns a buffer to the free list. buffer_size / min_buffer_size_ should be a power
   /// of 2, and buffer_size should be <= max_buffer_size_. These constraints will be met
   /// if buffer was acquired via GetFreeBuffer() (which it should have been).
-  void ReturnFreeBuffer(char* buffer, int64_t buffer_size);
+  /// 'numa_node' must be the node that was passed to GetFreeBuffer().
+  void ReturnFreeBuffer(char* buffer, int64_t buffer_size, int numa_node = 0);
 
   /// Returns the buffer in desc (cannot be NULL), sets buffer to NULL and clears the
   /// mem tracker.
   void ReturnFreeBuffer(BufferDescriptor* desc);
 
+  /// Returns true if buffers of 'buffer_size' bytes are mapped separately and placed on
+  /// their NUMA node. Only buffers of whole pages on NUMA machines are.
+  bool IsNumaAllocated(int64_t buffer_size) const;
+
+  /// Allocates a buffer of 'buffer_size' bytes, preferably on NUMA node 'numa_node', and
+  /// frees a buffer allocated with it.
+  char* AllocateBuffer(int64_t buffer_size, int numa_node);
+  void FreeBuffer(char* buffer, int64_t buffer_size);
+
+  /// Restricts the calling thread of 'disk_queue' to the cores of the NUMA node of the
+  /// disk if numa_aware_ is true and the node is known.
+  void SetNumaAffinity(DiskQueue* disk_queue);
+
   /// Disk worker thread loop. This function retrieves the next range to process on
   /// the disk queue and invokes ReadRange() or Write() depending on the type of Range().
   /// There can be multiple threads per disk running this loop.
@@ -828,6 +968,23 @@ class DiskIoMgr {
   /// Reads the specified scan range and calls HandleReadFinished when done.
   void ReadRange(DiskQueue* disk_queue, RequestContext* reader,
       ScanRange* range);
+
+  /// Updates the read counters after the read into 'buffer_desc' of its range.
+  void UpdateReadCounters(RequestContext* reader, BufferDescriptor* buffer_desc);
+
+  /// Like Write(), for disks with an io_uring. Submits the write and returns, and the
+  /// write is finished by HandleAsyncWriteFinished().
+  void WriteAsync(DiskQueue* disk_queue, RequestContext* writer_context,
+      WriteRange* write_range);
+
+  /// Completion thread loop of a disk with an io_uring. Finishes the reads and writes
+  /// submitted by the disk threads until the shutdown.
+  void IoUringCompletionLoop(DiskQueue* disk_queue);
+
+  /// Finish the read or write 'io' whose completion returned 'result', and call
+  /// HandleReadFinished() or HandleWriteFinished().
+  void HandleAsyncReadFinished(DiskQueue* disk_queue, AsyncIo* io, int result);
+  void HandleAsyncWriteFinished(AsyncIo* io, int result);
 };
 
 }
@@ -29,6 +29,7 @@
 #include "runtime/hbase-table-factory.h"
 #include "runtime/hdfs-fs-cache.h"
 #include "runtime/lib-cache.h"
+#include "runtime/mem-pool.h"
 #include "runtime/mem-tracker.h"
 #include "runtime/thread-resource-mgr.h"
 #include "runtime/tmp-file-mgr.h"
@@ -49,6 +50,7 @@
 #include "util/cgroups-mgr.h"
 #include "util/memory-metrics.h"
 #include "util/pretty-printer.h"
+#include "util/sampling-profiler.h"
 #include "util/thread-pool.h"
 #include "gen-cpp/ImpalaInternalService.h"
 #include "gen-cpp/CatalogService.h"
@@ -373,6 +375,10 @@ Status ExecEnv::StartServices() {
   mem_tracker_.reset(new MemTracker(TcmallocMetric::PHYSICAL_BYTES_RESERVED,
       bytes_limit > 0 ? bytes_limit : -1, -1, "Process"));
 
+  // Chunks cached by MemPools are counted in the process memory. Free them first, so
+  // that the tcmalloc callback below can return them to the OS.
+  mem_tracker_->AddGcFunction(&MemPool::FreeCachedChunks);
+
   // Since tcmalloc does not free unused memory, we may exceed the process mem limit even
   // if Impala is not actually using that much memory. Add a callback to free any unused
   // memory if we hit the process limit.
@@ -395,14 +401,16 @@ Status ExecEnv::StartServices() {
   LOG(INFO) << "Using global memory limit: "
             << PrettyPrinter::Print(bytes_limit, TUnit::BYTES);
 
-  RETURN_IF_ERROR(disk_io_mgr_->Init(mem_tracker_.get()));
+  RETURN_IF_ERROR(disk_io_mgr_->Init(mem_tracker_.get(), metrics_.get()));
 
   // Start services in order to ensure that dependencies between them are met
   if (enable_webserver_) {
     AddDefaultUrlCallbacks(webserver_.get(), mem_tracker_.get());
+    RETURN_IF_ERROR(SamplingProfiler::Init(webserver_.get()));
     RETURN_IF_ERROR(webserver_->Start());
   } else {
     LOG(INFO) << "Not starting webserver";
+    RETURN_IF_ERROR(SamplingProfiler::Init(NULL));
   }
 
   if (scheduler_ != NULL) RETURN_IF_ERROR(scheduler_->Init());
@@ -0,0 +1,145 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/fragment-output-cache.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "common/names.h"
+
+using namespace impala;
+
+namespace impala {
+
+// Returns an expr that calls the builtin function 'fn'.
+TExpr MakeFnCall(const string& fn) {
+  TExprNode node;
+  node.__set_node_type(TExprNodeType::FUNCTION_CALL);
+  node.fn.name.function_name = fn;
+  node.fn.binary_type = TFunctionBinaryType::BUILTIN;
+  node.__isset.fn = true;
+  TExpr expr;
+  expr.nodes.push_back(node);
+  return expr;
+}
+
+// Returns the request of a fragment that scans one file split with a data stream sink.
+TExecPlanFragmentParams MakeScanRequest() {
+  TExecPlanFragmentParams request;
+  TPlanNode scan;
+  scan.__set_node_id(0);
+  scan.__set_node_type(TPlanNodeType::HDFS_SCAN_NODE);
+  scan.conjuncts.push_back(MakeFnCall("lower"));
+  request.fragment.plan.nodes.push_back(scan);
+  request.fragment.output_sink.__set_type(TDataSinkType::DATA_STREAM_SINK);
+  request.fragment.__isset.output_sink = true;
+
+  TScanRangeParams scan_range;
+  THdfsFileSplit& split = scan_range.scan_range.hdfs_file_split;
+  split.__set_file_name("000000_0");
+  split.__set_length(1024);
+  split.__set_mtime(1);
+  scan_range.scan_range.__isset.hdfs_file_split = true;
+  scan_range.__set_volume_id(0);
+  request.params.per_node_scan_ranges[0].push_back(scan_range);
+  return request;
+}
+
+// Returns an entry with a single batch.
+FragmentOutputCache::EntryPtr MakeEntry(int64_t bytes) {
+  boost::shared_ptr<FragmentOutputCache::Entry> entry(new FragmentOutputCache::Entry());
+  entry->batches.resize(1);
+  entry->bytes = bytes;
+  return entry;
+}
+
+TEST(FragmentOutputCache, IsCacheable) {
+  TExecPlanFragmentParams request = MakeScanRequest();
+  EXPECT_TRUE(FragmentOutputCache::IsCacheable(request.fragment));
+
+  TPlanFragment fragment = request.fragment;
+  fragment.output_sink.__set_type(TDataSinkType::TABLE_SINK);
+  EXPECT_FALSE(FragmentOutputCache::IsCacheable(fragment));
+
+  fragment = request.fragment;
+  fragment.plan.nodes[0].conjuncts.push_back(MakeFnCall("rand"));
+  EXPECT_FALSE(FragmentOutputCache::IsCacheable(fragment));
+
+  fragment = request.fragment;
+  fragment.plan.nodes[0].conjuncts[0].nodes[0].fn.binary_type =
+      TFunctionBinaryType::NATIVE;
+  EXPECT_FALSE(FragmentOutputCache::IsCacheable(fragment));
+
+  fragment = request.fragment;
+  fragment.plan.nodes[0].runtime_filters.push_back(TRuntimeFilterDesc());
+  EXPECT_FALSE(FragmentOutputCache::IsCacheable(fragment));
+
+  fragment = request.fragment;
+  fragment.plan.nodes[0].__set_node_type(TPlanNodeType::EXCHANGE_NODE);
+  EXPECT_FALSE(FragmentOutputCache::IsCacheable(fragment));
+}
+
+TEST(FragmentOutputCache, GetKey) {
+  TExecPlanFragmentParams request = MakeScanRequest();
+  string key1, key2;
+  ASSERT_TRUE(FragmentOutputCache::GetKey(request, &key1));
+
+  // Where a scan range is read from doesn't matter.
+  request.params.per_node_scan_ranges[0][0].__set_volume_id(1);
+  ASSERT_TRUE(FragmentOutputCache::GetKey(request, &key2));
+  EXPECT_EQ(key1, key2);
+
+  // Rewritten files change the key.
+  request.params.per_node_scan_ranges[0][0].scan_range.hdfs_file_split.__set_mtime(2);
+  ASSERT_TRUE(FragmentOutputCache::GetKey(request, &key2));
+  EXPECT_NE(key1, key2);
+
+  request = MakeScanRequest();
+  request.fragment_instance_ctx.query_ctx.request.query_options.__set_batch_size(10);
+  ASSERT_TRUE(FragmentOutputCache::GetKey(request, &key2));
+  EXPECT_NE(key1, key2);
+
+  // Scan ranges of other tables don't identify the version of their data.
+  request = MakeScanRequest();
+  TScanRangeParams hbase_range;
+  hbase_range.scan_range.__isset.hbase_key_range = true;
+  request.params.per_node_scan_ranges[0].push_back(hbase_range);
+  EXPECT_FALSE(FragmentOutputCache::GetKey(request, &key2));
+
+  request = MakeScanRequest();
+  request.params.per_node_scan_ranges.clear();
+  EXPECT_FALSE(FragmentOutputCache::GetKey(request, &key2));
+}
+
+TEST(FragmentOutputCache, LookupAndInsert) {
+  FragmentOutputCache cache(1024, 100);
+  FragmentOutputCache::EntryPtr entry;
+  EXPECT_FALSE(cache.Lookup("k1", &entry));
+  cache.Insert("k1", MakeEntry(10));
+  ASSERT_TRUE(cache.Lookup("k1", &entry));
+  EXPECT_EQ(entry->batches.size(), 1);
+
+  // Output that is larger than the max entry size is dropped.
+  cache.Insert("k2", MakeEntry(200));
+  EXPECT_FALSE(cache.Lookup("k2", &entry));
+  EXPECT_EQ(cache.size(), 1);
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,196 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/fragment-output-cache.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <gutil/strings/substitute.h>
+
+#include "rpc/thrift-util.h"
+#include "util/impalad-metrics.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace strings;
+
+DEFINE_int64(fragment_output_cache_capacity, 0, "(Advanced) Maximum number of bytes of "
+    "serialized row batches sent by plan fragments that only scan HDFS files, which "
+    "are kept in an impalad-wide cache, so that repeated scans and pre-aggregations of "
+    "unchanged files are not executed again. If 0, the cache is disabled.");
+DEFINE_int64(fragment_output_cache_max_entry_size, 64L * 1024L * 1024L, "(Advanced) "
+    "Maximum number of bytes of the output of a single fragment instance in the "
+    "fragment output cache. Output of fragments that send more is not cached.");
+
+// Builtin functions whose results depend on more than their arguments.
+static const char* NON_DETERMINISTIC_FNS[] = {
+    "now", "current_timestamp", "unix_timestamp", "utc_timestamp", "rand", "random",
+    "uuid", "user", "current_user", "effective_user", "current_database", "pid",
+    "sleep", "version"};
+
+namespace {
+
+// Returns true if all functions that 'expr' calls are deterministic builtins.
+bool IsDeterministic(const TExpr& expr) {
+  for (const TExprNode& node: expr.nodes) {
+    if (!node.__isset.fn) continue;
+    if (node.fn.binary_type != TFunctionBinaryType::BUILTIN) return false;
+    for (const char* fn: NON_DETERMINISTIC_FNS) {
+      if (node.fn.name.function_name == fn) return false;
+    }
+  }
+  return true;
+}
+
+bool IsDeterministic(const vector<TExpr>& exprs) {
+  for (const TExpr& expr: exprs) {
+    if (!IsDeterministic(expr)) return false;
+  }
+  return true;
+}
+
+// Returns true if the output of 'node' only depends on its input and its exprs are
+// deterministic.
+bool IsCacheableNode(const TPlanNode& node) {
+  if (!node.runtime_filters.empty()) return false;
+  if (!IsDeterministic(node.conjuncts)) return false;
+  switch (node.node_type) {
+    case TPlanNodeType::HDFS_SCAN_NODE:
+      return node.hdfs_scan_node.collection_conjuncts.empty();
+    case TPlanNodeType::AGGREGATION_NODE:
+      return IsDeterministic(node.agg_node.grouping_exprs) &&
+          IsDeterministic(node.agg_node.aggregate_functions);
+    case TPlanNodeType::SORT_NODE:
+      return IsDeterministic(node.sort_node.sort_info.ordering_exprs);
+    case TPlanNodeType::SELECT_NODE:
+    case TPlanNodeType::EMPTY_SET_NODE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Appends the serialized 'obj' to 'key', prefixed by its length.
+template <typename T>
+bool AppendToKey(ThriftSerializer* serializer, const T& obj, string* key) {
+  string serialized;
+  if (!serializer->Serialize(&obj, &serialized).ok()) return false;
+  key->append(Substitute("$0:", serialized.size()));
+  key->append(serialized);
+  return true;
+}
+
+}
+
+FragmentOutputCache::FragmentOutputCache(int64_t capacity, int64_t max_entry_size)
+  : max_entry_size_(min(max_entry_size, capacity)),
+    cache_(capacity) {
+}
+
+FragmentOutputCache* FragmentOutputCache::GetInstance() {
+  static FragmentOutputCache* cache = FLAGS_fragment_output_cache_capacity > 0 ?
+      new FragmentOutputCache(FLAGS_fragment_output_cache_capacity,
+          FLAGS_fragment_output_cache_max_entry_size) : NULL;
+  return cache;
+}
+
+bool FragmentOutputCache::IsCacheable(const TPlanFragment& fragment) {
+  if (!fragment.__isset.output_sink) return false;
+  if (fragment.output_sink.type != TDataSinkType::DATA_STREAM_SINK) return false;
+  if (!IsDeterministic(fragment.output_exprs)) return false;
+  const TDataPartition& partition = fragment.output_sink.stream_sink.output_partition;
+  if (!IsDeterministic(partition.partition_exprs)) return false;
+  for (const TPlanNode& node: fragment.plan.nodes) {
+    if (!IsCacheableNode(node)) return false;
+  }
+  return true;
+}
+
+bool FragmentOutputCache::GetKey(const TExecPlanFragmentParams& request, string* key) {
+  if (!IsCacheable(request.fragment)) return false;
+  const TPlanFragmentExecParams& params = request.params;
+  // Keep the partitions that the scan ranges read, so that the key doesn't change with
+  // partitions that were added to the table since.
+  set<int64_t> partition_ids;
+  bool has_scan_ranges = false;
+  for (const auto& entry: params.per_node_scan_ranges) {
+    for (const TScanRangeParams& scan_range: entry.second) {
+      // Other scan ranges, e.g. of HBase tables, don't identify the version of their
+      // data.
+      if (!scan_range.scan_range.__isset.hdfs_file_split) return false;
+      partition_ids.insert(scan_range.scan_range.hdfs_file_split.partition_id);
+      has_scan_ranges = true;
+    }
+  }
+  if (!has_scan_ranges) return false;
+
+  TDescriptorTable desc_tbl = request.desc_tbl;
+  for (TTableDescriptor& table: desc_tbl.tableDescriptors) {
+    if (!table.__isset.hdfsTable) continue;
+    map<int64_t, THdfsPartition>& partitions = table.hdfsTable.partitions;
+    for (auto it = partitions.begin(); it != partitions.end();) {
+      if (partition_ids.find(it->first) == partition_ids.end()) {
+        partitions.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  ThriftSerializer serializer(true);
+  key->clear();
+  if (!AppendToKey(&serializer, request.fragment.plan, key)) return false;
+  if (!AppendToKey(&serializer, request.fragment.output_sink, key)) return false;
+  for (const TExpr& expr: request.fragment.output_exprs) {
+    if (!AppendToKey(&serializer, expr, key)) return false;
+  }
+  if (!AppendToKey(&serializer, desc_tbl, key)) return false;
+  if (!AppendToKey(&serializer,
+      request.fragment_instance_ctx.query_ctx.request.query_options, key)) {
+    return false;
+  }
+  // Only the scan ranges themselves identify the input, not where they are read from.
+  for (const auto& entry: params.per_node_scan_ranges) {
+    key->append(Substitute("$0:$1:", entry.first, entry.second.size()));
+    for (const TScanRangeParams& scan_range: entry.second) {
+      if (!AppendToKey(&serializer, scan_range.scan_range, key)) return false;
+    }
+  }
+  return true;
+}
+
+bool FragmentOutputCache::Lookup(const string& key, EntryPtr* entry) {
+  bool hit = cache_.Get(key, entry);
+  if (hit) {
+    if (ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_HIT_COUNT != NULL) {
+      ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_HIT_COUNT->Increment(1L);
+    }
+  } else if (ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_MISS_COUNT != NULL) {
+    ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_MISS_COUNT->Increment(1L);
+  }
+  return hit;
+}
+
+void FragmentOutputCache::Insert(const string& key, const EntryPtr& entry) {
+  // The cache stores the key in its map and its list.
+  int64_t charge = entry->bytes + 2 * key.size();
+  if (charge > max_entry_size_) return;
+  cache_.Put(key, entry, charge);
+  if (ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_NUM_ENTRIES != NULL) {
+    ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_NUM_ENTRIES->set_value(cache_.size());
+    ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_TOTAL_BYTES->set_value(cache_.total_charge());
+  }
+}
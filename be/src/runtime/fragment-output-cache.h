@@ -0,0 +1,97 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_RUNTIME_FRAGMENT_OUTPUT_CACHE_H
+#define IMPALA_RUNTIME_FRAGMENT_OUTPUT_CACHE_H
+
+#include <string>
+#include <vector>
+
+#include "gen-cpp/ImpalaInternalService_types.h"
+#include "gen-cpp/Results_types.h"
+#include "util/lru-cache.h"
+
+namespace impala {
+
+/// Cache of the output of plan fragments that only scan HDFS files, shared by all
+/// queries of an impalad and enabled by --fragment_output_cache_capacity. Serves
+/// queries that repeat the same scan, filter and pre-aggregation of static partitions,
+/// e.g. of a dimension table or of yesterday's data.
+///
+/// The output of a fragment instance is cached under a key made of its plan, output
+/// sink and exprs, the descriptors of its tuples and of the partitions it reads, its
+/// query options and its scan ranges, which contain the name, length and modification
+/// time of every file. Cached output is therefore never served after a file it was
+/// read from was rewritten or after the partitions' metadata changed. Since the plan
+/// includes the ids that the planner assigned to its nodes, tuples and slots, output is
+/// shared by statements that are planned alike up to the fragment, e.g. repeated
+/// reports, rather than by any statements with an equivalent subplan.
+///
+/// The output is kept as the serialized row batches that the fragment sent to its data
+/// stream sink. Tuple streams can't be shared across queries, since their buffers
+/// belong to the block manager of a single query.
+///
+/// Only fragments whose output is determined by their key are cached: fragments with a
+/// data stream sink, without exchanges, joins or runtime filters, whose scan ranges are
+/// all HDFS file splits and whose exprs only call deterministic builtin functions.
+/// This class is thread-safe.
+class FragmentOutputCache {
+ public:
+  /// The output of a fragment instance. Immutable once added to the cache.
+  struct Entry {
+    /// The row batches in the order the fragment sent them.
+    std::vector<TRowBatch> batches;
+
+    /// Total size of 'batches' in bytes.
+    int64_t bytes;
+
+    Entry() : bytes(0) {}
+  };
+
+  typedef LruCache<std::string, Entry>::ValuePtr EntryPtr;
+
+  /// 'capacity' is the limit on the total size of the cached output in bytes.
+  /// 'max_entry_size' is the limit for the output of a single fragment instance.
+  FragmentOutputCache(int64_t capacity, int64_t max_entry_size);
+
+  /// Returns the process-wide cache, or NULL if --fragment_output_cache_capacity is 0.
+  static FragmentOutputCache* GetInstance();
+
+  int64_t max_entry_size() const { return max_entry_size_; }
+
+  /// Returns true and sets 'key' if the output of the fragment instance of 'request'
+  /// can be cached.
+  static bool GetKey(const TExecPlanFragmentParams& request, std::string* key);
+
+  /// Returns true if the output of 'fragment' only depends on its scan ranges, i.e. it
+  /// has a data stream sink and none of the nodes or functions listed above.
+  static bool IsCacheable(const TPlanFragment& fragment);
+
+  /// Returns true and sets 'entry' if there is cached output for 'key'.
+  bool Lookup(const std::string& key, EntryPtr* entry);
+
+  /// Adds 'entry' under 'key'. Drops it if it is larger than max_entry_size().
+  void Insert(const std::string& key, const EntryPtr& entry);
+
+  size_t size() { return cache_.size(); }
+
+ private:
+  const int64_t max_entry_size_;
+
+  LruCache<std::string, Entry> cache_;
+};
+
+}
+
+#endif
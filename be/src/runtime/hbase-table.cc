@@ -27,6 +27,7 @@ jclass HBaseTable::table_cl_ = NULL;
 jmethodID HBaseTable::table_close_id_ = NULL;
 jmethodID HBaseTable::table_get_scanner_id_ = NULL;
 jmethodID HBaseTable::table_put_id_ = NULL;
+jmethodID HBaseTable::table_get_list_id_ = NULL;
 
 jclass HBaseTable::connection_cl_ = NULL;
 jmethodID HBaseTable::connection_get_table_id_ = NULL;
@@ -120,6 +121,10 @@ Status HBaseTable::InitJNI() {
   table_put_id_ = env->GetMethodID(table_cl_, "put", "(Ljava/util/List;)V");
   RETURN_ERROR_IF_EXC(env);
 
+  table_get_list_id_ = env->GetMethodID(table_cl_, "get",
+      "(Ljava/util/List;)[Lorg/apache/hadoop/hbase/client/Result;");
+  RETURN_ERROR_IF_EXC(env);
+
   // Connection
   RETURN_IF_ERROR(
       JniUtil::GetGlobalClassRef(env,
@@ -144,6 +149,16 @@ Status HBaseTable::GetResultScanner(const jobject& scan,
   return Status::OK();
 }
 
+Status HBaseTable::Get(const jobject& gets_list, jobjectArray* results) {
+  JNIEnv* env = getJNIEnv();
+  if (env == NULL) return Status("Error creating JNIEnv");
+
+  *results = reinterpret_cast<jobjectArray>(
+      env->CallObjectMethod(table_, table_get_list_id_, gets_list));
+  RETURN_ERROR_IF_EXC(env);
+  return Status::OK();
+}
+
 Status HBaseTable::Put(const jobject& puts_list) {
   JNIEnv* env = getJNIEnv();
   if (env == NULL) return Status("Error creating JNIEnv");
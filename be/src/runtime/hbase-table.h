@@ -41,6 +41,10 @@ class HBaseTable {
   /// KeyValues from HBase.
   Status GetResultScanner(const jobject& scan, jobject* result_scanner);
 
+  /// Fetches the rows of a java List of Get objects in one call. Returns a local
+  /// reference to the Result[] in 'results', with one, possibly empty, Result per Get.
+  Status Get(const jobject& gets_list, jobjectArray* results);
+
   /// Send an list of puts to hbase through a Table.
   Status Put(const jobject& puts_list);
 
@@ -70,6 +74,9 @@ class HBaseTable {
   /// table.put(List<Put> puts
   static jmethodID table_put_id_;
 
+  /// table.get(List<Get> gets)
+  static jmethodID table_get_list_id_;
+
   /// TableName class and static methods
   static jclass table_name_cl_;
 
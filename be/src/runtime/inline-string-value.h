@@ -0,0 +1,124 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_RUNTIME_INLINE_STRING_VALUE_H
+#define IMPALA_RUNTIME_INLINE_STRING_VALUE_H
+
+#include <string.h>
+#include <boost/cstdint.hpp>
+
+#include "runtime/string-value.inline.h"
+#include "util/bit-util.h"
+#include "util/hash-util.h"
+
+namespace impala {
+
+/// A compact form of a StringValue that has the same size, 16 bytes, but stores strings
+/// of up to MAX_INLINE_LEN bytes inline instead of pointing to them. Longer strings
+/// keep their first PREFIX_LEN bytes inline, followed by the pointer to the whole
+/// string:
+///
+///   bytes   0 - 3    4 - 7     8 - 15
+///   short:  len      the string, padded with zeros
+///   long:   len      prefix    ptr
+///
+/// Comparing, hashing and sorting short strings only touches the 16 bytes, and most
+/// comparisons of long strings are decided by the length and the prefix, without
+/// dereferencing the pointer. This pays off for short codes, e.g. of dictionary or
+/// flag columns, that are compared many times, like the keys of hash tables or sorts.
+/// The pointed-to data of long strings must stay valid as long as the InlineStringValue.
+/// No tuple layout uses it yet: string slots are always StringValues.
+class InlineStringValue {
+ public:
+  static const int MAX_INLINE_LEN = 12;
+  static const int PREFIX_LEN = 4;
+
+  InlineStringValue() { memset(this, 0, sizeof(*this)); }
+
+  explicit InlineStringValue(const StringValue& sv) {
+    memset(this, 0, sizeof(*this));
+    len_ = sv.len;
+    if (sv.len <= MAX_INLINE_LEN) {
+      memcpy(inline_data(), sv.ptr, sv.len);
+    } else {
+      memcpy(prefix_, sv.ptr, PREFIX_LEN);
+      ptr_ = sv.ptr;
+    }
+  }
+
+  int len() const { return len_; }
+  bool is_inline() const { return len_ <= MAX_INLINE_LEN; }
+
+  /// Returns the string, which points into this object for inlined strings.
+  const char* ptr() const { return is_inline() ? inline_data() : ptr_; }
+  StringValue ToStringValue() const {
+    return StringValue(const_cast<char*>(ptr()), len_);
+  }
+
+  /// Returns true if the strings are equal. Only dereferences the pointers if both
+  /// strings are long and have the same length and prefix.
+  bool Eq(const InlineStringValue& other) const {
+    if (LenAndPrefix() != other.LenAndPrefix()) return false;
+    if (is_inline()) return Suffix() == other.Suffix();
+    return memcmp(ptr_ + PREFIX_LEN, other.ptr_ + PREFIX_LEN, len_ - PREFIX_LEN) == 0;
+  }
+
+  /// Returns < 0, 0 or > 0 like StringValue::Compare(). Strings that differ within the
+  /// first PREFIX_LEN bytes are compared without dereferencing any pointer.
+  int Compare(const InlineStringValue& other) const {
+    // The prefixes are padded with zeros, so equal prefixes don't decide the order of
+    // e.g. "a" and "a\0".
+    uint32_t prefix = BitUtil::ByteSwap(Prefix());
+    uint32_t other_prefix = BitUtil::ByteSwap(other.Prefix());
+    if (prefix != other_prefix) return prefix < other_prefix ? -1 : 1;
+    return ToStringValue().Compare(other.ToStringValue());
+  }
+
+  /// Returns the same hash as HashUtil::Hash() of the string.
+  uint32_t Hash(uint32_t seed) const { return HashUtil::Hash(ptr(), len_, seed); }
+
+ private:
+  /// The inline string starts at 'prefix_' and continues over 'ptr_'.
+  char* inline_data() { return reinterpret_cast<char*>(this) + sizeof(len_); }
+  const char* inline_data() const {
+    return reinterpret_cast<const char*>(this) + sizeof(len_);
+  }
+
+  /// The first 8 or the last 8 bytes of the object as an integer.
+  uint64_t LenAndPrefix() const {
+    uint64_t val;
+    memcpy(&val, this, sizeof(val));
+    return val;
+  }
+  uint64_t Suffix() const {
+    uint64_t val;
+    memcpy(&val, reinterpret_cast<const char*>(this) + sizeof(val), sizeof(val));
+    return val;
+  }
+
+  uint32_t Prefix() const {
+    uint32_t val;
+    memcpy(&val, prefix_, sizeof(val));
+    return val;
+  }
+
+  int32_t len_;
+
+  char prefix_[PREFIX_LEN];
+  char* ptr_;
+};
+
+}
+
+#endif
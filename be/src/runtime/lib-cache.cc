@@ -14,6 +14,9 @@
 
 #include "runtime/lib-cache.h"
 
+#include <fstream>
+#include <sstream>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/thread/locks.hpp>
 
@@ -33,6 +36,13 @@ using namespace impala;
 
 DEFINE_string(local_library_dir, "/tmp",
               "Local directory to copy UDF libraries from HDFS into");
+DEFINE_bool(prefetch_udf_libraries, true, "(Advanced) If true, the libraries of "
+    "functions that are created while impalad is running are copied from HDFS and "
+    "loaded in the background before the first query that calls them.");
+
+// Maximum number of libraries waiting to be prefetched. Prefetch() drops libraries
+// beyond it rather than blocking its caller.
+static const uint32_t MAX_PREFETCH_QUEUE_SIZE = 64;
 
 scoped_ptr<LibCache> LibCache::instance_;
 
@@ -78,6 +88,10 @@ struct LibCache::LibCacheEntry {
   // not trivial to walk an .so for the symbol table.
   boost::unordered_set<std::string> symbols;
 
+  // The bitcode of the llvm module, which fragments parse and link into their own
+  // modules. Only used if the type is TYPE_IR.
+  boost::shared_ptr<const std::string> ir_module;
+
   // Set if an error occurs loading the cache entry before the cache entry
   // can be evicted. This allows other threads that attempt to use the entry
   // before it is removed to return the same error.
@@ -92,6 +106,10 @@ LibCache::LibCache() : current_process_handle_(NULL) {
 }
 
 LibCache::~LibCache() {
+  if (prefetch_pool_.get() != NULL) {
+    prefetch_pool_->Shutdown();
+    prefetch_pool_->Join();
+  }
   DropCache();
   if (current_process_handle_ != NULL) DynamicClose(current_process_handle_);
 }
@@ -114,6 +132,8 @@ Status LibCache::InitInternal() {
   }
   DCHECK(current_process_handle_ != NULL)
       << "We should always be able to get current process handle.";
+  prefetch_pool_.reset(new ThreadPool<PrefetchWork>("lib-cache", "prefetch", 1,
+      MAX_PREFETCH_QUEUE_SIZE, bind<void>(&LibCache::PrefetchLib, this, _1, _2)));
   return Status::OK();
 }
 
@@ -188,6 +208,35 @@ Status LibCache::GetLocalLibPath(const string& hdfs_lib_file, LibType type,
   return Status::OK();
 }
 
+Status LibCache::GetIrModule(const string& hdfs_lib_file,
+    boost::shared_ptr<const string>* bitcode) {
+  unique_lock<mutex> lock;
+  LibCacheEntry* entry = NULL;
+  RETURN_IF_ERROR(GetCacheEntry(hdfs_lib_file, TYPE_IR, &lock, &entry));
+  DCHECK(entry != NULL);
+  DCHECK_EQ(entry->type, TYPE_IR);
+  DCHECK(entry->ir_module.get() != NULL);
+  *bitcode = entry->ir_module;
+  return Status::OK();
+}
+
+void LibCache::Prefetch(const string& hdfs_lib_file, LibType type) {
+  if (!FLAGS_prefetch_udf_libraries || hdfs_lib_file.empty()) return;
+  // Prefetching is best effort, the library is loaded on first use otherwise.
+  if (prefetch_pool_->GetQueueSize() >= MAX_PREFETCH_QUEUE_SIZE) return;
+  prefetch_pool_->Offer(PrefetchWork(hdfs_lib_file, type));
+}
+
+void LibCache::PrefetchLib(int thread_id, const PrefetchWork& work) {
+  unique_lock<mutex> lock;
+  LibCacheEntry* entry = NULL;
+  Status status = GetCacheEntry(work.first, work.second, &lock, &entry);
+  if (!status.ok()) {
+    VLOG(1) << "Could not prefetch library " << work.first << ": "
+            << status.GetDetail();
+  }
+}
+
 Status LibCache::CheckSymbolExists(const string& hdfs_lib_file, LibType type,
     const string& symbol, bool quiet) {
   if (type == TYPE_SO) {
@@ -395,12 +444,24 @@ Status LibCache::GetCacheEntryInternal(const string& hdfs_lib_file, LibType type
     RETURN_IF_ERROR(
         DynamicOpen((*entry)->local_path.c_str(), &(*entry)->shared_object_handle));
   } else if (type == TYPE_IR) {
-    // Load the module temporarily and populate all symbols.
+    // Keep the bitcode in memory, and load the module temporarily to check that it can
+    // be parsed and to populate all symbols.
+    ifstream in((*entry)->local_path.c_str(), ios::in | ios::binary);
+    if (!in) {
+      stringstream ss;
+      ss << "Could not read module " << hdfs_lib_file << " (local path: "
+         << (*entry)->local_path << ")";
+      return Status(ss.str());
+    }
+    stringstream bitcode;
+    bitcode << in.rdbuf();
+    (*entry)->ir_module.reset(new string(bitcode.str()));
     ObjectPool pool;
     scoped_ptr<LlvmCodeGen> codegen;
     string module_id = filesystem::path((*entry)->local_path).stem().string();
-    RETURN_IF_ERROR(
-        LlvmCodeGen::CreateFromFile(&pool, (*entry)->local_path, module_id, &codegen));
+    RETURN_IF_ERROR(LlvmCodeGen::CreateFromMemory(&pool,
+        llvm::MemoryBufferRef(*(*entry)->ir_module, (*entry)->local_path),
+        (*entry)->local_path, module_id, &codegen));
     codegen->GetSymbols(&(*entry)->symbols);
   } else {
     DCHECK_EQ(type, TYPE_JAR);
@@ -17,13 +17,16 @@
 #define IMPALA_RUNTIME_LIB_CACHE_H
 
 #include <string>
+#include <utility>
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/thread/mutex.hpp>
 #include "common/atomic.h"
 #include "common/object-pool.h"
 #include "common/status.h"
+#include "util/thread-pool.h"
 
 namespace impala {
 
@@ -33,8 +36,13 @@ class RuntimeState;
 /// These libraries can either be shared objects, llvm modules or jars. For
 /// shared objects, when we load the shared object, we dlopen() it and keep
 /// it in our process. For modules, we store the symbols in the module to
-/// service symbol lookups. We can't cache the module since it (i.e. the external
-/// module) is consumed when it is linked with the query codegen module.
+/// service symbol lookups and keep the module's bitcode in memory, from which every
+/// fragment that uses the module parses and links it. We can't cache the parsed module
+/// since it (i.e. the external module) belongs to the LLVMContext of a single
+/// LlvmCodeGen and is consumed when it is linked with the query codegen module.
+//
+/// The libraries of functions that are created after startup are prefetched in the
+/// background, see Prefetch().
 //
 /// Locking strategy: We don't want to grab a big lock across all operations since
 /// one of the operations is copying a file from HDFS. With one lock that would
@@ -74,6 +82,18 @@ class LibCache {
   Status GetLocalLibPath(const std::string& hdfs_lib_file, LibType type,
                          std::string* local_path);
 
+  /// Sets 'bitcode' to the bitcode of the LLVM module at 'hdfs_lib_file', which is read
+  /// once when the library is copied to the local fs. The bitcode stays valid while the
+  /// caller holds it, even if the library is refreshed or removed from the cache.
+  Status GetIrModule(const std::string& hdfs_lib_file,
+      boost::shared_ptr<const std::string>* bitcode);
+
+  /// Copies 'hdfs_lib_file' to the local fs and loads it in a background thread, so
+  /// that the first query that uses it doesn't wait for it. Entries that need to be
+  /// refreshed are refreshed. Does nothing if --prefetch_udf_libraries is false or too
+  /// many libraries are already waiting to be prefetched.
+  void Prefetch(const std::string& hdfs_lib_file, LibType type);
+
   /// Returns status.ok() if the symbol exists in 'hdfs_lib_file', non-ok otherwise.
   /// If 'quiet' is true, the error status for non-Java unfound symbols will not be logged.
   Status CheckSymbolExists(const std::string& hdfs_lib_file, LibType type,
@@ -115,6 +135,10 @@ class LibCache {
   /// dlopen() handle for the current process (i.e. impalad).
   void* current_process_handle_;
 
+  /// Loads the libraries passed to Prefetch() in the background. A library and its type.
+  typedef std::pair<std::string, LibType> PrefetchWork;
+  boost::scoped_ptr<ThreadPool<PrefetchWork> > prefetch_pool_;
+
   /// The number of libs that have been copied from HDFS to the local FS.
   /// This is appended to the local fs path to remove collisions.
   AtomicInt64 num_libs_copied_;
@@ -134,6 +158,9 @@ class LibCache {
 
   Status InitInternal();
 
+  /// Called by prefetch_pool_ to load 'work'.
+  void PrefetchLib(int thread_id, const PrefetchWork& work);
+
   /// Returns the cache entry for 'hdfs_lib_file'. If this library has not been
   /// copied locally, it will copy it and add a new LibCacheEntry to 'lib_cache_'.
   /// Result is returned in *entry.
@@ -30,6 +30,10 @@ class MemPoolTest {
     return pool->CheckIntegrity(current_chunk_empty);
   }
 
+  static uint8_t* FirstChunk(MemPool* pool) {
+    return pool->chunks_.empty() ? NULL : pool->chunks_[0].data;
+  }
+
   static const int INITIAL_CHUNK_SIZE = MemPool::INITIAL_CHUNK_SIZE;
   static const int MAX_CHUNK_SIZE = MemPool::MAX_CHUNK_SIZE;
 };
@@ -394,6 +398,28 @@ TEST(MemPoolTest, FragmentationOverhead) {
   p.FreeAll();
 }
 
+// Test that a freed chunk of a standard size is reused by the next pool.
+TEST(MemPoolTest, ChunkCache) {
+  MemTracker tracker;
+  MemPool p(&tracker);
+  ASSERT_TRUE(p.Allocate(10) != NULL);
+  uint8_t* chunk = MemPoolTest::FirstChunk(&p);
+  p.FreeAll();
+  EXPECT_EQ(tracker.consumption(), 0);
+
+  MemPool p2(&tracker);
+  ASSERT_TRUE(p2.Allocate(10) != NULL);
+  EXPECT_EQ(MemPoolTest::FirstChunk(&p2), chunk);
+  EXPECT_EQ(tracker.consumption(), MemPoolTest::INITIAL_CHUNK_SIZE);
+  p2.FreeAll();
+
+  // Chunks of other sizes are not cached, but don't break anything.
+  MemPool p3(&tracker);
+  ASSERT_TRUE(p3.Allocate(MemPoolTest::MAX_CHUNK_SIZE + 1) != NULL);
+  p3.FreeAll();
+  EXPECT_EQ(tracker.consumption(), 0);
+}
+
 }
 
 int main(int argc, char **argv) {
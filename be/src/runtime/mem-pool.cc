@@ -13,13 +13,16 @@
 // limitations under the License.
 
 #include "runtime/mem-pool.h"
+#include "common/atomic.h"
 #include "runtime/mem-tracker.h"
 #include "util/bit-util.h"
 #include "util/impalad-metrics.h"
+#include "util/spinlock.h"
 
 #include <algorithm>
 #include <stdio.h>
 #include <sstream>
+#include <boost/thread/tss.hpp>
 
 #include "common/names.h"
 
@@ -27,8 +30,224 @@ using namespace impala;
 
 #define MEM_POOL_POISON (0x66aa77bb)
 
+DEFINE_int64(mem_pool_thread_cache_bytes, 1L * 1024 * 1024, "(Advanced) Maximum bytes "
+    "of freed mem pool chunks that each thread caches for reuse. 0 disables caching.");
+DEFINE_int64(mem_pool_global_cache_bytes, 64L * 1024 * 1024, "(Advanced) Maximum bytes "
+    "of freed mem pool chunks that threads with full caches share through a global "
+    "cache.");
+
 DECLARE_bool(disable_mem_pools);
 
+namespace impala {
+
+/// Caches freed chunks of the standard chunk sizes. Each thread caches up to
+/// --mem_pool_thread_cache_bytes without locking. When a thread's cache is full, half
+/// of its chunks of the freed size move to the global cache in one batch, and a
+/// thread that runs out of a size refills it from the global cache in one batch. The
+/// chunks of a thread move to the global cache when the thread exits. Chunks that
+/// don't fit the global cache are freed. Cached chunks count against no query
+/// MemTracker: a pool consumes a chunk when it gets it and releases it when it frees
+/// it, as it would with malloc() and free(). They do count against the process
+/// tracker, whose GC calls Flush().
+class MemPool::ChunkCache {
+ public:
+  /// Returns a cached chunk of 'size' bytes, or NULL if there is none.
+  static uint8_t* Get(int64_t size);
+
+  /// Caches 'chunk' of 'size' bytes, or frees it.
+  static void Put(uint8_t* chunk, int64_t size);
+
+  /// Frees the chunks of the global cache. The thread caches can only be accessed by
+  /// their threads, so each thread frees the chunks of its cache on its next Get() or
+  /// Put().
+  static void Flush();
+
+ private:
+  /// The number of standard chunk sizes, INITIAL_CHUNK_SIZE to MAX_CHUNK_SIZE.
+  static const int NUM_SIZES = 9;
+
+  struct ChunkLists {
+    /// chunks[i] holds chunks of INITIAL_CHUNK_SIZE << i bytes.
+    vector<uint8_t*> chunks[NUM_SIZES];
+    int64_t bytes;
+
+    /// The value of flush_count_ when the chunks were last freed by Flush(). Only
+    /// used for thread caches.
+    int64_t flush_count;
+
+    ChunkLists() : bytes(0), flush_count(0) {}
+  };
+
+  /// Returns the index of 'size' in ChunkLists::chunks, or -1 if 'size' is not a
+  /// standard size or caching is disabled.
+  static int SizeIdx(int64_t size);
+
+  /// Moves chunks of 'size' bytes from the back of 'src' to 'dst', as many as fit into
+  /// 'dst_max_bytes' but at most 'num_chunks'. Returns the number of chunks moved.
+  static int MoveChunks(ChunkLists* src, ChunkLists* dst, int idx, int num_chunks,
+      int64_t dst_max_bytes);
+
+  /// Returns the calling thread's cache, which is created by the first call. Frees
+  /// its chunks first if there was a Flush() since they were last freed.
+  static ChunkLists* GetThreadCache();
+
+  /// Frees the chunks of 'cache'.
+  static void FreeChunks(ChunkLists* cache);
+
+  /// Called when a thread exits with its cache.
+  static void ReleaseThreadCache(ChunkLists* cache);
+
+  static boost::thread_specific_ptr<ChunkLists> thread_cache_;
+  static SpinLock global_lock_;
+  static ChunkLists global_cache_;
+
+  /// Number of calls to Flush().
+  static AtomicInt64 flush_count_;
+};
+
+boost::thread_specific_ptr<MemPool::ChunkCache::ChunkLists>
+    MemPool::ChunkCache::thread_cache_(&MemPool::ChunkCache::ReleaseThreadCache);
+SpinLock MemPool::ChunkCache::global_lock_;
+MemPool::ChunkCache::ChunkLists MemPool::ChunkCache::global_cache_;
+AtomicInt64 MemPool::ChunkCache::flush_count_;
+
+int MemPool::ChunkCache::SizeIdx(int64_t size) {
+  if (FLAGS_disable_mem_pools || FLAGS_mem_pool_thread_cache_bytes <= 0) return -1;
+  if (size < INITIAL_CHUNK_SIZE || size > MAX_CHUNK_SIZE) return -1;
+  if ((size & (size - 1)) != 0) return -1;
+  int idx = 0;
+  while ((static_cast<int64_t>(INITIAL_CHUNK_SIZE) << idx) < size) ++idx;
+  DCHECK_LT(idx, NUM_SIZES);
+  return idx;
+}
+
+int MemPool::ChunkCache::MoveChunks(ChunkLists* src, ChunkLists* dst, int idx,
+    int num_chunks, int64_t dst_max_bytes) {
+  int64_t size = static_cast<int64_t>(INITIAL_CHUNK_SIZE) << idx;
+  int moved = 0;
+  while (moved < num_chunks && !src->chunks[idx].empty() &&
+      dst->bytes + size <= dst_max_bytes) {
+    dst->chunks[idx].push_back(src->chunks[idx].back());
+    src->chunks[idx].pop_back();
+    src->bytes -= size;
+    dst->bytes += size;
+    ++moved;
+  }
+  return moved;
+}
+
+MemPool::ChunkCache::ChunkLists* MemPool::ChunkCache::GetThreadCache() {
+  ChunkLists* cache = thread_cache_.get();
+  if (UNLIKELY(cache == NULL)) {
+    cache = new ChunkLists();
+    cache->flush_count = flush_count_.Load();
+    thread_cache_.reset(cache);
+  } else if (UNLIKELY(cache->flush_count != flush_count_.Load())) {
+    cache->flush_count = flush_count_.Load();
+    FreeChunks(cache);
+  }
+  return cache;
+}
+
+uint8_t* MemPool::ChunkCache::Get(int64_t size) {
+  int idx = SizeIdx(size);
+  if (idx < 0) return NULL;
+  ChunkLists* cache = GetThreadCache();
+  if (cache->chunks[idx].empty()) {
+    // Take up to half a thread cache of chunks, so that the next allocations of this
+    // size don't need the lock either.
+    int num_chunks = max<int64_t>(1, FLAGS_mem_pool_thread_cache_bytes / 2 / size);
+    int moved;
+    {
+      lock_guard<SpinLock> l(global_lock_);
+      moved = MoveChunks(&global_cache_, cache, idx, num_chunks,
+          max(FLAGS_mem_pool_thread_cache_bytes, cache->bytes + size));
+    }
+    if (moved == 0) return NULL;
+  }
+  uint8_t* chunk = cache->chunks[idx].back();
+  cache->chunks[idx].pop_back();
+  cache->bytes -= size;
+  if (ImpaladMetrics::MEM_POOL_CACHED_BYTES != NULL) {
+    ImpaladMetrics::MEM_POOL_CACHED_BYTES->Increment(-size);
+  }
+  return chunk;
+}
+
+void MemPool::ChunkCache::Put(uint8_t* chunk, int64_t size) {
+  int idx = SizeIdx(size);
+  if (idx < 0) {
+    free(chunk);
+    return;
+  }
+  ChunkLists* cache = GetThreadCache();
+  cache->chunks[idx].push_back(chunk);
+  cache->bytes += size;
+  int64_t freed_bytes = 0;
+  if (cache->bytes > FLAGS_mem_pool_thread_cache_bytes) {
+    // Return half of the chunks of this size to the global cache.
+    int num_chunks = (cache->chunks[idx].size() + 1) / 2;
+    int moved;
+    {
+      lock_guard<SpinLock> l(global_lock_);
+      moved = MoveChunks(cache, &global_cache_, idx, num_chunks,
+          FLAGS_mem_pool_global_cache_bytes);
+    }
+    for (; moved < num_chunks; ++moved) {
+      free(cache->chunks[idx].back());
+      cache->chunks[idx].pop_back();
+      cache->bytes -= size;
+      freed_bytes += size;
+    }
+  }
+  if (ImpaladMetrics::MEM_POOL_CACHED_BYTES != NULL) {
+    ImpaladMetrics::MEM_POOL_CACHED_BYTES->Increment(size - freed_bytes);
+  }
+}
+
+void MemPool::ChunkCache::FreeChunks(ChunkLists* cache) {
+  for (int i = 0; i < NUM_SIZES; ++i) {
+    for (uint8_t* chunk: cache->chunks[i]) free(chunk);
+    cache->chunks[i].clear();
+  }
+  if (ImpaladMetrics::MEM_POOL_CACHED_BYTES != NULL) {
+    ImpaladMetrics::MEM_POOL_CACHED_BYTES->Increment(-cache->bytes);
+  }
+  cache->bytes = 0;
+}
+
+void MemPool::ChunkCache::Flush() {
+  flush_count_.Add(1);
+  ChunkLists chunks;
+  {
+    lock_guard<SpinLock> l(global_lock_);
+    for (int i = 0; i < NUM_SIZES; ++i) chunks.chunks[i].swap(global_cache_.chunks[i]);
+    chunks.bytes = global_cache_.bytes;
+    global_cache_.bytes = 0;
+  }
+  FreeChunks(&chunks);
+}
+
+void MemPool::ChunkCache::ReleaseThreadCache(ChunkLists* cache) {
+  if (cache->flush_count != flush_count_.Load()) {
+    // The chunks were cached before a Flush(), don't keep them.
+    FreeChunks(cache);
+    delete cache;
+    return;
+  }
+  {
+    lock_guard<SpinLock> l(global_lock_);
+    for (int i = 0; i < NUM_SIZES; ++i) {
+      MoveChunks(cache, &global_cache_, i, cache->chunks[i].size(),
+          FLAGS_mem_pool_global_cache_bytes);
+    }
+  }
+  FreeChunks(cache);
+  delete cache;
+}
+
+}
+
 const int MemPool::INITIAL_CHUNK_SIZE;
 const int MemPool::MAX_CHUNK_SIZE;
 
@@ -59,7 +278,7 @@ MemPool::~MemPool() {
   int64_t total_bytes_released = 0;
   for (size_t i = 0; i < chunks_.size(); ++i) {
     total_bytes_released += chunks_[i].size;
-    free(chunks_[i].data);
+    ChunkCache::Put(chunks_[i].data, chunks_[i].size);
   }
 
   DCHECK(chunks_.empty()) << "Must call FreeAll() or AcquireData() for this pool";
@@ -83,7 +302,7 @@ void MemPool::FreeAll() {
   int64_t total_bytes_released = 0;
   for (size_t i = 0; i < chunks_.size(); ++i) {
     total_bytes_released += chunks_[i].size;
-    free(chunks_[i].data);
+    ChunkCache::Put(chunks_[i].data, chunks_[i].size);
   }
   chunks_.clear();
   next_chunk_size_ = INITIAL_CHUNK_SIZE;
@@ -142,8 +361,10 @@ bool MemPool::FindChunk(int64_t min_size, bool check_limits) {
       mem_tracker_->Consume(chunk_size);
     }
 
-    // Allocate a new chunk. Return early if malloc fails.
-    uint8_t* buf = reinterpret_cast<uint8_t*>(malloc(chunk_size));
+    // Allocate a new chunk, from the chunk cache if possible. Return early if malloc
+    // fails.
+    uint8_t* buf = ChunkCache::Get(chunk_size);
+    if (buf == NULL) buf = reinterpret_cast<uint8_t*>(malloc(chunk_size));
     if (UNLIKELY(buf == NULL)) {
       mem_tracker_->Release(chunk_size);
       DCHECK_EQ(current_chunk_idx_, static_cast<int>(chunks_.size()));
@@ -249,6 +470,10 @@ int64_t MemPool::GetTotalChunkSizes() const {
   return result;
 }
 
+void MemPool::FreeCachedChunks() {
+  ChunkCache::Flush();
+}
+
 bool MemPool::CheckIntegrity(bool current_chunk_empty) {
   DCHECK_EQ(zero_length_region_, MEM_POOL_POISON);
 
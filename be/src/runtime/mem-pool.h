@@ -74,6 +74,12 @@ class MemTracker;
 /// remains unchanged.
 /// The one remaining (empty) chunk is released:
 ///    delete p;
+//
+/// Chunks of the standard sizes (the powers of two from INITIAL_CHUNK_SIZE to
+/// MAX_CHUNK_SIZE) that are released are kept in a per-thread cache and reused by the
+/// next pool that needs a chunk of that size, see ChunkCache in mem-pool.cc. This avoids
+/// a malloc() and free() per chunk for pools that are filled and freed over and over,
+/// e.g. the tuple data pools of row batches. FreeCachedChunks() frees the cached chunks.
 
 class MemPool {
  public:
@@ -133,12 +139,18 @@ class MemPool {
   /// Return sum of chunk_sizes_.
   int64_t GetTotalChunkSizes() const;
 
+  /// Frees the cached chunks of released pools. Registered as a GcFunction of the
+  /// process MemTracker, which the cached chunks still count against.
+  static void FreeCachedChunks();
+
   /// TODO: make a macro for doing this
   /// For C++/IR interop, we need to be able to look up types by name.
   static const char* LLVM_CLASS_NAME;
 
  private:
   friend class MemPoolTest;
+  class ChunkCache;
+
   static const int INITIAL_CHUNK_SIZE = 4 * 1024;
 
   /// The maximum size of chunk that should be allocated. Allocations larger than this
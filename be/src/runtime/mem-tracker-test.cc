@@ -14,10 +14,14 @@
 
 #include <string>
 #include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 #include <gtest/gtest.h>
 
 #include "runtime/mem-tracker.h"
+#include "util/cpu-info.h"
 #include "util/metrics.h"
+#include "util/pretty-printer.h"
+#include "util/stopwatch.h"
 
 #include "common/names.h"
 
@@ -214,9 +218,107 @@ TEST(MemTestTest, GcFunctions) {
   t.Release(10);
 }
 
+TEST(MemTestTest, ConsumptionBatching) {
+  const int64_t batch_bytes = 1024;
+  MemTracker p;
+  MemTracker c(-1, -1, "", &p);
+  // Use a single slot, so that the test doesn't depend on the CPUs it runs on.
+  c.EnableConsumptionBatching(batch_bytes, 1);
+
+  // The first consumption takes a batch from the parent, the next ones are cached.
+  c.Consume(10);
+  EXPECT_EQ(c.consumption(), 10 + batch_bytes);
+  EXPECT_EQ(p.consumption(), 10 + batch_bytes);
+  EXPECT_TRUE(c.TryConsume(100));
+  EXPECT_EQ(p.consumption(), 10 + batch_bytes);
+
+  // Consumptions of at least a batch aren't cached.
+  c.Consume(2 * batch_bytes);
+  EXPECT_EQ(p.consumption(), 10 + 3 * batch_bytes);
+
+  // Releases are cached up to two batches, then all but one batch are released.
+  c.Release(2 * batch_bytes);
+  EXPECT_EQ(p.consumption(), 110 + batch_bytes);
+  c.Release(110);
+  EXPECT_EQ(p.consumption(), 110 + batch_bytes);
+
+  c.ReleaseBatchedConsumption();
+  EXPECT_EQ(c.consumption(), 0);
+  EXPECT_EQ(p.consumption(), 0);
+}
+
+TEST(MemTestTest, ConsumptionBatchingLimits) {
+  const int64_t batch_bytes = 1024;
+  MemTracker p(10 * batch_bytes);
+  MemTracker c(-1, -1, "", &p);
+  c.EnableConsumptionBatching(batch_bytes, 1);
+
+  // Far from the limit, a batch is cached.
+  EXPECT_TRUE(c.TryConsume(10));
+  EXPECT_EQ(p.consumption(), 10 + batch_bytes);
+
+  // Bring the tracker near the limit. The cached bytes are still used, but no new
+  // batch is taken.
+  EXPECT_TRUE(c.TryConsume(p.limit() - p.consumption() - batch_bytes));
+  EXPECT_EQ(p.consumption(), p.limit() - batch_bytes);
+  c.Consume(batch_bytes / 2);
+  EXPECT_EQ(p.consumption(), p.limit() - batch_bytes);
+  c.Consume(1000);
+  EXPECT_EQ(p.consumption(), p.limit() - 24);
+
+  // A TryConsume() that only fits without the cached bytes releases them and succeeds.
+  EXPECT_TRUE(c.TryConsume(530));
+  EXPECT_EQ(p.consumption(), p.limit() - 6);
+  EXPECT_FALSE(c.TryConsume(7));
+  EXPECT_EQ(p.consumption(), p.limit() - 6);
+
+  // Near the limit, released bytes aren't cached.
+  c.Release(p.limit() - 6);
+  EXPECT_EQ(c.consumption(), 0);
+  EXPECT_EQ(p.consumption(), 0);
+}
+
+// Consumes and releases from 'tracker' like a scanner thread's MemPools would.
+static void ConsumeAndRelease(MemTracker* tracker, int num_iters) {
+  const int64_t chunk_size = 8 * 1024;
+  for (int i = 0; i < num_iters; ++i) {
+    if (tracker->TryConsume(chunk_size)) tracker->Release(chunk_size);
+  }
+}
+
+// Measures the throughput of concurrent updates of a scan node's tracker with and
+// without batching.
+TEST(MemTestTest, ConsumptionBatchingBenchmark) {
+  const int num_threads = CpuInfo::num_cores();
+  const int num_iters = 100000;
+  for (int batching = 0; batching < 2; ++batching) {
+    MemTracker process_tracker;
+    MemTracker query_tracker(1024L * 1024L * 1024L, -1, "query", &process_tracker);
+    MemTracker node_tracker(-1, -1, "node", &query_tracker);
+    if (batching) node_tracker.EnableConsumptionBatching(64 * 1024);
+    MonotonicStopWatch watch;
+    watch.Start();
+    thread_group threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.add_thread(new thread(ConsumeAndRelease, &node_tracker, num_iters));
+    }
+    threads.join_all();
+    watch.Stop();
+    node_tracker.ReleaseBatchedConsumption();
+    EXPECT_EQ(query_tracker.consumption(), 0);
+    double updates_per_sec =
+        2.0 * num_threads * num_iters / (watch.ElapsedTime() / 1000000000.0);
+    LOG(INFO) << (batching ? "With" : "Without") << " batching, " << num_threads
+              << " threads: " << static_cast<int64_t>(updates_per_sec)
+              << " updates/sec, " << PrettyPrinter::Print(watch.ElapsedTime(),
+              TUnit::TIME_NS);
+  }
+}
+
 }
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
   return RUN_ALL_TESTS();
 }
@@ -14,14 +14,17 @@
 
 #include "runtime/mem-tracker.h"
 
+#include <sched.h>
 #include <boost/algorithm/string/join.hpp>
 #include <gperftools/malloc_extension.h>
+#include <gutil/port.h>
 #include <gutil/strings/substitute.h>
 
 #include "runtime/exec-env.h"
 #include "runtime/runtime-state.h"
 #include "resourcebroker/resource-broker.h"
 #include "scheduling/query-resource-mgr.h"
+#include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/mem-info.h"
 #include "util/pretty-printer.h"
@@ -61,7 +64,9 @@ MemTracker::MemTracker(int64_t byte_limit, int64_t rm_reserved_limit, const stri
     num_gcs_metric_(NULL),
     bytes_freed_by_last_gc_metric_(NULL),
     bytes_over_limit_metric_(NULL),
-    limit_metric_(NULL) {
+    limit_metric_(NULL),
+    batch_bytes_(0),
+    num_batching_slots_(0) {
   if (parent != NULL) parent_->AddChildTracker(this);
   Init();
 }
@@ -84,7 +89,9 @@ MemTracker::MemTracker(
     num_gcs_metric_(NULL),
     bytes_freed_by_last_gc_metric_(NULL),
     bytes_over_limit_metric_(NULL),
-    limit_metric_(NULL) {
+    limit_metric_(NULL),
+    batch_bytes_(0),
+    num_batching_slots_(0) {
   if (parent != NULL) parent_->AddChildTracker(this);
   Init();
 }
@@ -106,7 +113,9 @@ MemTracker::MemTracker(UIntGauge* consumption_metric,
     num_gcs_metric_(NULL),
     bytes_freed_by_last_gc_metric_(NULL),
     bytes_over_limit_metric_(NULL),
-    limit_metric_(NULL) {
+    limit_metric_(NULL),
+    batch_bytes_(0),
+    num_batching_slots_(0) {
   Init();
 }
 
@@ -129,6 +138,108 @@ void MemTracker::AddChildTracker(MemTracker* tracker) {
   tracker->child_tracker_it_ = child_trackers_.insert(child_trackers_.end(), tracker);
 }
 
+// The bytes cached for the CPUs that map to a slot, padded to a cache line so that the
+// slots of different CPUs don't share one.
+struct MemTracker::BatchingSlot {
+  AtomicInt64 bytes;
+  uint8_t padding[CACHELINE_SIZE - sizeof(AtomicInt64)];
+
+  // Removes 'num_bytes' from the slot if it has that many. Returns false otherwise.
+  bool TryTake(int64_t num_bytes) {
+    while (true) {
+      int64_t cached = bytes.Load();
+      if (cached < num_bytes) return false;
+      if (bytes.CompareAndSwap(cached, cached - num_bytes)) return true;
+    }
+  }
+
+  // Removes the bytes above 'keep_bytes' from the slot and returns them.
+  int64_t TakeAbove(int64_t keep_bytes) {
+    while (true) {
+      int64_t cached = bytes.Load();
+      if (cached <= keep_bytes) return 0;
+      if (bytes.CompareAndSwap(cached, keep_bytes)) return cached - keep_bytes;
+    }
+  }
+};
+
+void MemTracker::EnableConsumptionBatching(int64_t batch_bytes, int num_slots) {
+  DCHECK(consumption_metric_ == NULL);
+  DCHECK_GT(batch_bytes, 0);
+  DCHECK_NE(num_slots, 0);
+  num_batching_slots_ = num_slots > 0 ? num_slots : CpuInfo::num_cores();
+  batching_slots_.reset(new BatchingSlot[num_batching_slots_]);
+  batch_bytes_ = batch_bytes;
+}
+
+void MemTracker::ReleaseBatchedConsumption() {
+  int64_t released = 0;
+  for (int i = 0; i < num_batching_slots_; ++i) {
+    released += batching_slots_[i].TakeAbove(0);
+  }
+  if (released > 0) ReleaseUnbatched(released);
+}
+
+MemTracker::BatchingSlot* MemTracker::CurrentSlot() {
+#ifdef __APPLE__
+  int cpu = 0;
+#else
+  int cpu = sched_getcpu();
+#endif
+  // The slot only needs to be mostly private to the CPU, a wrong one is still correct.
+  if (UNLIKELY(cpu < 0)) cpu = 0;
+  return &batching_slots_[cpu % num_batching_slots_];
+}
+
+bool MemTracker::NearLimit() const {
+  if (limit_trackers_.empty()) return false;
+  // Leave room for the batches that all slots may cache.
+  return SpareCapacity() < 2 * batch_bytes_ * num_batching_slots_;
+}
+
+bool MemTracker::ConsumeBatched(int64_t bytes, bool enforce_limit) {
+  DCHECK_GT(bytes, 0);
+  BatchingSlot* slot = CurrentSlot();
+  if (slot->TryTake(bytes)) {
+    if (UNLIKELY(enable_logging_)) LogUpdate(true, bytes);
+    return true;
+  }
+  if (bytes < batch_bytes_ && !NearLimit()) {
+    // Consume a new batch for the slot along with 'bytes'.
+    if (!enforce_limit) {
+      ConsumeUnbatched(bytes + batch_bytes_);
+      slot->bytes.Add(batch_bytes_);
+      return true;
+    }
+    if (TryConsumeUnbatched(bytes + batch_bytes_)) {
+      slot->bytes.Add(batch_bytes_);
+      return true;
+    }
+  }
+  if (!enforce_limit) {
+    ConsumeUnbatched(bytes);
+    return true;
+  }
+  if (TryConsumeUnbatched(bytes)) return true;
+  // The cached bytes count against the limits. Release them before failing, so that
+  // batching doesn't make a TryConsume() fail that would succeed without it.
+  ReleaseBatchedConsumption();
+  return TryConsumeUnbatched(bytes);
+}
+
+void MemTracker::ReleaseBatched(int64_t bytes) {
+  DCHECK_GT(bytes, 0);
+  BatchingSlot* slot = CurrentSlot();
+  int64_t cached = slot->bytes.Add(bytes);
+  if (UNLIKELY(enable_logging_)) LogUpdate(false, bytes);
+  if (LIKELY(cached <= batch_bytes_)) return;
+  bool near_limit = NearLimit();
+  if (cached <= 2 * batch_bytes_ && !near_limit) return;
+  // Keep a batch in the slot, or nothing if the limits are near.
+  int64_t released = slot->TakeAbove(near_limit ? 0 : batch_bytes_);
+  if (released > 0) ReleaseUnbatched(released);
+}
+
 void MemTracker::UnregisterFromParent() {
   DCHECK(parent_ != NULL);
   lock_guard<mutex> l(parent_->child_trackers_lock_);
@@ -217,6 +328,7 @@ shared_ptr<MemTracker> MemTracker::GetQueryMemTracker(
 }
 
 MemTracker::~MemTracker() {
+  ReleaseBatchedConsumption();
   DCHECK_EQ(consumption_->current_value(), 0) << label_ << "\n" << GetStackTrace();
   lock_guard<SpinLock> l(static_mem_trackers_lock_);
   if (auto_unregister_) UnregisterFromParent();
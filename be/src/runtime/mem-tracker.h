@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include <map>
 #include <vector>
+#include <boost/scoped_array.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 #include <boost/thread/mutex.hpp>
@@ -57,6 +58,18 @@ class QueryResourceMgr;
 /// this will be called before the process limit is reported as exceeded. GcFunctions are
 /// called in the order they are added, so expensive functions should be added last.
 //
+/// Trackers that many threads update concurrently, e.g. the tracker of a scan node that
+/// its scanner threads allocate from, can batch their updates to avoid contention on
+/// the consumption counters of the tracker and all of its ancestors, which every
+/// update otherwise modifies atomically. With EnableConsumptionBatching(), the tracker
+/// consumes memory from itself and its ancestors in batches, caches the unused part of
+/// each batch in a slot per CPU and serves its Consume(), TryConsume() and Release()
+/// calls from the slot of the calling thread's CPU. The limits are still enforced,
+/// since the cached bytes are counted against them: the consumption of the tracker and
+/// its ancestors can only exceed the actual consumption, by at most two batches per
+/// CPU. When the spare capacity of the limits is low, the tracker stops caching, and
+/// it releases its cached bytes before a TryConsume() fails.
+//
 /// This class is thread-safe.
 class MemTracker {
  public:
@@ -121,18 +134,11 @@ class MemTracker {
       return;
     }
 
-    if (consumption_metric_ != NULL) {
-      RefreshConsumptionFromMetric();
+    if (UNLIKELY(batch_bytes_ > 0)) {
+      ConsumeBatched(bytes, false);
       return;
     }
-    if (UNLIKELY(enable_logging_)) LogUpdate(true, bytes);
-    for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
-         tracker != all_trackers_.end(); ++tracker) {
-      (*tracker)->consumption_->Add(bytes);
-      if ((*tracker)->consumption_metric_ == NULL) {
-        DCHECK_GE((*tracker)->consumption_->current_value(), 0);
-      }
-    }
+    ConsumeUnbatched(bytes);
   }
 
   /// Increases/Decreases the consumption of this tracker and the ancestors up to (but
@@ -161,57 +167,8 @@ class MemTracker {
   bool TryConsume(int64_t bytes) {
     if (consumption_metric_ != NULL) RefreshConsumptionFromMetric();
     if (UNLIKELY(bytes <= 0)) return true;
-    if (UNLIKELY(enable_logging_)) LogUpdate(true, bytes);
-    int i;
-    // Walk the tracker tree top-down, to avoid expanding a limit on a child whose parent
-    // won't accommodate the change.
-    for (i = all_trackers_.size() - 1; i >= 0; --i) {
-      MemTracker* tracker = all_trackers_[i];
-      int64_t limit = tracker->effective_limit();
-      if (limit < 0) {
-        tracker->consumption_->Add(bytes); // No limit at this tracker.
-      } else {
-        // If TryConsume fails, we can try to GC or expand the RM reservation, but we may
-        // need to try several times if there are concurrent consumers because we don't
-        // take a lock before trying to update consumption_.
-        while (true) {
-          if (LIKELY(tracker->consumption_->TryAdd(bytes, limit))) break;
-
-          VLOG_RPC << "TryConsume failed, bytes=" << bytes
-                   << " consumption=" << tracker->consumption_->current_value()
-                   << " limit=" << limit << " attempting to GC and expand reservation";
-          // TODO: This may not be right if more than one tracker can actually change its
-          // RM reservation limit.
-          if (UNLIKELY(tracker->GcMemory(limit - bytes) &&
-                  !tracker->ExpandRmReservation(bytes))) {
-            DCHECK_GE(i, 0);
-            // Failed for this mem tracker. Roll back the ones that succeeded.
-            // TODO: this doesn't roll it back completely since the max values for
-            // the updated trackers aren't decremented. The max values are only used
-            // for error reporting so this is probably okay. Rolling those back is
-            // pretty hard; we'd need something like 2PC.
-            //
-            // TODO: This might leave us with an allocated resource that we can't use.
-            // Specifically, the RM reservation of some ancestors' trackers may have been
-            // expanded only to fail at the current tracker. This may be wasteful as
-            // subsequent TryConsume() never gets to use the reserved resources. Consider
-            // adjusting the reservation of the ancestors' trackers.
-            for (int j = all_trackers_.size() - 1; j > i; --j) {
-              all_trackers_[j]->consumption_->Add(-bytes);
-            }
-            return false;
-          }
-          VLOG_RPC << "GC or expansion succeeded, TryConsume bytes=" << bytes
-                   << " consumption=" << tracker->consumption_->current_value()
-                   << " new limit=" << tracker->effective_limit() << " prev=" << limit;
-          // Need to update the limit if the RM reservation was expanded.
-          limit = tracker->effective_limit();
-        }
-      }
-    }
-    // Everyone succeeded, return.
-    DCHECK_EQ(i, -1);
-    return true;
+    if (UNLIKELY(batch_bytes_ > 0)) return ConsumeBatched(bytes, true);
+    return TryConsumeUnbatched(bytes);
   }
 
   /// Decreases consumption of this tracker and its ancestors by 'bytes'.
@@ -221,32 +178,11 @@ class MemTracker {
       return;
     }
 
-    if (UNLIKELY(released_memory_since_gc_.Add(bytes) > GC_RELEASE_SIZE)) {
-      GcTcmalloc();
-    }
-
-    if (consumption_metric_ != NULL) {
-      DCHECK(parent_ == NULL);
-      consumption_->Set(consumption_metric_->value());
+    if (UNLIKELY(batch_bytes_ > 0)) {
+      ReleaseBatched(bytes);
       return;
     }
-    if (UNLIKELY(enable_logging_)) LogUpdate(false, bytes);
-    for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
-         tracker != all_trackers_.end(); ++tracker) {
-      (*tracker)->consumption_->Add(-bytes);
-      /// If a UDF calls FunctionContext::TrackAllocation() but allocates less than the
-      /// reported amount, the subsequent call to FunctionContext::Free() may cause the
-      /// process mem tracker to go negative until it is synced back to the tcmalloc
-      /// metric. Don't blow up in this case. (Note that this doesn't affect non-process
-      /// trackers since we can enforce that the reported memory usage is internally
-      /// consistent.)
-      if ((*tracker)->consumption_metric_ == NULL) {
-        DCHECK_GE((*tracker)->consumption_->current_value(), 0)
-          << std::endl << (*tracker)->LogUsage();
-      }
-    }
-
-    /// TODO: Release brokered memory?
+    ReleaseUnbatched(bytes);
   }
 
   /// Returns true if a valid limit of this tracker or one of its ancestors is
@@ -285,6 +221,17 @@ class MemTracker {
     return result;
   }
 
+  /// Enables the batching of this tracker's Consume(), TryConsume() and Release() calls
+  /// with batches of 'batch_bytes', cached in 'num_slots' slots, or one per CPU if it is
+  /// negative. See the class comment. Must be called before the tracker is shared
+  /// between threads. Not valid for a tracker with a consumption metric.
+  void EnableConsumptionBatching(int64_t batch_bytes, int num_slots = -1);
+
+  /// Releases the batches cached by this tracker, so that consumption() is exact if
+  /// there are no concurrent users. Calls after it are batched again. A no-op if
+  /// batching isn't enabled.
+  void ReleaseBatchedConsumption();
+
   /// Refresh the value of consumption_. Only valid to call if consumption_metric_ is not
   /// null.
   void RefreshConsumptionFromMetric();
@@ -349,8 +296,127 @@ class MemTracker {
   static const std::string COUNTER_NAME;
 
  private:
+  struct BatchingSlot;
+
   bool CheckLimitExceeded() const { return limit_ >= 0 && limit_ < consumption(); }
 
+  /// Consume() and TryConsume() without batching, which update the consumption of this
+  /// tracker and its ancestors directly. 'bytes' must be positive.
+  void ConsumeUnbatched(int64_t bytes) {
+    if (consumption_metric_ != NULL) {
+      RefreshConsumptionFromMetric();
+      return;
+    }
+    if (UNLIKELY(enable_logging_)) LogUpdate(true, bytes);
+    for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
+         tracker != all_trackers_.end(); ++tracker) {
+      (*tracker)->consumption_->Add(bytes);
+      if ((*tracker)->consumption_metric_ == NULL) {
+        DCHECK_GE((*tracker)->consumption_->current_value(), 0);
+      }
+    }
+  }
+
+  bool TryConsumeUnbatched(int64_t bytes) {
+    if (UNLIKELY(enable_logging_)) LogUpdate(true, bytes);
+    int i;
+    // Walk the tracker tree top-down, to avoid expanding a limit on a child whose parent
+    // won't accommodate the change.
+    for (i = all_trackers_.size() - 1; i >= 0; --i) {
+      MemTracker* tracker = all_trackers_[i];
+      int64_t limit = tracker->effective_limit();
+      if (limit < 0) {
+        tracker->consumption_->Add(bytes); // No limit at this tracker.
+      } else {
+        // If TryConsume fails, we can try to GC or expand the RM reservation, but we may
+        // need to try several times if there are concurrent consumers because we don't
+        // take a lock before trying to update consumption_.
+        while (true) {
+          if (LIKELY(tracker->consumption_->TryAdd(bytes, limit))) break;
+
+          VLOG_RPC << "TryConsume failed, bytes=" << bytes
+                   << " consumption=" << tracker->consumption_->current_value()
+                   << " limit=" << limit << " attempting to GC and expand reservation";
+          // TODO: This may not be right if more than one tracker can actually change its
+          // RM reservation limit.
+          if (UNLIKELY(tracker->GcMemory(limit - bytes) &&
+                  !tracker->ExpandRmReservation(bytes))) {
+            DCHECK_GE(i, 0);
+            // Failed for this mem tracker. Roll back the ones that succeeded.
+            // TODO: this doesn't roll it back completely since the max values for
+            // the updated trackers aren't decremented. The max values are only used
+            // for error reporting so this is probably okay. Rolling those back is
+            // pretty hard; we'd need something like 2PC.
+            //
+            // TODO: This might leave us with an allocated resource that we can't use.
+            // Specifically, the RM reservation of some ancestors' trackers may have been
+            // expanded only to fail at the current tracker. This may be wasteful as
+            // subsequent TryConsume() never gets to use the reserved resources. Consider
+            // adjusting the reservation of the ancestors' trackers.
+            for (int j = all_trackers_.size() - 1; j > i; --j) {
+              all_trackers_[j]->consumption_->Add(-bytes);
+            }
+            return false;
+          }
+          VLOG_RPC << "GC or expansion succeeded, TryConsume bytes=" << bytes
+                   << " consumption=" << tracker->consumption_->current_value()
+                   << " new limit=" << tracker->effective_limit() << " prev=" << limit;
+          // Need to update the limit if the RM reservation was expanded.
+          limit = tracker->effective_limit();
+        }
+      }
+    }
+    // Everyone succeeded, return.
+    DCHECK_EQ(i, -1);
+    return true;
+  }
+
+  /// Release() without batching. 'bytes' must be positive.
+  void ReleaseUnbatched(int64_t bytes) {
+    if (UNLIKELY(released_memory_since_gc_.Add(bytes) > GC_RELEASE_SIZE)) {
+      GcTcmalloc();
+    }
+
+    if (consumption_metric_ != NULL) {
+      DCHECK(parent_ == NULL);
+      consumption_->Set(consumption_metric_->value());
+      return;
+    }
+    if (UNLIKELY(enable_logging_)) LogUpdate(false, bytes);
+    for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
+         tracker != all_trackers_.end(); ++tracker) {
+      (*tracker)->consumption_->Add(-bytes);
+      /// If a UDF calls FunctionContext::TrackAllocation() but allocates less than the
+      /// reported amount, the subsequent call to FunctionContext::Free() may cause the
+      /// process mem tracker to go negative until it is synced back to the tcmalloc
+      /// metric. Don't blow up in this case. (Note that this doesn't affect non-process
+      /// trackers since we can enforce that the reported memory usage is internally
+      /// consistent.)
+      if ((*tracker)->consumption_metric_ == NULL) {
+        DCHECK_GE((*tracker)->consumption_->current_value(), 0)
+          << std::endl << (*tracker)->LogUsage();
+      }
+    }
+
+    /// TODO: Release brokered memory?
+  }
+
+  /// Consumes 'bytes' from the batch cached by the current CPU's slot, or consumes a new
+  /// batch if it doesn't have enough. If 'enforce_limit' is true, behaves like
+  /// TryConsume() and returns false if 'bytes' can't be consumed without exceeding a
+  /// limit.
+  bool ConsumeBatched(int64_t bytes, bool enforce_limit);
+
+  /// Adds 'bytes' to the current CPU's slot and releases the bytes above a batch once
+  /// the slot caches more than two batches.
+  void ReleaseBatched(int64_t bytes);
+
+  /// Returns the slot of the CPU the calling thread runs on.
+  BatchingSlot* CurrentSlot();
+
+  /// Returns true if the spare capacity of the limits is too low to cache batches.
+  bool NearLimit() const;
+
   /// If consumption is higher than max_consumption, attempts to free memory by calling any
   /// added GC functions.  Returns true if max_consumption is still exceeded. Takes
   /// gc_lock. Updates metrics if initialized.
@@ -500,6 +566,15 @@ class MemTracker {
 
   /// Metric for limit_.
   IntGauge* limit_metric_;
+
+  /// If > 0, the size of the batches in which Consume(), TryConsume() and Release()
+  /// update the consumption of this tracker and its ancestors.
+  int64_t batch_bytes_;
+
+  /// The bytes that were consumed from the tracker and its ancestors that aren't used,
+  /// cached in one slot per CPU. Only allocated if batch_bytes_ > 0.
+  boost::scoped_array<BatchingSlot> batching_slots_;
+  int num_batching_slots_;
 };
 
 }
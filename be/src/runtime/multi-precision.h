@@ -112,6 +112,21 @@ inline int128_t ConvertToInt128(int256_t x, int128_t max_value, bool* overflow)
 /// native int types in templates.
 inline int128_t abs(const int128_t& x) { return (x < 0) ? -x : x; }
 
+/// Returns true if 'x' fits into an int64_t, excluding its minimum value so that
+/// negating the value or dividing it by -1 can't overflow.
+inline bool FitsInInt64(const int128_t& x) {
+  return abs(x) <= std::numeric_limits<int64_t>::max();
+}
+
+/// Returns x / y with a 64-bit division if both values fit into 64 bits, which is much
+/// faster than the 128-bit division of the compiler's runtime library.
+inline int128_t DivideInt128(const int128_t& x, const int128_t& y) {
+  if (FitsInInt64(x) && FitsInInt64(y)) {
+    return static_cast<int64_t>(x) / static_cast<int64_t>(y);
+  }
+  return x / y;
+}
+
 /// Get the high and low bits of an int128_t
 inline uint64_t HighBits(int128_t x) {
   return x >> 64;
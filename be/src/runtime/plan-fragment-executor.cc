@@ -37,15 +37,24 @@
 #include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/container-util.h"
+#include "util/hw-counters.h"
 #include "util/parse-util.h"
 #include "util/mem-info.h"
 #include "util/periodic-counter-updater.h"
+#include "util/sampling-profiler.h"
 #include "util/llama-util.h"
 #include "util/pretty-printer.h"
+#include "util/thread.h"
 
 DEFINE_bool(serialize_batch, false, "serialize and deserialize each returned row batch");
 DEFINE_int32(status_report_interval, 5, "interval between profile reports; in seconds");
 DECLARE_bool(enable_rm);
+DECLARE_bool(async_codegen);
+DECLARE_bool(hw_perf_counters);
+DEFINE_int64(codegen_min_scan_bytes, 0, "(Advanced) Fragments without exchange inputs "
+    "whose HDFS scan ranges add up to fewer bytes than this are executed without "
+    "codegen, since compiling would likely take longer than processing their input. "
+    "If 0, codegen is only disabled by the DISABLE_CODEGEN query option.");
 
 #include "common/names.h"
 
@@ -60,12 +69,12 @@ namespace impala {
 const string PlanFragmentExecutor::PER_HOST_PEAK_MEM_COUNTER = "PerHostPeakMemUsage";
 
 PlanFragmentExecutor::PlanFragmentExecutor(ExecEnv* exec_env,
-    const ReportStatusCallback& report_status_cb) :
+    const ReportStatusCallback& report_status_cb, bool sample_usage) :
     exec_env_(exec_env), plan_(NULL), report_status_cb_(report_status_cb),
     report_thread_active_(false), done_(false), closed_(false),
     has_thread_token_(false), is_prepared_(false), is_cancelled_(false),
     average_thread_tokens_(NULL), mem_usage_sampled_counter_(NULL),
-    thread_usage_sampled_counter_(NULL) {
+    thread_usage_sampled_counter_(NULL), sample_usage_(sample_usage) {
 }
 
 PlanFragmentExecutor::~PlanFragmentExecutor() {
@@ -80,6 +89,8 @@ PlanFragmentExecutor::~PlanFragmentExecutor() {
 Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   lock_guard<mutex> l(prepare_lock_);
   DCHECK(!is_prepared_);
+  SamplingProfiler::ScopedQueryTag query_tag(
+      request.fragment_instance_ctx.query_ctx.query_id);
   if (is_cancelled_) return Status::CANCELLED;
 
   is_prepared_ = true;
@@ -180,17 +191,19 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   }
   has_thread_token_ = true;
 
-  average_thread_tokens_ = profile()->AddSamplingCounter("AverageThreadTokens",
-      bind<int64_t>(mem_fn(&ThreadResourceMgr::ResourcePool::num_threads),
-          runtime_state_->resource_pool()));
-  mem_usage_sampled_counter_ = profile()->AddTimeSeriesCounter("MemoryUsage",
-      TUnit::BYTES,
-      bind<int64_t>(mem_fn(&MemTracker::consumption),
-          runtime_state_->instance_mem_tracker()));
-  thread_usage_sampled_counter_ = profile()->AddTimeSeriesCounter("ThreadUsage",
-      TUnit::UNIT,
-      bind<int64_t>(mem_fn(&ThreadResourceMgr::ResourcePool::num_threads),
-          runtime_state_->resource_pool()));
+  if (sample_usage_) {
+    average_thread_tokens_ = profile()->AddSamplingCounter("AverageThreadTokens",
+        bind<int64_t>(mem_fn(&ThreadResourceMgr::ResourcePool::num_threads),
+            runtime_state_->resource_pool()));
+    mem_usage_sampled_counter_ = profile()->AddTimeSeriesCounter("MemoryUsage",
+        TUnit::BYTES,
+        bind<int64_t>(mem_fn(&MemTracker::consumption),
+            runtime_state_->instance_mem_tracker()));
+    thread_usage_sampled_counter_ = profile()->AddTimeSeriesCounter("ThreadUsage",
+        TUnit::UNIT,
+        bind<int64_t>(mem_fn(&ThreadResourceMgr::ResourcePool::num_threads),
+            runtime_state_->resource_pool()));
+  }
 
   // set up desc tbl
   DescriptorTbl* desc_tbl = NULL;
@@ -238,6 +251,20 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
     scan_node->SetScanRanges(scan_ranges);
   }
 
+  FragmentOutputCache* output_cache = FragmentOutputCache::GetInstance();
+  if (output_cache != NULL && FragmentOutputCache::GetKey(request, &output_cache_key_)) {
+    if (output_cache->Lookup(output_cache_key_, &cached_output_)) {
+      // The plan is prepared, but not executed.
+      runtime_state_->DisableCodegen();
+      profile()->AddInfoString("FragmentOutputCache", "Hit");
+    } else {
+      output_to_cache_.reset(new FragmentOutputCache::Entry());
+      profile()->AddInfoString("FragmentOutputCache", "Miss");
+    }
+  }
+
+  MaybeDisableCodegen(params.per_node_scan_ranges, exch_nodes);
+
   RuntimeProfile::Counter* prepare_timer = ADD_TIMER(profile(), "PrepareTime");
   {
     SCOPED_TIMER(prepare_timer);
@@ -280,7 +307,16 @@ void PlanFragmentExecutor::OptimizeLlvmModule() {
   Status status = runtime_state_->GetCodegen(&codegen, /* initalize */ false);
   DCHECK(status.ok());
   DCHECK(codegen != NULL);
-  status = codegen->FinalizeModule();
+  if (FLAGS_async_codegen && !codegen->requires_sync_finalize()) {
+    codegen_thread_.reset(new Thread("plan-fragment-executor", "codegen",
+        &PlanFragmentExecutor::FinalizeLlvmModule, this, codegen));
+    return;
+  }
+  FinalizeLlvmModule(codegen);
+}
+
+void PlanFragmentExecutor::FinalizeLlvmModule(LlvmCodeGen* codegen) {
+  Status status = codegen->FinalizeModule();
   if (!status.ok()) {
     stringstream ss;
     ss << "Error with codegen for this query: " << status.GetDetail();
@@ -288,6 +324,26 @@ void PlanFragmentExecutor::OptimizeLlvmModule() {
   }
 }
 
+void PlanFragmentExecutor::MaybeDisableCodegen(
+    const PerNodeScanRanges& per_node_scan_ranges, const vector<ExecNode*>& exch_nodes) {
+  if (FLAGS_codegen_min_scan_bytes <= 0 || !runtime_state_->codegen_enabled()) return;
+  // The amount of input received from other fragments is not known.
+  if (!exch_nodes.empty()) return;
+  int64_t scan_bytes = 0;
+  for (const PerNodeScanRanges::value_type& entry: per_node_scan_ranges) {
+    for (const TScanRangeParams& params: entry.second) {
+      // The size of non-HDFS scan ranges, e.g. of HBase tables, is not known.
+      if (!params.scan_range.__isset.hdfs_file_split) return;
+      scan_bytes += params.scan_range.hdfs_file_split.length;
+    }
+  }
+  if (scan_bytes >= FLAGS_codegen_min_scan_bytes) return;
+  runtime_state_->DisableCodegen();
+  profile()->AddInfoString("CodegenDisabled", Substitute(
+      "Scan input of $0 is below --codegen_min_scan_bytes",
+      PrettyPrinter::Print(scan_bytes, TUnit::BYTES)));
+}
+
 void PlanFragmentExecutor::PrintVolumeIds(
     const PerNodeScanRanges& per_node_scan_ranges) {
   if (per_node_scan_ranges.empty()) return;
@@ -309,13 +365,15 @@ void PlanFragmentExecutor::PrintVolumeIds(
 Status PlanFragmentExecutor::Open() {
   VLOG_QUERY << "Open(): instance_id="
       << runtime_state_->fragment_instance_id();
+  SamplingProfiler::ScopedQueryTag query_tag(query_id_);
+  // The threads that the fragment starts inherit the affinity.
+  ScopedNumaAffinity numa_affinity(runtime_state_->resource_pool()->numa_node());
   // we need to start the profile-reporting thread before calling Open(), since it
   // may block
   if (!report_status_cb_.empty() && FLAGS_status_report_interval > 0) {
     unique_lock<mutex> l(report_thread_lock_);
-    report_thread_.reset(
-        new Thread("plan-fragment-executor", "report-profile",
-            &PlanFragmentExecutor::ReportProfile, this));
+    report_thread_.reset(Thread::CreatePooled("plan-fragment-executor",
+        "report-profile", bind<void>(&PlanFragmentExecutor::ReportProfile, this)));
     // make sure the thread started up, otherwise ReportProfile() might get into a race
     // with StopReportThread()
     report_thread_started_cv_.wait(l);
@@ -324,7 +382,16 @@ Status PlanFragmentExecutor::Open() {
 
   OptimizeLlvmModule();
 
+  // Count the hardware events of the fragment thread, including the ones that are
+  // attributed to its exec nodes.
+  ThreadHwCounters* hw_counters = NULL;
+  int64_t start_hw_counts[ThreadHwCounters::NUM_EVENTS];
+  if (FLAGS_hw_perf_counters) {
+    hw_counters = ThreadHwCounters::GetForCurrentThread();
+    if (hw_counters != NULL && !hw_counters->Read(start_hw_counts)) hw_counters = NULL;
+  }
   Status status = OpenInternal();
+  if (hw_counters != NULL) AddHwCounts(hw_counters, start_hw_counts);
   if (sink_.get() != NULL) {
     // We call Close() here rather than in OpenInternal() because we want to make sure
     // that Close() gets called even if there was an error in OpenInternal().
@@ -350,6 +417,7 @@ Status PlanFragmentExecutor::Open() {
 }
 
 Status PlanFragmentExecutor::OpenInternal() {
+  if (cached_output_ != NULL) return SendCachedOutput();
   {
     SCOPED_TIMER(profile()->total_time_counter());
     RETURN_IF_ERROR(plan_->Open(runtime_state_.get()));
@@ -371,7 +439,17 @@ Status PlanFragmentExecutor::OpenInternal() {
       }
     }
     SCOPED_TIMER(profile()->total_time_counter());
+    if (output_to_cache_ != NULL) AddToOutputToCache(batch);
     RETURN_IF_ERROR(sink_->Send(runtime_state(), batch, done_));
+    if (!done_ && sink_->ReceiversClosed()) {
+      // Stop early, closing the plan tree stops its scans. The output is incomplete and
+      // must not be cached.
+      VLOG_QUERY << "Receivers of fragment instance "
+                 << PrintId(runtime_state_->fragment_instance_id())
+                 << " closed, stopping early";
+      output_to_cache_.reset();
+      break;
+    }
   }
 
   // Flush the sink *before* stopping the report thread. Flush may need to add some
@@ -380,9 +458,40 @@ Status PlanFragmentExecutor::OpenInternal() {
   //
   SCOPED_TIMER(profile()->total_time_counter());
   RETURN_IF_ERROR(sink_->FlushFinal(runtime_state()));
+  if (output_to_cache_ != NULL) {
+    FragmentOutputCache::GetInstance()->Insert(output_cache_key_, output_to_cache_);
+    output_to_cache_.reset();
+  }
   return Status::OK();
 }
 
+Status PlanFragmentExecutor::SendCachedOutput() {
+  SCOPED_TIMER(profile()->total_time_counter());
+  DCHECK(sink_.get() != NULL);
+  RETURN_IF_ERROR(sink_->Open(runtime_state_.get()));
+  const vector<TRowBatch>& batches = cached_output_->batches;
+  for (int i = 0; i < batches.size(); ++i) {
+    RETURN_IF_CANCELLED(runtime_state_.get());
+    RowBatch batch(row_desc(), batches[i], runtime_state_->instance_mem_tracker());
+    COUNTER_ADD(rows_produced_counter_, batch.num_rows());
+    RETURN_IF_ERROR(sink_->Send(runtime_state(), &batch, i == batches.size() - 1));
+  }
+  done_ = true;
+  return sink_->FlushFinal(runtime_state());
+}
+
+void PlanFragmentExecutor::AddToOutputToCache(RowBatch* batch) {
+  if (batch->num_rows() == 0) return;
+  output_to_cache_->batches.push_back(TRowBatch());
+  TRowBatch* thrift_batch = &output_to_cache_->batches.back();
+  Status status = batch->Serialize(thrift_batch);
+  output_to_cache_->bytes += RowBatch::GetBatchSize(*thrift_batch);
+  if (!status.ok() ||
+      output_to_cache_->bytes > FragmentOutputCache::GetInstance()->max_entry_size()) {
+    output_to_cache_.reset();
+  }
+}
+
 void PlanFragmentExecutor::ReportProfile() {
   VLOG_FILE << "ReportProfile(): instance_id=" << runtime_state_->fragment_instance_id();
   DCHECK(!report_status_cb_.empty());
@@ -466,6 +575,7 @@ void PlanFragmentExecutor::StopReportThread() {
 Status PlanFragmentExecutor::GetNext(RowBatch** batch) {
   VLOG_FILE << "GetNext(): instance_id="
       << runtime_state_->fragment_instance_id();
+  SamplingProfiler::ScopedQueryTag query_tag(query_id_);
   Status status = GetNextInternal(batch);
   UpdateStatus(status);
   if (done_) {
@@ -500,6 +610,16 @@ Status PlanFragmentExecutor::GetNextInternal(RowBatch** batch) {
   return Status::OK();
 }
 
+void PlanFragmentExecutor::AddHwCounts(ThreadHwCounters* hw_counters,
+    const int64_t* start_counts) {
+  int64_t counts[ThreadHwCounters::NUM_EVENTS];
+  if (!hw_counters->Read(counts)) return;
+  for (int i = 0; i < ThreadHwCounters::NUM_EVENTS; ++i) {
+    profile()->AddCounter(ThreadHwCounters::EVENT_NAMES[i], TUnit::UNIT)->Add(
+        counts[i] - start_counts[i]);
+  }
+}
+
 void PlanFragmentExecutor::FragmentComplete() {
   // Check the atomic flag. If it is set, then a fragment complete report has already
   // been sent.
@@ -571,14 +691,17 @@ void PlanFragmentExecutor::ReleaseThreadToken() {
     if (runtime_state_->query_resource_mgr() != NULL) {
       runtime_state_->query_resource_mgr()->NotifyThreadUsageChange(-1);
     }
-    PeriodicCounterUpdater::StopSamplingCounter(average_thread_tokens_);
-    PeriodicCounterUpdater::StopTimeSeriesCounter(
-        thread_usage_sampled_counter_);
+    if (sample_usage_) {
+      PeriodicCounterUpdater::StopSamplingCounter(average_thread_tokens_);
+      PeriodicCounterUpdater::StopTimeSeriesCounter(
+          thread_usage_sampled_counter_);
+    }
   }
 }
 
 void PlanFragmentExecutor::Close() {
   if (closed_) return;
+  if (codegen_thread_.get() != NULL) codegen_thread_->Join();
   row_batch_.reset();
   // Prepare may not have been called, which sets runtime_state_
   if (runtime_state_.get() != NULL) {
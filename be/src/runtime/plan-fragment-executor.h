@@ -23,12 +23,14 @@
 
 #include "common/status.h"
 #include "common/object-pool.h"
+#include "runtime/fragment-output-cache.h"
 #include "runtime/runtime-state.h"
 #include "util/thread.h"
 
 namespace impala {
 
 class HdfsFsCache;
+class LlvmCodeGen;
 class ExecNode;
 class RowDescriptor;
 class RowBatch;
@@ -41,6 +43,7 @@ class TPlanExecRequest;
 class TPlanFragment;
 class TPlanFragmentExecParams;
 class TPlanExecParams;
+class ThreadHwCounters;
 
 /// PlanFragmentExecutor handles all aspects of the execution of a single plan fragment,
 /// including setup and tear-down, both in the success and error case.
@@ -75,7 +78,10 @@ class PlanFragmentExecutor {
 
   /// report_status_cb, if !empty(), is used to report the accumulated profile
   /// information periodically during execution (Open() or GetNext()).
-  PlanFragmentExecutor(ExecEnv* exec_env, const ReportStatusCallback& report_status_cb);
+  /// If 'sample_usage' is false, the thread and memory usage of the fragment are not
+  /// sampled over time, which fragments that finish within a few milliseconds can skip.
+  PlanFragmentExecutor(ExecEnv* exec_env, const ReportStatusCallback& report_status_cb,
+      bool sample_usage = true);
 
   /// Closes the underlying plan fragment and frees up all resources allocated
   /// in Open()/GetNext().
@@ -164,6 +170,11 @@ class PlanFragmentExecutor {
   boost::condition_variable report_thread_started_cv_;
   bool report_thread_active_;  // true if we started the thread
 
+  /// Thread that optimizes and compiles the codegen'd module while the fragment executes
+  /// with --async_codegen. NULL if the module is compiled synchronously. Joined in
+  /// Close(), before the jitted functions can be freed.
+  boost::scoped_ptr<Thread> codegen_thread_;
+
   /// true if plan_->GetNext() indicated that it's done
   bool done_;
 
@@ -239,6 +250,22 @@ class PlanFragmentExecutor {
   /// Sampled thread usage (tokens) at even time intervals.
   RuntimeProfile::TimeSeriesCounter* thread_usage_sampled_counter_;
 
+  /// If false, average_thread_tokens_ and the sampled counters are not created.
+  const bool sample_usage_;
+
+  /// Key of the output of this fragment instance in the fragment output cache. Empty if
+  /// the output can't be cached.
+  std::string output_cache_key_;
+
+  /// Output of an earlier instance of the same fragment, which OpenInternal() sends
+  /// instead of executing the plan. Set by Prepare() on a hit in the cache.
+  FragmentOutputCache::EntryPtr cached_output_;
+
+  /// The row batches sent to the sink so far, which are added to the cache once the
+  /// sink was flushed. Set by Prepare() on a miss in the cache, reset if the output gets
+  /// larger than the cache's max entry size.
+  boost::shared_ptr<FragmentOutputCache::Entry> output_to_cache_;
+
   ObjectPool* obj_pool() { return runtime_state_->obj_pool(); }
 
   /// typedef for TPlanFragmentExecParams.per_node_scan_ranges
@@ -262,6 +289,10 @@ class PlanFragmentExecutor {
   /// Called when the fragment execution is complete to finalize counters.
   void FragmentComplete();
 
+  /// Adds the counts of 'hw_counters' since they were 'start_counts' to the fragment's
+  /// profile.
+  void AddHwCounts(ThreadHwCounters* hw_counters, const int64_t* start_counts);
+
   /// Optimizes the code-generated functions in runtime_state_->llvm_codegen().
   /// Must be called between plan_->Prepare() and plan_->Open().
   /// This is somewhat time consuming so we don't want it to do it in
@@ -270,6 +301,10 @@ class PlanFragmentExecutor {
   /// in level order).
   void OptimizeLlvmModule();
 
+  /// Calls FinalizeModule() on 'codegen' and logs any error. Runs in codegen_thread_
+  /// with --async_codegen.
+  void FinalizeLlvmModule(LlvmCodeGen* codegen);
+
   /// Executes Open() logic and returns resulting status. Does not set status_.
   /// If this plan fragment has no sink, OpenInternal() does nothing.
   /// If this plan fragment has a sink and OpenInternal() returns without an
@@ -278,6 +313,14 @@ class PlanFragmentExecutor {
   /// have been stopped. sink_ will be set to NULL after successful execution.
   Status OpenInternal();
 
+  /// Called by OpenInternal() instead of executing the plan if cached_output_ is set.
+  /// Sends the cached row batches to the sink and flushes it.
+  Status SendCachedOutput();
+
+  /// Appends a serialized copy of 'batch' to output_to_cache_, or resets it if the
+  /// output no longer fits into the cache.
+  void AddToOutputToCache(RowBatch* batch);
+
   /// Executes GetNext() logic and returns resulting status.
   /// sets done_ to true if the last row batch was returned.
   Status GetNextInternal(RowBatch** batch);
@@ -286,6 +329,12 @@ class PlanFragmentExecutor {
   /// Idempotent.
   void StopReportThread();
 
+  /// Disables codegen for this fragment if its whole input comes from scan ranges of
+  /// fewer than --codegen_min_scan_bytes bytes, so that compiling would likely take
+  /// longer than processing the input. Must be called before plan_->Prepare().
+  void MaybeDisableCodegen(const PerNodeScanRanges& per_node_scan_ranges,
+      const std::vector<ExecNode*>& exch_nodes);
+
   /// Print stats about scan ranges for each volumeId in params to info log.
   void PrintVolumeIds(const TPlanExecParams& params);
   void PrintVolumeIds(const PerNodeScanRanges& per_node_scan_ranges);
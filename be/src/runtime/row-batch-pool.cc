@@ -0,0 +1,65 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "runtime/row-batch-pool.h"
+
+#include <boost/thread/locks.hpp>
+
+#include "runtime/row-batch.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+RowBatchPool::RowBatchPool(const RowDescriptor& row_desc, int capacity,
+    MemTracker* mem_tracker, int max_free_batches)
+  : row_desc_(row_desc),
+    capacity_(capacity),
+    mem_tracker_(mem_tracker),
+    max_free_batches_(max_free_batches) {
+  DCHECK_GT(capacity, 0);
+  DCHECK(mem_tracker != NULL);
+}
+
+RowBatchPool::~RowBatchPool() {
+  for (RowBatch* batch: free_batches_) delete batch;
+  free_batches_.clear();
+}
+
+RowBatch* RowBatchPool::Get() {
+  {
+    lock_guard<SpinLock> l(lock_);
+    if (!free_batches_.empty()) {
+      RowBatch* batch = free_batches_.back();
+      free_batches_.pop_back();
+      return batch;
+    }
+  }
+  return new RowBatch(row_desc_, capacity_, mem_tracker_);
+}
+
+void RowBatchPool::Return(RowBatch* batch) {
+  DCHECK(batch != NULL);
+  // Release the batch's resources outside the lock.
+  batch->Reset();
+  if (batch->capacity() == capacity_) {
+    lock_guard<SpinLock> l(lock_);
+    if (free_batches_.size() < max_free_batches_) {
+      free_batches_.push_back(batch);
+      return;
+    }
+  }
+  delete batch;
+}
@@ -0,0 +1,72 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_ROW_BATCH_POOL_H
+#define IMPALA_RUNTIME_ROW_BATCH_POOL_H
+
+#include <vector>
+
+#include "util/spinlock.h"
+
+namespace impala {
+
+class MemTracker;
+class RowBatch;
+class RowDescriptor;
+
+/// A thread-safe pool of empty row batches with the same row descriptor, capacity and
+/// MemTracker, for producers and consumers that pass a stream of batches, e.g. scanner
+/// threads and their scan node. Instead of constructing and destroying a batch for
+/// each batch of rows, the producer gets a batch from the pool and the consumer returns
+/// it once it is done with it, so the tuple pointer array and the batch's other
+/// structures are reused. The chunks of the batch's tuple data pool are reused through
+/// the MemPool chunk cache.
+///
+/// The batches in the pool stay charged to the MemTracker until the pool is destroyed,
+/// which must happen before the MemTracker is closed.
+class RowBatchPool {
+ public:
+  /// The pool keeps up to 'max_free_batches' returned batches.
+  RowBatchPool(const RowDescriptor& row_desc, int capacity, MemTracker* mem_tracker,
+      int max_free_batches);
+
+  /// Deletes the free batches. Batches that were not returned are owned by their
+  /// holders.
+  ~RowBatchPool();
+
+  /// Returns an empty batch, a returned one if there is any. The caller owns the batch
+  /// until it passes it to Return().
+  RowBatch* Get();
+
+  /// Resets 'batch' and keeps it for Get(), or deletes it if the pool is full or the
+  /// batch doesn't have the pool's capacity. 'batch' need not come from Get().
+  void Return(RowBatch* batch);
+
+  int capacity() const { return capacity_; }
+
+ private:
+  const RowDescriptor& row_desc_;
+  const int capacity_;
+  MemTracker* const mem_tracker_;
+  const int max_free_batches_;
+
+  /// Protects free_batches_.
+  SpinLock lock_;
+  std::vector<RowBatch*> free_batches_;
+};
+
+}
+
+#endif
@@ -17,6 +17,7 @@
 #include "runtime/collection-value-builder.h"
 #include "runtime/raw-value.inline.h"
 #include "runtime/row-batch.h"
+#include "runtime/row-batch-pool.h"
 #include "runtime/tuple-row.h"
 #include "util/stopwatch.h"
 #include "testutil/desc-tbl-builder.h"
@@ -47,19 +48,28 @@ class RowBatchSerializeTest : public testing::Test {
   // Serializes and deserializes 'batch', then checks that the deserialized batch is valid
   // and has the same contents as 'batch'.
   void TestRowBatch(const RowDescriptor& row_desc, RowBatch* batch, bool print_batches,
-      bool full_dedup = false) {
+      bool full_dedup = false, bool compress = true) {
     if (print_batches) cout << PrintBatch(batch) << endl;
 
     TRowBatch trow_batch;
-    EXPECT_OK(batch->Serialize(&trow_batch, full_dedup));
+    EXPECT_OK(batch->Serialize(&trow_batch, full_dedup, compress));
+    if (!compress) {
+      EXPECT_EQ(trow_batch.compression_type, THdfsCompression::NONE);
+      EXPECT_EQ(trow_batch.tuple_data.size(), trow_batch.uncompressed_size);
+    }
 
     RowBatch deserialized_batch(row_desc, trow_batch, tracker_.get());
     if (print_batches) cout << PrintBatch(&deserialized_batch) << endl;
+    TestBatchesEqual(row_desc, batch, &deserialized_batch);
+  }
 
-    EXPECT_EQ(batch->num_rows(), deserialized_batch.num_rows());
+  // Checks that 'deserialized_batch' has the same contents as 'batch'.
+  void TestBatchesEqual(const RowDescriptor& row_desc, RowBatch* batch,
+      RowBatch* deserialized_batch) {
+    EXPECT_EQ(batch->num_rows(), deserialized_batch->num_rows());
     for (int row_idx = 0; row_idx < batch->num_rows(); ++row_idx) {
       TupleRow* row = batch->GetRow(row_idx);
-      TupleRow* deserialized_row = deserialized_batch.GetRow(row_idx);
+      TupleRow* deserialized_row = deserialized_batch->GetRow(row_idx);
 
       for (int tuple_idx = 0; tuple_idx < row_desc.tuple_descriptors().size(); ++tuple_idx) {
         TupleDescriptor* tuple_desc = row_desc.tuple_descriptors()[tuple_idx];
@@ -313,6 +323,53 @@ TEST_F(RowBatchSerializeTest, String) {
   TestRowBatch(row_desc, batch, true);
 }
 
+// Deserializes into batches of a RowBatchPool, which are reused once returned.
+TEST_F(RowBatchSerializeTest, PooledBatches) {
+  // tuple: (int, string)
+  DescriptorTblBuilder builder(&pool_);
+  builder.DeclareTuple() << TYPE_INT << TYPE_STRING;
+  DescriptorTbl* desc_tbl = builder.Build();
+
+  vector<bool> nullable_tuples(1, false);
+  vector<TTupleId> tuple_id(1, (TTupleId) 0);
+  RowDescriptor row_desc(*desc_tbl, tuple_id, nullable_tuples);
+
+  RowBatch* batch = CreateRowBatch(row_desc);
+  TRowBatch trow_batch;
+  EXPECT_OK(batch->Serialize(&trow_batch));
+
+  RowBatchPool batch_pool(row_desc, NUM_ROWS, tracker_.get(), 1);
+  RowBatch* pooled_batch = batch_pool.Get();
+  EXPECT_EQ(pooled_batch->capacity(), NUM_ROWS);
+  for (int i = 0; i < 3; ++i) {
+    pooled_batch->Deserialize(trow_batch);
+    TestBatchesEqual(row_desc, batch, pooled_batch);
+    batch_pool.Return(pooled_batch);
+    // The pool keeps the returned batch and resets it.
+    RowBatch* next_batch = batch_pool.Get();
+    EXPECT_EQ(next_batch, pooled_batch);
+    EXPECT_EQ(next_batch->num_rows(), 0);
+    EXPECT_EQ(next_batch->capacity(), NUM_ROWS);
+  }
+  // The pool is full, so a second returned batch is deleted.
+  batch_pool.Return(batch_pool.Get());
+  batch_pool.Return(pooled_batch);
+}
+
+TEST_F(RowBatchSerializeTest, StringUncompressed) {
+  // tuple: (int, string)
+  DescriptorTblBuilder builder(&pool_);
+  builder.DeclareTuple() << TYPE_INT << TYPE_STRING;
+  DescriptorTbl* desc_tbl = builder.Build();
+
+  vector<bool> nullable_tuples(1, false);
+  vector<TTupleId> tuple_id(1, (TTupleId) 0);
+  RowDescriptor row_desc(*desc_tbl, tuple_id, nullable_tuples);
+
+  RowBatch* batch = CreateRowBatch(row_desc);
+  TestRowBatch(row_desc, batch, false, false, false);
+}
+
 TEST_F(RowBatchSerializeTest, BasicArray) {
   // tuple: (int, string, array<int>)
   ColumnType array_type;
@@ -471,7 +528,7 @@ void RowBatchSerializeTest::TestDupRemoval(bool full_dedup) {
   CreateTuples(tuple_desc, batch->tuple_data_pool(), num_distinct_tuples, 0, 10, &tuples);
   AddTuplesToRowBatch(num_rows, tuples, repeats, batch);
   TRowBatch trow_batch;
-  EXPECT_OK(batch->Serialize(&trow_batch, full_dedup));
+  EXPECT_OK(batch->Serialize(&trow_batch, full_dedup, true));
   // Serialized data should only have one copy of each tuple.
   int64_t total_byte_size = 0; // Total size without duplication
   for (int i = 0; i < tuples.size(); ++i) {
@@ -28,10 +28,6 @@
 
 #include "common/names.h"
 
-// Used to determine memory ownership of a RowBatch's tuple pointers.
-DECLARE_bool(enable_partitioned_hash_join);
-DECLARE_bool(enable_partitioned_aggregation);
-
 namespace impala {
 
 const int RowBatch::AT_CAPACITY_MEM_USAGE;
@@ -44,6 +40,8 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, int capacity,
     need_to_return_(false),
     num_tuples_per_row_(row_desc.tuple_descriptors().size()),
     auxiliary_mem_usage_(0),
+    has_selection_(false),
+    num_selected_(0),
     tuple_data_pool_(mem_tracker),
     row_desc_(row_desc),
     mem_tracker_(mem_tracker) {
@@ -52,13 +50,9 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, int capacity,
   tuple_ptrs_size_ = capacity * num_tuples_per_row_ * sizeof(Tuple*);
   DCHECK_GT(tuple_ptrs_size_, 0);
   // TODO: switch to Init() pattern so we can check memory limit and return Status.
-  if (FLAGS_enable_partitioned_aggregation && FLAGS_enable_partitioned_hash_join) {
-    mem_tracker_->Consume(tuple_ptrs_size_);
-    tuple_ptrs_ = reinterpret_cast<Tuple**>(malloc(tuple_ptrs_size_));
-    DCHECK(tuple_ptrs_ != NULL);
-  } else {
-    tuple_ptrs_ = reinterpret_cast<Tuple**>(tuple_data_pool_.Allocate(tuple_ptrs_size_));
-  }
+  mem_tracker_->Consume(tuple_ptrs_size_);
+  tuple_ptrs_ = reinterpret_cast<Tuple**>(malloc(tuple_ptrs_size_));
+  DCHECK(tuple_ptrs_ != NULL);
 }
 
 // TODO: we want our input_batch's tuple_data to come from our (not yet implemented)
@@ -74,6 +68,8 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
     need_to_return_(false),
     num_tuples_per_row_(input_batch.row_tuples.size()),
     auxiliary_mem_usage_(0),
+    has_selection_(false),
+    num_selected_(0),
     tuple_data_pool_(mem_tracker),
     row_desc_(row_desc),
     mem_tracker_(mem_tracker) {
@@ -81,13 +77,24 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
   tuple_ptrs_size_ = num_rows_ * input_batch.row_tuples.size() * sizeof(Tuple*);
   DCHECK_GT(tuple_ptrs_size_, 0);
   // TODO: switch to Init() pattern so we can check memory limit and return Status.
-  if (FLAGS_enable_partitioned_aggregation && FLAGS_enable_partitioned_hash_join) {
-    mem_tracker_->Consume(tuple_ptrs_size_);
-    tuple_ptrs_ = reinterpret_cast<Tuple**>(malloc(tuple_ptrs_size_));
-    DCHECK(tuple_ptrs_ != NULL);
-  } else {
-    tuple_ptrs_ = reinterpret_cast<Tuple**>(tuple_data_pool_.Allocate(tuple_ptrs_size_));
-  }
+  mem_tracker_->Consume(tuple_ptrs_size_);
+  tuple_ptrs_ = reinterpret_cast<Tuple**>(malloc(tuple_ptrs_size_));
+  DCHECK(tuple_ptrs_ != NULL);
+  DeserializeTupleData(input_batch);
+}
+
+void RowBatch::Deserialize(const TRowBatch& input_batch) {
+  DCHECK_EQ(num_rows_, 0);
+  DCHECK_EQ(num_tuples_per_row_, input_batch.row_tuples.size());
+  DCHECK_LE(input_batch.num_rows, capacity_);
+  num_rows_ = input_batch.num_rows;
+  // Like a batch made by the constructor, the batch is full. Reset() restores the
+  // capacity.
+  MarkAtCapacity();
+  DeserializeTupleData(input_batch);
+}
+
+void RowBatch::DeserializeTupleData(const TRowBatch& input_batch) {
   uint8_t* tuple_data;
   if (input_batch.compression_type != THdfsCompression::NONE) {
     // Decompress tuple data into data pool
@@ -153,19 +160,18 @@ RowBatch::~RowBatch() {
   for (int i = 0; i < blocks_.size(); ++i) {
     blocks_[i]->Delete();
   }
-  if (FLAGS_enable_partitioned_aggregation && FLAGS_enable_partitioned_hash_join) {
-    DCHECK(tuple_ptrs_ != NULL);
-    free(tuple_ptrs_);
-    mem_tracker_->Release(tuple_ptrs_size_);
-    tuple_ptrs_ = NULL;
-  }
+  DCHECK(tuple_ptrs_ != NULL);
+  free(tuple_ptrs_);
+  mem_tracker_->Release(tuple_ptrs_size_);
+  tuple_ptrs_ = NULL;
 }
 
-Status RowBatch::Serialize(TRowBatch* output_batch) {
-  return Serialize(output_batch, UseFullDedup());
+Status RowBatch::Serialize(TRowBatch* output_batch, bool compress) {
+  return Serialize(output_batch, UseFullDedup(), compress);
 }
 
-Status RowBatch::Serialize(TRowBatch* output_batch, bool full_dedup) {
+Status RowBatch::Serialize(TRowBatch* output_batch, bool full_dedup, bool compress) {
+  DCHECK(!has_selection_);
   // why does Thrift not generate a Clear() function?
   output_batch->row_tuples.clear();
   output_batch->tuple_offsets.clear();
@@ -192,6 +198,13 @@ Status RowBatch::Serialize(TRowBatch* output_batch, bool full_dedup) {
     SerializeInternal(size, NULL, output_batch);
   }
 
+  if (compress) RETURN_IF_ERROR(Compress(output_batch));
+  return Status::OK();
+}
+
+Status RowBatch::Compress(TRowBatch* output_batch) {
+  DCHECK_EQ(output_batch->compression_type, THdfsCompression::NONE);
+  int64_t size = output_batch->tuple_data.size();
   if (size > 0) {
     // Try compressing tuple_data to compression_scratch_, swap if compressed data is
     // smaller
@@ -322,10 +335,25 @@ void RowBatch::Reset() {
   }
   blocks_.clear();
   auxiliary_mem_usage_ = 0;
-  if (!FLAGS_enable_partitioned_aggregation || !FLAGS_enable_partitioned_hash_join) {
-    tuple_ptrs_ = reinterpret_cast<Tuple**>(tuple_data_pool_.Allocate(tuple_ptrs_size_));
-  }
   need_to_return_ = false;
+  has_selection_ = false;
+}
+
+void RowBatch::EnableSelection() {
+  if (selection_enabled()) return;
+  selection_.reset(new int[tuple_ptrs_size_ / (num_tuples_per_row_ * sizeof(Tuple*))]);
+}
+
+void RowBatch::ApplySelection() {
+  if (!has_selection_) return;
+  // The selected rows are in increasing order, so each one moves to the front or stays.
+  for (int i = 0; i < num_selected_; ++i) {
+    DCHECK_GE(selection_[i], i);
+    DCHECK_LT(selection_[i], num_rows_);
+    if (selection_[i] != i) CopyRow(GetRow(selection_[i]), GetRow(i));
+  }
+  num_rows_ = num_selected_;
+  has_selection_ = false;
 }
 
 void RowBatch::CloseTupleStreams() {
@@ -351,10 +379,6 @@ void RowBatch::TransferResourceOwnership(RowBatch* dest) {
   }
   blocks_.clear();
   if (need_to_return_) dest->MarkNeedToReturn();
-  if (!FLAGS_enable_partitioned_aggregation || !FLAGS_enable_partitioned_hash_join) {
-    // Tuple pointers were allocated from tuple_data_pool_ so are transferred.
-    tuple_ptrs_ = NULL;
-  }
   Reset();
 }
 
@@ -374,21 +398,18 @@ void RowBatch::AcquireState(RowBatch* src) {
   DCHECK(!need_to_return_);
   DCHECK_EQ(num_rows_, 0);
   DCHECK_EQ(auxiliary_mem_usage_, 0);
+  DCHECK(!has_selection_);
+  DCHECK(!src->has_selection_);
 
   num_rows_ = src->num_rows_;
   capacity_ = src->capacity_;
-  if (!FLAGS_enable_partitioned_aggregation || !FLAGS_enable_partitioned_hash_join) {
-    // Tuple pointers are allocated from tuple_data_pool_ so are transferred.
-    tuple_ptrs_ = src->tuple_ptrs_;
-    src->tuple_ptrs_ = NULL;
-  } else {
-    // tuple_ptrs_ were allocated with malloc so can be swapped between batches.
-    std::swap(tuple_ptrs_, src->tuple_ptrs_);
-  }
+  // tuple_ptrs_ were allocated with malloc so can be swapped between batches.
+  std::swap(tuple_ptrs_, src->tuple_ptrs_);
   src->TransferResourceOwnership(this);
 }
 
 void RowBatch::DeepCopyTo(RowBatch* dst) {
+  DCHECK(!has_selection_);
   DCHECK(dst->row_desc_.Equals(row_desc_));
   DCHECK_EQ(dst->num_rows_, 0);
   DCHECK_GE(dst->capacity_, num_rows_);
@@ -18,6 +18,7 @@
 
 #include <vector>
 #include <cstring>
+#include <boost/scoped_array.hpp>
 #include <boost/scoped_ptr.hpp>
 
 #include "codegen/impala-ir.h"
@@ -45,9 +46,8 @@ class TupleDescriptor;
 /// A RowBatch encapsulates a batch of rows, each composed of a number of tuples.
 /// The maximum number of rows is fixed at the time of construction.
 /// The row batch reference a few different sources of memory.
-///   1. TupleRow ptrs - may be malloc'd and owned by the RowBatch or allocated from
-///      the tuple pool, depending on whether legacy joins and aggs are enabled.
-///      See the comment on tuple_ptrs_ for more details.
+///   1. TupleRow ptrs - malloc'd and owned by the RowBatch. See the comment on
+///      tuple_ptrs_ for more details.
 ///   2. Tuple memory - this is allocated (or transferred to) the row batches tuple pool.
 ///   3. Auxiliary tuple memory (e.g. string data) - this can either be stored externally
 ///      (don't copy strings) or from the tuple pool (strings are copied).  If external,
@@ -72,6 +72,13 @@ class TupleDescriptor;
 //
 /// A row batch is considered at capacity if all the rows are full or it has accumulated
 /// auxiliary memory up to a soft cap. (See at_capacity_mem_usage_ comment).
+//
+/// Selection vectors: a filtering exec node can hand on its input batch with a list of
+/// the indices of the rows that passed, instead of copying those rows into a new batch.
+/// Only the selected rows are part of such a batch. Since most exec nodes expect all
+/// rows of a batch to be valid, a batch can only get a selection if its consumer called
+/// EnableSelection(). The consumer then either iterates over selection() or calls
+/// ApplySelection() to remove the rows that are not selected.
 class RowBatch {
  public:
   /// Create RowBatch for a maximum of 'capacity' rows of tuples specified
@@ -87,6 +94,11 @@ class RowBatch {
   RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
       MemTracker* tracker);
 
+  /// Populates this empty batch from input_batch like the constructor above, reusing
+  /// the batch's tuple pointers. input_batch must not have more rows than the batch's
+  /// capacity.
+  void Deserialize(const TRowBatch& input_batch);
+
   /// Releases all resources accumulated at this row batch.  This includes
   ///  - tuple_ptrs
   ///  - tuple mem pool data
@@ -195,6 +207,38 @@ class RowBatch {
     RowBatch* const parent_;
   };
 
+  /// Allows producers to set a selection on this batch. Called by the consumer of the
+  /// batch before it is filled.
+  void EnableSelection();
+
+  bool selection_enabled() const { return selection_.get() != NULL; }
+
+  /// Returns true if only the rows in selection() are part of the batch.
+  bool has_selection() const { return has_selection_; }
+
+  /// The array of the indices of the selected rows, in increasing order. Producers fill
+  /// it before calling SetSelection(). Only valid if selection_enabled().
+  int* selection() {
+    DCHECK(selection_enabled());
+    return selection_.get();
+  }
+
+  /// The number of rows that are part of the batch.
+  int num_selected() const { return has_selection_ ? num_selected_ : num_rows_; }
+
+  /// Marks the first 'num_selected' entries of selection() as the rows of the batch.
+  void SetSelection(int num_selected) {
+    DCHECK(selection_enabled());
+    DCHECK_GE(num_selected, 0);
+    DCHECK_LE(num_selected, num_rows_);
+    has_selection_ = true;
+    num_selected_ = num_selected;
+  }
+
+  /// Moves the selected rows to the front of the batch and drops the others, so that
+  /// the batch doesn't have a selection anymore. Does nothing without a selection.
+  void ApplySelection();
+
   int num_tuples_per_row() { return num_tuples_per_row_; }
   int row_byte_size() { return num_tuples_per_row_ * sizeof(Tuple*); }
   MemPool* tuple_data_pool() { return &tuple_data_pool_; }
@@ -247,6 +291,12 @@ class RowBatch {
     memset(row, 0, num_tuples_per_row_ * sizeof(Tuple*));
   }
 
+  /// Returns true if the batch has no rows and no auxiliary memory attached, so that it
+  /// can AcquireState() from another batch.
+  bool IsEmpty() const {
+    return num_rows_ == 0 && auxiliary_mem_usage_ == 0 && !need_to_return_;
+  }
+
   /// Acquires state from the 'src' row batch into this row batch. This includes all IO
   /// buffers and tuple data.
   /// This row batch must be empty and have the same row descriptor as the src batch.
@@ -268,11 +318,22 @@ class RowBatch {
   /// larger than the uncompressed data. Use output_batch.is_compressed to determine
   /// whether tuple_data is compressed. If an in-flight row is present in this row batch,
   /// it is ignored. This function does not Reset().
-  Status Serialize(TRowBatch* output_batch);
+  /// If 'compress' is false, tuple_data is left uncompressed and can be compressed later
+  /// with Compress().
+  Status Serialize(TRowBatch* output_batch, bool compress = true);
+
+  /// LZ4-compresses output_batch.tuple_data of a batch that was serialized uncompressed
+  /// from this row batch, unless the compressed data is larger than the uncompressed
+  /// data.
+  Status Compress(TRowBatch* output_batch);
 
   /// Utility function: returns total size of batch.
   static int GetBatchSize(const TRowBatch& batch);
 
+  /// Returns the size of the batch when deep copied, i.e. of all tuples and the string
+  /// and collection data they reference.
+  int64_t TotalByteSize() { return TotalByteSize(NULL); }
+
   int ALWAYS_INLINE num_rows() const { return num_rows_; }
   int ALWAYS_INLINE capacity() const { return capacity_; }
 
@@ -307,7 +368,7 @@ class RowBatch {
   bool UseFullDedup();
 
   /// Overload for testing that allows the test to force the deduplication level.
-  Status Serialize(TRowBatch* output_batch, bool full_dedup);
+  Status Serialize(TRowBatch* output_batch, bool full_dedup, bool compress);
 
   typedef FixedSizeHashTable<Tuple*, int> DedupMap;
 
@@ -321,6 +382,10 @@ class RowBatch {
   void SerializeInternal(int64_t size, DedupMap* distinct_tuples,
       TRowBatch* output_batch);
 
+  /// Copies the tuple data of input_batch into the tuple data pool and sets the tuple
+  /// pointers of its num_rows_ rows.
+  void DeserializeTupleData(const TRowBatch& input_batch);
+
   /// Close owned tuple streams and delete if needed.
   void CloseTupleStreams();
 
@@ -345,21 +410,10 @@ class RowBatch {
   const int num_tuples_per_row_;
 
   /// Array of pointers with capacity_ * num_tuples_per_row_ elements.
-  /// The memory ownership depends on whether legacy joins and aggs are enabled.
-  ///
-  /// Memory is malloc'd and owned by RowBatch:
-  /// If enable_partitioned_hash_join=true and enable_partitioned_aggregation=true
-  /// then the memory is owned by this RowBatch and is freed upon its destruction.
-  /// This mode is more performant especially with SubplanNodes in the ExecNode tree
-  /// because the tuple pointers are not transferred and do not have to be re-created
-  /// in every Reset().
-  ///
-  /// Memory is allocated from MemPool:
-  /// Otherwise, the memory is allocated from tuple_data_pool_. As a result, the
-  /// pointer memory is transferred just like tuple data, and must be re-created
-  /// in Reset(). This mode is required for the legacy join and agg which rely on
-  /// the tuple pointers being allocated from the tuple_data_pool_, so they can
-  /// acquire ownership of the tuple pointers.
+  /// The memory is malloc'd and owned by this RowBatch and is freed upon its
+  /// destruction. The tuple pointers are not transferred and do not have to be
+  /// re-created in every Reset(), which matters especially with SubplanNodes in the
+  /// ExecNode tree.
   int tuple_ptrs_size_;
   Tuple** tuple_ptrs_;
 
@@ -367,6 +421,16 @@ class RowBatch {
   /// TransferResourceOwnership().
   int64_t auxiliary_mem_usage_;
 
+  /// The selection vector with one entry per row of the full capacity. NULL unless
+  /// EnableSelection() was called. Not transferred by AcquireState(), since each batch
+  /// keeps its own.
+  boost::scoped_array<int> selection_;
+
+  /// True if the first num_selected_ entries of selection_ are the rows of the batch.
+  /// Cleared by Reset().
+  bool has_selection_;
+  int num_selected_;
+
   /// holding (some of the) data referenced by rows
   MemPool tuple_data_pool_;
 
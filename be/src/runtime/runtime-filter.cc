@@ -22,6 +22,7 @@
 #include "runtime/backend-client.h"
 #include "service/impala-server.h"
 #include "util/bloom-filter.h"
+#include "util/min-max-filter.h"
 
 using namespace impala;
 using namespace boost;
@@ -106,7 +107,7 @@ void SendFilterToCoordinator(TNetworkAddress address, TUpdateFilterParams params
 }
 
 void RuntimeFilterBank::UpdateFilterFromLocal(int32_t filter_id,
-    BloomFilter* bloom_filter) {
+    BloomFilter* bloom_filter, MinMaxFilter* min_max_filter) {
   DCHECK_NE(state_->query_options().runtime_filter_mode, TRuntimeFilterMode::OFF)
       << "Should not be calling UpdateFilterFromLocal() if filtering is disabled";
   TUpdateFilterParams params;
@@ -133,6 +134,7 @@ void RuntimeFilterBank::UpdateFilterFromLocal(int32_t filter_id,
       if (it == consumed_filters_.end()) return;
       filter = it->second;
     }
+    if (min_max_filter != NULL) filter->SetMinMaxFilter(min_max_filter);
     filter->SetBloomFilter(bloom_filter);
     state_->runtime_profile()->AddInfoString(
         Substitute("Filter $0 arrival", filter_id),
@@ -197,6 +199,18 @@ BloomFilter* RuntimeFilterBank::AllocateScratchBloomFilter(int32_t filter_id) {
   return bloom_filter;
 }
 
+MinMaxFilter* RuntimeFilterBank::AllocateScratchMinMaxFilter(int32_t filter_id,
+    const ColumnType& type) {
+  if (!MinMaxFilter::SupportsType(type)) return NULL;
+  lock_guard<mutex> l(runtime_filter_lock_);
+  if (closed_) return NULL;
+
+  RuntimeFilterMap::iterator it = produced_filters_.find(filter_id);
+  DCHECK(it != produced_filters_.end()) << "Filter ID " << filter_id << " not registered";
+  if (!it->second->filter_desc().has_local_targets) return NULL;
+  return obj_pool_.Add(new MinMaxFilter(type));
+}
+
 int64_t RuntimeFilterBank::GetFilterSizeForNdv(int64_t ndv) {
   if (ndv == -1) return default_filter_size_;
   int64_t required_space =
@@ -28,6 +28,7 @@
 namespace impala {
 
 class BloomFilter;
+class MinMaxFilter;
 class RuntimeFilter;
 class RuntimeState;
 
@@ -50,6 +51,10 @@ class RuntimeState;
 /// Filters are aggregated at the coordinator, and then made available to consumers after
 /// PublishGlobalFilter() has been called.
 ///
+/// Producers may also provide a MinMaxFilter (allocated by AllocateScratchMinMaxFilter())
+/// for integer-typed filters. Min/max filters are only published to local targets; they
+/// are not sent to the coordinator, so global filters only carry a bloom_filter.
+///
 /// After PublishGlobalFilter() has been called (and again, it may only be called once per
 /// filter_id), the RuntimeFilter object associated with filter_id will have a valid
 /// bloom_filter, and may be used for filter evaluation. This operation occurs without
@@ -66,8 +71,10 @@ class RuntimeFilterBank {
 
   /// Updates a filter's bloom_filter with 'bloom_filter' which has been produced by some
   /// operator in the local fragment instance. 'bloom_filter' may be NULL, representing a
-  /// full filter that contains all elements.
-  void UpdateFilterFromLocal(int32_t filter_id, BloomFilter* bloom_filter);
+  /// full filter that contains all elements. 'min_max_filter', if not NULL, is published
+  /// together with 'bloom_filter' to local consumers only.
+  void UpdateFilterFromLocal(int32_t filter_id, BloomFilter* bloom_filter,
+      MinMaxFilter* min_max_filter = NULL);
 
   /// Makes a bloom_filter (aggregated globally from all producer fragments) available for
   /// consumption by operators that wish to use it for filtering.
@@ -94,6 +101,13 @@ class RuntimeFilterBank {
   /// If there is not enough memory, or if Close() has been called first, returns NULL.
   BloomFilter* AllocateScratchBloomFilter(int32_t filter_id);
 
+  /// Returns a MinMaxFilter over values of 'type' for the filter identified by
+  /// 'filter_id', which may be passed to UpdateFilterFromLocal(). The memory returned is
+  /// owned by the RuntimeFilterBank. Returns NULL if the filter has no local targets
+  /// (min/max filters are not sent to remote ones), if 'type' is not supported by
+  /// MinMaxFilter, or if Close() has been called.
+  MinMaxFilter* AllocateScratchMinMaxFilter(int32_t filter_id, const ColumnType& type);
+
   /// Default hash seed to use when computing hashed values to insert into filters.
   static const int32_t DefaultHashSeed() { return 1234; }
 
@@ -157,7 +171,7 @@ class RuntimeFilterBank {
 class RuntimeFilter {
  public:
   RuntimeFilter(const TRuntimeFilterDesc& filter, int64_t filter_size)
-      : bloom_filter_(NULL), filter_desc_(filter), arrival_time_(0L),
+      : bloom_filter_(NULL), min_max_filter_(NULL), filter_desc_(filter), arrival_time_(0L),
         filter_size_(filter_size) {
     DCHECK_GT(filter_size_, 0);
     registration_time_ = MonotonicMillis();
@@ -174,9 +188,17 @@ class RuntimeFilter {
   /// once per filter. Does not acquire the memory associated with 'bloom_filter'.
   inline void SetBloomFilter(BloomFilter* bloom_filter);
 
+  /// Sets the min/max filter, which must not be modified afterwards. Must be called
+  /// before SetBloomFilter() so that the filter has arrived in full once
+  /// HasBloomFilter() returns true. Does not acquire the memory.
+  inline void SetMinMaxFilter(const MinMaxFilter* min_max_filter);
+
+  /// Returns the min/max filter, or NULL if there is none (yet).
+  const MinMaxFilter* min_max_filter() const { return min_max_filter_; }
+
   /// Returns false iff the bloom_filter filter has been set via SetBloomFilter() and
-  /// hash[val] is not in that bloom_filter. Otherwise returns true. Is safe to call
-  /// concurrently with SetBloomFilter().
+  /// hash[val] is not in that bloom_filter, or val is outside the range of the min/max
+  /// filter. Otherwise returns true. Is safe to call concurrently with SetBloomFilter().
   ///
   /// Templatized in preparation for templatized hashes.
   template<typename T>
@@ -206,6 +228,10 @@ class RuntimeFilter {
   /// compact way of representing a full Bloom filter that contains every element.
   BloomFilter* bloom_filter_;
 
+  /// Range of the filtered values, or NULL if there is no min/max filter. Only ever set
+  /// for filters with local producers.
+  const MinMaxFilter* min_max_filter_;
+
   /// Descriptor of the filter.
   TRuntimeFilterDesc filter_desc_;
 
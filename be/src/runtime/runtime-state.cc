@@ -131,9 +131,11 @@ Status RuntimeState::Init(ExecEnv* exec_env) {
     query_options.__set_batch_size(DEFAULT_BATCH_SIZE);
   }
 
-  // Register with the thread mgr
+  // Register with the thread mgr, which shares the threads between the request pools
+  // and queries.
   if (exec_env != NULL) {
-    resource_pool_ = exec_env->thread_mgr()->RegisterPool();
+    resource_pool_ = exec_env->thread_mgr()->RegisterPool(
+        fragment_params_.request_pool, PrintId(query_id()));
     DCHECK(resource_pool_ != NULL);
   }
 
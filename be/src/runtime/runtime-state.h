@@ -158,6 +158,13 @@ class RuntimeState {
   /// Returns true if codegen is enabled for this query.
   bool codegen_enabled() const { return !query_options().disable_codegen; }
 
+  /// Disables codegen for this fragment as if DISABLE_CODEGEN was set. Must be called
+  /// before the plan is prepared.
+  void DisableCodegen() {
+    fragment_params_.fragment_instance_ctx.query_ctx.request.query_options
+        .__set_disable_codegen(true);
+  }
+
   /// Returns true if the codegen object has been created. Note that this may return false
   /// even when codegen is enabled if nothing has been codegen'd.
   bool codegen_created() const { return codegen_.get() != NULL; }
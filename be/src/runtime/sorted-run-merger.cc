@@ -18,6 +18,7 @@
 #include "runtime/row-batch.h"
 #include "runtime/sorter.h"
 #include "runtime/tuple-row.h"
+#include "util/key-normalizer.inline.h"
 #include "util/runtime-profile.h"
 
 #include "common/names.h"
@@ -25,7 +26,7 @@
 namespace impala {
 
 /// BatchedRowSupplier returns individual rows in a batch obtained from a sorted input
-/// run (a RunBatchSupplier). Used as the heap element in the min heap maintained by the
+/// run (a RunBatchSupplier). Used as the leaves of the tree of losers maintained by the
 /// merger.
 /// Next() advances the row supplier to the next row in the input batch and retrieves
 /// the next batch from the input if the current input batch is exhausted. Transfers
@@ -37,7 +38,8 @@ class SortedRunMerger::BatchedRowSupplier {
     : sorted_run_(sorted_run),
       input_row_batch_(NULL),
       input_row_batch_index_(-1),
-      parent_(parent) {
+      parent_(parent),
+      key_is_complete_(false) {
   }
 
   /// Retrieves the first batch of sorted rows from the run.
@@ -70,6 +72,12 @@ class SortedRunMerger::BatchedRowSupplier {
       *done = input_row_batch_ == NULL;
       input_row_batch_index_ = 0;
     }
+    if (!*done && parent_->key_normalizer_.get() != NULL) {
+      KeyNormalizer* normalizer = parent_->key_normalizer_.get();
+      key_.resize(normalizer->key_len());
+      bool went_over = normalizer->NormalizeKey(current_row(), &key_[0]);
+      key_is_complete_ = parent_->all_keys_normalized_ && !went_over;
+    }
     return Status::OK();
   }
 
@@ -91,68 +99,98 @@ class SortedRunMerger::BatchedRowSupplier {
 
   /// The parent merger instance.
   SortedRunMerger* parent_;
+
+  /// Normalized key of the current row, if the parent uses normalized keys.
+  vector<uint8_t> key_;
+
+  /// True if key_ represents all sort keys of the current row exactly.
+  bool key_is_complete_;
 };
 
-void SortedRunMerger::Heapify(int parent_index) {
-  int left_index = 2 * parent_index + 1;
-  int right_index = left_index + 1;
-  if (left_index >= min_heap_.size()) return;
-  int least_child;
-  // Find the least child of parent.
-  if (right_index >= min_heap_.size() ||
-      comparator_.Less(
-          min_heap_[left_index]->current_row(), min_heap_[right_index]->current_row())) {
-    least_child = left_index;
-  } else {
-    least_child = right_index;
+inline bool SortedRunMerger::Less(const BatchedRowSupplier* lhs,
+    const BatchedRowSupplier* rhs) const {
+  if (key_normalizer_.get() != NULL) {
+    int result = memcmp(&lhs->key_[0], &rhs->key_[0], key_normalizer_->key_len());
+    if (result != 0) return result < 0;
+    // Equal keys that represent all sort keys mean equal rows.
+    if (lhs->key_is_complete_ && rhs->key_is_complete_) return false;
+  }
+  return comparator_.Less(lhs->current_row(), rhs->current_row());
+}
+
+inline bool SortedRunMerger::LessRun(int lhs, int rhs) const {
+  if (runs_[lhs] == NULL) return false;
+  if (runs_[rhs] == NULL) return true;
+  return Less(runs_[lhs], runs_[rhs]);
+}
+
+int SortedRunMerger::BuildTree(int node) {
+  int num_runs = runs_.size();
+  if (node >= num_runs) return node - num_runs;
+  int left_winner = BuildTree(2 * node);
+  int right_winner = BuildTree(2 * node + 1);
+  if (LessRun(right_winner, left_winner)) {
+    tree_[node] = left_winner;
+    return right_winner;
   }
+  tree_[node] = right_winner;
+  return left_winner;
+}
 
-  // If the parent is out of place, swap it with the least child and invoke
-  // Heapify recursively.
-  if (comparator_.Less(min_heap_[least_child]->current_row(),
-          min_heap_[parent_index]->current_row())) {
-    iter_swap(min_heap_.begin() + least_child, min_heap_.begin() + parent_index);
-    Heapify(least_child);
+inline void SortedRunMerger::ReplayMatches(int run_index) {
+  int winner = run_index;
+  for (int node = (run_index + runs_.size()) / 2; node > 0; node /= 2) {
+    // A tie with the loser at 'node' keeps the current winner.
+    if (LessRun(tree_[node], winner)) swap(tree_[node], winner);
   }
+  tree_[0] = winner;
 }
 
 SortedRunMerger::SortedRunMerger(const TupleRowComparator& comparator,
-    RowDescriptor* row_desc, RuntimeProfile* profile, bool deep_copy_input)
-  : comparator_(comparator),
+    RowDescriptor* row_desc, RuntimeProfile* profile, bool deep_copy_input,
+    int max_normalized_key_len)
+  : num_active_runs_(0),
+    comparator_(comparator),
+    key_normalizer_(
+        KeyNormalizer::Create(comparator, max_normalized_key_len, &all_keys_normalized_)),
     input_row_desc_(row_desc),
     deep_copy_input_(deep_copy_input) {
   get_next_timer_ = ADD_TIMER(profile, "MergeGetNext");
   get_next_batch_timer_ = ADD_TIMER(profile, "MergeGetNextBatch");
 }
 
+SortedRunMerger::~SortedRunMerger() {
+}
+
 Status SortedRunMerger::Prepare(const vector<RunBatchSupplier>& input_runs) {
-  DCHECK_EQ(min_heap_.size(), 0);
-  min_heap_.reserve(input_runs.size());
+  DCHECK_EQ(runs_.size(), 0);
+  runs_.reserve(input_runs.size());
   for (const RunBatchSupplier& input_run: input_runs) {
     BatchedRowSupplier* new_elem = pool_.Add(new BatchedRowSupplier(this, input_run));
     DCHECK(new_elem != NULL);
     bool empty;
     RETURN_IF_ERROR(new_elem->Init(&empty));
-    if (!empty) min_heap_.push_back(new_elem);
+    if (!empty) runs_.push_back(new_elem);
   }
+  num_active_runs_ = runs_.size();
+  if (runs_.empty()) return Status::OK();
 
-  // Construct the min heap from the sorted runs.
-  const int last_parent = (min_heap_.size() / 2) - 1;
-  for (int i = last_parent; i >= 0; --i) {
-    Heapify(i);
-  }
+  // Play the initial tournament between the sorted runs.
+  tree_.resize(runs_.size());
+  tree_[0] = BuildTree(1);
   return Status::OK();
 }
 
 Status SortedRunMerger::GetNext(RowBatch* output_batch, bool* eos) {
   ScopedTimer<MonotonicStopWatch> timer(get_next_timer_);
-  if (min_heap_.empty()) {
+  if (num_active_runs_ == 0) {
     *eos = true;
     return Status::OK();
   }
 
   while (!output_batch->AtCapacity()) {
-    BatchedRowSupplier* min = min_heap_[0];
+    int min_index = tree_[0];
+    BatchedRowSupplier* min = runs_[min_index];
     int output_row_index = output_batch->AddRow();
     TupleRow* output_row = output_batch->GetRow(output_row_index);
     if (deep_copy_input_) {
@@ -172,16 +210,15 @@ Status SortedRunMerger::GetNext(RowBatch* output_batch, bool* eos) {
     RETURN_IF_ERROR(min->Next(deep_copy_input_ ? NULL : output_batch,
         &min_run_complete));
     if (min_run_complete) {
-      // Remove the element from the heap.
-      iter_swap(min_heap_.begin(), min_heap_.end() - 1);
-      min_heap_.pop_back();
-      if (min_heap_.empty()) break;
+      // The exhausted run loses all further matches.
+      runs_[min_index] = NULL;
+      if (--num_active_runs_ == 0) break;
     }
 
-    Heapify(0);
+    ReplayMatches(min_index);
   }
 
-  *eos = min_heap_.empty();
+  *eos = num_active_runs_ == 0;
   return Status::OK();
 }
 
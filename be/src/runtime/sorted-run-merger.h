@@ -24,14 +24,18 @@
 
 namespace impala {
 
+class KeyNormalizer;
 class RowBatch;
 class RowDescriptor;
 class RuntimeProfile;
 
 /// SortedRunMerger is used to merge multiple sorted runs of tuples. A run is a sorted
 /// sequence of row batches, which are fetched from a RunBatchSupplier function object.
-/// Merging is implemented using a binary min-heap that maintains the run with the next
-/// tuple in sorted order at the top of the heap.
+/// Merging is implemented using a tournament tree of losers over the runs: every
+/// internal node of the tree holds the run that lost the comparison at that node, and
+/// the overall winner is the run with the next tuple in sorted order. After the winner
+/// advances, only the matches on the path from its leaf to the root are replayed, which
+/// takes one comparison per level of the tree instead of the two of a binary heap.
 ///
 /// Merged batches of rows are retrieved from SortedRunMerger via calls to GetNext().
 /// The merger is constructed with a boolean flag deep_copy_input.
@@ -39,6 +43,11 @@ class RuntimeProfile;
 /// If false, GetNext() only copies tuple pointers (TupleRows) into the output batch,
 /// and transfers resource ownership from the input batches to the output batch when
 /// an input batch is processed.
+///
+/// If the sort keys can be normalized (see KeyNormalizer), the merger builds a
+/// memcmp-comparable key for the current row of each input run when it advances to it,
+/// so that the comparisons in the tree only evaluate the comparator's exprs if two keys
+/// are equal.
 class SortedRunMerger {
  public:
   /// Function that returns the next batch of rows from an input sorted run. The batch
@@ -46,12 +55,15 @@ class SortedRunMerger {
   /// batch being returned.
   typedef boost::function<Status (RowBatch**)> RunBatchSupplier;
 
+  /// 'max_normalized_key_len' is the maximum length of the normalized keys. 0 disables
+  /// them.
   SortedRunMerger(const TupleRowComparator& comparator, RowDescriptor* row_desc,
-      RuntimeProfile* profile, bool deep_copy_input);
+      RuntimeProfile* profile, bool deep_copy_input, int max_normalized_key_len);
+
+  ~SortedRunMerger();
 
   /// Prepare this merger to merge and return rows from the sorted runs in 'input_runs'.
-  /// Retrieves the first batch from each run and sets up the binary heap implementing
-  /// the priority queue.
+  /// Retrieves the first batch from each run and sets up the tree of losers.
   Status Prepare(const std::vector<RunBatchSupplier>& input_runs);
 
   /// Return the next batch of sorted rows from this merger.
@@ -64,22 +76,44 @@ class SortedRunMerger {
  private:
   class BatchedRowSupplier;
 
-  /// Assuming the element at parent_index is the only out of place element in the heap,
-  /// restore the heap property (i.e. swap elements so parent <= children).
-  void Heapify(int parent_index);
+  /// Plays the matches of the subtree rooted at internal node 'node', storing the loser
+  /// of each match in 'tree_'. Returns the index of the winning run.
+  int BuildTree(int node);
+
+  /// Replays the matches on the path from the leaf of run 'run_index' to the root after
+  /// the run advanced, which makes the new winner tree_[0].
+  void ReplayMatches(int run_index);
+
+  /// Returns true if the current row of 'lhs' is less than the current row of 'rhs'.
+  bool Less(const BatchedRowSupplier* lhs, const BatchedRowSupplier* rhs) const;
+
+  /// Returns true if the current row of run 'lhs' is less than the current row of run
+  /// 'rhs'. Exhausted runs are greater than all other runs.
+  bool LessRun(int lhs, int rhs) const;
 
-  /// The binary min-heap used to merge rows from the sorted input runs. Since the heap is
-  /// stored in a 0-indexed array, the 0-th element is the minimum element in the heap,
-  /// and the children of the element at index i are 2*i+1 and 2*i+2. The heap property is
-  /// that row of the parent element is <= the rows of the child elements according to the
-  /// comparator comparator_.
-  /// The BatchedRowSupplier objects used in the min_heap_ are owned by this
-  /// SortedRunMerger instance.
-  std::vector<BatchedRowSupplier*> min_heap_;
+  /// The sorted input runs. Exhausted runs are set to NULL. The BatchedRowSupplier
+  /// objects are owned by this SortedRunMerger instance.
+  std::vector<BatchedRowSupplier*> runs_;
+
+  /// The tree of losers over runs_, stored as indexes into runs_. tree_[0] is the winner.
+  /// For k runs, the internal nodes are 1 to k - 1 and the children of node i are 2*i
+  /// and 2*i+1, where node k + j is the leaf of run j, so that the leaves are not
+  /// stored.
+  std::vector<int> tree_;
+
+  /// The number of runs that are not exhausted.
+  int num_active_runs_;
 
   /// Row comparator. Returns true if lhs < rhs.
   TupleRowComparator comparator_;
 
+  /// Builds the normalized keys of the current rows. NULL if normalized keys are not
+  /// used.
+  boost::scoped_ptr<KeyNormalizer> key_normalizer_;
+
+  /// True if key_normalizer_ normalizes all keys of comparator_.
+  bool all_keys_normalized_;
+
   /// Descriptor for the rows provided by the input runs. Owned by the exec-node through
   /// which this merger was created.
   RowDescriptor* input_row_desc_;
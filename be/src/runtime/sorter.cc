@@ -18,14 +18,28 @@
 #include <boost/random/uniform_int.hpp>
 #include <gutil/strings/substitute.h>
 
+#include "common/atomic.h"
 #include "runtime/buffered-block-mgr.h"
+#include "runtime/mem-tracker.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/sorted-run-merger.h"
+#include "runtime/thread-resource-mgr.h"
+#include "util/key-normalizer.inline.h"
 #include "util/runtime-profile.h"
+#include "util/thread.h"
 
 #include "common/names.h"
 
+DEFINE_int32(max_sort_normalized_key_len, 32, "(Advanced) Maximum length in bytes of "
+    "the memcmp-comparable keys the sorter builds from the sort exprs. Tuples are only "
+    "compared by evaluating the sort exprs if their keys are equal. 0 disables "
+    "normalized keys.");
+DEFINE_int32(sort_max_threads, 4, "(Advanced) Maximum number of threads, including the "
+    "fragment thread, that sort a large in-memory run. Helper threads are only used if "
+    "spare thread tokens are available and the run can be sorted on its normalized "
+    "keys alone.");
+
 using boost::uniform_int;
 using boost::mt19937_64;
 using namespace strings;
@@ -70,9 +84,11 @@ class Sorter::Run {
   /// Add a batch of input rows to the current run. Returns the number
   /// of rows actually added in num_processed. If the run is full (no more blocks can
   /// be allocated), num_processed may be less than the number of rows in the batch.
-  /// If materialize_slots_ is true, materializes the input rows using the expressions
-  /// in sorter_->sort_tuple_slot_expr_ctxs_, else just copies the input rows.
-  template <bool has_var_len_data>
+  /// If materialize_slots is true, materializes the input rows using the expressions
+  /// in sorter_->sort_tuple_slot_expr_ctxs_, else just copies the input rows, which
+  /// must consist of a single sort tuple. Only runs constructed from input rows may
+  /// materialize slots.
+  template <bool has_var_len_data, bool materialize_slots>
   Status AddBatch(RowBatch* batch, int start_index, int* num_processed);
 
   /// Attaches all fixed-len and var-len blocks to the given row batch.
@@ -131,6 +147,10 @@ class Sorter::Run {
   /// previously unpinned.
   Status PrepareRead();
 
+  /// Starts reading ahead the blocks that follow blocks[index] in an unpinned run, up to
+  /// the block mgr's read_ahead_blocks().
+  Status ReadAheadBlocks(const vector<BufferedBlockMgr::Block*>& blocks, int index);
+
   /// Copy the StringValue data in var_values to dest in order and update the StringValue
   /// ptrs to point to the copied data.
   void CopyVarLenData(const vector<StringValue*>& var_values, uint8_t* dest);
@@ -219,10 +239,26 @@ class Sorter::Run {
 /// Quick sort is used for sequences of tuples larger that 16 elements, and insertion sort
 /// is used for smaller sequences. The TupleSorter is initialized with a RuntimeState
 /// instance to check for cancellation during an in-memory sort.
+///
+/// If the sort keys can be normalized (see KeyNormalizer), a memcmp-comparable key is
+/// built for each tuple before sorting and moved along with it. Tuples are compared
+/// with the comparator only if their keys are equal and do not represent the full sort
+/// keys, e.g. because a string was truncated.
+///
+/// If the normalized keys are at most MAX_RADIX_SORT_KEY_LEN bytes, e.g. for integer
+/// keys, the tuples are sorted with an MSD radix sort on the key bytes instead of
+/// quicksort. Each pass partitions a range in place into 256 buckets by one key byte;
+/// small buckets are finished with insertion sort and ranges whose keys are equal but
+/// not complete with quicksort.
+///
+/// Large runs whose normalized keys are all complete, i.e. that can be sorted without
+/// evaluating the sort exprs, are sorted in parallel: the fragment thread partitions
+/// the run into ranges with quicksort partitioning steps, and then sorts the ranges
+/// together with helper threads, one per thread token that can be obtained.
 class Sorter::TupleSorter {
  public:
   TupleSorter(const TupleRowComparator& comparator, int64_t block_size,
-      int tuple_size, RuntimeState* state);
+      int tuple_size, MemTracker* mem_tracker, RuntimeState* state);
 
   ~TupleSorter();
 
@@ -235,6 +271,19 @@ class Sorter::TupleSorter {
  private:
   static const int INSERTION_THRESHOLD = 16;
 
+  /// Maximum normalized key length for which radix sort is used.
+  static const int MAX_RADIX_SORT_KEY_LEN = 16;
+
+  /// Minimum number of tuples in a run for it to be sorted in parallel.
+  static const int64_t PARALLEL_SORT_MIN_TUPLES = 1024 * 1024;
+
+  /// Number of ranges per thread that a run sorted in parallel is partitioned into, so
+  /// that threads that finish early can take over ranges.
+  static const int RANGES_PER_THREAD = 4;
+
+  /// A range [first, last) of tuple indices in run_.
+  typedef std::pair<int64_t, int64_t> Range;
+
   /// Helper class used to iterate over tuples in a run during quick sort and insertion
   /// sort.
   class TupleIterator {
@@ -283,6 +332,13 @@ class Sorter::TupleSorter {
       }
     }
 
+    /// Returns the normalized key of the current tuple, or NULL if the sort does not
+    /// use normalized keys.
+    uint8_t* key() const {
+      if (parent_->keys_ == NULL) return NULL;
+      return parent_->keys_ + index_ * parent_->key_stride_;
+    }
+
     /// The reverse of Next(). Can advance one before the first tuple in the run, but it
     /// is invalid to dereference 'current_tuple_' in that case.
     void Prev() {
@@ -318,6 +374,9 @@ class Sorter::TupleSorter {
   /// Size of the tuples in memory.
   const int tuple_size_;
 
+  /// Size of the blocks of a run.
+  const int64_t block_size_;
+
   /// Number of tuples per block in a run.
   const int block_capacity_;
 
@@ -327,9 +386,36 @@ class Sorter::TupleSorter {
   /// Tuple comparator with method Less() that returns true if lhs < rhs.
   const TupleRowComparator comparator_;
 
+  /// Builds the normalized keys. NULL if the sort keys cannot be normalized.
+  scoped_ptr<KeyNormalizer> key_normalizer_;
+
+  /// True if key_normalizer_ normalizes all the sort keys.
+  bool all_keys_normalized_;
+
+  /// Length of a normalized key. Each key is stored in key_stride_ = key_len_ + 1 bytes:
+  /// the last byte is 1 if the key represents the full sort keys of the tuple, i.e. all
+  /// sort keys are normalized and nothing was truncated.
+  int key_len_;
+  int key_stride_;
+
+  /// Tracks the memory for keys_. Not owned.
+  MemTracker* mem_tracker_;
+
   /// Runtime state instance to check for cancellation. Not owned.
   RuntimeState* const state_;
 
+  /// The normalized keys of the tuples in run_, in the same order as the tuples, while
+  /// run_ is being sorted. NULL if normalized keys are not used, e.g. because the
+  /// memory for them could not be obtained.
+  uint8_t* keys_;
+
+  /// True if all keys in keys_ represent the full sort keys of their tuples.
+  bool keys_complete_;
+
+  /// Temporary space for one key, used like temp_tuple_buffer_ and swap_buffer_.
+  uint8_t* temp_key_buffer_;
+  uint8_t* swap_key_buffer_;
+
   /// The run to be sorted.
   Run* run_;
 
@@ -344,6 +430,27 @@ class Sorter::TupleSorter {
   /// high: Mersenne Twister should be more than adequate.
   mt19937_64 rng_;
 
+  /// Builds keys_ for the tuples in run_. Leaves keys_ NULL if the memory for them could
+  /// not be obtained.
+  void NormalizeKeys();
+
+  /// Sorts run_ with helper threads if it is large enough, it can be sorted on keys_
+  /// alone and thread tokens are available. Returns false without sorting otherwise.
+  bool SortParallel();
+
+  /// Sorts the tuples in 'range' with radix sort or quicksort.
+  void SortRange(const Range& range);
+
+  /// Body of the threads of SortParallel(): sorts the ranges in 'ranges' in order,
+  /// taking the index of the next range to sort from 'next_range', until there are none
+  /// left. If 'release_token' is true, releases a thread token when done.
+  void SortRanges(const vector<Range>* ranges, AtomicInt32* next_range,
+      bool release_token);
+
+  /// Returns true if tuple 'lhs' with key 'lhs_key' is less than tuple 'rhs' with key
+  /// 'rhs_key'. The keys are ignored if keys_ is NULL.
+  bool Less(const uint8_t* lhs_key, uint8_t* lhs, const uint8_t* rhs_key, uint8_t* rhs);
+
   /// Perform an insertion sort for rows in the range [first, last) in a run.
   void InsertionSort(const TupleIterator& first, const TupleIterator& last);
 
@@ -352,21 +459,28 @@ class Sorter::TupleSorter {
   /// tuples in the second group are >= pivot. Tuples are swapped in place to create the
   /// groups and the index to the first element in the second group is returned.
   /// Checks state_->is_cancelled() and returns early with an invalid result if true.
-  TupleIterator Partition(TupleIterator first, TupleIterator last, Tuple* pivot);
+  TupleIterator Partition(TupleIterator first, TupleIterator last,
+      const TupleIterator& pivot);
 
   /// Performs a quicksort of rows in the range [first, last) followed by insertion sort
   /// for smaller groups of elements.
   /// Checks state_->is_cancelled() and returns early if true.
   void SortHelper(TupleIterator first, TupleIterator last);
 
+  /// Performs an MSD radix sort of the tuples with indices [first, last) in a run, whose
+  /// keys are all equal in the bytes before 'byte'. Requires keys_.
+  /// Checks state_->is_cancelled() and returns early if true.
+  void RadixSort(int64_t first, int64_t last, int byte);
+
   /// Select a pivot to partition [first, last).
-  Tuple* SelectPivot(TupleIterator first, TupleIterator last);
+  TupleIterator SelectPivot(TupleIterator first, TupleIterator last);
 
   /// Return median of three tuples according to the sort comparator.
-  Tuple* MedianOfThree(Tuple* t1, Tuple* t2, Tuple* t3);
+  const TupleIterator& MedianOfThree(const TupleIterator& t1, const TupleIterator& t2,
+      const TupleIterator& t3);
 
-  /// Swaps tuples pointed to by left and right using the swap buffer.
-  void Swap(uint8_t* left, uint8_t* right);
+  /// Swaps the tuples (and keys) pointed to by left and right using the swap buffers.
+  void Swap(const TupleIterator& left, const TupleIterator& right);
 }; // class TupleSorter
 
 // Sorter::Run methods
@@ -416,16 +530,18 @@ Status Sorter::Run::Init() {
   return Status::OK();
 }
 
-template <bool has_var_len_data>
+template <bool has_var_len_data, bool materialize_slots>
 Status Sorter::Run::AddBatch(RowBatch* batch, int start_index, int* num_processed) {
   DCHECK(!fixed_len_blocks_.empty());
   *num_processed = 0;
   BufferedBlockMgr::Block* cur_fixed_len_block = fixed_len_blocks_.back();
 
   DCHECK_EQ(materialize_slots_, !is_sorted_);
-  if (!materialize_slots_) {
+  DCHECK(materialize_slots_ || !materialize_slots);
+  if (!materialize_slots) {
     // If materialize slots is false the run is being constructed for an
-    // intermediate merge and the sort tuples have already been materialized.
+    // intermediate merge or from materialized rows, and the sort tuples have already
+    // been materialized.
     // The input row should have the same schema as the sort tuples.
     DCHECK_EQ(batch->row_desc().tuple_descriptors().size(), 1);
     DCHECK_EQ(batch->row_desc().tuple_descriptors()[0], sort_tuple_desc_);
@@ -453,7 +569,7 @@ Status Sorter::Run::AddBatch(RowBatch* batch, int start_index, int* num_processe
       int total_var_len = 0;
       TupleRow* input_row = batch->GetRow(cur_input_index);
       Tuple* new_tuple = cur_fixed_len_block->Allocate<Tuple>(sort_tuple_size_);
-      if (materialize_slots_) {
+      if (materialize_slots) {
         new_tuple->MaterializeExprs<has_var_len_data, true>(input_row, *sort_tuple_desc_,
             sorter_->sort_tuple_slot_expr_ctxs_, NULL, &string_values, &total_var_len);
         if (total_var_len > sorter_->block_mgr_->max_block_size()) {
@@ -635,6 +751,7 @@ Status Sorter::Run::PrepareRead() {
       status.AddDetail(Substitute(PIN_FAILED_ERROR_MSG, "fixed"));
       return status;
     }
+    RETURN_IF_ERROR(ReadAheadBlocks(fixed_len_blocks_, 0));
   }
 
   if (has_var_len_slots_ && var_len_blocks_.size() > 0) {
@@ -647,6 +764,17 @@ Status Sorter::Run::PrepareRead() {
       status.AddDetail(Substitute(PIN_FAILED_ERROR_MSG, "variable"));
       return status;
     }
+    RETURN_IF_ERROR(ReadAheadBlocks(var_len_blocks_, 0));
+  }
+  return Status::OK();
+}
+
+Status Sorter::Run::ReadAheadBlocks(const vector<BufferedBlockMgr::Block*>& blocks,
+    int index) {
+  DCHECK(!is_pinned_);
+  int end = min<int>(blocks.size(), index + 1 + sorter_->block_mgr_->read_ahead_blocks());
+  for (int i = index + 1; i < end; ++i) {
+    if (blocks[i] != NULL) RETURN_IF_ERROR(blocks[i]->ReadAhead());
   }
   return Status::OK();
 }
@@ -714,6 +842,7 @@ Status Sorter::Run::GetNext(RowBatch* output_batch, bool* eos) {
         return status;
       }
       pin_next_fixed_len_block_ = false;
+      RETURN_IF_ERROR(ReadAheadBlocks(fixed_len_blocks_, fixed_len_blocks_index_));
     }
     if (pin_next_var_len_block_) {
       var_len_blocks_[var_len_blocks_index_ - 1]->Delete();
@@ -728,6 +857,7 @@ Status Sorter::Run::GetNext(RowBatch* output_batch, bool* eos) {
         return status;
       }
       pin_next_var_len_block_ = false;
+      RETURN_IF_ERROR(ReadAheadBlocks(var_len_blocks_, var_len_blocks_index_));
     }
   }
 
@@ -857,27 +987,157 @@ void Sorter::Run::CopyVarLenDataConvertOffset(const vector<StringValue*>& string
 }
 
 // Sorter::TupleSorter methods.
+
+// Orders ranges by decreasing size.
+static bool RangeLarger(const pair<int64_t, int64_t>& lhs,
+    const pair<int64_t, int64_t>& rhs) {
+  return lhs.second - lhs.first > rhs.second - rhs.first;
+}
+
 Sorter::TupleSorter::TupleSorter(const TupleRowComparator& comp, int64_t block_size,
-    int tuple_size, RuntimeState* state)
+    int tuple_size, MemTracker* mem_tracker, RuntimeState* state)
   : tuple_size_(tuple_size),
+    block_size_(block_size),
     block_capacity_(block_size / tuple_size),
     last_tuple_block_offset_(tuple_size * ((block_size / tuple_size) - 1)),
     comparator_(comp),
-    state_(state) {
+    key_normalizer_(KeyNormalizer::Create(
+        comp, FLAGS_max_sort_normalized_key_len, &all_keys_normalized_)),
+    key_len_(key_normalizer_.get() == NULL ? 0 : key_normalizer_->key_len()),
+    key_stride_(key_len_ + 1),
+    mem_tracker_(mem_tracker),
+    state_(state),
+    keys_(NULL),
+    keys_complete_(false) {
   temp_tuple_buffer_ = new uint8_t[tuple_size];
   temp_tuple_row_ = reinterpret_cast<TupleRow*>(&temp_tuple_buffer_);
   swap_buffer_ = new uint8_t[tuple_size];
+  temp_key_buffer_ = new uint8_t[key_stride_];
+  swap_key_buffer_ = new uint8_t[key_stride_];
 }
 
 Sorter::TupleSorter::~TupleSorter() {
   delete[] temp_tuple_buffer_;
   delete[] swap_buffer_;
+  delete[] temp_key_buffer_;
+  delete[] swap_key_buffer_;
 }
 
 void Sorter::TupleSorter::Sort(Run* run) {
   run_ = run;
-  SortHelper(TupleIterator(this, 0), TupleIterator(this, run_->num_tuples_));
+  NormalizeKeys();
+  if (!SortParallel()) SortRange(Range(0, run_->num_tuples_));
   run->is_sorted_ = true;
+  if (keys_ != NULL) {
+    free(keys_);
+    keys_ = NULL;
+    mem_tracker_->Release(run_->num_tuples_ * key_stride_);
+  }
+}
+
+void Sorter::TupleSorter::NormalizeKeys() {
+  DCHECK(keys_ == NULL);
+  if (key_normalizer_.get() == NULL || run_->num_tuples_ < 2) return;
+  int64_t keys_bytes = run_->num_tuples_ * key_stride_;
+  if (!mem_tracker_->TryConsume(keys_bytes)) return;
+  keys_ = reinterpret_cast<uint8_t*>(malloc(keys_bytes));
+  if (keys_ == NULL) {
+    mem_tracker_->Release(keys_bytes);
+    return;
+  }
+  keys_complete_ = all_keys_normalized_;
+  TupleIterator iter(this, 0);
+  for (; iter.index_ < run_->num_tuples_; iter.Next()) {
+    uint8_t* key = iter.key();
+    bool went_over = key_normalizer_->NormalizeKey(
+        reinterpret_cast<TupleRow*>(&iter.current_tuple_), key);
+    key[key_len_] = all_keys_normalized_ && !went_over;
+    keys_complete_ &= key[key_len_];
+  }
+}
+
+bool Sorter::TupleSorter::SortParallel() {
+  if (FLAGS_sort_max_threads <= 1 || keys_ == NULL || !keys_complete_) return false;
+  if (run_->num_tuples_ < PARALLEL_SORT_MIN_TUPLES) return false;
+  ThreadResourceMgr::ResourcePool* resource_pool = state_->resource_pool();
+  int num_helpers = 0;
+  while (num_helpers < FLAGS_sort_max_threads - 1 &&
+      resource_pool->TryAcquireThreadToken()) {
+    ++num_helpers;
+  }
+  if (num_helpers == 0) return false;
+
+  // Split the largest range around a pivot until there are enough ranges. The keys are
+  // complete, so no comparison evaluates the sort exprs, which are not thread-safe.
+  vector<Range> ranges(1, Range(0, run_->num_tuples_));
+  const int num_ranges = (num_helpers + 1) * RANGES_PER_THREAD;
+  while (ranges.size() < num_ranges && !state_->is_cancelled()) {
+    int largest = 0;
+    for (int i = 1; i < ranges.size(); ++i) {
+      if (ranges[i].second - ranges[i].first >
+          ranges[largest].second - ranges[largest].first) {
+        largest = i;
+      }
+    }
+    Range range = ranges[largest];
+    if (range.second - range.first <= INSERTION_THRESHOLD) break;
+    TupleIterator first(this, range.first);
+    TupleIterator last(this, range.second);
+    TupleIterator cut = Partition(first, last, SelectPivot(first, last));
+    ranges[largest] = Range(range.first, cut.index_);
+    ranges.push_back(Range(cut.index_, range.second));
+  }
+
+  // Sort the largest ranges first so that the threads finish at about the same time.
+  sort(ranges.begin(), ranges.end(), RangeLarger);
+  AtomicInt32 next_range(0);
+  ThreadGroup helper_threads;
+  boost::ptr_vector<TupleSorter> helpers;
+  for (int i = 0; i < num_helpers; ++i) {
+    TupleSorter* helper =
+        new TupleSorter(comparator_, block_size_, tuple_size_, mem_tracker_, state_);
+    helpers.push_back(helper);
+    helper->run_ = run_;
+    helper->keys_ = keys_;
+    helper->keys_complete_ = true;
+    helper_threads.AddThread(new Thread("sorter", "in-memory sort thread",
+        bind(&TupleSorter::SortRanges, helper, &ranges, &next_range, true)));
+  }
+  SortRanges(&ranges, &next_range, false);
+  helper_threads.JoinAll();
+  // The keys are owned by this TupleSorter.
+  for (int i = 0; i < helpers.size(); ++i) helpers[i].keys_ = NULL;
+  return true;
+}
+
+void Sorter::TupleSorter::SortRange(const Range& range) {
+  if (keys_ != NULL && key_len_ <= MAX_RADIX_SORT_KEY_LEN) {
+    RadixSort(range.first, range.second, 0);
+  } else {
+    SortHelper(TupleIterator(this, range.first), TupleIterator(this, range.second));
+  }
+}
+
+void Sorter::TupleSorter::SortRanges(const vector<Range>* ranges,
+    AtomicInt32* next_range, bool release_token) {
+  while (true) {
+    int range_idx = next_range->Add(1) - 1;
+    if (range_idx >= ranges->size()) break;
+    SortRange((*ranges)[range_idx]);
+  }
+  if (release_token) state_->resource_pool()->ReleaseThreadToken(false);
+}
+
+inline bool Sorter::TupleSorter::Less(const uint8_t* lhs_key, uint8_t* lhs,
+    const uint8_t* rhs_key, uint8_t* rhs) {
+  if (keys_ != NULL) {
+    int result = memcmp(lhs_key, rhs_key, key_len_);
+    if (result != 0) return result < 0;
+    // Equal keys that represent the full sort keys mean equal tuples.
+    if (lhs_key[key_len_] && rhs_key[key_len_]) return false;
+  }
+  return comparator_.Less(
+      reinterpret_cast<TupleRow*>(&lhs), reinterpret_cast<TupleRow*>(&rhs));
 }
 
 // Sort the sequence of tuples from [first, last).
@@ -895,6 +1155,7 @@ void Sorter::TupleSorter::InsertionSort(const TupleIterator& first,
     // be inserted into the sorted sequence. Copy to temp_tuple_row_ since it may be
     // overwritten by the one at position 'insert_iter - 1'
     memcpy(temp_tuple_buffer_, insert_iter.current_tuple_, tuple_size_);
+    if (keys_ != NULL) memcpy(temp_key_buffer_, insert_iter.key(), key_stride_);
 
     // 'iter' points to the tuple that temp_tuple_row_ will be compared to.
     // 'copy_to' is the where iter should be copied to if it is >= temp_tuple_row_.
@@ -902,10 +1163,14 @@ void Sorter::TupleSorter::InsertionSort(const TupleIterator& first,
     TupleIterator iter = insert_iter;
     iter.Prev();
     uint8_t* copy_to = insert_iter.current_tuple_;
-    while (comparator_.Less(
-        temp_tuple_row_, reinterpret_cast<TupleRow*>(&iter.current_tuple_))) {
+    uint8_t* copy_to_key = insert_iter.key();
+    while (Less(temp_key_buffer_, temp_tuple_buffer_, iter.key(), iter.current_tuple_)) {
       memcpy(copy_to, iter.current_tuple_, tuple_size_);
       copy_to = iter.current_tuple_;
+      if (keys_ != NULL) {
+        memcpy(copy_to_key, iter.key(), key_stride_);
+        copy_to_key = iter.key();
+      }
       // Break if 'iter' has reached the first row, meaning that temp_tuple_row_
       // will be inserted in position 'first'
       if (iter.index_ <= first.index_) break;
@@ -913,29 +1178,29 @@ void Sorter::TupleSorter::InsertionSort(const TupleIterator& first,
     }
 
     memcpy(copy_to, temp_tuple_buffer_, tuple_size_);
+    if (keys_ != NULL) memcpy(copy_to_key, temp_key_buffer_, key_stride_);
   }
 }
 
 Sorter::TupleSorter::TupleIterator Sorter::TupleSorter::Partition(TupleIterator first,
-    TupleIterator last, Tuple* pivot) {
+    TupleIterator last, const TupleIterator& pivot) {
   // Copy pivot into temp_tuple since it points to a tuple within [first, last).
-  memcpy(temp_tuple_buffer_, pivot, tuple_size_);
+  memcpy(temp_tuple_buffer_, pivot.current_tuple_, tuple_size_);
+  if (keys_ != NULL) memcpy(temp_key_buffer_, pivot.key(), key_stride_);
 
   last.Prev();
   while (true) {
     // Search for the first and last out-of-place elements, and swap them.
-    while (comparator_.Less(
-        reinterpret_cast<TupleRow*>(&first.current_tuple_), temp_tuple_row_)) {
+    while (Less(first.key(), first.current_tuple_, temp_key_buffer_, temp_tuple_buffer_)) {
       first.Next();
     }
-    while (comparator_.Less(
-        temp_tuple_row_, reinterpret_cast<TupleRow*>(&last.current_tuple_))) {
+    while (Less(temp_key_buffer_, temp_tuple_buffer_, last.key(), last.current_tuple_)) {
       last.Prev();
     }
 
     if (first.index_ >= last.index_) break;
     // Swap first and last tuples.
-    Swap(first.current_tuple_, last.current_tuple_);
+    Swap(first, last);
 
     first.Next();
     last.Prev();
@@ -948,7 +1213,7 @@ void Sorter::TupleSorter::SortHelper(TupleIterator first, TupleIterator last) {
   if (UNLIKELY(state_->is_cancelled())) return;
   // Use insertion sort for smaller sequences.
   while (last.index_ - first.index_ > INSERTION_THRESHOLD) {
-    Tuple* pivot = SelectPivot(first, last);
+    TupleIterator pivot = SelectPivot(first, last);
 
     // Partition() splits the tuples in [first, last) into two groups (<= pivot
     // and >= pivot) in-place. 'cut' is the index of the first tuple in the second group.
@@ -973,7 +1238,55 @@ void Sorter::TupleSorter::SortHelper(TupleIterator first, TupleIterator last) {
   InsertionSort(first, last);
 }
 
-Tuple* Sorter::TupleSorter::SelectPivot(TupleIterator first, TupleIterator last) {
+void Sorter::TupleSorter::RadixSort(int64_t first, int64_t last, int byte) {
+  DCHECK(keys_ != NULL);
+  if (UNLIKELY(state_->is_cancelled())) return;
+  if (last - first <= INSERTION_THRESHOLD) {
+    InsertionSort(TupleIterator(this, first), TupleIterator(this, last));
+    return;
+  }
+  if (byte == key_len_) {
+    // All keys in the range are equal. The tuples are only out of order if the keys do
+    // not represent the full sort keys.
+    if (!keys_complete_) SortHelper(TupleIterator(this, first), TupleIterator(this, last));
+    return;
+  }
+
+  // Count the keys per bucket and compute the bucket boundaries.
+  int64_t bucket_end[256];
+  int64_t next[256];
+  memset(bucket_end, 0, sizeof(bucket_end));
+  for (int64_t i = first; i < last; ++i) ++bucket_end[keys_[i * key_stride_ + byte]];
+  int64_t start = first;
+  for (int b = 0; b < 256; ++b) {
+    next[b] = start;
+    start += bucket_end[b];
+    bucket_end[b] = start;
+  }
+
+  // Move each tuple to the next free slot of its bucket. Every swap puts at least one
+  // tuple in its final bucket.
+  for (int b = 0; b < 256; ++b) {
+    while (next[b] < bucket_end[b]) {
+      uint8_t key_byte = keys_[next[b] * key_stride_ + byte];
+      if (key_byte == b) {
+        ++next[b];
+      } else {
+        Swap(TupleIterator(this, next[b]), TupleIterator(this, next[key_byte]));
+        ++next[key_byte];
+      }
+    }
+  }
+
+  int64_t bucket_start = first;
+  for (int b = 0; b < 256; ++b) {
+    if (bucket_end[b] - bucket_start > 1) RadixSort(bucket_start, bucket_end[b], byte + 1);
+    bucket_start = bucket_end[b];
+  }
+}
+
+Sorter::TupleSorter::TupleIterator Sorter::TupleSorter::SelectPivot(
+    TupleIterator first, TupleIterator last) {
   // Select the median of three random tuples. The random selection avoids pathological
   // behaviour associated with techniques that pick a fixed element (e.g. picking
   // first/last/middle element) and taking the median tends to help us select better
@@ -986,25 +1299,20 @@ Tuple* Sorter::TupleSorter::SelectPivot(TupleIterator first, TupleIterator last)
   // less than 1%. Since selection is random each time, the chance of repeatedly picking
   // bad pivots decreases exponentialy and becomes negligibly small after a few
   // iterations.
-  Tuple* tuples[3];
-  for (int i = 0; i < 3; ++i) {
-    int64_t index = uniform_int<int64_t>(first.index_, last.index_ - 1)(rng_);
-    TupleIterator iter(this, index);
-    DCHECK(iter.current_tuple_ != NULL);
-    tuples[i] = reinterpret_cast<Tuple*>(iter.current_tuple_);
-  }
-
-  return MedianOfThree(tuples[0], tuples[1], tuples[2]);
+  TupleIterator t1(this, uniform_int<int64_t>(first.index_, last.index_ - 1)(rng_));
+  TupleIterator t2(this, uniform_int<int64_t>(first.index_, last.index_ - 1)(rng_));
+  TupleIterator t3(this, uniform_int<int64_t>(first.index_, last.index_ - 1)(rng_));
+  DCHECK(t1.current_tuple_ != NULL);
+  DCHECK(t2.current_tuple_ != NULL);
+  DCHECK(t3.current_tuple_ != NULL);
+  return MedianOfThree(t1, t2, t3);
 }
 
-Tuple* Sorter::TupleSorter::MedianOfThree(Tuple* t1, Tuple* t2, Tuple* t3) {
-  TupleRow* tr1 = reinterpret_cast<TupleRow*>(&t1);
-  TupleRow* tr2 = reinterpret_cast<TupleRow*>(&t2);
-  TupleRow* tr3 = reinterpret_cast<TupleRow*>(&t3);
-
-  bool t1_lt_t2 = comparator_.Less(tr1, tr2);
-  bool t2_lt_t3 = comparator_.Less(tr2, tr3);
-  bool t1_lt_t3 = comparator_.Less(tr1, tr3);
+const Sorter::TupleSorter::TupleIterator& Sorter::TupleSorter::MedianOfThree(
+    const TupleIterator& t1, const TupleIterator& t2, const TupleIterator& t3) {
+  bool t1_lt_t2 = Less(t1.key(), t1.current_tuple_, t2.key(), t2.current_tuple_);
+  bool t2_lt_t3 = Less(t2.key(), t2.current_tuple_, t3.key(), t3.current_tuple_);
+  bool t1_lt_t3 = Less(t1.key(), t1.current_tuple_, t3.key(), t3.current_tuple_);
 
   if (t1_lt_t2) {
     // t1 < t2
@@ -1033,10 +1341,16 @@ Tuple* Sorter::TupleSorter::MedianOfThree(Tuple* t1, Tuple* t2, Tuple* t3) {
   }
 }
 
-inline void Sorter::TupleSorter::Swap(uint8_t* left, uint8_t* right) {
-  memcpy(swap_buffer_, left, tuple_size_);
-  memcpy(left, right, tuple_size_);
-  memcpy(right, swap_buffer_, tuple_size_);
+inline void Sorter::TupleSorter::Swap(const TupleIterator& left,
+    const TupleIterator& right) {
+  memcpy(swap_buffer_, left.current_tuple_, tuple_size_);
+  memcpy(left.current_tuple_, right.current_tuple_, tuple_size_);
+  memcpy(right.current_tuple_, swap_buffer_, tuple_size_);
+  if (keys_ != NULL) {
+    memcpy(swap_key_buffer_, left.key(), key_stride_);
+    memcpy(left.key(), right.key(), key_stride_);
+    memcpy(right.key(), swap_key_buffer_, key_stride_);
+  }
 }
 
 // Sorter methods
@@ -1080,7 +1394,7 @@ Status Sorter::Init() {
   TupleDescriptor* sort_tuple_desc = output_row_desc_->tuple_descriptors()[0];
   has_var_len_slots_ = sort_tuple_desc->HasVarlenSlots();
   in_mem_tuple_sorter_.reset(new TupleSorter(compare_less_than_,
-      block_mgr_->max_block_size(), sort_tuple_desc->byte_size(), state_));
+      block_mgr_->max_block_size(), sort_tuple_desc->byte_size(), mem_tracker_, state_));
   unsorted_run_ = obj_pool_.Add(new Run(this, sort_tuple_desc, true));
 
   initial_runs_counter_ = ADD_COUNTER(profile_, "InitialRunsCreated", TUnit::UNIT);
@@ -1103,17 +1417,26 @@ Status Sorter::Init() {
 }
 
 Status Sorter::AddBatch(RowBatch* batch) {
+  return AddBatchInternal<true>(batch);
+}
+
+Status Sorter::AddMaterializedBatch(RowBatch* batch) {
+  return AddBatchInternal<false>(batch);
+}
+
+template <bool materialize_slots>
+Status Sorter::AddBatchInternal(RowBatch* batch) {
   DCHECK(unsorted_run_ != NULL);
   DCHECK(batch != NULL);
   int num_processed = 0;
   int cur_batch_index = 0;
   while (cur_batch_index < batch->num_rows()) {
     if (has_var_len_slots_) {
-      RETURN_IF_ERROR(unsorted_run_->AddBatch<true>(
-          batch, cur_batch_index, &num_processed));
+      RETURN_IF_ERROR((unsorted_run_->AddBatch<true, materialize_slots>(
+          batch, cur_batch_index, &num_processed)));
     } else {
-      RETURN_IF_ERROR(unsorted_run_->AddBatch<false>(
-          batch, cur_batch_index, &num_processed));
+      RETURN_IF_ERROR((unsorted_run_->AddBatch<false, materialize_slots>(
+          batch, cur_batch_index, &num_processed)));
     }
     cur_batch_index += num_processed;
     if (cur_batch_index < batch->num_rows()) {
@@ -1280,10 +1603,10 @@ Status Sorter::MergeIntermediateRuns() {
       RETURN_IF_ERROR(merger_->GetNext(&intermediate_merge_batch, &eos));
       Status ret_status;
       if (has_var_len_slots_) {
-        ret_status = merged_run->AddBatch<true>(&intermediate_merge_batch,
+        ret_status = merged_run->AddBatch<true, false>(&intermediate_merge_batch,
             0, &num_copied);
       } else {
-        ret_status = merged_run->AddBatch<false>(&intermediate_merge_batch,
+        ret_status = merged_run->AddBatch<false, false>(&intermediate_merge_batch,
             0, &num_copied);
       }
       if (!ret_status.ok()) return ret_status;
@@ -1325,7 +1648,8 @@ Status Sorter::CreateMerger(int num_runs) {
   }
   merging_runs_.clear();
   merger_.reset(
-      new SortedRunMerger(compare_less_than_, output_row_desc_, profile_, true));
+      new SortedRunMerger(compare_less_than_, output_row_desc_, profile_, true,
+          FLAGS_max_sort_normalized_key_len));
 
   vector<function<Status (RowBatch**)> > merge_runs;
   merge_runs.reserve(num_runs);
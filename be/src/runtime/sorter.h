@@ -103,6 +103,10 @@ class Sorter {
   /// Adds a batch of input rows to the current unsorted run.
   Status AddBatch(RowBatch* batch);
 
+  /// Adds a batch of rows that already consist of a single sort tuple, i.e. that were
+  /// materialized with the sort tuple slot exprs, to the current unsorted run.
+  Status AddMaterializedBatch(RowBatch* batch);
+
   /// Called to indicate there is no more input. Triggers the creation of merger(s) if
   /// necessary.
   Status InputDone();
@@ -130,6 +134,10 @@ class Sorter {
   class Run;
   class TupleSorter;
 
+  /// Implementation of AddBatch() and AddMaterializedBatch().
+  template <bool materialize_slots>
+  Status AddBatchInternal(RowBatch* batch);
+
   /// Create a SortedRunMerger from the first 'num_runs' sorted runs in sorted_runs_ and
   /// assign it to merger_. The runs to be merged are removed from sorted_runs_.
   /// The Sorter sets the deep_copy_input flag to true for the merger, since the blocks
@@ -18,6 +18,7 @@
 
 #include <vector>
 #include <cstring>
+#include <emmintrin.h>
 #include <boost/cstdint.hpp>
 
 #include "common/logging.h"
@@ -25,11 +26,16 @@
 
 namespace impala {
 
-/// TODO: This can be sped up with SIDD_CMP_EQUAL_ORDERED or at the very least rewritten
-/// from published algorithms.
+/// Substring search over non-null-terminated strings. Patterns of two or more characters
+/// are first searched for with SSE2: 16 candidate positions at a time are filtered by
+/// comparing the first and the last character of the pattern, and only the candidates
+/// where both match are compared in full. Unlike the SSE4.2 string instructions, which
+/// native code can only use behind a runtime CPU check (see sse-util.h), SSE2 is
+/// always available on x86-64. The last positions, where a 16 byte load would read past
+/// the end of the string, are searched with the algorithm below.
 //
-/// This is taken from the python search string function doing string search (substring)
-/// using an optimized boyer-moore-horspool algorithm.
+/// The scalar search is taken from the python search string function doing string search
+/// (substring) using an optimized boyer-moore-horspool algorithm.
 /// http://hg.python.org/cpython/file/6b6c79eba944/Objects/stringlib/fastsearch.h
 //
 /// PYTHON SOFTWARE FOUNDATION LICENSE VERSION 2
@@ -127,12 +133,30 @@ class StringSearch {
       return -1;
     }
 
+    // Search the positions at which both loads stay within 'str'.
+    int i = 0;
+    const __m128i first = _mm_set1_epi8(p[0]);
+    const __m128i last = _mm_set1_epi8(p[mlast]);
+    for (; i + mlast + SSE_WIDTH <= n; i += SSE_WIDTH) {
+      const __m128i block_first =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+      const __m128i block_last =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + mlast));
+      int mask = _mm_movemask_epi8(_mm_and_si128(
+          _mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+      while (mask != 0) {
+        int offset = __builtin_ctz(mask);
+        if (memcmp(s + i + offset + 1, p + 1, m - 2) == 0) return i + offset;
+        mask &= mask - 1;
+      }
+    }
+
     // General case.
     int j;
     // TODO: the original code seems to have an off by one error. It is possible
     // to index at w + m which is the length of the input string. Checks have
     // been added to make sure that w + m < str->len.
-    for (int i = 0; i <= w; i++) {
+    for (; i <= w; i++) {
       // note: using mlast in the skip path slows things down on x86
       if (s[i+m-1] == p[m-1]) {
         // candidate match
@@ -159,6 +183,9 @@ class StringSearch {
  private:
   static const int BLOOM_WIDTH = 64;
 
+  /// The number of positions compared at once by the SSE2 search.
+  static const int SSE_WIDTH = 16;
+
   void BloomAdd(char c) {
     mask_ |= (1UL << (c & (BLOOM_WIDTH - 1)));
   }
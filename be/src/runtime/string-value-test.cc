@@ -15,6 +15,7 @@
 #include <string>
 #include <gtest/gtest.h>
 
+#include "runtime/inline-string-value.h"
 #include "runtime/string-value.inline.h"
 #include "util/cpu-info.h"
 
@@ -116,6 +117,43 @@ TEST(StringValueTest, TestCompare) {
   EXPECT_EQ(chars[3].ptr[3], '4');
 }
 
+TEST(StringValueTest, InlineStringValue) {
+  EXPECT_EQ(sizeof(InlineStringValue), sizeof(StringValue));
+  // Must be in lexical order. Includes strings that are equal up to the padding of
+  // the prefix or of the inline string, and long strings that only differ after the
+  // prefix.
+  string strs[] = {"", string("\0", 1), "a", string("a\0", 2), string("a\0\0\0\0", 5),
+      "ab", "abc", "abcd", "abcde", "abcdefghijkl", "abcdefghijklm",
+      "abcdefghijklmn", "abcdefghijkz", "abcz", "abczzzzzzzzzzzzz", "\xff"};
+  const int NUM_STRINGS = sizeof(strs) / sizeof(strs[0]);
+  InlineStringValue isvs[NUM_STRINGS];
+  for (int i = 0; i < NUM_STRINGS; ++i) {
+    StringValue sv = FromStdString(strs[i]);
+    isvs[i] = InlineStringValue(sv);
+    EXPECT_EQ(isvs[i].is_inline(), sv.len <= InlineStringValue::MAX_INLINE_LEN);
+    EXPECT_EQ(isvs[i].len(), sv.len);
+    EXPECT_TRUE(isvs[i].ToStringValue().Eq(sv)) << i;
+    EXPECT_EQ(isvs[i].Hash(1234), HashUtil::Hash(sv.ptr, sv.len, 1234)) << i;
+  }
+  for (int i = 0; i < NUM_STRINGS; ++i) {
+    // A copy that doesn't share the data of long strings.
+    string copy = strs[i];
+    InlineStringValue isv(FromStdString(copy));
+    EXPECT_TRUE(isv.Eq(isvs[i])) << i;
+    for (int j = 0; j < NUM_STRINGS; ++j) {
+      EXPECT_EQ(isvs[i].Eq(isvs[j]), i == j) << "i=" << i << " j=" << j;
+      int cmp = isvs[i].Compare(isvs[j]);
+      if (i < j) {
+        EXPECT_LT(cmp, 0) << "i=" << i << " j=" << j;
+      } else if (i == j) {
+        EXPECT_EQ(cmp, 0) << "i=" << i << " j=" << j;
+      } else {
+        EXPECT_GT(cmp, 0) << "i=" << i << " j=" << j;
+      }
+    }
+  }
+}
+
 }
 
 int main(int argc, char **argv) {
@@ -30,7 +30,7 @@ class NotifiedCounter {
 
   void Notify(ThreadResourceMgr::ResourcePool* consumer) {
     ASSERT_TRUE(consumer != NULL);
-    ASSERT_LT(consumer->num_threads(), consumer->quota());
+    ASSERT_GT(consumer->num_available_threads(), 0);
     ++counter_;
   }
 
@@ -40,6 +40,21 @@ class NotifiedCounter {
   int counter_;
 };
 
+// Acquires an optional thread when notified and records the order of the borrowers.
+class Borrower {
+ public:
+  Borrower(int id, vector<int>* order) : id_(id), order_(order) {
+  }
+
+  void Notify(ThreadResourceMgr::ResourcePool* consumer) {
+    if (consumer->TryAcquireThreadToken()) order_->push_back(id_);
+  }
+
+ private:
+  int id_;
+  vector<int>* order_;
+};
+
 TEST(ThreadResourceMgr, BasicTest) {
   ThreadResourceMgr mgr(5);
   NotifiedCounter counter1, counter2;
@@ -80,19 +95,99 @@ TEST(ThreadResourceMgr, BasicTest) {
   ThreadResourceMgr::ResourcePool* c2 = mgr.RegisterPool();
   int callback2 = c2->AddThreadAvailableCb(bind<void>(mem_fn(&NotifiedCounter::Notify),
       &counter2, _1));
-  EXPECT_FALSE(c1->TryAcquireThreadToken());
+  EXPECT_EQ(c1->quota(), 3);
   EXPECT_EQ(c1->num_threads(), 3);
-  c1->AcquireThreadToken();
+  // c1 can borrow the threads that c2 doesn't use.
+  EXPECT_TRUE(c1->TryAcquireThreadToken());
+  EXPECT_TRUE(c1->TryAcquireThreadToken());
+  EXPECT_FALSE(c1->TryAcquireThreadToken());
+  EXPECT_EQ(c1->num_threads(), 5);
+  EXPECT_FALSE(c1->optional_exceeded());
+  // c2 takes its share, so c1 must give back a borrowed thread.
+  c2->AcquireThreadToken();
+  EXPECT_TRUE(c1->optional_exceeded());
+  c1->ReleaseThreadToken(false);
+  EXPECT_FALSE(c1->optional_exceeded());
   EXPECT_EQ(c1->num_threads(), 4);
-  EXPECT_EQ(c1->num_required_threads(), 2);
-  EXPECT_EQ(c1->num_optional_threads(), 2);
+  EXPECT_EQ(c1->num_required_threads(), 1);
+  EXPECT_EQ(c1->num_optional_threads(), 3);
+  EXPECT_EQ(counter1.counter(), 3);
+
+  // The thread that c2 releases is first offered to c2 and then lent to c1.
+  c2->ReleaseThreadToken(true);
+  EXPECT_EQ(counter2.counter(), 1);
+  EXPECT_EQ(counter1.counter(), 4);
+  c1->AcquireThreadToken();
+  EXPECT_EQ(c1->num_threads(), 5);
+  EXPECT_EQ(c1->num_available_threads(), 0);
 
   c1->RemoveThreadAvailableCb(callback1);
   mgr.UnregisterPool(c1);
   c2->RemoveThreadAvailableCb(callback2);
   mgr.UnregisterPool(c2);
-  EXPECT_EQ(counter1.counter(), 3);
-  EXPECT_EQ(counter2.counter(), 1);
+  EXPECT_EQ(counter1.counter(), 4);
+  EXPECT_EQ(counter2.counter(), 2);
+}
+
+// The quotas are the fair shares of the request pools, their queries and the queries'
+// fragments, and the pools with the largest share of idle threads borrow first.
+TEST(ThreadResourceMgr, FairShares) {
+  ThreadResourceMgr mgr(12);
+  ThreadResourceMgr::ResourcePool* q1 = mgr.RegisterPool("root.a", "q1");
+  EXPECT_EQ(q1->quota(), 12);
+  // A second query in the same request pool halves the quota.
+  ThreadResourceMgr::ResourcePool* q2_f1 = mgr.RegisterPool("root.a", "q2");
+  ThreadResourceMgr::ResourcePool* q2_f2 = mgr.RegisterPool("root.a", "q2");
+  EXPECT_EQ(q1->quota(), 6);
+  EXPECT_EQ(q2_f1->quota(), 3);
+  EXPECT_EQ(q2_f2->quota(), 3);
+  // Another request pool gets half of the system, however many queries root.a has.
+  ThreadResourceMgr::ResourcePool* q3 = mgr.RegisterPool("root.b", "q3");
+  EXPECT_EQ(q3->quota(), 6);
+  EXPECT_EQ(q1->quota(), 3);
+  EXPECT_EQ(q2_f1->quota(), 2);
+  q3->set_max_quota(4);
+  EXPECT_EQ(q3->quota(), 4);
+
+  vector<int> order;
+  Borrower borrower1(1, &order), borrower2(2, &order);
+  int callback1 = q1->AddThreadAvailableCb(
+      bind<void>(mem_fn(&Borrower::Notify), &borrower1, _1));
+  int callback2 = q2_f1->AddThreadAvailableCb(
+      bind<void>(mem_fn(&Borrower::Notify), &borrower2, _1));
+  for (int i = 0; i < 3; ++i) q1->AcquireThreadToken();
+  q2_f1->AcquireThreadToken();
+  for (int i = 0; i < 2; ++i) q2_f2->AcquireThreadToken();
+  for (int i = 0; i < 4; ++i) q3->AcquireThreadToken();
+  // q3 can't borrow an idle thread beyond its max quota.
+  EXPECT_FALSE(q3->TryAcquireThreadToken());
+  EXPECT_EQ(q1->num_available_threads(), 2);
+
+  // The thread that q2_f2 releases is lent to q2_f1, which uses half of its quota,
+  // before q1, which uses all of it.
+  q2_f2->ReleaseThreadToken(true);
+  ASSERT_EQ(order.size(), 2);
+  EXPECT_EQ(order[0], 2);
+  EXPECT_EQ(order[1], 1);
+  EXPECT_EQ(q2_f1->num_threads(), 2);
+  EXPECT_EQ(q1->num_threads(), 4);
+  EXPECT_TRUE(q1->TryAcquireThreadToken());
+  EXPECT_FALSE(q1->TryAcquireThreadToken());
+  EXPECT_FALSE(q1->optional_exceeded());
+  // q2_f2 takes its thread back, which oversubscribes the system, so q1 has to give
+  // back its borrowed threads.
+  q2_f2->AcquireThreadToken();
+  EXPECT_TRUE(q1->optional_exceeded());
+  EXPECT_FALSE(q2_f1->optional_exceeded());
+  EXPECT_FALSE(q3->optional_exceeded());
+
+  q1->RemoveThreadAvailableCb(callback1);
+  q2_f1->RemoveThreadAvailableCb(callback2);
+  for (ThreadResourceMgr::ResourcePool* pool: {q1, q2_f1, q2_f2, q3}) {
+    while (pool->num_optional_threads() > 0) pool->ReleaseThreadToken(false);
+    while (pool->num_required_threads() > 0) pool->ReleaseThreadToken(true);
+    mgr.UnregisterPool(pool);
+  }
 }
 
 TEST(ThreadResourceMgr, MultiCallbacks) {
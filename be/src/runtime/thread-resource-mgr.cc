@@ -14,6 +14,7 @@
 
 #include "runtime/thread-resource-mgr.h"
 
+#include <algorithm>
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
@@ -22,6 +23,7 @@
 
 #include "common/logging.h"
 #include "util/cpu-info.h"
+#include "util/parse-util.h"
 
 #include "common/names.h"
 
@@ -31,6 +33,11 @@ using namespace impala;
 // or 3x the number of cores.  This keeps the cores busy without causing excessive
 // thrashing.
 DEFINE_int32(num_threads_per_core, 3, "Number of threads per core.");
+DEFINE_bool(numa_pin_fragments, false, "(Advanced) If true and the machine has several "
+    "NUMA nodes, the fragment instances are distributed across the nodes and the "
+    "threads of each instance run on the cores of its node, so that the memory that "
+    "they allocate and touch first is local to them.");
+DECLARE_string(admission_pool_weights);
 
 ThreadResourceMgr::ThreadResourceMgr(int threads_quota) {
   DCHECK_GE(threads_quota, 0);
@@ -39,7 +46,11 @@ ThreadResourceMgr::ThreadResourceMgr(int threads_quota) {
   } else {
     system_threads_quota_ = threads_quota;
   }
-  per_pool_quota_ = 0;
+  num_threads_in_use_ = 0;
+  if (FLAGS_numa_pin_fragments && CpuInfo::num_numa_nodes() > 1) {
+    num_numa_node_pools_.resize(CpuInfo::num_numa_nodes());
+  }
+  ParseUtil::ParsePoolWeights(FLAGS_admission_pool_weights, &request_pool_weights_);
 }
 
 ThreadResourceMgr::ResourcePool::ResourcePool(ThreadResourceMgr* parent)
@@ -48,6 +59,8 @@ ThreadResourceMgr::ResourcePool::ResourcePool(ThreadResourceMgr* parent)
 
 void ThreadResourceMgr::ResourcePool::Reset() {
   num_threads_ = 0;
+  fair_quota_ = 0;
+  numa_node_ = -1;
   num_reserved_optional_threads_ = 0;
   thread_callbacks_.clear();
   num_callbacks_ = 0;
@@ -60,7 +73,8 @@ void ThreadResourceMgr::ResourcePool::ReserveOptionalTokens(int num) {
   num_reserved_optional_threads_ = num;
 }
 
-ThreadResourceMgr::ResourcePool* ThreadResourceMgr::RegisterPool() {
+ThreadResourceMgr::ResourcePool* ThreadResourceMgr::RegisterPool(
+    const string& request_pool, const string& query_key) {
   unique_lock<mutex> l(lock_);
   ResourcePool* pool = NULL;
   if (free_pool_objs_.empty()) {
@@ -74,6 +88,13 @@ ThreadResourceMgr::ResourcePool* ThreadResourceMgr::RegisterPool() {
   DCHECK(pools_.find(pool) == pools_.end());
   pools_.insert(pool);
   pool->Reset();
+  pool->request_pool_ = request_pool;
+  pool->query_key_ = query_key;
+  if (!num_numa_node_pools_.empty()) {
+    pool->numa_node_ = min_element(num_numa_node_pools_.begin(),
+        num_numa_node_pools_.end()) - num_numa_node_pools_.begin();
+    ++num_numa_node_pools_[pool->numa_node_];
+  }
 
   // Added a new pool, update the quotas for each pool.
   UpdatePoolQuotas(pool);
@@ -86,6 +107,10 @@ void ThreadResourceMgr::UnregisterPool(ResourcePool* pool) {
   unique_lock<mutex> l(lock_);
   DCHECK(pools_.find(pool) != pools_.end());
   pools_.erase(pool);
+  if (pool->numa_node_ >= 0) --num_numa_node_pools_[pool->numa_node_];
+  // The pool should have released its threads, but don't let any leaked threads count
+  // against the system forever.
+  __sync_fetch_and_add(&num_threads_in_use_, -pool->num_threads());
   free_pool_objs_.push_back(pool);
   UpdatePoolQuotas();
 }
@@ -129,10 +154,42 @@ void ThreadResourceMgr::ResourcePool::InvokeCallbacks() {
   }
 }
 
+double ThreadResourceMgr::GetRequestPoolWeight(const string& request_pool) const {
+  PoolWeightMap::const_iterator it = request_pool_weights_.find(request_pool);
+  return it == request_pool_weights_.end() ? 1.0 : it->second;
+}
+
 void ThreadResourceMgr::UpdatePoolQuotas(ResourcePool* new_pool) {
   if (pools_.empty()) return;
-  per_pool_quota_ =
-      ceil(static_cast<double>(system_threads_quota_) / pools_.size());
+  // The number of pools of each query of each request pool.  Pools without a query
+  // are queries of their own and are only counted in 'num_anonymous_queries'.
+  typedef unordered_map<string, int> QueryPoolCounts;
+  unordered_map<string, QueryPoolCounts> request_pools;
+  unordered_map<string, int> num_anonymous_queries;
+  for (ResourcePool* pool: pools_) {
+    QueryPoolCounts* queries = &request_pools[pool->request_pool_];
+    if (pool->query_key_.empty()) {
+      ++num_anonymous_queries[pool->request_pool_];
+    } else {
+      ++(*queries)[pool->query_key_];
+    }
+  }
+  double total_weight = 0;
+  for (const auto& request_pool: request_pools) {
+    total_weight += GetRequestPoolWeight(request_pool.first);
+  }
+
+  for (ResourcePool* pool: pools_) {
+    const QueryPoolCounts& queries = request_pools[pool->request_pool_];
+    int num_queries = queries.size() + num_anonymous_queries[pool->request_pool_];
+    int num_query_pools =
+        pool->query_key_.empty() ? 1 : queries.find(pool->query_key_)->second;
+    // The share of the request pool, split evenly between its queries and the query's
+    // share split evenly between its pools.
+    double share = system_threads_quota_ * GetRequestPoolWeight(pool->request_pool_)
+        / (total_weight * num_queries * num_query_pools);
+    pool->fair_quota_ = max(1, static_cast<int>(ceil(share)));
+  }
   // Only invoke callbacks on pool unregistration.
   if (new_pool == NULL) {
     for (Pools::iterator it = pools_.begin(); it != pools_.end(); ++it) {
@@ -141,3 +198,22 @@ void ThreadResourceMgr::UpdatePoolQuotas(ResourcePool* new_pool) {
     }
   }
 }
+
+void ThreadResourceMgr::LendIdleThreads(ResourcePool* releasing_pool) {
+  // Don't wait for the lock. It is held to register or unregister pools, which
+  // notifies the pools anyway, or by another releasing thread that lends the same idle
+  // threads. A missed notification only delays the borrowing until the next release.
+  unique_lock<mutex> l(lock_, boost::try_to_lock);
+  if (!l.owns_lock()) return;
+  vector<ResourcePool*> borrowers;
+  for (ResourcePool* pool: pools_) {
+    if (pool != releasing_pool && pool->num_callbacks_ > 0) borrowers.push_back(pool);
+  }
+  sort(borrowers.begin(), borrowers.end(), [](ResourcePool* lhs, ResourcePool* rhs) {
+    return lhs->num_threads() * rhs->quota() < rhs->num_threads() * lhs->quota();
+  });
+  for (ResourcePool* pool: borrowers) {
+    if (num_idle_threads() == 0) break;
+    pool->InvokeCallbacks();
+  }
+}
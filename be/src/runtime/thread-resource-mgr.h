@@ -22,8 +22,12 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <list>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "common/status.h"
 
@@ -34,8 +38,12 @@ namespace impala {
 /// query fragments.  If there is only one fragment running, it can use the
 /// entire pool, spinning up the maximum number of threads to saturate the
 /// hardware.  If there are multiple fragments, the CPU pool must be shared
-/// between them.  Currently, the total system pool is split evenly between
-/// all consumers.  Each consumer gets ceil(total_system_threads / num_consumers).
+/// between them.  The total system pool is split by fair share of a hierarchy: the
+/// request pools with running fragments share it in proportion to their weights in
+/// --admission_pool_weights, the queries of a request pool share its part evenly and
+/// the fragments of a query share the query's part evenly.  Each fragment's quota is
+/// the ceil of its share of the system threads.  Without weights and with one
+/// fragment per query, this is ceil(total_system_threads / num_consumers).
 //
 /// Each fragment must register with the ThreadResourceMgr to request threads
 /// (in the form of tokens).  The fragment has required threads (it can't run
@@ -43,21 +51,28 @@ namespace impala {
 /// own, it will be able to spin up more optional threads.  When the system
 /// is under load, the ThreadResourceMgr will stop giving out tokens for optional
 /// threads.
+/// The sharing is work conserving: a pool that is at its quota can still borrow
+/// optional threads, up to its max quota, while the system as a whole has idle
+/// threads, e.g. because the other pools are waiting for I/O or for their inputs.
+/// Borrowed threads are given back as soon as the system is oversubscribed, i.e. when
+/// the other pools use the threads of their quota again: optional_exceeded() then
+/// returns true for the pools over their quota, so a new or higher-weight query
+/// preempts the optional threads of the others without having to wait for them.
+/// Released threads that the releasing pool doesn't use are offered to the other
+/// pools, the pools furthest below their quota first.
 /// Pools should not use this for threads that are almost always idle (e.g.
 /// periodic reporting threads).
 /// Pools will temporarily go over the quota regularly and this is very
 /// much by design.  For example, if a pool is running on its own with
 /// 4 required threads and 28 optional and another pool is added to the
 /// system, the first pool's quota is then cut by half (16 total) and will
-/// over time drop the optional threads.
+/// over time drop the optional threads once the new pool uses its share.
 /// This class is thread safe.
 /// TODO: this is an initial simple version to improve the behavior with
 /// concurrency.  This will need to be expanded post GA.  These include:
 ///  - More places where threads are optional (e.g. hash table build side,
 ///    data stream threads, etc).
-///  - Admission control
 ///  - Integration with other nodes/statestore
-///  - Priorities for different pools
 /// If both the mgr and pool locks need to be taken, the mgr lock must
 /// be taken first.
 class ThreadResourceMgr {
@@ -74,12 +89,10 @@ class ThreadResourceMgr {
   /// variable semantics).
   typedef boost::function<void (ResourcePool*)> ThreadAvailableCb;
 
-  /// Pool abstraction for a single resource pool.
-  /// TODO: this is not quite sufficient going forward.  We need a hierarchy of pools,
-  /// one for the entire query, and a sub pool for each component that needs threads,
-  /// all of which share a quota.  Currently, the way state is tracked here, it would
-  /// be impossible to have two components both want optional threads (e.g. two things
-  /// that have 1+ thread usage).
+  /// Pool abstraction for the threads of a single fragment instance.
+  /// TODO: the components of a fragment that need threads still share the pool through
+  /// its callbacks and reserved tokens, so it is impossible to have two components
+  /// both want optional threads (e.g. two things that have 1+ thread usage).
   class ResourcePool {
    public:
     /// Acquire a thread for the pool.  This will always succeed; the
@@ -89,7 +102,8 @@ class ThreadResourceMgr {
     void AcquireThreadToken();
 
     /// Try to acquire a thread for this pool.  If the pool is at
-    /// the quota, this will return false and the pool should not run.
+    /// the quota and the system has no idle threads to borrow, or the pool is at its
+    /// max quota, this will return false and the pool should not run.
     /// Pools should use this API for resources they can use but don't
     /// need (e.g. scanner threads).
     bool TryAcquireThreadToken(bool* is_reserved = NULL);
@@ -137,26 +151,42 @@ class ThreadResourceMgr {
 
     int num_reserved_optional_threads() { return num_reserved_optional_threads_; }
 
-    /// Returns true if the number of optional threads has now exceeded the quota.
+    /// Returns true if the number of optional threads has now exceeded the quota and
+    /// the pool should give back an optional thread.  Borrowed threads may be kept
+    /// while the system isn't oversubscribed, unless the pool is above its max quota.
     bool optional_exceeded() {
       // Cache this so optional/required are computed based on the same value.
       volatile int64_t num_threads = num_threads_;
       int64_t optional_threads = num_threads >> 32;
       int64_t required_threads = num_threads & 0xFFFFFFFF;
-      return optional_threads > num_reserved_optional_threads_ &&
-             optional_threads + required_threads > quota();
+      if (optional_threads <= num_reserved_optional_threads_) return false;
+      if (optional_threads + required_threads > max_quota_) return true;
+      return optional_threads + required_threads > quota() &&
+          parent_->num_threads_in_use_ > parent_->system_threads_quota_;
     }
 
-    /// Returns the number of optional threads that can still be used.
+    /// Returns the number of optional threads that can still be used, including the
+    /// idle threads of the system that this pool can borrow.
     int num_available_threads() const {
-      int value = std::max(quota() - static_cast<int>(num_threads()),
+      int num_threads = this->num_threads();
+      int value = std::max(quota() - num_threads,
           num_reserved_optional_threads_ - num_optional_threads());
-      return std::max(0, value);
+      int num_borrowable =
+          std::min(parent_->num_idle_threads(), max_quota_ - num_threads);
+      return std::max(0, std::max(value, num_borrowable));
     }
 
-    /// Returns the quota for this pool.  Note this changes dynamically
-    /// based on system load.
-    int quota() const { return std::min(max_quota_, parent_->per_pool_quota_); }
+    /// Returns the quota for this pool, i.e. its fair share of the system threads.
+    /// Note this changes dynamically based on system load.
+    int quota() const { return std::min(max_quota_, fair_quota_); }
+
+    /// Returns the NUMA node that the threads of this pool should run on, or -1 if they
+    /// aren't pinned to a node.  See --numa_pin_fragments.
+    int numa_node() const { return numa_node_; }
+
+    /// Returns the request pool and the query that this pool was registered for.
+    const std::string& request_pool() const { return request_pool_; }
+    const std::string& query_key() const { return query_key_; }
 
     /// Sets the max thread quota for this pool.
     /// The actual quota is the min of this value and the dynamic value.
@@ -173,8 +203,23 @@ class ThreadResourceMgr {
     /// Invoke registered callbacks in round-robin manner until the quota is exhausted.
     void InvokeCallbacks();
 
+    /// Tries to borrow an idle thread of the system for an optional thread beyond the
+    /// quota.  Returns false if the pool is at its max quota or the system has no idle
+    /// threads.
+    bool TryBorrowThread(int64_t new_num_threads);
+
     ThreadResourceMgr* parent_;
 
+    /// The request pool and query of the fragment, which determine its share.
+    std::string request_pool_;
+    std::string query_key_;
+
+    /// The fair share of the system threads, set by the mgr's UpdatePoolQuotas().
+    int fair_quota_;
+
+    /// The NUMA node of the pool's threads or -1. Set on registration.
+    int numa_node_;
+
     int max_quota_;
     int num_reserved_optional_threads_;
 
@@ -208,9 +253,13 @@ class ThreadResourceMgr {
 
   int system_threads_quota() const { return system_threads_quota_; }
 
-  /// Register a new pool with the thread mgr.  Registering a pool
-  /// will update the quotas for all existing pools.
-  ResourcePool* RegisterPool();
+  /// Register a new pool with the thread mgr for a fragment instance of query
+  /// 'query_key' in request pool 'request_pool'.  Registering a pool will update the
+  /// quotas for all existing pools.  Pools with an empty 'query_key' are treated as
+  /// queries of their own.  If --numa_pin_fragments is true, the pool is assigned to
+  /// the NUMA node with the fewest pools.
+  ResourcePool* RegisterPool(const std::string& request_pool = "",
+      const std::string& query_key = "");
 
   /// Unregisters the pool.  'pool' is no longer valid after this.
   /// This updates the quotas for the remaining pools.
@@ -220,6 +269,15 @@ class ThreadResourceMgr {
   /// 'Optimal' number of threads for the entire process.
   int system_threads_quota_;
 
+  /// The total number of thread tokens held by all pools.  Updated atomically without
+  /// taking lock_.
+  int64_t num_threads_in_use_;
+
+  /// The weights of the request pools, parsed from --admission_pool_weights.  Request
+  /// pools that aren't listed have a weight of 1.
+  typedef boost::unordered_map<std::string, double> PoolWeightMap;
+  PoolWeightMap request_pool_weights_;
+
   /// Lock for the entire object.  Protects all fields below.
   boost::mutex lock_;
 
@@ -227,21 +285,35 @@ class ThreadResourceMgr {
   typedef std::set<ResourcePool*> Pools;
   Pools pools_;
 
-  /// Each pool currently gets the same share.  This is the ceil of the
-  /// system quota divided by the number of pools.
-  int per_pool_quota_;
-
   /// Recycled list of pool objects
   std::list<ResourcePool*> free_pool_objs_;
 
-  /// Updates the per pool quota and notifies any pools that now have
+  /// The number of registered pools pinned to each NUMA node, if pools are pinned.
+  std::vector<int> num_numa_node_pools_;
+
+  /// Returns the number of threads of the system that no pool uses.
+  int num_idle_threads() const {
+    return std::max<int64_t>(0, system_threads_quota_ - num_threads_in_use_);
+  }
+
+  /// Returns the weight of 'request_pool' in request_pool_weights_.
+  double GetRequestPoolWeight(const std::string& request_pool) const;
+
+  /// Updates the fair quotas of all pools and notifies any pools that now have
   /// more threads they can use.  Must be called with lock_ taken.
   /// If new_pool is non-null, new_pool will *not* be notified.
   void UpdatePoolQuotas(ResourcePool* new_pool = NULL);
+
+  /// Offers the idle threads of the system to the pools other than 'releasing_pool'
+  /// by invoking their callbacks, the pools with the lowest fraction of their quota
+  /// in use first.  Called after 'releasing_pool' released a thread that it didn't use
+  /// again.
+  void LendIdleThreads(ResourcePool* releasing_pool);
 };
 
 inline void ThreadResourceMgr::ResourcePool::AcquireThreadToken() {
   __sync_fetch_and_add(&num_threads_, 1);
+  __sync_fetch_and_add(&parent_->num_threads_in_use_, 1);
 }
 
 inline bool ThreadResourceMgr::ResourcePool::TryAcquireThreadToken(bool* is_reserved) {
@@ -249,19 +321,35 @@ inline bool ThreadResourceMgr::ResourcePool::TryAcquireThreadToken(bool* is_rese
     int64_t previous_num_threads = num_threads_;
     int64_t new_optional_threads = (previous_num_threads >> 32) + 1;
     int64_t new_required_threads = previous_num_threads & 0xFFFFFFFF;
-    if (new_optional_threads > num_reserved_optional_threads_ &&
-        new_optional_threads + new_required_threads > quota()) {
+    bool thread_is_reserved = new_optional_threads <= num_reserved_optional_threads_;
+    bool is_borrowed = !thread_is_reserved &&
+        new_optional_threads + new_required_threads > quota();
+    if (is_borrowed && !TryBorrowThread(new_optional_threads + new_required_threads)) {
       return false;
     }
-    bool thread_is_reserved = new_optional_threads <= num_reserved_optional_threads_;
     int64_t new_value = new_optional_threads << 32 | new_required_threads;
     // Atomically swap the new value if no one updated num_threads_.  We do not
     // not care about the ABA problem here.
     if (__sync_bool_compare_and_swap(&num_threads_, previous_num_threads, new_value)) {
+      // Borrowed threads were already added to the system's threads in use.
+      if (!is_borrowed) __sync_fetch_and_add(&parent_->num_threads_in_use_, 1);
       if (is_reserved != NULL) *is_reserved = thread_is_reserved;
       return true;
     }
+    if (is_borrowed) __sync_fetch_and_add(&parent_->num_threads_in_use_, -1);
+  }
+}
+
+inline bool ThreadResourceMgr::ResourcePool::TryBorrowThread(int64_t new_num_threads) {
+  if (new_num_threads > max_quota_) return false;
+  // Reserve the idle thread first so that concurrent borrowers can't oversubscribe
+  // the system.
+  if (__sync_add_and_fetch(&parent_->num_threads_in_use_, 1)
+      > parent_->system_threads_quota_) {
+    __sync_fetch_and_add(&parent_->num_threads_in_use_, -1);
+    return false;
   }
+  return true;
 }
 
 inline void ThreadResourceMgr::ResourcePool::ReleaseThreadToken(bool required) {
@@ -280,7 +368,10 @@ inline void ThreadResourceMgr::ResourcePool::ReleaseThreadToken(bool required) {
       }
     }
   }
+  __sync_fetch_and_add(&parent_->num_threads_in_use_, -1);
   InvokeCallbacks();
+  // Lend the thread to the other pools if this pool doesn't use it again.
+  if (parent_->num_idle_threads() > 0) parent_->LendIdleThreads(this);
 }
 
 } // namespace impala
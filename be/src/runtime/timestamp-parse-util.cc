@@ -25,7 +25,6 @@
 namespace assign = boost::assign;
 using boost::unordered_map;
 using boost::gregorian::date;
-using boost::gregorian::date_duration;
 using boost::posix_time::hours;
 using boost::posix_time::not_a_date_time;
 using boost::posix_time::time_duration;
@@ -57,6 +56,77 @@ struct DateTimeParseResult {
 
 bool TimestampParser::initialized_ = false;
 
+/// The day numbers of the first and last dates that boost::gregorian::date supports,
+/// 1400-01-01 and 9999-12-31.
+static const int32_t MIN_DAY_NUMBER = 2232400;
+static const int32_t MAX_DAY_NUMBER = 5373484;
+
+static inline bool IsLeapYear(int year) {
+  return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+
+/// Sets 'day_number' to the day number of the date 'year'-'month'-'day' plus
+/// 'day_offset' days, which is the representation of boost::gregorian::date (the Julian
+/// day number). Returns false if the date is not valid or not supported by boost. This
+/// avoids the exceptions and repeated range checks of boost's date constructor.
+static inline bool GetDayNumber(int year, int month, int day, int day_offset,
+    int32_t* day_number) {
+  static const int DAYS_IN_MONTH[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  if (UNLIKELY(year < 1400 || year > 9999 || month < 1 || month > 12 || day < 1)) {
+    return false;
+  }
+  if (UNLIKELY(day > DAYS_IN_MONTH[month - 1])) {
+    if (month != 2 || day != 29 || !IsLeapYear(year)) return false;
+  }
+  // Same as boost::gregorian::gregorian_calendar::day_number(). The year starts in
+  // March, so that the leap day is the last day of the year.
+  int a = (14 - month) / 12;
+  int y = year + 4800 - a;
+  int m = month + 12 * a - 3;
+  *day_number = day + (153 * m + 2) / 5 + 365 * y + y / 4 - y / 100 + y / 400 - 32045
+      + day_offset;
+  return *day_number >= MIN_DAY_NUMBER && *day_number <= MAX_DAY_NUMBER;
+}
+
+/// Returns the eight characters starting at 'str' as a word, the first one in the
+/// lowest byte.
+static inline uint64_t LoadWord(const char* str) {
+  uint64_t word;
+  memcpy(&word, str, sizeof(word));
+  return word;
+}
+
+/// Returns true if all bytes of 'word' that are set in 'mask' are ASCII digits. The
+/// digits are checked eight at a time: after subtracting '0' (by the xor, as the digits
+/// are 0x30 - 0x39) a digit byte is at most 9, and adding 0x76 to any larger byte sets
+/// its high bit. Carries out of a byte only happen if that byte already failed.
+static inline bool AllDigits(uint64_t word, uint64_t mask) {
+  uint64_t val = (word ^ 0x3030303030303030ULL) & mask;
+  return (((val + 0x7676767676767676ULL) | val) & 0x8080808080808080ULL & mask) == 0;
+}
+
+/// Returns the value of the two digits at 'str'.
+static inline int ParseTwoDigits(const char* str) {
+  return (str[0] - '0') * 10 + str[1] - '0';
+}
+
+/// Writes 'val' to 'buff', zero-padded to at least 'min_width' digits, the same as
+/// sprintf("%0*d"), and returns the number of characters written. 'val' must not be
+/// negative.
+static inline int FormatPaddedInt(int32_t val, int min_width, char* buff) {
+  DCHECK_GE(val, 0);
+  char digits[10];
+  int num_digits = 0;
+  do {
+    digits[num_digits++] = '0' + val % 10;
+    val /= 10;
+  } while (val > 0);
+  int len = 0;
+  while (len < min_width - num_digits) buff[len++] = '0';
+  while (num_digits > 0) buff[len++] = digits[--num_digits];
+  return len;
+}
+
 /// Lazily initialized pseudo-constant hashmap for mapping month names to an index.
 static unordered_map<StringValue, int> REV_MONTH_INDEX;
 
@@ -234,6 +304,7 @@ bool TimestampParser::Parse(const char* str, int len, boost::gregorian::date* d,
   if (LIKELY(len >= DEFAULT_TIME_FMT_LEN)) {
     // This string starts with a date component
     if (str[4] == '-') {
+      if (LIKELY(ParseDefaultDateTime(str, len, d, t))) return true;
       switch (len) {
         case DEFAULT_DATE_FMT_LEN: {
           dt_ctx = &DEFAULT_DATE_CTX;
@@ -292,6 +363,55 @@ bool TimestampParser::Parse(const char* str, int len, boost::gregorian::date* d,
   }
 }
 
+bool TimestampParser::ParseDefaultDateTime(const char* str, int len, date* d,
+    time_duration* t) {
+  DCHECK_LE(len, DEFAULT_DATE_TIME_FMT_LEN);
+  if (len != DEFAULT_DATE_FMT_LEN && len < DEFAULT_SHORT_DATE_TIME_FMT_LEN) return false;
+  // The digits of yyyy-MM are the bytes 0 - 3, 5 and 6 of the first word and the digits
+  // of dd the bytes 6 and 7 of the word at 'str' + 2. The bytes 4 and 7 of the first
+  // word must be '-'.
+  uint64_t date_word = LoadWord(str);
+  if (!AllDigits(date_word, 0x00FFFF00FFFFFFFFULL) ||
+      !AllDigits(LoadWord(str + 2), 0xFFFF000000000000ULL) ||
+      (date_word & 0xFF0000FF00000000ULL) != 0x2D00002D00000000ULL) {
+    return false;
+  }
+  int year = ParseTwoDigits(str) * 100 + ParseTwoDigits(str + 2);
+  int month = ParseTwoDigits(str + 5);
+  int day = ParseTwoDigits(str + 8);
+  int hour = 0;
+  int minute = 0;
+  int second = 0;
+  int32_t fraction = 0;
+  if (len > DEFAULT_DATE_FMT_LEN) {
+    if (str[10] != ' ' && str[10] != 'T') return false;
+    // The digits of HH:mm:ss are the bytes 0, 1, 3, 4, 6 and 7 of the word at 'str' + 11
+    // and the bytes 2 and 5 must be ':'.
+    uint64_t time_word = LoadWord(str + 11);
+    if (!AllDigits(time_word, 0xFFFF00FFFF00FFFFULL) ||
+        (time_word & 0x0000FF0000FF0000ULL) != 0x00003A00003A0000ULL) {
+      return false;
+    }
+    hour = ParseTwoDigits(str + 11);
+    minute = ParseTwoDigits(str + 14);
+    second = ParseTwoDigits(str + 17);
+    if (hour > 23 || minute > 59 || second > 59) return false;
+    if (len > DEFAULT_SHORT_DATE_TIME_FMT_LEN) {
+      if (str[DEFAULT_SHORT_DATE_TIME_FMT_LEN] != '.') return false;
+      for (int i = DEFAULT_SHORT_DATE_TIME_FMT_LEN + 1; i < len; ++i) {
+        if (str[i] < '0' || str[i] > '9') return false;
+        fraction = fraction * 10 + str[i] - '0';
+      }
+      for (int i = len; i < DEFAULT_DATE_TIME_FMT_LEN; ++i) fraction *= 10;
+    }
+  }
+  int32_t day_number;
+  if (!GetDayNumber(year, month, day, 0, &day_number)) return false;
+  *d = date(day_number);
+  *t = time_duration(hour, minute, second, fraction);
+  return true;
+}
+
 bool TimestampParser::Parse(const char* str, int len, const DateTimeFormatContext& dt_ctx,
     date* d, time_duration* t) {
   DCHECK(TimestampParser::initialized_);
@@ -321,31 +441,17 @@ bool TimestampParser::Parse(const char* str, int len, const DateTimeFormatContex
     *t = time_duration(0, 0, 0, 0);
   }
   if (dt_ctx.has_date_toks) {
-    bool is_valid_date = true;
-    try {
-      DCHECK(-1 <= day_offset && day_offset <= 1);
-      if ((dt_result.year == 1400 && dt_result.month == 1 && dt_result.day == 1 &&
-           day_offset == -1) ||
-          (dt_result.year == 9999 && dt_result.month == 12 && dt_result.day == 31 &&
-           day_offset == 1)) {
-        // Have to check lower/upper bound explicitly.
-        // Tried date::is_not_a_date_time() but it doesn't complain value is out of range
-        // for "'1400-01-01' - 1 day" and "'9999-12-31' + 1 day".
-        is_valid_date = false;
-      } else {
-        *d = date(dt_result.year, dt_result.month, dt_result.day);
-        *d += date_duration(day_offset);
-      }
-    } catch (boost::exception& e) {
-      is_valid_date = false;
-    }
-    if (!is_valid_date) {
+    DCHECK(-1 <= day_offset && day_offset <= 1);
+    int32_t day_number;
+    if (UNLIKELY(!GetDayNumber(dt_result.year, dt_result.month, dt_result.day,
+            day_offset, &day_number))) {
       VLOG_ROW << "Invalid date: " << dt_result.year << "-" << dt_result.month << "-"
                << dt_result.day;
       *d = date();
       *t = time_duration(not_a_date_time);
       return false;
     }
+    *d = date(day_number);
   } else {
     *d = date();
   }
@@ -361,6 +467,9 @@ int TimestampParser::Format(const DateTimeFormatContext& dt_ctx,
   DCHECK(buff != NULL);
   if (dt_ctx.has_date_toks && d.is_special()) return -1;
   if (dt_ctx.has_time_toks && t.is_special()) return -1;
+  // Only split the date into its fields once.
+  date::ymd_type ymd(1400, 1, 1);
+  if (dt_ctx.has_date_toks) ymd = d.year_month_day();
   char* str = buff;
   for (const DateTimeFormatToken& tok: dt_ctx.toks) {
     int32_t num_val = -1;
@@ -368,17 +477,17 @@ int TimestampParser::Format(const DateTimeFormatContext& dt_ctx,
     int str_val_len = 0;
     switch (tok.type) {
       case YEAR: {
-        num_val = d.year();
+        num_val = ymd.year;
         if (tok.len <= 3) num_val %= 100;
         break;
       }
-      case MONTH_IN_YEAR: num_val = d.month().as_number(); break;
+      case MONTH_IN_YEAR: num_val = ymd.month.as_number(); break;
       case MONTH_IN_YEAR_SLT: {
-        str_val = d.month().as_short_string();
+        str_val = ymd.month.as_short_string();
         str_val_len = 3;
         break;
       }
-      case DAY_IN_MONTH: num_val = d.day(); break;
+      case DAY_IN_MONTH: num_val = ymd.day; break;
       case HOUR_IN_DAY: num_val = t.hours(); break;
       case MINUTE_IN_HOUR: num_val = t.minutes(); break;
       case SECOND_IN_MINUTE: num_val = t.seconds(); break;
@@ -398,7 +507,7 @@ int TimestampParser::Format(const DateTimeFormatContext& dt_ctx,
       default: DCHECK(false) << "Unknown date/time format token";
     }
     if (num_val > -1) {
-      str += sprintf(str, "%0*d", tok.len, num_val);
+      str += FormatPaddedInt(num_val, tok.len, str);
     } else {
       memcpy(str, str_val, str_val_len);
       str += str_val_len;
@@ -409,6 +518,35 @@ int TimestampParser::Format(const DateTimeFormatContext& dt_ctx,
   return str - buff;
 }
 
+int TimestampParser::FormatDefault(const date& d, const time_duration& t, char* buff) {
+  char* str = buff;
+  if (!d.is_special()) {
+    date::ymd_type ymd = d.year_month_day();
+    str += FormatPaddedInt(ymd.year, 4, str);
+    *str++ = '-';
+    str += FormatPaddedInt(ymd.month.as_number(), 2, str);
+    *str++ = '-';
+    str += FormatPaddedInt(ymd.day, 2, str);
+  }
+  if (!t.is_special()) {
+    DCHECK(!t.is_negative());
+    DCHECK_LT(t.hours(), 100);
+    if (!d.is_special()) *str++ = ' ';
+    str += FormatPaddedInt(t.hours(), 2, str);
+    *str++ = ':';
+    str += FormatPaddedInt(t.minutes(), 2, str);
+    *str++ = ':';
+    str += FormatPaddedInt(t.seconds(), 2, str);
+    int32_t fraction = t.fractional_seconds();
+    if (fraction > 0) {
+      *str++ = '.';
+      str += FormatPaddedInt(fraction, 9, str);
+    }
+  }
+  DCHECK_LE(str - buff, MAX_DEFAULT_FMT_OUT_LEN);
+  return str - buff;
+}
+
 bool TimestampParser::ParseDateTime(const char* str, int str_len,
     const DateTimeFormatContext& dt_ctx, DateTimeParseResult* dt_result) {
   DCHECK(dt_ctx.fmt_len > 0);
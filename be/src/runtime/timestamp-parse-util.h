@@ -201,7 +201,30 @@ class TimestampParser {
       const boost::gregorian::date& d, const boost::posix_time::time_duration& t,
       int len, char* buff);
 
+  /// The maximum number of characters written by FormatDefault().
+  static const int MAX_DEFAULT_FMT_OUT_LEN = 32;
+
+  /// Format the date/time values in the default format yyyy-MM-dd HH:mm:ss, followed by
+  /// the nine digits of the fractional seconds if they are not zero. Only the date or the
+  /// time is formatted if the other one is not valid, and nothing if neither is, the same
+  /// as TimestampValue::DebugString(). No string terminator is appended.
+  /// d -- the date value
+  /// t -- the time value (must be less than 100 hours)
+  /// buff -- the output buffer (must hold at least MAX_DEFAULT_FMT_OUT_LEN characters)
+  /// Return the number of characters copied in to the buffer.
+  static int FormatDefault(const boost::gregorian::date& d,
+      const boost::posix_time::time_duration& t, char* buff);
+
  private:
+  /// Parses a yyyy-MM-dd or yyyy-MM-dd[ T]HH:mm:ss[.SSSSSSSSS] string without going
+  /// through the default format contexts. Only accepts strings that consist of digits
+  /// and separators at their exact positions and that hold a valid date/time, and
+  /// returns false otherwise, in which case the string must be parsed by the format
+  /// context which also reports the error (or accepts e.g. whitespace inside fields).
+  /// 'len' must be at most DEFAULT_DATE_TIME_FMT_LEN.
+  static bool ParseDefaultDateTime(const char* str, int len, boost::gregorian::date* d,
+      boost::posix_time::time_duration* t);
+
   static bool ParseDateTime(const char* str, int str_len,
       const DateTimeFormatContext& dt_ctx, DateTimeParseResult* dt_result);
 
@@ -623,6 +623,47 @@ TEST(TimestampTest, Basic) {
 
 }
 
+// Tests the strings in the default format that are parsed and printed without the
+// format contexts, and their fallbacks.
+TEST(TimestampTest, DefaultFormat) {
+  const char* VALID_VALS[] = { "2012-02-29", "2012-02-29 23:59:59",
+      "2012-02-29T00:00:00.1", "1400-01-01 00:00:00.000000001", "9999-12-31" };
+  const char* EXPECTED_VALS[] = { "2012-02-29 00:00:00", "2012-02-29 23:59:59",
+      "2012-02-29 00:00:00.100000000", "1400-01-01 00:00:00.000000001",
+      "9999-12-31 00:00:00" };
+  for (int i = 0; i < sizeof(VALID_VALS) / sizeof(char*); ++i) {
+    TimestampValue tv(VALID_VALS[i], strlen(VALID_VALS[i]));
+    EXPECT_TRUE(tv.HasDateAndTime()) << VALID_VALS[i];
+    EXPECT_EQ(EXPECTED_VALS[i], tv.DebugString());
+  }
+  // Invalid dates and times, and digits outside of the date/time fields.
+  const char* INVALID_VALS[] = { "2011-02-29", "1900-02-29", "2012-04-31",
+      "2012-00-10", "1399-12-31", "2012-01-20 24:00:00", "2012-01-20 10:60:00",
+      "2012-01-20 10:10:60", "2012-01-2a", "2012-01-20 10:1a:10",
+      "2012-01-20 10:10:10.12a", "2012-01-20 10-10-10", "2012-01-20X10:10:10" };
+  for (int i = 0; i < sizeof(INVALID_VALS) / sizeof(char*); ++i) {
+    TimestampValue tv(INVALID_VALS[i], strlen(INVALID_VALS[i]));
+    EXPECT_FALSE(tv.HasDateOrTime()) << INVALID_VALS[i];
+    EXPECT_EQ("", tv.DebugString());
+  }
+  // Strings that aren't in the default format but are accepted by the format contexts.
+  char s1[] = "2012-01-20  1:10:01";
+  TimestampValue v1(s1, strlen(s1));
+  EXPECT_EQ("2012-01-20 01:10:01", v1.DebugString());
+  char s2[] = "2012-01-20 01:10:01-08:00";
+  TimestampValue v2(s2, strlen(s2));
+  EXPECT_EQ("2012-01-20 01:10:01", v2.DebugString());
+  // The day offset of the timezone is applied to the date.
+  DateTimeFormatContext dt_ctx("yyyy-MM-dd HH:mm:ss+hh:mm", 25);
+  ASSERT_TRUE(TimestampParser::ParseFormatTokens(&dt_ctx));
+  char s3[] = "2012-03-01 01:10:01+02:00";
+  TimestampValue v3(s3, strlen(s3), dt_ctx);
+  EXPECT_EQ("2012-02-29 23:10:01", v3.DebugString());
+  char s4[] = "1400-01-01 01:10:01+02:00";
+  TimestampValue v4(s4, strlen(s4), dt_ctx);
+  EXPECT_FALSE(v4.HasDate());
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   impala::InitCommonRuntime(argc, argv, false);
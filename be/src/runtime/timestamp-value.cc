@@ -119,15 +119,9 @@ ptime TimestampValue::UnixTimeToPtime(time_t unix_time) const {
 }
 
 string TimestampValue::DebugString() const {
-  stringstream ss;
-  if (HasDate()) {
-    ss << boost::gregorian::to_iso_extended_string(date_);
-  }
-  if (HasTime()) {
-    if (HasDate()) ss << " ";
-    ss << boost::posix_time::to_simple_string(time_);
-  }
-  return ss.str();
+  char buff[TimestampParser::MAX_DEFAULT_FMT_OUT_LEN];
+  int len = TimestampParser::FormatDefault(date_, time_, buff);
+  return string(buff, len);
 }
 
 }
@@ -197,6 +197,55 @@ TEST_F(TmpFileMgrTest, TestReportError) {
   CheckMetrics(&tmp_file_mgr);
 }
 
+/// Test that the write load and throughput of devices is reflected in the estimated
+/// write times used for placement.
+TEST_F(TmpFileMgrTest, TestDeviceLoad) {
+  vector<string> tmp_dirs;
+  tmp_dirs.push_back("/tmp/tmp-file-mgr-test.1");
+  tmp_dirs.push_back("/tmp/tmp-file-mgr-test.2");
+  for (int i = 0; i < tmp_dirs.size(); ++i) {
+    EXPECT_TRUE(FileSystemUtil::RemoveAndCreateDirectory(tmp_dirs[i]).ok());
+  }
+  TmpFileMgr tmp_file_mgr;
+  tmp_file_mgr.InitCustom(tmp_dirs, false, metrics_.get());
+  vector<TmpFileMgr::DeviceId> devices = tmp_file_mgr.active_tmp_devices();
+  ASSERT_EQ(2, devices.size());
+  TUniqueId id;
+  TmpFileMgr::File* fast_file;
+  TmpFileMgr::File* slow_file;
+  EXPECT_TRUE(tmp_file_mgr.GetFile(devices[0], id, &fast_file).ok());
+  EXPECT_TRUE(tmp_file_mgr.GetFile(devices[1], id, &slow_file).ok());
+  EXPECT_EQ(devices[0], fast_file->device_id());
+
+  // Without measurements, the estimates only depend on the queued bytes.
+  const int64_t len = 1024;
+  EXPECT_EQ(tmp_file_mgr.EstimatedWriteNs(devices[0], len),
+      tmp_file_mgr.EstimatedWriteNs(devices[1], len));
+  int64_t bytes_ahead = fast_file->WriteIssued(len);
+  EXPECT_EQ(0, bytes_ahead);
+  EXPECT_GT(tmp_file_mgr.EstimatedWriteNs(devices[0], len),
+      tmp_file_mgr.EstimatedWriteNs(devices[1], len));
+  fast_file->WriteComplete(len, bytes_ahead, len, true);
+  EXPECT_EQ(len, tmp_file_mgr.bytes_written(devices[0]));
+
+  // The second device is ten times slower, so it should only be preferred once the
+  // first has ten times as many bytes queued.
+  bytes_ahead = slow_file->WriteIssued(len);
+  slow_file->WriteComplete(len, bytes_ahead, 10 * len, true);
+  EXPECT_LT(tmp_file_mgr.EstimatedWriteNs(devices[0], len),
+      tmp_file_mgr.EstimatedWriteNs(devices[1], len));
+  for (int i = 0; i < 10; ++i) fast_file->WriteIssued(len);
+  EXPECT_GT(tmp_file_mgr.EstimatedWriteNs(devices[0], len),
+      tmp_file_mgr.EstimatedWriteNs(devices[1], len));
+
+  // Failed writes are not counted.
+  for (int i = 0; i < 10; ++i) fast_file->WriteComplete(len, 0, len, false);
+  EXPECT_EQ(len, tmp_file_mgr.bytes_written(devices[0]));
+  EXPECT_EQ(len, tmp_file_mgr.bytes_written(devices[1]));
+  FileSystemUtil::RemovePaths(tmp_dirs);
+  CheckMetrics(&tmp_file_mgr);
+}
+
 TEST_F(TmpFileMgrTest, TestAllocateFails) {
   string tmp_dir("/tmp/tmp-file-mgr-test.1");
   string scratch_subdir = tmp_dir + "/impala-scratch";
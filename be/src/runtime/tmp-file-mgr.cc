@@ -25,6 +25,7 @@
 #include "util/debug-util.h"
 #include "util/disk-info.h"
 #include "util/filesystem-util.h"
+#include "util/histogram-metric.h"
 
 #include "common/names.h"
 
@@ -46,13 +47,22 @@ namespace impala {
 const string TMP_SUB_DIR_NAME = "impala-scratch";
 const uint64_t AVAILABLE_SPACE_THRESHOLD_MB = 1024;
 
+// Weight of a new sample in the moving average of a device's write throughput.
+const double WRITE_THROUGHPUT_SAMPLE_WEIGHT = 0.2;
+
 // Metric keys
 const string TMP_FILE_MGR_ACTIVE_SCRATCH_DIRS = "tmp-file-mgr.active-scratch-dirs";
 const string TMP_FILE_MGR_ACTIVE_SCRATCH_DIRS_LIST =
     "tmp-file-mgr.active-scratch-dirs.list";
+const string TMP_FILE_MGR_SCRATCH_WRITE_LATENCIES =
+    "tmp-file-mgr.scratch-write-latencies-ns";
+
+// The highest latency that the histogram of scratch write latencies tracks.
+const int64_t MAX_SCRATCH_WRITE_LATENCY_NS = 10L * 60L * 1000L * 1000L * 1000L;
 
 TmpFileMgr::TmpFileMgr() : initialized_(false), dir_status_lock_(), tmp_dirs_(),
-  num_active_scratch_dirs_metric_(NULL), active_scratch_dirs_metric_(NULL) {}
+  num_active_scratch_dirs_metric_(NULL), active_scratch_dirs_metric_(NULL),
+  scratch_write_latencies_metric_(NULL) {}
 
 Status TmpFileMgr::Init(MetricGroup* metrics) {
   string tmp_dirs_spec = FLAGS_scratch_dirs;
@@ -122,6 +132,9 @@ Status TmpFileMgr::InitCustom(const vector<string>& tmp_dirs, bool one_dir_per_d
   for (int i = 0; i < tmp_dirs_.size(); ++i) {
     active_scratch_dirs_metric_->Add(tmp_dirs_[i].path());
   }
+  scratch_write_latencies_metric_ = metrics->RegisterMetric(new HistogramMetric(
+      MakeTMetricDef(TMP_FILE_MGR_SCRATCH_WRITE_LATENCIES, TMetricKind::HISTOGRAM,
+      TUnit::TIME_NS), MAX_SCRATCH_WRITE_LATENCY_NS, 2));
 
   initialized_ = true;
 
@@ -160,6 +173,35 @@ string TmpFileMgr::GetTmpDirPath(DeviceId device_id) const {
   return tmp_dirs_[device_id].path();
 }
 
+double TmpFileMgr::EstimatedWriteNs(DeviceId device_id, int64_t len) {
+  DCHECK(initialized_);
+  DCHECK(device_id >= 0 && device_id < tmp_dirs_.size());
+  lock_guard<SpinLock> l(dir_status_lock_);
+  double ns_per_byte = tmp_dirs_[device_id].write_ns_per_byte_;
+  if (ns_per_byte == 0) {
+    // Not measured yet: assume the speed of the fastest measured device, or a uniform
+    // speed if there are no measurements, so that placement falls back to balancing
+    // the queued bytes.
+    ns_per_byte = 1;
+    bool found = false;
+    for (int i = 0; i < tmp_dirs_.size(); ++i) {
+      double other = tmp_dirs_[i].write_ns_per_byte_;
+      if (other > 0 && (!found || other < ns_per_byte)) {
+        ns_per_byte = other;
+        found = true;
+      }
+    }
+  }
+  return (tmp_dirs_[device_id].queued_bytes_ + len) * ns_per_byte;
+}
+
+int64_t TmpFileMgr::bytes_written(DeviceId device_id) {
+  DCHECK(initialized_);
+  DCHECK(device_id >= 0 && device_id < tmp_dirs_.size());
+  lock_guard<SpinLock> l(dir_status_lock_);
+  return tmp_dirs_[device_id].bytes_written_;
+}
+
 void TmpFileMgr::BlacklistDevice(DeviceId device_id) {
   DCHECK(initialized_);
   DCHECK(device_id >= 0 && device_id < tmp_dirs_.size());
@@ -248,6 +290,37 @@ void TmpFileMgr::File::ReportIOError(const ErrorMsg& msg) {
   // mgr_->BlacklistDevice(device_id_);
 }
 
+int64_t TmpFileMgr::File::WriteIssued(int64_t len) {
+  lock_guard<SpinLock> l(mgr_->dir_status_lock_);
+  Dir* dir = &mgr_->tmp_dirs_[device_id_];
+  int64_t bytes_ahead = dir->queued_bytes_;
+  dir->queued_bytes_ += len;
+  return bytes_ahead;
+}
+
+void TmpFileMgr::File::WriteComplete(int64_t len, int64_t bytes_ahead,
+    int64_t elapsed_ns, bool success) {
+  lock_guard<SpinLock> l(mgr_->dir_status_lock_);
+  Dir* dir = &mgr_->tmp_dirs_[device_id_];
+  dir->queued_bytes_ -= len;
+  DCHECK_GE(dir->queued_bytes_, 0);
+  if (!success) return;
+  dir->bytes_written_ += len;
+  if (elapsed_ns <= 0) return;
+  if (mgr_->scratch_write_latencies_metric_ != NULL) {
+    mgr_->scratch_write_latencies_metric_->Update(elapsed_ns);
+  }
+  // The write waited for the 'bytes_ahead' bytes queued before it, so the elapsed time
+  // is the time the device took to write all of them.
+  double sample = static_cast<double>(elapsed_ns) / (bytes_ahead + len);
+  if (dir->write_ns_per_byte_ == 0) {
+    dir->write_ns_per_byte_ = sample;
+  } else {
+    dir->write_ns_per_byte_ += WRITE_THROUGHPUT_SAMPLE_WEIGHT *
+        (sample - dir->write_ns_per_byte_);
+  }
+}
+
 Status TmpFileMgr::File::Remove() {
   if (current_size_ > 0) FileSystemUtil::RemovePaths(vector<string>(1, path_));
   return Status::OK();
@@ -22,11 +22,19 @@
 
 namespace impala {
 
+class HistogramMetric;
+
 /// TmpFileMgr creates and manages temporary files and directories on the local
 /// filesystem. It can manage multiple temporary directories across multiple devices.
 /// TmpFileMgr ensures that at most one directory per device is used unless overridden
 /// for testing. GetFile() returns a File handle with a unique filename on a device. The
 /// client owns the File handle and can use it to expand the file.
+///
+/// TmpFileMgr also tracks the write load of each device: the bytes queued for writing
+/// and an estimate of the device's write throughput, measured from completed writes.
+/// Clients striping data across several devices use EstimatedWriteNs() to place each
+/// write on the device that will complete it soonest, so that faster devices (e.g. SSDs
+/// next to HDDs) receive a proportionally larger share of the data.
 /// TODO: we could notify block managers about the failure so they can more take
 /// proactive action to avoid using the device.
 class TmpFileMgr {
@@ -51,11 +59,24 @@ class TmpFileMgr {
     /// Called to notify TmpFileMgr that an IO error was encountered for this file
     void ReportIOError(const ErrorMsg& msg);
 
+    /// Called when a write of 'len' bytes to this file is issued. Returns the number of
+    /// bytes that were already queued for writing on the file's device, which must be
+    /// passed to the matching WriteComplete() call.
+    int64_t WriteIssued(int64_t len);
+
+    /// Called when a write issued by WriteIssued() finishes, 'elapsed_ns' after it was
+    /// issued. 'bytes_ahead' is the value returned by WriteIssued(). Updates the load
+    /// and throughput estimate of the device. 'success' is false if the write failed,
+    /// in which case the throughput estimate is not updated.
+    void WriteComplete(int64_t len, int64_t bytes_ahead, int64_t elapsed_ns,
+        bool success);
+
     /// Delete the physical file on disk, if one was created.
     /// It is not valid to read or write to a file after calling Remove().
     Status Remove();
 
     const std::string& path() const { return path_; }
+    DeviceId device_id() const { return device_id_; }
     int disk_id() const { return disk_id_; }
     bool is_blacklisted() const { return blacklisted_; }
 
@@ -116,6 +137,15 @@ class TmpFileMgr {
   /// Return the scratch directory path for the device.
   std::string GetTmpDirPath(DeviceId device_id) const;
 
+  /// Returns the estimated time, in nanoseconds, until a write of 'len' bytes issued
+  /// now to the device would complete, given the bytes already queued on it and its
+  /// measured write throughput. Devices that have not completed a write yet are assumed
+  /// to be as fast as the fastest measured device.
+  double EstimatedWriteNs(DeviceId device_id, int64_t len);
+
+  /// Returns the total number of bytes successfully written to the device.
+  int64_t bytes_written(DeviceId device_id);
+
   /// Total number of devices with tmp directories that are active. There is one tmp
   /// directory per device.
   int num_active_tmp_devices();
@@ -143,11 +173,22 @@ class TmpFileMgr {
 
     /// path should be a absolute path to a writable scratch directory.
     Dir(const std::string& path, bool blacklisted)
-        : path_(path), blacklisted_(blacklisted) {}
+        : path_(path), blacklisted_(blacklisted), queued_bytes_(0), bytes_written_(0),
+          write_ns_per_byte_(0) {}
 
     std::string path_;
 
     bool blacklisted_;
+
+    /// Bytes of issued writes to this directory that have not completed yet.
+    int64_t queued_bytes_;
+
+    /// Total bytes successfully written to this directory.
+    int64_t bytes_written_;
+
+    /// Moving average of the time it takes the device to write one byte, or 0 if no
+    /// write has completed yet.
+    double write_ns_per_byte_;
   };
 
   /// Remove a device from the rotation. Subsequent attempts to allocate a file on that
@@ -158,7 +199,7 @@ class TmpFileMgr {
 
   bool initialized_;
 
-  /// Protects the status of tmp dirs (i.e. whether they're blacklisted).
+  /// Protects the status of tmp dirs (i.e. whether they're blacklisted) and their load.
   SpinLock dir_status_lock_;
 
   /// The created tmp directories.
@@ -167,6 +208,10 @@ class TmpFileMgr {
   /// Metrics to track active scratch directories.
   IntGauge* num_active_scratch_dirs_metric_;
   SetMetric<std::string>* active_scratch_dirs_metric_;
+
+  /// Latencies of the completed writes to scratch files, including the time they
+  /// waited for the writes queued before them.
+  HistogramMetric* scratch_write_latencies_metric_;
 };
 
 }
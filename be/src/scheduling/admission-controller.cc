@@ -24,6 +24,9 @@
 #include "runtime/exec-env.h"
 #include "runtime/mem-tracker.h"
 #include "util/debug-util.h"
+#include "util/hash-util.h"
+#include "util/parse-util.h"
+#include "util/string-parser.h"
 #include "util/time.h"
 #include "util/runtime-profile.h"
 #include "util/pretty-printer.h"
@@ -34,6 +37,17 @@ using namespace strings;
 
 DEFINE_int64(queue_wait_timeout_ms, 60 * 1000, "Maximum amount of time (in "
     "milliseconds) that a request will wait to be admitted before timing out.");
+DEFINE_string(admission_pool_weights, "", "(Advanced) comma-separated list of "
+    "<pool name>:<weight> pairs, e.g. 'root.etl:4,root.adhoc:1'. When requests are "
+    "queued in several pools, the queued requests are admitted by weighted fair share "
+    "of the pools' resources, so pools with a higher weight are admitted first. Pools "
+    "that are not listed have a weight of 1. The weights also divide the CPU between "
+    "the pools' running queries.");
+DEFINE_bool(admission_mem_estimate_feedback, false, "(Advanced) If true, the per-host "
+    "memory estimates from planning that are used for admission are corrected by the "
+    "ratio of the peak memory to the estimate of earlier runs of queries with the same "
+    "fingerprint, i.e. the same statement text apart from literals. Has no effect on "
+    "queries that are admitted with a memory limit.");
 
 namespace impala {
 
@@ -47,6 +61,17 @@ int64_t GetProcMemLimit() {
 }
 
 const string AdmissionController::IMPALA_REQUEST_QUEUE_TOPIC("impala-request-queue");
+const string AdmissionController::IMPALA_HOST_MEM_LIMITS_TOPIC("impala-host-mem-limits");
+
+// The bounds and the weight of the latest run of the corrections of the memory
+// estimates, and the headroom added to the observed peak memory.
+const double MIN_MEM_ESTIMATE_CORRECTION = 0.1;
+const double MAX_MEM_ESTIMATE_CORRECTION = 10;
+const double MEM_ESTIMATE_CORRECTION_WEIGHT = 0.5;
+const double MEM_ESTIMATE_PEAK_HEADROOM = 1.25;
+
+// The maximum number of fingerprints in mem_estimate_corrections_.
+const int MAX_MEM_ESTIMATE_CORRECTIONS = 10000;
 
 // Delimiter used for topic keys of the form "<pool_name><delimiter><backend_id>".
 // "!" is used because the backend id contains a colon, but it should not contain "!".
@@ -201,7 +226,9 @@ AdmissionController::AdmissionController(RequestPoolService* request_pool_servic
       metrics_group_(metrics),
       host_id_(TNetworkAddressToString(host_addr)),
       thrift_serializer_(false),
+      host_mem_limit_sent_(false),
       done_(false) {
+  ParseUtil::ParsePoolWeights(FLAGS_admission_pool_weights, &pool_weights_);
   dequeue_thread_.reset(new Thread("scheduling", "admission-thread",
         &AdmissionController::DequeueLoop, this));
 }
@@ -226,6 +253,13 @@ Status AdmissionController::Init(StatestoreSubscriber* subscriber) {
   Status status = subscriber->AddTopic(IMPALA_REQUEST_QUEUE_TOPIC, true, cb);
   if (!status.ok()) {
     status.AddDetail("AdmissionController failed to register request queue topic");
+    return status;
+  }
+  StatestoreSubscriber::UpdateCallback mem_limits_cb =
+    bind<void>(mem_fn(&AdmissionController::UpdateHostMemLimits), this, _1, _2);
+  status = subscriber->AddTopic(IMPALA_HOST_MEM_LIMITS_TOPIC, true, mem_limits_cb);
+  if (!status.ok()) {
+    status.AddDetail("AdmissionController failed to register host mem limits topic");
   }
   return status;
 }
@@ -288,6 +322,20 @@ void AdmissionController::PoolStats::Dequeue(const QuerySchedule& schedule,
   }
 }
 
+double AdmissionController::PoolStats::ResourceShare(const TPoolConfig& pool_cfg) const {
+  if (pool_cfg.max_mem_resources <= 0 && pool_cfg.max_requests <= 0) {
+    return agg_num_running_;
+  }
+  double share = 0;
+  if (pool_cfg.max_mem_resources > 0) {
+    share = static_cast<double>(EffectiveMemReserved()) / pool_cfg.max_mem_resources;
+  }
+  if (pool_cfg.max_requests > 0) {
+    share = max(share, static_cast<double>(agg_num_running_) / pool_cfg.max_requests);
+  }
+  return share;
+}
+
 void AdmissionController::UpdateHostMemAdmitted(const QuerySchedule& schedule,
     int64_t per_node_mem) {
   const unordered_set<TNetworkAddress>& hosts = schedule.unique_hosts();
@@ -330,9 +378,9 @@ bool AdmissionController::HasAvailableMemResources(const QuerySchedule& schedule
   }
 
   // Case 2:
-  int64_t proc_mem_limit = GetProcMemLimit();
   for (const TNetworkAddress& host: schedule.unique_hosts()) {
     const string host_id = TNetworkAddressToString(host);
+    int64_t proc_mem_limit = GetHostMemLimit(host_id);
     int64_t mem_reserved = host_mem_reserved_[host_id];
     int64_t mem_admitted = host_mem_admitted_[host_id];
     VLOG_ROW << "Checking memory on host=" << host_id
@@ -391,9 +439,10 @@ Status AdmissionController::RejectImmediately(QuerySchedule* schedule,
     reject_reason = Substitute(REASON_REQ_OVER_POOL_MEM, PrintBytes(cluster_mem_needed),
         PrintBytes(pool_cfg.max_mem_resources));
   } else if (pool_cfg.max_mem_resources > 0 &&
-      schedule->GetPerHostMemoryEstimate() >= GetProcMemLimit()) {
+      schedule->GetPerHostMemoryEstimate() >= GetMinHostMemLimit(*schedule)) {
     reject_reason = Substitute(REASON_REQ_OVER_NODE_MEM,
-        PrintBytes(schedule->GetPerHostMemoryEstimate()), PrintBytes(GetProcMemLimit()));
+        PrintBytes(schedule->GetPerHostMemoryEstimate()),
+        PrintBytes(GetMinHostMemLimit(*schedule)));
   } else if (stats->agg_num_queued() >= pool_cfg.max_queued) {
     reject_reason = Substitute(REASON_QUEUE_FULL, pool_cfg.max_queued,
         stats->agg_num_queued());
@@ -429,6 +478,10 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
   ScopedEvent completedEvent(schedule->query_events(), QUERY_EVENT_COMPLETED_ADMISSION);
   {
     lock_guard<mutex> lock(admission_ctrl_lock_);
+    // The estimate must not change until the query is released.
+    if (FLAGS_admission_mem_estimate_feedback && schedule->UsesPlannerMemoryEstimate()) {
+      ApplyMemEstimateCorrection(schedule);
+    }
     RequestQueue* queue = &request_queue_map_[pool_name];
     pool_config_map_[pool_name] = pool_cfg;
     PoolStats* stats = GetPoolStats(pool_name);
@@ -529,6 +582,10 @@ Status AdmissionController::ReleaseQuery(QuerySchedule* schedule) {
     PoolStats* stats = GetPoolStats(pool_name);
     stats->Release(*schedule);
     UpdateHostMemAdmitted(*schedule, -schedule->GetPerHostMemoryEstimate());
+    if (FLAGS_admission_mem_estimate_feedback && schedule->UsesPlannerMemoryEstimate() &&
+        schedule->peak_per_host_mem() > 0) {
+      UpdateMemEstimateCorrection(*schedule);
+    }
     pools_for_updates_.insert(pool_name);
     VLOG_RPC << "Released query id=" << schedule->query_id() << " "
              << stats->DebugString();
@@ -537,6 +594,11 @@ Status AdmissionController::ReleaseQuery(QuerySchedule* schedule) {
   return Status::OK();
 }
 
+void AdmissionController::GetHostMemReserved(HostMemMap* host_mem_reserved) {
+  lock_guard<mutex> lock(admission_ctrl_lock_);
+  *host_mem_reserved = host_mem_reserved_;
+}
+
 // Statestore subscriber callback for IMPALA_REQUEST_QUEUE_TOPIC.
 void AdmissionController::UpdatePoolStats(
     const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
@@ -566,6 +628,117 @@ void AdmissionController::UpdatePoolStats(
   dequeue_cv_.notify_one(); // Dequeue and admit queries on the dequeue thread
 }
 
+// Statestore subscriber callback for IMPALA_HOST_MEM_LIMITS_TOPIC.
+void AdmissionController::UpdateHostMemLimits(
+    const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
+    vector<TTopicDelta>* subscriber_topic_updates) {
+  {
+    lock_guard<mutex> lock(admission_ctrl_lock_);
+    StatestoreSubscriber::TopicDeltaMap::const_iterator topic =
+        incoming_topic_deltas.find(IMPALA_HOST_MEM_LIMITS_TOPIC);
+    if (topic != incoming_topic_deltas.end()) {
+      const TTopicDelta& delta = topic->second;
+      // A full update, e.g. after the statestore restarted, may not contain the entry
+      // of this host, so it is sent again.
+      if (!delta.is_delta) {
+        host_mem_limits_.clear();
+        host_mem_limit_sent_ = false;
+      }
+      for (const TTopicItem& item: delta.topic_entries) {
+        StringParser::ParseResult result;
+        int64_t mem_limit = StringParser::StringToInt<int64_t>(
+            item.value.data(), item.value.size(), &result);
+        if (result != StringParser::PARSE_SUCCESS) {
+          VLOG_QUERY << "Error parsing host mem limit with key: " << item.key;
+          continue;
+        }
+        host_mem_limits_[item.key] = mem_limit;
+      }
+      for (const string& host_id: delta.topic_deletions) host_mem_limits_.erase(host_id);
+    }
+    if (!host_mem_limit_sent_) {
+      subscriber_topic_updates->push_back(TTopicDelta());
+      TTopicDelta& topic_delta = subscriber_topic_updates->back();
+      topic_delta.topic_name = IMPALA_HOST_MEM_LIMITS_TOPIC;
+      topic_delta.topic_entries.push_back(TTopicItem());
+      topic_delta.topic_entries.back().key = host_id_;
+      topic_delta.topic_entries.back().value = Substitute("$0", GetProcMemLimit());
+      host_mem_limit_sent_ = true;
+    }
+  }
+  // A larger limit of a remote host may allow queued requests to be admitted.
+  dequeue_cv_.notify_one();
+}
+
+int64_t AdmissionController::GetHostMemLimit(const string& host_id) const {
+  if (host_id == host_id_) return GetProcMemLimit();
+  HostMemMap::const_iterator it = host_mem_limits_.find(host_id);
+  // Hosts that didn't send their limit yet are assumed to have the local limit.
+  return it == host_mem_limits_.end() ? GetProcMemLimit() : it->second;
+}
+
+int64_t AdmissionController::GetMinHostMemLimit(const QuerySchedule& schedule) const {
+  int64_t min_limit = GetProcMemLimit();
+  for (const TNetworkAddress& host: schedule.unique_hosts()) {
+    min_limit = min(min_limit, GetHostMemLimit(TNetworkAddressToString(host)));
+  }
+  return min_limit;
+}
+
+// Returns the hash of 'stmt' with its literals replaced by '?', its whitespace collapsed
+// and its letters lower-cased, so that runs of the same query with different constants
+// have the same fingerprint.
+static uint32_t GetQueryFingerprint(const string& stmt) {
+  string normalized;
+  normalized.reserve(stmt.size());
+  for (int i = 0; i < stmt.size(); ++i) {
+    char c = stmt[i];
+    if (c == '\'' || c == '"') {
+      // Skip to the closing quote.
+      for (++i; i < stmt.size() && stmt[i] != c; ++i) {
+        if (stmt[i] == '\\') ++i;
+      }
+      normalized.push_back('?');
+    } else if (isdigit(c) && (normalized.empty() ||
+        !(isalnum(normalized.back()) || normalized.back() == '_'))) {
+      // A number, but not a digit in an identifier.
+      while (i + 1 < stmt.size() && (isalnum(stmt[i + 1]) || stmt[i + 1] == '.')) ++i;
+      normalized.push_back('?');
+    } else if (isspace(c)) {
+      if (!normalized.empty() && normalized.back() != ' ') normalized.push_back(' ');
+    } else {
+      normalized.push_back(tolower(c));
+    }
+  }
+  return HashUtil::Hash(normalized.data(), normalized.size(), 0);
+}
+
+void AdmissionController::ApplyMemEstimateCorrection(QuerySchedule* schedule) {
+  MemEstimateCorrectionMap::const_iterator it = mem_estimate_corrections_.find(
+      GetQueryFingerprint(schedule->request().query_ctx.request.stmt));
+  if (it == mem_estimate_corrections_.end()) return;
+  VLOG_QUERY << "Correcting the memory estimate of query id=" << schedule->query_id()
+             << " by " << it->second;
+  schedule->set_mem_estimate_correction(it->second);
+}
+
+void AdmissionController::UpdateMemEstimateCorrection(const QuerySchedule& schedule) {
+  uint32_t fingerprint = GetQueryFingerprint(schedule.request().query_ctx.request.stmt);
+  double correction = MEM_ESTIMATE_PEAK_HEADROOM * schedule.peak_per_host_mem() /
+      schedule.request().per_host_mem_req;
+  MemEstimateCorrectionMap::iterator it = mem_estimate_corrections_.find(fingerprint);
+  if (it != mem_estimate_corrections_.end()) {
+    correction = MEM_ESTIMATE_CORRECTION_WEIGHT * correction +
+        (1 - MEM_ESTIMATE_CORRECTION_WEIGHT) * it->second;
+  } else if (mem_estimate_corrections_.size() >= MAX_MEM_ESTIMATE_CORRECTIONS) {
+    // Evict an arbitrary fingerprint to bound the memory of the history.
+    mem_estimate_corrections_.erase(mem_estimate_corrections_.begin());
+  }
+  correction = max(MIN_MEM_ESTIMATE_CORRECTION, min(MAX_MEM_ESTIMATE_CORRECTION,
+      correction));
+  mem_estimate_corrections_[fingerprint] = correction;
+}
+
 void AdmissionController::PoolStats::UpdateRemoteStats(const string& host_id,
     TPoolStats* host_stats) {
   DCHECK_NE(host_id, parent_->host_id_); // Shouldn't be updating for local host.
@@ -738,11 +911,26 @@ void AdmissionController::AddPoolUpdates(vector<TTopicDelta>* topic_updates) {
   pools_for_updates_.clear();
 }
 
+double AdmissionController::GetPoolWeight(const string& pool_name) const {
+  PoolWeightMap::const_iterator it = pool_weights_.find(pool_name);
+  return it == pool_weights_.end() ? 1.0 : it->second;
+}
+
+// A pool that the dequeue thread may admit queued requests from in this round.
+struct DequeueCandidate {
+  const string* pool_name;
+  const TPoolConfig* pool_config;
+  double weight;
+  // The number of requests that may still be dequeued from the pool in this round.
+  int64_t max_to_dequeue;
+};
+
 void AdmissionController::DequeueLoop() {
   while (true) {
     unique_lock<mutex> lock(admission_ctrl_lock_);
     if (done_) break;
     dequeue_cv_.wait(lock);
+    vector<DequeueCandidate> candidates;
     for (const PoolConfigMap::value_type& entry: pool_config_map_) {
       const string& pool_name = entry.first;
       const TPoolConfig& pool_config = entry.second;
@@ -783,34 +971,58 @@ void AdmissionController::DequeueLoop() {
       } else {
         max_to_dequeue = stats->agg_num_queued(); // No limit on num running requests
       }
-
-      RequestQueue& queue = request_queue_map_[pool_name];
       VLOG_RPC << "Dequeue thread will try to admit " << max_to_dequeue << " requests"
                << ", pool=" << pool_name << ", num_queued="
                << stats->local_stats().num_queued;
+      DequeueCandidate candidate = { &pool_name, &pool_config,
+          GetPoolWeight(pool_name), max_to_dequeue };
+      candidates.push_back(candidate);
+    }
 
-      while (max_to_dequeue > 0 && !queue.empty()) {
-        QueueNode* queue_node = queue.head();
-        DCHECK(queue_node != NULL);
-        DCHECK(!queue_node->is_admitted.IsSet());
-        const QuerySchedule& schedule = queue_node->schedule;
-        string not_admitted_reason;
-        // TODO: Requests further in the queue may be blocked unnecessarily. Consider a
-        // better policy once we have better test scenarios.
-        if (!CanAdmitRequest(schedule, pool_config, true, &not_admitted_reason)) {
-          VLOG_RPC << "Could not dequeue query id=" << schedule.query_id()
-                   << " reason: " << not_admitted_reason;
-          break;
+    // Admit one request at a time from the candidate with the smallest weighted share
+    // of its resources, until no candidate can admit its next request.
+    while (!candidates.empty()) {
+      int next = -1;
+      double min_share = 0;
+      for (int i = 0; i < candidates.size(); ++i) {
+        double share = GetPoolStats(*candidates[i].pool_name)->ResourceShare(
+            *candidates[i].pool_config) / candidates[i].weight;
+        if (next == -1 || share < min_share) {
+          min_share = share;
+          next = i;
         }
-        VLOG_RPC << "Dequeuing query=" << schedule.query_id();
+      }
+      DequeueCandidate* candidate = &candidates[next];
+      const string& pool_name = *candidate->pool_name;
+      PoolStats* stats = GetPoolStats(pool_name);
+      RequestQueue& queue = request_queue_map_[pool_name];
+      DCHECK(!queue.empty());
+      QueueNode* queue_node = queue.head();
+      DCHECK(queue_node != NULL);
+      DCHECK(!queue_node->is_admitted.IsSet());
+      const QuerySchedule& schedule = queue_node->schedule;
+      string not_admitted_reason;
+      // TODO: Requests further in the queue may be blocked unnecessarily. Consider a
+      // better policy once we have better test scenarios.
+      bool admitted =
+          CanAdmitRequest(schedule, *candidate->pool_config, true, &not_admitted_reason);
+      if (admitted) {
+        VLOG_RPC << "Dequeuing query=" << schedule.query_id() << " from pool="
+                 << pool_name << " with weighted share=" << min_share;
         queue.Dequeue();
         stats->Dequeue(schedule, false);
         stats->Admit(schedule);
         UpdateHostMemAdmitted(schedule, schedule.GetPerHostMemoryEstimate());
         queue_node->is_admitted.Set(true);
-        --max_to_dequeue;
+        --candidate->max_to_dequeue;
+      } else {
+        VLOG_RPC << "Could not dequeue query id=" << schedule.query_id()
+                 << " reason: " << not_admitted_reason;
       }
       pools_for_updates_.insert(pool_name);
+      if (!admitted || candidate->max_to_dequeue == 0 || queue.empty()) {
+        candidates.erase(candidates.begin() + next);
+      }
     }
   }
 }
@@ -85,7 +85,14 @@ class ExecEnv;
 ///     than or equal to the max resources specified.
 ///  2) All participating backends must have enough memory available. Each impalad has a
 ///     per-process mem limit, and that is the max memory that can be reserved on that
-///     backend.
+///     backend. Every impalad sends its limit via the IMPALA_HOST_MEM_LIMITS_TOPIC
+///     topic; the local limit is assumed for hosts whose limit wasn't received yet.
+///
+/// If --admission_mem_estimate_feedback is set, the per-node estimate from planning is
+/// corrected by the ratio of the peak memory (plus some headroom) to the estimate of
+/// earlier runs of queries with the same fingerprint, i.e. the statement with its
+/// literals removed (see UpdateMemEstimateCorrection()). The correction is only learned
+/// by the coordinator that admitted the query, and only from queries that succeeded.
 ///
 /// In order to admit based on these conditions, the admission controller accounts for
 /// the following on both a per-host and per-pool basis:
@@ -159,18 +166,17 @@ class ExecEnv;
 /// admission controller to the total number of requests queued across all admission
 /// controllers (i.e. impalads). This limits the amount of overadmission that may result
 /// from a large amount of resources becoming available at the same time.
-/// When there are requests queued in multiple pools on the same host, the admission
-/// controller simply iterates over the pools in pool_stats_ and attempts to dequeue from
-/// each. This is fine for the max_requests limit, but is unfair for memory-based
-/// admission because the iteration order of pools effectively gives priority to the
-/// queues at the beginning. Requests across queues may be competing for the same
-/// resources on particular hosts, i.e. #2 in the description of memory-based admission
-/// above. Note the pool's max_mem_resources (#1) is not contented.
-/// TODO: Improve the dequeuing policy. IMPALA-2968.
+/// When there are requests queued in multiple pools on the same host, they may compete
+/// for the same resources on particular hosts, i.e. #2 in the description of
+/// memory-based admission above (the pool's max_mem_resources, #1, is not contended).
+/// The dequeuing thread shares these resources between the pools by weighted fair
+/// share: it admits one request at a time from the pool that uses the smallest share of
+/// its configured resources (see PoolStats::ResourceShare()), divided by the pool's
+/// weight from --admission_pool_weights. A pool that can't admit its next request is
+/// skipped until the next round. Pools with a higher weight thus get resources first,
+/// and no pool is starved by the iteration order of the pools.
 ///
-/// TODO: Assumes all impalads have the same proc mem limit. Should send proc mem limit
-///       via statestore (e.g. ideally in TBackendDescriptor) and check per-node
-///       reservations against this value.
+/// TODO: Send the proc mem limit in TBackendDescriptor rather than in its own topic.
 /// TODO: Remove less important debug logging after more cluster testing. Should have a
 ///       better idea of what is perhaps unnecessary.
 class AdmissionController {
@@ -196,12 +202,18 @@ class AdmissionController {
   /// Registers with the subscription manager.
   Status Init(StatestoreSubscriber* subscriber);
 
+  /// Copies the memory reserved on each backend over all pools, keyed by the backend's
+  /// host id (its host:port), into 'host_mem_reserved'. The remote values are the ones
+  /// last received through the statestore.
+  void GetHostMemReserved(boost::unordered_map<std::string, int64_t>* host_mem_reserved);
+
  private:
   class PoolStats;
   friend class PoolStats;
 
-  /// Statestore topic name.
+  /// Statestore topic names.
   static const std::string IMPALA_REQUEST_QUEUE_TOPIC;
+  static const std::string IMPALA_HOST_MEM_LIMITS_TOPIC;
 
   /// Used for user-to-pool resolution and looking up pool configurations. Not owned by
   /// the AdmissionController.
@@ -231,6 +243,20 @@ class AdmissionController {
   HostMemMap host_mem_reserved_;
   HostMemMap host_mem_admitted_;
 
+  /// Map from host id to the process mem limit of that host, received via
+  /// IMPALA_HOST_MEM_LIMITS_TOPIC. Protected by admission_ctrl_lock_.
+  HostMemMap host_mem_limits_;
+
+  /// True if the local process mem limit was sent since the last full update of
+  /// IMPALA_HOST_MEM_LIMITS_TOPIC. Protected by admission_ctrl_lock_.
+  bool host_mem_limit_sent_;
+
+  /// Map from query fingerprint to the factor by which the memory estimates of its
+  /// queries are corrected. Only used with --admission_mem_estimate_feedback and
+  /// bounded in size. Protected by admission_ctrl_lock_.
+  typedef boost::unordered_map<uint32_t, double> MemEstimateCorrectionMap;
+  MemEstimateCorrectionMap mem_estimate_corrections_;
+
   /// Contains all per-pool statistics and metrics. Accessed via GetPoolStats().
   class PoolStats {
    public:
@@ -277,6 +303,11 @@ class AdmissionController {
       return std::max(agg_mem_reserved_, local_mem_admitted_);
     }
 
+    /// Returns the fraction of the pool's max_mem_resources and max_requests in
+    /// 'pool_cfg' that is in use, whichever is larger. If the pool has neither limit,
+    /// returns the number of running queries.
+    double ResourceShare(const TPoolConfig& pool_cfg) const;
+
     /// ADMISSION LIFECYCLE METHODS
     /// The following methods update the pool stats when the request represented by
     /// schedule is admitted, released, queued, or dequeued.
@@ -405,6 +436,12 @@ class AdmissionController {
   /// If true, tear down the dequeuing thread. This only happens in unit tests.
   bool done_;
 
+  /// Map of pool names to their weights in the fair share of the dequeuing thread,
+  /// parsed from --admission_pool_weights. Pools that aren't listed have a weight of 1.
+  /// Not modified after construction.
+  typedef boost::unordered_map<std::string, double> PoolWeightMap;
+  PoolWeightMap pool_weights_;
+
   /// Statestore subscriber callback that sends outgoing topic deltas (see
   /// AddPoolUpdates()) and processes incoming topic deltas, updating the PoolStats
   /// state.
@@ -412,6 +449,28 @@ class AdmissionController {
       const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
       std::vector<TTopicDelta>* subscriber_topic_updates);
 
+  /// Statestore subscriber callback that sends the local process mem limit when it
+  /// wasn't sent yet and processes the limits of the other hosts into host_mem_limits_.
+  void UpdateHostMemLimits(
+      const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
+      std::vector<TTopicDelta>* subscriber_topic_updates);
+
+  /// Returns the process mem limit of 'host_id'. Must hold admission_ctrl_lock_.
+  int64_t GetHostMemLimit(const std::string& host_id) const;
+
+  /// Returns the smallest process mem limit of the hosts in 'schedule'. Must hold
+  /// admission_ctrl_lock_.
+  int64_t GetMinHostMemLimit(const QuerySchedule& schedule) const;
+
+  /// Sets the memory estimate correction of 'schedule' to the one learned for its
+  /// fingerprint, if any. Must hold admission_ctrl_lock_.
+  void ApplyMemEstimateCorrection(QuerySchedule* schedule);
+
+  /// Updates the correction of the fingerprint of 'schedule' with the ratio of its peak
+  /// memory to its estimate from planning, averaged with the earlier runs. Must hold
+  /// admission_ctrl_lock_.
+  void UpdateMemEstimateCorrection(const QuerySchedule& schedule);
+
   /// Adds outgoing topic updates to subscriber_topic_updates for pools that have changed
   /// since the last call to AddPoolUpdates(). Called by UpdatePoolStats() before
   /// UpdateClusterAggregates(). Must hold admission_ctrl_lock_.
@@ -434,6 +493,9 @@ class AdmissionController {
   /// Dequeues and admits queued queries when notified by dequeue_cv_.
   void DequeueLoop();
 
+  /// Returns the weight of 'pool_name' in pool_weights_.
+  double GetPoolWeight(const std::string& pool_name) const;
+
   /// Returns true if schedule can be admitted to the pool with pool_cfg.
   /// admit_from_queue is true if attempting to admit from the queue. Otherwise, returns
   /// false and not_admitted_reason specifies why the request can not be admitted
@@ -65,7 +65,10 @@ QuerySchedule::QuerySchedule(const TUniqueId& query_id,
     query_events_(query_events),
     num_fragment_instances_(0),
     num_scan_ranges_(0),
-    is_admitted_(false) {
+    attempt_(0),
+    is_admitted_(false),
+    mem_estimate_correction_(1.0),
+    peak_per_host_mem_(-1) {
   fragment_exec_params_.resize(request.fragments.size());
   // Build two maps to map node ids to their fragments as well as to the offset in their
   // fragment's plan's nodes list.
@@ -122,7 +125,7 @@ int64_t QuerySchedule::GetPerHostMemoryEstimate() const {
   } else if (has_query_option) {
     per_host_mem = query_option_memory_limit;
   } else if (has_estimate) {
-    per_host_mem = estimate_limit;
+    per_host_mem = estimate_limit * mem_estimate_correction_;
   } else {
     // If no estimate or query option, use the server-side limits anyhow.
     bool ignored;
@@ -135,6 +138,16 @@ int64_t QuerySchedule::GetPerHostMemoryEstimate() const {
   return min(per_host_mem, MemInfo::physical_mem());
 }
 
+bool QuerySchedule::UsesPlannerMemoryEstimate() const {
+  // Follows the precedence of GetPerHostMemoryEstimate().
+  if (query_options_.__isset.rm_initial_mem && query_options_.rm_initial_mem > 0) {
+    return false;
+  }
+  if (FLAGS_rm_always_use_defaults) return false;
+  if (query_options_.__isset.mem_limit && query_options_.mem_limit > 0) return false;
+  return request_.__isset.per_host_mem_req && request_.per_host_mem_req > 0;
+}
+
 int16_t QuerySchedule::GetPerHostVCores() const {
   // Precedence of different estimate sources is:
   // server-side defaults (if rm_always_use_defaults == true) >
@@ -44,6 +44,8 @@ typedef boost::unordered_map<TNetworkAddress, PerNodeScanRanges>
 /// execution parameters for a single fragment; used to assemble the
 /// per-fragment instance TPlanFragmentExecParams;
 /// hosts.size() == instance_ids.size()
+/// A host may appear several times in 'hosts' if more than one instance of the
+/// fragment runs on it (see --non_scan_fragment_instances_per_host).
 struct FragmentExecParams {
   std::vector<TNetworkAddress> hosts; // execution backends
   std::vector<TUniqueId> instance_ids;
@@ -89,8 +91,25 @@ class QuerySchedule {
   /// Gets the estimated memory (bytes) and vcores per-node. Returns the user specified
   /// estimate (MEM_LIMIT query parameter) if provided or the estimate from planning if
   /// available, but is capped at the amount of physical memory to avoid problems if
-  /// either estimate is unreasonably large.
+  /// either estimate is unreasonably large. The estimate from planning is scaled by
+  /// mem_estimate_correction().
   int64_t GetPerHostMemoryEstimate() const;
+
+  /// Returns true if GetPerHostMemoryEstimate() is based on the estimate from planning.
+  bool UsesPlannerMemoryEstimate() const;
+
+  /// The factor by which the admission controller corrects the planner's per-host
+  /// memory estimate, learned from earlier runs of similar queries. Must not change
+  /// once the schedule was submitted for admission.
+  double mem_estimate_correction() const { return mem_estimate_correction_; }
+  void set_mem_estimate_correction(double correction) {
+    mem_estimate_correction_ = correction;
+  }
+
+  /// The highest peak memory usage of the query on any host, set once the query
+  /// completed successfully. -1 if unknown.
+  int64_t peak_per_host_mem() const { return peak_per_host_mem_; }
+  void set_peak_per_host_mem(int64_t peak_mem) { peak_per_host_mem_ = peak_mem; }
   int16_t GetPerHostVCores() const;
   /// Total estimated memory for all nodes. set_num_hosts() must be set before calling.
   int64_t GetClusterMemoryEstimate() const;
@@ -102,6 +121,12 @@ class QuerySchedule {
     num_fragment_instances_ = num_fragment_instances;
   }
   int64_t num_fragment_instances() const { return num_fragment_instances_; }
+
+  /// The number of times the query was executed before with earlier schedules, which
+  /// failed. The instance ids of each attempt are distinct, so that fragments of an
+  /// earlier attempt that are still being cancelled don't interfere with this one.
+  int attempt() const { return attempt_; }
+  void set_attempt(int attempt) { attempt_ = attempt; }
   int64_t num_scan_ranges() const { return num_scan_ranges_; }
 
   /// Map node ids to the index of their fragment in TQueryExecRequest.fragments.
@@ -159,6 +184,9 @@ class QuerySchedule {
   /// Total number of scan ranges of this query.
   int64_t num_scan_ranges_;
 
+  /// See attempt().
+  int attempt_;
+
   /// Request pool to which the request was submitted for admission.
   std::string request_pool_;
 
@@ -171,6 +199,10 @@ class QuerySchedule {
   /// Indicates if the query has been admitted for execution.
   bool is_admitted_;
 
+  /// See mem_estimate_correction() and peak_per_host_mem().
+  double mem_estimate_correction_;
+  int64_t peak_per_host_mem_;
+
   /// Resolves unique_hosts_ to node mgr addresses. Valid only after SetUniqueHosts() has
   /// been called.
   boost::scoped_ptr<ResourceResolver> resource_resolver_;
@@ -65,6 +65,11 @@ class Scheduler {
   /// Releases the reserved resources (if any) from the given schedule.
   virtual Status Release(QuerySchedule* schedule) = 0;
 
+  /// Notifies this scheduler that the backend at 'address' could not be reached by an
+  /// rpc. The backend is not scheduled on until the membership confirms that it is
+  /// still alive or it is removed from the membership.
+  virtual void BlacklistBackend(const TNetworkAddress& address) = 0;
+
   /// Notifies this scheduler that a resource reservation has been preempted by the
   /// central scheduler (Yarn via Llama). All affected queries are cancelled
   /// via their coordinator.
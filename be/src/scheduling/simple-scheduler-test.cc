@@ -21,6 +21,7 @@
 
 #include "common/logging.h"
 #include "simple-scheduler.h"
+#include "util/network-util.h"
 
 #include "common/names.h"
 
@@ -756,6 +757,20 @@ class SchedulerWrapper {
         plan_.query_options(), assignment);
   }
 
+  /// Call SampleScanRanges() for the scan ranges of the plan, whose files are in the
+  /// only partition of a table at 'location'.
+  void Sample(const string& location, double sample_percent,
+      vector<TScanRangeLocations>* sampled) {
+    TTableDescriptor table;
+    THdfsPartition& partition = table.hdfsTable.partitions[0];
+    partition.location.__set_prefix_index(-1);
+    partition.location.__set_suffix(location);
+    partition.__isset.location = true;
+    table.__isset.hdfsTable = true;
+    SimpleScheduler::SampleScanRanges(table, sample_percent,
+        plan_.scan_range_locations(), sampled);
+  }
+
   /// Reset the state of the scheduler by re-creating and initializing it.
   void Reset() { InitializeScheduler(); }
 
@@ -781,6 +796,11 @@ class SchedulerWrapper {
     SendTopicDelta(delta);
   }
 
+  /// Blacklist the backend of a host in the scheduler.
+  void BlacklistBackend(const Host& host) {
+    scheduler_->BlacklistBackend(MakeNetworkAddress(host.ip, host.be_port));
+  }
+
   /// Send a full map of the backends to the scheduler instead of deltas.
   void SendFullMembershipMap() {
     TTopicDelta delta;
@@ -1048,6 +1068,39 @@ TEST_F(SchedulerTest, ManyScanRanges) {
   EXPECT_LE(result.MaxNumAssignedBytesPerHost(), 140 * Block::DEFAULT_BLOCK_SIZE);
 }
 
+/// Sampling keeps about the sampled percentage of the files, and the same files for the
+/// same paths.
+TEST_F(SchedulerTest, SampleScanRanges) {
+  Cluster cluster;
+  cluster.AddHosts(10, true, true);
+
+  Schema schema(cluster);
+  schema.AddMultiBlockTable("T", 1000, ReplicaPlacement::LOCAL_ONLY, 3);
+
+  Plan plan(schema);
+  plan.AddTableScan("T");
+
+  SchedulerWrapper scheduler(plan);
+  vector<TScanRangeLocations> sampled;
+  scheduler.Sample("hdfs://nn/warehouse/t", 10, &sampled);
+  // The probability to sample fewer than 60 or more than 140 of 1000 files is smaller
+  // than 1E-4.
+  EXPECT_GE(sampled.size(), 60);
+  EXPECT_LE(sampled.size(), 140);
+  vector<TScanRangeLocations> resampled;
+  scheduler.Sample("hdfs://nn/warehouse/t", 10, &resampled);
+  ASSERT_EQ(sampled.size(), resampled.size());
+  for (int i = 0; i < sampled.size(); ++i) {
+    EXPECT_EQ(sampled[i].scan_range.hdfs_file_split.file_name,
+        resampled[i].scan_range.hdfs_file_split.file_name);
+  }
+  // Another location samples other files.
+  scheduler.Sample("hdfs://nn/warehouse/u", 10, &resampled);
+  EXPECT_NE(sampled, resampled);
+  scheduler.Sample("hdfs://nn/warehouse/t", 100, &sampled);
+  EXPECT_EQ(1000, sampled.size());
+}
+
 /// Compute a schedule in a split cluster (disjoint set of backends and datanodes).
 TEST_F(SchedulerTest, DisjointClusterWithRemoteReads) {
   Cluster cluster;
@@ -1190,6 +1243,52 @@ TEST_F(SchedulerTest, TestSendUpdates) {
   EXPECT_EQ(0, result.NumDiskAssignedBytes(1));
 }
 
+/// Test that blacklisted backends are not scheduled on until the statestore removes
+/// them from the membership.
+TEST_F(SchedulerTest, TestBlacklistBackend) {
+  Cluster cluster;
+  // The scheduler runs on the first host, which is never blacklisted.
+  cluster.AddHost(true, false);
+  cluster.AddHost(true, true);
+  cluster.AddHost(true, true);
+
+  Schema schema(cluster);
+  schema.AddMultiBlockTable("T1", 10, ReplicaPlacement::LOCAL_ONLY, 2);
+
+  Plan plan(schema);
+  plan.AddTableScan("T1");
+
+  Result result(plan);
+  SchedulerWrapper scheduler(plan);
+
+  scheduler.Compute(&result);
+  EXPECT_EQ(5 * Block::DEFAULT_BLOCK_SIZE, result.NumDiskAssignedBytes(1));
+  EXPECT_EQ(5 * Block::DEFAULT_BLOCK_SIZE, result.NumDiskAssignedBytes(2));
+
+  // The local backend and unknown backends are ignored.
+  scheduler.BlacklistBackend(cluster.hosts()[0]);
+  scheduler.BlacklistBackend(cluster.hosts()[1]);
+  result.Reset();
+  scheduler.Compute(&result);
+  EXPECT_EQ(0, result.NumDiskAssignedBytes(1));
+  EXPECT_EQ(10 * Block::DEFAULT_BLOCK_SIZE, result.NumTotalAssignedBytes(2));
+
+  // Membership updates don't add the backend back.
+  scheduler.SendEmptyUpdate();
+  scheduler.SendFullMembershipMap();
+  result.Reset();
+  scheduler.Compute(&result);
+  EXPECT_EQ(0, result.NumTotalAssignedBytes(1));
+
+  // The statestore confirms the failure and the backend is restarted.
+  scheduler.RemoveBackend(cluster.hosts()[1]);
+  scheduler.AddBackend(cluster.hosts()[1]);
+  result.Reset();
+  scheduler.Compute(&result);
+  EXPECT_EQ(5 * Block::DEFAULT_BLOCK_SIZE, result.NumDiskAssignedBytes(1));
+  EXPECT_EQ(5 * Block::DEFAULT_BLOCK_SIZE, result.NumDiskAssignedBytes(2));
+}
+
 }  // end namespace impala
 
 int main(int argc, char **argv) {
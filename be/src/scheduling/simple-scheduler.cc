@@ -14,6 +14,7 @@
 
 #include "scheduling/simple-scheduler.h"
 
+#include <queue>
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
@@ -24,6 +25,7 @@
 
 #include "common/logging.h"
 #include "util/metrics.h"
+#include "runtime/descriptors.h"
 #include "runtime/exec-env.h"
 #include "runtime/coordinator.h"
 #include "service/impala-server.h"
@@ -37,14 +39,23 @@
 #include "util/container-util.h"
 #include "util/debug-util.h"
 #include "util/error-util.h"
+#include "util/hash-util.h"
 #include "util/llama-util.h"
 #include "util/mem-info.h"
 #include "util/parse-util.h"
+#include "util/stopwatch.h"
+#include "util/string-parser.h"
+#include "util/time.h"
 #include "gen-cpp/ResourceBrokerService_types.h"
 
 #include "common/names.h"
 
+using boost::algorithm::is_any_of;
 using boost::algorithm::join;
+using boost::algorithm::split;
+using boost::algorithm::to_lower_copy;
+using boost::algorithm::token_compress_on;
+using boost::algorithm::trim;
 using namespace apache::thrift;
 using namespace rapidjson;
 using namespace strings;
@@ -56,6 +67,43 @@ DECLARE_int32(rm_default_cpu_vcores);
 DECLARE_string(rm_default_memory);
 
 DEFINE_bool(disable_admission_control, false, "Disables admission control.");
+DEFINE_double(scan_range_load_penalty_ratio, 0, "(Advanced) If greater than 0, scan "
+    "ranges are assigned to replicas as if the host of each replica with a local backend "
+    "had additionally been assigned this many bytes per byte of memory reserved on its "
+    "backends by all running queries, as published through the statestore. This steers "
+    "scans away from loaded hosts. Requires admission control. 0 disables it.");
+DEFINE_bool(balance_remote_scan_ranges, false, "(Advanced) If true, scan ranges that "
+    "are read remotely are assigned to the backend with the fewest remotely read bytes "
+    "assigned so far for the scan, instead of round-robin, so that large ranges don't "
+    "pile up on a few backends.");
+DEFINE_int32(backend_client_warmup_connections, 0, "(Advanced) Number of connections "
+    "that are opened in the background to every backend that joins the cluster, so "
+    "that the first queries don't have to wait for them. 0 disables the warm-up.");
+DEFINE_string(table_sample_percents, "", "(Advanced) Comma-separated list of "
+    "<db>.<table>:<percent> pairs. Scans of these tables only read a sample of this "
+    "percentage of their files, like TABLESAMPLE SYSTEM(<percent>), which speeds up "
+    "exploratory queries over huge tables. The sample is drawn before the scan ranges "
+    "are assigned to backends, so that it is balanced across them.");
+DEFINE_double(compute_stats_sample_percent, 0, "(Advanced) If between 0 and 100, the "
+    "scans of the child queries of COMPUTE STATS only read a sample of this percentage "
+    "of the files of the table, and the row counts, null counts and numbers of distinct "
+    "values are extrapolated from the sample. If 0, the whole table is scanned.");
+DEFINE_int64(table_sample_seed, 0, "(Advanced) Seed of the hash of the file paths that "
+    "decides which files are in the samples of --table_sample_percents and "
+    "--compute_stats_sample_percent. The same files are sampled until it changes.");
+DEFINE_int32(non_scan_fragment_instances_per_host, 1, "(Advanced) Number of instances "
+    "of each partitioned fragment without a scan (e.g. a partitioned join or "
+    "aggregation above an exchange) that are started on each host of its input "
+    "fragment. The instances of a host each run on their own thread and receive an "
+    "equal share of the hash partitions. Values greater than 1 should be combined with "
+    "--datastream_local_exchange so that exchanges between instances of the same host "
+    "don't go through rpcs. Note that the planner's per-host memory estimate assumes "
+    "one instance per fragment and host.");
+DEFINE_int32(backend_blacklist_timeout_s, 30, "(Advanced) The time, in seconds, for "
+    "which a backend that could not be reached by an rpc is not scheduled on, unless the "
+    "statestore removes it from the membership first. Blacklisting avoids scheduling on "
+    "a failed backend in the time the statestore takes to detect its failure. If 0, "
+    "backends are not blacklisted.");
 
 namespace impala {
 
@@ -63,6 +111,15 @@ static const string LOCAL_ASSIGNMENTS_KEY("simple-scheduler.local-assignments.to
 static const string ASSIGNMENTS_KEY("simple-scheduler.assignments.total");
 static const string SCHEDULER_INIT_KEY("simple-scheduler.initialized");
 static const string NUM_BACKENDS_KEY("simple-scheduler.num-backends");
+static const string MEMBERSHIP_UPDATE_TIME_KEY(
+    "simple-scheduler.membership-update-time-s");
+static const string NUM_BLACKLISTED_BACKENDS_KEY(
+    "simple-scheduler.num-blacklisted-backends");
+
+// Number of threads opening warm-up connections, and the maximum number of backends
+// waiting for them.
+static const int WARMUP_NUM_THREADS = 4;
+static const int WARMUP_QUEUE_SIZE = 10000;
 
 static const string BACKENDS_WEB_PAGE = "/backends";
 static const string BACKENDS_TEMPLATE = "backends.tmpl";
@@ -73,7 +130,8 @@ SimpleScheduler::SimpleScheduler(StatestoreSubscriber* subscriber,
     const string& backend_id, const TNetworkAddress& backend_address,
     MetricGroup* metrics, Webserver* webserver, ResourceBroker* resource_broker,
     RequestPoolService* request_pool_service)
-  : metrics_(metrics->GetChildGroup("scheduler")),
+  : backend_config_(new BackendConfig()),
+    metrics_(metrics->GetChildGroup("scheduler")),
     webserver_(webserver),
     statestore_subscriber_(subscriber),
     backend_id_(backend_id),
@@ -81,11 +139,12 @@ SimpleScheduler::SimpleScheduler(StatestoreSubscriber* subscriber,
     total_assignments_(NULL),
     total_local_assignments_(NULL),
     initialised_(NULL),
+    membership_update_time_metric_(NULL),
+    num_blacklisted_backends_metric_(NULL),
     update_count_(0),
     resource_broker_(resource_broker),
     request_pool_service_(request_pool_service) {
   backend_descriptor_.address = backend_address;
-  next_nonlocal_backend_entry_ = backend_map_.begin();
   if (FLAGS_disable_admission_control) LOG(INFO) << "Admission control is disabled.";
   if (!FLAGS_disable_admission_control) {
     admission_controller_.reset(
@@ -124,10 +183,13 @@ SimpleScheduler::SimpleScheduler(const vector<TNetworkAddress>& backends,
     total_assignments_(NULL),
     total_local_assignments_(NULL),
     initialised_(NULL),
+    membership_update_time_metric_(NULL),
+    num_blacklisted_backends_metric_(NULL),
     update_count_(0),
     resource_broker_(resource_broker),
     request_pool_service_(request_pool_service) {
   DCHECK(backends.size() > 0);
+  boost::shared_ptr<BackendConfig> backend_config(new BackendConfig());
   if (FLAGS_disable_admission_control) LOG(INFO) << "Admission control is disabled.";
   // request_pool_service_ may be null in unit tests
   if (request_pool_service_ != NULL && !FLAGS_disable_admission_control) {
@@ -151,23 +213,95 @@ SimpleScheduler::SimpleScheduler(const vector<TNetworkAddress>& backends,
       VLOG(1) << "Only localhost addresses found for " << backends[i].hostname;
     }
 
-    BackendMap::iterator it = backend_map_.find(ipaddr);
-    if (it == backend_map_.end()) {
-      it = backend_map_.insert(
-          make_pair(ipaddr, list<TBackendDescriptor>())).first;
-      backend_ip_map_[backends[i].hostname] = ipaddr;
+    BackendMap::iterator it = backend_config->backend_map.find(ipaddr);
+    if (it == backend_config->backend_map.end()) {
+      it = backend_config->backend_map.insert(
+          make_pair(ipaddr, vector<TBackendDescriptor>())).first;
+      backend_config->backend_ip_map[backends[i].hostname] = ipaddr;
     }
 
     TBackendDescriptor descriptor;
     descriptor.address = MakeNetworkAddress(ipaddr, backends[i].port);
     it->second.push_back(descriptor);
   }
-  next_nonlocal_backend_entry_ = backend_map_.begin();
+  backend_config->BuildBackendIps();
+  backend_config_ = backend_config;
+}
+
+void SimpleScheduler::BackendConfig::BuildBackendIps() {
+  backend_ips.clear();
+  for (const BackendMap::value_type& entry: backend_map) {
+    backend_ips.push_back(entry.first);
+  }
+}
+
+const vector<TBackendDescriptor>* SimpleScheduler::BackendConfig::LookUpBackends(
+    const TNetworkAddress& data_location) const {
+  BackendMap::const_iterator entry = backend_map.find(data_location.hostname);
+  if (entry == backend_map.end()) {
+    // backend_map maps ip address to backend but
+    // data_location.hostname might be a hostname.
+    // Find the ip address of the data_location from backend_ip_map.
+    BackendIpAddressMap::const_iterator itr = backend_ip_map.find(data_location.hostname);
+    if (itr != backend_ip_map.end()) entry = backend_map.find(itr->second);
+  }
+  if (entry == backend_map.end() || entry->second.empty()) return NULL;
+  return &entry->second;
+}
+
+void SimpleScheduler::AddBackend(const TBackendDescriptor& be_desc,
+    BackendConfig* backend_config) {
+  vector<TBackendDescriptor>* be_descs = &backend_config->backend_map[be_desc.ip_address];
+  if (find(be_descs->begin(), be_descs->end(), be_desc) == be_descs->end()) {
+    be_descs->push_back(be_desc);
+  }
+  backend_config->backend_ip_map[be_desc.address.hostname] = be_desc.ip_address;
+}
+
+void SimpleScheduler::RemoveBackend(const TBackendDescriptor& be_desc,
+    BackendConfig* backend_config) {
+  backend_config->backend_ip_map.erase(be_desc.address.hostname);
+  BackendMap::iterator entry = backend_config->backend_map.find(be_desc.ip_address);
+  if (entry == backend_config->backend_map.end()) return;
+  vector<TBackendDescriptor>* be_descs = &entry->second;
+  be_descs->erase(remove(be_descs->begin(), be_descs->end(), be_desc), be_descs->end());
+  if (be_descs->empty()) backend_config->backend_map.erase(entry);
+}
+
+SimpleScheduler::BackendConfigPtr SimpleScheduler::GetBackendConfig() const {
+  lock_guard<SpinLock> l(backend_config_lock_);
+  return backend_config_;
+}
+
+void SimpleScheduler::SetBackendConfig(const BackendConfigPtr& backend_config) {
+  lock_guard<SpinLock> l(backend_config_lock_);
+  backend_config_ = backend_config;
 }
 
 Status SimpleScheduler::Init() {
   LOG(INFO) << "Starting simple scheduler";
 
+  vector<string> table_sample_percents;
+  split(table_sample_percents, FLAGS_table_sample_percents, is_any_of(","),
+      token_compress_on);
+  for (const string& table_sample_percent: table_sample_percents) {
+    vector<string> table_and_percent;
+    split(table_and_percent, table_sample_percent, is_any_of(":"));
+    StringParser::ParseResult result = StringParser::PARSE_FAILURE;
+    double percent = 0;
+    if (table_and_percent.size() == 2) {
+      trim(table_and_percent[1]);
+      percent = StringParser::StringToFloat<double>(table_and_percent[1].c_str(),
+          table_and_percent[1].size(), &result);
+    }
+    if (result != StringParser::PARSE_SUCCESS || percent <= 0 || percent > 100) {
+      return Status(Substitute("Invalid entry of --table_sample_percents: '$0'. Expected "
+          "<db>.<table>:<percent> with a percentage in (0, 100].", table_sample_percent));
+    }
+    trim(table_and_percent[0]);
+    table_sample_percents_[to_lower_copy(table_and_percent[0])] = percent;
+  }
+
   if (webserver_ != NULL) {
     Webserver::UrlCallback backends_callback =
         bind<void>(mem_fn(&SimpleScheduler::BackendsUrlCallback), this, _1, _2);
@@ -186,13 +320,22 @@ Status SimpleScheduler::Init() {
     if (!FLAGS_disable_admission_control) {
       RETURN_IF_ERROR(admission_controller_->Init(statestore_subscriber_));
     }
+    if (FLAGS_backend_client_warmup_connections > 0) {
+      warmup_pool_.reset(new ThreadPool<TNetworkAddress>("scheduler",
+          "backend-client-warmup", WARMUP_NUM_THREADS, WARMUP_QUEUE_SIZE,
+          bind<void>(mem_fn(&SimpleScheduler::WarmUpBackendClients), this, _1, _2)));
+    }
   }
   if (metrics_ != NULL) {
     total_assignments_ = metrics_->AddCounter<int64_t>(ASSIGNMENTS_KEY, 0);
     total_local_assignments_ = metrics_->AddCounter<int64_t>(LOCAL_ASSIGNMENTS_KEY, 0);
     initialised_ = metrics_->AddProperty(SCHEDULER_INIT_KEY, true);
     num_fragment_instances_metric_ = metrics_->AddGauge<int64_t>(
-        NUM_BACKENDS_KEY, backend_map_.size());
+        NUM_BACKENDS_KEY, GetBackendConfig()->backend_map.size());
+    membership_update_time_metric_ =
+        StatsMetric<double>::CreateAndRegister(metrics_, MEMBERSHIP_UPDATE_TIME_KEY);
+    num_blacklisted_backends_metric_ =
+        metrics_->AddGauge<int64_t>(NUM_BLACKLISTED_BACKENDS_KEY, 0);
   }
 
   if (statestore_subscriber_ != NULL) {
@@ -249,78 +392,106 @@ void SimpleScheduler::BackendsUrlCallback(const Webserver::ArgumentMap& args,
   document->AddMember("backends", backends_list, document->GetAllocator());
 }
 
+void SimpleScheduler::WarmUpBackendClients(int thread_id,
+    const TNetworkAddress& address) {
+  ExecEnv* exec_env = ExecEnv::GetInstance();
+  if (exec_env == NULL || exec_env->impalad_client_cache() == NULL) return;
+  Status status = exec_env->impalad_client_cache()->WarmUp(address,
+      FLAGS_backend_client_warmup_connections);
+  if (!status.ok()) {
+    VLOG(1) << "Failed to warm up connections to " << address << ": "
+            << status.GetDetail();
+  }
+}
+
 void SimpleScheduler::UpdateMembership(
     const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
     vector<TTopicDelta>* subscriber_topic_updates) {
   ++update_count_;
-  // TODO: Work on a copy if possible, or at least do resolution as a separate step
   // First look to see if the topic(s) we're interested in have an update
   StatestoreSubscriber::TopicDeltaMap::const_iterator topic =
       incoming_topic_deltas.find(IMPALA_MEMBERSHIP_TOPIC);
 
   if (topic != incoming_topic_deltas.end()) {
+    MonotonicStopWatch sw;
+    sw.Start();
     const TTopicDelta& delta = topic->second;
-
-    // This function needs to handle both delta and non-delta updates. For delta
-    // updates, it is desireable to minimize the number of copies to only
-    // the added/removed items. To accomplish this, all updates are processed
-    // under a lock and applied to the shared backend maps (backend_map_ and
-    // backend_ip_map_) in place.
-    {
-      lock_guard<mutex> lock(backend_map_lock_);
-      bool backend_map_changed = false;
-      if (!delta.is_delta) {
-        backend_map_changed = true;
-        current_membership_.clear();
-        backend_map_.clear();
-        backend_ip_map_.clear();
+    lock_guard<mutex> l(membership_lock_);
+    // Backends that joined with this update, to warm up connections to.
+    vector<TNetworkAddress> new_backends;
+
+    // This function needs to handle both delta and non-delta updates. Only the
+    // added/removed items of a delta are deserialized and applied, to a copy of the
+    // current snapshot that is published once the whole update has been processed.
+    // Scheduling threads keep using the previous snapshot in the meantime. The copy is
+    // only made once the first item changes the membership.
+    boost::shared_ptr<BackendConfig> new_config;
+    if (!delta.is_delta) {
+      current_membership_.clear();
+      new_config.reset(new BackendConfig());
+    }
+    // Process new entries to the topic
+    for (const TTopicItem& item: delta.topic_entries) {
+      TBackendDescriptor be_desc;
+      // Benchmarks have suggested that this method can deserialize
+      // ~10m messages per second, so no immediate need to consider optimisation.
+      uint32_t len = item.value.size();
+      Status status = DeserializeThriftMsg(reinterpret_cast<const uint8_t*>(
+          item.value.data()), &len, false, &be_desc);
+      if (!status.ok()) {
+        VLOG(2) << "Error deserializing membership topic item with key: " << item.key;
+        continue;
+      }
+      if (item.key == backend_id_ && be_desc.address != backend_descriptor_.address) {
+        // Someone else has registered this subscriber ID with a
+        // different address. We will try to re-register
+        // (i.e. overwrite their subscription), but there is likely
+        // a configuration problem.
+        LOG_EVERY_N(WARNING, 30) << "Duplicate subscriber registration from address: "
+                                 << be_desc.address;
       }
 
-      // Process new entries to the topic
-      for (const TTopicItem& item: delta.topic_entries) {
-        TBackendDescriptor be_desc;
-        // Benchmarks have suggested that this method can deserialize
-        // ~10m messages per second, so no immediate need to consider optimisation.
-        uint32_t len = item.value.size();
-        Status status = DeserializeThriftMsg(reinterpret_cast<const uint8_t*>(
-            item.value.data()), &len, false, &be_desc);
-        if (!status.ok()) {
-          VLOG(2) << "Error deserializing membership topic item with key: " << item.key;
-          continue;
-        }
-        if (item.key == backend_id_ && be_desc.address != backend_descriptor_.address) {
-          // Someone else has registered this subscriber ID with a
-          // different address. We will try to re-register
-          // (i.e. overwrite their subscription), but there is likely
-          // a configuration problem.
-          LOG_EVERY_N(WARNING, 30) << "Duplicate subscriber registration from address: "
-                                   << be_desc.address;
-        }
-
-        backend_map_changed = true;
-        list<TBackendDescriptor>* be_descs = &backend_map_[be_desc.ip_address];
-        if (find(be_descs->begin(), be_descs->end(), be_desc) == be_descs->end()) {
-          backend_map_[be_desc.ip_address].push_back(be_desc);
-        }
-        backend_ip_map_[be_desc.address.hostname] = be_desc.ip_address;
-        current_membership_.insert(make_pair(item.key, be_desc));
+      if (warmup_pool_.get() != NULL && item.key != backend_id_
+          && current_membership_.find(item.key) == current_membership_.end()) {
+        new_backends.push_back(be_desc.address);
       }
-      // Process deletions from the topic
-      for (const string& backend_id: delta.topic_deletions) {
-        if (current_membership_.find(backend_id) != current_membership_.end()) {
-          backend_map_changed = true;
-          const TBackendDescriptor& be_desc = current_membership_[backend_id];
-          backend_ip_map_.erase(be_desc.address.hostname);
-          list<TBackendDescriptor>* be_descs = &backend_map_[be_desc.ip_address];
-          be_descs->erase(
-              remove(be_descs->begin(), be_descs->end(), be_desc), be_descs->end());
-          if (be_descs->empty()) backend_map_.erase(be_desc.ip_address);
-          current_membership_.erase(backend_id);
-        }
+      BackendIdMap::iterator known = current_membership_.find(item.key);
+      if (known != current_membership_.end() && known->second == be_desc) continue;
+      if (new_config.get() == NULL) {
+        new_config.reset(new BackendConfig(*GetBackendConfig()));
+      }
+      if (known != current_membership_.end()) {
+        // The backend has registered again with a different descriptor.
+        RemoveBackend(known->second, new_config.get());
+        current_membership_.erase(known);
+      }
+      // Blacklisted backends are added back once their blacklisting expires.
+      if (blacklist_.find(be_desc.address) == blacklist_.end()) {
+        AddBackend(be_desc, new_config.get());
       }
-      // Update invalidated iterator.
-      if (backend_map_changed) next_nonlocal_backend_entry_ = backend_map_.begin();
+      current_membership_.insert(make_pair(item.key, be_desc));
+    }
+    // Process deletions from the topic
+    for (const string& backend_id: delta.topic_deletions) {
+      BackendIdMap::iterator known = current_membership_.find(backend_id);
+      if (known == current_membership_.end()) continue;
+      if (new_config.get() == NULL) {
+        new_config.reset(new BackendConfig(*GetBackendConfig()));
+      }
+      RemoveBackend(known->second, new_config.get());
+      // The statestore confirmed the failure. A backend that registers again at the
+      // same address is a new process.
+      blacklist_.erase(known->second.address);
+      current_membership_.erase(known);
+    }
+    RestoreBlacklistedBackends(&new_config);
+    if (new_config.get() != NULL) {
+      new_config->BuildBackendIps();
+      SetBackendConfig(new_config);
+      // Start the round-robin over for the new set of backends.
+      next_nonlocal_backend_idx_.Store(0);
     }
+    for (const TNetworkAddress& address: new_backends) warmup_pool_->Offer(address);
 
     // If this impalad is not in our view of the membership list, we should add it and
     // tell the statestore.
@@ -353,46 +524,91 @@ void SimpleScheduler::UpdateMembership(
     }
     if (metrics_ != NULL) {
       num_fragment_instances_metric_->set_value(current_membership_.size());
+      num_blacklisted_backends_metric_->set_value(blacklist_.size());
+      membership_update_time_metric_->Update(
+          sw.ElapsedTime() / (1000.0 * 1000.0 * 1000.0));
     }
   }
 }
 
-Status SimpleScheduler::GetBackend(const TNetworkAddress& data_location,
-    TBackendDescriptor* backend) {
-  lock_guard<mutex> lock(backend_map_lock_);
-  if (backend_map_.size() == 0) {
-    return Status("No backends configured");
+void SimpleScheduler::RestoreBlacklistedBackends(
+    boost::shared_ptr<BackendConfig>* new_config) {
+  if (blacklist_.empty()) return;
+  int64_t now = MonotonicMillis();
+  for (BlacklistMap::iterator it = blacklist_.begin(); it != blacklist_.end();) {
+    if (it->second > now) {
+      ++it;
+      continue;
+    }
+    // The membership still has the backend, i.e. the statestore didn't detect a failure.
+    for (const BackendIdMap::value_type& member: current_membership_) {
+      if (member.second.address != it->first) continue;
+      LOG(INFO) << "Scheduling on blacklisted backend " << it->first << " again";
+      if (new_config->get() == NULL) {
+        new_config->reset(new BackendConfig(*GetBackendConfig()));
+      }
+      AddBackend(member.second, new_config->get());
+    }
+    it = blacklist_.erase(it);
   }
-  bool local_assignment = false;
-  BackendMap::iterator entry = backend_map_.find(data_location.hostname);
+}
 
-  if (entry == backend_map_.end()) {
-    // backend_map_ maps ip address to backend but
-    // data_location.hostname might be a hostname.
-    // Find the ip address of the data_location from backend_ip_map_.
-    BackendIpAddressMap::const_iterator itr =
-        backend_ip_map_.find(data_location.hostname);
-    if (itr != backend_ip_map_.end()) {
-      entry = backend_map_.find(itr->second);
+void SimpleScheduler::BlacklistBackend(const TNetworkAddress& address) {
+  if (FLAGS_backend_blacklist_timeout_s <= 0) return;
+  if (address == backend_descriptor_.address) return;
+  lock_guard<mutex> l(membership_lock_);
+  int64_t expiry_ms = MonotonicMillis() + FLAGS_backend_blacklist_timeout_s * 1000L;
+  BlacklistMap::iterator entry = blacklist_.find(address);
+  if (entry != blacklist_.end()) {
+    entry->second = expiry_ms;
+    return;
+  }
+  boost::shared_ptr<BackendConfig> new_config;
+  for (const BackendIdMap::value_type& member: current_membership_) {
+    if (member.second.address != address) continue;
+    if (new_config.get() == NULL) {
+      new_config.reset(new BackendConfig(*GetBackendConfig()));
     }
+    RemoveBackend(member.second, new_config.get());
   }
+  // Unknown backends, e.g. ones that the statestore already removed, are not
+  // scheduled on anyway.
+  if (new_config.get() == NULL) return;
+  LOG(INFO) << "Blacklisting unreachable backend " << address << " for "
+            << FLAGS_backend_blacklist_timeout_s << "s";
+  blacklist_[address] = expiry_ms;
+  new_config->BuildBackendIps();
+  SetBackendConfig(new_config);
+  next_nonlocal_backend_idx_.Store(0);
+  if (num_blacklisted_backends_metric_ != NULL) {
+    num_blacklisted_backends_metric_->set_value(blacklist_.size());
+  }
+}
 
-  if (entry == backend_map_.end()) {
+Status SimpleScheduler::GetBackend(const TNetworkAddress& data_location,
+    TBackendDescriptor* backend) {
+  BackendConfigPtr backend_config = GetBackendConfig();
+  if (backend_config->backend_map.size() == 0) {
+    return Status("No backends configured");
+  }
+  const vector<TBackendDescriptor>* backends =
+      backend_config->LookUpBackends(data_location);
+  bool local_assignment = backends != NULL;
+  if (!local_assignment) {
     // round robin the ipaddress
-    entry = next_nonlocal_backend_entry_;
-    ++next_nonlocal_backend_entry_;
-    if (next_nonlocal_backend_entry_ == backend_map_.end()) {
-      next_nonlocal_backend_entry_ = backend_map_.begin();
-    }
-  } else {
-    local_assignment = true;
+    const vector<string>& ips = backend_config->backend_ips;
+    int64_t idx = (next_nonlocal_backend_idx_.Add(1) - 1) % ips.size();
+    BackendMap::const_iterator entry = backend_config->backend_map.find(ips[idx]);
+    DCHECK(entry != backend_config->backend_map.end());
+    backends = &entry->second;
   }
-  DCHECK(!entry->second.empty());
+  DCHECK(!backends->empty());
   // Round-robin between impalads on the same ipaddress.
-  // Pick the first one, then move it to the back of the queue
-  *backend = entry->second.front();
-  entry->second.pop_front();
-  entry->second.push_back(*backend);
+  if (backends->size() == 1) {
+    *backend = backends->front();
+  } else {
+    *backend = (*backends)[(next_local_backend_idx_.Add(1) - 1) % backends->size()];
+  }
 
   if (metrics_ != NULL) {
     total_assignments_->Increment(1);
@@ -411,9 +627,9 @@ Status SimpleScheduler::GetBackend(const TNetworkAddress& data_location,
 }
 
 void SimpleScheduler::GetAllKnownBackends(BackendList* backends) {
-  lock_guard<mutex> lock(backend_map_lock_);
+  BackendConfigPtr backend_config = GetBackendConfig();
   backends->clear();
-  for (const BackendMap::value_type& backend_list: backend_map_) {
+  for (const BackendMap::value_type& backend_list: backend_config->backend_map) {
     backends->insert(backends->end(), backend_list.second.begin(),
                      backend_list.second.end());
   }
@@ -439,16 +655,104 @@ Status SimpleScheduler::ComputeScanRangeAssignment(const TQueryExecRequest& exec
         node.hdfs_scan_node.__isset.random_replica &&
         node.hdfs_scan_node.random_replica;
 
+    const vector<TScanRangeLocations>* locations = &entry->second;
+    vector<TScanRangeLocations> sampled_locations;
+    const TTableDescriptor* table = NULL;
+    double sample_percent = GetScanSamplePercent(exec_request, node, &table);
+    if (sample_percent < 100) {
+      SampleScanRanges(*table, sample_percent, entry->second, &sampled_locations);
+      VLOG_QUERY << "Sampled " << sampled_locations.size() << " of "
+                 << entry->second.size() << " scan ranges of node " << node_id
+                 << " (" << sample_percent << "% of the files of " << table->dbName
+                 << "." << table->tableName << ")";
+      locations = &sampled_locations;
+    }
+
     FragmentScanRangeAssignment* assignment =
         &(*schedule->exec_params())[fragment_idx].scan_range_assignment;
     RETURN_IF_ERROR(ComputeScanRangeAssignment(
-        node_id, node_replica_preference, node_random_replica, entry->second,
+        node_id, node_replica_preference, node_random_replica, *locations,
         exec_request.host_list, exec_at_coord, schedule->query_options(), assignment));
-    schedule->AddScanRanges(entry->second.size());
+    schedule->AddScanRanges(locations->size());
   }
   return Status::OK();
 }
 
+double SimpleScheduler::GetScanSamplePercent(const TQueryExecRequest& exec_request,
+    const TPlanNode& node, const TTableDescriptor** table) const {
+  if (!node.__isset.hdfs_scan_node || !exec_request.__isset.desc_tbl) return 100;
+  const TDescriptorTable& desc_tbl = exec_request.desc_tbl;
+  *table = NULL;
+  for (const TTupleDescriptor& tuple_desc: desc_tbl.tupleDescriptors) {
+    if (tuple_desc.id != node.hdfs_scan_node.tuple_id || !tuple_desc.__isset.tableId) {
+      continue;
+    }
+    for (const TTableDescriptor& table_desc: desc_tbl.tableDescriptors) {
+      if (table_desc.id == tuple_desc.tableId) *table = &table_desc;
+    }
+  }
+  if (*table == NULL || !(*table)->__isset.hdfsTable) return 100;
+
+  double percent = 100;
+  if (exec_request.query_ctx.__isset.parent_query_id) {
+    if (FLAGS_compute_stats_sample_percent > 0) {
+      percent = FLAGS_compute_stats_sample_percent;
+    }
+  } else if (!table_sample_percents_.empty()) {
+    unordered_map<string, double>::const_iterator table_percent =
+        table_sample_percents_.find(
+            to_lower_copy((*table)->dbName + "." + (*table)->tableName));
+    if (table_percent != table_sample_percents_.end()) percent = table_percent->second;
+  }
+  return min(percent, 100.0);
+}
+
+void SimpleScheduler::SampleScanRanges(const TTableDescriptor& table,
+    double sample_percent, const vector<TScanRangeLocations>& locations,
+    vector<TScanRangeLocations>* sampled) {
+  DCHECK(table.__isset.hdfsTable);
+  uint64_t max_hash = sample_percent >= 100 ? numeric_limits<uint64_t>::max() :
+      sample_percent / 100 * numeric_limits<uint64_t>::max();
+  // The partition locations, decompressed on first use.
+  unordered_map<int64_t, string> partition_locations;
+  sampled->clear();
+  for (const TScanRangeLocations& scan_range_locations: locations) {
+    DCHECK(scan_range_locations.scan_range.__isset.hdfs_file_split);
+    const THdfsFileSplit& split = scan_range_locations.scan_range.hdfs_file_split;
+    unordered_map<int64_t, string>::iterator location =
+        partition_locations.find(split.partition_id);
+    if (location == partition_locations.end()) {
+      location = partition_locations.insert(make_pair(split.partition_id, "")).first;
+      map<int64_t, THdfsPartition>::const_iterator partition =
+          table.hdfsTable.partitions.find(split.partition_id);
+      if (partition != table.hdfsTable.partitions.end()) {
+        DecompressLocation(table.hdfsTable, partition->second, &location->second);
+      }
+    }
+    string path = location->second + "/" + split.file_name;
+    if (HashUtil::MurmurHash2_64(path.data(), path.size(), FLAGS_table_sample_seed)
+        <= max_hash) {
+      sampled->push_back(scan_range_locations);
+    }
+  }
+}
+
+uint64_t SimpleScheduler::GetLoadPenalty(const TNetworkAddress& data_location,
+    const unordered_map<string, int64_t>& host_mem_reserved) {
+  BackendConfigPtr backend_config = GetBackendConfig();
+  const vector<TBackendDescriptor>* backends =
+      backend_config->LookUpBackends(data_location);
+  if (backends == NULL) return 0;
+  int64_t mem_reserved = 0;
+  for (const TBackendDescriptor& backend: *backends) {
+    unordered_map<string, int64_t>::const_iterator mem =
+        host_mem_reserved.find(TNetworkAddressToString(backend.address));
+    if (mem != host_mem_reserved.end()) mem_reserved += mem->second;
+  }
+  return static_cast<uint64_t>(max<int64_t>(mem_reserved, 0)
+      * FLAGS_scan_range_load_penalty_ratio);
+}
+
 Status SimpleScheduler::ComputeScanRangeAssignment(
     PlanNodeId node_id, const TReplicaPreference::type* node_replica_preference,
     bool node_random_replica, const vector<TScanRangeLocations>& locations,
@@ -477,6 +781,20 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
 
   // map from datanode host to total assigned bytes.
   unordered_map<TNetworkAddress, uint64_t> assigned_bytes_per_host;
+  // map from datanode host to the penalty in bytes for the load of its backends, and
+  // the memory reserved per backend that it is computed from.
+  unordered_map<TNetworkAddress, uint64_t> load_penalty_per_host;
+  unordered_map<string, int64_t> host_mem_reserved;
+  const bool load_aware = FLAGS_scan_range_load_penalty_ratio > 0
+      && admission_controller_.get() != NULL;
+  if (load_aware) admission_controller_->GetHostMemReserved(&host_mem_reserved);
+  // If --balance_remote_scan_ranges is set, all backends and a min-heap of the bytes of
+  // remote reads assigned to them, as pairs of bytes and index into
+  // remote_read_backends. Initialized on the first remote read.
+  BackendList remote_read_backends;
+  typedef pair<int64_t, int> BackendBytes;
+  priority_queue<BackendBytes, vector<BackendBytes>, greater<BackendBytes> >
+      remote_read_bytes;
   unordered_set<TNetworkAddress> remote_hosts;
   int64_t remote_bytes = 0L;
   int64_t local_bytes = 0L;
@@ -498,7 +816,8 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
     for (const TScanRangeLocation& location: scan_range_locations.locations) {
       TReplicaPreference::type memory_distance = TReplicaPreference::REMOTE;
       const TNetworkAddress& replica_host = host_list[location.host_idx];
-      if (HasLocalBackend(replica_host)) {
+      const bool has_local_backend = HasLocalBackend(replica_host);
+      if (has_local_backend) {
         // Adjust whether or not this replica should count as being cached based on the
         // query option and whether it is collocated. If the DN is not collocated treat
         // the replica as not cached (network transfer dominates anyway in this case).
@@ -517,6 +836,15 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
       uint64_t initial_bytes = 0L;
       uint64_t assigned_bytes =
           *FindOrInsert(&assigned_bytes_per_host, replica_host, initial_bytes);
+      if (load_aware && has_local_backend) {
+        unordered_map<TNetworkAddress, uint64_t>::iterator penalty =
+            load_penalty_per_host.find(replica_host);
+        if (penalty == load_penalty_per_host.end()) {
+          penalty = load_penalty_per_host.insert(make_pair(replica_host,
+              GetLoadPenalty(replica_host, host_mem_reserved))).first;
+        }
+        assigned_bytes += penalty->second;
+      }
 
       bool found_new_replica = false;
 
@@ -579,7 +907,21 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
     DCHECK(data_host != NULL);
 
     TNetworkAddress exec_hostport;
-    if (!exec_at_coord) {
+    if (!exec_at_coord && remote_read && FLAGS_balance_remote_scan_ranges) {
+      if (remote_read_backends.empty()) {
+        GetAllKnownBackends(&remote_read_backends);
+        if (remote_read_backends.empty()) return Status("No backends configured");
+        for (int i = 0; i < remote_read_backends.size(); ++i) {
+          remote_read_bytes.push(make_pair(0L, i));
+        }
+      }
+      BackendBytes least_loaded = remote_read_bytes.top();
+      remote_read_bytes.pop();
+      exec_hostport = remote_read_backends[least_loaded.second].address;
+      least_loaded.first += scan_range_length;
+      remote_read_bytes.push(least_loaded);
+      if (metrics_ != NULL) total_assignments_->Increment(1);
+    } else if (!exec_at_coord) {
       TBackendDescriptor backend;
       RETURN_IF_ERROR(GetBackend(*data_host, &backend));
       exec_hostport = backend.address;
@@ -640,9 +982,10 @@ void SimpleScheduler::ComputeFragmentExecParams(const TQueryExecRequest& exec_re
   for (FragmentExecParams& params: *fragment_exec_params) {
     for (int j = 0; j < params.hosts.size(); ++j) {
       int instance_num = num_fragment_instances + j;
-      // we add instance_num to query_id.lo to create a globally-unique instance id
+      // we add instance_num to query_id.lo to create a globally-unique instance id, and
+      // the attempt to query_id.hi to distinguish the instances of retried queries
       TUniqueId instance_id;
-      instance_id.hi = schedule->query_id().hi;
+      instance_id.hi = schedule->query_id().hi + schedule->attempt();
       DCHECK_LT(
           schedule->query_id().lo, numeric_limits<int64_t>::max() - instance_num - 1);
       instance_id.lo = schedule->query_id().lo + instance_num + 1;
@@ -755,9 +1098,23 @@ void SimpleScheduler::ComputeFragmentHosts(const TQueryExecRequest& exec_request
       int input_fragment_idx = FindLeftmostInputFragment(i, exec_request);
       DCHECK_GE(input_fragment_idx, 0);
       DCHECK_LT(input_fragment_idx, fragment_exec_params->size());
-      params.hosts = (*fragment_exec_params)[input_fragment_idx].hosts;
       // TODO: switch to unpartitioned/coord execution if our input fragment
       // is executed that way (could have been downgraded from distributed)
+      const vector<TNetworkAddress>& input_hosts =
+          (*fragment_exec_params)[input_fragment_idx].hosts;
+      if (FLAGS_non_scan_fragment_instances_per_host <= 1) {
+        params.hosts = input_hosts;
+        continue;
+      }
+      // Start several instances on every distinct host of the input fragment, which
+      // itself may already run several instances per host. The instances of a host
+      // are adjacent so that consecutive destinations of senders share a host.
+      unordered_set<TNetworkAddress> seen_hosts;
+      for (const TNetworkAddress& host: input_hosts) {
+        if (!seen_hosts.insert(host).second) continue;
+        params.hosts.insert(
+            params.hosts.end(), FLAGS_non_scan_fragment_instances_per_host, host);
+      }
       continue;
     }
 
@@ -20,14 +20,20 @@
 #include <vector>
 #include <string>
 #include <list>
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include "common/atomic.h"
 #include "common/status.h"
 #include "scheduling/scheduler.h"
 #include "statestore/statestore-subscriber.h"
 #include "statestore/statestore.h"
+#include "util/collection-metrics.h"
+#include "util/container-util.h"
 #include "util/metrics.h"
+#include "util/spinlock.h"
+#include "util/thread-pool.h"
 #include "scheduling/admission-controller.h"
 #include "gen-cpp/Types_types.h"  // for TNetworkAddress
 #include "gen-cpp/ResourceBrokerService_types.h"
@@ -44,8 +50,12 @@ class SchedulerWrapper;
 /// either from the statestore, or from a static list of addresses, and a list
 /// of target data locations.
 //
+/// The known backends are kept in an immutable BackendConfig snapshot. Membership
+/// updates apply the statestore's deltas to a copy of the current snapshot and then
+/// publish it, so scheduling threads only take a spinlock to copy the shared_ptr to
+/// the snapshot and never wait for an update to be processed.
+//
 /// TODO: Notice when there are duplicate statestore registrations (IMPALA-23)
-/// TODO: Handle deltas from the statestore
 class SimpleScheduler : public Scheduler {
  public:
   static const std::string IMPALA_MEMBERSHIP_TOPIC;
@@ -72,9 +82,7 @@ class SimpleScheduler : public Scheduler {
   virtual void GetAllKnownBackends(BackendList* backends);
 
   virtual bool HasLocalBackend(const TNetworkAddress& data_location) {
-    boost::lock_guard<boost::mutex> l(backend_map_lock_);
-    BackendMap::iterator entry = backend_map_.find(data_location.hostname);
-    return (entry != backend_map_.end() && entry->second.size() > 0);
+    return GetBackendConfig()->LookUpBackends(data_location) != NULL;
   }
 
   /// Registers with the subscription manager if required
@@ -82,42 +90,94 @@ class SimpleScheduler : public Scheduler {
 
   virtual Status Schedule(Coordinator* coord, QuerySchedule* schedule);
   virtual Status Release(QuerySchedule* schedule);
+
+  /// Removes the backend at 'address' from the backends that are scheduled on, for
+  /// --backend_blacklist_timeout_s or until the statestore removes it from the
+  /// membership, whichever comes first. Only blacklists backends of the membership
+  /// topic, and never the local backend.
+  virtual void BlacklistBackend(const TNetworkAddress& address);
   virtual void HandlePreemptedReservation(const TUniqueId& reservation_id);
   virtual void HandlePreemptedResource(const TUniqueId& client_resource_id);
   virtual void HandleLostResource(const TUniqueId& client_resource_id);
 
  private:
-  /// Protects access to backend_map_ and backend_ip_map_, which might otherwise be
-  /// updated asynchronously with respect to reads. Also protects the locality
-  /// counters, which are updated in GetBackends.
-  boost::mutex backend_map_lock_;
-
   /// Map from a datanode's IP address to a list of backend addresses running on that
   /// node.
-  typedef boost::unordered_map<std::string, std::list<TBackendDescriptor> > BackendMap;
-  BackendMap backend_map_;
+  typedef boost::unordered_map<std::string, std::vector<TBackendDescriptor> >
+      BackendMap;
 
   /// Map from a datanode's hostname to its IP address to support both hostname based
   /// lookup.
   typedef boost::unordered_map<std::string, std::string> BackendIpAddressMap;
-  BackendIpAddressMap backend_ip_map_;
+
+  /// A snapshot of the known backends. Not modified once it has been published in
+  /// backend_config_.
+  struct BackendConfig {
+    BackendMap backend_map;
+    BackendIpAddressMap backend_ip_map;
+
+    /// The keys of backend_map, in the order in which non-local data is assigned to
+    /// them round-robin. Set by BuildBackendIps().
+    std::vector<std::string> backend_ips;
+
+    /// Sets backend_ips from backend_map.
+    void BuildBackendIps();
+
+    /// Returns the backends on the host of 'data_location', which may be given by IP
+    /// address or hostname, or NULL if there are none.
+    const std::vector<TBackendDescriptor>* LookUpBackends(
+        const TNetworkAddress& data_location) const;
+  };
+  typedef boost::shared_ptr<const BackendConfig> BackendConfigPtr;
+
+  /// Returns the current snapshot of the backends.
+  BackendConfigPtr GetBackendConfig() const;
+
+  /// Publishes a new snapshot of the backends.
+  void SetBackendConfig(const BackendConfigPtr& backend_config);
+
+  /// Adds 'be_desc' to the maps of 'backend_config', which must not have been
+  /// published yet.
+  static void AddBackend(const TBackendDescriptor& be_desc,
+      BackendConfig* backend_config);
+
+  /// Removes 'be_desc' from the maps of 'backend_config', which must not have been
+  /// published yet.
+  static void RemoveBackend(const TBackendDescriptor& be_desc,
+      BackendConfig* backend_config);
+
+  /// Protects the backend_config_ pointer, but not the snapshot itself, which is
+  /// immutable.
+  mutable SpinLock backend_config_lock_;
+  BackendConfigPtr backend_config_;
+
+  /// Protects current_membership_ and blacklist_, and serializes the publication of
+  /// new snapshots by UpdateMembership() and BlacklistBackend(). Scheduling never takes
+  /// this lock.
+  boost::mutex membership_lock_;
 
   /// Map from unique backend id to TBackendDescriptor. Used to track the known backends
   /// from the statestore. It's important to track both the backend ID as well as the
   /// TBackendDescriptor so we know what is being removed in a given update.
-  /// Locking of this map is not needed since it should only be read/modified from
-  /// within the UpdateMembership() function.
+  /// Blacklisted backends are in this map, but not in backend_config_.
   typedef boost::unordered_map<std::string, TBackendDescriptor> BackendIdMap;
   BackendIdMap current_membership_;
 
+  /// Map from the address of a blacklisted backend to the time, in ms since
+  /// MonotonicMillis()'s epoch, when it is scheduled on again.
+  typedef boost::unordered_map<TNetworkAddress, int64_t> BlacklistMap;
+  BlacklistMap blacklist_;
+
   /// MetricGroup subsystem access
   MetricGroup* metrics_;
 
   /// Webserver for /backends. Not owned by us.
   Webserver* webserver_;
 
-  /// round robin entry in BackendMap for non-local host assignment
-  BackendMap::iterator next_nonlocal_backend_entry_;
+  /// Round-robin counters for GetBackend(): for the IP address of non-local host
+  /// assignments, and for the backend among several on the same IP address.
+  AtomicInt<int64_t> next_nonlocal_backend_idx_;
+  AtomicInt<int64_t> next_local_backend_idx_;
 
   /// Pointer to a subscription manager (which we do not own) which is used to register
   /// for dynamic updates to the set of available backends. May be NULL if the set of
@@ -140,6 +200,10 @@ class SimpleScheduler : public Scheduler {
   BooleanProperty* initialised_;
   /// Current number of backends
   IntGauge* num_fragment_instances_metric_;
+  /// Time in seconds spent processing membership topic updates
+  StatsMetric<double>* membership_update_time_metric_;
+  /// Current number of blacklisted backends
+  IntGauge* num_blacklisted_backends_metric_;
 
   /// Counts the number of UpdateMembership invocations, to help throttle the logging.
   uint32_t update_count_;
@@ -172,6 +236,14 @@ class SimpleScheduler : public Scheduler {
   /// Used to make admission decisions in 'Schedule()'
   boost::scoped_ptr<AdmissionController> admission_controller_;
 
+  /// Opens connections to backends that join the membership in the background. Only
+  /// created if --backend_client_warmup_connections > 0.
+  boost::scoped_ptr<ThreadPool<TNetworkAddress> > warmup_pool_;
+
+  /// Map from lower-case "<db>.<table>" to the percentage of its files that scans read,
+  /// parsed from --table_sample_percents in Init().
+  boost::unordered_map<std::string, double> table_sample_percents_;
+
   /// Adds the granted reservation and resources to the active_reservations_ and
   /// active_client_resources_ maps, respectively.
   void AddToActiveResourceMaps(
@@ -186,6 +258,15 @@ class SimpleScheduler : public Scheduler {
   void UpdateMembership(const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
       std::vector<TTopicDelta>* subscriber_topic_updates);
 
+  /// Removes the entries of blacklist_ that expired, and adds their backends back to
+  /// 'new_config', which is copied from backend_config_ first if it is NULL. Called by
+  /// UpdateMembership() with membership_lock_ held.
+  void RestoreBlacklistedBackends(boost::shared_ptr<BackendConfig>* new_config);
+
+  /// Called by warmup_pool_ to open --backend_client_warmup_connections connections to
+  /// 'address' in the impalad client cache.
+  void WarmUpBackendClients(int thread_id, const TNetworkAddress& address);
+
   /// Webserver callback that produces a list of known backends.
   /// Example output:
   /// "backends": [
@@ -213,6 +294,30 @@ class SimpleScheduler : public Scheduler {
       const std::vector<TNetworkAddress>& host_list, bool exec_at_coord,
       const TQueryOptions& query_options, FragmentScanRangeAssignment* assignment);
 
+  /// Returns the percentage of the files of the table of HDFS scan 'node' that are
+  /// scanned: --compute_stats_sample_percent for the child queries of COMPUTE STATS, the
+  /// percentage of the table in --table_sample_percents for other queries, or 100 to
+  /// scan all files. Sets 'table' to the scanned table if the scan is sampled.
+  double GetScanSamplePercent(const TQueryExecRequest& exec_request,
+      const TPlanNode& node, const TTableDescriptor** table) const;
+
+  /// Sets 'sampled' to the scan ranges of 'locations' in the files of 'table' whose
+  /// seeded hash of the path is in the lowest 'sample_percent' percent of hash values.
+  /// All ranges of a file are sampled or none, and the same files are sampled by every
+  /// query until --table_sample_seed changes. Sampling before the assignment keeps the
+  /// sampled ranges balanced across the backends.
+  static void SampleScanRanges(const TTableDescriptor& table, double sample_percent,
+      const std::vector<TScanRangeLocations>& locations,
+      std::vector<TScanRangeLocations>* sampled);
+
+  /// Returns the number of bytes that ComputeScanRangeAssignment() adds to the assigned
+  /// bytes of the replica host 'data_location' to account for the load of the backends
+  /// on it, i.e. --scan_range_load_penalty_ratio times the memory reserved on them in
+  /// 'host_mem_reserved', the map returned by AdmissionController::GetHostMemReserved().
+  /// Returns 0 if there is no backend on the host.
+  uint64_t GetLoadPenalty(const TNetworkAddress& data_location,
+      const boost::unordered_map<std::string, int64_t>& host_mem_reserved);
+
   /// Populates fragment_exec_params_ in schedule.
   void ComputeFragmentExecParams(const TQueryExecRequest& exec_request,
       QuerySchedule* schedule);
@@ -0,0 +1,150 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/catalog-snapshot.h"
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include <boost/filesystem.hpp>
+
+#include "common/names.h"
+
+using namespace impala;
+
+namespace impala {
+
+const string SNAPSHOT_DIR = "/tmp/catalog-snapshot-test";
+
+class CatalogSnapshotTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    boost::filesystem::remove_all(SNAPSHOT_DIR);
+  }
+
+  virtual void TearDown() {
+    boost::filesystem::remove_all(SNAPSHOT_DIR);
+  }
+
+  static void AddItem(const string& key, const string& value, TTopicDelta* delta) {
+    delta->topic_entries.push_back(TTopicItem());
+    delta->topic_entries.back().key = key;
+    delta->topic_entries.back().value = value;
+  }
+};
+
+TEST_F(CatalogSnapshotTest, WriteRead) {
+  CatalogSnapshot snapshot(SNAPSHOT_DIR);
+  TTopicDelta delta;
+  EXPECT_FALSE(snapshot.Read(&delta).ok());
+
+  CatalogSnapshot::TopicEntryMap entries;
+  entries["TABLE:db.t1"] = "t1";
+  entries["TABLE:db.t2"] = string(10000, 'x');
+  ASSERT_TRUE(snapshot.Write("catalog-update", entries, 42).ok());
+  ASSERT_TRUE(snapshot.Read(&delta).ok());
+  EXPECT_EQ(delta.topic_name, "catalog-update");
+  EXPECT_FALSE(delta.is_delta);
+  EXPECT_EQ(delta.to_version, 42);
+  CatalogSnapshot::TopicEntryMap read_entries;
+  CatalogSnapshot::ApplyDelta(delta, &read_entries);
+  EXPECT_TRUE(read_entries == entries);
+
+  // A later snapshot replaces the earlier one.
+  entries.erase("TABLE:db.t1");
+  ASSERT_TRUE(snapshot.Write("catalog-update", entries, 43).ok());
+  ASSERT_TRUE(snapshot.Read(&delta).ok());
+  EXPECT_EQ(delta.to_version, 43);
+  EXPECT_EQ(delta.topic_entries.size(), 1);
+}
+
+TEST_F(CatalogSnapshotTest, Corrupt) {
+  CatalogSnapshot snapshot(SNAPSHOT_DIR);
+  CatalogSnapshot::TopicEntryMap entries;
+  entries["TABLE:db.t1"] = "t1";
+  ASSERT_TRUE(snapshot.Write("catalog-update", entries, 1).ok());
+  {
+    ofstream out(snapshot.path().c_str(), ios::out | ios::binary | ios::trunc);
+    out << "CSN1 garbage";
+  }
+  TTopicDelta delta;
+  EXPECT_FALSE(snapshot.Read(&delta).ok());
+}
+
+TEST_F(CatalogSnapshotTest, ApplyDelta) {
+  CatalogSnapshot::TopicEntryMap entries;
+  TTopicDelta full;
+  full.is_delta = false;
+  AddItem("a", "1", &full);
+  AddItem("b", "2", &full);
+  CatalogSnapshot::ApplyDelta(full, &entries);
+  EXPECT_EQ(entries.size(), 2);
+
+  TTopicDelta delta;
+  delta.is_delta = true;
+  AddItem("b", "3", &delta);
+  AddItem("c", "4", &delta);
+  delta.topic_deletions.push_back("a");
+  CatalogSnapshot::ApplyDelta(delta, &entries);
+  EXPECT_EQ(entries.size(), 2);
+  EXPECT_EQ(entries["b"], "3");
+  EXPECT_EQ(entries["c"], "4");
+
+  // A full update replaces all entries.
+  CatalogSnapshot::ApplyDelta(full, &entries);
+  EXPECT_EQ(entries.size(), 2);
+  EXPECT_EQ(entries["a"], "1");
+  EXPECT_EQ(entries["b"], "2");
+}
+
+TEST_F(CatalogSnapshotTest, Diff) {
+  CatalogSnapshot::TopicEntryMap entries;
+  entries["unchanged"] = "1";
+  entries["changed"] = "2";
+  entries["dropped"] = "3";
+
+  TTopicDelta full;
+  full.is_delta = false;
+  full.__set_from_version(0);
+  full.__set_to_version(100);
+  AddItem("unchanged", "1", &full);
+  AddItem("changed", "20", &full);
+  AddItem("added", "4", &full);
+  // Deletions of entries that are already gone are not repeated.
+  full.topic_deletions.push_back("gone");
+
+  TTopicDelta diff;
+  CatalogSnapshot::Diff(entries, full, &diff);
+  EXPECT_TRUE(diff.is_delta);
+  EXPECT_EQ(diff.to_version, 100);
+  ASSERT_EQ(diff.topic_entries.size(), 2);
+  EXPECT_EQ(diff.topic_entries[0].key, "changed");
+  EXPECT_EQ(diff.topic_entries[1].key, "added");
+  ASSERT_EQ(diff.topic_deletions.size(), 1);
+  EXPECT_EQ(diff.topic_deletions[0], "dropped");
+
+  // Applying the diff to the snapshot's entries results in the entries of the full
+  // update.
+  CatalogSnapshot::ApplyDelta(diff, &entries);
+  CatalogSnapshot::TopicEntryMap full_entries;
+  CatalogSnapshot::ApplyDelta(full, &full_entries);
+  EXPECT_TRUE(entries == full_entries);
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,137 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/catalog-snapshot.h"
+
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include <boost/filesystem.hpp>
+#include <boost/unordered_set.hpp>
+#include <gutil/strings/substitute.h>
+#include <snappy.h>
+
+#include "common/logging.h"
+#include "rpc/thrift-util.h"
+
+#include "common/names.h"
+
+namespace filesystem = boost::filesystem;
+using namespace impala;
+using namespace strings;
+
+const string SNAPSHOT_FILE_NAME = "catalog_snapshot";
+
+// Starts the snapshot file, followed by the compressed serialized TTopicDelta.
+const uint32_t SNAPSHOT_MAGIC = 0x43534e31; // "CSN1"
+
+CatalogSnapshot::CatalogSnapshot(const string& dir)
+  : dir_(dir),
+    path_((filesystem::path(dir) / SNAPSHOT_FILE_NAME).string()) {
+}
+
+Status CatalogSnapshot::Read(TTopicDelta* delta) {
+  ifstream in(path_.c_str(), ios::in | ios::binary);
+  if (!in) return Status(Substitute("No catalog snapshot in $0", path_));
+  stringstream contents;
+  contents << in.rdbuf();
+  const string& buffer = contents.str();
+  uint32_t magic;
+  if (buffer.size() < sizeof(magic)) {
+    return Status(Substitute("Catalog snapshot $0 is truncated", path_));
+  }
+  memcpy(&magic, buffer.data(), sizeof(magic));
+  if (magic != SNAPSHOT_MAGIC) {
+    return Status(Substitute("Catalog snapshot $0 is invalid", path_));
+  }
+  string serialized;
+  if (!snappy::Uncompress(buffer.data() + sizeof(magic), buffer.size() - sizeof(magic),
+          &serialized)) {
+    return Status(Substitute("Error decompressing catalog snapshot $0", path_));
+  }
+  uint32_t len = serialized.size();
+  return DeserializeThriftMsg(reinterpret_cast<const uint8_t*>(serialized.data()), &len,
+      true, delta);
+}
+
+Status CatalogSnapshot::Write(const string& topic_name, const TopicEntryMap& entries,
+    int64_t version) {
+  TTopicDelta delta;
+  delta.topic_name = topic_name;
+  delta.is_delta = false;
+  delta.__set_to_version(version);
+  delta.topic_entries.reserve(entries.size());
+  for (const TopicEntryMap::value_type& entry: entries) {
+    delta.topic_entries.push_back(TTopicItem());
+    delta.topic_entries.back().key = entry.first;
+    delta.topic_entries.back().value = entry.second;
+  }
+  ThriftSerializer serializer(true);
+  uint8_t* buffer;
+  uint32_t len;
+  RETURN_IF_ERROR(serializer.Serialize(&delta, &len, &buffer));
+  string compressed;
+  snappy::Compress(reinterpret_cast<const char*>(buffer), len, &compressed);
+
+  // Write to a temporary file that replaces the snapshot once it is complete, so that a
+  // crash never leaves a partial snapshot behind.
+  const string tmp_path = path_ + ".tmp";
+  try {
+    filesystem::create_directories(dir_);
+  } catch (const filesystem::filesystem_error& e) {
+    return Status(Substitute("Could not create the catalog snapshot directory $0: $1",
+        dir_, e.what()));
+  }
+  {
+    ofstream out(tmp_path.c_str(), ios::out | ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char*>(&SNAPSHOT_MAGIC), sizeof(SNAPSHOT_MAGIC));
+    out.write(compressed.data(), compressed.size());
+    out.close();
+    if (!out) return Status(Substitute("Could not write catalog snapshot $0", tmp_path));
+  }
+  if (rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    return Status(Substitute("Could not rename catalog snapshot $0 to $1", tmp_path,
+        path_));
+  }
+  return Status::OK();
+}
+
+void CatalogSnapshot::ApplyDelta(const TTopicDelta& delta, TopicEntryMap* entries) {
+  if (!delta.is_delta) entries->clear();
+  for (const TTopicItem& item: delta.topic_entries) (*entries)[item.key] = item.value;
+  for (const string& key: delta.topic_deletions) entries->erase(key);
+}
+
+void CatalogSnapshot::Diff(const TopicEntryMap& entries, const TTopicDelta& full,
+    TTopicDelta* diff) {
+  DCHECK(!full.is_delta);
+  diff->topic_name = full.topic_name;
+  diff->is_delta = true;
+  diff->__set_from_version(full.from_version);
+  diff->__set_to_version(full.to_version);
+  diff->__set_min_subscriber_topic_version(full.min_subscriber_topic_version);
+  unordered_set<string> keys;
+  for (const TTopicItem& item: full.topic_entries) {
+    keys.insert(item.key);
+    TopicEntryMap::const_iterator entry = entries.find(item.key);
+    if (entry == entries.end() || entry->second != item.value) {
+      diff->topic_entries.push_back(item);
+    }
+  }
+  for (const TopicEntryMap::value_type& entry: entries) {
+    if (keys.find(entry.first) == keys.end()) {
+      diff->topic_deletions.push_back(entry.first);
+    }
+  }
+}
@@ -0,0 +1,75 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_SERVICE_CATALOG_SNAPSHOT_H
+#define IMPALA_SERVICE_CATALOG_SNAPSHOT_H
+
+#include <string>
+#include <boost/unordered_map.hpp>
+
+#include "common/status.h"
+#include "gen-cpp/StatestoreService_types.h"  // for TTopicDelta
+
+namespace impala {
+
+/// Snapshot of the catalog topic on local disk, from which an impalad restores its
+/// catalog on startup instead of waiting for the full topic from the statestore.
+///
+/// The snapshot holds the entries of the topic as of some topic version, serialized as
+/// a non-delta TTopicDelta and compressed with snappy, in a single file that Write()
+/// replaces atomically. Topic versions are only meaningful to the statestore instance
+/// that assigned them, so the first full topic update that an impalad receives after
+/// restoring a snapshot is compared with the snapshot by Diff(), and only the entries
+/// that differ are applied.
+/// Not thread-safe.
+class CatalogSnapshot {
+ public:
+  /// The values of the entries of the topic by key.
+  typedef boost::unordered_map<std::string, std::string> TopicEntryMap;
+
+  /// The snapshot is stored in 'dir'.
+  CatalogSnapshot(const std::string& dir);
+
+  /// Reads the snapshot into 'delta', a non-delta update with all entries of the topic
+  /// whose to_version is the topic version of the snapshot. Returns an error if there
+  /// is no snapshot or it cannot be read.
+  Status Read(TTopicDelta* delta);
+
+  /// Replaces the snapshot with 'entries' of 'topic_name' at topic version 'version'.
+  /// Creates the directory if it doesn't exist.
+  Status Write(const std::string& topic_name, const TopicEntryMap& entries,
+      int64_t version);
+
+  /// Applies the entries and deletions of 'delta' to 'entries'. A non-delta update
+  /// replaces all entries.
+  static void ApplyDelta(const TTopicDelta& delta, TopicEntryMap* entries);
+
+  /// Sets 'diff' to a delta update with the entries of the non-delta update 'full' that
+  /// are not in 'entries' or have different values, and the deletions of the entries
+  /// that are not in 'full'. The versions of 'diff' are those of 'full'.
+  static void Diff(const TopicEntryMap& entries, const TTopicDelta& full,
+      TTopicDelta* diff);
+
+  const std::string& path() const { return path_; }
+
+ private:
+  const std::string dir_;
+
+  /// The snapshot file in 'dir_'.
+  const std::string path_;
+};
+
+}
+
+#endif
@@ -48,6 +48,8 @@
 using namespace impala;
 using namespace apache::thrift::server;
 
+DECLARE_bool(catalog_topic_table_markers);
+
 // Called from the FE when it explicitly loads libfesupport.so for tests.
 // This creates the minimal state necessary to service the other JNI calls.
 // This is not called when we first start up the BE.
@@ -301,9 +303,16 @@ Java_com_cloudera_impala_service_FeSupport_NativePrioritizeLoad(
   TPrioritizeLoadRequest request;
   DeserializeThriftMsg(env, thrift_struct, &request);
 
-  CatalogOpExecutor catalog_op_executor(ExecEnv::GetInstance(), NULL, NULL);
   TPrioritizeLoadResponse result;
-  Status status = catalog_op_executor.PrioritizeLoad(request, &result);
+  Status status;
+  ImpalaServer* impala_server = ExecEnv::GetInstance()->impala_server();
+  if (FLAGS_catalog_topic_table_markers && impala_server != NULL) {
+    // The catalog topic doesn't have the metadata of tables in this mode.
+    status = impala_server->LoadTablesOnDemand(request, &result);
+  } else {
+    CatalogOpExecutor catalog_op_executor(ExecEnv::GetInstance(), NULL, NULL);
+    status = catalog_op_executor.PrioritizeLoad(request, &result);
+  }
   if (!status.ok()) {
     LOG(ERROR) << status.GetDetail();
     // Create a new Status, copy in this error, then update the result.
@@ -15,12 +15,16 @@
 #include "service/fragment-exec-state.h"
 
 #include <sstream>
+#include <gflags/gflags.h>
 
 #include "codegen/llvm-codegen.h"
 #include "gen-cpp/ImpalaInternalService.h"
 #include "rpc/thrift-util.h"
 #include "gutil/strings/substitute.h"
 #include "util/bloom-filter.h"
+#include "util/histogram-metric.h"
+#include "util/impalad-metrics.h"
+#include "util/time.h"
 #include "runtime/backend-client.h"
 
 #include "common/names.h"
@@ -29,6 +33,10 @@ using namespace apache::thrift;
 using namespace strings;
 using namespace impala;
 
+DEFINE_bool(report_profile_deltas, false, "(Advanced) If true, the periodic status "
+    "reports of fragment instances only contain the profile counters and info strings "
+    "that changed since the previous report, instead of the full profile.");
+
 Status FragmentMgr::FragmentExecState::UpdateStatus(const Status& status) {
   lock_guard<mutex> l(status_lock_);
   if (!status.ok() && exec_status_.ok()) exec_status_ = status;
@@ -38,6 +46,7 @@ Status FragmentMgr::FragmentExecState::UpdateStatus(const Status& status) {
 Status FragmentMgr::FragmentExecState::Cancel() {
   lock_guard<mutex> l(status_lock_);
   RETURN_IF_ERROR(exec_status_);
+  cancel_time_ms_.CompareAndSwap(0, MonotonicMillis());
   executor_.Cancel();
   return Status::OK();
 }
@@ -53,6 +62,11 @@ void FragmentMgr::FragmentExecState::Exec() {
   // Open() does the full execution, because all plan fragments have sinks
   executor_.Open();
   executor_.Close();
+  int64_t cancel_time_ms = cancel_time_ms_.Load();
+  HistogramMetric* latencies = ImpaladMetrics::FRAGMENT_CANCEL_TO_RELEASE_LATENCIES;
+  if (cancel_time_ms != 0 && latencies != NULL) {
+    latencies->Update(MonotonicMillis() - cancel_time_ms);
+  }
 }
 
 // There can only be one of these callbacks in-flight at any moment, because
@@ -83,7 +97,17 @@ void FragmentMgr::FragmentExecState::ReportStatusCb(
   params.__set_done(done);
 
   if (profile != NULL) {
-    profile->ToThrift(&params.profile);
+    if (FLAGS_report_profile_deltas) {
+      // The coordinator merges the reported profiles into the instance's profile, so
+      // unchanged parts don't need to be sent again.
+      TRuntimeProfileTree full_profile;
+      profile->ToThrift(&full_profile);
+      params.profile = full_profile;
+      RuntimeProfile::ComputeDelta(last_reported_profile_, &params.profile);
+      last_reported_profile_.nodes.swap(full_profile.nodes);
+    } else {
+      profile->ToThrift(&params.profile);
+    }
     params.__isset.profile = true;
   }
 
@@ -18,6 +18,7 @@
 #include <boost/bind.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include "common/atomic.h"
 #include "common/status.h"
 #include "runtime/client-cache.h"
 #include "runtime/plan-fragment-executor.h"
@@ -33,7 +34,8 @@ class FragmentMgr::FragmentExecState {
       executor_(exec_env, boost::bind<void>(
           boost::mem_fn(&FragmentMgr::FragmentExecState::ReportStatusCb),
               this, _1, _2, _3)),
-      client_cache_(exec_env->impalad_client_cache()), exec_params_(params) {
+      client_cache_(exec_env->impalad_client_cache()), exec_params_(params),
+      cancel_time_ms_(0) {
   }
 
   /// Calling the d'tor releases all memory and closes all data streams
@@ -47,7 +49,9 @@ class FragmentMgr::FragmentExecState {
   /// Call Prepare() and create and initialize data sink.
   Status Prepare();
 
-  /// Main loop of plan fragment execution. Blocks until execution finishes.
+  /// Main loop of plan fragment execution. Blocks until execution finishes and the
+  /// resources of the fragment are released. If the fragment was cancelled, records the
+  /// time since Cancel() in ImpaladMetrics::FRAGMENT_CANCEL_TO_RELEASE_LATENCIES.
   void Exec();
 
   const TUniqueId& query_id() const {
@@ -84,9 +88,17 @@ class FragmentMgr::FragmentExecState {
   /// if set to anything other than OK, execution has terminated w/ an error
   Status exec_status_;
 
+  /// MonotonicMillis() of the first call to Cancel(), or 0 if it was not cancelled.
+  AtomicInt64 cancel_time_ms_;
+
   /// Set once Prepare() has returned with exec_status_.
   Promise<Status> prepare_promise_;
 
+  /// The full profile sent with the previous status report, which the profile of the
+  /// next report is a delta against if --report_profile_deltas is set. Only used by
+  /// ReportStatusCb().
+  TRuntimeProfileTree last_reported_profile_;
+
   /// Update 'exec_status_' w/ 'status', if the former is not already an error.
   /// Returns the value of 'exec_status_' after this method completes.
   Status UpdateStatus(const Status& status);
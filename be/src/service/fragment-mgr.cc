@@ -69,12 +69,11 @@ Status FragmentMgr::ExecPlanFragment(const TExecPlanFragmentParams& exec_params)
   ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT->Increment(1L);
   ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS->Increment(1L);
 
-  // Execute plan fragment in new thread.
-  // TODO: manage threads via global thread pool?
+  // Execute plan fragment in a pooled thread.
   const TUniqueId& fragment_id = exec_state->fragment_instance_id();
-  exec_state->set_exec_thread(new Thread("fragment-mgr",
+  exec_state->set_exec_thread(Thread::CreatePooled("fragment-mgr",
       Substitute("exec-plan-fragment-$0", PrintId(fragment_id)),
-          &FragmentMgr::FragmentThread, this, fragment_id));
+          bind<void>(&FragmentMgr::FragmentThread, this, fragment_id)));
 
   return Status::OK();
 }
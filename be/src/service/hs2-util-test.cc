@@ -108,6 +108,33 @@ TEST(StitchNullsTest, StitchWithOffset) {
   }
 }
 
+// Test stitching at all combinations of unaligned offsets and lengths against stitching
+// one bit at a time.
+TEST(StitchNullsTest, StitchUnaligned) {
+  string from;
+  for (int i = 0; i < 8; ++i) from += static_cast<char>(0x5A ^ (i * 37));
+  for (int num_rows_before = 0; num_rows_before < 20; ++num_rows_before) {
+    for (int start_idx = 0; start_idx < 20; ++start_idx) {
+      for (int num_rows_added = 0; num_rows_added < 40; ++num_rows_added) {
+        string to((num_rows_before + 7) / 8, static_cast<char>(0));
+        for (int i = 0; i < num_rows_before; i += 3) to[i / 8] |= 1 << (i % 8);
+        string expected = to;
+        expected.resize((num_rows_before + num_rows_added + 7) / 8, 0);
+        for (int i = 0; i < num_rows_added; ++i) {
+          int from_idx = start_idx + i;
+          int to_idx = num_rows_before + i;
+          if (from[from_idx / 8] & (1 << (from_idx % 8))) {
+            expected[to_idx / 8] |= 1 << (to_idx % 8);
+          }
+        }
+        StitchNulls(num_rows_before, num_rows_added, start_idx, from, &to);
+        ASSERT_EQ(expected, to) << num_rows_before << " " << start_idx << " "
+                                << num_rows_added;
+      }
+    }
+  }
+}
+
 TEST(PrintTColumnValueTest, TestAllTypes) {
   using namespace apache::hive::service::cli::thrift;
 
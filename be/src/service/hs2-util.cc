@@ -15,8 +15,10 @@
 #include "service/hs2-util.h"
 
 #include "common/logging.h"
+#include "exprs/expr-context.h"
 #include "runtime/decimal-value.inline.h"
 #include "runtime/raw-value.inline.h"
+#include "runtime/row-batch.h"
 #include "runtime/types.h"
 
 #include <gutil/strings/substitute.h>
@@ -46,16 +48,160 @@ inline bool GetNullBit(const string& nulls, uint32_t row_idx) {
 
 void impala::StitchNulls(uint32_t num_rows_before, uint32_t num_rows_added,
     uint32_t start_idx, const string& from, string* to) {
-  to->reserve((num_rows_before + num_rows_added + 7) / 8);
+  DCHECK_EQ(to->size(), (num_rows_before + 7) / 8);
+  to->resize((num_rows_before + num_rows_added + 7) / 8, '\0');
 
-  // TODO: This is very inefficient, since we could conceivably go one byte at a time
-  // (although the operands should stay live in registers in the loop). However doing this
-  // more efficiently leads to very complex code: we have to deal with the fact that
-  // 'start_idx' and 'num_rows_before' might both lead to offsets into the null bitset
-  // that don't start on a byte boundary. We should revisit this, ideally with a good
-  // bitset implementation.
-  for (int i = 0; i < num_rows_added; ++i) {
-    SetNullBit(num_rows_before + i, GetNullBit(from, i + start_idx), to);
+  // Fill 'to' a byte at a time. Each step copies the bits up to the end of the current
+  // byte of 'to', which may come from two successive bytes of 'from'. The bits of 'to'
+  // past 'num_rows_before' are all still unset.
+  uint32_t i = 0;
+  while (i < num_rows_added) {
+    uint32_t to_idx = num_rows_before + i;
+    uint32_t from_idx = start_idx + i;
+    int to_bit = to_idx % 8;
+    int from_bit = from_idx % 8;
+    int num_bits = min<uint32_t>(8 - to_bit, num_rows_added - i);
+    uint32_t from_bits = static_cast<uint8_t>(from[from_idx / 8]);
+    if (from_bit + num_bits > 8) {
+      from_bits |= static_cast<uint32_t>(static_cast<uint8_t>(from[from_idx / 8 + 1]))
+          << 8;
+    }
+    from_bits = (from_bits >> from_bit) & ((1 << num_bits) - 1);
+    (*to)[to_idx / 8] |= static_cast<char>(from_bits << to_bit);
+    i += num_bits;
+  }
+}
+
+namespace {
+
+// Converters from the slot values of an expr to the values of a thrift::TColumn, used
+// by ExprValuesToHS2TypedColumn().
+template <typename T, typename SlotType>
+struct NumericToHS2 {
+  static T Convert(const void* value, const ColumnType& type) {
+    return *reinterpret_cast<const SlotType*>(value);
+  }
+};
+
+struct StringToHS2 {
+  static string Convert(const void* value, const ColumnType& type) {
+    switch (type.type) {
+      case TYPE_TIMESTAMP: {
+        string result;
+        RawValue::PrintValue(value, TYPE_TIMESTAMP, -1, &result);
+        return result;
+      }
+      case TYPE_STRING:
+      case TYPE_VARCHAR: {
+        const StringValue* str_val = reinterpret_cast<const StringValue*>(value);
+        return string(static_cast<char*>(str_val->ptr), str_val->len);
+      }
+      case TYPE_CHAR:
+        return string(StringValue::CharSlotToPtr(value, type), type.len);
+      case TYPE_DECIMAL:
+        // HiveServer2 requires decimal to be presented as string.
+        switch (type.GetByteSize()) {
+          case 4: return reinterpret_cast<const Decimal4Value*>(value)->ToString(type);
+          case 8: return reinterpret_cast<const Decimal8Value*>(value)->ToString(type);
+          case 16: return reinterpret_cast<const Decimal16Value*>(value)->ToString(type);
+          default: DCHECK(false) << "bad type: " << type;
+        }
+        return "";
+      default:
+        DCHECK(false) << "bad type: " << type;
+        return "";
+    }
+  }
+};
+
+// Appends the values of 'expr_ctx' for the rows [start_idx, start_idx + num_rows) of
+// 'batch' to 'values' and their null bits to 'nulls', which already hold 'row_idx' rows.
+template <typename T, typename Converter>
+void ExprValuesToHS2TypedColumn(ExprContext* expr_ctx, const ColumnType& type,
+    RowBatch* batch, int start_idx, int num_rows, uint32_t row_idx, vector<T>* values,
+    string* nulls) {
+  DCHECK_EQ(values->size(), row_idx);
+  DCHECK_EQ(nulls->size(), (row_idx + 7) / 8);
+  size_t new_size = values->size() + num_rows;
+  // Grow geometrically, a fetch may append many batches.
+  if (values->capacity() < new_size) values->reserve(max(new_size, 2 * values->size()));
+  nulls->resize((row_idx + num_rows + 7) / 8, '\0');
+  // The null bits of the current byte are collected in 'null_byte', which starts with
+  // the bits of the rows that are already in 'nulls'.
+  uint8_t null_byte = row_idx % 8 == 0 ? 0 : (*nulls)[row_idx / 8];
+  for (int i = start_idx; i < start_idx + num_rows; ++i) {
+    const void* value = expr_ctx->GetValue(batch->GetRow(i));
+    if (value == NULL) {
+      values->push_back(T());
+      null_byte |= 1 << (row_idx % 8);
+    } else {
+      values->push_back(Converter::Convert(value, type));
+    }
+    ++row_idx;
+    if (row_idx % 8 == 0) {
+      (*nulls)[row_idx / 8 - 1] = null_byte;
+      null_byte = 0;
+    }
+  }
+  if (row_idx % 8 != 0) (*nulls)[row_idx / 8] = null_byte;
+}
+
+}
+
+// For V6 and above
+void impala::ExprValuesToHS2TColumn(ExprContext* expr_ctx, const TColumnType& type,
+    RowBatch* batch, int start_idx, int num_rows, uint32_t row_idx,
+    thrift::TColumn* column) {
+  const ColumnType& col_type = ColumnType::FromThrift(type);
+  switch (type.types[0].scalar_type.type) {
+    case TPrimitiveType::NULL_TYPE:
+    case TPrimitiveType::BOOLEAN:
+      ExprValuesToHS2TypedColumn<bool, NumericToHS2<bool, bool> >(expr_ctx, col_type,
+          batch, start_idx, num_rows, row_idx, &column->boolVal.values,
+          &column->boolVal.nulls);
+      return;
+    case TPrimitiveType::TINYINT:
+      ExprValuesToHS2TypedColumn<int8_t, NumericToHS2<int8_t, int8_t> >(expr_ctx,
+          col_type, batch, start_idx, num_rows, row_idx, &column->byteVal.values,
+          &column->byteVal.nulls);
+      return;
+    case TPrimitiveType::SMALLINT:
+      ExprValuesToHS2TypedColumn<int16_t, NumericToHS2<int16_t, int16_t> >(expr_ctx,
+          col_type, batch, start_idx, num_rows, row_idx, &column->i16Val.values,
+          &column->i16Val.nulls);
+      return;
+    case TPrimitiveType::INT:
+      ExprValuesToHS2TypedColumn<int32_t, NumericToHS2<int32_t, int32_t> >(expr_ctx,
+          col_type, batch, start_idx, num_rows, row_idx, &column->i32Val.values,
+          &column->i32Val.nulls);
+      return;
+    case TPrimitiveType::BIGINT:
+      ExprValuesToHS2TypedColumn<int64_t, NumericToHS2<int64_t, int64_t> >(expr_ctx,
+          col_type, batch, start_idx, num_rows, row_idx, &column->i64Val.values,
+          &column->i64Val.nulls);
+      return;
+    case TPrimitiveType::FLOAT:
+      ExprValuesToHS2TypedColumn<double, NumericToHS2<double, float> >(expr_ctx,
+          col_type, batch, start_idx, num_rows, row_idx, &column->doubleVal.values,
+          &column->doubleVal.nulls);
+      return;
+    case TPrimitiveType::DOUBLE:
+      ExprValuesToHS2TypedColumn<double, NumericToHS2<double, double> >(expr_ctx,
+          col_type, batch, start_idx, num_rows, row_idx, &column->doubleVal.values,
+          &column->doubleVal.nulls);
+      return;
+    case TPrimitiveType::TIMESTAMP:
+    case TPrimitiveType::STRING:
+    case TPrimitiveType::VARCHAR:
+    case TPrimitiveType::CHAR:
+    case TPrimitiveType::DECIMAL:
+      ExprValuesToHS2TypedColumn<string, StringToHS2>(expr_ctx, col_type, batch,
+          start_idx, num_rows, row_idx, &column->stringVal.values,
+          &column->stringVal.nulls);
+      return;
+    default:
+      DCHECK(false) << "Unhandled type: "
+                    << TypeToString(ThriftToType(type.types[0].scalar_type.type));
   }
 }
 
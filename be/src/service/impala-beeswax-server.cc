@@ -155,6 +155,10 @@ class ImpalaServer::AsciiQueryResultSet : public ImpalaServer::QueryResultSet {
 
   virtual size_t size() { return result_set_->size(); }
 
+  virtual QueryResultSet* CreateEmpty(const TResultSetMetadata& metadata) {
+    return new AsciiQueryResultSet(metadata);
+  }
+
  private:
   // Metadata of the result set
   const TResultSetMetadata& metadata_;
@@ -32,6 +32,7 @@
 #include "common/version.h"
 #include "exprs/expr.h"
 #include "runtime/raw-value.h"
+#include "service/prepared-statement-cache.h"
 #include "service/query-exec-state.h"
 #include "service/query-options.h"
 #include "util/debug-util.h"
@@ -162,6 +163,18 @@ class ImpalaServer::HS2ColumnarResultSet : public ImpalaServer::QueryResultSet {
     return Status::OK();
   }
 
+  // Convert the rows of 'batch' one column at a time
+  virtual Status AddRows(const vector<ExprContext*>& exprs, RowBatch* batch,
+      int start_idx, int num_rows) {
+    DCHECK_EQ(exprs.size(), metadata_.columns.size());
+    for (int i = 0; i < exprs.size(); ++i) {
+      ExprValuesToHS2TColumn(exprs[i], metadata_.columns[i].columnType, batch, start_idx,
+          num_rows, num_rows_, &(result_set_->columns[i]));
+    }
+    num_rows_ += num_rows;
+    return Status::OK();
+  }
+
   // Copy all columns starting at 'start_idx' and proceeding for a maximum of 'num_rows'
   // from 'other' into this result set
   virtual int AddRows(const QueryResultSet* other, int start_idx, int num_rows) {
@@ -255,6 +268,10 @@ class ImpalaServer::HS2ColumnarResultSet : public ImpalaServer::QueryResultSet {
 
   virtual size_t size() { return num_rows_; }
 
+  virtual QueryResultSet* CreateEmpty(const TResultSetMetadata& metadata) {
+    return new HS2ColumnarResultSet(metadata);
+  }
+
  private:
   // Metadata of the result set
   const TResultSetMetadata& metadata_;
@@ -377,6 +394,10 @@ class ImpalaServer::HS2RowOrientedResultSet : public ImpalaServer::QueryResultSe
 
   virtual size_t size() { return result_set_->rows.size(); }
 
+  virtual QueryResultSet* CreateEmpty(const TResultSetMetadata& metadata) {
+    return new HS2RowOrientedResultSet(metadata);
+  }
+
  private:
   // Metadata of the result set
   const TResultSetMetadata& metadata_;
@@ -546,6 +567,11 @@ Status ImpalaServer::TExecuteStatementReqToTQueryContext(
     map<string, string>::const_iterator conf_itr = execute_request.confOverlay.begin();
     for (; conf_itr != execute_request.confOverlay.end(); ++conf_itr) {
       if (conf_itr->first == IMPALA_RESULT_CACHING_OPT) continue;
+      // Parameters of prepared statements are bound by ExecuteStatement().
+      if (conf_itr->first.compare(0, PreparedStatementCache::PARAM_PREFIX.size(),
+          PreparedStatementCache::PARAM_PREFIX) == 0) {
+        continue;
+      }
       if (conf_itr->first == ChildQuery::PARENT_QUERY_OPT) {
         if (ParseId(conf_itr->second, &query_ctx->parent_query_id)) {
           query_ctx->__isset.parent_query_id = true;
@@ -723,6 +749,20 @@ void ImpalaServer::ExecuteStatement(TExecuteStatementResp& return_val,
   Status status = TExecuteStatementReqToTQueryContext(request, &query_ctx);
   HS2_RETURN_IF_ERROR(return_val, status, SQLSTATE_GENERAL_ERROR);
 
+  // Bind the parameters of prepared statements, which are passed in the confOverlay.
+  PreparedStmt prepared_stmt;
+  if (request.__isset.confOverlay) {
+    status = PreparedStatementCache::ParseParams(request.confOverlay,
+        &prepared_stmt.params);
+    HS2_RETURN_IF_ERROR(return_val, status, SQLSTATE_GENERAL_ERROR);
+  }
+  if (!prepared_stmt.params.empty()) {
+    prepared_stmt.stmt_template = request.statement;
+    status = PreparedStatementCache::BindStmt(prepared_stmt.stmt_template,
+        prepared_stmt.params, &query_ctx.request.stmt);
+    HS2_RETURN_IF_ERROR(return_val, status, SQLSTATE_SYNTAX_ERROR_OR_ACCESS_VIOLATION);
+  }
+
   TUniqueId session_id;
   TUniqueId secret;
   HS2_RETURN_IF_ERROR(return_val, THandleIdentifierToTUniqueId(
@@ -754,7 +794,8 @@ void ImpalaServer::ExecuteStatement(TExecuteStatementResp& return_val,
   }
 
   shared_ptr<QueryExecState> exec_state;
-  status = Execute(&query_ctx, session, &exec_state);
+  status = Execute(&query_ctx, session, &exec_state,
+      prepared_stmt.params.empty() ? NULL : &prepared_stmt);
   HS2_RETURN_IF_ERROR(return_val, status, SQLSTATE_GENERAL_ERROR);
 
   // Optionally enable result caching on the QueryExecState.
@@ -19,12 +19,14 @@
 #include <gutil/strings/substitute.h>
 
 #include "catalog/catalog-util.h"
+#include "service/profile-archive.h"
 #include "service/query-exec-state.h"
 #include "util/webserver.h"
 
 #include "gen-cpp/beeswax_types.h"
 #include "thrift/protocol/TDebugProtocol.h"
 #include "util/redactor.h"
+#include "util/string-parser.h"
 #include "util/summary-util.h"
 #include "util/time.h"
 #include "util/url-coding.h"
@@ -88,6 +90,13 @@ void ImpalaServer::RegisterWebserverCallbacks(Webserver* webserver) {
   webserver->RegisterUrlCallback("/inflight_query_ids", "raw_text.tmpl",
       inflight_query_ids_callback, false);
 
+  if (profile_archive_ != NULL) {
+    Webserver::UrlCallback archived_queries_callback =
+        bind<void>(mem_fn(&ImpalaServer::ArchivedQueriesUrlCallback), this, _1, _2);
+    webserver->RegisterUrlCallback("/archived_queries", "raw_text.tmpl",
+        archived_queries_callback);
+  }
+
   Webserver::UrlCallback query_summary_callback =
       bind<void>(mem_fn(&ImpalaServer::QuerySummaryCallback), this, false, true, _1, _2);
   webserver->RegisterUrlCallback("/query_summary", "query_summary.tmpl",
@@ -212,6 +221,73 @@ void ImpalaServer::InflightQueryIdsUrlCallback(const Webserver::ArgumentMap& arg
   document->AddMember("contents", query_ids, document->GetAllocator());
 }
 
+// Sets 'value' to the integer argument 'name' if it is present. Returns an error if it
+// is not an integer.
+static Status ParseIntArg(const Webserver::ArgumentMap& args, const string& name,
+    int64_t* value) {
+  Webserver::ArgumentMap::const_iterator it = args.find(name);
+  if (it == args.end()) return Status::OK();
+  StringParser::ParseResult result;
+  *value = StringParser::StringToInt<int64_t>(it->second.c_str(), it->second.size(),
+      &result);
+  if (result != StringParser::PARSE_SUCCESS) {
+    return Status(Substitute("Could not parse '$0' argument: $1", name, it->second));
+  }
+  return Status::OK();
+}
+
+void ImpalaServer::ArchivedQueriesUrlCallback(const Webserver::ArgumentMap& args,
+    Document* document) {
+  ProfileArchive::Filter filter;
+  Webserver::ArgumentMap::const_iterator it = args.find("user");
+  if (it != args.end()) filter.user = it->second;
+  it = args.find("pool");
+  if (it != args.end()) filter.pool = it->second;
+  int64_t limit = 100;
+  Status status = ParseIntArg(args, "min_time_ms", &filter.min_time_ms);
+  if (status.ok()) status = ParseIntArg(args, "max_time_ms", &filter.max_time_ms);
+  if (status.ok()) status = ParseIntArg(args, "min_duration_ms", &filter.min_duration_ms);
+  if (status.ok()) {
+    status = ParseIntArg(args, "min_peak_mem_bytes", &filter.min_peak_mem_bytes);
+  }
+  if (status.ok()) status = ParseIntArg(args, "limit", &limit);
+
+  stringstream ss;
+  Value queries(kArrayType);
+  if (!status.ok()) {
+    ss << status.GetDetail();
+  } else {
+    vector<ProfileArchive::QueryRecord> records;
+    profile_archive_->Find(filter, limit, &records);
+    ss << "query_id\tarchive_time_ms\tuser\tpool\tduration_ms\tpeak_mem_bytes\tstmt\n";
+    for (const ProfileArchive::QueryRecord& record: records) {
+      const string& query_id = PrintId(record.query_id);
+      ss << query_id << "\t" << record.archive_time_ms << "\t" << record.user << "\t"
+         << record.pool << "\t" << record.duration_ms << "\t" << record.peak_mem_bytes
+         << "\t" << record.stmt << "\n";
+
+      Value query(kObjectType);
+      Value id(query_id.c_str(), document->GetAllocator());
+      query.AddMember("query_id", id, document->GetAllocator());
+      query.AddMember("archive_time_ms", record.archive_time_ms,
+          document->GetAllocator());
+      Value user(record.user.c_str(), document->GetAllocator());
+      query.AddMember("user", user, document->GetAllocator());
+      Value pool(record.pool.c_str(), document->GetAllocator());
+      query.AddMember("pool", pool, document->GetAllocator());
+      query.AddMember("duration_ms", record.duration_ms, document->GetAllocator());
+      query.AddMember("peak_mem_bytes", record.peak_mem_bytes, document->GetAllocator());
+      Value stmt(record.stmt.c_str(), document->GetAllocator());
+      query.AddMember("stmt", stmt, document->GetAllocator());
+      queries.PushBack(query, document->GetAllocator());
+    }
+  }
+  document->AddMember("queries", queries, document->GetAllocator());
+  document->AddMember(Webserver::ENABLE_RAW_JSON_KEY, true, document->GetAllocator());
+  Value contents(ss.str().c_str(), document->GetAllocator());
+  document->AddMember("contents", contents, document->GetAllocator());
+}
+
 void ImpalaServer::QueryStateToJson(const ImpalaServer::QueryStateRecord& record,
     Value* value, Document* document) {
   Value user(record.effective_user.c_str(), document->GetAllocator());
@@ -28,6 +28,7 @@
 #include <gutil/strings/substitute.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
+#include <snappy.h>
 #include <rapidjson/rapidjson.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
@@ -40,7 +41,10 @@
 #include "catalog/catalog-util.h"
 #include "common/logging.h"
 #include "common/version.h"
+#include "exec/catalog-op-executor.h"
 #include "exec/external-data-source-executor.h"
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
 #include "rpc/authentication.h"
 #include "rpc/thrift-util.h"
 #include "rpc/thrift-thread.h"
@@ -49,11 +53,17 @@
 #include "runtime/data-stream-mgr.h"
 #include "runtime/exec-env.h"
 #include "runtime/lib-cache.h"
+#include "runtime/row-batch.h"
 #include "runtime/timestamp-value.h"
 #include "runtime/tmp-file-mgr.h"
+#include "service/catalog-snapshot.h"
 #include "service/fragment-exec-state.h"
 #include "service/impala-internal-service.h"
+#include "service/loaded-table-cache.h"
 #include "service/query-exec-state.h"
+#include "service/prepared-statement-cache.h"
+#include "service/profile-archive.h"
+#include "service/query-result-cache.h"
 #include "scheduling/simple-scheduler.h"
 #include "util/bit-util.h"
 #include "util/cgroups-mgr.h"
@@ -69,6 +79,7 @@
 #include "util/string-parser.h"
 #include "util/summary-util.h"
 #include "util/uid-util.h"
+#include "util/url-coding.h"
 
 #include "gen-cpp/Types_types.h"
 #include "gen-cpp/ImpalaService.h"
@@ -84,6 +95,7 @@ using boost::algorithm::is_any_of;
 using boost::algorithm::istarts_with;
 using boost::algorithm::replace_all_copy;
 using boost::algorithm::split;
+using boost::algorithm::to_lower_copy;
 using boost::algorithm::token_compress_on;
 using boost::get_system_time;
 using boost::system_time;
@@ -143,6 +155,28 @@ DEFINE_int32(max_profile_log_files, 10, "Maximum number of profile log files to
     "retain. The most recent log files are retained. If set to 0, all log files "
     "are retained.");
 
+DEFINE_string(profile_archive_dir, "", "(Advanced) If not empty, the profiles of "
+    "completed queries are archived compressed in this directory, indexed by time, "
+    "user, pool, duration and peak memory. Archived profiles can be found on the "
+    "/archived_queries page and are shown by /query_profile after the queries left the "
+    "query log, also after restarts.");
+DEFINE_int64(max_profile_archive_size_mb, 1024, "(Advanced) The maximum size of the "
+    "profile archive in MB. The profiles of the oldest queries are deleted to stay "
+    "within the limit.");
+
+DEFINE_string(catalog_snapshot_dir, "", "(Advanced) If not empty, the impalad keeps a "
+    "compressed snapshot of the catalog topic in this directory and restores its catalog "
+    "from it on startup, so that it serves queries before the first catalog update from "
+    "the statestore arrives. The first full update is then compared with the snapshot "
+    "and only the objects that changed are loaded. Keeping the snapshot current "
+    "requires a copy of the catalog topic in memory.");
+DEFINE_int32(catalog_snapshot_interval_s, 300, "(Advanced) The interval, in seconds, at "
+    "which the snapshot in --catalog_snapshot_dir is rewritten if the catalog changed.");
+DEFINE_int32(catalog_loaded_tables_limit, 1000, "(Advanced) The maximum number of tables "
+    "whose metadata the impalad keeps if --catalog_topic_table_markers is true. The "
+    "metadata of the least recently used tables is dropped beyond the limit, and fetched "
+    "from the catalog service again when a query uses them.");
+
 DEFINE_int32(cancellation_thread_pool_size, 5,
     "(Advanced) Size of the thread-pool processing cancellations due to node failure");
 
@@ -177,6 +211,12 @@ DEFINE_string(local_nodemanager_url, "", "The URL of the local Yarn Node Manager
     "interface, used to detect if the Node Manager fails");
 DECLARE_bool(enable_rm);
 DECLARE_bool(compact_catalog_topic);
+DECLARE_bool(compress_catalog_topic);
+DECLARE_bool(catalog_topic_partition_entries);
+DECLARE_bool(catalog_topic_table_markers);
+DECLARE_int64(query_result_cache_capacity);
+DECLARE_int64(query_result_cache_max_entry_size);
+DECLARE_int64(prepared_statement_cache_capacity);
 
 namespace impala {
 
@@ -194,6 +234,12 @@ const string LINEAGE_LOG_FILE_PREFIX = "impala_lineage_log_1.0-";
 
 const uint32_t MAX_CANCELLATION_QUEUE_SIZE = 65536;
 
+// How long LoadTablesOnDemand() waits for the catalog service to load a table, and how
+// often it checks whether it is loaded. The frontend asks to load the table again after
+// a timeout.
+const int64_t TABLE_LOAD_TIMEOUT_MS = 2 * 60 * 1000;
+const int64_t TABLE_LOAD_POLL_INTERVAL_MS = 100;
+
 const string BEESWAX_SERVER_NAME = "beeswax-frontend";
 const string HS2_SERVER_NAME = "hiveserver2-frontend";
 
@@ -239,8 +285,23 @@ class CancellationWork {
   bool unregister_;
 };
 
+Status ImpalaServer::QueryResultSet::AddRows(const vector<ExprContext*>& exprs,
+    RowBatch* batch, int start_idx, int num_rows) {
+  vector<void*> row_values(exprs.size());
+  vector<int> scales(exprs.size());
+  for (int i = 0; i < exprs.size(); ++i) scales[i] = exprs[i]->root()->output_scale();
+  for (int i = start_idx; i < start_idx + num_rows; ++i) {
+    TupleRow* row = batch->GetRow(i);
+    for (int j = 0; j < exprs.size(); ++j) row_values[j] = exprs[j]->GetValue(row);
+    RETURN_IF_ERROR(AddOneRow(row_values, scales));
+  }
+  return Status::OK();
+}
+
 ImpalaServer::ImpalaServer(ExecEnv* exec_env)
-    : exec_env_(exec_env) {
+    : exec_env_(exec_env),
+      catalog_topic_entries_version_(0),
+      catalog_restored_from_snapshot_(false) {
   // Initialize default config
   InitializeConfigVariables();
 
@@ -262,11 +323,30 @@ ImpalaServer::ImpalaServer(ExecEnv* exec_env)
     }
   }
 
+  if (FLAGS_query_result_cache_capacity > 0) {
+    query_result_cache_.reset(new QueryResultCache(FLAGS_query_result_cache_capacity,
+        FLAGS_query_result_cache_max_entry_size));
+  }
+  if (FLAGS_prepared_statement_cache_capacity > 0) {
+    prepared_statement_cache_.reset(
+        new PreparedStatementCache(FLAGS_prepared_statement_cache_capacity));
+  }
+
   if (!InitProfileLogging().ok()) {
     LOG(ERROR) << "Query profile archival is disabled";
     FLAGS_log_query_to_file = false;
   }
 
+  if (!FLAGS_profile_archive_dir.empty()) {
+    profile_archive_.reset(new ProfileArchive(FLAGS_profile_archive_dir,
+        FLAGS_max_profile_archive_size_mb * 1024L * 1024L));
+    Status status = profile_archive_->Init();
+    if (!status.ok()) {
+      LOG(ERROR) << "Profile archive is disabled: " << status.GetDetail();
+      profile_archive_.reset();
+    }
+  }
+
   if (!InitAuditEventLogging().ok()) {
     CLEAN_EXIT_WITH_ERROR("Aborting Impala Server startup due to failure initializing "
         "audit event logging");
@@ -321,6 +401,19 @@ ImpalaServer::ImpalaServer(ExecEnv* exec_env)
 
   ABORT_IF_ERROR(ExternalDataSourceExecutor::InitJNI(exec_env->metrics()));
 
+  if (FLAGS_catalog_topic_table_markers) {
+    loaded_table_cache_.reset(new LoadedTableCache(FLAGS_catalog_loaded_tables_limit));
+  }
+
+  if (!FLAGS_catalog_snapshot_dir.empty()) {
+    catalog_snapshot_.reset(new CatalogSnapshot(FLAGS_catalog_snapshot_dir));
+    // Restore before registering for the catalog topic, so that the first update is
+    // compared with the snapshot.
+    RestoreCatalogFromSnapshot();
+    catalog_snapshot_thread_.reset(new Thread("impala-server", "catalog-snapshot",
+        bind<void>(&ImpalaServer::WriteCatalogSnapshots, this)));
+  }
+
   // Register the membership callback if required
   if (exec_env->subscriber() != NULL) {
     StatestoreSubscriber::UpdateCallback cb =
@@ -582,17 +675,35 @@ Status ImpalaServer::GetRuntimeProfileStr(const TUniqueId& query_id,
   {
     lock_guard<mutex> l(query_log_lock_);
     QueryLogIndex::const_iterator query_record = query_log_index_.find(query_id);
-    if (query_record == query_log_index_.end()) {
-      stringstream ss;
-      ss << "Query id " << PrintId(query_id) << " not found.";
-      return Status(ss.str());
-    }
-    if (base64_encoded) {
-      (*output) << query_record->second->encoded_profile_str;
-    } else {
-      (*output) << query_record->second->profile_str;
+    if (query_record != query_log_index_.end()) {
+      if (base64_encoded) {
+        (*output) << query_record->second->encoded_profile_str;
+      } else {
+        (*output) << query_record->second->profile_str;
+      }
+      return Status::OK();
     }
   }
+
+  // The query left the query log, search the profile archive.
+  if (profile_archive_ == NULL) {
+    stringstream ss;
+    ss << "Query id " << PrintId(query_id) << " not found.";
+    return Status(ss.str());
+  }
+  vector<uint8_t> archived_profile;
+  int64_t serialized_len;
+  RETURN_IF_ERROR(
+      profile_archive_->GetProfile(query_id, &archived_profile, &serialized_len));
+  if (base64_encoded) {
+    Base64Encode(archived_profile, output);
+  } else {
+    ObjectPool pool;
+    RuntimeProfile* profile;
+    RETURN_IF_ERROR(RuntimeProfile::CreateFromArchive(&pool, archived_profile.data(),
+        archived_profile.size(), serialized_len, &profile));
+    profile->PrettyPrint(output);
+  }
   return Status::OK();
 }
 
@@ -669,7 +780,38 @@ void ImpalaServer::LineageLoggerFlushThread() {
 }
 
 void ImpalaServer::ArchiveQuery(const QueryExecState& query) {
-  const string& encoded_profile_str = query.profile().SerializeToArchiveString();
+  vector<uint8_t> archived_profile;
+  int64_t serialized_len = 0;
+  Status archive_status = query.profile().SerializeToArchive(&archived_profile,
+      &serialized_len);
+  string encoded_profile_str;
+  if (archive_status.ok()) Base64Encode(archived_profile, &encoded_profile_str);
+
+  if (profile_archive_ != NULL && archive_status.ok()) {
+    ProfileArchive::QueryRecord archive_record;
+    archive_record.query_id = query.query_id();
+    archive_record.archive_time_ms = UnixMillis();
+    archive_record.user = query.effective_user();
+    const string* pool = query.summary_profile().GetInfoString("Request Pool");
+    if (pool != NULL) archive_record.pool = *pool;
+    archive_record.stmt = RedactCopy(query.sql_stmt());
+    double start_time;
+    double end_time;
+    if (query.start_time().ToSubsecondUnixTime(&start_time)
+        && query.end_time().ToSubsecondUnixTime(&end_time)) {
+      archive_record.duration_ms = max(0.0, (end_time - start_time) * 1000);
+    }
+    if (query.coord() != NULL) {
+      archive_record.peak_mem_bytes = query.coord()->max_per_host_peak_mem();
+    }
+    archive_status =
+        profile_archive_->Add(archive_record, archived_profile, serialized_len);
+    if (!archive_status.ok()) {
+      LOG_EVERY_N(WARNING, 1000) << "Could not archive query profile ("
+                                 << google::COUNTER << " attempts failed): "
+                                 << archive_status.GetDetail();
+    }
+  }
 
   // If there was an error initialising archival (e.g. directory is not writeable),
   // FLAGS_log_query_to_file will have been set to false
@@ -749,7 +891,8 @@ void ImpalaServer::AddPoolQueryOptions(TQueryCtx* ctx,
 
 Status ImpalaServer::Execute(TQueryCtx* query_ctx,
     shared_ptr<SessionState> session_state,
-    shared_ptr<QueryExecState>* exec_state) {
+    shared_ptr<QueryExecState>* exec_state,
+    const PreparedStmt* prepared_stmt) {
   PrepareQueryContext(query_ctx);
   ImpaladMetrics::IMPALA_SERVER_NUM_QUERIES->Increment(1L);
 
@@ -759,8 +902,8 @@ Status ImpalaServer::Execute(TQueryCtx* query_ctx,
   query_ctx->request.__set_redacted_stmt((const string) stmt);
 
   bool registered_exec_state;
-  Status status = ExecuteInternal(*query_ctx, session_state, &registered_exec_state,
-      exec_state);
+  Status status = ExecuteInternal(*query_ctx, prepared_stmt, session_state,
+      &registered_exec_state, exec_state);
   if (!status.ok() && registered_exec_state) {
     UnregisterQuery((*exec_state)->query_id(), false, &status);
   }
@@ -769,6 +912,7 @@ Status ImpalaServer::Execute(TQueryCtx* query_ctx,
 
 Status ImpalaServer::ExecuteInternal(
     const TQueryCtx& query_ctx,
+    const PreparedStmt* prepared_stmt,
     shared_ptr<SessionState> session_state,
     bool* registered_exec_state,
     shared_ptr<QueryExecState>* exec_state) {
@@ -803,14 +947,37 @@ Status ImpalaServer::ExecuteInternal(
     RETURN_IF_ERROR(RegisterQuery(session_state, *exec_state));
     *registered_exec_state = true;
 
-    RETURN_IF_ERROR((*exec_state)->UpdateQueryStatus(
-        exec_env_->frontend()->GetExecRequest(query_ctx, &result)));
-    (*exec_state)->query_events()->MarkEvent("Planning finished");
-    (*exec_state)->summary_profile()->AddEventSequence(
-        result.timeline.name, result.timeline);
+    string prepared_stmt_key;
+    bool reused_plan = false;
+    if (prepared_stmt != NULL && prepared_statement_cache_ != NULL) {
+      prepared_stmt_key = prepared_statement_cache_->GetKey(*prepared_stmt, query_ctx);
+      reused_plan = prepared_statement_cache_->Lookup(prepared_stmt_key, *prepared_stmt,
+          query_ctx, &result);
+    }
+    if (reused_plan) {
+      (*exec_state)->query_events()->MarkEvent("Reused plan of prepared statement");
+    } else {
+      RETURN_IF_ERROR((*exec_state)->UpdateQueryStatus(
+          exec_env_->frontend()->GetExecRequest(query_ctx, &result)));
+      if (!prepared_stmt_key.empty()) {
+        prepared_statement_cache_->Insert(prepared_stmt_key, *prepared_stmt, query_ctx,
+            result);
+      }
+      (*exec_state)->query_events()->MarkEvent("Planning finished");
+      (*exec_state)->summary_profile()->AddEventSequence(
+          result.timeline.name, result.timeline);
+    }
     if (result.__isset.result_set_metadata) {
       (*exec_state)->set_result_metadata(result.result_set_metadata);
     }
+    if (loaded_table_cache_ != NULL) {
+      for (const TAccessEvent& event: result.access_events) {
+        if (event.object_type == TCatalogObjectType::TABLE ||
+            event.object_type == TCatalogObjectType::VIEW) {
+          loaded_table_cache_->Touch(to_lower_copy(event.name));
+        }
+      }
+    }
   }
   VLOG(2) << "Execution request: " << ThriftDebugString(result);
 
@@ -1110,7 +1277,14 @@ void ImpalaServer::ReportExecStatus(
     // TODO: Re-enable logging when this only happens once per fragment.
     return;
   }
-  exec_state->coord()->UpdateFragmentExecStatus(params).SetTStatus(&return_val);
+  Coordinator* coord = exec_state->coord();
+  if (coord == NULL) {
+    // The query is being retried and its next attempt has no coordinator yet, so this
+    // report is from an instance of an earlier attempt.
+    Status::OK().SetTStatus(&return_val);
+    return;
+  }
+  coord->UpdateFragmentExecStatus(params).SetTStatus(&return_val);
 }
 
 void ImpalaServer::TransmitData(
@@ -1137,6 +1311,11 @@ void ImpalaServer::TransmitData(
     exec_env_->stream_mgr()->CloseSender(
         params.dest_fragment_instance_id, params.dest_node_id,
         params.sender_id).SetTStatus(&return_val);
+  } else if (exec_env_->stream_mgr()->IsRecvrClosed(
+      params.dest_fragment_instance_id, params.dest_node_id)) {
+    // Tell the sender to stop sending, e.g. because the exchange node reached its limit.
+    return_val.status.error_msgs.push_back(DataStreamMgr::RECVR_CLOSED_MSG);
+    return_val.status.__isset.error_msgs = true;
   }
 }
 
@@ -1233,129 +1412,463 @@ Status ImpalaServer::AuthorizeProxyUser(const string& user, const string& do_as_
   return Status(error_msg.str());
 }
 
+// Decompresses, if --compress_catalog_topic is true, and deserializes the value of a
+// catalog topic entry.
+template <class T>
+static Status DeserializeCatalogTopicValue(const string& value, T* object) {
+  string uncompressed_value;
+  const string* serialized_value = &value;
+  if (FLAGS_compress_catalog_topic) {
+    if (!snappy::Uncompress(value.data(), value.size(), &uncompressed_value)) {
+      return Status("Error decompressing catalog topic value");
+    }
+    serialized_value = &uncompressed_value;
+  }
+  uint32_t len = serialized_value->size();
+  return DeserializeThriftMsg(reinterpret_cast<const uint8_t*>(serialized_value->data()),
+      &len, FLAGS_compact_catalog_topic, object);
+}
+
+void ImpalaServer::UpdateCatalogTableEntries(const TTopicDelta& delta,
+    unordered_set<string>* changed_tables) {
+  if (!delta.is_delta) catalog_table_entries_.clear();
+  string table_entry_key;
+  int64_t partition_id;
+  for (const TTopicItem& item: delta.topic_entries) {
+    if (!ParseHdfsPartitionEntryKey(item.key, &table_entry_key, &partition_id)) continue;
+    catalog_table_entries_[table_entry_key].partition_values[partition_id] = item.value;
+    changed_tables->insert(table_entry_key);
+  }
+  for (const string& key: delta.topic_deletions) {
+    if (ParseHdfsPartitionEntryKey(key, &table_entry_key, &partition_id)) {
+      CatalogTableEntryMap::iterator entries =
+          catalog_table_entries_.find(table_entry_key);
+      if (entries == catalog_table_entries_.end()) continue;
+      entries->second.partition_values.erase(partition_id);
+      changed_tables->insert(table_entry_key);
+    } else {
+      // The deletions of the partitions of a dropped table precede its own deletion.
+      catalog_table_entries_.erase(key);
+      changed_tables->erase(key);
+    }
+  }
+}
+
+Status ImpalaServer::AddCachedPartitions(const string& table_entry_key,
+    TCatalogObject* catalog_object) {
+  CatalogTableEntryMap::const_iterator entries =
+      catalog_table_entries_.find(table_entry_key);
+  if (entries == catalog_table_entries_.end() ||
+      entries->second.partition_values.empty()) {
+    return Status::OK();
+  }
+  if (!catalog_object->table.__isset.hdfs_table) {
+    return Status(Substitute("Partitions received for non-HDFS table: $0",
+        table_entry_key));
+  }
+  map<int64_t, THdfsPartition>* partitions =
+      &catalog_object->table.hdfs_table.partitions;
+  for (const auto& partition_value: entries->second.partition_values) {
+    RETURN_IF_ERROR(DeserializeCatalogTopicValue(partition_value.second,
+        &(*partitions)[partition_value.first]));
+  }
+  return Status::OK();
+}
+
 void ImpalaServer::CatalogUpdateCallback(
     const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
     vector<TTopicDelta>* subscriber_topic_updates) {
   StatestoreSubscriber::TopicDeltaMap::const_iterator topic =
       incoming_topic_deltas.find(CatalogServer::IMPALA_CATALOG_TOPIC);
   if (topic == incoming_topic_deltas.end()) return;
-  const TTopicDelta& delta = topic->second;
+  const TTopicDelta* delta = &topic->second;
 
+  // The first full update after restoring the catalog from the snapshot only needs to
+  // apply the entries that changed since the snapshot was taken.
+  TTopicDelta snapshot_diff;
+  if (catalog_restored_from_snapshot_ && !delta->is_delta) {
+    catalog_restored_from_snapshot_ = false;
+    CatalogSnapshot::Diff(catalog_topic_entries_, *delta, &snapshot_diff);
+    LOG(INFO) << "Applying " << snapshot_diff.topic_entries.size() << " changed and "
+              << snapshot_diff.topic_deletions.size() << " deleted catalog topic "
+              << "entries of " << delta->topic_entries.size() << " to the catalog "
+              << "restored from " << catalog_snapshot_->path();
+    delta = &snapshot_diff;
+  }
 
   // Process any updates
-  if (delta.topic_entries.size() != 0 || delta.topic_deletions.size() != 0)  {
-    TUpdateCatalogCacheRequest update_req;
-    update_req.__set_is_delta(delta.is_delta);
-    // Process all Catalog updates (new and modified objects) and determine what the
-    // new catalog version will be.
-    int64_t new_catalog_version = catalog_update_info_.catalog_version;
-    for (const TTopicItem& item: delta.topic_entries) {
-      uint32_t len = item.value.size();
-      TCatalogObject catalog_object;
-      Status status = DeserializeThriftMsg(reinterpret_cast<const uint8_t*>(
-          item.value.data()), &len, FLAGS_compact_catalog_topic, &catalog_object);
+  if (delta->topic_entries.size() != 0 || delta->topic_deletions.size() != 0)  {
+    Status s = ApplyCatalogTopicDelta(*delta);
+    if (!s.ok()) {
+      LOG(ERROR) << "There was an error processing the impalad catalog update. Requesting"
+                 << " a full topic update to recover: " << s.GetDetail();
+      subscriber_topic_updates->push_back(TTopicDelta());
+      TTopicDelta& update = subscriber_topic_updates->back();
+      update.topic_name = CatalogServer::IMPALA_CATALOG_TOPIC;
+      update.__set_from_version(0L);
+      ImpaladMetrics::CATALOG_READY->set_value(false);
+      catalog_table_entries_.clear();
+      // Dropped all cached lib files (this behaves as if all functions and data
+      // sources are dropped).
+      LibCache::instance()->DropCache();
+      if (query_result_cache_ != NULL) query_result_cache_->InvalidateAll();
+      if (prepared_statement_cache_ != NULL) prepared_statement_cache_->InvalidateAll();
+    }
+  }
+
+  // Always update the minimum subscriber version for the catalog topic.
+  {
+    unique_lock<mutex> unique_lock(catalog_version_lock_);
+    min_subscriber_catalog_topic_version_ = delta->min_subscriber_topic_version;
+  }
+  catalog_version_update_cv_.notify_all();
+}
+
+Status ImpalaServer::ApplyCatalogTopicDelta(const TTopicDelta& delta) {
+  TUpdateCatalogCacheRequest update_req;
+  update_req.__set_is_delta(delta.is_delta);
+  // Process all Catalog updates (new and modified objects) and determine what the
+  // new catalog version will be.
+  int64_t new_catalog_version = catalog_update_info_.catalog_version;
+  // Keys of the tables whose cached partitions changed with this update. Tables that
+  // are not updated themselves are rebuilt from their cached entries below.
+  unordered_set<string> changed_tables;
+  if (FLAGS_catalog_topic_partition_entries) {
+    UpdateCatalogTableEntries(delta, &changed_tables);
+  }
+  string table_entry_key;
+  int64_t partition_id;
+  for (const TTopicItem& item: delta.topic_entries) {
+    if (FLAGS_catalog_topic_partition_entries &&
+        ParseHdfsPartitionEntryKey(item.key, &table_entry_key, &partition_id)) {
+      continue;
+    }
+    TCatalogObject catalog_object;
+    Status status = DeserializeCatalogTopicValue(item.value, &catalog_object);
+    if (!status.ok()) {
+      LOG(ERROR) << "Error deserializing item: " << status.GetDetail();
+      continue;
+    }
+    if (FLAGS_catalog_topic_partition_entries &&
+        catalog_object.type == TCatalogObjectType::TABLE) {
+      catalog_table_entries_[item.key].table_value = item.value;
+      changed_tables.erase(item.key);
+      status = AddCachedPartitions(item.key, &catalog_object);
       if (!status.ok()) {
-        LOG(ERROR) << "Error deserializing item: " << status.GetDetail();
+        LOG(ERROR) << "Error adding partitions to item: " << status.GetDetail();
         continue;
       }
-      if (catalog_object.type == TCatalogObjectType::CATALOG) {
-        update_req.__set_catalog_service_id(catalog_object.catalog.catalog_service_id);
-        new_catalog_version = catalog_object.catalog_version;
-      }
+    }
+    if (catalog_object.type == TCatalogObjectType::CATALOG) {
+      update_req.__set_catalog_service_id(catalog_object.catalog.catalog_service_id);
+      new_catalog_version = catalog_object.catalog_version;
+    }
 
-      // Refresh the lib cache entries of any added functions and data sources
-      if (catalog_object.type == TCatalogObjectType::FUNCTION) {
-        DCHECK(catalog_object.__isset.fn);
-        LibCache::instance()->SetNeedsRefresh(catalog_object.fn.hdfs_location);
-      }
-      if (catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
-        DCHECK(catalog_object.__isset.data_source);
-        LibCache::instance()->SetNeedsRefresh(catalog_object.data_source.hdfs_location);
+    // Refresh the lib cache entries of any added functions and data sources
+    if (catalog_object.type == TCatalogObjectType::FUNCTION) {
+      DCHECK(catalog_object.__isset.fn);
+      const TFunction& fn = catalog_object.fn;
+      LibCache::instance()->SetNeedsRefresh(fn.hdfs_location);
+      // Load the library of a function that was just created before the first query
+      // that calls it. A full update has all functions, most of which are never called.
+      if (delta.is_delta && fn.binary_type == TFunctionBinaryType::IR) {
+        LibCache::instance()->Prefetch(fn.hdfs_location, LibCache::TYPE_IR);
+      } else if (delta.is_delta && fn.binary_type == TFunctionBinaryType::NATIVE) {
+        LibCache::instance()->Prefetch(fn.hdfs_location, LibCache::TYPE_SO);
       }
+    }
+    if (catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
+      DCHECK(catalog_object.__isset.data_source);
+      LibCache::instance()->SetNeedsRefresh(catalog_object.data_source.hdfs_location);
+    }
+
+    update_req.updated_objects.push_back(catalog_object);
+  }
 
-      update_req.updated_objects.push_back(catalog_object);
+  // Rebuild the tables of which only partitions changed.
+  for (const string& key: changed_tables) {
+    CatalogTableEntryMap::const_iterator entries = catalog_table_entries_.find(key);
+    // The table may have been dropped or not be received yet.
+    if (entries == catalog_table_entries_.end() ||
+        entries->second.table_value.empty()) {
+      continue;
+    }
+    TCatalogObject catalog_object;
+    Status status =
+        DeserializeCatalogTopicValue(entries->second.table_value, &catalog_object);
+    if (status.ok()) status = AddCachedPartitions(key, &catalog_object);
+    if (!status.ok()) {
+      LOG(ERROR) << "Error rebuilding item: " << key << " " << status.GetDetail();
+      continue;
     }
+    update_req.updated_objects.push_back(catalog_object);
+  }
 
-    // We need to look up the dropped functions and data sources and remove them
-    // from the library cache. The data sent from the catalog service does not
-    // contain all the function metadata so we'll ask our local frontend for it. We
-    // need to do this before updating the catalog.
-    vector<TCatalogObject> dropped_objects;
+  // We need to look up the dropped functions and data sources and remove them
+  // from the library cache. The data sent from the catalog service does not
+  // contain all the function metadata so we'll ask our local frontend for it. We
+  // need to do this before updating the catalog.
+  vector<TCatalogObject> dropped_objects;
 
-    // Process all Catalog deletions (dropped objects). We only know the keys (object
-    // names) so must parse each key to determine the TCatalogObject.
-    for (const string& key: delta.topic_deletions) {
-      LOG(INFO) << "Catalog topic entry deletion: " << key;
-      TCatalogObject catalog_object;
-      Status status = TCatalogObjectFromEntryKey(key, &catalog_object);
-      if (!status.ok()) {
-        LOG(ERROR) << "Error parsing catalog topic entry deletion key: " << key << " "
-                   << "Error: " << status.GetDetail();
-        continue;
-      }
-      update_req.removed_objects.push_back(catalog_object);
-      if (catalog_object.type == TCatalogObjectType::FUNCTION ||
-          catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
-        TCatalogObject dropped_object;
-        if (exec_env_->frontend()->GetCatalogObject(
-                catalog_object, &dropped_object).ok()) {
-          // This object may have been dropped and re-created. To avoid removing the
-          // re-created object's entry from the cache verify the existing object has a
-          // catalog version <= the catalog version included in this statestore heartbeat.
-          if (dropped_object.catalog_version <= new_catalog_version) {
-            if (catalog_object.type == TCatalogObjectType::FUNCTION ||
-                catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
-              dropped_objects.push_back(dropped_object);
-            }
+  // Process all Catalog deletions (dropped objects). We only know the keys (object
+  // names) so must parse each key to determine the TCatalogObject.
+  for (const string& key: delta.topic_deletions) {
+    if (FLAGS_catalog_topic_partition_entries &&
+        ParseHdfsPartitionEntryKey(key, &table_entry_key, &partition_id)) {
+      continue;
+    }
+    LOG(INFO) << "Catalog topic entry deletion: " << key;
+    TCatalogObject catalog_object;
+    Status status = TCatalogObjectFromEntryKey(key, &catalog_object);
+    if (!status.ok()) {
+      LOG(ERROR) << "Error parsing catalog topic entry deletion key: " << key << " "
+                 << "Error: " << status.GetDetail();
+      continue;
+    }
+    update_req.removed_objects.push_back(catalog_object);
+    if (catalog_object.type == TCatalogObjectType::FUNCTION ||
+        catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
+      TCatalogObject dropped_object;
+      if (exec_env_->frontend()->GetCatalogObject(
+              catalog_object, &dropped_object).ok()) {
+        // This object may have been dropped and re-created. To avoid removing the
+        // re-created object's entry from the cache verify the existing object has a
+        // catalog version <= the catalog version included in this statestore heartbeat.
+        if (dropped_object.catalog_version <= new_catalog_version) {
+          if (catalog_object.type == TCatalogObjectType::FUNCTION ||
+              catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
+            dropped_objects.push_back(dropped_object);
           }
         }
-        // Nothing to do in error case.
       }
+      // Nothing to do in error case.
     }
+  }
 
-    // Call the FE to apply the changes to the Impalad Catalog.
-    TUpdateCatalogCacheResponse resp;
-    Status s = exec_env_->frontend()->UpdateCatalogCache(update_req, &resp);
-    if (!s.ok()) {
-      LOG(ERROR) << "There was an error processing the impalad catalog update. Requesting"
-                 << " a full topic update to recover: " << s.GetDetail();
-      subscriber_topic_updates->push_back(TTopicDelta());
-      TTopicDelta& update = subscriber_topic_updates->back();
-      update.topic_name = CatalogServer::IMPALA_CATALOG_TOPIC;
-      update.__set_from_version(0L);
-      ImpaladMetrics::CATALOG_READY->set_value(false);
-      // Dropped all cached lib files (this behaves as if all functions and data
-      // sources are dropped).
-      LibCache::instance()->DropCache();
+  // Call the FE to apply the changes to the Impalad Catalog.
+  TUpdateCatalogCacheResponse resp;
+  {
+    lock_guard<mutex> l(catalog_table_replace_lock_);
+    RETURN_IF_ERROR(exec_env_->frontend()->UpdateCatalogCache(update_req, &resp));
+    InvalidateLoadedTables(update_req);
+  }
+  InvalidateQueryResultCache(update_req);
+  InvalidatePreparedStatementCache(update_req);
+  {
+    unique_lock<mutex> unique_lock(catalog_version_lock_);
+    catalog_update_info_.catalog_version = new_catalog_version;
+    catalog_update_info_.catalog_topic_version = delta.to_version;
+    catalog_update_info_.catalog_service_id = resp.catalog_service_id;
+  }
+  ImpaladMetrics::CATALOG_READY->set_value(new_catalog_version > 0);
+  UpdateCatalogMetrics();
+  // Remove all dropped objects from the library cache.
+  // TODO: is this expensive? We'd like to process heartbeats promptly.
+  for (TCatalogObject& object: dropped_objects) {
+    if (object.type == TCatalogObjectType::FUNCTION) {
+      LibCache::instance()->RemoveEntry(object.fn.hdfs_location);
+    } else if (object.type == TCatalogObjectType::DATA_SOURCE) {
+      LibCache::instance()->RemoveEntry(object.data_source.hdfs_location);
     } else {
-      {
-        unique_lock<mutex> unique_lock(catalog_version_lock_);
-        catalog_update_info_.catalog_version = new_catalog_version;
-        catalog_update_info_.catalog_topic_version = delta.to_version;
-        catalog_update_info_.catalog_service_id = resp.catalog_service_id;
+      DCHECK(false);
+    }
+  }
+
+  if (catalog_snapshot_ != NULL) {
+    lock_guard<mutex> l(catalog_topic_entries_lock_);
+    CatalogSnapshot::ApplyDelta(delta, &catalog_topic_entries_);
+    catalog_topic_entries_version_ = delta.to_version;
+  }
+  return Status::OK();
+}
+
+void ImpalaServer::RestoreCatalogFromSnapshot() {
+  TTopicDelta delta;
+  Status status = catalog_snapshot_->Read(&delta);
+  if (status.ok()) {
+    // The topic version of the snapshot is not meaningful to the statestore that this
+    // impalad will receive updates from.
+    int64_t snapshot_version = delta.to_version;
+    delta.__set_to_version(0L);
+    status = ApplyCatalogTopicDelta(delta);
+    if (status.ok()) {
+      LOG(INFO) << "Restored " << delta.topic_entries.size() << " catalog topic "
+                << "entries of topic version " << snapshot_version << " from "
+                << catalog_snapshot_->path();
+      catalog_restored_from_snapshot_ = true;
+      return;
+    }
+  }
+  LOG(INFO) << "Not restoring the catalog from a snapshot: " << status.GetDetail();
+  // Start over from the first full topic update, as if there was no snapshot.
+  catalog_table_entries_.clear();
+  lock_guard<mutex> l(catalog_topic_entries_lock_);
+  catalog_topic_entries_.clear();
+}
+
+void ImpalaServer::WriteCatalogSnapshots() {
+  int64_t written_version = -1;
+  while (true) {
+    SleepForMs(FLAGS_catalog_snapshot_interval_s * 1000L);
+    // Copy the entries, so that catalog updates are not blocked while writing them.
+    CatalogSnapshot::TopicEntryMap entries;
+    int64_t version;
+    {
+      lock_guard<mutex> l(catalog_topic_entries_lock_);
+      // Don't replace the snapshot before the catalog topic was received.
+      if (catalog_topic_entries_version_ <= 0 ||
+          catalog_topic_entries_version_ == written_version) {
+        continue;
       }
-      ImpaladMetrics::CATALOG_READY->set_value(new_catalog_version > 0);
-      UpdateCatalogMetrics();
-      // Remove all dropped objects from the library cache.
-      // TODO: is this expensive? We'd like to process heartbeats promptly.
-      for (TCatalogObject& object: dropped_objects) {
-        if (object.type == TCatalogObjectType::FUNCTION) {
-          LibCache::instance()->RemoveEntry(object.fn.hdfs_location);
-        } else if (object.type == TCatalogObjectType::DATA_SOURCE) {
-          LibCache::instance()->RemoveEntry(object.data_source.hdfs_location);
-        } else {
-          DCHECK(false);
-        }
+      entries = catalog_topic_entries_;
+      version = catalog_topic_entries_version_;
+    }
+    Status status = catalog_snapshot_->Write(
+        CatalogServer::IMPALA_CATALOG_TOPIC, entries, version);
+    if (!status.ok()) {
+      LOG(WARNING) << "Could not write the catalog snapshot: " << status.GetDetail();
+      continue;
+    }
+    VLOG_QUERY << "Wrote " << entries.size() << " catalog topic entries of topic "
+               << "version " << version << " to " << catalog_snapshot_->path();
+    written_version = version;
+  }
+}
+
+Status ImpalaServer::LoadTablesOnDemand(const TPrioritizeLoadRequest& req,
+    TPrioritizeLoadResponse* result) {
+  DCHECK(loaded_table_cache_ != NULL);
+  CatalogOpExecutor catalog_op_executor(exec_env_, NULL, NULL);
+  RETURN_IF_ERROR(catalog_op_executor.PrioritizeLoad(req, result));
+  RETURN_IF_ERROR(Status(result->status));
+  for (const TCatalogObject& object_desc: req.object_descs) {
+    if (object_desc.type != TCatalogObjectType::TABLE) continue;
+    string table_name =
+        to_lower_copy(object_desc.table.db_name + "." + object_desc.table.tbl_name);
+    // The catalog service loads the table asynchronously. Tables that failed to load
+    // have a load status, which the frontend reports to the query.
+    TCatalogObject table;
+    int64_t wait_ms = 0;
+    while (true) {
+      RETURN_IF_ERROR(catalog_op_executor.GetCatalogObject(object_desc, &table));
+      if (table.table.__isset.metastore_table || table.table.__isset.load_status) break;
+      if (wait_ms >= TABLE_LOAD_TIMEOUT_MS) {
+        return Status(Substitute("Timed out waiting for the catalog service to load $0",
+            table_name));
       }
+      SleepForMs(TABLE_LOAD_POLL_INTERVAL_MS);
+      wait_ms += TABLE_LOAD_POLL_INTERVAL_MS;
+    }
+
+    lock_guard<mutex> l(catalog_table_replace_lock_);
+    bool replaced;
+    RETURN_IF_ERROR(ReplaceCatalogTable(table, &replaced));
+    // A newer marker of the table was received while it was loaded. The frontend will
+    // load it again.
+    if (!replaced) continue;
+    VLOG_QUERY << "Loaded table " << table_name << "@" << table.catalog_version
+               << " on demand";
+    vector<LoadedTableCache::TableVersion> evicted;
+    loaded_table_cache_->Add(table_name, table.catalog_version, &evicted);
+    for (const LoadedTableCache::TableVersion& evicted_table: evicted) {
+      TCatalogObject marker;
+      marker.__set_type(TCatalogObjectType::TABLE);
+      marker.__set_catalog_version(evicted_table.second);
+      size_t dot = evicted_table.first.find('.');
+      DCHECK_NE(dot, string::npos);
+      marker.table.__set_db_name(evicted_table.first.substr(0, dot));
+      marker.table.__set_tbl_name(evicted_table.first.substr(dot + 1));
+      marker.__isset.table = true;
+      RETURN_IF_ERROR(ReplaceCatalogTable(marker, &replaced));
+      VLOG_QUERY << "Evicted table " << evicted_table.first << "@"
+                 << evicted_table.second;
     }
   }
+  return Status::OK();
+}
 
-  // Always update the minimum subscriber version for the catalog topic.
-  {
-    unique_lock<mutex> unique_lock(catalog_version_lock_);
-    min_subscriber_catalog_topic_version_ = delta.min_subscriber_topic_version;
+Status ImpalaServer::ReplaceCatalogTable(const TCatalogObject& table, bool* replaced) {
+  TCatalogObject table_desc;
+  table_desc.__set_type(TCatalogObjectType::TABLE);
+  table_desc.table.__set_db_name(table.table.db_name);
+  table_desc.table.__set_tbl_name(table.table.tbl_name);
+  table_desc.__isset.table = true;
+  TCatalogObject existing;
+  bool exists = exec_env_->frontend()->GetCatalogObject(table_desc, &existing).ok();
+  *replaced = !exists || existing.catalog_version <= table.catalog_version;
+  if (!*replaced) return Status::OK();
+  TUpdateCatalogCacheResponse resp;
+  if (exists && existing.catalog_version == table.catalog_version) {
+    // The frontend only adds objects with newer versions than the objects they
+    // replace, and the metadata and the marker of a table have the same version, so
+    // remove the table first. Queries that are planned in between fail to resolve it.
+    TUpdateCatalogCacheRequest remove_req;
+    remove_req.__set_is_delta(true);
+    remove_req.removed_objects.push_back(existing);
+    RETURN_IF_ERROR(exec_env_->frontend()->UpdateCatalogCache(remove_req, &resp));
+  }
+  TUpdateCatalogCacheRequest add_req;
+  add_req.__set_is_delta(true);
+  add_req.updated_objects.push_back(table);
+  return exec_env_->frontend()->UpdateCatalogCache(add_req, &resp);
+}
+
+void ImpalaServer::InvalidateLoadedTables(const TUpdateCatalogCacheRequest& update_req) {
+  if (loaded_table_cache_ == NULL) return;
+  // A full update replaces all tables with markers.
+  if (!update_req.is_delta) {
+    loaded_table_cache_->Clear();
+    return;
   }
-  catalog_version_update_cv_.notify_all();
+  for (const TCatalogObject& object: update_req.updated_objects) {
+    if (object.type != TCatalogObjectType::TABLE) continue;
+    loaded_table_cache_->Invalidate(
+        to_lower_copy(object.table.db_name + "." + object.table.tbl_name),
+        object.catalog_version);
+  }
+  for (const TCatalogObject& object: update_req.removed_objects) {
+    if (object.type != TCatalogObjectType::TABLE) continue;
+    loaded_table_cache_->Remove(
+        to_lower_copy(object.table.db_name + "." + object.table.tbl_name));
+  }
+}
+
+void ImpalaServer::InvalidateQueryResultCache(
+    const TUpdateCatalogCacheRequest& update_req) {
+  if (query_result_cache_ == NULL) return;
+  // A full update may replace any object.
+  if (!update_req.is_delta) {
+    query_result_cache_->InvalidateAll();
+    return;
+  }
+  for (int i = 0; i < 2; ++i) {
+    const vector<TCatalogObject>& objects =
+        i == 0 ? update_req.updated_objects : update_req.removed_objects;
+    for (const TCatalogObject& object: objects) {
+      if (object.type == TCatalogObjectType::TABLE ||
+          object.type == TCatalogObjectType::VIEW) {
+        DCHECK(object.__isset.table);
+        query_result_cache_->InvalidateTable(
+            to_lower_copy(object.table.db_name + "." + object.table.tbl_name));
+      } else if (object.type == TCatalogObjectType::DATABASE ||
+          object.type == TCatalogObjectType::FUNCTION) {
+        // Dropping a database drops its tables, and a changed function may change the
+        // results of any query that calls it. Both are rare.
+        query_result_cache_->InvalidateAll();
+        return;
+      }
+    }
+  }
+}
+
+void ImpalaServer::InvalidatePreparedStatementCache(
+    const TUpdateCatalogCacheRequest& update_req) {
+  if (prepared_statement_cache_ == NULL) return;
+  if (update_req.is_delta && update_req.updated_objects.empty() &&
+      update_req.removed_objects.empty()) {
+    return;
+  }
+  prepared_statement_cache_->InvalidateAll();
 }
 
 Status ImpalaServer::ProcessCatalogUpdateResult(
@@ -1413,6 +1926,8 @@ Status ImpalaServer::ProcessCatalogUpdateResult(
     Status status = exec_env_->frontend()->UpdateCatalogCache(update_req, &resp);
     if (!status.ok()) LOG(ERROR) << status.GetDetail();
     RETURN_IF_ERROR(status);
+    InvalidateQueryResultCache(update_req);
+    InvalidatePreparedStatementCache(update_req);
     if (!wait_for_all_subscribers) return Status::OK();
   }
 
@@ -30,6 +30,7 @@
 #include "gen-cpp/Frontend_types.h"
 #include "rpc/thrift-server.h"
 #include "common/status.h"
+#include "service/catalog-snapshot.h"
 #include "service/frontend.h"
 #include "service/query-options.h"
 #include "util/metrics.h"
@@ -50,6 +51,13 @@ class ExecEnv;
 class DataSink;
 class CancellationWork;
 class Coordinator;
+class ExprContext;
+class LoadedTableCache;
+class PreparedStatementCache;
+struct PreparedStmt;
+class ProfileArchive;
+class QueryResultCache;
+class RowBatch;
 class RowDescriptor;
 class TCatalogUpdate;
 class TPlanExecRequest;
@@ -238,6 +246,29 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   void CatalogUpdateCallback(const StatestoreSubscriber::TopicDeltaMap& topic_deltas,
       std::vector<TTopicDelta>* topic_updates);
 
+  /// Applies the entries and deletions of the catalog topic update 'delta' to the
+  /// frontend's catalog. Returns an error if the frontend failed to apply them, in which
+  /// case the catalog must be rebuilt from a full topic update.
+  Status ApplyCatalogTopicDelta(const TTopicDelta& delta);
+
+  /// Applies the snapshot in --catalog_snapshot_dir, if there is one, to the frontend's
+  /// catalog. Called on startup before the catalog topic is subscribed to.
+  void RestoreCatalogFromSnapshot();
+
+  /// Run by catalog_snapshot_thread_. Writes catalog_topic_entries_ to the snapshot
+  /// every --catalog_snapshot_interval_s if they changed.
+  void WriteCatalogSnapshots();
+
+  /// Loads the metadata of the tables in 'req' from the catalog service into the
+  /// frontend's catalog, if --catalog_topic_table_markers is true. Called by the
+  /// frontend for the unloaded tables that a query uses, instead of only asking the
+  /// catalog service to prioritize their loading, since their metadata is never
+  /// published in the catalog topic. Waits until the catalog service loaded the tables.
+  /// Evicts the least recently used tables beyond --catalog_loaded_tables_limit from the
+  /// frontend's catalog.
+  Status LoadTablesOnDemand(const TPrioritizeLoadRequest& req,
+      TPrioritizeLoadResponse* result);
+
   /// Returns true if Impala is offline (and not accepting queries), false otherwise.
   bool IsOffline() {
     boost::lock_guard<boost::mutex> l(is_offline_lock_);
@@ -274,6 +305,12 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
     /// Returns 0 if the given range is out of bounds of the other result set.
     virtual int AddRows(const QueryResultSet* other, int start_idx, int num_rows) = 0;
 
+    /// Adds the rows [start_idx, start_idx + num_rows) of 'batch' as the values of
+    /// 'exprs'. The default adds the rows one at a time with AddOneRow(); result sets
+    /// that store their values by column convert each column in bulk instead.
+    virtual Status AddRows(const std::vector<ExprContext*>& exprs, RowBatch* batch,
+        int start_idx, int num_rows);
+
     /// Returns the approximate size of this result set in bytes.
     int64_t ByteSize() { return ByteSize(0, size()); }
 
@@ -282,6 +319,10 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
 
     /// Returns the size of this result set in number of rows.
     virtual size_t size() = 0;
+
+    /// Returns a new, empty result set of the same type with 'metadata', which must
+    /// outlive it, that owns its rows. The caller owns the returned result set.
+    virtual QueryResultSet* CreateEmpty(const TResultSetMetadata& metadata) = 0;
   };
 
   /// Result set implementations for Beeswax and HS2
@@ -329,12 +370,16 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   /// been checked out.
   /// query_session_state is a snapshot of session state that changes when the
   /// query was run. (e.g. default database).
+  /// If the query is an execution of a prepared statement, 'prepared_stmt' holds its
+  /// template and parameters, which are already bound to query_ctx->request.stmt.
   Status Execute(TQueryCtx* query_ctx,
                  boost::shared_ptr<SessionState> session_state,
-                 boost::shared_ptr<QueryExecState>* exec_state);
+                 boost::shared_ptr<QueryExecState>* exec_state,
+                 const PreparedStmt* prepared_stmt = NULL);
 
   /// Implements Execute() logic, but doesn't unregister query on error.
   Status ExecuteInternal(const TQueryCtx& query_ctx,
+                         const PreparedStmt* prepared_stmt,
                          boost::shared_ptr<SessionState> session_state,
                          bool* registered_exec_state,
                          boost::shared_ptr<QueryExecState>* exec_state);
@@ -460,6 +505,25 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   void InflightQueryIdsUrlCallback(const Webserver::ArgumentMap& args,
       rapidjson::Document* document);
 
+  /// Webserver callback for /archived_queries, which lists the queries in the profile
+  /// archive, most recent first. The optional arguments 'user', 'pool',
+  /// 'min_time_ms' and 'max_time_ms' (Unix milliseconds), 'min_duration_ms',
+  /// 'min_peak_mem_bytes' and 'limit' (default 100) select the queries. They are
+  /// printed as text in 'contents' and as a list:
+  /// "queries": [
+  /// {
+  ///   "query_id": "6242f69b02e4d609:ac84df1fbb0e16a3",
+  ///   "archive_time_ms": 1466000000000,
+  ///   "user": "alice",
+  ///   "pool": "root.default",
+  ///   "duration_ms": 1234,
+  ///   "peak_mem_bytes": 1048576,
+  ///   "stmt": "select ..."
+  /// }]
+  /// The profiles are shown by /query_profile.
+  void ArchivedQueriesUrlCallback(const Webserver::ArgumentMap& args,
+      rapidjson::Document* document);
+
   /// Json callback for /sessions, which prints a table of active client sessions.
   /// "sessions": [
   /// {
@@ -1010,6 +1074,92 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   /// The version information from the last successfull call to UpdateCatalog().
   CatalogUpdateVersionInfo catalog_update_info_;
 
+  /// The cached topic entry values of the HDFS tables and their partitions if
+  /// --catalog_topic_partition_entries is true. The catalogd publishes the partitions of
+  /// a table as separate topic entries, which are merged back into their table before it
+  /// is passed to the frontend. Only accessed by CatalogUpdateCallback().
+  struct CatalogTableEntries {
+    /// Value of the topic entry of the table, without its partitions.
+    std::string table_value;
+    /// Values of the topic entries of the partitions, by partition id.
+    std::map<int64_t, std::string> partition_values;
+  };
+
+  /// Map from table topic entry key to the table's cached topic entries.
+  typedef boost::unordered_map<std::string, CatalogTableEntries> CatalogTableEntryMap;
+  CatalogTableEntryMap catalog_table_entries_;
+
+  /// Updates catalog_table_entries_ with the partition entries and deletions of 'delta',
+  /// and with the deletions of tables. Inserts the keys of tables whose partitions
+  /// changed into 'changed_tables'.
+  void UpdateCatalogTableEntries(const TTopicDelta& delta,
+      boost::unordered_set<std::string>* changed_tables);
+
+  /// Adds the cached partitions of the table with topic entry key 'table_entry_key' to
+  /// 'catalog_object'.
+  Status AddCachedPartitions(const std::string& table_entry_key,
+      TCatalogObject* catalog_object);
+
+  /// The snapshot of the catalog topic on local disk. NULL if --catalog_snapshot_dir is
+  /// empty.
+  boost::scoped_ptr<CatalogSnapshot> catalog_snapshot_;
+
+  /// Thread that runs WriteCatalogSnapshots() if catalog_snapshot_ is not NULL.
+  boost::scoped_ptr<Thread> catalog_snapshot_thread_;
+
+  /// Protects catalog_topic_entries_ and catalog_topic_entries_version_, which are only
+  /// modified by the thread that applies catalog updates, so that thread doesn't need to
+  /// hold the lock while reading them.
+  boost::mutex catalog_topic_entries_lock_;
+
+  /// All entries of the catalog topic as of topic version
+  /// catalog_topic_entries_version_, if catalog_snapshot_ is not NULL.
+  CatalogSnapshot::TopicEntryMap catalog_topic_entries_;
+  int64_t catalog_topic_entries_version_;
+
+  /// True if the catalog was restored from the snapshot and no full topic update was
+  /// received since. Only accessed by CatalogUpdateCallback() and on startup.
+  bool catalog_restored_from_snapshot_;
+
+  /// The tables that LoadTablesOnDemand() loaded into the frontend's catalog. NULL if
+  /// --catalog_topic_table_markers is false.
+  boost::scoped_ptr<LoadedTableCache> loaded_table_cache_;
+
+  /// Serializes the replacement of tables in the frontend's catalog by
+  /// LoadTablesOnDemand() with the application of catalog topic updates, so that
+  /// neither replaces a newer version of a table written by the other.
+  boost::mutex catalog_table_replace_lock_;
+
+  /// Replaces the table in the frontend's catalog with 'table', which is either its
+  /// metadata or a marker from the catalog topic, unless the frontend has a newer
+  /// version of it. Sets 'replaced' to false in that case. The caller must hold
+  /// catalog_table_replace_lock_.
+  Status ReplaceCatalogTable(const TCatalogObject& table, bool* replaced);
+
+  /// Removes the tables that 'update_req' changed from loaded_table_cache_, after it was
+  /// applied to the frontend's catalog, which replaced their metadata with markers.
+  void InvalidateLoadedTables(const TUpdateCatalogCacheRequest& update_req);
+
+  /// Cache of the results of repeated queries. NULL if --query_result_cache_capacity
+  /// is 0.
+  boost::scoped_ptr<QueryResultCache> query_result_cache_;
+
+  /// Evicts the results of queries from query_result_cache_ that read objects that are
+  /// changed by 'update_req', after it was applied to the local catalog cache.
+  void InvalidateQueryResultCache(const TUpdateCatalogCacheRequest& update_req);
+
+  /// Plans of prepared statements that HS2 clients execute repeatedly. NULL if
+  /// --prepared_statement_cache_capacity is 0.
+  boost::scoped_ptr<PreparedStatementCache> prepared_statement_cache_;
+
+  /// Evicts all plans from prepared_statement_cache_ if 'update_req' changes any
+  /// catalog object, after it was applied to the local catalog cache.
+  void InvalidatePreparedStatementCache(const TUpdateCatalogCacheRequest& update_req);
+
+  /// The profiles of completed queries on local disk. NULL if --profile_archive_dir is
+  /// empty or the archive could not be opened.
+  boost::scoped_ptr<ProfileArchive> profile_archive_;
+
   /// The current minimum topic version processed across all subscribers of the catalog
   /// topic. Used to determine when other nodes have successfully processed a catalog
   /// update. Updated with each catalog topic heartbeat from the statestore.
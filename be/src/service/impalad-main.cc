@@ -23,6 +23,7 @@
 #include "common/init.h"
 #include "exec/hbase-table-scanner.h"
 #include "exec/hbase-table-writer.h"
+#include "exec/hdfs-parquet-scanner.h"
 #include "exprs/hive-udf-call.h"
 #include "runtime/hbase-table.h"
 #include "codegen/llvm-codegen.h"
@@ -84,6 +85,7 @@ int ImpaladMain(int argc, char** argv) {
     ShutdownLogging();
     exit(1);
   }
+  HdfsParquetScanner::InitPageCache(exec_env.process_mem_tracker());
 
   // this blocks until the beeswax and hs2 servers terminate
   ABORT_IF_ERROR(beeswax_server->Start());
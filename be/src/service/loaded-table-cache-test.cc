@@ -0,0 +1,85 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/loaded-table-cache.h"
+
+#include <gtest/gtest.h>
+
+#include "common/names.h"
+
+using namespace impala;
+
+namespace impala {
+
+TEST(LoadedTableCacheTest, EvictLeastRecentlyUsed) {
+  LoadedTableCache cache(2);
+  vector<LoadedTableCache::TableVersion> evicted;
+  cache.Add("db.t1", 1, &evicted);
+  cache.Add("db.t2", 2, &evicted);
+  EXPECT_TRUE(evicted.empty());
+  EXPECT_EQ(cache.size(), 2);
+
+  // Using t1 makes t2 the least recently used table.
+  cache.Touch("db.t1");
+  cache.Touch("db.unknown");
+  cache.Add("db.t3", 3, &evicted);
+  ASSERT_EQ(evicted.size(), 1);
+  EXPECT_EQ(evicted[0].first, "db.t2");
+  EXPECT_EQ(evicted[0].second, 2);
+  EXPECT_EQ(cache.size(), 2);
+
+  // Adding a cached table again replaces its version and doesn't evict.
+  evicted.clear();
+  cache.Add("db.t1", 4, &evicted);
+  EXPECT_TRUE(evicted.empty());
+  cache.Add("db.t4", 5, &evicted);
+  ASSERT_EQ(evicted.size(), 1);
+  EXPECT_EQ(evicted[0].first, "db.t3");
+}
+
+TEST(LoadedTableCacheTest, ZeroCapacity) {
+  // The table that was just loaded is never evicted.
+  LoadedTableCache cache(0);
+  vector<LoadedTableCache::TableVersion> evicted;
+  cache.Add("db.t1", 1, &evicted);
+  EXPECT_EQ(cache.size(), 1);
+  cache.Add("db.t2", 2, &evicted);
+  ASSERT_EQ(evicted.size(), 1);
+  EXPECT_EQ(evicted[0].first, "db.t1");
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST(LoadedTableCacheTest, Invalidate) {
+  LoadedTableCache cache(10);
+  vector<LoadedTableCache::TableVersion> evicted;
+  cache.Add("db.t1", 10, &evicted);
+  cache.Add("db.t2", 10, &evicted);
+  // A marker of the loaded version doesn't invalidate the table.
+  EXPECT_FALSE(cache.Invalidate("db.t1", 10));
+  EXPECT_FALSE(cache.Invalidate("db.unknown", 10));
+  EXPECT_TRUE(cache.Invalidate("db.t1", 11));
+  EXPECT_EQ(cache.size(), 1);
+  cache.Remove("db.t2");
+  EXPECT_EQ(cache.size(), 0);
+  cache.Add("db.t3", 12, &evicted);
+  cache.Clear();
+  EXPECT_EQ(cache.size(), 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,73 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/loaded-table-cache.h"
+
+#include <boost/thread/locks.hpp>
+
+#include "common/names.h"
+
+using namespace impala;
+
+void LoadedTableCache::Add(const string& table_name, int64_t version,
+    vector<TableVersion>* evicted) {
+  lock_guard<mutex> l(lock_);
+  TableMap::iterator it = tables_.find(table_name);
+  if (it != tables_.end()) {
+    lru_list_.erase(it->second);
+    tables_.erase(it);
+  }
+  tables_[table_name] =
+      lru_list_.insert(lru_list_.end(), TableVersion(table_name, version));
+  while (static_cast<int>(tables_.size()) > capacity_ && lru_list_.size() > 1) {
+    evicted->push_back(lru_list_.front());
+    tables_.erase(lru_list_.front().first);
+    lru_list_.pop_front();
+  }
+}
+
+void LoadedTableCache::Touch(const string& table_name) {
+  lock_guard<mutex> l(lock_);
+  TableMap::iterator it = tables_.find(table_name);
+  if (it == tables_.end()) return;
+  lru_list_.splice(lru_list_.end(), lru_list_, it->second);
+}
+
+bool LoadedTableCache::Invalidate(const string& table_name, int64_t version) {
+  lock_guard<mutex> l(lock_);
+  TableMap::iterator it = tables_.find(table_name);
+  if (it == tables_.end() || it->second->second >= version) return false;
+  lru_list_.erase(it->second);
+  tables_.erase(it);
+  return true;
+}
+
+void LoadedTableCache::Remove(const string& table_name) {
+  lock_guard<mutex> l(lock_);
+  TableMap::iterator it = tables_.find(table_name);
+  if (it == tables_.end()) return;
+  lru_list_.erase(it->second);
+  tables_.erase(it);
+}
+
+void LoadedTableCache::Clear() {
+  lock_guard<mutex> l(lock_);
+  lru_list_.clear();
+  tables_.clear();
+}
+
+int LoadedTableCache::size() {
+  lock_guard<mutex> l(lock_);
+  return tables_.size();
+}
@@ -0,0 +1,79 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_SERVICE_LOADED_TABLE_CACHE_H
+#define IMPALA_SERVICE_LOADED_TABLE_CACHE_H
+
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace impala {
+
+/// Tracks the tables whose metadata an impalad fetched from the catalog service on
+/// demand, enabled by --catalog_topic_table_markers, in least recently used order. The
+/// cache only holds the names and catalog versions of the tables; their metadata is
+/// held by the frontend's catalog. Adding a table beyond the capacity evicts the least
+/// recently used tables, which the caller replaces with markers in the frontend.
+/// Table names are "<db>.<table>" in lower case.
+/// This class is thread-safe.
+class LoadedTableCache {
+ public:
+  /// A table name and its catalog version.
+  typedef std::pair<std::string, int64_t> TableVersion;
+
+  /// Holds at most 'capacity' tables.
+  explicit LoadedTableCache(int capacity) : capacity_(capacity) { }
+
+  /// Adds 'table_name', loaded at catalog version 'version', as the most recently used
+  /// table, replacing an existing entry. Appends the evicted tables to 'evicted'.
+  void Add(const std::string& table_name, int64_t version,
+      std::vector<TableVersion>* evicted);
+
+  /// Marks 'table_name' as the most recently used table, if it is cached.
+  void Touch(const std::string& table_name);
+
+  /// Removes 'table_name' if it was cached at a version older than 'version', i.e. the
+  /// frontend replaced it with a newer marker. Returns true if it was removed.
+  bool Invalidate(const std::string& table_name, int64_t version);
+
+  /// Removes 'table_name' if it is cached.
+  void Remove(const std::string& table_name);
+
+  /// Removes all tables.
+  void Clear();
+
+  int size();
+
+ private:
+  const int capacity_;
+
+  /// Protects all members below.
+  boost::mutex lock_;
+
+  /// The least recently used table is at the beginning of the list.
+  typedef std::list<TableVersion> LruList;
+  LruList lru_list_;
+
+  /// Maps each table name to its entry in 'lru_list_'.
+  typedef boost::unordered_map<std::string, LruList::iterator> TableMap;
+  TableMap tables_;
+};
+
+}
+
+#endif
@@ -0,0 +1,163 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/prepared-statement-cache.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "runtime/types.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+namespace impala {
+
+// Returns the plan of "select ... where c = <value>" with a literal of 'type'.
+TExecRequest MakeExecRequest(int64_t value, PrimitiveType type = TYPE_BIGINT) {
+  TExprNode literal;
+  literal.__set_node_type(TExprNodeType::INT_LITERAL);
+  literal.__set_type(ColumnType(type).ToThrift());
+  literal.int_literal.__set_value(value);
+  literal.__isset.int_literal = true;
+  TExpr conjunct;
+  conjunct.nodes.push_back(literal);
+
+  TPlanNode scan;
+  scan.__set_node_type(TPlanNodeType::HDFS_SCAN_NODE);
+  scan.conjuncts.push_back(conjunct);
+  TPlanFragment fragment;
+  fragment.plan.nodes.push_back(scan);
+
+  TExecRequest request;
+  request.__set_stmt_type(TStmtType::QUERY);
+  request.query_exec_request.fragments.push_back(fragment);
+  request.__isset.query_exec_request = true;
+  return request;
+}
+
+// Returns the value of the literal of a plan returned by MakeExecRequest().
+int64_t GetLiteral(const TExecRequest& request) {
+  return request.query_exec_request.fragments[0].plan.nodes[0].conjuncts[0].nodes[0]
+      .int_literal.value;
+}
+
+PreparedStmt MakePreparedStmt(const string& param) {
+  PreparedStmt prepared_stmt;
+  prepared_stmt.stmt_template = "select a from t where c = ?";
+  prepared_stmt.params.push_back(param);
+  return prepared_stmt;
+}
+
+TEST(PreparedStatementCache, ParseParams) {
+  map<string, string> conf_overlay;
+  vector<string> params;
+  conf_overlay["impala.resultset.cache.size"] = "100";
+  ASSERT_TRUE(PreparedStatementCache::ParseParams(conf_overlay, &params).ok());
+  EXPECT_TRUE(params.empty());
+
+  conf_overlay["impala.prepared.param.2"] = "'b'";
+  conf_overlay["impala.prepared.param.1"] = "-10";
+  ASSERT_TRUE(PreparedStatementCache::ParseParams(conf_overlay, &params).ok());
+  ASSERT_EQ(params.size(), 2);
+  EXPECT_EQ(params[0], "-10");
+  EXPECT_EQ(params[1], "'b'");
+
+  conf_overlay["impala.prepared.param.4"] = "1";
+  EXPECT_FALSE(PreparedStatementCache::ParseParams(conf_overlay, &params).ok());
+  conf_overlay.erase("impala.prepared.param.4");
+  conf_overlay["impala.prepared.param.3"] = "'a' or true or 'b'";
+  EXPECT_FALSE(PreparedStatementCache::ParseParams(conf_overlay, &params).ok());
+  conf_overlay["impala.prepared.param.3"] = "1.5";
+  EXPECT_FALSE(PreparedStatementCache::ParseParams(conf_overlay, &params).ok());
+}
+
+TEST(PreparedStatementCache, BindStmt) {
+  vector<string> params;
+  params.push_back("1");
+  params.push_back("'x'");
+  string stmt;
+  ASSERT_TRUE(PreparedStatementCache::BindStmt(
+      "select '?', `?` from t where a = ? -- b = ?\nand c = ? /* ? */", params,
+      &stmt).ok());
+  EXPECT_EQ(stmt, "select '?', `?` from t where a = 1 -- b = ?\nand c = 'x' /* ? */");
+  EXPECT_FALSE(PreparedStatementCache::BindStmt("select ?", params, &stmt).ok());
+  EXPECT_FALSE(PreparedStatementCache::BindStmt("select ?, ?, ?", params, &stmt).ok());
+}
+
+TEST(PreparedStatementCache, LookupAndInsert) {
+  PreparedStatementCache cache(10);
+  TQueryCtx query_ctx;
+  TExecRequest result;
+  PreparedStmt stmt1 = MakePreparedStmt("1");
+  string key = cache.GetKey(stmt1, query_ctx);
+  EXPECT_FALSE(cache.Lookup(key, stmt1, query_ctx, &result));
+
+  // The plan of the first execution is not reused until a second execution confirmed
+  // it.
+  cache.Insert(key, stmt1, query_ctx, MakeExecRequest(1));
+  EXPECT_EQ(cache.size(), 1);
+  PreparedStmt stmt2 = MakePreparedStmt("2");
+  EXPECT_FALSE(cache.Lookup(key, stmt2, query_ctx, &result));
+  cache.Insert(key, stmt2, query_ctx, MakeExecRequest(2));
+
+  PreparedStmt stmt3 = MakePreparedStmt("3");
+  query_ctx.__set_now_string("now");
+  ASSERT_TRUE(cache.Lookup(key, stmt3, query_ctx, &result));
+  EXPECT_EQ(GetLiteral(result), 3);
+  EXPECT_EQ(result.query_exec_request.query_ctx.now_string, "now");
+
+  // Parameters that don't fit the planned literal's type are planned.
+  EXPECT_FALSE(cache.Lookup(key, MakePreparedStmt("'3'"), query_ctx, &result));
+
+  cache.InvalidateAll();
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_NE(cache.GetKey(stmt3, query_ctx), key);
+}
+
+TEST(PreparedStatementCache, NotReusable) {
+  PreparedStatementCache cache(10);
+  TQueryCtx query_ctx;
+  TExecRequest result;
+  PreparedStmt stmt1 = MakePreparedStmt("1");
+  PreparedStmt stmt2 = MakePreparedStmt("2");
+  PreparedStmt stmt3 = MakePreparedStmt("3");
+
+  // The parameter is not in the plan, e.g. because it was used to prune partitions.
+  string key = cache.GetKey(stmt1, query_ctx);
+  cache.Insert(key, stmt1, query_ctx, MakeExecRequest(5));
+  EXPECT_EQ(cache.size(), 0);
+
+  // The parameter has the value of a constant of the template, which the plan of the
+  // next execution still contains.
+  cache.Insert(key, stmt1, query_ctx, MakeExecRequest(1));
+  cache.Insert(key, stmt2, query_ctx, MakeExecRequest(1));
+  EXPECT_FALSE(cache.Lookup(key, stmt3, query_ctx, &result));
+
+  // The planned literal is narrower than the parameters of later executions.
+  PreparedStatementCache tinyint_cache(10);
+  tinyint_cache.Insert(key, stmt1, query_ctx, MakeExecRequest(1, TYPE_TINYINT));
+  tinyint_cache.Insert(key, stmt2, query_ctx, MakeExecRequest(2, TYPE_TINYINT));
+  EXPECT_TRUE(tinyint_cache.Lookup(key, stmt3, query_ctx, &result));
+  EXPECT_FALSE(tinyint_cache.Lookup(key, MakePreparedStmt("1000"), query_ctx,
+      &result));
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
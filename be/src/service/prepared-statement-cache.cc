@@ -0,0 +1,400 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/prepared-statement-cache.h"
+
+#include <limits>
+#include <gutil/strings/substitute.h>
+
+#include "rpc/thrift-util.h"
+#include "runtime/types.h"
+#include "service/query-options.h"
+#include "util/auth-util.h"
+#include "util/impalad-metrics.h"
+#include "util/string-parser.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace strings;
+
+DEFINE_int64(prepared_statement_cache_capacity, 0, "(Advanced) Maximum number of plans "
+    "of prepared statements that are kept in an impalad-wide cache, so that HS2 "
+    "clients that repeatedly execute a statement template with different parameters "
+    "skip its analysis and planning. If 0, the cache is disabled.");
+
+const string PreparedStatementCache::PARAM_PREFIX = "impala.prepared.param.";
+
+namespace {
+
+// Returns true and sets 'value' if 'param' is an integer literal.
+bool ParseIntParam(const string& param, int64_t* value) {
+  StringParser::ParseResult result;
+  *value = StringParser::StringToInt<int64_t>(param.c_str(), param.size(), &result);
+  return result == StringParser::PARSE_SUCCESS;
+}
+
+// Returns true and sets 'value' to the contents of 'param' if it is a single-quoted
+// string literal without escapes or quotes.
+bool ParseStringParam(const string& param, string* value) {
+  if (param.size() < 2 || param[0] != '\'' || param[param.size() - 1] != '\'') {
+    return false;
+  }
+  *value = param.substr(1, param.size() - 2);
+  return value->find_first_of("'\\") == string::npos;
+}
+
+// Returns true if the int literal 'node' can hold 'value' without changing its type.
+bool FitsIntLiteral(const TExprNode& node, int64_t value) {
+  switch (ColumnType::FromThrift(node.type).type) {
+    case TYPE_TINYINT:
+      return value >= numeric_limits<int8_t>::min() &&
+          value <= numeric_limits<int8_t>::max();
+    case TYPE_SMALLINT:
+      return value >= numeric_limits<int16_t>::min() &&
+          value <= numeric_limits<int16_t>::max();
+    case TYPE_INT:
+      return value >= numeric_limits<int32_t>::min() &&
+          value <= numeric_limits<int32_t>::max();
+    case TYPE_BIGINT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns true if 'node' is the literal of 'param'.
+bool IsParamLiteral(const TExprNode& node, const string& param) {
+  int64_t int_value;
+  string string_value;
+  if (node.node_type == TExprNodeType::INT_LITERAL) {
+    return ParseIntParam(param, &int_value) && node.int_literal.value == int_value;
+  } else if (node.node_type == TExprNodeType::STRING_LITERAL) {
+    // Literals of CHAR or VARCHAR types may have been truncated or padded.
+    return ColumnType::FromThrift(node.type).type == TYPE_STRING &&
+        ParseStringParam(param, &string_value) &&
+        node.string_literal.value == string_value;
+  }
+  return false;
+}
+
+// Sets the value of the literal 'node' to 'param'. Returns false if it doesn't fit.
+bool BindLiteral(const string& param, TExprNode* node) {
+  if (node->node_type == TExprNodeType::INT_LITERAL) {
+    int64_t value;
+    if (!ParseIntParam(param, &value) || !FitsIntLiteral(*node, value)) return false;
+    node->int_literal.value = value;
+    return true;
+  }
+  DCHECK_EQ(node->node_type, TExprNodeType::STRING_LITERAL);
+  return ParseStringParam(param, &node->string_literal.value);
+}
+
+void AddLiterals(TExpr* expr, vector<TExprNode*>* literals) {
+  for (TExprNode& node: expr->nodes) {
+    if (node.node_type == TExprNodeType::INT_LITERAL ||
+        node.node_type == TExprNodeType::STRING_LITERAL) {
+      literals->push_back(&node);
+    }
+  }
+}
+
+void AddLiterals(vector<TExpr>* exprs, vector<TExprNode*>* literals) {
+  for (TExpr& expr: *exprs) AddLiterals(&expr, literals);
+}
+
+// Adds the literals of the exprs of 'node'. Returns false if 'node' may have exprs
+// that are not visited.
+bool AddPlanNodeLiterals(TPlanNode* node, vector<TExprNode*>* literals) {
+  AddLiterals(&node->conjuncts, literals);
+  for (TRuntimeFilterDesc& filter: node->runtime_filters) {
+    AddLiterals(&filter.src_expr, literals);
+    for (TRuntimeFilterTargetDesc& target: filter.targets) {
+      AddLiterals(&target.target_expr, literals);
+    }
+  }
+  switch (node->node_type) {
+    case TPlanNodeType::HDFS_SCAN_NODE:
+      for (auto& entry: node->hdfs_scan_node.collection_conjuncts) {
+        AddLiterals(&entry.second, literals);
+      }
+      return true;
+    case TPlanNodeType::AGGREGATION_NODE:
+      AddLiterals(&node->agg_node.grouping_exprs, literals);
+      AddLiterals(&node->agg_node.aggregate_functions, literals);
+      return true;
+    case TPlanNodeType::SORT_NODE:
+      AddLiterals(&node->sort_node.sort_info.ordering_exprs, literals);
+      AddLiterals(&node->sort_node.sort_info.sort_tuple_slot_exprs, literals);
+      AddLiterals(&node->sort_node.partition_exprs, literals);
+      return true;
+    case TPlanNodeType::HASH_JOIN_NODE:
+      for (TEqJoinCondition& condition: node->hash_join_node.eq_join_conjuncts) {
+        AddLiterals(&condition.left, literals);
+        AddLiterals(&condition.right, literals);
+      }
+      AddLiterals(&node->hash_join_node.other_join_conjuncts, literals);
+      return true;
+    case TPlanNodeType::NESTED_LOOP_JOIN_NODE:
+      AddLiterals(&node->nested_loop_join_node.join_conjuncts, literals);
+      return true;
+    case TPlanNodeType::SELECT_NODE:
+    case TPlanNodeType::EXCHANGE_NODE:
+    case TPlanNodeType::EMPTY_SET_NODE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+}
+
+PreparedStatementCache::PreparedStatementCache(int64_t capacity)
+  : generation_(0),
+    cache_(capacity) {
+}
+
+Status PreparedStatementCache::ParseParams(const map<string, string>& conf_overlay,
+    vector<string>* params) {
+  params->clear();
+  map<int, string> numbered_params;
+  for (const map<string, string>::value_type& entry: conf_overlay) {
+    if (entry.first.compare(0, PARAM_PREFIX.size(), PARAM_PREFIX) != 0) continue;
+    StringParser::ParseResult result;
+    int n = StringParser::StringToInt<int>(entry.first.c_str() + PARAM_PREFIX.size(),
+        entry.first.size() - PARAM_PREFIX.size(), &result);
+    if (result != StringParser::PARSE_SUCCESS || n < 1) {
+      return Status(Substitute("Invalid prepared statement parameter '$0'.",
+          entry.first));
+    }
+    int64_t int_value;
+    string string_value;
+    if (!ParseIntParam(entry.second, &int_value) &&
+        !ParseStringParam(entry.second, &string_value)) {
+      return Status(Substitute("Invalid value '$0' for '$1': parameters must be integer "
+          "or single-quoted string literals without quotes or escapes.", entry.second,
+          entry.first));
+    }
+    numbered_params[n] = entry.second;
+  }
+  for (const map<int, string>::value_type& param: numbered_params) {
+    if (param.first != params->size() + 1) {
+      return Status(Substitute("Missing prepared statement parameter '$0$1'.",
+          PARAM_PREFIX, params->size() + 1));
+    }
+    params->push_back(param.second);
+  }
+  return Status::OK();
+}
+
+Status PreparedStatementCache::BindStmt(const string& stmt_template,
+    const vector<string>& params, string* stmt) {
+  stmt->clear();
+  stmt->reserve(stmt_template.size());
+  int num_placeholders = 0;
+  char quote = 0;
+  for (int i = 0; i < stmt_template.size(); ++i) {
+    char c = stmt_template[i];
+    if (quote != 0) {
+      stmt->push_back(c);
+      if (c == '\\' && i + 1 < stmt_template.size()) {
+        stmt->push_back(stmt_template[++i]);
+      } else if (c == quote) {
+        quote = 0;
+      }
+      continue;
+    }
+    if (c == '\'' || c == '"' || c == '`') {
+      quote = c;
+    } else if (c == '-' && stmt_template.compare(i, 2, "--") == 0) {
+      // Copy comments up to their end.
+      size_t end = stmt_template.find('\n', i);
+      if (end == string::npos) end = stmt_template.size();
+      stmt->append(stmt_template, i, end - i);
+      i = end - 1;
+      continue;
+    } else if (c == '/' && stmt_template.compare(i, 2, "/*") == 0) {
+      size_t end = stmt_template.find("*/", i + 2);
+      end = end == string::npos ? stmt_template.size() : end + 2;
+      stmt->append(stmt_template, i, end - i);
+      i = end - 1;
+      continue;
+    } else if (c == '?') {
+      if (num_placeholders < params.size()) stmt->append(params[num_placeholders]);
+      ++num_placeholders;
+      continue;
+    }
+    stmt->push_back(c);
+  }
+  if (num_placeholders != params.size()) {
+    return Status(Substitute("Prepared statement has $0 placeholders, but $1 "
+        "parameters.", num_placeholders, params.size()));
+  }
+  return Status::OK();
+}
+
+bool PreparedStatementCache::GetLiterals(TExecRequest* exec_request,
+    vector<TExprNode*>* literals) {
+  literals->clear();
+  if (exec_request->stmt_type != TStmtType::QUERY ||
+      !exec_request->__isset.query_exec_request) {
+    return false;
+  }
+  for (TPlanFragment& fragment: exec_request->query_exec_request.fragments) {
+    for (TPlanNode& node: fragment.plan.nodes) {
+      if (!AddPlanNodeLiterals(&node, literals)) return false;
+    }
+    AddLiterals(&fragment.output_exprs, literals);
+    AddLiterals(&fragment.partition.partition_exprs, literals);
+    if (fragment.__isset.output_sink) {
+      if (fragment.output_sink.type != TDataSinkType::DATA_STREAM_SINK) return false;
+      AddLiterals(
+          &fragment.output_sink.stream_sink.output_partition.partition_exprs, literals);
+    }
+  }
+  return true;
+}
+
+string PreparedStatementCache::GetKey(const PreparedStmt& prepared_stmt,
+    const TQueryCtx& query_ctx) {
+  string key = prepared_stmt.stmt_template;
+  key.push_back('\0');
+  key.append(query_ctx.session.database);
+  key.push_back('\0');
+  key.append(GetEffectiveUser(query_ctx.session));
+  map<string, string> options;
+  TQueryOptionsToMap(query_ctx.request.query_options, &options);
+  for (const map<string, string>::value_type& option: options) {
+    key.push_back('\0');
+    key.append(option.first);
+    key.push_back('=');
+    key.append(option.second);
+  }
+  lock_guard<mutex> l(lock_);
+  key.push_back('\0');
+  key.append(Substitute("$0", generation_));
+  return key;
+}
+
+bool PreparedStatementCache::Bind(const Entry& entry, const vector<string>& params,
+    TExecRequest* exec_request) {
+  DCHECK_EQ(entry.param_literal_idxs.size(), params.size());
+  *exec_request = entry.exec_request;
+  vector<TExprNode*> literals;
+  bool has_literals = GetLiterals(exec_request, &literals);
+  DCHECK(has_literals);
+  for (int i = 0; i < params.size(); ++i) {
+    DCHECK_LT(entry.param_literal_idxs[i], literals.size());
+    if (!BindLiteral(params[i], literals[entry.param_literal_idxs[i]])) return false;
+  }
+  return true;
+}
+
+bool PreparedStatementCache::IsSamePlan(const TExecRequest& r1, const TExecRequest& r2) {
+  string serialized[2];
+  const TExecRequest* requests[] = {&r1, &r2};
+  ThriftSerializer serializer(true);
+  for (int i = 0; i < 2; ++i) {
+    // Leave out the fields that differ between executions of the same plan.
+    TExecRequest request = *requests[i];
+    request.query_exec_request.query_ctx = TQueryCtx();
+    request.query_exec_request.query_plan.clear();
+    request.timeline = TEventSequence();
+    if (!serializer.Serialize(&request, &serialized[i]).ok()) return false;
+  }
+  return serialized[0] == serialized[1];
+}
+
+bool PreparedStatementCache::Lookup(const string& key, const PreparedStmt& prepared_stmt,
+    const TQueryCtx& query_ctx, TExecRequest* exec_request) {
+  LruCache<string, Entry>::ValuePtr entry;
+  bool hit = cache_.Get(key, &entry) && entry->verified &&
+      Bind(*entry, prepared_stmt.params, exec_request);
+  if (hit) {
+    // The frontend adds fields to the query context, e.g. the tables that are missing
+    // stats, which are kept. Only the fields of this execution are replaced.
+    TQueryCtx& cached_ctx = exec_request->query_exec_request.query_ctx;
+    cached_ctx.__set_request(query_ctx.request);
+    cached_ctx.__set_session(query_ctx.session);
+    cached_ctx.__set_query_id(query_ctx.query_id);
+    cached_ctx.__set_now_string(query_ctx.now_string);
+    cached_ctx.__set_pid(query_ctx.pid);
+    cached_ctx.__set_coord_address(query_ctx.coord_address);
+    if (ImpaladMetrics::PREPARED_STATEMENT_CACHE_HIT_COUNT != NULL) {
+      ImpaladMetrics::PREPARED_STATEMENT_CACHE_HIT_COUNT->Increment(1L);
+    }
+  } else if (ImpaladMetrics::PREPARED_STATEMENT_CACHE_MISS_COUNT != NULL) {
+    ImpaladMetrics::PREPARED_STATEMENT_CACHE_MISS_COUNT->Increment(1L);
+  }
+  return hit;
+}
+
+void PreparedStatementCache::Insert(const string& key, const PreparedStmt& prepared_stmt,
+    const TQueryCtx& query_ctx, const TExecRequest& exec_request) {
+  boost::shared_ptr<Entry> entry(new Entry());
+  entry->exec_request = exec_request;
+  entry->params = prepared_stmt.params;
+  vector<TExprNode*> literals;
+  if (!GetLiterals(&entry->exec_request, &literals)) return;
+  for (const string& param: prepared_stmt.params) {
+    int literal_idx = -1;
+    for (int i = 0; i < literals.size(); ++i) {
+      if (!IsParamLiteral(*literals[i], param)) continue;
+      // Literals with the value of more than one parameter, or of a parameter and a
+      // constant of the template, can't be told apart.
+      if (literal_idx != -1) return;
+      literal_idx = i;
+    }
+    if (literal_idx == -1) return;
+    for (int idx: entry->param_literal_idxs) {
+      if (idx == literal_idx) return;
+    }
+    entry->param_literal_idxs.push_back(literal_idx);
+  }
+
+  // A literal with the value of a parameter may also be a constant of the template,
+  // while the parameter itself was used to prune partitions. The plan is only used
+  // once binding the parameters of a second execution to the plan of the first one
+  // results in the plan of the second one.
+  LruCache<string, Entry>::ValuePtr candidate;
+  if (cache_.Get(key, &candidate)) {
+    // Verified plans are replaced if they were missed because a parameter didn't fit.
+    if (candidate->verified) return;
+    if (candidate->param_literal_idxs == entry->param_literal_idxs &&
+        candidate->params != entry->params) {
+      TExecRequest bound_request;
+      entry->verified = Bind(*candidate, prepared_stmt.params, &bound_request) &&
+          IsSamePlan(bound_request, exec_request);
+    }
+  }
+  // The catalog may have been updated while the statement was planned.
+  if (GetKey(prepared_stmt, query_ctx) != key) return;
+  cache_.Put(key, entry, 1);
+  UpdateMetrics();
+}
+
+void PreparedStatementCache::InvalidateAll() {
+  {
+    lock_guard<mutex> l(lock_);
+    ++generation_;
+  }
+  cache_.Clear();
+  UpdateMetrics();
+}
+
+void PreparedStatementCache::UpdateMetrics() {
+  if (ImpaladMetrics::PREPARED_STATEMENT_CACHE_NUM_ENTRIES != NULL) {
+    ImpaladMetrics::PREPARED_STATEMENT_CACHE_NUM_ENTRIES->set_value(cache_.size());
+  }
+}
@@ -0,0 +1,149 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_SERVICE_PREPARED_STATEMENT_CACHE_H
+#define IMPALA_SERVICE_PREPARED_STATEMENT_CACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#include "common/status.h"
+#include "gen-cpp/Frontend_types.h"
+#include "util/lru-cache.h"
+
+namespace impala {
+
+/// A statement with '?' placeholders and the literals bound to them by one execution.
+struct PreparedStmt {
+  /// The statement text with a '?' outside of quotes for each parameter.
+  std::string stmt_template;
+
+  /// The SQL literals of the parameters, in the order of their placeholders. Either
+  /// integers or single-quoted strings.
+  std::vector<std::string> params;
+};
+
+/// Cache of the plans of prepared statements that HS2 clients execute repeatedly with
+/// different parameters, such as point lookups, enabled by
+/// --prepared_statement_cache_capacity. A client executes a prepared statement by
+/// sending the template as the statement and each parameter's literal in the
+/// confOverlay as "impala.prepared.param.<n>", counting from 1.
+///
+/// Executions of a template are planned by the frontend with the literals substituted
+/// into the statement until a plan can be reused. A plan can be reused if its exprs
+/// contain each parameter exactly once, as an integer or string literal, and if a
+/// second execution with other parameters resulted in the same plan up to these
+/// literals. Later executions copy the cached request and bind their literals into it,
+/// which skips analysis and planning. Plans in which a parameter was folded into a
+/// constant, used to prune partitions or repeated through predicate propagation are
+/// never reused, since their scan ranges or exprs depend on the planned values.
+/// Parameters that don't fit the type of the planned literal are planned like any
+/// other statement. The plan text in the profiles of reused plans shows the literals
+/// of the execution that was planned first.
+///
+/// Plans are keyed by the template, the session's database and user and the query
+/// options. All plans are evicted by every catalog update, since they contain the
+/// scan ranges and the privileges that were current when they were planned.
+/// This class is thread-safe.
+class PreparedStatementCache {
+ public:
+  /// A cached plan. Immutable once added to the cache.
+  struct Entry {
+    /// The plan of an execution with 'params'.
+    TExecRequest exec_request;
+    std::vector<std::string> params;
+
+    /// For each parameter, the index of its literal among all literals of the plan's
+    /// exprs, in the order in which GetLiterals() returns them.
+    std::vector<int> param_literal_idxs;
+
+    /// True once the plan of an execution with other parameters matched this plan with
+    /// these parameters bound to it. Plans that are not verified are not reused.
+    bool verified;
+
+    Entry() : verified(false) {}
+  };
+
+  /// 'capacity' is the maximum number of cached plans.
+  PreparedStatementCache(int64_t capacity);
+
+  /// Prefix of the confOverlay keys of the parameters of a prepared statement.
+  static const std::string PARAM_PREFIX;
+
+  /// Sets 'params' to the literals of the parameters in 'conf_overlay'. Returns an
+  /// error if they are not numbered 1 to n without gaps or are not valid literals.
+  static Status ParseParams(const std::map<std::string, std::string>& conf_overlay,
+      std::vector<std::string>* params);
+
+  /// Sets 'stmt' to 'stmt_template' with its placeholders replaced by 'params'. Returns
+  /// an error if the number of placeholders differs from the number of parameters.
+  static Status BindStmt(const std::string& stmt_template,
+      const std::vector<std::string>& params, std::string* stmt);
+
+  /// Sets 'literals' to the literal nodes of all exprs of the plan of 'exec_request'.
+  /// Returns false if the plan is not a query or has nodes or sinks whose exprs are not
+  /// visited, e.g. of unions or analytic functions.
+  static bool GetLiterals(TExecRequest* exec_request,
+      std::vector<TExprNode*>* literals);
+
+  /// Returns the key of the plan of 'prepared_stmt' executed with 'query_ctx'. It
+  /// includes the current generation, so plans of statements that were planned during
+  /// a catalog update are not added.
+  std::string GetKey(const PreparedStmt& prepared_stmt, const TQueryCtx& query_ctx);
+
+  /// Returns true and sets 'exec_request' to the cached plan for 'key' with the
+  /// parameters of 'prepared_stmt' bound to it and the per-execution fields of
+  /// 'query_ctx'. Returns false if there is no plan or the parameters can't be bound.
+  bool Lookup(const std::string& key, const PreparedStmt& prepared_stmt,
+      const TQueryCtx& query_ctx, TExecRequest* exec_request);
+
+  /// Adds 'exec_request', the plan of 'prepared_stmt' with its parameters substituted,
+  /// under 'key', which was returned by GetKey() before planning. Verifies the plan
+  /// against an unverified plan with other parameters under the same key. Drops it if
+  /// it can't be bound to other parameters or the catalog was updated since.
+  void Insert(const std::string& key, const PreparedStmt& prepared_stmt,
+      const TQueryCtx& query_ctx, const TExecRequest& exec_request);
+
+  /// Evicts all plans.
+  void InvalidateAll();
+
+  size_t size() { return cache_.size(); }
+
+ private:
+  /// Protects generation_.
+  boost::mutex lock_;
+
+  /// Bumped by InvalidateAll(), part of every key.
+  int64_t generation_;
+
+  LruCache<std::string, Entry> cache_;
+
+  /// Sets 'exec_request' to the plan of 'entry' with 'params' bound to it. Returns false
+  /// if a parameter doesn't fit the type of its literal.
+  static bool Bind(const Entry& entry, const std::vector<std::string>& params,
+      TExecRequest* exec_request);
+
+  /// Returns true if 'r1' and 'r2' are the same plan, ignoring the fields that differ
+  /// between executions, such as the query context.
+  static bool IsSamePlan(const TExecRequest& r1, const TExecRequest& r2);
+
+  /// Updates the num-entries metric.
+  void UpdateMetrics();
+};
+
+}
+
+#endif
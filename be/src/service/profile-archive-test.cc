@@ -0,0 +1,177 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/profile-archive.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <boost/filesystem.hpp>
+
+#include "common/object-pool.h"
+#include "util/runtime-profile.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+namespace impala {
+
+const string ARCHIVE_DIR = "/tmp/profile-archive-test";
+
+class ProfileArchiveTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    boost::filesystem::remove_all(ARCHIVE_DIR);
+  }
+
+  virtual void TearDown() {
+    boost::filesystem::remove_all(ARCHIVE_DIR);
+  }
+
+  // Archives a query whose profile has a counter with 'value'.
+  void AddQuery(ProfileArchive* archive, int64_t id, int64_t time_ms,
+      const string& user, int64_t duration_ms, int64_t value) {
+    ObjectPool pool;
+    RuntimeProfile profile(&pool, "Query");
+    profile.AddCounter("Value", TUnit::UNIT)->Set(value);
+    vector<uint8_t> archived_profile;
+    int64_t serialized_len;
+    ASSERT_TRUE(profile.SerializeToArchive(&archived_profile, &serialized_len).ok());
+
+    ProfileArchive::QueryRecord record;
+    record.query_id.__set_hi(id);
+    record.query_id.__set_lo(id);
+    record.archive_time_ms = time_ms;
+    record.user = user;
+    record.pool = "root.default";
+    record.stmt = "select 1";
+    record.duration_ms = duration_ms;
+    record.peak_mem_bytes = 1024 * id;
+    ASSERT_TRUE(archive->Add(record, archived_profile, serialized_len).ok());
+  }
+
+  // Returns the value of the counter of the archived profile of query 'id', or -1 if
+  // the profile can't be read.
+  int64_t GetValue(ProfileArchive* archive, int64_t id) {
+    TUniqueId query_id;
+    query_id.__set_hi(id);
+    query_id.__set_lo(id);
+    vector<uint8_t> archived_profile;
+    int64_t serialized_len;
+    if (!archive->GetProfile(query_id, &archived_profile, &serialized_len).ok()) {
+      return -1;
+    }
+    ObjectPool pool;
+    RuntimeProfile* profile;
+    if (!RuntimeProfile::CreateFromArchive(&pool, archived_profile.data(),
+        archived_profile.size(), serialized_len, &profile).ok()) {
+      return -1;
+    }
+    EXPECT_EQ(profile->name(), "Query");
+    RuntimeProfile::Counter* counter = profile->GetCounter("Value");
+    return counter == NULL ? -1 : counter->value();
+  }
+};
+
+TEST_F(ProfileArchiveTest, AddAndFind) {
+  ProfileArchive archive(ARCHIVE_DIR, 1024L * 1024L);
+  ASSERT_TRUE(archive.Init().ok());
+  AddQuery(&archive, 1, 1000, "alice", 10, 11);
+  AddQuery(&archive, 2, 2000, "bob", 200, 22);
+  AddQuery(&archive, 3, 3000, "alice", 3000, 33);
+  EXPECT_EQ(archive.num_queries(), 3);
+  EXPECT_EQ(GetValue(&archive, 1), 11);
+  EXPECT_EQ(GetValue(&archive, 3), 33);
+  EXPECT_EQ(GetValue(&archive, 4), -1);
+
+  vector<ProfileArchive::QueryRecord> records;
+  ProfileArchive::Filter filter;
+  archive.Find(filter, 10, &records);
+  ASSERT_EQ(records.size(), 3);
+  EXPECT_EQ(records[0].query_id.hi, 3);
+  EXPECT_EQ(records[2].query_id.hi, 1);
+  EXPECT_EQ(records[1].user, "bob");
+  EXPECT_EQ(records[1].peak_mem_bytes, 2048);
+  archive.Find(filter, 1, &records);
+  ASSERT_EQ(records.size(), 1);
+  EXPECT_EQ(records[0].query_id.hi, 3);
+
+  filter.user = "alice";
+  archive.Find(filter, 10, &records);
+  EXPECT_EQ(records.size(), 2);
+  filter.min_duration_ms = 100;
+  archive.Find(filter, 10, &records);
+  ASSERT_EQ(records.size(), 1);
+  EXPECT_EQ(records[0].query_id.hi, 3);
+
+  ProfileArchive::Filter time_filter;
+  time_filter.min_time_ms = 1500;
+  time_filter.max_time_ms = 2500;
+  time_filter.min_peak_mem_bytes = 2000;
+  archive.Find(time_filter, 10, &records);
+  ASSERT_EQ(records.size(), 1);
+  EXPECT_EQ(records[0].query_id.hi, 2);
+}
+
+// The index is rebuilt from the segments when the archive is opened again, ignoring an
+// incomplete profile at the end of a segment.
+TEST_F(ProfileArchiveTest, Reopen) {
+  {
+    ProfileArchive archive(ARCHIVE_DIR, 1024L * 1024L);
+    ASSERT_TRUE(archive.Init().ok());
+    AddQuery(&archive, 1, 1000, "alice", 10, 11);
+    AddQuery(&archive, 2, 2000, "bob", 20, 22);
+  }
+  string segment = ARCHIVE_DIR + "/profile_archive-0";
+  int64_t size = boost::filesystem::file_size(segment);
+  boost::filesystem::resize_file(segment, size - 1);
+
+  ProfileArchive archive(ARCHIVE_DIR, 1024L * 1024L);
+  ASSERT_TRUE(archive.Init().ok());
+  EXPECT_EQ(archive.num_queries(), 1);
+  EXPECT_EQ(GetValue(&archive, 1), 11);
+  EXPECT_EQ(GetValue(&archive, 2), -1);
+
+  // New profiles go to a new segment.
+  AddQuery(&archive, 3, 3000, "alice", 30, 33);
+  EXPECT_TRUE(boost::filesystem::exists(ARCHIVE_DIR + "/profile_archive-1"));
+  ProfileArchive reopened_archive(ARCHIVE_DIR, 1024L * 1024L);
+  ASSERT_TRUE(reopened_archive.Init().ok());
+  EXPECT_EQ(reopened_archive.num_queries(), 2);
+  EXPECT_EQ(GetValue(&reopened_archive, 3), 33);
+}
+
+// The oldest segments are deleted when the archive exceeds its size limit.
+TEST_F(ProfileArchiveTest, SizeLimit) {
+  // Each segment holds a single profile.
+  ProfileArchive archive(ARCHIVE_DIR, 1000);
+  ASSERT_TRUE(archive.Init().ok());
+  for (int i = 1; i <= 100; ++i) AddQuery(&archive, i, i, "alice", i, i);
+  EXPECT_LT(archive.num_queries(), 100);
+  EXPECT_GT(archive.num_queries(), 0);
+  EXPECT_EQ(GetValue(&archive, 1), -1);
+  EXPECT_EQ(GetValue(&archive, 100), 100);
+
+  vector<ProfileArchive::QueryRecord> records;
+  archive.Find(ProfileArchive::Filter(), 1000, &records);
+  EXPECT_EQ(records.size(), archive.num_queries());
+  EXPECT_EQ(records[0].query_id.hi, 100);
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,312 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/profile-archive.h"
+
+#include <string.h>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <gutil/strings/substitute.h>
+
+#include "common/logging.h"
+#include "util/debug-util.h"
+#include "util/error-util.h"
+#include "util/string-parser.h"
+
+#include "common/names.h"
+
+namespace filesystem = boost::filesystem;
+using namespace impala;
+using namespace strings;
+
+const string SEGMENT_FILE_PREFIX = "profile_archive-";
+
+// Starts every entry of a segment, i.e. an index record followed by a profile.
+const uint32_t ENTRY_MAGIC = 0x50415231; // "PAR1"
+
+// The segments are rolled after reaching this fraction of the archive's size limit.
+const int NUM_SEGMENTS = 10;
+
+// Appends the bytes of 'value' to 'buffer'.
+template <typename T>
+static void AppendValue(T value, string* buffer) {
+  buffer->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void AppendString(const string& value, string* buffer) {
+  AppendValue<uint32_t>(value.size(), buffer);
+  buffer->append(value);
+}
+
+// Reads a value appended by AppendValue() from 'buffer' at '*pos' and advances '*pos'.
+// Returns false if 'buffer' ends before the value.
+template <typename T>
+static bool ReadValue(const string& buffer, int* pos, T* value) {
+  if (*pos + sizeof(T) > buffer.size()) return false;
+  memcpy(value, buffer.data() + *pos, sizeof(T));
+  *pos += sizeof(T);
+  return true;
+}
+
+static bool ReadString(const string& buffer, int* pos, string* value) {
+  uint32_t len;
+  if (!ReadValue(buffer, pos, &len) || *pos + len > buffer.size()) return false;
+  value->assign(buffer, *pos, len);
+  *pos += len;
+  return true;
+}
+
+ProfileArchive::ProfileArchive(const string& dir, int64_t max_size_bytes)
+  : dir_(dir),
+    max_size_bytes_(max_size_bytes),
+    total_size_bytes_(0) {
+}
+
+Status ProfileArchive::Init() {
+  lock_guard<mutex> l(lock_);
+  DCHECK(segments_.empty());
+  vector<Segment> segments;
+  try {
+    filesystem::create_directories(dir_);
+    for (filesystem::directory_iterator it(dir_); it != filesystem::directory_iterator();
+         ++it) {
+      const string& name = it->path().filename().string();
+      if (name.compare(0, SEGMENT_FILE_PREFIX.size(), SEGMENT_FILE_PREFIX) != 0) continue;
+      StringParser::ParseResult result;
+      Segment segment;
+      segment.seq = StringParser::StringToInt<int64_t>(
+          name.c_str() + SEGMENT_FILE_PREFIX.size(),
+          name.size() - SEGMENT_FILE_PREFIX.size(), &result);
+      if (result != StringParser::PARSE_SUCCESS) continue;
+      segment.path = it->path().string();
+      segment.size_bytes = filesystem::file_size(it->path());
+      segments.push_back(segment);
+    }
+  } catch (const filesystem::filesystem_error& e) {
+    return Status(Substitute("Could not open the profile archive in $0: $1", dir_,
+        e.what()));
+  }
+
+  sort(segments.begin(), segments.end(),
+      [](const Segment& lhs, const Segment& rhs) { return lhs.seq < rhs.seq; });
+  for (Segment& segment: segments) {
+    LoadSegment(&segment);
+    segments_.push_back(segment);
+    total_size_bytes_ += segment.size_bytes;
+  }
+  LOG(INFO) << "Loaded " << index_.size() << " queries from the profile archive in "
+            << dir_;
+  RETURN_IF_ERROR(StartSegment());
+  DeleteOldSegments();
+  return Status::OK();
+}
+
+void ProfileArchive::LoadSegment(Segment* segment) {
+  ifstream in(segment->path.c_str(), ios::in | ios::binary);
+  int64_t offset = 0;
+  while (offset < segment->size_bytes) {
+    // The fixed-size part of the entry header: the magic number and the length of the
+    // index record.
+    string header(sizeof(uint32_t) * 2, '\0');
+    if (!in.read(&header[0], header.size())) break;
+    int pos = 0;
+    uint32_t magic;
+    uint32_t record_len;
+    ReadValue(header, &pos, &magic);
+    ReadValue(header, &pos, &record_len);
+    if (magic != ENTRY_MAGIC) break;
+
+    string record(record_len + sizeof(int64_t) * 2, '\0');
+    if (!in.read(&record[0], record.size())) break;
+    pos = 0;
+    IndexEntry entry;
+    QueryRecord* r = &entry.record;
+    if (!ReadValue(record, &pos, &r->query_id.hi)
+        || !ReadValue(record, &pos, &r->query_id.lo)
+        || !ReadValue(record, &pos, &r->archive_time_ms)
+        || !ReadValue(record, &pos, &r->duration_ms)
+        || !ReadValue(record, &pos, &r->peak_mem_bytes)
+        || !ReadString(record, &pos, &r->user)
+        || !ReadString(record, &pos, &r->pool)
+        || !ReadString(record, &pos, &r->stmt)
+        || pos != record_len
+        || !ReadValue(record, &pos, &entry.serialized_len)
+        || !ReadValue(record, &pos, &entry.len)) {
+      break;
+    }
+    entry.segment_seq = segment->seq;
+    entry.offset = offset + header.size() + record.size();
+    if (entry.offset + entry.len > segment->size_bytes) break;
+    AddToIndex(entry);
+    offset = entry.offset + entry.len;
+    in.seekg(offset);
+  }
+  if (offset < segment->size_bytes) {
+    LOG(WARNING) << "Ignoring " << segment->size_bytes - offset << " bytes at the end "
+                 << "of profile archive segment " << segment->path << ", which don't "
+                 << "contain a complete profile";
+  }
+}
+
+Status ProfileArchive::StartSegment() {
+  if (current_segment_.is_open()) current_segment_.close();
+  Segment segment;
+  segment.seq = segments_.empty() ? 0 : segments_.back().seq + 1;
+  segment.path = Substitute("$0/$1$2", dir_, SEGMENT_FILE_PREFIX, segment.seq);
+  segment.size_bytes = 0;
+  current_segment_.open(segment.path.c_str(), ios::out | ios::binary | ios::trunc);
+  if (!current_segment_.is_open()) {
+    return Status(Substitute("Could not create profile archive segment $0: $1",
+        segment.path, GetStrErrMsg()));
+  }
+  segments_.push_back(segment);
+  return Status::OK();
+}
+
+void ProfileArchive::DeleteOldSegments() {
+  while (total_size_bytes_ > max_size_bytes_ && segments_.size() > 1) {
+    const Segment& segment = segments_.front();
+    boost::system::error_code ec;
+    filesystem::remove(segment.path, ec);
+    if (ec) {
+      LOG(WARNING) << "Could not delete profile archive segment " << segment.path
+                   << ": " << ec.message();
+    }
+    while (!index_.empty() && index_.front().segment_seq == segment.seq) {
+      QueryIdIndex::iterator it = query_id_index_.find(index_.front().record.query_id);
+      if (it != query_id_index_.end() && it->second == &index_.front()) {
+        query_id_index_.erase(it);
+      }
+      index_.pop_front();
+    }
+    total_size_bytes_ -= segment.size_bytes;
+    segments_.pop_front();
+  }
+}
+
+void ProfileArchive::AddToIndex(const IndexEntry& entry) {
+  index_.push_back(entry);
+  query_id_index_[entry.record.query_id] = &index_.back();
+}
+
+Status ProfileArchive::Add(const QueryRecord& record, const vector<uint8_t>& profile,
+    int64_t serialized_len) {
+  IndexEntry entry;
+  entry.record = record;
+  if (entry.record.stmt.size() > MAX_STMT_LEN) entry.record.stmt.resize(MAX_STMT_LEN);
+  entry.serialized_len = serialized_len;
+  entry.len = profile.size();
+
+  string index_record;
+  AppendValue(record.query_id.hi, &index_record);
+  AppendValue(record.query_id.lo, &index_record);
+  AppendValue(record.archive_time_ms, &index_record);
+  AppendValue(record.duration_ms, &index_record);
+  AppendValue(record.peak_mem_bytes, &index_record);
+  AppendString(record.user, &index_record);
+  AppendString(record.pool, &index_record);
+  AppendString(entry.record.stmt, &index_record);
+
+  string buffer;
+  AppendValue(ENTRY_MAGIC, &buffer);
+  AppendValue<uint32_t>(index_record.size(), &buffer);
+  buffer.append(index_record);
+  AppendValue(entry.serialized_len, &buffer);
+  AppendValue(entry.len, &buffer);
+  buffer.append(reinterpret_cast<const char*>(profile.data()), profile.size());
+
+  lock_guard<mutex> l(lock_);
+  DCHECK(!segments_.empty());
+  int64_t segment_size = max<int64_t>(max_size_bytes_ / NUM_SEGMENTS, 1);
+  if (segments_.back().size_bytes > 0
+      && segments_.back().size_bytes + buffer.size() > segment_size) {
+    RETURN_IF_ERROR(StartSegment());
+  }
+  Segment* segment = &segments_.back();
+  // Flushed after every profile so that GetProfile() can read it.
+  current_segment_.write(buffer.data(), buffer.size());
+  current_segment_.flush();
+  if (!current_segment_) {
+    Status write_status(Substitute("Could not write to profile archive segment $0: $1",
+        segment->path, GetStrErrMsg()));
+    // Later profiles are written to a new segment instead of after the partial one.
+    current_segment_.clear();
+    Status status = StartSegment();
+    if (!status.ok()) LOG(WARNING) << status.GetDetail();
+    return write_status;
+  }
+  entry.segment_seq = segment->seq;
+  entry.offset = segment->size_bytes + buffer.size() - profile.size();
+  segment->size_bytes += buffer.size();
+  total_size_bytes_ += buffer.size();
+  AddToIndex(entry);
+  DeleteOldSegments();
+  return Status::OK();
+}
+
+void ProfileArchive::Find(const Filter& filter, int limit,
+    vector<QueryRecord>* records) {
+  records->clear();
+  lock_guard<mutex> l(lock_);
+  // The archive times are in order unless the system clock was set back, so the scan
+  // stops at the first query that was archived before the time range.
+  for (deque<IndexEntry>::reverse_iterator it = index_.rbegin();
+       it != index_.rend() && records->size() < limit; ++it) {
+    const QueryRecord& record = it->record;
+    if (record.archive_time_ms < filter.min_time_ms) break;
+    if (record.archive_time_ms > filter.max_time_ms) continue;
+    if (!filter.user.empty() && record.user != filter.user) continue;
+    if (!filter.pool.empty() && record.pool != filter.pool) continue;
+    if (record.duration_ms < filter.min_duration_ms) continue;
+    if (record.peak_mem_bytes < filter.min_peak_mem_bytes) continue;
+    records->push_back(record);
+  }
+}
+
+Status ProfileArchive::GetProfile(const TUniqueId& query_id, vector<uint8_t>* profile,
+    int64_t* serialized_len) {
+  string path;
+  int64_t offset;
+  int64_t len;
+  {
+    lock_guard<mutex> l(lock_);
+    QueryIdIndex::const_iterator it = query_id_index_.find(query_id);
+    if (it == query_id_index_.end()) {
+      return Status(Substitute("Query id $0 not found in the profile archive.",
+          PrintId(query_id)));
+    }
+    const IndexEntry* entry = it->second;
+    for (const Segment& segment: segments_) {
+      if (segment.seq == entry->segment_seq) path = segment.path;
+    }
+    offset = entry->offset;
+    len = entry->len;
+    *serialized_len = entry->serialized_len;
+  }
+
+  // The segment may be deleted in the meantime, which fails the read.
+  ifstream in(path.c_str(), ios::in | ios::binary);
+  profile->resize(len);
+  in.seekg(offset);
+  if (!in.read(reinterpret_cast<char*>(profile->data()), len)) {
+    return Status(Substitute("Could not read the profile of query $0 from profile "
+        "archive segment $1", PrintId(query_id), path));
+  }
+  return Status::OK();
+}
+
+int64_t ProfileArchive::num_queries() {
+  lock_guard<mutex> l(lock_);
+  return index_.size();
+}
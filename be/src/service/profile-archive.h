@@ -0,0 +1,171 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_SERVICE_PROFILE_ARCHIVE_H
+#define IMPALA_SERVICE_PROFILE_ARCHIVE_H
+
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "common/status.h"
+#include "gen-cpp/Types_types.h"  // for TUniqueId
+#include "util/uid-util.h"
+
+namespace impala {
+
+/// Archive of the profiles of completed queries on local disk, which keeps the profiles
+/// of past queries available after they left the query log, also across restarts.
+///
+/// The profiles are stored compressed (see RuntimeProfile::SerializeToArchive()) in
+/// segment files that are only appended to. Each profile is preceded by the index
+/// record of its query, i.e. its id, archive time, user, pool, duration and peak
+/// memory. The index is kept in memory and rebuilt from the index records by Init(), so
+/// that queries are found without reading any profile. The oldest segment is deleted
+/// when the segments exceed the size limit of the archive.
+/// Thread-safe.
+class ProfileArchive {
+ public:
+  /// The index record of an archived query.
+  struct QueryRecord {
+    TUniqueId query_id;
+
+    /// Unix milliseconds when the query was archived.
+    int64_t archive_time_ms;
+
+    /// The effective user and the request pool of the query.
+    std::string user;
+    std::string pool;
+
+    /// The statement of the query, truncated to MAX_STMT_LEN characters.
+    std::string stmt;
+
+    int64_t duration_ms;
+
+    /// The highest peak memory of the query on any host.
+    int64_t peak_mem_bytes;
+
+    QueryRecord() : archive_time_ms(0), duration_ms(0), peak_mem_bytes(0) { }
+  };
+
+  /// The queries that Find() returns. Empty strings match any user or pool. The times
+  /// are inclusive bounds of the archive time.
+  struct Filter {
+    std::string user;
+    std::string pool;
+    int64_t min_time_ms;
+    int64_t max_time_ms;
+    int64_t min_duration_ms;
+    int64_t min_peak_mem_bytes;
+
+    Filter()
+      : min_time_ms(0),
+        max_time_ms(std::numeric_limits<int64_t>::max()),
+        min_duration_ms(0),
+        min_peak_mem_bytes(0) { }
+  };
+
+  static const int MAX_STMT_LEN = 1024;
+
+  /// The archive is stored in 'dir'. 'max_size_bytes' is the size limit of the segments,
+  /// which are rolled after reaching a tenth of it.
+  ProfileArchive(const std::string& dir, int64_t max_size_bytes);
+
+  /// Creates the directory if it doesn't exist, loads the index of the existing
+  /// segments and starts a new segment. A segment that ends with an incomplete profile,
+  /// e.g. after a crash, is indexed up to that profile. Must be called once before any
+  /// other method.
+  Status Init();
+
+  /// Appends the profile of a query, serialized by RuntimeProfile::SerializeToArchive(),
+  /// and adds the query to the index. 'record.stmt' is truncated to MAX_STMT_LEN.
+  Status Add(const QueryRecord& record, const std::vector<uint8_t>& profile,
+      int64_t serialized_len);
+
+  /// Sets 'records' to at most 'limit' queries that match 'filter', most recently
+  /// archived first.
+  void Find(const Filter& filter, int limit, std::vector<QueryRecord>* records);
+
+  /// Reads the profile of 'query_id' into 'profile' and sets 'serialized_len' for
+  /// RuntimeProfile::CreateFromArchive(). Returns an error if the query is not archived.
+  Status GetProfile(const TUniqueId& query_id, std::vector<uint8_t>* profile,
+      int64_t* serialized_len);
+
+  /// Returns the number of archived queries.
+  int64_t num_queries();
+
+ private:
+  /// A segment file. Segments are numbered in the order in which they were started.
+  struct Segment {
+    int64_t seq;
+    std::string path;
+    int64_t size_bytes;
+  };
+
+  /// The position of an archived query in the segments.
+  struct IndexEntry {
+    QueryRecord record;
+    int64_t segment_seq;
+
+    /// The offset of the profile in the segment and its length.
+    int64_t offset;
+    int64_t len;
+    int64_t serialized_len;
+  };
+
+  /// Loads the index records of 'segment'. Must be called with 'lock_' held.
+  void LoadSegment(Segment* segment);
+
+  /// Closes the current segment and starts a new one. Must be called with 'lock_' held.
+  Status StartSegment();
+
+  /// Deletes the oldest segments until the segments fit into 'max_size_bytes_', except
+  /// for the current one. Must be called with 'lock_' held.
+  void DeleteOldSegments();
+
+  /// Adds 'entry' to the end of the index. Must be called with 'lock_' held.
+  void AddToIndex(const IndexEntry& entry);
+
+  const std::string dir_;
+  const int64_t max_size_bytes_;
+
+  /// Protects all members below.
+  boost::mutex lock_;
+
+  /// The segments, oldest first. The last one is the current segment that profiles are
+  /// appended to.
+  std::deque<Segment> segments_;
+
+  /// The current segment.
+  std::ofstream current_segment_;
+
+  /// The sum of the sizes of 'segments_'.
+  int64_t total_size_bytes_;
+
+  /// The archived queries in the order in which they were archived.
+  std::deque<IndexEntry> index_;
+
+  /// The entries of 'index_' by query id. Adding or removing entries at either end of a
+  /// deque doesn't move the others.
+  typedef boost::unordered_map<TUniqueId, IndexEntry*> QueryIdIndex;
+  QueryIdIndex query_id_index_;
+};
+
+}
+
+#endif
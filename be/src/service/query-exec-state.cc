@@ -14,6 +14,7 @@
 #include "service/query-exec-state.h"
 
 #include <limits>
+#include <boost/algorithm/string.hpp>
 #include <gutil/strings/substitute.h>
 
 #include "exprs/expr.h"
@@ -35,11 +36,22 @@
 #include "common/names.h"
 
 using boost::algorithm::join;
+using boost::algorithm::to_lower_copy;
 using namespace apache::hive::service::cli::thrift;
 using namespace apache::thrift;
 using namespace beeswax;
 using namespace strings;
 
+DEFINE_int32(num_prefetched_result_sets, 0, "(Advanced) If greater than 0, the results "
+    "of queries are evaluated in a background thread ahead of the client's fetches, "
+    "keeping this many fetch-sized result sets ready. This takes the evaluation of the "
+    "output expressions off the fetch RPCs of clients that stream large results.");
+
+DEFINE_int32(max_query_retries, 1, "(Advanced) Maximum number of times a query is "
+    "transparently re-scheduled and re-executed after one of its fragment instances "
+    "could not reach a backend, before any rows were returned. The unreachable backends "
+    "are blacklisted so that the retry avoids them. 0 disables retries.");
+
 DECLARE_int32(catalog_service_port);
 DECLARE_string(catalog_service_host);
 DECLARE_bool(enable_rm);
@@ -65,6 +77,7 @@ ImpalaServer::QueryExecState::QueryExecState(
     session_(session),
     schedule_(NULL),
     coord_(NULL),
+    num_retries_(0),
     result_cache_max_size_(-1),
     profile_(&profile_pool_, "Query"),  // assign name w/ id after planning
     server_profile_(&profile_pool_, "ImpalaServer"),
@@ -75,6 +88,10 @@ ImpalaServer::QueryExecState::QueryExecState(
     current_batch_row_(0),
     num_rows_fetched_(0),
     fetched_rows_(false),
+    prefetched_row_idx_(0),
+    prefetch_fetch_size_(0),
+    prefetch_done_(false),
+    prefetch_cancelled_(false),
     frontend_(frontend),
     parent_server_(server),
     start_time_(TimestampValue::LocalTime()) {
@@ -110,6 +127,7 @@ ImpalaServer::QueryExecState::QueryExecState(
 
 ImpalaServer::QueryExecState::~QueryExecState() {
   DCHECK(wait_thread_.get() == NULL) << "BlockOnWait() needs to be called!";
+  DCHECK(prefetch_thread_.get() == NULL) << "Done() needs to be called!";
 }
 
 Status ImpalaServer::QueryExecState::SetResultCache(QueryResultSet* cache,
@@ -140,6 +158,9 @@ Status ImpalaServer::QueryExecState::Exec(TExecRequest* exec_request) {
     case TStmtType::QUERY:
     case TStmtType::DML:
       DCHECK(exec_request_.__isset.query_exec_request);
+      if (exec_request->stmt_type == TStmtType::QUERY && LookupQueryResultCache()) {
+        return Status::OK();
+      }
       return ExecQueryOrDmlRequest(exec_request_.query_exec_request);
     case TStmtType::EXPLAIN: {
       request_result_set_.reset(new vector<TResultRow>(
@@ -425,8 +446,27 @@ Status ImpalaServer::QueryExecState::ExecQueryOrDmlRequest(
   if (FLAGS_enable_rm) {
     DCHECK(exec_env_->resource_broker() != NULL);
   }
+  Status status = ScheduleAndExec(query_exec_request);
+  while (!status.ok() && RetryAfterBackendFailure(status)) {
+    status = ScheduleAndExec(query_exec_request);
+  }
+  {
+    lock_guard<mutex> l(lock_);
+    RETURN_IF_ERROR(UpdateQueryStatus(status));
+  }
+
+  if (coord_->is_fast_path()) {
+    summary_profile_.AddInfoString("ExecutionPath", "Single node fast path");
+  }
+  profile_.AddChild(coord_->query_profile());
+  return Status::OK();
+}
+
+Status ImpalaServer::QueryExecState::ScheduleAndExec(
+    const TQueryExecRequest& query_exec_request) {
   schedule_.reset(new QuerySchedule(query_id(), query_exec_request,
       exec_request_.query_options, &summary_profile_, query_events_));
+  schedule_->set_attempt(num_retries_);
   coord_.reset(new Coordinator(exec_request_.query_options, exec_env_, query_events_));
   Status status = exec_env_->scheduler()->Schedule(coord_.get(), schedule_.get());
   if (FLAGS_enable_rm) {
@@ -437,11 +477,7 @@ Status ImpalaServer::QueryExecState::ExecQueryOrDmlRequest(
           reservation_request_ss.str());
     }
   }
-
-  {
-    lock_guard<mutex> l(lock_);
-    RETURN_IF_ERROR(UpdateQueryStatus(status));
-  }
+  RETURN_IF_ERROR(status);
 
   if (FLAGS_enable_rm && schedule_->HasReservation()) {
     // Add the granted reservation to the query profile.
@@ -450,14 +486,46 @@ Status ImpalaServer::QueryExecState::ExecQueryOrDmlRequest(
     summary_profile_.AddInfoString("Granted resource reservation", reservation_ss.str());
     query_events_->MarkEvent("Resources reserved");
   }
-  status = coord_->Exec(*schedule_, &output_expr_ctxs_);
-  {
-    lock_guard<mutex> l(lock_);
-    RETURN_IF_ERROR(UpdateQueryStatus(status));
+  return coord_->Exec(*schedule_, &output_expr_ctxs_);
+}
+
+bool ImpalaServer::QueryExecState::RetryAfterBackendFailure(const Status& status) {
+  if (stmt_type() != TStmtType::QUERY || num_retries_ >= FLAGS_max_query_retries) {
+    return false;
   }
+  if (coord_.get() == NULL) return false;
+  vector<TNetworkAddress> unreachable_backends = coord_->unreachable_backends();
+  if (unreachable_backends.empty()) return false;
 
-  profile_.AddChild(coord_->query_profile());
-  return Status::OK();
+  // Cancel() holds lock_ while it cancels coord_, so the attempt is only retired if the
+  // query was not cancelled in the meantime.
+  lock_guard<mutex> l(lock_);
+  if (!query_status_.ok() || query_state_ == QueryState::EXCEPTION) return false;
+  stringstream backends;
+  for (int i = 0; i < unreachable_backends.size(); ++i) {
+    if (i != 0) backends << ", ";
+    backends << unreachable_backends[i];
+  }
+  LOG(INFO) << "Retrying query_id=" << PrintId(query_id()) << " without unreachable "
+            << "backends " << backends.str() << " after error: " << status.GetDetail();
+  coord_->Cancel();
+  Expr::Close(output_expr_ctxs_, coord_->runtime_state());
+  output_expr_ctxs_.clear();
+  Status release_status = exec_env_->scheduler()->Release(schedule_.get());
+  if (!release_status.ok()) {
+    LOG(WARNING) << "Failed to release resources of query " << schedule_->query_id()
+                 << " because of error: " << release_status.GetDetail();
+  }
+  profile_.RemoveChild(coord_->query_profile());
+  retired_coords_.emplace_back();
+  retired_coords_.back().swap(coord_);
+  retired_schedules_.emplace_back();
+  retired_schedules_.back().swap(schedule_);
+  ++num_retries_;
+  summary_profile_.AddInfoString("Retried", Substitute("$0 time(s), unreachable "
+      "backends: $1", num_retries_, backends.str()));
+  query_events_->MarkEvent("Retried after backend failure");
+  return true;
 }
 
 Status ImpalaServer::QueryExecState::ExecDdlRequest() {
@@ -537,7 +605,13 @@ void ImpalaServer::QueryExecState::Done() {
   query_events_->MarkEvent("Unregister query");
 
   if (coord_.get() != NULL) {
+    // The prefetch thread evaluates the output exprs.
+    StopPrefetching();
     Expr::Close(output_expr_ctxs_, coord_->runtime_state());
+    // Let admission control learn from the memory the query actually used.
+    if (query_status_.ok()) {
+      schedule_->set_peak_per_host_mem(coord_->max_per_host_peak_mem());
+    }
     // Release any reserved resources.
     Status status = exec_env_->scheduler()->Release(schedule_.get());
     if (!status.ok()) {
@@ -563,6 +637,10 @@ Status ImpalaServer::QueryExecState::Exec(const TMetadataOpRequest& exec_request
 }
 
 void ImpalaServer::QueryExecState::WaitAsync() {
+  if (coord_.get() != NULL && coord_->is_fast_path()) {
+    Wait();
+    return;
+  }
   wait_thread_.reset(new Thread(
       "query-exec-state", "wait-thread", &ImpalaServer::QueryExecState::Wait, this));
 }
@@ -615,7 +693,15 @@ Status ImpalaServer::QueryExecState::WaitInternal() {
 
   RETURN_IF_ERROR(WaitForChildQueries());
   if (coord_.get() != NULL) {
-    RETURN_IF_ERROR(coord_->Wait());
+    Status status = coord_->Wait();
+    while (!status.ok() && RetryAfterBackendFailure(status)) {
+      status = ScheduleAndExec(exec_request_.query_exec_request);
+      if (status.ok()) {
+        profile_.AddChild(coord_->query_profile());
+        status = coord_->Wait();
+      }
+    }
+    RETURN_IF_ERROR(status);
     RETURN_IF_ERROR(Expr::Open(output_expr_ctxs_, coord_->runtime_state()));
     RETURN_IF_ERROR(UpdateCatalog());
   }
@@ -647,6 +733,9 @@ Status ImpalaServer::QueryExecState::FetchRows(const int32_t max_rows,
 
   // ImpalaServer::FetchInternal has already taken our lock_
   UpdateQueryStatus(FetchRowsInternal(max_rows, fetched_rows));
+  if (eos_ && query_status_.ok() && query_result_cache_entry_ != NULL) {
+    AddToQueryResultCache(fetched_rows);
+  }
 
   MarkInactive();
   return query_status_;
@@ -718,15 +807,7 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
     if (num_rows_fetched_from_cache >= max_rows) return Status::OK();
   }
 
-  // List of expr values to hold evaluated rows from the query
-  vector<void*> result_row;
-  result_row.resize(output_expr_ctxs_.size());
-
-  // List of scales for floating point values in result_row
-  vector<int> scales;
-  scales.resize(result_row.size());
-
-  if (coord_ == NULL) {
+  if (coord_ == NULL && cached_results_ == NULL) {
     // Query with LIMIT 0.
     query_state_ = QueryState::FINISHED;
     eos_ = true;
@@ -734,36 +815,49 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
   }
 
   query_state_ = QueryState::FINISHED;  // results will be ready after this call
-  // Fetch the next batch if we've returned the current batch entirely
-  if (current_batch_ == NULL || current_batch_row_ >= current_batch_->num_rows()) {
-    RETURN_IF_ERROR(FetchNextBatch());
-  }
-  if (current_batch_ == NULL) return Status::OK();
-
   // Maximum number of rows to be fetched from the coord.
   int32_t max_coord_rows = max_rows;
   if (max_rows > 0) {
     DCHECK_LE(num_rows_fetched_from_cache, max_rows);
     max_coord_rows = max_rows - num_rows_fetched_from_cache;
   }
-  {
-    SCOPED_TIMER(row_materialization_timer_);
-    // Convert the available rows, limited by max_coord_rows
-    int available = current_batch_->num_rows() - current_batch_row_;
-    int fetched_count = available;
-    // max_coord_rows <= 0 means no limit
-    if (max_coord_rows > 0 && max_coord_rows < available) fetched_count = max_coord_rows;
-    for (int i = 0; i < fetched_count; ++i) {
-      TupleRow* row = current_batch_->GetRow(current_batch_row_);
-      RETURN_IF_ERROR(GetRowValue(row, &result_row, &scales));
-      RETURN_IF_ERROR(fetched_rows->AddOneRow(result_row, scales));
-      ++num_rows_fetched_;
-      ++current_batch_row_;
+
+  if (cached_results_ != NULL) {
+    // Serve the fetch from the query result cache.
+    QueryResultSet* cached_rows = cached_results_->rows.get();
+    int num_rows = max_coord_rows > 0 ? max_coord_rows : cached_rows->size();
+    num_rows_fetched_ += fetched_rows->AddRows(cached_rows, num_rows_fetched_, num_rows);
+    eos_ = num_rows_fetched_ >= cached_rows->size();
+  } else if (FLAGS_num_prefetched_result_sets > 0 && !coord_->is_fast_path()) {
+    RETURN_IF_ERROR(FetchPrefetchedRows(max_coord_rows, fetched_rows));
+  } else {
+    // Fetch the next batch if we've returned the current batch entirely
+    if (current_batch_ == NULL || current_batch_row_ >= current_batch_->num_rows()) {
+      RETURN_IF_ERROR(FetchNextBatch());
+    }
+    if (current_batch_ == NULL) return Status::OK();
+
+    {
+      SCOPED_TIMER(row_materialization_timer_);
+      // Convert the available rows, limited by max_coord_rows
+      int available = current_batch_->num_rows() - current_batch_row_;
+      int fetched_count = available;
+      // max_coord_rows <= 0 means no limit
+      if (max_coord_rows > 0 && max_coord_rows < available) {
+        fetched_count = max_coord_rows;
+      }
+      RETURN_IF_ERROR(fetched_rows->AddRows(output_expr_ctxs_, current_batch_,
+          current_batch_row_, fetched_count));
+      num_rows_fetched_ += fetched_count;
+      current_batch_row_ += fetched_count;
     }
+    ExprContext::FreeLocalAllocations(output_expr_ctxs_);
+    // Check if there was an error evaluating a row value.
+    RETURN_IF_ERROR(coord_->runtime_state()->CheckQueryState());
+  }
+  if (query_result_cache_entry_ != NULL) {
+    CollectQueryResults(fetched_rows, num_rows_fetched_from_cache);
   }
-  ExprContext::FreeLocalAllocations(output_expr_ctxs_);
-  // Check if there was an error evaluating a row value.
-  RETURN_IF_ERROR(coord_->runtime_state()->CheckQueryState());
 
   // Update the result cache if necessary.
   if (result_cache_max_size_ > 0 && result_cache_.get() != NULL) {
@@ -821,16 +915,6 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
   return Status::OK();
 }
 
-Status ImpalaServer::QueryExecState::GetRowValue(TupleRow* row, vector<void*>* result,
-                                                 vector<int>* scales) {
-  DCHECK(result->size() >= output_expr_ctxs_.size());
-  for (int i = 0; i < output_expr_ctxs_.size(); ++i) {
-    (*result)[i] = output_expr_ctxs_[i]->GetValue(row);
-    (*scales)[i] = output_expr_ctxs_[i]->root()->output_scale();
-  }
-  return Status::OK();
-}
-
 void ImpalaServer::QueryExecState::Cancel(const Status* cause) {
   // Cancel and close child queries before cancelling parent.
   for (ChildQuery& child_query: child_queries_) {
@@ -922,6 +1006,195 @@ Status ImpalaServer::QueryExecState::FetchNextBatch() {
   return Status::OK();
 }
 
+bool ImpalaServer::QueryExecState::LookupQueryResultCache() {
+  QueryResultCache* cache = parent_server_->query_result_cache_.get();
+  // Child queries are issued by their parent, e.g. by COMPUTE STATS.
+  if (cache == NULL || query_ctx_.__isset.parent_query_id) return false;
+  vector<string> tables;
+  const TQueryExecRequest& query_exec_request = exec_request_.query_exec_request;
+  if (query_exec_request.__isset.desc_tbl) {
+    for (const TTableDescriptor& table: query_exec_request.desc_tbl.tableDescriptors) {
+      // Only the data of HDFS tables changes with their catalog versions.
+      if (table.tableType != TTableType::HDFS_TABLE) return false;
+      tables.push_back(to_lower_copy(table.dbName + "." + table.tableName));
+    }
+  }
+  // The descriptor table only has the tables that views read, not the views.
+  for (const TAccessEvent& event: exec_request_.access_events) {
+    if (event.object_type == TCatalogObjectType::TABLE ||
+        event.object_type == TCatalogObjectType::VIEW) {
+      tables.push_back(to_lower_copy(event.name));
+    }
+  }
+
+  // The results are cached in the result set format of the client's protocol.
+  string result_format = "beeswax";
+  if (session_type() == TSessionType::HIVESERVER2) {
+    result_format = session_->hs2_version < TProtocolVersion::HIVE_CLI_SERVICE_PROTOCOL_V6
+        ? "hs2-rows" : "hs2-columns";
+  }
+  if (!QueryResultCache::GetStmtKey(sql_stmt(), result_format,
+      query_ctx_.request.query_options, &query_result_cache_stmt_key_)) {
+    return false;
+  }
+  query_result_cache_key_ = cache->GetKey(query_result_cache_stmt_key_, &tables);
+  if (cache->Lookup(query_result_cache_key_, &cached_results_)) {
+    summary_profile_.AddInfoString("Query Result Cache", "Hit");
+    query_events_->MarkEvent("Results found in query result cache");
+    return true;
+  }
+  summary_profile_.AddInfoString("Query Result Cache", "Miss");
+  query_result_cache_entry_.reset(new QueryResultCache::Entry());
+  query_result_cache_entry_->metadata = result_metadata_;
+  query_result_cache_entry_->tables.swap(tables);
+  return false;
+}
+
+void ImpalaServer::QueryExecState::CollectQueryResults(QueryResultSet* fetched_rows,
+    int start_idx) {
+  QueryResultCache::Entry* entry = query_result_cache_entry_.get();
+  if (entry->rows == NULL) entry->rows.reset(fetched_rows->CreateEmpty(entry->metadata));
+  int num_rows = fetched_rows->size() - start_idx;
+  if (num_rows <= 0) return;
+  entry->rows->AddRows(fetched_rows, start_idx, num_rows);
+  entry->rows_bytes += fetched_rows->ByteSize(start_idx, num_rows);
+  if (entry->rows_bytes > parent_server_->query_result_cache_->max_entry_size()) {
+    VLOG_QUERY << "Results of query " << PrintId(query_id()) << " are too large for "
+               << "the query result cache";
+    query_result_cache_entry_.reset();
+  }
+}
+
+void ImpalaServer::QueryExecState::AddToQueryResultCache(QueryResultSet* fetched_rows) {
+  QueryResultCache::Entry* entry = query_result_cache_entry_.get();
+  // The results are empty if no fetch got rows from the coordinator.
+  if (entry->rows == NULL) entry->rows.reset(fetched_rows->CreateEmpty(entry->metadata));
+  parent_server_->query_result_cache_->Insert(query_result_cache_stmt_key_,
+      query_result_cache_key_, query_result_cache_entry_);
+  query_result_cache_entry_.reset();
+}
+
+Status ImpalaServer::QueryExecState::FetchPrefetchedRows(int32_t max_rows,
+    QueryResultSet* fetched_rows) {
+  DCHECK(!eos_);
+  DCHECK(coord_.get() != NULL);
+  if (prefetch_thread_.get() == NULL) {
+    // Prefetch result sets of the size of the first fetch, clients usually keep it.
+    prefetch_prototype_.reset(fetched_rows->CreateEmpty(result_metadata_));
+    prefetch_fetch_size_ = max(max_rows, 0);
+    prefetch_thread_.reset(new Thread("query-exec-state", "prefetch-results",
+        &ImpalaServer::QueryExecState::PrefetchResults, this));
+  }
+
+  // Like FetchNextBatch(), release lock_ while waiting so calls to Cancel() are not
+  // blocked. fetch_rows_lock_ ensures that only one fetch consumes the results.
+  shared_ptr<QueryResultSet> results;
+  Status prefetch_status;
+  lock_.unlock();
+  {
+    unique_lock<mutex> l(prefetch_lock_);
+    while (prefetched_results_.empty() && !prefetch_done_ && !prefetch_cancelled_) {
+      prefetch_cv_.wait(l);
+    }
+    if (!prefetched_results_.empty()) {
+      results = prefetched_results_.front();
+    } else if (prefetch_cancelled_) {
+      prefetch_status = Status::CANCELLED;
+    } else {
+      prefetch_status = prefetch_status_;
+    }
+  }
+  lock_.lock();
+  RETURN_IF_ERROR(prefetch_status);
+  // Check if query status has changed while waiting.
+  RETURN_IF_ERROR(query_status_);
+  if (results == NULL) {
+    eos_ = true;
+    return Status::OK();
+  }
+
+  // The prefetch thread doesn't modify the result sets it has queued.
+  int num_rows = max_rows > 0 ? max_rows : results->size();
+  int rows_added = fetched_rows->AddRows(results.get(), prefetched_row_idx_, num_rows);
+  num_rows_fetched_ += rows_added;
+  prefetched_row_idx_ += rows_added;
+  if (prefetched_row_idx_ >= results->size()) {
+    lock_guard<mutex> l(prefetch_lock_);
+    prefetched_results_.pop_front();
+    prefetched_row_idx_ = 0;
+    // Report eos with the last rows rather than on the next fetch.
+    eos_ = prefetched_results_.empty() && prefetch_done_ && prefetch_status_.ok();
+    prefetch_cv_.notify_all();
+  }
+  return Status::OK();
+}
+
+void ImpalaServer::QueryExecState::PrefetchResults() {
+  Status status;
+  while (true) {
+    {
+      unique_lock<mutex> l(prefetch_lock_);
+      while (prefetched_results_.size() >= max(FLAGS_num_prefetched_result_sets, 1) &&
+          !prefetch_cancelled_) {
+        prefetch_cv_.wait(l);
+      }
+      if (prefetch_cancelled_) break;
+    }
+    shared_ptr<QueryResultSet> results(
+        prefetch_prototype_->CreateEmpty(result_metadata_));
+    status = PrefetchResultSet(results.get());
+    if (!status.ok() || results->size() == 0) break;
+    lock_guard<mutex> l(prefetch_lock_);
+    prefetched_results_.push_back(results);
+    prefetch_cv_.notify_all();
+  }
+  lock_guard<mutex> l(prefetch_lock_);
+  prefetch_done_ = true;
+  prefetch_status_ = status;
+  prefetch_cv_.notify_all();
+}
+
+Status ImpalaServer::QueryExecState::PrefetchResultSet(QueryResultSet* result_set) {
+  // A fetch size of 0 means no limit, in which case the result set gets one batch.
+  while (prefetch_fetch_size_ <= 0 || result_set->size() < prefetch_fetch_size_) {
+    if (current_batch_ == NULL || current_batch_row_ >= current_batch_->num_rows()) {
+      if (prefetch_fetch_size_ <= 0 && result_set->size() > 0) break;
+      RETURN_IF_ERROR(coord_->GetNext(&current_batch_, coord_->runtime_state()));
+      current_batch_row_ = 0;
+      if (current_batch_ == NULL) break;
+      continue;
+    }
+    SCOPED_TIMER(row_materialization_timer_);
+    int fetched_count = current_batch_->num_rows() - current_batch_row_;
+    if (prefetch_fetch_size_ > 0) {
+      fetched_count = min<int>(fetched_count, prefetch_fetch_size_ - result_set->size());
+    }
+    RETURN_IF_ERROR(result_set->AddRows(output_expr_ctxs_, current_batch_,
+        current_batch_row_, fetched_count));
+    current_batch_row_ += fetched_count;
+    ExprContext::FreeLocalAllocations(output_expr_ctxs_);
+    // Check if there was an error evaluating a row value.
+    RETURN_IF_ERROR(coord_->runtime_state()->CheckQueryState());
+  }
+  return Status::OK();
+}
+
+void ImpalaServer::QueryExecState::StopPrefetching() {
+  if (prefetch_thread_.get() == NULL) return;
+  bool prefetch_done;
+  {
+    lock_guard<mutex> l(prefetch_lock_);
+    prefetch_cancelled_ = true;
+    prefetch_done = prefetch_done_;
+    prefetch_cv_.notify_all();
+  }
+  // Unblock the prefetch thread if it is waiting for the next batch.
+  if (!prefetch_done) coord_->Cancel();
+  prefetch_thread_->Join();
+  prefetch_thread_.reset();
+  prefetched_results_.clear();
+}
+
 void ImpalaServer::QueryExecState::SetResultSet(const vector<string>& results) {
   request_result_set_.reset(new vector<TResultRow>);
   request_result_set_->resize(results.size());
@@ -23,11 +23,14 @@
 #include "scheduling/query-schedule.h"
 #include "gen-cpp/Frontend_types.h"
 #include "service/impala-server.h"
+#include "service/query-result-cache.h"
 #include "gen-cpp/Frontend_types.h"
 #include "util/auth-util.h"
 
 #include <boost/thread.hpp>
 #include <boost/unordered_set.hpp>
+#include <deque>
+#include <list>
 #include <vector>
 
 namespace impala {
@@ -75,7 +78,9 @@ class ImpalaServer::QueryExecState {
   /// by call to Exec(). Waits for all child queries to complete. Takes lock_.
   void Wait();
 
-  /// Calls Wait() asynchronously in a thread and returns immediately.
+  /// Calls Wait() asynchronously in a thread and returns immediately. Queries on the
+  /// single node fast path (see Coordinator::is_fast_path()) call Wait() directly, since
+  /// they produce their first rows faster than a thread can be started.
   void WaitAsync();
 
   /// BlockOnWait() may be called after WaitAsync() has been called in order to wait
@@ -235,6 +240,15 @@ class ImpalaServer::QueryExecState {
   /// not set for ddl queries, or queries with "limit 0"
   boost::scoped_ptr<Coordinator> coord_;
 
+  /// The schedules and coordinators of earlier attempts of the query, which was retried
+  /// by RetryAfterBackendFailure(). They are kept alive until the query is destroyed
+  /// because status reports of their fragment instances may still reach them.
+  std::list<boost::scoped_ptr<QuerySchedule> > retired_schedules_;
+  std::list<boost::scoped_ptr<Coordinator> > retired_coords_;
+
+  /// Number of times the query was retried after losing a backend.
+  int num_retries_;
+
   /// Runs statements that query or modify the catalog via the CatalogService.
   boost::scoped_ptr<CatalogOpExecutor> catalog_op_executor_;
 
@@ -294,6 +308,57 @@ class ImpalaServer::QueryExecState {
   /// (or error) was returned to the client.
   bool fetched_rows_;
 
+  /// Result prefetching, used for queries with --num_prefetched_result_sets > 0. The
+  /// prefetch thread, started by the first fetch, runs PrefetchResults(): it gets the
+  /// batches from the coordinator and evaluates the output exprs into result sets of
+  /// the size of the first fetch, keeping up to --num_prefetched_result_sets of them
+  /// ready. Fetches copy their rows out of these result sets, so the output exprs are
+  /// not evaluated on the client's RPC thread. current_batch_ and current_batch_row_
+  /// are only used by the prefetch thread once it was started.
+  boost::scoped_ptr<Thread> prefetch_thread_;
+
+  /// An empty result set of the client's type, used to create the prefetched ones.
+  boost::scoped_ptr<QueryResultSet> prefetch_prototype_;
+
+  /// Protects the fields below, except prefetched_row_idx_ and prefetch_fetch_size_.
+  /// Must not be held while acquiring lock_.
+  boost::mutex prefetch_lock_;
+
+  /// Signalled when a result set was prefetched or consumed, and when prefetching ended
+  /// or was cancelled. Used with prefetch_lock_.
+  boost::condition_variable prefetch_cv_;
+
+  /// The prefetched result sets. Only the fetches read and remove them, the front one
+  /// starting at prefetched_row_idx_, which is only accessed by the fetches.
+  std::deque<boost::shared_ptr<QueryResultSet> > prefetched_results_;
+  int prefetched_row_idx_;
+
+  /// The number of rows in each prefetched result set, 0 for one batch. Set before the
+  /// prefetch thread is started.
+  int prefetch_fetch_size_;
+
+  /// Set by the prefetch thread when it is done, along with its final status.
+  bool prefetch_done_;
+  Status prefetch_status_;
+
+  /// Set by StopPrefetching() to stop the prefetch thread.
+  bool prefetch_cancelled_;
+
+  /// The keys of the results of this query in ImpalaServer::query_result_cache_, see
+  /// QueryResultCache::GetStmtKey() and GetKey(). Set by LookupQueryResultCache() if the
+  /// query is cacheable.
+  std::string query_result_cache_stmt_key_;
+  std::string query_result_cache_key_;
+
+  /// The results of this query if they were found in the query result cache, in which
+  /// case the query is not executed and the fetches are served from them.
+  QueryResultCache::EntryPtr cached_results_;
+
+  /// The results of a cacheable query, collected as they are fetched from the
+  /// coordinator and added to the query result cache when all of them were fetched.
+  /// Reset if their size exceeds the limit of the cache.
+  boost::shared_ptr<QueryResultCache::Entry> query_result_cache_entry_;
+
   /// To get access to UpdateCatalog, LOAD, and DDL methods. Not owned.
   Frontend* frontend_;
 
@@ -333,6 +398,18 @@ class ImpalaServer::QueryExecState {
   /// Non-blocking.
   Status ExecQueryOrDmlRequest(const TQueryExecRequest& query_exec_request);
 
+  /// Creates schedule_ and coord_ for the current attempt of the query and starts its
+  /// execution. Does not update query_state_/status_.
+  Status ScheduleAndExec(const TQueryExecRequest& query_exec_request);
+
+  /// Called when the current attempt of the query failed with 'status' before any rows
+  /// were returned. If the query is a QUERY statement that has retries left, was not
+  /// cancelled, and lost a backend that its coordinator found unreachable, cancels and
+  /// retires the current attempt so that the caller can start a new one with
+  /// ScheduleAndExec(), and returns true. The scheduler has blacklisted the unreachable
+  /// backends, so the new schedule avoids them. Otherwise returns false.
+  bool RetryAfterBackendFailure(const Status& status);
+
   /// Core logic of executing a ddl statement. May internally initiate execution of
   /// queries (e.g., compute stats) or dml (e.g., create table as select)
   Status ExecDdlRequest();
@@ -354,10 +431,35 @@ class ImpalaServer::QueryExecState {
   /// released.
   Status FetchNextBatch();
 
-  /// Evaluates 'output_expr_ctxs_' against 'row' and output the evaluated row in
-  /// 'result'. The values' scales (# of digits after decimal) are stored in 'scales'.
-  /// result and scales must have been resized to the number of columns before call.
-  Status GetRowValue(TupleRow* row, std::vector<void*>* result, std::vector<int>* scales);
+  /// Implements FetchRowsInternal() with prefetching: copies at most 'max_rows' rows
+  /// (no limit if <= 0) from the prefetched result sets into 'fetched_rows' and starts
+  /// the prefetch thread on the first call. Caller needs to hold lock_, which is
+  /// released while waiting for results.
+  Status FetchPrefetchedRows(int32_t max_rows, QueryResultSet* fetched_rows);
+
+  /// Looks up the results of this query in the query result cache, if it is enabled
+  /// and the query is cacheable. Returns true and sets cached_results_ on a hit.
+  /// Otherwise prepares query_result_cache_entry_ to collect the results.
+  bool LookupQueryResultCache();
+
+  /// Adds the rows of 'fetched_rows' starting at 'start_idx', which were fetched from
+  /// the coordinator, to query_result_cache_entry_.
+  void CollectQueryResults(QueryResultSet* fetched_rows, int start_idx);
+
+  /// Adds query_result_cache_entry_ to the query result cache once all results were
+  /// fetched into 'fetched_rows' (or earlier result sets).
+  void AddToQueryResultCache(QueryResultSet* fetched_rows);
+
+  /// Thread function of the prefetch thread.
+  void PrefetchResults();
+
+  /// Evaluates the next prefetch_fetch_size_ rows from the coordinator into
+  /// 'result_set'. Leaves it empty at the end of the results.
+  Status PrefetchResultSet(QueryResultSet* result_set);
+
+  /// Stops and joins the prefetch thread, if any. Cancels the coordinator if the
+  /// prefetch thread didn't reach the end of the results.
+  void StopPrefetching();
 
   /// Gather and publish all required updates to the metastore
   Status UpdateCatalog();
@@ -0,0 +1,153 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/query-result-cache.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "common/names.h"
+
+using namespace impala;
+
+namespace impala {
+
+// Result set that only counts its rows, for the cache to hold.
+class CountingResultSet : public ImpalaServer::QueryResultSet {
+ public:
+  CountingResultSet() : num_rows_(0) {}
+  virtual Status AddOneRow(const vector<void*>& row, const vector<int>& scales) {
+    ++num_rows_;
+    return Status::OK();
+  }
+  virtual Status AddOneRow(const TResultRow& row) {
+    ++num_rows_;
+    return Status::OK();
+  }
+  virtual int AddRows(const QueryResultSet* other, int start_idx, int num_rows) {
+    num_rows_ += num_rows;
+    return num_rows;
+  }
+  virtual int64_t ByteSize(int start_idx, int num_rows) { return num_rows; }
+  virtual size_t size() { return num_rows_; }
+  virtual QueryResultSet* CreateEmpty(const TResultSetMetadata& metadata) {
+    return new CountingResultSet();
+  }
+
+ private:
+  int num_rows_;
+};
+
+// Returns a cache entry for the results of a query that reads 'tables'.
+boost::shared_ptr<QueryResultCache::Entry> MakeEntry(const vector<string>& tables,
+    int64_t rows_bytes) {
+  boost::shared_ptr<QueryResultCache::Entry> entry(new QueryResultCache::Entry());
+  entry->rows.reset(new CountingResultSet());
+  entry->tables = tables;
+  entry->rows_bytes = rows_bytes;
+  return entry;
+}
+
+TEST(QueryResultCache, NormalizeStmt) {
+  EXPECT_EQ(QueryResultCache::NormalizeStmt("  select\n\t a,  b from t ; "),
+      "select a, b from t");
+  // Whitespace in quotes is kept.
+  EXPECT_EQ(QueryResultCache::NormalizeStmt("select 'a  b',  \"c\\\"  d\" from t"),
+      "select 'a  b', \"c\\\"  d\" from t");
+  EXPECT_EQ(QueryResultCache::NormalizeStmt("select `a  b`;;"), "select `a  b`");
+}
+
+TEST(QueryResultCache, NonDeterministicFunctions) {
+  EXPECT_TRUE(QueryResultCache::CallsNonDeterministicFunction("select now()"));
+  EXPECT_TRUE(QueryResultCache::CallsNonDeterministicFunction("select a, rand (1)"));
+  EXPECT_TRUE(QueryResultCache::CallsNonDeterministicFunction("select count(),uuid()"));
+  EXPECT_FALSE(QueryResultCache::CallsNonDeterministicFunction("select username()"));
+  EXPECT_FALSE(QueryResultCache::CallsNonDeterministicFunction("select now from t"));
+  EXPECT_FALSE(QueryResultCache::CallsNonDeterministicFunction("select a from users"));
+}
+
+TEST(QueryResultCache, StmtKey) {
+  TQueryOptions options;
+  string key1, key2;
+  ASSERT_TRUE(QueryResultCache::GetStmtKey("select a from t", "beeswax", options,
+      &key1));
+  ASSERT_TRUE(QueryResultCache::GetStmtKey("select  a\nfrom t;", "beeswax", options,
+      &key2));
+  EXPECT_EQ(key1, key2);
+  ASSERT_TRUE(QueryResultCache::GetStmtKey("select a from t", "hs2-rows", options,
+      &key2));
+  EXPECT_NE(key1, key2);
+  options.__set_batch_size(10);
+  ASSERT_TRUE(QueryResultCache::GetStmtKey("select a from t", "beeswax", options,
+      &key2));
+  EXPECT_NE(key1, key2);
+
+  EXPECT_FALSE(QueryResultCache::GetStmtKey("select /* +NO_RESULT_CACHE */ a from t",
+      "beeswax", options, &key2));
+  EXPECT_FALSE(QueryResultCache::GetStmtKey("select now()", "beeswax", options,
+      &key2));
+}
+
+TEST(QueryResultCache, Invalidation) {
+  QueryResultCache cache(1024, 1024);
+  QueryResultCache::EntryPtr result;
+  vector<string> tables;
+  tables.push_back("db.t2");
+  tables.push_back("db.t1");
+  string key = cache.GetKey("q1", &tables);
+  EXPECT_FALSE(cache.Lookup(key, &result));
+  cache.Insert("q1", key, MakeEntry(tables, 10));
+  ASSERT_TRUE(cache.Lookup(key, &result));
+  EXPECT_EQ(cache.GetKey("q1", &tables), key);
+
+  vector<string> other_tables(1, "db.t3");
+  string other_key = cache.GetKey("q2", &other_tables);
+  cache.Insert("q2", other_key, MakeEntry(other_tables, 10));
+  EXPECT_EQ(cache.size(), 2);
+
+  // Updates of a table evict the results that read it and change their key.
+  cache.InvalidateTable("db.t1");
+  EXPECT_FALSE(cache.Lookup(key, &result));
+  EXPECT_TRUE(cache.Lookup(other_key, &result));
+  EXPECT_NE(cache.GetKey("q1", &tables), key);
+
+  // Results of queries that ran during a table update are not added.
+  key = cache.GetKey("q1", &tables);
+  cache.InvalidateTable("db.t2");
+  cache.Insert("q1", key, MakeEntry(tables, 10));
+  EXPECT_FALSE(cache.Lookup(key, &result));
+  EXPECT_FALSE(cache.Lookup(cache.GetKey("q1", &tables), &result));
+
+  cache.InvalidateAll();
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_NE(cache.GetKey("q2", &other_tables), other_key);
+}
+
+TEST(QueryResultCache, MaxEntrySize) {
+  QueryResultCache cache(1024, 100);
+  QueryResultCache::EntryPtr result;
+  vector<string> tables(1, "db.t");
+  string key = cache.GetKey("q", &tables);
+  cache.Insert("q", key, MakeEntry(tables, 200));
+  EXPECT_FALSE(cache.Lookup(key, &result));
+  cache.Insert("q", key, MakeEntry(tables, 10));
+  EXPECT_TRUE(cache.Lookup(key, &result));
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,217 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/query-result-cache.h"
+
+#include <algorithm>
+#include <map>
+#include <ctype.h>
+#include <boost/algorithm/string.hpp>
+#include <gutil/strings/substitute.h>
+
+#include "service/query-options.h"
+#include "util/impalad-metrics.h"
+
+#include "common/names.h"
+
+using boost::algorithm::to_lower_copy;
+using namespace impala;
+using namespace strings;
+
+DEFINE_int64(query_result_cache_capacity, 0, "(Advanced) Maximum number of bytes of "
+    "final query results kept in an impalad-wide cache, so that repeated identical "
+    "queries against unchanged tables are answered without executing them. If 0, the "
+    "cache is disabled.");
+DEFINE_int64(query_result_cache_max_entry_size, 16L * 1024L * 1024L, "(Advanced) "
+    "Maximum number of bytes of the results of a single query in the query result "
+    "cache. Results of queries that return more are not cached.");
+
+// The hint in a comment of a statement that bypasses the cache.
+static const string NO_RESULT_CACHE_HINT = "+no_result_cache";
+
+// Functions whose results depend on more than their arguments.
+static const char* NON_DETERMINISTIC_FNS[] = {
+    "now", "current_timestamp", "unix_timestamp", "utc_timestamp", "rand", "random",
+    "uuid", "user", "current_user", "effective_user", "current_database", "pid",
+    "sleep", "version"};
+
+namespace {
+
+// Returns true if 'c' can be part of an identifier.
+inline bool IsIdentifierChar(char c) {
+  return isalnum(c) || c == '_';
+}
+
+// Returns true if 'entry' holds the results of a query that reads 'table'.
+inline bool ReadsTable(const QueryResultCache::Entry& entry, const string& table) {
+  return binary_search(entry.tables.begin(), entry.tables.end(), table);
+}
+
+// Predicate for LruCache::EraseIf() that matches the results that read 'table'.
+struct ReadsTablePredicate {
+  ReadsTablePredicate(const string& table) : table(table) {}
+  bool operator()(const QueryResultCache::Entry& entry) const {
+    return ReadsTable(entry, table);
+  }
+  const string& table;
+};
+
+}
+
+QueryResultCache::QueryResultCache(int64_t capacity, int64_t max_entry_size)
+  : max_entry_size_(min(max_entry_size, capacity)),
+    generation_(0),
+    cache_(capacity) {
+}
+
+string QueryResultCache::NormalizeStmt(const string& stmt) {
+  string result;
+  result.reserve(stmt.size());
+  char quote = 0;
+  bool pending_space = false;
+  for (int i = 0; i < stmt.size(); ++i) {
+    char c = stmt[i];
+    if (quote != 0) {
+      result += c;
+      if (c == '\\' && i + 1 < stmt.size()) {
+        result += stmt[++i];
+      } else if (c == quote) {
+        quote = 0;
+      }
+      continue;
+    }
+    if (isspace(c)) {
+      pending_space = true;
+      continue;
+    }
+    if (pending_space && !result.empty()) result += ' ';
+    pending_space = false;
+    if (c == '\'' || c == '"' || c == '`') quote = c;
+    result += c;
+  }
+  // Remove trailing semicolons, with the whitespace before them.
+  while (!result.empty() && (result[result.size() - 1] == ';' ||
+      result[result.size() - 1] == ' ')) {
+    result.erase(result.size() - 1);
+  }
+  return result;
+}
+
+bool QueryResultCache::CallsNonDeterministicFunction(const string& stmt) {
+  for (const char* fn: NON_DETERMINISTIC_FNS) {
+    const int len = strlen(fn);
+    size_t pos = stmt.find(fn);
+    while (pos != string::npos) {
+      size_t end = pos + len;
+      // Only match the whole name followed by an argument list, e.g. not "username".
+      if ((pos == 0 || !IsIdentifierChar(stmt[pos - 1])) && end < stmt.size()) {
+        if (stmt[end] == ' ') ++end;
+        if (end < stmt.size() && stmt[end] == '(') return true;
+      }
+      pos = stmt.find(fn, pos + 1);
+    }
+  }
+  return false;
+}
+
+bool QueryResultCache::GetStmtKey(const string& stmt, const string& result_format,
+    const TQueryOptions& query_options, string* stmt_key) {
+  string normalized = NormalizeStmt(stmt);
+  string lower_stmt = to_lower_copy(normalized);
+  if (lower_stmt.find(NO_RESULT_CACHE_HINT) != string::npos) return false;
+  if (CallsNonDeterministicFunction(lower_stmt)) return false;
+
+  stmt_key->clear();
+  stmt_key->append(normalized);
+  stmt_key->push_back('\0');
+  stmt_key->append(result_format);
+  map<string, string> options;
+  TQueryOptionsToMap(query_options, &options);
+  for (const map<string, string>::value_type& option: options) {
+    stmt_key->push_back('\0');
+    stmt_key->append(option.first);
+    stmt_key->push_back('=');
+    stmt_key->append(option.second);
+  }
+  return true;
+}
+
+string QueryResultCache::GetKey(const string& stmt_key, vector<string>* tables) {
+  sort(tables->begin(), tables->end());
+  tables->erase(unique(tables->begin(), tables->end()), tables->end());
+  lock_guard<mutex> l(lock_);
+  string key = stmt_key;
+  key.push_back('\0');
+  key.append(Substitute("$0", generation_));
+  for (const string& table: *tables) {
+    TableVersionMap::const_iterator version = table_versions_.find(table);
+    key.push_back('\0');
+    key.append(Substitute("$0@$1", table,
+        version == table_versions_.end() ? 0 : version->second));
+  }
+  return key;
+}
+
+bool QueryResultCache::Lookup(const string& key, EntryPtr* entry) {
+  bool hit = cache_.Get(key, entry);
+  if (hit) {
+    if (ImpaladMetrics::QUERY_RESULT_CACHE_HIT_COUNT != NULL) {
+      ImpaladMetrics::QUERY_RESULT_CACHE_HIT_COUNT->Increment(1L);
+    }
+  } else if (ImpaladMetrics::QUERY_RESULT_CACHE_MISS_COUNT != NULL) {
+    ImpaladMetrics::QUERY_RESULT_CACHE_MISS_COUNT->Increment(1L);
+  }
+  return hit;
+}
+
+void QueryResultCache::Insert(const string& stmt_key, const string& key,
+    const EntryPtr& entry) {
+  DCHECK(entry->rows != NULL);
+  vector<string> tables = entry->tables;
+  // The versions of the tables changed if they were updated while the query ran, in
+  // which case its results may be stale. An invalidation between this check and the
+  // Put() below is harmless: the entry can't be hit with the bumped versions.
+  if (GetKey(stmt_key, &tables) != key) return;
+  int64_t charge = entry->rows_bytes + key.size();
+  if (charge > max_entry_size_) return;
+  cache_.Put(key, entry, charge);
+  UpdateMetrics();
+}
+
+void QueryResultCache::InvalidateTable(const string& table) {
+  {
+    lock_guard<mutex> l(lock_);
+    ++table_versions_[table];
+  }
+  cache_.EraseIf(ReadsTablePredicate(table));
+  UpdateMetrics();
+}
+
+void QueryResultCache::InvalidateAll() {
+  {
+    lock_guard<mutex> l(lock_);
+    ++generation_;
+  }
+  cache_.Clear();
+  UpdateMetrics();
+}
+
+void QueryResultCache::UpdateMetrics() {
+  if (ImpaladMetrics::QUERY_RESULT_CACHE_NUM_ENTRIES != NULL) {
+    ImpaladMetrics::QUERY_RESULT_CACHE_NUM_ENTRIES->set_value(cache_.size());
+  }
+  if (ImpaladMetrics::QUERY_RESULT_CACHE_TOTAL_BYTES != NULL) {
+    ImpaladMetrics::QUERY_RESULT_CACHE_TOTAL_BYTES->set_value(cache_.total_charge());
+  }
+}
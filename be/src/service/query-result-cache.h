@@ -0,0 +1,134 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_SERVICE_QUERY_RESULT_CACHE_H
+#define IMPALA_SERVICE_QUERY_RESULT_CACHE_H
+
+#include <string>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "service/impala-server.h"
+#include "util/lru-cache.h"
+
+namespace impala {
+
+/// Cache of the final result sets of queries, shared by all sessions of an impalad and
+/// enabled by --query_result_cache_capacity. Serves clients that repeatedly issue the
+/// same SELECT against tables that rarely change, such as dashboards.
+///
+/// A query's results are cached under a key made of its normalized statement text, the
+/// result set format of the client's protocol, its query options and the versions of
+/// all tables and views it reads. A table's version is bumped by every catalog update
+/// of the table, which also evicts the results that read it, so results are never
+/// served after an update of their tables was applied to this impalad's catalog.
+/// Changes to files that are not announced to the catalog, e.g. by external writers
+/// without a REFRESH, are not detected, like for the planner's metadata.
+///
+/// The results of a query are added once a client fetched all of them, if they fit
+/// --query_result_cache_max_entry_size. Queries that call non-deterministic functions,
+/// read tables other than HDFS tables or have the +no_result_cache hint in a comment
+/// (e.g. "select /* +no_result_cache */ ...") bypass the cache.
+///
+/// Entries are evicted in LRU order when the total size of the cached results exceeds
+/// the capacity. This class is thread-safe.
+class QueryResultCache {
+ public:
+  /// The results of a query. Immutable once added to the cache, so any number of queries
+  /// can read them at the same time.
+  struct Entry {
+    /// Metadata of the rows, which the result set refers to.
+    TResultSetMetadata metadata;
+
+    /// The rows in the result set format of the client's protocol. Created by the first
+    /// fetch.
+    boost::scoped_ptr<ImpalaServer::QueryResultSet> rows;
+
+    /// The tables and views the query reads, as lower case "db.table".
+    std::vector<std::string> tables;
+
+    /// Approximate size of 'rows' in bytes.
+    int64_t rows_bytes;
+
+    Entry() : rows_bytes(0) {}
+  };
+
+  typedef LruCache<std::string, Entry>::ValuePtr EntryPtr;
+
+  /// 'capacity' is the limit on the total size of the cached results in bytes.
+  /// 'max_entry_size' is the limit for the results of a single query.
+  QueryResultCache(int64_t capacity, int64_t max_entry_size);
+
+  int64_t max_entry_size() const { return max_entry_size_; }
+
+  /// Returns a key of the results of 'stmt' that identifies everything but the versions
+  /// of its tables: the normalized statement, the result set format 'result_format' and
+  /// 'query_options'. Returns false, if the statement must not be cached.
+  static bool GetStmtKey(const std::string& stmt, const std::string& result_format,
+      const TQueryOptions& query_options, std::string* stmt_key);
+
+  /// Returns the key of the results of a query with 'stmt_key' that reads 'tables',
+  /// which includes their current versions. Sorts 'tables'.
+  std::string GetKey(const std::string& stmt_key, std::vector<std::string>* tables);
+
+  /// Returns true and sets 'entry' if there are cached results for 'key'.
+  bool Lookup(const std::string& key, EntryPtr* entry);
+
+  /// Adds 'entry', the results of a query with 'stmt_key', under the key that was
+  /// returned by GetKey() before the query started. Drops the entry if any of its tables
+  /// changed since then.
+  void Insert(const std::string& stmt_key, const std::string& key,
+      const EntryPtr& entry);
+
+  /// Evicts the results of queries that read 'table' ("db.table") and bumps its version.
+  void InvalidateTable(const std::string& table);
+
+  /// Evicts all results, e.g. after a function was changed or the catalog was reset.
+  void InvalidateAll();
+
+  /// Returns 'stmt' with each run of whitespace outside of quotes replaced by a single
+  /// space and with leading and trailing whitespace and semicolons removed.
+  static std::string NormalizeStmt(const std::string& stmt);
+
+  /// Returns true if the normalized, lower case 'stmt' calls a function whose result
+  /// depends on more than its arguments, e.g. now() or rand().
+  static bool CallsNonDeterministicFunction(const std::string& stmt);
+
+  size_t size() { return cache_.size(); }
+
+ private:
+  const int64_t max_entry_size_;
+
+  /// Protects table_versions_ and generation_. Not held while accessing cache_.
+  boost::mutex lock_;
+
+  /// The versions of the tables that were changed since the cache was created. Tables
+  /// without an entry have version 0.
+  typedef boost::unordered_map<std::string, int64_t> TableVersionMap;
+  TableVersionMap table_versions_;
+
+  /// Bumped by InvalidateAll(), part of every key.
+  int64_t generation_;
+
+  LruCache<std::string, Entry> cache_;
+
+  /// Updates the num-entries and total-bytes metrics.
+  void UpdateMetrics();
+};
+
+}
+
+#endif
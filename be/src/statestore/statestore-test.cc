@@ -12,15 +12,21 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <gutil/strings/substitute.h>
+
 #include "testutil/gtest-util.h"
 #include "testutil/in-process-servers.h"
 #include "common/init.h"
 #include "util/metrics.h"
+#include "util/pretty-printer.h"
+#include "util/stopwatch.h"
+#include "statestore/statestore.h"
 #include "statestore/statestore-subscriber.h"
 
 #include "common/names.h"
 
 using namespace impala;
+using namespace strings;
 
 DECLARE_string(ssl_server_certificate);
 DECLARE_string(ssl_private_key);
@@ -89,6 +95,54 @@ TEST(StatestoreSslTest, SmokeTest) {
   ASSERT_FALSE(sub_will_not_start->Start().ok());
 }
 
+// Checks the deltas of a large topic and logs how long it takes to build them.
+TEST(StatestoreTest, TopicDeltas) {
+  const int NUM_ENTRIES = 200000;
+  MetricGroup metrics("topic-deltas");
+  Statestore::Topic topic("topic", metrics.AddGauge<int64_t>("key-size", 0),
+      metrics.AddGauge<int64_t>("value-size", 0),
+      metrics.AddGauge<int64_t>("topic-size", 0));
+  for (int i = 0; i < NUM_ENTRIES; ++i) {
+    topic.Put(Substitute("key-$0", i), string(100, 'a' + i % 26));
+  }
+  Statestore::TopicEntry::Version initial_version = topic.last_version();
+  // Update every 100th entry and then delete every 1000th.
+  for (int i = 0; i < NUM_ENTRIES; i += 100) {
+    topic.Put(Substitute("key-$0", i), "updated");
+  }
+  for (int i = 0; i < NUM_ENTRIES; i += 1000) {
+    topic.Put(Substitute("key-$0", i), Statestore::TopicEntry::NULL_VALUE);
+  }
+
+  MonotonicStopWatch sw;
+  sw.Start();
+  shared_ptr<const TTopicDelta> full_delta = topic.GetDelta(0);
+  LOG(INFO) << "Full delta: " << PrettyPrinter::Print(sw.ElapsedTime(), TUnit::TIME_NS);
+  EXPECT_FALSE(full_delta->is_delta);
+  EXPECT_EQ(NUM_ENTRIES - NUM_ENTRIES / 1000, full_delta->topic_entries.size());
+  EXPECT_EQ(NUM_ENTRIES / 1000, full_delta->topic_deletions.size());
+  EXPECT_EQ(topic.last_version(), full_delta->to_version);
+
+  sw.Reset();
+  shared_ptr<const TTopicDelta> delta = topic.GetDelta(initial_version);
+  LOG(INFO) << "Incremental delta: "
+            << PrettyPrinter::Print(sw.ElapsedTime(), TUnit::TIME_NS);
+  EXPECT_TRUE(delta->is_delta);
+  EXPECT_EQ(initial_version, delta->from_version);
+  EXPECT_EQ(NUM_ENTRIES / 100 - NUM_ENTRIES / 1000, delta->topic_entries.size());
+  EXPECT_EQ(NUM_ENTRIES / 1000, delta->topic_deletions.size());
+  for (const TTopicItem& item: delta->topic_entries) EXPECT_EQ("updated", item.value);
+
+  // Subscribers at the same version share the delta until the topic changes.
+  sw.Reset();
+  EXPECT_EQ(delta.get(), topic.GetDelta(initial_version).get());
+  LOG(INFO) << "Cached delta: " << PrettyPrinter::Print(sw.ElapsedTime(), TUnit::TIME_NS);
+  topic.Put("key-1", "updated");
+  shared_ptr<const TTopicDelta> new_delta = topic.GetDelta(initial_version);
+  EXPECT_NE(delta.get(), new_delta.get());
+  EXPECT_EQ(delta->topic_entries.size() + 1, new_delta->topic_entries.size());
+}
+
 }
 
 int main(int argc, char **argv) {
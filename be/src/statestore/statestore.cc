@@ -141,7 +141,7 @@ Statestore::TopicEntry::Version Statestore::Topic::Put(const string& key,
   value_size_delta += bytes.size();
 
   entry_it->second.SetValue(bytes, ++last_version_);
-  topic_update_log_.insert(make_pair(entry_it->second.version(), key));
+  topic_update_log_.insert(make_pair(entry_it->second.version(), &*entry_it));
 
   total_key_size_bytes_ += key_size_delta;
   total_value_size_bytes_ += value_size_delta;
@@ -161,7 +161,7 @@ void Statestore::Topic::DeleteIfVersionsMatch(TopicEntry::Version version,
     // Add a new entry with the the version history for this deletion and remove the old
     // entry
     topic_update_log_.erase(version);
-    topic_update_log_.insert(make_pair(++last_version_, key));
+    topic_update_log_.insert(make_pair(++last_version_, &*entry_it));
     total_value_size_bytes_ -= entry_it->second.value().size();
     DCHECK_GE(total_value_size_bytes_, static_cast<int64_t>(0));
 
@@ -171,6 +171,54 @@ void Statestore::Topic::DeleteIfVersionsMatch(TopicEntry::Version version,
   }
 }
 
+shared_ptr<const TTopicDelta> Statestore::Topic::GetDelta(
+    TopicEntry::Version from_version) {
+  if (delta_cache_version_ != last_version_) {
+    delta_cache_.clear();
+    delta_cache_version_ = last_version_;
+  }
+  bool cacheable = from_version > Subscriber::TOPIC_INITIAL_VERSION;
+  if (cacheable) {
+    DeltaCache::const_iterator it = delta_cache_.find(from_version);
+    if (it != delta_cache_.end()) return it->second;
+  }
+
+  shared_ptr<TTopicDelta> topic_delta(new TTopicDelta());
+  topic_delta->topic_name = topic_id_;
+  // If the subscriber version is > 0, send this update as a delta. Otherwise, this is
+  // a new subscriber so send them a non-delta update that includes all items in the
+  // topic.
+  topic_delta->is_delta = cacheable;
+  topic_delta->__set_from_version(from_version);
+
+  TopicUpdateLog::const_iterator next_update =
+      topic_update_log_.upper_bound(from_version);
+  for (; next_update != topic_update_log_.end(); ++next_update) {
+    const TopicEntryKey& key = next_update->second->first;
+    const TopicEntry& topic_entry = next_update->second->second;
+    DCHECK_EQ(topic_entry.version(), next_update->first);
+    if (topic_entry.value() == Statestore::TopicEntry::NULL_VALUE) {
+      topic_delta->topic_deletions.push_back(key);
+    } else {
+      topic_delta->topic_entries.push_back(TTopicItem());
+      TTopicItem& topic_item = topic_delta->topic_entries.back();
+      topic_item.key = key;
+      topic_item.value = topic_entry.value();
+    }
+  }
+
+  if (topic_update_log_.size() > 0) {
+    // The largest version for this topic will be the last item in the version history
+    // map.
+    topic_delta->__set_to_version(topic_update_log_.rbegin()->first);
+  } else {
+    // There are no updates in the version history
+    topic_delta->__set_to_version(Subscriber::TOPIC_INITIAL_VERSION);
+  }
+  if (cacheable) delta_cache_[from_version] = topic_delta;
+  return topic_delta;
+}
+
 Statestore::Subscriber::Subscriber(const SubscriberId& subscriber_id,
     const TUniqueId& registration_id, const TNetworkAddress& network_address,
     const vector<TTopicRegistration>& subscribed_topics)
@@ -342,6 +390,7 @@ Status Statestore::OfferUpdate(const ScheduledSubscriberUpdate& update,
     lock_guard<mutex> l(subscribers_lock_);
     SubscriberMap::iterator subscriber_it = subscribers_.find(update.second);
     DCHECK(subscriber_it != subscribers_.end());
+    RemoveSubscriberTopicVersions(*subscriber_it->second);
     subscribers_.erase(subscriber_it);
     LOG(ERROR) << ss.str();
     return Status(ss.str());
@@ -381,6 +430,7 @@ Status Statestore::RegisterSubscriber(const SubscriberId& subscriber_id,
     shared_ptr<Subscriber> current_registration(
         new Subscriber(subscriber_id, *registration_id, location, topic_registrations));
     subscribers_.insert(make_pair(subscriber_id, current_registration));
+    AddSubscriberTopicVersions(*current_registration);
     failure_detector_->UpdateHeartbeat(
         PrintId(current_registration->registration_id()), true);
     num_subscribers_metric_->set_value(subscribers_.size());
@@ -441,11 +491,14 @@ Status Statestore::SendTopicUpdate(Subscriber* subscriber, bool* update_skipped)
   map<TopicEntryKey, TTopicDelta>::const_iterator topic_delta =
       update_state_request.topic_deltas.begin();
   for (; topic_delta != update_state_request.topic_deltas.end(); ++topic_delta) {
-    subscriber->SetLastTopicVersionProcessed(topic_delta->first,
+    SetLastTopicVersionProcessed(subscriber, topic_delta->first,
         topic_delta->second.to_version);
   }
 
   // Thirdly: perform any / all updates returned by the subscriber
+  // Requests for a different delta base, which are applied after releasing topic_lock_
+  // because subscribers_lock_ cannot be taken while holding it.
+  vector<pair<TopicId, TopicEntry::Version> > from_versions;
   {
     lock_guard<mutex> l(topic_lock_);
     for (const TTopicDelta& update: response.topic_updates) {
@@ -466,7 +519,7 @@ Status Statestore::SendTopicUpdate(Subscriber* subscriber, bool* update_skipped)
         LOG(INFO) << "Received request for different delta base of topic: "
                   << update.topic_name << " from: " << subscriber->id()
                   << " subscriber from_version: " << update.from_version;
-        subscriber->SetLastTopicVersionProcessed(topic_it->first, update.from_version);
+        from_versions.push_back(make_pair(topic_it->first, update.from_version));
       }
 
       Topic* topic = &topic_it->second;
@@ -482,70 +535,43 @@ Status Statestore::SendTopicUpdate(Subscriber* subscriber, bool* update_skipped)
       }
     }
   }
+  for (const pair<TopicId, TopicEntry::Version>& from_version: from_versions) {
+    SetLastTopicVersionProcessed(subscriber, from_version.first, from_version.second);
+  }
   topic_update_duration_metric_->Update(sw.ElapsedTime() / (1000.0 * 1000.0 * 1000.0));
   return Status::OK();
 }
 
 void Statestore::GatherTopicUpdates(const Subscriber& subscriber,
     TUpdateStateRequest* update_state_request) {
+  // The deltas are shared with other subscribers, so they are only copied into the
+  // request after releasing topic_lock_.
+  vector<shared_ptr<const TTopicDelta> > topic_deltas;
   {
     lock_guard<mutex> l(topic_lock_);
     for (const Subscriber::Topics::value_type& subscribed_topic:
          subscriber.subscribed_topics()) {
-      TopicMap::const_iterator topic_it = topics_.find(subscribed_topic.first);
+      TopicMap::iterator topic_it = topics_.find(subscribed_topic.first);
       DCHECK(topic_it != topics_.end());
 
       TopicEntry::Version last_processed_version =
           subscriber.LastTopicVersionProcessed(topic_it->first);
-      const Topic& topic = topic_it->second;
-
-      TTopicDelta& topic_delta =
-          update_state_request->topic_deltas[subscribed_topic.first];
-      topic_delta.topic_name = subscribed_topic.first;
-
-      // If the subscriber version is > 0, send this update as a delta. Otherwise, this is
-      // a new subscriber so send them a non-delta update that includes all items in the
-      // topic.
-      topic_delta.is_delta = last_processed_version > Subscriber::TOPIC_INITIAL_VERSION;
-      topic_delta.__set_from_version(last_processed_version);
+      Topic* topic = &topic_it->second;
 
-      if (!topic_delta.is_delta &&
-          topic.last_version() > Subscriber::TOPIC_INITIAL_VERSION) {
+      if (last_processed_version == Subscriber::TOPIC_INITIAL_VERSION &&
+          topic->last_version() > Subscriber::TOPIC_INITIAL_VERSION) {
         int64_t topic_size =
-            topic.total_key_size_bytes() + topic.total_value_size_bytes();
-        VLOG_QUERY << "Preparing initial " << topic_delta.topic_name
+            topic->total_key_size_bytes() + topic->total_value_size_bytes();
+        VLOG_QUERY << "Preparing initial " << subscribed_topic.first
                    << " topic update for " << subscriber.id() << ". Size = "
                    << PrettyPrinter::Print(topic_size, TUnit::BYTES);
       }
-
-      TopicUpdateLog::const_iterator next_update =
-          topic.topic_update_log().upper_bound(last_processed_version);
-
-      for (; next_update != topic.topic_update_log().end(); ++next_update) {
-        TopicEntryMap::const_iterator itr = topic.entries().find(next_update->second);
-        DCHECK(itr != topic.entries().end());
-        const TopicEntry& topic_entry = itr->second;
-        if (topic_entry.value() == Statestore::TopicEntry::NULL_VALUE) {
-          topic_delta.topic_deletions.push_back(itr->first);
-        } else {
-          topic_delta.topic_entries.push_back(TTopicItem());
-          TTopicItem& topic_item = topic_delta.topic_entries.back();
-          topic_item.key = itr->first;
-          // TODO: Does this do a needless copy?
-          topic_item.value = topic_entry.value();
-        }
-      }
-
-      if (topic.topic_update_log().size() > 0) {
-        // The largest version for this topic will be the last item in the version history
-        // map.
-        topic_delta.__set_to_version(topic.topic_update_log().rbegin()->first);
-      } else {
-        // There are no updates in the version history
-        topic_delta.__set_to_version(Subscriber::TOPIC_INITIAL_VERSION);
-      }
+      topic_deltas.push_back(topic->GetDelta(last_processed_version));
     }
   }
+  for (const shared_ptr<const TTopicDelta>& topic_delta: topic_deltas) {
+    update_state_request->topic_deltas[topic_delta->topic_name] = *topic_delta;
+  }
 
   // Fill in the min subscriber topic version. This must be done after releasing
   // topic_lock_.
@@ -559,22 +585,43 @@ void Statestore::GatherTopicUpdates(const Subscriber& subscriber,
 
 const Statestore::TopicEntry::Version Statestore::GetMinSubscriberTopicVersion(
     const TopicId& topic_id, SubscriberId* subscriber_id) {
-  TopicEntry::Version min_topic_version = numeric_limits<int64_t>::max();
-  bool found = false;
-  // Find the minimum version processed for this topic across all topic subscribers.
-  for (const SubscriberMap::value_type& subscriber: subscribers_) {
-    if (subscriber.second->subscribed_topics().find(topic_id) !=
-        subscriber.second->subscribed_topics().end()) {
-      found = true;
-      TopicEntry::Version last_processed_version =
-          subscriber.second->LastTopicVersionProcessed(topic_id);
-      if (last_processed_version < min_topic_version) {
-        min_topic_version = last_processed_version;
-        if (subscriber_id != NULL) *subscriber_id = subscriber.second->id();
-      }
-    }
+  SubscriberTopicVersionMap::const_iterator it =
+      subscriber_topic_versions_.find(topic_id);
+  if (it == subscriber_topic_versions_.end() || it->second.empty()) {
+    return Subscriber::TOPIC_INITIAL_VERSION;
+  }
+  const pair<TopicEntry::Version, SubscriberId>& min_version = *it->second.begin();
+  if (subscriber_id != NULL) *subscriber_id = min_version.second;
+  return min_version.first;
+}
+
+void Statestore::SetLastTopicVersionProcessed(Subscriber* subscriber,
+    const TopicId& topic_id, TopicEntry::Version version) {
+  lock_guard<mutex> l(subscribers_lock_);
+  SubscriberMap::const_iterator it = subscribers_.find(subscriber->id());
+  bool is_registered = it != subscribers_.end() && it->second.get() == subscriber;
+  if (is_registered) {
+    TopicVersionSet* versions = &subscriber_topic_versions_[topic_id];
+    versions->erase(make_pair(subscriber->LastTopicVersionProcessed(topic_id),
+        subscriber->id()));
+    versions->insert(make_pair(version, subscriber->id()));
+  }
+  subscriber->SetLastTopicVersionProcessed(topic_id, version);
+}
+
+void Statestore::AddSubscriberTopicVersions(const Subscriber& subscriber) {
+  for (const Subscriber::Topics::value_type& topic: subscriber.subscribed_topics()) {
+    subscriber_topic_versions_[topic.first].insert(
+        make_pair(topic.second.last_version, subscriber.id()));
+  }
+}
+
+void Statestore::RemoveSubscriberTopicVersions(const Subscriber& subscriber) {
+  for (const Subscriber::Topics::value_type& topic: subscriber.subscribed_topics()) {
+    SubscriberTopicVersionMap::iterator it = subscriber_topic_versions_.find(topic.first);
+    if (it == subscriber_topic_versions_.end()) continue;
+    it->second.erase(make_pair(topic.second.last_version, subscriber.id()));
   }
-  return found ? min_topic_version : Subscriber::TOPIC_INITIAL_VERSION;
 }
 
 bool Statestore::ShouldExit() {
@@ -741,6 +788,7 @@ void Statestore::UnregisterSubscriber(Subscriber* subscriber) {
   }
   num_subscribers_metric_->Increment(-1L);
   subscriber_set_metric_->Remove(subscriber->id());
+  RemoveSubscriberTopicVersions(*subscriber);
   subscribers_.erase(subscriber->id());
 }
 
@@ -19,10 +19,13 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <boost/unordered_map.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/uuid/uuid_generators.hpp>
+#include <gtest/gtest_prod.h> // for FRIEND_TEST
 
 #include "gen-cpp/Types_types.h"
 #include "gen-cpp/StatestoreSubscriber.h"
@@ -121,6 +124,8 @@ class Statestore {
   void SetExitFlag();
 
  private:
+  FRIEND_TEST(StatestoreTest, TopicDeltas);
+
   /// A TopicEntry is a single entry in a topic, and logically is a <string, byte string>
   /// pair. If the byte string is NULL, the entry has been deleted, but may be retained to
   /// track changes to send to subscribers.
@@ -166,9 +171,12 @@ class Statestore {
   /// Map from TopicEntryKey to TopicEntry, maintained by a Topic object.
   typedef boost::unordered_map<TopicEntryKey, TopicEntry> TopicEntryMap;
 
-  /// Map from Version to TopicEntryKey, maintained by a Topic object. Effectively a log of
-  /// the updates made to a Topic, ordered by version.
-  typedef std::map<TopicEntry::Version, TopicEntryKey> TopicUpdateLog;
+  /// Map from Version to the entry in the TopicEntryMap with that version, maintained by
+  /// a Topic object. Effectively a log of the updates made to a Topic, ordered by
+  /// version. Entries are never removed from the TopicEntryMap, and references to its
+  /// elements stay valid when it is rehashed, so the log can point to them directly.
+  typedef std::map<TopicEntry::Version, const TopicEntryMap::value_type*>
+      TopicUpdateLog;
 
   /// A Topic is logically a map between a string key and a sequence of bytes. A <string,
   /// bytes> pair is a TopicEntry.
@@ -181,7 +189,8 @@ class Statestore {
         IntGauge* value_size_metric, IntGauge* topic_size_metric)
         : topic_id_(topic_id), last_version_(0L), total_key_size_bytes_(0L),
           total_value_size_bytes_(0L), key_size_metric_(key_size_metric),
-          value_size_metric_(value_size_metric), topic_size_metric_(topic_size_metric) { }
+          value_size_metric_(value_size_metric), topic_size_metric_(topic_size_metric),
+          delta_cache_version_(0L) { }
 
     /// Adds an entry with the given key. If bytes == NULL_VALUE, the entry is considered
     /// deleted, and may be garbage collected in the future. The entry is assigned a new
@@ -201,6 +210,16 @@ class Statestore {
     /// Must be called holding the topic lock
     void DeleteIfVersionsMatch(TopicEntry::Version version, const TopicEntryKey& key);
 
+    /// Returns the delta of all entries updated after 'from_version', up to the last
+    /// version of the topic. Incremental deltas are cached until the topic changes, so
+    /// that subscribers that have processed the same version share a single delta,
+    /// which is usually the case for all subscribers after each round of updates.
+    /// Non-delta updates, i.e. those from version 0, aren't cached because they contain
+    /// the whole topic. min_subscriber_topic_version is not set.
+    //
+    /// Must be called holding the topic lock
+    boost::shared_ptr<const TTopicDelta> GetDelta(TopicEntry::Version from_version);
+
     const TopicId& id() const { return topic_id_; }
     const TopicEntryMap& entries() const { return entries_; }
     TopicEntry::Version last_version() const { return last_version_; }
@@ -220,13 +239,7 @@ class Statestore {
     TopicEntry::Version last_version_;
 
     /// Contains a history of updates to this Topic, with each key being a Version and the
-    /// value being a TopicEntryKey. Used to look up the TopicEntry in the entries_ map
-    /// corresponding to each version update.
-    //
-    /// TODO: Looking up a TopicEntry from the topic_update_log_ requires two reads - one
-    /// to get the TopicEntryKey and another to use that key to look up the corresponding
-    /// TopicEntry in the entries_ map. Based on performance needs, we may need to revisit
-    /// this to find a way to do the look up using a single read.
+    /// value being the entry of entries_ with that version.
     TopicUpdateLog topic_update_log_;
 
     /// Total memory occupied by the key strings, in bytes
@@ -239,6 +252,13 @@ class Statestore {
     IntGauge* key_size_metric_;
     IntGauge* value_size_metric_;
     IntGauge* topic_size_metric_;
+
+    /// Cache of the deltas returned by GetDelta(), by their from version. Only valid
+    /// while last_version_ == delta_cache_version_.
+    typedef std::map<TopicEntry::Version, boost::shared_ptr<const TTopicDelta> >
+        DeltaCache;
+    DeltaCache delta_cache_;
+    TopicEntry::Version delta_cache_version_;
   };
 
   /// Note on locking: Subscribers and Topics should be accessed under their own coarse
@@ -342,6 +362,15 @@ class Statestore {
   /// topic_lock_.
   boost::mutex subscribers_lock_;
 
+  /// The last version of each topic processed by each of its subscribers, ordered by
+  /// version, so that the minimum version of a topic can be found without enumerating
+  /// all subscribers. Maintained by SetLastTopicVersionProcessed(),
+  /// AddSubscriberTopicVersions() and RemoveSubscriberTopicVersions(). Protected by
+  /// subscribers_lock_.
+  typedef std::set<std::pair<TopicEntry::Version, SubscriberId> > TopicVersionSet;
+  typedef boost::unordered_map<TopicId, TopicVersionSet> SubscriberTopicVersionMap;
+  SubscriberTopicVersionMap subscriber_topic_versions_;
+
   /// Map of subscribers currently connected; upon failure their entry is removed from this
   /// map. Subscribers must only be removed by UnregisterSubscriber() which ensures that
   /// the correct cleanup is done. If a subscriber re-registers, it must be unregistered
@@ -468,22 +497,28 @@ class Statestore {
       TUpdateStateRequest* update_state_request);
 
   /// Returns the minimum last processed topic version across all subscribers for the given
-  /// topic ID. Calculated by enumerating all subscribers and looking at their
-  /// LastTopicVersionProcessed() for this topic. The value returned will always be <=
-  /// topics_[topic_id].last_version_. Returns TOPIC_INITIAL_VERSION if no subscribers are
-  /// registered to the topic. The subscriber ID to whom the min version belongs can also
-  /// be retrieved using the optional subscriber_id output parameter. If multiple
-  /// subscribers have the same min version, the subscriber_id may be set to any one of the
-  /// matching subscribers.
+  /// topic ID, as tracked in subscriber_topic_versions_. The value returned will always
+  /// be <= topics_[topic_id].last_version_. Returns TOPIC_INITIAL_VERSION if no
+  /// subscribers are registered to the topic. The subscriber ID to whom the min version
+  /// belongs can also be retrieved using the optional subscriber_id output parameter. If
+  /// multiple subscribers have the same min version, the subscriber_id may be set to any
+  /// one of the matching subscribers.
   //
   /// Must be called holding the subscribers_ lock.
-  //
-  /// TODO: Update the min subscriber version only when a topic is updated, rather than
-  /// each time a subscriber is updated. One way to do this would be to keep a priority
-  /// queue in Topic of each subscriber's last processed version of the topic.
   const TopicEntry::Version GetMinSubscriberTopicVersion(const TopicId& topic_id,
       SubscriberId* subscriber_id = NULL);
 
+  /// Sets the last version of 'topic_id' processed by 'subscriber' and updates
+  /// subscriber_topic_versions_ if 'subscriber' is still registered. Takes
+  /// subscribers_lock_.
+  void SetLastTopicVersionProcessed(Subscriber* subscriber, const TopicId& topic_id,
+      TopicEntry::Version version);
+
+  /// Adds the versions of all topics that 'subscriber' subscribes to to, or removes them
+  /// from, subscriber_topic_versions_. Must be called holding subscribers_lock_.
+  void AddSubscriberTopicVersions(const Subscriber& subscriber);
+  void RemoveSubscriberTopicVersions(const Subscriber& subscriber);
+
   /// True if the shutdown flag has been set true, false otherwise.
   bool ShouldExit();
 
@@ -112,6 +112,13 @@ class FunctionContextImpl {
 
   RuntimeState* state() { return state_; }
 
+  /// The function registered with FunctionContext::SetBatchFunction(), or NULL.
+  impala_udf::BatchUdf batch_fn() const { return batch_fn_; }
+
+  /// Scratch memory for evaluating batches, owned by and reused across calls of the
+  /// caller of 'batch_fn_'.
+  std::vector<uint8_t>* batch_scratch() { return &batch_scratch_; }
+
  private:
   friend class impala_udf::FunctionContext;
   friend class ExprContext;
@@ -166,6 +173,10 @@ class FunctionContextImpl {
   void* thread_local_fn_state_;
   void* fragment_local_fn_state_;
 
+  /// The batched version of the UDF, see batch_fn().
+  impala_udf::BatchUdf batch_fn_;
+  std::vector<uint8_t> batch_scratch_;
+
   /// The number of bytes allocated externally by the user function. In some cases,
   /// it is too inconvenient to use the Allocate()/Free() APIs in the FunctionContext,
   /// particularly for existing codebases (e.g. they use std::vector). Instead, they'll
@@ -277,6 +277,25 @@ TEST(UdfTest, MemTest) {
 
 }
 
+TEST(UdfTest, TestBatchColumn) {
+  uint8_t nulls[2] = { 0, 0 };
+  int32_t values[10];
+  UdfBatchColumn col;
+  col.values = values;
+  col.nulls = nulls;
+  for (int i = 0; i < 10; ++i) {
+    col.SetNull(i, i % 3 == 0);
+    col.Values<int32_t>()[i] = i;
+  }
+  for (int i = 0; i < 10; ++i) EXPECT_EQ(col.IsNull(i), i % 3 == 0) << i;
+  EXPECT_EQ(nulls[0], 0x49);
+  EXPECT_EQ(nulls[1], 0x02);
+  col.SetNull(3, false);
+  EXPECT_FALSE(col.IsNull(3));
+  EXPECT_TRUE(col.IsNull(6));
+  EXPECT_EQ(col.Values<int32_t>()[9], 9);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   InitCommonRuntime(argc, argv, false, TestInfo::BE_TEST);
@@ -40,6 +40,13 @@ struct IntVal;
 struct BigIntVal;
 struct StringVal;
 struct TimestampVal;
+struct UdfBatchColumn;
+
+class FunctionContext;
+
+/// A UDF that evaluates a batch of rows in one call, see the UDFs section below.
+typedef void (*BatchUdf)(FunctionContext* context, int num_rows,
+    const UdfBatchColumn* args, UdfBatchColumn* result);
 
 /// A FunctionContext is passed to every UDF/UDA and is the interface for the UDF to the
 /// rest of the system. It contains APIs to examine the system state, report errors and
@@ -175,6 +182,10 @@ class FunctionContext {
   void SetFunctionState(FunctionStateScope scope, void* ptr);
   void* GetFunctionState(FunctionStateScope scope) const;
 
+  /// Registers 'fn' as the batched version of this UDF, see the UDFs section below.
+  /// Should be called from the UDF's prepare function. Passing NULL unregisters it.
+  void SetBatchFunction(BatchUdf fn);
+
   /// Returns the return type information of this function. For UDAs, this is the final
   /// return type of the UDA (e.g., the type returned by the finalize function).
   const TypeDesc& GetReturnType() const;
@@ -305,6 +316,44 @@ typedef void (*UdfPrepare)(FunctionContext* context,
 typedef void (*UdfClose)(FunctionContext* context,
                          FunctionContext::FunctionStateScope scope);
 
+/// ------ Batched Evaluation -------
+/// ---------------------------------
+/// A UDF can additionally provide a version of itself that evaluates many rows per call,
+/// which saves the call overhead of each row and lets the UDF loop over plain arrays.
+/// The prepare function registers it with FunctionContext::SetBatchFunction(). Impala
+/// then may call either version for any row, so both must compute the same results.
+/// Currently the batched version is used to evaluate UDFs that are predicates, e.g.
+/// "select * from tbl where my_udf(x)", and the row version everywhere else.
+///
+/// The batched version gets one UdfBatchColumn per argument, holding the argument
+/// values of 'num_rows' rows, and writes the results to the column 'result'. The result
+/// column is initialized to non-NULL zero values. Errors and warnings are reported
+/// through the FunctionContext as usual.
+
+/// The values of an argument or the results of a batch of rows. Row i is NULL if bit
+/// (i % 8) of nulls[i / 8] is set, otherwise its value is values[i], an array of:
+///   bool for BOOLEAN, int8_t for TINYINT, int16_t for SMALLINT, int32_t for INT,
+///   int64_t for BIGINT, float for FLOAT, double for DOUBLE, StringVal for STRING,
+///   VARCHAR and CHAR, TimestampVal for TIMESTAMP and DecimalVal for DECIMAL.
+/// The 'is_null' field of StringVal, TimestampVal and DecimalVal values is unused. The
+/// data of input strings is owned by Impala and is valid for the duration of the call;
+/// result strings must be allocated like the ones returned by the row version.
+struct UdfBatchColumn {
+  void* values;
+  uint8_t* nulls;
+
+  bool IsNull(int i) const { return (nulls[i >> 3] & (1 << (i & 7))) != 0; }
+
+  void SetNull(int i, bool is_null) {
+    uint8_t bit = 1 << (i & 7);
+    nulls[i >> 3] = is_null ? (nulls[i >> 3] | bit) : (nulls[i >> 3] & ~bit);
+  }
+
+  /// Returns the values as an array of 'T'.
+  template <typename T>
+  T* Values() const { return reinterpret_cast<T*>(values); }
+};
+
 //----------------------------------------------------------------------------
 //------------------------------- UDAs ---------------------------------------
 //----------------------------------------------------------------------------
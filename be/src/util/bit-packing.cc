@@ -0,0 +1,167 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/bit-packing.h"
+
+#include <algorithm>
+#include <immintrin.h>
+#include <string.h>
+
+#include "common/logging.h"
+#include "util/cpu-info.h"
+
+namespace impala {
+
+namespace {
+
+/// Number of bytes past the end of a group of 8 values that the kernels may read: the
+/// last value of a scalar group is read with a 64-bit load, and the second half of a
+/// SIMD group with a 128-bit load that starts in the middle of the group.
+const int MAX_OVERREAD_BYTES = 16;
+
+/// Returns the number of whole groups of 8 values that can be unpacked from 'in_bytes'
+/// bytes without reading past the end of the input.
+inline int NumGroups(int bit_width, int64_t in_bytes, int num_values) {
+  DCHECK_GT(bit_width, 0);
+  int64_t max_end = in_bytes - bit_width - MAX_OVERREAD_BYTES;
+  if (max_end < 0) return 0;
+  return std::min<int64_t>(num_values / 8, max_end / bit_width + 1);
+}
+
+/// Shuffle controls, multipliers and shift amounts of the SIMD kernels for each bit
+/// width. A group of 8 values is processed as two halves of 4 values, the second of
+/// which is loaded starting at byte (4 * bit_width) / 8 of the group. For value i of a
+/// half, bytes [4 * i, 4 * i + 4) of the shuffle control select the 4 bytes starting
+/// at the value's first byte, and the value then starts at bit 'shift' of that 32-bit
+/// word.
+struct UnpackTables {
+  /// Shuffle control of both halves, the second in bytes [16, 32).
+  uint8_t shuffle[BitPacking::MAX_BIT_WIDTH + 1][32];
+  /// 'shift' of each value, for _mm256_srlv_epi32().
+  uint32_t shift[BitPacking::MAX_BIT_WIDTH + 1][8];
+  /// 1 << (7 - 'shift') for each value: multiplying by it and shifting right by 7 is a
+  /// right shift by 'shift', which SSE4.1 lacks for variable amounts.
+  uint32_t mult[BitPacking::MAX_BIT_WIDTH + 1][8];
+
+  UnpackTables() {
+    memset(this, 0, sizeof(*this));
+    for (int bit_width = 1; bit_width <= BitPacking::MAX_BIT_WIDTH; ++bit_width) {
+      for (int half = 0; half < 2; ++half) {
+        int half_byte_offset = half * (4 * bit_width) / 8;
+        for (int i = 0; i < 4; ++i) {
+          int bit = (half * 4 + i) * bit_width;
+          int byte = bit / 8 - half_byte_offset;
+          int shift_amount = bit % 8;
+          for (int b = 0; b < 4; ++b) {
+            // Bytes past the end of a 128-bit half are never needed for the bit widths
+            // the SIMD kernels support.
+            shuffle[bit_width][half * 16 + i * 4 + b] = std::min(byte + b, 15);
+          }
+          shift[bit_width][half * 4 + i] = shift_amount;
+          mult[bit_width][half * 4 + i] = 1U << (7 - shift_amount);
+        }
+      }
+    }
+  }
+};
+
+const UnpackTables UNPACK_TABLES;
+
+}
+
+int BitPacking::UnpackValues(int bit_width, const uint8_t* in, int64_t in_bytes,
+    int num_values, uint32_t* out) {
+  if (CpuInfo::IsSupported(CpuInfo::AVX2)) {
+    return UnpackValuesAVX2(bit_width, in, in_bytes, num_values, out);
+  } else if (CpuInfo::IsSupported(CpuInfo::SSE4_1)) {
+    return UnpackValuesSSE4(bit_width, in, in_bytes, num_values, out);
+  }
+  return UnpackValuesScalar(bit_width, in, in_bytes, num_values, out);
+}
+
+int BitPacking::UnpackValuesScalar(int bit_width, const uint8_t* in, int64_t in_bytes,
+    int num_values, uint32_t* out) {
+  DCHECK_LE(bit_width, MAX_BIT_WIDTH);
+  const uint64_t mask = (1ULL << bit_width) - 1;
+  const int num_groups = NumGroups(bit_width, in_bytes, num_values);
+  for (int g = 0; g < num_groups; ++g) {
+    const uint8_t* group = in + g * bit_width;
+    // Each value and its offset within its first byte fit in 64 bits.
+    for (int i = 0; i < 8; ++i) {
+      int bit = i * bit_width;
+      uint64_t word;
+      memcpy(&word, group + bit / 8, sizeof(word));
+      out[i] = (word >> (bit % 8)) & mask;
+    }
+    out += 8;
+  }
+  return num_groups * 8;
+}
+
+int __attribute__((target("sse4.1"))) BitPacking::UnpackValuesSSE4(int bit_width,
+    const uint8_t* in, int64_t in_bytes, int num_values, uint32_t* out) {
+  if (bit_width > MAX_SIMD_BIT_WIDTH) {
+    return UnpackValuesScalar(bit_width, in, in_bytes, num_values, out);
+  }
+  const __m128i shuffle_lo = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(&UNPACK_TABLES.shuffle[bit_width][0]));
+  const __m128i shuffle_hi = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(&UNPACK_TABLES.shuffle[bit_width][16]));
+  const __m128i mult_lo = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(&UNPACK_TABLES.mult[bit_width][0]));
+  const __m128i mult_hi = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(&UNPACK_TABLES.mult[bit_width][4]));
+  const __m128i mask = _mm_set1_epi32((1U << bit_width) - 1);
+  const int half_byte_offset = (4 * bit_width) / 8;
+  const int num_groups = NumGroups(bit_width, in_bytes, num_values);
+  for (int g = 0; g < num_groups; ++g) {
+    const uint8_t* group = in + g * bit_width;
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    __m128i hi =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(group + half_byte_offset));
+    lo = _mm_srli_epi32(_mm_mullo_epi32(_mm_shuffle_epi8(lo, shuffle_lo), mult_lo), 7);
+    hi = _mm_srli_epi32(_mm_mullo_epi32(_mm_shuffle_epi8(hi, shuffle_hi), mult_hi), 7);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_and_si128(lo, mask));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_and_si128(hi, mask));
+    out += 8;
+  }
+  return num_groups * 8;
+}
+
+int __attribute__((target("avx2"))) BitPacking::UnpackValuesAVX2(int bit_width,
+    const uint8_t* in, int64_t in_bytes, int num_values, uint32_t* out) {
+  if (bit_width > MAX_SIMD_BIT_WIDTH) {
+    return UnpackValuesScalar(bit_width, in, in_bytes, num_values, out);
+  }
+  const __m256i shuffle = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(&UNPACK_TABLES.shuffle[bit_width][0]));
+  const __m256i shift = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(&UNPACK_TABLES.shift[bit_width][0]));
+  const __m256i mask = _mm256_set1_epi32((1U << bit_width) - 1);
+  const int half_byte_offset = (4 * bit_width) / 8;
+  const int num_groups = NumGroups(bit_width, in_bytes, num_values);
+  for (int g = 0; g < num_groups; ++g) {
+    const uint8_t* group = in + g * bit_width;
+    __m256i v = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(group + half_byte_offset)), 1);
+    // _mm256_shuffle_epi8() shuffles within each 128-bit lane.
+    v = _mm256_srlv_epi32(_mm256_shuffle_epi8(v, shuffle), shift);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_and_si256(v, mask));
+    out += 8;
+  }
+  return num_groups * 8;
+}
+
+}
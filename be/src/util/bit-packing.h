@@ -0,0 +1,63 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_UTIL_BIT_PACKING_H
+#define IMPALA_UTIL_BIT_PACKING_H
+
+#include <stdint.h>
+
+namespace impala {
+
+/// Kernels that unpack runs of bit-packed values, in the layout written by BitWriter:
+/// value i of width 'bit_width' occupies bits [i * bit_width, (i + 1) * bit_width) of
+/// the input, counting from the least significant bit of the first byte.
+///
+/// Values are unpacked in groups of 8, which always span exactly 'bit_width' bytes, so
+/// the input of every group is byte aligned. On CPUs with AVX2 a group is unpacked with
+/// one shuffle and one variable shift; with SSE4.1 the variable shift is emulated by a
+/// multiplication. Both require a value and its bit offset within its first byte to fit
+/// in 32 bits, i.e. a bit width of at most 25. Wider values are unpacked with 64-bit
+/// scalar loads.
+class BitPacking {
+ public:
+  /// Maximum bit width supported by UnpackValues().
+  static const int MAX_BIT_WIDTH = 32;
+
+  /// Unpacks up to 'num_values' values of width 'bit_width' from 'in', which holds
+  /// 'in_bytes' bytes, into 'out'. Only whole groups of 8 values are unpacked, and the
+  /// kernels may read up to 16 bytes past the end of a group, so fewer values than
+  /// requested may be returned; the caller must unpack the remainder itself. Returns
+  /// the number of values unpacked, a multiple of 8. The input consumed is
+  /// 'return value' * 'bit_width' / 8 bytes.
+  static int UnpackValues(int bit_width, const uint8_t* in, int64_t in_bytes,
+      int num_values, uint32_t* out);
+
+  /// Same as UnpackValues(), but always uses the given kernel. The SSE4.1 and AVX2
+  /// versions must only be called if the CPU supports them. Exposed for testing and
+  /// benchmarking.
+  static int UnpackValuesScalar(int bit_width, const uint8_t* in, int64_t in_bytes,
+      int num_values, uint32_t* out);
+  static int UnpackValuesSSE4(int bit_width, const uint8_t* in, int64_t in_bytes,
+      int num_values, uint32_t* out);
+  static int UnpackValuesAVX2(int bit_width, const uint8_t* in, int64_t in_bytes,
+      int num_values, uint32_t* out);
+
+ private:
+  /// Largest bit width the SIMD kernels support, see class comment.
+  static const int MAX_SIMD_BIT_WIDTH = 25;
+};
+
+}
+
+#endif
@@ -112,6 +112,13 @@ class BitReader {
   template<typename T>
   bool GetValue(int num_bits, T* v);
 
+  /// Gets the next 'num_values' values from the buffer into 'v'. Once the stream is
+  /// byte aligned, whole groups of 8 values are unpacked with BitPacking::UnpackValues().
+  /// Returns the number of values read, which is less than 'num_values' only if there
+  /// are not enough bytes left. num_bits must be <= 32.
+  template<typename T>
+  int GetValues(int num_bits, T* v, int num_values);
+
   /// Reads a 'num_bytes'-sized value from the buffer and stores it in 'v'. T needs to be a
   /// little-endian native type and big enough to store 'num_bytes'. The value is assumed
   /// to be byte-aligned so the stream will be advanced to the start of the next byte
@@ -140,6 +147,10 @@ class BitReader {
 
   int byte_offset_;       // Offset in buffer_
   int bit_offset_;        // Offset in buffered_values_
+
+  /// Number of values GetValues() unpacks at a time into a temporary buffer when T is
+  /// not 32 bits wide.
+  static const int UNPACK_BATCH_SIZE = 128;
 };
 
 }
@@ -18,6 +18,8 @@
 
 #include "util/bit-stream-utils.h"
 
+#include "util/bit-packing.h"
+
 namespace impala {
 
 inline bool BitWriter::PutValue(uint64_t v, int num_bits) {
@@ -112,6 +114,65 @@ inline bool BitReader::GetValue(int num_bits, T* v) {
   return true;
 }
 
+template<typename T>
+inline int BitReader::GetValues(int num_bits, T* v, int num_values) {
+  DCHECK(buffer_ != NULL);
+  DCHECK_LE(num_bits, 32);
+  DCHECK_LE(num_bits, sizeof(T) * 8);
+
+  int num_read = 0;
+  // Values are only unpacked in bulk from the start of a byte.
+  while (num_read < num_values && (bit_offset_ % 8 != 0 || num_bits == 0)) {
+    if (UNLIKELY(!GetValue(num_bits, &v[num_read]))) return num_read;
+    ++num_read;
+  }
+
+  int byte_pos = byte_offset_ + bit_offset_ / 8;
+  const uint8_t* in = buffer_ + byte_pos;
+  int64_t in_bytes = max_bytes_ - byte_pos;
+  int num_unpacked = 0;
+  while (num_read + num_unpacked < num_values) {
+    int n;
+    if (sizeof(T) == sizeof(uint32_t)) {
+      n = BitPacking::UnpackValues(num_bits, in, in_bytes,
+          num_values - num_read - num_unpacked,
+          reinterpret_cast<uint32_t*>(v + num_read + num_unpacked));
+    } else {
+      uint32_t unpacked[UNPACK_BATCH_SIZE];
+      n = BitPacking::UnpackValues(num_bits, in, in_bytes,
+          std::min(UNPACK_BATCH_SIZE, num_values - num_read - num_unpacked), unpacked);
+      for (int i = 0; i < n; ++i) {
+        v[num_read + num_unpacked + i] = static_cast<T>(unpacked[i]);
+      }
+    }
+    if (n == 0) break;
+    // Groups of 8 values always end on a byte boundary.
+    int bytes_consumed = n / 8 * num_bits;
+    in += bytes_consumed;
+    in_bytes -= bytes_consumed;
+    num_unpacked += n;
+  }
+
+  if (num_unpacked > 0) {
+    num_read += num_unpacked;
+    byte_offset_ = in - buffer_;
+    bit_offset_ = 0;
+    int bytes_remaining = max_bytes_ - byte_offset_;
+    if (LIKELY(bytes_remaining >= 8)) {
+      memcpy(&buffered_values_, buffer_ + byte_offset_, 8);
+    } else {
+      memcpy(&buffered_values_, buffer_ + byte_offset_, bytes_remaining);
+    }
+  }
+
+  // The kernels leave the last few values, close to the end of the buffer, to us.
+  while (num_read < num_values) {
+    if (UNLIKELY(!GetValue(num_bits, &v[num_read]))) return num_read;
+    ++num_read;
+  }
+  return num_read;
+}
+
 template<typename T>
 inline bool BitReader::GetAligned(int num_bytes, T* v) {
   DCHECK_LE(num_bytes, sizeof(T));
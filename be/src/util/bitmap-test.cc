@@ -163,6 +163,29 @@ TEST(Bitmap, OverflowTest) {
   EXPECT_FALSE(bm.Get<true>(bit_idx));
 }
 
+TEST(Bitmap, NextUnsetBitTest) {
+  Bitmap bm(200);
+  bm.SetAllBits(true);
+  EXPECT_EQ(bm.NextUnsetBit(0), 200);
+  bm.Set<false>(3, false);
+  bm.Set<false>(130, false);
+  EXPECT_EQ(bm.NextUnsetBit(0), 3);
+  EXPECT_EQ(bm.NextUnsetBit(3), 3);
+  EXPECT_EQ(bm.NextUnsetBit(4), 130);
+  EXPECT_EQ(bm.NextUnsetBit(130), 130);
+  EXPECT_EQ(bm.NextUnsetBit(131), 200);
+  EXPECT_EQ(bm.NextUnsetBit(200), 200);
+
+  bm.SetAllBits(false);
+  EXPECT_EQ(bm.NextUnsetBit(0), 0);
+  EXPECT_EQ(bm.NextUnsetBit(199), 199);
+  // The unset bits of the last word past num_bits() are never returned.
+  for (int i = 0; i < 200; ++i) bm.Set<false>(i, true);
+  EXPECT_EQ(bm.NextUnsetBit(0), 200);
+  Bitmap bm_empty(0);
+  EXPECT_EQ(bm_empty.NextUnsetBit(0), 0);
+}
+
 /// Test that bitmap memory usage calculation is correct.
 TEST(Bitmap, MemUsage) {
   // 70 bits requires two int64s, for 16 bytes.
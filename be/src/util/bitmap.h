@@ -16,6 +16,8 @@
 #ifndef IMPALA_UTIL_BITMAP_H
 #define IMPALA_UTIL_BITMAP_H
 
+#include <algorithm>
+
 #include "util/bit-util.h"
 
 namespace impala {
@@ -91,6 +93,21 @@ class Bitmap {
     return (buffer_[word_index] & (1LL << bit_index)) != 0;
   }
 
+  /// Returns the index of the first unset bit at or after 'bit_index', or num_bits() if
+  /// all of them are set. Skips over words with all bits set.
+  int64_t NextUnsetBit(int64_t bit_index) const {
+    DCHECK_GE(bit_index, 0);
+    if (bit_index >= num_bits_) return num_bits_;
+    int64_t word_index = bit_index >> NUM_OFFSET_BITS;
+    uint64_t unset = ~buffer_[word_index] & (~0ULL << (bit_index & BIT_INDEX_MASK));
+    while (unset == 0) {
+      if (++word_index == buffer_.size()) return num_bits_;
+      unset = ~buffer_[word_index];
+    }
+    int64_t result = (word_index << NUM_OFFSET_BITS) + __builtin_ctzll(unset);
+    return std::min(result, num_bits_);
+  }
+
   /// Bitwise ANDs the src bitmap into this one.
   void And(const Bitmap* src) {
     DCHECK_EQ(num_bits(), src->num_bits());
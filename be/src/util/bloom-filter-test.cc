@@ -20,6 +20,8 @@
 
 #include <gtest/gtest.h>
 
+#include "util/cpu-info.h"
+
 using namespace std;
 
 namespace {
@@ -229,9 +231,85 @@ TEST(BloomFilter, Or) {
   ASSERT_FALSE(bf2.Find(81));
 }
 
+TEST(BloomFilter, OrThrift) {
+  BloomFilter bf1(BloomFilter::MinLogSpace(100, 0.01));
+  BloomFilter bf2(BloomFilter::MinLogSpace(100, 0.01));
+  for (int i = 0; i < 10; ++i) bf1.Insert(i);
+  for (int i = 60; i < 80; ++i) bf2.Insert(i);
+
+  TBloomFilter thrift_bf1;
+  BloomFilter::ToThrift(&bf1, &thrift_bf1);
+  TBloomFilter thrift_bf2;
+  BloomFilter::ToThrift(&bf2, &thrift_bf2);
+  bf2.Or(thrift_bf1);
+  for (int i = 0; i < 10; ++i) ASSERT_TRUE(bf2.Find(i));
+  for (int i = 60; i < 80; ++i) ASSERT_TRUE(bf2.Find(i));
+  ASSERT_FALSE(bf2.Find(81));
+
+  // OR-ing the serialized filters gives the same directory.
+  BloomFilter::Or(thrift_bf1, &thrift_bf2);
+  TBloomFilter thrift_or;
+  BloomFilter::ToThrift(&bf2, &thrift_or);
+  EXPECT_EQ(thrift_bf2.directory, thrift_or.directory);
+}
+
+// FindBatch() returns the same results as Find().
+TEST(BloomFilter, FindBatch) {
+  srand(0);
+  BloomFilter bf(12);
+  vector<uint32_t> hashes;
+  for (int i = 0; i < 1000; ++i) {
+    hashes.push_back(MakeRand());
+    if (i % 2 == 0) bf.Insert(hashes.back());
+  }
+  // Use a size that is not a multiple of the batch size.
+  bool found[1000];
+  int num_found = bf.FindBatch(&hashes[0], 999, found);
+  int expected_num_found = 0;
+  for (int i = 0; i < 999; ++i) {
+    EXPECT_EQ(bf.Find(hashes[i]), found[i]) << i;
+    if (i % 2 == 0) EXPECT_TRUE(found[i]) << i;
+    expected_num_found += found[i];
+  }
+  EXPECT_EQ(expected_num_found, num_found);
+}
+
+// The AVX2 and scalar code paths must build identical filters, since filters are
+// exchanged between machines that may not all support AVX2.
+TEST(BloomFilter, Avx2Compatibility) {
+  if (!CpuInfo::IsSupported(CpuInfo::AVX2)) return;
+  srand(0);
+  vector<uint32_t> hashes;
+  for (int i = 0; i < (1 << 12); ++i) hashes.push_back(MakeRand());
+
+  BloomFilter avx2_bf(14);
+  for (uint32_t hash: hashes) avx2_bf.Insert(hash);
+  CpuInfo::EnableFeature(CpuInfo::AVX2, false);
+  BloomFilter scalar_bf(14);
+  for (uint32_t hash: hashes) scalar_bf.Insert(hash);
+
+  TBloomFilter avx2_thrift, scalar_thrift;
+  BloomFilter::ToThrift(&avx2_bf, &avx2_thrift);
+  BloomFilter::ToThrift(&scalar_bf, &scalar_thrift);
+  EXPECT_EQ(scalar_thrift.directory, avx2_thrift.directory);
+
+  // Lookups with either path agree, for present as well as for (mostly) absent values.
+  vector<bool> scalar_found;
+  for (int i = 0; i < hashes.size(); ++i) {
+    EXPECT_TRUE(avx2_bf.Find(hashes[i]));
+    scalar_found.push_back(avx2_bf.Find(~hashes[i]));
+  }
+  CpuInfo::EnableFeature(CpuInfo::AVX2, true);
+  for (int i = 0; i < hashes.size(); ++i) {
+    EXPECT_TRUE(scalar_bf.Find(hashes[i]));
+    EXPECT_EQ(scalar_found[i], scalar_bf.Find(~hashes[i]));
+  }
+}
+
 }  // namespace impala
 
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
   return RUN_ALL_TESTS();
 }
@@ -14,6 +14,7 @@
 
 #include "util/bloom-filter.h"
 
+#include <immintrin.h>
 #include <stdlib.h>
 
 #include <algorithm>
@@ -79,12 +80,122 @@ void BloomFilter::ToThrift(const BloomFilter* filter, TBloomFilter* thrift) {
   filter->ToThrift(thrift);
 }
 
+namespace {
+
+/// Computes the same per-word masks as BloomFilter::BucketInsert(): word i of the bucket
+/// gets bit ((bits_to_set >> (6 * i)) & 63) set. Words 0-3 are returned in 'lo',
+/// words 4-7 in 'hi'.
+inline __attribute__((always_inline, target("avx2"))) void MakeBucketMasksAVX2(
+    const uint64_t bits_to_set, __m256i* lo, __m256i* hi) {
+  const __m256i bits = _mm256_set1_epi64x(bits_to_set);
+  const __m256i word_mask = _mm256_set1_epi64x(63);
+  const __m256i ones = _mm256_set1_epi64x(1);
+  const __m256i lo_shifts = _mm256_setr_epi64x(0, 6, 12, 18);
+  const __m256i hi_shifts = _mm256_setr_epi64x(24, 30, 36, 42);
+  *lo = _mm256_sllv_epi64(ones,
+      _mm256_and_si256(_mm256_srlv_epi64(bits, lo_shifts), word_mask));
+  *hi = _mm256_sllv_epi64(ones,
+      _mm256_and_si256(_mm256_srlv_epi64(bits, hi_shifts), word_mask));
+}
+
+}
+
+void __attribute__((target("avx2"))) BloomFilter::BucketInsertAVX2(
+    const uint32_t bucket_idx, const uint64_t bits_to_set) {
+  DCHECK_EQ(LOG_BUCKET_WORD_BITS, 6);
+  DCHECK_EQ(BUCKET_WORDS, 8);
+  __m256i lo_mask, hi_mask;
+  MakeBucketMasksAVX2(bits_to_set, &lo_mask, &hi_mask);
+  // The directory is cache line aligned, so both halves of a bucket are aligned.
+  __m256i* bucket = reinterpret_cast<__m256i*>(&directory_[bucket_idx]);
+  _mm256_store_si256(bucket, _mm256_or_si256(_mm256_load_si256(bucket), lo_mask));
+  _mm256_store_si256(
+      bucket + 1, _mm256_or_si256(_mm256_load_si256(bucket + 1), hi_mask));
+}
+
+bool __attribute__((target("avx2"))) BloomFilter::BucketFindAVX2(
+    const uint32_t bucket_idx, const uint64_t bits_to_set) const {
+  __m256i lo_mask, hi_mask;
+  MakeBucketMasksAVX2(bits_to_set, &lo_mask, &hi_mask);
+  const __m256i* bucket = reinterpret_cast<const __m256i*>(&directory_[bucket_idx]);
+  // _mm256_testc_si256(a, b) is 1 iff all the bits set in 'b' are also set in 'a'.
+  return _mm256_testc_si256(_mm256_load_si256(bucket), lo_mask)
+      & _mm256_testc_si256(_mm256_load_si256(bucket + 1), hi_mask);
+}
+
+int BloomFilter::FindBatch(const uint32_t* hashes, int num_hashes, bool* found) const {
+  const bool use_avx2 = CpuInfo::IsSupported(CpuInfo::AVX2);
+  uint32_t bucket_idxs[FIND_BATCH_SIZE];
+  int num_found = 0;
+  for (int batch_start = 0; batch_start < num_hashes; batch_start += FIND_BATCH_SIZE) {
+    const int batch_size =
+        min(num_hashes - batch_start, static_cast<int>(FIND_BATCH_SIZE));
+    for (int i = 0; i < batch_size; ++i) {
+      bucket_idxs[i] = HashUtil::Rehash32to32(hashes[batch_start + i]) & directory_mask_;
+      __builtin_prefetch(&directory_[bucket_idxs[i]], 0 /* read */, 1);
+    }
+    for (int i = 0; i < batch_size; ++i) {
+      const uint64_t bits_to_set = HashUtil::Rehash32to64(hashes[batch_start + i]);
+      const bool result = use_avx2 ? BucketFindAVX2(bucket_idxs[i], bits_to_set)
+                                   : BucketFind(bucket_idxs[i], bits_to_set);
+      found[batch_start + i] = result;
+      num_found += result;
+    }
+  }
+  return num_found;
+}
+
+// ORs the 'size' bytes of 'in' into 'out'. 'size' must be a multiple of 32, which the
+// size of a directory always is. Neither needs to be aligned, since the directories of
+// serialized filters are strings.
+static void OrDirectories(const uint8_t* in, int64_t size, uint8_t* out) {
+  for (int64_t i = 0; i < size; i += sizeof(__m128i)) {
+    const __m128i* in_ptr = reinterpret_cast<const __m128i*>(in + i);
+    __m128i* out_ptr = reinterpret_cast<__m128i*>(out + i);
+    _mm_storeu_si128(out_ptr, _mm_or_si128(_mm_loadu_si128(out_ptr),
+        _mm_loadu_si128(in_ptr)));
+  }
+}
+
+static void __attribute__((target("avx2"))) OrDirectoriesAVX2(const uint8_t* in,
+    int64_t size, uint8_t* out) {
+  for (int64_t i = 0; i < size; i += sizeof(__m256i)) {
+    const __m256i* in_ptr = reinterpret_cast<const __m256i*>(in + i);
+    __m256i* out_ptr = reinterpret_cast<__m256i*>(out + i);
+    _mm256_storeu_si256(out_ptr, _mm256_or_si256(_mm256_loadu_si256(out_ptr),
+        _mm256_loadu_si256(in_ptr)));
+  }
+}
+
+static void OrDirectoriesDispatch(const uint8_t* in, int64_t size, uint8_t* out) {
+  DCHECK_EQ(size % sizeof(__m256i), 0);
+  if (CpuInfo::IsSupported(CpuInfo::AVX2)) {
+    OrDirectoriesAVX2(in, size, out);
+  } else {
+    OrDirectories(in, size, out);
+  }
+}
+
 void BloomFilter::Or(const BloomFilter& other) {
   DCHECK_EQ(log_num_buckets_, other.log_num_buckets_);
-  BucketWord* dir_ptr = reinterpret_cast<BucketWord*>(directory_);
-  const BucketWord* other_dir_ptr = reinterpret_cast<const BucketWord*>(other.directory_);
-  int directory_size_in_words = directory_size() / sizeof(BucketWord);
-  for (int i = 0; i < directory_size_in_words; ++i) dir_ptr[i] |= other_dir_ptr[i];
+  OrDirectoriesDispatch(reinterpret_cast<const uint8_t*>(other.directory_),
+      directory_size(), reinterpret_cast<uint8_t*>(directory_));
+}
+
+void BloomFilter::Or(const TBloomFilter& other) {
+  DCHECK(!other.always_true);
+  DCHECK_EQ(other.directory.size(), directory_size());
+  OrDirectoriesDispatch(reinterpret_cast<const uint8_t*>(other.directory.data()),
+      directory_size(), reinterpret_cast<uint8_t*>(directory_));
+}
+
+void BloomFilter::Or(const TBloomFilter& in, TBloomFilter* out) {
+  DCHECK(!in.always_true);
+  DCHECK(!out->always_true);
+  DCHECK_EQ(in.log_heap_space, out->log_heap_space);
+  DCHECK_EQ(in.directory.size(), out->directory.size());
+  OrDirectoriesDispatch(reinterpret_cast<const uint8_t*>(in.directory.data()),
+      in.directory.size(), reinterpret_cast<uint8_t*>(&out->directory[0]));
 }
 
 // The following three methods are derived from
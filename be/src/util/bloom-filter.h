@@ -24,6 +24,8 @@
 
 #include "gen-cpp/ImpalaInternalService_types.h"
 #include "runtime/buffered-block-mgr.h"
+#include "util/cpu-info.h"
+#include "util/hash-util.h"
 
 namespace impala {
 
@@ -46,6 +48,10 @@ namespace impala {
 /// false positive rate near optimal for between 5 and 15 bits per distinct value, which
 /// corresponds to false positive probabilities between 0.1% (for 15 bits) and 10% (for 5
 /// bits).
+///
+/// On CPUs with AVX2, a whole bucket is updated or tested with two 256-bit operations
+/// instead of a loop over its words. Both paths produce the same directory, so filters
+/// can be exchanged between machines with and without AVX2.
 class BloomFilter {
  public:
   /// Consumes at most (1 << log_heap_space) bytes on the heap.
@@ -71,9 +77,22 @@ class BloomFilter {
   /// high probabilty) if it is not.
   bool Find(const uint32_t hash) const;
 
+  /// Finds each of the 'num_hashes' elements of 'hashes', setting found[i] to the result
+  /// of Find(hashes[i]). The buckets of a group of hashes are prefetched before they are
+  /// tested so that their cache misses overlap. Returns the number of elements found.
+  int FindBatch(const uint32_t* hashes, int num_hashes, bool* found) const;
+
   /// Computes the logical OR of this filter with 'other' and stores the result in 'this'.
   void Or(const BloomFilter& other);
 
+  /// Same as above, but ORs the directory of the serialized filter 'other' in directly
+  /// instead of deserializing it first. 'other' must not be always_true.
+  void Or(const TBloomFilter& other);
+
+  /// Computes the logical OR of the serialized filters 'in' and 'out' and stores the
+  /// result in 'out', without deserializing either. Neither may be always_true.
+  static void Or(const TBloomFilter& in, TBloomFilter* out);
+
   /// As more distinct items are inserted into a BloomFilter, the false positive rate
   /// rises. MaxNdv() returns the NDV (number of distinct values) at which a BloomFilter
   /// constructed with (1 << log_heap_space) bytes of heap space hits false positive
@@ -128,6 +147,17 @@ class BloomFilter {
     return 1uLL << (log_num_buckets_ + LOG_BUCKET_BYTE_SIZE);
   }
 
+  /// Number of hashes whose buckets FindBatch() prefetches at a time.
+  static const int FIND_BATCH_SIZE = 16;
+
+  /// Sets or tests the bits selected by 'bits_to_set' in bucket 'bucket_idx'. See
+  /// Insert() for how the bits are chosen. The AVX2 versions must only be called if
+  /// CpuInfo::AVX2 is supported.
+  void BucketInsert(const uint32_t bucket_idx, uint64_t bits_to_set);
+  bool BucketFind(const uint32_t bucket_idx, uint64_t bits_to_set) const;
+  void BucketInsertAVX2(const uint32_t bucket_idx, const uint64_t bits_to_set);
+  bool BucketFindAVX2(const uint32_t bucket_idx, const uint64_t bits_to_set) const;
+
   /// Serializes this filter as Thrift.
   void ToThrift(TBloomFilter* thrift) const;
 
@@ -136,7 +166,25 @@ class BloomFilter {
 
 inline void BloomFilter::Insert(const uint32_t hash) {
   const uint32_t bucket_idx = HashUtil::Rehash32to32(hash) & directory_mask_;
-  uint64_t bits_to_set = HashUtil::Rehash32to64(hash);
+  const uint64_t bits_to_set = HashUtil::Rehash32to64(hash);
+  if (CpuInfo::IsSupported(CpuInfo::AVX2)) {
+    BucketInsertAVX2(bucket_idx, bits_to_set);
+  } else {
+    BucketInsert(bucket_idx, bits_to_set);
+  }
+}
+
+inline bool BloomFilter::Find(const uint32_t hash) const {
+  const uint32_t bucket_idx = HashUtil::Rehash32to32(hash) & directory_mask_;
+  const uint64_t bits_to_set = HashUtil::Rehash32to64(hash);
+  if (CpuInfo::IsSupported(CpuInfo::AVX2)) {
+    return BucketFindAVX2(bucket_idx, bits_to_set);
+  } else {
+    return BucketFind(bucket_idx, bits_to_set);
+  }
+}
+
+inline void BloomFilter::BucketInsert(const uint32_t bucket_idx, uint64_t bits_to_set) {
   // To set 8 bits in an 64-byte cache line, we set one bit in each 64-bit uint64_t in
   // that cache line. This is a "split Bloom filter", and it has approximately the same
   // false positive probability as standard a Bloom filter; See Mitzenmacher's "Bloom
@@ -156,9 +204,8 @@ inline void BloomFilter::Insert(const uint32_t hash) {
   }
 }
 
-inline bool BloomFilter::Find(const uint32_t hash) const {
-  const uint32_t bucket_idx = HashUtil::Rehash32to32(hash) & directory_mask_;
-  uint64_t bits_to_set = HashUtil::Rehash32to64(hash);
+inline bool BloomFilter::BucketFind(const uint32_t bucket_idx,
+    uint64_t bits_to_set) const {
   for (int i = 0; i < BUCKET_WORDS; ++i) {
     if (!(directory_[bucket_idx][i] &
             (static_cast<BucketWord>(1) << (bits_to_set & BUCKET_WORD_MASK)))) {
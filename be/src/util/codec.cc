@@ -105,6 +105,11 @@ Status Codec::CreateCompressor(MemPool* mem_pool, bool reuse,
     case THdfsCompression::LZ4:
       compressor->reset(new Lz4Compressor(mem_pool, reuse));
       break;
+#ifdef IMPALA_HAVE_ZSTD
+    case THdfsCompression::ZSTD:
+      compressor->reset(new ZstdCompressor(mem_pool, reuse));
+      break;
+#endif
     default: {
       if (format == THdfsCompression::LZO) return Status(NO_LZO_MSG);
       return Status(Substitute("Unsupported codec: $0", format));
@@ -151,6 +156,11 @@ Status Codec::CreateDecompressor(MemPool* mem_pool, bool reuse,
     case THdfsCompression::LZ4:
       decompressor->reset(new Lz4Decompressor(mem_pool, reuse));
       break;
+#ifdef IMPALA_HAVE_ZSTD
+    case THdfsCompression::ZSTD:
+      decompressor->reset(new ZstdDecompressor(mem_pool, reuse));
+      break;
+#endif
     default: {
       if (format == THdfsCompression::LZO) return Status(NO_LZO_MSG);
       return Substitute("Unsupported codec: $0", format);
@@ -165,6 +175,7 @@ Codec::Codec(MemPool* mem_pool, bool reuse_buffer, bool supports_streaming)
     reuse_buffer_(reuse_buffer),
     out_buffer_(NULL),
     buffer_length_(0),
+    stream_out_buf_size_(STREAM_OUT_BUF_SIZE),
     supports_streaming_(supports_streaming) {
   if (memory_pool_ != NULL) {
     temp_memory_pool_.reset(new MemPool(memory_pool_->mem_tracker()));
@@ -152,6 +152,14 @@ class Codec {
 
   bool supports_streaming() const { return supports_streaming_; }
 
+  /// Sets the size of the output buffers that ProcessBlockStreaming() allocates, which
+  /// defaults to STREAM_OUT_BUF_SIZE. Must be called before ProcessBlockStreaming().
+  void set_stream_out_buf_size(int64_t size) {
+    DCHECK(out_buffer_ == NULL);
+    DCHECK_GT(size, 0);
+    stream_out_buf_size_ = size;
+  }
+
   /// Largest block we will compress/decompress: 2GB.
   /// We are dealing with compressed blocks that are never this big but we want to guard
   /// against a corrupt file that has the block length as some large number.
@@ -185,6 +193,9 @@ class Codec {
   /// Length of the output buffer.
   int64_t buffer_length_;
 
+  /// Size of the output buffers allocated by ProcessBlockStreaming().
+  int64_t stream_out_buf_size_;
+
   /// Can decompressor support streaming mode.
   /// This is set to true for codecs that implement ProcessBlockStreaming().
   bool supports_streaming_;
@@ -22,8 +22,12 @@
 #undef DISALLOW_COPY_AND_ASSIGN // Snappy redefines this.
 #include <snappy.h>
 #include <lz4.h>
+#ifdef IMPALA_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include <boost/crc.hpp>
+#include <gflags/gflags.h>
 #include <gutil/strings/substitute.h>
 
 #include "common/names.h"
@@ -32,6 +36,11 @@ using boost::crc_32_type;
 using namespace impala;
 using namespace strings;
 
+#ifdef IMPALA_HAVE_ZSTD
+DEFINE_int32(zstd_compression_level, 3, "(Advanced) Compression level used by the "
+    "zstd codec, from 1 (fastest) to 22 (best compression).");
+#endif
+
 GzipCompressor::GzipCompressor(Format format, MemPool* mem_pool, bool reuse_buffer)
   : Codec(mem_pool, reuse_buffer),
     format_(format) {
@@ -295,3 +304,53 @@ Status Lz4Compressor::ProcessBlock(bool output_preallocated, int64_t input_lengt
                        reinterpret_cast<char*>(*output), input_length);
   return Status::OK();
 }
+
+#ifdef IMPALA_HAVE_ZSTD
+ZstdCompressor::ZstdCompressor(MemPool* mem_pool, bool reuse_buffer)
+  : Codec(mem_pool, reuse_buffer),
+    ctx_(NULL),
+    level_(FLAGS_zstd_compression_level) {
+}
+
+ZstdCompressor::~ZstdCompressor() {
+  if (ctx_ != NULL) ZSTD_freeCCtx(ctx_);
+}
+
+Status ZstdCompressor::Init() {
+  if (level_ < 1 || level_ > ZSTD_maxCLevel()) {
+    return Status(Substitute("Invalid zstd compression level: $0", level_));
+  }
+  ctx_ = ZSTD_createCCtx();
+  if (ctx_ == NULL) return Status("Zstd: failed to create compression context");
+  return Status::OK();
+}
+
+int64_t ZstdCompressor::MaxOutputLen(int64_t input_len, const uint8_t* input) {
+  return ZSTD_compressBound(input_len);
+}
+
+Status ZstdCompressor::ProcessBlock(bool output_preallocated, int64_t input_length,
+    const uint8_t* input, int64_t* output_length, uint8_t** output) {
+  int64_t max_compressed_len = MaxOutputLen(input_length);
+  if (output_preallocated && *output_length < max_compressed_len) {
+    return Status("ZstdCompressor::ProcessBlock: output length too small");
+  }
+
+  if (!output_preallocated) {
+    if ((!reuse_buffer_ || buffer_length_ < max_compressed_len)) {
+      DCHECK(memory_pool_ != NULL) << "Can't allocate without passing in a mem pool";
+      buffer_length_ = max_compressed_len;
+      out_buffer_ = memory_pool_->Allocate(buffer_length_);
+    }
+    *output = out_buffer_;
+  }
+
+  size_t ret = ZSTD_compressCCtx(ctx_, *output, max_compressed_len, input, input_length,
+      level_);
+  if (ZSTD_isError(ret)) {
+    return Status(Substitute("Zstd: compress failed: $0", ZSTD_getErrorName(ret)));
+  }
+  *output_length = ret;
+  return Status::OK();
+}
+#endif
@@ -16,8 +16,11 @@
 #ifndef IMPALA_UTIL_COMPRESS_H
 #define IMPALA_UTIL_COMPRESS_H
 
-/// We need zlib.h here to declare stream_ below.
+/// We need zlib.h and zstd.h here to declare stream_ and ctx_ below.
 #include <zlib.h>
+#ifdef IMPALA_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "util/codec.h"
 #include "exec/hdfs-scanner.h"
@@ -132,5 +135,31 @@ class Lz4Compressor : public Codec {
   virtual Status Init() { return Status::OK(); }
 };
 
+#ifdef IMPALA_HAVE_ZSTD
+/// Zstandard compresses considerably better than snappy and lz4 at comparable
+/// decompression speed, at the cost of slower compression. Each block is written as a
+/// single zstd frame that records its uncompressed size. The compression level is set
+/// by --zstd_compression_level.
+class ZstdCompressor : public Codec {
+ public:
+  virtual ~ZstdCompressor();
+  virtual int64_t MaxOutputLen(int64_t input_len, const uint8_t* input = NULL);
+  virtual Status ProcessBlock(bool output_preallocated, int64_t input_length,
+      const uint8_t* input, int64_t* output_length, uint8_t** output);
+  virtual std::string file_extension() const { return "zst"; }
+
+ private:
+  friend class Codec;
+  ZstdCompressor(MemPool* mem_pool = NULL, bool reuse_buffer = false);
+  virtual Status Init();
+
+  /// Compression context, reused across blocks.
+  ZSTD_CCtx* ctx_;
+
+  /// Compression level, from --zstd_compression_level.
+  int level_;
+};
+#endif
+
 }
 #endif
@@ -0,0 +1,68 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/count-min-sketch.h"
+
+#include <stdlib.h>
+#include <map>
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace impala {
+
+// Estimates are exact while there are fewer items than counters per row.
+TEST(CountMinSketch, Exact) {
+  CountMinSketch sketch(10, 4);
+  for (uint32_t i = 0; i < 10; ++i) {
+    for (uint32_t j = 0; j <= i; ++j) EXPECT_EQ(sketch.Add(i), j + 1);
+  }
+  for (uint32_t i = 0; i < 10; ++i) EXPECT_EQ(sketch.Estimate(i), i + 1);
+  EXPECT_EQ(sketch.total_count(), 55);
+}
+
+// Estimates never undercount and stay within the error bound for a skewed stream.
+TEST(CountMinSketch, Skewed) {
+  srand(0);
+  const int LOG_WIDTH = 8;
+  const uint32_t NUM_ITEMS = 100000;
+  CountMinSketch sketch(LOG_WIDTH, 4);
+  map<uint32_t, uint32_t> counts;
+  for (uint32_t i = 0; i < NUM_ITEMS; ++i) {
+    // A third of the stream is a single hot item.
+    uint32_t item = i % 3 == 0 ? 42 : rand();
+    sketch.Add(item);
+    ++counts[item];
+  }
+  EXPECT_EQ(sketch.total_count(), NUM_ITEMS);
+  size_t num_over_bound = 0;
+  for (map<uint32_t, uint32_t>::iterator it = counts.begin(); it != counts.end();
+      ++it) {
+    uint32_t estimate = sketch.Estimate(it->first);
+    EXPECT_GE(estimate, it->second);
+    if (estimate > it->second + 2 * NUM_ITEMS / (1 << LOG_WIDTH)) ++num_over_bound;
+  }
+  // The bound holds with probability 1 - 2^-4 per item.
+  EXPECT_LT(num_over_bound, counts.size() / 8);
+  EXPECT_GE(sketch.Estimate(42), NUM_ITEMS / 3);
+  EXPECT_LT(sketch.Estimate(42), NUM_ITEMS / 3 + 2 * NUM_ITEMS / (1 << LOG_WIDTH));
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,94 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_UTIL_COUNT_MIN_SKETCH_H
+#define IMPALA_UTIL_COUNT_MIN_SKETCH_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "common/logging.h"
+#include "util/hash-util.h"
+
+namespace impala {
+
+/// A count-min sketch (Cormode and Muthukrishnan, "An Improved Data Stream Summary: The
+/// Count-Min Sketch and its Applications") estimates how often each item of a stream
+/// was added, in space that does not depend on the number of distinct items. Items are
+/// identified by 32-bit hashes.
+/// The sketch has 'depth' rows of (1 << log_width) counters. Adding an item increments
+/// one counter per row and its estimate is the minimum of these counters. The estimate
+/// is never below the true count, and with probability 1 - 2^-depth it exceeds it by at
+/// most 2 * total_count() / width.
+/// The row indexes are derived from two halves of HashUtil::Rehash32to64() by double
+/// hashing, so the input hash need not be uniform.
+class CountMinSketch {
+ public:
+  CountMinSketch(int log_width, int depth)
+    : width_mask_((1 << log_width) - 1),
+      depth_(depth),
+      total_count_(0),
+      counters_((1 << log_width) * depth, 0) {
+    DCHECK_GE(log_width, 0);
+    DCHECK_LT(log_width, 31);
+    DCHECK_GT(depth, 0);
+  }
+
+  /// Adds one occurrence of 'hash' and returns its new estimated count.
+  uint32_t Add(uint32_t hash) {
+    uint64_t h = HashUtil::Rehash32to64(hash);
+    uint32_t estimate = std::numeric_limits<uint32_t>::max();
+    for (int i = 0; i < depth_; ++i) {
+      uint32_t* counter = &counters_[CounterIdx(h, i)];
+      ++*counter;
+      estimate = std::min(estimate, *counter);
+    }
+    ++total_count_;
+    return estimate;
+  }
+
+  /// Returns the estimated count of 'hash'.
+  uint32_t Estimate(uint32_t hash) const {
+    uint64_t h = HashUtil::Rehash32to64(hash);
+    uint32_t estimate = std::numeric_limits<uint32_t>::max();
+    for (int i = 0; i < depth_; ++i) {
+      estimate = std::min(estimate, counters_[CounterIdx(h, i)]);
+    }
+    return estimate;
+  }
+
+  /// Number of items added so far.
+  int64_t total_count() const { return total_count_; }
+
+ private:
+  /// Returns the index in counters_ of the counter in 'row' for the rehashed item 'h'.
+  int CounterIdx(uint64_t h, int row) const {
+    uint32_t h1 = h;
+    uint32_t h2 = h >> 32;
+    return row * (width_mask_ + 1) + ((h1 + row * h2) & width_mask_);
+  }
+
+  const uint32_t width_mask_;
+  const int depth_;
+  int64_t total_count_;
+
+  /// The rows of counters, back to back.
+  std::vector<uint32_t> counters_;
+};
+
+}
+
+#endif
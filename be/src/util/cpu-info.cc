@@ -23,7 +23,9 @@
 #include <fstream>
 #include <gutil/strings/substitute.h>
 #include <mmintrin.h>
+#include <sched.h>
 #include <sstream>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -33,6 +35,9 @@
 #include "common/names.h"
 
 using boost::algorithm::contains;
+using boost::algorithm::is_any_of;
+using boost::algorithm::split;
+using boost::algorithm::token_compress_on;
 using boost::algorithm::trim;
 using std::max;
 using strings::Substitute;
@@ -52,6 +57,8 @@ long CpuInfo::cache_line_sizes_[L3_CACHE + 1];
 int64_t CpuInfo::cycles_per_ms_;
 int CpuInfo::num_cores_ = 1;
 string CpuInfo::model_name_ = "unknown";
+vector<int> CpuInfo::core_to_numa_node_;
+vector<vector<int> > CpuInfo::numa_node_to_cores_;
 
 static struct {
   string name;
@@ -62,6 +69,8 @@ static struct {
   { "sse4_1", CpuInfo::SSE4_1 },
   { "sse4_2", CpuInfo::SSE4_2 },
   { "popcnt", CpuInfo::POPCNT },
+  { "avx",    CpuInfo::AVX },
+  { "avx2",   CpuInfo::AVX2 },
 };
 static const long num_flags = sizeof(flag_mappings) / sizeof(flag_mappings[0]);
 
@@ -79,6 +88,70 @@ int64_t ParseCPUFlags(const string& values) {
   return flags;
 }
 
+// Parses a list of cores in the format of the sysfs cpulist files, e.g. "0-3,8,10-11",
+// into 'cores'. Returns false if 'list' is not in this format.
+static bool ParseCoreList(const string& list, vector<int>* cores) {
+  vector<string> ranges;
+  split(ranges, list, is_any_of(","), token_compress_on);
+  for (const string& range: ranges) {
+    if (range.empty()) continue;
+    int first;
+    int last;
+    char extra;
+    int num_fields = sscanf(range.c_str(), "%d-%d%c", &first, &last, &extra);
+    if (num_fields == 1) last = first;
+    if (num_fields < 1 || num_fields > 2 || first < 0 || last < first) return false;
+    for (int core = first; core <= last; ++core) cores->push_back(core);
+  }
+  return true;
+}
+
+void CpuInfo::InitNuma() {
+  core_to_numa_node_.clear();
+  numa_node_to_cores_.clear();
+  // The nodes are numbered from 0 without gaps on the machines we run on.
+  for (int node = 0; ; ++node) {
+    ifstream cpulist(Substitute("/sys/devices/system/node/node$0/cpulist", node).c_str(),
+        ios::in);
+    if (!cpulist.good()) break;
+    string line;
+    getline(cpulist, line);
+    trim(line);
+    vector<int> cores;
+    if (!ParseCoreList(line, &cores)) {
+      LOG(WARNING) << "Could not parse the cores of NUMA node " << node << ": " << line;
+      numa_node_to_cores_.clear();
+      break;
+    }
+    numa_node_to_cores_.push_back(cores);
+  }
+  if (numa_node_to_cores_.empty()) {
+    // Treat the machine as a single node.
+    numa_node_to_cores_.resize(1);
+    for (int core = 0; core < num_cores_; ++core) {
+      numa_node_to_cores_[0].push_back(core);
+    }
+  }
+  for (int node = 0; node < numa_node_to_cores_.size(); ++node) {
+    for (int core: numa_node_to_cores_[node]) {
+      if (core >= core_to_numa_node_.size()) core_to_numa_node_.resize(core + 1, 0);
+      core_to_numa_node_[core] = node;
+    }
+  }
+}
+
+int CpuInfo::GetCurrentNumaNode() {
+  DCHECK(initialized_);
+  if (numa_node_to_cores_.size() == 1) return 0;
+#ifdef __APPLE__
+  return 0;
+#else
+  int core = sched_getcpu();
+  if (core < 0 || core >= core_to_numa_node_.size()) return 0;
+  return core_to_numa_node_[core];
+#endif
+}
+
 void CpuInfo::Init() {
   string line;
   string name;
@@ -159,6 +232,7 @@ void CpuInfo::Init() {
   }
 
   if (FLAGS_num_cores > 0) num_cores_ = FLAGS_num_cores;
+  InitNuma();
 
   initialized_ = true;
 }
@@ -196,6 +270,7 @@ string CpuInfo::DebugString() {
   stream << "Cpu Info:" << endl
          << "  Model: " << model_name_ << endl
          << "  Cores: " << num_cores_ << endl
+         << "  NUMA Nodes: " << numa_node_to_cores_.size() << endl
          << "  " << L1 << endl
          << "  " << L2 << endl
          << "  " << L3 << endl
@@ -17,6 +17,7 @@
 #define IMPALA_UTIL_CPU_INFO_H
 
 #include <string>
+#include <vector>
 #include <boost/cstdint.hpp>
 
 #include "common/logging.h"
@@ -33,6 +34,8 @@ class CpuInfo {
   static const int64_t SSE4_1  = (1 << 2);
   static const int64_t SSE4_2  = (1 << 3);
   static const int64_t POPCNT  = (1 << 4);
+  static const int64_t AVX     = (1 << 5);
+  static const int64_t AVX2    = (1 << 6);
 
   /// Cache enums for L1 (data), L2 and L3
   enum CacheLevel {
@@ -88,6 +91,25 @@ class CpuInfo {
     return num_cores_;
   }
 
+  /// Returns the number of NUMA nodes on this machine, which is 1 if the machine is not
+  /// a NUMA machine or the topology is not known.
+  static int num_numa_nodes() {
+    DCHECK(initialized_);
+    return numa_node_to_cores_.size();
+  }
+
+  /// Returns the cores of NUMA node 'node'.
+  static const std::vector<int>& GetCoresOfNumaNode(int node) {
+    DCHECK(initialized_);
+    DCHECK_GE(node, 0);
+    DCHECK_LT(node, numa_node_to_cores_.size());
+    return numa_node_to_cores_[node];
+  }
+
+  /// Returns the NUMA node of the core that the calling thread runs on. The thread
+  /// can be moved to another core at any time, so this is only a hint.
+  static int GetCurrentNumaNode();
+
   /// Returns the model name of the cpu (e.g. Intel i7-2600)
   static std::string model_name() {
     DCHECK(initialized_);
@@ -105,6 +127,16 @@ class CpuInfo {
   static int64_t cycles_per_ms_;
   static int num_cores_;
   static std::string model_name_;
+
+  /// The NUMA node of each core, indexed by the core id.
+  static std::vector<int> core_to_numa_node_;
+
+  /// The cores of each NUMA node. Has one node with all cores if the NUMA nodes are not
+  /// known.
+  static std::vector<std::vector<int> > numa_node_to_cores_;
+
+  /// Initializes the NUMA fields from /sys/devices/system/node.
+  static void InitNuma();
 };
 
 }
@@ -325,6 +325,12 @@ TEST_F(DecompressorTest, LZ4) {
   RunTest(THdfsCompression::LZ4);
 }
 
+#ifdef IMPALA_HAVE_ZSTD
+TEST_F(DecompressorTest, Zstd) {
+  RunTest(THdfsCompression::ZSTD);
+}
+#endif
+
 TEST_F(DecompressorTest, Gzip) {
   RunTest(THdfsCompression::GZIP);
   RunTestStreaming(THdfsCompression::GZIP);
@@ -25,6 +25,9 @@
 #undef DISALLOW_COPY_AND_ASSIGN // Snappy redefines this.
 #include <snappy.h>
 #include <lz4.h>
+#ifdef IMPALA_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "common/names.h"
 
@@ -74,7 +77,7 @@ Status GzipDecompressor::ProcessBlockStreaming(int64_t input_length, const uint8
     int64_t* input_bytes_read, int64_t* output_length, uint8_t** output,
     bool* stream_end) {
   if (!reuse_buffer_ || out_buffer_ == NULL) {
-    buffer_length_ = STREAM_OUT_BUF_SIZE;
+    buffer_length_ = stream_out_buf_size_;
     out_buffer_ = memory_pool_->TryAllocate(buffer_length_);
     if (UNLIKELY(out_buffer_ == NULL)) {
       string details = Substitute(DECOMPRESSOR_MEM_LIMIT_EXCEEDED, "Gzip",
@@ -355,7 +358,7 @@ Status BzipDecompressor::ProcessBlockStreaming(int64_t input_length, const uint8
     int64_t* input_bytes_read, int64_t* output_length, uint8_t** output,
     bool* stream_end) {
   if (!reuse_buffer_ || out_buffer_ == NULL) {
-    buffer_length_ = STREAM_OUT_BUF_SIZE;
+    buffer_length_ = stream_out_buf_size_;
     out_buffer_ = memory_pool_->TryAllocate(buffer_length_);
     if (UNLIKELY(out_buffer_ == NULL)) {
       string details = Substitute(DECOMPRESSOR_MEM_LIMIT_EXCEEDED, "Bzip",
@@ -603,3 +606,57 @@ Status Lz4Decompressor::ProcessBlock(bool output_preallocated, int64_t input_len
 
   return Status::OK();
 }
+
+#ifdef IMPALA_HAVE_ZSTD
+ZstdDecompressor::ZstdDecompressor(MemPool* mem_pool, bool reuse_buffer)
+  : Codec(mem_pool, reuse_buffer),
+    ctx_(NULL) {
+}
+
+ZstdDecompressor::~ZstdDecompressor() {
+  if (ctx_ != NULL) ZSTD_freeDCtx(ctx_);
+}
+
+Status ZstdDecompressor::Init() {
+  ctx_ = ZSTD_createDCtx();
+  if (ctx_ == NULL) return Status("Zstd: failed to create decompression context");
+  return Status::OK();
+}
+
+int64_t ZstdDecompressor::MaxOutputLen(int64_t input_len, const uint8_t* input) {
+  DCHECK(input != NULL) << "Passed null input to Zstd Decompressor";
+  unsigned long long result = ZSTD_getFrameContentSize(input, input_len);
+  if (result == ZSTD_CONTENTSIZE_UNKNOWN || result == ZSTD_CONTENTSIZE_ERROR) return -1;
+  return result;
+}
+
+Status ZstdDecompressor::ProcessBlock(bool output_preallocated, int64_t input_length,
+    const uint8_t* input, int64_t* output_length, uint8_t** output) {
+  if (!output_preallocated) {
+    int64_t uncompressed_length = MaxOutputLen(input_length, input);
+    if (uncompressed_length < 0) return Status("Zstd: GetFrameContentSize failed");
+    if (!reuse_buffer_ || out_buffer_ == NULL || buffer_length_ < uncompressed_length) {
+      buffer_length_ = uncompressed_length;
+      if (buffer_length_ > MAX_BLOCK_SIZE) {
+        return Status("Decompressor: block size is too big");
+      }
+      out_buffer_ = memory_pool_->TryAllocate(buffer_length_);
+      if (UNLIKELY(out_buffer_ == NULL)) {
+        string details = Substitute(DECOMPRESSOR_MEM_LIMIT_EXCEEDED, "Zstd",
+            buffer_length_);
+        return memory_pool_->mem_tracker()->MemLimitExceeded(NULL,
+            details, buffer_length_);
+      }
+    }
+    *output = out_buffer_;
+    *output_length = uncompressed_length;
+  }
+
+  size_t ret = ZSTD_decompressDCtx(ctx_, *output, *output_length, input, input_length);
+  if (ZSTD_isError(ret)) {
+    return Status(Substitute("Zstd: decompress failed: $0", ZSTD_getErrorName(ret)));
+  }
+  *output_length = ret;
+  return Status::OK();
+}
+#endif
@@ -16,9 +16,12 @@
 #ifndef IMPALA_UTIL_DECOMPRESS_H
 #define IMPALA_UTIL_DECOMPRESS_H
 
-// We need zlib.h here to declare stream_ below.
+// We need zlib.h and zstd.h here to declare stream_ and ctx_ below.
 #include <zlib.h>
 #include <bzlib.h>
+#ifdef IMPALA_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "util/codec.h"
 #include "exec/hdfs-scanner.h"
@@ -110,6 +113,28 @@ class Lz4Decompressor : public Codec {
   virtual Status Init() { return Status::OK(); }
 };
 
+#ifdef IMPALA_HAVE_ZSTD
+/// Decompressor for blocks written by ZstdCompressor. Each block must be a single zstd
+/// frame; if the output is not preallocated, the frame must record its uncompressed
+/// size.
+class ZstdDecompressor : public Codec {
+ public:
+  virtual ~ZstdDecompressor();
+  virtual int64_t MaxOutputLen(int64_t input_len, const uint8_t* input = NULL);
+  virtual Status ProcessBlock(bool output_preallocated, int64_t input_length,
+      const uint8_t* input, int64_t* output_length, uint8_t** output);
+  virtual std::string file_extension() const { return "zst"; }
+
+ private:
+  friend class Codec;
+  ZstdDecompressor(MemPool* mem_pool = NULL, bool reuse_buffer = false);
+  virtual Status Init();
+
+  /// Decompression context, reused across blocks.
+  ZSTD_DCtx* ctx_;
+};
+#endif
+
 class SnappyBlockDecompressor : public Codec {
  public:
   virtual ~SnappyBlockDecompressor() { }
@@ -0,0 +1,152 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string>
+
+#include "testutil/gtest-util.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "util/codec.h"
+#include "util/cpu-info.h"
+#include "util/decompression-pipeline.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+class DecompressionPipelineTest : public ::testing::Test {
+ protected:
+  /// Smaller than the decompressed input, so that each stream spans several buffers.
+  static const int64_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+  DecompressionPipelineTest() : mem_pool_(&mem_tracker_) {
+    for (int i = 0; i < 1024 * 1024; ++i) input_ += 'a' + rand() % 4;
+  }
+
+  ~DecompressionPipelineTest() {
+    mem_pool_.FreeAll();
+  }
+
+  /// Returns 'num_streams' concatenated compressed streams of input_.
+  string Compress(THdfsCompression::type format, int num_streams) {
+    scoped_ptr<Codec> compressor;
+    EXPECT_OK(Codec::CreateCompressor(&mem_pool_, false, format, &compressor));
+    uint8_t* compressed;
+    int64_t compressed_len;
+    EXPECT_OK(compressor->ProcessBlock(false, input_.size(),
+        reinterpret_cast<const uint8_t*>(input_.data()), &compressed_len, &compressed));
+    compressor->Close();
+    string result;
+    for (int i = 0; i < num_streams; ++i) {
+      result.append(reinterpret_cast<char*>(compressed), compressed_len);
+    }
+    return result;
+  }
+
+  /// Decompresses 'compressed' through a pipeline, adding it as input in pieces of at
+  /// most 'input_len' bytes. Returns the decompressed data in 'result'.
+  Status Decompress(THdfsCompression::type format, const string& compressed,
+      int input_len, string* result, bool* stream_end) {
+    DecompressionPipeline pipeline(&mem_tracker_, 3, 2);
+    Status status = pipeline.Init(format, OUTPUT_BUFFER_SIZE);
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(compressed.data());
+    int64_t input_remaining = compressed.size();
+    bool eos = false;
+    while (status.ok() && !eos) {
+      while (status.ok() && pipeline.NeedsInput()) {
+        if (input_remaining == 0) {
+          pipeline.InputDone();
+          break;
+        }
+        int64_t len = min<int64_t>(input_len, input_remaining);
+        status = pipeline.AddInput(input, len);
+        input += len;
+        input_remaining -= len;
+      }
+      if (!status.ok()) break;
+      uint8_t* buffer;
+      int64_t len;
+      status = pipeline.GetNext(&mem_pool_, &buffer, &len, &eos);
+      if (status.ok()) result->append(reinterpret_cast<char*>(buffer), len);
+    }
+    *stream_end = pipeline.stream_end();
+    pipeline.Close();
+    return status;
+  }
+
+  void RunTest(THdfsCompression::type format) {
+    for (int num_streams = 1; num_streams <= 3; ++num_streams) {
+      string compressed = Compress(format, num_streams);
+      string expected;
+      for (int i = 0; i < num_streams; ++i) expected += input_;
+      // Include input pieces too small to decompress on their own.
+      int input_lens[] = {7, 4096, 1024 * 1024};
+      for (int input_len: input_lens) {
+        string result;
+        bool stream_end;
+        EXPECT_OK(Decompress(format, compressed, input_len, &result, &stream_end));
+        EXPECT_TRUE(stream_end);
+        EXPECT_TRUE(result == expected) << "Output mismatch, input_len=" << input_len;
+      }
+    }
+
+    // A truncated stream doesn't end at a stream end.
+    string compressed = Compress(format, 1);
+    compressed.resize(compressed.size() / 2);
+    string result;
+    bool stream_end;
+    EXPECT_OK(Decompress(format, compressed, 4096, &result, &stream_end));
+    EXPECT_FALSE(stream_end);
+    EXPECT_LT(result.size(), input_.size());
+  }
+
+  MemTracker mem_tracker_;
+  MemPool mem_pool_;
+  string input_;
+};
+
+TEST_F(DecompressionPipelineTest, Gzip) {
+  RunTest(THdfsCompression::GZIP);
+}
+
+TEST_F(DecompressionPipelineTest, Bzip2) {
+  RunTest(THdfsCompression::BZIP2);
+}
+
+// Close() must free queued buffers when the output is not fully consumed.
+TEST_F(DecompressionPipelineTest, CloseEarly) {
+  string compressed = Compress(THdfsCompression::GZIP, 3);
+  DecompressionPipeline pipeline(&mem_tracker_, 3, 1);
+  EXPECT_OK(pipeline.Init(THdfsCompression::GZIP, OUTPUT_BUFFER_SIZE));
+  EXPECT_OK(pipeline.AddInput(reinterpret_cast<const uint8_t*>(compressed.data()),
+      compressed.size()));
+  uint8_t* buffer;
+  int64_t len;
+  bool eos;
+  EXPECT_OK(pipeline.GetNext(&mem_pool_, &buffer, &len, &eos));
+  EXPECT_GT(len, 0);
+  EXPECT_FALSE(eos);
+  pipeline.Close();
+  mem_pool_.FreeAll();
+  EXPECT_EQ(mem_tracker_.consumption(), 0);
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
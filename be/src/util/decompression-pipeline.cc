@@ -0,0 +1,201 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/decompression-pipeline.h"
+
+#include <gutil/strings/substitute.h>
+
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "util/codec.h"
+#include "util/thread.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace strings;
+
+DecompressionPipeline::DecompressionPipeline(MemTracker* mem_tracker,
+    int max_input_buffers, int max_output_buffers)
+  : mem_tracker_(mem_tracker),
+    max_input_buffers_(max_input_buffers),
+    num_input_buffers_(0),
+    input_done_(false),
+    stream_end_(false),
+    input_queue_(max_input_buffers),
+    output_queue_(max_output_buffers) {
+  DCHECK_GT(max_input_buffers, 0);
+  DCHECK_GT(max_output_buffers, 0);
+}
+
+DecompressionPipeline::~DecompressionPipeline() {
+  DCHECK(decompress_thread_.get() == NULL) << "Must call Close()";
+}
+
+Status DecompressionPipeline::Init(THdfsCompression::type compression,
+    int64_t output_buffer_size) {
+  decompressor_pool_.reset(new MemPool(mem_tracker_));
+  // The output buffers are handed to the caller, so they can't be reused.
+  RETURN_IF_ERROR(Codec::CreateDecompressor(decompressor_pool_.get(), false,
+      compression, &decompressor_));
+  DCHECK(decompressor_->supports_streaming());
+  decompressor_->set_stream_out_buf_size(output_buffer_size);
+  decompress_thread_.reset(new Thread("decompression-pipeline", "decompress-thread",
+      &DecompressionPipeline::DecompressThread, this));
+  return Status::OK();
+}
+
+Status DecompressionPipeline::AddInput(const uint8_t* data, int64_t len) {
+  DCHECK(NeedsInput());
+  DCHECK_GT(len, 0);
+  if (!mem_tracker_->TryConsume(len)) {
+    return mem_tracker_->MemLimitExceeded(NULL,
+        Substitute("Could not copy $0 bytes of compressed input for decompression.",
+            len), len);
+  }
+  InputBuffer* input = new InputBuffer();
+  input->data.assign(data, data + len);
+  ++num_input_buffers_;
+  // Doesn't block: the queue can hold all max_input_buffers_ input buffers.
+  if (!input_queue_.BlockingPut(input)) {
+    mem_tracker_->Release(len);
+    delete input;
+    return Status::CANCELLED;
+  }
+  return Status::OK();
+}
+
+void DecompressionPipeline::InputDone() {
+  input_done_ = true;
+}
+
+Status DecompressionPipeline::GetNext(MemPool* pool, uint8_t** buffer, int64_t* len,
+    bool* eos) {
+  *len = 0;
+  *eos = false;
+  while (num_input_buffers_ > 0) {
+    OutputBuffer* output;
+    bool got_output = output_queue_.BlockingGet(&output);
+    if (!got_output) return Status::CANCELLED;
+    Status status = output->status;
+    if (output->last) --num_input_buffers_;
+    stream_end_ = output->stream_end;
+    if (status.ok() && output->len > 0) {
+      pool->AcquireData(output->pool.get(), false);
+      *buffer = output->data;
+      *len = output->len;
+    }
+    output->pool->FreeAll();
+    delete output;
+    RETURN_IF_ERROR(status);
+    if (*len > 0) return Status::OK();
+  }
+  *eos = input_done_;
+  return Status::OK();
+}
+
+void DecompressionPipeline::Close() {
+  input_queue_.Shutdown();
+  output_queue_.Shutdown();
+  if (decompress_thread_.get() != NULL) {
+    decompress_thread_->Join();
+    decompress_thread_.reset();
+  }
+  // After the shutdown the queues still return the remaining buffers.
+  InputBuffer* input;
+  while (input_queue_.BlockingGet(&input)) {
+    mem_tracker_->Release(input->data.size());
+    delete input;
+  }
+  OutputBuffer* output;
+  while (output_queue_.BlockingGet(&output)) {
+    output->pool->FreeAll();
+    delete output;
+  }
+  if (decompressor_.get() != NULL) decompressor_->Close();
+  if (decompressor_pool_.get() != NULL) decompressor_pool_->FreeAll();
+}
+
+void DecompressionPipeline::DecompressThread() {
+  InputBuffer* input;
+  while (input_queue_.BlockingGet(&input)) {
+    bool queued_output = DecompressInput(input);
+    mem_tracker_->Release(input->data.size());
+    delete input;
+    if (!queued_output) break;
+  }
+}
+
+bool DecompressionPipeline::DecompressInput(InputBuffer* input) {
+  const uint8_t* data = &input->data[0];
+  int64_t len = input->data.size();
+  if (!pending_input_.empty()) {
+    pending_input_.insert(pending_input_.end(), input->data.begin(), input->data.end());
+    data = &pending_input_[0];
+    len = pending_input_.size();
+  }
+
+  while (true) {
+    int64_t bytes_read = 0;
+    int64_t output_len = 0;
+    uint8_t* output = NULL;
+    bool stream_end = false;
+    Status status = decompressor_->ProcessBlockStreaming(len, data, &bytes_read,
+        &output_len, &output, &stream_end);
+    if (!status.ok()) {
+      // The decompressor can't continue after an error.
+      PutOutput(NULL, 0, true, false, status);
+      return false;
+    }
+    DCHECK_LE(bytes_read, len);
+    data += bytes_read;
+    len -= bytes_read;
+
+    // Stop once the input is consumed or the decompressor can't make progress without
+    // more input, e.g. because the input ends in the middle of a header.
+    bool last = len == 0 || (bytes_read == 0 && output_len == 0);
+    if (last) {
+      vector<uint8_t> remaining(data, data + len);
+      pending_input_.swap(remaining);
+    }
+    if (output_len == 0 && !last) {
+      decompressor_pool_->FreeAll();
+      continue;
+    }
+    if (!PutOutput(output, output_len, last, stream_end, Status::OK())) return false;
+    if (last) return true;
+  }
+}
+
+bool DecompressionPipeline::PutOutput(uint8_t* data, int64_t len, bool last,
+    bool stream_end, const Status& status) {
+  OutputBuffer* output = new OutputBuffer();
+  output->pool.reset(new MemPool(mem_tracker_));
+  if (len > 0) {
+    output->pool->AcquireData(decompressor_pool_.get(), false);
+  } else {
+    decompressor_pool_->FreeAll();
+  }
+  output->data = data;
+  output->len = len;
+  output->last = last;
+  output->stream_end = stream_end;
+  output->status = status;
+  if (!output_queue_.BlockingPut(output)) {
+    output->pool->FreeAll();
+    delete output;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,148 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_DECOMPRESSION_PIPELINE_H
+#define IMPALA_UTIL_DECOMPRESSION_PIPELINE_H
+
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+
+#include "common/status.h"
+#include "gen-cpp/Descriptors_types.h"
+#include "util/blocking-queue.h"
+
+namespace impala {
+
+class Codec;
+class MemPool;
+class MemTracker;
+class Thread;
+
+/// Decompresses a compressed stream with a streaming decompressor (gzip or bzip2) on a
+/// separate thread, so that the decompression of the stream overlaps with the
+/// processing of the decompressed data by the caller.
+///
+/// The caller adds compressed input with AddInput(), which copies it, and fetches
+/// decompressed buffers with GetNext(). Both sides are bounded: at most
+/// 'max_input_buffers' input buffers are queued or being decompressed, and at most
+/// 'max_output_buffers' decompressed buffers wait to be fetched. The caller must add
+/// input whenever NeedsInput() returns true before calling GetNext(), which guarantees
+/// that GetNext() never waits for input that will not come.
+///
+/// All methods must be called from the same thread.
+class DecompressionPipeline {
+ public:
+  /// Memory of the input copies and the decompressed buffers is counted against
+  /// 'mem_tracker'.
+  DecompressionPipeline(MemTracker* mem_tracker, int max_input_buffers,
+      int max_output_buffers);
+
+  /// Close() must have been called.
+  ~DecompressionPipeline();
+
+  /// Creates the decompressor of type 'compression', which must support streaming and
+  /// decompresses into buffers of 'output_buffer_size' bytes, and starts the
+  /// decompression thread.
+  Status Init(THdfsCompression::type compression, int64_t output_buffer_size);
+
+  /// Returns true if the caller must call AddInput() or InputDone() before GetNext().
+  bool NeedsInput() const {
+    return !input_done_ && num_input_buffers_ < max_input_buffers_;
+  }
+
+  /// Copies 'len' bytes of compressed data for decompression.
+  Status AddInput(const uint8_t* data, int64_t len);
+
+  /// Indicates that all compressed data has been added.
+  void InputDone();
+
+  /// Returns the next decompressed buffer in '*buffer' and '*len'. The memory of the
+  /// buffer is transferred to 'pool'. Sets '*len' to 0 if more input is needed first.
+  /// Sets '*eos' to true once all decompressed data has been returned. Returns the
+  /// error if decompression failed.
+  Status GetNext(MemPool* pool, uint8_t** buffer, int64_t* len, bool* eos);
+
+  /// Returns true if the decompressed data ended at the end of a compressed stream. Only
+  /// valid once GetNext() returned eos. If false, the input was truncated.
+  bool stream_end() const { return stream_end_; }
+
+  /// Stops the decompression thread and frees all queued buffers.
+  void Close();
+
+ private:
+  /// A copy of compressed input.
+  struct InputBuffer {
+    std::vector<uint8_t> data;
+  };
+
+  /// A decompressed buffer and the pool that owns it. 'last' is set on the last output
+  /// of each input buffer, even if it is empty, so that the caller can track how many
+  /// input buffers are still being decompressed.
+  struct OutputBuffer {
+    boost::scoped_ptr<MemPool> pool;
+    uint8_t* data;
+    int64_t len;
+    bool last;
+    bool stream_end;
+    Status status;
+  };
+
+  /// Body of the decompression thread. Decompresses the input buffers in order until
+  /// the input queue is shut down.
+  void DecompressThread();
+
+  /// Decompresses 'input' together with the input that the decompressor could not
+  /// consume yet, and queues the output buffers. Returns false if the output queue
+  /// was shut down or decompression failed.
+  bool DecompressInput(InputBuffer* input);
+
+  /// Queues an output buffer with the memory allocated from decompressor_pool_.
+  /// Returns false if the output queue was shut down.
+  bool PutOutput(uint8_t* data, int64_t len, bool last, bool stream_end,
+      const Status& status);
+
+  MemTracker* mem_tracker_;
+  const int max_input_buffers_;
+
+  /// Number of input buffers that have been added but whose last output has not been
+  /// returned by GetNext() yet.
+  int num_input_buffers_;
+
+  /// True once InputDone() was called.
+  bool input_done_;
+
+  /// True if the last decompressed data ended a compressed stream.
+  bool stream_end_;
+
+  /// Queues of input and output buffers. Both are shut down by Close().
+  BlockingQueue<InputBuffer*> input_queue_;
+  BlockingQueue<OutputBuffer*> output_queue_;
+
+  /// Pool of the decompressor's output buffers, which are transferred to the pool of
+  /// each OutputBuffer. Only used by the decompression thread.
+  boost::scoped_ptr<MemPool> decompressor_pool_;
+  boost::scoped_ptr<Codec> decompressor_;
+
+  /// Compressed input that the decompressor could not make progress on, and that is
+  /// decompressed together with the next input buffer. Only used by the decompression
+  /// thread.
+  std::vector<uint8_t> pending_input_;
+
+  boost::scoped_ptr<Thread> decompress_thread_;
+};
+
+}
+
+#endif
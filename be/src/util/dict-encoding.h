@@ -15,6 +15,8 @@
 #ifndef IMPALA_UTIL_DICT_ENCODING_H
 #define IMPALA_UTIL_DICT_ENCODING_H
 
+#include <algorithm>
+#include <cmath>
 #include <map>
 
 #include <boost/unordered_map.hpp>
@@ -34,8 +36,9 @@ namespace impala {
 /// the dictionary is being constructed. At any time, the buffered values can be
 /// written out with the current dictionary size. More values can then be added to
 /// the encoder, including new dictionary entries.
-/// TODO: if the dictionary was made to be ordered, the dictionary would compress better.
-/// Add this to the spec as future improvement.
+/// The entries are in insertion order, unless SortDictionary() is called before the
+/// dictionary is written out. Sorted dictionaries compress better, and their first and
+/// last entries are the minimum and maximum values.
 
 /// Base class for encoders. This is convenient so users can have a type that
 /// abstracts over the actual dictionary type.
@@ -60,6 +63,16 @@ class DictEncoderBase {
   /// Clears all the indices (but leaves the dictionary).
   void ClearIndices() { buffered_indices_.clear(); }
 
+  /// Swaps the buffered indices with 'indices'. Used to write out the indices of data
+  /// that was buffered elsewhere with the dictionary.
+  void SwapIndices(std::vector<int>* indices) { buffered_indices_.swap(*indices); }
+
+  /// Reorders the dictionary entries in ascending order of their values and updates the
+  /// buffered indices accordingly. Sets 'new_indices' to the new index of each entry,
+  /// indexed by its old index, so that indices buffered elsewhere can be updated too.
+  /// More values can be added afterwards.
+  virtual void SortDictionary(std::vector<int>* new_indices) = 0;
+
   /// Returns a conservative estimate of the number of bytes needed to encode the buffered
   /// indices. Used to size the buffer passed to WriteData().
   int EstimatedDataEncodedSize() {
@@ -113,6 +126,8 @@ class DictEncoder : public DictEncoderBase {
 
   virtual void WriteDict(uint8_t* buffer);
 
+  virtual void SortDictionary(std::vector<int>* new_indices);
+
   virtual int num_entries() const { return nodes_.size(); }
 
  private:
@@ -152,6 +167,9 @@ class DictEncoder : public DictEncoderBase {
   /// Hash function for mapping a value to a bucket.
   inline uint32_t Hash(const T& value) const;
 
+  /// Strict weak ordering of the values used by SortDictionary().
+  static bool Less(const T& a, const T& b) { return a < b; }
+
   /// Adds value to the hash table and updates dict_encoded_size_. Returns the
   /// number of bytes added to dict_encoded_size_.
   /// bucket gives a pointer to the location (i.e. chain) to add the value
@@ -206,6 +224,17 @@ class DictDecoder : public DictDecoderBase {
   /// the string data is from the dictionary buffer passed into the c'tor.
   bool GetValue(T* value);
 
+  /// Returns the dictionary index of the next value. Returns false if the data is
+  /// invalid. Together with GetEntry() this is equivalent to GetValue().
+  bool GetIndex(int* index);
+
+  /// Returns the dictionary entry at 'index', which must be a valid index, in *value.
+  void GetEntry(int index, T* value) const;
+
+  /// Returns the dictionary indices of the next 'num_values' values in 'indices'.
+  /// Returns false if the data is invalid.
+  bool GetIndices(int* indices, int num_values);
+
  private:
   std::vector<T> dict_;
 };
@@ -291,6 +320,78 @@ inline bool DictDecoder<Decimal16Value>::GetValue(Decimal16Value* value) {
   return true;
 }
 
+template<typename T>
+inline bool DictDecoder<T>::GetIndex(int* index) {
+  bool result = data_decoder_.Get(index);
+  return LIKELY(result & (*index >= 0) & (*index < dict_.size()));
+}
+
+template<typename T>
+inline bool DictDecoder<T>::GetIndices(int* indices, int num_values) {
+  if (UNLIKELY(data_decoder_.GetValues(indices, num_values) != num_values)) return false;
+  // Validate all indices at once, which keeps the loop free of branches. Negative
+  // indices wrap around to large unsigned values.
+  uint32_t max_index = 0;
+  for (int i = 0; i < num_values; ++i) {
+    max_index = std::max(max_index, static_cast<uint32_t>(indices[i]));
+  }
+  return max_index < dict_.size();
+}
+
+template<typename T>
+inline void DictDecoder<T>::GetEntry(int index, T* value) const {
+  DCHECK_GE(index, 0);
+  DCHECK_LT(index, dict_.size());
+  *value = dict_[index];
+}
+
+template<>
+inline void DictDecoder<Decimal16Value>::GetEntry(int index,
+    Decimal16Value* value) const {
+  DCHECK_GE(index, 0);
+  DCHECK_LT(index, dict_.size());
+  // Workaround for IMPALA-959, see GetValue().
+  const uint8_t* addr = reinterpret_cast<const uint8_t*>(&dict_[0]);
+  memcpy(value, addr + index * sizeof(*value), sizeof(*value));
+}
+
+/// NaNs are ordered after all other values, since '<' does not order them.
+template<>
+inline bool DictEncoder<float>::Less(const float& a, const float& b) {
+  return a < b || (std::isnan(b) && !std::isnan(a));
+}
+
+template<>
+inline bool DictEncoder<double>::Less(const double& a, const double& b) {
+  return a < b || (std::isnan(b) && !std::isnan(a));
+}
+
+template<typename T>
+inline void DictEncoder<T>::SortDictionary(std::vector<int>* new_indices) {
+  std::vector<int> order(nodes_.size());
+  for (int i = 0; i < order.size(); ++i) order[i] = i;
+  std::sort(order.begin(), order.end(),
+      [this](int a, int b) { return Less(nodes_[a].value, nodes_[b].value); });
+
+  new_indices->resize(nodes_.size());
+  std::vector<Node> sorted_nodes;
+  sorted_nodes.reserve(nodes_.size());
+  for (int i = 0; i < order.size(); ++i) {
+    (*new_indices)[order[i]] = i;
+    sorted_nodes.push_back(nodes_[order[i]]);
+  }
+  nodes_.swap(sorted_nodes);
+
+  // The hash chains link the nodes by their index, rebuild them.
+  std::fill(buckets_.begin(), buckets_.end(), Node::INVALID_INDEX);
+  for (int i = 0; i < nodes_.size(); ++i) {
+    NodeIndex* bucket = &buckets_[Hash(nodes_[i].value) & (HASH_TABLE_SIZE - 1)];
+    nodes_[i].next = *bucket;
+    *bucket = i;
+  }
+  for (int& index: buffered_indices_) index = (*new_indices)[index];
+}
+
 template<typename T>
 inline void DictEncoder<T>::WriteDict(uint8_t* buffer) {
   for (const Node& node: nodes_) {
@@ -28,6 +28,49 @@
 
 namespace impala {
 
+// Checks that sorting the dictionary after adding 'values' preserves the encoded values
+// and orders the entries.
+template<typename T>
+void ValidateSortedDict(const vector<T>& values, int fixed_buffer_byte_size) {
+  MemTracker tracker;
+  MemPool pool(&tracker);
+  DictEncoder<T> encoder(&pool, fixed_buffer_byte_size);
+  for (T i: values) encoder.Put(i);
+  int num_entries = encoder.num_entries();
+  vector<int> new_indices;
+  encoder.SortDictionary(&new_indices);
+  EXPECT_EQ(num_entries, new_indices.size());
+
+  uint8_t dict_buffer[encoder.dict_encoded_size()];
+  encoder.WriteDict(dict_buffer);
+  int data_buffer_len = encoder.EstimatedDataEncodedSize();
+  uint8_t data_buffer[data_buffer_len];
+  int data_len = encoder.WriteData(data_buffer, data_buffer_len);
+  EXPECT_GT(data_len, 0);
+  encoder.ClearIndices();
+
+  // Values that are already in the sorted dictionary are still found.
+  for (T i: values) EXPECT_EQ(0, encoder.Put(i));
+  EXPECT_EQ(num_entries, encoder.num_entries());
+  encoder.ClearIndices();
+
+  DictDecoder<T> decoder(
+      dict_buffer, encoder.dict_encoded_size(), fixed_buffer_byte_size);
+  for (int k = 1; k < decoder.num_entries(); ++k) {
+    T prev, cur;
+    decoder.GetEntry(k - 1, &prev);
+    decoder.GetEntry(k, &cur);
+    EXPECT_TRUE(prev < cur);
+  }
+  decoder.SetData(data_buffer, data_len);
+  for (T i: values) {
+    T j;
+    decoder.GetValue(&j);
+    EXPECT_EQ(i, j);
+  }
+  pool.FreeAll();
+}
+
 template<typename T>
 void ValidateDict(const vector<T>& values, int fixed_buffer_byte_size) {
   set<T> values_set(values.begin(), values.end());
@@ -55,7 +98,29 @@ void ValidateDict(const vector<T>& values, int fixed_buffer_byte_size) {
     decoder.GetValue(&j);
     EXPECT_EQ(i, j);
   }
+
+  // Decoding by index must return the same values.
+  decoder.SetData(data_buffer, data_len);
+  for (T i: values) {
+    int index;
+    EXPECT_TRUE(decoder.GetIndex(&index));
+    T j;
+    decoder.GetEntry(index, &j);
+    EXPECT_EQ(i, j);
+  }
+
+  // Decoding the indices in a batch must return the same values.
+  decoder.SetData(data_buffer, data_len);
+  vector<int> indices(values.size());
+  EXPECT_TRUE(decoder.GetIndices(indices.data(), indices.size()));
+  for (int k = 0; k < values.size(); ++k) {
+    T j;
+    decoder.GetEntry(indices[k], &j);
+    EXPECT_EQ(values[k], j);
+  }
   pool.FreeAll();
+
+  ValidateSortedDict(values, fixed_buffer_byte_size);
 }
 
 TEST(DictTest, TestStrings) {
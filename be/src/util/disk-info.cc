@@ -19,6 +19,7 @@
 #else
 #include <sys/vfs.h>
 #endif
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -112,9 +113,30 @@ void DiskInfo::GetDeviceNames() {
       if (line == "0") disks_[i].is_rotational = false;
     }
     if (rotational.is_open()) rotational.close();
+    disks_[i].numa_node = GetNumaNode(disks_[i].name);
   }
 }
 
+int DiskInfo::GetNumaNode(const string& name) {
+  // /sys/block/<device> links to the device in /sys/devices. The PCIe device that the
+  // disk is attached to, e.g. the NVMe or SAS controller, is one of its parents and has
+  // a numa_node file, which contains -1 if the machine is not a NUMA machine.
+  char* device_path = realpath(("/sys/block/" + name).c_str(), NULL);
+  if (device_path == NULL) return -1;
+  string dir = device_path;
+  free(device_path);
+  while (dir.size() > string("/sys/devices").size()) {
+    ifstream numa_node_file((dir + "/numa_node").c_str(), ios::in);
+    if (numa_node_file.good()) {
+      int numa_node = -1;
+      numa_node_file >> numa_node;
+      return numa_node_file.fail() ? -1 : numa_node;
+    }
+    dir = dir.substr(0, dir.rfind('/'));
+  }
+  return -1;
+}
+
 void DiskInfo::Init() {
   GetDeviceNames();
   initialized_ = true;
@@ -135,7 +157,8 @@ string DiskInfo::DebugString() {
   stream << "  Num disks " << num_disks() << ": " << endl;
   for (int i = 0; i < disks_.size(); ++i) {
     stream << "    " << disks_[i].name
-           << " (rotational=" << (disks_[i].is_rotational ? "true" : "false") << ")\n";
+           << " (rotational=" << (disks_[i].is_rotational ? "true" : "false")
+           << ", numa_node=" << disks_[i].numa_node << ")\n";
   }
   stream << endl;
   return stream.str();
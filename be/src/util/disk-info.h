@@ -72,6 +72,13 @@ class DiskInfo {
     DCHECK_LT(disk_id, disks_.size());
     return disks_[disk_id].is_rotational;
   }
+
+  /// Returns the NUMA node of the controller of disk_id, or -1 if it is not known.
+  static int numa_node(int disk_id) {
+    DCHECK_GE(disk_id, 0);
+    DCHECK_LT(disk_id, disks_.size());
+    return disks_[disk_id].numa_node;
+  }
   
   static std::string DebugString();
 
@@ -88,8 +95,11 @@ class DiskInfo {
 
     bool is_rotational;
 
+    /// NUMA node of the PCIe device the disk is attached to. -1 if not known.
+    int numa_node;
+
     Disk(const std::string& name = "", int id = -1, bool is_rotational = true) 
-      : name(name), id(id), is_rotational(is_rotational) {}
+      : name(name), id(id), is_rotational(is_rotational), numa_node(-1) {}
   };
 
   /// All disks
@@ -104,6 +114,9 @@ class DiskInfo {
   static int num_datanode_dirs_;
 
   static void GetDeviceNames();
+
+  /// Returns the NUMA node of the block device 'name', or -1 if it is not known.
+  static int GetNumaNode(const std::string& name);
 };
 
 
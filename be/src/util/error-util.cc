@@ -25,11 +25,14 @@ namespace impala {
 
 string GetStrErrMsg() {
   // Save errno. "<<" could reset it.
-  int e = errno;
-  if (e == 0) return "";
+  return GetStrErrMsg(errno);
+}
+
+string GetStrErrMsg(int err_num) {
+  if (err_num == 0) return "";
   stringstream ss;
   char buf[1024];
-  ss << "Error(" << e << "): " << strerror_r(e, buf, 1024);
+  ss << "Error(" << err_num << "): " << strerror_r(err_num, buf, 1024);
   return ss.str();
 }
 
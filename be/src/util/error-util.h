@@ -32,6 +32,9 @@ namespace impala {
 /// Returns empty string if errno is 0.
 std::string GetStrErrMsg();
 
+/// Same as above for the error number 'err_num', e.g. returned by a system call.
+std::string GetStrErrMsg(int err_num);
+
 /// Returns an error message warning that the given table names are missing relevant
 /// table/and or column statistics.
 std::string GetTablesMissingStatsWarning(
@@ -29,6 +29,11 @@ uint32_t IrMurmurHash(const void* data, int32_t bytes, uint32_t hash) {
   return HashUtil::MurmurHash2_64(data, bytes, hash);
 }
 
+extern "C"
+uint32_t IrMurmurHash64to32(const void* data, int32_t bytes, uint32_t hash) {
+  return HashUtil::MurmurHash2_64to32(data, bytes, hash);
+}
+
 extern "C"
 uint32_t IrCrcHash(const void* data, int32_t bytes, uint32_t hash) {
 #ifdef __SSE4_2__
@@ -153,6 +153,17 @@ class HashUtil {
     return h;
   }
 
+  /// Return a 32-bit hash computed by invoking Murmur2-64 and folding the result to
+  /// 32-bits. Truncating the result instead would leave the upper bits of the 32-bit
+  /// hash, which hash tables use for partitioning, depending on the lower half of the
+  /// state only. The input seed 'hash' is duplicated so that it changes both halves of
+  /// the initial state, which makes the hashes for different seeds more independent.
+  static uint32_t MurmurHash2_64to32(const void* input, int len, uint32_t hash) {
+    uint64_t hash_u64 = hash | (static_cast<uint64_t>(hash) << 32);
+    hash_u64 = MurmurHash2_64(input, len, hash_u64);
+    return (hash_u64 >> 32) ^ (hash_u64 & 0xFFFFFFFF);
+  }
+
   /// default values recommended by http://isthe.com/chongo/tech/comp/fnv/
   static const uint32_t FNV_PRIME = 0x01000193; //   16777619
   static const uint32_t FNV_SEED = 0x811C9DC5; // 2166136261
@@ -19,6 +19,7 @@
 #include "util/debug-util.h"
 #include "util/error-util.h"
 #include "util/hdfs-util.h"
+#include "util/stopwatch.h"
 
 #include "common/names.h"
 
@@ -47,6 +48,18 @@ HdfsOp::HdfsOp(HdfsOpType op, const string& src, short permissions,
 // Required for ThreadPool
 HdfsOp::HdfsOp() { }
 
+const char* impala::HdfsOpTypeToString(HdfsOpType op) {
+  switch (op) {
+    case DELETE: return "Delete";
+    case CREATE_DIR: return "CreateDir";
+    case RENAME: return "Rename";
+    case MOVE: return "Move";
+    case DELETE_THEN_CREATE: return "DeleteThenCreate";
+    case CHMOD: return "Chmod";
+  }
+  return "Unknown";
+}
+
 void HdfsOp::AddError(const string& error_msg) const {
   stringstream ss;
   ss << "Hdfs op (";
@@ -76,6 +89,8 @@ void HdfsOp::AddError(const string& error_msg) const {
 
 void HdfsOp::Execute() const {
   if (op_set_->ShouldAbort()) return;
+  MonotonicStopWatch timer;
+  timer.Start();
   int err = 0;
   hdfsFS src_connection;
   Status connection_status = HdfsFsCache::instance()->GetConnection(src_, &src_connection,
@@ -108,8 +123,12 @@ void HdfsOp::Execute() const {
       VLOG_FILE << "hdfsMove() src_file=" << src_ << " dst_file=" << dst_;
       break;
     case DELETE_THEN_CREATE:
-      err = hdfsDelete(src_connection, src_.c_str(), 1);
-      VLOG_FILE << "hdfsDelete() file=" << src_;
+      // Checking for the directory here instead of in the caller avoids a serial
+      // round trip per directory.
+      if (hdfsExists(src_connection, src_.c_str()) == 0) {
+        err = hdfsDelete(src_connection, src_.c_str(), 1);
+        VLOG_FILE << "hdfsDelete() file=" << src_;
+      }
       if (err != -1) {
         err = hdfsCreateDirectory(src_connection, src_.c_str());
         VLOG_FILE << "hdfsCreateDirectory() file=" << src_;
@@ -126,6 +145,7 @@ void HdfsOp::Execute() const {
         connection_status.ok() ? GetStrErrMsg() : connection_status.GetDetail();
     AddError(error_msg);
   }
+  op_set_->AddOpTime(op_, timer.ElapsedTime());
   op_set_->MarkOneOpDone();
 }
 
@@ -27,6 +27,7 @@
 
 namespace impala {
 
+/// DELETE_THEN_CREATE deletes the directory if it exists and then (re-)creates it.
 enum HdfsOpType {
   DELETE,
   CREATE_DIR,
@@ -36,6 +37,11 @@ enum HdfsOpType {
   CHMOD
 };
 
+static const int NUM_HDFS_OP_TYPES = CHMOD + 1;
+
+/// Returns the name of 'op', e.g. "Rename".
+const char* HdfsOpTypeToString(HdfsOpType op);
+
 class HdfsOperationSet;
 
 /// Container class that encapsulates a single HDFS operation. Used only internally by
@@ -119,6 +125,13 @@ class HdfsOperationSet {
 
   HdfsFsCache::HdfsFsMap* connection_cache() { return connection_cache_; }
 
+  /// Returns the number of added operations.
+  int64_t num_ops() const { return ops_.size(); }
+
+  /// Returns the time spent in executed operations of type 'op', summed over all
+  /// threads that executed them. Not valid until Execute has returned.
+  int64_t op_time_ns(HdfsOpType op) { return op_time_ns_[op].Read(); }
+
  private:
   /// The set of operations to be submitted to HDFS
   std::vector<HdfsOp> ops_;
@@ -140,12 +153,18 @@ class HdfsOperationSet {
   /// True if a single error should cause any subsequent operations to become no-ops.
   bool abort_on_error_;
 
+  /// Time spent in executed operations per HdfsOpType.
+  AtomicInt64 op_time_ns_[NUM_HDFS_OP_TYPES];
+
   friend class HdfsOp;
 
   /// Called by HdfsOp to signal its completion. When the last op has finished, this
   /// method signals Execute() so that it can return.
   void MarkOneOpDone();
 
+  /// Called by HdfsOp to record the time spent executing an operation of type 'op'.
+  void AddOpTime(HdfsOpType op, int64_t time_ns) { op_time_ns_[op].Add(time_ns); }
+
   /// Called by HdfsOp to record an error
   void AddError(const std::string& err, const HdfsOp* op);
 
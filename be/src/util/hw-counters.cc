@@ -0,0 +1,95 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/hw-counters.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <boost/thread/tss.hpp>
+
+#include "common/logging.h"
+#include "util/error-util.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+const char* ThreadHwCounters::EVENT_NAMES[] = {
+    "HwCycles", "HwInstructions", "HwCacheMisses", "HwBranchMisses"};
+
+// The PERF_COUNT_HW_* config of each event.
+static const uint64_t EVENT_CONFIGS[] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES};
+
+// The counters of each thread, closed when the thread exits. Threads whose counters
+// can't be opened keep counters without file descriptors, so that they are not
+// opened again.
+static boost::thread_specific_ptr<ThreadHwCounters> thread_counters;
+
+ThreadHwCounters::ThreadHwCounters() {
+  for (int i = 0; i < NUM_EVENTS; ++i) fds_[i] = -1;
+}
+
+ThreadHwCounters::~ThreadHwCounters() {
+  for (int i = 0; i < NUM_EVENTS; ++i) {
+    if (fds_[i] != -1) close(fds_[i]);
+  }
+}
+
+ThreadHwCounters* ThreadHwCounters::GetForCurrentThread() {
+  ThreadHwCounters* counters = thread_counters.get();
+  if (counters == NULL) {
+    counters = new ThreadHwCounters();
+    thread_counters.reset(counters);
+    if (!counters->Open()) {
+      VLOG_QUERY << "Could not open the hardware counters of a thread: "
+                 << GetStrErrMsg();
+      for (int i = 0; i < NUM_EVENTS; ++i) {
+        if (counters->fds_[i] != -1) close(counters->fds_[i]);
+        counters->fds_[i] = -1;
+      }
+    }
+  }
+  return counters->fds_[0] == -1 ? NULL : counters;
+}
+
+bool ThreadHwCounters::Open() {
+  for (int i = 0; i < NUM_EVENTS; ++i) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = EVENT_CONFIGS[i];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // Count the calling thread on any CPU.
+    fds_[i] = syscall(__NR_perf_event_open, &attr, 0, -1, fds_[0], 0);
+    if (fds_[i] == -1) return false;
+  }
+  return true;
+}
+
+bool ThreadHwCounters::Read(int64_t* values) {
+  // With PERF_FORMAT_GROUP, the group leader returns the number of events followed by
+  // the count of each event.
+  uint64_t buffer[NUM_EVENTS + 1];
+  if (read(fds_[0], buffer, sizeof(buffer)) != sizeof(buffer)) return false;
+  DCHECK_EQ(buffer[0], NUM_EVENTS);
+  for (int i = 0; i < NUM_EVENTS; ++i) values[i] = buffer[i + 1];
+  return true;
+}
@@ -0,0 +1,67 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_UTIL_HW_COUNTERS_H
+#define IMPALA_UTIL_HW_COUNTERS_H
+
+#include <boost/cstdint.hpp>
+
+namespace impala {
+
+/// The hardware performance counters of a single thread, opened with perf_event_open()
+/// as one group, so that the kernel schedules them onto the PMU together and all of
+/// them are read with a single read(). Unlike PerfCounters, which counts the whole
+/// process for microbenchmarks, the counters only count the user space code of the
+/// thread that opened them, so that they can be attributed to the exec nodes that the
+/// thread runs. See ExecTimeMeasurement.
+class ThreadHwCounters {
+ public:
+  enum Event {
+    CYCLES,
+    INSTRUCTIONS,
+    /// Usually misses of the last level cache.
+    CACHE_MISSES,
+    BRANCH_MISSES,
+    NUM_EVENTS,
+  };
+
+  /// The names of the profile counters, by Event.
+  static const char* EVENT_NAMES[NUM_EVENTS];
+
+  /// Returns the counters of the calling thread, which are opened on the first call and
+  /// closed when the thread exits. Returns NULL if they can't be opened, e.g. in VMs
+  /// without a virtual PMU or if kernel.perf_event_paranoid forbids it.
+  static ThreadHwCounters* GetForCurrentThread();
+
+  /// Sets 'values' to the counts since the counters were opened, by Event. Returns
+  /// false if the counters can't be read.
+  bool Read(int64_t* values);
+
+  ~ThreadHwCounters();
+
+ private:
+  ThreadHwCounters();
+
+  /// Opens the counters for the calling thread. Returns false if any of them can't be
+  /// opened.
+  bool Open();
+
+  /// The file descriptors of the counters, by Event. The first one is the group leader.
+  /// -1 if not open.
+  int fds_[NUM_EVENTS];
+};
+
+}
+
+#endif
@@ -41,6 +41,8 @@ const char* ImpaladMetricKeys::NUM_SCAN_RANGES_MISSING_VOLUME_ID =
     "impala-server.scan-ranges.num-missing-volume-id";
 const char* ImpaladMetricKeys::MEM_POOL_TOTAL_BYTES =
     "impala-server.mem-pool.total-bytes";
+const char* ImpaladMetricKeys::MEM_POOL_CACHED_BYTES =
+    "impala-server.mem-pool.cached-bytes";
 const char* ImpaladMetricKeys::HASH_TABLE_TOTAL_BYTES =
     "impala-server.hash-table.total-bytes";
 const char* ImpaladMetricKeys::IO_MGR_NUM_OPEN_FILES =
@@ -71,6 +73,64 @@ const char* ImpaladMetricKeys::IO_MGR_CACHED_FILE_HANDLES_HIT_COUNT =
     "impala-server.io.mgr.cached-file-handles-hit-count";
 const char* ImpaladMetricKeys::IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT =
     "impala-server.io.mgr.cached-file-handles-miss-count";
+const char* ImpaladMetricKeys::IO_MGR_S3_READ_LATENCIES =
+    "impala-server.io.mgr.s3-read-latencies-ms";
+const char* ImpaladMetricKeys::IO_MGR_FILE_HANDLE_OPEN_LATENCIES =
+    "impala-server.io.mgr.file-handle-open-latencies-ms";
+const char* ImpaladMetricKeys::IO_MGR_REMOTE_DATA_CACHE_HIT_BYTES =
+    "impala-server.io.mgr.remote-data-cache-hit-bytes";
+const char* ImpaladMetricKeys::IO_MGR_REMOTE_DATA_CACHE_MISS_BYTES =
+    "impala-server.io.mgr.remote-data-cache-miss-bytes";
+const char* ImpaladMetricKeys::DATA_STREAM_SENDER_TRANSMIT_DATA_LATENCIES =
+    "impala-server.data-stream-sender.transmit-data-latencies-ns";
+const char* ImpaladMetricKeys::FRAGMENT_CANCEL_TO_RELEASE_LATENCIES =
+    "impala-server.fragment-cancel-to-release-latencies-ms";
+const char* ImpaladMetricKeys::PARQUET_FOOTER_CACHE_HIT_COUNT =
+    "impala-server.parquet-footer-cache.hit-count";
+const char* ImpaladMetricKeys::PARQUET_FOOTER_CACHE_MISS_COUNT =
+    "impala-server.parquet-footer-cache.miss-count";
+const char* ImpaladMetricKeys::PARQUET_FOOTER_CACHE_NUM_ENTRIES =
+    "impala-server.parquet-footer-cache.num-entries";
+const char* ImpaladMetricKeys::PARQUET_FOOTER_CACHE_TOTAL_BYTES =
+    "impala-server.parquet-footer-cache.total-bytes";
+const char* ImpaladMetricKeys::PARQUET_PAGE_CACHE_HIT_COUNT =
+    "impala-server.parquet-page-cache.hit-count";
+const char* ImpaladMetricKeys::PARQUET_PAGE_CACHE_MISS_COUNT =
+    "impala-server.parquet-page-cache.miss-count";
+const char* ImpaladMetricKeys::PARQUET_PAGE_CACHE_NUM_ENTRIES =
+    "impala-server.parquet-page-cache.num-entries";
+const char* ImpaladMetricKeys::PARQUET_PAGE_CACHE_TOTAL_BYTES =
+    "impala-server.parquet-page-cache.total-bytes";
+const char* ImpaladMetricKeys::CODEGEN_CACHE_HIT_COUNT =
+    "impala-server.codegen-cache.hit-count";
+const char* ImpaladMetricKeys::CODEGEN_CACHE_MISS_COUNT =
+    "impala-server.codegen-cache.miss-count";
+const char* ImpaladMetricKeys::CODEGEN_CACHE_NUM_ENTRIES =
+    "impala-server.codegen-cache.num-entries";
+const char* ImpaladMetricKeys::CODEGEN_CACHE_TOTAL_BYTES =
+    "impala-server.codegen-cache.total-bytes";
+const char* ImpaladMetricKeys::QUERY_RESULT_CACHE_HIT_COUNT =
+    "impala-server.query-result-cache.hit-count";
+const char* ImpaladMetricKeys::QUERY_RESULT_CACHE_MISS_COUNT =
+    "impala-server.query-result-cache.miss-count";
+const char* ImpaladMetricKeys::QUERY_RESULT_CACHE_NUM_ENTRIES =
+    "impala-server.query-result-cache.num-entries";
+const char* ImpaladMetricKeys::QUERY_RESULT_CACHE_TOTAL_BYTES =
+    "impala-server.query-result-cache.total-bytes";
+const char* ImpaladMetricKeys::FRAGMENT_OUTPUT_CACHE_HIT_COUNT =
+    "impala-server.fragment-output-cache.hit-count";
+const char* ImpaladMetricKeys::FRAGMENT_OUTPUT_CACHE_MISS_COUNT =
+    "impala-server.fragment-output-cache.miss-count";
+const char* ImpaladMetricKeys::FRAGMENT_OUTPUT_CACHE_NUM_ENTRIES =
+    "impala-server.fragment-output-cache.num-entries";
+const char* ImpaladMetricKeys::FRAGMENT_OUTPUT_CACHE_TOTAL_BYTES =
+    "impala-server.fragment-output-cache.total-bytes";
+const char* ImpaladMetricKeys::PREPARED_STATEMENT_CACHE_HIT_COUNT =
+    "impala-server.prepared-statement-cache.hit-count";
+const char* ImpaladMetricKeys::PREPARED_STATEMENT_CACHE_MISS_COUNT =
+    "impala-server.prepared-statement-cache.miss-count";
+const char* ImpaladMetricKeys::PREPARED_STATEMENT_CACHE_NUM_ENTRIES =
+    "impala-server.prepared-statement-cache.num-entries";
 const char* ImpaladMetricKeys::CATALOG_NUM_DBS =
     "catalog.num-databases";
 const char* ImpaladMetricKeys::CATALOG_NUM_TABLES =
@@ -115,6 +175,20 @@ IntCounter* ImpaladMetrics::IO_MGR_LOCAL_BYTES_READ = NULL;
 IntCounter* ImpaladMetrics::IO_MGR_SHORT_CIRCUIT_BYTES_READ = NULL;
 IntCounter* ImpaladMetrics::IO_MGR_CACHED_BYTES_READ = NULL;
 IntCounter* ImpaladMetrics::IO_MGR_BYTES_WRITTEN = NULL;
+IntCounter* ImpaladMetrics::IO_MGR_REMOTE_DATA_CACHE_HIT_BYTES = NULL;
+IntCounter* ImpaladMetrics::IO_MGR_REMOTE_DATA_CACHE_MISS_BYTES = NULL;
+IntCounter* ImpaladMetrics::PARQUET_FOOTER_CACHE_HIT_COUNT = NULL;
+IntCounter* ImpaladMetrics::PARQUET_FOOTER_CACHE_MISS_COUNT = NULL;
+IntCounter* ImpaladMetrics::PARQUET_PAGE_CACHE_HIT_COUNT = NULL;
+IntCounter* ImpaladMetrics::PARQUET_PAGE_CACHE_MISS_COUNT = NULL;
+IntCounter* ImpaladMetrics::CODEGEN_CACHE_HIT_COUNT = NULL;
+IntCounter* ImpaladMetrics::CODEGEN_CACHE_MISS_COUNT = NULL;
+IntCounter* ImpaladMetrics::QUERY_RESULT_CACHE_HIT_COUNT = NULL;
+IntCounter* ImpaladMetrics::QUERY_RESULT_CACHE_MISS_COUNT = NULL;
+IntCounter* ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_HIT_COUNT = NULL;
+IntCounter* ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_MISS_COUNT = NULL;
+IntCounter* ImpaladMetrics::PREPARED_STATEMENT_CACHE_HIT_COUNT = NULL;
+IntCounter* ImpaladMetrics::PREPARED_STATEMENT_CACHE_MISS_COUNT = NULL;
 
 // Gauges
 IntGauge* ImpaladMetrics::CATALOG_NUM_DBS = NULL;
@@ -130,7 +204,19 @@ IntGauge* ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_COUNT = NULL;
 IntGauge* ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT = NULL;
 IntGauge* ImpaladMetrics::IO_MGR_TOTAL_BYTES = NULL;
 IntGauge* ImpaladMetrics::MEM_POOL_TOTAL_BYTES = NULL;
+IntGauge* ImpaladMetrics::MEM_POOL_CACHED_BYTES = NULL;
 IntGauge* ImpaladMetrics::NUM_FILES_OPEN_FOR_INSERT = NULL;
+IntGauge* ImpaladMetrics::PARQUET_FOOTER_CACHE_NUM_ENTRIES = NULL;
+IntGauge* ImpaladMetrics::PARQUET_FOOTER_CACHE_TOTAL_BYTES = NULL;
+IntGauge* ImpaladMetrics::PARQUET_PAGE_CACHE_NUM_ENTRIES = NULL;
+IntGauge* ImpaladMetrics::PARQUET_PAGE_CACHE_TOTAL_BYTES = NULL;
+IntGauge* ImpaladMetrics::CODEGEN_CACHE_NUM_ENTRIES = NULL;
+IntGauge* ImpaladMetrics::CODEGEN_CACHE_TOTAL_BYTES = NULL;
+IntGauge* ImpaladMetrics::QUERY_RESULT_CACHE_NUM_ENTRIES = NULL;
+IntGauge* ImpaladMetrics::QUERY_RESULT_CACHE_TOTAL_BYTES = NULL;
+IntGauge* ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_NUM_ENTRIES = NULL;
+IntGauge* ImpaladMetrics::FRAGMENT_OUTPUT_CACHE_TOTAL_BYTES = NULL;
+IntGauge* ImpaladMetrics::PREPARED_STATEMENT_CACHE_NUM_ENTRIES = NULL;
 IntGauge* ImpaladMetrics::RESULTSET_CACHE_TOTAL_NUM_ROWS = NULL;
 IntGauge* ImpaladMetrics::RESULTSET_CACHE_TOTAL_BYTES = NULL;
 
@@ -143,6 +229,10 @@ StringProperty* ImpaladMetrics::IMPALA_SERVER_VERSION = NULL;
 // Histograms
 HistogramMetric* ImpaladMetrics::QUERY_DURATIONS = NULL;
 HistogramMetric* ImpaladMetrics::DDL_DURATIONS = NULL;
+HistogramMetric* ImpaladMetrics::IO_MGR_S3_READ_LATENCIES = NULL;
+HistogramMetric* ImpaladMetrics::IO_MGR_FILE_HANDLE_OPEN_LATENCIES = NULL;
+HistogramMetric* ImpaladMetrics::DATA_STREAM_SENDER_TRANSMIT_DATA_LATENCIES = NULL;
+HistogramMetric* ImpaladMetrics::FRAGMENT_CANCEL_TO_RELEASE_LATENCIES = NULL;
 
 // Other
 StatsMetric<uint64_t, StatsType::MEAN>*
@@ -187,6 +277,8 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
   // Initialize memory usage metrics
   MEM_POOL_TOTAL_BYTES = m->AddGauge<int64_t>(
       ImpaladMetricKeys::MEM_POOL_TOTAL_BYTES, 0);
+  MEM_POOL_CACHED_BYTES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::MEM_POOL_CACHED_BYTES, 0);
   HASH_TABLE_TOTAL_BYTES = m->AddGauge<int64_t>(
       ImpaladMetricKeys::HASH_TABLE_TOTAL_BYTES, 0);
 
@@ -221,6 +313,58 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
       ImpaladMetricKeys::IO_MGR_SHORT_CIRCUIT_BYTES_READ, 0);
   IO_MGR_BYTES_WRITTEN = m->AddCounter<int64_t>(
       ImpaladMetricKeys::IO_MGR_BYTES_WRITTEN, 0);
+  IO_MGR_REMOTE_DATA_CACHE_HIT_BYTES = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::IO_MGR_REMOTE_DATA_CACHE_HIT_BYTES, 0);
+  IO_MGR_REMOTE_DATA_CACHE_MISS_BYTES = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::IO_MGR_REMOTE_DATA_CACHE_MISS_BYTES, 0);
+
+  // Initialize Parquet footer cache metrics
+  PARQUET_FOOTER_CACHE_HIT_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::PARQUET_FOOTER_CACHE_HIT_COUNT, 0);
+  PARQUET_FOOTER_CACHE_MISS_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::PARQUET_FOOTER_CACHE_MISS_COUNT, 0);
+  PARQUET_FOOTER_CACHE_NUM_ENTRIES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::PARQUET_FOOTER_CACHE_NUM_ENTRIES, 0);
+  PARQUET_FOOTER_CACHE_TOTAL_BYTES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::PARQUET_FOOTER_CACHE_TOTAL_BYTES, 0);
+  PARQUET_PAGE_CACHE_HIT_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::PARQUET_PAGE_CACHE_HIT_COUNT, 0);
+  PARQUET_PAGE_CACHE_MISS_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::PARQUET_PAGE_CACHE_MISS_COUNT, 0);
+  PARQUET_PAGE_CACHE_NUM_ENTRIES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::PARQUET_PAGE_CACHE_NUM_ENTRIES, 0);
+  PARQUET_PAGE_CACHE_TOTAL_BYTES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::PARQUET_PAGE_CACHE_TOTAL_BYTES, 0);
+  CODEGEN_CACHE_HIT_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::CODEGEN_CACHE_HIT_COUNT, 0);
+  CODEGEN_CACHE_MISS_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::CODEGEN_CACHE_MISS_COUNT, 0);
+  CODEGEN_CACHE_NUM_ENTRIES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::CODEGEN_CACHE_NUM_ENTRIES, 0);
+  CODEGEN_CACHE_TOTAL_BYTES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::CODEGEN_CACHE_TOTAL_BYTES, 0);
+  QUERY_RESULT_CACHE_HIT_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::QUERY_RESULT_CACHE_HIT_COUNT, 0);
+  QUERY_RESULT_CACHE_MISS_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::QUERY_RESULT_CACHE_MISS_COUNT, 0);
+  QUERY_RESULT_CACHE_NUM_ENTRIES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::QUERY_RESULT_CACHE_NUM_ENTRIES, 0);
+  QUERY_RESULT_CACHE_TOTAL_BYTES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::QUERY_RESULT_CACHE_TOTAL_BYTES, 0);
+  FRAGMENT_OUTPUT_CACHE_HIT_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::FRAGMENT_OUTPUT_CACHE_HIT_COUNT, 0);
+  FRAGMENT_OUTPUT_CACHE_MISS_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::FRAGMENT_OUTPUT_CACHE_MISS_COUNT, 0);
+  FRAGMENT_OUTPUT_CACHE_NUM_ENTRIES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::FRAGMENT_OUTPUT_CACHE_NUM_ENTRIES, 0);
+  FRAGMENT_OUTPUT_CACHE_TOTAL_BYTES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::FRAGMENT_OUTPUT_CACHE_TOTAL_BYTES, 0);
+  PREPARED_STATEMENT_CACHE_HIT_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::PREPARED_STATEMENT_CACHE_HIT_COUNT, 0);
+  PREPARED_STATEMENT_CACHE_MISS_COUNT = m->AddCounter<int64_t>(
+      ImpaladMetricKeys::PREPARED_STATEMENT_CACHE_MISS_COUNT, 0);
+  PREPARED_STATEMENT_CACHE_NUM_ENTRIES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::PREPARED_STATEMENT_CACHE_NUM_ENTRIES, 0);
 
   IO_MGR_CACHED_FILE_HANDLES_HIT_RATIO =
       StatsMetric<uint64_t, StatsType::MEAN>::CreateAndRegister(m,
@@ -240,6 +384,26 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
       MetricDefs::Get(ImpaladMetricKeys::QUERY_DURATIONS), FIVE_HOURS_IN_MS, 3));
   DDL_DURATIONS = m->RegisterMetric(new HistogramMetric(
       MetricDefs::Get(ImpaladMetricKeys::DDL_DURATIONS), FIVE_HOURS_IN_MS, 3));
+
+  // Individual S3 reads are at most a few MB, so reads that take longer than ten minutes
+  // are not worth distinguishing.
+  const int TEN_MINUTES_IN_MS = 60 * 1000 * 10;
+  IO_MGR_S3_READ_LATENCIES = m->RegisterMetric(new HistogramMetric(
+      MakeTMetricDef(ImpaladMetricKeys::IO_MGR_S3_READ_LATENCIES,
+          TMetricKind::HISTOGRAM, TUnit::TIME_MS), TEN_MINUTES_IN_MS, 3));
+  IO_MGR_FILE_HANDLE_OPEN_LATENCIES = m->RegisterMetric(new HistogramMetric(
+      MakeTMetricDef(ImpaladMetricKeys::IO_MGR_FILE_HANDLE_OPEN_LATENCIES,
+          TMetricKind::HISTOGRAM, TUnit::TIME_MS), TEN_MINUTES_IN_MS, 3));
+  FRAGMENT_CANCEL_TO_RELEASE_LATENCIES = m->RegisterMetric(new HistogramMetric(
+      MakeTMetricDef(ImpaladMetricKeys::FRAGMENT_CANCEL_TO_RELEASE_LATENCIES,
+          TMetricKind::HISTOGRAM, TUnit::TIME_MS), TEN_MINUTES_IN_MS, 3));
+
+  // Most RPCs take less than a millisecond, so their latencies are tracked in ns, with
+  // two significant digits to keep the histograms small.
+  const int64_t TEN_MINUTES_IN_NS = TEN_MINUTES_IN_MS * 1000L * 1000L;
+  DATA_STREAM_SENDER_TRANSMIT_DATA_LATENCIES = m->RegisterMetric(new HistogramMetric(
+      MakeTMetricDef(ImpaladMetricKeys::DATA_STREAM_SENDER_TRANSMIT_DATA_LATENCIES,
+          TMetricKind::HISTOGRAM, TUnit::TIME_NS), TEN_MINUTES_IN_NS, 2));
 }
 
 }
@@ -61,6 +61,9 @@ class ImpaladMetricKeys {
   /// Number of bytes currently in use across all mem pools
   static const char* MEM_POOL_TOTAL_BYTES;
 
+  /// Number of bytes of freed mem pool chunks that are cached for reuse
+  static const char* MEM_POOL_CACHED_BYTES;
+
   /// Number of bytes currently in use across all hash tables
   static const char* HASH_TABLE_TOTAL_BYTES;
 
@@ -106,6 +109,94 @@ class ImpaladMetricKeys {
   /// Number of cache misses for cached HDFS file handles
   static const char* IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT;
 
+  /// Latency of the individual read requests to S3
+  static const char* IO_MGR_S3_READ_LATENCIES;
+
+  /// Latency of opening HDFS file handles that were not found in the file handle cache
+  static const char* IO_MGR_FILE_HANDLE_OPEN_LATENCIES;
+
+  /// Number of bytes of remote reads that were found in the data cache
+  static const char* IO_MGR_REMOTE_DATA_CACHE_HIT_BYTES;
+
+  /// Number of bytes of remote reads that were not found in the data cache
+  static const char* IO_MGR_REMOTE_DATA_CACHE_MISS_BYTES;
+
+  /// Latency of the TransmitData() RPCs of the data stream senders
+  static const char* DATA_STREAM_SENDER_TRANSMIT_DATA_LATENCIES;
+
+  /// Time from the cancellation of a fragment instance until it released its resources
+  static const char* FRAGMENT_CANCEL_TO_RELEASE_LATENCIES;
+
+  /// Number of Parquet file footers found in the footer cache
+  static const char* PARQUET_FOOTER_CACHE_HIT_COUNT;
+
+  /// Number of Parquet file footers not found in the footer cache
+  static const char* PARQUET_FOOTER_CACHE_MISS_COUNT;
+
+  /// Number of Parquet file footers in the footer cache
+  static const char* PARQUET_FOOTER_CACHE_NUM_ENTRIES;
+
+  /// Estimated number of bytes used by the Parquet file footers in the footer cache
+  static const char* PARQUET_FOOTER_CACHE_TOTAL_BYTES;
+
+  /// Number of Parquet column chunks found in the page cache
+  static const char* PARQUET_PAGE_CACHE_HIT_COUNT;
+
+  /// Number of Parquet column chunks not found in the page cache
+  static const char* PARQUET_PAGE_CACHE_MISS_COUNT;
+
+  /// Number of Parquet column chunks in the page cache
+  static const char* PARQUET_PAGE_CACHE_NUM_ENTRIES;
+
+  /// Number of bytes of decompressed pages in the page cache
+  static const char* PARQUET_PAGE_CACHE_TOTAL_BYTES;
+
+  /// Number of codegen'd modules whose compiled object was found in the codegen cache
+  static const char* CODEGEN_CACHE_HIT_COUNT;
+
+  /// Number of codegen'd modules whose compiled object was not found in the codegen cache
+  static const char* CODEGEN_CACHE_MISS_COUNT;
+
+  /// Number of compiled objects in the codegen cache
+  static const char* CODEGEN_CACHE_NUM_ENTRIES;
+
+  /// Number of bytes of bitcode and compiled objects in the codegen cache
+  static const char* CODEGEN_CACHE_TOTAL_BYTES;
+
+  /// Number of queries whose results were found in the query result cache
+  static const char* QUERY_RESULT_CACHE_HIT_COUNT;
+
+  /// Number of cacheable queries whose results were not found in the query result cache
+  static const char* QUERY_RESULT_CACHE_MISS_COUNT;
+
+  /// Number of query results in the query result cache
+  static const char* QUERY_RESULT_CACHE_NUM_ENTRIES;
+
+  /// Number of bytes of query results in the query result cache
+  static const char* QUERY_RESULT_CACHE_TOTAL_BYTES;
+
+  /// Number of fragment instances whose output was found in the fragment output cache
+  static const char* FRAGMENT_OUTPUT_CACHE_HIT_COUNT;
+
+  /// Number of cacheable fragment instances whose output was not found in the fragment
+  /// output cache
+  static const char* FRAGMENT_OUTPUT_CACHE_MISS_COUNT;
+
+  /// Number of fragment outputs in the fragment output cache
+  static const char* FRAGMENT_OUTPUT_CACHE_NUM_ENTRIES;
+
+  /// Number of bytes of serialized row batches in the fragment output cache
+  static const char* FRAGMENT_OUTPUT_CACHE_TOTAL_BYTES;
+
+  /// Number of executions of prepared statements that reused a cached plan
+  static const char* PREPARED_STATEMENT_CACHE_HIT_COUNT;
+
+  /// Number of executions of prepared statements that were planned
+  static const char* PREPARED_STATEMENT_CACHE_MISS_COUNT;
+
+  /// Number of plans in the prepared statement cache
+  static const char* PREPARED_STATEMENT_CACHE_NUM_ENTRIES;
+
   /// Number of DBs in the catalog
   static const char* CATALOG_NUM_DBS;
 
@@ -162,6 +253,20 @@ class ImpaladMetrics {
   static IntCounter* IO_MGR_CACHED_BYTES_READ;
   static IntCounter* IO_MGR_SHORT_CIRCUIT_BYTES_READ;
   static IntCounter* IO_MGR_BYTES_WRITTEN;
+  static IntCounter* IO_MGR_REMOTE_DATA_CACHE_HIT_BYTES;
+  static IntCounter* IO_MGR_REMOTE_DATA_CACHE_MISS_BYTES;
+  static IntCounter* PARQUET_FOOTER_CACHE_HIT_COUNT;
+  static IntCounter* PARQUET_FOOTER_CACHE_MISS_COUNT;
+  static IntCounter* PARQUET_PAGE_CACHE_HIT_COUNT;
+  static IntCounter* PARQUET_PAGE_CACHE_MISS_COUNT;
+  static IntCounter* CODEGEN_CACHE_HIT_COUNT;
+  static IntCounter* CODEGEN_CACHE_MISS_COUNT;
+  static IntCounter* QUERY_RESULT_CACHE_HIT_COUNT;
+  static IntCounter* QUERY_RESULT_CACHE_MISS_COUNT;
+  static IntCounter* FRAGMENT_OUTPUT_CACHE_HIT_COUNT;
+  static IntCounter* FRAGMENT_OUTPUT_CACHE_MISS_COUNT;
+  static IntCounter* PREPARED_STATEMENT_CACHE_HIT_COUNT;
+  static IntCounter* PREPARED_STATEMENT_CACHE_MISS_COUNT;
 
   // Gauges
   static IntGauge* CATALOG_NUM_DBS;
@@ -177,7 +282,19 @@ class ImpaladMetrics {
   static IntGauge* IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT;
   static IntGauge* IO_MGR_TOTAL_BYTES;
   static IntGauge* MEM_POOL_TOTAL_BYTES;
+  static IntGauge* MEM_POOL_CACHED_BYTES;
   static IntGauge* NUM_FILES_OPEN_FOR_INSERT;
+  static IntGauge* PARQUET_FOOTER_CACHE_NUM_ENTRIES;
+  static IntGauge* PARQUET_FOOTER_CACHE_TOTAL_BYTES;
+  static IntGauge* PARQUET_PAGE_CACHE_NUM_ENTRIES;
+  static IntGauge* PARQUET_PAGE_CACHE_TOTAL_BYTES;
+  static IntGauge* CODEGEN_CACHE_NUM_ENTRIES;
+  static IntGauge* CODEGEN_CACHE_TOTAL_BYTES;
+  static IntGauge* QUERY_RESULT_CACHE_NUM_ENTRIES;
+  static IntGauge* QUERY_RESULT_CACHE_TOTAL_BYTES;
+  static IntGauge* FRAGMENT_OUTPUT_CACHE_NUM_ENTRIES;
+  static IntGauge* FRAGMENT_OUTPUT_CACHE_TOTAL_BYTES;
+  static IntGauge* PREPARED_STATEMENT_CACHE_NUM_ENTRIES;
   static IntGauge* RESULTSET_CACHE_TOTAL_NUM_ROWS;
   static IntGauge* RESULTSET_CACHE_TOTAL_BYTES;
   // Properties
@@ -188,6 +305,10 @@ class ImpaladMetrics {
   // Histograms
   static HistogramMetric* QUERY_DURATIONS;
   static HistogramMetric* DDL_DURATIONS;
+  static HistogramMetric* IO_MGR_S3_READ_LATENCIES;
+  static HistogramMetric* IO_MGR_FILE_HANDLE_OPEN_LATENCIES;
+  static HistogramMetric* DATA_STREAM_SENDER_TRANSMIT_DATA_LATENCIES;
+  static HistogramMetric* FRAGMENT_CANCEL_TO_RELEASE_LATENCIES;
 
   // Other
   static StatsMetric<uint64_t, StatsType::MEAN>* IO_MGR_CACHED_FILE_HANDLES_HIT_RATIO;
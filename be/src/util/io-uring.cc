@@ -0,0 +1,261 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/io-uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <gutil/strings/substitute.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define IMPALA_HAVE_IO_URING
+#endif
+#endif
+
+#include "util/error-util.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace strings;
+
+IoUring::IoUring()
+  : fd_(-1),
+    queue_depth_(0),
+    sq_ring_(MAP_FAILED),
+    sq_ring_size_(0),
+    cq_ring_(MAP_FAILED),
+    cq_ring_size_(0),
+    sqes_(MAP_FAILED),
+    sqes_size_(0),
+    in_flight_(0) {
+}
+
+#ifdef IMPALA_HAVE_IO_URING
+
+static int IoUringSetup(unsigned entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int IoUringEnter(int fd, unsigned to_submit, unsigned min_complete,
+    unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+IoUring::~IoUring() {
+  DCHECK_EQ(in_flight_, 0);
+  if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+  if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+  if (fd_ >= 0) close(fd_);
+}
+
+bool IoUring::IsSupported() {
+  // The system call fails with ENOSYS on kernels without io_uring, or EPERM if it is
+  // disabled.
+  static const bool supported = [] {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = IoUringSetup(1, &params);
+    if (fd < 0) return false;
+    close(fd);
+    return true;
+  }();
+  return supported;
+}
+
+Status IoUring::Init(int queue_depth) {
+  DCHECK_EQ(fd_, -1);
+  DCHECK_GT(queue_depth, 0);
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  fd_ = IoUringSetup(queue_depth, &params);
+  if (fd_ < 0) {
+    return Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("io_uring_setup($0) failed with errno=$1 description=$2",
+            queue_depth, errno, GetStrErrMsg())));
+  }
+  // The kernel rounds the number of entries up to a power of two. The completion
+  // queue is at least as large as the submission queue, so it can't overflow with at
+  // most 'queue_depth' operations in flight.
+  DCHECK_GE(params.sq_entries, queue_depth);
+  DCHECK_GE(params.cq_entries, queue_depth);
+  queue_depth_ = queue_depth;
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+  single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#endif
+  if (single_mmap) sq_ring_size_ = cq_ring_size_ = max(sq_ring_size_, cq_ring_size_);
+  sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    return Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("Mapping the io_uring submission queue failed with errno=$0 "
+            "description=$1", errno, GetStrErrMsg())));
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      return Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+          Substitute("Mapping the io_uring completion queue failed with errno=$0 "
+              "description=$1", errno, GetStrErrMsg())));
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      fd_, IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED) {
+    return Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("Mapping the io_uring submission entries failed with errno=$0 "
+            "description=$1", errno, GetStrErrMsg())));
+  }
+
+  char* sq_ring = reinterpret_cast<char*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.array);
+  char* cq_ring = reinterpret_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_mask);
+  cqes_ = cq_ring + params.cq_off.cqes;
+  return Status::OK();
+}
+
+Status IoUring::Submit(OpType op, int fd, const struct iovec* iov, int64_t offset,
+    void* user_data) {
+  return SubmitInternal(op == READ ? IORING_OP_READV : IORING_OP_WRITEV, fd, iov,
+      offset, user_data);
+}
+
+Status IoUring::SubmitNop(void* user_data) {
+  return SubmitInternal(IORING_OP_NOP, -1, NULL, 0, user_data);
+}
+
+Status IoUring::SubmitInternal(uint8_t opcode, int fd, const struct iovec* iov,
+    int64_t offset, void* user_data) {
+  DCHECK_GE(fd_, 0);
+  unique_lock<mutex> l(lock_);
+  while (in_flight_ >= queue_depth_) slot_available_.wait(l);
+
+  // Only this thread writes the tail, while the kernel advances the head as it consumes
+  // the entries.
+  unsigned tail = *sq_tail_;
+  unsigned index = tail & *sq_mask_;
+  io_uring_sqe* sqe = reinterpret_cast<io_uring_sqe*>(sqes_) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->off = offset;
+  sqe->addr = reinterpret_cast<uint64_t>(iov);
+  sqe->len = iov == NULL ? 0 : 1;
+  sqe->user_data = reinterpret_cast<uint64_t>(user_data);
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+  while (true) {
+    int ret = IoUringEnter(fd_, 1, 0, 0);
+    if (ret == 1) break;
+    if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) continue;
+    int err = ret < 0 ? errno : EIO;
+    // Take back the entry unless the kernel consumed it.
+    if (__atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == tail) {
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+    }
+    return Status(ErrorMsg(TErrorCode::RUNTIME_ERROR,
+        Substitute("io_uring_enter() failed with errno=$0 description=$1", err,
+            GetStrErrMsg(err))));
+  }
+  ++in_flight_;
+  return Status::OK();
+}
+
+int IoUring::Wait(Completion* completions, int max_completions) {
+  DCHECK_GE(fd_, 0);
+  DCHECK_GT(max_completions, 0);
+  while (true) {
+    // Only this thread writes the head, while the kernel advances the tail as it adds
+    // completions.
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head != tail) {
+      int num_completions = 0;
+      io_uring_cqe* cqes = reinterpret_cast<io_uring_cqe*>(cqes_);
+      for (; head != tail && num_completions < max_completions; ++head) {
+        io_uring_cqe* cqe = &cqes[head & *cq_mask_];
+        completions[num_completions].user_data =
+            reinterpret_cast<void*>(cqe->user_data);
+        completions[num_completions].result = cqe->res;
+        ++num_completions;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+      {
+        lock_guard<mutex> l(lock_);
+        in_flight_ -= num_completions;
+        DCHECK_GE(in_flight_, 0);
+      }
+      slot_available_.notify_all();
+      return num_completions;
+    }
+    int ret = IoUringEnter(fd_, 0, 1, IORING_ENTER_GETEVENTS);
+    if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      LOG(ERROR) << "Waiting for io_uring completions failed with errno=" << errno
+                 << " description=" << GetStrErrMsg();
+      return 0;
+    }
+  }
+}
+
+#else
+
+IoUring::~IoUring() {
+}
+
+bool IoUring::IsSupported() {
+  return false;
+}
+
+Status IoUring::Init(int queue_depth) {
+  return Status("io_uring is not supported by this build");
+}
+
+Status IoUring::Submit(OpType op, int fd, const struct iovec* iov, int64_t offset,
+    void* user_data) {
+  DCHECK(false);
+  return Status("io_uring is not supported by this build");
+}
+
+Status IoUring::SubmitNop(void* user_data) {
+  DCHECK(false);
+  return Status("io_uring is not supported by this build");
+}
+
+int IoUring::Wait(Completion* completions, int max_completions) {
+  DCHECK(false);
+  return 0;
+}
+
+#endif
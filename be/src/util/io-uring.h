@@ -0,0 +1,119 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_IO_URING_H
+#define IMPALA_UTIL_IO_URING_H
+
+#include <sys/uio.h>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "common/status.h"
+
+namespace impala {
+
+/// Minimal wrapper around a Linux io_uring instance, which lets a thread have many
+/// positional reads and writes on files in flight at the same time. The operations are
+/// submitted with Submit() and their results are collected with Wait(), usually by a
+/// different thread.
+///
+/// The ring is set up with the io_uring system calls directly, so that no library is
+/// needed. If the kernel headers at build time don't support io_uring, or the running
+/// kernel doesn't, IsSupported() returns false and Init() fails.
+///
+/// Submit() is thread-safe and blocks while 'queue_depth' operations are in flight.
+/// Wait() must only be called by one thread at a time.
+class IoUring {
+ public:
+  enum OpType {
+    READ,
+    WRITE,
+  };
+
+  /// The result of an operation: the 'user_data' it was submitted with and the number
+  /// of bytes transferred, or a negated errno.
+  struct Completion {
+    void* user_data;
+    int result;
+  };
+
+  IoUring();
+  ~IoUring();
+
+  /// Returns true if io_uring can be used on this machine.
+  static bool IsSupported();
+
+  /// Sets up a ring that holds up to 'queue_depth' operations in flight.
+  Status Init(int queue_depth);
+
+  /// Submits a read into or a write from the buffer 'iov' of file descriptor 'fd' at
+  /// 'offset'. 'iov' and the buffer must stay valid until the operation completes, and
+  /// 'fd' may be closed as soon as this returns.
+  Status Submit(OpType op, int fd, const struct iovec* iov, int64_t offset,
+      void* user_data);
+
+  /// Submits an operation that doesn't do anything, e.g. to wake up the thread in
+  /// Wait().
+  Status SubmitNop(void* user_data);
+
+  /// Blocks until at least one operation completed and returns up to 'max_completions'
+  /// of them in 'completions'. Returns the number of completions returned, which can be
+  /// 0 after an error waiting for them has been logged.
+  int Wait(Completion* completions, int max_completions);
+
+ private:
+  /// Adds an operation with the given fields to the submission queue and submits it.
+  Status SubmitInternal(uint8_t opcode, int fd, const struct iovec* iov,
+      int64_t offset, void* user_data);
+
+  /// File descriptor of the ring. -1 if Init() was not successful.
+  int fd_;
+
+  /// The maximum number of operations in flight.
+  int queue_depth_;
+
+  /// The mapped memory of the submission and completion queues and of the array of
+  /// submission entries. cq_ring_ is the same as sq_ring_ if the kernel maps both
+  /// queues together.
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  void* sqes_;
+  size_t sqes_size_;
+
+  /// Pointers to the fields of the queues that are shared with the kernel.
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  void* cqes_;
+
+  /// Protects the submission queue and in_flight_.
+  boost::mutex lock_;
+
+  /// Signalled when operations complete.
+  boost::condition_variable slot_available_;
+
+  /// The number of operations submitted whose completions were not returned by Wait().
+  int in_flight_;
+};
+
+}
+
+#endif
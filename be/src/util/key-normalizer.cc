@@ -0,0 +1,69 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/key-normalizer.inline.h"
+
+#include <algorithm>
+
+#include "common/names.h"
+
+namespace impala {
+
+// Number of string bytes the key length is sized for.
+const int STRING_KEY_PREFIX_LEN = 16;
+
+KeyNormalizer* KeyNormalizer::Create(const TupleRowComparator& comparator,
+    int max_key_len, bool* all_keys) {
+  const vector<ExprContext*>& ctxs = comparator.key_expr_ctxs_lhs();
+  vector<bool> nulls_first = comparator.nulls_first();
+  *all_keys = false;
+  int num_keys = 0;
+  int key_len = 0;
+  for (; num_keys < ctxs.size(); ++num_keys) {
+    const ColumnType& type = ctxs[num_keys]->root()->type();
+    // One byte for the null indicator.
+    int len = 1;
+    switch (type.type) {
+      case TYPE_NULL:
+      case TYPE_BOOLEAN:
+      case TYPE_TINYINT:
+      case TYPE_SMALLINT:
+      case TYPE_INT:
+      case TYPE_BIGINT:
+      case TYPE_FLOAT:
+      case TYPE_DOUBLE:
+        len += type.GetByteSize();
+        break;
+      case TYPE_STRING:
+      case TYPE_VARCHAR:
+        // The string prefix and the terminator.
+        len += STRING_KEY_PREFIX_LEN + 1;
+        break;
+      default:
+        // TODO: normalize TIMESTAMP, DECIMAL and CHAR keys.
+        len = 0;
+    }
+    if (len == 0) break;
+    key_len += len;
+  }
+  if (num_keys == 0 || max_key_len <= 0) return NULL;
+  *all_keys = num_keys == ctxs.size();
+  vector<ExprContext*> key_ctxs(ctxs.begin(), ctxs.begin() + num_keys);
+  vector<bool> is_asc(comparator.is_asc().begin(),
+      comparator.is_asc().begin() + num_keys);
+  nulls_first.resize(num_keys);
+  return new KeyNormalizer(key_ctxs, min(key_len, max_key_len), is_asc, nulls_first);
+}
+
+}
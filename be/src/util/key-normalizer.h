@@ -16,6 +16,7 @@
 #define IMPALA_UTIL_KEY_NORMALIZER_H_
 
 #include "exprs/expr.h"
+#include "util/tuple-row-compare.h"
 
 namespace impala {
 
@@ -43,17 +44,22 @@ namespace impala {
 ///     All numbers assumed unsigned.
 /// Strings:
 ///     Write one character at a time with a null byte at the end (inverted if
-///     sort descending). Unlike other data types, we may write partial strings.
-///     NOTE: This assumes strings do not contain null characters.
+///     sort descending). Characters 0 and 1 are escaped as the two bytes 1, 1 and 1, 2
+///     so that the terminator sorts before any character. Unlike other data types, we
+///     may write partial strings.
 /// Booleans/Nulls:
 ///     Left as-is.
 //
 /// Finally, we pad any remaining bytes of the key with zeroes.
+//
+/// If the key does not fit, the bytes written so far are still a valid prefix: two keys
+/// that differ within it compare correctly with memcmp(), and keys that are equal must
+/// be compared on the original values.
 class KeyNormalizer {
  public:
   /// Initializes the normalizer with the key exprs and length alloted to each normalized
   /// key.
-  KeyNormalizer(const std::vector<ExprContext*>& key_exprs_ctxs, int key_len,
+  KeyNormalizer(const std::vector<ExprContext*>& key_expr_ctxs, int key_len,
       const std::vector<bool>& is_asc, const std::vector<bool>& nulls_first)
       : key_expr_ctxs_(key_expr_ctxs), key_len_(key_len), is_asc_(is_asc),
         nulls_first_(nulls_first) {
@@ -66,6 +72,16 @@ class KeyNormalizer {
   /// TODO: Handle non-nullable columns
   bool NormalizeKey(TupleRow* tuple_row, uint8_t* dst, int* key_idx_over_budget = NULL);
 
+  /// Creates a normalizer for the sort keys of 'comparator', or returns NULL if the first
+  /// key cannot be normalized or 'max_key_len' is not positive. Only the longest prefix
+  /// of keys with supported types is normalized; 'all_keys' is set to true if that
+  /// prefix includes all keys. The key length is the space the normalized keys need,
+  /// assuming short strings, capped at 'max_key_len'. The caller owns the result.
+  static KeyNormalizer* Create(const TupleRowComparator& comparator, int max_key_len,
+      bool* all_keys);
+
+  int key_len() const { return key_len_; }
+
  private:
   /// Returns true if we went over the max key size while writing the null bit.
   static bool WriteNullBit(uint8_t null_bit, uint8_t* value, uint8_t* dst,
@@ -126,11 +126,22 @@ inline bool KeyNormalizer::WriteNormalizedKey(const ColumnType& type, bool is_as
       StringValue* string_val = reinterpret_cast<StringValue*>(value);
 
       // Copy the string over, with an additional NULL at the end.
-      int size = std::min(string_val->len, *bytes_left);
-      for (int i = 0; i < size; ++i) {
-        StoreFinalValue<uint8_t>(string_val->ptr[i], dst + i, is_asc);
+      int size = 0;
+      for (int i = 0; i < string_val->len; ++i) {
+        if (*bytes_left == 0) return true;
+        uint8_t c = string_val->ptr[i];
+        if (c <= 1) {
+          // Escape 0 and 1. If only the first byte of the escape fits, write it: it is
+          // shared by both escapes and sorts before any other character.
+          StoreFinalValue<uint8_t>(1, dst + size, is_asc);
+          ++size;
+          if (--*bytes_left == 0) return true;
+          ++c;
+        }
+        StoreFinalValue<uint8_t>(c, dst + size, is_asc);
+        ++size;
+        --*bytes_left;
       }
-      *bytes_left -= size;
 
       if (*bytes_left == 0) return true;
 
@@ -169,6 +180,8 @@ inline bool KeyNormalizer::NormalizeKey(TupleRow* row, uint8_t* dst,
         !nulls_first_[i], is_asc_[i], key, dst + offset, &bytes_left);
     if (went_over) {
       if (key_idx_over_budget != NULL) *key_idx_over_budget = i;
+      // Zero out the bytes that were reserved for the value that did not fit.
+      bzero(dst + key_len_ - bytes_left, bytes_left);
       return true;
     }
   }
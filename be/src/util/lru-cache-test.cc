@@ -149,6 +149,87 @@ TEST(FifoMultimap, PopShouldPopMostRecent) {
   ASSERT_EQ(0, c.size());
 }
 
+TEST(LruCache, Basic) {
+  LruCache<int, string> c(10);
+  LruCache<int, string>::ValuePtr result;
+  ASSERT_EQ(10, c.capacity());
+  c.Put(0, LruCache<int, string>::ValuePtr(new string("a")), 4);
+  c.Put(1, LruCache<int, string>::ValuePtr(new string("b")), 4);
+  ASSERT_EQ(2, c.size());
+  ASSERT_EQ(8, c.total_charge());
+  ASSERT_FALSE(c.Get(99, &result));
+  // Lookups do not remove entries.
+  ASSERT_TRUE(c.Get(0, &result));
+  ASSERT_EQ("a", *result);
+  ASSERT_TRUE(c.Get(0, &result));
+  ASSERT_EQ(2, c.size());
+
+  // Replacing an entry updates its value and charge.
+  c.Put(0, LruCache<int, string>::ValuePtr(new string("c")), 2);
+  ASSERT_EQ(2, c.size());
+  ASSERT_EQ(6, c.total_charge());
+  ASSERT_TRUE(c.Get(0, &result));
+  ASSERT_EQ("c", *result);
+
+  // Entries larger than the capacity are not added.
+  c.Put(2, LruCache<int, string>::ValuePtr(new string("d")), 11);
+  ASSERT_FALSE(c.Get(2, &result));
+  ASSERT_EQ(2, c.size());
+}
+
+TEST(LruCache, EvictLeastRecentlyUsed) {
+  LruCache<int, int> c(3);
+  LruCache<int, int>::ValuePtr result;
+  for (int i = 0; i < 3; ++i) c.Put(i, LruCache<int, int>::ValuePtr(new int(i)), 1);
+  // Make 0 the most recently used entry, so that 1 is evicted first.
+  ASSERT_TRUE(c.Get(0, &result));
+  c.Put(3, LruCache<int, int>::ValuePtr(new int(3)), 1);
+  ASSERT_EQ(3, c.size());
+  ASSERT_FALSE(c.Get(1, &result));
+  ASSERT_TRUE(c.Get(0, &result));
+  ASSERT_TRUE(c.Get(2, &result));
+  ASSERT_TRUE(c.Get(3, &result));
+
+  // An entry with a larger charge evicts as many entries as needed.
+  c.Put(4, LruCache<int, int>::ValuePtr(new int(4)), 2);
+  ASSERT_EQ(2, c.size());
+  ASSERT_EQ(3, c.total_charge());
+  ASSERT_TRUE(c.Get(3, &result));
+  ASSERT_TRUE(c.Get(4, &result));
+
+  // Evicted values stay valid while they are referenced.
+  c.Put(5, LruCache<int, int>::ValuePtr(new int(5)), 3);
+  ASSERT_EQ(1, c.size());
+  ASSERT_EQ(4, *result);
+
+  // Clear() removes all entries.
+  c.Clear();
+  ASSERT_EQ(0, c.size());
+  ASSERT_EQ(0, c.total_charge());
+  ASSERT_FALSE(c.Get(5, &result));
+  c.Put(6, LruCache<int, int>::ValuePtr(new int(6)), 3);
+  ASSERT_TRUE(c.Get(6, &result));
+}
+
+bool IsOdd(int v) { return v % 2 == 1; }
+
+TEST(LruCache, EraseIf) {
+  LruCache<int, int> c(10);
+  LruCache<int, int>::ValuePtr result;
+  for (int i = 0; i < 5; ++i) c.Put(i, LruCache<int, int>::ValuePtr(new int(i)), 2);
+  ASSERT_TRUE(c.Get(3, &result));
+  c.EraseIf(IsOdd);
+  ASSERT_EQ(3, c.size());
+  ASSERT_EQ(6, c.total_charge());
+  ASSERT_FALSE(c.Get(1, &result));
+  ASSERT_FALSE(c.Get(3, &result));
+  // Erased values stay valid while they are referenced.
+  ASSERT_EQ(3, *result);
+  ASSERT_TRUE(c.Get(0, &result));
+  ASSERT_TRUE(c.Get(2, &result));
+  ASSERT_TRUE(c.Get(4, &result));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -16,12 +16,14 @@
 #define IMPALA_UTIL_LRU_CACHE_H_
 
 #include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 #include <list>
 #include <map>
 #include <stack>
+#include <vector>
 
 #include "gutil/macros.h"
 #include "util/spinlock.h"
@@ -131,6 +133,92 @@ class FifoMultimap {
   static void DummyDeleter(Value* v) {}
 };
 
+/// Implementation of an LruCache of shared, immutable values.
+///
+/// The cache is bounded by the total 'charge' of its entries, e.g. their approximate size
+/// in bytes, rather than by their number. If adding an entry exceeds the capacity, the
+/// least recently used entries are evicted. Unlike FifoMultimap, looking up a key does
+/// not remove its entry: Get() returns a shared pointer to the value, so that any number
+/// of callers can use it at the same time. An evicted value is freed once the last
+/// caller releases it.
+///
+/// This class is thread-safe and protects its members using a spin lock. This class
+/// cannot be copied or assigned.
+template<typename Key, typename Value>
+class LruCache {
+ public:
+  typedef boost::shared_ptr<const Value> ValuePtr;
+
+  /// Instantiates the cache with an upper bound of 'capacity' on the total charge of its
+  /// entries.
+  explicit LruCache(size_t capacity) : capacity_(capacity), total_charge_(0) {}
+
+  /// Adds 'v' under 'k' with the given 'charge', replacing any existing entry for 'k'.
+  /// Evicts the least recently used entries until the total charge fits the capacity.
+  /// An entry whose charge alone exceeds the capacity is not added.
+  void Put(const Key& k, const ValuePtr& v, size_t charge);
+
+  /// Looks up 'k' and marks its entry as the most recently used one. Returns false if
+  /// there is no entry for 'k'.
+  bool Get(const Key& k, ValuePtr* out);
+
+  /// Removes all entries. Values still referenced by callers of Get() stay valid.
+  void Clear();
+
+  /// Removes the entries for whose value 'pred' returns true. Values still referenced by
+  /// callers of Get() stay valid.
+  template <typename Pred>
+  void EraseIf(const Pred& pred);
+
+  /// Returns the number of entries in the cache.
+  size_t size() {
+    boost::lock_guard<SpinLock> g(lock_);
+    return cache_.size();
+  }
+
+  /// Returns the total charge of the entries in the cache.
+  size_t total_charge() {
+    boost::lock_guard<SpinLock> g(lock_);
+    return total_charge_;
+  }
+
+  /// Returns the capacity of the cache
+  size_t capacity() const { return capacity_; }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(LruCache);
+
+  struct Entry {
+    Key key;
+    ValuePtr value;
+    size_t charge;
+  };
+
+  /// Total capacity, cannot be changed at run-time.
+  const size_t capacity_;
+
+  /// Protects access to cache_, lru_list_ and total_charge_.
+  SpinLock lock_;
+
+  typedef std::list<Entry> ListType;
+
+  /// The least recently used entry is stored at the beginning of the list. Entries are
+  /// moved to the end of the list when they are added or looked up.
+  ListType lru_list_;
+
+  typedef std::map<Key, typename ListType::iterator> MapType;
+
+  /// Maps each key to its entry in 'lru_list_'.
+  MapType cache_;
+
+  /// Sum of the charges of all entries.
+  size_t total_charge_;
+
+  /// Removes the entry 'it' points to from both internal collections and appends its
+  /// value to 'evicted'.
+  void EraseEntry(typename MapType::iterator it, std::vector<ValuePtr>* evicted);
+};
+
 }
 
 #include "lru-cache.inline.h"
@@ -81,6 +81,70 @@ void FifoMultimap<Key, Value>::EvictValue() {
   --size_;
 }
 
+template <typename Key, typename Value>
+void LruCache<Key, Value>::Put(const Key& k, const ValuePtr& v, size_t charge) {
+  // Declared before the lock is taken, so that the evicted values are freed after it is
+  // released.
+  std::vector<ValuePtr> evicted;
+  boost::lock_guard<SpinLock> g(lock_);
+  typename MapType::iterator it = cache_.find(k);
+  if (it != cache_.end()) EraseEntry(it, &evicted);
+  if (charge > capacity_) return;
+  while (total_charge_ + charge > capacity_) {
+    DCHECK(!lru_list_.empty());
+    EraseEntry(cache_.find(lru_list_.front().key), &evicted);
+  }
+  Entry entry;
+  entry.key = k;
+  entry.value = v;
+  entry.charge = charge;
+  cache_[k] = lru_list_.insert(lru_list_.end(), entry);
+  total_charge_ += charge;
+}
+
+template <typename Key, typename Value>
+bool LruCache<Key, Value>::Get(const Key& k, ValuePtr* out) {
+  boost::lock_guard<SpinLock> g(lock_);
+  typename MapType::iterator it = cache_.find(k);
+  if (it == cache_.end()) return false;
+  // Move the entry to the most recently used end of the list.
+  lru_list_.splice(lru_list_.end(), lru_list_, it->second);
+  *out = it->second->value;
+  return true;
+}
+
+template <typename Key, typename Value>
+void LruCache<Key, Value>::Clear() {
+  std::vector<ValuePtr> evicted;
+  boost::lock_guard<SpinLock> g(lock_);
+  while (!cache_.empty()) EraseEntry(cache_.begin(), &evicted);
+}
+
+template <typename Key, typename Value>
+template <typename Pred>
+void LruCache<Key, Value>::EraseIf(const Pred& pred) {
+  std::vector<ValuePtr> evicted;
+  boost::lock_guard<SpinLock> g(lock_);
+  typename ListType::iterator it = lru_list_.begin();
+  while (it != lru_list_.end()) {
+    typename ListType::iterator next = it;
+    ++next;
+    if (pred(*it->value)) EraseEntry(cache_.find(it->key), &evicted);
+    it = next;
+  }
+}
+
+template <typename Key, typename Value>
+void LruCache<Key, Value>::EraseEntry(typename MapType::iterator it,
+    std::vector<ValuePtr>* evicted) {
+  DCHECK(it != cache_.end());
+  evicted->push_back(it->second->value);
+  DCHECK_GE(total_charge_, it->second->charge);
+  total_charge_ -= it->second->charge;
+  lru_list_.erase(it->second);
+  cache_.erase(it);
+}
+
 }
 
 #endif // IMPALA_UTIL_LRU_CACHE_INLINE_H_
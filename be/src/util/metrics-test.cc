@@ -14,6 +14,7 @@
 
 #include "util/metrics.h"
 #include "util/collection-metrics.h"
+#include "util/histogram-metric.h"
 #include "util/memory-metrics.h"
 
 #include <gtest/gtest.h>
@@ -324,6 +325,24 @@ TEST_F(MetricsTest, StatsMetricsJson) {
   EXPECT_EQ(stats_val["stddev"].GetDouble(), 5.0);
 }
 
+TEST_F(MetricsTest, HistogramMetricsJson) {
+  MetricGroup metrics("HistogramMetrics");
+  HistogramMetric* metric = metrics.RegisterMetric(new HistogramMetric(
+      MakeTMetricDef("histogram_metric", TMetricKind::HISTOGRAM, TUnit::TIME_NS), 1000,
+      2));
+  for (int i = 1; i <= 100; ++i) metric->Update(i);
+  // Values above the highest trackable value are recorded as that value.
+  metric->Update(1000000);
+  Document document;
+  Value val;
+  metrics.ToJson(true, &document, &val);
+  const Value& histogram_val = val["metrics"][0u];
+  EXPECT_EQ(histogram_val["count"].GetInt(), 101);
+  EXPECT_EQ(histogram_val["50th %-ile"].GetInt(), 51);
+  EXPECT_EQ(histogram_val["99.9th %-ile"].GetInt(), 1000);
+  EXPECT_EQ(string(histogram_val["units"].GetString()), "TIME_NS");
+}
+
 TEST_F(MetricsTest, UnitsAndDescriptionJson) {
   MetricGroup metrics("Units");
   AddMetricDef("counter", TMetricKind::COUNTER, TUnit::BYTES, "description");
@@ -0,0 +1,86 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/min-max-filter.h"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace impala {
+
+TEST(MinMaxFilter, SupportsType) {
+  EXPECT_TRUE(MinMaxFilter::SupportsType(ColumnType(TYPE_TINYINT)));
+  EXPECT_TRUE(MinMaxFilter::SupportsType(ColumnType(TYPE_SMALLINT)));
+  EXPECT_TRUE(MinMaxFilter::SupportsType(ColumnType(TYPE_INT)));
+  EXPECT_TRUE(MinMaxFilter::SupportsType(ColumnType(TYPE_BIGINT)));
+  EXPECT_FALSE(MinMaxFilter::SupportsType(ColumnType(TYPE_DOUBLE)));
+  EXPECT_FALSE(MinMaxFilter::SupportsType(ColumnType(TYPE_STRING)));
+}
+
+// An empty filter rejects every value and every range.
+TEST(MinMaxFilter, Empty) {
+  MinMaxFilter f(ColumnType(TYPE_INT));
+  EXPECT_TRUE(f.IsEmpty());
+  int32_t v = 0;
+  EXPECT_FALSE(f.Eval(&v));
+  EXPECT_FALSE(f.Overlaps(numeric_limits<int64_t>::min(),
+      numeric_limits<int64_t>::max()));
+}
+
+TEST(MinMaxFilter, EvalAndOverlaps) {
+  MinMaxFilter f(ColumnType(TYPE_SMALLINT));
+  for (int16_t v = -10; v <= 20; v += 5) f.Insert(&v);
+  EXPECT_FALSE(f.IsEmpty());
+  EXPECT_EQ(-10, f.min());
+  EXPECT_EQ(20, f.max());
+
+  int16_t v = -11;
+  EXPECT_FALSE(f.Eval(&v));
+  v = -10;
+  EXPECT_TRUE(f.Eval(&v));
+  // Values between inserted ones pass: the filter only tracks the range.
+  v = 1;
+  EXPECT_TRUE(f.Eval(&v));
+  v = 21;
+  EXPECT_FALSE(f.Eval(&v));
+  EXPECT_TRUE(f.Eval(NULL));
+
+  EXPECT_FALSE(f.Overlaps(-100, -11));
+  EXPECT_TRUE(f.Overlaps(-100, -10));
+  EXPECT_TRUE(f.Overlaps(0, 1));
+  EXPECT_TRUE(f.Overlaps(20, 100));
+  EXPECT_FALSE(f.Overlaps(21, 100));
+}
+
+// Once a NULL is inserted all ranges must pass, since the range may contain NULLs.
+TEST(MinMaxFilter, Null) {
+  MinMaxFilter f(ColumnType(TYPE_BIGINT));
+  int64_t v = 5;
+  f.Insert(&v);
+  EXPECT_FALSE(f.Overlaps(10, 20));
+  EXPECT_FALSE(f.has_null());
+  f.Insert(NULL);
+  EXPECT_TRUE(f.has_null());
+  EXPECT_TRUE(f.Overlaps(10, 20));
+  v = 10;
+  EXPECT_FALSE(f.Eval(&v));
+}
+
+}  // namespace impala
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
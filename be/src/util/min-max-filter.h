@@ -0,0 +1,112 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_UTIL_MIN_MAX_FILTER_H
+#define IMPALA_UTIL_MIN_MAX_FILTER_H
+
+#include <stdint.h>
+
+#include <limits>
+
+#include "common/logging.h"
+#include "runtime/types.h"
+
+namespace impala {
+
+/// A MinMaxFilter tracks the smallest and largest value inserted into it. It is a much
+/// cheaper (and much less selective) companion to a BloomFilter that, unlike a
+/// BloomFilter, can be tested against a whole range of values at once, e.g. against the
+/// column statistics of a Parquet row group. Only integer types are supported; all
+/// values are widened to int64_t.
+///
+/// NULL values are not part of the range. If a NULL is inserted the filter remembers it
+/// and conservatively lets all NULLs and all ranges pass, since NULLs may match in joins
+/// with IS NOT DISTINCT FROM predicates.
+class MinMaxFilter {
+ public:
+  MinMaxFilter(const ColumnType& type)
+    : type_(type.type),
+      min_(std::numeric_limits<int64_t>::max()),
+      max_(std::numeric_limits<int64_t>::min()),
+      has_null_(false) {
+    DCHECK(SupportsType(type)) << type;
+  }
+
+  /// Returns true if a MinMaxFilter can be built over values of 'type'.
+  static bool SupportsType(const ColumnType& type) {
+    switch (type.type) {
+      case TYPE_TINYINT:
+      case TYPE_SMALLINT:
+      case TYPE_INT:
+      case TYPE_BIGINT:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /// Adds the value pointed to by 'val' to the filter. 'val' may be NULL.
+  void Insert(const void* val) {
+    if (val == NULL) {
+      has_null_ = true;
+      return;
+    }
+    int64_t v = ToInt64(val);
+    if (v < min_) min_ = v;
+    if (v > max_) max_ = v;
+  }
+
+  /// Returns false if the value pointed to by 'val' is definitely not in the filter.
+  bool Eval(const void* val) const {
+    if (val == NULL) return true;
+    int64_t v = ToInt64(val);
+    return v >= min_ && v <= max_;
+  }
+
+  /// Returns false if no value in [lo, hi] can be in the filter.
+  bool Overlaps(int64_t lo, int64_t hi) const {
+    return has_null_ || (lo <= max_ && hi >= min_);
+  }
+
+  /// Returns true if no non-NULL value was inserted.
+  bool IsEmpty() const { return min_ > max_; }
+
+  /// Returns true if a NULL was inserted.
+  bool has_null() const { return has_null_; }
+
+  int64_t min() const { return min_; }
+  int64_t max() const { return max_; }
+
+ private:
+  int64_t ToInt64(const void* val) const {
+    switch (type_) {
+      case TYPE_TINYINT: return *reinterpret_cast<const int8_t*>(val);
+      case TYPE_SMALLINT: return *reinterpret_cast<const int16_t*>(val);
+      case TYPE_INT: return *reinterpret_cast<const int32_t*>(val);
+      case TYPE_BIGINT: return *reinterpret_cast<const int64_t*>(val);
+      default:
+        DCHECK(false) << type_;
+        return 0;
+    }
+  }
+
+  const PrimitiveType type_;
+  int64_t min_;
+  int64_t max_;
+  bool has_null_;
+};
+
+}
+
+#endif
@@ -112,6 +112,22 @@ TEST(ParseMemSpecs, Basic) {
   ASSERT_LT(bytes, 0);
 }
 
+
+TEST(ParsePoolWeights, Basic) {
+  unordered_map<string, double> weights;
+  ParseUtil::ParsePoolWeights("root.etl:4, root.adhoc:0.5,,a:b:2", &weights);
+  ASSERT_EQ(3, weights.size());
+  EXPECT_EQ(4, weights["root.etl"]);
+  EXPECT_EQ(0.5, weights["root.adhoc"]);
+  EXPECT_EQ(2, weights["a:b"]);
+
+  // Invalid entries are ignored.
+  weights.clear();
+  ParseUtil::ParsePoolWeights("root.etl,:1,root.a:,root.b:0,root.c:-1,root.d:1x",
+      &weights);
+  EXPECT_TRUE(weights.empty());
+}
+
 }
 
 int main(int argc, char **argv) {
@@ -13,6 +13,11 @@
 // limitations under the License.
 
 #include "util/parse-util.h"
+
+#include <stdlib.h>
+#include <boost/algorithm/string.hpp>
+
+#include "common/logging.h"
 #include "util/mem-info.h"
 #include "util/string-parser.h"
 
@@ -92,4 +97,27 @@ int64_t ParseUtil::ParseMemSpec(const string& mem_spec_str, bool* is_percent,
   return bytes;
 }
 
+void ParseUtil::ParsePoolWeights(const string& spec,
+    unordered_map<string, double>* pool_weights) {
+  vector<string> entries;
+  boost::split(entries, spec, boost::is_any_of(","));
+  for (string& entry: entries) {
+    boost::trim(entry);
+    if (entry.empty()) continue;
+    size_t pos = entry.find_last_of(':');
+    double weight = 0;
+    if (pos != string::npos && pos > 0) {
+      char* end;
+      string weight_str = entry.substr(pos + 1);
+      weight = strtod(weight_str.c_str(), &end);
+      if (weight_str.empty() || *end != '\0') weight = 0;
+    }
+    if (weight <= 0) {
+      LOG(WARNING) << "Ignoring invalid pool weight: " << entry;
+      continue;
+    }
+    (*pool_weights)[entry.substr(0, pos)] = weight;
+  }
+}
+
 }
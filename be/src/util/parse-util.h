@@ -17,6 +17,7 @@
 
 #include <string>
 #include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
 
 namespace impala {
 
@@ -38,6 +39,13 @@ class ParseUtil {
   /// Returns -1 if parsing failed.
   static int64_t ParseMemSpec(const std::string& mem_spec_str,
       bool* is_percent, int64_t relative_reference);
+
+  /// Parses a comma-separated list of '<pool name>:<weight>' pairs, e.g. the value of
+  /// --admission_pool_weights, into 'pool_weights'. Pool names may contain ':', so the
+  /// weight follows the last one. Entries without a positive weight are logged and
+  /// ignored.
+  static void ParsePoolWeights(const std::string& spec,
+      boost::unordered_map<std::string, double>* pool_weights);
 };
 
 }
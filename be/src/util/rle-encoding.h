@@ -17,6 +17,8 @@
 
 #include <math.h>
 
+#include <algorithm>
+
 #include "common/compiler-util.h"
 #include "util/bit-stream-utils.inline.h"
 #include "util/bit-util.h"
@@ -104,6 +106,12 @@ class RleDecoder {
   template<typename T>
   bool Get(T* val);
 
+  /// Gets the next 'num_values' values into 'values'. Repeated runs are filled in bulk.
+  /// Returns the number of values read, which is less than 'num_values' if there are no
+  /// more.
+  template<typename T>
+  int GetValues(T* values, int num_values);
+
  protected:
   /// Fills literal_count_ and repeat_count_ with next values. Returns false if there
   /// are no more.
@@ -266,6 +274,34 @@ inline bool RleDecoder::Get(T* val) {
   return true;
 }
 
+template<typename T>
+inline int RleDecoder::GetValues(T* values, int num_values) {
+  DCHECK_GE(bit_width_, 0);
+  int num_read = 0;
+  while (num_read < num_values) {
+    if (repeat_count_ == 0 && literal_count_ == 0) {
+      if (!NextCounts<T>()) break;
+    }
+    if (repeat_count_ > 0) {
+      int n = std::min<uint32_t>(repeat_count_, num_values - num_read);
+      std::fill(values + num_read, values + num_read + n, static_cast<T>(current_value_));
+      repeat_count_ -= n;
+      num_read += n;
+    } else {
+      DCHECK_GT(literal_count_, 0);
+      int n = std::min<uint32_t>(literal_count_, num_values - num_read);
+      int num_unpacked = bit_reader_.GetValues(bit_width_, values + num_read, n);
+      num_read += num_unpacked;
+      if (UNLIKELY(num_unpacked < n)) {
+        literal_count_ = 0;
+        return num_read;
+      }
+      literal_count_ -= n;
+    }
+  }
+  return num_read;
+}
+
 template<typename T>
 bool RleDecoder::NextCounts() {
   // Read the next run's indicator int, it could be a literal or repeated run.
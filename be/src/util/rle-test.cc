@@ -21,8 +21,10 @@
 #include <math.h>
 
 #include "common/init.h"
+#include "util/bit-packing.h"
 #include "util/rle-encoding.h"
 #include "util/bit-stream-utils.inline.h"
+#include "util/cpu-info.h"
 
 #include "common/names.h"
 
@@ -135,6 +137,85 @@ TEST(BitArray, TestValues) {
   }
 }
 
+// Writes 'num_vals' random values of width 'bit_width' after 'skip' leading values and
+// checks that BitReader::GetValues() reads back the same values as GetValue().
+void TestBitArrayGetValues(int bit_width, int num_vals, int skip) {
+  const int len = BitUtil::Ceil(bit_width * (num_vals + skip), 8);
+  const uint64_t mask = (1ULL << bit_width) - 1;
+  // Keep the buffer non-NULL for a bit width of 0.
+  vector<uint8_t> buffer(len + 1);
+  vector<uint32_t> values(num_vals + skip);
+  BitWriter writer(buffer.data(), len);
+  for (int i = 0; i < values.size(); ++i) {
+    values[i] = (static_cast<uint64_t>(rand()) * rand()) & mask;
+    EXPECT_TRUE(writer.PutValue(values[i], bit_width));
+  }
+  writer.Flush();
+
+  BitReader reader(buffer.data(), len);
+  uint32_t val;
+  for (int i = 0; i < skip; ++i) EXPECT_TRUE(reader.GetValue(bit_width, &val));
+  vector<uint32_t> decoded(num_vals);
+  EXPECT_EQ(num_vals, reader.GetValues(bit_width, decoded.data(), num_vals));
+  for (int i = 0; i < num_vals; ++i) EXPECT_EQ(values[i + skip], decoded[i]) << i;
+  EXPECT_EQ(reader.bytes_left(), 0);
+
+  // Values narrower than the unpacked 32-bit integers go through a temporary buffer.
+  if (bit_width <= 8) {
+    reader.Reset(buffer.data(), len);
+    for (int i = 0; i < skip; ++i) EXPECT_TRUE(reader.GetValue(bit_width, &val));
+    vector<uint8_t> decoded8(num_vals);
+    EXPECT_EQ(num_vals, reader.GetValues(bit_width, decoded8.data(), num_vals));
+    for (int i = 0; i < num_vals; ++i) EXPECT_EQ(values[i + skip], decoded8[i]) << i;
+  }
+}
+
+TEST(BitArray, TestGetValues) {
+  for (int width = 0; width <= MAX_WIDTH; ++width) {
+    for (int skip = 0; skip < 3; ++skip) {
+      TestBitArrayGetValues(width, 1, skip);
+      TestBitArrayGetValues(width, 9, skip);
+      TestBitArrayGetValues(width, 1000, skip);
+      TestBitArrayGetValues(width, 1003, skip);
+    }
+  }
+}
+
+// Checks every unpacking kernel the CPU supports against BitReader::GetValue().
+TEST(BitArray, TestUnpackKernels) {
+  typedef int (*UnpackFn)(int, const uint8_t*, int64_t, int, uint32_t*);
+  vector<UnpackFn> kernels;
+  kernels.push_back(BitPacking::UnpackValuesScalar);
+  if (CpuInfo::IsSupported(CpuInfo::SSE4_1)) kernels.push_back(BitPacking::UnpackValuesSSE4);
+  if (CpuInfo::IsSupported(CpuInfo::AVX2)) kernels.push_back(BitPacking::UnpackValuesAVX2);
+
+  const int num_vals = 1024;
+  for (int width = 1; width <= BitPacking::MAX_BIT_WIDTH; ++width) {
+    const int len = BitUtil::Ceil(width * num_vals, 8);
+    vector<uint8_t> buffer(len);
+    BitWriter writer(buffer.data(), len);
+    for (int i = 0; i < num_vals; ++i) {
+      EXPECT_TRUE(writer.PutValue((static_cast<uint64_t>(rand()) * rand()) &
+          ((1ULL << width) - 1), width));
+    }
+    writer.Flush();
+    vector<uint32_t> expected(num_vals);
+    BitReader reader(buffer.data(), len);
+    for (int i = 0; i < num_vals; ++i) EXPECT_TRUE(reader.GetValue(width, &expected[i]));
+
+    for (int k = 0; k < kernels.size(); ++k) {
+      vector<uint32_t> unpacked(num_vals);
+      int num_unpacked = kernels[k](width, buffer.data(), len, num_vals, unpacked.data());
+      EXPECT_EQ(num_unpacked % 8, 0);
+      // Only the groups close to the end of the buffer may be left to the caller.
+      EXPECT_GE(num_unpacked, num_vals - 8 * (16 / width + 2));
+      for (int i = 0; i < num_unpacked; ++i) {
+        EXPECT_EQ(expected[i], unpacked[i]) << "kernel " << k << " width " << width;
+      }
+    }
+  }
+}
+
 // Test some mixed values
 TEST(BitArray, TestMixed) {
   const int len = 1024;
@@ -212,6 +293,16 @@ void ValidateRle(const vector<int>& values, int bit_width,
     }
     decoder.Reset(buffer, len, bit_width);
   }
+
+  // Verify batched read. Use a batch size that does not line up with the runs.
+  vector<uint64_t> decoded(values.size());
+  int num_read = 0;
+  while (num_read < values.size()) {
+    int batch_size = min<int>(7, values.size() - num_read);
+    EXPECT_EQ(batch_size, decoder.GetValues(&decoded[num_read], batch_size));
+    num_read += batch_size;
+  }
+  for (int i = 0; i < values.size(); ++i) EXPECT_EQ(values[i], decoded[i]);
 }
 
 TEST(Rle, SpecificSequences) {
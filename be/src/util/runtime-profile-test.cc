@@ -222,6 +222,101 @@ TEST(CountersTest, MergeAndUpdate) {
   profile2.PrettyPrint(&dummy);
 }
 
+TEST(CountersTest, Delta) {
+  ObjectPool pool;
+  RuntimeProfile profile(&pool, "Parent");
+  RuntimeProfile child(&pool, "Child");
+  profile.AddChild(&child);
+  RuntimeProfile::Counter* parent_counter = profile.AddCounter("A", TUnit::UNIT);
+  RuntimeProfile::Counter* child_counter = child.AddCounter("B", TUnit::UNIT);
+  child.AddCounter("C", TUnit::UNIT)->Set(3);
+  profile.AddInfoString("Key", "Value");
+  parent_counter->Set(1);
+  child_counter->Set(2);
+
+  // The first report is a delta against nothing, i.e. the full profile, which also
+  // contains the total and inactive time counters of each node.
+  TRuntimeProfileTree prev;
+  TRuntimeProfileTree delta;
+  profile.ToThrift(&delta);
+  RuntimeProfile::ComputeDelta(prev, &delta);
+  EXPECT_EQ(delta.nodes.size(), 2);
+  EXPECT_EQ(delta.nodes[0].counters.size(), 3);
+  EXPECT_EQ(delta.nodes[1].counters.size(), 4);
+  RuntimeProfile updated_profile(&pool, "Updated");
+  updated_profile.Update(delta);
+  profile.ToThrift(&prev);
+
+  // Only the changed counter is kept.
+  child_counter->Set(5);
+  profile.ToThrift(&delta);
+  RuntimeProfile::ComputeDelta(prev, &delta);
+  EXPECT_EQ(delta.nodes.size(), 2);
+  EXPECT_EQ(delta.nodes[0].counters.size(), 0);
+  EXPECT_EQ(delta.nodes[0].info_strings.size(), 0);
+  EXPECT_EQ(delta.nodes[0].info_strings_display_order.size(), 0);
+  ASSERT_EQ(delta.nodes[1].counters.size(), 1);
+  EXPECT_EQ(delta.nodes[1].counters[0].name, "B");
+
+  updated_profile.Update(delta);
+  vector<RuntimeProfile*> children;
+  updated_profile.GetChildren(&children);
+  ASSERT_EQ(children.size(), 1);
+  ValidateCounter(&updated_profile, "A", 1);
+  ValidateCounter(children[0], "B", 5);
+  ValidateCounter(children[0], "C", 3);
+  EXPECT_EQ(*updated_profile.GetInfoString("Key"), "Value");
+}
+
+// Update() matches sorted counters and children at the same positions without lookups,
+// but must still handle thrift profiles that are not in that layout.
+TEST(CountersTest, UpdateUnorderedLayout) {
+  ObjectPool pool;
+  RuntimeProfile profile(&pool, "Profile");
+  profile.AddCounter("B", TUnit::UNIT)->Set(1);
+  RuntimeProfile child1(&pool, "Child1");
+  RuntimeProfile child2(&pool, "Child2");
+  profile.AddChild(&child1);
+  profile.AddChild(&child2);
+  profile.total_time_counter()->Set(100);
+
+  TRuntimeProfileTree tree;
+  profile.ToThrift(&tree);
+  RuntimeProfile* from_thrift = RuntimeProfile::CreateFromThrift(&pool, tree);
+  EXPECT_EQ(from_thrift->total_time_counter()->value(), 100);
+  EXPECT_EQ(from_thrift->GetCounter("TotalTime"), from_thrift->total_time_counter());
+
+  // Counters out of order and new ones in between, children in reverse order.
+  TCounter counter;
+  counter.unit = TUnit::UNIT;
+  vector<TCounter> counters;
+  counter.name = "C";
+  counter.value = 3;
+  counters.push_back(counter);
+  counter.name = "A";
+  counter.value = 4;
+  counters.push_back(counter);
+  counter.name = "B";
+  counter.value = 5;
+  counters.push_back(counter);
+  tree.nodes[0].counters = counters;
+  swap(tree.nodes[1], tree.nodes[2]);
+  tree.nodes[1].counters = counters;
+  from_thrift->Update(tree);
+
+  ValidateCounter(from_thrift, "A", 4);
+  ValidateCounter(from_thrift, "B", 5);
+  ValidateCounter(from_thrift, "C", 3);
+  EXPECT_EQ(from_thrift->total_time_counter()->value(), 100);
+  vector<RuntimeProfile*> children;
+  from_thrift->GetChildren(&children);
+  ASSERT_EQ(children.size(), 2);
+  EXPECT_EQ(children[0]->name(), "Child1");
+  EXPECT_EQ(children[1]->name(), "Child2");
+  ValidateCounter(children[1], "A", 4);
+  EXPECT_TRUE(children[0]->GetCounter("A") == NULL);
+}
+
 TEST(CountersTest, HighWaterMarkCounters) {
   ObjectPool pool;
   RuntimeProfile profile(&pool, "Profile");
@@ -367,6 +462,32 @@ TEST(CountersTest, InfoStringTest) {
   EXPECT_EQ(*update_dst_profile.GetInfoString("Foo"), "Bar");
 }
 
+TEST(CountersTest, RemoveChild) {
+  ObjectPool pool;
+  RuntimeProfile profile(&pool, "Profile");
+  RuntimeProfile child1(&pool, "Child");
+  RuntimeProfile child2(&pool, "Child");
+  profile.AddChild(&child1);
+  // A child with the same name is only added once the first one is removed.
+  profile.AddChild(&child2);
+  vector<RuntimeProfile*> children;
+  profile.GetChildren(&children);
+  ASSERT_EQ(children.size(), 1);
+  EXPECT_EQ(children[0], &child1);
+
+  profile.RemoveChild(&child2);
+  profile.GetChildren(&children);
+  EXPECT_EQ(children.size(), 1);
+  profile.RemoveChild(&child1);
+  profile.AddChild(&child2);
+  profile.GetChildren(&children);
+  ASSERT_EQ(children.size(), 1);
+  EXPECT_EQ(children[0], &child2);
+  TRuntimeProfileTree tprofile;
+  profile.ToThrift(&tprofile);
+  EXPECT_EQ(tprofile.nodes.size(), 2);
+}
+
 TEST(CountersTest, RateCounters) {
   ObjectPool pool;
   RuntimeProfile profile(&pool, "Profile");
@@ -532,6 +653,83 @@ TEST(CountersTest, StreamingSampler) {
   ValidateSampler(sampler, 7, 1000, 2);
 }
 
+// Uses 'ms' milliseconds of the calling thread's CPU time.
+static void BusyLoop(int64_t ms) {
+  timespec start, now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+  do {
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  } while ((now.tv_sec - start.tv_sec) * 1000L + (now.tv_nsec - start.tv_nsec) / 1000000L
+      < ms);
+}
+
+TEST(CountersTest, ExecTimeCounters) {
+  ObjectPool pool;
+  RuntimeProfile parent_profile(&pool, "Parent");
+  RuntimeProfile child_profile(&pool, "Child");
+  RuntimeProfile::ExecTimeCounters* parent = parent_profile.AddExecTimeCounters(false);
+  RuntimeProfile::ExecTimeCounters* child = child_profile.AddExecTimeCounters(false);
+  {
+    SCOPED_EXEC_TIME_MEASUREMENT(parent);
+    BusyLoop(50);
+    {
+      SCOPED_EXEC_TIME_MEASUREMENT(child);
+      BusyLoop(100);
+      SCOPED_WAIT_TIMER(IO_WAIT);
+      SleepForMs(20);
+    }
+    SCOPED_WAIT_TIMER(SPILL_WAIT);
+    SleepForMs(20);
+  }
+  // Waits outside of measurements are not attributed to any node.
+  {
+    SCOPED_WAIT_TIMER(IO_WAIT);
+    SleepForMs(20);
+  }
+
+  // The parent's CPU time excludes the child's.
+  int64_t parent_cpu = parent_profile.GetCounter("CpuTime")->value();
+  int64_t child_cpu = child_profile.GetCounter("CpuTime")->value();
+  EXPECT_GE(parent_cpu, 50L * 1000L * 1000L);
+  EXPECT_LT(parent_cpu, 100L * 1000L * 1000L);
+  EXPECT_GE(child_cpu, 100L * 1000L * 1000L);
+
+  EXPECT_TRUE(parent_profile.GetCounter("IoWaitTime") == NULL);
+  EXPECT_GE(parent_profile.GetCounter("SpillWaitTime")->value(), 20L * 1000L * 1000L);
+  EXPECT_GE(child_profile.GetCounter("IoWaitTime")->value(), 20L * 1000L * 1000L);
+  EXPECT_TRUE(child_profile.GetCounter("SpillWaitTime") == NULL);
+
+  // Measurements without counters are not on the stack.
+  {
+    SCOPED_EXEC_TIME_MEASUREMENT(NULL);
+    EXPECT_TRUE(ExecTimeMeasurement::current_counters() == NULL);
+  }
+}
+
+TEST(CountersTest, ExecTimeHwCounters) {
+  // Many VMs don't have a PMU.
+  if (ThreadHwCounters::GetForCurrentThread() == NULL) return;
+  ObjectPool pool;
+  RuntimeProfile parent_profile(&pool, "Parent");
+  RuntimeProfile child_profile(&pool, "Child");
+  RuntimeProfile::ExecTimeCounters* parent = parent_profile.AddExecTimeCounters(true);
+  RuntimeProfile::ExecTimeCounters* child = child_profile.AddExecTimeCounters(true);
+  {
+    SCOPED_EXEC_TIME_MEASUREMENT(parent);
+    BusyLoop(10);
+    SCOPED_EXEC_TIME_MEASUREMENT(child);
+    BusyLoop(50);
+  }
+  for (int i = 0; i < ThreadHwCounters::NUM_EVENTS; ++i) {
+    EXPECT_TRUE(child_profile.GetCounter(ThreadHwCounters::EVENT_NAMES[i]) != NULL);
+  }
+  int64_t parent_instructions = parent_profile.GetCounter("HwInstructions")->value();
+  int64_t child_instructions = child_profile.GetCounter("HwInstructions")->value();
+  EXPECT_GT(parent_instructions, 0);
+  EXPECT_GT(child_instructions, parent_instructions);
+  EXPECT_GT(child_profile.GetCounter("HwCycles")->value(), 0);
+}
+
 // Test class to test ConcurrentStopWatch and RuntimeProfile::ConcurrentTimerCounter
 // don't double count in multithread environment.
 class TimerCounterTest {
@@ -14,12 +14,15 @@
 
 #include "util/runtime-profile.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 
 #include <boost/bind.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <gutil/strings/substitute.h>
 
 #include "common/object-pool.h"
 #include "rpc/thrift-util.h"
@@ -33,6 +36,8 @@
 
 #include "common/names.h"
 
+using strings::Substitute;
+
 namespace impala {
 
 // Thread counters name
@@ -71,6 +76,8 @@ RuntimeProfile::RuntimeProfile(ObjectPool* pool, const string& name,
   }
   counter_map_[TOTAL_TIME_COUNTER_NAME] = total_time_counter;
   counter_map_[INACTIVE_TIME_COUNTER_NAME] = inactive_timer;
+  total_time_counter_ = total_time_counter;
+  inactive_timer_counter_ = inactive_timer;
 }
 
 RuntimeProfile::~RuntimeProfile() {
@@ -113,8 +120,15 @@ RuntimeProfile* RuntimeProfile::CreateFromThrift(ObjectPool* pool,
   profile->metadata_ = node.metadata;
   for (int i = 0; i < node.counters.size(); ++i) {
     const TCounter& counter = node.counters[i];
-    profile->counter_map_[counter.name] =
-      pool->Add(new Counter(counter.unit, counter.value));
+    // Keep the TotalTime and InactiveTotalTime counters that the constructor added, so
+    // that total_time_counter() and inactive_timer() return them.
+    CounterMap::iterator it = profile->counter_map_.find(counter.name);
+    if (it != profile->counter_map_.end() && it->second->unit() == counter.unit) {
+      it->second->Set(counter.value);
+    } else {
+      profile->counter_map_[counter.name] =
+        pool->Add(new Counter(counter.unit, counter.value));
+    }
   }
 
   if (node.__isset.event_sequences) {
@@ -219,15 +233,24 @@ void RuntimeProfile::Update(const vector<TRuntimeProfileNode>& nodes, int* idx)
   DCHECK_LT(*idx, nodes.size());
   const TRuntimeProfileNode& node = nodes[*idx];
   {
-    // Update this level.
-    map<string, Counter*>::iterator dst_iter;
+    // Update this level. ToThrift() serializes the counters sorted by name, so they are
+    // matched up with the counter map in a single pass over both instead of one lookup
+    // per counter. Counters that are out of order are looked up.
     lock_guard<SpinLock> l(counter_map_lock_);
+    CounterMap::iterator j = counter_map_.begin();
+    const string* prev_name = NULL;
     for (int i = 0; i < node.counters.size(); ++i) {
       const TCounter& tcounter = node.counters[i];
-      CounterMap::iterator j = counter_map_.find(tcounter.name);
-      if (j == counter_map_.end()) {
-        counter_map_[tcounter.name] =
-          pool_->Add(new Counter(tcounter.unit, tcounter.value));
+      if (prev_name != NULL && tcounter.name < *prev_name) {
+        j = counter_map_.lower_bound(tcounter.name);
+      } else {
+        while (j != counter_map_.end() && j->first < tcounter.name) ++j;
+      }
+      prev_name = &tcounter.name;
+      if (j == counter_map_.end() || j->first != tcounter.name) {
+        // Inserting before 'j' with it as hint takes amortized constant time.
+        j = counter_map_.insert(j, make_pair(tcounter.name,
+            pool_->Add(new Counter(tcounter.unit, tcounter.value))));
       } else {
         if (j->second->unit() != tcounter.unit) {
           LOG(ERROR) << "Cannot update counters with the same name ("
@@ -287,12 +310,16 @@ void RuntimeProfile::Update(const vector<TRuntimeProfileNode>& nodes, int* idx)
   ++*idx;
   {
     lock_guard<SpinLock> l(children_lock_);
-    // Update children with matching names; create new ones if they don't match.
+    // Update children with matching names; create new ones if they don't match. The
+    // children of a reported profile usually keep their positions between reports, so
+    // the child at the same position is checked before looking up the name.
     for (int i = 0; i < node.num_children; ++i) {
       const TRuntimeProfileNode& tchild = nodes[*idx];
-      ChildMap::iterator j = child_map_.find(tchild.name);
       RuntimeProfile* child = NULL;
-      if (j != child_map_.end()) {
+      ChildMap::iterator j;
+      if (i < children_.size() && children_[i].first->name_ == tchild.name) {
+        child = children_[i].first;
+      } else if ((j = child_map_.find(tchild.name)) != child_map_.end()) {
         child = j->second;
       } else {
         child = pool_->Add(new RuntimeProfile(pool_, tchild.name));
@@ -390,6 +417,20 @@ void RuntimeProfile::AddChild(RuntimeProfile* child, bool indent, RuntimeProfile
   }
 }
 
+void RuntimeProfile::RemoveChild(RuntimeProfile* child) {
+  DCHECK(child != NULL);
+  lock_guard<SpinLock> l(children_lock_);
+  ChildMap::iterator entry = child_map_.find(child->name_);
+  if (entry == child_map_.end() || entry->second != child) return;
+  child_map_.erase(entry);
+  for (ChildVector::iterator it = children_.begin(); it != children_.end(); ++it) {
+    if (it->first == child) {
+      children_.erase(it);
+      return;
+    }
+  }
+}
+
 void RuntimeProfile::GetChildren(vector<RuntimeProfile*>* children) {
   children->clear();
   lock_guard<SpinLock> l(children_lock_);
@@ -486,6 +527,44 @@ void RuntimeProfile::AddLocalTimeCounter(const DerivedCounterFunction& counter_f
   counter_map_[LOCAL_TIME_COUNTER_NAME] = local_time_counter;
 }
 
+RuntimeProfile::ExecTimeCounters* RuntimeProfile::AddExecTimeCounters(
+    bool hw_counters) {
+  ExecTimeCounters* counters = pool_->Add(new ExecTimeCounters());
+  counters->profile_ = this;
+  counters->cpu_time_ = AddCounter("CpuTime", TUnit::TIME_NS);
+  if (hw_counters) {
+    for (int i = 0; i < ThreadHwCounters::NUM_EVENTS; ++i) {
+      counters->hw_counters_[i] =
+          AddCounter(ThreadHwCounters::EVENT_NAMES[i], TUnit::UNIT);
+    }
+  }
+  return counters;
+}
+
+__thread ExecTimeMeasurement* ExecTimeMeasurement::current_ = NULL;
+
+void ExecTimeMeasurement::StartHwMeasurement() {
+  ThreadHwCounters* hw_counters = ThreadHwCounters::GetForCurrentThread();
+  if (hw_counters == NULL || !hw_counters->Read(start_hw_counts_)) return;
+  thread_hw_counters_ = hw_counters;
+  for (int i = 0; i < ThreadHwCounters::NUM_EVENTS; ++i) nested_hw_counts_[i] = 0;
+}
+
+void ExecTimeMeasurement::StopHwMeasurement() {
+  int64_t counts[ThreadHwCounters::NUM_EVENTS];
+  if (!thread_hw_counters_->Read(counts)) return;
+  for (int i = 0; i < ThreadHwCounters::NUM_EVENTS; ++i) {
+    int64_t count = counts[i] - start_hw_counts_[i];
+    counters_->hw_counters_[i]->Add(max<int64_t>(count - nested_hw_counts_[i], 0));
+    if (parent_ != NULL && parent_->thread_hw_counters_ != NULL) {
+      parent_->nested_hw_counts_[i] += count;
+    }
+  }
+}
+
+const char* ScopedWaitTimer::WAIT_TIMER_NAMES[] = {
+    "IoWaitTime", "NetworkWaitTime", "SpillWaitTime"};
+
 RuntimeProfile::Counter* RuntimeProfile::GetCounter(const string& name) {
   lock_guard<SpinLock> l(counter_map_lock_);
   if (counter_map_.find(name) != counter_map_.end()) {
@@ -634,30 +713,167 @@ string RuntimeProfile::SerializeToArchiveString() const {
 }
 
 void RuntimeProfile::SerializeToArchiveString(stringstream* out) const {
+  vector<uint8_t> compressed_buffer;
+  int64_t serialized_len;
+  if (!SerializeToArchive(&compressed_buffer, &serialized_len).ok()) return;
+  Base64Encode(compressed_buffer, out);
+}
+
+Status RuntimeProfile::SerializeToArchive(vector<uint8_t>* out,
+    int64_t* serialized_len) const {
   TRuntimeProfileTree thrift_object;
   const_cast<RuntimeProfile*>(this)->ToThrift(&thrift_object);
   ThriftSerializer serializer(true);
   vector<uint8_t> serialized_buffer;
-  Status status = serializer.Serialize(&thrift_object, &serialized_buffer);
-  if (!status.ok()) return;
+  RETURN_IF_ERROR(serializer.Serialize(&thrift_object, &serialized_buffer));
+  *serialized_len = serialized_buffer.size();
 
   // Compress the serialized thrift string.  This uses string keys and is very
   // easy to compress.
   scoped_ptr<Codec> compressor;
-  status = Codec::CreateCompressor(NULL, false, THdfsCompression::DEFAULT, &compressor);
+  Status status =
+      Codec::CreateCompressor(NULL, false, THdfsCompression::DEFAULT, &compressor);
   DCHECK(status.ok()) << status.GetDetail();
-  if (!status.ok()) return;
+  RETURN_IF_ERROR(status);
 
-  vector<uint8_t> compressed_buffer;
-  compressed_buffer.resize(compressor->MaxOutputLen(serialized_buffer.size()));
-  int64_t result_len = compressed_buffer.size();
-  uint8_t* compressed_buffer_ptr = &compressed_buffer[0];
-  compressor->ProcessBlock(true, serialized_buffer.size(), &serialized_buffer[0],
-      &result_len, &compressed_buffer_ptr);
-  compressed_buffer.resize(result_len);
-
-  Base64Encode(compressed_buffer, out);
+  out->resize(compressor->MaxOutputLen(serialized_buffer.size()));
+  int64_t result_len = out->size();
+  uint8_t* compressed_buffer_ptr = &(*out)[0];
+  status = compressor->ProcessBlock(true, serialized_buffer.size(),
+      &serialized_buffer[0], &result_len, &compressed_buffer_ptr);
   compressor->Close();
+  RETURN_IF_ERROR(status);
+  out->resize(result_len);
+  return Status::OK();
+}
+
+Status RuntimeProfile::CreateFromArchive(ObjectPool* pool, const uint8_t* data,
+    int64_t len, int64_t serialized_len, RuntimeProfile** profile) {
+  scoped_ptr<Codec> decompressor;
+  RETURN_IF_ERROR(
+      Codec::CreateDecompressor(NULL, false, THdfsCompression::DEFAULT, &decompressor));
+  vector<uint8_t> serialized_buffer(serialized_len);
+  int64_t result_len = serialized_len;
+  uint8_t* serialized_buffer_ptr = serialized_buffer.data();
+  Status status = decompressor->ProcessBlock(true, len, data, &result_len,
+      &serialized_buffer_ptr);
+  decompressor->Close();
+  RETURN_IF_ERROR(status);
+  if (result_len != serialized_len) {
+    return Status(Substitute("Archived profile has $0 bytes, expected $1", result_len,
+        serialized_len));
+  }
+
+  TRuntimeProfileTree thrift_object;
+  uint32_t thrift_len = serialized_len;
+  RETURN_IF_ERROR(DeserializeThriftMsg(serialized_buffer.data(), &thrift_len, true,
+      &thrift_object));
+  *profile = CreateFromThrift(pool, thrift_object);
+  if (*profile == NULL) return Status("Archived profile is empty");
+  return Status::OK();
+}
+
+// Sets 'paths' to the path of every node of the preorder 'nodes', i.e. the names of the
+// node and its ancestors, joined by '/'.
+static void GetNodePaths(const vector<TRuntimeProfileNode>& nodes,
+    vector<string>* paths) {
+  paths->resize(nodes.size());
+  // The paths of the ancestors of the current node and their number of children that
+  // have not been visited yet.
+  vector<pair<string, int> > ancestors;
+  for (int i = 0; i < nodes.size(); ++i) {
+    while (!ancestors.empty() && ancestors.back().second == 0) ancestors.pop_back();
+    if (ancestors.empty()) {
+      (*paths)[i] = nodes[i].name;
+    } else {
+      (*paths)[i] = ancestors.back().first + "/" + nodes[i].name;
+      --ancestors.back().second;
+    }
+    ancestors.push_back(make_pair((*paths)[i], nodes[i].num_children));
+  }
+}
+
+void RuntimeProfile::ComputeDelta(const TRuntimeProfileTree& prev,
+    TRuntimeProfileTree* tree) {
+  // The node of 'prev' that matches each node of 'tree', or NULL. If the tree structure
+  // didn't change, which is the common case between two reports, the nodes are matched
+  // up by their positions without building the paths.
+  vector<const TRuntimeProfileNode*> prev_nodes(tree->nodes.size());
+  bool same_structure = prev.nodes.size() == tree->nodes.size();
+  for (int i = 0; same_structure && i < prev.nodes.size(); ++i) {
+    same_structure = prev.nodes[i].name == tree->nodes[i].name
+        && prev.nodes[i].num_children == tree->nodes[i].num_children;
+    prev_nodes[i] = &prev.nodes[i];
+  }
+  if (!same_structure) {
+    vector<string> prev_paths;
+    vector<string> paths;
+    GetNodePaths(prev.nodes, &prev_paths);
+    GetNodePaths(tree->nodes, &paths);
+    unordered_map<string, const TRuntimeProfileNode*> prev_nodes_by_path;
+    for (int i = 0; i < prev.nodes.size(); ++i) {
+      prev_nodes_by_path[prev_paths[i]] = &prev.nodes[i];
+    }
+    for (int i = 0; i < tree->nodes.size(); ++i) {
+      unordered_map<string, const TRuntimeProfileNode*>::const_iterator it =
+          prev_nodes_by_path.find(paths[i]);
+      prev_nodes[i] = it == prev_nodes_by_path.end() ? NULL : it->second;
+    }
+  }
+
+  for (int i = 0; i < tree->nodes.size(); ++i) {
+    if (prev_nodes[i] == NULL) continue;
+    const TRuntimeProfileNode& prev_node = *prev_nodes[i];
+    TRuntimeProfileNode* node = &tree->nodes[i];
+
+    // Both lists of counters are sorted by name, since ToThrift() serializes them from
+    // a map.
+    vector<TCounter> counters;
+    vector<TCounter>::const_iterator prev_counter = prev_node.counters.begin();
+    for (const TCounter& counter: node->counters) {
+      while (prev_counter != prev_node.counters.end()
+          && prev_counter->name < counter.name) {
+        ++prev_counter;
+      }
+      if (prev_counter != prev_node.counters.end() && *prev_counter == counter) continue;
+      counters.push_back(counter);
+    }
+    node->counters.swap(counters);
+
+    // Update() merges the child counter sets, so they only need to be sent when they
+    // change.
+    if (node->child_counters_map == prev_node.child_counters_map) {
+      node->child_counters_map.clear();
+    }
+
+    vector<string> display_order;
+    for (const string& key: node->info_strings_display_order) {
+      map<string, string>::const_iterator prev_info = prev_node.info_strings.find(key);
+      if (prev_info != prev_node.info_strings.end()
+          && prev_info->second == node->info_strings[key]) {
+        node->info_strings.erase(key);
+      } else {
+        display_order.push_back(key);
+      }
+    }
+    node->info_strings_display_order.swap(display_order);
+
+    vector<TTimeSeriesCounter> time_series_counters;
+    for (const TTimeSeriesCounter& counter: node->time_series_counters) {
+      if (find(prev_node.time_series_counters.begin(),
+          prev_node.time_series_counters.end(), counter) ==
+          prev_node.time_series_counters.end()) {
+        time_series_counters.push_back(counter);
+      }
+    }
+    node->time_series_counters.swap(time_series_counters);
+
+    if (node->__isset.event_sequences && prev_node.__isset.event_sequences
+        && node->event_sequences == prev_node.event_sequences) {
+      node->event_sequences.clear();
+      node->__isset.event_sequences = false;
+    }
+  }
 }
 
 void RuntimeProfile::ToThrift(TRuntimeProfileTree* tree) const {
@@ -676,19 +892,23 @@ void RuntimeProfile::ToThrift(vector<TRuntimeProfileNode>* nodes) const {
   node.metadata = metadata_;
   node.indent = true;
 
-  CounterMap counter_map;
+  // Counters are never removed from the map, so their names stay valid after the lock
+  // is released. Copying the names and pointers avoids copying the map.
+  vector<pair<const string*, Counter*> > counters;
   {
     lock_guard<SpinLock> l(counter_map_lock_);
-    counter_map = counter_map_;
+    counters.reserve(counter_map_.size());
+    for (const CounterMap::value_type& entry: counter_map_) {
+      counters.push_back(make_pair(&entry.first, entry.second));
+    }
     node.child_counters_map = child_counter_map_;
   }
-  for (map<string, Counter*>::const_iterator iter = counter_map.begin();
-       iter != counter_map.end(); ++iter) {
-    TCounter counter;
-    counter.name = iter->first;
-    counter.value = iter->second->value();
-    counter.unit = iter->second->unit();
-    node.counters.push_back(counter);
+  node.counters.resize(counters.size());
+  for (int i = 0; i < counters.size(); ++i) {
+    TCounter* counter = &node.counters[i];
+    counter->name = *counters[i].first;
+    counter->value = counters[i].second->value();
+    counter->unit = counters[i].second->unit();
   }
 
   {
@@ -16,16 +16,19 @@
 #ifndef IMPALA_UTIL_RUNTIME_PROFILE_H
 #define IMPALA_UTIL_RUNTIME_PROFILE_H
 
+#include <algorithm>
 #include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/unordered_map.hpp>
 #include <iostream>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <time.h>
 
 #include "common/atomic.h"
 #include "common/logging.h"
 #include "common/object-pool.h"
+#include "util/hw-counters.h"
 #include "util/stopwatch.h"
 #include "util/streaming-sampler.h"
 #include "gen-cpp/RuntimeProfile_types.h"
@@ -61,6 +64,13 @@ namespace impala {
   #define SCOPED_CONCURRENT_COUNTER(c) \
     ScopedStopWatch<RuntimeProfile::ConcurrentTimerCounter> \
       MACRO_CONCAT(SCOPED_CONCURRENT_COUNTER, __COUNTER__)(c)
+  #define ADD_EXEC_TIME_COUNTERS(profile, hw_counters) \
+    (profile)->AddExecTimeCounters(hw_counters)
+  #define SCOPED_EXEC_TIME_MEASUREMENT(c) \
+    ExecTimeMeasurement MACRO_CONCAT(SCOPED_EXEC_TIME_MEASUREMENT, __COUNTER__)(c)
+  #define SCOPED_WAIT_TIMER(wait_type) \
+    ScopedWaitTimer \
+      MACRO_CONCAT(SCOPED_WAIT_TIMER, __COUNTER__)(ScopedWaitTimer::wait_type)
 #else
   #define ADD_COUNTER(profile, name, unit) NULL
   #define ADD_TIME_SERIES_COUNTER(profile, name, src_counter) NULL
@@ -73,6 +83,9 @@ namespace impala {
   #define ADD_THREAD_COUNTERS(profile, prefix) NULL
   #define SCOPED_THREAD_COUNTER_MEASUREMENT(c)
   #define SCOPED_CONCURRENT_COUNTER(c)
+  #define ADD_EXEC_TIME_COUNTERS(profile, hw_counters) NULL
+  #define SCOPED_EXEC_TIME_MEASUREMENT(c)
+  #define SCOPED_WAIT_TIMER(wait_type)
 #endif
 
 class ObjectPool;
@@ -283,6 +296,32 @@ class RuntimeProfile {
     Counter* involuntary_context_switches_;
   };
 
+  /// The CPU time that the code of an exec node used, and the time that it waited, by
+  /// the cause of the wait. Updated by ExecTimeMeasurement and ScopedWaitTimer.
+  class ExecTimeCounters {
+   public:
+    ExecTimeCounters() : profile_(NULL), cpu_time_(NULL) {
+      for (int i = 0; i < ThreadHwCounters::NUM_EVENTS; ++i) hw_counters_[i] = NULL;
+    }
+
+    RuntimeProfile* profile() const { return profile_; }
+
+   private:
+    friend class ExecTimeMeasurement;
+    friend class ScopedWaitTimer;
+    friend class RuntimeProfile;
+
+    /// The profile that the wait timers are added to once the node first waits.
+    RuntimeProfile* profile_;
+
+    /// CPU time of all threads, excluding the time of nested measurements.
+    Counter* cpu_time_;
+
+    /// The hardware counters of all threads, by ThreadHwCounters::Event, excluding the
+    /// counts of nested measurements. NULL if they are not collected.
+    Counter* hw_counters_[ThreadHwCounters::NUM_EVENTS];
+  };
+
   /// An EventSequence captures a sequence of events (each added by
   /// calling MarkEvent). Each event has a text label, and a time
   /// (measured relative to the moment Start() was called as t=0). It is
@@ -437,6 +476,9 @@ class RuntimeProfile {
   void AddChild(RuntimeProfile* child,
       bool indent = true, RuntimeProfile* location = NULL);
 
+  /// Removes 'child' if it was added with AddChild(). Does not free it.
+  void RemoveChild(RuntimeProfile* child);
+
   /// Sorts all children according to a custom comparator. Does not
   /// invalidate pointers to profiles.
   template <class Compare>
@@ -489,6 +531,12 @@ class RuntimeProfile {
   /// that the caller can update.  The counter is owned by the RuntimeProfile object.
   ThreadCounters* AddThreadCounters(const std::string& prefix);
 
+  /// Adds the "CpuTime" counter of an exec node, and the counters of
+  /// ThreadHwCounters::EVENT_NAMES if 'hw_counters' is true. Returns an
+  /// ExecTimeCounters object that ExecTimeMeasurement updates. The counters are owned
+  /// by the RuntimeProfile object.
+  ExecTimeCounters* AddExecTimeCounters(bool hw_counters);
+
   // Add a derived counter to capture the local time. This function can be called at most
   // once.
   void AddLocalTimeCounter(const DerivedCounterFunction& counter_fn);
@@ -520,8 +568,8 @@ class RuntimeProfile {
   const std::string* GetInfoString(const std::string& key) const;
 
   /// Returns the counter for the total elapsed time.
-  Counter* total_time_counter() { return counter_map_[TOTAL_TIME_COUNTER_NAME]; }
-  Counter* inactive_timer() { return counter_map_[INACTIVE_TIME_COUNTER_NAME]; }
+  Counter* total_time_counter() { return total_time_counter_; }
+  Counter* inactive_timer() { return inactive_timer_counter_; }
   int64_t local_time() { return local_time_ns_; }
 
   /// Prints the counters in a name: value format.
@@ -533,6 +581,14 @@ class RuntimeProfile {
   void ToThrift(TRuntimeProfileTree* tree) const;
   void ToThrift(std::vector<TRuntimeProfileNode>* nodes) const;
 
+  /// Removes the counters, info strings, time series counters and event sequences of
+  /// 'tree' that are unchanged from 'prev', an earlier serialization of the same
+  /// profile. Nodes are matched up by their path of names, and all nodes are kept so
+  /// that the tree structure is preserved. Applying the result with Update() to a
+  /// profile that was updated with 'prev' gives the same counters as applying the
+  /// full 'tree'.
+  static void ComputeDelta(const TRuntimeProfileTree& prev, TRuntimeProfileTree* tree);
+
   /// Serializes the runtime profile to a string.  This first serializes the
   /// object using thrift compact binary format, then gzip compresses it and
   /// finally encodes it as base64.  This is not a lightweight operation and
@@ -540,6 +596,16 @@ class RuntimeProfile {
   std::string SerializeToArchiveString() const;
   void SerializeToArchiveString(std::stringstream* out) const;
 
+  /// Serializes the profile like SerializeToArchiveString() into 'out', without the
+  /// base64 encoding. Sets 'serialized_len' to the length of the thrift serialization
+  /// before the compression, which CreateFromArchive() needs.
+  Status SerializeToArchive(std::vector<uint8_t>* out, int64_t* serialized_len) const;
+
+  /// Deserializes a profile serialized by SerializeToArchive(). The profiles are
+  /// allocated from the pool.
+  static Status CreateFromArchive(ObjectPool* pool, const uint8_t* data, int64_t len,
+      int64_t serialized_len, RuntimeProfile** profile);
+
   /// Divides all counters by n
   void Divide(int n);
 
@@ -683,6 +749,11 @@ class RuntimeProfile {
 
   Counter counter_total_time_;
 
+  /// The TotalTime and InactiveTotalTime counters of 'counter_map_', which are looked up
+  /// often enough to be kept outside of the map. Set by the constructor.
+  Counter* total_time_counter_;
+  Counter* inactive_timer_counter_;
+
   /// Total time spent waiting (on non-children) that should not be counted when
   /// computing local_time_percent_. This is updated for example in the exchange
   /// node when waiting on the sender from another fragment.
@@ -881,6 +952,115 @@ class ThreadCounterMeasurement {
   RuntimeProfile::ThreadCounters* counters_;
 };
 
+/// Adds the CPU time that the calling thread spends in the scope of this object to
+/// the "CpuTime" counter of an exec node, excluding the CPU time of the measurements
+/// nested within the scope, e.g. of the node's children. Waits within the scope that
+/// are timed with ScopedWaitTimer are attributed to the node.
+/// If the counters include hardware counters, the counts of the thread's
+/// ThreadHwCounters are attributed the same way.
+/// Measurements of a thread are kept in a thread-local stack, so they must be strictly
+/// nested.
+class ExecTimeMeasurement {
+ public:
+  /// Does nothing if 'counters' is NULL.
+  ExecTimeMeasurement(RuntimeProfile::ExecTimeCounters* counters)
+    : counters_(counters), parent_(current_), start_cpu_time_(0), nested_cpu_time_(0),
+      thread_hw_counters_(NULL) {
+    if (counters_ == NULL) return;
+    current_ = this;
+    if (counters_->hw_counters_[0] != NULL) StartHwMeasurement();
+    start_cpu_time_ = ThreadCpuTime();
+  }
+
+  ~ExecTimeMeasurement() {
+    if (counters_ == NULL) return;
+    if (thread_hw_counters_ != NULL) StopHwMeasurement();
+    int64_t cpu_time = ThreadCpuTime() - start_cpu_time_;
+    counters_->cpu_time_->Add(std::max<int64_t>(cpu_time - nested_cpu_time_, 0));
+    if (parent_ != NULL) parent_->nested_cpu_time_ += cpu_time;
+    current_ = parent_;
+  }
+
+  /// Returns the counters of the innermost measurement of the calling thread, or NULL.
+  static RuntimeProfile::ExecTimeCounters* current_counters() {
+    return current_ == NULL ? NULL : current_->counters_;
+  }
+
+ private:
+  /// Disable copy constructor and assignment
+  ExecTimeMeasurement(const ExecTimeMeasurement& timer);
+  ExecTimeMeasurement& operator=(const ExecTimeMeasurement& timer);
+
+  /// Returns the CPU time that the calling thread used so far, in ns.
+  static int64_t ThreadCpuTime() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000L * 1000L * 1000L + ts.tv_nsec;
+  }
+
+  /// Reads the initial counts of the thread's hardware counters, if it has any.
+  void StartHwMeasurement();
+
+  /// Adds the counts since StartHwMeasurement() to the counters, excluding the counts of
+  /// nested measurements.
+  void StopHwMeasurement();
+
+  /// The innermost measurement of this thread.
+  static __thread ExecTimeMeasurement* current_;
+
+  RuntimeProfile::ExecTimeCounters* counters_;
+  ExecTimeMeasurement* parent_;
+  int64_t start_cpu_time_;
+
+  /// CPU time of the measurements nested in this one.
+  int64_t nested_cpu_time_;
+
+  /// The hardware counters of this thread, if they are measured. If set, the arrays
+  /// below contain the initial counts and the counts of the nested measurements.
+  ThreadHwCounters* thread_hw_counters_;
+  int64_t start_hw_counts_[ThreadHwCounters::NUM_EVENTS];
+  int64_t nested_hw_counts_[ThreadHwCounters::NUM_EVENTS];
+};
+
+/// Adds the wall-clock time of its scope to a wait timer of the exec node whose
+/// ExecTimeMeasurement is the innermost one of the calling thread, if any. The timer is
+/// named after the cause of the wait ('wait_type') and added to the node's profile
+/// when the node first waits for that cause.
+class ScopedWaitTimer {
+ public:
+  enum WaitType {
+    /// Waiting for reads of scan ranges.
+    IO_WAIT,
+    /// Waiting for row batches from other fragment instances.
+    NETWORK_WAIT,
+    /// Waiting for spilled blocks to be read or written.
+    SPILL_WAIT,
+  };
+
+  ScopedWaitTimer(WaitType wait_type)
+    : wait_type_(wait_type), counters_(ExecTimeMeasurement::current_counters()) {
+    if (counters_ != NULL) sw_.Start();
+  }
+
+  ~ScopedWaitTimer() {
+    if (counters_ == NULL) return;
+    counters_->profile_->AddCounter(WAIT_TIMER_NAMES[wait_type_], TUnit::TIME_NS)->Add(
+        sw_.ElapsedTime());
+  }
+
+ private:
+  /// Disable copy constructor and assignment
+  ScopedWaitTimer(const ScopedWaitTimer& timer);
+  ScopedWaitTimer& operator=(const ScopedWaitTimer& timer);
+
+  /// The names of the timers, by WaitType.
+  static const char* WAIT_TIMER_NAMES[];
+
+  WaitType wait_type_;
+  RuntimeProfile::ExecTimeCounters* counters_;
+  MonotonicStopWatch sw_;
+};
+
 }
 
 #endif
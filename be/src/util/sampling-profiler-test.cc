@@ -0,0 +1,80 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/sampling-profiler.h"
+
+#include <time.h>
+#include <gtest/gtest.h>
+
+#include "common/init.h"
+#include "common/object-pool.h"
+#include "util/debug-util.h"
+#include "util/runtime-profile.h"
+
+#include "common/names.h"
+
+DECLARE_int32(sampling_profiler_hz);
+
+namespace impala {
+
+// Uses 'ms' milliseconds of the calling thread's CPU time.
+static void BusyLoop(int64_t ms) {
+  timespec start, now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+  do {
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  } while ((now.tv_sec - start.tv_sec) * 1000L + (now.tv_nsec - start.tv_nsec) / 1000000L
+      < ms);
+}
+
+TEST(SamplingProfilerTest, TagsSamples) {
+  ObjectPool pool;
+  RuntimeProfile profile(&pool, "Node");
+  profile.set_metadata(7);
+  RuntimeProfile::ExecTimeCounters* counters = profile.AddExecTimeCounters(false);
+  TUniqueId query_id;
+  query_id.__set_hi(1);
+  query_id.__set_lo(2);
+  {
+    SamplingProfiler::ScopedQueryTag query_tag(query_id);
+    SCOPED_EXEC_TIME_MEASUREMENT(counters);
+    BusyLoop(500);
+  }
+  SamplingProfiler::ProcessSamples();
+
+  stringstream query_stacks;
+  SamplingProfiler::GetCollapsedStacks(&query_id, &query_stacks);
+  EXPECT_EQ(query_stacks.str().find("exec node 7;"), 0) << query_stacks.str();
+
+  stringstream all_stacks;
+  SamplingProfiler::GetCollapsedStacks(NULL, &all_stacks);
+  EXPECT_NE(all_stacks.str().find("query " + PrintId(query_id) + ";exec node 7;"),
+      string::npos) << all_stacks.str();
+
+  // Queries without samples have no stacks.
+  TUniqueId other_query_id;
+  stringstream other_stacks;
+  SamplingProfiler::GetCollapsedStacks(&other_query_id, &other_stacks);
+  EXPECT_TRUE(other_stacks.str().empty());
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  FLAGS_sampling_profiler_hz = 1000;
+  impala::InitCommonRuntime(argc, argv, true, impala::TestInfo::BE_TEST);
+  ABORT_IF_ERROR(impala::SamplingProfiler::Init(NULL));
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,304 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/sampling-profiler.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <gutil/strings/substitute.h>
+
+#include "common/atomic.h"
+#include "util/debug-util.h"
+#include "util/error-util.h"
+#include "util/runtime-profile.h"
+#include "util/symbols-util.h"
+#include "util/thread.h"
+#include "util/time.h"
+#include "util/webserver.h"
+
+#include "common/names.h"
+
+using boost::unordered_map;
+using namespace impala;
+using namespace rapidjson;
+using namespace strings;
+
+DEFINE_int32(sampling_profiler_hz, 0, "(Advanced) Number of stack samples per second "
+    "of CPU time of the process that the sampling profiler takes, tagged with the "
+    "query and exec node that the sampled thread worked for. The samples are shown on "
+    "the /sampling_profile page. Low rates such as 19Hz keep the overhead of the "
+    "profiler low enough to run it continuously. If 0, the profiler is disabled.");
+DEFINE_int32(sampling_profiler_max_queries, 100, "(Advanced) Number of the most "
+    "recently sampled queries whose samples the sampling profiler keeps.");
+
+namespace {
+
+// The maximum number of frames of a sample.
+const int MAX_FRAMES = 64;
+
+// The frames of the signal handler and of the signal trampoline.
+const int NUM_HANDLER_FRAMES = 2;
+
+// The number of samples that can be taken before the background thread drains them.
+const int NUM_SAMPLE_SLOTS = 4096;
+
+// The maximum number of different stacks per query. Samples with other stacks are
+// counted as OTHER_STACKS.
+const int MAX_STACKS_PER_QUERY = 10000;
+const char* OTHER_STACKS = "[other stacks]";
+
+// How often the background thread drains the samples.
+const int DRAIN_INTERVAL_MS = 100;
+
+// The states of a sample slot. The signal handler fills EMPTY slots, the background
+// thread drains FULL ones.
+enum SlotState {
+  EMPTY,
+  WRITING,
+  FULL,
+  READING,
+};
+
+struct Sample {
+  AtomicInt32 state;
+  int64_t query_hi;
+  int64_t query_lo;
+  int32_t node_id;
+  int num_frames;
+  void* frames[MAX_FRAMES];
+};
+
+Sample samples[NUM_SAMPLE_SLOTS];
+AtomicInt64 next_slot;
+AtomicInt64 num_dropped_samples;
+
+// The query of the calling thread. Both are 0 if the thread doesn't work for a query.
+__thread int64_t query_tag_hi = 0;
+__thread int64_t query_tag_lo = 0;
+
+// The samples of a query, by collapsed stack.
+struct QueryStacks {
+  map<string, int64_t> counts;
+  int64_t last_sample_ms;
+};
+
+typedef map<pair<int64_t, int64_t>, QueryStacks> QueryStacksMap;
+
+// Protects query_stacks and symbols.
+mutex stacks_lock;
+QueryStacksMap query_stacks;
+unordered_map<void*, string> symbols;
+
+// Only writes to the slot and uses async-signal-safe functions. backtrace() was called
+// once by Init(), so it doesn't load libgcc here.
+void HandleSample(int sig, siginfo_t* info, void* context) {
+  int saved_errno = errno;
+  Sample* sample = &samples[(next_slot.Add(1) - 1) % NUM_SAMPLE_SLOTS];
+  if (!sample->state.CompareAndSwap(EMPTY, WRITING)) {
+    num_dropped_samples.Add(1);
+    errno = saved_errno;
+    return;
+  }
+  sample->query_hi = query_tag_hi;
+  sample->query_lo = query_tag_lo;
+  RuntimeProfile::ExecTimeCounters* counters = ExecTimeMeasurement::current_counters();
+  sample->node_id = counters == NULL ? -1 : counters->profile()->metadata();
+  sample->num_frames = backtrace(sample->frames, MAX_FRAMES);
+  sample->state.Store(FULL);
+  errno = saved_errno;
+}
+
+// Returns the name of the function that contains 'pc'. Must be called with
+// stacks_lock held.
+const string& Symbolize(void* pc) {
+  unordered_map<void*, string>::iterator it = symbols.find(pc);
+  if (it != symbols.end()) return it->second;
+  string symbol;
+  Dl_info info;
+  if (dladdr(pc, &info) != 0 && info.dli_sname != NULL) {
+    symbol = SymbolsUtil::DemangleNoArgs(info.dli_sname);
+  } else {
+    symbol = Substitute("$0", pc);
+  }
+  // Frames are separated by ';' in collapsed stacks.
+  replace(symbol.begin(), symbol.end(), ';', ':');
+  return symbols[pc] = symbol;
+}
+
+// Adds 'sample' to the stacks of its query. Must be called with stacks_lock held.
+void AddSample(const Sample& sample) {
+  pair<int64_t, int64_t> query_id(sample.query_hi, sample.query_lo);
+  QueryStacksMap::iterator it = query_stacks.find(query_id);
+  if (it == query_stacks.end()) {
+    if (query_stacks.size() > FLAGS_sampling_profiler_max_queries) {
+      // Evict the query that was sampled least recently.
+      QueryStacksMap::iterator oldest = query_stacks.begin();
+      for (QueryStacksMap::iterator q = query_stacks.begin(); q != query_stacks.end();
+           ++q) {
+        if (q->second.last_sample_ms < oldest->second.last_sample_ms) oldest = q;
+      }
+      query_stacks.erase(oldest);
+    }
+    it = query_stacks.insert(make_pair(query_id, QueryStacks())).first;
+  }
+  QueryStacks* stacks = &it->second;
+  stacks->last_sample_ms = MonotonicMillis();
+
+  // Collapsed stacks start with the outermost frame.
+  string stack = sample.node_id == -1 ? "no exec node" :
+      Substitute("exec node $0", sample.node_id);
+  for (int i = sample.num_frames - 1; i >= NUM_HANDLER_FRAMES; --i) {
+    stack += ";";
+    stack += Symbolize(sample.frames[i]);
+  }
+  if (stacks->counts.size() >= MAX_STACKS_PER_QUERY &&
+      stacks->counts.find(stack) == stacks->counts.end()) {
+    stack = OTHER_STACKS;
+  }
+  ++stacks->counts[stack];
+}
+
+void DrainSamples() {
+  while (true) {
+    SleepForMs(DRAIN_INTERVAL_MS);
+    SamplingProfiler::ProcessSamples();
+  }
+}
+
+void SamplingProfileUrlCallback(const Webserver::ArgumentMap& args,
+    Document* document) {
+  stringstream ss;
+  Webserver::ArgumentMap::const_iterator it = args.find("query_id");
+  TUniqueId query_id;
+  if (it != args.end() && !ParseId(it->second, &query_id)) {
+    ss << "Could not parse 'query_id' argument: " << it->second;
+  } else {
+    SamplingProfiler::ProcessSamples();
+    SamplingProfiler::GetCollapsedStacks(it == args.end() ? NULL : &query_id, &ss);
+  }
+  document->AddMember(Webserver::ENABLE_RAW_JSON_KEY, true, document->GetAllocator());
+  Value contents(ss.str().c_str(), document->GetAllocator());
+  document->AddMember("contents", contents, document->GetAllocator());
+}
+
+}
+
+Status SamplingProfiler::Init(Webserver* webserver) {
+  if (webserver != NULL) {
+    webserver->RegisterUrlCallback("/sampling_profile", "raw_text.tmpl",
+        SamplingProfileUrlCallback, false);
+  }
+  // Several impalads may run in the same process, e.g. in tests, but they share the
+  // profiler.
+  static bool started = false;
+  if (started || FLAGS_sampling_profiler_hz <= 0) return Status::OK();
+  started = true;
+
+  // Loads libgcc, which is not safe in the signal handler.
+  void* frame;
+  backtrace(&frame, 1);
+
+  // A real-time signal, since the on-demand profiles of /pprof/profile use SIGPROF.
+  int signal = SIGRTMIN;
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = &HandleSample;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(signal, &action, NULL) != 0) {
+    return Status(Substitute("Could not install the sampling profiler's signal "
+        "handler: $0", GetStrErrMsg()));
+  }
+
+  sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_SIGNAL;
+  event.sigev_signo = signal;
+  timer_t timer;
+  if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &timer) != 0) {
+    return Status(Substitute("Could not create the sampling profiler's timer: $0",
+        GetStrErrMsg()));
+  }
+  int64_t interval_ns = 1000L * 1000L * 1000L / FLAGS_sampling_profiler_hz;
+  itimerspec spec;
+  spec.it_interval.tv_sec = interval_ns / (1000L * 1000L * 1000L);
+  spec.it_interval.tv_nsec = interval_ns % (1000L * 1000L * 1000L);
+  spec.it_value = spec.it_interval;
+
+  // The thread runs for the lifetime of the process.
+  new Thread("sampling-profiler", "drain-samples", &DrainSamples);
+  if (timer_settime(timer, 0, &spec, NULL) != 0) {
+    return Status(Substitute("Could not start the sampling profiler's timer: $0",
+        GetStrErrMsg()));
+  }
+  LOG(INFO) << "Sampling profiler started at " << FLAGS_sampling_profiler_hz << "Hz";
+  return Status::OK();
+}
+
+SamplingProfiler::ScopedQueryTag::ScopedQueryTag(const TUniqueId& query_id)
+  : prev_hi_(query_tag_hi),
+    prev_lo_(query_tag_lo) {
+  query_tag_hi = query_id.hi;
+  query_tag_lo = query_id.lo;
+}
+
+SamplingProfiler::ScopedQueryTag::~ScopedQueryTag() {
+  query_tag_hi = prev_hi_;
+  query_tag_lo = prev_lo_;
+}
+
+void SamplingProfiler::ProcessSamples() {
+  lock_guard<mutex> l(stacks_lock);
+  for (int i = 0; i < NUM_SAMPLE_SLOTS; ++i) {
+    Sample* sample = &samples[i];
+    if (!sample->state.CompareAndSwap(FULL, READING)) continue;
+    AddSample(*sample);
+    sample->state.Store(EMPTY);
+  }
+}
+
+void SamplingProfiler::GetCollapsedStacks(const TUniqueId* query_id, stringstream* out) {
+  lock_guard<mutex> l(stacks_lock);
+  for (const QueryStacksMap::value_type& entry: query_stacks) {
+    string prefix;
+    if (query_id != NULL) {
+      if (entry.first.first != query_id->hi || entry.first.second != query_id->lo) {
+        continue;
+      }
+    } else if (entry.first.first == 0 && entry.first.second == 0) {
+      prefix = "no query;";
+    } else {
+      TUniqueId id;
+      id.__set_hi(entry.first.first);
+      id.__set_lo(entry.first.second);
+      prefix = Substitute("query $0;", PrintId(id));
+    }
+    for (const auto& stack: entry.second.counts) {
+      (*out) << prefix << stack.first << " " << stack.second << "\n";
+    }
+  }
+  int64_t num_dropped = num_dropped_samples.Load();
+  if (query_id == NULL && num_dropped > 0) {
+    (*out) << "[dropped samples] " << num_dropped << "\n";
+  }
+}
@@ -0,0 +1,77 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_UTIL_SAMPLING_PROFILER_H
+#define IMPALA_UTIL_SAMPLING_PROFILER_H
+
+#include <sstream>
+#include <boost/cstdint.hpp>
+
+#include "common/status.h"
+#include "gen-cpp/Types_types.h"  // for TUniqueId
+
+namespace impala {
+
+class Webserver;
+
+/// Always-on sampling profiler, enabled by --sampling_profiler_hz. A timer on the CPU
+/// clock of the process signals the thread that is running when it expires, so the
+/// stacks of the threads are sampled in proportion to the CPU time that they use.
+/// Each sample is tagged with the query that the thread works for (see ScopedQueryTag)
+/// and the exec node whose ExecTimeMeasurement is the thread's innermost one.
+///
+/// The signal handler only copies the stack into a fixed-size buffer, which a
+/// background thread drains. It symbolizes the samples and aggregates them into the
+/// call stacks of each query, of which the most recently sampled
+/// --sampling_profiler_max_queries are kept. The stacks are exposed on the
+/// /sampling_profile page in the "collapsed" format that flame graph tools such as
+/// flamegraph.pl render, one "frame;...;frame <num samples>" line per stack. The
+/// stacks of a single query start with the exec node, the stacks of all queries with
+/// the query id. The pages of several impalads can be concatenated into the flame
+/// graph of a cluster.
+///
+/// Frames are symbolized with the dynamic symbol table, so functions that are not
+/// exported appear as their address.
+class SamplingProfiler {
+ public:
+  /// Starts sampling if --sampling_profiler_hz is greater than 0 and sampling wasn't
+  /// started yet. Registers the /sampling_profile page if 'webserver' is not NULL. Must
+  /// be called after InitThreading().
+  static Status Init(Webserver* webserver);
+
+  /// Tags the samples of the calling thread with a query for the lifetime of this
+  /// object. Tags may be nested, the previous tag is restored when the object is
+  /// destroyed.
+  class ScopedQueryTag {
+   public:
+    ScopedQueryTag(const TUniqueId& query_id);
+    ~ScopedQueryTag();
+
+   private:
+    int64_t prev_hi_;
+    int64_t prev_lo_;
+  };
+
+  /// Aggregates the samples that the background thread hasn't processed yet. Exposed
+  /// for testing.
+  static void ProcessSamples();
+
+  /// Writes the collapsed stacks of 'query_id' to 'out', or of all queries and threads
+  /// if 'query_id' is NULL.
+  static void GetCollapsedStacks(const TUniqueId* query_id, std::stringstream* out);
+};
+
+}
+
+#endif
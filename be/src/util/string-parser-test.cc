@@ -185,6 +185,24 @@ TEST(StringToInt, InvalidLeadingTrailing) {
   TestIntValue<int8_t>("   ", 0, StringParser::PARSE_FAILURE);
 }
 
+// Integers of eight digits or more are parsed eight digits at a time.
+TEST(StringToInt, LongDigitRuns) {
+  TestIntValue<int32_t>("123456789", 123456789, StringParser::PARSE_SUCCESS);
+  TestIntValue<int32_t>("-098765432", -98765432, StringParser::PARSE_SUCCESS);
+  TestIntValue<int64_t>("1234567890123456", 1234567890123456,
+      StringParser::PARSE_SUCCESS);
+  TestIntValue<int64_t>("-123456789012345678", -123456789012345678LL,
+      StringParser::PARSE_SUCCESS);
+  TestIntValue<int64_t>("000000000000000001", 1, StringParser::PARSE_SUCCESS);
+
+  // A non-digit within the first eight or the next eight characters.
+  TestIntValue<int64_t>("1234567x", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int64_t>("12345678 9", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int64_t>("12345678901234:6", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int32_t>("1234/5678", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int32_t>("12345678\x80", 0, StringParser::PARSE_FAILURE);
+}
+
 TEST(StringToInt, Limit) {
   TestIntValue<int8_t>("127", 127, StringParser::PARSE_SUCCESS);
   TestIntValue<int8_t>("-128", -128, StringParser::PARSE_SUCCESS);
@@ -427,6 +445,36 @@ TEST(StringToFloat, Basic) {
   TestAllFloatVariants("ThisIsANaN", StringParser::PARSE_FAILURE);
 }
 
+// The results must be exactly those of strtod(), also for values that are not exact
+// after accumulating the digits as a double.
+TEST(StringToFloat, Exact) {
+  TestAllFloatVariants("0.1", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("0.3", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("123456.789012", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("9007199254740993", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("9007199254740993.5", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("2.2250738585072011e-308", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("4.9406564584124654e-324", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("1.7976931348623157e308", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("123.456e-5", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("1e22", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("1e23", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("0e999999999", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("1e-999999999", StringParser::PARSE_SUCCESS);
+  TestAllFloatVariants("1E+5", StringParser::PARSE_SUCCESS);
+
+  for (int i = 0; i < 10000; ++i) {
+    string s = lexical_cast<string>(rand() % 100000) + "." +
+        lexical_cast<string>(rand()) + "e" + lexical_cast<string>(rand() % 40 - 20);
+    TestFloatValue<double>(s, StringParser::PARSE_SUCCESS);
+  }
+
+  TestAllFloatVariants(".e5", StringParser::PARSE_FAILURE);
+  TestAllFloatVariants("1e", StringParser::PARSE_FAILURE);
+  TestAllFloatVariants("1e+", StringParser::PARSE_FAILURE);
+  TestAllFloatVariants("1.2.3e5", StringParser::PARSE_FAILURE);
+}
+
 TEST(StringToFloat, InvalidLeadingTrailing) {
   // Test that trailing garbage is not allowed.
   TestFloatValue<double>("123xyz   ", StringParser::PARSE_FAILURE);
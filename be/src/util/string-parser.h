@@ -16,6 +16,8 @@
 #ifndef IMPALA_UTIL_STRING_PARSER_H
 #define IMPALA_UTIL_STRING_PARSER_H
 
+#include <stdio.h>
+#include <string.h>
 #include <limits>
 #include <boost/type_traits.hpp>
 #include "common/compiler-util.h"
@@ -40,12 +42,15 @@ namespace impala {
 /// for that data type.  This is different from hive, which returns NULL for overflow
 /// slots for int types and inf/-inf for float types.
 //
+/// Integers that cannot overflow are parsed eight digits at a time (see
+/// ParseEightDigits()). Floats are parsed exactly: the digits are accumulated into an
+/// integer and scaled by an exact power of ten, which is correctly rounded as long as
+/// both fit into the mantissa of a double. Other floats fall back to strtod().
+//
 /// Things we tried that did not work:
 ///  - lookup table for converting character to digit
 /// Improvements (TODO):
 ///  - Validate input using _sidd_compare_ranges
-///  - Since we know the length, we can parallelize this: i.e. result = 100*s[0] +
-///    10*s[1] + s[2]
 class StringParser {
  public:
   enum ParseResult {
@@ -354,10 +359,12 @@ class StringParser {
   /// This is considerably faster than glibc's implementation (>100x why???)
   /// No special case handling needs to be done for overflows, the floating point spec
   /// already does it and will cap the values to -inf/inf
-  /// To avoid inaccurate conversions this function falls back to strtod for
-  /// scientific notation.
+  /// The digits are accumulated into an integer 'mantissa', so the value is
+  /// mantissa * 10^exponent. If 'mantissa' has at most 53 bits and 10^|exponent| is
+  /// exact in a double, a single multiplication or division rounds correctly (this is
+  /// Clinger's fast path). Otherwise, e.g. for more than 15 - 19 significant digits or
+  /// large exponents, the digits are converted by strtod(), which is also exact.
   /// Return PARSE_FAILURE on leading whitespace. Trailing whitespace is allowed.
-  /// TODO: Investigate using intrinsics to speed up the slow strtod path.
   /// TODO: there are other possible optimizations, see IMPALA-1729
   template <typename T>
   static inline T StringToFloatInternal(const char* s, int len, ParseResult* result) {
@@ -366,17 +373,16 @@ class StringParser {
       return 0;
     }
 
-    // Use double here to not lose precision while accumulating the result
-    double val = 0;
     bool negative = false;
     int i = 0;
-    double divide = 1;
-    bool decimal = false;
-    int64_t remainder = 0;
-    // The number of significant figures we've encountered so far (i.e., digits excluding
-    // leading 0s). This technically shouldn't count trailing 0s either, but for us it
-    // doesn't matter if we count them based on the implementation below.
-    int sig_figs = 0;
+    // The first MAX_MANTISSA_DIGITS significant digits (i.e. excluding leading 0s) and
+    // the number of significant digits that didn't fit.
+    uint64_t mantissa = 0;
+    int num_sig_digits = 0;
+    int num_dropped_digits = 0;
+    int num_digits = 0;
+    int num_frac_digits = 0;
+    int num_dots = 0;
     switch (*s) {
       case '-': negative = true;
       case '+': i = 1;
@@ -384,23 +390,16 @@ class StringParser {
     int first = i;
     for (; i < len; ++i) {
       if (LIKELY(s[i] >= '0' && s[i] <= '9')) {
-        if (s[i] != '0' || sig_figs > 0) ++sig_figs;
-        if (decimal) {
-          // According to the IEEE floating-point spec, a double has up to 15-17
-          // significant decimal digits (see
-          // http://en.wikipedia.org/wiki/Double-precision_floating-point_format). We stop
-          // processing digits after we've already seen at least 18 sig figs to avoid
-          // overflowing 'remainder' (we stop after 18 instead of 17 to get the rounding
-          // right).
-          if (sig_figs <= 18) {
-            remainder = remainder * 10 + s[i] - '0';
-            divide *= 10;
-          }
+        ++num_digits;
+        if (num_dots > 0) ++num_frac_digits;
+        if (LIKELY(num_sig_digits < MAX_MANTISSA_DIGITS)) {
+          mantissa = mantissa * 10 + s[i] - '0';
+          if (mantissa != 0) ++num_sig_digits;
         } else {
-          val = val * 10 + s[i] - '0';
+          ++num_dropped_digits;
         }
       } else if (s[i] == '.') {
-        decimal = true;
+        ++num_dots;
       } else if (s[i] == 'e' || s[i] == 'E') {
         break;
       } else if (s[i] == 'i' || s[i] == 'I') {
@@ -437,27 +436,31 @@ class StringParser {
         break;
       }
     }
+    int digits_end = i;
 
-    val += remainder / divide;
-
+    // The exponent of the digits, i.e. of their value as an integer.
+    int exponent = -num_frac_digits;
     if (i < len && (s[i] == 'e' || s[i] == 'E')) {
-      // Create a C-string from s starting after the optional '-' sign and fall back to
-      // strtod to avoid conversion inaccuracy for scientific notation.
-      // Do not use boost::lexical_cast because it causes codegen to crash for an
-      // unknown reason (exception handling?).
-      char c_str[len - negative + 1];
-      memcpy(c_str, s + negative, len - negative);
-      c_str[len - negative] = '\0';
-      char* s_end;
-      val = strtod(c_str, &s_end);
-      if (s_end != c_str + len - negative) {
-        // skip trailing whitespace
-        int trailing_len = len - negative - (int)(s_end - c_str);
-        if (UNLIKELY(!IsAllWhitespace(s_end, trailing_len))) {
-          *result = PARSE_FAILURE;
-          return val;
-        }
+      // Like strtod(), which used to parse scientific notation, this requires digits
+      // before the exponent and a single dot.
+      int explicit_exponent;
+      if (UNLIKELY(num_digits == 0 || num_dots > 1 ||
+          !ParseExponent(s + i + 1, len - i - 1, &explicit_exponent))) {
+        *result = PARSE_FAILURE;
+        return 0;
       }
+      exponent += explicit_exponent;
+    }
+
+    double val;
+    if (mantissa == 0) {
+      val = 0;
+    } else if (LIKELY(num_dropped_digits == 0 && mantissa <= MAX_EXACT_MANTISSA &&
+        exponent >= -MAX_EXACT_POW10 && exponent <= MAX_EXACT_POW10)) {
+      val = exponent < 0 ? mantissa / ExactPowerOfTen(-exponent) :
+          mantissa * ExactPowerOfTen(exponent);
+    } else {
+      val = DigitsToDouble(s + first, digits_end - first, exponent);
     }
 
     // Determine if it is an overflow case and update the result
@@ -469,6 +472,60 @@ class StringParser {
     return (T)(negative ? -val : val);
   }
 
+  /// The most significant digits that StringToFloatInternal() accumulates, which always
+  /// fit into a uint64_t.
+  static const int MAX_MANTISSA_DIGITS = 19;
+
+  /// The largest mantissa and power of ten that are exact in a double.
+  static const uint64_t MAX_EXACT_MANTISSA = 1ULL << 53;
+  static const int MAX_EXACT_POW10 = 22;
+
+  /// Returns 10^'exp' for 0 <= 'exp' <= MAX_EXACT_POW10.
+  static inline double ExactPowerOfTen(int exp) {
+    static const double POWERS_OF_TEN[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14,
+        1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    DCHECK_GE(exp, 0);
+    DCHECK_LE(exp, MAX_EXACT_POW10);
+    return POWERS_OF_TEN[exp];
+  }
+
+  /// Parses the exponent of a float after the 'e', i.e. an optional sign followed by at
+  /// least one digit, into 'exponent'. Trailing whitespace is allowed. Exponents beyond
+  /// MAX_EXPONENT are capped, which doesn't change the result as they overflow or
+  /// underflow any double. Returns false if 's' is not a valid exponent.
+  static inline bool ParseExponent(const char* s, int len, int* exponent) {
+    static const int MAX_EXPONENT = 100000;
+    bool negative = false;
+    int i = 0;
+    if (len > 0 && (s[0] == '-' || s[0] == '+')) {
+      negative = s[0] == '-';
+      i = 1;
+    }
+    if (i == len || s[i] < '0' || s[i] > '9') return false;
+    int val = 0;
+    for (; i < len && s[i] >= '0' && s[i] <= '9'; ++i) {
+      if (val < MAX_EXPONENT) val = val * 10 + s[i] - '0';
+    }
+    if (!IsAllWhitespace(s + i, len - i)) return false;
+    *exponent = negative ? -val : val;
+    return true;
+  }
+
+  /// Converts the digits in 's', ignoring any dots, times 10^'exponent' with strtod().
+  /// Do not use boost::lexical_cast because it causes codegen to crash for an unknown
+  /// reason (exception handling?).
+  static inline double DigitsToDouble(const char* s, int len, int exponent) {
+    // The digits, 'e', the sign and the digits of 'exponent' and '\0'.
+    char c_str[len + 16];
+    int c_str_len = 0;
+    for (int i = 0; i < len; ++i) {
+      if (s[i] != '.') c_str[c_str_len++] = s[i];
+    }
+    snprintf(c_str + c_str_len, sizeof(c_str) - c_str_len, "e%d", exponent);
+    return strtod(c_str, NULL);
+  }
+
   /// Parses a string for 'true' or 'false', case insensitive.
   /// Return PARSE_FAILURE on leading whitespace. Trailing whitespace is allowed.
   static inline bool StringToBoolInternal(const char* s, int len, ParseResult* result) {
@@ -522,14 +579,28 @@ class StringParser {
       *result = PARSE_SUCCESS;
       return val;
     }
-    // Factor out the first char for error handling speeds up the loop.
-    if (LIKELY(s[0] >= '0' && s[0] <= '9')) {
-      val = s[0] - '0';
-    } else {
-      *result = PARSE_FAILURE;
-      return 0;
+    int i = 0;
+    // Only types that hold more than eight digits can have a field of eight digits
+    // without overflowing.
+    if (sizeof(T) >= sizeof(uint32_t)) {
+      for (; i + 8 <= len; i += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, s + i, sizeof(chunk));
+        if (!AllDigits(chunk)) break;
+        val = val * 100000000ULL + ParseEightDigits(chunk);
+      }
     }
-    for (int i = 1; i < len; ++i) {
+    if (i == 0) {
+      // Factor out the first char for error handling speeds up the loop.
+      if (LIKELY(s[0] >= '0' && s[0] <= '9')) {
+        val = s[0] - '0';
+      } else {
+        *result = PARSE_FAILURE;
+        return 0;
+      }
+      i = 1;
+    }
+    for (; i < len; ++i) {
       if (LIKELY(s[i] >= '0' && s[i] <= '9')) {
         T digit = s[i] - '0';
         val = val * 10 + digit;
@@ -546,6 +617,29 @@ class StringParser {
     return val;
   }
 
+  /// Returns true if the eight bytes of 'chunk' are ASCII digits. After subtracting '0'
+  /// (by the xor, as the digits are 0x30 - 0x39) a digit byte is at most 9, and adding
+  /// 0x76 to any larger byte sets its high bit. Carries out of a byte only happen if
+  /// that byte already failed.
+  static inline bool AllDigits(uint64_t chunk) {
+    uint64_t val = chunk ^ 0x3030303030303030ULL;
+    return (((val + 0x7676767676767676ULL) | val) & 0x8080808080808080ULL) == 0;
+  }
+
+  /// Returns the value of the eight ASCII digits in 'chunk', which was loaded from
+  /// memory, i.e. has the first digit in its lowest byte. The digits are combined
+  /// pairwise, then into groups of four and then of eight, with one multiplication per
+  /// step.
+  static inline uint32_t ParseEightDigits(uint64_t chunk) {
+    chunk -= 0x3030303030303030ULL;
+    // Each even byte is now 10 * digit + the next digit.
+    chunk = (chunk * 10) + (chunk >> 8);
+    // Combines the pairs into 4 digits in each half, then the halves into 8 digits.
+    chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+        (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    return static_cast<uint32_t>(chunk);
+  }
+
   static inline bool IsWhitespace(const char& c) {
     return c == ' ' || UNLIKELY(c == '\t' || c == '\n' || c == '\v' || c == '\f'
         || c == '\r');
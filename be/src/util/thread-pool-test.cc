@@ -21,9 +21,12 @@
 #include "common/init.h"
 #include "common/logging.h"
 #include "util/thread-pool.h"
+#include "util/time.h"
 
 #include "common/names.h"
 
+DECLARE_int32(pooled_threads_max_idle);
+
 namespace impala {
 
 const int NUM_THREADS = 5;
@@ -65,10 +68,89 @@ TEST(ThreadPoolTest, BasicTest) {
   EXPECT_EQ(expected_count, count);
 }
 
+// Waits until 'pool' has 'num_threads' threads. Returns false after about 10s.
+bool WaitForNumThreads(DynamicThreadPool* pool, int num_threads) {
+  for (int i = 0; i < 1000 && pool->num_threads() != num_threads; ++i) SleepForMs(10);
+  return pool->num_threads() == num_threads;
+}
+
+// Waits until 'pool' has 'num_idle_threads' idle threads. Returns false after about 10s.
+bool WaitForNumIdleThreads(DynamicThreadPool* pool, int num_idle_threads) {
+  for (int i = 0; i < 1000 && pool->num_idle_threads() != num_idle_threads; ++i) {
+    SleepForMs(10);
+  }
+  return pool->num_idle_threads() == num_idle_threads;
+}
+
+void Block(Promise<bool>* started, Promise<bool>* release) {
+  started->Set(true);
+  release->Get();
+}
+
+TEST(DynamicThreadPoolTest, ReusesIdleThreads) {
+  DynamicThreadPool pool("thread-pool", "worker", 2, 60 * 1000);
+  Promise<bool> started1;
+  Promise<bool> release;
+  ASSERT_TRUE(pool.Offer(bind(Block, &started1, &release)));
+  started1.Get();
+  EXPECT_EQ(pool.num_threads(), 1);
+
+  // Work offered while all threads are busy gets a new thread.
+  Promise<bool> started2;
+  Promise<bool> started3;
+  ASSERT_TRUE(pool.Offer(bind(Block, &started2, &release)));
+  ASSERT_TRUE(pool.Offer(bind(Block, &started3, &release)));
+  started2.Get();
+  started3.Get();
+  EXPECT_EQ(pool.num_threads(), 3);
+
+  // Only two of the threads stay idle once the work is done.
+  release.Set(true);
+  ASSERT_TRUE(WaitForNumThreads(&pool, 2));
+  ASSERT_TRUE(WaitForNumIdleThreads(&pool, 2));
+
+  // Idle threads are reused.
+  Promise<bool> started4;
+  Promise<bool> release4;
+  ASSERT_TRUE(pool.Offer(bind(Block, &started4, &release4)));
+  started4.Get();
+  EXPECT_EQ(pool.num_threads(), 2);
+  release4.Set(true);
+}
+
+TEST(DynamicThreadPoolTest, IdleTimeout) {
+  DynamicThreadPool pool("thread-pool", "worker", 2, 10);
+  Promise<bool> started;
+  Promise<bool> release;
+  release.Set(true);
+  ASSERT_TRUE(pool.Offer(bind(Block, &started, &release)));
+  started.Get();
+  EXPECT_TRUE(WaitForNumThreads(&pool, 0));
+}
+
+void Increment(int* counter) {
+  ++*counter;
+}
+
+TEST(ThreadTest, CreatePooled) {
+  int counter = 0;
+  for (int i = 0; i < 10; ++i) {
+    scoped_ptr<Thread> thread(
+        Thread::CreatePooled("thread-pool-test", "increment", bind(Increment, &counter)));
+    EXPECT_GE(thread->tid(), Thread::INVALID_THREAD_ID);
+    thread->Join();
+    // Joining again returns right away, like for threads that are not pooled.
+    thread->Join();
+    EXPECT_EQ(counter, i + 1);
+  }
+}
+
 }
 
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
+  // Makes Thread::CreatePooled() use pooled threads.
+  FLAGS_pooled_threads_max_idle = 2;
   impala::InitCommonRuntime(argc, argv, true, impala::TestInfo::BE_TEST);
   return RUN_ALL_TESTS();
 }
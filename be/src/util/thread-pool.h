@@ -17,6 +17,8 @@
 
 #include "util/blocking-queue.h"
 
+#include <deque>
+#include <map>
 #include <boost/thread/mutex.hpp>
 #include <boost/bind/mem_fn.hpp>
 
@@ -175,6 +177,145 @@ class CallableThreadPool : public ThreadPool<boost::function<void()> > {
   }
 };
 
+/// Thread pool whose number of threads follows the offered work, for callables that may
+/// block for a long time, e.g. on IO or on each other, and that would otherwise each be
+/// run on a new thread. Offer() hands the callable to an idle thread, or starts a new
+/// thread if no thread is idle, so that callables never wait for each other. Threads
+/// that stayed idle for 'idle_timeout_ms' exit, as do threads that become idle while
+/// 'max_idle_threads' other threads are idle, so that bursts of work don't leave many
+/// threads behind.
+class DynamicThreadPool {
+ public:
+  typedef boost::function<void()> WorkFunction;
+
+  DynamicThreadPool(const std::string& group, const std::string& thread_prefix,
+      uint32_t max_idle_threads, int64_t idle_timeout_ms)
+    : group_(group),
+      thread_prefix_(thread_prefix),
+      max_idle_threads_(max_idle_threads),
+      idle_timeout_ms_(idle_timeout_ms),
+      next_thread_id_(0),
+      num_idle_threads_(0),
+      shutdown_(false) {
+  }
+
+  /// Waits for all offered work to be processed and all threads to exit.
+  ~DynamicThreadPool() {
+    boost::unique_lock<boost::mutex> l(lock_);
+    shutdown_ = true;
+    work_cv_.notify_all();
+    while (!threads_.empty()) {
+      if (exited_thread_ids_.empty()) exit_cv_.wait(l);
+      JoinExitedThreads(&l);
+    }
+  }
+
+  /// Runs 'work' on an idle thread of the pool or on a new thread. Returns false if the
+  /// pool is shut down.
+  bool Offer(const WorkFunction& work) {
+    boost::unique_lock<boost::mutex> l(lock_);
+    if (shutdown_) return false;
+    JoinExitedThreads(&l);
+    work_queue_.push_back(work);
+    if (num_idle_threads_ >= work_queue_.size()) {
+      work_cv_.notify_one();
+      return true;
+    }
+    int thread_id = next_thread_id_++;
+    std::stringstream threadname;
+    threadname << thread_prefix_ << "(" << thread_id << ")";
+    // The new thread blocks on lock_ until the thread is added to threads_.
+    threads_[thread_id] = new Thread(group_, threadname.str(),
+        boost::bind<void>(boost::mem_fn(&DynamicThreadPool::WorkerThread), this,
+            thread_id));
+    return true;
+  }
+
+  /// Returns the number of threads of the pool.
+  int num_threads() {
+    boost::lock_guard<boost::mutex> l(lock_);
+    return threads_.size() - exited_thread_ids_.size();
+  }
+
+  /// Returns the number of threads that are waiting for work.
+  int num_idle_threads() {
+    boost::lock_guard<boost::mutex> l(lock_);
+    return num_idle_threads_;
+  }
+
+ private:
+  /// Driver method for each thread. Processes work until the thread times out waiting for
+  /// more work, too many other threads are idle or the pool is shut down.
+  void WorkerThread(int thread_id) {
+    boost::unique_lock<boost::mutex> l(lock_);
+    while (true) {
+      if (work_queue_.empty()) {
+        if (shutdown_ || num_idle_threads_ >= max_idle_threads_) break;
+        ++num_idle_threads_;
+        bool notified = work_cv_.timed_wait(l,
+            boost::posix_time::milliseconds(idle_timeout_ms_));
+        --num_idle_threads_;
+        if (!notified && work_queue_.empty()) break;
+        continue;
+      }
+      WorkFunction work = work_queue_.front();
+      work_queue_.pop_front();
+      l.unlock();
+      work();
+      l.lock();
+    }
+    exited_thread_ids_.push_back(thread_id);
+    exit_cv_.notify_all();
+  }
+
+  /// Joins and frees the threads that exited. Releases 'lock' while joining.
+  void JoinExitedThreads(boost::unique_lock<boost::mutex>* lock) {
+    if (exited_thread_ids_.empty()) return;
+    std::vector<Thread*> exited_threads;
+    for (int thread_id: exited_thread_ids_) {
+      exited_threads.push_back(threads_[thread_id]);
+      threads_.erase(thread_id);
+    }
+    exited_thread_ids_.clear();
+    lock->unlock();
+    for (Thread* thread: exited_threads) {
+      thread->Join();
+      delete thread;
+    }
+    lock->lock();
+  }
+
+  const std::string group_;
+  const std::string thread_prefix_;
+  const uint32_t max_idle_threads_;
+  const int64_t idle_timeout_ms_;
+
+  /// Protects all members below.
+  boost::mutex lock_;
+
+  /// Work that was offered but not yet picked up by a thread, in FIFO order.
+  std::deque<WorkFunction> work_queue_;
+
+  /// Signalled when work is offered or the pool is shut down.
+  boost::condition_variable work_cv_;
+
+  /// Signalled when a thread exits.
+  boost::condition_variable exit_cv_;
+
+  /// All threads that were not joined yet, by their id. Owned.
+  std::map<int, Thread*> threads_;
+
+  /// Ids of the threads that exited and still need to be joined.
+  std::vector<int> exited_thread_ids_;
+
+  int next_thread_id_;
+
+  /// Number of threads waiting on work_cv_.
+  uint32_t num_idle_threads_;
+
+  bool shutdown_;
+};
+
 }
 
 #endif
@@ -16,6 +16,7 @@
 
 #include <set>
 #include <map>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -23,10 +24,12 @@
 #include "util/debug-util.h"
 #include "util/error-util.h"
 #include "util/cgroups-mgr.h"
+#include "util/cpu-info.h"
 #include "util/metrics.h"
 #include "util/webserver.h"
 #include "util/url-coding.h"
 #include "util/os-util.h"
+#include "util/thread-pool.h"
 
 #include "common/names.h"
 
@@ -34,6 +37,14 @@ namespace this_thread = boost::this_thread;
 using boost::ptr_vector;
 using namespace rapidjson;
 
+DEFINE_int32(pooled_threads_max_idle, 0, "(Advanced) Maximum number of idle threads that "
+    "are kept to run the fragment instances, status reports and scanner threads of "
+    "later queries, which then reuse threads instead of starting new ones. If 0, these "
+    "threads are not pooled.");
+DEFINE_int32(pooled_threads_idle_timeout_ms, 60 * 1000, "(Advanced) Pooled threads that "
+    "stayed idle for this many milliseconds exit. Only used if "
+    "--pooled_threads_max_idle is greater than 0.");
+
 namespace impala {
 
 static const string THREADS_WEB_PAGE = "/threadz";
@@ -48,6 +59,18 @@ class ThreadMgr;
 // manager after the destruction can be avoided.
 shared_ptr<ThreadMgr> thread_manager;
 
+// Runs the work of the threads created by Thread::CreatePooled(). NULL if
+// --pooled_threads_max_idle is 0. Never destroyed, since pooled work may still be
+// running when the process exits.
+static DynamicThreadPool* pooled_threads = NULL;
+
+// The cores that the process may run on, read by InitThreading(). Pooled threads are
+// reset to these cores once a ScopedNumaAffinity pinned any thread, i.e. once
+// 'numa_affinity_used' is true, because a pooled thread inherits the affinity of the
+// thread that started it.
+static cpu_set_t process_cores;
+static bool numa_affinity_used = false;
+
 // A singleton class that tracks all live threads, and groups them together for easy
 // auditing. Used only by Thread.
 class ThreadMgr {
@@ -58,13 +81,15 @@ class ThreadMgr {
 
   // Registers a thread to the supplied category. The key is a boost::thread::id, used
   // instead of the system TID since boost::thread::id is always available, unlike
-  // gettid() which might fail.
+  // gettid() which might fail. 'is_pooled_work' is true for the work of a pooled thread,
+  // which is listed under its own category but doesn't count as a new thread.
   void AddThread(const thread::id& thread, const string& name, const string& category,
-      int64_t tid);
+      int64_t tid, bool is_pooled_work = false);
 
   // Removes a thread from the supplied category. If the thread has
   // already been removed, this is a no-op.
-  void RemoveThread(const thread::id& boost_id, const string& category);
+  void RemoveThread(const thread::id& boost_id, const string& category,
+      bool is_pooled_work = false);
 
  private:
   // Container class for any details we want to capture about a thread
@@ -175,21 +200,22 @@ Status ThreadMgr::StartInstrumentation(MetricGroup* metrics, Webserver* webserve
 }
 
 void ThreadMgr::AddThread(const thread::id& thread, const string& name,
-    const string& category, int64_t tid) {
+    const string& category, int64_t tid, bool is_pooled_work) {
   lock_guard<mutex> l(lock_);
   thread_categories_[category][thread] = ThreadDescriptor(category, name, tid);
-  if (metrics_enabled_) {
+  if (metrics_enabled_ && !is_pooled_work) {
     current_num_threads_metric_->Increment(1L);
     total_threads_metric_->Increment(1L);
   }
 }
 
-void ThreadMgr::RemoveThread(const thread::id& boost_id, const string& category) {
+void ThreadMgr::RemoveThread(const thread::id& boost_id, const string& category,
+    bool is_pooled_work) {
   lock_guard<mutex> l(lock_);
   ThreadCategoryMap::iterator category_it = thread_categories_.find(category);
   DCHECK(category_it != thread_categories_.end());
   category_it->second.erase(boost_id);
-  if (metrics_enabled_) current_num_threads_metric_->Increment(-1L);
+  if (metrics_enabled_ && !is_pooled_work) current_num_threads_metric_->Increment(-1L);
 }
 
 void ThreadMgr::ThreadOverviewUrlCallback(const Webserver::ArgumentMap& args,
@@ -262,12 +288,52 @@ void ThreadMgr::ThreadGroupUrlCallback(const Webserver::ArgumentMap& args,
 void InitThreading() {
   DCHECK(thread_manager.get() == NULL);
   thread_manager.reset(new ThreadMgr());
+  if (pthread_getaffinity_np(pthread_self(), sizeof(process_cores), &process_cores)
+      != 0) {
+    CPU_ZERO(&process_cores);
+  }
+  if (FLAGS_pooled_threads_max_idle > 0) {
+    pooled_threads = new DynamicThreadPool("thread-pool", "pooled-thread",
+        FLAGS_pooled_threads_max_idle, FLAGS_pooled_threads_idle_timeout_ms);
+  }
 }
 
 Status StartThreadInstrumentation(MetricGroup* metrics, Webserver* webserver) {
   return thread_manager->StartInstrumentation(metrics, webserver);
 }
 
+Thread* Thread::CreatePooled(const string& category, const string& name,
+    const ThreadFunctor& functor) {
+  Thread* thread = new Thread(category, name);
+  if (pooled_threads == NULL || !thread->StartPooledWork(functor)) {
+    thread->StartThread(functor);
+  }
+  return thread;
+}
+
+void Thread::Join() const {
+  if (thread_.get() != NULL) {
+    thread_->join();
+  } else {
+    pooled_work_done_->Get();
+  }
+}
+
+bool Thread::StartPooledWork(const ThreadFunctor& functor) {
+  DCHECK(tid_ == UNINITIALISED_THREAD_ID) << "StartPooledWork called twice";
+  Promise<int64_t> thread_started;
+  pooled_work_done_.reset(new Promise<bool>());
+  if (!pooled_threads->Offer(bind(&Thread::SupervisePooledWork, name_, category_,
+      functor, &thread_started, pooled_work_done_))) {
+    pooled_work_done_.reset();
+    return false;
+  }
+  tid_ = thread_started.Get();
+  VLOG(2) << "Started pooled work in thread " << tid_ << " - " << category_ << ":"
+          << name_;
+  return true;
+}
+
 void Thread::StartThread(const ThreadFunctor& functor) {
   DCHECK(thread_manager.get() != NULL)
       << "Thread created before InitThreading called";
@@ -316,6 +382,57 @@ void Thread::SuperviseThread(const string& name, const string& category,
   thread_mgr_ref->RemoveThread(this_thread::get_id(), category_copy);
 }
 
+void Thread::SupervisePooledWork(const string& name, const string& category,
+    Thread::ThreadFunctor functor, Promise<int64_t>* thread_started,
+    shared_ptr<Promise<bool> > done) {
+  int64_t system_tid = syscall(SYS_gettid);
+  string category_copy = category.empty() ? "no-category" : category;
+  shared_ptr<ThreadMgr> thread_mgr_ref = thread_manager;
+  stringstream ss;
+  ss << (name.empty() ? "thread" : name) << "-" << system_tid;
+
+  // Register the work under its own name, so that the debug UI shows the pooled thread
+  // as if it had been started for it.
+  thread_mgr_ref->AddThread(this_thread::get_id(), ss.str(), category_copy, system_tid,
+      true);
+  // Like in SuperviseThread(), the parameters passed by pointer may not be referenced
+  // after this point.
+  thread_started->Set(system_tid);
+
+  if (numa_affinity_used && CPU_COUNT(&process_cores) > 0) {
+    pthread_setaffinity_np(pthread_self(), sizeof(process_cores), &process_cores);
+  }
+  functor();
+  thread_mgr_ref->RemoveThread(this_thread::get_id(), category_copy, true);
+  done->Set(true);
+}
+
+ScopedNumaAffinity::ScopedNumaAffinity(int numa_node) : is_pinned_(false) {
+  if (numa_node < 0 || numa_node >= CpuInfo::num_numa_nodes()) return;
+  if (pthread_getaffinity_np(pthread_self(), sizeof(previous_cores_), &previous_cores_)
+      != 0) {
+    return;
+  }
+  cpu_set_t cores;
+  CPU_ZERO(&cores);
+  for (int core: CpuInfo::GetCoresOfNumaNode(numa_node)) CPU_SET(core, &cores);
+  CPU_AND(&cores, &cores, &previous_cores_);
+  if (CPU_COUNT(&cores) == 0 || CPU_EQUAL(&cores, &previous_cores_)) return;
+  numa_affinity_used = true;
+  int ret = pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+  if (ret != 0) {
+    VLOG(2) << "Could not run thread on NUMA node " << numa_node << ": "
+            << GetStrErrMsg(ret);
+    return;
+  }
+  is_pinned_ = true;
+}
+
+ScopedNumaAffinity::~ScopedNumaAffinity() {
+  if (!is_pinned_) return;
+  pthread_setaffinity_np(pthread_self(), sizeof(previous_cores_), &previous_cores_);
+}
+
 Status ThreadGroup::AddThread(Thread* thread) {
   threads_.push_back(thread);
   if (!cgroup_path_.empty()) {
@@ -15,9 +15,11 @@
 #ifndef IMPALA_UTIL_THREAD_H
 #define IMPALA_UTIL_THREAD_H
 
+#include <sched.h>
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 
@@ -97,9 +99,19 @@ class Thread {
     StartThread(boost::bind(f, a1, a2, a3, a4, a5));
   }
 
+  /// Like the constructors, but runs 'functor' on an idle thread of a process-wide pool
+  /// if --pooled_threads_max_idle is greater than 0, which saves starting a new thread.
+  /// The returned object, which the caller owns, can be used like any other Thread.
+  /// The work shows up in the debug UI under 'category' and 'name' while it runs. Use
+  /// this for short-lived threads that are started for every query, but not for
+  /// threads that are assigned to cgroups, since pooled threads are later reused by
+  /// other queries.
+  static Thread* CreatePooled(const std::string& category, const std::string& name,
+      const boost::function<void ()>& functor);
+
   /// Blocks until this thread finishes execution. Once this method returns, the thread
   /// will be unregistered with the ThreadMgr and will not appear in the debug UI.
-  void Join() const { thread_->join(); }
+  void Join() const;
 
   /// The thread ID assigned to this thread by the operating system. If the OS does not
   /// support retrieving the tid, returns Thread::INVALID_THREAD_ID.
@@ -116,9 +128,14 @@ class Thread {
   /// Function object that wraps the user-supplied function to run in a separate thread.
   typedef boost::function<void ()> ThreadFunctor;
 
-  /// The actual thread object that runs the user's method via SuperviseThread().
+  /// The actual thread object that runs the user's method via SuperviseThread(). NULL
+  /// if the method runs on a pooled thread.
   boost::scoped_ptr<boost::thread> thread_;
 
+  /// Set by SupervisePooledWork() once the user's method returned. Only set if the
+  /// method runs on a pooled thread.
+  boost::shared_ptr<Promise<bool> > pooled_work_done_;
+
   /// Name and category for this thread
   const std::string category_;
   const std::string name_;
@@ -154,6 +171,22 @@ class Thread {
   /// exactly once before SuperviseThread() notifies the caller.
   static void SuperviseThread(const std::string& name, const std::string& category,
       ThreadFunctor functor, Promise<int64_t>* thread_started);
+
+  /// Used by CreatePooled().
+  Thread(const std::string& category, const std::string& name)
+      : category_(category), name_(name), tid_(UNINITIALISED_THREAD_ID) {
+  }
+
+  /// Offers the user's method to the pool of threads and returns once a pooled thread
+  /// picked it up and its TID was read. Returns false if the pool is shut down.
+  bool StartPooledWork(const ThreadFunctor& functor);
+
+  /// Wrapper for the user-supplied function on a pooled thread. Like SuperviseThread(),
+  /// but registers the work with the ThreadMgr instead of the thread and sets 'done'
+  /// once the method returned.
+  static void SupervisePooledWork(const std::string& name, const std::string& category,
+      ThreadFunctor functor, Promise<int64_t>* thread_started,
+      boost::shared_ptr<Promise<bool> > done);
 };
 
 /// Utility class to group together a set of threads. A replacement for
@@ -197,6 +230,25 @@ class ThreadGroup {
   std::string cgroup_path_;
 };
 
+/// Runs the calling thread on the cores of NUMA node 'numa_node' while the object is in
+/// scope, and afterwards on the cores it ran on before. Only the cores of the node that
+/// the thread was allowed to run on, e.g. by its cpuset cgroup, are used. Does nothing
+/// if 'numa_node' is negative, i.e. if the work isn't pinned to a node.
+/// Pooled threads drop the affinity that they inherited from the thread that started
+/// them before running the work of a Thread::CreatePooled().
+class ScopedNumaAffinity {
+ public:
+  explicit ScopedNumaAffinity(int numa_node);
+  ~ScopedNumaAffinity();
+
+ private:
+  /// True if the affinity of the thread was changed and must be restored.
+  bool is_pinned_;
+
+  /// The cores that the thread ran on before.
+  cpu_set_t previous_cores_;
+};
+
 /// Initialises the threading subsystem. Must be called before a Thread is created.
 void InitThreading();
 
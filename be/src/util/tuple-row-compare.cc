@@ -14,6 +14,7 @@
 
 #include "util/tuple-row-compare.h"
 
+#include <limits>
 #include <gutil/strings/substitute.h>
 
 #include "codegen/codegen-anyval.h"
@@ -24,7 +25,104 @@ using namespace impala;
 using namespace llvm;
 using namespace strings;
 
+bool TupleRowComparator::SupportsZOrder(const ColumnType& type) {
+  switch (type.type) {
+    case TYPE_BOOLEAN:
+    case TYPE_TINYINT:
+    case TYPE_SMALLINT:
+    case TYPE_INT:
+    case TYPE_BIGINT:
+    case TYPE_FLOAT:
+    case TYPE_DOUBLE:
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint64_t TupleRowComparator::GetZOrderValue(const void* value, int i) const {
+  // NULLs are ordered like the smallest or the largest value.
+  if (value == NULL) {
+    return nulls_first_[i] < 0 ? 0 : std::numeric_limits<uint64_t>::max();
+  }
+  uint64_t result;
+  const ColumnType& type = key_expr_ctxs_lhs_[i]->root()->type();
+  // Flipping the sign bit orders signed integers like unsigned ones. Negative floating
+  // point values are ordered by flipping all bits instead.
+  switch (type.type) {
+    case TYPE_BOOLEAN:
+      result = static_cast<uint64_t>(*reinterpret_cast<const bool*>(value)) << 63;
+      break;
+    case TYPE_TINYINT:
+      result = static_cast<uint64_t>(
+          static_cast<uint8_t>(*reinterpret_cast<const int8_t*>(value)) ^ 0x80) << 56;
+      break;
+    case TYPE_SMALLINT:
+      result = static_cast<uint64_t>(
+          static_cast<uint16_t>(*reinterpret_cast<const int16_t*>(value)) ^ 0x8000) << 48;
+      break;
+    case TYPE_INT:
+      result = static_cast<uint64_t>(static_cast<uint32_t>(
+          *reinterpret_cast<const int32_t*>(value)) ^ 0x80000000U) << 32;
+      break;
+    case TYPE_BIGINT:
+      result = static_cast<uint64_t>(*reinterpret_cast<const int64_t*>(value)) ^
+          (1ULL << 63);
+      break;
+    case TYPE_FLOAT: {
+      uint32_t bits;
+      memcpy(&bits, value, sizeof(bits));
+      bits = (bits & 0x80000000U) != 0 ? ~bits : bits | 0x80000000U;
+      result = static_cast<uint64_t>(bits) << 32;
+      break;
+    }
+    case TYPE_DOUBLE: {
+      uint64_t bits;
+      memcpy(&bits, value, sizeof(bits));
+      result = (bits & (1ULL << 63)) != 0 ? ~bits : bits | (1ULL << 63);
+      break;
+    }
+    case TYPE_STRING:
+    case TYPE_VARCHAR: {
+      const StringValue* sv = reinterpret_cast<const StringValue*>(value);
+      result = 0;
+      for (int j = 0; j < sizeof(result) && j < sv->len; ++j) {
+        result |= static_cast<uint64_t>(static_cast<uint8_t>(sv->ptr[j])) << (56 - 8 * j);
+      }
+      break;
+    }
+    default:
+      DCHECK(false) << type;
+      return 0;
+  }
+  return is_asc_[i] ? result : ~result;
+}
+
+int TupleRowComparator::CompareZOrder(TupleRow* lhs, TupleRow* rhs) const {
+  // The values of the expr whose values differ in the most significant bit decide. If
+  // several differ in the same bit, the first one decides, as if its bits came first.
+  uint64_t max_xor = 0;
+  uint64_t lhs_decisive = 0;
+  uint64_t rhs_decisive = 0;
+  for (int i = 0; i < key_expr_ctxs_lhs_.size(); ++i) {
+    uint64_t lhs_value = GetZOrderValue(key_expr_ctxs_lhs_[i]->GetValue(lhs), i);
+    uint64_t rhs_value = GetZOrderValue(key_expr_ctxs_rhs_[i]->GetValue(rhs), i);
+    uint64_t x = lhs_value ^ rhs_value;
+    // True if the most significant bit of 'x' is higher than the one of 'max_xor'.
+    if (max_xor < x && max_xor < (max_xor ^ x)) {
+      max_xor = x;
+      lhs_decisive = lhs_value;
+      rhs_decisive = rhs_value;
+    }
+  }
+  if (max_xor == 0) return 0;
+  return lhs_decisive < rhs_decisive ? -1 : 1;
+}
+
 Status TupleRowComparator::Codegen(RuntimeState* state) {
+  if (zorder_) return Status("Z-order comparisons are not codegen'd");
   Function* fn;
   RETURN_IF_ERROR(CodegenCompare(state, &fn));
   LlvmCodeGen* codegen;
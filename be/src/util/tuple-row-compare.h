@@ -65,6 +65,7 @@ class TupleRowComparator {
       : key_expr_ctxs_lhs_(sort_key_exprs.lhs_ordering_expr_ctxs()),
         key_expr_ctxs_rhs_(sort_key_exprs.rhs_ordering_expr_ctxs()),
         is_asc_(is_asc),
+        zorder_(false),
         codegend_compare_fn_(NULL) {
     DCHECK_EQ(key_expr_ctxs_lhs_.size(), is_asc.size());
     DCHECK_EQ(key_expr_ctxs_lhs_.size(), nulls_first.size());
@@ -74,24 +75,51 @@ class TupleRowComparator {
     }
   }
 
-  TupleRowComparator(const SortExecExprs& sort_key_exprs, bool is_asc, bool nulls_first)
+  /// If 'zorder' is true, the rows are compared in the Z-order of the values of the
+  /// exprs instead of lexically, see CompareZOrder().
+  TupleRowComparator(const SortExecExprs& sort_key_exprs, bool is_asc, bool nulls_first,
+      bool zorder = false)
       : key_expr_ctxs_lhs_(sort_key_exprs.lhs_ordering_expr_ctxs()),
         key_expr_ctxs_rhs_(sort_key_exprs.rhs_ordering_expr_ctxs()),
         is_asc_(key_expr_ctxs_lhs_.size(), is_asc),
         nulls_first_(key_expr_ctxs_lhs_.size(), nulls_first ? -1 : 1),
+        zorder_(zorder),
         codegend_compare_fn_(NULL) {
   }
 
+  /// Creates a comparator with the sort order and the codegen'd function of
+  /// 'comparator' that evaluates the exprs in 'key_expr_ctxs_lhs' and
+  /// 'key_expr_ctxs_rhs', which are clones of the exprs of 'comparator' (see
+  /// ExprContext::Clone()) for use by another thread. The clones must outlive this
+  /// comparator.
+  TupleRowComparator(const TupleRowComparator& comparator,
+      const std::vector<ExprContext*>& key_expr_ctxs_lhs,
+      const std::vector<ExprContext*>& key_expr_ctxs_rhs)
+      : key_expr_ctxs_lhs_(key_expr_ctxs_lhs),
+        key_expr_ctxs_rhs_(key_expr_ctxs_rhs),
+        is_asc_(comparator.is_asc_),
+        nulls_first_(comparator.nulls_first_),
+        zorder_(comparator.zorder_),
+        codegend_compare_fn_(comparator.codegend_compare_fn_) {
+    DCHECK_EQ(key_expr_ctxs_lhs_.size(), comparator.key_expr_ctxs_lhs_.size());
+    DCHECK_EQ(key_expr_ctxs_rhs_.size(), comparator.key_expr_ctxs_rhs_.size());
+  }
+
   /// Codegens a Compare() function for this comparator that is used in the () operator.
-  /// Returns Status::OK() iff the codegen was successful.
+  /// Returns Status::OK() iff the codegen was successful. Z-order comparisons are not
+  /// codegen'd.
   Status Codegen(RuntimeState* state);
 
+  /// Returns true if all exprs of type 'type' can be compared in Z-order.
+  static bool SupportsZOrder(const ColumnType& type);
+
   /// Returns a negative value if lhs is less than rhs, a positive value if lhs is greater
   /// than rhs, or 0 if they are equal. All exprs (key_exprs_lhs_ and key_exprs_rhs_) must
   /// have been prepared and opened before calling this, i.e. 'sort_key_exprs' in the
   /// constructor must have been opened.
   int Compare(TupleRow* lhs, TupleRow* rhs) const {
     DCHECK_EQ(key_expr_ctxs_lhs_.size(), key_expr_ctxs_rhs_.size());
+    if (zorder_) return CompareZOrder(lhs, rhs);
     for (int i = 0; i < key_expr_ctxs_lhs_.size(); ++i) {
       void* lhs_value = key_expr_ctxs_lhs_[i]->GetValue(lhs);
       void* rhs_value = key_expr_ctxs_rhs_[i]->GetValue(rhs);
@@ -126,11 +154,27 @@ class TupleRowComparator {
     return Less(lhs_row, rhs_row);
   }
 
+  const std::vector<ExprContext*>& key_expr_ctxs_lhs() const {
+    return key_expr_ctxs_lhs_;
+  }
+  const std::vector<ExprContext*>& key_expr_ctxs_rhs() const {
+    return key_expr_ctxs_rhs_;
+  }
+  const std::vector<bool>& is_asc() const { return is_asc_; }
+
+  /// Returns, for each key expr, true if nulls sort before all other values.
+  std::vector<bool> nulls_first() const {
+    std::vector<bool> result;
+    for (int i = 0; i < nulls_first_.size(); ++i) result.push_back(nulls_first_[i] < 0);
+    return result;
+  }
+
  private:
   const std::vector<ExprContext*>& key_expr_ctxs_lhs_;
   const std::vector<ExprContext*>& key_expr_ctxs_rhs_;
   std::vector<bool> is_asc_;
   std::vector<int8_t> nulls_first_;
+  bool zorder_;
 
   /// We store a pointer to the codegen'd function pointer (adding an extra level of
   /// indirection) so that copies of this TupleRowComparator will have the same pointer to
@@ -143,6 +187,20 @@ class TupleRowComparator {
       TupleRow*);
   CompareFn* codegend_compare_fn_;
 
+  /// Implements Compare() for Z-order comparators. The values of the exprs are mapped to
+  /// unsigned 64-bit integers in the same order (see GetZOrderValue()), and the rows are
+  /// ordered as if the bits of these integers were interleaved, most significant bits
+  /// first. Without computing the interleaved bits, this is the order of the integers
+  /// that differ in the most significant bit. Unlike the lexical order, this keeps rows
+  /// with close values of every expr close together, so that the min/max ranges of the
+  /// values of each expr in a run of sorted rows are narrow.
+  int CompareZOrder(TupleRow* lhs, TupleRow* rhs) const;
+
+  /// Returns the unsigned integer that 'value' of expr 'i' is ordered by in Z-order.
+  /// Integers and floating point values are aligned at the most significant bit, strings
+  /// are ordered by their first 8 bytes.
+  uint64_t GetZOrderValue(const void* value, int i) const;
+
   /// Codegen Compare(). Returns a non-OK status if codegen is unsuccessful.
   /// TODO: have codegen'd users inline this instead of calling through the () operator
   Status CodegenCompare(RuntimeState* state, llvm::Function** fn);